@@ -15,6 +15,7 @@
 #include "app/check_update.h"
 #include "app/cli/app_options.h"
 #include "app/cli/cli_processor.h"
+#include "app/cli/cli_server.h"
 #include "app/cli/default_cli_delegate.h"
 #include "app/cli/preview_cli_delegate.h"
 #include "app/color_spaces.h"
@@ -35,11 +36,14 @@
 #include "app/modules/gfx.h"
 #include "app/modules/gui.h"
 #include "app/modules/palettes.h"
+#include "app/perf_counters.h"
+#include "app/perf_trace.h"
 #include "app/pref/preferences.h"
 #include "app/recent_files.h"
 #include "app/resource_finder.h"
 #include "app/send_crash.h"
 #include "app/site.h"
+#include "app/startup_trace.h"
 #include "app/tools/active_tool.h"
 #include "app/tools/tool_box.h"
 #include "app/ui/backup_indicator.h"
@@ -83,6 +87,7 @@
 
 #ifdef ENABLE_SCRIPTING
   #include "app/script/engine.h"
+  #include "app/script/profiler.h"
   #include "app/shell.h"
 #endif
 
@@ -134,6 +139,7 @@ class App::LoadLanguage {
 public:
   LoadLanguage(Preferences& pref,
                Extensions& exts) {
+    StartupTrace span("strings");
     Strings::createInstance(pref, exts);
   }
 };
@@ -281,10 +287,30 @@ int App::initialize(const AppOptions& options)
 #endif
 
   m_isShell = options.startShell();
-  m_coreModules = std::make_unique<CoreModules>();
+
+#ifdef ENABLE_SCRIPTING
+  m_profileScripts = options.profileScripts();
+  if (!m_profileScripts.empty())
+    m_engine->startProfiler();
+#endif
+  if (options.startServer())
+    m_server = std::make_unique<CliServer>(options.exeName());
+  {
+    StartupTrace span("preferences");
+    m_coreModules = std::make_unique<CoreModules>();
+  }
 
   auto& pref = preferences();
 
+  // Trace hot paths for the whole session (--trace) or when the
+  // [perf] trace option is enabled
+  m_perfTraceFile = options.perfTrace();
+  if (!m_perfTraceFile.empty() || pref.perf.trace())
+    PerfTrace::start();
+  m_perfTraceConn = pref.perf.trace.AfterChange.connect(
+    [this]{ onPerfTraceChange(); });
+  m_perfReport = options.perfReport();
+
   os::TabletOptions tabletOptions;
 
 #if LAF_WINDOWS
@@ -348,11 +374,14 @@ int App::initialize(const AppOptions& options)
 #endif
 
   // Load modules
-  m_modules = std::make_unique<Modules>(createLogInDesktop, pref);
-  m_legacy = std::make_unique<LegacyModules>(isGui() ? REQUIRE_INTERFACE: 0);
-#ifdef ENABLE_UI
-  m_brushes = std::make_unique<AppBrushes>();
-#endif
+  {
+    StartupTrace span("modules");
+    m_modules = std::make_unique<Modules>(createLogInDesktop, pref);
+  }
+  {
+    StartupTrace span("legacy modules");
+    m_legacy = std::make_unique<LegacyModules>(isGui() ? REQUIRE_INTERFACE: 0);
+  }
 
   // Data recovery is enabled only in GUI mode
   if (isGui() && pref.general.dataRecovery())
@@ -363,7 +392,10 @@ int App::initialize(const AppOptions& options)
 
   // Load or create the default palette, or migrate the default
   // palette from an old format palette to the new one, etc.
-  load_default_palette();
+  {
+    StartupTrace span("default palette");
+    load_default_palette();
+  }
 
 #ifdef ENABLE_UI
   // Initialize GUI interface
@@ -383,10 +415,13 @@ int App::initialize(const AppOptions& options)
     manager->invalidate();
 
     // Create the main window.
-    m_mainWindow.reset(new MainWindow);
-    m_mainWindow->initialize();
-    if (m_mod)
-      m_mod->modMainWindow(m_mainWindow.get());
+    {
+      StartupTrace span("main window");
+      m_mainWindow.reset(new MainWindow);
+      m_mainWindow->initialize();
+      if (m_mod)
+        m_mod->modMainWindow(m_mainWindow.get());
+    }
 
     // Data recovery is enabled only in GUI mode
     if (pref.general.dataRecovery())
@@ -421,13 +456,17 @@ int App::initialize(const AppOptions& options)
 #ifdef ENABLE_SCRIPTING
   // Call the init() function from all plugins
   LOG("APP: Initializing scripts...\n");
-  extensions().executeInitActions();
+  {
+    StartupTrace span("scripts init");
+    extensions().executeInitActions();
+  }
 #endif
 
   // Process options
   LOG("APP: Processing options...\n");
   int code;
   {
+    StartupTrace span("cli");
     std::unique_ptr<CliDelegate> delegate;
     if (options.previewCLI())
       delegate.reset(new PreviewCliDelegate);
@@ -440,6 +479,11 @@ int App::initialize(const AppOptions& options)
 
   LOG("APP: Finish launching...\n");
   system->finishLaunching();
+
+  // In GUI mode the startup trace finishes with the first paint of
+  // the main window.
+  if (!isGui())
+    StartupTrace::finish();
   return code;
 }
 
@@ -593,6 +637,10 @@ void App::run()
   }
 #endif  // ENABLE_SCRIPTING
 
+  // Process jobs from stdin re-using this same App instance.
+  if (m_server)
+    m_server->run(context(), std::cin, std::cout);
+
   // ----------------------------------------------------------------------
 
 #ifdef ENABLE_SCRIPTING
@@ -626,6 +674,18 @@ App::~App()
     LOG("APP: Exit\n");
     ASSERT(m_instance == this);
 
+    // Save the startup trace if it wasn't saved yet (e.g. the
+    // program was closed before the first paint)
+    StartupTrace::finish();
+
+    // Save the trace of hot paths
+    m_perfTraceConn.disconnect();
+    if (PerfTrace::isEnabled())
+      PerfTrace::stop(perfTraceFilename());
+
+    if (m_perfReport)
+      std::cout << PerfCounters::report() << std::flush;
+
 #ifdef ENABLE_SCRIPTING
     // Destroy scripting engine calling a method (instead of using
     // reset()) because we need to keep the "m_engine" pointer valid
@@ -635,6 +695,13 @@ App::~App()
     // onclose event handler fails with a Lua error when we are
     // closing the app, a Lua error must be printed, and we need a
     // valid m_engine pointer.
+    if (!m_profileScripts.empty()) {
+      m_engine->stopProfiler();
+      if (!m_engine->profiler()->saveFoldedStacks(m_profileScripts))
+        LOG(ERROR, "APP: Cannot write scripts profile to '%s'\n",
+            m_profileScripts.c_str());
+    }
+
     m_engine->destroy();
     m_engine.reset();
 #endif
@@ -767,6 +834,33 @@ crash::DataRecovery* App::dataRecovery() const
   return m_modules->recovery();
 }
 
+void App::onPerfTraceChange()
+{
+  if (preferences().perf.trace()) {
+    if (!PerfTrace::isEnabled())
+      PerfTrace::start();
+  }
+  else if (PerfTrace::isEnabled()) {
+    const std::string fn = perfTraceFilename();
+    if (PerfTrace::stop(fn))
+      LOG("APP: Trace saved in '%s'\n", fn.c_str());
+  }
+}
+
+std::string App::perfTraceFilename() const
+{
+  if (!m_perfTraceFile.empty())
+    return m_perfTraceFile;
+
+  const std::string fn = preferences().perf.traceFile();
+  if (!fn.empty())
+    return fn;
+
+  ResourceFinder rf(false);
+  rf.includeUserDir("trace.json");
+  return rf.getFirstOrCreateDefault();
+}
+
 #ifdef ENABLE_UI
 void App::showNotification(INotificationDelegate* del)
 {
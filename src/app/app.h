@@ -15,6 +15,7 @@
 
 #include "base/paths.h"
 #include "doc/pixel_format.h"
+#include "obs/connection.h"
 #include "obs/signal.h"
 
 #include <memory>
@@ -40,6 +41,7 @@ namespace app {
   class AppMod;
   class AppOptions;
   class BackupIndicator;
+  class CliServer;
   class Context;
   class ContextBar;
   class Doc;
@@ -102,8 +104,11 @@ namespace app {
     crash::DataRecovery* dataRecovery() const;
 
 #ifdef ENABLE_UI
+    // The brushes are loaded on first use (they are not needed in
+    // batch mode).
     AppBrushes& brushes() {
-      ASSERT(m_brushes.get());
+      if (!m_brushes)
+        m_brushes = std::make_unique<AppBrushes>();
       return *m_brushes;
     }
 
@@ -133,6 +138,9 @@ namespace app {
     class LoadLanguage;
     class Modules;
 
+    void onPerfTraceChange();
+    std::string perfTraceFilename() const;
+
     static App* m_instance;
 
     AppMod* m_mod;
@@ -142,6 +150,8 @@ namespace app {
     std::unique_ptr<LegacyModules> m_legacy;
     bool m_isGui;
     bool m_isShell;
+    // Headless server to process jobs (--server option)
+    std::unique_ptr<CliServer> m_server;
 #ifdef ENABLE_STEAM
     bool m_inAppSteam = true;
 #endif
@@ -153,8 +163,17 @@ namespace app {
 #endif // ENABLE_UI
 #ifdef ENABLE_SCRIPTING
     std::unique_ptr<script::Engine> m_engine;
+    // File to save the profile of scripts (--profile-scripts)
+    std::string m_profileScripts;
 #endif
 
+    // File to save the trace of hot paths (--trace), if it's empty
+    // the trace is saved in [perf] trace_file
+    std::string m_perfTraceFile;
+    // Print the performance counters at exit (--perf-report)
+    bool m_perfReport = false;
+    obs::scoped_connection m_perfTraceConn;
+
     // Set the memory dump filename to show in the Preferences dialog
     // or the "send crash" dialog. It's set by the SendCrash class.
     std::string m_memoryDumpFilename;
@@ -0,0 +1,511 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/cels_compressor.h"
+
+#include "app/context.h"
+#include "app/doc.h"
+#include "app/doc_lock_stats.h"
+#include "app/doc_memory.h"
+#include "app/doc_undo.h"
+#include "app/pref/preferences.h"
+#include "app/site.h"
+#include "app/tools/tool_loop_manager.h"
+#include "app/ui_context.h"
+#include "base/buffer.h"
+#include "base/mem_utils.h"
+#include "base/thread.h"
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/images_dedup.h"
+#include "doc/sprite.h"
+#include "ui/system.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#define CELSCOMP_TRACE(...) // TRACEARGS
+
+namespace app {
+
+// Cels in frames near the active frame are never compressed
+static constexpr doc::frame_t kKeepFrames = 4;
+
+// Maximum time to check again the cels
+static constexpr base::tick_t kMaxCheckPeriodMSecs = 60*1000;
+
+// Time to check again the memory budget
+static constexpr base::tick_t kBudgetCheckPeriodMSecs = 5*1000;
+
+// Maximum number of bytes of pixels moved to scratch files in each
+// pass (the pixels are copied with the sprite locked for writing)
+static constexpr std::size_t kMaxMappedBytesPerPass = 256*1024*1024;
+
+CelsCompressor::CelsCompressor(Context* ctx)
+  : m_ctx(ctx)
+  , m_done(false)
+  , m_cancelDoc(nullptr)
+{
+  const Preferences& pref = ctx->preferences();
+  if (pref.experimental.compressInactiveCels())
+    m_compressAfterMSecs = base::tick_t(1000.0*60.0*pref.experimental.compressInactiveCelsAfter());
+  else
+    m_compressAfterMSecs = 0;
+
+  m_memoryBudget = std::size_t(std::max(0, pref.experimental.memoryBudget())) * 1024 * 1024;
+  m_dedupImages = pref.experimental.dedupCelImages();
+  m_mappedPixelsThreshold = std::size_t(std::max(0, pref.experimental.mappedPixelsThreshold())) * 1024 * 1024;
+
+  if (isEnabled())
+    m_ctx->add_observer(this);
+}
+
+CelsCompressor::~CelsCompressor()
+{
+  if (isEnabled())
+    m_ctx->remove_observer(this);
+
+  if (m_thread.joinable()) {
+    CELSCOMP_TRACE("CELSCOMP: Join thread");
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_done = true;
+      m_cv.notify_all();
+    }
+    m_thread.join();
+  }
+}
+
+void CelsCompressor::addDoc(Doc* doc)
+{
+  if (!isEnabled())
+    return;
+
+  CELSCOMP_TRACE("CELSCOMP: Add doc", doc);
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_docs.push_back(DocInfo{ doc, 0 });
+
+  if (!m_thread.joinable())
+    m_thread = std::thread([this]{ backgroundThread(); });
+}
+
+void CelsCompressor::removeDoc(Doc* doc)
+{
+  if (!isEnabled())
+    return;
+
+  CELSCOMP_TRACE("CELSCOMP: Remove doc", doc);
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_docs.erase(
+    std::remove_if(m_docs.begin(), m_docs.end(),
+                   [doc](const DocInfo& info){ return info.doc == doc; }),
+    m_docs.end());
+
+  // Wait the background thread if it's compressing cels of this doc
+  m_cancelDoc = doc;
+  m_cv.wait(lock, [this, doc]{ return m_processingDoc != doc; });
+  m_cancelDoc = nullptr;
+}
+
+void CelsCompressor::onActiveSiteChange(const Site& site)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  for (DocInfo& info : m_docs) {
+    if (info.doc == site.document()) {
+      info.activeFrame = site.frame();
+      break;
+    }
+  }
+}
+
+void CelsCompressor::backgroundThread()
+{
+  CELSCOMP_TRACE("CELSCOMP: [BG] Background thread start");
+
+  base::this_thread::set_name("cels-compressor");
+  DocLockStats::Operation operation("cels-compressor");
+
+  base::tick_t period = kMaxCheckPeriodMSecs;
+  if (m_compressAfterMSecs > 0)
+    period = std::min(period, m_compressAfterMSecs);
+  if (m_memoryBudget > 0)
+    period = std::min(period, kBudgetCheckPeriodMSecs);
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_done) {
+    m_cv.wait_for(lock, std::chrono::milliseconds(period),
+                  [this]{ return m_done.load(); });
+    if (m_done)
+      break;
+
+    // Forget images of closed docs
+    auto isClosed = [this](Doc* doc){
+      return (std::find_if(m_docs.begin(), m_docs.end(),
+                           [doc](const DocInfo& info){ return info.doc == doc; }) == m_docs.end());
+    };
+    for (auto it=m_images.begin(); it!=m_images.end(); ) {
+      if (isClosed(it->first))
+        it = m_images.erase(it);
+      else
+        ++it;
+    }
+    for (auto it=m_dedupSignatures.begin(); it!=m_dedupSignatures.end(); ) {
+      if (isClosed(it->first))
+        it = m_dedupSignatures.erase(it);
+      else
+        ++it;
+    }
+
+    // Avoid doing the work in the middle of a stroke
+    if (tools::ToolLoopManager::isAnyToolLoopActive())
+      continue;
+
+    // Deduplicate images before compressing them (compressed images
+    // aren't compared)
+    if (m_dedupImages) {
+      for (std::size_t i=0; i<m_docs.size() && !m_done; ++i) {
+        Doc* doc = m_docs[i].doc;
+        m_processingDoc = doc;
+        lock.unlock();
+
+        dedupDocImages(doc);
+
+        lock.lock();
+        m_processingDoc = nullptr;
+        m_cv.notify_all();
+      }
+    }
+
+    // Move big images to scratch files before compressing them
+    // (mapped images aren't compressed)
+    if (m_mappedPixelsThreshold > 0) {
+      for (std::size_t i=0; i<m_docs.size() && !m_done; ++i) {
+        Doc* doc = m_docs[i].doc;
+        m_processingDoc = doc;
+        lock.unlock();
+
+        mapDocImages(doc);
+
+        lock.lock();
+        m_processingDoc = nullptr;
+        m_cv.notify_all();
+      }
+    }
+
+    if (m_compressAfterMSecs > 0) {
+      for (std::size_t i=0; i<m_docs.size() && !m_done; ++i) {
+        const DocInfo info = m_docs[i];
+        m_processingDoc = info.doc;
+        lock.unlock();
+
+        compressDocCels(info.doc, info.activeFrame, false);
+
+        lock.lock();
+        m_processingDoc = nullptr;
+        m_cv.notify_all();
+      }
+    }
+
+    if (m_memoryBudget > 0 && !m_done)
+      keepMemoryBudget(lock);
+  }
+
+  CELSCOMP_TRACE("CELSCOMP: [BG] Background thread end");
+}
+
+// Executed from the backgroundThread() with m_mutex locked
+std::size_t CelsCompressor::calcDocsMemoryUsage(std::unique_lock<std::mutex>& lock)
+{
+  std::size_t total = 0;
+  for (std::size_t i=0; i<m_docs.size() && !m_done; ++i) {
+    Doc* doc = m_docs[i].doc;
+    m_processingDoc = doc;
+    lock.unlock();
+
+    auto lockResult = doc->readLock(0);
+    if (lockResult != Doc::LockResult::Fail) {
+      total += calc_doc_memory_usage(doc).total();
+      doc->unlock(lockResult);
+    }
+
+    lock.lock();
+    m_processingDoc = nullptr;
+    m_cv.notify_all();
+  }
+  return total;
+}
+
+// Executed from the backgroundThread() with m_mutex locked
+void CelsCompressor::keepMemoryBudget(std::unique_lock<std::mutex>& lock)
+{
+  std::size_t total = calcDocsMemoryUsage(lock);
+  if (total <= m_memoryBudget)
+    return;
+
+  CELSCOMP_TRACE("CELSCOMP: [BG] Memory usage",
+                 base::get_pretty_memory_size(total),
+                 "exceeds the budget, compressing cels");
+
+  // Compress all inactive cels without waiting
+  for (std::size_t i=0; i<m_docs.size() && !m_done; ++i) {
+    const DocInfo info = m_docs[i];
+    m_processingDoc = info.doc;
+    lock.unlock();
+
+    compressDocCels(info.doc, info.activeFrame, true);
+
+    lock.lock();
+    m_processingDoc = nullptr;
+    m_cv.notify_all();
+  }
+
+  total = calcDocsMemoryUsage(lock);
+  if (total <= m_memoryBudget || m_done)
+    return;
+
+  // Spill old undo states to disk from the UI thread (where the undo
+  // history is modified), starting with the biggest histories.
+  const std::size_t excess = total - m_memoryBudget;
+  ui::execute_from_ui_thread([excess]{
+    auto ctx = UIContext::instance();
+    if (!ctx)
+      return;
+
+    std::vector<DocUndo*> undos;
+    for (Doc* doc : ctx->documents())
+      undos.push_back(doc->undoHistory());
+    std::sort(undos.begin(), undos.end(),
+              [](const DocUndo* a, const DocUndo* b){
+                return a->totalUndoSize() > b->totalUndoSize();
+              });
+
+    std::size_t remaining = excess;
+    for (DocUndo* undo : undos) {
+      if (remaining == 0)
+        break;
+      const std::size_t oldSize = undo->totalUndoSize();
+      undo->spillOldStates(oldSize - std::min(oldSize, remaining));
+      remaining -= std::min(remaining, oldSize - undo->totalUndoSize());
+    }
+  });
+}
+
+// Executed from the backgroundThread() (non-UI thread)
+void CelsCompressor::compressDocCels(Doc* doc,
+                                     const doc::frame_t activeFrame,
+                                     const bool force)
+{
+  struct Item {
+    doc::ImageRef image;
+    doc::ObjectVersion version;
+    base::buffer data;
+  };
+  std::vector<Item> items;
+  Images& images = m_images[doc];
+  Images seenImages;
+  const base::tick_t now = base::current_tick();
+
+  // Compress the pixels with the sprite locked for reading
+  auto lockResult = doc->readLock(0);
+  if (lockResult == Doc::LockResult::Fail) {
+    CELSCOMP_TRACE("CELSCOMP: [BG] Doc", doc, "is locked");
+    return;
+  }
+
+  for (doc::Cel* cel : doc->sprite()->uniqueCels()) {
+    if (m_done || m_cancelDoc == doc)
+      break;
+
+    // Don't load cels that are decoded on demand
+    if (!cel->data()->isImageLoaded() ||
+        std::abs(cel->frame() - activeFrame) <= kKeepFrames)
+      continue;
+
+    const doc::ImageRef image = cel->imageRef();
+    if (image->hasReleasedPixels() ||
+        image->hasMappedPixels())
+      continue;
+
+    // Compress the image only if it wasn't modified in the last
+    // m_compressAfterMSecs (or we are over the memory budget)
+    ImageInfo info = images[image->id()];
+    if (info.version != image->version() || info.timestamp == 0) {
+      info.version = image->version();
+      info.timestamp = now;
+    }
+    seenImages[image->id()] = info;
+    if (!force && now - info.timestamp < m_compressAfterMSecs)
+      continue;
+
+    Item item;
+    item.image = image;
+    item.version = image->version();
+    image->compressPixels(item.data);
+    items.push_back(std::move(item));
+  }
+  doc->unlock(lockResult);
+  images = std::move(seenImages);
+
+  if (items.empty())
+    return;
+
+  // Release the pixels with the sprite locked for writing (no other
+  // thread can be using them)
+  lockResult = doc->writeLock(100);
+  if (lockResult == Doc::LockResult::Fail) {
+    CELSCOMP_TRACE("CELSCOMP: [BG] Doc", doc, "is locked for writing");
+    return;
+  }
+
+  for (Item& item : items) {
+    // Skip images modified in the meantime (images with pixels
+    // pinned by a DocFrameSnapshot are skipped by releasePixels())
+    if (item.image->version() == item.version)
+      item.image->releasePixels(std::move(item.data));
+  }
+  doc->unlock(lockResult);
+
+  CELSCOMP_TRACE("CELSCOMP: [BG] Released pixels of", items.size(), "images");
+}
+
+// Executed from the backgroundThread() (non-UI thread)
+void CelsCompressor::dedupDocImages(Doc* doc)
+{
+  struct Item {
+    doc::DuplicatedImage dup;
+    doc::ObjectVersion imageVersion;
+    doc::ObjectVersion originalVersion;
+  };
+  std::vector<Item> items;
+
+  // Compare the images with the sprite locked for reading
+  auto lockResult = doc->readLock(0);
+  if (lockResult == Doc::LockResult::Fail) {
+    CELSCOMP_TRACE("CELSCOMP: [BG] Doc", doc, "is locked");
+    return;
+  }
+
+  std::vector<doc::ImageRef> images;
+  uint64_t signature = 0;
+  for (doc::Cel* cel : doc->sprite()->uniqueCels()) {
+    if (m_done || m_cancelDoc == doc)
+      break;
+
+    // Don't load cels that are decoded on demand
+    if (!cel->data()->isImageLoaded())
+      continue;
+
+    const doc::ImageRef image = cel->imageRef();
+    signature = signature*31 + ((uint64_t(image->id()) << 32) | image->version());
+    images.push_back(image);
+  }
+
+  // Compare the images again only if something has changed
+  uint64_t& lastSignature = m_dedupSignatures[doc];
+  if (signature != lastSignature && !m_done && m_cancelDoc != doc) {
+    lastSignature = signature;
+    for (auto& dup : doc::find_duplicated_images(images))
+      items.push_back(Item{ dup, dup.image->version(), dup.original->version() });
+  }
+  doc->unlock(lockResult);
+
+  if (items.empty())
+    return;
+
+  // Share the pixels with the sprite locked for writing
+  lockResult = doc->writeLock(100);
+  if (lockResult == Doc::LockResult::Fail) {
+    CELSCOMP_TRACE("CELSCOMP: [BG] Doc", doc, "is locked for writing");
+    // Try again in the next pass
+    m_dedupSignatures[doc] = 0;
+    return;
+  }
+
+  for (Item& item : items) {
+    // Skip images modified in the meantime
+    if (item.dup.image->version() == item.imageVersion &&
+        item.dup.original->version() == item.originalVersion)
+      item.dup.image->sharePixelsWith(item.dup.original.get());
+  }
+  doc->unlock(lockResult);
+
+  CELSCOMP_TRACE("CELSCOMP: [BG] Deduplicated", items.size(), "images");
+}
+
+// Executed from the backgroundThread() (non-UI thread)
+void CelsCompressor::mapDocImages(Doc* doc)
+{
+  struct Item {
+    doc::ImageRef image;
+    doc::ObjectVersion version;
+  };
+  std::vector<Item> items;
+
+  // Find big images with the sprite locked for reading
+  auto lockResult = doc->readLock(0);
+  if (lockResult == Doc::LockResult::Fail) {
+    CELSCOMP_TRACE("CELSCOMP: [BG] Doc", doc, "is locked");
+    return;
+  }
+
+  if (doc->mappedPixels()) {
+    std::size_t bytes = 0;
+    for (doc::Cel* cel : doc->sprite()->uniqueCels()) {
+      if (m_done || m_cancelDoc == doc ||
+          bytes >= kMaxMappedBytesPerPass)
+        break;
+
+      // Don't load cels that are decoded on demand
+      if (!cel->data()->isImageLoaded())
+        continue;
+
+      const doc::ImageRef image = cel->imageRef();
+      if (image->hasReleasedPixels() ||
+          image->hasMappedPixels())
+        continue;
+
+      const std::size_t size = image->getMemSize();
+      if (size < m_mappedPixelsThreshold)
+        continue;
+
+      items.push_back(Item{ image, image->version() });
+      bytes += size;
+    }
+  }
+  doc->unlock(lockResult);
+
+  if (items.empty())
+    return;
+
+  // Move the pixels with the sprite locked for writing (no other
+  // thread can be using them)
+  lockResult = doc->writeLock(100);
+  if (lockResult == Doc::LockResult::Fail) {
+    CELSCOMP_TRACE("CELSCOMP: [BG] Doc", doc, "is locked for writing");
+    return;
+  }
+
+  int mapped = 0;
+  for (Item& item : items) {
+    if (m_done || m_cancelDoc == doc)
+      break;
+    // Skip images modified in the meantime
+    if (item.image->version() == item.version &&
+        item.image->mapPixels())
+      ++mapped;
+  }
+  doc->unlock(lockResult);
+
+  CELSCOMP_TRACE("CELSCOMP: [BG] Mapped pixels of", mapped, "images");
+}
+
+} // namespace app
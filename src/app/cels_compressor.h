@@ -0,0 +1,103 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_CELS_COMPRESSOR_H_INCLUDED
+#define APP_CELS_COMPRESSOR_H_INCLUDED
+#pragma once
+
+#include "app/context_observer.h"
+#include "base/time.h"
+#include "doc/frame.h"
+#include "doc/object_id.h"
+#include "doc/object_version.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace app {
+
+  class Context;
+  class Doc;
+
+  // Memory-saving mode (experimental.compress_inactive_cels option):
+  // a background thread compresses the images of cels that are far
+  // from the active frame and weren't modified in the last X
+  // minutes, releasing their pixels (see doc::Image::releasePixels()).
+  // The pixels are decompressed again the next time they are used.
+  //
+  // The same thread keeps all documents inside the memory budget
+  // (experimental.memory_budget option): when they use more memory,
+  // the inactive cels are compressed without waiting, and old undo
+  // states are spilled to disk.
+  //
+  // It can also make unlinked cels with the same pixels share their
+  // pixels (experimental.dedup_cel_images option), and move the pixels
+  // of big images to scratch files in documents with the out-of-core
+  // mode enabled (experimental.mapped_pixels_threshold option, see
+  // Doc::mappedPixels()).
+  class CelsCompressor : public ContextObserver {
+  public:
+    CelsCompressor(Context* ctx);
+    ~CelsCompressor();
+
+    void addDoc(Doc* doc);
+    void removeDoc(Doc* doc);
+
+  private:
+    // ContextObserver impl
+    void onActiveSiteChange(const Site& site) override;
+
+    bool isEnabled() const {
+      return (m_compressAfterMSecs > 0 || m_memoryBudget > 0 || m_dedupImages ||
+              m_mappedPixelsThreshold > 0);
+    }
+
+    void backgroundThread();
+    void compressDocCels(Doc* doc, doc::frame_t activeFrame, bool force);
+    void dedupDocImages(Doc* doc);
+    void mapDocImages(Doc* doc);
+    std::size_t calcDocsMemoryUsage(std::unique_lock<std::mutex>& lock);
+    void keepMemoryBudget(std::unique_lock<std::mutex>& lock);
+
+    struct DocInfo {
+      Doc* doc;
+      doc::frame_t activeFrame;
+    };
+
+    // Last version of each image, and when it was seen for the
+    // first time with that version
+    struct ImageInfo {
+      doc::ObjectVersion version = 0;
+      base::tick_t timestamp = 0;
+    };
+    using Images = std::map<doc::ObjectId, ImageInfo>;
+
+    Context* m_ctx;
+    base::tick_t m_compressAfterMSecs;
+    std::size_t m_memoryBudget;
+    bool m_dedupImages;
+    std::size_t m_mappedPixelsThreshold;
+    std::atomic<bool> m_done;
+    std::atomic<Doc*> m_cancelDoc;
+    std::vector<DocInfo> m_docs;
+    Doc* m_processingDoc = nullptr;
+    std::map<Doc*, Images> m_images; // Used only in the background thread
+    // Signature of the images of each doc in the last dedup pass
+    // (used only in the background thread)
+    std::map<Doc*, uint64_t> m_dedupSignatures;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::thread m_thread;
+  };
+
+} // namespace app
+
+#endif
@@ -13,6 +13,7 @@
 
 #include "base/fs.h"
 
+#include <cstdlib>
 #include <iostream>
 
 namespace app {
@@ -21,16 +22,21 @@ AppOptions::AppOptions(int argc, const char* argv[])
   : m_exeName(base::get_file_name(argv[0]))
   , m_startUI(true)
   , m_startShell(false)
+  , m_startServer(false)
   , m_previewCLI(false)
   , m_showHelp(false)
   , m_showVersion(false)
   , m_verboseLevel(kNoVerbose)
+  , m_perfReport(false)
 #ifdef ENABLE_SCRIPTING
   , m_shell(m_po.add("shell").description("Start an interactive console to execute scripts"))
 #endif
   , m_batch(m_po.add("batch").mnemonic('b').description("Do not start the UI"))
+  , m_server(m_po.add("server").description("Start a headless server that processes\njobs from stdin (one command line per\nline), without starting the program\nagain for each job"))
   , m_preview(m_po.add("preview").mnemonic('p').description("Do not execute actions, just print what will be\ndone"))
   , m_saveAs(m_po.add("save-as").requiresValue("<filename>").description("Save the last given sprite with other format"))
+  , m_noUndo(m_po.add("no-undo").description("Don't keep undo information of the\nchanges made by the next commands and\nscripts (saves memory in batch mode)"))
+  , m_jobs(m_po.add("jobs").requiresValue("<n>").description("Number of input files to load in parallel\nin batch mode"))
   , m_palette(m_po.add("palette").requiresValue("<filename>").description("Change the palette of the last given sprite"))
   , m_scale(m_po.add("scale").requiresValue("<factor>").description("Resize all previously opened sprites"))
   , m_ditheringAlgorithm(m_po.add("dithering-algorithm").requiresValue("<algorithm>").description("Dithering algorithm used in --color-mode\nto convert images from RGB to Indexed\n  none\n  ordered\n  old"))
@@ -38,10 +44,13 @@ AppOptions::AppOptions(int argc, const char* argv[])
   , m_colorMode(m_po.add("color-mode").requiresValue("<mode>").description("Change color mode of all previously\nopened sprites:\n  rgb\n  grayscale\n  indexed"))
   , m_shrinkTo(m_po.add("shrink-to").requiresValue("width,height").description("Shrink each sprite if it is\nlarger than width or height"))
   , m_data(m_po.add("data").requiresValue("<filename.json>").description("File to store the sprite sheet metadata"))
-  , m_format(m_po.add("format").requiresValue("<format>").description("Format to export the data file\n(json-hash, json-array)"))
+  , m_format(m_po.add("format").requiresValue("<format>").description("Format to export the data file\n(json-hash, json-array, binary)"))
+  , m_dataCompact(m_po.add("data-compact").description("Remove the whitespace from the JSON data file"))
   , m_sheet(m_po.add("sheet").requiresValue("<filename.png>").description("Image file to save the texture"))
   , m_sheetType(m_po.add("sheet-type").requiresValue("<type>").description("Algorithm to create the sprite sheet:\n  horizontal\n  vertical\n  rows\n  columns\n  packed"))
   , m_sheetPack(m_po.add("sheet-pack").description("Same as -sheet-type packed"))
+  , m_sheetPackMethod(m_po.add("sheet-pack-method").requiresValue("<method>").description("Algorithm to pack sprites with -sheet-type packed:\n  best-fit\n  maxrects\n  skyline"))
+  , m_sheetCache(m_po.add("sheet-cache").requiresValue("<filename>").description("File to re-use the unchanged sprites\nfrom the previous --sheet export"))
   , m_sheetWidth(m_po.add("sheet-width").requiresValue("<pixels>").description("Sprite sheet width"))
   , m_sheetHeight(m_po.add("sheet-height").requiresValue("<pixels>").description("Sprite sheet height"))
   , m_sheetColumns(m_po.add("sheet-columns").requiresValue("<columns>").description("Fixed # of columns for -sheet-type rows"))
@@ -57,6 +66,7 @@ AppOptions::AppOptions(int argc, const char* argv[])
   , m_playSubtags(m_po.add("play-subtags").description("Play subtags and repeats when saving the frames of an animated sprite"))
   , m_frameRange(m_po.add("frame-range").requiresValue("from,to").description("Only export frames in the [from,to] range"))
   , m_ignoreEmpty(m_po.add("ignore-empty").description("Do not export empty frames/cels"))
+  , m_compression(m_po.add("compression").requiresValue("<level>").description("Compression level for --save-as .aseprite files\n  fast\n  default\n  max"))
   , m_mergeDuplicates(m_po.add("merge-duplicates").description("Merge all duplicate frames into one in the sprite sheet"))
   , m_borderPadding(m_po.add("border-padding").requiresValue("<value>").description("Add padding on the texture borders"))
   , m_shapePadding(m_po.add("shape-padding").requiresValue("<value>").description("Add padding between frames"))
@@ -79,8 +89,15 @@ AppOptions::AppOptions(int argc, const char* argv[])
   , m_listSlices(m_po.add("list-slices").description("List slices of the next given sprite\nor include slices in JSON data"))
   , m_oneFrame(m_po.add("oneframe").description("Load just the first frame"))
   , m_exportTileset(m_po.add("export-tileset").description("Export only tilesets from visible tilemap layers"))
+  , m_compare(m_po.add("compare").requiresValue("<filename>").description("Compare the last given sprite with other file\nExit code is 1 if they are different"))
   , m_verbose(m_po.add("verbose").mnemonic('v').description("Explain what is being done"))
   , m_debug(m_po.add("debug").description("Extreme verbose mode and\ncopy log to desktop"))
+  , m_traceStartupOpt(m_po.add("trace-startup").requiresValue("<filename.json>").description("Save the time of each startup phase\nin Chrome trace-event format"))
+  , m_perfTraceOpt(m_po.add("trace").requiresValue("<filename.json>").description("Save the time spent in hot paths (rendering,\nfiles, filters, scripts, etc.) in Chrome\ntrace-event format"))
+  , m_perfReportOpt(m_po.add("perf-report").description("Print the performance counters (pixels\ncomposited, bytes compressed, etc.) at exit"))
+#ifdef ENABLE_SCRIPTING
+  , m_profileScriptsOpt(m_po.add("profile-scripts").requiresValue("<filename.txt>").description("Profile Lua scripts and save the time of\neach call stack in the folded format\nused by flame graph tools"))
+#endif
 #ifdef ENABLE_STEAM
   , m_noInApp(m_po.add("noinapp").description("Disable \"in game\" visibility on Steam\nDoesn't count playtime"))
 #endif
@@ -101,11 +118,28 @@ AppOptions::AppOptions(int argc, const char* argv[])
 #ifdef ENABLE_SCRIPTING
     m_startShell = m_po.enabled(m_shell);
 #endif
+    m_startServer = m_po.enabled(m_server);
+
+    if (m_po.enabled(m_traceStartupOpt))
+      m_traceStartup = m_po.value_of(m_traceStartupOpt);
+    else if (const char* env = std::getenv("ASEPRITE_TRACE_STARTUP"))
+      m_traceStartup = env;
+
+    if (m_po.enabled(m_perfTraceOpt))
+      m_perfTrace = m_po.value_of(m_perfTraceOpt);
+    m_perfReport = m_po.enabled(m_perfReportOpt);
+
+#ifdef ENABLE_SCRIPTING
+    if (m_po.enabled(m_profileScriptsOpt))
+      m_profileScripts = m_po.value_of(m_profileScriptsOpt);
+#endif
+
     m_previewCLI = m_po.enabled(m_preview);
     m_showHelp = m_po.enabled(m_help);
     m_showVersion = m_po.enabled(m_version);
 
     if (m_startShell ||
+        m_startServer ||
         m_showHelp ||
         m_showVersion ||
         m_po.enabled(m_batch)) {
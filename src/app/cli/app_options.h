@@ -36,17 +36,31 @@ public:
 
   bool startUI() const { return m_startUI; }
   bool startShell() const { return m_startShell; }
+  bool startServer() const { return m_startServer; }
   bool previewCLI() const { return m_previewCLI; }
   bool showHelp() const { return m_showHelp; }
   bool showVersion() const { return m_showVersion; }
   VerboseLevel verboseLevel() const { return m_verboseLevel; }
 
+  // File to save the startup trace (--trace-startup option or
+  // ASEPRITE_TRACE_STARTUP environment variable)
+  const std::string& traceStartup() const { return m_traceStartup; }
+  // File to save the trace of hot paths (--trace option)
+  const std::string& perfTrace() const { return m_perfTrace; }
+  // Print the performance counters at exit (--perf-report option)
+  bool perfReport() const { return m_perfReport; }
+#ifdef ENABLE_SCRIPTING
+  const std::string& profileScripts() const { return m_profileScripts; }
+#endif
+
   const ValueList& values() const {
     return m_po.values();
   }
 
   // Export options
   const Option& saveAs() const { return m_saveAs; }
+  const Option& noUndo() const { return m_noUndo; }
+  const Option& jobs() const { return m_jobs; }
   const Option& palette() const { return m_palette; }
   const Option& scale() const { return m_scale; }
   const Option& ditheringAlgorithm() const { return m_ditheringAlgorithm; }
@@ -55,9 +69,12 @@ public:
   const Option& shrinkTo() const { return m_shrinkTo; }
   const Option& data() const { return m_data; }
   const Option& format() const { return m_format; }
+  const Option& dataCompact() const { return m_dataCompact; }
   const Option& sheet() const { return m_sheet; }
   const Option& sheetType() const { return m_sheetType; }
   const Option& sheetPack() const { return m_sheetPack; }
+  const Option& sheetPackMethod() const { return m_sheetPackMethod; }
+  const Option& sheetCache() const { return m_sheetCache; }
   const Option& sheetWidth() const { return m_sheetWidth; }
   const Option& sheetHeight() const { return m_sheetHeight; }
   const Option& sheetColumns() const { return m_sheetColumns; }
@@ -73,6 +90,7 @@ public:
   const Option& playSubtags() const { return m_playSubtags; }
   const Option& frameRange() const { return m_frameRange; }
   const Option& ignoreEmpty() const { return m_ignoreEmpty; }
+  const Option& compression() const { return m_compression; }
   const Option& mergeDuplicates() const { return m_mergeDuplicates; }
   const Option& borderPadding() const { return m_borderPadding; }
   const Option& shapePadding() const { return m_shapePadding; }
@@ -95,6 +113,7 @@ public:
   const Option& listSlices() const { return m_listSlices; }
   const Option& oneFrame() const { return m_oneFrame; }
   const Option& exportTileset() const { return m_exportTileset; }
+  const Option& compare() const { return m_compare; }
 
   bool hasExporterParams() const;
 #ifdef ENABLE_STEAM
@@ -111,17 +130,27 @@ private:
   base::ProgramOptions m_po;
   bool m_startUI;
   bool m_startShell;
+  bool m_startServer;
   bool m_previewCLI;
   bool m_showHelp;
   bool m_showVersion;
   VerboseLevel m_verboseLevel;
+  std::string m_traceStartup;
+  std::string m_perfTrace;
+  bool m_perfReport;
+#ifdef ENABLE_SCRIPTING
+  std::string m_profileScripts;
+#endif
 
 #ifdef ENABLE_SCRIPTING
   Option& m_shell;
 #endif
   Option& m_batch;
+  Option& m_server;
   Option& m_preview;
   Option& m_saveAs;
+  Option& m_noUndo;
+  Option& m_jobs;
   Option& m_palette;
   Option& m_scale;
   Option& m_ditheringAlgorithm;
@@ -130,9 +159,12 @@ private:
   Option& m_shrinkTo;
   Option& m_data;
   Option& m_format;
+  Option& m_dataCompact;
   Option& m_sheet;
   Option& m_sheetType;
   Option& m_sheetPack;
+  Option& m_sheetPackMethod;
+  Option& m_sheetCache;
   Option& m_sheetWidth;
   Option& m_sheetHeight;
   Option& m_sheetColumns;
@@ -148,6 +180,7 @@ private:
   Option& m_playSubtags;
   Option& m_frameRange;
   Option& m_ignoreEmpty;
+  Option& m_compression;
   Option& m_mergeDuplicates;
   Option& m_borderPadding;
   Option& m_shapePadding;
@@ -170,9 +203,16 @@ private:
   Option& m_listSlices;
   Option& m_oneFrame;
   Option& m_exportTileset;
+  Option& m_compare;
 
   Option& m_verbose;
   Option& m_debug;
+  Option& m_traceStartupOpt;
+  Option& m_perfTraceOpt;
+  Option& m_perfReportOpt;
+#ifdef ENABLE_SCRIPTING
+  Option& m_profileScriptsOpt;
+#endif
 #ifdef ENABLE_STEAM
   Option& m_noInApp;
 #endif
@@ -0,0 +1,177 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/app.h"
+#include "app/cli/app_options.h"
+#include "app/cli/cli_processor.h"
+#include "app/cli/default_cli_delegate.h"
+#include "app/context.h"
+#include "app/doc.h"
+#include "base/fs.h"
+#include "base/string.h"
+#include "os/system.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// Startup and open file benchmarks in headless (batch) mode:
+//
+// * BM_AppInitialize: time to initialize and close the App. The
+//   first initialization of the process (cold, which loads fonts,
+//   palettes, extensions, etc. from disk the first time) is reported
+//   in the "cold_ms" counter, the benchmark itself measures the next
+//   initializations (warm).
+// * BM_OpenFile/<file>: time to open each file of the corpus through
+//   the CliProcessor (as "aseprite -b <file>" does).
+//
+// The corpus is the list of directories/files given in the command
+// line (or the ASEPRITE_BENCHMARK_FILES directory), e.g.:
+//
+//   cli_benchmark tests/sprites
+//
+// Each benchmark is repeated to report the p50/p90/p99 percentiles
+// of the iteration times.
+
+using namespace app;
+
+namespace {
+
+constexpr int kRepetitions = 20;
+
+double percentile(const std::vector<double>& v, const double p)
+{
+  if (v.empty())
+    return 0.0;
+  std::vector<double> sorted = v;
+  std::sort(sorted.begin(), sorted.end());
+  const auto i = std::size_t(p * (sorted.size() - 1) + 0.5);
+  return sorted[std::min(i, sorted.size() - 1)];
+}
+
+benchmark::internal::Benchmark* add_percentiles(benchmark::internal::Benchmark* bm)
+{
+  return bm
+    ->Repetitions(kRepetitions)
+    ->ComputeStatistics("p50", [](const std::vector<double>& v) { return percentile(v, 0.50); })
+    ->ComputeStatistics("p90", [](const std::vector<double>& v) { return percentile(v, 0.90); })
+    ->ComputeStatistics("p99", [](const std::vector<double>& v) { return percentile(v, 0.99); })
+    ->ReportAggregatesOnly(true)
+    ->Unit(benchmark::kMillisecond);
+}
+
+double g_coldMSecs = 0.0;
+
+void initialize_and_close_app(const char* argv0)
+{
+  App app;
+  const char* argv[] = { argv0, "-b" };
+  app.initialize(AppOptions(2, argv));
+  app.close();
+}
+
+void BM_AppInitialize(benchmark::State& state, const char* argv0)
+{
+  for (auto _ : state)
+    initialize_and_close_app(argv0);
+
+  state.counters["cold_ms"] = g_coldMSecs;
+}
+
+void BM_OpenFile(benchmark::State& state,
+                 const char* argv0,
+                 const std::string& filename)
+{
+  App app;
+  {
+    const char* argv[] = { argv0, "-b" };
+    app.initialize(AppOptions(2, argv));
+  }
+  Context* ctx = app.context();
+
+  const char* argv[] = { argv0, "-b", filename.c_str() };
+  const AppOptions options(3, argv);
+  DefaultCliDelegate delegate;
+
+  for (auto _ : state) {
+    CliProcessor cli(&delegate, options);
+    if (cli.process(ctx) != 0 || ctx->documents().empty()) {
+      state.SkipWithError("Error opening the file");
+      break;
+    }
+
+    state.PauseTiming();
+    while (!ctx->documents().empty()) {
+      Doc* doc = ctx->documents().back();
+      doc->close();
+      ctx->closeDocument(doc);
+    }
+    state.ResumeTiming();
+  }
+
+  state.counters["file_size"] = double(base::file_size(filename));
+  app.close();
+}
+
+void add_corpus_files(const std::string& path,
+                      std::vector<std::string>& files)
+{
+  if (base::is_directory(path)) {
+    for (const std::string& fn : base::list_files(path))
+      add_corpus_files(base::join_path(path, fn), files);
+  }
+  else if (base::is_file(path)) {
+    const std::string ext = base::string_to_lower(base::get_file_extension(path));
+    if (ext == "ase" || ext == "aseprite")
+      files.push_back(path);
+  }
+}
+
+} // anonymous namespace
+
+int app_main(int argc, char* argv[])
+{
+  os::SystemRef system(os::make_system());
+
+  ::benchmark::Initialize(&argc, argv);
+
+  // Remaining arguments are the corpus
+  std::vector<std::string> files;
+  for (int i=1; i<argc; ++i)
+    add_corpus_files(argv[i], files);
+  if (argc == 1) {
+    if (const char* dir = std::getenv("ASEPRITE_BENCHMARK_FILES"))
+      add_corpus_files(dir, files);
+  }
+
+  // Cold initialization (first one in this process)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    initialize_and_close_app(argv[0]);
+    g_coldMSecs = std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - start).count();
+  }
+
+  add_percentiles(
+    benchmark::RegisterBenchmark("BM_AppInitialize", BM_AppInitialize, argv[0]));
+
+  for (const std::string& fn : files) {
+    add_percentiles(
+      benchmark::RegisterBenchmark(
+        ("BM_OpenFile/" + base::get_file_title(fn)).c_str(),
+        BM_OpenFile, argv[0], fn));
+  }
+
+  return ::benchmark::RunSpecifiedBenchmarks();
+}
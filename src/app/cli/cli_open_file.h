@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2016-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -27,6 +27,7 @@ namespace app {
     std::string tagnameFormat;
     std::string tag;
     std::string slice;
+    std::string compression;
     std::vector<std::string> includeLayers;
     std::vector<std::string> excludeLayers;
     doc::frame_t fromFrame = -1;
@@ -0,0 +1,140 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/cli/cli_preload_files.h"
+
+#include "app/console.h"
+#include "app/context.h"
+#include "app/doc.h"
+#include "app/file/file.h"
+#include "base/fs.h"
+
+#include <algorithm>
+
+namespace app {
+
+CliPreloadFiles::CliPreloadFiles(Context* ctx,
+                                 const base::paths& filenames,
+                                 const int jobs)
+  : m_ctx(ctx)
+  , m_jobs(std::max(1, jobs))
+  , m_pool(m_jobs)
+{
+  for (const auto& fn : filenames)
+    m_items.push_back(Item{ fn });
+
+  startUntil(m_jobs-1);
+}
+
+CliPreloadFiles::~CliPreloadFiles()
+{
+  // Stop the files that are still loading and delete the documents
+  // that weren't used.
+  for (auto& item : m_items) {
+    if (item.fop)
+      item.fop->stop();
+  }
+  m_pool.wait_all();
+
+  for (auto& item : m_items) {
+    if (item.fop)
+      delete item.fop->releaseDocument();
+  }
+}
+
+bool CliPreloadFiles::open(Context* ctx, const std::string& filename)
+{
+  auto it = std::find_if(m_items.begin(), m_items.end(),
+                         [&filename](const Item& item){
+                           return (item.filename == filename);
+                         });
+  if (it == m_items.end())
+    return false;
+
+  const int index = int(it - m_items.begin());
+
+  // Keep the next files loading while we use this one
+  startUntil(index + m_jobs);
+
+  std::unique_ptr<FileOp> fop = std::move(it->fop);
+  if (!fop)
+    return false;
+
+  {
+    std::unique_lock lock(m_mutex);
+    m_doneCv.wait(lock, [&fop]{ return fop->isDone(); });
+  }
+
+  // Same post-load processing of OpenFileCommand
+  fop->postLoad();
+
+  if (fop->hasError() && !fop->isStop()) {
+    Console console;
+    console.printf(fop->error().c_str());
+  }
+
+  m_usedFiles.clear();
+  for (const auto& fn : fop->filenames())
+    m_usedFiles.push_back(base::normalize_path(fn));
+
+  Doc* doc = fop->releaseDocument();
+  if (doc)
+    doc->setContext(ctx);
+  return true;
+}
+
+void CliPreloadFiles::startUntil(const int index)
+{
+  const int n = std::min(index+1, int(m_items.size()));
+  for (int i=0; i<n; ++i) {
+    Item& item = m_items[i];
+    if (item.started)
+      continue;
+
+    item.started = true;
+
+    // Use the same flags of the OpenFileCommand in batch mode
+    std::unique_ptr<FileOp> fop(
+      FileOp::createLoadDocumentOperation(
+        m_ctx, item.filename,
+        FILE_LOAD_DATA_FILE |
+        FILE_LOAD_CREATE_PALETTE |
+        FILE_LOAD_SEQUENCE_ASK));
+
+    // Errors and sequences of files are handled by the
+    // OpenFileCommand when the file is opened.
+    if (!fop || fop->hasError() || fop->filenames().size() > 1)
+      continue;
+
+    FileOp* fopPtr = fop.get();
+    item.fop = std::move(fop);
+
+    m_pool.execute(
+      [this, fopPtr]{
+        try {
+          fopPtr->operate(nullptr);
+        }
+        catch (const std::exception& e) {
+          fopPtr->setError("Error loading file:\n%s", e.what());
+        }
+
+        if (fopPtr->isStop() && fopPtr->document())
+          delete fopPtr->releaseDocument();
+
+        {
+          const std::lock_guard lock(m_mutex);
+          fopPtr->done();
+        }
+        m_doneCv.notify_all();
+      });
+  }
+}
+
+} // namespace app
@@ -0,0 +1,64 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_CLI_CLI_PRELOAD_FILES_H_INCLUDED
+#define APP_CLI_CLI_PRELOAD_FILES_H_INCLUDED
+#pragma once
+
+#include "base/paths.h"
+#include "base/thread_pool.h"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace app {
+
+  class Context;
+  class FileOp;
+
+  // Loads the input files of the CLI in worker threads (--jobs
+  // option) so the next files are decoded while the previous ones
+  // are being processed. The documents are added to the context
+  // from the main thread in the same order of the command line, so
+  // the output (and errors) are the same as loading them one by one.
+  class CliPreloadFiles {
+  public:
+    CliPreloadFiles(Context* ctx,
+                    const base::paths& filenames,
+                    const int jobs);
+    ~CliPreloadFiles();
+
+    // Adds the preloaded document of the given file to the context.
+    // Returns false if the file wasn't preloaded (e.g. it's a
+    // sequence of files) and must be opened as usual.
+    bool open(Context* ctx, const std::string& filename);
+
+    const base::paths& usedFiles() const { return m_usedFiles; }
+
+  private:
+    struct Item {
+      std::string filename;
+      std::unique_ptr<FileOp> fop;
+      bool started = false;
+    };
+
+    void startUntil(const int index);
+
+    Context* m_ctx;
+    int m_jobs;
+    std::vector<Item> m_items;
+    base::paths m_usedFiles;
+    std::mutex m_mutex;
+    std::condition_variable m_doneCv;
+    base::thread_pool m_pool;
+  };
+
+} // namespace app
+
+#endif
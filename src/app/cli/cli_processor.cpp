@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -140,6 +140,16 @@ std::string convert_filter_to_layer_path_if_possible(
     return filter;
 }
 
+// The CLI never undoes the --scale, --color-mode, or --shrink-to
+// changes, so in batch mode we can discard the undo history (and the
+// copies of the original images) after each command. In this way
+// only one version of each sprite is kept in memory.
+void discard_undo_history(Context* ctx, Doc* doc)
+{
+  if (!ctx->isUIAvailable())
+    doc->undoHistory()->clearUndo();
+}
+
 } // anonymous namespace
 
 // static
@@ -182,6 +192,8 @@ CliProcessor::CliProcessor(CliDelegate* delegate,
 
 int CliProcessor::process(Context* ctx)
 {
+  int exitCode = 0;
+
   // --help
   if (m_options.showHelp()) {
     m_delegate->showHelp(m_options);
@@ -199,16 +211,45 @@ int CliProcessor::process(Context* ctx)
     CliOpenFile cof;
     SpriteSheetType sheetType = SpriteSheetType::None;
     Doc* lastDoc = nullptr;
+    bool sameDocs = true;
     render::DitheringAlgorithm ditheringAlgorithm = render::DitheringAlgorithm::None;
     std::string ditheringMatrix;
 
+    // --jobs <n>
+    //
+    // Loading the documents is the only part that can run in
+    // parallel (commands and scripts work with the context from the
+    // main thread), so we decode the next input files in worker
+    // threads while the previous ones are processed.
+    if (!ctx->isUIAvailable() && !m_options.previewCLI()) {
+      int jobs = 1;
+      base::paths filenames;
+      for (const auto& value : m_options.values()) {
+        if (value.option() == &m_options.jobs())
+          jobs = base::convert_to<int>(value.value());
+        else if (!value.option())
+          filenames.push_back(base::normalize_path(value.value()));
+      }
+      if (jobs > 1 && filenames.size() > 1)
+        m_preload = std::make_unique<CliPreloadFiles>(ctx, filenames, jobs);
+    }
+
     for (const auto& value : m_options.values()) {
       const AppOptions::Option* opt = value.option();
 
       // Special options/commands
       if (opt) {
+        // --jobs <n>
+        if (opt == &m_options.jobs()) {
+          // Already used to create m_preload
+        }
+        // --no-undo
+        else if (opt == &m_options.noUndo()) {
+          if (!ctx->isUIAvailable())
+            ctx->setUndoEnabled(false);
+        }
         // --data <file.json>
-        if (opt == &m_options.data()) {
+        else if (opt == &m_options.data()) {
           if (m_exporter)
             m_exporter->setDataFilename(value.value());
         }
@@ -221,10 +262,17 @@ int CliProcessor::process(Context* ctx)
               format = SpriteSheetDataFormat::JsonHash;
             else if (value.value() == "json-array")
               format = SpriteSheetDataFormat::JsonArray;
+            else if (value.value() == "binary")
+              format = SpriteSheetDataFormat::Binary;
 
             m_exporter->setDataFormat(format);
           }
         }
+        // --data-compact
+        else if (opt == &m_options.dataCompact()) {
+          if (m_exporter)
+            m_exporter->setDataCompact(true);
+        }
         // --sheet <file.png>
         else if (opt == &m_options.sheet()) {
           if (m_exporter)
@@ -267,6 +315,23 @@ int CliProcessor::process(Context* ctx)
         else if (opt == &m_options.sheetPack()) {
           sheetType = SpriteSheetType::Packed;
         }
+        // --sheet-pack-method <method>
+        else if (opt == &m_options.sheetPackMethod()) {
+          sheetType = SpriteSheetType::Packed;
+          if (m_exporter) {
+            if (value.value() == "best-fit")
+              m_exporter->setPackMethod(SpriteSheetPackMethod::BestFit);
+            else if (value.value() == "maxrects")
+              m_exporter->setPackMethod(SpriteSheetPackMethod::MaxRects);
+            else if (value.value() == "skyline")
+              m_exporter->setPackMethod(SpriteSheetPackMethod::Skyline);
+          }
+        }
+        // --sheet-cache <filename>
+        else if (opt == &m_options.sheetCache()) {
+          if (m_exporter)
+            m_exporter->setCacheFilename(value.value());
+        }
         // --split-layers
         else if (opt == &m_options.splitLayers()) {
           cof.splitLayers = true;
@@ -325,6 +390,10 @@ int CliProcessor::process(Context* ctx)
           if (m_exporter)
             m_exporter->setIgnoreEmptyCels(true);
         }
+        // --compression <level>
+        else if (opt == &m_options.compression()) {
+          cof.compression = value.value();
+        }
         // --merge-duplicates
         else if (opt == &m_options.mergeDuplicates()) {
           if (m_exporter)
@@ -463,6 +532,7 @@ int CliProcessor::process(Context* ctx)
             ctx->setActiveDocument(doc);
             ctx->executeCommand(Commands::instance()->byId(CommandId::SpriteSize()),
                                 params);
+            discard_undo_history(ctx, doc);
           }
         }
         // --dithering-algorithm <algorithm>
@@ -525,6 +595,7 @@ int CliProcessor::process(Context* ctx)
           for (auto doc : ctx->documents()) {
             ctx->setActiveDocument(doc);
             ctx->executeCommand(command, params);
+            discard_undo_history(ctx, doc);
           }
         }
         // --shrink-to <width,height>
@@ -551,6 +622,7 @@ int CliProcessor::process(Context* ctx)
               params.set("scale", base::convert_to<std::string>(scale).c_str());
               ctx->executeCommand(Commands::instance()->byId(CommandId::SpriteSize()),
                                   params);
+              discard_undo_history(ctx, doc);
             }
           }
         }
@@ -616,6 +688,15 @@ int CliProcessor::process(Context* ctx)
         else if (opt == &m_options.exportTileset()) {
           cof.exportTileset = true;
         }
+        // --compare <filename>
+        else if (opt == &m_options.compare()) {
+          if (lastDoc) {
+            if (!m_delegate->compareFile(ctx, lastDoc, value.value()))
+              sameDocs = false;
+          }
+          else
+            console.printf("A document is needed before --compare argument\n");
+        }
       }
       // File names aren't associated to any option
       else {
@@ -641,6 +722,12 @@ int CliProcessor::process(Context* ctx)
       m_delegate->exportFiles(ctx, *m_exporter.get());
       m_exporter.reset(nullptr);
     }
+
+    m_preload.reset();
+
+    // --compare returns 1 if some document was different
+    if (!sameDocs)
+      exitCode = 1;
   }
 
   // Running mode
@@ -653,7 +740,7 @@ int CliProcessor::process(Context* ctx)
   else {
     m_delegate->batchMode();
   }
-  return 0;
+  return exitCode;
 }
 
 bool CliProcessor::openFile(Context* ctx, CliOpenFile& cof)
@@ -662,13 +749,32 @@ bool CliProcessor::openFile(Context* ctx, CliOpenFile& cof)
 
   Doc* oldDoc = ctx->activeDocument();
 
-  m_batch.open(ctx,
-               cof.filename,
-               cof.oneFrame);
+  // With --frame-range we can load only the cels of the given
+  // frames when we're exporting (and the range is not relative to a
+  // tag, as we don't know the tags before loading the file).
+  const bool loadFrameRange =
+    (m_exporter &&
+     cof.hasFrameRange() &&
+     !cof.hasTag() &&
+     !cof.splitTags);
+
+  // --oneframe and --frame-range need a different load operation
+  // than the preloaded one
+  const bool preloaded =
+    (m_preload && !cof.oneFrame && !loadFrameRange &&
+     m_preload->open(ctx, cof.filename));
+  if (!preloaded) {
+    m_batch.open(ctx,
+                 cof.filename,
+                 cof.oneFrame,
+                 (loadFrameRange ? cof.fromFrame: -1),
+                 (loadFrameRange ? cof.toFrame: -1));
+  }
 
   // Mark used file names as "already processed" so we don't try to
   // open then again
-  for (const auto& usedFn : m_batch.usedFiles()) {
+  for (const auto& usedFn : (preloaded ? m_preload->usedFiles():
+                                         m_batch.usedFiles())) {
     auto fn = base::normalize_path(usedFn);
     m_usedFiles.insert(fn);
 
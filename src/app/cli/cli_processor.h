@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2016-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -11,6 +11,7 @@
 
 #include "app/cli/cli_delegate.h"
 #include "app/cli/cli_open_file.h"
+#include "app/cli/cli_preload_files.h"
 #include "app/doc_exporter.h"
 #include "app/util/open_batch.h"
 #include "doc/selected_layers.h"
@@ -65,6 +66,9 @@ namespace app {
     // load a sequence of files) so we don't ask for them again.
     std::set<std::string> m_usedFiles;
     OpenBatchOfFiles m_batch;
+
+    // Input files loaded in worker threads (--jobs option)
+    std::unique_ptr<CliPreloadFiles> m_preload;
   };
 
 } // namespace app
@@ -0,0 +1,122 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/cli/cli_server.h"
+
+#include "app/cli/app_options.h"
+#include "app/cli/cli_processor.h"
+#include "app/cli/default_cli_delegate.h"
+#include "app/console.h"
+#include "app/context.h"
+#include "app/doc.h"
+
+#include <iostream>
+#include <vector>
+
+namespace app {
+
+CliServer::CliServer(const std::string& exeName)
+  : m_exeName(exeName)
+{
+}
+
+void CliServer::run(Context* ctx, std::istream& is, std::ostream& os)
+{
+  LOG("APP: Server mode, waiting jobs...\n");
+
+  std::string line;
+  while (std::getline(is, line)) {
+    std::vector<std::string> args = SplitArgs(line);
+    if (args.empty())
+      continue;
+
+    if (args.size() == 1 && args[0] == "exit")
+      break;
+
+    const int code = processJob(ctx, args);
+    closeDocs(ctx);
+
+    // Each job starts with the undo enabled (--no-undo is per job)
+    ctx->setUndoEnabled(true);
+
+    os << "END " << code << std::endl;
+  }
+}
+
+int CliServer::processJob(Context* ctx,
+                          const std::vector<std::string>& args)
+{
+  std::vector<const char*> argv;
+  argv.push_back(m_exeName.c_str());
+  for (const auto& arg : args)
+    argv.push_back(arg.c_str());
+
+  try {
+    AppOptions options(int(argv.size()), argv.data());
+    DefaultCliDelegate delegate;
+    CliProcessor cli(&delegate, options);
+    return cli.process(ctx);
+  }
+  catch (const std::exception& ex) {
+    Console::showException(ex);
+    return -1;
+  }
+}
+
+// Closes all documents opened by the last job (same as the CloseAllDocs
+// helper used at exit in App::run()).
+void CliServer::closeDocs(Context* ctx)
+{
+  std::vector<Doc*> docs;
+  for (Doc* doc : ctx->documents())
+    docs.push_back(doc);
+  for (Doc* doc : docs) {
+    doc->close();
+    delete doc;
+  }
+}
+
+// static
+std::vector<std::string> CliServer::SplitArgs(const std::string& line)
+{
+  std::vector<std::string> args;
+  std::string arg;
+  bool inArg = false;
+  bool inQuotes = false;
+
+  for (std::size_t i=0; i<line.size(); ++i) {
+    const char chr = line[i];
+    if (chr == '\\' && i+1 < line.size() &&
+        (line[i+1] == '"' || line[i+1] == '\\')) {
+      arg.push_back(line[++i]);
+      inArg = true;
+    }
+    else if (chr == '"') {
+      inQuotes = !inQuotes;
+      inArg = true;
+    }
+    else if (!inQuotes && (chr == ' ' || chr == '\t' || chr == '\r')) {
+      if (inArg) {
+        args.push_back(arg);
+        arg.clear();
+        inArg = false;
+      }
+    }
+    else {
+      arg.push_back(chr);
+      inArg = true;
+    }
+  }
+  if (inArg)
+    args.push_back(arg);
+  return args;
+}
+
+} // namespace app
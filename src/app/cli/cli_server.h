@@ -0,0 +1,48 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_CLI_CLI_SERVER_H_INCLUDED
+#define APP_CLI_CLI_SERVER_H_INCLUDED
+#pragma once
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace app {
+
+  class Context;
+
+  // Headless server mode (--server option). Reads jobs from the
+  // given input stream, one per line, each one with the same
+  // arguments of the command line (e.g. "a.ase --scale 2 --save-as
+  // b.png" or "--script file.lua"). All jobs re-use the same App
+  // (preferences, extensions, script engine, etc.), so the startup
+  // time is paid only once.
+  //
+  // After each job, the documents opened by the job are closed and
+  // the line "END <code>" is written to the output stream (the exit
+  // code of the job, 0 if it was successful).
+  class CliServer {
+  public:
+    CliServer(const std::string& exeName);
+
+    void run(Context* ctx, std::istream& is, std::ostream& os);
+
+    // Splits a job line in arguments, double quotes can be used to
+    // include spaces in one argument and backslash to escape quotes.
+    static std::vector<std::string> SplitArgs(const std::string& line);
+
+  private:
+    int processJob(Context* ctx, const std::vector<std::string>& args);
+    void closeDocs(Context* ctx);
+
+    std::string m_exeName;
+  };
+
+} // namespace app
+
+#endif
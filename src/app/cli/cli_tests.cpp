@@ -9,6 +9,7 @@
 
 #include "app/cli/app_options.h"
 #include "app/cli/cli_processor.h"
+#include "app/cli/cli_server.h"
 #include "app/doc_exporter.h"
 
 #include <initializer_list>
@@ -93,3 +94,17 @@ TEST(Cli, Version)
   p.process(nullptr);
   EXPECT_TRUE(d.versionWasShown());
 }
+
+TEST(Cli, ServerSplitArgs)
+{
+  using Args = std::vector<std::string>;
+
+  EXPECT_EQ(Args(), CliServer::SplitArgs(""));
+  EXPECT_EQ(Args(), CliServer::SplitArgs("   "));
+  EXPECT_EQ(Args({ "a.ase", "--save-as", "b.png" }),
+            CliServer::SplitArgs("a.ase  --save-as b.png\r"));
+  EXPECT_EQ(Args({ "my file.ase", "--script-param", "name=a \"b\"" }),
+            CliServer::SplitArgs("\"my file.ase\" --script-param \"name=a \\\"b\\\"\""));
+  EXPECT_EQ(Args({ "", "c:\\dir\\" }),
+            CliServer::SplitArgs("\"\" c:\\dir\\\\"));
+}
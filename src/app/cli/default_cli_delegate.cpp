@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2016-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -17,7 +17,9 @@
 #include "app/commands/params.h"
 #include "app/console.h"
 #include "app/doc.h"
+#include "app/doc_diff.h"
 #include "app/doc_exporter.h"
+#include "app/file/file.h"
 #include "app/file/palette_file.h"
 #include "app/ui_context.h"
 #include "base/convert_to.h"
@@ -106,6 +108,9 @@ void DefaultCliDelegate::saveFile(Context* ctx, const CliOpenFile& cof)
   if (cof.ignoreEmpty)
     params.set("ignoreEmpty", "true");
 
+  if (!cof.compression.empty())
+    params.set("compression", cof.compression.c_str());
+
   ctx->executeCommand(saveAsCommand, params);
 }
 
@@ -126,6 +131,31 @@ void DefaultCliDelegate::loadPalette(Context* ctx,
   }
 }
 
+bool DefaultCliDelegate::compareFile(Context* ctx,
+                                     const Doc* doc,
+                                     const std::string& filename)
+{
+  std::unique_ptr<Doc> other(load_document(ctx, filename));
+  if (!other) {
+    Console().printf("Error loading file in --compare '%s'\n",
+                     filename.c_str());
+    return false;
+  }
+
+  const DocDiff diff = compare_docs(doc, other.get());
+  if (!diff.anything)
+    return true;
+
+  std::cout << "'" << doc->filename() << "' and '"
+            << filename << "' are different:";
+  for_each_doc_diff_field(diff, [](const char* name, const bool value){
+    if (value && std::string(name) != "anything")
+      std::cout << ' ' << name;
+  });
+  std::cout << '\n';
+  return false;
+}
+
 void DefaultCliDelegate::exportFiles(Context* ctx, DocExporter& exporter)
 {
   LOG("APP: Exporting sheet...\n");
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2016-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -112,6 +112,10 @@ void PreviewCliDelegate::saveFile(Context* ctx, const CliOpenFile& cof)
     std::cout << "  - Ignore empty frames\n";
   }
 
+  if (!cof.compression.empty()) {
+    std::cout << "  - Compression: " << cof.compression << "\n";
+  }
+
   std::cout << "  - Size: "
             << cof.document->sprite()->width() << "x"
             << cof.document->sprite()->height() << "\n";
@@ -180,6 +184,16 @@ void PreviewCliDelegate::loadPalette(Context* ctx,
             << "  - Palette: '" << filename << "'\n";
 }
 
+bool PreviewCliDelegate::compareFile(Context* ctx,
+                                     const Doc* doc,
+                                     const std::string& filename)
+{
+  std::cout << "- Compare:\n"
+            << "  - Sprite: '" << doc->filename() << "'\n"
+            << "  - File: '" << filename << "'\n";
+  return true;
+}
+
 void PreviewCliDelegate::exportFiles(Context* ctx, DocExporter& exporter)
 {
   std::string type = "None";
@@ -196,6 +210,16 @@ void PreviewCliDelegate::exportFiles(Context* ctx, DocExporter& exporter)
             << "  - Type: " << type << "\n"
             << "  - Size: " << size.w << "x" << size.h << "\n";
 
+  if (exporter.spriteSheetType() == SpriteSheetType::Packed) {
+    std::string method = "Best Fit";
+    switch (exporter.packMethod()) {
+      case SpriteSheetPackMethod::BestFit:  method = "Best Fit"; break;
+      case SpriteSheetPackMethod::MaxRects: method = "MaxRects"; break;
+      case SpriteSheetPackMethod::Skyline:  method = "Skyline";  break;
+    }
+    std::cout << "  - Pack method: " << method << "\n";
+  }
+
   if (!exporter.textureFilename().empty()) {
     std::cout << "  - Save texture file: '"
               << exporter.textureFilename() << "'\n";
@@ -206,6 +230,7 @@ void PreviewCliDelegate::exportFiles(Context* ctx, DocExporter& exporter)
     switch (exporter.dataFormat()) {
       case SpriteSheetDataFormat::JsonHash: format = "JSON Hash"; break;
       case SpriteSheetDataFormat::JsonArray: format = "JSON Array"; break;
+      case SpriteSheetDataFormat::Binary: format = "Binary"; break;
     }
     std::cout << "  - Save data file: '" << exporter.dataFilename() << "'\n"
               << "  - Data format: " << format << "\n";
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -9,17 +9,95 @@
 #endif
 
 #include "app/closed_docs.h"
+
+#include "app/crash/read_document.h"
+#include "app/crash/write_document.h"
 #include "app/doc.h"
 #include "app/pref/preferences.h"
+#include "base/fs.h"
+#include "base/log.h"
+#include "base/process.h"
 #include "base/thread.h"
+#include "doc/sprite.h"
+#include "fmt/format.h"
 
 #include <algorithm>
+#include <atomic>
 #include <limits>
 
 #define CLOSEDOC_TRACE(...) // TRACEARGS
 
 namespace app {
 
+namespace {
+
+// Closed docs that use more memory than this are stored on disk
+constexpr int kMinMemSizeToStore = 32*1024*1024;
+
+std::atomic<int> g_storedDocs(0);
+
+bool should_store_doc(const Doc* doc)
+{
+  return (doc->sprite()->getMemSize() >= kMinMemSizeToStore);
+}
+
+void remove_stored_doc(const std::string& dir)
+{
+  try {
+    for (const auto& fn : base::list_files(dir))
+      base::delete_file(base::join_path(dir, fn));
+    base::remove_directory(dir);
+  }
+  catch (const std::exception& ex) {
+    LOG(ERROR, "CLOSEDOC: Cannot remove %s: %s\n", dir.c_str(), ex.what());
+  }
+}
+
+// Writes the document in a new temporary directory with the same
+// serializer used for the crash backups (images are compressed).
+bool store_doc(Doc* doc, std::string& dir)
+{
+  dir = base::join_path(
+    base::get_temp_path(),
+    fmt::format("aseprite-closed-{}-{}",
+                base::get_current_process_id(),
+                ++g_storedDocs));
+
+  bool result = false;
+  try {
+    base::make_directory(dir);
+
+    const Doc::LockResult lockResult = doc->readLock(0);
+    if (lockResult != Doc::LockResult::Fail) {
+      result = crash::write_full_document(dir, doc, nullptr);
+      doc->unlock(lockResult);
+    }
+  }
+  catch (const std::exception& ex) {
+    LOG(ERROR, "CLOSEDOC: Cannot store doc in %s: %s\n", dir.c_str(), ex.what());
+  }
+
+  if (!result)
+    remove_stored_doc(dir);
+  return result;
+}
+
+Doc* restore_doc(const std::string& dir, const bool modified)
+{
+  Doc* doc = crash::read_document(dir, nullptr);
+  if (doc) {
+    if (!modified)
+      doc->markAsSaved();
+  }
+  else {
+    LOG(ERROR, "CLOSEDOC: Cannot restore doc from %s\n", dir.c_str());
+  }
+  remove_stored_doc(dir);
+  return doc;
+}
+
+} // anonymous namespace
+
 ClosedDocs::ClosedDocs(const Preferences& pref)
   : m_done(false)
 {
@@ -87,15 +165,24 @@ void ClosedDocs::addClosedDoc(Doc* doc)
 
 Doc* ClosedDocs::reopenLastClosedDoc()
 {
-  Doc* doc = nullptr;
+  ClosedDoc closedDoc = { nullptr, 0 };
   {
     std::unique_lock<std::mutex> lock(m_mutex);
+    // Wait the background thread if it's storing the doc
+    m_cv.wait(lock, [this]{
+      return (m_docs.empty() || m_docs.front().state != State::Storing);
+    });
     if (!m_docs.empty()) {
-      doc = m_docs.front().doc;
+      closedDoc = m_docs.front();
       m_docs.erase(m_docs.begin());
     }
-    CLOSEDOC_TRACE(" -> ", doc);
+    CLOSEDOC_TRACE(" -> ", closedDoc.doc);
   }
+
+  Doc* doc = closedDoc.doc;
+  if (closedDoc.state == State::Stored)
+    doc = restore_doc(closedDoc.dir, closedDoc.modified);
+
   CLOSEDOC_TRACE("CLOSEDOC: Reopen last closed doc", doc);
   return doc;
 }
@@ -105,12 +192,22 @@ std::vector<Doc*> ClosedDocs::getAndRemoveAllClosedDocs()
   std::vector<Doc*> docs;
   {
     std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this]{
+      return std::none_of(m_docs.begin(), m_docs.end(),
+                          [](const ClosedDoc& closedDoc) {
+                            return closedDoc.state == State::Storing;
+                          });
+    });
     CLOSEDOC_TRACE("CLOSEDOC: Get and remove all closed", m_docs.size(), "docs");
-    for (const ClosedDoc& closedDoc : m_docs)
-      docs.push_back(closedDoc.doc);
+    for (const ClosedDoc& closedDoc : m_docs) {
+      if (closedDoc.state == State::Stored)
+        remove_stored_doc(closedDoc.dir);
+      else
+        docs.push_back(closedDoc.doc);
+    }
     m_docs.clear();
     m_done = true;
-    m_cv.notify_one();
+    m_cv.notify_all();
   }
   return docs;
 }
@@ -125,23 +222,35 @@ void ClosedDocs::backgroundThread()
   while (!m_done) {
     base::tick_t now = base::current_tick();
     base::tick_t waitForMSecs = std::numeric_limits<base::tick_t>::max();
+    Doc* docToStore = nullptr;
 
     for (auto it=m_docs.begin(); it != m_docs.end(); ) {
-      const ClosedDoc& closedDoc = *it;
+      ClosedDoc& closedDoc = *it;
       auto doc = closedDoc.doc;
 
+      const bool canDelete =
+        (// If the doc is already stored on disk
+         closedDoc.state == State::Stored ||
+         // If we backup process is disabled
+         m_dataRecoveryPeriodMSecs == 0 ||
+         // Or this document doesn't need a backup (e.g. an unmodified document)
+         !doc->needsBackup() ||
+         // Or the document already has the backup done
+         doc->isFullyBackedUp());
+
       base::tick_t diff = now - closedDoc.timestamp;
       if (diff >= m_keepClosedDocAliveForMSecs) {
-        if (// If we backup process is disabled
-            m_dataRecoveryPeriodMSecs == 0 ||
-            // Or this document doesn't need a backup (e.g. an unmodified document)
-            !doc->needsBackup() ||
-            // Or the document already has the backup done
-            doc->isFullyBackedUp()) {
-          // Finally delete the document (this is the place where we
-          // delete all documents created/loaded by the user)
-          CLOSEDOC_TRACE("CLOSEDOC: [BG] Delete doc", doc);
-          delete doc;
+        if (canDelete) {
+          if (closedDoc.state == State::Stored) {
+            CLOSEDOC_TRACE("CLOSEDOC: [BG] Delete stored doc", closedDoc.dir);
+            remove_stored_doc(closedDoc.dir);
+          }
+          else {
+            // Finally delete the document (this is the place where we
+            // delete all documents created/loaded by the user)
+            CLOSEDOC_TRACE("CLOSEDOC: [BG] Delete doc", doc);
+            delete doc;
+          }
           it = m_docs.erase(it);
         }
         else {
@@ -150,11 +259,56 @@ void ClosedDocs::backgroundThread()
         }
       }
       else {
+        // Big documents are stored on disk as soon as they can be
+        // deleted from memory
+        if (closedDoc.state == State::InMemory && should_store_doc(doc)) {
+          if (canDelete) {
+            if (!docToStore)
+              docToStore = doc;
+          }
+          else {
+            waitForMSecs = std::min(waitForMSecs, m_dataRecoveryPeriodMSecs);
+          }
+        }
         waitForMSecs = std::min(waitForMSecs, m_keepClosedDocAliveForMSecs-diff);
         ++it;
       }
     }
 
+    if (docToStore) {
+      auto findDoc = [this, docToStore]{
+        return std::find_if(m_docs.begin(), m_docs.end(),
+                            [docToStore](const ClosedDoc& closedDoc) {
+                              return closedDoc.doc == docToStore;
+                            });
+      };
+      findDoc()->state = State::Storing;
+
+      // Store the doc without locking the list (the entry cannot be
+      // removed while its state is State::Storing)
+      std::string dir;
+      const bool modified = docToStore->isModified();
+      lock.unlock();
+      CLOSEDOC_TRACE("CLOSEDOC: [BG] Store doc", docToStore);
+      const bool stored = store_doc(docToStore, dir);
+      lock.lock();
+
+      auto it = findDoc();
+      ASSERT(it != m_docs.end());
+      if (stored) {
+        it->state = State::Stored;
+        it->doc = nullptr;
+        it->dir = dir;
+        it->modified = modified;
+        delete docToStore;
+      }
+      else {
+        it->state = State::CannotBeStored;
+      }
+      m_cv.notify_all();
+      continue;
+    }
+
     if (waitForMSecs < std::numeric_limits<base::tick_t>::max()) {
       CLOSEDOC_TRACE("CLOSEDOC: [BG] Wait for", waitForMSecs, "milliseconds");
 
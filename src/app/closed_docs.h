@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -13,6 +13,7 @@
 #include <atomic>
 #include <condition_variable>
 #include <mutex>
+#include <string>
 #include <thread>
 #include <vector>
 
@@ -29,6 +30,10 @@ namespace app {
   //   garbage collector).
   // * If the document was not restore, we delete it from memory, if
   //   the document was restore, we remove it from the m_docs.
+  // * Big documents are stored in a temporary directory (using the
+  //   compressed format of the crash backups) and deleted from
+  //   memory as soon as they don't need a backup. They are loaded
+  //   again when they are reopened (without their undo history).
   class ClosedDocs {
   public:
     ClosedDocs(const Preferences& pref);
@@ -45,9 +50,19 @@ namespace app {
   private:
     void backgroundThread();
 
+    enum class State {
+      InMemory,
+      Storing,          // The background thread is storing the doc
+      Stored,           // The doc is stored in "dir" (doc == nullptr)
+      CannotBeStored,
+    };
+
     struct ClosedDoc {
       Doc* doc;
       base::tick_t timestamp;
+      State state = State::InMemory;
+      std::string dir;
+      bool modified = false;    // Modified state of the stored doc
     };
 
     std::atomic<bool> m_done;
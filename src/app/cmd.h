@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -16,6 +17,7 @@
 namespace app {
 
   class Context;
+  class UndoSpillFile;
 
   class Cmd : public undo::UndoCommand {
   public:
@@ -32,6 +34,11 @@ namespace app {
     std::string label() const;
     size_t memSize() const;
 
+    // Moves big buffers of this command (e.g. image pixels) to the
+    // given file to reduce the memory used by the undo history. The
+    // data is loaded again when the command is undone/redone.
+    void spill(UndoSpillFile* file);
+
     Context* context() const { return m_ctx; }
 
   protected:
@@ -41,6 +48,7 @@ namespace app {
     virtual void onFireNotifications();
     virtual std::string onLabel() const;
     virtual size_t onMemSize() const;
+    virtual void onSpill(UndoSpillFile* file);
 
   private:
     Context* m_ctx;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2021  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -13,19 +13,28 @@
 #include "app/cmd/assign_color_profile.h"
 #include "app/cmd/replace_image.h"
 #include "app/cmd/set_palette.h"
+#include "app/color_space_lut.h"
 #include "app/doc.h"
+#include "base/thread_pool.h"
 #include "doc/cels_range.h"
 #include "doc/palette.h"
 #include "doc/sprite.h"
 #include "os/color_space.h"
 #include "os/system.h"
 
+#include <algorithm>
+#include <thread>
+#include <vector>
+
 namespace app {
 namespace cmd {
 
+// Converts the image using the "lut" (if it's available) or the
+// "conversion" directly.
 static doc::ImageRef convert_image_color_space(const doc::Image* srcImage,
                                                const gfx::ColorSpaceRef& newCS,
-                                               os::ColorSpaceConversion* conversion)
+                                               os::ColorSpaceConversion* conversion,
+                                               const ColorSpaceLut* lut)
 {
   ImageSpec spec = srcImage->spec();
   spec.setColorSpace(newCS);
@@ -38,9 +47,12 @@ static doc::ImageRef convert_image_color_space(const doc::Image* srcImage,
 
   if (spec.colorMode() == doc::ColorMode::RGB) {
     for (int y=0; y<spec.height(); ++y) {
-      conversion->convertRgba((uint32_t*)dstImage->getPixelAddress(0, y),
-                              (const uint32_t*)srcImage->getPixelAddress(0, y),
-                              spec.width());
+      auto dstPtr = (uint32_t*)dstImage->getPixelAddress(0, y);
+      auto srcPtr = (const uint32_t*)srcImage->getPixelAddress(0, y);
+      if (lut)
+        lut->convertRgba(dstPtr, srcPtr, spec.width());
+      else
+        conversion->convertRgba(dstPtr, srcPtr, spec.width());
     }
   }
   else if (spec.colorMode() == doc::ColorMode::GRAYSCALE) {
@@ -56,7 +68,10 @@ static doc::ImageRef convert_image_color_space(const doc::Image* srcImage,
         *it = doc::graya_getv(*srcPtr);
     }
 
-    conversion->convertGray(&buf[0], &buf[0], spec.width()*spec.height());
+    if (lut)
+      lut->convertGray(&buf[0], &buf[0], spec.width()*spec.height());
+    else
+      conversion->convertGray(&buf[0], &buf[0], spec.width()*spec.height());
 
     it = buf.begin();
     for (int y=0; y<spec.height(); ++y) {
@@ -70,6 +85,47 @@ static doc::ImageRef convert_image_color_space(const doc::Image* srcImage,
   return dstImage;
 }
 
+// Converts the images of all unique cels of the sprite from several
+// threads (each image is independent of the others), and then calls
+// func(oldImage, newImage) in the same order of Sprite::uniqueCels().
+template<typename Func>
+static void convert_cel_images(doc::Sprite* sprite,
+                               const gfx::ColorSpaceRef& newCS,
+                               os::ColorSpaceConversion* conversion,
+                               Func func)
+{
+  std::vector<ImageRef> oldImages;
+  for (Cel* cel : sprite->uniqueCels()) {
+    ImageRef image = cel->imageRef();
+    if (image->pixelFormat() != IMAGE_TILEMAP)
+      oldImages.push_back(image);
+  }
+  if (oldImages.empty())
+    return;
+
+  // Lookup tables (shared by all threads)
+  ColorSpaceLutRef lut;
+  if (conversion)
+    lut = get_color_space_lut(sprite->colorSpace(), newCS, conversion);
+
+  std::vector<ImageRef> newImages(oldImages.size());
+  {
+    const int nthreads = std::clamp<int>(std::thread::hardware_concurrency(),
+                                         1, int(oldImages.size()));
+    base::thread_pool pool(nthreads);
+    for (size_t i=0; i<oldImages.size(); ++i) {
+      pool.execute([&oldImages, &newImages, &newCS, conversion, &lut, i]{
+        newImages[i] = convert_image_color_space(
+          oldImages[i].get(), newCS, conversion, lut.get());
+      });
+    }
+    pool.wait_all();
+  }
+
+  for (size_t i=0; i<oldImages.size(); ++i)
+    func(oldImages[i], newImages[i]);
+}
+
 void convert_color_profile(doc::Sprite* sprite,
                            const gfx::ColorSpaceRef& newCS)
 {
@@ -86,15 +142,11 @@ void convert_color_profile(doc::Sprite* sprite,
 
   // Convert images
   if (sprite->pixelFormat() != doc::IMAGE_INDEXED) {
-    for (Cel* cel : sprite->uniqueCels()) {
-      ImageRef old_image = cel->imageRef();
-      if (old_image.get()->pixelFormat() != IMAGE_TILEMAP) {
-        ImageRef new_image = convert_image_color_space(
-          old_image.get(), newCS, conversion.get());
-
+    convert_cel_images(
+      sprite, newCS, conversion.get(),
+      [sprite](const ImageRef& old_image, const ImageRef& new_image){
         sprite->replaceImage(old_image->id(), new_image);
-      }
-    }
+      });
   }
 
   if (conversion) {
@@ -142,8 +194,9 @@ void convert_color_profile(doc::Image* image,
     switch (image->pixelFormat()) {
       case doc::IMAGE_RGB:
       case doc::IMAGE_GRAYSCALE: {
+        ColorSpaceLutRef lut = get_color_space_lut(oldCS, newCS, conversion.get());
         ImageRef newImage = convert_image_color_space(
-          image, newCS, conversion.get());
+          image, newCS, conversion.get(), lut.get());
 
         image->copy(newImage.get(), gfx::Clip(image->bounds()));
         break;
@@ -181,15 +234,11 @@ ConvertColorProfile::ConvertColorProfile(doc::Sprite* sprite, const gfx::ColorSp
 
   // Convert images
   if (sprite->pixelFormat() != doc::IMAGE_INDEXED) {
-    for (Cel* cel : sprite->uniqueCels()) {
-      ImageRef old_image = cel->imageRef();
-      if (old_image.get()->pixelFormat() != IMAGE_TILEMAP) {
-        ImageRef new_image = convert_image_color_space(
-          old_image.get(), newCS, conversion.get());
-
+    convert_cel_images(
+      sprite, newCS, conversion.get(),
+      [this, sprite](const ImageRef& old_image, const ImageRef& new_image){
         m_seq.add(new cmd::ReplaceImage(sprite, old_image, new_image));
-      }
-    }
+      });
   }
 
   if (conversion) {
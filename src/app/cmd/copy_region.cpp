@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -13,6 +13,7 @@
 
 #include "app/doc.h"
 #include "app/util/buffer_region.h"
+#include "base/exception.h"
 #include "doc/image.h"
 #include "doc/sprite.h"
 #include "doc/tileset.h"
@@ -61,6 +62,8 @@ void CopyRegion::onExecute()
 {
   if (!m_alreadyCopied)
     swap();
+
+  makeDelta();
 }
 
 void CopyRegion::onUndo()
@@ -73,12 +76,71 @@ void CopyRegion::onRedo()
   swap();
 }
 
+// Converts m_buffer (original pixels) to a compressed delta with the
+// new pixels in the image. As usually only a few pixels of the region
+// are modified (e.g. brush strokes), the delta is mostly zeros and it
+// compresses a lot better than the original pixels.
+void CopyRegion::makeDelta()
+{
+  if (m_deltaSize > 0 || m_buffer.empty())
+    return;
+
+  const Image* image = this->image();
+  ASSERT(image);
+
+  xor_buffer_with_image_region(m_region, image, m_buffer);
+
+  base::buffer compressed;
+  if (compress_buffer(m_buffer, compressed)) {
+    m_deltaSize = m_buffer.size();
+    m_buffer.swap(compressed);
+  }
+  else {
+    // Restore the original pixels (XOR two times)
+    xor_buffer_with_image_region(m_region, image, m_buffer);
+  }
+}
+
+void CopyRegion::onSpill(UndoSpillFile* file)
+{
+  if (m_spilledBuffer.isValid() ||
+      m_buffer.size() < UndoSpillFile::kMinChunkSize)
+    return;
+
+  if (file->write(m_buffer.data(), m_buffer.size(), m_spilledBuffer)) {
+    m_spillFile = file;
+    base::buffer().swap(m_buffer);
+  }
+}
+
+void CopyRegion::reloadSpilledBuffer()
+{
+  if (!m_spilledBuffer.isValid())
+    return;
+
+  m_buffer.resize(m_spilledBuffer.rawSize);
+  if (!m_spillFile->read(m_spilledBuffer, m_buffer.data()))
+    throw base::Exception("Cannot read undo information from disk");
+
+  m_spilledBuffer = UndoSpillFile::Chunk();
+}
+
 void CopyRegion::swap()
 {
   Image* image = this->image();
   ASSERT(image);
 
-  swap_image_region_with_buffer(m_region, image, m_buffer);
+  reloadSpilledBuffer();
+  if (m_deltaSize > 0) {
+    base::buffer delta;
+    if (!decompress_buffer(m_buffer, m_deltaSize, delta))
+      throw base::Exception("Cannot decompress undo information");
+
+    xor_image_region_with_buffer(m_region, image, delta);
+  }
+  else {
+    swap_image_region_with_buffer(m_region, image, m_buffer);
+  }
   image->incrementVersion();
 
   rehash();
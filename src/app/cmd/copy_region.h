@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -11,6 +11,7 @@
 
 #include "app/cmd.h"
 #include "app/cmd/with_image.h"
+#include "app/undo_spill_file.h"
 #include "base/buffer.h"
 #include "doc/tile.h"
 #include "gfx/point.h"
@@ -43,14 +44,26 @@ namespace cmd {
     size_t onMemSize() const override {
       return sizeof(*this) + m_buffer.size();
     }
+    void onSpill(UndoSpillFile* file) override;
 
   private:
     void swap();
+    void makeDelta();
+    void reloadSpilledBuffer();
     virtual void rehash() { }
 
     bool m_alreadyCopied;
     gfx::Region m_region;
+
+    // Pixels to swap with the image region, or (after the first
+    // execution) the compressed XOR between the original and the new
+    // pixels (when m_deltaSize > 0).
     base::buffer m_buffer;
+    size_t m_deltaSize = 0;
+
+    // Where m_buffer is stored when it was spilled to disk
+    UndoSpillFile* m_spillFile = nullptr;
+    UndoSpillFile::Chunk m_spilledBuffer;
   };
 
   class CopyTileRegion : public CopyRegion {
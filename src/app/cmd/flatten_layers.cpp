@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -22,6 +22,7 @@
 #include "app/doc.h"
 #include "app/i18n/strings.h"
 #include "app/restore_visible_layers.h"
+#include "app/util/render_frames.h"
 #include "doc/algorithm/shrink_bounds.h"
 #include "doc/cel.h"
 #include "doc/layer.h"
@@ -66,9 +67,6 @@ void FlattenLayers::onExecute()
   if (list.empty())
     return;                     // Do nothing
 
-  // Create a temporary image.
-  ImageRef image(Image::create(sprite->spec()));
-
   LayerImage* flatLayer;  // The layer onto which everything will be flattened.
   color_t bgcolor;        // The background color to use for flatLayer.
   bool newFlatLayer = false;
@@ -87,9 +85,12 @@ void FlattenLayers::onExecute()
     bgcolor = sprite->transparentColor();
   }
 
-  render::Render render;
-  render.setNewBlend(m_newBlendMethod);
-  render.setBgOptions(render::BgOptions::MakeNone());
+  // Rendered image of each frame, and its bounds without the
+  // background color (empty if the whole image is the bg color).
+  struct FlatFrame {
+    ImageRef image;
+    gfx::Rect bounds;
+  };
 
   {
     // Show only the layers to be flattened so other layers are hidden
@@ -97,39 +98,54 @@ void FlattenLayers::onExecute()
     RestoreVisibleLayers restore;
     restore.showSelectedLayers(sprite, layers);
 
-    // Copy all frames to the background.
-    for (frame_t frame(0); frame<sprite->totalFrames(); ++frame) {
-      // Clear the image and render this frame.
-      clear_image(image.get(), bgcolor);
-      render.renderSprite(image.get(), sprite, frame);
-
-      // TODO Keep cel links when possible
-
-      ImageRef cel_image;
-      Cel* cel = flatLayer->cel(frame);
-      if (cel) {
-        if (cel->links())
-          executeAndAdd(new cmd::UnlinkCel(cel));
-
-        cel_image = cel->imageRef();
-        ASSERT(cel_image);
-
-        executeAndAdd(
-          new cmd::CopyRect(cel_image.get(), image.get(),
-                            gfx::Clip(0, 0, image->bounds())));
-      }
-      else {
-        gfx::Rect bounds(image->bounds());
+    // Render all frames in parallel, and copy them to the flat layer
+    // in frame order.
+    render_frames_in_parallel(
+      0, sprite->lastFrame(),
+      [this, sprite, bgcolor](const frame_t frame) {
+        FlatFrame result;
+        result.image.reset(Image::create(sprite->spec()));
+
+        // Clear the image and render this frame.
+        clear_image(result.image.get(), bgcolor);
+
+        render::Render render;
+        render.setNewBlend(m_newBlendMethod);
+        render.setBgOptions(render::BgOptions::MakeNone());
+        render.renderSprite(result.image.get(), sprite, frame);
+
+        gfx::Rect bounds(result.image->bounds());
         if (doc::algorithm::shrink_bounds(
-              image.get(), image->maskColor(), nullptr, bounds)) {
+              result.image.get(), result.image->maskColor(), nullptr, bounds))
+          result.bounds = bounds;
+        return result;
+      },
+      [this, flatLayer](const frame_t frame, FlatFrame&& result) {
+        Image* image = result.image.get();
+
+        // TODO Keep cel links when possible
+
+        ImageRef cel_image;
+        Cel* cel = flatLayer->cel(frame);
+        if (cel) {
+          if (cel->links())
+            executeAndAdd(new cmd::UnlinkCel(cel));
+
+          cel_image = cel->imageRef();
+          ASSERT(cel_image);
+
+          executeAndAdd(
+            new cmd::CopyRect(cel_image.get(), image,
+                              gfx::Clip(0, 0, image->bounds())));
+        }
+        else if (!result.bounds.isEmpty()) {
           cel_image.reset(
-            doc::crop_image(image.get(), bounds, image->maskColor()));
+            doc::crop_image(image, result.bounds, image->maskColor()));
           cel = new Cel(frame, cel_image);
-          cel->setPosition(bounds.origin());
+          cel->setPosition(result.bounds.origin());
           flatLayer->addCel(cel);
         }
-      }
-    }
+      });
   }
 
   // Add new flatten layer
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -12,14 +12,12 @@
 
 #include "app/doc.h"
 #include "app/doc_event.h"
-#include "doc/cel.h"
-#include "doc/cels_range.h"
-#include "doc/layer.h"
-#include "doc/layer_tilemap.h"
 #include "doc/remap.h"
 #include "doc/sprite.h"
 #include "doc/tileset.h"
 
+#include <vector>
+
 namespace app {
 namespace cmd {
 
@@ -34,39 +32,30 @@ RemapTilemaps::RemapTilemaps(Tileset* tileset,
 
 void RemapTilemaps::onExecute()
 {
-  Tileset* tileset = this->tileset();
-  remapTileset(tileset, m_remap);
-  incrementVersions(tileset);
+  remapTileset(this->tileset(), m_remap);
 }
 
 void RemapTilemaps::onUndo()
 {
-  Tileset* tileset = this->tileset();
-  remapTileset(tileset, m_remap.invert());
-  incrementVersions(tileset);
+  remapTileset(this->tileset(), m_remap.invert());
 }
 
 void RemapTilemaps::remapTileset(Tileset* tileset, const Remap& remap)
 {
   Sprite* spr = tileset->sprite();
-  spr->remapTilemaps(tileset, remap);
+
+  // Only tilemaps using the remapped tiles are modified
+  std::vector<ImageRef> images;
+  spr->remapTilemaps(tileset, remap, &images);
 
   Doc* doc = static_cast<Doc*>(spr->document());
   DocEvent ev(doc);
   ev.sprite(spr);
   ev.tileset(tileset);
   doc->notify_observers<DocEvent&, const Remap&>(&DocObserver::onRemapTileset, ev, remap);
-}
 
-void RemapTilemaps::incrementVersions(Tileset* tileset)
-{
-  Sprite* spr = tileset->sprite();
-  for (const Cel* cel : spr->uniqueCels()) {
-    if (cel->layer()->isTilemap() &&
-        static_cast<LayerTilemap*>(cel->layer())->tileset() == tileset) {
-      cel->image()->incrementVersion();
-    }
-  }
+  for (const ImageRef& image : images)
+    image->incrementVersion();
 }
 
 } // namespace cmd
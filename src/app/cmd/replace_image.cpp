@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2023  Igara Studio S.A.
+// Copyright (C) 2023-2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -11,6 +11,7 @@
 
 #include "app/cmd/replace_image.h"
 
+#include "base/exception.h"
 #include "doc/cel.h"
 #include "doc/cels_range.h"
 #include "doc/image.h"
@@ -48,6 +49,8 @@ void ReplaceImage::onExecute()
 
 void ReplaceImage::onUndo()
 {
+  reloadSpilledCopy();
+
   ImageRef newImage = sprite()->getImageRef(m_newImageId);
   ASSERT(newImage);
   ASSERT(!sprite()->getImageRef(m_oldImageId));
@@ -59,6 +62,8 @@ void ReplaceImage::onUndo()
 
 void ReplaceImage::onRedo()
 {
+  reloadSpilledCopy();
+
   ImageRef oldImage = sprite()->getImageRef(m_oldImageId);
   ASSERT(oldImage);
   ASSERT(!sprite()->getImageRef(m_newImageId));
@@ -68,6 +73,39 @@ void ReplaceImage::onRedo()
   m_copy.reset(Image::createCopy(oldImage.get()));
 }
 
+void ReplaceImage::onSpill(UndoSpillFile* file)
+{
+  if (!m_copy)
+    return;
+
+  // The pixels of an image are stored in one contiguous block
+  const size_t size = m_copy->rowBytes() * m_copy->height();
+  if (size < UndoSpillFile::kMinChunkSize)
+    return;
+
+  if (file->write(m_copy->getPixelAddress(0, 0), size, m_spilledCopy)) {
+    m_spillFile = file;
+    m_spilledCopySpec = m_copy->spec();
+    m_copy.reset();
+  }
+}
+
+void ReplaceImage::reloadSpilledCopy()
+{
+  if (!m_spilledCopy.isValid())
+    return;
+
+  ASSERT(m_spilledCopySpec);
+  ImageRef copy(Image::create(*m_spilledCopySpec));
+  if (copy->rowBytes() * copy->height() != m_spilledCopy.rawSize ||
+      !m_spillFile->read(m_spilledCopy, copy->getPixelAddress(0, 0)))
+    throw base::Exception("Cannot read undo information from disk");
+
+  m_copy = copy;
+  m_spilledCopy = UndoSpillFile::Chunk();
+  m_spilledCopySpec.reset();
+}
+
 void ReplaceImage::replaceImage(ObjectId oldId, const ImageRef& newImage)
 {
   Sprite* spr = sprite();
@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -10,8 +11,11 @@
 
 #include "app/cmd.h"
 #include "app/cmd/with_sprite.h"
+#include "app/undo_spill_file.h"
 #include "doc/image_ref.h"
+#include "doc/image_spec.h"
 
+#include <optional>
 #include <sstream>
 
 namespace app {
@@ -31,9 +35,11 @@ namespace cmd {
       return sizeof(*this) +
         (m_copy ? m_copy->getMemSize(): 0);
     }
+    void onSpill(UndoSpillFile* file) override;
 
   private:
     void replaceImage(ObjectId oldId, const ImageRef& newImage);
+    void reloadSpilledCopy();
 
     ObjectId m_oldImageId;
     ObjectId m_newImageId;
@@ -43,6 +49,12 @@ namespace cmd {
     // Then the reference is not used anymore.
     ImageRef m_newImage;
     ImageRef m_copy;
+
+    // Where the pixels of m_copy are stored when it was spilled to
+    // disk (m_copy is nullptr in that case)
+    UndoSpillFile* m_spillFile = nullptr;
+    UndoSpillFile::Chunk m_spilledCopy;
+    std::optional<ImageSpec> m_spilledCopySpec;
   };
 
 } // namespace cmd
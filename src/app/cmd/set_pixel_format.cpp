@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -17,10 +17,12 @@
 #include "app/cmd/set_palette.h"
 #include "app/doc.h"
 #include "app/doc_event.h"
+#include "base/thread_pool.h"
 #include "doc/cel.h"
 #include "doc/cels_range.h"
 #include "doc/document.h"
 #include "doc/layer.h"
+#include "doc/locked_rgbmap.h"
 #include "doc/palette.h"
 #include "doc/rgbmap.h"
 #include "doc/sprite.h"
@@ -28,46 +30,18 @@
 #include "render/quantization.h"
 #include "render/task_delegate.h"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <thread>
+
 namespace app {
 namespace cmd {
 
 using namespace doc;
 
-namespace {
-
-class SuperDelegate : public render::TaskDelegate {
-public:
-  SuperDelegate(int nimages, render::TaskDelegate* delegate)
-    : m_nimages(nimages)
-    , m_curImage(0)
-    , m_delegate(delegate) {
-  }
-
-  void notifyTaskProgress(double progress) override {
-    if (m_delegate)
-      m_delegate->notifyTaskProgress(
-        (progress + m_curImage) / m_nimages);
-  }
-
-  bool continueTask() override {
-    if (m_delegate)
-      return m_delegate->continueTask();
-    else
-      return true;
-  }
-
-  void nextImage() {
-    ++m_curImage;
-  }
-
-private:
-  int m_nimages;
-  int m_curImage;
-  TaskDelegate* m_delegate;
-};
-
-} // anonymous namespace
-
 SetPixelFormat::SetPixelFormat(Sprite* sprite,
                                const PixelFormat newFormat,
                                const render::Dithering& dithering,
@@ -81,39 +55,16 @@ SetPixelFormat::SetPixelFormat(Sprite* sprite,
   if (sprite->pixelFormat() == newFormat)
     return;
 
-  // Calculate the number of images to convert just to show a proper
-  // progress bar.
-  tile_index nimages = 0;
-  for (Cel* cel : sprite->uniqueCels())
-    if (!cel->layer()->isTilemap())
-      ++nimages;
-  if (sprite->hasTilesets()) {
-    for (Tileset* tileset : *sprite->tilesets()) {
-      if (tileset)
-        nimages += tileset->size();
-    }
-  }
-
-  SuperDelegate superDel(nimages, delegate);
-
-  // Convert cel images
+  // Collect cel and tileset images to convert them in parallel
+  std::vector<ImageToConvert> images;
   for (Cel* cel : sprite->uniqueCels()) {
     if (cel->layer()->isTilemap())
       continue;
 
-    ImageRef oldImage = cel->imageRef();
-    convertImage(sprite, dithering,
-                 oldImage,
-                 cel->frame(),
-                 cel->layer()->isBackground(),
-                 mapAlgorithm,
-                 toGray,
-                 &superDel);
-
-    superDel.nextImage();
+    images.push_back(ImageToConvert{ cel->imageRef(),
+                                     cel->frame(),
+                                     cel->layer()->isBackground() });
   }
-
-  // Convert tileset images
   if (sprite->hasTilesets()) {
     for (Tileset* tileset : *sprite->tilesets()) {
       if (!tileset)
@@ -122,19 +73,23 @@ SetPixelFormat::SetPixelFormat(Sprite* sprite,
       for (tile_index i=0; i<tileset->size(); ++i) {
         ImageRef oldImage = tileset->get(i);
         if (oldImage) {
-          convertImage(sprite, dithering,
-                       oldImage,
-                       0,     // TODO select a frame or generate other tilesets?
-                       false, // TODO is background? it depends of the layer where this tileset is used
-                       mapAlgorithm,
-                       toGray,
-                       &superDel);
+          images.push_back(ImageToConvert{
+              oldImage,
+              0,       // TODO select a frame or generate other tilesets?
+              false }); // TODO is background? it depends of the layer where this tileset is used
         }
-        superDel.nextImage();
       }
     }
   }
 
+  convertImages(sprite, dithering, images, mapAlgorithm, toGray, delegate);
+
+  for (const auto& image : images) {
+    // The image can be nullptr if the task was canceled
+    if (image.newImage)
+      m_seq.add(new cmd::ReplaceImage(sprite, image.oldImage, image.newImage));
+  }
+
   // Set all cels opacity to 100% if we are converting to indexed.
   // TODO remove this
   if (newFormat == IMAGE_INDEXED) {
@@ -201,44 +156,93 @@ void SetPixelFormat::setFormat(PixelFormat format)
   doc->notify_observers<DocEvent&>(&DocObserver::onPixelFormatChanged, ev);
 }
 
-void SetPixelFormat::convertImage(doc::Sprite* sprite,
-                                  const render::Dithering& dithering,
-                                  const doc::ImageRef& oldImage,
-                                  const doc::frame_t frame,
-                                  const bool isBackground,
-                                  const doc::RgbMapAlgorithm mapAlgorithm,
-                                  doc::rgba_to_graya_func toGray,
-                                  render::TaskDelegate* delegate)
+void SetPixelFormat::convertImages(doc::Sprite* sprite,
+                                   const render::Dithering& dithering,
+                                   std::vector<ImageToConvert>& images,
+                                   const doc::RgbMapAlgorithm mapAlgorithm,
+                                   doc::rgba_to_graya_func toGray,
+                                   render::TaskDelegate* delegate)
 {
-  ASSERT(oldImage);
-  ASSERT(oldImage->pixelFormat() != IMAGE_TILEMAP);
-
-  // Making the RGBMap for Image->INDEXDED conversion.
-  // TODO: this is needed only when newImage
-  RgbMap* rgbmap;
-  int newMaskIndex = (isBackground ? -1 : 0);
-  if (m_newFormat == IMAGE_INDEXED) {
-    rgbmap = sprite->rgbMap(frame, sprite->rgbMapForSprite(), mapAlgorithm);
-    if (m_oldFormat == IMAGE_INDEXED)
-      newMaskIndex = sprite->transparentColor();
-    else
-      newMaskIndex = rgbmap->maskIndex();
-  }
-  else {
-    rgbmap = nullptr;
+  const int nimages = int(images.size());
+  const int nthreads = std::max(1u, std::thread::hardware_concurrency());
+  int doneImages = 0;
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::atomic<bool> canceled(false);
+
+  // Images are converted in groups of consecutive images that use the
+  // same palette, because the sprite RgbMap must be regenerated (from
+  // this thread) for each palette.
+  for (int i=0; i<nimages && !canceled; ) {
+    const Palette* palette = sprite->palette(images[i].frame);
+
+    // Making the RGBMap for Image->INDEXDED conversion.
+    RgbMap* rgbmap = nullptr;
+    if (m_newFormat == IMAGE_INDEXED)
+      rgbmap = sprite->rgbMap(images[i].frame, sprite->rgbMapForSprite(), mapAlgorithm);
+
+    int j = i;
+    for (; j<nimages && sprite->palette(images[j].frame) == palette; ++j) {
+      ASSERT(images[j].oldImage);
+      ASSERT(images[j].oldImage->pixelFormat() != IMAGE_TILEMAP);
+    }
+
+    std::mutex rgbmapMutex;
+    base::thread_pool pool(std::min(nthreads, j-i));
+    for (int k=i; k<j; ++k) {
+      pool.execute(
+        [&, k]{
+          ImageToConvert& image = images[k];
+          if (!canceled) {
+            int newMaskIndex = (image.isBackground ? -1 : 0);
+            std::optional<LockedRgbMap> lockedRgbmap;
+            if (rgbmap) {
+              lockedRgbmap.emplace(rgbmap, rgbmapMutex);
+              if (m_oldFormat == IMAGE_INDEXED)
+                newMaskIndex = sprite->transparentColor();
+              else
+                newMaskIndex = rgbmap->maskIndex();
+            }
+
+            image.newImage.reset(
+              render::convert_pixel_format
+              (image.oldImage.get(), nullptr, m_newFormat,
+               dithering,
+               (rgbmap ? &*lockedRgbmap: nullptr),
+               palette,
+               image.isBackground,
+               newMaskIndex,
+               toGray,
+               nullptr));
+          }
+
+          std::lock_guard lock(mutex);
+          ++doneImages;
+          cv.notify_one();
+        });
+    }
+
+    // Report the progress from this thread
+    {
+      std::unique_lock lock(mutex);
+      while (doneImages < j) {
+        const int lastDone = doneImages;
+        cv.wait(lock, [&]{ return doneImages != lastDone; });
+
+        if (delegate && !canceled) {
+          const int done = doneImages;
+          lock.unlock();
+          if (delegate->continueTask())
+            delegate->notifyTaskProgress(double(done) / double(nimages));
+          else
+            canceled = true;
+          lock.lock();
+        }
+      }
+    }
+    pool.wait_all();
+    i = j;
   }
-  ImageRef newImage(
-    render::convert_pixel_format
-    (oldImage.get(), nullptr, m_newFormat,
-     dithering,
-     rgbmap,
-     sprite->palette(frame),
-     isBackground,
-     newMaskIndex,
-     toGray,
-     delegate));
-
-  m_seq.add(new cmd::ReplaceImage(sprite, oldImage, newImage));
 }
 
 } // namespace cmd
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -17,6 +17,8 @@
 #include "doc/pixel_format.h"
 #include "doc/rgbmap_algorithm.h"
 
+#include <vector>
+
 namespace doc {
   class Sprite;
 }
@@ -49,14 +51,19 @@ namespace cmd {
 
   private:
     void setFormat(doc::PixelFormat format);
-    void convertImage(doc::Sprite* sprite,
-                      const render::Dithering& dithering,
-                      const doc::ImageRef& oldImage,
-                      const doc::frame_t frame,
-                      const bool isBackground,
-                      const doc::RgbMapAlgorithm mapAlgorithm,
-                      doc::rgba_to_graya_func toGray,
-                      render::TaskDelegate* delegate);
+    struct ImageToConvert {
+      doc::ImageRef oldImage;
+      doc::frame_t frame;
+      bool isBackground;
+      doc::ImageRef newImage;
+    };
+
+    void convertImages(doc::Sprite* sprite,
+                       const render::Dithering& dithering,
+                       std::vector<ImageToConvert>& images,
+                       const doc::RgbMapAlgorithm mapAlgorithm,
+                       doc::rgba_to_graya_func toGray,
+                       render::TaskDelegate* delegate);
 
     doc::PixelFormat m_oldFormat;
     doc::PixelFormat m_newFormat;
@@ -0,0 +1,218 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/color_space_lut.h"
+
+#include "base/debug.h"
+#include "doc/simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <list>
+#include <mutex>
+
+namespace app {
+
+namespace {
+
+constexpr int G = ColorSpaceLut::kGridSize;
+
+// Offsets (in floats) to the next node in each axis
+constexpr int kROffset = 4;
+constexpr int kGOffset = 4*G;
+constexpr int kBOffset = 4*G*G;
+
+// Number of cached tables (each one uses ~570KB)
+constexpr int kMaxCachedLuts = 4;
+
+struct GridPos {
+  int index;                    // Index of the previous node
+  float frac;                   // Position between the previous and the next node [0, 1]
+};
+
+// 8-bit values of the grid nodes. Nodes are closer near black where
+// transfer functions (gamma curves) change faster.
+const std::array<int, G>& node_values()
+{
+  static const std::array<int, G> values = []{
+    std::array<int, G> result;
+    for (int i=0; i<G; ++i) {
+      const double t = double(i) / (G-1);
+      result[i] = int(std::round(255.0 * t * t));
+      if (i > 0)
+        result[i] = std::max(result[i], result[i-1]+1);
+    }
+    return result;
+  }();
+  return values;
+}
+
+// Position of each 8-bit value in the grid
+const std::array<GridPos, 256>& grid_positions()
+{
+  static const std::array<GridPos, 256> positions = []{
+    const auto& nodes = node_values();
+    std::array<GridPos, 256> result;
+    int i = 0;
+    for (int v=0; v<256; ++v) {
+      while (i < G-2 && v >= nodes[i+1])
+        ++i;
+      result[v].index = i;
+      result[v].frac = float(v - nodes[i]) / float(nodes[i+1] - nodes[i]);
+    }
+    return result;
+  }();
+  return positions;
+}
+
+struct CacheEntry {
+  gfx::ColorSpaceRef srcCS;
+  gfx::ColorSpaceRef dstCS;
+  ColorSpaceLutRef lut;
+};
+
+std::mutex g_cacheMutex;
+std::list<CacheEntry> g_cache; // Most recently used first
+
+} // anonymous namespace
+
+ColorSpaceLut::ColorSpaceLut(os::ColorSpaceConversion* conversion)
+  : m_grid(4*G*G*G)
+{
+  ASSERT(conversion);
+
+  // Convert all the grid nodes with just one call
+  const auto& values = node_values();
+  std::vector<uint32_t> nodes(G*G*G);
+  auto it = nodes.begin();
+  for (int b=0; b<G; ++b)
+    for (int g=0; g<G; ++g)
+      for (int r=0; r<G; ++r, ++it)
+        *it = (values[r]
+               | (values[g] << 8)
+               | (values[b] << 16)
+               | (255 << 24));
+  conversion->convertRgba(nodes.data(), nodes.data(), int(nodes.size()));
+
+  auto gridIt = m_grid.begin();
+  for (const uint32_t c : nodes) {
+    *gridIt++ = float(c & 0xff);
+    *gridIt++ = float((c >> 8) & 0xff);
+    *gridIt++ = float((c >> 16) & 0xff);
+    *gridIt++ = 0.0f;
+  }
+
+  for (int v=0; v<256; ++v)
+    m_gray[v] = v;
+  conversion->convertGray(m_gray.data(), m_gray.data(), int(m_gray.size()));
+}
+
+void ColorSpaceLut::convertRgba(uint32_t* dst, const uint32_t* src, int n) const
+{
+  const auto& pos = grid_positions();
+  const float* grid = m_grid.data();
+
+  for (int i=0; i<n; ++i) {
+    const uint32_t c = src[i];
+    const GridPos& pr = pos[c & 0xff];
+    const GridPos& pg = pos[(c >> 8) & 0xff];
+    const GridPos& pb = pos[(c >> 16) & 0xff];
+    const float fr = pr.frac;
+    const float fg = pg.frac;
+    const float fb = pb.frac;
+
+    // Choose the tetrahedron of the cube that contains the color:
+    // the color is a weighted sum of the nodes c000, c1, c2, and c111.
+    int o1, o2;
+    float w1, w2, w3;
+    if (fr >= fg) {
+      if (fg >= fb)      { o1 = kROffset; o2 = kROffset+kGOffset; w1 = fr; w2 = fg; w3 = fb; }
+      else if (fr >= fb) { o1 = kROffset; o2 = kROffset+kBOffset; w1 = fr; w2 = fb; w3 = fg; }
+      else               { o1 = kBOffset; o2 = kROffset+kBOffset; w1 = fb; w2 = fr; w3 = fg; }
+    }
+    else {
+      if (fb >= fg)      { o1 = kBOffset; o2 = kGOffset+kBOffset; w1 = fb; w2 = fg; w3 = fr; }
+      else if (fb >= fr) { o1 = kGOffset; o2 = kGOffset+kBOffset; w1 = fg; w2 = fb; w3 = fr; }
+      else               { o1 = kGOffset; o2 = kROffset+kGOffset; w1 = fg; w2 = fr; w3 = fb; }
+    }
+
+    const float* c000 = grid + (pr.index*kROffset +
+                                pg.index*kGOffset +
+                                pb.index*kBOffset);
+    const float* c1 = c000 + o1;
+    const float* c2 = c000 + o2;
+    const float* c111 = c000 + kROffset + kGOffset + kBOffset;
+    const float k0 = 1.0f - w1;
+    const float k1 = w1 - w2;
+    const float k2 = w2 - w3;
+    const float k3 = w3;
+
+#if DOC_SIMD_SSE2
+    __m128 v = _mm_mul_ps(_mm_loadu_ps(c000), _mm_set1_ps(k0));
+    v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(c1), _mm_set1_ps(k1)));
+    v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(c2), _mm_set1_ps(k2)));
+    v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(c111), _mm_set1_ps(k3)));
+    __m128i rgb = _mm_cvtps_epi32(v);
+    rgb = _mm_packs_epi32(rgb, rgb);
+    rgb = _mm_packus_epi16(rgb, rgb);
+    dst[i] = (uint32_t(_mm_cvtsi128_si32(rgb)) & 0x00ffffff) | (c & 0xff000000);
+#elif DOC_SIMD_NEON
+    float32x4_t v = vmulq_n_f32(vld1q_f32(c000), k0);
+    v = vmlaq_n_f32(v, vld1q_f32(c1), k1);
+    v = vmlaq_n_f32(v, vld1q_f32(c2), k2);
+    v = vmlaq_n_f32(v, vld1q_f32(c111), k3);
+    const uint16x4_t rgb16 = vqmovun_s32(vcvtnq_s32_f32(v));
+    const uint8x8_t rgb8 = vqmovn_u16(vcombine_u16(rgb16, rgb16));
+    dst[i] = (vget_lane_u32(vreinterpret_u32_u8(rgb8), 0) & 0x00ffffff) | (c & 0xff000000);
+#else
+    uint32_t result = (c & 0xff000000);
+    for (int j=0; j<3; ++j) {
+      const float v = c000[j]*k0 + c1[j]*k1 + c2[j]*k2 + c111[j]*k3;
+      result |= uint32_t(std::clamp(int(std::nearbyint(v)), 0, 255)) << (8*j);
+    }
+    dst[i] = result;
+#endif
+  }
+}
+
+void ColorSpaceLut::convertGray(uint8_t* dst, const uint8_t* src, int n) const
+{
+  for (int i=0; i<n; ++i)
+    dst[i] = m_gray[src[i]];
+}
+
+ColorSpaceLutRef get_color_space_lut(const gfx::ColorSpaceRef& srcCS,
+                                     const gfx::ColorSpaceRef& dstCS,
+                                     os::ColorSpaceConversion* conversion)
+{
+  ASSERT(srcCS);
+  ASSERT(dstCS);
+
+  const std::lock_guard lock(g_cacheMutex);
+  for (auto it=g_cache.begin(); it!=g_cache.end(); ++it) {
+    if (it->srcCS->nearlyEqual(*srcCS) &&
+        it->dstCS->nearlyEqual(*dstCS)) {
+      // Move to the front of the list (most recently used)
+      g_cache.splice(g_cache.begin(), g_cache, it);
+      return g_cache.front().lut;
+    }
+  }
+
+  if (!conversion)
+    return nullptr;
+
+  auto lut = std::make_shared<ColorSpaceLut>(conversion);
+  g_cache.push_front(CacheEntry{ srcCS, dstCS, lut });
+  if (g_cache.size() > kMaxCachedLuts)
+    g_cache.pop_back();
+  return lut;
+}
+
+} // namespace app
@@ -0,0 +1,60 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_COLOR_SPACE_LUT_H_INCLUDED
+#define APP_COLOR_SPACE_LUT_H_INCLUDED
+#pragma once
+
+#include "gfx/color_space.h"
+#include "os/color_space.h"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace app {
+
+  // Lookup tables to convert images between two color spaces. The
+  // tables are generated with one os::ColorSpaceConversion call, and
+  // then RGBA pixels are converted with tetrahedral interpolation in
+  // a 3D grid (the result is exact in the grid nodes, and between
+  // nodes it can differ in one or two levels from the exact
+  // conversion), and grayscale pixels with a direct table (exact).
+  //
+  // The same ColorSpaceLut can be used from several threads.
+  class ColorSpaceLut {
+  public:
+    // Nodes in each axis of the RGB grid (they are closer near 0)
+    static constexpr int kGridSize = 33;
+
+    explicit ColorSpaceLut(os::ColorSpaceConversion* conversion);
+
+    // The alpha channel is kept as it is.
+    void convertRgba(uint32_t* dst, const uint32_t* src, int n) const;
+    void convertGray(uint8_t* dst, const uint8_t* src, int n) const;
+
+  private:
+    // RGB values of each node (4 floats per node, the last one is
+    // unused, so a node can be loaded as a SIMD vector).
+    std::vector<float> m_grid;
+    std::array<uint8_t, 256> m_gray;
+  };
+
+  using ColorSpaceLutRef = std::shared_ptr<const ColorSpaceLut>;
+
+  // Returns the lookup tables to convert from srcCS to dstCS. The
+  // last used tables are cached, so converting several images (or
+  // several times) between the same color spaces generates the
+  // tables only once. The given conversion is used only if the
+  // tables aren't in the cache.
+  ColorSpaceLutRef get_color_space_lut(const gfx::ColorSpaceRef& srcCS,
+                                       const gfx::ColorSpaceRef& dstCS,
+                                       os::ColorSpaceConversion* conversion);
+
+} // namespace app
+
+#endif
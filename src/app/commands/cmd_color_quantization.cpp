@@ -39,6 +39,7 @@ struct ColorQuantizationParams : public NewParams {
   Param<int> maxColors { this, 256, "maxColors" };
   Param<bool> useRange { this, false, "useRange" };
   Param<RgbMapAlgorithm> algorithm { this, RgbMapAlgorithm::DEFAULT, "algorithm" };
+  Param<render::PaletteAlgorithm> paletteAlgorithm { this, render::PaletteAlgorithm::Default, "paletteAlgorithm" };
 };
 
 #if ENABLE_UI
@@ -98,6 +99,7 @@ void ColorQuantizationCommand::onExecute(Context* ctx)
   bool withAlpha = params().withAlpha();
   int maxColors = params().maxColors();
   RgbMapAlgorithm algorithm = params().algorithm();
+  const render::PaletteAlgorithm paletteAlgorithm = params().paletteAlgorithm();
   bool createPal;
 
   Site site = ctx->activeSite();
@@ -184,13 +186,15 @@ void ColorQuantizationCommand::onExecute(Context* ctx)
     const bool newBlend = pref.experimental.newBlend();
     job.startJobWithCallback(
       [sprite, withAlpha, curPalette, &tmpPalette, &job, &entries,
-       newBlend, algorithm, createPal, site, frame](Tx& tx) {
+       newBlend, algorithm, paletteAlgorithm, createPal, site, frame](Tx& tx) {
         render::create_palette_from_sprite(
           sprite, 0, sprite->lastFrame(),
           withAlpha, &tmpPalette,
           &job,                 // SpriteJob is a render::TaskDelegate
           newBlend,
-          algorithm);
+          algorithm,
+          true,                 // calculateWithTransparent
+          paletteAlgorithm);
 
         std::unique_ptr<Palette> newPalette(
           new Palette(createPal ? tmpPalette:
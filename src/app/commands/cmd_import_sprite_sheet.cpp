@@ -35,9 +35,13 @@
 #include "doc/palette.h"
 #include "doc/primitives.h"
 #include "doc/sprite.h"
+#include "doc/task_scheduler.h"
 #include "render/render.h"
 #include "ui/ui.h"
 
+#include <unordered_map>
+#include <vector>
+
 #include "import_sprite_sheet.xml.h"
 
 namespace app {
@@ -50,6 +54,7 @@ struct ImportSpriteSheetParams : public NewParams {
   Param<gfx::Rect> frameBounds { this, gfx::Rect(0, 0, 0, 0), "frameBounds" };
   Param<gfx::Size> padding { this, gfx::Size(0, 0), "padding" };
   Param<bool> partialTiles { this, false, "partialTiles" };
+  Param<bool> mergeDuplicates { this, false, "mergeDuplicates" };
 };
 
 class ImportSpriteSheetWindow : public app::gen::ImportSpriteSheet
@@ -454,8 +459,8 @@ void ImportSpriteSheetCommand::onExecute(Context* context)
     frame_t currentFrame = context->activeSite().frame();
     gfx::Rect frameBounds = params.frameBounds();
     const gfx::Size padding = params.padding();
-    render::Render render;
-    render.setNewBlend(Preferences::instance().experimental.newBlend());
+    const bool newBlend = Preferences::instance().experimental.newBlend();
+    const bool mergeDuplicates = params.mergeDuplicates();
 
     if (frameBounds.isEmpty())
       frameBounds = sprite->bounds();
@@ -496,19 +501,39 @@ void ImportSpriteSheetCommand::onExecute(Context* context)
         break;
     }
 
-    // As first step, we cut each tile and add them into "animation" list.
-    for (const auto& tileRect : tileRects) {
-      ImageRef resultImage(
-        Image::create(
-          sprite->pixelFormat(), tileRect.w, tileRect.h));
-
-      // Render the portion of sheet.
-      render.renderSprite(
-        resultImage.get(), sprite, currentFrame,
-        gfx::Clip(0, 0, tileRect));
-
-      animation.push_back(resultImage);
-    }
+    // As first step, we cut each tile and add them into "animation"
+    // list. Tiles are rendered in parallel (each task with its own
+    // renderer, the sprite is only read). Empty tiles are left as
+    // nullptr so we don't create cels for them.
+    const color_t transparent =
+      (sprite->pixelFormat() == IMAGE_INDEXED ? sprite->transparentColor(): 0);
+    animation.resize(tileRects.size());
+    std::vector<uint64_t> hashes(mergeDuplicates ? tileRects.size(): 0);
+    doc::parallel_for(
+      0, int(tileRects.size()), 8,
+      [&](const int from, const int to){
+        render::Render render;
+        render.setNewBlend(newBlend);
+
+        for (int i=from; i<to; ++i) {
+          const gfx::Rect& tileRect = tileRects[i];
+          ImageRef resultImage(
+            Image::create(
+              sprite->pixelFormat(), tileRect.w, tileRect.h));
+
+          // Render the portion of sheet.
+          render.renderSprite(
+            resultImage.get(), sprite, currentFrame,
+            gfx::Clip(0, 0, tileRect));
+
+          if (is_plain_image(resultImage.get(), transparent))
+            continue;
+
+          if (mergeDuplicates)
+            hashes[i] = calculate_image_content_hash(resultImage.get());
+          animation[i] = resultImage;
+        }
+      });
 
     if (animation.size() == 0) {
       Alert::show(Strings::alerts_empty_rect_importing_sprite_sheet());
@@ -528,12 +553,32 @@ void ImportSpriteSheetCommand::onExecute(Context* context)
       api.newLayer(sprite->root(), Strings::import_sprite_sheet_layer_name());
 
     // Add all frames+cels to the new layer
+    std::unordered_map<uint64_t, std::vector<Cel*>> celsByHash;
     for (size_t i=0; i<animation.size(); ++i) {
+      if (!animation[i])
+        continue;
+
+      // Link the cel to a previous one with the same image
+      Cel* sameCel = nullptr;
+      if (mergeDuplicates) {
+        auto& cels = celsByHash[hashes[i]];
+        for (Cel* cel : cels) {
+          if (is_same_image(cel->image(), animation[i].get())) {
+            sameCel = cel;
+            break;
+          }
+        }
+      }
+
       // Create the cel.
-      std::unique_ptr<Cel> resultCel(new Cel(frame_t(i), animation[i]));
+      std::unique_ptr<Cel> resultCel(
+        sameCel ? Cel::MakeLink(frame_t(i), sameCel):
+                  new Cel(frame_t(i), animation[i]));
 
       // Add the cel in the layer.
       api.addCel(resultLayer, resultCel.get());
+      if (mergeDuplicates && !sameCel)
+        celsByHash[hashes[i]].push_back(resultCel.get());
       resultCel.release();
     }
 
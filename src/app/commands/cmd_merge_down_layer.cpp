@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -20,6 +20,7 @@
 #include "app/doc_api.h"
 #include "app/modules/gui.h"
 #include "app/tx.h"
+#include "app/util/render_frames.h"
 #include "doc/blend_internals.h"
 #include "doc/cel.h"
 #include "doc/image.h"
@@ -81,82 +82,95 @@ void MergeDownLayerCommand::onExecute(Context* context)
 
   Tx tx(writer, friendlyName(), ModifyDocument);
 
-  for (frame_t frpos = 0; frpos<sprite->totalFrames(); ++frpos) {
-    // Get frames
-    Cel* src_cel = src_layer->cel(frpos);
-    Cel* dst_cel = dst_layer->cel(frpos);
+  const doc::color_t bgcolor = app_get_color_to_clear_layer(dst_layer);
 
-    // Get images
-    Image* src_image;
-    if (src_cel != NULL)
-      src_image = src_cel->image();
-    else
-      src_image = NULL;
+  // Merged image of each frame (or null if there is no source cel).
+  struct MergedFrame {
+    ImageRef image;
+    gfx::Rect bounds;
+  };
 
-    ImageRef dst_image;
-    if (dst_cel)
-      dst_image = dst_cel->imageRef();
+  // The merged images are created in several threads, and the cels
+  // are modified in frame order.
+  render_frames_in_parallel(
+    0, sprite->lastFrame(),
+    [sprite, src_layer, dst_layer, bgcolor](const frame_t frpos) {
+      MergedFrame result;
 
-    // With source image?
-    if (src_image) {
-      int t;
-      int opacity;
-      opacity = MUL_UN8(src_cel->opacity(), src_layer->opacity(), t);
+      // Get frames
+      const Cel* src_cel = src_layer->cel(frpos);
+      const Cel* dst_cel = dst_layer->cel(frpos);
 
-      // No destination image
-      if (!dst_image) {  // Only a transparent layer can have a null cel
-        // Copy this cel to the destination layer...
+      // Without source image there is nothing to merge
+      if (!src_cel || !src_cel->image())
+        return result;
 
+      // No destination image
+      if (!dst_cel) {  // Only a transparent layer can have a null cel
         // Creating a copy of the image
-        dst_image.reset(
+        result.image.reset(
           render::rasterize_with_cel_bounds(src_cel));
-
-        // Creating a copy of the cell
-        dst_cel = new Cel(frpos, dst_image);
-        dst_cel->setPosition(src_cel->x(), src_cel->y());
-        dst_cel->setOpacity(opacity);
-
-        tx(new cmd::AddCel(dst_layer, dst_cel));
+        result.bounds = src_cel->bounds();
       }
       // With destination
       else {
-        gfx::Rect bounds;
-
         // Merge down in the background layer
         if (dst_layer->isBackground()) {
-          bounds = sprite->bounds();
+          result.bounds = sprite->bounds();
         }
         // Merge down in a transparent layer
         else {
-          bounds = src_cel->bounds().createUnion(dst_cel->bounds());
+          result.bounds = src_cel->bounds().createUnion(dst_cel->bounds());
         }
 
-        doc::color_t bgcolor = app_get_color_to_clear_layer(dst_layer);
-
-        ImageRef new_image(doc::crop_image(
-            dst_image.get(),
-            bounds.x-dst_cel->x(),
-            bounds.y-dst_cel->y(),
-            bounds.w, bounds.h, bgcolor));
+        result.image.reset(doc::crop_image(
+            dst_cel->image(),
+            result.bounds.x-dst_cel->x(),
+            result.bounds.y-dst_cel->y(),
+            result.bounds.w, result.bounds.h, bgcolor));
 
         // Draw src_cel on new_image
         render::rasterize(
-          new_image.get(), src_cel,
-          -bounds.x, -bounds.y, false);
+          result.image.get(), src_cel,
+          -result.bounds.x, -result.bounds.y, false);
+      }
+      return result;
+    },
+    [sprite, src_layer, dst_layer, &tx](const frame_t frpos,
+                                        MergedFrame&& result) {
+      if (!result.image)
+        return;
 
+      Cel* src_cel = src_layer->cel(frpos);
+      Cel* dst_cel = dst_layer->cel(frpos);
+      ASSERT(src_cel);
+
+      // No destination image
+      if (!dst_cel) {
+        int t;
+        const int opacity = MUL_UN8(src_cel->opacity(), src_layer->opacity(), t);
+
+        // Creating a copy of the cell
+        dst_cel = new Cel(frpos, result.image);
+        dst_cel->setPosition(result.bounds.x, result.bounds.y);
+        dst_cel->setOpacity(opacity);
+
+        tx(new cmd::AddCel(dst_layer, dst_cel));
+      }
+      // With destination
+      else {
         // First unlink the dst_cel
         if (dst_cel->links())
           tx(new cmd::UnlinkCel(dst_cel));
 
         // Then modify the dst_cel
         tx(new cmd::SetCelPosition(dst_cel,
-            bounds.x, bounds.y));
+            result.bounds.x, result.bounds.y));
 
         tx(new cmd::ReplaceImage(sprite,
-            dst_cel->imageRef(), new_image));
+            dst_cel->imageRef(), result.image));
       }
-    }
-  }
+    });
 
   document->notifyLayerMergedDown(src_layer, dst_layer);
   document->getApi(tx).removeLayer(src_layer); // src_layer is deleted inside removeLayer()
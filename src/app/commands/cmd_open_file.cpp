@@ -30,7 +30,9 @@
 #include "doc/sprite.h"
 #include "ui/ui.h"
 
+#include <algorithm>
 #include <cstdio>
+#include <limits>
 
 namespace app {
 
@@ -79,6 +81,8 @@ OpenFileCommand::OpenFileCommand()
   , m_ui(true)
   , m_repeatCheckbox(false)
   , m_oneFrame(false)
+  , m_fromFrame(-1)
+  , m_toFrame(-1)
   , m_seqDecision(gen::SequenceDecision::ASK)
 {
 }
@@ -96,6 +100,16 @@ void OpenFileCommand::onLoadParams(const Params& params)
   m_repeatCheckbox = params.get_as<bool>("repeat_checkbox");
   m_oneFrame = params.get_as<bool>("oneframe");
 
+  // Range of frames to load (1-based, only cels in this range are
+  // loaded in .aseprite files)
+  m_fromFrame = m_toFrame = -1;
+  if (params.has_param("fromframe") || params.has_param("toframe")) {
+    m_fromFrame = std::max(0, params.get_as<int>("fromframe")-1);
+    m_toFrame = (params.has_param("toframe") ?
+                 std::max(m_fromFrame, doc::frame_t(params.get_as<int>("toframe")-1)):
+                 std::numeric_limits<doc::frame_t>::max());
+  }
+
   std::string sequence = params.get("sequence");
   if (m_oneFrame ||
       sequence == "skip" ||
@@ -196,6 +210,9 @@ void OpenFileCommand::onExecute(Context* context)
     if (!fop)
       return;
 
+    if (m_fromFrame >= 0)
+      fop->setLoadFrameRange(m_fromFrame, m_toFrame);
+
     if (fop->hasError()) {
       console.printf(fop->error().c_str());
       unrecent = true;
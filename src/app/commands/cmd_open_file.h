@@ -12,6 +12,7 @@
 #include "app/commands/command.h"
 #include "app/pref/preferences.h"
 #include "base/paths.h"
+#include "doc/frame.h"
 
 #include <string>
 
@@ -39,6 +40,8 @@ namespace app {
     bool m_ui;
     bool m_repeatCheckbox;
     bool m_oneFrame;
+    doc::frame_t m_fromFrame;
+    doc::frame_t m_toFrame;
     base::paths m_usedFiles;
     gen::SequenceDecision m_seqDecision;
   };
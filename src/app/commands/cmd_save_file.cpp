@@ -238,6 +238,13 @@ void SaveFileBaseCommand::saveDocumentInBackground(
   if (resizeOnTheFly == ResizeOnTheFly::On)
     fop->setOnTheFlyScale(scale);
 
+  // Compression level for .aseprite files (it's kept in the document
+  // format options for the following saves)
+  if (params().compression.isSet()) {
+    if (auto opts = std::dynamic_pointer_cast<AseOptions>(fop->formatOptions()))
+      opts->setCompression(params().compression());
+  }
+
   SaveFileJob job(fop.get(), params().ui());
   job.showProgressWindow();
 
@@ -11,6 +11,7 @@
 
 #include "app/commands/command.h"
 #include "app/commands/new_params.h"
+#include "app/file/ase_options.h"
 #include "doc/anidir.h"
 #include "doc/frames_sequence.h"
 #include "gfx/point.h"
@@ -35,6 +36,7 @@ namespace app {
     Param<double> scale { this, 1.0, "scale" };
     Param<gfx::Rect> bounds { this, gfx::Rect(), "bounds" };
     Param<bool> playSubtags { this, false, "playSubtags" };
+    Param<AseOptions::Compression> compression { this, AseOptions::Compression::Default, "compression" };
   };
 
   class SaveFileBaseCommand : public CommandWithNewParams<SaveFileParams> {
@@ -18,12 +18,13 @@
 #include "app/site.h"
 #include "doc/cel.h"
 #include "doc/frame_range.h"
-#include "doc/image_bits.h"
 #include "doc/layer.h"
 #include "doc/layer_tilemap.h"
 #include "doc/octree_map.h"
 #include "doc/palette.h"
 #include "doc/sprite.h"
+#include "doc/tile_usage.h"
+#include "doc/tileset.h"
 
 namespace app {
 
@@ -49,6 +50,7 @@ protected:
 private:
   void selectTiles(const Layer* layer,
                    const SelectedFrames& selectedFrames,
+                   const doc::TileUsage& usage,
                    PalettePicks& usedTiles);
 
   Modifier m_modifier;
@@ -91,16 +93,22 @@ void SelectPaletteColorsCommand::onLoadParams(const Params& params)
 void SelectPaletteColorsCommand::selectTiles(
   const Layer* layer,
   const SelectedFrames& selectedFrames,
+  const doc::TileUsage& usage,
   PalettePicks& usedTiles)
 {
   ASSERT(layer);
   ASSERT(layer->isTilemap());
 
-  // For each tile on each cel's tilemap
+  // For each tile used on each cel's tilemap (without scanning the
+  // tilemap, we use the tileset usage index)
   for (frame_t frame : selectedFrames) {
     if (Cel* cel = layer->cel(frame)) {
-      for (const doc::tile_t t : LockImageBits<TilemapTraits>(cel->image())) {
-        tile_index ti = doc::tile_geti(t);
+      const auto* tiles = usage.tilesUsedBy(cel->image());
+      if (!tiles)
+        continue;
+
+      for (const auto& tile : *tiles) {
+        const tile_index ti = tile.first;
         if (ti >= 0 && ti < usedTiles.size())
           usedTiles[ti] = true;
       }
@@ -207,11 +215,12 @@ void SelectPaletteColorsCommand::onExecute(Context* context)
     if (!tileset)
       return;
 
+    const doc::TileUsage& usage = tileset->usage();
     PalettePicks usedTiles(tileset->size());
     for (const Layer* layer : selectedLayers) {
       if (layer->isTilemap() &&
           static_cast<const LayerTilemap*>(layer)->tileset() == tileset) {
-        selectTiles(layer, selectedFrames, usedTiles);
+        selectTiles(layer, selectedFrames, usage, usedTiles);
       }
     }
 
@@ -20,6 +20,7 @@
 #include "app/console.h"
 #include "app/context_access.h"
 #include "app/doc_api.h"
+#include "app/doc_memory.h"
 #include "app/i18n/strings.h"
 #include "app/modules/gui.h"
 #include "app/pref/preferences.h"
@@ -300,6 +301,21 @@ void SpritePropertiesCommand::onExecute(Context* context)
     // How many frames
     window.frames()->setTextf("%d", (int)sprite->totalFrames());
 
+    // Memory used by the document
+    const DocMemoryUsage usage = calc_doc_memory_usage(document);
+    window.memory()->setText(
+      Strings::sprite_properties_memory_usage(
+        base::get_pretty_memory_size(usage.total()),
+        base::get_pretty_memory_size(usage.images),
+        base::get_pretty_memory_size(usage.compressedImages),
+        base::get_pretty_memory_size(usage.tilesets),
+        base::get_pretty_memory_size(usage.undo)));
+
+    // Out-of-core mode (only when it's enabled in the preferences)
+    window.mappedPixels()->setSelected(document->mappedPixels());
+    window.mappedPixels()->setVisible(
+      Preferences::instance().experimental.mappedPixelsThreshold() > 0);
+
     if (sprite->pixelFormat() == IMAGE_INDEXED) {
       color_button = new ColorButton(app::Color::fromIndex(sprite->transparentColor()),
                                      IMAGE_INDEXED,
@@ -403,6 +419,9 @@ void SpritePropertiesCommand::onExecute(Context* context)
 
     const UserData newUserData = window.getUserData();
 
+    // This is not an undoable change (it doesn't modify the sprite)
+    writer.document()->setMappedPixels(window.mappedPixels()->isSelected());
+
     if (index != sprite->transparentColor() ||
         pixelRatio != sprite->pixelRatio() ||
         newUserData != sprite->userData()) {
@@ -23,6 +23,7 @@
 #include "app/sprite_job.h"
 #include "app/util/resize_image.h"
 #include "base/convert_to.h"
+#include "base/thread_pool.h"
 #include "doc/algorithm/resize_image.h"
 #include "doc/cel.h"
 #include "doc/cels_range.h"
@@ -39,6 +40,9 @@
 #include "sprite_size.xml.h"
 
 #include <algorithm>
+#include <memory>
+#include <thread>
+#include <vector>
 
 #define PERC_FORMAT     "%.4g"
 
@@ -159,38 +163,78 @@ protected:
       }
     }
 
+    // Images of groups of cels are resized in parallel (each group
+    // has one cel per thread), and then the commands to replace them
+    // are added to the transaction from this thread. RotSprite uses
+    // static buffers, and the bilinear method on indexed images uses
+    // the sprite RgbMap, so they are resized from this thread.
+    std::vector<Cel*> cels;
+    for (Cel* cel : sprite()->uniqueCels())
+      cels.push_back(cel);
+
+    const bool parallel =
+      (m_resize_method != doc::algorithm::RESIZE_METHOD_ROTSPRITE &&
+       (m_resize_method != doc::algorithm::RESIZE_METHOD_BILINEAR ||
+        sprite()->pixelFormat() != IMAGE_INDEXED));
+    const int nthreads =
+      (parallel ? std::clamp<int>(std::thread::hardware_concurrency(), 1, 8): 1);
+    std::unique_ptr<base::thread_pool> threads;
+    if (nthreads > 1)
+      threads = std::make_unique<base::thread_pool>(nthreads);
+    std::vector<ImageRef> newImages(nthreads);
+
     // For each cel...
-    for (Cel* cel : sprite()->uniqueCels()) {
-      // We need to adjust only the origin/position of tilemap cels
-      // (because tiles are resized automatically when we resize the
-      // tileset).
-      if (cel->layer()->isTilemap()) {
-        Tileset* tileset = static_cast<LayerTilemap*>(cel->layer())->tileset();
-        gfx::Size canvasSize =
-          tileset->grid().tilemapSizeToCanvas(
-            gfx::Size(cel->image()->width(),
-                      cel->image()->height()));
-        gfx::Rect newBounds(cel->x()*scale.w,
-                            cel->y()*scale.h,
-                            canvasSize.w,
-                            canvasSize.h);
-        tx(new cmd::SetCelBoundsF(cel, newBounds));
-      }
-      else {
-        resize_cel_image(
-          tx, cel, scale,
-          m_resize_method,
-          cel->layer()->isReference() ?
-          -cel->boundsF().origin():
-          gfx::PointF(-cel->bounds().origin()));
+    for (int i=0; i<int(cels.size()); i+=nthreads) {
+      const int n = std::min<int>(nthreads, int(cels.size())-i);
+      if (threads) {
+        for (int j=0; j<n; ++j) {
+          Cel* cel = cels[i+j];
+          if (cel->layer()->isTilemap())
+            continue;
+
+          threads->execute([this, cel, &newImages, &scale, j]{
+            newImages[j] = create_resized_cel_image(cel, scale, m_resize_method);
+          });
+        }
+        threads->wait_all();
       }
 
-      jobProgress((float)progress / img_count);
-      ++progress;
+      for (int j=0; j<n; ++j) {
+        Cel* cel = cels[i+j];
+
+        // We need to adjust only the origin/position of tilemap cels
+        // (because tiles are resized automatically when we resize the
+        // tileset).
+        if (cel->layer()->isTilemap()) {
+          Tileset* tileset = static_cast<LayerTilemap*>(cel->layer())->tileset();
+          gfx::Size canvasSize =
+            tileset->grid().tilemapSizeToCanvas(
+              gfx::Size(cel->image()->width(),
+                        cel->image()->height()));
+          gfx::Rect newBounds(cel->x()*scale.w,
+                              cel->y()*scale.h,
+                              canvasSize.w,
+                              canvasSize.h);
+          tx(new cmd::SetCelBoundsF(cel, newBounds));
+        }
+        else {
+          resize_cel_image(
+            tx, cel, scale,
+            m_resize_method,
+            cel->layer()->isReference() ?
+            -cel->boundsF().origin():
+            gfx::PointF(-cel->bounds().origin()),
+            newImages[j]);
+          newImages[j].reset();
+        }
+
+        jobProgress((float)progress / img_count);
+        ++progress;
 
-      // Cancel all the operation?
-      if (isCanceled())
-        return;        // Tx destructor will undo all operations
+        // Cancel all the operation?
+        if (isCanceled())
+          return;        // Tx destructor will undo all operations
+      }
     }
 
     // Resize mask
@@ -0,0 +1,235 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/color.h"
+#include "app/color_utils.h"
+#include "app/commands/command.h"
+#include "app/commands/filters/filter_chain_item.h"
+#include "app/commands/filters/filter_manager_impl.h"
+#include "app/commands/filters/filter_worker.h"
+#include "app/commands/new_params.h"
+#include "app/context.h"
+#include "app/pref/preferences.h"
+#include "app/site.h"
+#include "base/string.h"
+#include "doc/sprite.h"
+#include "filters/brightness_contrast_filter.h"
+#include "filters/color_curve.h"
+#include "filters/color_curve_filter.h"
+#include "filters/filter_chain.h"
+#include "filters/hue_saturation_filter.h"
+#include "filters/invert_color_filter.h"
+#include "filters/replace_color_filter.h"
+
+namespace app {
+
+using namespace filters;
+
+namespace {
+
+class BrightnessContrastItem : public FilterChainItem {
+public:
+  Param<double> brightness { this, 0.0, "brightness" };
+  Param<double> contrast { this, 0.0, "contrast" };
+
+  std::unique_ptr<Filter> createFilter(const Site& site) const override {
+    auto filter = std::make_unique<BrightnessContrastFilter>();
+    if (brightness.isSet()) filter->setBrightness(brightness() / 100.0);
+    if (contrast.isSet()) filter->setContrast(contrast() / 100.0);
+    return filter;
+  }
+
+protected:
+  Target defaultTarget(const Site& site) const override {
+    return TARGET_RED_CHANNEL |
+           TARGET_GREEN_CHANNEL |
+           TARGET_BLUE_CHANNEL |
+           TARGET_GRAY_CHANNEL |
+           TARGET_ALPHA_CHANNEL;
+  }
+};
+
+class HueSaturationItem : public FilterChainItem {
+public:
+  Param<HueSaturationFilter::Mode> mode { this, HueSaturationFilter::Mode::HSL_MUL, "mode" };
+  Param<double> hue { this, 0.0, "hue" };
+  Param<double> saturation { this, 0.0, "saturation" };
+  Param<double> lightness { this, 0.0, { "lightness", "value" } };
+  Param<double> alpha { this, 0.0, "alpha" };
+
+  std::unique_ptr<Filter> createFilter(const Site& site) const override {
+    auto filter = std::make_unique<HueSaturationFilter>();
+    if (mode.isSet()) filter->setMode(mode());
+    if (hue.isSet()) filter->setHue(hue());
+    if (saturation.isSet()) filter->setSaturation(saturation() / 100.0);
+    if (lightness.isSet()) filter->setLightness(lightness() / 100.0);
+    if (alpha.isSet()) filter->setAlpha(alpha() / 100.0);
+    return filter;
+  }
+
+protected:
+  Target defaultTarget(const Site& site) const override {
+    return TARGET_RED_CHANNEL |
+           TARGET_GREEN_CHANNEL |
+           TARGET_BLUE_CHANNEL |
+           TARGET_GRAY_CHANNEL |
+           TARGET_ALPHA_CHANNEL;
+  }
+};
+
+class ColorCurveItem : public FilterChainItem {
+public:
+  Param<ColorCurve> curve { this, ColorCurve(), "curve" };
+
+  std::unique_ptr<Filter> createFilter(const Site& site) const override {
+    auto filter = std::make_unique<ColorCurveFilter>();
+    if (curve.isSet())
+      filter->setCurve(curve());
+    else {
+      ColorCurve defaultCurve;
+      defaultCurve.addDefaultPoints();
+      filter->setCurve(defaultCurve);
+    }
+    return filter;
+  }
+
+protected:
+  Target defaultTarget(const Site& site) const override {
+    return TARGET_RED_CHANNEL |
+           TARGET_GREEN_CHANNEL |
+           TARGET_BLUE_CHANNEL |
+           TARGET_GRAY_CHANNEL;
+  }
+};
+
+class InvertColorItem : public FilterChainItem {
+public:
+  std::unique_ptr<Filter> createFilter(const Site& site) const override {
+    return std::make_unique<InvertColorFilter>();
+  }
+
+protected:
+  Target defaultTarget(const Site& site) const override {
+    return TARGET_RED_CHANNEL |
+           TARGET_GREEN_CHANNEL |
+           TARGET_BLUE_CHANNEL |
+           TARGET_GRAY_CHANNEL;
+  }
+};
+
+class ReplaceColorItem : public FilterChainItem {
+public:
+  Param<app::Color> from { this, app::Color(), "from" };
+  Param<app::Color> to { this, app::Color(), "to" };
+  Param<int> tolerance { this, 0, "tolerance" };
+
+  std::unique_ptr<Filter> createFilter(const Site& site) const override {
+    auto filter = std::make_unique<ReplaceColorFilter>();
+    const app::Color fromColor =
+      (from.isSet() ? from(): Preferences::instance().colorBar.fgColor());
+    const app::Color toColor =
+      (to.isSet() ? to(): Preferences::instance().colorBar.bgColor());
+    if (site.layer()) {
+      filter->setFrom(color_utils::color_for_layer(fromColor, site.layer()));
+      filter->setTo(color_utils::color_for_layer(toColor, site.layer()));
+    }
+    if (tolerance.isSet()) filter->setTolerance(tolerance());
+    return filter;
+  }
+
+protected:
+  Target defaultTarget(const Site& site) const override {
+    return (site.sprite()->pixelFormat() == IMAGE_INDEXED ?
+            TARGET_INDEX_CHANNEL:
+            TARGET_RED_CHANNEL |
+            TARGET_GREEN_CHANNEL |
+            TARGET_BLUE_CHANNEL |
+            TARGET_GRAY_CHANNEL |
+            TARGET_ALPHA_CHANNEL);
+  }
+};
+
+} // anonymous namespace
+
+// static
+std::shared_ptr<FilterChainItem> FilterChainItem::create(const std::string& name)
+{
+  if (base::utf8_icmp(name, "BrightnessContrast") == 0)
+    return std::make_shared<BrightnessContrastItem>();
+  if (base::utf8_icmp(name, "HueSaturation") == 0)
+    return std::make_shared<HueSaturationItem>();
+  if (base::utf8_icmp(name, "ColorCurve") == 0)
+    return std::make_shared<ColorCurveItem>();
+  if (base::utf8_icmp(name, "InvertColor") == 0)
+    return std::make_shared<InvertColorItem>();
+  if (base::utf8_icmp(name, "ReplaceColor") == 0)
+    return std::make_shared<ReplaceColorItem>();
+  return nullptr;
+}
+
+// Applies several filters in one pass (one undoable change), e.g.
+// from Lua:
+//
+//   app.command.FilterChain{
+//     filters={ { "BrightnessContrast", brightness=20 },
+//               { "HueSaturation", hue=30, saturation=10 } } }
+//
+// or from a string param:
+//
+//   filters="BrightnessContrast brightness=20; HueSaturation hue=30"
+//
+struct FilterChainParams : public NewParams {
+  Param<filters::Target> channels { this, 0, "channels" };
+  Param<FilterChainItems> items { this, FilterChainItems(), "filters" };
+};
+
+class FilterChainCommand : public CommandWithNewParams<FilterChainParams> {
+public:
+  FilterChainCommand();
+
+protected:
+  bool onEnabled(Context* context) override;
+  void onExecute(Context* context) override;
+};
+
+FilterChainCommand::FilterChainCommand()
+  : CommandWithNewParams<FilterChainParams>(CommandId::FilterChain(), CmdRecordableFlag)
+{
+}
+
+bool FilterChainCommand::onEnabled(Context* context)
+{
+  return context->checkFlags(ContextFlags::ActiveDocumentIsWritable |
+                             ContextFlags::HasActiveSprite);
+}
+
+void FilterChainCommand::onExecute(Context* context)
+{
+  Site site = context->activeSite();
+
+  FilterChain chain;
+  for (const auto& item : params().items())
+    chain.addFilter(item->createFilter(site), item->target(site));
+  if (chain.empty())
+    return;
+
+  FilterManagerImpl filterMgr(context, &chain);
+  filterMgr.setTarget(TARGET_ALL_CHANNELS | TARGET_INDEX_CHANNEL);
+  if (params().channels.isSet()) filterMgr.setTarget(params().channels());
+
+  start_filter_worker(&filterMgr);
+}
+
+Command* CommandFactory::createFilterChainCommand()
+{
+  return new FilterChainCommand;
+}
+
+} // namespace app
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -34,6 +34,8 @@
 
 #include "outline.xml.h"
 
+#include <algorithm>
+
 namespace app {
 
 using namespace app::skin;
@@ -45,6 +47,7 @@ struct OutlineParams : public NewParams {
   Param<filters::Target> channels { this, 0, "channels" };
   Param<filters::OutlineFilter::Place> place { this, OutlineFilter::Place::Outside, "place" };
   Param<filters::OutlineFilter::Matrix> matrix { this, OutlineFilter::Matrix::Circle, "matrix" };
+  Param<int> width { this, 1, "width" };
   Param<app::Color> color { this, app::Color(), "color" };
   Param<app::Color> bgColor { this, app::Color(), "bgColor" };
   Param<filters::TiledMode> tiledMode { this, filters::TiledMode::NONE, "tiledMode" };
@@ -94,6 +97,7 @@ public:
     m_panel.color()->setColor(m_filter.color());
     m_panel.bgColor()->setColor(m_filter.bgColor());
     m_panel.place()->setSelectedItem((int)m_filter.place());
+    m_panel.width()->setValue(m_filter.width());
     updateButtonsFromMatrix();
 
     m_panel.color()->Change.connect(&OutlineWindow::onColorChange, this);
@@ -110,6 +114,10 @@ public:
       [this](ButtonSet::Item*){
         onPlaceChange((OutlineFilter::Place)m_panel.place()->selectedItem());
       });
+    m_panel.width()->Change.connect(
+      [this]{
+        onWidthChange(m_panel.width()->getValue());
+      });
   }
 
 private:
@@ -154,6 +162,12 @@ private:
     restartPreview();
   }
 
+  void onWidthChange(const int width) {
+    stopPreview();
+    m_filter.width(width);
+    restartPreview();
+  }
+
   void onMatrixTypeChange() {
     stopPreview();
 
@@ -231,6 +245,7 @@ void OutlineCommand::onExecute(Context* context)
   if (ui) {
     filter.place((OutlineFilter::Place)get_config_int(ConfigSection, "Place", int(OutlineFilter::Place::Outside)));
     filter.matrix((OutlineFilter::Matrix)get_config_int(ConfigSection, "Matrix", int(OutlineFilter::Matrix::Circle)));
+    filter.width(get_config_int(ConfigSection, "Width", 1));
     filter.color(ColorBar::instance()->getFgColor());
 
     DocumentPreferences& docPref = Preferences::instance()
@@ -241,6 +256,7 @@ void OutlineCommand::onExecute(Context* context)
 
   if (params().place.isSet()) filter.place(params().place());
   if (params().matrix.isSet()) filter.matrix(params().matrix());
+  if (params().width.isSet()) filter.width(std::clamp(params().width(), 1, 256));
   if (params().color.isSet()) filter.color(params().color());
   if (params().bgColor.isSet()) filter.bgColor(params().bgColor());
   if (params().tiledMode.isSet()) filter.tiledMode(params().tiledMode());
@@ -263,6 +279,7 @@ void OutlineCommand::onExecute(Context* context)
     if (window.doModal()) {
       set_config_int(ConfigSection, "Place", int(filter.place()));
       set_config_int(ConfigSection, "Matrix", int(filter.matrix()));
+      set_config_int(ConfigSection, "Width", filter.width());
     }
   }
   else
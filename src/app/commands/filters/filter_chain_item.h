@@ -0,0 +1,56 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_COMMANDS_FILTERS_FILTER_CHAIN_ITEM_H_INCLUDED
+#define APP_COMMANDS_FILTERS_FILTER_CHAIN_ITEM_H_INCLUDED
+#pragma once
+
+#include "app/commands/new_params.h"
+#include "filters/target.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace filters {
+  class Filter;
+}
+
+namespace app {
+  class Site;
+
+  // One filter of the FilterChain command with its parameters. The
+  // parameters have the same names and units as the command of each
+  // filter (e.g. "brightness" from -100 to 100 like the
+  // BrightnessContrast command).
+  class FilterChainItem : public NewParams {
+  public:
+    virtual ~FilterChainItem() { }
+
+    // Creates the filter with the given parameters.
+    virtual std::unique_ptr<filters::Filter> createFilter(const Site& site) const = 0;
+
+    // Channels modified by this filter (the same default channels as
+    // the command of the filter).
+    filters::Target target(const Site& site) const {
+      return (channels.isSet() ? channels(): defaultTarget(site));
+    }
+
+    // Returns nullptr if there is no filter with the given name (or
+    // it cannot be chained, e.g. filters that use neighbor pixels).
+    static std::shared_ptr<FilterChainItem> create(const std::string& name);
+
+    Param<filters::Target> channels { this, 0, "channels" };
+
+  protected:
+    virtual filters::Target defaultTarget(const Site& site) const = 0;
+  };
+
+  using FilterChainItems = std::vector<std::shared_ptr<FilterChainItem>>;
+
+} // namespace app
+
+#endif
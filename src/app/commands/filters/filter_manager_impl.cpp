@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -16,6 +16,7 @@
 #include "app/cmd/patch_cel.h"
 #include "app/cmd/set_palette.h"
 #include "app/cmd/unlink_cel.h"
+#include "app/commands/filters/filter_shaders.h"
 #include "app/context_access.h"
 #include "app/doc.h"
 #include "app/ini_file.h"
@@ -34,22 +35,142 @@
 #include "doc/cels_range.h"
 #include "doc/image.h"
 #include "doc/layer.h"
+#include "doc/locked_rgbmap.h"
 #include "doc/mask.h"
 #include "doc/sprite.h"
+#include "doc/task_scheduler.h"
 #include "filters/filter.h"
 #include "ui/manager.h"
 #include "ui/view.h"
 #include "ui/widget.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
+#include <mutex>
+#include <optional>
 #include <set>
+#include <thread>
 
 namespace app {
 
 using namespace std;
 using namespace ui;
 
+// Minimum number of pixels to apply the filter from several threads.
+static constexpr int kMinPixelsToParallelize = 256*256;
+
+// Number of rows that each thread filters in each round. Between
+// rounds we report the progress and check if the user cancelled the
+// process.
+static constexpr int kRowsPerBand = 32;
+
+#ifdef ENABLE_UI
+// Minimum number of pixels to show a low resolution preview first.
+static constexpr int kMinPixelsForLowResPreview = 256*256;
+#endif
+
+// Lightweight FilterManager used to apply the filter to a band of
+// rows [row, rowEnd) of the given source/destination images from a
+// worker thread. It has its own row, mask iterator, and RgbMap cache,
+// and uses the bounds/mask/palette of the FilterManagerImpl.
+class FilterManagerImpl::RowsManager : public FilterManager
+                                     , public FilterIndexedData {
+public:
+  RowsManager(FilterManagerImpl* mgr,
+              const Image* src,
+              Image* dst,
+              const Target target,
+              const RgbMap* rgbmap,
+              std::mutex& rgbmapMutex,
+              const int row,
+              const int rowEnd)
+    : m_mgr(mgr)
+    , m_src(src)
+    , m_dst(dst)
+    , m_target(target)
+    , m_row(row)
+    , m_rowEnd(rowEnd) {
+    if (rgbmap)
+      m_rgbmap.emplace(rgbmap, rgbmapMutex);
+  }
+
+  void run() {
+    Filter* filter = m_mgr->m_filter;
+    const PixelFormat pixelFormat = this->pixelFormat();
+    for (; m_row < m_rowEnd && !taskToken().canceled(); ++m_row) {
+      if (!m_mgr->lockMaskRow(m_row, m_maskBits, m_maskIterator))
+        break;
+
+      switch (pixelFormat) {
+        case IMAGE_RGB:       filter->applyToRgba(this); break;
+        case IMAGE_GRAYSCALE: filter->applyToGrayscale(this); break;
+        case IMAGE_INDEXED:   filter->applyToIndexed(this); break;
+      }
+    }
+  }
+
+  // FilterManager implementation
+  doc::PixelFormat pixelFormat() const override {
+    return m_mgr->pixelFormat();
+  }
+  const void* getSourceAddress() override {
+    return m_src->getPixelAddress(m_mgr->m_bounds.x,
+                                  m_mgr->m_bounds.y+m_row);
+  }
+  void* getDestinationAddress() override {
+    return m_dst->getPixelAddress(m_mgr->m_bounds.x,
+                                  m_mgr->m_bounds.y+m_row);
+  }
+  int getWidth() override { return m_mgr->m_bounds.w; }
+  Target getTarget() override { return m_target; }
+  FilterIndexedData* getIndexedData() override { return this; }
+  bool skipPixel() override {
+    bool skip = false;
+    if (m_mgr->m_mask && m_mgr->m_mask->bitmap()) {
+      if (!*m_maskIterator)
+        skip = true;
+      ++m_maskIterator;
+    }
+    return skip;
+  }
+  const doc::Image* getSourceImage() override { return m_src; }
+  int x() const override { return m_mgr->m_bounds.x; }
+  int y() const override { return m_mgr->m_bounds.y+m_row; }
+  bool isFirstRow() const override { return m_row == 0; }
+  bool isMaskActive() const override { return m_mgr->isMaskActive(); }
+  base::task_token& taskToken() const override { return m_mgr->taskToken(); }
+
+  // FilterIndexedData implementation
+  const doc::Palette* getPalette() const override {
+    return m_mgr->getPalette();
+  }
+  const doc::RgbMap* getRgbMap() const override {
+    ASSERT(m_rgbmap);
+    return &*m_rgbmap;
+  }
+  doc::Palette* getNewPalette() override {
+    // The palette is modified only from the main thread (before
+    // applying the filter to the rows).
+    ASSERT(false);
+    return m_mgr->getNewPalette();
+  }
+  doc::PalettePicks getPalettePicks() override {
+    return m_mgr->getPalettePicks();
+  }
+
+private:
+  FilterManagerImpl* m_mgr;
+  const Image* m_src;
+  Image* m_dst;
+  Target m_target;
+  int m_row;
+  int m_rowEnd;
+  doc::ImageBits<doc::BitmapTraits> m_maskBits;
+  doc::ImageBits<doc::BitmapTraits>::iterator m_maskIterator;
+  std::optional<doc::LockedRgbMap> m_rgbmap;
+};
+
 FilterManagerImpl::FilterManagerImpl(Context* context, Filter* filter)
   : m_reader(context)
   , m_site(*const_cast<Site*>(m_reader.site()))
@@ -58,6 +179,7 @@ FilterManagerImpl::FilterManagerImpl(Context* context, Filter* filter)
   , m_src(nullptr)
   , m_dst(nullptr)
   , m_row(0)
+  , m_previewStep(1)
   , m_mask(nullptr)
   , m_previewMask(nullptr)
   , m_targetOrig(TARGET_ALL_CHANNELS)
@@ -121,6 +243,7 @@ void FilterManagerImpl::begin()
   Doc* document = m_site.document();
 
   m_row = 0;
+  m_previewStep = 1;
   m_mask = (document->isMaskVisible() ? document->mask(): nullptr);
   m_taskToken = &m_noToken; // Don't use the preview token (which can be canceled)
   updateBounds(m_mask);
@@ -139,7 +262,9 @@ void FilterManagerImpl::beginForPreview()
     m_previewMask->replace(m_site.sprite()->bounds());
   }
 
-  m_row = m_nextRowToFlush = 0;
+  m_row = 0;
+  m_previewStep = 1;
+  m_dirtyBegin = m_dirtyEnd = 0;
   m_mask = m_previewMask.get();
 
   // If we have a tiled mode enabled, we'll apply the filter to the whole areaes
@@ -164,6 +289,13 @@ void FilterManagerImpl::beginForPreview()
     m_row = -1;
     return;
   }
+
+  // For big areas we show a low resolution preview first (matching
+  // the zoom level of the editor when it's zoomed out).
+  if (m_bounds.w*m_bounds.h >= kMinPixelsForLowResPreview) {
+    const double scale = activeEditor->projection().scaleY();
+    m_previewStep = std::clamp(int(1.0 / scale), 2, 8);
+  }
 }
 
 #endif // ENABLE_UI
@@ -178,22 +310,24 @@ bool FilterManagerImpl::applyStep()
   if (m_row < 0 || m_row >= m_bounds.h)
     return false;
 
-  if (m_mask && m_mask->bitmap()) {
-    int x = m_bounds.x - m_mask->bounds().x;
-    int y = m_bounds.y - m_mask->bounds().y + m_row;
-    if ((x >= m_bounds.w) ||
-        (y >= m_bounds.h))
-      return false;
-
-    m_maskBits = m_mask->bitmap()
-      ->lockBits<BitmapTraits>(Image::ReadLock,
-        gfx::Rect(x, y, m_bounds.w - x, m_bounds.h - y));
-
-    m_maskIterator = m_maskBits.begin();
+  if (!lockMaskRow(m_row, m_maskBits, m_maskIterator)) {
+    // Rows are not sorted in the low resolution preview, so there
+    // might be other rows to calculate.
+    if (m_previewStep > 1) {
+      m_row = nextRow(m_row);
+      return true;
+    }
+    return false;
   }
 
   if (m_row == 0) {
     applyToPaletteIfNeeded();
+
+#if defined(ENABLE_UI) && SK_ENABLE_SKSL
+    // Preview point filters with a shader (all rows at once)
+    if (m_previewMask && applyShaderForPreview())
+      return true;
+#endif
   }
 
   switch (m_site.sprite()->pixelFormat()) {
@@ -201,66 +335,94 @@ bool FilterManagerImpl::applyStep()
     case IMAGE_GRAYSCALE: m_filter->applyToGrayscale(this); break;
     case IMAGE_INDEXED:   m_filter->applyToIndexed(this); break;
   }
-  ++m_row;
 
+  // Low resolution pass
+  int n = 0;
+  if (m_previewStep > 1 && (m_row % m_previewStep) == 0) {
+    n = std::min(m_previewStep, m_bounds.h - m_row) - 1;
+    if (!taskToken().canceled())
+      copyRowToNextRows(m_row, n);
+  }
+
+#ifdef ENABLE_UI
+  if (m_dirtyBegin < m_dirtyEnd) {
+    m_dirtyBegin = std::min(m_dirtyBegin, m_row);
+    m_dirtyEnd = std::max(m_dirtyEnd, m_row+n+1);
+  }
+  else {
+    m_dirtyBegin = m_row;
+    m_dirtyEnd = m_row+n+1;
+  }
+#endif
+
+  m_row = nextRow(m_row);
   return true;
 }
 
+int FilterManagerImpl::nextRow(const int row) const
+{
+  if (m_previewStep <= 1)
+    return row+1;
+
+  // First pass: one row of each m_previewStep rows
+  if ((row % m_previewStep) == 0) {
+    const int next = row + m_previewStep;
+    if (next < m_bounds.h)
+      return next;
+    // Start the second pass (if there are more rows)
+    return std::min(1, m_bounds.h);
+  }
+
+  // Second pass: skip the rows of the first pass
+  int next = row+1;
+  if ((next % m_previewStep) == 0)
+    ++next;
+  return std::min(next, m_bounds.h);
+}
+
+void FilterManagerImpl::copyRowToNextRows(const int row, const int n)
+{
+  const int bpp = m_dst->bytesPerPixel();
+  const uint8_t* srcRow = m_dst->getPixelAddress(m_bounds.x, m_bounds.y+row);
+
+  for (int i=1; i<=n; ++i) {
+    const int y = m_bounds.y+row+i;
+    uint8_t* dstRow = m_dst->getPixelAddress(m_bounds.x, y);
+
+    if (m_mask && m_mask->bitmap()) {
+      for (int x=0; x<m_bounds.w; ++x) {
+        if (m_mask->containsPoint(m_bounds.x+x, y))
+          std::copy(srcRow + x*bpp, srcRow + (x+1)*bpp, dstRow + x*bpp);
+      }
+    }
+    else
+      std::copy(srcRow, srcRow + m_bounds.w*bpp, dstRow);
+  }
+}
+
 void FilterManagerImpl::apply()
 {
   CommandResult result;
   bool cancelled = false;
 
   begin();
-  while (!cancelled && applyStep()) {
-    if (m_progressDelegate) {
-      // Report progress.
-      m_progressDelegate->reportProgress(m_progressBase + m_progressWidth * (m_row+1) / m_bounds.h);
-
-      // Does the user cancelled the whole process?
-      cancelled = m_progressDelegate->isCancelled();
-    }
+  if (canApplyInParallel()) {
+    cancelled = applyInParallel();
   }
+  else {
+    while (!cancelled && applyStep()) {
+      if (m_progressDelegate) {
+        // Report progress.
+        m_progressDelegate->reportProgress(m_progressBase + m_progressWidth * (m_row+1) / m_bounds.h);
 
-  if (!cancelled) {
-    gfx::Rect output;
-    if (algorithm::shrink_bounds2(m_src.get(), m_dst.get(),
-                                  m_bounds, output)) {
-      if (m_cel->layer()->isTilemap()) {
-        modify_tilemap_cel_region(
-          *m_tx,
-          m_cel, nullptr,
-          gfx::Region(output),
-          m_site.tilesetMode(),
-          [this](const doc::ImageRef& origTile,
-                 const gfx::Rect& tileBoundsInCanvas) -> doc::ImageRef {
-            return ImageRef(
-              crop_image(m_dst.get(),
-                         tileBoundsInCanvas.x,
-                         tileBoundsInCanvas.y,
-                         tileBoundsInCanvas.w,
-                         tileBoundsInCanvas.h,
-                         m_dst->maskColor()));
-          });
-      }
-      else if (m_cel->layer()->isBackground()) {
-        (*m_tx)(
-          new cmd::CopyRegion(
-            m_cel->image(),
-            m_dst.get(),
-            gfx::Region(output),
-            position()));
-      }
-      else {
-        // Patch "m_cel"
-        (*m_tx)(
-          new cmd::PatchCel(
-            m_cel, m_dst.get(),
-            gfx::Region(output),
-            position()));
+        // Does the user cancelled the whole process?
+        cancelled = m_progressDelegate->isCancelled();
       }
     }
+  }
 
+  if (!cancelled) {
+    patchCel(m_cel, m_src.get(), m_dst.get());
     result = CommandResult(CommandResult::kOk);
   }
   else {
@@ -271,6 +433,167 @@ void FilterManagerImpl::apply()
   m_reader.context()->setCommandResult(result);
 }
 
+void FilterManagerImpl::patchCel(Cel* cel, const Image* src, Image* dst)
+{
+  gfx::Rect output;
+  if (algorithm::shrink_bounds2(src, dst, m_bounds, output)) {
+    if (cel->layer()->isTilemap()) {
+      modify_tilemap_cel_region(
+        *m_tx,
+        cel, nullptr,
+        gfx::Region(output),
+        m_site.tilesetMode(),
+        [dst](const doc::ImageRef& origTile,
+              const gfx::Rect& tileBoundsInCanvas) -> doc::ImageRef {
+          return ImageRef(
+            crop_image(dst,
+                       tileBoundsInCanvas.x,
+                       tileBoundsInCanvas.y,
+                       tileBoundsInCanvas.w,
+                       tileBoundsInCanvas.h,
+                       dst->maskColor()));
+        });
+    }
+    else if (cel->layer()->isBackground()) {
+      (*m_tx)(
+        new cmd::CopyRegion(
+          cel->image(),
+          dst,
+          gfx::Region(output),
+          position()));
+    }
+    else {
+      // Patch "cel"
+      (*m_tx)(
+        new cmd::PatchCel(
+          cel, dst,
+          gfx::Region(output),
+          position()));
+    }
+  }
+}
+
+bool FilterManagerImpl::canApplyInParallel() const
+{
+  return (m_filter->isParallelizable() &&
+          std::thread::hardware_concurrency() > 1 &&
+          m_bounds.h > kRowsPerBand &&
+          m_bounds.w*m_bounds.h >= kMinPixelsToParallelize);
+}
+
+bool FilterManagerImpl::applyInParallel()
+{
+  ASSERT(m_row == 0);
+  applyToPaletteIfNeeded();
+
+  // The shared RgbMap is created/regenerated here (in the calling
+  // thread), then each band uses it through its own LockedRgbMap.
+  const RgbMap* rgbmap =
+    (pixelFormat() == IMAGE_INDEXED ? getRgbMap(): nullptr);
+  std::mutex rgbmapMutex;
+
+  doc::TaskGroup group(doc::TaskPriority::Interactive);
+  const int nthreads = std::clamp(group.threads(), 1, 8);
+  bool cancelled = false;
+
+  while (!cancelled && m_row < m_bounds.h) {
+    const int rowEnd = std::min(m_row + nthreads*kRowsPerBand, m_bounds.h);
+    for (int row=m_row; row<rowEnd; row+=kRowsPerBand) {
+      group.run([this, rgbmap, &rgbmapMutex, row, rowEnd]{
+        RowsManager band(this, m_src.get(), m_dst.get(), m_target,
+                         rgbmap, rgbmapMutex,
+                         row, std::min(row+kRowsPerBand, rowEnd));
+        band.run();
+      });
+    }
+    group.wait();
+    m_row = rowEnd;
+
+    if (m_progressDelegate) {
+      m_progressDelegate->reportProgress(m_progressBase + m_progressWidth * m_row / m_bounds.h);
+      cancelled = m_progressDelegate->isCancelled();
+    }
+    if (taskToken().canceled())
+      cancelled = true;
+  }
+  return cancelled;
+}
+
+bool FilterManagerImpl::canApplyToCelsInParallel(const CelList& cels) const
+{
+  return (m_filter->isParallelizable() &&
+          std::thread::hardware_concurrency() > 1 &&
+          cels.size() > 1);
+}
+
+void FilterManagerImpl::applyToCelsInParallel(const CelList& cels)
+{
+  Doc* doc = m_site.document();
+  if (!updateBounds(doc->isMaskVisible() ? doc->mask(): nullptr))
+    throw InvalidAreaException();
+
+  begin();
+
+  const RgbMap* rgbmap =
+    (pixelFormat() == IMAGE_INDEXED ? getRgbMap(): nullptr);
+  std::mutex rgbmapMutex;
+
+  struct CelImages {
+    Cel* cel = nullptr;
+    ImageRef src;
+    ImageRef dst;
+  };
+
+  doc::TaskGroup group(doc::TaskPriority::Interactive);
+  const int nthreads = std::clamp(group.threads(), 1, 8);
+
+  // Each round filters (at most) one cel per thread, so we don't keep
+  // the source/destination images of all cels in memory at the same
+  // time. Then the cels are patched in the same order as the serial
+  // version (so the undo history is deterministic).
+  std::vector<CelImages> round(nthreads);
+  bool cancelled = false;
+  const int n = int(cels.size());
+  for (int i=0; i<n && !cancelled; i+=nthreads) {
+    const int m = std::min(nthreads, n-i);
+    for (int j=0; j<m; ++j) {
+      round[j].cel = cels[i+j];
+      group.run([this, &round, rgbmap, &rgbmapMutex, j]{
+        CelImages& images = round[j];
+        images.src = crop_cel_image(images.cel, 0);
+        images.dst.reset(Image::createCopy(images.src.get()));
+
+        Target target = m_targetOrig;
+        if (images.cel->layer()->isBackground())
+          target &= ~TARGET_ALPHA_CHANNEL;
+
+        RowsManager rows(this, images.src.get(), images.dst.get(), target,
+                         rgbmap, rgbmapMutex, 0, m_bounds.h);
+        rows.run();
+      });
+    }
+    group.wait();
+
+    for (int j=0; j<m; ++j) {
+      patchCel(round[j].cel, round[j].src.get(), round[j].dst.get());
+      round[j] = CelImages();
+    }
+
+    if (m_progressDelegate) {
+      m_progressBase += m_progressWidth * m;
+      m_progressDelegate->reportProgress(m_progressBase);
+      cancelled = m_progressDelegate->isCancelled();
+    }
+  }
+
+  end();
+
+  ASSERT(m_reader.context());
+  m_reader.context()->setCommandResult(
+    CommandResult(cancelled ? CommandResult::kCanceled:
+                              CommandResult::kOk));
+}
+
 void FilterManagerImpl::applyToTarget()
 {
   applyToPaletteIfNeeded();
@@ -325,24 +648,35 @@ void FilterManagerImpl::applyToTarget()
                           m_site.frame(), &newPalette));
   }
 
-  // For each target image
-  for (auto it = cels.begin();
-       it != cels.end() && !cancelled;
-       ++it) {
-    Image* image = (*it)->image();
-
+  if (canApplyToCelsInParallel(cels)) {
     // Avoid applying the filter two times to the same image
-    if (visited.find(image->id()) == visited.end()) {
-      visited.insert(image->id());
-      applyToCel(*it);
+    CelList uniqueCels;
+    for (Cel* cel : cels) {
+      if (visited.insert(cel->image()->id()).second)
+        uniqueCels.push_back(cel);
     }
+    applyToCelsInParallel(uniqueCels);
+  }
+  else {
+    // For each target image
+    for (auto it = cels.begin();
+         it != cels.end() && !cancelled;
+         ++it) {
+      Image* image = (*it)->image();
+
+      // Avoid applying the filter two times to the same image
+      if (visited.find(image->id()) == visited.end()) {
+        visited.insert(image->id());
+        applyToCel(*it);
+      }
 
-    // Is there a delegate to know if the process was cancelled by the user?
-    if (m_progressDelegate)
-      cancelled = m_progressDelegate->isCancelled();
+      // Is there a delegate to know if the process was cancelled by the user?
+      if (m_progressDelegate)
+        cancelled = m_progressDelegate->isCancelled();
 
-    // Make progress
-    m_progressBase += m_progressWidth;
+      // Make progress
+      m_progressBase += m_progressWidth;
+    }
   }
 
   // Reset m_oldPalette to avoid restoring the color palette
@@ -374,25 +708,42 @@ void FilterManagerImpl::commitTransaction()
 
 #ifdef ENABLE_UI
 
+#if SK_ENABLE_SKSL
+bool FilterManagerImpl::applyShaderForPreview()
+{
+  // The shader is applied to the whole m_bounds rectangle
+  if (m_mask && m_mask->bitmap() && !m_mask->isRectangular())
+    return false;
+
+  if (!apply_filter_shader(m_filter, m_target,
+                           m_src.get(), m_dst.get(), m_bounds))
+    return false;
+
+  m_dirtyBegin = 0;
+  m_dirtyEnd = m_row = m_bounds.h;
+  return true;
+}
+#endif
+
 void FilterManagerImpl::flush()
 {
-  int h = m_row - m_nextRowToFlush;
+  const int h = m_dirtyEnd - m_dirtyBegin;
 
   if (m_row >= 0 && h > 0) {
     // Redraw the color palette
-    if (m_nextRowToFlush == 0 && paletteHasChanged())
+    if (m_dirtyBegin == 0 && paletteHasChanged())
       redrawColorPalette();
 
     for (Editor* editor : UIContext::instance()->getAllEditorsIncludingPreview(document())) {
       // We expand the region one pixel at the top and bottom of the
-      // region [m_row,m_nextRowToFlush) to be updated on the screen to
+      // region [m_dirtyBegin,m_dirtyEnd) to be updated on the screen to
       // avoid screen artifacts when we apply filters like convolution
       // matrices.
       gfx::Rect rect(
         editor->editorToScreen(
           gfx::Point(
             m_bounds.x,
-            m_bounds.y+m_nextRowToFlush-1)),
+            m_bounds.y+m_dirtyBegin-1)),
         gfx::Size(
           editor->projection().applyX(m_bounds.w),
           (editor->projection().scaleY() >= 1 ? editor->projection().applyY(h+2):
@@ -408,7 +759,7 @@ void FilterManagerImpl::flush()
       editor->invalidateRegion(reg1);
     }
 
-    m_nextRowToFlush = m_row+1;
+    m_dirtyBegin = m_dirtyEnd = 0;
   }
 }
 
@@ -518,6 +869,26 @@ bool FilterManagerImpl::updateBounds(doc::Mask* mask)
   return !m_bounds.isEmpty();
 }
 
+bool FilterManagerImpl::lockMaskRow(const int row,
+                                    ImageBits<BitmapTraits>& maskBits,
+                                    ImageBits<BitmapTraits>::iterator& maskIterator) const
+{
+  if (m_mask && m_mask->bitmap()) {
+    int x = m_bounds.x - m_mask->bounds().x;
+    int y = m_bounds.y - m_mask->bounds().y + row;
+    if ((x >= m_bounds.w) ||
+        (y >= m_bounds.h))
+      return false;
+
+    maskBits = m_mask->bitmap()
+      ->lockBits<BitmapTraits>(Image::ReadLock,
+        gfx::Rect(x, y, m_bounds.w - x, m_bounds.h - y));
+
+    maskIterator = maskBits.begin();
+  }
+  return true;
+}
+
 bool FilterManagerImpl::paletteHasChanged()
 {
   return
@@ -15,6 +15,7 @@
 #include "app/tx.h"
 #include "base/exception.h"
 #include "base/task.h"
+#include "doc/cel_list.h"
 #include "doc/image_impl.h"
 #include "doc/image_ref.h"
 #include "doc/pixel_format.h"
@@ -130,11 +131,43 @@ namespace app {
     doc::PalettePicks getPalettePicks() override;
 
   private:
+    class RowsManager;
+
     void init(doc::Cel* cel);
     void apply();
     void applyToCel(doc::Cel* cel);
     bool updateBounds(doc::Mask* mask);
 
+    // Applies the filter to bands of rows from several threads (only
+    // for big areas and filters that support it). Returns true if the
+    // user cancelled the process.
+    bool canApplyInParallel() const;
+    bool applyInParallel();
+
+    // Applies the filter to several cels at the same time (one cel
+    // per thread).
+    bool canApplyToCelsInParallel(const doc::CelList& cels) const;
+    void applyToCelsInParallel(const doc::CelList& cels);
+
+    // Adds the undoable command to patch the given cel with the
+    // modified pixels of "dst".
+    void patchCel(doc::Cel* cel, const doc::Image* src, doc::Image* dst);
+
+    // Returns the next row to calculate in applyStep() (depending on
+    // m_previewStep).
+    int nextRow(int row) const;
+
+    // Copies the already calculated "row" of m_dst to the next "n"
+    // rows (only selected pixels).
+    void copyRowToNextRows(int row, int n);
+
+    // Locks the mask bits of the given row in "maskBits" and
+    // initializes "maskIterator" (when there is a mask). Returns false
+    // if the row is outside the mask.
+    bool lockMaskRow(int row,
+                     doc::ImageBits<doc::BitmapTraits>& maskBits,
+                     doc::ImageBits<doc::BitmapTraits>::iterator& maskIterator) const;
+
     // Returns true if the palette was changed (true when the filter
     // modifies the palette).
     bool paletteHasChanged();
@@ -143,6 +176,11 @@ namespace app {
 
 #ifdef ENABLE_UI
     void redrawColorPalette();
+#if SK_ENABLE_SKSL
+    // Applies the filter to the preview using a shader (if the filter
+    // has one). Returns false if it wasn't possible.
+    bool applyShaderForPreview();
+#endif
 #endif
 
     ContextReader m_reader;
@@ -153,8 +191,15 @@ namespace app {
     doc::ImageRef m_src;
     doc::ImageRef m_dst;
     int m_row;
+    // Rows are calculated in two passes when m_previewStep > 1: first
+    // one of each m_previewStep rows (copied to the following rows to
+    // show a low resolution preview as soon as possible), and then the
+    // remaining rows.
+    int m_previewStep;
 #ifdef ENABLE_UI
-    int m_nextRowToFlush;
+    // Range of rows [m_dirtyBegin, m_dirtyEnd) to flush to the screen.
+    int m_dirtyBegin;
+    int m_dirtyEnd;
 #endif
     gfx::Rect m_bounds;
     doc::Mask* m_mask;
@@ -0,0 +1,225 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#if SK_ENABLE_SKSL
+
+#include "app/commands/filters/filter_shaders.h"
+
+#include "app/util/shader_helpers.h"
+#include "base/debug.h"
+#include "doc/image.h"
+#include "filters/brightness_contrast_filter.h"
+#include "filters/color_curve_filter.h"
+#include "filters/hue_saturation_filter.h"
+#include "filters/invert_color_filter.h"
+
+#include "include/core/SkCanvas.h"
+#include "include/core/SkData.h"
+#include "include/core/SkImage.h"
+#include "include/effects/SkRuntimeEffect.h"
+
+#include <string>
+#include <vector>
+
+namespace app {
+
+using namespace filters;
+
+namespace {
+
+// All shaders receive the unpremultiplied source pixels (iImg is a
+// raw shader) and the channels to modify (iTarget, 1 for each
+// channel in the target), and return premultiplied colors.
+
+const char* kInvertShaderCode = R"(
+uniform shader iImg;
+uniform half4 iTarget;
+
+half4 main(vec2 fragcoord) {
+ half4 c = iImg.eval(fragcoord);
+ c = mix(c, 1 - c, iTarget);
+ return half4(c.rgb * c.a, c.a);
+}
+)";
+
+// iMap is a 256x1 image with the new value of each channel value
+// (used for brightness/contrast and color curve).
+const char* kColorMapShaderCode = R"(
+uniform shader iImg;
+uniform shader iMap;
+uniform half4 iTarget;
+
+half map(half v) {
+ return iMap.eval(float2(floor(float(v)*255 + 0.5) + 0.5, 0.5)).a;
+}
+
+half4 main(vec2 fragcoord) {
+ half4 c = iImg.eval(fragcoord);
+ c = mix(c, half4(map(c.r), map(c.g), map(c.b), map(c.a)), iTarget);
+ return half4(c.rgb * c.a, c.a);
+}
+)";
+
+// Same as HueSaturationFilter::applyFilterToRgbT()
+const char* kHueSaturationShaderCode = R"(
+uniform shader iImg;
+uniform half4 iTarget;
+uniform float iHue;          // Hue to add in [-0.5, 0.5] range
+uniform float iSaturation;
+uniform float iLightness;
+uniform float iAlpha;
+uniform float iHsl;          // 1 for HSL, 0 for HSV
+uniform float iMultiply;     // 1 to multiply, 0 to add
+
+half4 main(vec2 fragcoord) {
+ half4 c = iImg.eval(fragcoord);
+ half3 hsx = (iHsl > 0 ? rgb_to_hsl(c.rgb): rgb_to_hsv(c.rgb));
+ hsx.x = fract(hsx.x + iHue);
+ if (iMultiply > 0) {
+  hsx.y *= 1 + iSaturation;
+  hsx.z *= 1 + iLightness;
+ }
+ else {
+  hsx.y += iSaturation;
+  hsx.z += iLightness;
+ }
+ hsx.yz = saturate(hsx.yz);
+ half4 r = half4(iHsl > 0 ? hsl_to_rgb(hsx): hsv_to_rgb(hsx),
+                 saturate(c.a * (1 + iAlpha)));
+ c = mix(c, r, iTarget);
+ return half4(c.rgb * c.a, c.a);
+}
+)";
+
+sk_sp<SkRuntimeEffect> invert_effect()
+{
+  static sk_sp<SkRuntimeEffect> effect = make_shader(kInvertShaderCode);
+  return effect;
+}
+
+sk_sp<SkRuntimeEffect> color_map_effect()
+{
+  static sk_sp<SkRuntimeEffect> effect = make_shader(kColorMapShaderCode);
+  return effect;
+}
+
+sk_sp<SkRuntimeEffect> hue_saturation_effect()
+{
+  static sk_sp<SkRuntimeEffect> effect = make_shader(
+    (std::string(kRGB_to_HSL_sksl) +
+     kHSL_to_RGB_sksl +
+     kRGB_to_HSV_sksl +
+     kHSV_to_RGB_sksl +
+     kHueSaturationShaderCode).c_str());
+  return effect;
+}
+
+SkV4 target_to_SkV4(const Target target)
+{
+  return SkV4{ (target & TARGET_RED_CHANNEL   ? 1.0f: 0.0f),
+               (target & TARGET_GREEN_CHANNEL ? 1.0f: 0.0f),
+               (target & TARGET_BLUE_CHANNEL  ? 1.0f: 0.0f),
+               (target & TARGET_ALPHA_CHANNEL ? 1.0f: 0.0f) };
+}
+
+// Creates a 256x1 image to be used as iMap (the map is saved in the
+// alpha channel).
+sk_sp<SkShader> make_color_map_shader(const std::vector<int>& cmap)
+{
+  ASSERT(cmap.size() == 256);
+  std::vector<uint8_t> data(256);
+  for (int i=0; i<256; ++i)
+    data[i] = uint8_t(cmap[i]);
+
+  auto skData = SkData::MakeWithCopy(data.data(), data.size());
+  auto skMap = SkImage::MakeRasterData(
+    SkImageInfo::Make(256, 1, kAlpha_8_SkColorType, kUnpremul_SkAlphaType),
+    skData, 256);
+  return skMap->makeRawShader(SkSamplingOptions(SkFilterMode::kNearest));
+}
+
+} // anonymous namespace
+
+bool apply_filter_shader(Filter* filter,
+                         const Target target,
+                         const doc::Image* src,
+                         doc::Image* dst,
+                         const gfx::Rect& bounds)
+{
+  if (src->pixelFormat() != doc::IMAGE_RGB ||
+      dst->pixelFormat() != doc::IMAGE_RGB)
+    return false;
+
+  // Filters that are using the palette to modify RGB pixels (when
+  // there are selected palette entries) are not supported.
+  if (auto fwp = dynamic_cast<FilterWithPalette*>(filter)) {
+    if (fwp->usePaletteOnRGB())
+      return false;
+  }
+
+  sk_sp<SkShader> imgShader =
+    make_skimage_for_docimage(src)
+    ->makeRawShader(SkSamplingOptions(SkFilterMode::kNearest));
+  sk_sp<SkShader> shader;
+
+  if (dynamic_cast<InvertColorFilter*>(filter)) {
+    SkRuntimeShaderBuilder builder(invert_effect());
+    builder.child("iImg") = imgShader;
+    builder.uniform("iTarget") = target_to_SkV4(target);
+    shader = builder.makeShader();
+  }
+  else if (auto bc = dynamic_cast<BrightnessContrastFilter*>(filter)) {
+    SkRuntimeShaderBuilder builder(color_map_effect());
+    builder.child("iImg") = imgShader;
+    builder.child("iMap") = make_color_map_shader(bc->colorMap());
+    // Brightness/contrast doesn't modify the alpha channel
+    builder.uniform("iTarget") = target_to_SkV4(target & ~TARGET_ALPHA_CHANNEL);
+    shader = builder.makeShader();
+  }
+  else if (auto cc = dynamic_cast<ColorCurveFilter*>(filter)) {
+    SkRuntimeShaderBuilder builder(color_map_effect());
+    builder.child("iImg") = imgShader;
+    builder.child("iMap") = make_color_map_shader(cc->colorMap());
+    builder.uniform("iTarget") = target_to_SkV4(target);
+    shader = builder.makeShader();
+  }
+  else if (auto hs = dynamic_cast<HueSaturationFilter*>(filter)) {
+    using Mode = HueSaturationFilter::Mode;
+    const Mode mode = hs->mode();
+    SkRuntimeShaderBuilder builder(hue_saturation_effect());
+    builder.child("iImg") = imgShader;
+    builder.uniform("iTarget") = target_to_SkV4(target);
+    builder.uniform("iHue") = float(hs->hue() / 360.0);
+    builder.uniform("iSaturation") = float(hs->saturation());
+    builder.uniform("iLightness") = float(hs->lightness());
+    builder.uniform("iAlpha") = float(hs->alpha());
+    builder.uniform("iHsl") = (mode == Mode::HSL_MUL ||
+                               mode == Mode::HSL_ADD ? 1.0f: 0.0f);
+    builder.uniform("iMultiply") = (mode == Mode::HSV_MUL ||
+                                    mode == Mode::HSL_MUL ? 1.0f: 0.0f);
+    shader = builder.makeShader();
+  }
+
+  if (!shader)
+    return false;
+
+  SkPaint p;
+  p.setBlendMode(SkBlendMode::kSrc);
+  p.setStyle(SkPaint::kFill_Style);
+  p.setShader(shader);
+
+  auto canvas = make_skcanvas_for_docimage(dst);
+  canvas->drawRect(SkRect::MakeXYWH(bounds.x, bounds.y, bounds.w, bounds.h), p);
+  return true;
+}
+
+} // namespace app
+
+#endif // SK_ENABLE_SKSL
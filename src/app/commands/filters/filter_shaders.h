@@ -0,0 +1,45 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_COMMANDS_FILTERS_FILTER_SHADERS_H_INCLUDED
+#define APP_COMMANDS_FILTERS_FILTER_SHADERS_H_INCLUDED
+#pragma once
+
+#if SK_ENABLE_SKSL
+
+#include "filters/target.h"
+#include "gfx/rect.h"
+
+namespace doc {
+  class Image;
+}
+
+namespace filters {
+  class Filter;
+}
+
+namespace app {
+
+  // Applies the given filter to the "bounds" area of the "src" RGB
+  // image using a Skia runtime effect, saving the result in "dst".
+  // Only point filters (invert, brightness/contrast, hue/saturation,
+  // and color curve) have a shader. Returns false if the filter or
+  // the image is not supported (and nothing was done).
+  //
+  // The result is not bit-exact with the CPU version of the filter
+  // (e.g. HSL conversions are calculated with floats), so it's used
+  // only to preview the filter.
+  bool apply_filter_shader(filters::Filter* filter,
+                           const filters::Target target,
+                           const doc::Image* src,
+                           doc::Image* dst,
+                           const gfx::Rect& bounds);
+
+} // namespace app
+
+#endif // SK_ENABLE_SKSL
+
+#endif
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -12,20 +12,22 @@
 #include "app/app.h"
 #include "app/commands/filters/filter_manager_impl.h"
 #include "app/console.h"
+#include "app/doc_lock_stats.h"
 #include "app/i18n/strings.h"
 #include "app/ini_file.h"
 #include "app/modules/gui.h"
+#include "app/perf_trace.h"
 #include "app/ui/editor/editor.h"
 #include "app/ui/status_bar.h"
 #include "base/thread.h"
 #include "doc/sprite.h"
+#include "doc/task_scheduler.h"
 #include "ui/ui.h"
 
 #include <cstdlib>
 #include <cstring>
 #include <functional>
 #include <mutex>
-#include <thread>
 
 namespace app {
 
@@ -136,11 +138,11 @@ void FilterWorker::run()
   m_filterMgr->initTransaction();
 
 #ifdef ENABLE_UI
-  std::thread thread;
+  doc::TaskGroup task(doc::TaskPriority::Interactive);
   // Open the alert window in foreground (this is modal, locks the main thread)
   if (m_alert) {
-    // Launch the thread to apply the effect in background
-    thread = std::thread([this]{ applyFilterInBackground(); });
+    // Apply the effect in background (in the shared task scheduler)
+    task.run([this]{ applyFilterInBackground(); });
     m_alert->openAndWait();
   }
   else
@@ -159,9 +161,8 @@ void FilterWorker::run()
   }
 
 #ifdef ENABLE_UI
-  // Wait the `effect_bg' thread
-  if (thread.joinable())
-    thread.join();
+  // Wait the background task
+  task.wait();
 
   if (!m_error.empty()) {
     Console console;
@@ -204,6 +205,9 @@ bool FilterWorker::isCancelled()
 //
 void FilterWorker::applyFilterInBackground()
 {
+  PerfTrace span("filters", "FilterWorker::applyFilterInBackground");
+  DocLockStats::Operation operation("filter");
+
   try {
     // Apply the filter
     m_filterMgr->applyToTarget();
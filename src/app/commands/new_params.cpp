@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -11,10 +11,13 @@
 #include "app/commands/new_params.h"
 
 #include "app/color.h"
+#include "app/commands/filters/filter_chain_item.h"
 #include "app/doc_exporter.h"
+#include "app/file/ase_options.h"
 #include "app/sprite_sheet_type.h"
 #include "app/tools/ink_type.h"
 #include "base/convert_to.h"
+#include "base/log.h"
 #include "base/split_string.h"
 #include "base/string.h"
 #include "doc/algorithm/resize_image.h"
@@ -27,6 +30,9 @@
 #include "filters/tiled_mode.h"
 #include "gfx/rect.h"
 #include "gfx/size.h"
+#include "render/palette_algorithm.h"
+
+#include <algorithm>
 
 #ifdef ENABLE_SCRIPTING
 #include "app/script/engine.h"
@@ -128,6 +134,8 @@ void Param<app::SpriteSheetDataFormat>::fromString(const std::string& value)
       base::utf8_icmp(value, "json-array") == 0 ||
       base::utf8_icmp(value, "json_array") == 0)
     setValue(app::SpriteSheetDataFormat::JsonArray);
+  else if (base::utf8_icmp(value, "Binary") == 0)
+    setValue(app::SpriteSheetDataFormat::Binary);
   else
     setValue(app::SpriteSheetDataFormat::JsonHash);
 }
@@ -224,6 +232,40 @@ void Param<filters::ColorCurve>::fromString(const std::string& value)
   setValue(curve);
 }
 
+// Filters separated by ";", each one with its name and its params
+// separated by spaces, e.g. "BrightnessContrast brightness=20;
+// HueSaturation hue=30 mode=hsv"
+template<>
+void Param<FilterChainItems>::fromString(const std::string& value)
+{
+  FilterChainItems items;
+  std::vector<std::string> filters, parts;
+  base::split_string(value, filters, ";");
+  for (const auto& filter : filters) {
+    parts.clear();
+    base::split_string(filter, parts, " ");
+    parts.erase(std::remove(parts.begin(), parts.end(), std::string()),
+                parts.end());
+    if (parts.empty())
+      continue;
+
+    auto item = FilterChainItem::create(parts[0]);
+    if (!item) {
+      LOG(ERROR, "CMD: Invalid filter for a filter chain: %s\n", parts[0].c_str());
+      continue;
+    }
+    for (int i=1; i<int(parts.size()); ++i) {
+      const auto j = parts[i].find('=');
+      if (j == std::string::npos)
+        continue;
+      if (ParamBase* p = item->getParam(parts[i].substr(0, j)))
+        p->fromString(parts[i].substr(j+1));
+    }
+    items.push_back(item);
+  }
+  setValue(items);
+}
+
 template<>
 void Param<tools::InkType>::fromString(const std::string& value)
 {
@@ -241,6 +283,30 @@ void Param<doc::RgbMapAlgorithm>::fromString(const std::string& value)
     setValue(doc::RgbMapAlgorithm::DEFAULT);
 }
 
+template<>
+void Param<render::PaletteAlgorithm>::fromString(const std::string& value)
+{
+  if (base::utf8_icmp(value, "median-cut") == 0)
+    setValue(render::PaletteAlgorithm::MedianCut);
+  else if (base::utf8_icmp(value, "wu") == 0)
+    setValue(render::PaletteAlgorithm::Wu);
+  else if (base::utf8_icmp(value, "k-means") == 0)
+    setValue(render::PaletteAlgorithm::KMeans);
+  else
+    setValue(render::PaletteAlgorithm::Default);
+}
+
+template<>
+void Param<AseOptions::Compression>::fromString(const std::string& value)
+{
+  if (base::utf8_icmp(value, "fast") == 0)
+    setValue(AseOptions::Compression::Fast);
+  else if (base::utf8_icmp(value, "max") == 0)
+    setValue(AseOptions::Compression::Max);
+  else
+    setValue(AseOptions::Compression::Default);
+}
+
 //////////////////////////////////////////////////////////////////////
 // Convert values from Lua
 //////////////////////////////////////////////////////////////////////
@@ -390,6 +456,49 @@ void Param<filters::ColorCurve>::fromLua(lua_State* L, int index)
   }
 }
 
+// Array of filters, each one a table with the name of the filter as
+// the first element and its params, e.g.
+// { { "BrightnessContrast", brightness=20 }, { "HueSaturation", hue=30 } }
+template<>
+void Param<FilterChainItems>::fromLua(lua_State* L, int index)
+{
+  if (lua_type(L, index) == LUA_TSTRING) {
+    fromString(lua_tostring(L, index));
+    return;
+  }
+  if (!lua_istable(L, index))
+    return;
+
+  index = lua_absindex(L, index);
+  FilterChainItems items;
+  for (int i=1; lua_geti(L, index, i) == LUA_TTABLE; ++i) {
+    const int itemIndex = lua_absindex(L, -1);
+
+    std::shared_ptr<FilterChainItem> item;
+    if (lua_geti(L, itemIndex, 1) == LUA_TSTRING) {
+      item = FilterChainItem::create(lua_tostring(L, -1));
+      if (!item)
+        LOG(ERROR, "CMD: Invalid filter for a filter chain: %s\n", lua_tostring(L, -1));
+    }
+    lua_pop(L, 1);
+
+    if (item) {
+      lua_pushnil(L);
+      while (lua_next(L, itemIndex) != 0) {
+        if (lua_type(L, -2) == LUA_TSTRING) {
+          if (ParamBase* p = item->getParam(lua_tostring(L, -2)))
+            p->fromLua(L, -1);
+        }
+        lua_pop(L, 1);          // Pop the value, leave the key
+      }
+      items.push_back(item);
+    }
+    lua_pop(L, 1);              // Pop the filter table
+  }
+  lua_pop(L, 1);                // Pop the last non-table value
+  setValue(items);
+}
+
 template<>
 void Param<tools::InkType>::fromLua(lua_State* L, int index)
 {
@@ -405,6 +514,24 @@ void Param<doc::RgbMapAlgorithm>::fromLua(lua_State* L, int index)
     setValue((doc::RgbMapAlgorithm)lua_tointeger(L, index));
 }
 
+template<>
+void Param<render::PaletteAlgorithm>::fromLua(lua_State* L, int index)
+{
+  if (lua_type(L, index) == LUA_TSTRING)
+    fromString(lua_tostring(L, index));
+  else
+    setValue((render::PaletteAlgorithm)lua_tointeger(L, index));
+}
+
+template<>
+void Param<AseOptions::Compression>::fromLua(lua_State* L, int index)
+{
+  if (lua_type(L, index) == LUA_TSTRING)
+    fromString(lua_tostring(L, index));
+  else
+    setValue((AseOptions::Compression)lua_tointeger(L, index));
+}
+
 void CommandWithNewParamsBase::loadParamsFromLuaTable(lua_State* L, int index)
 {
   onResetValues();
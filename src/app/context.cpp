@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -17,6 +17,8 @@
 #include "app/commands/commands.h"
 #include "app/console.h"
 #include "app/doc.h"
+#include "app/doc_lock_stats.h"
+#include "app/perf_trace.h"
 #include "app/pref/preferences.h"
 #include "app/site.h"
 #include "app/util/clipboard.h"
@@ -163,6 +165,9 @@ void Context::executeCommand(Command* command, const Params& params)
   if (!command)
     return;
 
+  PerfTrace span("command", "Context::executeCommand");
+  DocLockStats::Operation operation(command->id().c_str());
+
   m_result.reset();
 
   Console console;
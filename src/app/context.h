@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -103,6 +103,14 @@ namespace app {
     virtual bool isExecutingMacro() const  { return false; }
     virtual bool isExecutingScript() const { return false; }
 
+    // When the undo is disabled, transactions are committed without
+    // being added to the undo history of the document (useful for
+    // batch mode, where nobody can undo the changes anyway). Each
+    // commit clears the undo history and marks the document as
+    // modified.
+    bool isUndoEnabled() const { return m_undoEnabled; }
+    void setUndoEnabled(bool state) { m_undoEnabled = state; }
+
     bool checkFlags(uint32_t flags) const { return m_flags.check(flags); }
     void updateFlags() { m_flags.update(this); }
 
@@ -159,6 +167,7 @@ namespace app {
     ContextFlags m_flags;       // Last updated flags.
     Doc* m_lastSelectedDoc;
     mutable std::unique_ptr<Preferences> m_preferences;
+    bool m_undoEnabled = true;
 
     // Result of the execution of a command.
     CommandResult m_result;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -26,7 +26,11 @@
 #include "app/doc.h"
 #include "app/doc_access.h"
 #include "app/doc_diff.h"
+#include "app/doc_lock_stats.h"
+#include "app/doc_undo.h"
+#include "app/perf_trace.h"
 #include "app/pref/preferences.h"
+#include "app/tools/tool_loop_manager.h"
 #include "base/chrono.h"
 #include "base/remove_from_container.h"
 #include "base/thread.h"
@@ -38,6 +42,17 @@ namespace crash {
 
 namespace {
 
+// Approximated number of modified bytes to start a backup before the
+// "data recovery period" ends.
+const size_t kBigChangeSize = 16*1024*1024;
+
+// Seconds to wait before starting a backup to coalesce it with
+// following changes.
+const int kCoalescePeriod = 2;
+
+// Max number of seconds to delay a backup while the user is drawing.
+const int kMaxToolLoopDelay = 60;
+
 class SwitchBackupIcon {
 public:
   SwitchBackupIcon() {
@@ -65,6 +80,8 @@ BackupObserver::BackupObserver(RecoveryConfig* config,
   , m_session(session)
   , m_ctx(ctx)
   , m_done(false)
+  , m_dirtyBytes(0)
+  , m_changes(0)
   , m_thread([this]{ backgroundThread(); })
 {
   m_ctx->add_observer(this);
@@ -74,6 +91,8 @@ BackupObserver::BackupObserver(RecoveryConfig* config,
 BackupObserver::~BackupObserver()
 {
   m_thread.join();
+  for (Doc* doc : m_documents)
+    doc->undoHistory()->remove_observer(this);
   m_ctx->documents().remove_observer(this);
   m_ctx->remove_observer(this);
 }
@@ -88,13 +107,24 @@ void BackupObserver::onAddDocument(Doc* document)
 {
   RECO_TRACE("RECO: Observe document %p\n", document);
 
-  std::unique_lock<std::mutex> lock(m_mutex);
-  m_documents.push_back(document);
+  DocUndo* undo = document->undoHistory();
+  undo->add_observer(this);
+  m_undoSizes[undo] = undo->totalUndoSize();
+
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_documents.push_back(document);
+  }
+  // The first backup of the document is needed
+  addChanges(0);
 }
 
 void BackupObserver::onRemoveDocument(Doc* doc)
 {
   RECO_TRACE("RECO: Remove document %p\n", doc);
+
+  doc->undoHistory()->remove_observer(this);
+  m_undoSizes.erase(doc->undoHistory());
   {
     std::unique_lock<std::mutex> lock(m_mutex);
     base::remove_from_container(m_documents, doc);
@@ -119,8 +149,11 @@ void BackupObserver::onRemoveDocument(Doc* doc)
 
     RECO_TRACE("RECO: Adding to CLOSEDOC %p\n", doc);
 
-    std::unique_lock<std::mutex> lock(m_mutex);
-    m_closedDocs.push_back(doc);
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_closedDocs.push_back(doc);
+    }
+    addChanges(0);
   }
   else {
     RECO_TRACE("RECO: Removing doc %p from session\n", doc);
@@ -128,10 +161,34 @@ void BackupObserver::onRemoveDocument(Doc* doc)
   }
 }
 
+// Undo/redo
+void BackupObserver::onCurrentUndoStateChange(DocUndo* history)
+{
+  addChanges(0);
+}
+
+void BackupObserver::onTotalUndoSizeChange(DocUndo* history)
+{
+  size_t& oldSize = m_undoSizes[history];
+  const size_t newSize = history->totalUndoSize();
+  addChanges(newSize > oldSize ? newSize - oldSize:
+                                 oldSize - newSize);
+  oldSize = newSize;
+}
+
+// Executed from the UI thread
+void BackupObserver::addChanges(size_t bytes)
+{
+  ++m_changes;
+  if ((m_dirtyBytes += bytes) >= kBigChangeSize)
+    m_wakeup.notify_one();
+}
+
 void BackupObserver::backgroundThread()
 {
   std::unique_lock<std::mutex> lock(m_mutex);
   base::this_thread::set_name("backup");
+  DocLockStats::Operation operation("backup");
 
   int normalPeriod = int(60.0*m_config->dataRecoveryPeriod);
   int lockedPeriod = 5;
@@ -143,7 +200,32 @@ void BackupObserver::backgroundThread()
   int waitFor = normalPeriod;
 
   while (!m_done) {
-    m_wakeup.wait_for(lock, std::chrono::seconds(waitFor));
+    // Wait the whole period, or less if there are big changes
+    m_wakeup.wait_for(lock, std::chrono::seconds(waitFor),
+                      [this]{ return m_done || m_dirtyBytes >= kBigChangeSize; });
+
+    if (!m_done) {
+      // Nothing to save
+      if (m_changes == 0 && m_closedDocs.empty()) {
+        waitFor = normalPeriod;
+        continue;
+      }
+
+      // Coalesce changes that are done in a row, and avoid doing the
+      // IO in the middle of a stroke (the backup is delayed until
+      // the tool loop ends, or kMaxToolLoopDelay as max).
+      base::Chrono delay;
+      do {
+        m_wakeup.wait_for(lock, std::chrono::seconds(kCoalescePeriod),
+                          [this]{ return m_done.load(); });
+      } while (!m_done &&
+               tools::ToolLoopManager::isAnyToolLoopActive() &&
+               delay.elapsed() < kMaxToolLoopDelay);
+    }
+
+    // New changes from this point will be saved in the next backup
+    m_dirtyBytes = 0;
+    m_changes = 0;
 
     RECO_TRACE("RECO: Start backup process for %d documents\n",
                m_documents.size() + m_closedDocs.size());
@@ -176,6 +258,10 @@ void BackupObserver::backgroundThread()
       }
     }
 
+    // Retry the locked documents in the next iteration
+    if (somethingLocked)
+      ++m_changes;
+
     waitFor = (somethingLocked ? lockedPeriod: normalPeriod);
 
     RECO_TRACE("RECO: Backup process done (%.16g)\n", chrono.elapsed());
@@ -185,6 +271,8 @@ void BackupObserver::backgroundThread()
 // Executed from the backgroundThread() (non-UI thread)
 bool BackupObserver::saveDocData(Doc* doc)
 {
+  PerfTrace span("backup", "BackupObserver::saveDocData");
+
   try {
     if (!doc->needsBackup())
       return true;
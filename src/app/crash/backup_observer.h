@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -11,10 +11,12 @@
 
 #include "app/context_observer.h"
 #include "app/doc_observer.h"
+#include "app/doc_undo_observer.h"
 #include "app/docs_observer.h"
 
 #include <atomic>
 #include <condition_variable>
+#include <map>
 #include <mutex>
 #include <thread>
 #include <vector>
@@ -22,13 +24,15 @@
 namespace app {
 class Context;
 class Doc;
+class DocUndo;
 namespace crash {
   struct RecoveryConfig;
   class Session;
 
   class BackupObserver : public ContextObserver
                        , public DocsObserver
-                       , public DocObserver {
+                       , public DocObserver
+                       , public DocUndoObserver {
   public:
     BackupObserver(RecoveryConfig* config,
                    Session* session,
@@ -40,9 +44,14 @@ namespace crash {
     void onAddDocument(Doc* document) override;
     void onRemoveDocument(Doc* document) override;
 
+    // DocUndoObserver impl
+    void onCurrentUndoStateChange(DocUndo* history) override;
+    void onTotalUndoSizeChange(DocUndo* history) override;
+
   private:
     void backgroundThread();
     bool saveDocData(Doc* doc);
+    void addChanges(size_t bytes);
 
     RecoveryConfig* m_config;
     Session* m_session;
@@ -51,6 +60,17 @@ namespace crash {
     std::vector<Doc*> m_closedDocs;
     std::atomic<bool> m_done;
 
+    // Changes made in all documents since the last backup. The number
+    // of bytes is approximated with the growth of the undo history
+    // (DocUndo::totalUndoSize() deltas), and it's used to start the
+    // backup sooner after big changes.
+    std::atomic<size_t> m_dirtyBytes;
+    std::atomic<int> m_changes;
+
+    // Last known DocUndo::totalUndoSize() of each document (only
+    // accessed from the UI thread)
+    std::map<DocUndo*, size_t> m_undoSizes;
+
     std::mutex m_mutex;
 
     // Used to wakeup the backgroundThread() when we have to stop the
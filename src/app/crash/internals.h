@@ -10,16 +10,28 @@
 #pragma once
 
 #include "doc/object.h"
+#include "fmt/format.h"
 
 #include <algorithm>
 #include <functional>
 #include <map>
+#include <string>
 
 namespace app {
 namespace crash {
 
   const uint32_t MAGIC_NUMBER = 0x454E4946; // 'FINE' in ASCII
 
+  // Image objects ("img-ID.VER" files) start with a null ID when the
+  // image content is stored in a "blob-HASH" file (with the
+  // doc::write_image() data). In this way images with the same
+  // content are stored just once.
+  const doc::ObjectId IMAGE_BLOB_REF = doc::NullId;
+
+  inline std::string blob_filename(uint64_t hash) {
+    return fmt::format("blob-{:016x}", hash);
+  }
+
   class ObjVersions {
   public:
     ObjVersions() {
@@ -17,10 +17,13 @@
 #include "app/doc.h"
 #include "base/convert_to.h"
 #include "base/exception.h"
+#include "base/file_handle.h"
 #include "base/fs.h"
 #include "base/fstream_path.h"
 #include "base/serialization.h"
 #include "base/string.h"
+#include "base/thread_pool.h"
+#include "dio/file_interface.h"
 #include "doc/cel.h"
 #include "doc/cel_data_io.h"
 #include "doc/cel_io.h"
@@ -46,8 +49,13 @@
 #include "doc/util.h"
 #include "fixmath/fixmath.h"
 
+#include <algorithm>
 #include <fstream>
+#include <future>
 #include <map>
+#include <set>
+#include <streambuf>
+#include <thread>
 
 namespace app {
 namespace crash {
@@ -66,6 +74,61 @@ bool check_magic_number(const std::string& fn)
   return (read32(s) == MAGIC_NUMBER);
 }
 
+// Read-only stream buffer over bytes in memory.
+class MemoryStreamBuf : public std::streambuf {
+public:
+  MemoryStreamBuf(const uint8_t* data, size_t size) {
+    char* p = (char*)data;
+    setg(p, p, p+size);
+  }
+};
+
+Image* read_blob_image(std::istream& s)
+{
+  if (read32(s) != MAGIC_NUMBER)
+    return nullptr;
+  return read_image(s, false);
+}
+
+// Reads an image from a blob file. The file is mapped in memory when
+// it's possible to avoid copying the compressed data through the
+// std::ifstream buffers.
+Image* read_blob_file(const std::string& fn)
+{
+  base::FileHandle handle(base::open_file(fn, "rb"));
+  if (!handle)
+    return nullptr;
+
+  dio::MappedFileInterface mapped(handle.get());
+  if (mapped.isMapped()) {
+    const size_t size = base::file_size(fn);
+    if (const uint8_t* data = mapped.readInPlace(size)) {
+      MemoryStreamBuf buf(data, size);
+      std::istream s(&buf);
+      return read_blob_image(s);
+    }
+  }
+
+  std::ifstream s(FSTREAM_PATH(fn), std::ifstream::binary);
+  if (!s)
+    return nullptr;
+  return read_blob_image(s);
+}
+
+// Reads an image object, which can contain the image itself (old
+// backups) or a reference to a blob file with its content.
+Image* read_image_object(std::istream& s, const std::string& dir)
+{
+  const std::istream::pos_type pos = s.tellg();
+  if (read32(s) != IMAGE_BLOB_REF) {
+    s.seekg(pos);
+    return read_image(s, false);
+  }
+
+  const uint64_t hash = read64(s);
+  return read_blob_file(base::join_path(dir, blob_filename(hash)));
+}
+
 class Reader : public SubObjectsIO {
 public:
   Reader(const std::string& dir,
@@ -99,6 +162,9 @@ public:
       ObjVersions& versions = m_objVersions[id];
       versions.add(ver);
 
+      if (fn.compare(0, 4, "img-") == 0)
+        m_imageIds.insert(id);
+
       if (fn.compare(0, 3, "doc") == 0) {
         if (!m_docId)
           m_docId = id;
@@ -112,6 +178,8 @@ public:
   }
 
   Doc* loadDocument() {
+    preloadImages();
+
     Doc* doc = loadObject<Doc*>("doc", m_docId, &Reader::readDocument);
     if (doc)
       fixUndetectedDocumentIssues(doc);
@@ -141,6 +209,70 @@ private:
     return loadObject<Sprite*>("spr", sprId, &Reader::readSprite);
   }
 
+  // Images are the heaviest objects to restore (they have to be
+  // decompressed) and don't depend on other objects, so we decode all
+  // of them in parallel before loading the rest of the document
+  // structure (cel data, cels, layers, etc.) which use them.
+  void preloadImages() {
+    if (m_imageIds.size() < 2)
+      return;
+
+    using Task = std::packaged_task<Image*()>;
+    std::vector<std::pair<ObjectId, std::future<Image*>>> pending;
+    pending.reserve(m_imageIds.size());
+    {
+      base::thread_pool pool(std::max(1u, std::thread::hardware_concurrency()));
+      for (ObjectId id : m_imageIds) {
+        auto it = m_objVersions.find(id);
+        if (it == m_objVersions.end())
+          continue;
+
+        const ObjVersions* versions = &it->second;
+        auto task = std::make_shared<Task>(
+          [this, id, versions]() -> Image* {
+            try {
+              return preloadImage(id, *versions);
+            }
+            catch (const std::exception&) {
+              return nullptr;
+            }
+          });
+        pending.push_back(std::make_pair(id, task->get_future()));
+        pool.execute([task]{ (*task)(); });
+      }
+      pool.wait_all();
+    }
+
+    for (auto& pair : pending) {
+      if (Image* image = pair.second.get())
+        m_images[pair.first] = ImageRef(image);
+    }
+  }
+
+  // Executed from a worker thread, it cannot use the Console or
+  // modify the Reader state. Images that cannot be loaded here are
+  // loaded again (and errors reported) from getImageRef().
+  Image* preloadImage(const ObjectId id, const ObjVersions& versions) const {
+    for (size_t i=0; i<versions.size(); ++i) {
+      ObjectVersion ver = versions[i];
+      if (!ver)
+        continue;
+
+      if (canceled())
+        return nullptr;
+
+      std::ifstream s(FSTREAM_PATH(base::join_path(m_dir, objectFilename("img", id, ver))),
+                      std::ifstream::binary);
+      if (read32(s) == MAGIC_NUMBER) {
+        if (Image* image = read_image_object(s, m_dir)) {
+          RECO_TRACE("RECO: img #%d v%d preloaded\n", id, ver);
+          return image;
+        }
+      }
+    }
+    return nullptr;
+  }
+
   ImageRef getImageRef(ObjectId imageId) {
     if (m_images.find(imageId) != m_images.end())
       return m_images[imageId];
@@ -168,12 +300,7 @@ private:
 
       RECO_TRACE("RECO: Restoring %s #%d v%d\n", prefix, id, ver);
 
-      std::string fn = prefix;
-      fn.push_back('-');
-      fn += base::convert_to<std::string>(id);
-      fn.push_back('.');
-      fn += base::convert_to<std::string>(ver);
-
+      std::string fn = objectFilename(prefix, id, ver);
       std::ifstream s(FSTREAM_PATH(base::join_path(m_dir, fn)), std::ifstream::binary);
       T obj = nullptr;
       if (read32(s) == MAGIC_NUMBER)
@@ -515,7 +642,7 @@ private:
   }
 
   Image* readImage(std::ifstream& s) {
-    return read_image(s, false);
+    return read_image_object(s, m_dir);
   }
 
   Palette* readPalette(std::ifstream& s) {
@@ -580,6 +707,17 @@ private:
     }
   }
 
+  static std::string objectFilename(const char* prefix,
+                                    const ObjectId id,
+                                    const ObjectVersion version) {
+    std::string fn = prefix;
+    fn.push_back('-');
+    fn += base::convert_to<std::string>(id);
+    fn.push_back('.');
+    fn += base::convert_to<std::string>(version);
+    return fn;
+  }
+
   bool canceled() const {
     if (m_taskToken)
       return m_taskToken->canceled();
@@ -596,6 +734,7 @@ private:
   DocumentInfo* m_loadInfo;
   std::vector<std::pair<ObjectId, ObjectId> > m_celsToLoad;
   std::map<ObjectId, ImageRef> m_images;
+  std::set<ObjectId> m_imageIds; // IDs of all "img" objects in "m_dir"
   std::map<ObjectId, CelDataRef> m_celdatas;
   // Each ObjectId is a tileset ID that didn't contain the empty tile
   // as the first tile (this was an old format used in internal betas)
@@ -656,7 +795,7 @@ Doc* read_document_with_raw_images(const std::string& dir,
 
     ImageRef img;
     if (read32(s) == MAGIC_NUMBER)
-      img.reset(read_image(s, false));
+      img.reset(read_image_object(s, dir));
 
     if (img) {
       lay->addCel(new Cel(frame, img));
@@ -228,9 +228,19 @@ public:
 
 bool Session::saveDocumentChanges(Doc* doc)
 {
-  CustomWeakDocReader reader(doc);
-  if (!reader.isLocked())
-    return false;
+  // Copy the modified objects with the document locked, and then
+  // write them to disk with the lock released, so the UI thread can
+  // modify the document meanwhile.
+  DocSnapshotPtr snapshot;
+  {
+    CustomWeakDocReader reader(doc);
+    if (!reader.isLocked())
+      return false;
+
+    snapshot = take_document_snapshot(doc, &reader);
+    if (!snapshot)
+      return false;
+  }
 
   app::Context ctx;
   std::string dir = base::join_path(m_path,
@@ -252,7 +262,7 @@ bool Session::saveDocumentChanges(Doc* doc)
   }
 
   // Save document information
-  return write_document(dir, doc, &reader);
+  return write_document_snapshot(dir, snapshot);
 }
 
 void Session::removeDocument(Doc* doc)
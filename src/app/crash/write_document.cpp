@@ -26,10 +26,12 @@
 #include "doc/cels_range.h"
 #include "doc/frame.h"
 #include "doc/image_io.h"
+#include "doc/image_ref.h"
 #include "doc/layer.h"
 #include "doc/layer_tilemap.h"
 #include "doc/palette.h"
 #include "doc/palette_io.h"
+#include "doc/primitives.h"
 #include "doc/serial_format.h"
 #include "doc/slice.h"
 #include "doc/slice_io.h"
@@ -42,9 +44,12 @@
 #include "doc/tilesets.h"
 #include "doc/user_data_io.h"
 #include "fixmath/fixmath.h"
+#include "zlib.h"
 
 #include <fstream>
 #include <map>
+#include <sstream>
+#include <vector>
 
 namespace app {
 namespace crash {
@@ -53,22 +58,70 @@ using namespace base::serialization;
 using namespace base::serialization::little_endian;
 using namespace doc;
 
+// Objects of a document that were modified since the last backup.
+// It's created with the document locked (take_document_snapshot())
+// and can be written without the lock (write_document_snapshot()).
+class DocSnapshot {
+public:
+  struct Object {
+    const char* prefix;
+    ObjectId id;
+    ObjectVersion version;
+    std::string data;   // Serialized object (empty for images)
+    ImageRef image;     // Copy of the image pixels (only for "img")
+  };
+
+  DocSnapshot(const ObjectId docId) : m_docId(docId) { }
+
+  ObjectId docId() const { return m_docId; }
+  std::vector<Object>& objects() { return m_objects; }
+
+private:
+  ObjectId m_docId;
+  std::vector<Object> m_objects;
+};
+
 namespace {
 
+// Blobs with image contents of each document (see IMAGE_BLOB_REF)
+struct DocBlobs {
+  std::map<std::string, uint64_t> images; // "img-ID.VER" -> blob hash
+  std::map<uint64_t, int> refs;           // Blob hash -> number of images
+};
+
 static std::map<ObjectId, ObjVersionsMap> g_docVersions;
 static std::map<ObjectId, base::paths> g_deleteFiles;
+static std::map<ObjectId, DocBlobs> g_docBlobs;
 
 class Writer {
 public:
-  Writer(const std::string& dir, Doc* doc, doc::CancelIO* cancel)
-    : m_dir(dir)
+  Writer(DocSnapshot* snapshot, Doc* doc, doc::CancelIO* cancel)
+    : m_snapshot(snapshot)
+    , m_doc(doc)
+    , m_objVersions(g_docVersions[snapshot->docId()])
+    , m_deleteFiles(g_deleteFiles[snapshot->docId()])
+    , m_blobs(g_docBlobs[snapshot->docId()])
+    , m_cancel(cancel) {
+  }
+
+  // Writer with its own object versions (e.g. to write all objects
+  // of the document in a directory that isn't a session backup).
+  Writer(DocSnapshot* snapshot, Doc* doc, doc::CancelIO* cancel,
+         ObjVersionsMap& objVersions,
+         base::paths& deleteFiles,
+         DocBlobs& blobs)
+    : m_snapshot(snapshot)
     , m_doc(doc)
-    , m_objVersions(g_docVersions[doc->id()])
-    , m_deleteFiles(g_deleteFiles[doc->id()])
+    , m_objVersions(objVersions)
+    , m_deleteFiles(deleteFiles)
+    , m_blobs(blobs)
     , m_cancel(cancel) {
   }
 
-  bool saveDocument() {
+  // Copies all modified objects of the document to the snapshot. It
+  // must be called with the document locked, but it's fast as it
+  // only serializes objects in memory and copies image pixels.
+  bool takeSnapshot() {
     Sprite* spr = m_doc->sprite();
 
     // Save from objects without children (e.g. images), to aggregated
@@ -109,7 +162,7 @@ public:
         if (cel->link())        // Skip link
           continue;
 
-        if (!saveObject("img", cel->image(), &Writer::writeImage))
+        if (!saveImage(cel->image()))
           return false;
 
         if (!saveObject("celdata", cel->data(), &Writer::writeCelData))
@@ -138,6 +191,23 @@ public:
     if (!saveObject("doc", m_doc, &Writer::writeDocumentFile))
       return false;
 
+    return true;
+  }
+
+  // Writes the objects of the snapshot in the given directory. It
+  // doesn't need the document, so the document lock can be released
+  // before calling this function (the heavy part of the backup
+  // process: hashing, compressing, and writing images to disk).
+  bool writeSnapshot(const std::string& dir) {
+    m_dir = dir;
+
+    // Objects are saved in the same order they were added to the
+    // snapshot (from objects without children to aggregated objects)
+    for (DocSnapshot::Object& obj : m_snapshot->objects()) {
+      if (!writeObjectFile(obj))
+        return false;
+    }
+
     // Delete old files after all files are correctly saved.
     deleteOldVersions();
     return true;
@@ -149,14 +219,14 @@ private:
     return (m_cancel && m_cancel->isCanceled());
   }
 
-  bool writeDocumentFile(std::ofstream& s, Doc* doc) {
+  bool writeDocumentFile(std::ostream& s, Doc* doc) {
     write32(s, doc->sprite()->id());
     write_string(s, doc->filename());
     write16(s, uint16_t(doc::SerialFormat::LastVer));
     return true;
   }
 
-  bool writeSprite(std::ofstream& s, Sprite* spr) {
+  bool writeSprite(std::ostream& s, Sprite* spr) {
     // Header
     write8(s, int(spr->colorMode()));
     write16(s, spr->width());
@@ -210,7 +280,7 @@ private:
     return true;
   }
 
-  bool writeGridBounds(std::ofstream& s, const gfx::Rect& grid) {
+  bool writeGridBounds(std::ostream& s, const gfx::Rect& grid) {
     write16(s, (int16_t)grid.x);
     write16(s, (int16_t)grid.y);
     write16(s, grid.w);
@@ -218,7 +288,7 @@ private:
     return true;
   }
 
-  bool writeColorSpace(std::ofstream& s, const gfx::ColorSpaceRef& colorSpace) {
+  bool writeColorSpace(std::ostream& s, const gfx::ColorSpaceRef& colorSpace) {
     write16(s, colorSpace->type());
     write16(s, colorSpace->flags());
     write32(s, fixmath::ftofix(colorSpace->gamma()));
@@ -232,7 +302,7 @@ private:
     return true;
   }
 
-  void writeAllLayersID(std::ofstream& s, ObjectId parentId, const LayerGroup* group) {
+  void writeAllLayersID(std::ostream& s, ObjectId parentId, const LayerGroup* group) {
     for (const Layer* lay : group->layers()) {
       write32(s, lay->id());
       write32(s, parentId);
@@ -242,7 +312,7 @@ private:
     }
   }
 
-  bool writeLayerStructure(std::ofstream& s, Layer* lay) {
+  bool writeLayerStructure(std::ostream& s, Layer* lay) {
     write32(s, static_cast<int>(lay->flags())); // Flags
     write16(s, static_cast<int>(lay->type()));  // Type
     write_string(s, lay->name());
@@ -282,64 +352,155 @@ private:
     return true;
   }
 
-  bool writeCel(std::ofstream& s, Cel* cel) {
+  bool writeCel(std::ostream& s, Cel* cel) {
     write_cel(s, cel);
     return true;
   }
 
-  bool writeCelData(std::ofstream& s, CelData* celdata) {
+  bool writeCelData(std::ostream& s, CelData* celdata) {
     write_celdata(s, celdata);
     return true;
   }
 
-  bool writeImage(std::ofstream& s, Image* img) {
-    return write_image(s, img, m_cancel);
+  bool writeImage(std::ostream& s, const DocSnapshot::Object& obj) {
+    const Image* img = obj.image.get();
+    const uint64_t hash = calculate_image_content_hash(img);
+    if (!saveBlob(hash, img))
+      return false;
+
+    write32(s, IMAGE_BLOB_REF);
+    write64(s, hash);
+
+    m_blobs.images[objectFilename(obj.prefix, obj.id, obj.version)] = hash;
+    ++m_blobs.refs[hash];
+    return true;
+  }
+
+  // Saves the image content in a "blob-HASH" file if it doesn't
+  // exist yet. Backups are compressed with the fastest zlib level.
+  bool saveBlob(const uint64_t hash, const Image* img) {
+    if (m_blobs.refs.find(hash) != m_blobs.refs.end())
+      return true;
+
+    const std::string fn = base::join_path(m_dir, blob_filename(hash));
+    std::ofstream s(FSTREAM_PATH(fn), std::ofstream::binary);
+    write32(s, 0);                // Leave a room for the magic number
+    if (!write_image(s, img, nullptr, Z_BEST_SPEED))
+      return false;
+
+    s.flush();
+    s.seekp(0);
+    write32(s, MAGIC_NUMBER);
+
+    m_blobs.refs[hash] = 0;
+    RECO_TRACE(" - Saved blob %s\n", blob_filename(hash).c_str());
+    return true;
+  }
+
+  // Called when an "img-ID.VER" file is deleted to delete its blob
+  // when it's not used by other images.
+  void releaseBlob(const std::string& file) {
+    auto it = m_blobs.images.find(base::get_file_name(file));
+    if (it == m_blobs.images.end())
+      return;
+
+    const uint64_t hash = it->second;
+    m_blobs.images.erase(it);
+
+    auto refIt = m_blobs.refs.find(hash);
+    if (refIt != m_blobs.refs.end() && --refIt->second <= 0) {
+      m_blobs.refs.erase(refIt);
+
+      const std::string blobfn = base::join_path(m_dir, blob_filename(hash));
+      try {
+        RECO_TRACE(" - Deleting <%s>\n", blobfn.c_str());
+        base::delete_file(blobfn);
+      }
+      catch (const std::exception&) {
+        RECO_TRACE(" - Cannot delete <%s>\n", blobfn.c_str());
+      }
+    }
   }
 
-  bool writePalette(std::ofstream& s, Palette* pal) {
+  bool writePalette(std::ostream& s, Palette* pal) {
     write_palette(s, pal);
     return true;
   }
 
-  bool writeTileset(std::ofstream& s, Tileset* tileset) {
+  bool writeTileset(std::ostream& s, Tileset* tileset) {
     write_tileset(s, tileset);
     return true;
   }
 
-  bool writeFrameTag(std::ofstream& s, Tag* frameTag) {
+  bool writeFrameTag(std::ostream& s, Tag* frameTag) {
     write_tag(s, frameTag);
     return true;
   }
 
-  bool writeSlice(std::ofstream& s, Slice* slice) {
+  bool writeSlice(std::ostream& s, Slice* slice) {
     write_slice(s, slice);
     return true;
   }
 
   template<typename T>
-  bool saveObject(const char* prefix, T* obj, bool (Writer::*writeMember)(std::ofstream&, T*)) {
+  bool isModified(T* obj) {
+    if (!obj->version())
+      obj->incrementVersion();
+
+    auto it = m_objVersions.find(obj->id());
+    return (it == m_objVersions.end() ||
+            it->second.newer() != obj->version());
+  }
+
+  template<typename T>
+  bool saveObject(const char* prefix, T* obj, bool (Writer::*writeMember)(std::ostream&, T*)) {
     if (isCanceled())
       return false;
 
-    if (!obj->version())
-      obj->incrementVersion();
+    if (!isModified(obj))
+      return true;
+
+    std::ostringstream s(std::ios::binary);
+    if (!(this->*writeMember)(s, obj)) // Write the object
+      return false;
+
+    m_snapshot->objects().push_back(
+      DocSnapshot::Object{ prefix, obj->id(), obj->version(), s.str(), nullptr });
+    return true;
+  }
 
-    ObjVersions& versions = m_objVersions[obj->id()];
-    if (versions.newer() == obj->version())
+  // Images are not serialized at this point, we just copy their
+  // pixels so the image can be modified while we write it.
+  bool saveImage(Image* img) {
+    if (isCanceled())
+      return false;
+
+    if (!isModified(img))
       return true;
 
-    std::string fn = prefix;
-    fn.push_back('-');
-    fn += base::convert_to<std::string>(obj->id());
+    m_snapshot->objects().push_back(
+      DocSnapshot::Object{ "img", img->id(), img->version(), std::string(),
+                           ImageRef(Image::createCopy(img)) });
+    return true;
+  }
+
+  bool writeObjectFile(const DocSnapshot::Object& obj) {
+    // The same object could be added two times to the snapshot
+    ObjVersions& versions = m_objVersions[obj.id];
+    if (versions.newer() == obj.version)
+      return true;
 
-    std::string fullfn = base::join_path(m_dir, fn);
-    std::string oldfn = fullfn + "." + base::convert_to<std::string>(versions.older());
-    fullfn += "." + base::convert_to<std::string>(obj->version());
+    std::string fullfn = base::join_path(m_dir, objectFilename(obj.prefix, obj.id, obj.version));
+    std::string oldfn = base::join_path(m_dir, objectFilename(obj.prefix, obj.id, versions.older()));
 
     std::ofstream s(FSTREAM_PATH(fullfn), std::ofstream::binary);
     write32(s, 0);                // Leave a room for the magic number
-    if (!(this->*writeMember)(s, obj)) // Write the object
-      return false;
+    if (obj.image) {
+      if (!writeImage(s, obj))
+        return false;
+    }
+    else
+      s.write(obj.data.c_str(), obj.data.size());
 
     // Flush all data. In this way we ensure that the magic number is
     // the last thing being written in the file.
@@ -354,12 +515,23 @@ private:
       m_deleteFiles.push_back(oldfn);
 
     // Rotate versions and add the latest one
-    versions.rotateRevisions(obj->version());
+    versions.rotateRevisions(obj.version);
 
-    RECO_TRACE(" - Saved %s #%d v%d\n", prefix, obj->id(), obj->version());
+    RECO_TRACE(" - Saved %s #%d v%d\n", obj.prefix, obj.id, obj.version);
     return true;
   }
 
+  static std::string objectFilename(const char* prefix,
+                                    const ObjectId id,
+                                    const ObjectVersion version) {
+    std::string fn = prefix;
+    fn.push_back('-');
+    fn += base::convert_to<std::string>(id);
+    fn.push_back('.');
+    fn += base::convert_to<std::string>(version);
+    return fn;
+  }
+
   void deleteOldVersions() {
     while (!m_deleteFiles.empty() && !isCanceled()) {
       std::string file = m_deleteFiles.back();
@@ -372,13 +544,16 @@ private:
       catch (const std::exception&) {
         RECO_TRACE(" - Cannot delete <%s>\n", file.c_str());
       }
+      releaseBlob(file);
     }
   }
 
+  DocSnapshot* m_snapshot;
   std::string m_dir;
   Doc* m_doc;
   ObjVersionsMap& m_objVersions;
   base::paths& m_deleteFiles;
+  DocBlobs& m_blobs;
   doc::CancelIO* m_cancel;
 };
 
@@ -387,12 +562,47 @@ private:
 //////////////////////////////////////////////////////////////////////
 // Public API
 
+DocSnapshotPtr take_document_snapshot(Doc* doc,
+                                      doc::CancelIO* cancel)
+{
+  auto snapshot = std::make_shared<DocSnapshot>(doc->id());
+  Writer writer(snapshot.get(), doc, cancel);
+  if (writer.takeSnapshot())
+    return snapshot;
+  else
+    return nullptr;
+}
+
+bool write_document_snapshot(const std::string& dir,
+                             const DocSnapshotPtr& snapshot)
+{
+  ASSERT(snapshot);
+  Writer writer(snapshot.get(), nullptr, nullptr);
+  return writer.writeSnapshot(dir);
+}
+
 bool write_document(const std::string& dir,
                     Doc* doc,
                     doc::CancelIO* cancel)
 {
-  Writer writer(dir, doc, cancel);
-  return writer.saveDocument();
+  DocSnapshotPtr snapshot = take_document_snapshot(doc, cancel);
+  return (snapshot && write_document_snapshot(dir, snapshot));
+}
+
+bool write_full_document(const std::string& dir,
+                         Doc* doc,
+                         doc::CancelIO* cancel)
+{
+  // We don't use the versions of the session backup (g_docVersions)
+  // so all objects are written in the directory.
+  ObjVersionsMap objVersions;
+  base::paths deleteFiles;
+  DocBlobs blobs;
+
+  DocSnapshot snapshot(doc->id());
+  Writer writer(&snapshot, doc, cancel, objVersions, deleteFiles, blobs);
+  return (writer.takeSnapshot() &&
+          writer.writeSnapshot(dir));
 }
 
 void delete_document_internals(Doc* doc)
@@ -411,6 +621,11 @@ void delete_document_internals(Doc* doc)
     if (it != g_deleteFiles.end())
       g_deleteFiles.erase(it);
   }
+  {
+    auto it = g_docBlobs.find(doc->id());
+    if (it != g_docBlobs.end())
+      g_docBlobs.erase(it);
+  }
 }
 
 } // namespace crash
@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -8,6 +9,7 @@
 #define APP_CRASH_WRITE_DOCUMENT_H_INCLUDED
 #pragma once
 
+#include <memory>
 #include <string>
 
 namespace doc {
@@ -19,7 +21,26 @@ namespace app {
 
   namespace crash {
 
+    class DocSnapshot;
+    using DocSnapshotPtr = std::shared_ptr<DocSnapshot>;
+
+    // Copies the modified objects of the document in memory. It must
+    // be called with the document locked, and returns nullptr if the
+    // given "cancel" is canceled in the middle of the process.
+    DocSnapshotPtr take_document_snapshot(Doc* doc, doc::CancelIO* cancel);
+
+    // Writes the snapshot in the document backup directory. The
+    // document doesn't need to be locked.
+    bool write_document_snapshot(const std::string& dir,
+                                 const DocSnapshotPtr& snapshot);
+
     bool write_document(const std::string& dir, Doc* doc, doc::CancelIO* cancel);
+
+    // Writes all the objects of the document in the given directory
+    // (it doesn't affect the backup of the document in the session),
+    // the document can be loaded again with read_document(). It must
+    // be called with the document locked.
+    bool write_full_document(const std::string& dir, Doc* doc, doc::CancelIO* cancel);
     void delete_document_internals(Doc* doc);
 
   } // namespace crash
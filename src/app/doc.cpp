@@ -51,6 +51,7 @@ using namespace doc;
 Doc::Doc(Sprite* sprite)
   : m_ctx(nullptr)
   , m_flags(kMaskVisible)
+  , m_writeEpoch(std::make_shared<std::atomic<uint32_t>>(0))
   , m_undo(new DocUndo)
   , m_transaction(nullptr)
   // Information about the file format used to load/save this document
@@ -72,6 +73,9 @@ Doc::~Doc()
 {
   DOC_TRACE("DOC: Deleting", this);
   removeFromContext();
+
+  // Invalidate snapshots of this document
+  ++(*m_writeEpoch);
 }
 
 void Doc::setContext(Context* ctx)
@@ -104,22 +108,32 @@ bool Doc::canWriteLockFromRead() const
 
 Doc::LockResult Doc::readLock(int timeout)
 {
+  const auto start = DocLockStats::Clock::now();
   auto res = m_rwLock.lock(base::RWLock::ReadLock, timeout);
+  onLockResult(DocLockStats::Kind::Read, start, res != LockResult::Fail);
   DOC_TRACE("DOC: readLock", this, (int)res);
   return res;
 }
 
 Doc::LockResult Doc::writeLock(int timeout)
 {
+  const auto start = DocLockStats::Clock::now();
   auto res = m_rwLock.lock(base::RWLock::WriteLock, timeout);
+  onLockResult(DocLockStats::Kind::Write, start, res != LockResult::Fail);
   DOC_TRACE("DOC: writeLock", this, (int)res);
+  if (res != LockResult::Fail)
+    ++(*m_writeEpoch);
   return res;
 }
 
 Doc::LockResult Doc::upgradeToWrite(int timeout)
 {
+  const auto start = DocLockStats::Clock::now();
   auto res = m_rwLock.upgradeToWrite(timeout);
+  onLockResult(DocLockStats::Kind::Upgrade, start, res != LockResult::Fail);
   DOC_TRACE("DOC: upgradeToWrite", this, (int)res);
+  if (res != LockResult::Fail)
+    ++(*m_writeEpoch);
   return res;
 }
 
@@ -133,12 +147,15 @@ void Doc::unlock(LockResult lockResult)
 {
   ASSERT(lockResult != base::RWLock::LockResult::Fail);
   DOC_TRACE("DOC: unlock", this, (int)lockResult);
+  onUnlock();
   m_rwLock.unlock(lockResult);
 }
 
 bool Doc::weakLock(std::atomic<base::RWLock::WeakLock>* weak_lock_flag)
 {
+  const auto start = DocLockStats::Clock::now();
   bool res = m_rwLock.weakLock(weak_lock_flag);
+  onLockResult(DocLockStats::Kind::Weak, start, res);
   DOC_TRACE("DOC: weakLock", this, (int)res);
   return res;
 }
@@ -146,9 +163,35 @@ bool Doc::weakLock(std::atomic<base::RWLock::WeakLock>* weak_lock_flag)
 void Doc::weakUnlock()
 {
   DOC_TRACE("DOC: weakUnlock", this);
+  onUnlock();
   m_rwLock.weakUnlock();
 }
 
+void Doc::onLockResult(const DocLockStats::Kind kind,
+                       const DocLockStats::Clock::time_point start,
+                       const bool locked)
+{
+  const auto end = DocLockStats::Clock::now();
+  const DocLockStats::Holder current = DocLockStats::currentHolder();
+  DocLockStats::Holder holder;
+  {
+    const std::lock_guard lock(m_lockHolderMutex);
+    if (locked)
+      m_lockHolder = current;
+    else
+      holder = m_lockHolder;
+  }
+  DocLockStats::addLock(kind, this, current, start, end, locked, holder);
+}
+
+void Doc::onUnlock()
+{
+  const DocLockStats::Holder current = DocLockStats::currentHolder();
+  const std::lock_guard lock(m_lockHolderMutex);
+  if (m_lockHolder.thread == current.thread)
+    m_lockHolder = DocLockStats::Holder();
+}
+
 void Doc::setTransaction(Transaction* transaction)
 {
   if (transaction) {
@@ -327,6 +370,38 @@ void Doc::notifyAfterAddTile(LayerTilemap* layer, frame_t frame, tile_index ti)
   notify_observers<DocEvent&>(&DocObserver::onAfterAddTile, ev);
 }
 
+void Doc::beginDeferredNotifications()
+{
+  ++m_deferredNotifications;
+}
+
+void Doc::endDeferredNotifications()
+{
+  ASSERT(m_deferredNotifications > 0);
+  if (--m_deferredNotifications == 0 &&
+      m_hasDeferredNotifications) {
+    m_hasDeferredNotifications = false;
+    notifyGeneralUpdate();
+  }
+}
+
+// static
+bool Doc::isDeferredNotification(void (DocObserver::*method)(DocEvent&))
+{
+  return (method == &DocObserver::onSpritePixelsModified ||
+          method == &DocObserver::onImagePixelsModified ||
+          method == &DocObserver::onCelPositionChanged ||
+          method == &DocObserver::onCelOpacityChange ||
+          method == &DocObserver::onCelZIndexChange ||
+          method == &DocObserver::onLayerNameChange ||
+          method == &DocObserver::onLayerOpacityChange ||
+          method == &DocObserver::onLayerBlendModeChange ||
+          method == &DocObserver::onUserDataChange ||
+          method == &DocObserver::onFrameDurationChanged ||
+          method == &DocObserver::onTagChange ||
+          method == &DocObserver::onTagRename);
+}
+
 bool Doc::isModified() const
 {
   return !m_undo->isInSavedStateOrSimilar();
@@ -351,8 +426,10 @@ void Doc::impossibleToBackToSavedState()
 bool Doc::needsBackup() const
 {
   // If the undo history isn't empty, the user has modified the
-  // document, so we need to backup those changes.
-  return m_undo->canUndo() || m_undo->canRedo();
+  // document, so we need to backup those changes. The history can
+  // be empty for a modified document if it was changed without
+  // undo (see Context::setUndoEnabled()).
+  return m_undo->canUndo() || m_undo->canRedo() || isModified();
 }
 
 bool Doc::inhibitBackup() const
@@ -368,6 +445,19 @@ void Doc::setInhibitBackup(const bool inhibitBackup)
     m_flags &= ~kInhibitBackup;
 }
 
+bool Doc::mappedPixels() const
+{
+  return (m_flags & kMappedPixels) == kMappedPixels;
+}
+
+void Doc::setMappedPixels(const bool mappedPixels)
+{
+  if (mappedPixels)
+    m_flags |= kMappedPixels;
+  else
+    m_flags &= ~kMappedPixels;
+}
+
 void Doc::markAsBackedUp()
 {
   DOC_TRACE("DOC: Mark as fully backed up", this);
@@ -418,12 +508,12 @@ void Doc::destroyMaskBoundaries()
 
 void Doc::generateMaskBoundaries(const Mask* mask)
 {
-  m_maskBoundaries.reset();
-
   // No mask specified? Use the current one in the document
   if (!mask) {
-    if (!isMaskVisible())       // The mask is hidden
+    if (!isMaskVisible()) {     // The mask is hidden
+      m_maskBoundaries.reset();
       return;                   // Done, without boundaries
+    }
     else
       mask = this->mask();      // Use the document mask
   }
@@ -431,10 +521,13 @@ void Doc::generateMaskBoundaries(const Mask* mask)
   ASSERT(mask);
 
   if (!mask->isEmpty()) {
-    m_maskBoundaries.regen(mask->bitmap());
-    m_maskBoundaries.offset(mask->bounds().x,
-                            mask->bounds().y);
+    // Reuses the current segments if the mask bitmap didn't change
+    // (e.g. the selection was just moved)
+    m_maskBoundaries.regen(mask->bitmap(),
+                           mask->bounds().origin());
   }
+  else
+    m_maskBoundaries.reset();
 
   notifySelectionBoundariesChanged();
 }
@@ -9,6 +9,7 @@
 #define APP_DOC_H_INCLUDED
 #pragma once
 
+#include "app/doc_lock_stats.h"
 #include "app/doc_observer.h"
 #include "app/extra_cel.h"
 #include "app/file/format_options.h"
@@ -27,7 +28,9 @@
 
 #include <atomic>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <type_traits>
 
 namespace doc {
   class Cel;
@@ -66,9 +69,11 @@ namespace app {
       kInhibitBackup    = 4, // Inhibit the backup process
       kFullyBackedUp    = 8, // Full backup was done
       kReadOnly         = 16,// This document is read-only
+      kMappedPixels     = 32,// Big images are mapped to scratch files
     };
   public:
     using LockResult = base::RWLock::LockResult;
+    using WriteEpochRef = std::shared_ptr<const std::atomic<uint32_t>>;
 
     Doc(Sprite* sprite);
     ~Doc();
@@ -87,6 +92,12 @@ namespace app {
     bool weakLock(std::atomic<base::RWLock::WeakLock>* weak_lock_flag);
     void weakUnlock();
 
+    // Counter incremented each time the document is locked for
+    // writing (and when it's destroyed). It can be used to know if the
+    // document could have been modified without locking it (e.g. see
+    // DocFrameSnapshot).
+    WriteEpochRef writeEpochRef() const { return m_writeEpoch; }
+
     // Sets active/running transaction.
     void setTransaction(Transaction* transaction);
     Transaction* transaction() { return m_transaction; }
@@ -134,6 +145,28 @@ namespace app {
     void notifyLayerGroupCollapseChange(Layer* layer);
     void notifyAfterAddTile(LayerTilemap* layer, frame_t frame, tile_index ti);
 
+    // Defers notifications about modified pixels/properties
+    // (onSpritePixelsModified(), onCelOpacityChange(), etc.) until
+    // the last endDeferredNotifications() call, where only one
+    // onGeneralUpdate() is sent if some notification was deferred
+    // (e.g. to avoid invalidating the timeline/editors for each change
+    // of a script inside app.transaction()). Notifications about
+    // added/removed objects are never deferred.
+    void beginDeferredNotifications();
+    void endDeferredNotifications();
+
+    template<typename... Args>
+    void notify_observers(void (DocObserver::*method)(Args...), Args... args) {
+      if constexpr (std::is_same_v<void (DocObserver::*)(Args...),
+                                   void (DocObserver::*)(DocEvent&)>) {
+        if (m_deferredNotifications > 0 && isDeferredNotification(method)) {
+          m_hasDeferredNotifications = true;
+          return;
+        }
+      }
+      obs::observable<DocObserver>::notify_observers<Args...>(method, args...);
+    }
+
     //////////////////////////////////////////////////////////////////////
     // File related properties
 
@@ -161,6 +194,12 @@ namespace app {
     void markAsBackedUp();
     bool isFullyBackedUp() const;
 
+    // Out-of-core mode: the pixels of big cel images are moved to
+    // scratch files (see doc::Image::mapPixels()) by the
+    // CelsCompressor (experimental.mapped_pixels_threshold option).
+    bool mappedPixels() const;
+    void setMappedPixels(const bool mappedPixels);
+
     // TODO This read-only flag might be confusing because it
     //      indicates that the file was loaded from an incompatible
     //      version (future unknown feature) and it's preferable to
@@ -254,6 +293,14 @@ namespace app {
   private:
     void removeFromContext();
     void updateOSColorSpace(bool appWideSignal);
+    static bool isDeferredNotification(void (DocObserver::*method)(DocEvent&));
+
+    // Records the lock wait time in DocLockStats, and the new holder
+    // of the lock (or the current holder if the lock failed).
+    void onLockResult(const DocLockStats::Kind kind,
+                      const DocLockStats::Clock::time_point start,
+                      const bool locked);
+    void onUnlock();
 
     // The document is in the collection of documents of this context.
     Context* m_ctx;
@@ -263,6 +310,12 @@ namespace app {
 
     // Read-Write locks.
     base::RWLock m_rwLock;
+    std::shared_ptr<std::atomic<uint32_t>> m_writeEpoch;
+
+    // Last thread/operation that acquired the lock (to know who was
+    // holding the lock when a lock fails).
+    std::mutex m_lockHolderMutex;
+    DocLockStats::Holder m_lockHolder;
 
     // Undo and redo information about the document.
     std::unique_ptr<DocUndo> m_undo;
@@ -291,9 +344,31 @@ namespace app {
     // Last used color space to render a sprite.
     os::ColorSpaceRef m_osColorSpace;
 
+    // Number of beginDeferredNotifications() calls without its
+    // endDeferredNotifications().
+    int m_deferredNotifications = 0;
+    bool m_hasDeferredNotifications = false;
+
     DISABLE_COPYING(Doc);
   };
 
+  // Defers the notifications of the given document in the scope of
+  // this object (see Doc::beginDeferredNotifications()).
+  class DeferDocNotifications {
+  public:
+    DeferDocNotifications(Doc* doc) : m_doc(doc) {
+      if (m_doc)
+        m_doc->beginDeferredNotifications();
+    }
+    ~DeferDocNotifications() {
+      if (m_doc)
+        m_doc->endDeferredNotifications();
+    }
+  private:
+    Doc* m_doc;
+    DISABLE_COPYING(DeferDocNotifications);
+  };
+
 } // namespace app
 
 #endif
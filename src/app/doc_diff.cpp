@@ -24,6 +24,9 @@
 #include "doc/tilesets.h"
 #include "doc/user_data.h"
 
+#include <map>
+#include <utility>
+
 #ifdef _DEBUG
 namespace doc {
 
@@ -39,6 +42,38 @@ static std::ostream& operator<<(std::ostream& os, const UserData& userData)
 
 namespace app {
 
+namespace {
+
+// Compares the pixels of pairs of images, remembering the result of
+// each pair so images shared by several cels (linked cels) are
+// compared only once. Images are always compared pixel by pixel
+// (is_same_image() treats transparent pixels with different RGB
+// values as the same color, and content hashes can collide).
+class ImageComparer {
+public:
+  bool isSame(const Image* a, const Image* b) {
+    if (a == b)
+      return true;
+    if (a->bounds() != b->bounds() ||
+        a->pixelFormat() != b->pixelFormat())
+      return false;
+
+    const auto key = std::make_pair(a, b);
+    auto it = m_results.find(key);
+    if (it != m_results.end())
+      return it->second;
+
+    const bool same = is_same_image(a, b);
+    m_results[key] = same;
+    return same;
+  }
+
+private:
+  std::map<std::pair<const Image*, const Image*>, bool> m_results;
+};
+
+} // anonymous namespace
+
 #ifdef _DEBUG
   #define TRACEDIFF(a, b) if (a != b) { TRACEARGS(#a " != " #b, a, b); }
 #else
@@ -49,6 +84,7 @@ DocDiff compare_docs(const Doc* a,
                      const Doc* b)
 {
   DocDiff diff;
+  ImageComparer comparer;
 
   // Don't compare filenames
   //if (a->filename() != b->filename())...
@@ -116,6 +152,9 @@ DocDiff compare_docs(const Doc* a,
 
   // Palettes
   if (a->sprite()->getPalettes().size() != b->sprite()->getPalettes().size()) {
+    diff.anything = diff.palettes = true;
+  }
+  else {
     const PalettesList& aPals = a->sprite()->getPalettes();
     const PalettesList& bPals = b->sprite()->getPalettes();
     auto aIt = aPals.begin(), aEnd = aPals.end();
@@ -163,8 +202,8 @@ DocDiff compare_docs(const Doc* a,
       }
       else {
         for (tile_index ti=0; ti<aTileset->size(); ++ti) {
-          if (!is_same_image(aTileset->get(ti).get(),
-                             bTileset->get(ti).get())) {
+          if (!comparer.isSame(aTileset->get(ti).get(),
+                               bTileset->get(ti).get())) {
             diff.anything = diff.tilesets = true;
             goto done;
           }
@@ -222,9 +261,13 @@ DocDiff compare_docs(const Doc* a,
               TRACEDIFF(aCel->opacity(), bCel->opacity());
               TRACEDIFF(aCel->data()->userData(), bCel->data()->userData());
             }
-            if (aCel->image() && bCel->image()) {
-              if (aCel->image()->bounds() != bCel->image()->bounds() ||
-                  !is_same_image(aCel->image(), bCel->image()))
+            // Once we know that images are different we can skip
+            // comparing pixels of other cels
+            if (diff.images) {
+              // Do nothing
+            }
+            else if (aCel->image() && bCel->image()) {
+              if (!comparer.isSame(aCel->image(), bCel->image()))
                 diff.anything = diff.images = true;
             }
             // In case one is nullptr and the other not
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -43,10 +43,30 @@ namespace app {
   };
 
   // Useful for testing purposes to detect if two documents (after
-  // some kind of operation) are equivalent.
+  // some kind of operation) are equivalent. Images shared by
+  // several cels are compared only once, and images are not compared
+  // anymore once a difference in images was found.
   DocDiff compare_docs(const Doc* a,
                        const Doc* b);
 
+  // Calls func(name, value) for each field of the diff (e.g. to
+  // print the differences from the CLI or to return them to scripts).
+  template<typename Func>
+  void for_each_doc_diff_field(const DocDiff& diff, Func&& func) {
+    func("anything", diff.anything);
+    func("canvas", diff.canvas);
+    func("totalFrames", diff.totalFrames);
+    func("frameDuration", diff.frameDuration);
+    func("tags", diff.tags);
+    func("palettes", diff.palettes);
+    func("tilesets", diff.tilesets);
+    func("layers", diff.layers);
+    func("cels", diff.cels);
+    func("images", diff.images);
+    func("colorProfiles", diff.colorProfiles);
+    func("gridBounds", diff.gridBounds);
+  }
+
 } // namespace app
 
 #endif
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -16,8 +16,10 @@
 #include "app/console.h"
 #include "app/context.h"
 #include "app/doc.h"
+#include "app/doc_exporter_cache.h"
 #include "app/file/file.h"
 #include "app/filename_formatter.h"
+#include "app/perf_trace.h"
 #include "app/restore_visible_layers.h"
 #include "app/snap_to_grid.h"
 #include "app/util/autocrop.h"
@@ -25,12 +27,13 @@
 #include "base/fs.h"
 #include "base/fstream_path.h"
 #include "base/replace_string.h"
+#include "base/scoped_value.h"
 #include "base/string.h"
+#include "base/thread_pool.h"
+#include "doc/algorithm/pack_rects.h"
 #include "doc/algorithm/shrink_bounds.h"
 #include "doc/cel.h"
 #include "doc/image.h"
-#include "doc/images_map.h"
-#include "doc/images_map.h"
 #include "doc/layer.h"
 #include "doc/palette.h"
 #include "doc/primitives.h"
@@ -43,17 +46,24 @@
 #include "gfx/rect_io.h"
 #include "gfx/size.h"
 #include "render/dithering.h"
+#include "render/frame_signature.h"
 #include "render/ordered_dither.h"
 #include "render/render.h"
 #include "ver/info.h"
 
 #include <algorithm>
+#include <charconv>
+#include <cstdint>
 #include <cstdio>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <set>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #define DX_TRACE(...) // TRACEARGS
@@ -88,12 +98,177 @@ std::ostream& operator<<(std::ostream& os, const doc::UserData& data)
   return os;
 }
 
+// Appends the decimal representation of the given number to the
+// string (faster than the std::ostream formatted output, which uses
+// the stream locale for each number).
+void append_number(std::string& s, const int value)
+{
+  char buf[16];
+  const auto res = std::to_chars(buf, buf+sizeof(buf), value);
+  s.append(buf, res.ptr);
+}
+
+// Stream buffer that removes the whitespace outside JSON strings
+// before forwarding the characters to another stream buffer, used to
+// create a compact data file from the same JSON output.
+class CompactJsonBuf : public std::streambuf {
+public:
+  explicit CompactJsonBuf(std::streambuf* dst) : m_dst(dst) { }
+
+protected:
+  int_type overflow(int_type ch) override {
+    if (traits_type::eq_int_type(ch, traits_type::eof()))
+      return traits_type::not_eof(ch);
+
+    const char c = traits_type::to_char_type(ch);
+    if (m_inString) {
+      if (m_escape)
+        m_escape = false;
+      else if (c == '\\')
+        m_escape = true;
+      else if (c == '"')
+        m_inString = false;
+    }
+    else if (c == '"')
+      m_inString = true;
+    else if (c == ' ' || c == '\n' || c == '\r' || c == '\t')
+      return ch;
+    return m_dst->sputc(c);
+  }
+
+  std::streamsize xsputn(const char* s, std::streamsize n) override {
+    for (std::streamsize i=0; i<n; ++i) {
+      if (traits_type::eq_int_type(overflow(traits_type::to_int_type(s[i])),
+                                   traits_type::eof()))
+        return i;
+    }
+    return n;
+  }
+
+  int sync() override {
+    return m_dst->pubsync();
+  }
+
+private:
+  std::streambuf* m_dst;
+  bool m_inString = false;
+  bool m_escape = false;
+};
+
+// Writes the values of the binary data file in little-endian.
+class BinaryDataWriter {
+public:
+  explicit BinaryDataWriter(std::ostream& os) : m_os(os) { }
+
+  void write8(const uint8_t value) {
+    m_os.put(char(value));
+  }
+
+  void write32(const uint32_t value) {
+    const char bytes[4] = { char(value & 0xff),
+                            char((value >> 8) & 0xff),
+                            char((value >> 16) & 0xff),
+                            char((value >> 24) & 0xff) };
+    m_os.write(bytes, 4);
+  }
+
+  void writeInt(const int value) {
+    write32(uint32_t(int32_t(value)));
+  }
+
+  void writeString(const std::string& value) {
+    write32(uint32_t(value.size()));
+    m_os.write(value.c_str(), value.size());
+  }
+
+  void writeRect(const gfx::Rect& rc) {
+    writeInt(rc.x);
+    writeInt(rc.y);
+    writeInt(rc.w);
+    writeInt(rc.h);
+  }
+
+private:
+  std::ostream& m_os;
+};
+
 } // anonymous namespace
 
 namespace app {
 
 typedef std::shared_ptr<gfx::Rect> SharedRectPtr;
 
+namespace {
+
+// Calls func(i) for each sample i in [0, n) from a pool of worker
+// threads. The layers visibility is changed only from the calling
+// thread: consecutive samples that show the same layers are
+// processed together, so func() can render the sample (it must not
+// modify the sprite). The progress of the token goes from 0 to 1.
+template<typename GetSample, typename Func>
+void for_each_sample_in_parallel(const int n,
+                                 GetSample getSample,
+                                 Func func,
+                                 base::task_token& token)
+{
+  base::thread_pool pool(std::max(1u, std::thread::hardware_concurrency()));
+
+  for (int i=0; i<n; ) {
+    if (token.canceled())
+      return;
+    token.set_progress(float(i) / n);
+
+    const auto& first = getSample(i);
+    int j = i+1;
+    for (; j<n; ++j) {
+      const auto& sample = getSample(j);
+      if (sample.sprite() != first.sprite() ||
+          sample.selectedLayers() != first.selectedLayers())
+        break;
+    }
+
+    RestoreVisibleLayers layersVisibility;
+    if (first.selectedLayers())
+      layersVisibility.showSelectedLayers(first.sprite(),
+                                          *first.selectedLayers());
+
+    for (; i<j; ++i) {
+      pool.execute([&token, &func, i]{
+        if (!token.canceled())
+          func(i);
+      });
+    }
+    pool.wait_all();
+  }
+  token.set_progress(1.0f);
+}
+
+// Finds images with the same pixels using a hash of their content,
+// the pixels are compared only when two hashes are equal.
+class ImagesHashMap {
+public:
+  // Returns the index of the first added image equal to the image
+  // with the given index, or adds the index and returns -1. The
+  // images are got with getImage(index) only when two hashes are
+  // equal (so images with a known hash can be rendered on demand).
+  template<typename GetImage>
+  int findOrAdd(const uint32_t hash, const int index, GetImage getImage) {
+    const auto range = m_images.equal_range(hash);
+    for (auto it=range.first; it!=range.second; ++it) {
+      if (is_same_image(getImage(it->second).get(),
+                        getImage(index).get()))
+        return it->second;
+    }
+    m_images.emplace(hash, index);
+    return -1;
+  }
+
+private:
+  std::unordered_multimap<uint32_t, int> m_images;
+};
+
+} // anonymous namespace
+
 DocExporter::Item::Item(Doc* doc,
                         const doc::Tag* tag,
                         const doc::SelectedLayers* selLayers,
@@ -170,6 +345,9 @@ public:
     m_extrude(extrude),
     m_isLinked(false),
     m_isDuplicated(false),
+    m_hasHash(false),
+    m_hash(0),
+    m_cacheKey(0),
     m_originalSize(size),
     m_trimmedBounds(size),
     m_inTextureBounds(std::make_shared<gfx::Rect>(size)) {
@@ -235,7 +413,26 @@ public:
   void setLinked() { m_isLinked = true; }
   void setDuplicated() { m_isDuplicated = true; }
 
-  ImageRef createRender(ImageBufferPtr& imageBuf) {
+  // Hash of the rendered sample (to find duplicates)
+  bool hasHash() const { return m_hasHash; }
+  uint32_t hash() const { return m_hash; }
+  void setHash(const uint32_t hash) {
+    m_hasHash = true;
+    m_hash = hash;
+  }
+  void clearHash() {
+    m_hasHash = false;
+    m_hash = 0;
+  }
+
+  // Key of this sample in the DocExporterCache (0 if it cannot be
+  // cached)
+  uint64_t cacheKey() const { return m_cacheKey; }
+  void setCacheKey(const uint64_t key) { m_cacheKey = key; }
+
+  // The visible layers must be set before calling createRender() or
+  // renderSample() (see for_each_sample_in_parallel()).
+  ImageRef createRender(ImageBufferPtr& imageBuf) const {
     ASSERT(m_sprite);
 
     // We use the m_image as it is, it doesn't require a special
@@ -255,11 +452,6 @@ public:
   }
 
   void renderSample(doc::Image* dst, int x, int y, bool extrude) const {
-    RestoreVisibleLayers layersVisibility;
-    if (m_selLayers)
-      layersVisibility.showSelectedLayers(m_sprite,
-                                          *m_selLayers);
-
     render::Render render;
 
     // 1) We cannot use the Preferences because this is called from a non-UI thread
@@ -322,6 +514,9 @@ private:
   bool m_extrude;
   bool m_isLinked;
   bool m_isDuplicated;
+  bool m_hasHash;
+  uint32_t m_hash;
+  uint64_t m_cacheKey;
   gfx::Size m_originalSize;
   gfx::Rect m_trimmedBounds;
   SharedRectPtr m_inTextureBounds;
@@ -340,6 +535,10 @@ public:
     m_samples.push_back(sample);
   }
 
+  Sample& operator[](const size_t i) {
+    return m_samples[i];
+  }
+
   const Sample& operator[](const size_t i) const {
     return m_samples[i];
   }
@@ -361,6 +560,55 @@ public:
                              int shapePadding,
                              int& width, int& height,
                              base::task_token& token) = 0;
+
+protected:
+  typedef std::vector<ImageRef> Renders;
+
+  // Renders the samples that match the given filter and calculates
+  // the hash of their pixels in worker threads to compare them (the
+  // other images are nullptr). Samples with a hash from a previous
+  // export (DocExporterCache) are not rendered. We have to use one
+  // ImageBuffer for each image because we're going to keep all
+  // images to compare them.
+  template<typename Filter>
+  static Renders createRenders(Samples& samples,
+                               Filter filter,
+                               base::task_token& token) {
+    Renders renders(samples.size());
+    for_each_sample_in_parallel(
+      samples.size(),
+      [&samples](const int i) -> const Sample& { return samples[i]; },
+      [&samples, &renders, &filter](const int i) {
+        Sample& sample = samples[i];
+        if (filter(sample) && !sample.hasHash()) {
+          doc::ImageBufferPtr sampleBuf = std::make_shared<doc::ImageBuffer>();
+          ImageRef image = sample.createRender(sampleBuf);
+          sample.setHash(calculate_image_hash(image.get(), image->bounds()));
+          renders[i] = std::move(image);
+        }
+      },
+      token);
+    return renders;
+  }
+
+  // Returns the render of the sample i, creating it now if it wasn't
+  // rendered by createRenders() (from the calling thread, as we have
+  // to change the layers visibility).
+  static const ImageRef& getRender(const Samples& samples,
+                                   Renders& renders,
+                                   const int i) {
+    if (!renders[i]) {
+      const Sample& sample = samples[i];
+      RestoreVisibleLayers layersVisibility;
+      if (sample.selectedLayers())
+        layersVisibility.showSelectedLayers(sample.sprite(),
+                                            *sample.selectedLayers());
+
+      doc::ImageBufferPtr sampleBuf = std::make_shared<doc::ImageBuffer>();
+      renders[i] = sample.createRender(sampleBuf);
+    }
+    return renders[i];
+  }
 };
 
 class DocExporter::SimpleLayoutSamples : public DocExporter::LayoutSamples {
@@ -392,7 +640,7 @@ public:
     const Layer* oldLayer = nullptr;
     const Tag* oldTag = nullptr;
 
-    doc::ImagesMap duplicates;
+    ImagesHashMap duplicates;
     gfx::Point framePt(borderPadding, borderPadding);
     gfx::Size rowSize(0, 0);
 
@@ -406,10 +654,20 @@ public:
         itemsPerBand = m_maxCols;
     }
 
+    token.set_progress_range(0.2f, 0.3f);
+    Renders renders =
+      createRenders(samples,
+                    [this](const Sample& sample){
+                      return (!sample.isEmpty() &&
+                              (m_mergeDups || sample.isLinked()));
+                    },
+                    token);
+    token.set_progress_range(0.0f, 1.0f);
+
     for (auto& sample : samples) {
       if (token.canceled())
         return;
-      token.set_progress(0.2f + 0.2f * i / samples.size());
+      token.set_progress(0.3f + 0.1f * i / samples.size());
 
       if (sample.isEmpty()) {
         sample.setInTextureBounds(gfx::Rect(0, 0, 0, 0));
@@ -418,20 +676,17 @@ public:
       }
 
       if (m_mergeDups || sample.isLinked()) {
-        doc::ImageBufferPtr sampleBuf = std::make_shared<doc::ImageBuffer>();
-        doc::ImageRef sampleRender(sample.createRender(sampleBuf));
-        auto it = duplicates.find(sampleRender);
-        if (it != duplicates.end()) {
-          const uint32_t j = it->second;
-
+        const int j = duplicates.findOrAdd(
+          sample.hash(), i,
+          [&samples, &renders](const int k) -> const ImageRef& {
+            return getRender(samples, renders, k);
+          });
+        if (j >= 0) {
           sample.setDuplicated();
           sample.setSharedBounds(samples[j].sharedBounds());
           ++i;
           continue;
         }
-        else {
-          duplicates[sampleRender] = i;
-        }
       }
 
       const Sprite* sprite = sample.sprite();
@@ -528,39 +783,72 @@ private:
 
 class DocExporter::BestFitLayoutSamples : public DocExporter::LayoutSamples {
 public:
+  BestFitLayoutSamples(SpriteSheetPackMethod method)
+    : m_method(method) {
+  }
+
   void layoutSamples(Samples& samples,
                      int borderPadding,
                      int shapePadding,
                      int& width, int& height,
                      base::task_token& token) override {
-    gfx::PackingRects pr(borderPadding, shapePadding);
-    doc::ImagesMap duplicates;
+    switch (m_method) {
+      case SpriteSheetPackMethod::MaxRects: {
+        doc::algorithm::RectsPacker pr(
+          doc::algorithm::RectsPacker::Method::MaxRects,
+          borderPadding, shapePadding);
+        packSamples(pr, samples, width, height, token);
+        break;
+      }
+      case SpriteSheetPackMethod::Skyline: {
+        doc::algorithm::RectsPacker pr(
+          doc::algorithm::RectsPacker::Method::Skyline,
+          borderPadding, shapePadding);
+        packSamples(pr, samples, width, height, token);
+        break;
+      }
+      default: {
+        gfx::PackingRects pr(borderPadding, shapePadding);
+        packSamples(pr, samples, width, height, token);
+        break;
+      }
+    }
+  }
+
+private:
+  // Packer can be gfx::PackingRects or doc::algorithm::RectsPacker
+  template<typename Packer>
+  void packSamples(Packer& pr,
+                   Samples& samples,
+                   int& width, int& height,
+                   base::task_token& token) {
+    ImagesHashMap duplicates;
+
+    token.set_progress_range(0.2f, 0.3f);
+    Renders renders =
+      createRenders(samples,
+                    [](const Sample& sample){ return !sample.isEmpty(); },
+                    token);
+    if (token.canceled())
+      return;
 
     uint32_t i = 0;
     for (auto& sample : samples) {
-      if (token.canceled())
-        return;
-      token.set_progress_range(0.2f, 0.3f);
-      token.set_progress(float(i) / samples.size());
-
       if (sample.isEmpty()) {
         ++i;
         continue;
       }
 
-      // We have to use one ImageBuffer for each image because we're
-      // going to store all images in the "duplicates" map.
-      doc::ImageBufferPtr sampleBuf = std::make_shared<doc::ImageBuffer>();
-      doc::ImageRef sampleRender(sample.createRender(sampleBuf));
-      auto it = duplicates.find(sampleRender);
-      if (it != duplicates.end()) {
-        const uint32_t j = it->second;
-
+      const int j = duplicates.findOrAdd(
+        sample.hash(), i,
+        [&samples, &renders](const int k) -> const ImageRef& {
+          return getRender(samples, renders, k);
+        });
+      if (j >= 0) {
         sample.setDuplicated();
         sample.setSharedBounds(samples[j].sharedBounds());
       }
       else {
-        duplicates[sampleRender] = i;
         pr.add(sample.requiredSize());
       }
       ++i;
@@ -588,11 +876,12 @@ public:
       sample.setInTextureBounds(*(it++));
     }
   }
+
+  SpriteSheetPackMethod m_method;
 };
 
 DocExporter::DocExporter()
   : m_docBuf(std::make_shared<doc::ImageBuffer>())
-  , m_sampleBuf(std::make_shared<doc::ImageBuffer>())
 {
   m_cache.spriteId = doc::NullId;
   reset();
@@ -601,6 +890,7 @@ DocExporter::DocExporter()
 void DocExporter::reset()
 {
   m_sheetType = SpriteSheetType::None;
+  m_packMethod = SpriteSheetPackMethod::BestFit;
   m_dataFormat = SpriteSheetDataFormat::Default;
   m_dataFilename.clear();
   m_textureFilename.clear();
@@ -625,6 +915,7 @@ void DocExporter::reset()
   m_listLayers = false;
   m_listLayerHierarchy = false;
   m_listSlices = false;
+  m_dataCompact = false;
   m_documents.clear();
 }
 
@@ -635,8 +926,14 @@ void DocExporter::setDocImageBuffer(const doc::ImageBufferPtr& docBuf)
 
 Doc* DocExporter::exportSheet(Context* ctx, base::task_token& token)
 {
-  // We output the metadata to std::cout if the user didn't specify a file.
+  PerfTrace span("export", "DocExporter::exportSheet");
+
+  // We output the metadata to std::cout if the user didn't specify a
+  // file. The file is written through a big buffer as the data of
+  // each sample is written in small pieces.
+  std::vector<char> fosBuffer(256*1024);
   std::ofstream fos;
+  fos.rdbuf()->pubsetbuf(fosBuffer.data(), fosBuffer.size());
   std::streambuf* osbuf = nullptr;
   if (m_dataFilename.empty()) {
     // Redirect to stdout if we are running in batch mode
@@ -658,11 +955,32 @@ Doc* DocExporter::exportSheet(Context* ctx, base::task_token& token)
       }
     }
 
-    fos.open(FSTREAM_PATH(m_dataFilename), std::ios::out);
+    fos.open(FSTREAM_PATH(m_dataFilename),
+             (m_dataFormat == SpriteSheetDataFormat::Binary ?
+              std::ios::out | std::ios::binary: std::ios::out));
     osbuf = fos.rdbuf();
   }
+
+  // Remove the whitespace of the JSON data
+  std::unique_ptr<CompactJsonBuf> compactBuf;
+  if (osbuf && m_dataCompact &&
+      m_dataFormat != SpriteSheetDataFormat::Binary) {
+    compactBuf = std::make_unique<CompactJsonBuf>(osbuf);
+    osbuf = compactBuf.get();
+  }
   std::ostream os(osbuf);
 
+  // Load the data of the previous export to re-use the unchanged
+  // samples.
+  std::unique_ptr<DocExporterCache> exportCache;
+  if (!m_cacheFilename.empty()) {
+    exportCache = std::make_unique<DocExporterCache>();
+    if (!exportCache->load(m_cacheFilename, cacheOptions()))
+      exportCache = std::make_unique<DocExporterCache>();
+  }
+  base::ScopedValue<DocExporterCache*> scopedCache(m_exportCache,
+                                                   exportCache.get());
+
   // Steps for sheet construction:
   // 1) Capture the samples (each sprite+frame pair)
   Samples samples;
@@ -695,7 +1013,9 @@ Doc* DocExporter::exportSheet(Context* ctx, base::task_token& token)
   Image* textureImage = texture->root()->firstLayer()
     ->cel(frame_t(0))->image();
 
-  renderTexture(ctx, samples, textureImage, token);
+  doc::ImageRef cachedTexture = loadCachedTexture(ctx, texture);
+  renderTexture(ctx, samples, textureImage, cachedTexture.get(), token);
+  cachedTexture.reset();
   if (token.canceled())
     return nullptr;
   token.set_progress(0.8f);
@@ -706,8 +1026,13 @@ Doc* DocExporter::exportSheet(Context* ctx, base::task_token& token)
   token.set_progress(0.9f);
 
   // Save the metadata.
-  if (osbuf)
-    createDataFile(samples, os, texture);
+  if (osbuf) {
+    if (m_dataFormat == SpriteSheetDataFormat::Binary)
+      createBinaryDataFile(samples, os, texture);
+    else
+      createDataFile(samples, os, texture);
+    os.flush();
+  }
   token.set_progress(0.95f);
 
   // Save the image files.
@@ -715,8 +1040,33 @@ Doc* DocExporter::exportSheet(Context* ctx, base::task_token& token)
     DX_TRACE("DX: exportSheet", m_textureFilename);
     textureDocument->setFilename(m_textureFilename.c_str());
     int ret = save_document(ctx, textureDocument.get());
-    if (ret == 0)
+    if (ret == 0) {
       textureDocument->markAsSaved();
+
+      if (m_exportCache) {
+        const Image* image = texture->root()->firstLayer()
+          ->cel(frame_t(0))->image();
+        m_exportCache->setTexture(
+          m_textureFilename,
+          calculate_image_hash(image, image->bounds()));
+      }
+    }
+  }
+
+  // Save the data to re-use in the next export.
+  if (m_exportCache) {
+    for (const auto& sample : samples) {
+      if (!sample.cacheKey())
+        continue;
+
+      DocExporterCache::Sample cached;
+      cached.hasHash = sample.hasHash();
+      cached.hash = sample.hash();
+      if (!sample.isEmpty())
+        cached.inTextureBounds = sample.inTextureBounds();
+      m_exportCache->addSample(sample.cacheKey(), cached);
+    }
+    m_exportCache->save(m_cacheFilename, cacheOptions());
   }
 
   token.set_progress(1.0f);
@@ -883,8 +1233,24 @@ int DocExporter::addTilesetsSamples(
 void DocExporter::captureSamples(Samples& samples,
                                  base::task_token& token)
 {
+  PerfTrace span("export", "DocExporter::captureSamples");
+
   DX_TRACE("DX: Capture samples");
 
+  const int nitems = int(m_documents.size());
+  int itemIndex = 0;
+
+  // Index of the first sample of each layer/frame, used to re-use
+  // the bounds of linked cels.
+  std::map<std::pair<const Layer*, frame_t>, int> layerFrameSamples;
+  auto addSample = [&samples, &layerFrameSamples](const Sample& sample) {
+    if (sample.layer()) {
+      layerFrameSamples.emplace(
+        std::make_pair(sample.layer(), sample.frame()),
+        samples.size());
+    }
+    samples.addSample(sample);
+  };
   for (auto& item : m_documents) {
     if (token.canceled())
       return;
@@ -910,6 +1276,19 @@ void DocExporter::captureSamples(Samples& samples,
         (tag != nullptr));              // Has tag
     }
 
+    // Key of this item in the cache of the previous export (0 if we
+    // cannot use the cache, e.g. the document has changes that are
+    // not in its file).
+    uint64_t itemKey = 0;
+    if (m_exportCache && !item.isOneImageOnly() && !doc->isModified()) {
+      const uint64_t fileKey = m_exportCache->fileKey(doc->filename());
+      if (fileKey) {
+        itemKey = DocExporterCache::hash(fileKey, sprite);
+        itemKey = DocExporterCache::hash(itemKey, item.selLayers.get());
+        itemKey = DocExporterCache::hash(itemKey, item.splitGrid ? 1: 0);
+      }
+    }
+
     gfx::Rect spriteBounds;
 
     // This item is only one image (e.g. a tileset tile)
@@ -926,6 +1305,10 @@ void DocExporter::captureSamples(Samples& samples,
             m_cache.trimmedByGrid == m_trimByGrid) {
           spriteBounds = m_cache.trimmedBounds;
         }
+        else if (const DocExporterCache::Trim* cached =
+                 (itemKey ? m_exportCache->findTrim(itemKey): nullptr)) {
+          spriteBounds = cached->bounds;
+        }
         else {
           spriteBounds = get_trimmed_bounds(sprite, m_trimByGrid);
           if (spriteBounds.isEmpty())
@@ -938,9 +1321,47 @@ void DocExporter::captureSamples(Samples& samples,
           m_cache.trimmedByGrid = m_trimByGrid;
           m_cache.trimmedBounds = spriteBounds;
         }
+        if (itemKey)
+          m_exportCache->addTrim(itemKey, { false, spriteBounds });
       }
     }
 
+    // Samples of this item, they are added to "samples" when the
+    // cels are trimmed (in the same order as the frames).
+    struct ItemSample {
+      Sample sample;
+      // Index of the item sample with the original cel of a linked
+      // cel (-1 if it's not linked to a sample of this item).
+      int linkedTo = -1;
+      // True if we have to render the sample to trim it or to know
+      // if it's empty.
+      bool trim = false;
+      // True if the trim results (empty/frameBounds) come from the
+      // cache of the previous export.
+      bool cached = false;
+      bool empty = false;
+      gfx::Rect frameBounds;
+      // Key of the sample in the cache (0 if it's not cached)
+      uint64_t key = 0;
+    };
+    std::vector<ItemSample> itemSamples;
+    std::map<frame_t, int> itemFrameSamples;
+
+    // Signatures of the frames of this item when we merge duplicates,
+    // so frames that render the same pixels (e.g. frames with linked
+    // cels in all layers) re-use the first sample instead of being
+    // rendered again to trim them.
+    std::map<frame_t, uint64_t> frameSignatures;
+    std::unordered_map<uint64_t, int> signatureSamples;
+    if (m_mergeDuplicates && !layer &&
+        !item.isOneImageOnly() && !item.splitGrid) {
+      RestoreVisibleLayers layersVisibility;
+      if (item.selLayers)
+        layersVisibility.showSelectedLayers(sprite, *item.selLayers);
+      for (frame_t frame : item.getSelectedFrames())
+        frameSignatures[frame] = render::calc_frame_signature(sprite, frame);
+    }
+
     frame_t outputFrame = 0;
     for (frame_t frame : item.getSelectedFrames()) {
       if (token.canceled())
@@ -963,13 +1384,17 @@ void DocExporter::captureSamples(Samples& samples,
 
       std::string filename = filename_formatter(format, fnInfo);
 
-      Sample sample(
-        (item.image ? item.image->size():
-         item.splitGrid ? sprite->gridBounds().size():
-                          sprite->size()),
-        doc, sprite, item.image, item.selLayers.get(),
-        frame, innerTag, filename,
-        m_innerPadding, m_extrude);
+      ItemSample itemSample{
+        Sample(
+          (item.image ? item.image->size():
+           item.splitGrid ? sprite->gridBounds().size():
+                            sprite->size()),
+          doc, sprite, item.image, item.selLayers.get(),
+          frame, innerTag, filename,
+          m_innerPadding, m_extrude) };
+      Sample& sample = itemSample.sample;
+      if (itemKey)
+        itemSample.key = DocExporterCache::hash(itemKey, int(frame));
       Cel* cel = nullptr;
       Cel* link = nullptr;
       bool done = false;
@@ -981,24 +1406,29 @@ void DocExporter::captureSamples(Samples& samples,
       }
 
       // Re-use linked samples
-      bool alreadyTrimmed = false;
       if (link && m_mergeDuplicates &&
           !item.isOneImageOnly()) {
-        for (const Sample& other : samples) {
-          if (token.canceled())
-            return;
-
-          if (other.sprite() == sprite &&
-              other.layer() == layer &&
-              other.frame() == link->frame()) {
-            ASSERT(!other.isLinked());
+        auto it = layerFrameSamples.find(
+          std::make_pair((const Layer*)layer, link->frame()));
+        if (it != layerFrameSamples.end()) {
+          const Sample& other = samples[it->second];
+          ASSERT(!other.isLinked());
+
+          sample.setLinked();
+          sample.setTrimmedBounds(other.trimmedBounds());
+          sample.setSharedBounds(other.sharedBounds());
+          done = true;
+        }
+        // The original cel can be in a sample of this same item, we
+        // will re-use its bounds when it's trimmed.
+        else {
+          auto it2 = itemFrameSamples.find(link->frame());
+          if (it2 != itemFrameSamples.end()) {
+            ASSERT(!itemSamples[it2->second].sample.isLinked());
 
             sample.setLinked();
-            sample.setTrimmedBounds(other.trimmedBounds());
-            sample.setSharedBounds(other.sharedBounds());
-            alreadyTrimmed = true;
+            itemSample.linkedTo = it2->second;
             done = true;
-            break;
           }
         }
         // "done" variable can be false here, e.g. when we export a
@@ -1006,56 +1436,100 @@ void DocExporter::captureSamples(Samples& samples,
         ASSERT(done || (!done && tag));
       }
 
+      // Re-use samples of identical frames
+      auto signature = frameSignatures.find(frame);
+      if (signature != frameSignatures.end()) {
+        auto it = signatureSamples.find(signature->second);
+        if (it != signatureSamples.end()) {
+          sample.setLinked();
+          itemSample.linkedTo = it->second;
+          done = true;
+        }
+        else {
+          signatureSamples.emplace(signature->second, int(itemSamples.size()));
+        }
+      }
+
       if (!done && (m_ignoreEmptyCels || m_trimCels) &&
           !item.isOneImageOnly()) {
         // Ignore empty cels
         if (layer && layer->isImage() && !cel && m_ignoreEmptyCels)
           continue;
 
-        ImageRef sampleRender(sample.createRender(m_sampleBuf));
+        itemSample.trim = true;
+
+        if (const DocExporterCache::Trim* cached =
+            (itemSample.key ? m_exportCache->findTrim(itemSample.key): nullptr)) {
+          itemSample.cached = true;
+          itemSample.empty = cached->empty;
+          itemSample.frameBounds = cached->bounds;
+        }
+      }
+      // If "Ignore Empty" is checked and the item is a tile...
+      else if (m_ignoreEmptyCels && item.isOneImageOnly()) {
+        // Skip empty tile
+        if (is_empty_image(item.image.get()))
+          continue;
+      }
+
+      itemFrameSamples.emplace(frame, int(itemSamples.size()));
+      itemSamples.push_back(std::move(itemSample));
+    }
+
+    // Render and trim the samples of this item in worker threads.
+    const bool trim =
+      std::any_of(itemSamples.begin(), itemSamples.end(),
+                  [](const ItemSample& itemSample){
+                    return itemSample.trim && !itemSample.cached;
+                  });
+    token.set_progress_range(0.2f * itemIndex / nitems,
+                             0.2f * (itemIndex+1) / nitems);
+    if (trim) {
+      for_each_sample_in_parallel(
+        int(itemSamples.size()),
+        [&itemSamples](const int i) -> const Sample& {
+          return itemSamples[i].sample;
+        },
+        [this, &itemSamples, layer, sprite, &spriteBounds](const int i) {
+          ItemSample& itemSample = itemSamples[i];
+          if (!itemSample.trim || itemSample.cached)
+            return;
+
+          doc::ImageBufferPtr sampleBuf = std::make_shared<doc::ImageBuffer>();
+          ImageRef sampleRender(itemSample.sample.createRender(sampleBuf));
 
-        gfx::Rect frameBounds;
-        doc::color_t refColor = 0;
+          gfx::Rect& frameBounds = itemSample.frameBounds;
+          doc::color_t refColor = 0;
 
-        if (m_trimCels) {
-          if ((layer &&
-               layer->isBackground()) ||
-              (!layer &&
-               sprite->backgroundLayer() &&
-               sprite->backgroundLayer()->isVisible())) {
-            refColor = get_pixel(sampleRender.get(), 0, 0);
+          if (m_trimCels) {
+            if ((layer &&
+                 layer->isBackground()) ||
+                (!layer &&
+                 sprite->backgroundLayer() &&
+                 sprite->backgroundLayer()->isVisible())) {
+              refColor = get_pixel(sampleRender.get(), 0, 0);
+            }
+            else {
+              refColor = sprite->transparentColor();
+            }
           }
-          else {
+          else if (m_ignoreEmptyCels)
             refColor = sprite->transparentColor();
-          }
-        }
-        else if (m_ignoreEmptyCels)
-          refColor = sprite->transparentColor();
-
-        if (!algorithm::shrink_bounds(sampleRender.get(),
-                                      refColor,
-                                      nullptr,        // layer
-                                      spriteBounds,   // startBounds
-                                      frameBounds)) { // output bounds
-          // If shrink_bounds() returns false, it's because the whole
-          // image is transparent (equal to the mask color).
-
-          // Should we ignore this empty frame? (i.e. don't include
-          // the frame in the sprite sheet)
-          if (m_ignoreEmptyCels)
-            continue;
 
-          // Create an entry with Size(1, 1) for this completely
-          // trimmed frame anyway so we conserve the frame information
-          // (position and duration of the frame in the JSON data, and
-          // the relative position of the frame in frame tags).
-          sample.setTrimmedBounds(frameBounds = gfx::Rect(0, 0, 1, 1));
-        }
+          if (!algorithm::shrink_bounds(sampleRender.get(),
+                                        refColor,
+                                        nullptr,        // layer
+                                        spriteBounds,   // startBounds
+                                        frameBounds)) { // output bounds
+            // If shrink_bounds() returns false, it's because the whole
+            // image is transparent (equal to the mask color).
+            itemSample.empty = true;
+            frameBounds = gfx::Rect(0, 0, 1, 1);
+          }
 
-        if (m_trimCels) {
           // TODO merge this code with the code in DocApi::trimSprite()
-          if (m_trimByGrid) {
-            const gfx::Rect& gridBounds = doc->sprite()->gridBounds();
+          if (m_trimCels && m_trimByGrid) {
+            const gfx::Rect& gridBounds = sprite->gridBounds();
             gfx::Point posTopLeft =
               snap_to_grid(gridBounds,
                            frameBounds.origin(),
@@ -1066,15 +1540,71 @@ void DocExporter::captureSamples(Samples& samples,
                            PreferSnapTo::CeilGrid);
             frameBounds = gfx::Rect(posTopLeft, posBottomRight);
           }
-          sample.setTrimmedBounds(frameBounds);
-          alreadyTrimmed = true;
+        },
+        token);
+    }
+    token.set_progress_range(0.0f, 1.0f);
+    if (token.canceled())
+      return;
+
+    if (itemKey) {
+      for (const ItemSample& itemSample : itemSamples) {
+        if (itemSample.trim) {
+          m_exportCache->addTrim(itemSample.key,
+                                 { itemSample.empty, itemSample.frameBounds });
         }
       }
-      // If "Ignore Empty" is checked and the item is a tile...
-      else if (m_ignoreEmptyCels && item.isOneImageOnly()) {
-        // Skip empty tile
-        if (is_empty_image(item.image.get()))
+    }
+
+    // Each sample is identified in the cache by its frame and its
+    // final bounds, we can re-use the hash of its image (to find
+    // duplicates) from the previous export.
+    auto setSampleKey = [this](ItemSample& itemSample) {
+      if (!itemSample.key)
+        return;
+      Sample& sample = itemSample.sample;
+      sample.setCacheKey(DocExporterCache::hash(itemSample.key,
+                                                sample.trimmedBounds()));
+      const DocExporterCache::Sample* cached =
+        m_exportCache->findSample(sample.cacheKey());
+      if (cached && cached->hasHash)
+        sample.setHash(cached->hash);
+      else
+        sample.clearHash();
+    };
+
+    // Add the samples in the same order of the frames.
+    for (ItemSample& itemSample : itemSamples) {
+      Sample& sample = itemSample.sample;
+      bool alreadyTrimmed = sample.isLinked();
+
+      if (itemSample.linkedTo >= 0) {
+        const ItemSample& other = itemSamples[itemSample.linkedTo];
+
+        // The original cel was an empty frame that we ignored, so
+        // this linked cel is empty too.
+        if (other.empty && m_ignoreEmptyCels) {
+          itemSample.empty = true;
+          continue;
+        }
+
+        sample.setTrimmedBounds(other.sample.trimmedBounds());
+        sample.setSharedBounds(other.sample.sharedBounds());
+      }
+      else if (itemSample.trim) {
+        // Should we ignore this empty frame? (i.e. don't include
+        // the frame in the sprite sheet)
+        if (itemSample.empty && m_ignoreEmptyCels)
           continue;
+
+        // Create an entry with Size(1, 1) for a completely trimmed
+        // frame anyway so we conserve the frame information (position
+        // and duration of the frame in the JSON data, and the
+        // relative position of the frame in frame tags).
+        if (itemSample.empty || m_trimCels)
+          sample.setTrimmedBounds(itemSample.frameBounds);
+        if (m_trimCels)
+          alreadyTrimmed = true;
       }
 
       if (!alreadyTrimmed && m_trimSprite)
@@ -1090,12 +1620,14 @@ void DocExporter::captureSamples(Samples& samples,
             const gfx::Rect cellBounds(pos, gridBounds.size());
             sample.setTrimmedBounds(cellBounds);
             sample.setSharedBounds(std::make_shared<gfx::Rect>(sample.inTextureBounds()));
-            samples.addSample(sample);
+            setSampleKey(itemSample);
+            addSample(sample);
           }
         }
       }
       else {
-        samples.addSample(sample);
+        setSampleKey(itemSample);
+        addSample(sample);
       }
 
       DX_TRACE("DX:   - Sample:",
@@ -1104,18 +1636,21 @@ void DocExporter::captureSamples(Samples& samples,
                "TrimmedBounds:", sample.trimmedBounds(),
                "InTextureBounds:", sample.inTextureBounds());
     }
+    ++itemIndex;
   }
 }
 
 void DocExporter::layoutSamples(Samples& samples,
                                 base::task_token& token)
 {
+  PerfTrace span("export", "DocExporter::layoutSamples");
+
   int width = m_textureWidth;
   int height = m_textureHeight;
 
   switch (m_sheetType) {
     case SpriteSheetType::Packed: {
-      BestFitLayoutSamples layout;
+      BestFitLayoutSamples layout(m_packMethod);
       layout.layoutSamples(
         samples, m_borderPadding, m_shapePadding,
         width, height, token);
@@ -1181,6 +1716,8 @@ gfx::Size DocExporter::calculateSheetSize(const Samples& samples,
 Doc* DocExporter::createEmptyTexture(const Samples& samples,
                                      base::task_token& token) const
 {
+  PerfTrace span("export", "DocExporter::createEmptyTexture");
+
   ColorMode colorMode = ColorMode::INDEXED;
   Palette palette(0, 0);
   int maxColors = 256;
@@ -1269,26 +1806,28 @@ Doc* DocExporter::createEmptyTexture(const Samples& samples,
 void DocExporter::renderTexture(Context* ctx,
                                 const Samples& samples,
                                 Image* textureImage,
+                                const Image* cachedTexture,
                                 base::task_token& token) const
 {
+  PerfTrace span("export", "DocExporter::renderTexture");
+
   textureImage->clear(textureImage->maskColor());
 
-  int i = 0;
+  auto sampleToRender = [](const Sample& sample) {
+    return (!sample.isLinked() &&
+            !sample.isDuplicated() &&
+            !sample.isEmpty());
+  };
+
+  // Make the sprites compatible with the texture so the render()
+  // works correctly. This modifies the sprites so it must be done
+  // before rendering the samples in worker threads.
   for (const auto& sample : samples) {
     if (token.canceled())
       return;
-    token.set_progress(0.6f + 0.2f * i / int(samples.size()));
-
-    if (sample.isLinked() ||
-        sample.isDuplicated() ||
-        sample.isEmpty()) {
-      ++i;
-      continue;
-    }
 
-    // Make the sprite compatible with the texture so the render()
-    // works correctly.
-    if (sample.sprite()->pixelFormat() != textureImage->pixelFormat()) {
+    if (sampleToRender(sample) &&
+        sample.sprite()->pixelFormat() != textureImage->pixelFormat()) {
       cmd::SetPixelFormat(
         sample.sprite(),
         textureImage->pixelFormat(),
@@ -1298,19 +1837,106 @@ void DocExporter::renderTexture(Context* ctx,
         nullptr) // TODO add a delegate to show progress
         .execute(ctx);
     }
-
-    sample.renderSample(
-      textureImage,
-      sample.inTextureBounds().x+m_innerPadding,
-      sample.inTextureBounds().y+m_innerPadding,
-      m_extrude);
-    ++i;
   }
+
+  // Each sample is rendered in its own texture bounds, so samples
+  // can be rendered in parallel.
+  token.set_progress_range(0.6f, 0.8f);
+  for_each_sample_in_parallel(
+    samples.size(),
+    [&samples](const int i) -> const Sample& { return samples[i]; },
+    [this, &samples, &sampleToRender, textureImage, cachedTexture](const int i) {
+      const Sample& sample = samples[i];
+      if (!sampleToRender(sample))
+        return;
+
+      // Copy the pixels of an unchanged sample from the texture of
+      // the previous export.
+      if (cachedTexture && sample.cacheKey()) {
+        const DocExporterCache::Sample* cached =
+          m_exportCache->findSample(sample.cacheKey());
+        if (cached &&
+            !cached->inTextureBounds.isEmpty() &&
+            cached->inTextureBounds.size() == sample.inTextureBounds().size() &&
+            cachedTexture->bounds().contains(cached->inTextureBounds)) {
+          textureImage->copy(cachedTexture,
+                             gfx::Clip(sample.inTextureBounds().origin(),
+                                       cached->inTextureBounds));
+          return;
+        }
+      }
+
+      sample.renderSample(
+        textureImage,
+        sample.inTextureBounds().x+m_innerPadding,
+        sample.inTextureBounds().y+m_innerPadding,
+        m_extrude);
+    },
+    token);
+  token.set_progress_range(0.0f, 1.0f);
+}
+
+doc::ImageRef DocExporter::loadCachedTexture(Context* ctx,
+                                             const doc::Sprite* texture) const
+{
+  if (!m_exportCache ||
+      m_textureFilename.empty() ||
+      m_exportCache->textureFilename() != m_textureFilename ||
+      !base::is_file(m_textureFilename))
+    return nullptr;
+
+  std::unique_ptr<Doc> doc(load_document(ctx, m_textureFilename));
+  if (!doc)
+    return nullptr;
+
+  // The pixels of the previous texture can be re-used only if the
+  // file wasn't modified since the previous export.
+  const Sprite* sprite = doc->sprite();
+  const Layer* layer = sprite->root()->firstLayer();
+  const Cel* cel = (layer ? layer->cel(frame_t(0)): nullptr);
+  if (!cel ||
+      sprite->pixelFormat() != texture->pixelFormat() ||
+      (texture->pixelFormat() == IMAGE_INDEXED &&
+       *sprite->palette(frame_t(0)) != *texture->palette(frame_t(0))))
+    return nullptr;
+
+  const ImageRef image = cel->imageRef();
+  if (calculate_image_hash(image.get(), image->bounds()) != m_exportCache->textureHash())
+    return nullptr;
+
+  return image;
+}
+
+// Properties that change the output of all samples, the cache of a
+// previous export is used only if they are the same.
+std::string DocExporter::cacheOptions() const
+{
+  std::ostringstream os;
+  os << int(m_sheetType) << ' '
+     << int(m_packMethod) << ' '
+     << m_textureWidth << ' '
+     << m_textureHeight << ' '
+     << m_textureColumns << ' '
+     << m_textureRows << ' '
+     << m_borderPadding << ' '
+     << m_shapePadding << ' '
+     << m_innerPadding << ' '
+     << m_ignoreEmptyCels << ' '
+     << m_mergeDuplicates << ' '
+     << m_trimSprite << ' '
+     << m_trimCels << ' '
+     << m_trimByGrid << ' '
+     << m_extrude << ' '
+     << m_splitLayers << ' '
+     << m_splitTags;
+  return os.str();
 }
 
 void DocExporter::trimTexture(const Samples& samples,
                               doc::Sprite* texture) const
 {
+  PerfTrace span("export", "DocExporter::trimTexture");
+
   if (m_textureWidth > 0 && m_textureHeight > 0)
     return;
 
@@ -1347,6 +1973,8 @@ void DocExporter::createDataFile(const Samples& samples,
                                  std::ostream& os,
                                  doc::Sprite* texture)
 {
+  PerfTrace span("export", "DocExporter::createDataFile");
+
   std::string frames_begin;
   std::string frames_end;
   bool filename_as_key = false;
@@ -1376,9 +2004,15 @@ void DocExporter::createDataFile(const Samples& samples,
       filename_as_key = false;
       filename_as_attr = true;
       break;
+    case SpriteSheetDataFormat::Binary:
+      // Created with createBinaryDataFile()
+      break;
   }
 
   os << "{ \"frames\": " << frames_begin << "\n";
+
+  // Each frame is formatted in this string and written at once.
+  std::string buf;
   for (Samples::const_iterator
          it = samples.begin(),
          end = samples.end(); it != end; ) {
@@ -1387,34 +2021,57 @@ void DocExporter::createDataFile(const Samples& samples,
     gfx::Rect spriteSourceBounds = sample.trimmedBounds();
     gfx::Rect frameBounds = sample.inTextureBounds();
 
-    if (filename_as_key)
-      os << "   \"" << escape_for_json(sample.filename()) << "\": {\n";
-    else if (filename_as_attr)
-      os << "   {\n"
-         << "    \"filename\": \"" << escape_for_json(sample.filename()) << "\",\n";
-
-    os << "    \"frame\": { "
-       << "\"x\": " << frameBounds.x + nonExtrudedPosition << ", "
-       << "\"y\": " << frameBounds.y + nonExtrudedPosition << ", "
-       << "\"w\": " << frameBounds.w + nonExtrudedSize << ", "
-       << "\"h\": " << frameBounds.h + nonExtrudedSize << " },\n"
-       << "    \"rotated\": false,\n"
-       << "    \"trimmed\": " << (sample.trimmed() ? "true": "false") << ",\n"
-       << "    \"spriteSourceSize\": { "
-       << "\"x\": " << spriteSourceBounds.x << ", "
-       << "\"y\": " << spriteSourceBounds.y << ", "
-       << "\"w\": " << spriteSourceBounds.w << ", "
-       << "\"h\": " << spriteSourceBounds.h << " },\n"
-       << "    \"sourceSize\": { "
-       << "\"w\": " << srcSize.w << ", "
-       << "\"h\": " << srcSize.h << " },\n"
-       << "    \"duration\": " << sample.sprite()->frameDuration(sample.frame()) << "\n"
-       << "   }";
+    buf.clear();
+    if (filename_as_key) {
+      buf += "   \"";
+      buf += escape_for_json(sample.filename());
+      buf += "\": {\n";
+    }
+    else if (filename_as_attr) {
+      buf += "   {\n"
+             "    \"filename\": \"";
+      buf += escape_for_json(sample.filename());
+      buf += "\",\n";
+    }
+
+    buf += "    \"frame\": { \"x\": ";
+    append_number(buf, frameBounds.x + nonExtrudedPosition);
+    buf += ", \"y\": ";
+    append_number(buf, frameBounds.y + nonExtrudedPosition);
+    buf += ", \"w\": ";
+    append_number(buf, frameBounds.w + nonExtrudedSize);
+    buf += ", \"h\": ";
+    append_number(buf, frameBounds.h + nonExtrudedSize);
+    buf += " },\n"
+           "    \"rotated\": false,\n"
+           "    \"trimmed\": ";
+    buf += (sample.trimmed() ? "true": "false");
+    buf += ",\n"
+           "    \"spriteSourceSize\": { \"x\": ";
+    append_number(buf, spriteSourceBounds.x);
+    buf += ", \"y\": ";
+    append_number(buf, spriteSourceBounds.y);
+    buf += ", \"w\": ";
+    append_number(buf, spriteSourceBounds.w);
+    buf += ", \"h\": ";
+    append_number(buf, spriteSourceBounds.h);
+    buf += " },\n"
+           "    \"sourceSize\": { \"w\": ";
+    append_number(buf, srcSize.w);
+    buf += ", \"h\": ";
+    append_number(buf, srcSize.h);
+    buf += " },\n"
+           "    \"duration\": ";
+    append_number(buf, sample.sprite()->frameDuration(sample.frame()));
+    buf += "\n"
+           "   }";
 
     if (++it != samples.end())
-      os << ",\n";
+      buf += ",\n";
     else
-      os << "\n";
+      buf += "\n";
+
+    os.write(buf.c_str(), buf.size());
   }
   os << " " << frames_end;
 
@@ -1671,4 +2328,145 @@ void DocExporter::createDataFile(const Samples& samples,
      << "}\n";
 }
 
+// Binary data file for runtime loaders (all values in little-endian,
+// strings as uint32 length + UTF-8 bytes):
+//
+//   char[4]  "ASDF"
+//   uint32   Version (1)
+//   string   Texture filename ("" if there is no texture file)
+//   uint8    Texture format (0=RGBA8888, 1=I8)
+//   int32    Texture width and height
+//   uint32   Number of frames, for each frame:
+//     string   Filename
+//     int32[4] Bounds in the texture (x, y, w, h)
+//     uint8    Trimmed (0 or 1)
+//     int32[4] Source bounds in the sprite (x, y, w, h)
+//     int32[2] Source size (w, h)
+//     int32    Duration in milliseconds
+//   uint32   Number of tags (0 if tags aren't listed), for each tag:
+//     string   Name
+//     int32    From and to frames
+//     uint8    Direction (doc::AniDir)
+//     int32    Repeat (0 = infinite)
+//   uint32   Number of slices (0 if slices aren't listed), for each slice:
+//     string   Name
+//     uint32   Number of keys, for each key:
+//       int32    Frame
+//       int32[4] Bounds
+//       uint8    Flags (1 = with center, 2 = with pivot)
+//       int32[4] Center (if flags & 1)
+//       int32[2] Pivot (if flags & 2)
+//
+// Layers are not included in this format.
+void DocExporter::createBinaryDataFile(const Samples& samples,
+                                       std::ostream& os,
+                                       doc::Sprite* texture)
+{
+  PerfTrace span("export", "DocExporter::createBinaryDataFile");
+
+  BinaryDataWriter w(os);
+  const int nonExtrudedPosition = (m_extrude ? 1: 0);
+  const int nonExtrudedSize = (m_extrude ? -2: 0);
+
+  os.write("ASDF", 4);
+  w.write32(1);
+  w.writeString(m_textureFilename.empty() ? std::string():
+                                            base::get_file_name(m_textureFilename));
+  w.write8(texture->pixelFormat() == IMAGE_RGB ? 0: 1);
+  w.writeInt(texture->width());
+  w.writeInt(texture->height());
+
+  // Frames
+  w.write32(uint32_t(samples.size()));
+  for (const Sample& sample : samples) {
+    const gfx::Rect frameBounds = sample.inTextureBounds();
+    const gfx::Size srcSize = sample.originalSize();
+
+    w.writeString(sample.filename());
+    w.writeRect(gfx::Rect(frameBounds.x + nonExtrudedPosition,
+                          frameBounds.y + nonExtrudedPosition,
+                          frameBounds.w + nonExtrudedSize,
+                          frameBounds.h + nonExtrudedSize));
+    w.write8(sample.trimmed() ? 1: 0);
+    w.writeRect(sample.trimmedBounds());
+    w.writeInt(srcSize.w);
+    w.writeInt(srcSize.h);
+    w.writeInt(sample.sprite()->frameDuration(sample.frame()));
+  }
+
+  // Sprites from where we get the tags and slices (only once each
+  // one, as with -split-layers the same sprite is added several
+  // times)
+  std::vector<std::pair<Doc*, Sprite*>> sprites;
+  {
+    std::set<doc::ObjectId> includedSprites;
+    for (auto& item : m_documents) {
+      if (item.isOneImageOnly())
+        continue;
+
+      Sprite* sprite = item.doc->sprite();
+      if (includedSprites.insert(sprite->id()).second)
+        sprites.emplace_back(item.doc, sprite);
+    }
+  }
+
+  // Tags
+  if (m_listTags) {
+    uint32_t ntags = 0;
+    for (const auto& it : sprites)
+      ntags += uint32_t(it.second->tags().size());
+    w.write32(ntags);
+
+    const std::string format =
+      (m_tagnameFormat.empty() ? std::string("{tag}"): m_tagnameFormat);
+    for (const auto& it : sprites) {
+      for (const Tag* tag : it.second->tags()) {
+        FilenameInfo fnInfo;
+        fnInfo
+          .filename(it.first->filename())
+          .innerTagName(tag->name());
+        w.writeString(filename_formatter(format, fnInfo));
+        w.writeInt(tag->fromFrame());
+        w.writeInt(tag->toFrame());
+        w.write8(uint8_t(tag->aniDir()));
+        w.writeInt(tag->repeat());
+      }
+    }
+  }
+  else
+    w.write32(0);
+
+  // Slices
+  if (m_listSlices) {
+    uint32_t nslices = 0;
+    for (const auto& it : sprites)
+      nslices += uint32_t(it.second->slices().size());
+    w.write32(nslices);
+
+    for (const auto& it : sprites) {
+      for (const Slice* slice : it.second->slices()) {
+        w.writeString(slice->name());
+        w.write32(uint32_t(slice->size()));
+        for (const auto& key : *slice) {
+          const SliceKey* sliceKey = key.value();
+          const bool hasCenter = !sliceKey->center().isEmpty();
+          const bool hasPivot = sliceKey->hasPivot();
+
+          w.writeInt(key.frame());
+          w.writeRect(sliceKey->bounds());
+          w.write8((hasCenter ? 1: 0) | (hasPivot ? 2: 0));
+          if (hasCenter)
+            w.writeRect(sliceKey->center());
+          if (hasPivot) {
+            w.writeInt(sliceKey->pivot().x);
+            w.writeInt(sliceKey->pivot().y);
+          }
+        }
+      }
+    }
+  }
+  else
+    w.write32(0);
+}
+
 } // namespace app
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -10,6 +10,7 @@
 #pragma once
 
 #include "app/sprite_sheet_data_format.h"
+#include "app/sprite_sheet_pack_method.h"
 #include "app/sprite_sheet_type.h"
 #include "base/disable_copying.h"
 #include "base/task.h"
@@ -39,6 +40,7 @@ namespace app {
 
   class Context;
   class Doc;
+  class DocExporterCache;
 
   class DocExporter {
   public:
@@ -51,6 +53,7 @@ namespace app {
     const std::string& dataFilename() { return m_dataFilename; }
     const std::string& textureFilename() { return m_textureFilename; }
     SpriteSheetType spriteSheetType() { return m_sheetType; }
+    SpriteSheetPackMethod packMethod() const { return m_packMethod; }
     const std::string& filenameFormat() const { return m_filenameFormat; }
     const std::string& tagnameFormat() const { return m_tagnameFormat; }
 
@@ -62,6 +65,7 @@ namespace app {
     void setTextureColumns(int columns) { m_textureColumns = columns; }
     void setTextureRows(int rows) { m_textureRows = rows; }
     void setSpriteSheetType(SpriteSheetType type) { m_sheetType = type; }
+    void setPackMethod(SpriteSheetPackMethod method) { m_packMethod = method; }
     void setIgnoreEmptyCels(bool ignore) { m_ignoreEmptyCels = ignore; }
     void setMergeDuplicates(bool merge) { m_mergeDuplicates = merge; }
     void setBorderPadding(int padding) { m_borderPadding = padding; }
@@ -79,6 +83,11 @@ namespace app {
     void setListLayers(bool value) { m_listLayers = value; }
     void setListLayerHierarchy(bool value) { m_listLayerHierarchy = value; }
     void setListSlices(bool value) { m_listSlices = value; }
+    void setDataCompact(bool value) { m_dataCompact = value; }
+
+    // File used to re-use the samples of unchanged files from the
+    // previous export (see DocExporterCache).
+    void setCacheFilename(const std::string& filename) { m_cacheFilename = filename; }
 
     void addImage(
       Doc* doc,
@@ -124,9 +133,14 @@ namespace app {
     void renderTexture(Context* ctx,
                        const Samples& samples,
                        doc::Image* textureImage,
+                       const doc::Image* cachedTexture,
                        base::task_token& token) const;
+    doc::ImageRef loadCachedTexture(Context* ctx,
+                                    const doc::Sprite* texture) const;
+    std::string cacheOptions() const;
     void trimTexture(const Samples& samples, doc::Sprite* texture) const;
     void createDataFile(const Samples& samples, std::ostream& os, doc::Sprite* texture);
+    void createBinaryDataFile(const Samples& samples, std::ostream& os, doc::Sprite* texture);
 
     class Item {
     public:
@@ -159,6 +173,7 @@ namespace app {
     typedef std::vector<Item> Items;
 
     SpriteSheetType m_sheetType;
+    SpriteSheetPackMethod m_packMethod;
     SpriteSheetDataFormat m_dataFormat;
     std::string m_dataFilename;
     std::string m_textureFilename;
@@ -183,11 +198,14 @@ namespace app {
     bool m_listLayers;
     bool m_listLayerHierarchy;
     bool m_listSlices;
+    bool m_dataCompact;
     Items m_documents;
+    std::string m_cacheFilename;
+    // Cache of the previous export used inside exportSheet()
+    DocExporterCache* m_exportCache = nullptr;
 
     // Buffers used
     doc::ImageBufferPtr m_docBuf;
-    doc::ImageBufferPtr m_sampleBuf;
 
     // Trimmed bounds of a specific sprite (to avoid recalculating
     // this)
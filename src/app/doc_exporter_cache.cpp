@@ -0,0 +1,227 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/doc_exporter_cache.h"
+
+#include "base/fs.h"
+#include "base/fstream_path.h"
+#include "doc/layer.h"
+#include "doc/palette.h"
+#include "doc/selected_layers.h"
+#include "doc/sprite.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+namespace app {
+
+namespace {
+
+const char* kCacheHeader = "aseprite-sheet-cache 1";
+
+// FNV-1a
+const uint64_t kHashSeed = 0xcbf29ce484222325ull;
+const uint64_t kHashPrime = 0x100000001b3ull;
+
+std::istream& operator>>(std::istream& is, gfx::Rect& rc)
+{
+  return is >> rc.x >> rc.y >> rc.w >> rc.h;
+}
+
+std::ostream& operator<<(std::ostream& os, const gfx::Rect& rc)
+{
+  return os << rc.x << ' ' << rc.y << ' ' << rc.w << ' ' << rc.h;
+}
+
+// Index of each layer from the root of the sprite, it doesn't
+// depend on object IDs (which can be different in each execution).
+std::vector<int> layer_path(const doc::Layer* layer)
+{
+  std::vector<int> path;
+  for (; layer && layer->parent(); layer=layer->parent()) {
+    const auto& layers = layer->parent()->layers();
+    path.push_back(int(std::find(layers.begin(), layers.end(), layer) - layers.begin()));
+  }
+  std::reverse(path.begin(), path.end());
+  return path;
+}
+
+} // anonymous namespace
+
+bool DocExporterCache::load(const std::string& filename,
+                            const std::string& options)
+{
+  std::ifstream f(FSTREAM_PATH(filename));
+  std::string line;
+  if (!std::getline(f, line) || line != kCacheHeader)
+    return false;
+  if (!std::getline(f, line) || line != "options " + options)
+    return false;
+
+  while (std::getline(f, line)) {
+    std::istringstream s(line);
+    std::string type;
+    uint64_t key;
+    s >> type;
+    if (type == "texture") {
+      s >> std::hex >> m_oldTextureHash >> std::dec;
+      s.get();
+      std::getline(s, m_oldTextureFilename);
+    }
+    else if (type == "trim") {
+      Trim trim;
+      int empty;
+      s >> std::hex >> key >> std::dec >> empty >> trim.bounds;
+      trim.empty = (empty != 0);
+      if (s)
+        m_oldTrims[key] = trim;
+    }
+    else if (type == "sample") {
+      Sample sample;
+      int hasHash;
+      s >> std::hex >> key >> sample.hash >> std::dec
+        >> hasHash >> sample.inTextureBounds;
+      sample.hasHash = (hasHash != 0);
+      if (s)
+        m_oldSamples[key] = sample;
+    }
+  }
+  return true;
+}
+
+void DocExporterCache::save(const std::string& filename,
+                            const std::string& options) const
+{
+  std::ofstream f(FSTREAM_PATH(filename), std::ios::out);
+  f << kCacheHeader << "\n"
+    << "options " << options << "\n";
+  if (!m_newTextureFilename.empty()) {
+    f << "texture " << std::hex << m_newTextureHash << std::dec
+      << " " << m_newTextureFilename << "\n";
+  }
+  for (const auto& it : m_newTrims) {
+    f << "trim " << std::hex << it.first << std::dec << " "
+      << (it.second.empty ? 1: 0) << " "
+      << it.second.bounds << "\n";
+  }
+  for (const auto& it : m_newSamples) {
+    f << "sample " << std::hex << it.first << " " << it.second.hash << std::dec << " "
+      << (it.second.hasHash ? 1: 0) << " "
+      << it.second.inTextureBounds << "\n";
+  }
+}
+
+const DocExporterCache::Trim* DocExporterCache::findTrim(const uint64_t key) const
+{
+  auto it = m_oldTrims.find(key);
+  return (it != m_oldTrims.end() ? &it->second: nullptr);
+}
+
+const DocExporterCache::Sample* DocExporterCache::findSample(const uint64_t key) const
+{
+  auto it = m_oldSamples.find(key);
+  return (it != m_oldSamples.end() ? &it->second: nullptr);
+}
+
+void DocExporterCache::addTrim(const uint64_t key, const Trim& trim)
+{
+  m_newTrims[key] = trim;
+}
+
+void DocExporterCache::addSample(const uint64_t key, const Sample& sample)
+{
+  m_newSamples[key] = sample;
+}
+
+void DocExporterCache::setTexture(const std::string& filename, const uint32_t hash)
+{
+  m_newTextureFilename = filename;
+  m_newTextureHash = hash;
+}
+
+uint64_t DocExporterCache::fileKey(const std::string& filename)
+{
+  auto it = m_fileKeys.find(filename);
+  if (it != m_fileKeys.end())
+    return it->second;
+
+  uint64_t key = 0;
+  if (!filename.empty() && base::is_file(filename)) {
+    std::ifstream f(FSTREAM_PATH(filename), std::ifstream::binary);
+    std::vector<char> buf(64*1024);
+    key = hash(kHashSeed, filename.c_str(), filename.size());
+    while (f) {
+      f.read(buf.data(), buf.size());
+      key = hash(key, buf.data(), std::size_t(f.gcount()));
+    }
+    // 0 means "no key"
+    if (key == 0)
+      key = 1;
+  }
+  m_fileKeys[filename] = key;
+  return key;
+}
+
+// static
+uint64_t DocExporterCache::hash(const uint64_t seed, const void* data, const std::size_t size)
+{
+  uint64_t h = seed;
+  auto p = (const uint8_t*)data;
+  for (std::size_t i=0; i<size; ++i) {
+    h ^= p[i];
+    h *= kHashPrime;
+  }
+  return h;
+}
+
+// static
+uint64_t DocExporterCache::hash(const uint64_t seed, const gfx::Rect& rc)
+{
+  const int values[] = { rc.x, rc.y, rc.w, rc.h };
+  return hash(seed, values, sizeof(values));
+}
+
+// static
+uint64_t DocExporterCache::hash(const uint64_t seed, const doc::SelectedLayers* selLayers)
+{
+  if (!selLayers)
+    return hash(seed, -1);
+
+  std::vector<std::vector<int>> paths;
+  for (const doc::Layer* layer : *selLayers)
+    paths.push_back(layer_path(layer));
+  std::sort(paths.begin(), paths.end());
+
+  uint64_t h = hash(seed, int(paths.size()));
+  for (const auto& path : paths) {
+    h = hash(h, int(path.size()));
+    h = hash(h, path.data(), path.size() * sizeof(int));
+  }
+  return h;
+}
+
+// static
+uint64_t DocExporterCache::hash(const uint64_t seed, const doc::Sprite* sprite)
+{
+  uint64_t h = hash(seed, int(sprite->pixelFormat()));
+  h = hash(h, sprite->bounds());
+  h = hash(h, int(sprite->transparentColor()));
+  for (const doc::Palette* pal : sprite->getPalettes()) {
+    h = hash(h, pal->frame());
+    h = hash(h, pal->rawColorsData(), pal->size() * sizeof(doc::color_t));
+  }
+  for (const doc::Layer* layer : sprite->allLayers())
+    h = hash(h, layer->isVisible() ? 1: 0);
+  return h;
+}
+
+} // namespace app
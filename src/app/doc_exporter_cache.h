@@ -0,0 +1,100 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_DOC_EXPORTER_CACHE_H_INCLUDED
+#define APP_DOC_EXPORTER_CACHE_H_INCLUDED
+#pragma once
+
+#include "gfx/rect.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace doc {
+  class SelectedLayers;
+  class Sprite;
+}
+
+namespace app {
+
+  // Data of a previous sprite sheet export saved in a file, used by
+  // DocExporter to avoid rendering the samples of files that didn't
+  // change. Each sample is identified by a key calculated from the
+  // content of its source file and the sample properties, so the
+  // results of the previous export (trimmed bounds, hash of the
+  // rendered image, and position in the previous texture) can be
+  // re-used to create the same texture and data file.
+  class DocExporterCache {
+  public:
+    struct Trim {
+      bool empty = false;
+      gfx::Rect bounds;
+    };
+
+    struct Sample {
+      bool hasHash = false;
+      uint32_t hash = 0;
+      // Bounds of the sample in the previous texture (empty if it
+      // wasn't in the texture)
+      gfx::Rect inTextureBounds;
+    };
+
+    // Loads the previous export data, returns false if the file
+    // doesn't exist or it was created with other options.
+    bool load(const std::string& filename,
+              const std::string& options);
+
+    // Saves the data added with the add*() functions.
+    void save(const std::string& filename,
+              const std::string& options) const;
+
+    // Data from the previous export
+    const Trim* findTrim(const uint64_t key) const;
+    const Sample* findSample(const uint64_t key) const;
+    const std::string& textureFilename() const { return m_oldTextureFilename; }
+    uint32_t textureHash() const { return m_oldTextureHash; }
+
+    // Data for the next export
+    void addTrim(const uint64_t key, const Trim& trim);
+    void addSample(const uint64_t key, const Sample& sample);
+    void setTexture(const std::string& filename, const uint32_t hash);
+
+    // Returns a key for the given file content (or 0 if the file
+    // cannot be read).
+    uint64_t fileKey(const std::string& filename);
+
+    static uint64_t hash(const uint64_t seed, const void* data, const std::size_t size);
+    static uint64_t hash(const uint64_t seed, const int value) {
+      return hash(seed, &value, sizeof(value));
+    }
+    static uint64_t hash(const uint64_t seed, const gfx::Rect& rc);
+    static uint64_t hash(const uint64_t seed, const doc::SelectedLayers* selLayers);
+    // Hashes the sprite properties that can be changed after loading
+    // the file without modifying the document (e.g. the visibility of
+    // layers changed by --layer/--all-layers CLI options, or the
+    // palette).
+    static uint64_t hash(const uint64_t seed, const doc::Sprite* sprite);
+
+  private:
+    std::map<uint64_t, Trim> m_oldTrims;
+    std::map<uint64_t, Sample> m_oldSamples;
+    std::string m_oldTextureFilename;
+    uint32_t m_oldTextureHash = 0;
+
+    std::map<uint64_t, Trim> m_newTrims;
+    std::map<uint64_t, Sample> m_newSamples;
+    std::string m_newTextureFilename;
+    uint32_t m_newTextureHash = 0;
+
+    // Keys of files already read
+    std::map<std::string, uint64_t> m_fileKeys;
+  };
+
+} // namespace app
+
+#endif
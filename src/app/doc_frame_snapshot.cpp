@@ -0,0 +1,108 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/doc_frame_snapshot.h"
+
+#include "app/doc_access.h"
+#include "doc/blend_internals.h"
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/render_plan.h"
+#include "doc/sprite.h"
+#include "render/frame_signature.h"
+#include "render/render.h"
+
+namespace app {
+
+using namespace doc;
+
+// static
+std::unique_ptr<DocFrameSnapshot> DocFrameSnapshot::capture(Doc* doc,
+                                                            const frame_t frame,
+                                                            const int timeout)
+{
+  try {
+    const DocReader reader(doc, timeout);
+    return std::unique_ptr<DocFrameSnapshot>(
+      new DocFrameSnapshot(doc, frame));
+  }
+  catch (const CannotReadDocException&) {
+    return nullptr;
+  }
+}
+
+// Executed with the document locked
+DocFrameSnapshot::DocFrameSnapshot(const Doc* doc, const frame_t frame)
+  : m_spec(doc->sprite()->spec())
+  , m_frame(frame)
+  , m_palette(*doc->sprite()->palette(frame))
+  , m_epochRef(doc->writeEpochRef())
+  , m_epoch(*m_epochRef)
+  , m_signature(render::calc_frame_signature(doc->sprite(), frame))
+{
+  const Sprite* sprite = doc->sprite();
+
+  RenderPlan plan;
+  plan.addLayer(sprite->root(), frame);
+
+  for (const auto& item : plan.items()) {
+    const Cel* cel = item.cel;
+    if (!cel || !item.layer->isImage())
+      continue;
+
+    // TODO add support to render tilemaps (we should keep a
+    //      reference to the tileset images too), and reference
+    //      layers (which use cel->boundsF())
+    if (cel->image()->pixelFormat() == IMAGE_TILEMAP ||
+        item.layer->isReference()) {
+      m_complete = false;
+      continue;
+    }
+
+    const auto* layer = static_cast<const LayerImage*>(item.layer);
+    int t;
+    m_items.push_back(
+      Item{ cel->imageRef(),
+            cel->image()->pinPixels(),
+            cel->position(),
+            MUL_UN8(cel->opacity(), layer->opacity(), t),
+            layer->blendMode() });
+  }
+}
+
+bool DocFrameSnapshot::isStale() const
+{
+  return (*m_epochRef != m_epoch);
+}
+
+void DocFrameSnapshot::render(Image* dst) const
+{
+  ASSERT(dst->width() == m_spec.width());
+  ASSERT(dst->height() == m_spec.height());
+
+  dst->clear(dst->maskColor());
+  renderOver(dst);
+}
+
+void DocFrameSnapshot::renderOver(Image* dst) const
+{
+  ASSERT(dst->width() == m_spec.width());
+  ASSERT(dst->height() == m_spec.height());
+
+  render::Render render;
+  for (const Item& item : m_items) {
+    render.renderImage(dst, item.image.get(), &m_palette,
+                       item.position.x, item.position.y,
+                       item.opacity, item.blendMode);
+  }
+}
+
+} // namespace app
@@ -0,0 +1,98 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_DOC_FRAME_SNAPSHOT_H_INCLUDED
+#define APP_DOC_FRAME_SNAPSHOT_H_INCLUDED
+#pragma once
+
+#include "app/doc.h"
+#include "doc/blend_mode.h"
+#include "doc/frame.h"
+#include "doc/image_buffer.h"
+#include "doc/image_ref.h"
+#include "doc/image_spec.h"
+#include "doc/palette.h"
+#include "gfx/point.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace app {
+
+  // View of one frame of a sprite that can be rendered without
+  // locking the document (e.g. from a background thread to generate
+  // a thumbnail or a preview).
+  //
+  // The snapshot is captured with a short read lock: it copies all the
+  // information needed to render the frame and keeps references to
+  // the cel images (which are not copied) and their pinned pixels
+  // (see doc::Image::pinPixels(), so they cannot be released or
+  // moved while the snapshot exists). As images can be modified
+  // in-place by a writer after the lock is released, isStale() can be
+  // used after rendering to know if a write lock was acquired in the
+  // meantime, and the result should be discarded/rendered again.
+  class DocFrameSnapshot {
+  public:
+    // Returns nullptr if the document cannot be locked to read it in
+    // the given timeout.
+    static std::unique_ptr<DocFrameSnapshot> capture(Doc* doc,
+                                                     const doc::frame_t frame,
+                                                     const int timeout);
+
+    const doc::ImageSpec& spec() const { return m_spec; }
+    doc::frame_t frame() const { return m_frame; }
+
+    // Signature of the frame contents (see
+    // render::calc_frame_signature()), snapshots with the same
+    // signature render the same pixels.
+    uint64_t signature() const { return m_signature; }
+
+    // Number of write locks of the document when the snapshot was
+    // captured (snapshots with the same epoch see the same images).
+    uint32_t epoch() const { return m_epoch; }
+
+    // Returns true if the document was modified (or destroyed) after
+    // the snapshot was captured.
+    bool isStale() const;
+
+    // Returns false if some visible cel was not included in the
+    // snapshot (e.g. tilemaps or reference layers), i.e. render() is
+    // not exactly the same as rendering the sprite frame.
+    bool isComplete() const { return m_complete; }
+
+    // Renders the frame in "dst", which must have the size of spec()
+    // (but it can have a different color mode, e.g. RGB).
+    void render(doc::Image* dst) const;
+
+    // Same as render() but the frame is composited over the existing
+    // pixels of "dst" (e.g. a checkered background).
+    void renderOver(doc::Image* dst) const;
+
+  private:
+    struct Item {
+      doc::ImageRef image;
+      doc::ImageBufferPtr pixels;
+      gfx::Point position;
+      int opacity;
+      doc::BlendMode blendMode;
+    };
+
+    DocFrameSnapshot(const Doc* doc, const doc::frame_t frame);
+
+    doc::ImageSpec m_spec;
+    doc::frame_t m_frame;
+    doc::Palette m_palette;
+    std::vector<Item> m_items;
+    Doc::WriteEpochRef m_epochRef;
+    uint32_t m_epoch;
+    uint64_t m_signature;
+    bool m_complete = true;
+  };
+
+} // namespace app
+
+#endif
@@ -0,0 +1,186 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/doc_lock_stats.h"
+
+#include "app/doc.h"
+#include "app/perf_counters.h"
+#include "app/perf_trace.h"
+#include "base/log.h"
+#include "fmt/format.h"
+#include "ui/system.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string_view>
+
+namespace app {
+
+namespace {
+
+struct OperationStats {
+  int64_t locks = 0;
+  int64_t failures = 0;
+  int64_t waitUs = 0;
+  int64_t maxWaitUs = 0;
+};
+
+struct Failure {
+  DocLockStats::Kind kind;
+  std::string docName;
+  DocLockStats::Holder waiter;
+  DocLockStats::Holder holder;
+  int64_t waitUs;
+};
+
+std::mutex g_mutex;
+std::map<std::string, OperationStats, std::less<>> g_operations;
+std::deque<Failure> g_failures;
+
+std::atomic<int> g_threads(0);
+thread_local int t_thread = 0;
+thread_local const char* t_operation = nullptr;
+
+const char* kind_name(const DocLockStats::Kind kind)
+{
+  switch (kind) {
+    case DocLockStats::Kind::Read: return "read";
+    case DocLockStats::Kind::Write: return "write";
+    case DocLockStats::Kind::Upgrade: return "upgrade";
+    case DocLockStats::Kind::Weak: return "weak";
+  }
+  return "";
+}
+
+std::string holder_name(const DocLockStats::Holder& holder)
+{
+  if (!holder.thread)
+    return "nobody";
+  return fmt::format("{} (thread {})",
+                     holder.operation ? holder.operation: "unknown",
+                     holder.thread);
+}
+
+} // anonymous namespace
+
+DocLockStats::Operation::Operation(const char* name)
+  : m_prev(t_operation)
+{
+  t_operation = name;
+}
+
+DocLockStats::Operation::~Operation()
+{
+  t_operation = m_prev;
+}
+
+// static
+DocLockStats::Holder DocLockStats::currentHolder()
+{
+  if (!t_thread)
+    t_thread = ++g_threads;
+
+  Holder holder;
+  holder.thread = t_thread;
+  if (t_operation)
+    holder.operation = t_operation;
+  else if (ui::is_ui_thread())
+    holder.operation = "ui";
+  else
+    holder.operation = "unknown";
+  return holder;
+}
+
+// static
+void DocLockStats::addLock(const Kind kind,
+                           const Doc* doc,
+                           const Holder& waiter,
+                           const Clock::time_point start,
+                           const Clock::time_point end,
+                           const bool locked,
+                           const Holder& holder)
+{
+  const int64_t waitUs =
+    std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+  PerfCounters::add(PerfCounters::LockWaitTime, waitUs);
+
+  if (PerfTrace::isEnabled() && waitUs > 0)
+    PerfTrace::addSpan(locked ? "lock": "lock_failed",
+                       waiter.operation, start, end);
+
+  if (!locked) {
+    LOG(VERBOSE, "DOC: %s lock of '%s' failed after %dus, waiting: %s, holder: %s\n",
+        kind_name(kind),
+        doc->name().c_str(),
+        int(waitUs),
+        holder_name(waiter).c_str(),
+        holder_name(holder).c_str());
+  }
+
+  const std::lock_guard lock(g_mutex);
+
+  auto it = g_operations.find(std::string_view(waiter.operation));
+  if (it == g_operations.end())
+    it = g_operations.emplace(waiter.operation, OperationStats()).first;
+
+  OperationStats& stats = it->second;
+  ++stats.locks;
+  stats.waitUs += waitUs;
+  stats.maxWaitUs = std::max(stats.maxWaitUs, waitUs);
+
+  if (!locked) {
+    ++stats.failures;
+
+    g_failures.push_back(Failure{ kind, doc->name(), waiter, holder, waitUs });
+    if (int(g_failures.size()) > kMaxFailures)
+      g_failures.pop_front();
+  }
+}
+
+// static
+void DocLockStats::reset()
+{
+  const std::lock_guard lock(g_mutex);
+  g_operations.clear();
+  g_failures.clear();
+}
+
+// static
+std::string DocLockStats::report()
+{
+  const std::lock_guard lock(g_mutex);
+  std::string result = "Doc locks by operation:\n";
+  for (const auto& [operation, stats] : g_operations) {
+    result += fmt::format(
+      "  {}: {} locks, {} failures, {:.3f} ms waiting (max {:.3f} ms)\n",
+      operation, stats.locks, stats.failures,
+      double(stats.waitUs) / 1000.0,
+      double(stats.maxWaitUs) / 1000.0);
+  }
+
+  result += fmt::format("Last {} failed locks:\n", g_failures.size());
+  for (const Failure& failure : g_failures) {
+    result += fmt::format(
+      "  {} lock of '{}' by {} after {:.3f} ms, held by {}\n",
+      kind_name(failure.kind),
+      failure.docName,
+      holder_name(failure.waiter),
+      double(failure.waitUs) / 1000.0,
+      holder_name(failure.holder));
+  }
+  return result;
+}
+
+} // namespace app
@@ -0,0 +1,81 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_DOC_LOCK_STATS_H_INCLUDED
+#define APP_DOC_LOCK_STATS_H_INCLUDED
+#pragma once
+
+#include <chrono>
+#include <string>
+
+namespace app {
+  class Doc;
+
+  // Statistics of the Doc read/write locks: time waiting for each
+  // lock (grouped by the operation that was waiting), and the last
+  // locks that failed (timeout) with the operation that was holding
+  // the lock in that moment. Used to find which background jobs
+  // (backups, thumbnails, scripts, etc.) are starving the UI.
+  //
+  // They can be printed from the developer console with:
+  //
+  //   print(app.perf.lockReport())
+  //
+  // And when the trace is enabled (see PerfTrace), each lock wait is
+  // recorded as a span in the "lock" category (or "lock_failed"
+  // when the lock fails) named as the waiting operation.
+  class DocLockStats {
+  public:
+    typedef std::chrono::steady_clock Clock;
+
+    enum class Kind { Read, Write, Upgrade, Weak };
+
+    // Number of failed locks that are kept to be reported.
+    static constexpr int kMaxFailures = 32;
+
+    // Names the operation that the current thread is doing while
+    // this object is alive (e.g. "backup"), to identify the thread
+    // when it's waiting for or holding a lock. The name must outlive
+    // the operation (usually it's a string literal).
+    class Operation {
+    public:
+      explicit Operation(const char* name);
+      ~Operation();
+    private:
+      const char* m_prev;
+    };
+
+    // Who is waiting for or holding a lock.
+    struct Holder {
+      int thread = 0;                   // 1 for the first thread that locked a Doc, 2 for the second, etc.
+      const char* operation = nullptr;
+    };
+
+    // Returns the thread/operation of the current thread. Threads
+    // without an Operation are named "ui" (UI thread) or "unknown".
+    static Holder currentHolder();
+
+    // Called by Doc each time a lock is acquired or fails. The
+    // holder is the last one that acquired the lock (only used
+    // when the lock fails).
+    static void addLock(const Kind kind,
+                        const Doc* doc,
+                        const Holder& waiter,
+                        const Clock::time_point start,
+                        const Clock::time_point end,
+                        const bool locked,
+                        const Holder& holder);
+
+    static void reset();
+
+    // Returns a readable report with the wait time per operation
+    // and the last failed locks.
+    static std::string report();
+  };
+
+} // namespace app
+
+#endif
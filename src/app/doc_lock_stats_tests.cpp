@@ -0,0 +1,66 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+#include "app/doc.h"
+#include "app/doc_lock_stats.h"
+#include "app/test_context.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+using namespace app;
+
+TEST(DocLockStats, FailedLockReportsHolder)
+{
+  TestContext ctx;
+  Doc* doc = ctx.documents().add(32, 16);
+  DocLockStats::reset();
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool locked = false;
+  bool done = false;
+
+  std::thread holder([&]{
+    DocLockStats::Operation operation("holder-job");
+    auto res = doc->writeLock(0);
+    EXPECT_NE(Doc::LockResult::Fail, res);
+    {
+      std::unique_lock lock(mutex);
+      locked = true;
+      cv.notify_one();
+      cv.wait(lock, [&]{ return done; });
+    }
+    if (res != Doc::LockResult::Fail)
+      doc->unlock(res);
+  });
+
+  {
+    std::unique_lock lock(mutex);
+    cv.wait(lock, [&]{ return locked; });
+  }
+
+  {
+    DocLockStats::Operation operation("waiter-job");
+    EXPECT_EQ(Doc::LockResult::Fail, doc->readLock(0));
+  }
+
+  {
+    const std::lock_guard lock(mutex);
+    done = true;
+    cv.notify_one();
+  }
+  holder.join();
+
+  const std::string report = DocLockStats::report();
+  EXPECT_NE(std::string::npos, report.find("waiter-job: 1 locks, 1 failures"));
+  EXPECT_NE(std::string::npos, report.find("held by holder-job"));
+
+  doc->close();
+}
@@ -0,0 +1,52 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/doc_memory.h"
+
+#include "app/doc.h"
+#include "app/doc_undo.h"
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/sprite.h"
+#include "doc/tilesets.h"
+
+namespace app {
+
+DocMemoryUsage calc_doc_memory_usage(const Doc* doc)
+{
+  DocMemoryUsage usage;
+  const doc::Sprite* sprite = doc->sprite();
+
+  for (const doc::Cel* cel : sprite->uniqueCels()) {
+    // Cels decoded on demand aren't in memory yet
+    if (!cel->data()->isImageLoaded())
+      continue;
+
+    const doc::Image* image = cel->image();
+    if (image->hasReleasedPixels())
+      usage.compressedImages += image->getMemSize();
+    else if (image->hasMappedPixels())
+      usage.mappedImages += image->getMemSize();
+    else
+      usage.images += image->getMemSize();
+  }
+
+  if (sprite->hasTilesets())
+    usage.tilesets = sprite->tilesets()->getMemSize();
+
+  if (const DocUndo* undo = doc->undoHistory()) {
+    usage.undo = undo->totalUndoSize();
+    usage.undoOnDisk = undo->spilledUndoSize();
+  }
+
+  return usage;
+}
+
+} // namespace app
@@ -0,0 +1,36 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_DOC_MEMORY_H_INCLUDED
+#define APP_DOC_MEMORY_H_INCLUDED
+#pragma once
+
+#include <cstddef>
+
+namespace app {
+
+  class Doc;
+
+  // Memory used by a document by category (in bytes).
+  struct DocMemoryUsage {
+    std::size_t images = 0;           // Pixels of cel images
+    std::size_t compressedImages = 0; // Cel images compressed in memory (CelsCompressor)
+    std::size_t mappedImages = 0;     // Cel images mapped to scratch files (not in total())
+    std::size_t tilesets = 0;         // Images of tiles
+    std::size_t undo = 0;             // Undo history in memory
+    std::size_t undoOnDisk = 0;       // Undo data spilled to disk (not in total())
+
+    std::size_t total() const {
+      return images + compressedImages + tilesets + undo;
+    }
+  };
+
+  // The document must be locked for reading.
+  DocMemoryUsage calc_doc_memory_usage(const Doc* doc);
+
+} // namespace app
+
+#endif
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -17,7 +17,9 @@
 #include "app/console.h"
 #include "app/context.h"
 #include "app/doc_undo_observer.h"
+#include "app/perf_counters.h"
 #include "app/pref/preferences.h"
+#include "app/undo_spill_file.h"
 #include "base/mem_utils.h"
 #include "base/scoped_value.h"
 #include "undo/undo_history.h"
@@ -36,6 +38,10 @@ DocUndo::DocUndo()
 {
 }
 
+DocUndo::~DocUndo()
+{
+}
+
 void DocUndo::setContext(Context* ctx)
 {
   m_ctx = ctx;
@@ -63,6 +69,20 @@ void DocUndo::add(CmdTransaction* cmd)
 
   m_undoHistory.add(cmd);
   m_totalUndoSize += cmd->memSize();
+  PerfCounters::add(PerfCounters::UndoBytes, cmd->memSize());
+
+  // Move the payload of old undo states to disk if the undo history
+  // is using too much memory.
+  if (App::instance()) {
+    const size_t memoryLimit =
+      size_t(App::instance()->preferences().undo.memoryLimit())
+      * 1024 * 1024;
+
+    if (memoryLimit > 0 &&
+        m_totalUndoSize > memoryLimit) {
+      spillOldStates(memoryLimit);
+    }
+  }
 
   notify_observers(&DocUndoObserver::onAddUndoState, this);
   notify_observers(&DocUndoObserver::onTotalUndoSizeChange, this);
@@ -152,6 +172,19 @@ void DocUndo::clearRedo()
   notify_observers(&DocUndoObserver::onClearRedo, this);
 }
 
+void DocUndo::clearUndo()
+{
+  clearRedo();
+
+  // The current state is the last one, so we can delete all states
+  while (m_undoHistory.firstState()) {
+    if (!m_undoHistory.deleteFirstState())
+      break;
+  }
+
+  notify_observers(&DocUndoObserver::onTotalUndoSizeChange, this);
+}
+
 bool DocUndo::isInSavedStateOrSimilar() const
 {
   if (m_savedStateIsLost)
@@ -314,6 +347,37 @@ const undo::UndoState* DocUndo::nextRedo() const
     return m_undoHistory.firstState();
 }
 
+size_t DocUndo::spilledUndoSize() const
+{
+  return (m_spillFile ? size_t(m_spillFile->size()): 0);
+}
+
+void DocUndo::spillOldStates(const size_t memoryLimit)
+{
+  if (m_totalUndoSize <= memoryLimit)
+    return;
+
+  if (!m_spillFile)
+    m_spillFile = std::make_unique<UndoSpillFile>();
+
+  UNDO_TRACE("UNDO: Spilling undo states to disk (%s > %s)\n",
+             base::get_pretty_memory_size(m_totalUndoSize).c_str(),
+             base::get_pretty_memory_size(memoryLimit).c_str());
+
+  // From the oldest state to the current one (which is kept in
+  // memory, as it's the next one to be undone).
+  const undo::UndoState* state = m_undoHistory.firstState();
+  while (state &&
+         state != m_undoHistory.currentState() &&
+         m_totalUndoSize > memoryLimit) {
+    Cmd* cmd = STATE_CMD(state);
+    const size_t oldSize = cmd->memSize();
+    cmd->spill(m_spillFile.get());
+    m_totalUndoSize -= oldSize - cmd->memSize();
+    state = state->next();
+  }
+}
+
 void DocUndo::onDeleteUndoState(undo::UndoState* state)
 {
   ASSERT(state);
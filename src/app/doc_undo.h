@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -17,6 +17,7 @@
 #include "undo/undo_history.h"
 
 #include <iosfwd>
+#include <memory>
 #include <string>
 
 namespace app {
@@ -26,6 +27,7 @@ namespace app {
   class CmdTransaction;
   class Context;
   class DocUndoObserver;
+  class UndoSpillFile;
 
   // Exception thrown when we want to modify the sprite (add new
   // app::Cmd objects) when we are undoing/redoing/moving throw the
@@ -40,9 +42,20 @@ namespace app {
                   public undo::UndoHistoryDelegate {
   public:
     DocUndo();
+    ~DocUndo();
 
+    // Memory used by the undo history (undo information spilled to
+    // disk is not included)
     size_t totalUndoSize() const { return m_totalUndoSize; }
 
+    // Bytes of undo information spilled to disk
+    size_t spilledUndoSize() const;
+
+    // Moves the payload of old undo states to disk until the undo
+    // history uses less than "memoryLimit" bytes (the current state
+    // is always kept in memory).
+    void spillOldStates(const size_t memoryLimit);
+
     void setContext(Context* ctx);
 
     void add(CmdTransaction* cmd);
@@ -54,6 +67,11 @@ namespace app {
 
     void clearRedo();
 
+    // Deletes all the undo history (used in batch mode where the
+    // changes are never undone, to free the memory used by the
+    // copies of the original images).
+    void clearUndo();
+
     // Returns true we are in the UndoState that matches the sprite
     // version on the disk (or we are in a similar state that doesn't
     // modify that same state, e.g. if the current state modifies the
@@ -107,6 +125,11 @@ namespace app {
     // undo::UndoHistoryDelegate impl
     void onDeleteUndoState(undo::UndoState* state) override;
 
+    // Temporary file where old undo states are moved when the undo
+    // history uses too much memory. It's declared before
+    // m_undoHistory so it's destroyed after all states.
+    std::unique_ptr<UndoSpillFile> m_spillFile;
+
     undo::UndoHistory m_undoHistory;
     const undo::UndoState* m_savedState = nullptr;
     Context* m_ctx = nullptr;
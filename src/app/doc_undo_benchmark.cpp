@@ -0,0 +1,299 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/cmd/add_cel.h"
+#include "app/cmd/copy_region.h"
+#include "app/cmd/patch_cel.h"
+#include "app/cmd/remove_cel.h"
+#include "app/cmd/replace_image.h"
+#include "app/context.h"
+#include "app/doc.h"
+#include "app/doc_undo.h"
+#include "app/transaction.h"
+#include "doc/doc.h"
+#include "fmt/format.h"
+#include "undo/undo_state.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <random>
+
+#if _WIN32
+  #include <windows.h>
+
+  #include <psapi.h>
+#else
+  #include <sys/resource.h>
+#endif
+
+// Benchmarks of the undo history: committing transactions with the
+// most common commands, and undoing/redoing/moving through long
+// histories. Each benchmark reports:
+//
+// * undo_size: memory used by the undo history (DocUndo::totalUndoSize,
+//   the max size reached in BM_TransactionCommit),
+// * peak_memory: peak of memory of the whole process (run each
+//   benchmark alone with --benchmark_filter=... to get the peak of
+//   just one command/history).
+
+using namespace app;
+using namespace doc;
+
+namespace {
+
+enum class CmdType { PatchCel, CopyRegion, AddCel, ReplaceImage };
+
+constexpr int kLayers = 4;
+constexpr int kFrames = 16;
+constexpr int kPatchSize = 64;
+
+// Maximum undo history size in BM_TransactionCommit (the history is
+// cleared when it reaches this size so long runs don't use all the
+// memory)
+constexpr std::size_t kMaxUndoSize = 512 * 1024 * 1024;
+
+std::size_t peak_memory()
+{
+#if _WIN32
+  PROCESS_MEMORY_COUNTERS pmc;
+  if (::GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+    return pmc.PeakWorkingSetSize;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+  #if __APPLE__
+    return std::size_t(usage.ru_maxrss); // In bytes
+  #else
+    return std::size_t(usage.ru_maxrss) * 1024; // In kilobytes
+  #endif
+  }
+#endif
+  return 0;
+}
+
+ImageRef random_image(std::mt19937& rng, const int w, const int h)
+{
+  std::uniform_int_distribution<color_t> colors(0, 0xffffffff);
+  ImageRef image(Image::create(IMAGE_RGB, w, h));
+  for (auto& pixel : LockImageBits<RgbTraits>(image.get(), Image::WriteLock))
+    pixel = colors(rng);
+  return image;
+}
+
+// Sprite with kLayers x kFrames cels of size x size pixels (and an
+// empty last layer where cmd::AddCel adds new cels).
+class UndoBenchmarkDoc {
+public:
+  UndoBenchmarkDoc(Context* ctx, const int size)
+    : m_ctx(ctx)
+    , m_size(size)
+    , m_rng(size)
+  {
+    Sprite* spr = new Sprite(ImageSpec(ColorMode::RGB, size, size), 256);
+    spr->setTotalFrames(kFrames);
+
+    for (int i=0; i<kLayers; ++i) {
+      LayerImage* layer = new LayerImage(spr);
+      spr->root()->addLayer(layer);
+      for (frame_t frame=0; frame<kFrames; ++frame)
+        layer->addCel(new Cel(frame, random_image(m_rng, size, size)));
+    }
+
+    m_emptyLayer = new LayerImage(spr);
+    spr->root()->addLayer(m_emptyLayer);
+
+    m_doc.reset(new Doc(spr));
+    m_doc->setContext(ctx);
+  }
+
+  ~UndoBenchmarkDoc() {
+    m_doc->close();
+  }
+
+  Doc* doc() const { return m_doc.get(); }
+  DocUndo* undo() const { return m_doc->undoHistory(); }
+
+  // Commits one transaction with a command of the given type
+  // modifying the i-th cel.
+  void commit(const CmdType type, const int i) {
+    Sprite* spr = m_doc->sprite();
+    LayerImage* layer = static_cast<LayerImage*>(
+      spr->root()->layers()[i % kLayers]);
+    Cel* cel = layer->cel(frame_t((i / kLayers) % kFrames));
+    std::uniform_int_distribution<int> pos(0, m_size - kPatchSize);
+    const gfx::Point pt(pos(m_rng), pos(m_rng));
+    const gfx::Region rgn(gfx::Rect(pt, gfx::Size(kPatchSize, kPatchSize)));
+
+    Transaction tx(m_ctx, m_doc.get(), "Benchmark");
+    switch (type) {
+
+      case CmdType::PatchCel: {
+        ImageRef patch = random_image(m_rng, kPatchSize, kPatchSize);
+        tx.execute(new cmd::PatchCel(cel, patch.get(), rgn, pt));
+        break;
+      }
+
+      case CmdType::CopyRegion: {
+        ImageRef src = random_image(m_rng, m_size, m_size);
+        tx.execute(new cmd::CopyRegion(cel->image(), src.get(), rgn,
+                                       gfx::Point(0, 0)));
+        break;
+      }
+
+      case CmdType::AddCel: {
+        const frame_t frame = frame_t(i % kFrames);
+        if (Cel* oldCel = m_emptyLayer->cel(frame))
+          tx.execute(new cmd::RemoveCel(oldCel));
+        tx.execute(new cmd::AddCel(
+                     m_emptyLayer,
+                     new Cel(frame, random_image(m_rng, m_size, m_size))));
+        break;
+      }
+
+      case CmdType::ReplaceImage: {
+        ImageRef newImage = random_image(m_rng, m_size, m_size);
+        tx.execute(new cmd::ReplaceImage(spr, cel->imageRef(), newImage));
+        break;
+      }
+    }
+    tx.commit();
+  }
+
+  // Creates an undo history with n undo states
+  void makeHistory(const CmdType type, const int n) {
+    for (int i=0; i<n; ++i)
+      commit(type, i);
+  }
+
+private:
+  Context* m_ctx;
+  int m_size;
+  std::mt19937 m_rng;
+  std::unique_ptr<Doc> m_doc;
+  LayerImage* m_emptyLayer;
+};
+
+void set_counters(benchmark::State& state, const std::size_t undoSize)
+{
+  state.counters["undo_size"] = double(undoSize);
+  state.counters["peak_memory"] = double(peak_memory());
+}
+
+void BM_TransactionCommit(benchmark::State& state, Context* ctx,
+                          const CmdType type)
+{
+  const int size = state.range(0);
+  UndoBenchmarkDoc doc(ctx, size);
+  std::size_t maxUndoSize = 0;
+
+  int i = 0;
+  for (auto _ : state) {
+    doc.commit(type, i++);
+
+    const std::size_t undoSize = doc.undo()->totalUndoSize();
+    maxUndoSize = std::max(maxUndoSize, undoSize);
+    if (undoSize > kMaxUndoSize) {
+      state.PauseTiming();
+      doc.undo()->clearUndo();
+      state.ResumeTiming();
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  set_counters(state, maxUndoSize);
+}
+
+// Undoes and redoes the whole history (one undo/redo per state)
+void BM_UndoRedo(benchmark::State& state, Context* ctx,
+                 const CmdType type)
+{
+  const int size = state.range(0);
+  const int n = state.range(1);
+  UndoBenchmarkDoc doc(ctx, size);
+  doc.makeHistory(type, n);
+
+  DocUndo* undo = doc.undo();
+  for (auto _ : state) {
+    while (undo->canUndo())
+      undo->undo();
+    while (undo->canRedo())
+      undo->redo();
+  }
+
+  state.SetItemsProcessed(state.iterations() * 2 * n);
+  set_counters(state, undo->totalUndoSize());
+}
+
+// Jumps from the last state to the first one and back (like
+// clicking in the Undo History window)
+void BM_MoveToState(benchmark::State& state, Context* ctx,
+                    const CmdType type)
+{
+  const int size = state.range(0);
+  const int n = state.range(1);
+  UndoBenchmarkDoc doc(ctx, size);
+  doc.makeHistory(type, n);
+
+  DocUndo* undo = doc.undo();
+  const undo::UndoState* first = undo->firstState();
+  const undo::UndoState* last = undo->lastState();
+  for (auto _ : state) {
+    undo->moveToState(first);
+    undo->moveToState(last);
+  }
+
+  state.SetItemsProcessed(state.iterations() * 2 * n);
+  set_counters(state, undo->totalUndoSize());
+}
+
+} // anonymous namespace
+
+int app_main(int argc, char* argv[])
+{
+  Context ctx;
+
+  const std::pair<const char*, CmdType> cmds[] = {
+    { "PatchCel", CmdType::PatchCel },
+    { "CopyRegion", CmdType::CopyRegion },
+    { "AddCel", CmdType::AddCel },
+    { "ReplaceImage", CmdType::ReplaceImage },
+  };
+
+  for (const auto& cmd : cmds) {
+    benchmark::RegisterBenchmark(
+      fmt::format("BM_TransactionCommit/{}", cmd.first).c_str(),
+      BM_TransactionCommit, &ctx, cmd.second)
+      ->Arg(256)
+      ->Arg(1024)
+      ->Unit(benchmark::kMicrosecond);
+
+    benchmark::RegisterBenchmark(
+      fmt::format("BM_UndoRedo/{}", cmd.first).c_str(),
+      BM_UndoRedo, &ctx, cmd.second)
+      ->Args({ 256, 100 })
+      ->Args({ 256, 1000 })
+      ->Args({ 1024, 100 })
+      ->Unit(benchmark::kMillisecond);
+
+    benchmark::RegisterBenchmark(
+      fmt::format("BM_MoveToState/{}", cmd.first).c_str(),
+      BM_MoveToState, &ctx, cmd.second)
+      ->Args({ 256, 100 })
+      ->Args({ 256, 1000 })
+      ->Args({ 1024, 100 })
+      ->Unit(benchmark::kMillisecond);
+  }
+
+  ::benchmark::Initialize(&argc, argv);
+  return ::benchmark::RunSpecifiedBenchmarks();
+}
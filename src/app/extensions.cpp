@@ -20,11 +20,13 @@
 #include "app/load_matrix.h"
 #include "app/pref/preferences.h"
 #include "app/resource_finder.h"
+#include "app/startup_trace.h"
 #include "base/exception.h"
 #include "base/file_content.h"
 #include "base/file_handle.h"
 #include "base/fs.h"
 #include "base/fstream_path.h"
+#include "base/thread_pool.h"
 #include "render/dithering_matrix.h"
 #include "ui/widget.h"
 
@@ -42,10 +44,12 @@
 #include "archive_entry.h"
 #include "json11.hpp"
 
+#include <algorithm>
 #include <fstream>
 #include <queue>
 #include <sstream>
 #include <string>
+#include <thread>
 
 #include "base/log.h"
 
@@ -797,6 +801,8 @@ void Extension::addScript(const std::string& fn)
 
 Extensions::Extensions()
 {
+  StartupTrace span("extensions");
+
   // Create and get the user extensions directory
   {
     ResourceFinder rf2;
@@ -810,11 +816,21 @@ Extensions::Extensions()
     LOG("EXT: User extensions path '%s'\n", m_userExtensionsPath.c_str());
   }
 
+  // package.json files of each extension
+  struct Package {
+    std::string dir;
+    std::string fullFn;
+    bool isBuiltinExtension;
+    json11::Json json;
+    std::string error;
+  };
+  std::vector<Package> packages;
+
   ResourceFinder rf;
   rf.includeUserDir("extensions");
   rf.includeDataDir("extensions");
 
-  // Load extensions from data/ directory on all possible locations
+  // Find extensions from data/ directory on all possible locations
   // (installed folder and user folder)
   while (rf.next()) {
     auto extensionsDir = rf.filename();
@@ -837,14 +853,44 @@ Extensions::Extensions()
           continue;
         }
 
+        packages.push_back(Package{ dir, fullFn, isBuiltinExtension });
+      }
+    }
+  }
+
+  // Read and parse all package.json files in parallel
+  if (!packages.empty()) {
+    base::thread_pool pool(
+      std::clamp(int(std::thread::hardware_concurrency()),
+                 1, int(packages.size())));
+    for (auto& package : packages) {
+      pool.execute([&package]{
         try {
-          loadExtension(dir, fullFn, isBuiltinExtension);
+          read_json_file(package.fullFn, package.json);
         }
         catch (const std::exception& ex) {
-          LOG("EXT: Error loading JSON file: %s\n",
-              ex.what());
+          package.error = ex.what();
         }
-      }
+      });
+    }
+    pool.wait_all();
+  }
+
+  // Create the extensions in the same order they were found
+  for (const auto& package : packages) {
+    if (!package.error.empty()) {
+      LOG("EXT: Error loading JSON file: %s\n",
+          package.error.c_str());
+      continue;
+    }
+
+    try {
+      loadExtension(package.dir, package.json,
+                    package.isBuiltinExtension);
+    }
+    catch (const std::exception& ex) {
+      LOG("EXT: Error loading JSON file: %s\n",
+          ex.what());
     }
   }
 }
@@ -1118,6 +1164,13 @@ Extension* Extensions::loadExtension(const std::string& path,
 {
   json11::Json json;
   read_json_file(fullPackageFilename, json);
+  return loadExtension(path, json, isBuiltinExtension);
+}
+
+Extension* Extensions::loadExtension(const std::string& path,
+                                     const json11::Json& json,
+                                     const bool isBuiltinExtension)
+{
   auto name = json["name"].string_value();
   auto version = json["version"].string_value();
   auto displayName = json["displayName"].string_value();
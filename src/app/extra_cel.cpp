@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -11,6 +11,7 @@
 
 #include "app/extra_cel.h"
 
+#include "doc/color_mode.h"
 #include "doc/sprite.h"
 
 namespace app {
@@ -42,6 +43,20 @@ void ExtraCel::create(const TilemapMode tilemapMode,
       m_image->height() != imageSize.h) {
     if (!m_imageBuffer)
       m_imageBuffer.reset(new doc::ImageBuffer(1));
+
+    // When the buffer must grow we reserve some extra space, so it
+    // isn't reallocated on each mouse movement when the image is just
+    // a little bigger than the previous one (e.g. scaling the
+    // selected pixels in PixelsMovement).
+    const int bpp = doc::bytes_per_pixel_for_colormode(doc::ColorMode(pixelFormat));
+    const std::size_t requiredSize =
+      std::size_t(doc_align_size(bpp*imageSize.w)) * imageSize.h +
+      doc_align_size(sizeof(uint8_t*) * imageSize.h);
+    if (requiredSize > m_imageBuffer->size()) {
+      m_image.reset();
+      m_imageBuffer->resizeIfNecessary(requiredSize + requiredSize/2);
+    }
+
     doc::Image* newImage = doc::Image::create(pixelFormat,
                                               imageSize.w, imageSize.h,
                                               m_imageBuffer);
@@ -11,14 +11,17 @@
 
 #include "app/context.h"
 #include "app/doc.h"
+#include "app/file/ase_options.h"
 #include "app/file/file.h"
 #include "app/file/file_format.h"
 #include "app/file/format_options.h"
+#include "app/perf_counters.h"
 #include "base/cfile.h"
 #include "base/exception.h"
 #include "base/file_handle.h"
 #include "base/fs.h"
 #include "base/mem_utils.h"
+#include "base/thread_pool.h"
 #include "dio/aseprite_common.h"
 #include "dio/aseprite_decoder.h"
 #include "dio/decode_delegate.h"
@@ -30,8 +33,13 @@
 #include "ver/info.h"
 #include "zlib.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <deque>
+#include <future>
+#include <map>
+#include <memory>
+#include <thread>
 #include <variant>
 
 #define ASEFILE_TRACE(...) // TRACE(__VA_ARGS__)
@@ -70,6 +78,11 @@ public:
     return m_fop->isOneFrame();
   }
 
+  bool decodeFrameRange(doc::frame_t& fromFrame,
+                        doc::frame_t& toFrame) override {
+    return m_fop->getLoadFrameRange(fromFrame, toFrame);
+  }
+
   doc::color_t defaultSliceColor() override {
     auto color = m_fop->config().defaultSliceColor;
     return doc::rgba(color.getRed(),
@@ -88,6 +101,22 @@ public:
     return m_fop->config().cacheCompressedTilesets;
   }
 
+  bool cacheCompressedCels() const override {
+    return m_fop->config().cacheCompressedCels;
+  }
+
+  bool decodeCelsLazily() const override {
+    return m_fop->config().lazyCelDecoding;
+  }
+
+  bool decodeCelsInParallel() const override {
+    return m_fop->config().parallelCelDecoding;
+  }
+
+  bool dedupCelImages() const override {
+    return m_fop->config().dedupCelImages;
+  }
+
 private:
   FileOp* m_fop;
   doc::Sprite* m_sprite;
@@ -113,7 +142,7 @@ public:
     return m_image->widthBytes();
   }
   const uint8_t* getScanlineAddress(int y) const override {
-    return m_image->getPixelAddress(0, y);
+    return m_image->readPixelAddress(0, y);
   }
 };
 
@@ -144,6 +173,27 @@ public:
 
 } // anonymous namespace
 
+// Returns the zlib compression level to save the given file
+// operation (from its AseOptions).
+static int ase_file_compression_level(const FileOp* fop)
+{
+  switch (fop->formatOptionsForSaving<AseOptions>()->compression()) {
+    case AseOptions::Compression::Fast: return Z_BEST_SPEED;
+    case AseOptions::Compression::Max:  return Z_BEST_COMPRESSION;
+    default:                            return Z_DEFAULT_COMPRESSION;
+  }
+}
+
+// Returns true if we can re-use cached compressed data (which could
+// be compressed with any level). We don't use it when the maximum
+// compression is requested, as the user wants the smallest file.
+static bool ase_file_reuse_compressed_data(const int compressionLevel)
+{
+  return (compressionLevel != Z_BEST_COMPRESSION);
+}
+
+class CelCompressor;
+
 static void ase_file_prepare_header(FILE* f, dio::AsepriteHeader* header, const Sprite* sprite,
                                     const frame_t firstFrame, const frame_t totalFrames);
 static void ase_file_write_header(FILE* f, dio::AsepriteHeader* header);
@@ -161,7 +211,14 @@ static layer_t ase_file_write_cels(FILE* f,  FileOp* fop,
                                    const dio::AsepriteExternalFiles& ext_files,
                                    const Sprite* sprite, const Layer* layer,
                                    layer_t layer_index,
-                                   const frame_t frame);
+                                   const frame_t frame,
+                                   CelCompressor* compressor);
+
+static void write_compressed_image(FILE* f,
+                                   ScanlinesGen* gen,
+                                   PixelFormat pixelFormat,
+                                   int compressionLevel,
+                                   base::buffer* compressedOutput = nullptr);
 
 static void ase_file_write_padding(FILE* f, int bytes);
 static void ase_file_write_string(FILE* f, const std::string& string);
@@ -177,12 +234,23 @@ static void ase_file_write_cel_chunk(FILE* f, dio::AsepriteFrameHeader* frame_he
                                      const LayerImage* layer,
                                      const layer_t layer_index,
                                      const Sprite* sprite,
-                                     const frame_t firstFrame);
+                                     const frame_t firstFrame,
+                                     CelCompressor* compressor);
+static const Cel* ase_file_get_cel_link(const Cel* cel,
+                                        const LayerImage* layer,
+                                        const frame_t firstFrame);
 static void ase_file_write_cel_extra_chunk(FILE* f, dio::AsepriteFrameHeader* frame_header,
                                            const Cel* cel);
 static void ase_file_write_color_profile(FILE* f,
                                          dio::AsepriteFrameHeader* frame_header,
                                          const doc::Sprite* sprite);
+static size_t ase_file_write_frame_index_chunk(FILE* f,
+                                               dio::AsepriteFrameHeader* frame_header,
+                                               const int nframes);
+static void ase_file_complete_frame_index_chunk(FILE* f,
+                                                const size_t pos,
+                                                const std::vector<uint32_t>& offsets,
+                                                const std::vector<uint32_t>& flags);
 #if 0
 static void ase_file_write_mask_chunk(FILE* f, dio::AsepriteFrameHeader* frame_header, Mask* mask);
 #endif
@@ -234,6 +302,135 @@ private:
   dio::AsepriteChunk m_chunk;
 };
 
+// Compresses cel images in worker threads ahead of the chunk writer.
+// The writer still writes each cel in the same order (and zlib
+// gives the same output), so the file is identical to the one saved
+// compressing each cel in the saving thread.
+class CelCompressor {
+public:
+  CelCompressor(const Sprite* sprite,
+                const frame_t firstFrame,
+                const int compressionLevel,
+                const bool cacheCompressedCels)
+    : m_sprite(sprite)
+    , m_firstFrame(firstFrame)
+    , m_compressionLevel(compressionLevel)
+    , m_cacheCompressedCels(cacheCompressedCels)
+    , m_pool(std::max(1u, std::thread::hardware_concurrency())) {
+  }
+
+  ~CelCompressor() {
+    m_pool.wait_all();
+  }
+
+  // Number of frames that should be queued ahead of the frame that
+  // is being written
+  int lookahead() const {
+    return 2 * std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  // zlib compression level for cel images.
+  int compressionLevel() const { return m_compressionLevel; }
+
+  // True if the compressed data of each image should be kept in
+  // memory to re-use it in the next save.
+  bool cacheCompressedCels() const { return m_cacheCompressedCels; }
+
+  // Result of take() for a cel.
+  struct Item {
+    // False if the cel wasn't queued with queueFrame()
+    bool queued = false;
+    // True if the cached compressed data of the image is valid (so
+    // it wasn't compressed again)
+    bool cached = false;
+    // Content hash of the image (only if cacheCompressedCels())
+    uint64_t contentHash = 0;
+    // Compressed image (if it's not cached)
+    std::unique_ptr<base::buffer> output;
+  };
+
+  // Starts compressing the images of the given frame (only cels that
+  // will be saved as compressed images, not linked cels, nor images
+  // with valid cached compressed data).
+  void queueFrame(const frame_t frame) {
+    for (const Layer* layer : m_sprite->allLayers()) {
+      if (!layer->isImage())
+        continue;
+
+      const Cel* cel = layer->cel(frame);
+      if (!cel ||
+          !cel->image() ||
+          m_cels.find(cel) != m_cels.end() ||
+          ase_file_get_cel_link(cel, static_cast<const LayerImage*>(layer),
+                                m_firstFrame)) {
+        continue;
+      }
+
+      const Image* image = cel->image();
+      Queued& queued = m_cels[cel];
+
+      // The content hash is calculated just once for each cel (the
+      // writer uses it to cache the new compressed data)
+      if (m_cacheCompressedCels) {
+        queued.contentHash = calculate_image_content_hash(image);
+        if (image->hasValidCompressedData(queued.contentHash)) {
+          queued.cached = true;
+          continue;
+        }
+      }
+
+      const int level = m_compressionLevel;
+      auto task = std::make_shared<Task>(
+        [image, level]{
+          auto output = std::make_unique<base::buffer>();
+          ImageScanlines scan(image);
+          write_compressed_image(nullptr, &scan, image->pixelFormat(),
+                                 level, output.get());
+          return output;
+        });
+      queued.future = task->get_future();
+      m_pool.execute([task]{ (*task)(); });
+    }
+  }
+
+  // Returns the compressed image of the given cel (waiting the worker
+  // thread if it's not ready yet). Exceptions from the worker are
+  // re-thrown here.
+  Item take(const Cel* cel) {
+    Item item;
+    auto it = m_cels.find(cel);
+    if (it == m_cels.end())
+      return item;
+
+    Queued queued = std::move(it->second);
+    m_cels.erase(it);
+
+    item.queued = true;
+    item.cached = queued.cached;
+    item.contentHash = queued.contentHash;
+    if (queued.future.valid())
+      item.output = queued.future.get();
+    return item;
+  }
+
+private:
+  using CompressedImage = std::unique_ptr<base::buffer>;
+  using Task = std::packaged_task<CompressedImage()>;
+
+  struct Queued {
+    bool cached = false;
+    uint64_t contentHash = 0;
+    std::future<CompressedImage> future;
+  };
+
+  const Sprite* m_sprite;
+  frame_t m_firstFrame;
+  int m_compressionLevel;
+  bool m_cacheCompressedCels;
+  std::map<const Cel*, Queued> m_cels;
+  base::thread_pool m_pool;
+};
+
 class AseFormat : public FileFormat {
 
   const char* onGetName() const override {
@@ -253,6 +450,7 @@ class AseFormat : public FileFormat {
     return
       FILE_SUPPORT_LOAD |
       FILE_SUPPORT_SAVE |
+      FILE_SUPPORT_GET_FORMAT_OPTIONS |
       FILE_SUPPORT_RGB |
       FILE_SUPPORT_RGBA |
       FILE_SUPPORT_GRAY |
@@ -271,6 +469,13 @@ class AseFormat : public FileFormat {
 #ifdef ENABLE_SAVE
   bool onSave(FileOp* fop) override;
 #endif
+
+  // There is no dialog for .aseprite options, we just keep the
+  // options of the document (e.g. the compression level given in a
+  // previous save through the SaveFile command).
+  FormatOptionsPtr onAskUserForFormatOptions(FileOp* fop) override {
+    return fop->formatOptionsOfDocument<AseOptions>();
+  }
 };
 
 FileFormat* CreateAseFormat()
@@ -281,11 +486,17 @@ FileFormat* CreateAseFormat()
 bool AseFormat::onLoad(FileOp* fop)
 {
   FileHandle handle(open_file_with_exception(fop->filename(), "rb"));
-  dio::StdioFileInterface fileInterface(handle.get());
+
+  // Decode the file directly from memory when it can be mapped
+  dio::MappedFileInterface mappedInterface(handle.get());
+  dio::StdioFileInterface stdioInterface(handle.get());
+  dio::FileInterface* fileInterface =
+    (mappedInterface.isMapped() ? (dio::FileInterface*)&mappedInterface:
+                                  (dio::FileInterface*)&stdioInterface);
 
   DecodeDelegate delegate(fop);
   dio::AsepriteDecoder decoder;
-  decoder.initialize(&delegate, &fileInterface);
+  decoder.initialize(&delegate, fileInterface);
   if (!decoder.decode())
     return false;
 
@@ -361,10 +572,40 @@ bool AseFormat::onSave(FileOp* fop)
     }
   }
 
+  // Compress cel images in parallel (a few frames ahead of the
+  // frame that is being written)
+  std::vector<frame_t> frames;
+  for (frame_t frame : fop->roi().framesSequence())
+    frames.push_back(frame);
+
+  const int compressionLevel = ase_file_compression_level(fop);
+  CelCompressor compressor(sprite, fop->roi().fromFrame(),
+                           compressionLevel,
+                           fop->config().cacheCompressedCels &&
+                           ase_file_reuse_compressed_data(compressionLevel));
+  int queuedFrames = 0;
+
+  // Offset/flags of each frame for the optional frame index chunk
+  const bool writeFrameIndex = fop->config().writeFrameIndex;
+  size_t frameIndexPos = 0;
+  std::vector<uint32_t> frameOffsets;
+  std::vector<uint32_t> frameFlags;
+
   // Write frames
   int outputFrame = 0;
   dio::AsepriteExternalFiles ext_files;
-  for (frame_t frame : fop->roi().framesSequence()) {
+  for (frame_t frame : frames) {
+    for (; queuedFrames < int(frames.size()) &&
+           queuedFrames <= outputFrame + compressor.lookahead();
+         ++queuedFrames) {
+      compressor.queueFrame(frames[queuedFrames]);
+    }
+
+    if (writeFrameIndex) {
+      frameOffsets.push_back(uint32_t(ftell(f)));
+      frameFlags.push_back(0);
+    }
+
     // Prepare the frame header
     dio::AsepriteFrameHeader frame_header;
     ase_file_prepare_frame_header(f, &frame_header);
@@ -379,6 +620,12 @@ bool AseFormat::onSave(FileOp* fop)
       // Save color profile in first frame
       if (fop->preserveColorProfile())
         ase_file_write_color_profile(f, &frame_header, sprite);
+
+      // Reserve the frame index chunk (it's completed when all frames
+      // are written)
+      if (writeFrameIndex)
+        frameIndexPos = ase_file_write_frame_index_chunk(f, &frame_header,
+                                                         int(frames.size()));
     }
 
     // is the first frame or did the palette change?
@@ -388,6 +635,9 @@ bool AseFormat::onSave(FileOp* fop)
          (frame == fop->roi().fromFrame() ||
          // This palette is different from the previous frame palette
          sprite->palette(frame-1)->countDiff(pal, &palFrom, &palTo) > 0)) {
+      if (writeFrameIndex)
+        frameFlags.back() |= ASE_FRAME_INDEX_FLAG_PALETTE;
+
       // Write new palette chunk
       if (require_new_palette_chunk) {
         ase_file_write_palette_chunk(f, &frame_header,
@@ -440,7 +690,7 @@ bool AseFormat::onSave(FileOp* fop)
     // Write cel chunks
     ase_file_write_cels(f, fop, &frame_header, ext_files,
                         sprite, sprite->root(),
-                        0, frame);
+                        0, frame, &compressor);
 
     // Write the frame header
     ase_file_write_frame_header(f, &frame_header);
@@ -454,6 +704,15 @@ bool AseFormat::onSave(FileOp* fop)
       break;
   }
 
+  if (writeFrameIndex && frameIndexPos > 0) {
+    // When the operation is stopped, frames that weren't written are
+    // saved as empty entries
+    frameOffsets.resize(frames.size(), 0);
+    frameFlags.resize(frames.size(), 0);
+    ase_file_complete_frame_index_chunk(f, frameIndexPos,
+                                        frameOffsets, frameFlags);
+  }
+
   // Write the missing field (filesize) of the header.
   ase_file_write_header_filesize(f, &header);
 
@@ -588,14 +847,16 @@ static layer_t ase_file_write_cels(FILE* f, FileOp* fop,
                                    const dio::AsepriteExternalFiles& ext_files,
                                    const Sprite* sprite, const Layer* layer,
                                    layer_t layer_index,
-                                   const frame_t frame)
+                                   const frame_t frame,
+                                   CelCompressor* compressor)
 {
   if (layer->isImage()) {
     const Cel* cel = layer->cel(frame);
     if (cel) {
       ase_file_write_cel_chunk(f, frame_header, cel,
                                static_cast<const LayerImage*>(layer),
-                               layer_index, sprite, fop->roi().fromFrame());
+                               layer_index, sprite, fop->roi().fromFrame(),
+                               compressor);
 
       if (layer->isReference())
         ase_file_write_cel_extra_chunk(f, frame_header, cel);
@@ -615,7 +876,7 @@ static layer_t ase_file_write_cels(FILE* f, FileOp* fop,
     for (const Layer* child : static_cast<const LayerGroup*>(layer)->layers()) {
       layer_index =
         ase_file_write_cels(f, fop, frame_header, ext_files, sprite, child,
-                            layer_index, frame);
+                            layer_index, frame, compressor);
     }
   }
 
@@ -869,6 +1130,7 @@ static void write_raw_image(FILE* f, ScanlinesGen* gen, PixelFormat pixelFormat)
 template<typename ImageTraits>
 static void write_compressed_image_templ(FILE* f,
                                          ScanlinesGen* gen,
+                                         const int compressionLevel,
                                          base::buffer* compressedOutput)
 {
   PixelIO<ImageTraits> pixel_io;
@@ -878,7 +1140,7 @@ static void write_compressed_image_templ(FILE* f,
   zstream.zalloc = (alloc_func)0;
   zstream.zfree  = (free_func)0;
   zstream.opaque = (voidpf)0;
-  err = deflateInit(&zstream, Z_DEFAULT_COMPRESSION);
+  err = deflateInit(&zstream, compressionLevel);
   if (err != Z_OK)
     throw base::Exception("ZLib error %d in deflateInit().", err);
 
@@ -907,8 +1169,9 @@ static void write_compressed_image_templ(FILE* f,
 
       int output_bytes = compressed.size() - zstream.avail_out;
       if (output_bytes > 0) {
-        if ((fwrite(&compressed[0], 1, output_bytes, f) != (size_t)output_bytes)
-            || ferror(f))
+        // "f" can be nullptr when we only want the compressedOutput
+        if (f && ((fwrite(&compressed[0], 1, output_bytes, f) != (size_t)output_bytes)
+                  || ferror(f)))
           throw base::Exception("Error writing compressed image pixels.\n");
 
         // Save the whole compressed buffer to re-use in following
@@ -928,28 +1191,32 @@ static void write_compressed_image_templ(FILE* f,
   err = deflateEnd(&zstream);
   if (err != Z_OK)
     throw base::Exception("ZLib error %d in deflateEnd().", err);
+
+  PerfCounters::add(PerfCounters::BytesCompressed,
+                    int64_t(scanline.size()) * imgSize.h);
 }
 
 static void write_compressed_image(FILE* f,
                                    ScanlinesGen* gen,
                                    PixelFormat pixelFormat,
-                                   base::buffer* compressedOutput = nullptr)
+                                   const int compressionLevel,
+                                   base::buffer* compressedOutput)
 {
   switch (pixelFormat) {
     case IMAGE_RGB:
-      write_compressed_image_templ<RgbTraits>(f, gen, compressedOutput);
+      write_compressed_image_templ<RgbTraits>(f, gen, compressionLevel, compressedOutput);
       break;
 
     case IMAGE_GRAYSCALE:
-      write_compressed_image_templ<GrayscaleTraits>(f, gen, compressedOutput);
+      write_compressed_image_templ<GrayscaleTraits>(f, gen, compressionLevel, compressedOutput);
       break;
 
     case IMAGE_INDEXED:
-      write_compressed_image_templ<IndexedTraits>(f, gen, compressedOutput);
+      write_compressed_image_templ<IndexedTraits>(f, gen, compressionLevel, compressedOutput);
       break;
 
     case IMAGE_TILEMAP:
-      write_compressed_image_templ<TilemapTraits>(f, gen, compressedOutput);
+      write_compressed_image_templ<TilemapTraits>(f, gen, compressionLevel, compressedOutput);
       break;
   }
 }
@@ -958,15 +1225,10 @@ static void write_compressed_image(FILE* f,
 // Cel Chunk
 //////////////////////////////////////////////////////////////////////
 
-static void ase_file_write_cel_chunk(FILE* f, dio::AsepriteFrameHeader* frame_header,
-                                     const Cel* cel,
-                                     const LayerImage* layer,
-                                     const layer_t layer_index,
-                                     const Sprite* sprite,
-                                     const frame_t firstFrame)
+static const Cel* ase_file_get_cel_link(const Cel* cel,
+                                        const LayerImage* layer,
+                                        const frame_t firstFrame)
 {
-  ChunkWriter chunk(f, frame_header, ASE_FILE_CHUNK_CEL);
-
   const Cel* link = cel->link();
 
   // In case the original link is outside the ROI, we've to find the
@@ -981,6 +1243,72 @@ static void ase_file_write_cel_chunk(FILE* f, dio::AsepriteFrameHeader* frame_he
     if (link == cel)
       link = nullptr;
   }
+  return link;
+}
+
+static void ase_file_write_compressed_cel_image(FILE* f,
+                                                const Cel* cel,
+                                                CelCompressor* compressor)
+{
+  const Image* image = cel->image();
+  const bool cache = (compressor && compressor->cacheCompressedCels());
+
+  // Use the image already compressed by a worker thread (or the
+  // content hash calculated by CelCompressor::queueFrame())
+  CelCompressor::Item item;
+  if (compressor)
+    item = compressor->take(cel);
+  if (cache && !item.queued) {
+    item.contentHash = calculate_image_content_hash(image);
+    item.cached = image->hasValidCompressedData(item.contentHash);
+  }
+
+  // Save the cached compressed data if the image wasn't modified
+  // since it was loaded/saved the last time
+  if (item.cached) {
+    const base::buffer& data = image->compressedData();
+
+    ASEFILE_TRACE("[%d] saving compressed cel image (%s)\n",
+                  image->id(), base::get_pretty_memory_size(data.size()).c_str());
+
+    if ((fwrite(data.data(), 1, data.size(), f) != data.size()) || ferror(f))
+      throw base::Exception("Error writing compressed image pixels.\n");
+    return;
+  }
+
+  std::unique_ptr<base::buffer> output = std::move(item.output);
+  if (output) {
+    if (!output->empty() &&
+        ((fwrite(output->data(), 1, output->size(), f) != output->size())
+         || ferror(f)))
+      throw base::Exception("Error writing compressed image pixels.\n");
+  }
+  else {
+    ImageScanlines scan(image);
+    output = std::make_unique<base::buffer>();
+    write_compressed_image(f, &scan, image->pixelFormat(),
+                           compressor ? compressor->compressionLevel():
+                                        Z_DEFAULT_COMPRESSION,
+                           cache ? output.get(): nullptr);
+  }
+
+  // Keep the compressed data so saving the file again will not need
+  // recompressing this image
+  if (cache)
+    image->setCompressedData(*output, item.contentHash);
+}
+
+static void ase_file_write_cel_chunk(FILE* f, dio::AsepriteFrameHeader* frame_header,
+                                     const Cel* cel,
+                                     const LayerImage* layer,
+                                     const layer_t layer_index,
+                                     const Sprite* sprite,
+                                     const frame_t firstFrame,
+                                     CelCompressor* compressor)
+{
+  ChunkWriter chunk(f, frame_header, ASE_FILE_CHUNK_CEL);
+
+  const Cel* link = ase_file_get_cel_link(cel, layer, firstFrame);
 
   int cel_type = (link ? ASE_FILE_LINK_CEL:
                   cel->layer()->isTilemap() ? ASE_FILE_COMPRESSED_TILEMAP:
@@ -1029,8 +1357,7 @@ static void ase_file_write_cel_chunk(FILE* f, dio::AsepriteFrameHeader* frame_he
         fputw(image->width(), f);
         fputw(image->height(), f);
 
-        ImageScanlines scan(image);
-        write_compressed_image(f, &scan, image->pixelFormat());
+        ase_file_write_compressed_cel_image(f, cel, compressor);
       }
       else {
         // Width and height
@@ -1054,8 +1381,7 @@ static void ase_file_write_cel_chunk(FILE* f, dio::AsepriteFrameHeader* frame_he
       fputl(tile_f_dflip, f);
       ase_file_write_padding(f, 10);
 
-      ImageScanlines scan(image);
-      write_compressed_image(f, &scan, IMAGE_TILEMAP);
+      ase_file_write_compressed_cel_image(f, cel, compressor);
     }
   }
 }
@@ -1122,6 +1448,41 @@ static void ase_file_write_color_profile(FILE* f,
   }
 }
 
+// Writes an empty frame index chunk and returns the position of its
+// entries, ase_file_complete_frame_index_chunk() fills them later.
+static size_t ase_file_write_frame_index_chunk(FILE* f,
+                                               dio::AsepriteFrameHeader* frame_header,
+                                               const int nframes)
+{
+  ChunkWriter chunk(f, frame_header, ASE_FILE_CHUNK_FRAME_INDEX);
+
+  fputl(nframes, f);
+  ase_file_write_padding(f, 8);
+
+  size_t pos = ftell(f);
+  for (int i=0; i<nframes; ++i) {
+    fputl(0, f);                // Frame offset
+    fputl(0, f);                // Frame flags
+  }
+  return pos;
+}
+
+static void ase_file_complete_frame_index_chunk(FILE* f,
+                                                const size_t pos,
+                                                const std::vector<uint32_t>& offsets,
+                                                const std::vector<uint32_t>& flags)
+{
+  ASSERT(offsets.size() == flags.size());
+
+  const long end = ftell(f);
+  fseek(f, pos, SEEK_SET);
+  for (size_t i=0; i<offsets.size(); ++i) {
+    fputl(offsets[i], f);
+    fputl(flags[i], f);
+  }
+  fseek(f, end, SEEK_SET);
+}
+
 #if 0
 static void ase_file_write_mask_chunk(FILE* f, dio::AsepriteFrameHeader* frame_header, Mask* mask)
 {
@@ -1478,9 +1839,12 @@ static void ase_file_write_tileset_chunk(FILE* f, FileOp* fop,
   if (flags & ASE_TILESET_FLAG_EMBEDDED) {
     size_t beg = ftell(f);
 
+    const int compressionLevel = ase_file_compression_level(fop);
+
     // Save the cached tileset compressed data
     if (!tileset->compressedData().empty() &&
-        tileset->compressedDataVersion() == tileset->version()) {
+        tileset->compressedDataVersion() == tileset->version() &&
+        ase_file_reuse_compressed_data(compressionLevel)) {
       const base::buffer& data = tileset->compressedData();
 
       ASEFILE_TRACE("[%d] saving compressed tileset (%s)\n",
@@ -1502,7 +1866,7 @@ static void ase_file_write_tileset_chunk(FILE* f, FileOp* fop,
         compressedDataPtr = &compressedData;
 
       write_compressed_image(f, &gen, tileset->sprite()->pixelFormat(),
-                             compressedDataPtr);
+                             compressionLevel, compressedDataPtr);
 
       // As we've just compressed the tileset, we can cache this same
       // data (so saving the file again will not need recompressing).
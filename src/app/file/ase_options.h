@@ -0,0 +1,31 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_FILE_ASE_OPTIONS_H_INCLUDED
+#define APP_FILE_ASE_OPTIONS_H_INCLUDED
+#pragma once
+
+#include "app/file/format_options.h"
+
+namespace app {
+
+  // Data for .aseprite files
+  class AseOptions : public FormatOptions {
+  public:
+    // Compression level used to deflate cel images and tilesets:
+    // Fast is zlib level 1, Max is level 9.
+    enum class Compression { Default, Fast, Max };
+
+    Compression compression() const { return m_compression; }
+    void setCompression(const Compression compression) { m_compression = compression; }
+
+  private:
+    Compression m_compression = Compression::Default;
+  };
+
+} // namespace app
+
+#endif
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -24,6 +24,9 @@
 #include "doc/doc.h"
 #include "fmt/format.h"
 
+#include <algorithm>
+#include <vector>
+
 namespace app {
 
 // Max supported .bmp size (to filter out invalid image sizes)
@@ -511,172 +514,82 @@ static void read_bmicolors(FileOp* fop, int bytes, FILE *f, bool win_flag)
 /* read_1bit_line:
  *  Support function for reading the 1 bit bitmap file format.
  */
-static void read_1bit_line(int length, FILE *f, Image *image, int line)
+static void read_1bit_line(int length, const uint8_t* src, Image *image, int line)
 {
-  unsigned char b[32];
-  unsigned long n;
-  int i, j, k;
-  int pix;
-
-  for (i=0; i<length; i++) {
-    j = i % 32;
-    if (j == 0) {
-      n = fgetl(f);
-      n =
-        ((n&0x000000ff)<<24) |
-        ((n&0x0000ff00)<< 8) |
-        ((n&0x00ff0000)>> 8) |
-        ((n&0xff000000)>>24);
-      for (k=0; k<32; k++) {
-        b[31-k] = (char)(n & 1);
-        n = n >> 1;
-      }
-    }
-    pix = b[j];
-    put_pixel(image, i, line, pix);
-  }
+  uint8_t* dst = image->getPixelAddress(0, line);
+  for (int i=0; i<length; i++)
+    dst[i] = (src[i/8] >> (7 - (i & 7))) & 1;
 }
 
 /* read_2bit_line (not standard):
  *  Support function for reading the 2 bit bitmap file format.
  */
-static void read_2bit_line(int length, FILE *f, Image *image, int line)
+static void read_2bit_line(int length, const uint8_t* src, Image *image, int line)
 {
-  unsigned char b[16];
-  unsigned long n;
-  int i, j, k;
-  int temp;
-  int pix;
-
-  for (i=0; i<length; i++) {
-    j = i % 16;
-    if (j == 0) {
-      n = fgetl(f);
-      for (k=0; k<4; k++) {
-        temp = n & 255;
-        b[k*4+3] = temp & 3;
-        temp = temp >> 2;
-        b[k*4+2] = temp & 3;
-        temp = temp >> 2;
-        b[k*4+1] = temp & 3;
-        temp = temp >> 2;
-        b[k*4] = temp & 3;
-        n = n >> 8;
-      }
-    }
-    pix = b[j];
-    put_pixel(image, i, line, pix);
-  }
+  uint8_t* dst = image->getPixelAddress(0, line);
+  for (int i=0; i<length; i++)
+    dst[i] = (src[i/4] >> (6 - 2*(i & 3))) & 3;
 }
 
 /* read_4bit_line:
  *  Support function for reading the 4 bit bitmap file format.
  */
-static void read_4bit_line(int length, FILE *f, Image *image, int line)
+static void read_4bit_line(int length, const uint8_t* src, Image *image, int line)
 {
-  unsigned char b[8];
-  unsigned long n;
-  int i, j, k;
-  int temp;
-  int pix;
-
-  for (i=0; i<length; i++) {
-    j = i % 8;
-    if (j == 0) {
-      n = fgetl(f);
-      for (k=0; k<4; k++) {
-        temp = n & 255;
-        b[k*2+1] = temp & 15;
-        temp = temp >> 4;
-        b[k*2] = temp & 15;
-        n = n >> 8;
-      }
-    }
-    pix = b[j];
-    put_pixel(image, i, line, pix);
-  }
+  uint8_t* dst = image->getPixelAddress(0, line);
+  for (int i=0; i<length; i++)
+    dst[i] = (src[i/2] >> (i & 1 ? 0: 4)) & 15;
 }
 
 /* read_8bit_line:
  *  Support function for reading the 8 bit bitmap file format.
  */
-static void read_8bit_line(int length, FILE *f, Image *image, int line)
+static void read_8bit_line(int length, const uint8_t* src, Image *image, int line)
 {
-  unsigned char b[4];
-  unsigned long n;
-  int i, j, k;
-  int pix;
-
-  for (i=0; i<length; i++) {
-    j = i % 4;
-    if (j == 0) {
-      n = fgetl(f);
-      for (k=0; k<4; k++) {
-        b[k] = (char)(n & 255);
-        n = n >> 8;
-      }
-    }
-    pix = b[j];
-    put_pixel(image, i, line, pix);
-  }
+  std::copy(src, src+length, image->getPixelAddress(0, line));
 }
 
-static void read_16bit_line(int length, FILE *f, Image *image, int line, bool& withAlpha)
+static void read_16bit_line(int length, const uint8_t* src, Image *image, int line, bool& withAlpha)
 {
-  int i, r, g, b, a, word;
-
-  for (i=0; i<length; i++) {
-    word = fgetw(f);
-
-    r = (word >> 10) & 0x1f;
-    g = (word >> 5) & 0x1f;
-    b = (word) & 0x1f;
-    a = (word & 0x8000 ? 255 : 0);
-    if (a)
-      withAlpha = true;
-    put_pixel(image, i, line,
-              rgba(scale_5bits_to_8bits(r),
-                   scale_5bits_to_8bits(g),
-                   scale_5bits_to_8bits(b), a));
+  auto dst = (uint32_t*)image->getPixelAddress(0, line);
+  int alphaBits = 0;
+
+  for (int i=0; i<length; i++, src+=2) {
+    const int word = src[0] | (src[1] << 8);
+    const int r = (word >> 10) & 0x1f;
+    const int g = (word >> 5) & 0x1f;
+    const int b = (word) & 0x1f;
+    const int a = (word & 0x8000 ? 255 : 0);
+    alphaBits |= a;
+    dst[i] = rgba(scale_5bits_to_8bits(r),
+                  scale_5bits_to_8bits(g),
+                  scale_5bits_to_8bits(b), a);
   }
 
-  i = (2*i) % 4;
-  if (i > 0)
-    while (i++ < 4)
-      fgetc(f);
+  if (alphaBits)
+    withAlpha = true;
 }
 
-static void read_24bit_line(int length, FILE *f, Image *image, int line)
+static void read_24bit_line(int length, const uint8_t* src, Image *image, int line)
 {
-  int i, r, g, b;
-
-  for (i=0; i<length; i++) {
-    b = fgetc(f);
-    g = fgetc(f);
-    r = fgetc(f);
-    put_pixel(image, i, line, rgba(r, g, b, 255));
-  }
-
-  i = (3*i) % 4;
-  if (i > 0)
-    while (i++ < 4)
-      fgetc(f);
+  auto dst = (uint32_t*)image->getPixelAddress(0, line);
+  for (int i=0; i<length; i++, src+=3)
+    dst[i] = rgba(src[2], src[1], src[0], 255);
 }
 
-static void read_32bit_line(int length, FILE *f, Image *image, int line,
+static void read_32bit_line(int length, const uint8_t* src, Image *image, int line,
                             bool& withAlpha)
 {
-  int i, r, g, b, a;
+  auto dst = (uint32_t*)image->getPixelAddress(0, line);
+  int alphaBits = 0;
 
-  for (i=0; i<length; i++) {
-    b = fgetc(f);
-    g = fgetc(f);
-    r = fgetc(f);
-    a = fgetc(f);
-    if (a)
-      withAlpha = true;
-    put_pixel(image, i, line, rgba(r, g, b, a));
+  for (int i=0; i<length; i++, src+=4) {
+    alphaBits |= src[3];
+    dst[i] = rgba(src[2], src[1], src[0], src[3]);
   }
+
+  if (alphaBits)
+    withAlpha = true;
 }
 
 /* read_image:
@@ -691,15 +604,25 @@ static void read_image(FILE *f, Image *image, const BITMAPINFOHEADER *infoheader
   dir    = height < 0 ? 1: -1;
   height = ABS(height);
 
+  // Each row is padded to 4 bytes, we read the whole row at once
+  const int width = (int)infoheader->biWidth;
+  const size_t rowBytes = ((size_t(width) * infoheader->biBitCount + 31) / 32) * 4;
+  std::vector<uint8_t> row(rowBytes);
+
   for (i=0; i<height; i++, line+=dir) {
+    // Missing bytes (truncated files) are read as zero
+    const size_t n = fread(row.data(), 1, rowBytes, f);
+    if (n < rowBytes)
+      std::fill(row.begin()+n, row.end(), 0);
+
     switch (infoheader->biBitCount) {
-      case 1: read_1bit_line(infoheader->biWidth, f, image, line); break;
-      case 2: read_2bit_line(infoheader->biWidth, f, image, line); break;
-      case 4: read_4bit_line(infoheader->biWidth, f, image, line); break;
-      case 8: read_8bit_line(infoheader->biWidth, f, image, line); break;
-      case 16: read_16bit_line(infoheader->biWidth, f, image, line, withAlpha); break;
-      case 24: read_24bit_line(infoheader->biWidth, f, image, line); break;
-      case 32: read_32bit_line(infoheader->biWidth, f, image, line, withAlpha); break;
+      case 1: read_1bit_line(width, row.data(), image, line); break;
+      case 2: read_2bit_line(width, row.data(), image, line); break;
+      case 4: read_4bit_line(width, row.data(), image, line); break;
+      case 8: read_8bit_line(width, row.data(), image, line); break;
+      case 16: read_16bit_line(width, row.data(), image, line, withAlpha); break;
+      case 24: read_24bit_line(width, row.data(), image, line); break;
+      case 32: read_32bit_line(width, row.data(), image, line, withAlpha); break;
     }
 
     fop->setProgress((float)(i+1) / (float)(height));
@@ -925,12 +848,23 @@ static int read_bitfields_image(FILE *f, Image *image, BITMAPINFOHEADER *infohea
   bytes_per_pixel = ((bits_per_pixel / 8) +
                      ((bits_per_pixel % 8) > 0 ? 1: 0));
 
+  const int width = (int)infoheader->biWidth;
+  const size_t rowBytes = ((size_t(width) * bytes_per_pixel + 3) / 4) * 4;
+  std::vector<uint8_t> row(rowBytes);
+
   for (i=0; i<height; i++, line+=dir) {
-    for (j=0; j<(int)infoheader->biWidth; j++) {
+    const size_t n = fread(row.data(), 1, rowBytes, f);
+    if (n < rowBytes)
+      std::fill(row.begin()+n, row.end(), 0);
+
+    const uint8_t* src = row.data();
+    auto dst = (uint32_t*)image->getPixelAddress(0, line);
+
+    for (j=0; j<width; j++, src+=bytes_per_pixel) {
       /* read the DWORD, WORD or BYTE in little-endian order */
       buffer = 0;
       for (k=0; k<bytes_per_pixel; k++)
-        buffer |= fgetc(f) << (k<<3);
+        buffer |= uint32_t(src[k]) << (k<<3);
 
       r = (buffer & rmask) >> rshift;
       g = (buffer & gmask) >> gshift;
@@ -944,13 +878,8 @@ static int read_bitfields_image(FILE *f, Image *image, BITMAPINFOHEADER *infohea
 
       if (a)
         withAlpha = true;
-      put_pixel_fast<RgbTraits>(image, j, line, rgba(r, g, b, a));
+      dst[j] = rgba(r, g, b, a);
     }
-
-    j = (bytes_per_pixel*j) % 4;
-    if (j > 0)
-      while (j++ < 4)
-        fgetc(f);
   }
 
   if (!withAlpha) {
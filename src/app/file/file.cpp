@@ -26,6 +26,7 @@
 #include "app/i18n/strings.h"
 #include "app/modules/gui.h"
 #include "app/modules/palettes.h"
+#include "app/perf_trace.h"
 #include "app/pref/preferences.h"
 #include "app/tx.h"
 #include "app/ui/incompat_file_window.h"
@@ -33,10 +34,12 @@
 #include "app/ui/status_bar.h"
 #include "base/fs.h"
 #include "base/string.h"
+#include "base/thread_pool.h"
 #include "dio/detect_format.h"
 #include "doc/algorithm/resize_image.h"
 #include "doc/doc.h"
 #include "fmt/format.h"
+#include "render/frame_signature.h"
 #include "render/quantization.h"
 #include "render/render.h"
 #include "ui/alert.h"
@@ -50,6 +53,9 @@
 #include <algorithm>
 #include <cstring>
 #include <cstdarg>
+#include <deque>
+#include <future>
+#include <thread>
 
 namespace app {
 
@@ -63,6 +69,7 @@ public:
     , m_spec(m_sprite->spec())
     , m_supportAnimation(fop->fileFormat()->support(FILE_SUPPORT_FRAMES))
     , m_newBlend(fop->newBlend())
+    , m_parallelRender(fop->config().parallelRender)
   {
     ASSERT(m_doc && m_sprite);
   }
@@ -130,6 +137,10 @@ public:
     return m_sprite->frameDuration(frame);
   }
 
+  uint64_t frameSignature(doc::frame_t frame) const override {
+    return render::calc_frame_signature(m_sprite, frame);
+  }
+
   const doc::Palette* palette(doc::frame_t frame) const override {
     ASSERT(m_sprite);
     return m_sprite->palette(frame);
@@ -165,6 +176,8 @@ public:
     render::Render render;
     render.setNewBlend(m_newBlend);
     render.setBgOptions(render::BgOptions::MakeNone());
+    if (m_parallelRender)
+      render.setParallelTileSize(128);
     render.renderSprite(
       (needResize ? m_tmpUnscaledRender.get(): dst),
       m_sprite, frame,
@@ -187,6 +200,10 @@ public:
     m_spec.setHeight(m_spec.height() * m_scale.y);
   }
 
+  bool isScaled() const override {
+    return needResize();
+  }
+
 private:
   bool needResize() const {
     return (m_scale != gfx::PointF(1.0, 1.0));
@@ -197,11 +214,231 @@ private:
   doc::ImageSpec m_spec;
   const bool m_supportAnimation;
   const bool m_newBlend;
+  const bool m_parallelRender;
   doc::ImageRef m_tmpScaledImage = nullptr;
   mutable doc::ImageRef m_tmpUnscaledRender = nullptr;
   gfx::PointF m_scale = gfx::PointF(1.0, 1.0);
 };
 
+// Encodes the files of a sequence in worker threads. Frames are
+// still rendered in the FileOp thread, and each file is saved with
+// its own FileOp (with the rendered image, palette, and filename) so
+// formats don't share any state between threads.
+class FileOp::SequenceEncoder {
+public:
+  SequenceEncoder(FileOp* fop)
+    : m_fop(fop)
+    , m_maxPendingFiles(2 * std::max(1u, std::thread::hardware_concurrency()))
+    , m_pool(std::max(1u, std::thread::hardware_concurrency())) {
+  }
+
+  ~SequenceEncoder() {
+    waitAll();
+  }
+
+  // Starts saving the given rendered "image" in the current
+  // m_fop->m_filename. Returns false if we have to stop because a
+  // previous file couldn't be saved.
+  bool queue(const frame_t frame,
+             const frame_t outputFrame,
+             const gfx::Rect& bounds,
+             const ImageRef& image) {
+    // Limit the number of rendered images in memory
+    while (!m_failed && int(m_pending.size()) >= m_maxPendingFiles)
+      waitFirst();
+    if (m_failed)
+      return false;
+
+    std::shared_ptr<FileOp> fop(
+      new FileOp(FileOpSave, m_fop->m_context, &m_fop->m_config));
+    fop->m_format = m_fop->m_format;
+    fop->m_document = m_fop->m_document;
+    fop->m_filename = m_fop->m_filename;
+    fop->m_roi = m_fop->m_roi;
+    fop->m_formatOptions = m_fop->m_formatOptions;
+    fop->m_seq.filename_list.push_back(m_fop->m_filename);
+    fop->m_seq.palette = new Palette(frame_t(0), 256);
+    fop->m_seq.image = image;
+    fop->m_seq.frame = frame;
+    m_fop->m_document->sprite()->palette(frame)->copyColorsTo(fop->m_seq.palette);
+
+    if (fop->m_format->support(FILE_ENCODE_ABSTRACT_IMAGE)) {
+      fop->makeAbstractImage();
+      fop->m_abstractImage->setSpecSize(m_fop->m_roi.fileCanvasSize(),
+                                        bounds.size());
+    }
+
+    auto task = std::make_shared<Task>(
+      [fop]{
+        try {
+          return fop->m_format->save(fop.get());
+        }
+        catch (const std::exception& ex) {
+          fop->setError("%s\n", ex.what());
+          return false;
+        }
+      });
+    m_pending.push_back(Pending{ outputFrame, fop, task->get_future() });
+    m_pool.execute([task]{ (*task)(); });
+    return true;
+  }
+
+  // Waits all pending files. Errors are reported in the same order
+  // as the files of the sequence.
+  void waitAll() {
+    while (!m_pending.empty())
+      waitFirst();
+  }
+
+  bool failed() const { return m_failed; }
+
+private:
+  using Task = std::packaged_task<bool()>;
+
+  struct Pending {
+    frame_t outputFrame;
+    std::shared_ptr<FileOp> fop;
+    std::future<bool> result;
+  };
+
+  void waitFirst() {
+    Pending pending = std::move(m_pending.front());
+    m_pending.pop_front();
+
+    const bool result = pending.result.get();
+    const FileOp* fop = pending.fop.get();
+    if (fop->hasIncompatibilityError())
+      m_fop->setIncompatibilityError(fop->m_incompatibilityError);
+    if (fop->hasError())
+      m_fop->setError("%s", fop->error().c_str());
+    if (!result) {
+      m_fop->setError("Error saving frame %d in the file \"%s\"\n",
+                      pending.outputFrame+1, fop->m_filename.c_str());
+      m_failed = true;
+    }
+  }
+
+  FileOp* m_fop;
+  const int m_maxPendingFiles;
+  bool m_failed = false;
+  std::deque<Pending> m_pending;
+  base::thread_pool m_pool;
+};
+
+// Decodes the files of a sequence in worker threads. Each file is
+// loaded with its own FileOp (starting with the palette of the first
+// file), and the results are merged in the original FileOp in the same
+// order of the sequence, so the final sprite is the same as loading
+// the files one by one.
+class FileOp::SequenceDecoder {
+public:
+  SequenceDecoder(FileOp* fop)
+    : m_fop(fop)
+    , m_palette(*fop->m_seq.palette)
+    , m_maxPendingFiles(2 * std::max(1u, std::thread::hardware_concurrency()))
+    , m_pool(std::max(1u, std::thread::hardware_concurrency())) {
+  }
+
+  ~SequenceDecoder() {
+    // Discard the files that weren't merged
+    m_pool.wait_all();
+    for (auto& pending : m_pending)
+      discard(pending.fop.get());
+  }
+
+  bool canQueue() const {
+    return (int(m_pending.size()) < m_maxPendingFiles);
+  }
+
+  void queue(const std::string& filename) {
+    std::shared_ptr<FileOp> fop(
+      new FileOp(FileOpLoad, m_fop->m_context, &m_fop->m_config));
+    fop->m_format = m_fop->m_format;
+    fop->m_filename = filename;
+    fop->m_seq.filename_list.push_back(filename);
+    fop->m_seq.palette = new Palette(m_palette);
+
+    auto task = std::make_shared<Task>(
+      [fop]{
+        try {
+          return fop->m_format->load(fop.get());
+        }
+        catch (const std::exception& ex) {
+          fop->setError("%s\n", ex.what());
+          return false;
+        }
+      });
+    m_pending.push_back(Pending{ fop, task->get_future() });
+    m_pool.execute([task]{ (*task)(); });
+  }
+
+  // Waits the next file of the sequence and merges its image and
+  // palette in m_fop as if it were loaded calling
+  // m_fop->m_format->load(m_fop).
+  bool loadNext() {
+    ASSERT(!m_pending.empty());
+    Pending pending = std::move(m_pending.front());
+    m_pending.pop_front();
+
+    bool result = pending.result.get();
+    FileOp* fop = pending.fop.get();
+
+    if (fop->hasIncompatibilityError())
+      m_fop->setIncompatibilityError(fop->m_incompatibilityError);
+    if (fop->hasError())
+      m_fop->setError("%s", fop->error().c_str());
+    if (fop->m_embeddedColorProfile)
+      m_fop->setEmbeddedColorProfile();
+    if (fop->m_formatOptions)
+      m_fop->m_formatOptions = fop->m_formatOptions;
+    if (fop->m_seq.has_alpha)
+      m_fop->m_seq.has_alpha = true;
+    if (fop->m_seq.palette_changed)
+      *m_fop->m_seq.palette = *fop->m_seq.palette;
+
+    // The file was loaded in its own sprite (the first file created
+    // the sprite of m_fop)
+    if (fop->m_document && fop->m_seq.last_cel) {
+      const Sprite* src = fop->m_document->sprite();
+      Sprite* dst = m_fop->m_document->sprite();
+      if (src->pixelFormat() != dst->pixelFormat()) {
+        m_fop->setError("Error: image does not match color mode\n");
+      }
+      else {
+        if (src->transparentColor() != 0)
+          dst->setTransparentColor(src->transparentColor());
+
+        m_fop->m_seq.image = fop->m_seq.image;
+        m_fop->m_seq.last_cel = new Cel(m_fop->m_seq.frame++, ImageRef(nullptr));
+      }
+    }
+
+    discard(fop);
+    return result;
+  }
+
+private:
+  using Task = std::packaged_task<bool()>;
+
+  struct Pending {
+    std::shared_ptr<FileOp> fop;
+    std::future<bool> result;
+  };
+
+  static void discard(FileOp* fop) {
+    delete fop->m_seq.last_cel;
+    fop->m_seq.last_cel = nullptr;
+    delete fop->m_document;
+    fop->m_document = nullptr;
+  }
+
+  FileOp* m_fop;
+  const Palette m_palette;      // Palette after loading the first file
+  const int m_maxPendingFiles;
+  std::deque<Pending> m_pending;
+  base::thread_pool m_pool;
+};
+
 base::paths get_readable_extensions()
 {
   base::paths paths;
@@ -839,6 +1076,9 @@ void FileOp::operate(IFileOpProgress* progress)
 {
   ASSERT(!isDone());
 
+  PerfTrace span("file", (m_type == FileOpLoad ? "FileOp::operate (load)":
+                                                 "FileOp::operate (save)"));
+
   m_progressInterface = progress;
 
   // Load //////////////////////////////////////////////////////////////////////
@@ -879,13 +1119,24 @@ void FileOp::operate(IFileOpProgress* progress)
       m_seq.progress_offset = 0.0f;
       m_seq.progress_fraction = 1.0f / (double)frames;
 
+      // Files after the first one are decoded in worker threads
+      std::unique_ptr<SequenceDecoder> decoder;
       auto it = m_seq.filename_list.begin(),
-           end = m_seq.filename_list.end();
+           end = m_seq.filename_list.end(),
+           queued = it;
       for (; it != end; ++it) {
         m_filename = it->c_str();
 
         // Call the "load" procedure to read the first bitmap.
-        bool loadres = m_format->load(this);
+        bool loadres;
+        if (decoder) {
+          for (; queued != end && decoder->canQueue(); ++queued)
+            decoder->queue(*queued);
+          loadres = decoder->loadNext();
+        }
+        else {
+          loadres = m_format->load(this);
+        }
         if (!loadres) {
           setError("Error loading frame %d from file \"%s\"\n",
                    frame+1, m_filename.c_str());
@@ -905,6 +1156,11 @@ void FileOp::operate(IFileOpProgress* progress)
           else {
             // Add the keyframe
             add_image();
+
+            if (m_config.parallelSequenceLoad && frames > 2) {
+              decoder = std::make_unique<SequenceDecoder>(this);
+              queued = it+1;
+            }
           }
         }
         // For other frames
@@ -941,7 +1197,12 @@ void FileOp::operate(IFileOpProgress* progress)
 
         ++frame;
         m_seq.progress_offset += m_seq.progress_fraction;
+
+        // Files decoded in worker threads don't report their progress
+        if (decoder)
+          setProgress(0.0);
       }
+      decoder.reset();
       m_filename = *m_seq.filename_list.begin();
 
       // Final setup
@@ -1022,6 +1283,17 @@ void FileOp::operate(IFileOpProgress* progress)
       // For each frame in the sprite.
       render::Render render;
       render.setNewBlend(m_config.newBlend);
+      if (m_config.parallelRender)
+        render.setParallelTileSize(128);
+
+      // Encode files in worker threads (except when the image is
+      // scaled on the fly, as the resize uses the sprite RGB map
+      // which is not thread-safe)
+      std::unique_ptr<SequenceEncoder> encoder;
+      if (m_config.parallelSequenceSave &&
+          (!m_abstractImage || !m_abstractImage->isScaled())) {
+        encoder = std::make_unique<SequenceEncoder>(this);
+      }
 
       frame_t outputFrame = 0;
       for (frame_t frame : m_roi.framesSequence()) {
@@ -1058,8 +1330,19 @@ void FileOp::operate(IFileOpProgress* progress)
           // Make directories
           makeDirectories();
 
+          if (encoder) {
+            if (!encoder->queue(frame, outputFrame, bounds, m_seq.image))
+              break;
+
+            // The queued image is used by the worker thread, so we
+            // need a new image to render the next frame
+            m_seq.image.reset(Image::create(sprite->pixelFormat(),
+                                            m_roi.fileCanvasSize().w,
+                                            m_roi.fileCanvasSize().h));
+            m_seq.image->clear(0);
+          }
           // Call the "save" procedure... did it fail?
-          if (!m_format->save(this)) {
+          else if (!m_format->save(this)) {
             setError("Error saving frame %d in the file \"%s\"\n",
                      outputFrame+1, m_filename.c_str());
             break;
@@ -1070,6 +1353,9 @@ void FileOp::operate(IFileOpProgress* progress)
         ++outputFrame;
       }
 
+      if (encoder)
+        encoder->waitAll();
+
       m_filename = *m_seq.filename_list.begin();
 
       // Destroy the image
@@ -1271,7 +1557,16 @@ void FileOp::postLoad()
 
   // Mark this document as associated to a file in the disk (so File >
   // Save doesn't ask for a new name)
-  m_document->markAsSaved();
+  if (m_loadFromFrame < 0) {
+    m_document->markAsSaved();
+  }
+  // A document loaded partially (only the cels of a range of frames)
+  // cannot overwrite the original file without losing the cels
+  // outside the range, so it's not associated to the file (File >
+  // Save will ask for a new name) and it's marked as modified.
+  else {
+    m_document->impossibleToBackToSavedState();
+  }
 
   // In case that the document was loaded without all the information
   // from the file, i.e. we loaded an .aseprite file created with a
@@ -1311,6 +1606,7 @@ void FileOp::setLoadedFormatOptions(const FormatOptionsPtr& opts)
 void FileOp::sequenceSetNColors(int ncolors)
 {
   m_seq.palette->resize(ncolors);
+  m_seq.palette_changed = true;
 }
 
 int FileOp::sequenceGetNColors() const
@@ -1321,6 +1617,7 @@ int FileOp::sequenceGetNColors() const
 void FileOp::sequenceSetColor(int index, int r, int g, int b)
 {
   m_seq.palette->setEntry(index, rgba(r, g, b, 255));
+  m_seq.palette_changed = true;
 }
 
 void FileOp::sequenceGetColor(int index, int* r, int* g, int* b) const
@@ -1346,6 +1643,7 @@ void FileOp::sequenceSetAlpha(int index, int a)
   int b = rgba_getb(c);
 
   m_seq.palette->setEntry(index, rgba(r, g, b, a));
+  m_seq.palette_changed = true;
 }
 
 void FileOp::sequenceGetAlpha(int index, int* a) const
@@ -1531,6 +1829,8 @@ FileOp::FileOp(FileOpType type,
   , m_done(false)
   , m_stop(false)
   , m_oneframe(false)
+  , m_loadFromFrame(-1)
+  , m_loadToFrame(-1)
   , m_createPaletteFromRgba(false)
   , m_ignoreEmpty(false)
   , m_embeddedColorProfile(false)
@@ -1549,6 +1849,7 @@ FileOp::FileOp(FileOpType type,
   m_seq.progress_offset = 0.0f;
   m_seq.progress_fraction = 0.0f;
   m_seq.frame = frame_t(0);
+  m_seq.palette_changed = false;
   m_seq.layer = nullptr;
   m_seq.last_cel = nullptr;
   m_seq.duration = 100;
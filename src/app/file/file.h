@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -21,6 +21,7 @@
 #include "doc/frames_sequence.h"
 #include "os/color_space.h"
 
+#include <cstdint>
 #include <cstdio>
 #include <memory>
 #include <mutex>
@@ -124,6 +125,11 @@ namespace app {
     virtual int frames() const = 0;
     virtual int frameDuration(doc::frame_t frame) const = 0;
 
+    // Returns the same value for frames that render the same pixels
+    // (e.g. frames with linked cels), so encoders can extend the
+    // duration of the previous frame instead of adding a new one.
+    virtual uint64_t frameSignature(doc::frame_t frame) const = 0;
+
     virtual const doc::Palette* palette(doc::frame_t frame) const = 0;
     virtual doc::PalettesList palettes() const = 0;
 
@@ -142,6 +148,11 @@ namespace app {
     virtual void renderFrame(const doc::frame_t frame,
                              const gfx::Rect& frameBounds,
                              doc::Image* dst) const = 0;
+
+    // Returns true if the frames are resized on the fly. In this
+    // case renderFrame() uses a shared temporary image, so it cannot
+    // be called from several threads at the same time.
+    virtual bool isScaled() const = 0;
   };
 
   // Structure to load & save files.
@@ -169,6 +180,31 @@ namespace app {
 
     bool isSequence() const { return !m_seq.filename_list.empty(); }
     bool isOneFrame() const { return m_oneframe; }
+
+    // Loads only the cels of the given range of frames (in formats
+    // that support it, e.g. ASE). The cels outside the range will be
+    // missing, so the loaded document is not associated to the file
+    // (it cannot be saved back without asking for a file name).
+    void setLoadFrameRange(const doc::frame_t fromFrame,
+                           const doc::frame_t toFrame) {
+      m_loadFromFrame = fromFrame;
+      m_loadToFrame = toFrame;
+    }
+    bool getLoadFrameRange(doc::frame_t& fromFrame,
+                           doc::frame_t& toFrame) const {
+      if (m_loadFromFrame < 0)
+        return false;
+      fromFrame = m_loadFromFrame;
+      toFrame = m_loadToFrame;
+      return true;
+    }
+    // The loaded image will be used only at the given size (e.g. to
+    // create a thumbnail), so formats that can decode a downscaled
+    // image faster (e.g. JPEG) can load a smaller image, but never
+    // smaller than this size. An empty size loads the full image.
+    void setLoadMinSize(const gfx::Size& size) { m_loadMinSize = size; }
+    const gfx::Size& loadMinSize() const { return m_loadMinSize; }
+
     bool preserveColorProfile() const { return m_config.preserveColorProfile; }
     const FileFormat* fileFormat() const { return m_format; }
 
@@ -312,6 +348,9 @@ namespace app {
     bool m_oneframe;            // Load just one frame (in formats
                                 // that support animation like
                                 // GIF/FLI/ASE).
+    doc::frame_t m_loadFromFrame; // Range of frames to load (or -1
+    doc::frame_t m_loadToFrame;   // to load all frames).
+    gfx::Size m_loadMinSize;      // Minimum size of a downscaled load.
     bool m_createPaletteFromRgba;
     bool m_ignoreEmpty;
 
@@ -330,6 +369,7 @@ namespace app {
     struct {
       base::paths filename_list;  // All file names to load/save.
       Palette* palette;           // Palette of the sequence.
+      bool palette_changed;       // True if the loaded file modified the palette.
       ImageRef image;             // Image to be saved/loaded.
       // For the progress bar.
       double progress_offset;      // Progress offset from the current frame.
@@ -347,6 +387,9 @@ namespace app {
     class FileAbstractImageImpl;
     std::unique_ptr<FileAbstractImageImpl> m_abstractImage;
 
+    class SequenceEncoder;
+    class SequenceDecoder;
+
     void prepareForSequence();
     void makeAbstractImage();
     void makeDirectories();
@@ -0,0 +1,296 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/context.h"
+#include "app/doc.h"
+#include "app/file/file.h"
+#include "app/file/file_format.h"
+#include "app/file/file_formats_manager.h"
+#include "base/fs.h"
+#include "doc/doc.h"
+#include "fmt/format.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+
+#if _WIN32
+  #include <windows.h>
+
+  #include <psapi.h>
+#else
+  #include <sys/resource.h>
+#endif
+
+// Load/save benchmarks for each file format registered in the
+// FileFormatsManager. Each benchmark reports:
+//
+// * bytes_per_second: throughput of the raw pixels of the sprite
+//   (all cels of all layers/frames),
+// * output_size: size of the saved file,
+// * peak_memory: peak of memory of the whole process (run each
+//   benchmark alone with --benchmark_filter=... to get the peak of
+//   just one format/sprite).
+
+using namespace app;
+using namespace doc;
+
+namespace {
+
+enum class Content { Rgba, Indexed, Tilemap };
+
+struct SpriteParams {
+  Content content;
+  int w, h;
+  int layers;
+  int frames;
+};
+
+const SpriteParams kSprites[] = {
+  { Content::Rgba,    256,  256,  1,  1 },
+  { Content::Rgba,    2048, 2048, 1,  1 },
+  { Content::Rgba,    256,  256,  16, 32 },
+  { Content::Indexed, 256,  256,  1,  1 },
+  { Content::Indexed, 2048, 2048, 1,  1 },
+  { Content::Indexed, 256,  256,  16, 32 },
+  { Content::Tilemap, 1024, 1024, 8,  8 },
+};
+
+constexpr int kTileSize = 16;
+constexpr int kTilesetSize = 256;
+
+std::size_t peak_memory()
+{
+#if _WIN32
+  PROCESS_MEMORY_COUNTERS pmc;
+  if (::GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+    return pmc.PeakWorkingSetSize;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+  #if __APPLE__
+    return std::size_t(usage.ru_maxrss); // In bytes
+  #else
+    return std::size_t(usage.ru_maxrss) * 1024; // In kilobytes
+  #endif
+  }
+#endif
+  return 0;
+}
+
+// Fills the image with runs of random colors (like a real sprite, so
+// the compression of each format has some work to do).
+template<typename ImageTraits>
+void fill_random(Image* image, std::mt19937& rng, const color_t maxColor)
+{
+  std::uniform_int_distribution<color_t> colors(0, maxColor);
+  std::uniform_int_distribution<int> runs(1, 16);
+  color_t c = colors(rng);
+  int run = runs(rng);
+  for (auto& pixel : LockImageBits<ImageTraits>(image, Image::WriteLock)) {
+    pixel = c;
+    if (--run == 0) {
+      c = colors(rng);
+      run = runs(rng);
+    }
+  }
+}
+
+Doc* create_doc(Context* ctx, const SpriteParams& params)
+{
+  std::mt19937 rng(params.w * params.h * params.layers * params.frames);
+
+  const ColorMode colorMode = (params.content == Content::Indexed ?
+                               ColorMode::INDEXED: ColorMode::RGB);
+  Sprite* spr = new Sprite(ImageSpec(colorMode, params.w, params.h), 256);
+  spr->setTotalFrames(params.frames);
+
+  tileset_index tsi = 0;
+  if (params.content == Content::Tilemap) {
+    Tileset* tileset = new Tileset(spr, Grid(gfx::Size(kTileSize, kTileSize)),
+                                   kTilesetSize);
+    for (tile_index ti=1; ti<kTilesetSize; ++ti) {
+      ImageRef tileImage = tileset->get(ti);
+      fill_random<RgbTraits>(tileImage.get(), rng, 0xffffffff);
+    }
+    tsi = spr->tilesets()->add(tileset);
+  }
+
+  for (int i=0; i<params.layers; ++i) {
+    LayerImage* layer;
+    if (params.content == Content::Tilemap)
+      layer = new LayerTilemap(spr, tsi);
+    else
+      layer = new LayerImage(spr);
+    layer->setName(fmt::format("Layer {}", i+1));
+    spr->root()->addLayer(layer);
+
+    for (frame_t frame=0; frame<params.frames; ++frame) {
+      ImageRef image;
+      switch (params.content) {
+        case Content::Rgba:
+          image.reset(Image::create(IMAGE_RGB, params.w, params.h));
+          fill_random<RgbTraits>(image.get(), rng, 0xffffffff);
+          break;
+        case Content::Indexed:
+          image.reset(Image::create(IMAGE_INDEXED, params.w, params.h));
+          fill_random<IndexedTraits>(image.get(), rng, 255);
+          break;
+        case Content::Tilemap:
+          image.reset(Image::create(IMAGE_TILEMAP,
+                                    params.w / kTileSize,
+                                    params.h / kTileSize));
+          fill_random<TilemapTraits>(image.get(), rng, kTilesetSize-1);
+          break;
+      }
+      layer->addCel(new Cel(frame, image));
+    }
+  }
+
+  Doc* doc = new Doc(spr);
+  doc->setContext(ctx);
+  return doc;
+}
+
+// Bytes of all the pixels in the sprite (to measure the throughput)
+int64_t raw_size(const SpriteParams& params)
+{
+  const int bpp = (params.content == Content::Indexed ? 1: 4);
+  return int64_t(bpp) * params.w * params.h * params.layers * params.frames;
+}
+
+bool is_supported(FileFormat* format, const SpriteParams& params)
+{
+  if (!format->support(FILE_SUPPORT_SAVE))
+    return false;
+
+  // Formats without frames save animations as sequence of files
+  if (params.frames > 1 && !format->support(FILE_SUPPORT_FRAMES))
+    return false;
+
+  switch (params.content) {
+    case Content::Rgba:
+      return format->support(FILE_SUPPORT_RGBA);
+    case Content::Indexed:
+      return format->support(FILE_SUPPORT_INDEXED);
+    case Content::Tilemap:
+      // Only .aseprite files support tilemaps
+      return (format->dioFormat() == dio::FileFormat::ASE_ANIMATION);
+  }
+  return false;
+}
+
+std::string benchmark_name(const char* op,
+                           const std::string& ext,
+                           const SpriteParams& params)
+{
+  const char* contentNames[] = { "RGBA", "Indexed", "Tilemap" };
+  return fmt::format("BM_{}/{}/{}/{}x{}/{}layers/{}frames",
+                     op, ext, contentNames[int(params.content)],
+                     params.w, params.h, params.layers, params.frames);
+}
+
+void BM_SaveFile(benchmark::State& state,
+                 Context* ctx,
+                 const std::string& filename,
+                 const SpriteParams params)
+{
+  std::unique_ptr<Doc> doc(create_doc(ctx, params));
+  doc->setFilename(filename);
+
+  for (auto _ : state) {
+    if (save_document(ctx, doc.get()) != 0) {
+      state.SkipWithError("Error saving the file");
+      break;
+    }
+  }
+
+  state.SetBytesProcessed(state.iterations() * raw_size(params));
+  state.counters["output_size"] = double(base::file_size(filename));
+  state.counters["peak_memory"] = double(peak_memory());
+  doc->close();
+
+  if (base::is_file(filename))
+    base::delete_file(filename);
+}
+
+void BM_LoadFile(benchmark::State& state,
+                 Context* ctx,
+                 const std::string& filename,
+                 const SpriteParams params)
+{
+  {
+    std::unique_ptr<Doc> doc(create_doc(ctx, params));
+    doc->setFilename(filename);
+    if (save_document(ctx, doc.get()) != 0) {
+      state.SkipWithError("Error saving the file");
+      return;
+    }
+    doc->close();
+  }
+
+  for (auto _ : state) {
+    std::unique_ptr<Doc> doc(load_document(ctx, filename));
+    if (!doc) {
+      state.SkipWithError("Error loading the file");
+      break;
+    }
+    doc->close();
+  }
+
+  state.SetBytesProcessed(state.iterations() * raw_size(params));
+  state.counters["output_size"] = double(base::file_size(filename));
+  state.counters["peak_memory"] = double(peak_memory());
+
+  if (base::is_file(filename))
+    base::delete_file(filename);
+}
+
+} // anonymous namespace
+
+int app_main(int argc, char* argv[])
+{
+  Context ctx;
+  const std::string dir = base::get_temp_path();
+
+  for (FileFormat* format : *FileFormatsManager::instance()) {
+    base::paths exts;
+    format->getExtensions(exts);
+    if (exts.empty())
+      continue;
+
+    const std::string& ext = exts.front();
+    const std::string filename =
+      base::join_path(dir, fmt::format("file_benchmark.{}", ext));
+
+    for (const SpriteParams& params : kSprites) {
+      if (!is_supported(format, params))
+        continue;
+
+      benchmark::RegisterBenchmark(
+        benchmark_name("SaveFile", ext, params).c_str(),
+        BM_SaveFile, &ctx, filename, params)
+        ->Unit(benchmark::kMillisecond);
+
+      if (format->support(FILE_SUPPORT_LOAD)) {
+        benchmark::RegisterBenchmark(
+          benchmark_name("LoadFile", ext, params).c_str(),
+          BM_LoadFile, &ctx, filename, params)
+          ->Unit(benchmark::kMillisecond);
+      }
+    }
+  }
+
+  ::benchmark::Initialize(&argc, argv);
+  return ::benchmark::RunSpecifiedBenchmarks();
+}
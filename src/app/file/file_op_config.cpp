@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -22,10 +22,22 @@ void FileOpConfig::fillFromPreferences()
   filesWithProfile = pref.color.filesWithProfile();
   missingProfile = pref.color.missingProfile();
   newBlend = pref.experimental.newBlend();
+  parallelRender = pref.experimental.parallelRender();
   defaultSliceColor = pref.slices.defaultColor();
   workingCS = get_working_rgb_space_from_preferences();
   rgbMapAlgorithm = pref.quantization.rgbmapAlgorithm();
   cacheCompressedTilesets = pref.tileset.cacheCompressedTilesets();
+  cacheCompressedCels = pref.experimental.cacheCompressedCels();
+  lazyCelDecoding = pref.experimental.lazyCelDecoding();
+  parallelCelDecoding = pref.experimental.parallelCelDecoding();
+  dedupCelImages = pref.experimental.dedupCelImages();
+  parallelSequenceSave = pref.experimental.parallelSequenceSave();
+  parallelSequenceLoad = pref.experimental.parallelSequenceLoad();
+  parallelGifEncoding = pref.experimental.parallelGifEncoding();
+  pngCompression = pref.png.compression();
+  parallelPngEncoding = pref.experimental.parallelPngEncoding();
+  parallelWebPEncoding = pref.experimental.parallelWebpEncoding();
+  writeFrameIndex = pref.experimental.aseFrameIndex();
 }
 
 } // namespace app
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -31,6 +31,10 @@ namespace app {
     // blend mode.h
     bool newBlend = true;
 
+    // Render big frames dividing them in tiles which are rendered in
+    // worker threads.
+    bool parallelRender = false;
+
     app::Color defaultSliceColor = app::Color::fromRgb(0, 0, 255);
 
     // Algorithm used to create a palette from RGB files.
@@ -42,6 +46,49 @@ namespace app {
     // compressed data that was loaded as-is).
     bool cacheCompressedTilesets = true;
 
+    // Cache compressed cel images (the ones loaded from or saved to
+    // .aseprite files) so unmodified cels are not re-compressed in
+    // the next save.
+    bool cacheCompressedCels = false;
+
+    // Keep the compressed pixels of cels loaded from .aseprite files
+    // in memory, and decode each image the first time it's used.
+    bool lazyCelDecoding = false;
+
+    // Inflate the cel images of .aseprite files in worker threads.
+    bool parallelCelDecoding = true;
+
+    // Share the pixels of cels with the same images (loaded from
+    // .aseprite files).
+    bool dedupCelImages = false;
+
+    // Encode the files of a sequence (e.g. frame{frame}.png) in
+    // worker threads.
+    bool parallelSequenceSave = true;
+
+    // Decode the files of a sequence in worker threads.
+    bool parallelSequenceLoad = true;
+
+    // Render and quantize the frames of GIF animations in worker
+    // threads.
+    bool parallelGifEncoding = true;
+
+    // Compression level/filters used to save PNG files (fast encoding
+    // vs small files).
+    app::gen::PngCompression pngCompression = app::gen::PngCompression::DEFAULT;
+
+    // Filter and compress chunks of rows of big PNG files in worker
+    // threads.
+    bool parallelPngEncoding = true;
+
+    // Render the frames of WebP animations in worker threads.
+    bool parallelWebPEncoding = true;
+
+    // Write a frame index chunk in .aseprite files so the decoder can
+    // jump directly to the requested frames. Disabled by default
+    // because old versions warn about the unknown chunk.
+    bool writeFrameIndex = false;
+
     void fillFromPreferences();
   };
 
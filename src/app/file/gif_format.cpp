@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -23,6 +23,7 @@
 #include "app/util/autocrop.h"
 #include "base/file_handle.h"
 #include "base/fs.h"
+#include "base/thread_pool.h"
 #include "doc/doc.h"
 #include "doc/octree_map.h"
 #include "gfx/clip.h"
@@ -35,6 +36,9 @@
 #include "gif_options.xml.h"
 
 #include <algorithm>
+#include <deque>
+#include <future>
+#include <thread>
 
 #include <gif_lib.h>
 
@@ -950,6 +954,39 @@ class GifEncoder {
 public:
   typedef int gifframe_t;
 
+  // Maximum delay of a GIF frame (in 1/100 seconds)
+  static constexpr int kMaxFrameDelay = 0xffff;
+
+  // A frame converted to indexed, ready to be written in the GIF
+  // file.
+  struct QuantizedFrame {
+    gifframe_t gifFrame = 0;
+    frame_t frame = 0;
+    gfx::Rect frameBounds;
+    DisposalMethod disposal = DisposalMethod::NONE;
+    bool fixDuration = false;
+    ImageRef frameImage;
+    // Palette of the local colormap (when there is no global colormap)
+    Palette localPalette;
+    int localTransparent = -1;
+    Remap remap = Remap(256);
+  };
+  using QuantizedFramePtr = std::unique_ptr<QuantizedFrame>;
+
+  // Differences between the current frame and the previous one
+  // (calculated in a worker thread).
+  struct FrameDiff {
+    ImageRef currentImage;
+    // Pixels of the current frame that must be painted (the other
+    // ones are transparent), cropped to changedBounds.
+    ImageRef deltaImage;
+    // Bounds of the changed pixels (empty if nothing changed).
+    gfx::Rect changedBounds;
+    // True if an opaque pixel of the current frame is transparent in
+    // the next frame (so we need the RESTORE_BGCOLOR disposal).
+    bool pixelClearing = false;
+  };
+
   GifEncoder(FileOp* fop, GifFileType* gifFile)
     : m_fop(fop)
     , m_gifFile(gifFile)
@@ -1080,11 +1117,12 @@ public:
     }
 
     // Create the 3 temporary images (previous/current/next) to
-    // compare pixels between them.
-    for (int i=0; i<3; ++i)
-      m_images[i].reset(Image::create((m_preservePaletteOrder)? IMAGE_INDEXED : IMAGE_RGB,
-                                      m_spriteBounds.w,
-                                      m_spriteBounds.h));
+    // compare pixels between them. Then they are replaced with the
+    // rendered frames.
+    for (ImageRef* image : { &m_previousImage, &m_currentImage, &m_nextImage })
+      image->reset(Image::create((m_preservePaletteOrder)? IMAGE_INDEXED : IMAGE_RGB,
+                                 m_spriteBounds.w,
+                                 m_spriteBounds.h));
   }
 
   ~GifEncoder() {
@@ -1097,170 +1135,304 @@ public:
     if (m_loop >= 0)
       writeLoopExtension();
 
-    // Previous and next images are used to decide the best disposal
-    // method (e.g. if it's more convenient to restore the background
-    // color or to restore the previous frame to reach the next one).
-    m_previousImage = m_images[0].get();
-    m_currentImage = m_images[1].get();
-    m_nextImage = m_images[2].get();
-
-    auto frame_beg = m_fop->roi().framesSequence().begin();
-#if _DEBUG
-    auto frame_end = m_fop->roi().framesSequence().end();
-#endif
-    auto frame_it = frame_beg;
+    // Frames are rendered and quantized in worker threads, and then
+    // written (LZW compressed) in the same order from this thread.
+    // The delta image/disposal method is calculated in this thread
+    // too because it depends on the previous frame. (The abstract
+    // image cannot render frames in parallel when it's scaled.)
+    const bool parallel = (m_fop->config().parallelGifEncoding &&
+                           !m_img->isScaled());
+    const int nthreads = std::max(1u, std::thread::hardware_concurrency());
+    const int maxPending = (parallel ? 2*nthreads: 0);
+    std::unique_ptr<base::thread_pool> pool;
+    if (parallel)
+      pool = std::make_unique<base::thread_pool>(nthreads);
 
     // In this code "gifFrame" will be the GIF frame, and "frame" will
-    // be the doc::Sprite frame.
-    gifframe_t nframes = totalFrames();
-    for (gifframe_t gifFrame=0; gifFrame<nframes; ++gifFrame) {
-      ASSERT(frame_it != frame_end);
-      frame_t frame = *frame_it;
-      ++frame_it;
+    // be the doc::Sprite frame. Consecutive frames that render the
+    // same pixels (e.g. frames with linked cels) are saved as just
+    // one GIF frame with the sum of their durations.
+    std::vector<frame_t> frames;
+    uint64_t prevSignature = 0;
+    m_frameDurations.clear();
+    for (frame_t frame : m_fop->roi().framesSequence()) {
+      const uint64_t signature = m_img->frameSignature(frame);
+      const int duration = m_img->frameDuration(frame);
+      if (!frames.empty() &&
+          signature == prevSignature &&
+          m_fop->roi().frameBounds(frame) == m_fop->roi().frameBounds(frames.back()) &&
+          (m_frameDurations.back() + duration) / 10 <= kMaxFrameDelay) {
+        m_frameDurations.back() += duration;
+        continue;
+      }
+      frames.push_back(frame);
+      m_frameDurations.push_back(duration);
+      prevSignature = signature;
+    }
 
+    const gifframe_t nframes = gifframe_t(frames.size());
+
+    std::deque<std::future<ImageRef>> renders;
+    std::deque<std::future<FrameDiff>> diffs;
+    std::deque<std::future<QuantizedFramePtr>> quantized;
+    int nextRender = 0;
+    int nextDiff = 0;
+
+    // Returns the next rendered frame, and queues the render of the
+    // following frames.
+    auto nextRenderedFrame = [&]() -> ImageRef {
+      for (; (nextRender < nframes &&
+              (renders.empty() || int(renders.size()) < maxPending)); ++nextRender) {
+        renders.push_back(
+          runTask<ImageRef>(pool.get(),
+                            [this, frame=frames[nextRender]]{
+                              return renderFrame(frame);
+                            }));
+      }
+      ImageRef image = renders.front().get();
+      renders.pop_front();
+      return image;
+    };
+
+    // Queues the calculation of the differences of the next frame
+    // with the previous one.
+    auto queueNextFrameDiff = [&]{
+      const gifframe_t gifFrame = nextDiff++;
+
+      // Previous and next images are used to decide the best disposal
+      // method (e.g. if it's more convenient to restore the background
+      // color or to restore the previous frame to reach the next one).
       if (gifFrame == 0)
-        renderFrame(frame, m_nextImage);
+        m_nextImage = nextRenderedFrame();
       else
         std::swap(m_previousImage, m_currentImage);
 
       // Render next frame
       std::swap(m_currentImage, m_nextImage);
       if (gifFrame+1 < nframes)
-        renderFrame(*frame_it, m_nextImage);
+        m_nextImage = nextRenderedFrame();
+
+      diffs.push_back(
+        runTask<FrameDiff>(pool.get(),
+                           [this, gifFrame,
+                            previous=m_previousImage,
+                            current=m_currentImage,
+                            next=m_nextImage]{
+                             return calculateFrameDiff(gifFrame,
+                                                       previous.get(),
+                                                       current,
+                                                       next.get());
+                           }));
+    };
 
-      gfx::Rect frameBounds = m_spriteBounds;
-      DisposalMethod disposal = DisposalMethod::DO_NOT_DISPOSE;
+    for (gifframe_t gifFrame=0; gifFrame<nframes; ++gifFrame) {
+      const frame_t frame = frames[gifFrame];
 
-      // Creation of the deltaImage (difference image result respect
-      // to current VS previous frame image).  At the same time we
-      // must scan the next image, to check if some pixel turns to
-      // transparent (0), if the case, we need to force disposal
-      // method of the current image to RESTORE_BG.  Further, at the
-      // same time, we must check if we can go without color zero (0).
+      while (nextDiff < nframes &&
+             (diffs.empty() || int(diffs.size()) < maxPending))
+        queueNextFrameDiff();
 
-      calculateDeltaImageFrameBoundsDisposal(gifFrame, frameBounds, disposal);
+      FrameDiff diff = diffs.front().get();
+      diffs.pop_front();
 
-      writeImage(gifFrame, frame, frameBounds, disposal,
-                 // Only the last frame in the animation needs the fix
-                 (fix_last_frame_duration && gifFrame == nframes-1));
+      gfx::Rect frameBounds = m_spriteBounds;
+      DisposalMethod disposal = DisposalMethod::DO_NOT_DISPOSE;
 
-      m_fop->setProgress(double(gifFrame+1) / double(nframes));
+      // Creation of the deltaImage (difference image result respect
+      // to current VS previous frame image) from the frame diff, and
+      // selection of the disposal method of the current frame.
+      calculateDeltaImageFrameBoundsDisposal(gifFrame, diff, frameBounds, disposal);
+
+      // Only the last frame in the animation needs the fix
+      const bool fixDuration = (fix_last_frame_duration && gifFrame == nframes-1);
+
+      quantized.push_back(
+        runTask<QuantizedFramePtr>(pool.get(),
+                                   [this, gifFrame, frame, frameBounds, disposal, fixDuration,
+                                    deltaImage=m_deltaImage]{
+                                     return quantizeFrame(gifFrame, frame, frameBounds,
+                                                          disposal, fixDuration,
+                                                          deltaImage.get());
+                                   }));
+
+      while (!quantized.empty() &&
+             (int(quantized.size()) > maxPending || gifFrame == nframes-1)) {
+        const QuantizedFramePtr qf = quantized.front().get();
+        quantized.pop_front();
+
+        writeImage(*qf);
+        m_fop->setProgress(double(qf->gifFrame+1) / double(nframes));
+      }
     }
     return true;
   }
 
 private:
 
+  // Compares the current frame with the previous and next ones to
+  // find the pixels that must be painted in this frame: pixels that
+  // changed from the previous frame, or pixels that will be
+  // transparent in the next frame (as they must be restored with
+  // RESTORE_BGCOLOR). It's called from worker threads, and doesn't
+  // depend on the disposal method of the previous frame.
+  FrameDiff calculateFrameDiff(const gifframe_t gifFrame,
+                               const Image* previous,
+                               const ImageRef& current,
+                               const Image* next) const {
+    FrameDiff diff;
+    diff.currentImage = current;
+
+    // With an indexed image (palette order preserved) we always
+    // restore the whole frame.
+    if (m_preservePaletteOrder)
+      return diff;
+
+    const int w = m_spriteBounds.w;
+    const int h = m_spriteBounds.h;
+
+    // "Pixel clearing" detection for the first frame (frame 0): the
+    // first frame is good to force to disposal = DO_NOT_DISPOSE, but
+    // when the next frame (frame 1) has a "pixel clearing", we must
+    // change disposal to RESTORE_BGCOLOR.
+    if (gifFrame == 0) {
+      if (!m_hasBackground) {
+        for (int y=0; y<h && !diff.pixelClearing; ++y) {
+          auto curRow = (RgbTraits::const_address_t)current->getPixelAddress(0, y);
+          auto nextRow = (RgbTraits::const_address_t)next->getPixelAddress(0, y);
+          for (int x=0; x<w; ++x) {
+            if (rgba_geta(curRow[x]) != 0 && rgba_geta(nextRow[x]) == 0) {
+              diff.pixelClearing = true;
+              break;
+            }
+          }
+        }
+      }
+      return diff;
+    }
+
+    // A pixel must be painted if it's an opaque pixel that changed,
+    // or if it will be cleared in the next frame.
+    auto isChanged = [](const color_t prev, const color_t cur, const color_t next) {
+      return ((rgba_geta(cur) != 0 && prev != cur) || rgba_geta(next) == 0);
+    };
+
+    // Find the changed pixels bounds scanning each row from both
+    // sides (the unchanged pixels in the middle of a changed row are
+    // only visited to detect a "pixel clearing" once).
+    int x1 = w, y1 = h, x2 = -1, y2 = -1;
+    for (int y=0; y<h; ++y) {
+      auto prevRow = (RgbTraits::const_address_t)previous->getPixelAddress(0, y);
+      auto curRow = (RgbTraits::const_address_t)current->getPixelAddress(0, y);
+      auto nextRow = (RgbTraits::const_address_t)next->getPixelAddress(0, y);
+
+      int u = 0;
+      while (u < w && !isChanged(prevRow[u], curRow[u], nextRow[u]))
+        ++u;
+      if (u == w)
+        continue;
+
+      int v = w-1;
+      while (v > u && !isChanged(prevRow[v], curRow[v], nextRow[v]))
+        --v;
+
+      x1 = std::min(x1, u);
+      x2 = std::max(x2, v);
+      if (y1 == h)
+        y1 = y;
+      y2 = y;
+
+      // A "pixel clearing" is the only way to change the disposal
+      // mode to RESTORE_BGCOLOR.
+      if (!diff.pixelClearing) {
+        for (int x=u; x<=v; ++x) {
+          if (rgba_geta(curRow[x]) != 0 && rgba_geta(nextRow[x]) == 0) {
+            diff.pixelClearing = true;
+            break;
+          }
+        }
+      }
+    }
+
+    if (x2 < x1)
+      return diff;
+
+    // Copy the changed pixels, the unchanged ones are transparent
+    // (mask color = 0).
+    diff.changedBounds = gfx::Rect(x1, y1, x2-x1+1, y2-y1+1);
+    diff.deltaImage.reset(Image::create(IMAGE_RGB,
+                                        diff.changedBounds.w,
+                                        diff.changedBounds.h));
+    for (int y=0; y<diff.changedBounds.h; ++y) {
+      auto prevRow = (RgbTraits::const_address_t)previous->getPixelAddress(x1, y1+y);
+      auto curRow = (RgbTraits::const_address_t)current->getPixelAddress(x1, y1+y);
+      auto nextRow = (RgbTraits::const_address_t)next->getPixelAddress(x1, y1+y);
+      auto deltaRow = (RgbTraits::address_t)diff.deltaImage->getPixelAddress(0, y);
+      for (int x=0; x<diff.changedBounds.w; ++x) {
+        const color_t c = curRow[x];
+        deltaRow[x] = (isChanged(prevRow[x], c, nextRow[x]) &&
+                       rgba_geta(c) != 0 ? c: 0);
+      }
+    }
+    return diff;
+  }
+
   void calculateDeltaImageFrameBoundsDisposal(gifframe_t gifFrame,
+                                              const FrameDiff& diff,
                                               gfx::Rect& frameBounds,
                                               DisposalMethod& disposal) {
+    const Image* currentImage = diff.currentImage.get();
+
     if (gifFrame == 0) {
-      m_deltaImage.reset(Image::createCopy(m_currentImage));
+      m_deltaImage = diff.currentImage;
       frameBounds = m_spriteBounds;
 
-      // The first frame (frame 0) is good to force to disposal = DO_NOT_DISPOSE,
-      // but when the next frame (frame 1) has a "pixel clearing",
-      // we must change disposal to RESTORE_BGCOLOR.
-
-      // "Pixel clearing" detection:
       if (!m_hasBackground && !m_preservePaletteOrder) {
-        const LockImageBits<RgbTraits> bits2(m_currentImage);
-        const LockImageBits<RgbTraits> bits3(m_nextImage);
-        typename LockImageBits<RgbTraits>::const_iterator it2, it3, end2, end3;
-        for (it2 = bits2.begin(), end2 = bits2.end(),
-             it3 = bits3.begin(), end3 = bits3.end();
-              it2 != end2 && it3 != end3; ++it2, ++it3) {
-          if (rgba_geta(*it2) != 0 && rgba_geta(*it3) == 0) {
-            disposal = DisposalMethod::RESTORE_BGCOLOR;
-            break;
-          }
-        }
+        if (diff.pixelClearing)
+          disposal = DisposalMethod::RESTORE_BGCOLOR;
       }
       else if (m_preservePaletteOrder)
         disposal = DisposalMethod::RESTORE_BGCOLOR;
     }
     else {
-      int x1 = 0;
-      int y1 = 0;
-      int x2 = 0;
-      int y2 = 0;
-
       if (!m_preservePaletteOrder) {
         // When m_lastDisposal was RESTORE_BGBOLOR it implies
         // we will have to cover with colors the entire previous frameBounds plus
         // the current frameBounds due to color changes, so we must start with
         // a frameBounds equal to the previous frame iteration (saved in m_lastFrameBounds).
-        // Then we must cover all the resultant frameBounds with full color
-        // in m_currentImage, the output image will be saved in deltaImage.
-        if (m_lastDisposal == DisposalMethod::RESTORE_BGCOLOR) {
-          x1 = m_lastFrameBounds.x;
-          y1 = m_lastFrameBounds.y;
-          x2 = m_lastFrameBounds.x + m_lastFrameBounds.w - 1;
-          y2 = m_lastFrameBounds.y + m_lastFrameBounds.h - 1;
-        }
-        else {
-          x1 = m_spriteBounds.w - 1;
-          y1 = m_spriteBounds.h - 1;
-        }
-
-        int i = 0;
-        int x, y;
-        const LockImageBits<RgbTraits> bits1(m_previousImage);
-        LockImageBits<RgbTraits> bits2(m_currentImage);
-        const LockImageBits<RgbTraits> bits3(m_nextImage);
-        m_deltaImage.reset(Image::create(PixelFormat::IMAGE_RGB, m_spriteBounds.w, m_spriteBounds.h));
-        clear_image(m_deltaImage.get(), 0);
-        LockImageBits<RgbTraits> deltaBits(m_deltaImage.get());
-        typename LockImageBits<RgbTraits>::iterator deltaIt;
-        typename LockImageBits<RgbTraits>::iterator it2, end2;
-        typename LockImageBits<RgbTraits>::const_iterator it1, it3, end1, deltaEnd;
-
-        bool previousImageMatchsCurrent = true;
-        for (it1 = bits1.begin(), end1 = bits1.end(),
-             it2 = bits2.begin(), end2 = bits2.end(),
-             it3 = bits3.begin(),
-             deltaIt = deltaBits.begin();
-             it1 != end1 && it2 != end2; ++it1, ++it2, ++it3, ++deltaIt, ++i) {
-          x = i % m_spriteBounds.w;
-          y = i / m_spriteBounds.w;
-          // While we are checking color differences,
-          // we enlarge the frameBounds where the color differences take place
-          if ((rgba_geta(*it2) != 0 && *it1 != *it2) || rgba_geta(*it3) == 0) {
-            previousImageMatchsCurrent = false;
-            *it2 = (rgba_geta(*it2) ? *it2 : 0);
-            *deltaIt = *it2;
-            if (x < x1) x1 = x;
-            if (x > x2) x2 = x;
-            if (y < y1) y1 = y;
-            if (y > y2) y2 = y;
-          }
-
-          // We need to change disposal mode DO_NOT_DISPOSE to RESTORE_BGCOLOR only
-          // if we found a "pixel clearing" in the next Image. RESTORE_BGCOLOR is
-          // our way to clear pixels.
-          if (rgba_geta(*it2) != 0 && rgba_geta(*it3) == 0) {
-            disposal = DisposalMethod::RESTORE_BGCOLOR;
-          }
-        }
-        if (previousImageMatchsCurrent)
-          frameBounds = gfx::Rect(m_lastFrameBounds);
+        if (diff.changedBounds.isEmpty())
+          frameBounds = m_lastFrameBounds;
+        else if (m_lastDisposal == DisposalMethod::RESTORE_BGCOLOR)
+          frameBounds = m_lastFrameBounds.createUnion(diff.changedBounds);
         else
-          frameBounds = gfx::Rect(x1, y1, x2-x1+1, y2-y1+1);
+          frameBounds = diff.changedBounds;
+
+        // We need to change disposal mode DO_NOT_DISPOSE to RESTORE_BGCOLOR only
+        // if we found a "pixel clearing" in the next Image. RESTORE_BGCOLOR is
+        // our way to clear pixels.
+        if (diff.pixelClearing)
+          disposal = DisposalMethod::RESTORE_BGCOLOR;
       }
       else
         disposal = DisposalMethod::RESTORE_BGCOLOR;
 
       // We need to conditionate the deltaImage to the next step: 'writeImage()'
       // To do it, we need to crop deltaImage in frameBounds.
-      // If disposal method changed to RESTORE_BGCOLOR deltaImage we need to reproduce ALL the colors of m_currentImage
+      // If disposal method changed to RESTORE_BGCOLOR deltaImage we need to reproduce ALL the colors of the current image
       // contained in frameBounds (so, we will overwrite delta image with a cropped current image).
-      // In the other hand, if disposal is still DO_NOT_DISPOSAL, delta image will be a cropped image
-      // from itself in frameBounds.
+      // In the other hand, if disposal is still DO_NOT_DISPOSAL, delta image will be the changed pixels
+      // (already cropped in frameBounds), or a transparent image if nothing changed.
       if (disposal == DisposalMethod::RESTORE_BGCOLOR || m_lastDisposal == DisposalMethod::RESTORE_BGCOLOR) {
-        m_deltaImage.reset(crop_image(m_currentImage, frameBounds, 0));
+        m_deltaImage.reset(crop_image(currentImage, frameBounds, 0));
       }
       else {
-        m_deltaImage.reset(crop_image(m_deltaImage.get(), frameBounds, 0));
+        if (diff.deltaImage) {
+          ASSERT(frameBounds == diff.changedBounds);
+          m_deltaImage = diff.deltaImage;
+        }
+        else {
+          m_deltaImage.reset(Image::create(IMAGE_RGB, frameBounds.w, frameBounds.h));
+          clear_image(m_deltaImage.get(), 0);
+        }
         disposal = DisposalMethod::DO_NOT_DISPOSE;
       }
       m_lastFrameBounds = frameBounds;
@@ -1326,12 +1498,11 @@ private:
   // Writes graphics extension record (to save the duration of the
   // frame and maybe the transparency index).
   void writeExtension(const gifframe_t gifFrame,
-                      const frame_t frame,
                       const int transparentIndex,
                       const DisposalMethod disposalMethod,
                       const bool fixDuration) {
     unsigned char extension_bytes[5];
-    int frameDelay = m_img->frameDuration(frame) / 10;
+    int frameDelay = m_frameDurations[gifFrame] / 10;
 
     // Fix duration for Twitter. It looks like the last frame must be
     // 1/4 of its duration for some strange reason in the Twitter
@@ -1366,35 +1537,46 @@ private:
   }
 
 
-  void writeImage(const gifframe_t gifFrame,
-                  const frame_t frame,
-                  const gfx::Rect& frameBounds,
-                  const DisposalMethod disposal,
-                  const bool fixDuration) {
+  // Converts the delta image of the frame to an indexed image (with
+  // the global palette or a new palette for this frame). This is
+  // called from worker threads, so it cannot modify the encoder
+  // state or use the GIF file.
+  QuantizedFramePtr quantizeFrame(const gifframe_t gifFrame,
+                                  const frame_t frame,
+                                  const gfx::Rect& frameBounds,
+                                  const DisposalMethod disposal,
+                                  const bool fixDuration,
+                                  const Image* deltaImage) const {
+    auto qf = std::make_unique<QuantizedFrame>();
+    qf->gifFrame = gifFrame;
+    qf->frame = frame;
+    qf->frameBounds = frameBounds;
+    qf->disposal = disposal;
+    qf->fixDuration = fixDuration;
+
+    int transparentIndex = m_transparentIndex;
     Palette framePalette;
     if (m_globalColormap)
       framePalette = m_globalColormapPalette;
     else
-      framePalette = calculatePalette();
+      framePalette = calculatePalette(deltaImage, transparentIndex);
 
     OctreeMap octree;
-    octree.regenerateMap(&framePalette, m_transparentIndex);
+    octree.regenerateMap(&framePalette, transparentIndex);
     ImageRef frameImage(Image::create(IMAGE_INDEXED,
                                       frameBounds.w,
-                                      frameBounds.h,
-                                      m_frameImageBuf));
+                                      frameBounds.h));
 
     // Every frame might use a small portion of the global palette,
     // to optimize the gif file size, we will analize which colors
     // will be used in each processed frame.
     PalettePicks usedColors(framePalette.size());
 
-    int localTransparent = m_transparentIndex;
-    ColorMapObject* colormap = m_globalColormap;
-    Remap remap(256);
+    int localTransparent = transparentIndex;
+    Remap& remap = qf->remap;
 
     if (!m_preservePaletteOrder) {
-      const LockImageBits<RgbTraits> srcBits(m_deltaImage.get());
+      const LockImageBits<RgbTraits> srcBits(deltaImage);
       LockImageBits<IndexedTraits> dstBits(frameImage.get());
 
       auto srcIt = srcBits.begin();
@@ -1414,13 +1596,13 @@ private:
               rgba_getg(color),
               rgba_getb(color),
               255,
-              m_transparentIndex);
+              transparentIndex);
             if (i < 0)
               i = octree.mapColor(color | rgba_a_mask); // alpha=255
           }
           else {
-            if (m_transparentIndex >= 0)
-              i = m_transparentIndex;
+            if (transparentIndex >= 0)
+              i = transparentIndex;
             else
               i = m_bgIndex;
           }
@@ -1443,7 +1625,7 @@ private:
       for (int i=0; i<remap.size(); ++i)
         remap.map(i, i);
 
-      if (!colormap) {
+      if (!m_globalColormap) {
         Palette reducedPalette(0, usedNColors);
 
         for (int i=0, j=0; i<framePalette.size(); ++i) {
@@ -1454,23 +1636,42 @@ private:
           }
         }
 
-        colormap = createColorMap(&reducedPalette);
+        // The colormap is created from this palette when the frame
+        // is written.
+        qf->localPalette = reducedPalette;
         if (localTransparent >= 0)
           localTransparent = remap[localTransparent];
       }
 
-      if (localTransparent >= 0 && m_transparentIndex != localTransparent)
-        remap.map(m_transparentIndex, localTransparent);
+      if (localTransparent >= 0 && transparentIndex != localTransparent)
+        remap.map(transparentIndex, localTransparent);
     }
     else {
-      frameImage.reset(Image::createCopy(m_deltaImage.get()));
-      for (int i=0; i<colormap->ColorCount; ++i)
+      frameImage.reset(Image::createCopy(deltaImage));
+      for (int i=0; i<m_globalColormap->ColorCount; ++i)
         remap.map(i, i);
     }
 
+    qf->frameImage = frameImage;
+    qf->localTransparent = localTransparent;
+    return qf;
+  }
+
+  // Writes the quantized frame in the GIF file. Frames must be
+  // written in order.
+  void writeImage(const QuantizedFrame& qf) {
+    const gifframe_t gifFrame = qf.gifFrame;
+    const gfx::Rect& frameBounds = qf.frameBounds;
+    const Image* frameImage = qf.frameImage.get();
+    const Remap& remap = qf.remap;
+
+    ColorMapObject* colormap = m_globalColormap;
+    if (!colormap)
+      colormap = createColorMap(&qf.localPalette);
+
     // Write extension record.
-    writeExtension(gifFrame, frame, localTransparent,
-                   disposal, fixDuration);
+    writeExtension(gifFrame, qf.localTransparent,
+                   qf.disposal, qf.fixDuration);
 
     // Write the image record.
     if (EGifPutImageDesc(m_gifFile,
@@ -1488,8 +1689,8 @@ private:
       // Need to perform 4 passes on the images.
       for (int i=0; i<4; ++i)
         for (int y=interlaced_offset[i]; y<frameBounds.h; y+=interlaced_jumps[i]) {
-          IndexedTraits::address_t addr =
-            (IndexedTraits::address_t)frameImage->getPixelAddress(0, y);
+          IndexedTraits::const_address_t addr =
+            (IndexedTraits::const_address_t)frameImage->getPixelAddress(0, y);
 
           for (int i=0; i<frameBounds.w; ++i, ++addr)
             scanline[i] = remap[*addr];
@@ -1501,8 +1702,8 @@ private:
     else {
       // Write all image scanlines (not interlaced in this case).
       for (int y=0; y<frameBounds.h; ++y) {
-        IndexedTraits::address_t addr =
-          (IndexedTraits::address_t)frameImage->getPixelAddress(0, y);
+        IndexedTraits::const_address_t addr =
+          (IndexedTraits::const_address_t)frameImage->getPixelAddress(0, y);
 
         for (int i=0; i<frameBounds.w; ++i, ++addr)
           scanline[i] = remap[*addr];
@@ -1516,9 +1717,10 @@ private:
       GifFreeMapObject(colormap);
   }
 
-  Palette calculatePalette() {
+  static Palette calculatePalette(const Image* deltaImage,
+                                  int& transparentIndex) {
     OctreeMap octree;
-    const LockImageBits<RgbTraits> imageBits(m_deltaImage.get());
+    const LockImageBits<RgbTraits> imageBits(deltaImage);
     auto it = imageBits.begin(), end = imageBits.end();
     bool maskColorFounded = false;
     for (; it != end; ++it) {
@@ -1534,7 +1736,7 @@ private:
       // If there is a mask color, the OctreeMap::makePalette adds it
       // by default at entry == 0.
       octree.makePalette(&palette, 256, 8);
-      m_transparentIndex = 0;
+      transparentIndex = 0;
       return palette;
     }
     else {
@@ -1544,17 +1746,36 @@ private:
       Palette paletteWithoutMask(0, palette.size() - 1);
       for (int i=0; i < paletteWithoutMask.size(); i++)
         paletteWithoutMask.setEntry(i, palette.entry(i+1));
-      m_transparentIndex = -1;
+      transparentIndex = -1;
       return paletteWithoutMask;
     }
   }
 
-  void renderFrame(frame_t frame, Image* dst) {
+  // Renders the given frame in a new image. This is called from
+  // worker threads.
+  ImageRef renderFrame(const frame_t frame) const {
+    ImageRef dst(Image::create((m_preservePaletteOrder)? IMAGE_INDEXED : IMAGE_RGB,
+                               m_spriteBounds.w,
+                               m_spriteBounds.h));
     if (m_preservePaletteOrder)
-      clear_image(dst, m_bgIndex);
+      clear_image(dst.get(), m_bgIndex);
+    else
+      clear_image(dst.get(), 0);
+    m_img->renderFrame(frame, m_fop->roi().frameBounds(frame), dst.get());
+    return dst;
+  }
+
+  // Runs the given function in the thread pool (or in this same
+  // thread if there is no pool).
+  template<typename T, typename Func>
+  static std::future<T> runTask(base::thread_pool* pool, Func&& func) {
+    auto task = std::make_shared<std::packaged_task<T()>>(std::forward<Func>(func));
+    std::future<T> future = task->get_future();
+    if (pool)
+      pool->execute([task]{ (*task)(); });
     else
-      clear_image(dst, 0);
-    m_img->renderFrame(frame, m_fop->roi().frameBounds(frame), dst);
+      (*task)();
+    return future;
   }
 
 private:
@@ -1602,12 +1823,12 @@ private:
   bool m_preservePaletteOrder;
   gfx::Rect m_lastFrameBounds;
   DisposalMethod m_lastDisposal;
-  ImageBufferPtr m_frameImageBuf;
-  ImageRef m_images[3];
-  Image* m_previousImage;
-  Image* m_currentImage;
-  Image* m_nextImage;
-  std::unique_ptr<Image> m_deltaImage;
+  ImageRef m_previousImage;
+  ImageRef m_currentImage;
+  ImageRef m_nextImage;
+  ImageRef m_deltaImage;
+  // Duration of each GIF frame (in milliseconds)
+  std::vector<int> m_frameDurations;
 };
 
 bool GifFormat::onSave(FileOp* fop)
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -174,6 +174,21 @@ bool JpegFormat::onLoad(FileOp* fop)
   else
     dinfo.out_color_space = JCS_RGB;
 
+  // Use the DCT scaling of libjpeg to decode a downscaled image
+  // (1/2, 1/4, or 1/8) when the caller doesn't need the full image
+  // (e.g. thumbnails), which is several times faster.
+  const gfx::Size minSize = fop->loadMinSize();
+  if (!minSize.isEmpty()) {
+    unsigned int denom = 1;
+    while (denom < 8 &&
+           (dinfo.image_width + 2*denom - 1) / (2*denom) >= unsigned(minSize.w) &&
+           (dinfo.image_height + 2*denom - 1) / (2*denom) >= unsigned(minSize.h)) {
+      denom *= 2;
+    }
+    dinfo.scale_num = 1;
+    dinfo.scale_denom = denom;
+  }
+
   // Start decompressor.
   jpeg_start_decompress(&dinfo);
 
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -14,8 +14,10 @@
 #include "app/file/file.h"
 #include "app/file/file_format.h"
 #include "app/file/file_formats_manager.h"
+#include "app/file/palette_file.h"
 #include "base/fs.h"
 #include "base/string.h"
+#include "base/time.h"
 #include "dio/detect_format.h"
 #include "doc/cel.h"
 #include "doc/file/act_file.h"
@@ -28,7 +30,10 @@
 #include "doc/palette.h"
 #include "doc/sprite.h"
 
+#include <algorithm>
 #include <cstring>
+#include <map>
+#include <mutex>
 
 namespace app {
 
@@ -36,6 +41,78 @@ using namespace doc;
 
 static const char* palExts[] = { "act", "col", "gpl", "hex", "pal" };
 
+namespace {
+
+// Palettes already parsed (by filename), used to avoid parsing the
+// same files again and again (e.g. when the palette popup or
+// extensions load the same palettes). An entry is valid while the
+// file has the same modification time and size.
+struct CachedPalette {
+  base::Time mtime;
+  std::size_t size;
+  std::shared_ptr<const Palette> palette;
+  uint64_t lastUse;
+};
+
+const std::size_t kMaxCachedPalettes = 256;
+
+std::mutex g_cacheMutex;
+std::map<std::string, CachedPalette> g_cache;
+uint64_t g_cacheTick = 0;
+
+std::unique_ptr<Palette> get_cached_palette(const std::string& filename,
+                                            const base::Time& mtime,
+                                            const std::size_t size)
+{
+  const std::lock_guard lock(g_cacheMutex);
+  auto it = g_cache.find(filename);
+  if (it == g_cache.end())
+    return nullptr;
+
+  CachedPalette& cached = it->second;
+  if (!(cached.mtime == mtime) || cached.size != size) {
+    g_cache.erase(it);
+    return nullptr;
+  }
+
+  cached.lastUse = ++g_cacheTick;
+  return std::make_unique<Palette>(*cached.palette);
+}
+
+void add_cached_palette(const std::string& filename,
+                        const base::Time& mtime,
+                        const std::size_t size,
+                        const Palette& palette)
+{
+  const std::lock_guard lock(g_cacheMutex);
+
+  // Remove the least recently used palette
+  if (g_cache.size() >= kMaxCachedPalettes &&
+      g_cache.find(filename) == g_cache.end()) {
+    auto lru = std::min_element(
+      g_cache.begin(), g_cache.end(),
+      [](const auto& a, const auto& b){
+        return a.second.lastUse < b.second.lastUse;
+      });
+    g_cache.erase(lru);
+  }
+
+  g_cache[filename] = CachedPalette{
+    mtime, size, std::make_shared<Palette>(palette), ++g_cacheTick };
+}
+
+void remove_cached_palette(const std::string& filename)
+{
+  const std::lock_guard lock(g_cacheMutex);
+  g_cache.erase(filename);
+}
+
+std::unique_ptr<doc::Palette> load_palette_file(
+  const char* filename,
+  const FileOpConfig* config);
+
+} // anonymous namespace
+
 base::paths get_readable_palette_extensions()
 {
   base::paths paths = get_readable_extensions();
@@ -55,6 +132,33 @@ base::paths get_writable_palette_extensions()
 std::unique_ptr<doc::Palette> load_palette(
   const char* filename,
   const FileOpConfig* config)
+{
+  const std::string fn = filename;
+  if (!base::is_file(fn))
+    return load_palette_file(filename, config);
+
+  const base::Time mtime = base::get_modification_time(fn);
+  const std::size_t size = base::file_size(fn);
+  if (auto pal = get_cached_palette(fn, mtime, size))
+    return pal;
+
+  auto pal = load_palette_file(filename, config);
+  if (pal)
+    add_cached_palette(fn, mtime, size, *pal);
+  return pal;
+}
+
+void clear_palette_cache()
+{
+  const std::lock_guard lock(g_cacheMutex);
+  g_cache.clear();
+}
+
+namespace {
+
+std::unique_ptr<doc::Palette> load_palette_file(
+  const char* filename,
+  const FileOpConfig* config)
 {
   dio::FileFormat dioFormat = dio::detect_format(filename);
   std::unique_ptr<Palette> pal = nullptr;
@@ -118,12 +222,18 @@ std::unique_ptr<doc::Palette> load_palette(
   return pal;
 }
 
+} // anonymous namespace
+
 bool save_palette(const char* filename, const Palette* pal, int columns,
                   const gfx::ColorSpaceRef& cs)
 {
   dio::FileFormat dioFormat = dio::detect_format_by_file_extension(filename);
   bool success = false;
 
+  // The file will be replaced (its modification time could be the
+  // same if it's saved in the same second)
+  remove_cached_palette(filename);
+
   switch (dioFormat) {
 
     case dio::FileFormat::ACT_PALETTE:
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -24,9 +24,14 @@ namespace app {
   base::paths get_readable_palette_extensions();
   base::paths get_writable_palette_extensions();
 
+  // Loaded palettes are cached (by filename, modification time and
+  // file size), so loading the same unmodified file again returns a
+  // copy of the already parsed palette.
   std::unique_ptr<doc::Palette> load_palette(
     const char *filename,
     const FileOpConfig* config = nullptr);
+  void clear_palette_cache();
+
   bool save_palette(const char *filename,
                     const doc::Palette* pal,
                     int columns,
@@ -0,0 +1,60 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+#include "app/file/palette_file.h"
+#include "base/fs.h"
+#include "doc/palette.h"
+
+#include <cstdio>
+#include <fstream>
+
+using namespace app;
+using namespace doc;
+
+static void write_gpl(const char* fn, const char* entries)
+{
+  std::ofstream f(fn);
+  f << "GIMP Palette\n"
+    << "# Comment\n"
+    << entries;
+}
+
+TEST(PaletteFile, LoadGpl)
+{
+  const char* fn = "_test_palette.gpl";
+  clear_palette_cache();
+  write_gpl(fn,
+            "  0   0   0 Black\n"
+            "255 128  64 Orange Color\n"
+            "bad line\n");
+
+  std::unique_ptr<Palette> pal = load_palette(fn);
+  ASSERT_TRUE(pal != nullptr);
+  ASSERT_EQ(2, pal->size());
+  EXPECT_EQ(rgba(0, 0, 0, 255), pal->getEntry(0));
+  EXPECT_EQ(rgba(255, 128, 64, 255), pal->getEntry(1));
+  EXPECT_EQ("Black", pal->getEntryName(0));
+  EXPECT_EQ("Orange", pal->getEntryName(1));
+
+  // Load from the cache
+  std::unique_ptr<Palette> pal2 = load_palette(fn);
+  ASSERT_TRUE(pal2 != nullptr);
+  EXPECT_EQ(0, pal->countDiff(pal2.get(), nullptr, nullptr));
+
+  // A saved palette replaces the cached one
+  pal2->addEntry(rgba(1, 2, 3, 255));
+  pal2->setEntryName(2, "New");
+  ASSERT_TRUE(save_palette(fn, pal2.get(), 0, nullptr));
+
+  std::unique_ptr<Palette> pal3 = load_palette(fn);
+  ASSERT_TRUE(pal3 != nullptr);
+  ASSERT_EQ(3, pal3->size());
+  EXPECT_EQ(rgba(1, 2, 3, 255), pal3->getEntry(2));
+
+  base::delete_file(fn);
+}
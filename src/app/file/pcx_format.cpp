@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -18,6 +18,9 @@
 #include "base/file_handle.h"
 #include "doc/doc.h"
 
+#include <algorithm>
+#include <vector>
+
 namespace app {
 
 using namespace base;
@@ -64,9 +67,7 @@ bool PcxFormat::onLoad(FileOp* fop)
   int c, r, g, b;
   int width, height;
   int bpp, bytes_per_line;
-  int xx, po;
   int x, y;
-  char ch = 0;
 
   FileHandle handle(open_file_with_exception(fop->filename(), "rb"));
   FILE* f = handle.get();
@@ -117,46 +118,54 @@ bool PcxFormat::onLoad(FileOp* fop)
   if (bpp == 24)
     clear_image(image.get(), rgba(0, 0, 0, 255));
 
-  for (y=0; y<height; y++) {       /* read RLE encoded PCX data */
-    x = xx = 0;
-    po = rgba_r_shift;
+  // Read all the RLE encoded data (and the 256 color palette at the
+  // end of the file) at once
+  std::vector<uint8_t> data;
+  {
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+      data.insert(data.end(), buf, buf+n);
+  }
+  const uint8_t* src = data.data();
+  const uint8_t* const srcEnd = src + data.size();
+  auto read_byte = [&src, srcEnd]() -> uint8_t {
+    return (src < srcEnd ? *(src++): 0);
+  };
 
-    while (x < bytes_per_line*bpp/8) {
-      ch = fgetc(f);
+  // Decoded scanline with all color planes
+  const int scanlineBytes = bytes_per_line*bpp/8;
+  std::vector<uint8_t> scanline(std::max(0, scanlineBytes));
+  const int w = std::min(image->width(), bytes_per_line);
+
+  for (y=0; y<height; y++) {       /* read RLE encoded PCX data */
+    x = 0;
+    while (x < scanlineBytes) {
+      uint8_t ch = read_byte();
       if ((ch & 0xC0) == 0xC0) {
         c = (ch & 0x3F);
-        ch = fgetc(f);
+        ch = read_byte();
       }
       else
         c = 1;
 
-      if (bpp == 8) {
-        while (c--) {
-          if (x < image->width())
-            put_pixel_fast<IndexedTraits>(image.get(), x, y, ch);
+      // The rest of a run that crosses the end of the scanline is
+      // discarded
+      for (; c > 0 && x < scanlineBytes; --c)
+        scanline[x++] = ch;
+    }
 
-          x++;
-        }
-      }
-      else {
-        while (c--) {
-          if (xx < image->width())
-            put_pixel_fast<RgbTraits>(image.get(), xx, y,
-                                      get_pixel_fast<RgbTraits>(image.get(), xx, y) | ((ch & 0xff) << po));
-
-          x++;
-          if (x == bytes_per_line) {
-            xx = 0;
-            po = rgba_g_shift;
-          }
-          else if (x == bytes_per_line*2) {
-            xx = 0;
-            po = rgba_b_shift;
-          }
-          else
-            xx++;
-        }
-      }
+    if (bpp == 8) {
+      std::copy(scanline.begin(), scanline.begin()+w,
+                image->getPixelAddress(0, y));
+    }
+    else {
+      const uint8_t* rPlane = scanline.data();
+      const uint8_t* gPlane = rPlane + bytes_per_line;
+      const uint8_t* bPlane = gPlane + bytes_per_line;
+      auto dst = (uint32_t*)image->getPixelAddress(0, y);
+      for (x=0; x<w; ++x)
+        dst[x] = rgba(rPlane[x], gPlane[x], bPlane[x], 255);
     }
 
     fop->setProgress((float)(y+1) / (float)(height));
@@ -166,12 +175,12 @@ bool PcxFormat::onLoad(FileOp* fop)
 
   if (!fop->isStop()) {
     if (bpp == 8) {                  /* look for a 256 color palette */
-      while ((c = fgetc(f)) != EOF) {
-        if (c == 12) {
+      while (src < srcEnd) {
+        if (read_byte() == 12) {
           for (c=0; c<256; c++) {
-            r = fgetc(f);
-            g = fgetc(f);
-            b = fgetc(f);
+            r = read_byte();
+            g = read_byte();
+            b = read_byte();
             fop->sequenceSetColor(c, r, g, b);
           }
           break;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -16,14 +16,24 @@
 #include "app/file/format_options.h"
 #include "app/file/png_format.h"
 #include "app/file/png_options.h"
+#include "app/perf_counters.h"
 #include "base/file_handle.h"
+#include "base/thread_pool.h"
 #include "doc/doc.h"
 #include "gfx/color_space.h"
 
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <future>
+#include <limits>
 #include <stdio.h>
 #include <stdlib.h>
+#include <thread>
+#include <vector>
 
 #include "png.h"
+#include "zlib.h"
 
 #define PNG_TRACE(...) // TRACE
 
@@ -523,6 +533,257 @@ gfx::ColorSpaceRef PngFormat::loadColorSpace(png_structp png_ptr, png_infop info
 
 #ifdef ENABLE_SAVE
 
+namespace {
+
+// Minimum size of the image data (uncompressed rows) to encode it in
+// worker threads.
+const size_t kMinParallelEncodingSize = 2*1024*1024;
+
+// Approximated size of uncompressed rows per chunk compressed by each
+// worker thread.
+const size_t kParallelChunkSize = 1024*1024;
+
+using FillPngRow = std::function<void(png_uint_32 y, uint8_t* dst)>;
+
+struct PngDataChunk {
+  std::vector<uint8_t> data;
+  uLong adler;
+  size_t filteredSize;
+  png_uint_32 endRow;
+  bool ok;
+};
+
+int paeth_predictor(int a, int b, int c)
+{
+  const int p = a + b - c;
+  const int pa = std::abs(p - a);
+  const int pb = std::abs(p - b);
+  const int pc = std::abs(p - c);
+  if (pa <= pb && pa <= pc)
+    return a;
+  else if (pb <= pc)
+    return b;
+  else
+    return c;
+}
+
+// Filters one row (all filter types are tested and we select the
+// one with the minimum sum of absolute differences, as the libpng
+// heuristic does).
+void filter_png_row(const uint8_t* prev, const uint8_t* row,
+                    const size_t rowbytes, const int bpp,
+                    std::vector<uint8_t> filtered[5],
+                    std::vector<uint8_t>& dst)
+{
+  size_t bestSum = std::numeric_limits<size_t>::max();
+  int best = PNG_FILTER_VALUE_NONE;
+
+  for (int f=PNG_FILTER_VALUE_NONE; f<PNG_FILTER_VALUE_LAST; ++f) {
+    uint8_t* out = filtered[f].data();
+    size_t sum = 0;
+    for (size_t i=0; i<rowbytes; ++i) {
+      const int a = (i >= size_t(bpp) ? row[i-bpp]: 0);
+      const int b = (prev ? prev[i]: 0);
+      const int c = (prev && i >= size_t(bpp) ? prev[i-bpp]: 0);
+      int v = row[i];
+      switch (f) {
+        case PNG_FILTER_VALUE_SUB: v -= a; break;
+        case PNG_FILTER_VALUE_UP: v -= b; break;
+        case PNG_FILTER_VALUE_AVG: v -= (a + b) / 2; break;
+        case PNG_FILTER_VALUE_PAETH: v -= paeth_predictor(a, b, c); break;
+      }
+      out[i] = uint8_t(v);
+      sum += std::abs(int(int8_t(out[i])));
+    }
+    if (sum < bestSum) {
+      bestSum = sum;
+      best = f;
+    }
+  }
+
+  dst.push_back(uint8_t(best));
+  dst.insert(dst.end(), filtered[best].begin(), filtered[best].begin()+rowbytes);
+}
+
+// Fills, filters, and compresses the given range of rows as a raw
+// deflate stream. Chunks (except the last one) are finished with a
+// Z_SYNC_FLUSH (aligned to a byte boundary and without the final
+// block bit), so all chunks can be concatenated in one zlib stream.
+PngDataChunk compress_png_rows(const png_uint_32 y0,
+                               const png_uint_32 y1,
+                               const bool last,
+                               const size_t rowbytes,
+                               const int bpp,
+                               const bool filterRows,
+                               const int level,
+                               const FillPngRow& fillRow)
+{
+  PngDataChunk chunk;
+  chunk.endRow = y1;
+  chunk.ok = false;
+
+  // The row before y0 is needed to filter the first row
+  std::vector<uint8_t> prev(rowbytes), row(rowbytes);
+  if (filterRows && y0 > 0)
+    fillRow(y0-1, prev.data());
+
+  std::vector<uint8_t> filtered[5];
+  if (filterRows) {
+    for (auto& f : filtered)
+      f.resize(rowbytes);
+  }
+
+  std::vector<uint8_t> input;
+  input.reserve((rowbytes+1) * (y1-y0));
+  for (png_uint_32 y=y0; y<y1; ++y) {
+    fillRow(y, row.data());
+    if (filterRows) {
+      filter_png_row((y > 0 ? prev.data(): nullptr), row.data(),
+                     rowbytes, bpp, filtered, input);
+      std::swap(prev, row);
+    }
+    else {
+      input.push_back(PNG_FILTER_VALUE_NONE);
+      input.insert(input.end(), row.begin(), row.end());
+    }
+  }
+
+  z_stream zstream;
+  zstream.zalloc = (alloc_func)0;
+  zstream.zfree = (free_func)0;
+  zstream.opaque = (voidpf)0;
+  if (deflateInit2(&zstream, level, Z_DEFLATED, -MAX_WBITS, 8,
+                   filterRows ? Z_FILTERED: Z_DEFAULT_STRATEGY) != Z_OK)
+    return chunk;
+
+  PerfCounters::add(PerfCounters::BytesCompressed, input.size());
+
+  chunk.data.resize(deflateBound(&zstream, input.size()) + 16);
+  zstream.next_in = (Bytef*)input.data();
+  zstream.avail_in = (uInt)input.size();
+
+  const int flush = (last ? Z_FINISH: Z_SYNC_FLUSH);
+  int ret;
+  do {
+    if (zstream.total_out == chunk.data.size())
+      chunk.data.resize(2*chunk.data.size());
+    zstream.next_out = (Bytef*)chunk.data.data() + zstream.total_out;
+    zstream.avail_out = (uInt)(chunk.data.size() - zstream.total_out);
+    ret = deflate(&zstream, flush);
+  } while (ret == Z_OK && (zstream.avail_out == 0 || last));
+
+  chunk.ok = (last ? ret == Z_STREAM_END:
+                     ret == Z_OK || ret == Z_BUF_ERROR);
+  chunk.data.resize(zstream.total_out);
+  deflateEnd(&zstream);
+
+  chunk.adler = adler32(adler32(0, nullptr, 0), input.data(), (uInt)input.size());
+  chunk.filteredSize = input.size();
+  return chunk;
+}
+
+bool write_png_chunk(FILE* fp, const char* name,
+                     const uint8_t* data, const size_t size)
+{
+  uint8_t header[8] = {
+    uint8_t(size >> 24), uint8_t(size >> 16), uint8_t(size >> 8), uint8_t(size),
+    uint8_t(name[0]), uint8_t(name[1]), uint8_t(name[2]), uint8_t(name[3]) };
+
+  uLong crc = crc32(0, nullptr, 0);
+  crc = crc32(crc, header+4, 4);
+  if (size > 0)
+    crc = crc32(crc, data, (uInt)size);
+
+  const uint8_t footer[4] = {
+    uint8_t(crc >> 24), uint8_t(crc >> 16), uint8_t(crc >> 8), uint8_t(crc) };
+
+  return (fwrite(header, 1, 8, fp) == 8 &&
+          (size == 0 || fwrite(data, 1, size, fp) == size) &&
+          fwrite(footer, 1, 4, fp) == 4);
+}
+
+// Writes the IDAT chunks of the image compressing chunks of rows in
+// worker threads. The chunks are written in order as soon as they
+// are ready.
+bool write_png_idat_in_parallel(FILE* fp,
+                                FileOp* fop,
+                                const png_uint_32 height,
+                                const size_t rowbytes,
+                                const int bpp,
+                                const bool filterRows,
+                                const int level,
+                                const FillPngRow& fillRow)
+{
+  using Task = std::packaged_task<PngDataChunk()>;
+
+  const int nthreads = std::max(1u, std::thread::hardware_concurrency());
+  const png_uint_32 rowsPerChunk =
+    std::max<png_uint_32>(1, png_uint_32(kParallelChunkSize / (rowbytes+1)));
+
+  base::thread_pool pool(nthreads);
+  std::deque<std::future<PngDataChunk>> pending;
+  png_uint_32 nextRow = 0;
+  uLong adler = adler32(0, nullptr, 0);
+  bool first = true;
+  bool result = true;
+
+  while (nextRow < height || !pending.empty()) {
+    for (; nextRow < height && int(pending.size()) < 2*nthreads; nextRow += rowsPerChunk) {
+      const png_uint_32 y0 = nextRow;
+      const png_uint_32 y1 = std::min(height, y0 + rowsPerChunk);
+      auto task = std::make_shared<Task>(
+        [y0, y1, height, rowbytes, bpp, filterRows, level, &fillRow]{
+          return compress_png_rows(y0, y1, y1 == height, rowbytes, bpp,
+                                   filterRows, level, fillRow);
+        });
+      pending.push_back(task->get_future());
+      pool.execute([task]{ (*task)(); });
+    }
+
+    PngDataChunk chunk = pending.front().get();
+    pending.pop_front();
+    if (!chunk.ok) {
+      fop->setError("Error compressing PNG image data\n");
+      result = false;
+      break;
+    }
+
+    adler = adler32_combine(adler, chunk.adler, chunk.filteredSize);
+
+    if (first) {
+      // zlib header (with the compression level in FLEVEL)
+      const int flevel = (level == Z_BEST_SPEED ? 0:
+                          level == Z_BEST_COMPRESSION ? 3: 2);
+      const uint8_t cmf = 0x78;   // deflate with a 32K window
+      uint8_t flg = (flevel << 6);
+      flg += (31 - ((cmf << 8) + flg) % 31) % 31;
+      chunk.data.insert(chunk.data.begin(), { cmf, flg });
+      first = false;
+    }
+
+    if (nextRow >= height && pending.empty()) {
+      // zlib footer
+      chunk.data.push_back(uint8_t(adler >> 24));
+      chunk.data.push_back(uint8_t(adler >> 16));
+      chunk.data.push_back(uint8_t(adler >> 8));
+      chunk.data.push_back(uint8_t(adler));
+    }
+
+    if (!write_png_chunk(fp, "IDAT", chunk.data.data(), chunk.data.size())) {
+      fop->setError("Error writing PNG image data\n");
+      result = false;
+      break;
+    }
+
+    fop->setProgress(double(chunk.endRow) / double(height));
+  }
+
+  pool.wait_all();
+  return result;
+}
+
+} // anonymous namespace
+
 bool PngFormat::onSave(FileOp* fop)
 {
   png_infop info;
@@ -584,6 +845,25 @@ bool PngFormat::onSave(FileOp* fop)
   png_set_IHDR(png, info, width, height, 8, color_type,
                PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
 
+  // Compression level and row filters
+  const gen::PngCompression compression = fop->config().pngCompression;
+  int level = Z_DEFAULT_COMPRESSION;
+  bool filterRows = (color_type != PNG_COLOR_TYPE_PALETTE);
+  switch (compression) {
+    case gen::PngCompression::FAST:
+      level = Z_BEST_SPEED;
+      filterRows = false;
+      png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_FILTER_NONE);
+      png_set_compression_level(png, level);
+      break;
+    case gen::PngCompression::SMALL:
+      level = Z_BEST_COMPRESSION;
+      png_set_compression_level(png, level);
+      break;
+    default:
+      break;
+  }
+
   // User chunks
   auto opts = fop->formatOptionsOfDocument<PngOptions>();
   if (opts && !opts->isEmpty()) {
@@ -663,47 +943,81 @@ bool PngFormat::onSave(FileOp* fop)
   png_write_info(png, info);
   png_set_packing(png);
 
-  row_pointer = (png_bytep)png_malloc(png, png_get_rowbytes(png, info));
+  // Converts the row "y" of the image to the PNG format (this can be
+  // called from worker threads).
+  FillPngRow fillRow =
+    [fop, img, &spec, color_type, width, height](const png_uint_32 y,
+                                                 uint8_t* dst_address) {
+      if (color_type == PNG_COLOR_TYPE_RGB_ALPHA) {
+        unsigned int x, c, a;
+        bool opaque = true;
 
-  for (png_uint_32 y=0; y<height; ++y) {
-    uint8_t* dst_address = row_pointer;
+        if (spec.colorMode() == ColorMode::RGB) {
+          auto src_address = (const uint32_t*)img->getScanline(y);
 
-    if (png_get_color_type(png, info) == PNG_COLOR_TYPE_RGB_ALPHA) {
-      unsigned int x, c, a;
-      bool opaque = true;
+          for (x=0; x<width; ++x) {
+            c = *(src_address++);
+            a = rgba_geta(c);
+
+            if (opaque) {
+              if (a < 255)
+                opaque = false;
+              else if (fix_one_alpha_pixel && x == width-1 && y == height-1)
+                a = 254;
+            }
 
-      if (spec.colorMode() == ColorMode::RGB) {
+            *(dst_address++) = rgba_getr(c);
+            *(dst_address++) = rgba_getg(c);
+            *(dst_address++) = rgba_getb(c);
+            *(dst_address++) = a;
+          }
+        }
+        // In case that we are converting an indexed image to RGB just
+        // to convert one pixel with alpha=254.
+        else if (spec.colorMode() == ColorMode::INDEXED) {
+          auto src_address = (const uint8_t*)img->getScanline(y);
+          unsigned int x, c;
+          int r, g, b, a;
+          bool opaque = true;
+
+          for (x=0; x<width; ++x) {
+            c = *(src_address++);
+            fop->sequenceGetColor(c, &r, &g, &b);
+            fop->sequenceGetAlpha(c, &a);
+
+            if (opaque) {
+              if (a < 255)
+                opaque = false;
+              else if (fix_one_alpha_pixel && x == width-1 && y == height-1)
+                a = 254;
+            }
+
+            *(dst_address++) = r;
+            *(dst_address++) = g;
+            *(dst_address++) = b;
+            *(dst_address++) = a;
+          }
+        }
+      }
+      else if (color_type == PNG_COLOR_TYPE_RGB) {
         auto src_address = (const uint32_t*)img->getScanline(y);
+        unsigned int x, c;
 
         for (x=0; x<width; ++x) {
           c = *(src_address++);
-          a = rgba_geta(c);
-
-          if (opaque) {
-            if (a < 255)
-              opaque = false;
-            else if (fix_one_alpha_pixel && x == width-1 && y == height-1)
-              a = 254;
-          }
-
           *(dst_address++) = rgba_getr(c);
           *(dst_address++) = rgba_getg(c);
           *(dst_address++) = rgba_getb(c);
-          *(dst_address++) = a;
         }
       }
-      // In case that we are converting an indexed image to RGB just
-      // to convert one pixel with alpha=254.
-      else if (spec.colorMode() == ColorMode::INDEXED) {
-        auto src_address = (const uint8_t*)img->getScanline(y);
-        unsigned int x, c;
-        int r, g, b, a;
+      else if (color_type == PNG_COLOR_TYPE_GRAY_ALPHA) {
+        auto src_address = (const uint16_t*)img->getScanline(y);
+        unsigned int x, c, a;
         bool opaque = true;
 
-        for (x=0; x<width; ++x) {
+        for (x=0; x<width; x++) {
           c = *(src_address++);
-          fop->sequenceGetColor(c, &r, &g, &b);
-          fop->sequenceGetAlpha(c, &a);
+          a = graya_geta(c);
 
           if (opaque) {
             if (a < 255)
@@ -712,69 +1026,66 @@ bool PngFormat::onSave(FileOp* fop)
               a = 254;
           }
 
-          *(dst_address++) = r;
-          *(dst_address++) = g;
-          *(dst_address++) = b;
+          *(dst_address++) = graya_getv(c);
           *(dst_address++) = a;
         }
       }
-    }
-    else if (png_get_color_type(png, info) == PNG_COLOR_TYPE_RGB) {
-      auto src_address = (const uint32_t*)img->getScanline(y);
-      unsigned int x, c;
-
-      for (x=0; x<width; ++x) {
-        c = *(src_address++);
-        *(dst_address++) = rgba_getr(c);
-        *(dst_address++) = rgba_getg(c);
-        *(dst_address++) = rgba_getb(c);
-      }
-    }
-    else if (png_get_color_type(png, info) == PNG_COLOR_TYPE_GRAY_ALPHA) {
-      auto src_address = (const uint16_t*)img->getScanline(y);
-      unsigned int x, c, a;
-      bool opaque = true;
+      else if (color_type == PNG_COLOR_TYPE_GRAY) {
+        auto src_address = (const uint16_t*)img->getScanline(y);
+        unsigned int x, c;
 
-      for (x=0; x<width; x++) {
-        c = *(src_address++);
-        a = graya_geta(c);
-
-        if (opaque) {
-          if (a < 255)
-            opaque = false;
-          else if (fix_one_alpha_pixel && x == width-1 && y == height-1)
-            a = 254;
+        for (x=0; x<width; ++x) {
+          c = *(src_address++);
+          *(dst_address++) = graya_getv(c);
         }
+      }
+      else if (color_type == PNG_COLOR_TYPE_PALETTE) {
+        auto src_address = (const uint8_t*)img->getScanline(y);
+        unsigned int x;
 
-        *(dst_address++) = graya_getv(c);
-        *(dst_address++) = a;
+        for (x=0; x<width; ++x)
+          *(dst_address++) = *(src_address++);
       }
-    }
-    else if (png_get_color_type(png, info) == PNG_COLOR_TYPE_GRAY) {
-      auto src_address = (const uint16_t*)img->getScanline(y);
-      unsigned int x, c;
+    };
+
+  const size_t rowbytes = png_get_rowbytes(png, info);
+  if (fop->config().parallelPngEncoding &&
+      height > 1 &&
+      rowbytes * height >= kMinParallelEncodingSize) {
+    // IDAT chunks are written directly in the file (from compressed
+    // chunks of rows in worker threads), and then the chunks that
+    // libpng writes in png_write_end()
+    if (!write_png_idat_in_parallel(fp, fop, height, rowbytes,
+                                    png_get_channels(png, info),
+                                    filterRows, level, fillRow))
+      return false;
 
-      for (x=0; x<width; ++x) {
-        c = *(src_address++);
-        *(dst_address++) = graya_getv(c);
+    if (opts) {
+      for (const auto& chunk : opts->chunks()) {
+        // Only safe-to-copy chunks (as libpng does)
+        if ((chunk.location & PNG_AFTER_IDAT) &&
+            chunk.name.size() == 4 && (chunk.name[3] & 0x20)) {
+          png_write_chunk(png, (png_const_bytep)chunk.name.c_str(),
+                          (png_const_bytep)chunk.data.data(), chunk.data.size());
+        }
       }
     }
-    else if (png_get_color_type(png, info) == PNG_COLOR_TYPE_PALETTE) {
-      auto src_address = (const uint8_t*)img->getScanline(y);
-      unsigned int x;
+    png_write_chunk(png, (png_const_bytep)"IEND", nullptr, 0);
+  }
+  else {
+    row_pointer = (png_bytep)png_malloc(png, rowbytes);
 
-      for (x=0; x<width; ++x)
-        *(dst_address++) = *(src_address++);
-    }
+    for (png_uint_32 y=0; y<height; ++y) {
+      fillRow(y, row_pointer);
+      png_write_rows(png, &row_pointer, 1);
 
-    png_write_rows(png, &row_pointer, 1);
+      fop->setProgress((double)(y+1) / (double)(height));
+    }
 
-    fop->setProgress((double)(y+1) / (double)(height));
+    png_free(png, row_pointer);
+    png_write_end(png, info);
   }
 
-  png_free(png, row_pointer);
-  png_write_end(png, info);
-
   if (spec.colorMode() == ColorMode::INDEXED) {
     png_free(png, palette);
     palette = nullptr;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2021  Igara Studio S.A.
+// Copyright (C) 2021-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -7,6 +7,7 @@
 #include "app/file/file.h"
 #include "app/file/file_format.h"
 #include "base/file_handle.h"
+#include "base/thread_pool.h"
 #include "doc/blend_mode.h"
 #include "doc/image_impl.h"
 #include "doc/layer.h"
@@ -15,6 +16,12 @@
 #include "doc/sprite.h"
 #include "psd/psd.h"
 
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
 namespace app {
 
 doc::PixelFormat psd_cmode_to_ase_format(const psd::ColorMode mode)
@@ -97,9 +104,25 @@ FileFormat* CreatePsdFormat()
   return new PsdFormat();
 }
 
+// Decoded channels of an image. They are converted to the pixels of
+// the image in a worker thread while the decoder continues reading
+// the next layers.
+struct PsdPendingImage {
+  doc::ImageRef image;
+  doc::PixelFormat pixelFormat;
+  int depth;
+  bool hasTransparentChannel;
+  // Rows of each channel (in the same order they were decoded)
+  std::vector<std::pair<psd::ChannelID,
+                        std::vector<std::vector<uint8_t>>>> channels;
+};
+
 class PsdDecoderDelegate : public psd::DecoderDelegate {
 public:
-  PsdDecoderDelegate()
+  // If skipHiddenLayers is true, the pixels of hidden layers are not
+  // decoded (used when we only need a flattened frame, e.g. to
+  // generate a thumbnail).
+  PsdDecoderDelegate(const bool skipHiddenLayers)
     : m_currentImage(nullptr)
     , m_currentLayer(nullptr)
     , m_layerGroup(nullptr)
@@ -107,9 +130,21 @@ public:
     , m_activeFrameIndex(0)
     , m_pixelFormat(PixelFormat::IMAGE_INDEXED)
     , m_layerHasTransparentChannel(false)
+    , m_skipHiddenLayers(skipHiddenLayers)
+    , m_skipCurrentLayer(false)
+    , m_pool(std::max(1u, std::thread::hardware_concurrency()))
   { }
 
-  Sprite* getSprite() { return assembleDocument(); }
+  ~PsdDecoderDelegate() {
+    m_pool.wait_all();
+  }
+
+  Sprite* getSprite() {
+    // Wait all images to be converted
+    flushPendingImage(false);
+    m_pool.wait_all();
+    return assembleDocument();
+  }
 
   void onFileHeader(const psd::FileHeader& header) override
   {
@@ -195,19 +230,36 @@ public:
         //m_currentLayer->setVisible(layerRecord.isVisible());
         m_layerHasTransparentChannel =
           hasTransparency(layerRecord.channels.size());
+
+        // Hidden layers don't affect the flattened frame
+        if (m_skipHiddenLayers && !layerRecord.isVisible()) {
+          m_currentLayer->setVisible(false);
+          m_skipCurrentLayer = true;
+        }
       }
       else {
         m_currentLayer = *findIter;
-        m_currentImage = m_currentLayer->cel(frame_t(0))->imageRef();
+        if (Cel* cel = m_currentLayer->cel(frame_t(0))) {
+          // Wait the pixels of this image to be converted (as new
+          // channels will be merged with the existing pixels)
+          m_pool.wait_all();
+          m_currentImage = cel->imageRef();
+        }
       }
     }
   }
 
   void onEndLayer(const psd::LayerRecord& layerRecord) override
   {
-    if (!m_framesInfo.empty() &&
-        (layerRecord.inFrames.size() == m_framesInfo.size()) &&
-        m_currentImage) {
+    const bool copyToFrames =
+      (!m_framesInfo.empty() &&
+       (layerRecord.inFrames.size() == m_framesInfo.size()) &&
+       m_currentImage);
+
+    // If the cel is copied to other frames, we need its pixels now
+    flushPendingImage(copyToFrames);
+
+    if (copyToFrames) {
       std::unique_ptr<Cel> layerCel(m_currentLayer->cel(frame_t(0)));
       LayerImage* imageLayer = static_cast<LayerImage*>(m_currentLayer);
       imageLayer->removeCel(layerCel.get());
@@ -232,6 +284,7 @@ public:
     m_currentImage.reset();
     m_currentLayer = nullptr;
     m_layerHasTransparentChannel = false;
+    m_skipCurrentLayer = false;
   }
 
   // Emitted only if there's a palette in an image
@@ -248,6 +301,11 @@ public:
   // Emitted when an image data is about to be transmitted
   void onBeginImage(const psd::ImageData& imageData) override
   {
+    flushPendingImage(false);
+
+    if (m_skipCurrentLayer)
+      return;
+
     if (!m_currentImage) {
       // Only occurs where there's an image with no layer
       if (m_layers.empty()) {
@@ -293,26 +351,92 @@ public:
     if (!m_currentImage || y >= m_currentImage->height())
       return;
 
-    const int dataCount = bytes / (img.depth >= 8 ? (img.depth / 8) : 1);
-    uint8_t* dstGenericAddress = m_currentImage->getPixelAddress(0, y);
+    if (img.depth != 1 && img.depth != 8 &&
+        img.depth != 16 && img.depth != 32)
+      throw std::runtime_error("invalid image depth");
+
+    if (!m_pending || m_pending->image != m_currentImage) {
+      flushPendingImage(false);
+
+      m_pending = std::make_unique<PsdPendingImage>();
+      m_pending->image = m_currentImage;
+      m_pending->pixelFormat = m_pixelFormat;
+      m_pending->depth = img.depth;
+      m_pending->hasTransparentChannel = m_layerHasTransparentChannel;
+    }
+
+    auto& channels = m_pending->channels;
+    if (channels.empty() || channels.back().first != chanID) {
+      channels.emplace_back(chanID, std::vector<std::vector<uint8_t>>());
+      channels.back().second.resize(m_currentImage->height());
+    }
+    channels.back().second[y].assign(data, data+bytes);
+  }
+
+private:
+  inline bool hasTransparency(const size_t nchannels)
+  {
+    // RGBA or grayscale image with alpha channel
+    return nchannels == 4 || nchannels == 2;
+  }
+
+  // Converts the pending channels to pixels in a worker thread (or
+  // in this same thread if "now" is true).
+  void flushPendingImage(const bool now)
+  {
+    if (!m_pending)
+      return;
+
+    std::shared_ptr<PsdPendingImage> pending(std::move(m_pending));
+    if (now)
+      convertChannels(*pending);
+    else
+      m_pool.execute([pending]{ convertChannels(*pending); });
+  }
+
+  // Merges the decoded channels with the pixels of the image row by
+  // row (so all channels of a row are merged while it's in cache).
+  static void convertChannels(const PsdPendingImage& pending)
+  {
+    Image* image = pending.image.get();
+    for (int y=0; y<image->height(); ++y) {
+      for (const auto& channel : pending.channels) {
+        const std::vector<uint8_t>& row = channel.second[y];
+        if (!row.empty())
+          convertScanline(pending, image, y, channel.first,
+                          row.data(), int(row.size()));
+      }
+    }
+  }
+
+  static void convertScanline(const PsdPendingImage& pending,
+                              Image* image,
+                              const int y,
+                              const psd::ChannelID chanID,
+                              const uint8_t* data,
+                              const int bytes)
+  {
+    const int depth = pending.depth;
+    const int dataCount = bytes / (depth >= 8 ? (depth / 8) : 1);
+    uint8_t* dstGenericAddress = image->getPixelAddress(0, y);
 
-    if (m_pixelFormat == doc::PixelFormat::IMAGE_INDEXED) {
+    if (pending.pixelFormat == doc::PixelFormat::IMAGE_INDEXED) {
       IndexedTraits::address_t dstAddress =
         (IndexedTraits::address_t)dstGenericAddress;
-      for (int x = 0; x < dataCount && x < m_currentImage->width(); ++x) {
-        *(dstAddress)++ = getNormalizedPixelValue(data, img.depth);
+      for (int x = 0; x < dataCount && x < image->width(); ++x) {
+        *(dstAddress)++ = getNormalizedPixelValue(data, depth);
       }
     }
-    else if (m_pixelFormat == doc::PixelFormat::IMAGE_GRAYSCALE) {
+    else if (pending.pixelFormat == doc::PixelFormat::IMAGE_GRAYSCALE) {
       GrayscaleTraits::address_t dstAddress =
         (GrayscaleTraits::address_t)dstGenericAddress;
       uint8_t v = 0, a = 0;
-      for (int x = 0; x < dataCount && x < m_currentImage->width(); ++x) {
+      for (int x = 0; x < dataCount && x < image->width(); ++x) {
         const GrayscaleTraits::pixel_t pixel = *dstAddress;
-        const uint8_t newPixelValue = getNormalizedPixelValue(data, img.depth);
+        const uint8_t newPixelValue = getNormalizedPixelValue(data, depth);
         if (chanID == psd::ChannelID::Red) {
           v = newPixelValue;
-          a = m_layerHasTransparentChannel ? graya_geta(pixel) : 255;
+          a = pending.hasTransparentChannel ? graya_geta(pixel) : 255;
         }
         else if (chanID == psd::ChannelID::Alpha ||
                  chanID == psd::ChannelID::TransparencyMask) {
@@ -322,16 +446,16 @@ public:
         *(dstAddress++) = graya(v, a);
       }
     }
-    else if (m_pixelFormat == doc::PixelFormat::IMAGE_RGB) {
+    else if (pending.pixelFormat == doc::PixelFormat::IMAGE_RGB) {
       RgbTraits::address_t dstAddress = (RgbTraits::address_t)dstGenericAddress;
       uint8_t r, g, b, a;
-      for (int x = 0; x < dataCount && x < m_currentImage->width(); ++x) {
-        const uint8_t newPixelValue = getNormalizedPixelValue(data, img.depth);
+      for (int x = 0; x < dataCount && x < image->width(); ++x) {
+        const uint8_t newPixelValue = getNormalizedPixelValue(data, depth);
         const color_t c = *(dstAddress);
         r = rgba_getr(c);
         g = rgba_getg(c);
         b = rgba_getb(c);
-        a = m_layerHasTransparentChannel ? rgba_geta(c) : 255;
+        a = pending.hasTransparentChannel ? rgba_geta(c) : 255;
         if (chanID == psd::ChannelID::Red) {
           r = newPixelValue;
         }
@@ -350,13 +474,6 @@ public:
     }
   }
 
-private:
-  inline bool hasTransparency(const size_t nchannels)
-  {
-    // RGBA or grayscale image with alpha channel
-    return nchannels == 4 || nchannels == 2;
-  }
-
   void linkNewCel(Layer* layer, doc::ImageRef image)
   {
     if (!image)
@@ -388,8 +505,8 @@ private:
     return m_sprite;
   }
 
-  std::uint8_t getNormalizedPixelValue(const std::uint8_t*& data,
-                                       const int depth)
+  static std::uint8_t getNormalizedPixelValue(const std::uint8_t*& data,
+                                              const int depth)
   {
     if (depth == 1 || depth == 8) {
       return *(data++);
@@ -429,6 +546,10 @@ private:
   std::vector<psd::FrameInformation> m_framesInfo;
   Palette m_palette;
   bool m_layerHasTransparentChannel;
+  bool m_skipHiddenLayers;
+  bool m_skipCurrentLayer;
+  std::unique_ptr<PsdPendingImage> m_pending;
+  base::thread_pool m_pool;
 };
 
 bool PsdFormat::onLoad(FileOp* fop)
@@ -437,7 +558,7 @@ bool PsdFormat::onLoad(FileOp* fop)
     base::open_file_with_exception(fop->filename(), "rb");
   FILE* f = fileHandle.get();
   psd::StdioFileInterface fileInterface(f);
-  PsdDecoderDelegate pDelegate;
+  PsdDecoderDelegate pDelegate(fop->isOneFrame());
   psd::Decoder decoder(&fileInterface, &pDelegate);
 
   if (!decoder.readFileHeader()) {
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2023  Igara Studio S.A.
+// Copyright (C) 2023-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -12,14 +12,302 @@
 #include "app/file/file_format.h"
 #include "base/file_handle.h"
 
+#include <cstring>
+#include <vector>
+
 #define QOI_NO_STDIO
-#define QOI_IMPLEMENTATION
 #include "qoi.h"
 
 namespace app {
 
 using namespace base;
 
+namespace {
+
+// QOI chunks (as defined in the QOI specification)
+const uint8_t kQoiOpIndex = 0x00; // 00xxxxxx
+const uint8_t kQoiOpDiff  = 0x40; // 01xxxxxx
+const uint8_t kQoiOpLuma  = 0x80; // 10xxxxxx
+const uint8_t kQoiOpRun   = 0xc0; // 11xxxxxx
+const uint8_t kQoiOpRgb   = 0xfe; // 11111110
+const uint8_t kQoiOpRgba  = 0xff; // 11111111
+const uint8_t kQoiMask2   = 0xc0; // 11000000
+
+const int kQoiHeaderSize = 14;
+const int kQoiMaxRun = 62;
+const uint8_t kQoiPadding[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+
+// Same limit as the reference implementation
+const uint32_t kQoiPixelsMax = 400000000;
+
+// doc::rgba() pixels in memory have the same RGBA byte order of QOI pixels
+inline int qoi_color_hash(const doc::color_t c)
+{
+  return (doc::rgba_getr(c)*3 +
+          doc::rgba_getg(c)*5 +
+          doc::rgba_getb(c)*7 +
+          doc::rgba_geta(c)*11) % 64;
+}
+
+inline uint32_t qoi_read_32(const uint8_t* p)
+{
+  return ((uint32_t(p[0]) << 24) |
+          (uint32_t(p[1]) << 16) |
+          (uint32_t(p[2]) << 8) |
+          uint32_t(p[3]));
+}
+
+inline void qoi_write_32(uint8_t* p, const uint32_t v)
+{
+  p[0] = (v >> 24) & 0xff;
+  p[1] = (v >> 16) & 0xff;
+  p[2] = (v >> 8) & 0xff;
+  p[3] = v & 0xff;
+}
+
+bool qoi_read_header(const uint8_t* data, const size_t size, qoi_desc* desc)
+{
+  if (size < kQoiHeaderSize + sizeof(kQoiPadding) ||
+      std::memcmp(data, "qoif", 4) != 0)
+    return false;
+
+  desc->width = qoi_read_32(data+4);
+  desc->height = qoi_read_32(data+8);
+  desc->channels = data[12];
+  desc->colorspace = data[13];
+
+  return (desc->width > 0 &&
+          desc->height > 0 &&
+          (desc->channels == 3 || desc->channels == 4) &&
+          desc->colorspace <= QOI_LINEAR &&
+          desc->height < kQoiPixelsMax / desc->width);
+}
+
+// Decodes the QOI chunks directly in the RGB image (which must have
+// the size specified in the header).
+bool qoi_decode_to_image(const uint8_t* data, const size_t size,
+                         const qoi_desc& desc, doc::Image* image)
+{
+  const uint8_t* p = data + kQoiHeaderSize;
+  const uint8_t* end = data + size - sizeof(kQoiPadding);
+  // Forced alpha = 255 for RGB files (the alpha channel of chunks is ignored)
+  const doc::color_t alphaMask = (desc.channels == 3 ? doc::rgba_a_mask: 0);
+
+  doc::color_t index[64];
+  std::fill(std::begin(index), std::end(index), 0);
+  doc::color_t px = doc::rgba(0, 0, 0, 255);
+  int run = 0;
+
+  for (int y=0; y<int(desc.height); ++y) {
+    auto dst = (uint32_t*)image->getPixelAddress(0, y);
+    auto dstEnd = dst + desc.width;
+
+    while (dst < dstEnd) {
+      // A run can cover several rows
+      if (run > 0) {
+        const int n = std::min<int>(run, dstEnd - dst);
+        std::fill(dst, dst+n, px | alphaMask);
+        dst += n;
+        run -= n;
+        continue;
+      }
+
+      if (p >= end)
+        return false;
+
+      const uint8_t b1 = *(p++);
+      if (b1 == kQoiOpRgb) {
+        if (end - p < 3)
+          return false;
+        px = doc::rgba(p[0], p[1], p[2], doc::rgba_geta(px));
+        p += 3;
+      }
+      else if (b1 == kQoiOpRgba) {
+        if (end - p < 4)
+          return false;
+        px = doc::rgba(p[0], p[1], p[2], p[3]);
+        p += 4;
+      }
+      else {
+        switch (b1 & kQoiMask2) {
+          case kQoiOpIndex:
+            px = index[b1];
+            break;
+          case kQoiOpDiff:
+            px = doc::rgba(doc::rgba_getr(px) + ((b1 >> 4) & 0x03) - 2,
+                           doc::rgba_getg(px) + ((b1 >> 2) & 0x03) - 2,
+                           doc::rgba_getb(px) + ( b1       & 0x03) - 2,
+                           doc::rgba_geta(px));
+            break;
+          case kQoiOpLuma: {
+            if (p >= end)
+              return false;
+            const uint8_t b2 = *(p++);
+            const int vg = (b1 & 0x3f) - 32;
+            px = doc::rgba(doc::rgba_getr(px) + vg - 8 + ((b2 >> 4) & 0x0f),
+                           doc::rgba_getg(px) + vg,
+                           doc::rgba_getb(px) + vg - 8 +  (b2       & 0x0f),
+                           doc::rgba_geta(px));
+            break;
+          }
+          case kQoiOpRun:
+            // As the reference decoder, the index is updated with
+            // the repeated pixel too
+            index[qoi_color_hash(px)] = px;
+            run = (b1 & 0x3f) + 1;
+            continue;
+        }
+      }
+
+      index[qoi_color_hash(px)] = px;
+      *(dst++) = px | alphaMask;
+    }
+  }
+  return true;
+}
+
+// Encodes the image writing the QOI data in the file (using a small
+// buffer instead of a buffer for the whole file).
+class QoiWriter {
+public:
+  QoiWriter(FILE* f) : m_f(f), m_buf(64*1024) { }
+
+  uint8_t* reserve(const int n) {
+    if (m_pos + n > int(m_buf.size()))
+      flush();
+    return &m_buf[m_pos];
+  }
+
+  void advance(const int n) { m_pos += n; }
+
+  void put(const uint8_t v) {
+    *reserve(1) = v;
+    advance(1);
+  }
+
+  void flush() {
+    if (m_pos > 0) {
+      fwrite(&m_buf[0], 1, m_pos, m_f);
+      m_pos = 0;
+    }
+  }
+
+private:
+  FILE* m_f;
+  std::vector<uint8_t> m_buf;
+  int m_pos = 0;
+};
+
+void qoi_encode_image(const doc::Image* image, const qoi_desc& desc, FILE* f)
+{
+  QoiWriter writer(f);
+
+  uint8_t* header = writer.reserve(kQoiHeaderSize);
+  std::memcpy(header, "qoif", 4);
+  qoi_write_32(header+4, desc.width);
+  qoi_write_32(header+8, desc.height);
+  header[12] = desc.channels;
+  header[13] = desc.colorspace;
+  writer.advance(kQoiHeaderSize);
+
+  // For RGB files the alpha is always 255
+  const doc::color_t alphaMask = (desc.channels == 3 ? doc::rgba_a_mask: 0);
+
+  doc::color_t index[64];
+  std::fill(std::begin(index), std::end(index), 0);
+  doc::color_t prev = doc::rgba(0, 0, 0, 255);
+  int run = 0;
+
+  auto flushRun = [&writer, &run]{
+    for (; run >= kQoiMaxRun; run -= kQoiMaxRun)
+      writer.put(kQoiOpRun | (kQoiMaxRun - 1));
+    if (run > 0) {
+      writer.put(kQoiOpRun | (run - 1));
+      run = 0;
+    }
+  };
+
+  for (int y=0; y<int(desc.height); ++y) {
+    auto src = (const uint32_t*)image->getPixelAddress(0, y);
+    const int w = int(desc.width);
+
+    for (int x=0; x<w; ) {
+      const doc::color_t px = src[x] | alphaMask;
+
+      // Count all the equal pixels of this row at once (comparing
+      // 32-bit pixels instead of each channel)
+      if (px == prev) {
+        int u = x+1;
+        while (u < w && (src[u] | alphaMask) == prev)
+          ++u;
+        run += u - x;
+        x = u;
+        continue;
+      }
+
+      flushRun();
+
+      const int i = qoi_color_hash(px);
+      if (index[i] == px) {
+        writer.put(kQoiOpIndex | i);
+      }
+      else {
+        index[i] = px;
+
+        uint8_t* out = writer.reserve(5);
+        if (doc::rgba_geta(px) == doc::rgba_geta(prev)) {
+          const int vr = int(doc::rgba_getr(px)) - int(doc::rgba_getr(prev));
+          const int vg = int(doc::rgba_getg(px)) - int(doc::rgba_getg(prev));
+          const int vb = int(doc::rgba_getb(px)) - int(doc::rgba_getb(prev));
+          // Differences wrap around (as uint8_t values)
+          const int8_t dr = int8_t(vr), dg = int8_t(vg), db = int8_t(vb);
+          const int dr_dg = dr - dg;
+          const int db_dg = db - dg;
+
+          if (dr > -3 && dr < 2 &&
+              dg > -3 && dg < 2 &&
+              db > -3 && db < 2) {
+            out[0] = kQoiOpDiff | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2);
+            writer.advance(1);
+          }
+          else if (dr_dg > -9 && dr_dg < 8 &&
+                   dg > -33 && dg < 32 &&
+                   db_dg > -9 && db_dg < 8) {
+            out[0] = kQoiOpLuma | (dg + 32);
+            out[1] = ((dr_dg + 8) << 4) | (db_dg + 8);
+            writer.advance(2);
+          }
+          else {
+            out[0] = kQoiOpRgb;
+            out[1] = doc::rgba_getr(px);
+            out[2] = doc::rgba_getg(px);
+            out[3] = doc::rgba_getb(px);
+            writer.advance(4);
+          }
+        }
+        else {
+          out[0] = kQoiOpRgba;
+          out[1] = doc::rgba_getr(px);
+          out[2] = doc::rgba_getg(px);
+          out[3] = doc::rgba_getb(px);
+          out[4] = doc::rgba_geta(px);
+          writer.advance(5);
+        }
+      }
+
+      prev = px;
+      ++x;
+    }
+  }
+  flushRun();
+
+  std::memcpy(writer.reserve(sizeof(kQoiPadding)), kQoiPadding, sizeof(kQoiPadding));
+  writer.advance(sizeof(kQoiPadding));
+  writer.flush();
+}
+
+} // anonymous namespace
+
 class QoiFormat : public FileFormat {
   const char* onGetName() const override {
     return "qoi";
@@ -65,16 +353,14 @@ bool QoiFormat::onLoad(FileOp* fop)
     return false;
   fseek(f, 0, SEEK_SET);
 
-  auto data = QOI_MALLOC(size);
-  if (!data)
-    return false;
+  std::vector<uint8_t> data(size);
+  data.resize(fread(data.data(), 1, size, f));
 
   qoi_desc desc;
-  auto bytes_read = fread(data, 1, size, f);
-  auto pixels = qoi_decode(data, bytes_read, &desc, 0);
-  QOI_FREE(data);
-  if (!pixels)
+  if (!qoi_read_header(data.data(), data.size(), &desc)) {
+    fop->setError("Invalid QOI file.\n");
     return false;
+  }
 
   ImageRef image = fop->sequenceImageToLoad(
     IMAGE_RGB,
@@ -83,27 +369,11 @@ bool QoiFormat::onLoad(FileOp* fop)
   if (!image)
     return false;
 
-  auto src = (const uint8_t*)pixels;
-  for (int y=0; y<desc.height; ++y) {
-    auto dst = (uint32_t*)image->getPixelAddress(0, y);
-    switch (desc.channels) {
-      case 4:
-        for (int x=0; x<desc.width; ++x, ++dst) {
-          *dst = doc::rgba(src[0], src[1], src[2], src[3]);
-          src += 4;
-        }
-        break;
-      case 3:
-        for (int x=0; x<desc.width; ++x, ++dst) {
-          *dst = doc::rgba(src[0], src[1], src[2], 255);
-          src += 3;
-        }
-        break;
-    }
+  if (!qoi_decode_to_image(data.data(), data.size(), desc, image.get())) {
+    fop->setError("Error decoding QOI file.\n");
+    return false;
   }
 
-  QOI_FREE(pixels);
-
   if (desc.channels == 4)
     fop->sequenceSetHasAlpha(true);
 
@@ -156,44 +426,7 @@ bool QoiFormat::onSave(FileOp* fop)
     desc.colorspace = QOI_LINEAR;
   }
 
-  auto pixels = (uint8_t*)QOI_MALLOC(desc.width * desc.height * desc.channels);
-  if (!pixels)
-    return false;
-
-  auto dst = pixels;
-  for (int y=0; y<desc.height; ++y) {
-    auto src = (uint32_t*)image->getPixelAddress(0, y);
-    switch (desc.channels) {
-      case 4:
-        for (int x=0; x<desc.width; ++x, ++src) {
-          uint32_t c = *src;
-          dst[0] = doc::rgba_getr(c);
-          dst[1] = doc::rgba_getg(c);
-          dst[2] = doc::rgba_getb(c);
-          dst[3] = doc::rgba_geta(c);
-          dst += 4;
-        }
-        break;
-      case 3:
-        for (int x=0; x<desc.width; ++x, ++src) {
-          uint32_t c = *src;
-          dst[0] = doc::rgba_getr(c);
-          dst[1] = doc::rgba_getg(c);
-          dst[2] = doc::rgba_getb(c);
-          dst += 3;
-        }
-        break;
-    }
-  }
-
-  int size = 0;
-  auto encoded = qoi_encode(pixels, &desc, &size);
-  QOI_FREE(pixels);
-  if (!encoded)
-    return false;
-
-  fwrite(encoded, 1, size, f);
-  QOI_FREE(encoded);
+  qoi_encode_image(image.get(), desc, f);
 
   if (ferror(handle.get())) {
     fop->setError("Error writing file.\n");
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2015-2018  David Capello
 // Copyright (C) 2015  Gabriel Rauter
 //
@@ -22,6 +22,7 @@
 #include "app/pref/preferences.h"
 #include "base/convert_to.h"
 #include "base/file_handle.h"
+#include "base/thread_pool.h"
 #include "doc/doc.h"
 #include "ui/manager.h"
 
@@ -30,7 +31,10 @@
 #include <cstdio>
 #include <cstdlib>
 #include <algorithm>
+#include <deque>
+#include <future>
 #include <map>
+#include <thread>
 
 #include <webp/demux.h>
 #include <webp/mux.h>
@@ -297,47 +301,102 @@ bool WebPFormat::onSave(FileOp* fop)
       break;
   }
 
+  config.thread_level = opts->threadLevel();
+  if (opts->method() != WebPOptions::kPresetMethod)
+    config.method = opts->method();
+
   WebPAnimEncoderOptions enc_options;
   WebPAnimEncoderOptionsInit(&enc_options);
   enc_options.anim_params.loop_count =
     (opts->loop() ? 0:  // 0 = infinite
                     1); // 1 = loop once
 
-  ImageRef image(Image::create(IMAGE_RGB, w, h));
+  // Renders the frame in a new image (this can be called from worker
+  // threads)
+  auto renderFrame = [fop, sprite, w, h](const frame_t frame) -> ImageRef {
+    ImageRef image(Image::create(IMAGE_RGB, w, h));
+    clear_image(image.get(), image->maskColor());
+    sprite->renderFrame(frame, fop->roi().frameBounds(frame), image.get());
+
+    // Switch R <-> B channels because WebPAnimEncoderAssemble()
+    // expects MODE_BGRA pictures.
+    LockImageBits<RgbTraits> bits(image.get(), Image::ReadWriteLock);
+    auto it = bits.begin(), end = bits.end();
+    for (; it != end; ++it) {
+      auto c = *it;
+      *it = rgba(rgba_getb(c), // Use blue in red channel
+                 rgba_getg(c),
+                 rgba_getr(c), // Use red in blue channel
+                 rgba_geta(c));
+    }
+    return image;
+  };
+
+  // Frames are rendered in worker threads (a few frames ahead) while
+  // the encoder compresses the current one (except when the image is
+  // scaled, as the resize uses a shared temporary image)
+  using Task = std::packaged_task<ImageRef()>;
+  const int nthreads = std::max(1u, std::thread::hardware_concurrency());
+  std::unique_ptr<base::thread_pool> pool;
+  if (fop->config().parallelWebPEncoding && !sprite->isScaled())
+    pool = std::make_unique<base::thread_pool>(nthreads);
+
+  // Consecutive frames that render the same pixels (e.g. frames with
+  // linked cels) are encoded just once with the sum of their
+  // durations.
+  std::vector<frame_t> frames;
+  std::vector<int> durations;
+  uint64_t prevSignature = 0;
+  for (frame_t frame : fop->roi().framesSequence()) {
+    const uint64_t signature = sprite->frameSignature(frame);
+    if (!frames.empty() &&
+        signature == prevSignature &&
+        fop->roi().frameBounds(frame) == fop->roi().frameBounds(frames.back())) {
+      durations.back() += sprite->frameDuration(frame);
+      continue;
+    }
+    frames.push_back(frame);
+    durations.push_back(sprite->frameDuration(frame));
+    prevSignature = signature;
+  }
+
+  std::deque<std::future<ImageRef>> renders;
+  int nextRender = 0;
 
-  const doc::frame_t totalFrames = fop->roi().frames();
+  const doc::frame_t totalFrames = doc::frame_t(frames.size());
   WriterData wd(fp, fop, totalFrames);
   WebPPicture pic;
   WebPPictureInit(&pic);
   pic.width = w;
   pic.height = h;
   pic.use_argb = true;
-  pic.argb = (uint32_t*)image->getPixelAddress(0, 0);
-  pic.argb_stride = image->rowPixels(); // Stride in pixels (not bytes)
   pic.user_data = &wd;
   pic.progress_hook = progress_report;
 
   WebPAnimEncoder* enc = WebPAnimEncoderNew(w, h, &enc_options);
   int timestamp_ms = 0;
-  for (frame_t frame : fop->roi().framesSequence()) {
-    // Render the frame in the bitmap
-    clear_image(image.get(), image->maskColor());
-    sprite->renderFrame(frame, fop->roi().frameBounds(frame), image.get());
-
-    // Switch R <-> B channels because WebPAnimEncoderAssemble()
-    // expects MODE_BGRA pictures.
-    {
-      LockImageBits<RgbTraits> bits(image.get(), Image::ReadWriteLock);
-      auto it = bits.begin(), end = bits.end();
-      for (; it != end; ++it) {
-        auto c = *it;
-        *it = rgba(rgba_getb(c), // Use blue in red channel
-                   rgba_getg(c),
-                   rgba_getr(c), // Use red in blue channel
-                   rgba_geta(c));
-      }
+  for (int i=0; i<int(frames.size()); ++i) {
+    const frame_t frame = frames[i];
+    for (; (nextRender < int(frames.size()) &&
+            (renders.empty() || (pool && int(renders.size()) < 2*nthreads))); ++nextRender) {
+      auto task = std::make_shared<Task>(
+        [&renderFrame, renderedFrame=frames[nextRender]]{
+          return renderFrame(renderedFrame);
+        });
+      renders.push_back(task->get_future());
+      if (pool)
+        pool->execute([task]{ (*task)(); });
+      else
+        (*task)();
     }
 
+    // Get the rendered frame in the bitmap
+    ImageRef image = renders.front().get();
+    renders.pop_front();
+
+    pic.argb = (uint32_t*)image->getPixelAddress(0, 0);
+    pic.argb_stride = image->rowPixels(); // Stride in pixels (not bytes)
+
     if (!WebPAnimEncoderAdd(enc, &pic, timestamp_ms, &config)) {
       if (!fop->isStop()) {
         fop->setError("Error saving frame %d info\n", frame);
@@ -346,7 +405,7 @@ bool WebPFormat::onSave(FileOp* fop)
       else
         return true;
     }
-    timestamp_ms += sprite->frameDuration(frame);
+    timestamp_ms += durations[i];
 
     wd.f++;
   }
@@ -394,6 +453,11 @@ FormatOptionsPtr WebPFormat::onAskUserForFormatOptions(FileOp* fop)
           break;
       }
 
+      if (pref.isSet(pref.webp.threadLevel))
+        opts->setThreadLevel(pref.webp.threadLevel());
+      if (pref.isSet(pref.webp.method))
+        opts->setMethod(std::clamp(pref.webp.method(), -1, 6));
+
       if (pref.webp.showAlert()) {
         app::gen::WebpOptions win;
 
@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 // Copyright (C) 2015  Gabriel Rauter
 //
@@ -24,12 +25,17 @@ namespace app {
     // By default we use 6, because 9 is too slow
     const int kDefaultCompression = 6;
 
+    // Use the method (speed/quality trade-off) of the selected preset
+    static constexpr int kPresetMethod = -1;
+
     WebPOptions() : m_loop(true),
                     m_type(Type::Simple),
                     m_compression(kDefaultCompression),
                     m_imageHint(WEBP_HINT_DEFAULT),
                     m_quality(100),
-                    m_imagePreset(WEBP_PRESET_DEFAULT) { }
+                    m_imagePreset(WEBP_PRESET_DEFAULT),
+                    m_threadLevel(1),
+                    m_method(kPresetMethod) { }
 
     bool loop() const { return m_loop; }
     Type type() const { return m_type; }
@@ -37,6 +43,8 @@ namespace app {
     WebPImageHint imageHint() const { return m_imageHint; }
     int quality() const { return m_quality; }
     WebPPreset imagePreset() const { return m_imagePreset; }
+    int threadLevel() const { return m_threadLevel; }
+    int method() const { return m_method; }
 
     void setLoop(const bool loop) {
       m_loop = loop;
@@ -71,6 +79,15 @@ namespace app {
       m_imagePreset = imagePreset;
     }
 
+    void setThreadLevel(const int threadLevel) {
+      m_threadLevel = threadLevel;
+    }
+
+    void setMethod(const int method) {
+      ASSERT(method == kPresetMethod || (method >= 0 && method <= 6));
+      m_method = method;
+    }
+
   private:
     bool m_loop;
     Type m_type;
@@ -80,6 +97,9 @@ namespace app {
     // Lossy options
     int m_quality;      // Between 0 (smallest file) and 100 (biggest)
     WebPPreset m_imagePreset;  // Image Preset for lossy webp.
+    // Common options
+    int m_threadLevel;  // 0 = single thread, 1 = use multiple threads if possible
+    int m_method;       // Between 0 (fast) and 6 (slower-better), or kPresetMethod
   };
 
 } // namespace app
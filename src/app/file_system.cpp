@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -24,8 +24,12 @@
 #include "os/window.h"
 
 #include <algorithm>
+#include <condition_variable>
 #include <cstdio>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -70,6 +74,105 @@ unsigned int current_file_system_version = 0;
   base::ComPtr<IShellFolder> shl_idesktop;
 #endif
 
+#ifndef _WIN32
+
+struct FolderEntry {
+  std::string name;
+  bool is_folder;
+};
+using FolderEntries = std::vector<FolderEntry>;
+
+// Reads the entries of a folder. It doesn't use any FileItem, so it
+// can be called from any thread.
+FolderEntries read_folder_entries(const std::string& path)
+{
+  FolderEntries entries;
+  DIR* dir = opendir(path.c_str());
+  if (!dir)
+    return entries;
+
+  dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    std::string fn = entry->d_name;
+    if (fn == "." || fn == "..")
+      continue;
+
+    bool is_folder;
+#ifdef DT_DIR
+    // Avoid a stat() call for each entry when the file system
+    // already gives us the type of file
+    if (entry->d_type == DT_DIR)
+      is_folder = true;
+    else if (entry->d_type == DT_REG)
+      is_folder = false;
+    else
+#endif
+    {
+      std::string fullfn = base::join_path(path, fn);
+      struct stat fileStat;
+
+      if (stat(fullfn.c_str(), &fileStat) != 0 ||
+          (fileStat.st_mode & S_IFMT) == S_IFLNK) {
+        is_folder = base::is_directory(fullfn);
+      }
+      else {
+        is_folder = ((fileStat.st_mode & S_IFMT) == S_IFDIR);
+      }
+    }
+
+    entries.push_back(FolderEntry{ std::move(fn), is_folder });
+  }
+  closedir(dir);
+  return entries;
+}
+
+// Entries of a folder that are being read in a background thread.
+class FolderListing {
+public:
+  static std::shared_ptr<FolderListing> start(const std::string& path,
+                                              const unsigned int version) {
+    auto listing = std::make_shared<FolderListing>(version);
+    // Detached thread because reading a folder can take a lot of
+    // time (so we don't use a worker of the doc::TaskScheduler), the
+    // thread references only this FolderListing
+    std::thread([listing, path]{
+      FolderEntries entries = read_folder_entries(path);
+
+      const std::lock_guard lock(listing->m_mutex);
+      listing->m_entries = std::move(entries);
+      listing->m_ready = true;
+      listing->m_cv.notify_all();
+    }).detach();
+    return listing;
+  }
+
+  explicit FolderListing(const unsigned int version)
+    : m_version(version) { }
+
+  unsigned int version() const { return m_version; }
+
+  bool isReady() const {
+    const std::lock_guard lock(m_mutex);
+    return m_ready;
+  }
+
+  // Waits the background thread and returns the entries.
+  FolderEntries wait() {
+    std::unique_lock lock(m_mutex);
+    m_cv.wait(lock, [this]{ return m_ready; });
+    return std::move(m_entries);
+  }
+
+private:
+  unsigned int m_version;
+  mutable std::mutex m_mutex;
+  std::condition_variable m_cv;
+  FolderEntries m_entries;
+  bool m_ready = false;
+};
+
+#endif
+
 // a position in the file-system
 class FileItem final : public IFileItem {
 public:
@@ -84,6 +187,9 @@ public:
   mutable bool m_is_folder;
   std::atomic<double> m_thumbnailProgress;
   std::atomic<os::Surface*> m_thumbnail;
+#ifndef _WIN32
+  std::shared_ptr<FolderListing> m_listing; // Children read in background
+#endif
 #ifdef _WIN32
   LPITEMIDLIST m_pidl;            // relative to parent
   LPITEMIDLIST m_fullpidl;        // relative to the Desktop folder
@@ -94,7 +200,7 @@ public:
   FileItem(FileItem* parent);
   ~FileItem();
 
-  void insertChildSorted(FileItem* child);
+  bool isChildrenListOutdated() const;
   int compare(const FileItem& that) const;
 
   bool operator<(const FileItem& that) const { return compare(that) < 0; }
@@ -114,6 +220,7 @@ public:
 
   IFileItem* parent() const override;
   const FileItemList& children() override;
+  bool prefetchChildren() override;
   void createDirectory(const std::string& dirname) override;
 
   bool hasExtension(const base::paths& extensions) override;
@@ -424,19 +531,13 @@ IFileItem* FileItem::parent() const
 const FileItemList& FileItem::children()
 {
   // Is the file-item a folder?
-  if (isFolder() &&
-      // if the children list is empty, or the file-system version
-      // change (it's like to say: the current m_children list
-      // is outdated)...
-      (m_children.empty() ||
-       current_file_system_version > m_version)) {
-    FileItemList::iterator it;
+  if (isFolder() && isChildrenListOutdated()) {
+    FileItemList newChildren;
     FileItem* child;
 
     // we have to mark current items as deprecated
-    for (it=m_children.begin();
-         it!=m_children.end(); ++it) {
-      child = static_cast<FileItem*>(*it);
+    for (auto item : m_children) {
+      child = static_cast<FileItem*>(item);
       child->m_removed = true;
     }
 
@@ -501,7 +602,8 @@ const FileItemList& FileItem::children()
                 free_pidl(itempidl[c]);
               }
 
-              insertChildSorted(child);
+              child->m_removed = false;
+              newChildren.push_back(child);
             }
           }
         }
@@ -509,65 +611,64 @@ const FileItemList& FileItem::children()
     }
 #else
     {
-      DIR* dir = opendir(m_filename.c_str());
-      if (dir) {
-        dirent* entry;
-        while ((entry = readdir(dir)) != NULL) {
-          FileItem* child;
-          std::string fn = entry->d_name;
-          std::string fullfn = base::join_path(m_filename, fn);
-
-          if (fn == "." || fn == "..")
-            continue;
-
-          child = get_fileitem_by_path(fullfn, false);
-          if (!child) {
-            child = new FileItem(this);
-
-            bool is_folder;
-            struct stat fileStat;
-
-            stat(fullfn.c_str(), &fileStat);
-
-            if ((fileStat.st_mode & S_IFMT) == S_IFLNK) {
-              is_folder = base::is_directory(fullfn);
-            }
-            else {
-              is_folder = ((fileStat.st_mode & S_IFMT) == S_IFDIR);
-            }
-
-            child->m_filename = fullfn;
-            child->m_displayname = fn;
-            child->m_is_folder = is_folder;
-
-            put_fileitem(child);
-          }
-          else {
-            ASSERT(child->m_parent == this);
-          }
-
-          insertChildSorted(child);
+      // Use the entries read in background (or read them now)
+      FolderEntries entries;
+      if (m_listing && m_listing->version() == current_file_system_version)
+        entries = m_listing->wait();
+      else
+        entries = read_folder_entries(m_filename);
+      m_listing.reset();
+
+      for (const FolderEntry& entry : entries) {
+        std::string fullfn = base::join_path(m_filename, entry.name);
+
+        // We don't use get_fileitem_by_path() to avoid checking if
+        // each existent item is still there (we've just read it)
+        auto it = fileitems_map->find(get_key_for_filename(fullfn));
+        if (it == fileitems_map->end()) {
+          child = new FileItem(this);
+          child->m_filename = fullfn;
+          child->m_displayname = entry.name;
+          child->m_is_folder = entry.is_folder;
+
+          put_fileitem(child);
+        }
+        else {
+          child = it->second;
+          child->m_is_folder = entry.is_folder;
+          ASSERT(child->m_parent == this);
         }
-        closedir(dir);
+
+        child->m_removed = false;
+        newChildren.push_back(child);
       }
     }
 #endif
 
     // check old file-items (maybe removed directories or file-items)
-    for (it=m_children.begin();
-         it!=m_children.end(); ) {
-      child = static_cast<FileItem*>(*it);
+    FileItemList oldChildren;
+    std::swap(oldChildren, m_children);
+    for (auto item : oldChildren) {
+      child = static_cast<FileItem*>(item);
       ASSERT(child);
 
       if (child && child->m_removed) {
-        it = m_children.erase(it);
         child->m_parent = nullptr;
         child->deleteItem();
       }
-      else
-        ++it;
     }
 
+    // Sort the new list just once (instead of inserting each item in
+    // its sorted position, which was O(n^2) for big folders)
+    std::sort(newChildren.begin(), newChildren.end(),
+              [](const IFileItem* a, const IFileItem* b){
+                return (*static_cast<const FileItem*>(a) <
+                        *static_cast<const FileItem*>(b));
+              });
+    newChildren.erase(std::unique(newChildren.begin(), newChildren.end()),
+                      newChildren.end());
+    m_children = std::move(newChildren);
+
     // now this file-item is updated
     m_version = current_file_system_version;
   }
@@ -575,12 +676,30 @@ const FileItemList& FileItem::children()
   return m_children;
 }
 
+bool FileItem::prefetchChildren()
+{
+  if (!isFolder() || !isChildrenListOutdated())
+    return true;
+
+#ifdef _WIN32
+  // Shell folders are enumerated in the UI thread
+  return true;
+#else
+  if (!m_listing || m_listing->version() != current_file_system_version)
+    m_listing = FolderListing::start(m_filename, current_file_system_version);
+  return m_listing->isReady();
+#endif
+}
+
 void FileItem::createDirectory(const std::string& dirname)
 {
   base::make_directory(base::join_path(m_filename, dirname));
 
   // Invalidate the children list.
   m_version = 0;
+#ifndef _WIN32
+  m_listing.reset();
+#endif
 }
 
 bool FileItem::hasExtension(const base::paths& extensions)
@@ -647,23 +766,13 @@ FileItem::~FileItem()
 #endif
 }
 
-void FileItem::insertChildSorted(FileItem* child)
+bool FileItem::isChildrenListOutdated() const
 {
-  // this file-item wasn't removed from the last lookup
-  child->m_removed = false;
-
-  // if the fileitem is already in the list we can go back
-  if (std::find(m_children.begin(), m_children.end(), child) != m_children.end())
-    return;
-
-  for (auto it=m_children.begin(), end=m_children.end(); it!=end; ++it) {
-    if (*child < *static_cast<FileItem*>(*it)) {
-      m_children.insert(it, child);
-      return;
-    }
-  }
-
-  m_children.push_back(child);
+  // if the children list is empty, or the file-system version
+  // change (it's like to say: the current m_children list
+  // is outdated)...
+  return (m_children.empty() ||
+          current_file_system_version > m_version);
 }
 
 int FileItem::compare(const FileItem& that) const
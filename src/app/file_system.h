@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -80,6 +80,13 @@ namespace app {
 
     virtual IFileItem* parent() const = 0;
     virtual const FileItemList& children() = 0;
+
+    // Starts reading the children of this folder in a background
+    // thread (if the list is outdated). Returns true if children()
+    // can be called without blocking, so the UI can wait for slow
+    // folders (e.g. network shares) calling this function again.
+    virtual bool prefetchChildren() = 0;
+
     virtual void createDirectory(const std::string& dirname) = 0;
 
     virtual bool hasExtension(const base::paths& extensions) = 0;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019 Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -9,6 +9,7 @@
 #include "config.h"
 #endif
 
+#include "app/util/render_frames.h"
 #include "doc/cel.h"
 #include "doc/frame.h"
 #include "doc/image.h"
@@ -31,28 +32,39 @@ LayerImage* create_flatten_layer_copy(Sprite* dstSprite, const Layer* srcLayer,
                                       const bool newBlend)
 {
   std::unique_ptr<LayerImage> flatLayer(new LayerImage(dstSprite));
-  render::Render render;
-  render.setNewBlend(newBlend);
+  const PixelFormat pixelFormat = flatLayer->sprite()->pixelFormat();
 
-  for (frame_t frame=frmin; frame<=frmax; ++frame) {
-    // Does this frame have cels to render?
-    if (has_cels(srcLayer, frame)) {
-      // Create a new image to render each frame.
-      ImageRef image(Image::create(flatLayer->sprite()->pixelFormat(), bounds.w, bounds.h));
+  // Each frame is rendered in a different thread, and the cels are
+  // added to the output layer in frame order.
+  render_frames_in_parallel(
+    frmin, frmax,
+    [&](const frame_t frame) -> ImageRef {
+      // Does this frame have cels to render?
+      if (!has_cels(srcLayer, frame))
+        return nullptr;
 
-      // Create the new cel for the output layer.
-      std::unique_ptr<Cel> cel(new Cel(frame, image));
-      cel->setPosition(bounds.x, bounds.y);
+      // Create a new image to render each frame.
+      ImageRef image(Image::create(pixelFormat, bounds.w, bounds.h));
 
       // Render this frame.
+      render::Render render;
+      render.setNewBlend(newBlend);
       render.renderLayer(image.get(), srcLayer, frame,
         gfx::Clip(0, 0, bounds));
+      return image;
+    },
+    [&](const frame_t frame, ImageRef&& image) {
+      if (!image)
+        return;
+
+      // Create the new cel for the output layer.
+      std::unique_ptr<Cel> cel(new Cel(frame, image));
+      cel->setPosition(bounds.x, bounds.y);
 
       // Add the cel (and release the std::unique_ptr).
       flatLayer->addCel(cel.get());
       cel.release();
-    }
-  }
+    });
 
   return flatLayer.release();
 }
@@ -23,6 +23,7 @@
 #include "app/modules/gui.h"
 #include "app/modules/palettes.h"
 #include "app/pref/preferences.h"
+#include "app/startup_trace.h"
 #include "app/tools/ink.h"
 #include "app/tools/tool_box.h"
 #include "app/ui/editor/editor.h"
@@ -201,8 +202,11 @@ int init_module_gui()
   manager = new CustomizedGuiManager(main_window);
 
   // Setup the GUI theme for all widgets
-  gui_theme = new SkinTheme;
-  ui::set_theme(gui_theme, pref.general.uiScale());
+  {
+    StartupTrace span("ui skin");
+    gui_theme = new SkinTheme;
+    ui::set_theme(gui_theme, pref.general.uiScale());
+  }
 
   if (maximized)
     main_window->maximize();
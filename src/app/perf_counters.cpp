@@ -0,0 +1,80 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/perf_counters.h"
+
+#include "fmt/format.h"
+#include "render/render_counters.h"
+
+namespace app {
+
+using render::RenderCounters;
+
+// static
+int64_t PerfCounters::get(const Counter counter)
+{
+  int64_t value = m_values[counter].load(std::memory_order_relaxed);
+  switch (counter) {
+    case PixelsComposited:
+      value += RenderCounters::get(RenderCounters::PixelsComposited);
+      break;
+    case CelsRendered:
+      value += RenderCounters::get(RenderCounters::CelsRendered);
+      break;
+    case CacheHits:
+      value += RenderCounters::get(RenderCounters::CacheHits);
+      break;
+    case CacheMisses:
+      value += RenderCounters::get(RenderCounters::CacheMisses);
+      break;
+    default:
+      break;
+  }
+  return value;
+}
+
+// static
+const char* PerfCounters::name(const Counter counter)
+{
+  static const char* names[] = {
+    "pixelsComposited",
+    "celsRendered",
+    "cacheHits",
+    "cacheMisses",
+    "bytesCompressed",
+    "undoBytes",
+    "lockWaitTime",
+  };
+  static_assert(sizeof(names) / sizeof(names[0]) == kCounters,
+                "A name is needed for each counter");
+  return names[counter];
+}
+
+// static
+void PerfCounters::reset()
+{
+  for (auto& value : m_values)
+    value = 0;
+  RenderCounters::reset();
+}
+
+// static
+std::string PerfCounters::report()
+{
+  std::string result;
+  for (int i=0; i<kCounters; ++i) {
+    result += fmt::format("{} {}\n",
+                          name(Counter(i)),
+                          get(Counter(i)));
+  }
+  return result;
+}
+
+} // namespace app
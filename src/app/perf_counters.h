@@ -0,0 +1,58 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_PERF_COUNTERS_H_INCLUDED
+#define APP_PERF_COUNTERS_H_INCLUDED
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace app {
+
+  // Cumulative counters of the work done by the program (pixels
+  // composited, compressed bytes, etc.) since it started (or the
+  // last reset()). They can be read from scripts (app.perf) or
+  // printed at exit with --perf-report, so a CI job can detect
+  // regressions comparing deterministic values instead of wall-time.
+  //
+  // The rendering counters are taken from render::RenderCounters.
+  class PerfCounters {
+  public:
+    enum Counter {
+      PixelsComposited,
+      CelsRendered,
+      CacheHits,                // Group cache + layer boundaries cache
+      CacheMisses,
+      BytesCompressed,          // Input bytes of zlib compression
+      UndoBytes,                // Memory of all undo states added
+      LockWaitTime,             // Microseconds waiting in Doc locks
+      kCounters
+    };
+
+    static void add(const Counter counter, const int64_t value) {
+      m_values[counter].fetch_add(value, std::memory_order_relaxed);
+    }
+
+    static int64_t get(const Counter counter);
+
+    // Name of the counter used in app.perf and --perf-report
+    // (e.g. "pixelsComposited")
+    static const char* name(const Counter counter);
+
+    static void reset();
+
+    // Returns one "name value" line for each counter
+    static std::string report();
+
+  private:
+    static inline std::atomic<int64_t> m_values[kCounters] = { };
+  };
+
+} // namespace app
+
+#endif
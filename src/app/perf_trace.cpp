@@ -0,0 +1,130 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/perf_trace.h"
+
+#include "base/fstream_path.h"
+#include "base/log.h"
+
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace app {
+
+namespace {
+
+struct Span {
+  const char* category;
+  const char* name;
+  PerfTrace::Clock::time_point start;
+  PerfTrace::Clock::duration duration;
+  std::thread::id thread;
+};
+
+std::mutex g_mutex;
+PerfTrace::Clock::time_point g_start;
+std::thread::id g_mainThread;
+std::vector<Span> g_spans;
+int g_discarded = 0;
+
+} // anonymous namespace
+
+std::atomic<bool> PerfTrace::s_enabled(false);
+
+// static
+void PerfTrace::start()
+{
+  const std::lock_guard lock(g_mutex);
+  g_spans.clear();
+  g_discarded = 0;
+  g_start = Clock::now();
+  g_mainThread = std::this_thread::get_id();
+  s_enabled = true;
+}
+
+// static
+bool PerfTrace::stop(const std::string& filename)
+{
+  const std::lock_guard lock(g_mutex);
+  if (!s_enabled)
+    return false;
+
+  s_enabled = false;
+
+  if (g_discarded > 0) {
+    LOG(WARNING, "APP: %d trace spans were discarded (more than %d spans)\n",
+        g_discarded, kMaxEvents);
+  }
+
+  // Each thread is identified with a number (1 for the main thread)
+  std::vector<std::thread::id> threads = { g_mainThread };
+  auto tid = [&threads](const std::thread::id id) {
+    auto it = std::find(threads.begin(), threads.end(), id);
+    if (it != threads.end())
+      return int(it - threads.begin()) + 1;
+    threads.push_back(id);
+    return int(threads.size());
+  };
+
+  std::ofstream f(FSTREAM_PATH(filename), std::ios::out);
+  if (!f) {
+    LOG(ERROR, "APP: Cannot write trace to '%s'\n", filename.c_str());
+    g_spans.clear();
+    return false;
+  }
+
+  using std::chrono::duration_cast;
+  using std::chrono::microseconds;
+
+  f << "{ \"traceEvents\": [";
+  bool first = true;
+  for (const Span& span : g_spans) {
+    if (first)
+      first = false;
+    else
+      f << ",";
+
+    f << "\n  { \"name\": \"" << span.name << "\""
+      << ", \"cat\": \"" << span.category << "\""
+      << ", \"ph\": \"X\""
+      << ", \"ts\": " << duration_cast<microseconds>(span.start - g_start).count()
+      << ", \"dur\": " << duration_cast<microseconds>(span.duration).count()
+      << ", \"pid\": 1"
+      << ", \"tid\": " << tid(span.thread) << " }";
+  }
+  f << "\n],\n"
+    << "\"displayTimeUnit\": \"ms\" }\n";
+
+  g_spans.clear();
+  return bool(f);
+}
+
+// static
+void PerfTrace::addSpan(const char* category,
+                        const char* name,
+                        const Clock::time_point start,
+                        const Clock::time_point end)
+{
+  const std::lock_guard lock(g_mutex);
+  // Check again as the trace could be stopped after the span started
+  if (!s_enabled)
+    return;
+
+  if (g_spans.size() < kMaxEvents)
+    g_spans.push_back({ category, name, start, end - start,
+                        std::this_thread::get_id() });
+  else
+    ++g_discarded;
+}
+
+} // namespace app
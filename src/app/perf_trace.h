@@ -0,0 +1,89 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_PERF_TRACE_H_INCLUDED
+#define APP_PERF_TRACE_H_INCLUDED
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+namespace app {
+
+  // Records the wall-time of hot paths (rendering, file operations,
+  // backups, filters, sprite sheet export, tool loops, scripts) and
+  // saves them in the Chrome trace-event format (which can be opened
+  // with chrome://tracing or https://ui.perfetto.dev/).
+  //
+  // It can be enabled for the whole session with --trace <file.json>,
+  // or toggled at runtime with the [perf] trace option, e.g. from the
+  // developer console:
+  //
+  //   app.preferences.perf.trace = true
+  //   ...
+  //   app.preferences.perf.trace = false -- Saves the trace
+  //
+  // When it's disabled, a span costs just a relaxed atomic load.
+  //
+  // Usage:
+  //
+  //   {
+  //     PerfTrace span("render", "SimpleRenderer::renderSprite");
+  //     ... code to measure ...
+  //   }
+  //
+  // The category and name must be string literals (only the
+  // pointers are stored).
+  class PerfTrace {
+  public:
+    typedef std::chrono::steady_clock Clock;
+
+    // Maximum number of recorded spans (new spans are discarded
+    // when this limit is reached)
+    static constexpr int kMaxEvents = 1024*1024;
+
+    PerfTrace(const char* category, const char* name)
+      : m_category(isEnabled() ? category: nullptr)
+      , m_name(name) {
+      if (m_category)
+        m_start = Clock::now();
+    }
+
+    ~PerfTrace() {
+      if (m_category)
+        addSpan(m_category, m_name, m_start, Clock::now());
+    }
+
+    static bool isEnabled() {
+      return s_enabled.load(std::memory_order_relaxed);
+    }
+
+    // Discards the previous spans and starts recording new ones.
+    static void start();
+
+    // Stops recording and saves the recorded spans in the given file.
+    static bool stop(const std::string& filename);
+
+    // Adds a span that was already measured (e.g. to use a name that
+    // is known only when the span ends). Does nothing if the trace
+    // is disabled.
+    static void addSpan(const char* category,
+                        const char* name,
+                        const Clock::time_point start,
+                        const Clock::time_point end);
+
+  private:
+    static std::atomic<bool> s_enabled;
+
+    const char* m_category;
+    const char* m_name;
+    Clock::time_point m_start;
+  };
+
+} // namespace app
+
+#endif
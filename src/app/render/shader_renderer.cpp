@@ -13,13 +13,22 @@
 #if SK_ENABLE_SKSL && ENABLE_DEVMODE // TODO remove ENABLE_DEVMODE when the ShaderRenderer is ready
 
 #include "app/color_utils.h"
+#include "app/perf_trace.h"
 #include "app/util/shader_helpers.h"
+#include "base/log.h"
+#include "doc/layer_tilemap.h"
+#include "doc/playback.h"
 #include "doc/render_plan.h"
 #include "os/skia/skia_surface.h"
 
+#include "include/core/SkBlender.h"
 #include "include/core/SkCanvas.h"
+#include "include/core/SkColorFilter.h"
 #include "include/effects/SkRuntimeEffect.h"
 
+#include <algorithm>
+#include <cstdlib>
+
 namespace app {
 
 using namespace doc;
@@ -55,6 +64,62 @@ half4 main(vec2 fragcoord) {
 }
 )";
 
+// Blenders for the non-standard Skia blend modes. They use the
+// separable blend mode formula of the W3C compositing spec (same as
+// the rgba_blender_subtract/divide functions).
+const char* kSubtractBlenderCode = R"(
+half4 main(half4 src, half4 dst) {
+ half3 cs = (src.a > 0 ? src.rgb / src.a: half3(0));
+ half3 cb = (dst.a > 0 ? dst.rgb / dst.a: half3(0));
+ half3 b = max(cb - cs, 0);
+ return half4((1 - dst.a)*src.rgb + (1 - src.a)*dst.rgb + src.a*dst.a*b,
+              src.a + dst.a*(1 - src.a));
+}
+)";
+
+const char* kDivideBlenderCode = R"(
+half divide(half cb, half cs) {
+ if (cb == 0) return 0;
+ if (cs == 0) return 1;
+ return min(1, cb / cs);
+}
+
+half4 main(half4 src, half4 dst) {
+ half3 cs = (src.a > 0 ? src.rgb / src.a: half3(0));
+ half3 cb = (dst.a > 0 ? dst.rgb / dst.a: half3(0));
+ half3 b = half3(divide(cb.r, cs.r),
+                 divide(cb.g, cs.g),
+                 divide(cb.b, cs.b));
+ return half4((1 - dst.a)*src.rgb + (1 - src.a)*dst.rgb + src.a*dst.a*b,
+              src.a + dst.a*(1 - src.a));
+}
+)";
+
+sk_sp<SkBlender> make_blender(const char* code)
+{
+  auto result = SkRuntimeEffect::MakeForBlender(SkString(code));
+  if (!result.errorText.isEmpty()) {
+    LOG(ERROR, "Error compiling blender: %s\n", result.errorText.c_str());
+    return nullptr;
+  }
+  return result.effect->makeBlender(nullptr);
+}
+
+// Same as rgba_blender_red_tint/blue_tint, the source color is
+// converted to its luma and mixed with red or blue.
+sk_sp<SkColorFilter> make_tint_filter(const bool red)
+{
+  const float r = 0.2126f/2, g = 0.7152f/2, b = 0.0722f/2;
+  const float red_offset = (red ? 0.5f: 0.0f);
+  const float blue_offset = (red ? 0.0f: 0.5f);
+  const float matrix[20] = {
+    r, g, b, 0, red_offset,
+    r, g, b, 0, 0,
+    r, g, b, 0, blue_offset,
+    0, 0, 0, 1, 0 };
+  return SkColorFilters::Matrix(matrix);
+}
+
 inline SkBlendMode to_skia(const doc::BlendMode bm) {
   switch (bm) {
     case doc::BlendMode::NORMAL: return SkBlendMode::kSrcOver;
@@ -74,8 +139,10 @@ inline SkBlendMode to_skia(const doc::BlendMode bm) {
     case doc::BlendMode::HSL_COLOR: return SkBlendMode::kColor;
     case doc::BlendMode::HSL_LUMINOSITY: return SkBlendMode::kLuminosity;
     case doc::BlendMode::ADDITION: return SkBlendMode::kPlus;
-    case doc::BlendMode::SUBTRACT: break; // TODO
-    case doc::BlendMode::DIVIDE: break; // TODO
+    case doc::BlendMode::DST_OVER: return SkBlendMode::kDstOver;
+    // SUBTRACT, DIVIDE, and RED/BLUE_TINT are handled in
+    // ShaderRenderer::setPaintBlendMode()
+    default: break;
   }
   return SkBlendMode::kSrc;
 }
@@ -90,23 +157,34 @@ ShaderRenderer::ShaderRenderer()
   m_bgEffect = make_shader(kBgShaderCode);
   m_indexedEffect = make_shader(kIndexedShaderCode);
   m_grayscaleEffect = make_shader(kGrayscaleShaderCode);
+  m_subtractBlender = make_blender(kSubtractBlenderCode);
+  m_divideBlender = make_blender(kDivideBlenderCode);
+
+  // The background is rendered on the screen (renderBgOnScreen),
+  // so the fallback renderer must not render it
+  m_fallback.setBgOptions(render::BgOptions::MakeTransparent());
 }
 
 ShaderRenderer::~ShaderRenderer() = default;
 
 void ShaderRenderer::setRefLayersVisiblity(const bool visible)
 {
-  // TODO impl
+  m_showRefLayers = visible;
+  m_fallback.setRefLayersVisiblity(visible);
 }
 
 void ShaderRenderer::setNonactiveLayersOpacity(const int opacity)
 {
-  // TODO impl
+  m_nonactiveLayersOpacity = opacity;
+  m_fallback.setNonactiveLayersOpacity(opacity);
 }
 
 void ShaderRenderer::setNewBlendMethod(const bool newBlend)
 {
-  // TODO impl
+  // Skia blend modes are equal to the new blend method, the old one
+  // is rendered with the fallback renderer
+  m_newBlendMethod = newBlend;
+  m_fallback.setNewBlendMethod(newBlend);
 }
 
 void ShaderRenderer::setBgOptions(const render::BgOptions& bg)
@@ -117,11 +195,13 @@ void ShaderRenderer::setBgOptions(const render::BgOptions& bg)
 void ShaderRenderer::setProjection(const render::Projection& projection)
 {
   m_proj = projection;
+  m_fallback.setProjection(projection);
 }
 
 void ShaderRenderer::setSelectedLayer(const doc::Layer* layer)
 {
-  // TODO impl
+  m_selectedLayerForOpacity = layer;
+  m_fallback.setSelectedLayer(layer);
 }
 
 void ShaderRenderer::setPreviewImage(const doc::Layer* layer,
@@ -137,12 +217,14 @@ void ShaderRenderer::setPreviewImage(const doc::Layer* layer,
   m_previewTileset = tileset;
   m_previewPos = pos;
   m_previewBlendMode = blendMode;
+  m_fallback.setPreviewImage(layer, frame, image, tileset, pos, blendMode);
 }
 
 void ShaderRenderer::removePreviewImage()
 {
   m_previewImage = nullptr;
   m_previewTileset = nullptr;
+  m_fallback.removePreviewImage();
 }
 
 void ShaderRenderer::setExtraImage(render::ExtraType type,
@@ -152,22 +234,34 @@ void ShaderRenderer::setExtraImage(render::ExtraType type,
                                    const doc::Layer* currentLayer,
                                    const doc::frame_t currentFrame)
 {
-  // TODO impl
+  m_extraType = type;
+  m_extraCel = cel;
+  m_extraImage = image;
+  m_extraBlendMode = blendMode;
+  m_currentLayer = currentLayer;
+  m_currentFrame = currentFrame;
+  m_fallback.setExtraImage(type, cel, image, blendMode,
+                           currentLayer, currentFrame);
 }
 
 void ShaderRenderer::removeExtraImage()
 {
-  // TODO impl
+  m_extraType = render::ExtraType::NONE;
+  m_extraCel = nullptr;
+  m_extraImage = nullptr;
+  m_fallback.removeExtraImage();
 }
 
 void ShaderRenderer::setOnionskin(const render::OnionskinOptions& options)
 {
-  // TODO impl
+  m_onionskin = options;
+  m_fallback.setOnionskin(options);
 }
 
 void ShaderRenderer::disableOnionskin()
 {
-  // TODO impl
+  m_onionskin.type(render::OnionskinType::NONE);
+  m_fallback.disableOnionskin();
 }
 
 void ShaderRenderer::renderSprite(os::Surface* dstSurface,
@@ -175,6 +269,13 @@ void ShaderRenderer::renderSprite(os::Surface* dstSurface,
                                   const doc::frame_t frame,
                                   const gfx::ClipF& area)
 {
+  if (useFallback()) {
+    m_fallback.renderSprite(dstSurface, sprite, frame, area);
+    return;
+  }
+
+  PerfTrace span("render", "ShaderRenderer::renderSprite");
+
   m_sprite = sprite;
 
   // Copy the current color palette to a 256 palette (so all entries
@@ -210,21 +311,130 @@ void ShaderRenderer::renderSprite(os::Surface* dstSurface,
 
     RenderPlan plan;
     plan.addLayer(sprite->root(), frame);
-    renderPlan(canvas, sprite, plan, frame, area);
+
+    m_globalOpacity = 255;
+    if (m_onionskin.position() == render::OnionskinPosition::BEHIND) {
+      // Background layer - Onion skin behind the sprite - Transparent layers
+      renderPlan(canvas, sprite, plan, frame, area, true, false);
+      renderOnionskin(canvas, sprite, frame, area);
+      renderPlan(canvas, sprite, plan, frame, area, false, true);
+    }
+    else {
+      renderPlan(canvas, sprite, plan, frame, area);
+      renderOnionskin(canvas, sprite, frame, area);
+    }
+
+    // Overlay preview image
+    if (m_previewImage &&
+        m_selectedLayer == nullptr &&
+        m_selectedFrame == frame) {
+      drawImage(canvas, m_previewImage,
+                m_previewPos.x, m_previewPos.y,
+                255, m_previewBlendMode);
+    }
   }
   canvas->restore();
 }
 
+void ShaderRenderer::renderOnionskin(SkCanvas* canvas,
+                                     const doc::Sprite* sprite,
+                                     const doc::frame_t frame,
+                                     const gfx::ClipF& area)
+{
+  if (m_onionskin.type() == render::OnionskinType::NONE)
+    return;
+
+  Tag* loop = m_onionskin.loopTag();
+  Layer* onionLayer = (m_onionskin.layer() ? m_onionskin.layer():
+                                             sprite->root());
+  Playback play(
+    sprite,
+    TagsList(),
+    frame,
+    loop ? Playback::PlayInLoop : Playback::PlayAll,
+    loop);
+  frame_t prevFrames = (loop ? m_onionskin.prevFrames():
+                               std::min(frame, m_onionskin.prevFrames()));
+  play.nextFrame(-prevFrames);
+
+  for (frame_t frameOut = frame - prevFrames;
+       frameOut <= frame + m_onionskin.nextFrames();
+       ++frameOut, play.nextFrame()) {
+    const frame_t frameIn = play.frame();
+    if (frameIn == frame ||
+        frameIn < 0 ||
+        frameIn > sprite->lastFrame()) {
+      continue;
+    }
+
+    m_globalOpacity =
+      m_onionskin.opacityBase() -
+      m_onionskin.opacityStep() * (std::abs(frameOut - frame)-1);
+    m_globalOpacity = std::clamp(m_globalOpacity, 0, 255);
+    if (m_globalOpacity == 0)
+      continue;
+
+    BlendMode blendMode = BlendMode::UNSPECIFIED;
+    if (m_onionskin.type() == render::OnionskinType::MERGE)
+      blendMode = BlendMode::NORMAL;
+    else if (m_onionskin.type() == render::OnionskinType::RED_BLUE_TINT)
+      blendMode = (frameOut < frame ? BlendMode::RED_TINT: BlendMode::BLUE_TINT);
+
+    RenderPlan plan;
+    plan.addLayer(onionLayer, frameIn);
+    renderPlan(canvas, sprite, plan, frameIn, area,
+               // Render background only for "in-front" onion skinning and
+               // when opacity is < 255
+               (m_globalOpacity < 255 &&
+                m_onionskin.position() == render::OnionskinPosition::INFRONT),
+               true, blendMode);
+  }
+  m_globalOpacity = 255;
+}
+
 void ShaderRenderer::renderPlan(SkCanvas* canvas,
                                 const doc::Sprite* sprite,
                                 const doc::RenderPlan& plan,
                                 const doc::frame_t frame,
-                                const gfx::ClipF& area)
+                                const gfx::ClipF& area,
+                                const bool render_background,
+                                const bool render_transparent,
+                                const doc::BlendMode blendMode)
 {
   for (const auto& item : plan.items()) {
     const Cel* cel = item.cel;
     const Layer* layer = item.layer;
 
+    if ((layer->isBackground() && !render_background) ||
+        (!layer->isBackground() && !render_transparent))
+      continue;
+
+    if (!m_showRefLayers && layer->isReference())
+      continue;
+
+    const bool isSelected = (m_selectedLayerForOpacity == layer);
+    const doc::BlendMode layerBlendMode =
+      (blendMode == BlendMode::UNSPECIFIED ?
+       static_cast<const LayerImage*>(layer)->blendMode(): blendMode);
+
+    // Check if we have to draw the extra cel in this layer/frame (or
+    // in a linked frame)
+    bool drawExtra = false;
+    if (m_extraCel &&
+        m_extraImage &&
+        layer == m_currentLayer &&
+        m_extraImage->pixelFormat() != IMAGE_TILEMAP) {
+      if (frame == m_extraCel->frame() &&
+          frame == m_currentFrame) {
+        drawExtra = true;
+      }
+      else {
+        const Cel* cel2 = layer->cel(m_extraCel->frame());
+        if (cel && cel2 && cel->data() == cel2->data())
+          drawExtra = true;
+      }
+    }
+
     switch (layer->type()) {
 
       case doc::ObjectType::LayerImage: {
@@ -255,13 +465,35 @@ void ShaderRenderer::renderPlan(SkCanvas* canvas,
           int t;
           int opacity = cel->opacity();
           opacity = MUL_UN8(opacity, imgLayer->opacity(), t);
-
+          opacity = MUL_UN8(opacity, m_globalOpacity, t);
+          if (!isSelected && m_nonactiveLayersOpacity != 255)
+            opacity = MUL_UN8(opacity, m_nonactiveLayersOpacity, t);
+
+          // Draw parts outside the "m_extraCel" area
+          canvas->save();
+          if (drawExtra && m_extraType == render::ExtraType::PATCH) {
+            const gfx::Rect rc = m_extraCel->bounds();
+            canvas->clipRect(SkRect::MakeXYWH(rc.x, rc.y, rc.w, rc.h),
+                             SkClipOp::kDifference);
+          }
           drawImage(canvas,
                     celImage,
                     celBounds.x,
                     celBounds.y,
                     opacity,
-                    imgLayer->blendMode());
+                    layerBlendMode);
+          canvas->restore();
+
+          // Composite the current cel a second time with the extra
+          // blend mode
+          if (drawExtra && m_extraType == render::ExtraType::OVER_COMPOSITE) {
+            drawImage(canvas,
+                      celImage,
+                      celBounds.x,
+                      celBounds.y,
+                      opacity,
+                      m_extraBlendMode);
+          }
         }
         break;
       }
@@ -327,13 +559,16 @@ void ShaderRenderer::renderPlan(SkCanvas* canvas,
               int t;
               int opacity = cel->opacity();
               opacity = MUL_UN8(opacity, tilemapLayer->opacity(), t);
+              opacity = MUL_UN8(opacity, m_globalOpacity, t);
+              if (!isSelected && m_nonactiveLayersOpacity != 255)
+                opacity = MUL_UN8(opacity, m_nonactiveLayersOpacity, t);
 
               drawImage(canvas,
                         tileImage.get(),
                         tileBoundsOnCanvas.x,
                         tileBoundsOnCanvas.y,
                         opacity,
-                        tilemapLayer->blendMode());
+                        layerBlendMode);
             }
           }
         }
@@ -345,6 +580,19 @@ void ShaderRenderer::renderPlan(SkCanvas* canvas,
         break;
     }
 
+    // Draw extras
+    if (drawExtra &&
+        m_extraType != render::ExtraType::NONE &&
+        m_extraType != render::ExtraType::OVER_COMPOSITE &&
+        m_extraCel->opacity() > 0) {
+      const gfx::Rect rc = m_extraCel->bounds();
+      drawImage(canvas,
+                m_extraImage,
+                rc.x, rc.y,
+                m_extraCel->opacity(),
+                m_extraBlendMode);
+    }
+
     if (layer == m_bgLayer) {
       afterBackgroundLayerIsPainted();
     }
@@ -396,7 +644,10 @@ void ShaderRenderer::renderImage(doc::Image* dstImage,
                                  const int opacity,
                                  const doc::BlendMode blendMode)
 {
-  // TODO impl
+  // The destination is not a surface, so there is nothing to do
+  // with shaders here
+  m_fallback.renderImage(dstImage, srcImage, pal,
+                         x, y, opacity, blendMode);
 }
 
 void ShaderRenderer::drawImage(SkCanvas* canvas,
@@ -413,7 +664,7 @@ void ShaderRenderer::drawImage(SkCanvas* canvas,
     case doc::ColorMode::RGB: {
       SkPaint p;
       p.setAlpha(opacity);
-      p.setBlendMode(to_skia(blendMode));
+      setPaintBlendMode(p, blendMode);
       canvas->drawImage(skImg.get(),
                         SkIntToScalar(x),
                         SkIntToScalar(y),
@@ -428,7 +679,7 @@ void ShaderRenderer::drawImage(SkCanvas* canvas,
 
       SkPaint p;
       p.setAlpha(opacity);
-      p.setBlendMode(to_skia(blendMode));
+      setPaintBlendMode(p, blendMode);
       p.setStyle(SkPaint::kFill_Style);
       p.setShader(builder.makeShader());
 
@@ -461,7 +712,7 @@ void ShaderRenderer::drawImage(SkCanvas* canvas,
 
       SkPaint p;
       p.setAlpha(opacity);
-      p.setBlendMode(to_skia(blendMode));
+      setPaintBlendMode(p, blendMode);
       p.setStyle(SkPaint::kFill_Style);
       p.setShader(builder.makeShader());
 
@@ -477,6 +728,45 @@ void ShaderRenderer::drawImage(SkCanvas* canvas,
   }
 }
 
+void ShaderRenderer::setPaintBlendMode(SkPaint& paint,
+                                       const doc::BlendMode blendMode)
+{
+  switch (blendMode) {
+    case doc::BlendMode::SUBTRACT:
+      if (m_subtractBlender) {
+        paint.setBlender(m_subtractBlender);
+        return;
+      }
+      break;
+    case doc::BlendMode::DIVIDE:
+      if (m_divideBlender) {
+        paint.setBlender(m_divideBlender);
+        return;
+      }
+      break;
+    case doc::BlendMode::RED_TINT:
+    case doc::BlendMode::BLUE_TINT:
+      paint.setColorFilter(
+        make_tint_filter(blendMode == doc::BlendMode::RED_TINT));
+      paint.setBlendMode(SkBlendMode::kSrcOver);
+      return;
+    default:
+      break;
+  }
+  paint.setBlendMode(to_skia(blendMode));
+}
+
+// Returns true if the sprite must be rendered with m_fallback as
+// the shaders don't support some of the current options yet.
+bool ShaderRenderer::useFallback() const
+{
+  return (!m_newBlendMethod ||
+          (m_extraCel &&
+           m_extraImage &&
+           m_extraType != render::ExtraType::NONE &&
+           m_extraImage->pixelFormat() == IMAGE_TILEMAP));
+}
+
 // TODO this is equal to Render::checkIfWeShouldUsePreview(const Cel*),
 //      we might think in a way to merge both functions
 bool ShaderRenderer::checkIfWeShouldUsePreview(const doc::Cel* cel) const
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -11,11 +11,14 @@
 #if SK_ENABLE_SKSL
 
 #include "app/render/renderer.h"
+#include "app/render/simple_renderer.h"
 #include "doc/palette.h"
 
 #include "include/core/SkRefCnt.h"
 
+class SkBlender;
 class SkCanvas;
+class SkPaint;
 class SkRuntimeEffect;
 
 namespace doc {
@@ -27,6 +30,10 @@ namespace app {
   // Use SkSL to compose images with Skia shaders on the CPU (with the
   // SkSL VM) or GPU-accelerated (with native OpenGL/Metal/etc. shaders).
   //
+  // Features that are not supported by the shaders yet (the old
+  // blend method, tilemap extra cels, and rendering in doc::Image
+  // with renderImage()) are rendered with a SimpleRenderer.
+  //
   // TODO This is an ongoing effort, not yet ready for production, and
   //      only accessible when ENABLE_DEVMODE is defined.
   class ShaderRenderer : public Renderer {
@@ -80,14 +87,24 @@ namespace app {
                     const doc::Sprite* sprite,
                     const doc::RenderPlan& plan,
                     const doc::frame_t frame,
-                    const gfx::ClipF& area);
+                    const gfx::ClipF& area,
+                    const bool render_background = true,
+                    const bool render_transparent = true,
+                    const doc::BlendMode blendMode = doc::BlendMode::UNSPECIFIED);
+    void renderOnionskin(SkCanvas* canvas,
+                         const doc::Sprite* sprite,
+                         const doc::frame_t frame,
+                         const gfx::ClipF& area);
     void drawImage(SkCanvas* canvas,
                    const doc::Image* srcImage,
                    const int x,
                    const int y,
                    const int opacity,
                    const doc::BlendMode blendMode);
+    void setPaintBlendMode(SkPaint& paint,
+                           const doc::BlendMode blendMode);
 
+    bool useFallback() const;
     bool checkIfWeShouldUsePreview(const doc::Cel* cel) const;
     void afterBackgroundLayerIsPainted();
 
@@ -97,6 +114,8 @@ namespace app {
     sk_sp<SkRuntimeEffect> m_bgEffect;
     sk_sp<SkRuntimeEffect> m_indexedEffect;
     sk_sp<SkRuntimeEffect> m_grayscaleEffect;
+    sk_sp<SkBlender> m_subtractBlender;
+    sk_sp<SkBlender> m_divideBlender;
     const doc::Sprite* m_sprite = nullptr;
     const doc::LayerImage* m_bgLayer = nullptr;
     // TODO these members are the same as in render::Render, we should
@@ -107,6 +126,22 @@ namespace app {
     const doc::Tileset* m_previewTileset = nullptr;
     gfx::Point m_previewPos;
     doc::BlendMode m_previewBlendMode = doc::BlendMode::NORMAL;
+    bool m_showRefLayers = false;
+    int m_nonactiveLayersOpacity = 255;
+    const doc::Layer* m_selectedLayerForOpacity = nullptr;
+    render::ExtraType m_extraType = render::ExtraType::NONE;
+    const doc::Cel* m_extraCel = nullptr;
+    const doc::Image* m_extraImage = nullptr;
+    doc::BlendMode m_extraBlendMode = doc::BlendMode::NORMAL;
+    const doc::Layer* m_currentLayer = nullptr;
+    doc::frame_t m_currentFrame = 0;
+    render::OnionskinOptions m_onionskin = render::OnionskinOptions(render::OnionskinType::NONE);
+    int m_globalOpacity = 255;
+    bool m_newBlendMethod = true;
+
+    // Used to render what the shaders don't support yet (see
+    // useFallback()), it receives the same options as this renderer.
+    SimpleRenderer m_fallback;
 
     // Palette of 256 colors (useful for the indexed shader to set all
     // colors outside the valid range as transparent RGBA=0 values)
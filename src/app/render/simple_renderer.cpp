@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -10,8 +10,15 @@
 
 #include "app/render/simple_renderer.h"
 
+#include "app/perf_trace.h"
+#include "app/pref/preferences.h"
 #include "app/ui/editor/editor_render.h"
+#include "app/ui/paint_profiler.h"
 #include "app/util/conversion_to_surface.h"
+#include "base/chrono.h"
+#include "render/render_stats.h"
+
+#include <algorithm>
 
 namespace app {
 
@@ -20,6 +27,27 @@ using namespace doc;
 SimpleRenderer::SimpleRenderer()
 {
   m_properties.outputsUnpremultiplied = true;
+
+  // Render big areas using several threads (each thread renders a
+  // different tile of the destination area).
+  if (Preferences::instance().experimental.parallelRender())
+    m_render.setParallelTileSize(128);
+
+  // Composite unmodified layer groups as just one image
+  if (Preferences::instance().experimental.cacheLayerGroups())
+    m_render.setGroupCache(&m_groupCache);
+
+  // Composite unmodified onion skin frames as just one image
+  if (Preferences::instance().experimental.cacheOnionskinFrames())
+    m_render.setOnionskinCache(&m_onionskinCache);
+
+  // Render tilemaps copying rows of tiles from an atlas
+  if (Preferences::instance().experimental.tilemapAtlas())
+    m_render.setTileAtlas(&m_tileAtlas);
+
+  // Composite Normal layers over a premultiplied destination
+  if (Preferences::instance().experimental.premultipliedComposition())
+    m_render.setPremultipliedComposition(true);
 }
 
 void SimpleRenderer::setRefLayersVisiblity(const bool visible)
@@ -99,11 +127,33 @@ void SimpleRenderer::renderSprite(os::Surface* dstSurface,
                                   const doc::frame_t frame,
                                   const gfx::ClipF& area)
 {
+  PerfTrace span("render", "SimpleRenderer::renderSprite");
+
   ImageRef dstImage(Image::create(
                       IMAGE_RGB, area.size.w, area.size.h,
                       EditorRender::getRenderImageBuffer()));
-  m_render.renderSprite(dstImage.get(), sprite, frame, area);
 
+  // Split the rendering time in the stages of the paint profiler
+  if (PaintProfiler* profiler = PaintProfiler::activeInstance()) {
+    render::RenderStats stats;
+    base::Chrono chrono;
+    m_render.setStats(&stats);
+    m_render.renderSprite(dstImage.get(), sprite, frame, area);
+    m_render.setStats(nullptr);
+
+    const double elapsed = chrono.elapsed();
+    const double plan = stats.elapsed(render::RenderStats::Plan);
+    const double onionskin = stats.elapsed(render::RenderStats::Onionskin);
+    profiler->addStageTime(PaintProfiler::Stage::RenderPlan, plan);
+    profiler->addStageTime(PaintProfiler::Stage::Onionskin, onionskin);
+    profiler->addStageTime(PaintProfiler::Stage::Composite,
+                           std::max(0.0, elapsed - plan - onionskin));
+  }
+  else {
+    m_render.renderSprite(dstImage.get(), sprite, frame, area);
+  }
+
+  PaintProfiler::ScopedStage stage(PaintProfiler::Stage::SurfaceConversion);
   convert_image_to_surface(dstImage.get(), sprite->palette(frame),
                            dstSurface, 0, 0, 0, 0, area.size.w, area.size.h);
 }
@@ -112,6 +162,8 @@ void SimpleRenderer::renderCheckeredBackground(os::Surface* dstSurface,
                                                const doc::Sprite* sprite,
                                                const gfx::Clip& area)
 {
+  PaintProfiler::ScopedStage stage(PaintProfiler::Stage::Background);
+
   ImageRef dstImage(Image::create(
                       IMAGE_RGB, area.size.w, area.size.h,
                       EditorRender::getRenderImageBuffer()));
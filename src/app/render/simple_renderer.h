@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -9,6 +9,8 @@
 #pragma once
 
 #include "app/render/renderer.h"
+#include "render/group_cache.h"
+#include "render/tile_atlas.h"
 
 namespace app {
 
@@ -62,6 +64,9 @@ namespace app {
   private:
     Properties m_properties;
     render::Render m_render;
+    render::GroupCache m_groupCache;
+    render::GroupCache m_onionskinCache;
+    render::TileAtlas m_tileAtlas;
   };
 
 } // namespace app
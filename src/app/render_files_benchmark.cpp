@@ -0,0 +1,119 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/context.h"
+#include "app/doc.h"
+#include "app/file/file.h"
+#include "base/fs.h"
+#include "base/string.h"
+#include "doc/image.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+#include "fmt/format.h"
+#include "render/render.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Renders real .aseprite files (all the frames of each file) at
+// different zoom levels, to measure render optimizations with real
+// content instead of the synthetic documents of render_benchmark.
+//
+// The files are loaded from the directory specified in the
+// ASEPRITE_BENCHMARK_FILES environment variable, e.g.:
+//
+//   ASEPRITE_BENCHMARK_FILES=~/sprites ./render_files_benchmark
+
+using namespace app;
+using namespace doc;
+using namespace render;
+
+namespace {
+
+const int kZooms[] = { 25, 100, 400 };
+
+void BM_RenderFile(benchmark::State& state,
+                   Context* ctx,
+                   const std::string& filename,
+                   const int zoomPercent)
+{
+  std::unique_ptr<Doc> doc(load_document(ctx, filename));
+  if (!doc) {
+    state.SkipWithError("Error loading the file");
+    return;
+  }
+
+  const Sprite* spr = doc->sprite();
+  const Zoom zoom = (zoomPercent >= 100 ? Zoom(zoomPercent / 100, 1):
+                                          Zoom(1, 100 / zoomPercent));
+  const int w = std::max(1, zoom.apply(spr->width()));
+  const int h = std::max(1, zoom.apply(spr->height()));
+  std::unique_ptr<Image> dst(Image::create(IMAGE_RGB, w, h));
+
+  Render render;
+  BgOptions bg;
+  bg.type = BgType::CHECKERED;
+  bg.zoom = true;
+  bg.color1 = rgba(100, 100, 100, 255);
+  bg.color2 = rgba(200, 200, 200, 255);
+  bg.stripeSize = gfx::Size(16, 16);
+  render.setBgOptions(bg);
+  render.setProjection(Projection(spr->pixelRatio(), zoom));
+
+  for (auto _ : state) {
+    for (frame_t frame=0; frame<spr->totalFrames(); ++frame) {
+      render.renderSprite(
+        dst.get(), spr, frame,
+        gfx::Clip(0, 0, 0, 0, w, h));
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * spr->totalFrames());
+  state.counters["frames"] = spr->totalFrames();
+  state.counters["layers"] = int(spr->allLayersCount());
+
+  doc->close();
+}
+
+} // anonymous namespace
+
+int app_main(int argc, char* argv[])
+{
+  Context ctx;
+
+  if (const char* dir = std::getenv("ASEPRITE_BENCHMARK_FILES")) {
+    for (const std::string& fn : base::list_files(dir)) {
+      const std::string ext = base::string_to_lower(base::get_file_extension(fn));
+      if (ext != "ase" && ext != "aseprite")
+        continue;
+
+      const std::string filename = base::join_path(dir, fn);
+      for (const int zoom : kZooms) {
+        benchmark::RegisterBenchmark(
+          fmt::format("BM_RenderFile/{}/zoom:{}",
+                      base::get_file_title(fn), zoom).c_str(),
+          BM_RenderFile, &ctx, filename, zoom)
+          ->Unit(benchmark::kMillisecond);
+      }
+    }
+  }
+  else {
+    std::printf("Set ASEPRITE_BENCHMARK_FILES to a directory with .aseprite files\n");
+  }
+
+  ::benchmark::Initialize(&argc, argv);
+  return ::benchmark::RunSpecifiedBenchmarks();
+}
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2015-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -143,9 +143,14 @@ int App_transaction(lua_State* L)
   //
   //   app.transaction(function)
   //   app.transaction(string, function)
+  //   app.transaction(string, function, { undo=false })
   //
   // Where if the string is the first argument, it will be the
-  // transaction name/undo-redo label.
+  // transaction name/undo-redo label. The optional table can be
+  // used to apply the changes without adding them to the undo
+  // history (e.g. to save memory in scripts that modify thousands
+  // of cels). In that case the previous undo history of the sprite
+  // is discarded too, and the sprite is marked as modified.
 
   if (lua_isstring(L, index)) {
     label = lua_tostring(L, index);
@@ -157,17 +162,37 @@ int App_transaction(lua_State* L)
     if (!ctx)
       return luaL_error(L, "no context");
 
+    const int funcIndex = index;
+    const bool oldUndoEnabled = ctx->isUndoEnabled();
+    bool undoEnabled = oldUndoEnabled;
+    if (lua_istable(L, funcIndex+1)) {
+      int type = lua_getfield(L, funcIndex+1, "undo");
+      if (type != LUA_TNIL)
+        undoEnabled = (oldUndoEnabled && lua_toboolean(L, -1));
+      lua_pop(L, 1);
+    }
+
     try {
       // We lock the document in the whole transaction because the
       // RWLock now is re-entrant and we are able to call commands
       // inside the app.transaction() (creating inner ContextWriters).
       ContextWriter writer(ctx);
+
+      // Notifications about modified pixels/properties are sent as
+      // one general update at the end of the transaction (after the
+      // Tx is committed or rolled back).
+      DeferDocNotifications deferNotifications(writer.document());
+
       Tx tx(writer, label);
 
-      lua_pushvalue(L, -1);
-      if (lua_pcall(L, 0, LUA_MULTRET, 0) == LUA_OK)
+      top = lua_gettop(L);
+      lua_pushvalue(L, funcIndex);
+      ctx->setUndoEnabled(undoEnabled);
+      const int status = lua_pcall(L, 0, LUA_MULTRET, 0);
+      if (status == LUA_OK)
         tx.commit();
-      else
+      ctx->setUndoEnabled(oldUndoEnabled);
+      if (status != LUA_OK)
         return lua_error(L); // pcall already put an error object on the stack
       nresults = lua_gettop(L) - top;
     }
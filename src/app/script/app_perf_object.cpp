@@ -0,0 +1,99 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/doc_lock_stats.h"
+#include "app/perf_counters.h"
+#include "app/script/luacpp.h"
+
+namespace app {
+namespace script {
+
+namespace {
+
+struct AppPerf { };
+
+template<PerfCounters::Counter counter>
+int AppPerf_get_counter(lua_State* L)
+{
+  lua_pushinteger(L, PerfCounters::get(counter));
+  return 1;
+}
+
+int AppPerf_reset(lua_State* L)
+{
+  PerfCounters::reset();
+  DocLockStats::reset();
+  return 0;
+}
+
+// Returns all the counters in a table
+int AppPerf_counters(lua_State* L)
+{
+  lua_newtable(L);
+  for (int i=0; i<PerfCounters::kCounters; ++i) {
+    const auto counter = PerfCounters::Counter(i);
+    lua_pushinteger(L, PerfCounters::get(counter));
+    lua_setfield(L, -2, PerfCounters::name(counter));
+  }
+  return 1;
+}
+
+// Returns a "name value" line for each counter
+int AppPerf_report(lua_State* L)
+{
+  lua_pushstring(L, PerfCounters::report().c_str());
+  return 1;
+}
+
+// Returns the wait time for Doc locks by operation and the last
+// failed locks
+int AppPerf_lockReport(lua_State* L)
+{
+  lua_pushstring(L, DocLockStats::report().c_str());
+  return 1;
+}
+
+const Property AppPerf_properties[] = {
+  { "pixelsComposited", AppPerf_get_counter<PerfCounters::PixelsComposited>, nullptr },
+  { "celsRendered", AppPerf_get_counter<PerfCounters::CelsRendered>, nullptr },
+  { "cacheHits", AppPerf_get_counter<PerfCounters::CacheHits>, nullptr },
+  { "cacheMisses", AppPerf_get_counter<PerfCounters::CacheMisses>, nullptr },
+  { "bytesCompressed", AppPerf_get_counter<PerfCounters::BytesCompressed>, nullptr },
+  { "undoBytes", AppPerf_get_counter<PerfCounters::UndoBytes>, nullptr },
+  { "lockWaitTime", AppPerf_get_counter<PerfCounters::LockWaitTime>, nullptr },
+  { nullptr, nullptr, nullptr }
+};
+
+const luaL_Reg AppPerf_methods[] = {
+  { "reset", AppPerf_reset },
+  { "counters", AppPerf_counters },
+  { "report", AppPerf_report },
+  { "lockReport", AppPerf_lockReport },
+  { nullptr, nullptr }
+};
+
+} // anonymous namespace
+
+DEF_MTNAME(AppPerf);
+
+void register_app_perf_object(lua_State* L)
+{
+  REG_CLASS(L, AppPerf);
+  REG_CLASS_PROPERTIES(L, AppPerf);
+
+  lua_getglobal(L, "app");
+  lua_pushstring(L, "perf");
+  push_new<AppPerf>(L);
+  lua_rawset(L, -3);
+  lua_pop(L, 1);
+}
+
+} // namespace script
+} // namespace app
@@ -0,0 +1,111 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/app.h"
+#include "app/script/engine.h"
+#include "app/script/luacpp.h"
+#include "app/script/profiler.h"
+#include "app/script/security.h"
+
+namespace app {
+namespace script {
+
+namespace {
+
+struct AppProfiler { };
+
+Engine* get_engine(lua_State* L)
+{
+  Engine* engine = App::instance()->scriptEngine();
+  if (!engine)
+    luaL_error(L, "no script engine");
+  return engine;
+}
+
+int AppProfiler_start(lua_State* L)
+{
+  get_engine(L)->startProfiler();
+  return 0;
+}
+
+int AppProfiler_stop(lua_State* L)
+{
+  get_engine(L)->stopProfiler();
+  return 0;
+}
+
+int AppProfiler_reset(lua_State* L)
+{
+  get_engine(L)->profiler()->reset();
+  return 0;
+}
+
+// Returns a text table with the functions sorted by self time
+int AppProfiler_report(lua_State* L)
+{
+  const int maxFunctions = luaL_optinteger(L, 1, 30);
+  lua_pushstring(L, get_engine(L)->profiler()->report(maxFunctions).c_str());
+  return 1;
+}
+
+// Returns the call stacks in the folded format (or saves them in the
+// given file to generate a flame graph)
+int AppProfiler_foldedStacks(lua_State* L)
+{
+  Profiler* profiler = get_engine(L)->profiler();
+  if (const char* filename = lua_tostring(L, 1)) {
+    if (!ask_access(L, filename, FileAccessMode::Write, ResourceType::File))
+      return luaL_error(L, "the script doesn't have access to write the file '%s'",
+                        filename);
+    lua_pushboolean(L, profiler->saveFoldedStacks(filename));
+  }
+  else
+    lua_pushstring(L, profiler->foldedStacks().c_str());
+  return 1;
+}
+
+int AppProfiler_get_isRunning(lua_State* L)
+{
+  lua_pushboolean(L, get_engine(L)->profiler()->isRunning());
+  return 1;
+}
+
+const Property AppProfiler_properties[] = {
+  { "isRunning", AppProfiler_get_isRunning, nullptr },
+  { nullptr, nullptr, nullptr }
+};
+
+const luaL_Reg AppProfiler_methods[] = {
+  { "start", AppProfiler_start },
+  { "stop", AppProfiler_stop },
+  { "reset", AppProfiler_reset },
+  { "report", AppProfiler_report },
+  { "foldedStacks", AppProfiler_foldedStacks },
+  { nullptr, nullptr }
+};
+
+} // anonymous namespace
+
+DEF_MTNAME(AppProfiler);
+
+void register_app_profiler_object(lua_State* L)
+{
+  REG_CLASS(L, AppProfiler);
+  REG_CLASS_PROPERTIES(L, AppProfiler);
+
+  lua_getglobal(L, "app");
+  lua_pushstring(L, "profiler");
+  push_new<AppProfiler>(L);
+  lua_rawset(L, -3);
+  lua_pop(L, 1);
+}
+
+} // namespace script
+} // namespace app
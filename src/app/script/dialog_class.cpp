@@ -13,6 +13,7 @@
 #include "app/color.h"
 #include "app/color_utils.h"
 #include "app/file_selector.h"
+#include "app/perf_trace.h"
 #include "app/script/canvas_widget.h"
 #include "app/script/engine.h"
 #include "app/script/graphics_context.h"
@@ -300,6 +301,7 @@ void Dialog_connect_signal(lua_State* L,
       callback(L, std::forward<Args>(args)...);
 
       if (lua_isfunction(L, -2)) {
+        PerfTrace span("script", "Dialog callback");
         try {
           if (lua_pcall(L, 1, 0, 0)) {
             if (const char* s = lua_tostring(L, -1))
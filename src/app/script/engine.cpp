@@ -14,13 +14,18 @@
 #include "app/app.h"
 #include "app/console.h"
 #include "app/doc_exporter.h"
+#include "app/doc_lock_stats.h"
 #include "app/doc_range.h"
+#include "app/perf_trace.h"
 #include "app/pref/preferences.h"
 #include "app/script/blend_mode.h"
 #include "app/script/luacpp.h"
+#include "app/script/profiler.h"
 #include "app/script/require.h"
+#include "app/script/script_cache.h"
 #include "app/script/security.h"
 #include "app/sprite_sheet_type.h"
+#include "app/startup_trace.h"
 #include "app/tilemap_mode.h"
 #include "app/tileset_mode.h"
 #include "app/tools/ink_type.h"
@@ -112,6 +117,19 @@ int print(lua_State* L)
   return 0;
 }
 
+// Reads the whole content of the given file, returns false if the
+// file cannot be opened.
+bool read_file(const std::string& filename, std::string& content)
+{
+  std::ifstream s(FSTREAM_PATH(filename), std::ios::binary);
+  if (!s)
+    return false;
+  std::stringstream buf;
+  buf << s.rdbuf();
+  content = buf.str();
+  return true;
+}
+
 static int dofilecont(lua_State *L, int d1, lua_KContext d2)
 {
   (void)d1;
@@ -135,7 +153,23 @@ int dofile(lua_State *L)
   }
 
   lua_settop(L, 1);
-  if (luaL_loadfile(L, fname.c_str()) != LUA_OK)
+
+  // Use the bytecode cache of the engine if this is its Lua state
+  // (files with a BOM or a first line starting with '#' are loaded
+  // with luaL_loadfile() as it skips them).
+  auto app = App::instance();
+  Engine* engine = (app ? app->scriptEngine(): nullptr);
+  std::string source;
+  int status;
+  if (engine && engine->luaState() == L &&
+      read_file(fname, source) &&
+      (source.empty() || (source[0] != '#' && source[0] != '\xEF'))) {
+    status = engine->loadFile(base::get_absolute_path(fname), source);
+  }
+  else {
+    status = luaL_loadfile(L, fname.c_str());
+  }
+  if (status != LUA_OK)
     return lua_error(L);
   {
     AddScriptFilename add(fname);
@@ -173,6 +207,8 @@ void register_app_object(lua_State* L);
 void register_app_pixel_color_object(lua_State* L);
 void register_app_fs_object(lua_State* L);
 void register_app_os_object(lua_State* L);
+void register_app_perf_object(lua_State* L);
+void register_app_profiler_object(lua_State* L);
 void register_app_command_object(lua_State* L);
 void register_app_preferences_object(lua_State* L);
 void register_json_object(lua_State* L);
@@ -193,6 +229,7 @@ void register_frame_class(lua_State* L);
 void register_frames_class(lua_State* L);
 void register_grid_class(lua_State* L);
 void register_image_class(lua_State* L);
+void register_image_bytes_class(lua_State* L);
 void register_image_iterator_class(lua_State* L);
 void register_image_spec_class(lua_State* L);
 void register_images_class(lua_State* L);
@@ -205,6 +242,7 @@ void register_point_class(lua_State* L);
 void register_properties_class(lua_State* L);
 void register_range_class(lua_State* L);
 void register_rect_class(lua_State* L);
+void register_renderer_class(lua_State* L);
 void register_selection_class(lua_State* L);
 void register_site_class(lua_State* L);
 void register_size_class(lua_State* L);
@@ -223,14 +261,18 @@ void register_tool_class(lua_State* L);
 void register_uuid_class(lua_State* L);
 void register_version_class(lua_State* L);
 void register_websocket_class(lua_State* L);
+void register_worker_class(lua_State* L);
 
 void set_app_params(lua_State* L, const Params& params);
 
 Engine::Engine()
   : L(luaL_newstate())
   , m_delegate(nullptr)
+  , m_profiler(std::make_unique<Profiler>())
   , m_printLastResult(false)
 {
+  StartupTrace span("script engine");
+
 #if _DEBUG
   int top = lua_gettop(L);
 #endif
@@ -268,6 +310,8 @@ Engine::Engine()
   register_app_pixel_color_object(L);
   register_app_fs_object(L);
   register_app_os_object(L);
+  register_app_perf_object(L);
+  register_app_profiler_object(L);
   register_app_command_object(L);
   register_app_preferences_object(L);
   register_json_object(L);
@@ -359,6 +403,7 @@ Engine::Engine()
   lua_setglobal(L, "SpriteSheetDataFormat");
   setfield_integer(L, "JSON_HASH", SpriteSheetDataFormat::JsonHash);
   setfield_integer(L, "JSON_ARRAY", SpriteSheetDataFormat::JsonArray);
+  setfield_integer(L, "BINARY", SpriteSheetDataFormat::Binary);
   lua_pop(L, 1);
 
   lua_newtable(L);
@@ -495,6 +540,7 @@ Engine::Engine()
   register_frames_class(L);
   register_grid_class(L);
   register_image_class(L);
+  register_image_bytes_class(L);
   register_image_iterator_class(L);
   register_image_spec_class(L);
   register_images_class(L);
@@ -507,6 +553,7 @@ Engine::Engine()
   register_properties_class(L);
   register_range_class(L);
   register_rect_class(L);
+  register_renderer_class(L);
   register_selection_class(L);
   register_site_class(L);
   register_size_class(L);
@@ -524,6 +571,7 @@ Engine::Engine()
   register_tool_class(L);
   register_uuid_class(L);
   register_version_class(L);
+  register_worker_class(L);
 #if ENABLE_WEBSOCKET
   register_websocket_class(L);
 #endif
@@ -539,6 +587,7 @@ Engine::~Engine()
 
 void Engine::destroy()
 {
+  stopProfiler();
 #ifdef ENABLE_UI
   close_all_dialogs();
 #endif
@@ -572,9 +621,20 @@ void Engine::printLastResult()
 bool Engine::evalCode(const std::string& code,
                       const std::string& filename)
 {
+  PerfTrace span("script", "Engine::evalCode");
+  return evalChunk(
+    luaL_loadbuffer(L, code.c_str(), code.size(), filename.c_str()));
+}
+
+// Executes the chunk in the top of the stack, or shows the error
+// message in the top of the stack if it couldn't be loaded.
+bool Engine::evalChunk(const int loadStatus)
+{
+  DocLockStats::Operation operation("script");
+
   bool ok = true;
   try {
-    if (luaL_loadbuffer(L, code.c_str(), code.size(), filename.c_str()) ||
+    if (loadStatus != LUA_OK ||
         lua_pcall(L, 0, 1, 0)) {
       const char* s = lua_tostring(L, -1);
       if (s)
@@ -626,23 +686,21 @@ void Engine::handleException(const std::exception& ex)
 bool Engine::evalFile(const std::string& filename,
                       const Params& params)
 {
-  std::stringstream buf;
-  {
-    std::ifstream s(FSTREAM_PATH(filename));
-    // Returns false if we cannot open the file
-    if (!s)
-      return false;
-    buf << s.rdbuf();
-  }
+  PerfTrace span("script", "Engine::evalFile");
+
+  // Returns false if we cannot open the file
+  std::string source;
+  if (!read_file(filename, source))
+    return false;
   std::string absFilename = base::get_absolute_path(filename);
 
   AddScriptFilename addScript(absFilename);
   set_app_params(L, params);
 
   if (g_debuggerDelegate)
-    g_debuggerDelegate->startFile(absFilename, buf.str());
+    g_debuggerDelegate->startFile(absFilename, source);
 
-  bool result = evalCode(buf.str(), "@" + absFilename);
+  bool result = evalChunk(loadFile(absFilename, source));
 
   if (g_debuggerDelegate)
     g_debuggerDelegate->endFile(absFilename);
@@ -662,6 +720,19 @@ bool Engine::evalUserFile(const std::string& filename,
   return evalFile(filename, params);
 }
 
+int Engine::loadFile(const std::string& absFilename,
+                     const std::string& source)
+{
+  if (Preferences::instance().experimental.scriptBytecodeCache()) {
+    if (!m_scriptCache)
+      m_scriptCache = std::make_unique<ScriptCache>();
+    return m_scriptCache->load(L, absFilename, source);
+  }
+  const std::string chunkname = "@" + absFilename;
+  return luaL_loadbuffer(L, source.c_str(), source.size(),
+                         chunkname.c_str());
+}
+
 void Engine::startDebugger(DebuggerDelegate* debuggerDelegate)
 {
   g_debuggerDelegate = debuggerDelegate;
@@ -682,6 +753,16 @@ void Engine::stopDebugger()
   lua_sethook(L, nullptr, 0, 0);
 }
 
+void Engine::startProfiler()
+{
+  m_profiler->start(L);
+}
+
+void Engine::stopProfiler()
+{
+  m_profiler->stop(L);
+}
+
 void Engine::onConsoleError(const char* text)
 {
   if (text && m_delegate)
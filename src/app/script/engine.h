@@ -27,6 +27,7 @@
 #include <cstdio>
 #include <functional>
 #include <map>
+#include <memory>
 #include <string>
 
 struct lua_State;
@@ -69,6 +70,9 @@ namespace app {
 
   namespace script {
 
+  class Profiler;
+  class ScriptCache;
+
   class EngineDelegate {
   public:
     virtual ~EngineDelegate() { }
@@ -108,6 +112,13 @@ namespace app {
     bool evalUserFile(const std::string& filename,
                       const Params& params = Params());
 
+    // Loads the given script file (the "source" is the file content)
+    // pushing the compiled chunk in the stack (or an error message),
+    // like luaL_loadbuffer(). It uses the bytecode cache (see
+    // ScriptCache) if it's enabled.
+    int loadFile(const std::string& absFilename,
+                 const std::string& source);
+
     void handleException(const std::exception& ex);
 
     void consolePrint(const char* text) {
@@ -123,12 +134,21 @@ namespace app {
     void startDebugger(DebuggerDelegate* debuggerDelegate);
     void stopDebugger();
 
+    // Lua profiler (see Profiler class). It cannot be used at the
+    // same time as the debugger (both use the Lua hook).
+    Profiler* profiler() { return m_profiler.get(); }
+    void startProfiler();
+    void stopProfiler();
+
   private:
+    bool evalChunk(int loadStatus);
     void onConsoleError(const char* text);
     void onConsolePrint(const char* text);
 
     lua_State* L;
     EngineDelegate* m_delegate;
+    std::unique_ptr<Profiler> m_profiler;
+    std::unique_ptr<ScriptCache> m_scriptCache;
     bool m_printLastResult;
     int m_returnCode;
   };
@@ -151,6 +171,7 @@ namespace app {
   void push_app_events(lua_State* L);
   void push_app_theme(lua_State* L, int uiscale = 1);
   int push_image_iterator_function(lua_State* L, const doc::Image* image, int extraArgIndex);
+  void push_image_bytes(lua_State* L, doc::Image* image, int imageIndex);
   void push_brush(lua_State* L, const doc::BrushRef& brush);
   void push_cel_image(lua_State* L, doc::Cel* cel);
   void push_cel_images(lua_State* L, const doc::ObjectIds& cels);
@@ -191,6 +212,14 @@ namespace app {
 
   gfx::Point convert_args_into_point(lua_State* L, int index);
   gfx::Rect convert_args_into_rect(lua_State* L, int index);
+
+  // Same as above, but "nextIndex" is set to the index of the
+  // argument after the point/rectangle, which can be specified as a
+  // Point/Rectangle object, a table, or plain numbers (x, y[, w,
+  // h]) to avoid creating temporary objects in tight loops.
+  gfx::Point convert_args_into_point(lua_State* L, int index, int& nextIndex);
+  gfx::Rect convert_args_into_rect(lua_State* L, int index, int& nextIndex);
+
   gfx::Size convert_args_into_size(lua_State* L, int index);
   app::Color convert_args_into_color(lua_State* L, int index);
   doc::color_t convert_args_into_pixel_color(lua_State* L, int index,
@@ -198,10 +227,20 @@ namespace app {
   base::Uuid convert_args_into_uuid(lua_State* L, int index);
   doc::Palette* get_palette_from_arg(lua_State* L, int index);
   doc::Image* may_get_image_from_arg(lua_State* L, int index);
+  const doc::Image* may_get_image_bytes_from_arg(lua_State* L, int index);
   doc::Image* get_image_from_arg(lua_State* L, int index);
   doc::Cel* get_image_cel_from_arg(lua_State* L, int index);
   doc::Tileset* get_image_tileset_from_arg(lua_State* L, int index);
   doc::frame_t get_frame_number_from_arg(lua_State* L, int index);
+
+  // Renders the sprite frame in "dst" at the given position with the
+  // Renderer object at "index" (reusing its configuration and
+  // caches). Returns false if there is no Renderer in that argument.
+  bool render_sprite_with_renderer_from_arg(lua_State* L, int index,
+                                            doc::Image* dst,
+                                            const doc::Sprite* sprite,
+                                            const doc::frame_t frame,
+                                            const gfx::Point& pos);
   const doc::Mask* get_mask_from_arg(lua_State* L, int index);
   app::tools::Tool* get_tool_from_arg(lua_State* L, int index);
   doc::BrushRef get_brush_from_arg(lua_State* L, int index);
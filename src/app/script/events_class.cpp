@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2021-2023  Igara Studio S.A.
+// Copyright (C) 2021-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -16,6 +16,7 @@
 #include "app/doc_event.h"
 #include "app/doc_undo.h"
 #include "app/doc_undo_observer.h"
+#include "app/perf_trace.h"
 #include "app/pref/preferences.h"
 #include "app/script/docobj.h"
 #include "app/script/engine.h"
@@ -112,6 +113,8 @@ protected:
     if (eventType >= m_listeners.size())
       return;
 
+    PerfTrace span("script", "Events::call");
+
     script::Engine* engine = App::instance()->scriptEngine();
     lua_State* L = engine->luaState();
 
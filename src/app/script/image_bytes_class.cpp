@@ -0,0 +1,243 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/script/docobj.h"
+#include "app/script/engine.h"
+#include "app/script/luacpp.h"
+#include "doc/image.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace app {
+namespace script {
+
+namespace {
+
+// A view of the pixel buffer of an image (Image:bytesView()) to
+// read/write bytes without copying the whole buffer into a Lua
+// string. The view is pinned to the image version: if the image is
+// modified by other means (not through this view), the view must be
+// re-created.
+struct ImageBytesObj {
+  doc::ObjectId imageId = 0;
+  doc::ObjectVersion version = 0;
+  ImageBytesObj(doc::Image* image)
+    : imageId(image->id())
+    , version(image->version()) {
+  }
+  ImageBytesObj(const ImageBytesObj&) = delete;
+  ImageBytesObj& operator=(const ImageBytesObj&) = delete;
+
+  doc::Image* image(lua_State* L) {
+    doc::Image* image = check_docobj(L, doc::get<doc::Image>(imageId));
+    if (image->version() != version)
+      luaL_error(L, "the image was modified, the bytes view is not valid anymore");
+    return image;
+  }
+
+  uint8_t* data(lua_State* L) {
+    return image(L)->getPixelAddress(0, 0);
+  }
+
+  size_t size(lua_State* L) {
+    doc::Image* image = this->image(L);
+    return size_t(image->rowBytes()) * image->height();
+  }
+
+  // Called after modifying the pixels through the view.
+  void modified(lua_State* L) {
+    doc::Image* image = this->image(L);
+    image->incrementVersion();
+    version = image->version();
+  }
+};
+
+// Returns the 0-based offset of the 1-based "pos" argument (like
+// string.byte() or string.unpack() positions) checking that "n"
+// bytes can be accessed from that position.
+size_t get_offset(lua_State* L, ImageBytesObj* obj, int index, size_t n)
+{
+  const lua_Integer pos = luaL_checkinteger(L, index);
+  const size_t size = obj->size(L);
+  if (pos < 1 || size_t(pos-1) + n > size)
+    luaL_error(L, "position %d out of bounds (the view has %d bytes)",
+               int(pos), int(size));
+  return size_t(pos-1);
+}
+
+int ImageBytes_gc(lua_State* L)
+{
+  get_obj<ImageBytesObj>(L, 1)->~ImageBytesObj();
+  return 0;
+}
+
+int ImageBytes_len(lua_State* L)
+{
+  auto obj = get_obj<ImageBytesObj>(L, 1);
+  lua_pushinteger(L, obj->size(L));
+  return 1;
+}
+
+// view:u8(pos [, value])
+int ImageBytes_u8(lua_State* L)
+{
+  auto obj = get_obj<ImageBytesObj>(L, 1);
+  const size_t offset = get_offset(L, obj, 2, 1);
+  uint8_t* p = obj->data(L) + offset;
+  if (lua_isnone(L, 3)) {
+    lua_pushinteger(L, *p);
+    return 1;
+  }
+  *p = uint8_t(luaL_checkinteger(L, 3));
+  obj->modified(L);
+  return 0;
+}
+
+// view:u32(pos [, value]) (in the native byte order, as the
+// pixels of RGB images)
+int ImageBytes_u32(lua_State* L)
+{
+  auto obj = get_obj<ImageBytesObj>(L, 1);
+  const size_t offset = get_offset(L, obj, 2, 4);
+  uint8_t* p = obj->data(L) + offset;
+  if (lua_isnone(L, 3)) {
+    uint32_t value;
+    std::memcpy(&value, p, 4);
+    lua_pushinteger(L, value);
+    return 1;
+  }
+  const uint32_t value = uint32_t(luaL_checkinteger(L, 3));
+  std::memcpy(p, &value, 4);
+  obj->modified(L);
+  return 0;
+}
+
+// view:read([i [, j]]) returns the bytes from i to j as a string
+// (like string.sub(), but only the given range is copied).
+int ImageBytes_read(lua_State* L)
+{
+  auto obj = get_obj<ImageBytesObj>(L, 1);
+  const lua_Integer size = obj->size(L);
+  const lua_Integer i = std::max<lua_Integer>(luaL_optinteger(L, 2, 1), 1);
+  const lua_Integer j = std::min<lua_Integer>(luaL_optinteger(L, 3, size), size);
+  if (i > j)
+    lua_pushliteral(L, "");
+  else
+    lua_pushlstring(L, (const char*)obj->data(L) + i - 1, size_t(j - i + 1));
+  return 1;
+}
+
+// view:write(pos, string) copies the string at the given position.
+int ImageBytes_write(lua_State* L)
+{
+  auto obj = get_obj<ImageBytesObj>(L, 1);
+  size_t n;
+  const char* s = luaL_checklstring(L, 3, &n);
+  const size_t offset = get_offset(L, obj, 2, n);
+  std::memcpy(obj->data(L) + offset, s, n);
+  obj->modified(L);
+  return 0;
+}
+
+// view:pack(pos, fmt, v1, v2, ...) like string.pack(fmt, v1, v2,
+// ...) but writing the result directly in the view. Returns the
+// position after the last written byte.
+int ImageBytes_pack(lua_State* L)
+{
+  auto obj = get_obj<ImageBytesObj>(L, 1);
+  const int nargs = lua_gettop(L);
+  lua_getglobal(L, "string");
+  lua_getfield(L, -1, "pack");
+  for (int i=3; i<=nargs; ++i)
+    lua_pushvalue(L, i);
+  lua_call(L, nargs-2, 1);
+
+  size_t n;
+  const char* s = lua_tolstring(L, -1, &n);
+  const size_t offset = get_offset(L, obj, 2, n);
+  std::memcpy(obj->data(L) + offset, s, n);
+  obj->modified(L);
+  lua_pushinteger(L, lua_Integer(offset + n + 1));
+  return 1;
+}
+
+// view:unpack(fmt [, pos]) like string.unpack(fmt, bytes, pos). Only
+// the bytes needed by the format are copied (if the format has a
+// fixed size), the rest of the view is copied in other case.
+int ImageBytes_unpack(lua_State* L)
+{
+  auto obj = get_obj<ImageBytesObj>(L, 1);
+  luaL_checkstring(L, 2);
+  const size_t offset = (lua_isnoneornil(L, 3) ? 0: get_offset(L, obj, 3, 0));
+  size_t n = obj->size(L) - offset;
+
+  lua_getglobal(L, "string");
+  lua_getfield(L, -1, "packsize");
+  lua_pushvalue(L, 2);
+  if (lua_pcall(L, 1, 1, 0) == LUA_OK)
+    n = std::min<size_t>(n, lua_tointeger(L, -1));
+  lua_pop(L, 1);
+
+  const int top = lua_gettop(L);
+  lua_getfield(L, -1, "unpack");
+  lua_pushvalue(L, 2);
+  lua_pushlstring(L, (const char*)obj->data(L) + offset, n);
+  lua_call(L, 2, LUA_MULTRET);
+
+  // Convert the last returned value (the next position) to a
+  // position in the view
+  const int nresults = lua_gettop(L) - top;
+  lua_pushinteger(L, lua_tointeger(L, -1) + lua_Integer(offset));
+  lua_replace(L, -2);
+  return nresults;
+}
+
+const luaL_Reg ImageBytes_methods[] = {
+  { "u8", ImageBytes_u8 },
+  { "u32", ImageBytes_u32 },
+  { "read", ImageBytes_read },
+  { "write", ImageBytes_write },
+  { "pack", ImageBytes_pack },
+  { "unpack", ImageBytes_unpack },
+  { "__len", ImageBytes_len },
+  { "__gc", ImageBytes_gc },
+  { nullptr, nullptr }
+};
+
+} // anonymous namespace
+
+DEF_MTNAME(ImageBytesObj);
+
+void register_image_bytes_class(lua_State* L)
+{
+  using ImageBytes = ImageBytesObj;
+  REG_CLASS(L, ImageBytes);
+}
+
+void push_image_bytes(lua_State* L, doc::Image* image, int imageIndex)
+{
+  push_new<ImageBytesObj>(L, image);
+
+  // Keep a reference to the Image object so the image is not
+  // deleted while the view is alive
+  lua_pushvalue(L, imageIndex);
+  lua_setiuservalue(L, -2, 1);
+}
+
+const doc::Image* may_get_image_bytes_from_arg(lua_State* L, int index)
+{
+  if (auto obj = may_get_obj<ImageBytesObj>(L, index))
+    return obj->image(L);
+  return nullptr;
+}
+
+} // namespace script
+} // namespace app
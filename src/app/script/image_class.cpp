@@ -27,6 +27,7 @@
 #include "app/util/autocrop.h"
 #include "app/util/resize_image.h"
 #include "base/fs.h"
+#include "base/thread_pool.h"
 #include "doc/algorithm/flip_image.h"
 #include "doc/algorithm/flip_type.h"
 #include "doc/algorithm/shrink_bounds.h"
@@ -36,11 +37,14 @@
 #include "doc/image_ref.h"
 #include "doc/primitives.h"
 #include "doc/sprite.h"
+#include "doc/tileset.h"
 #include "render/render.h"
 
 #include <algorithm>
 #include <cstring>
 #include <memory>
+#include <thread>
+#include <unordered_map>
 
 namespace app {
 namespace script {
@@ -49,6 +53,9 @@ namespace {
 
 static ImageBufferPtr buf; // TODO non-thread safe
 
+// Minimum number of pixels to transform an image in several threads
+static constexpr int kMinPixelsInParallel = 256*256;
+
 struct ImageObj {
   doc::ObjectId imageId = 0;
   doc::ObjectId celId = 0;
@@ -125,12 +132,16 @@ int Image_new(lua_State* L)
     spec = *spec2;
   }
   else if (auto imgObj = may_get_obj<ImageObj>(L, 1)) {
-    // Copy a region of the image
-    if (auto rc = may_get_obj<gfx::Rect>(L, 2)) {
+    // Copy a region of the image (Image(image, rectangle) or
+    // Image(image, x, y, w, h))
+    if (may_get_obj<gfx::Rect>(L, 2) ||
+        (lua_type(L, 2) == LUA_TNUMBER &&
+         lua_type(L, 5) == LUA_TNUMBER)) {
+      const gfx::Rect rc = convert_args_into_rect(L, 2);
       doc::Image* crop = nullptr;
       try {
         auto docImg = imgObj->image(L);
-        crop = doc::crop_image(docImg, *rc, docImg->maskColor());
+        crop = doc::crop_image(docImg, rc, docImg->maskColor());
       }
       catch (const std::invalid_argument&) {
         // Do nothing (will return nil)
@@ -207,6 +218,124 @@ int Image_new(lua_State* L)
   return 1;
 }
 
+// Transforms each pixel of the image with "f" (the rows are split in
+// several threads for big images).
+template<typename ImageTraits, typename UnaryOperation>
+void transform_pixels(Image* image, UnaryOperation&& f)
+{
+  using pixel_t = typename ImageTraits::pixel_t;
+  const int w = image->width();
+  const int h = image->height();
+  auto transformRows = [image, w, &f](const int y1, const int y2) {
+    for (int y=y1; y<y2; ++y) {
+      auto p = (pixel_t*)image->getPixelAddress(0, y);
+      for (int x=0; x<w; ++x, ++p)
+        *p = f(*p);
+    }
+  };
+
+  int nthreads = 1;
+  if (w*h >= kMinPixelsInParallel)
+    nthreads = std::min<int>(std::max(1u, std::thread::hardware_concurrency()), h);
+
+  if (nthreads < 2) {
+    transformRows(0, h);
+  }
+  else {
+    base::thread_pool threads(nthreads);
+    for (int i=0; i<nthreads; ++i) {
+      threads.execute([&transformRows, i, h, nthreads]{
+        transformRows(h*i/nthreads, h*(i+1)/nthreads);
+      });
+    }
+    threads.wait_all();
+  }
+}
+
+// Same as transform_pixels() with a function that receives/returns
+// color_t values (bitmaps are not supported).
+template<typename UnaryOperation>
+void transform_pixels_any(Image* image, UnaryOperation&& f)
+{
+  switch (image->pixelFormat()) {
+    case doc::IMAGE_RGB:
+      transform_pixels<doc::RgbTraits>(image, f);
+      break;
+    case doc::IMAGE_GRAYSCALE:
+      transform_pixels<doc::GrayscaleTraits>(image, f);
+      break;
+    case doc::IMAGE_INDEXED:
+      transform_pixels<doc::IndexedTraits>(image, f);
+      break;
+    case doc::IMAGE_TILEMAP:
+      transform_pixels<doc::TilemapTraits>(image, f);
+      break;
+    default:
+      ASSERT(false);
+      break;
+  }
+}
+
+// Applies "f" to the image of the given Image object. If the image is
+// from a cel, the modification is undoable; if it's a tile, the
+// tileset is notified.
+template<typename Func>
+void modify_image(lua_State* L, ImageObj* obj, Func&& f)
+{
+  Image* img = obj->image(L);
+
+  if (auto cel = obj->cel(L)) {
+    ImageRef tmp(Image::createCopy(img));
+    f(tmp.get());
+
+    int x1, y1, x2, y2;
+    if (get_shrink_rect2(&x1, &y1, &x2, &y2, img, tmp.get())) {
+      Tx tx(cel->sprite());
+      tx(new cmd::CopyRect(
+           img, tmp.get(),
+           gfx::Clip(x1, y1, x1, y1, x2-x1+1, y2-y1+1)));
+      tx.commit();
+    }
+  }
+  else {
+    f(img);
+    img->incrementVersion();
+
+    if (obj->tilesetId) {
+      if (doc::Tileset* ts = obj->tileset(L)) {
+        ts->incrementVersion();
+        ts->notifyTileContentChange(obj->ti);
+      }
+    }
+  }
+}
+
+doc::color_t get_pixel_color_from_arg(lua_State* L, int index,
+                                      const doc::PixelFormat pixelFormat)
+{
+  if (lua_isinteger(L, index))
+    return lua_tointeger(L, index);
+  else
+    return convert_args_into_pixel_color(L, index, pixelFormat);
+}
+
+// Reads a table of 256 entries (indexes from 0 to 255) to map each
+// channel value. Missing entries are not modified.
+void get_lut_from_arg(lua_State* L, int index, uint8_t lut[256])
+{
+  for (int i=0; i<256; ++i)
+    lut[i] = i;
+
+  if (!lua_istable(L, index))
+    return;
+
+  for (int i=0; i<256; ++i) {
+    if (lua_geti(L, index, i) != LUA_TNIL)
+      lut[i] = std::clamp<int>(lua_tointeger(L, -1), 0, 255);
+    lua_pop(L, 1);
+  }
+}
+
 int Image_clone(lua_State* L)
 {
   auto obj = get_obj<ImageObj>(L, 1);
@@ -239,9 +368,15 @@ int Image_clear(lua_State* L)
   gfx::Rect rc;
   int i = 2;
 
-  if (auto rcPtr = may_get_obj<gfx::Rect>(L, i)) {
-    rc = *rcPtr;
-    ++i;
+  if (may_get_obj<gfx::Rect>(L, i)) {
+    rc = convert_args_into_rect(L, i, i);
+  }
+  // Image:clear(x, y, w, h [, color])
+  else if (lua_type(L, i) == LUA_TNUMBER &&
+           lua_type(L, i+1) == LUA_TNUMBER &&
+           lua_type(L, i+2) == LUA_TNUMBER &&
+           lua_type(L, i+3) == LUA_TNUMBER) {
+    rc = convert_args_into_rect(L, i, i);
   }
   else {
     rc = img->bounds();         // Clear the whole image
@@ -255,6 +390,7 @@ int Image_clear(lua_State* L)
     color = convert_args_into_pixel_color(L, i, img->pixelFormat());
 
   doc::fill_rect(img, rc, color); // Clips the rectangle to the image bounds
+  img->incrementVersion();
   return 0;
 }
 
@@ -270,6 +406,7 @@ int Image_drawPixel(lua_State* L)
   else
     color = convert_args_into_pixel_color(L, 4, img->pixelFormat());
   doc::put_pixel(img, x, y, color);
+  img->incrementVersion();
 
   // Rehash tileset
   if (obj->tilesetId) {
@@ -285,29 +422,22 @@ int Image_drawImage(lua_State* L)
 {
   auto obj = get_obj<ImageObj>(L, 1);
   auto sprite = get_obj<ImageObj>(L, 2);
-  gfx::Point pos = convert_args_into_point(L, 3);
-
-  // Arguments index fix to support the following cases:
+  // Supported cases:
   //   - Image:drawImage(image, x, y, opacity, blendMode)
   //   - Image:drawImage(image, Point(x, y), opacity, blendMode)
   //   - Image:drawImage(image, {x, y}, opacity, blendMode)
   //   - Image:drawImage(image, {x=x1, y=y1}, opacity, blendMode)
-  //
-  // TODO create a similar convert_args_into_point() function so we
-  //      can get the argsFix/modified index directly from there to
-  //      read the next argument
-  int argsFix = 0;
-  if (lua_isinteger(L, 3))
-    argsFix = 1;
+  int i;
+  gfx::Point pos = convert_args_into_point(L, 3, i);
 
   int opacity = 255;
-  if (lua_isinteger(L, 4 + argsFix))
-    opacity = std::clamp(int(lua_tointeger(L, 4 + argsFix)), 0, 255);
+  if (lua_isinteger(L, i))
+    opacity = std::clamp(int(lua_tointeger(L, i)), 0, 255);
 
   doc::BlendMode blendMode = doc::BlendMode::NORMAL;
-  if (lua_isinteger(L, 5 + argsFix)) {
+  if (lua_isinteger(L, i+1)) {
     blendMode = base::convert_to<doc::BlendMode>(
-                  app::script::BlendMode(lua_tointeger(L, 5 + argsFix)));
+                  app::script::BlendMode(lua_tointeger(L, i+1)));
   }
 
   Image* dst = obj->image(L);
@@ -342,6 +472,7 @@ int Image_drawImage(lua_State* L)
                      gfx::Clip(pos, src->bounds()),
                      get_current_palette(),
                      opacity, blendMode);
+    dst->incrementVersion();
   }
   return 0;
 }
@@ -351,17 +482,26 @@ int Image_drawSprite(lua_State* L)
   auto obj = get_obj<ImageObj>(L, 1);
   const auto sprite = get_docobj<Sprite>(L, 2);
   doc::frame_t frame = get_frame_number_from_arg(L, 3);
-  gfx::Point pos = convert_args_into_point(L, 4);
+  int rendererIndex;
+  gfx::Point pos = convert_args_into_point(L, 4, rendererIndex);
   doc::Image* dst = obj->image(L);
 
   ASSERT(dst);
   ASSERT(sprite);
 
+  // Image:drawSprite(sprite, frame, position, renderer) uses the
+  // configuration/caches of the given Renderer object
+  auto draw = [L, rendererIndex, sprite, frame, pos](Image* dst) {
+    if (!render_sprite_with_renderer_from_arg(L, rendererIndex,
+                                              dst, sprite, frame, pos))
+      render_sprite(dst, sprite, frame, pos.x, pos.y);
+  };
+
   if (auto cel = obj->cel(L)) {
     Tx tx(cel->sprite());
 
     ImageRef tmp(Image::createCopy(dst));
-    render_sprite(tmp.get(), sprite, frame, pos.x, pos.y);
+    draw(tmp.get());
 
     int x1, y1, x2, y2;
     if (get_shrink_rect2(&x1, &y1, &x2, &y2, dst, tmp.get())) {
@@ -375,7 +515,8 @@ int Image_drawSprite(lua_State* L)
   // If the destination image is not related to a sprite, we just draw
   // the source image without undo information.
   else {
-    render_sprite(dst, sprite, frame, pos.x, pos.y);
+    draw(dst);
+    dst->incrementVersion();
   }
   return 0;
 }
@@ -642,7 +783,105 @@ int Image_flip(lua_State* L)
   }
   else {
     doc::algorithm::flip_image(img, img->bounds(), flipType);
+    img->incrementVersion();
+  }
+  return 0;
+}
+
+int Image_mapColors(lua_State* L)
+{
+  auto obj = get_obj<ImageObj>(L, 1);
+  const doc::PixelFormat pixelFormat = obj->image(L)->pixelFormat();
+  if (pixelFormat == doc::IMAGE_BITMAP)
+    return luaL_error(L, "Image:mapColors() is not supported for bitmaps");
+  if (!lua_istable(L, 2))
+    return luaL_error(L, "Image:mapColors() expects a table of pixel values");
+
+  std::unordered_map<doc::color_t, doc::color_t> map;
+  lua_pushnil(L);
+  while (lua_next(L, 2) != 0) {
+    if (lua_isinteger(L, -2)) {
+      map[doc::color_t(lua_tointeger(L, -2))] =
+        get_pixel_color_from_arg(L, lua_gettop(L), pixelFormat);
+    }
+    lua_pop(L, 1);
   }
+  if (map.empty())
+    return 0;
+
+  modify_image(L, obj, [&map](Image* img){
+    if (img->pixelFormat() == doc::IMAGE_INDEXED) {
+      // Lookup table for 8-bit images
+      uint8_t lut[256];
+      for (int i=0; i<256; ++i) {
+        auto it = map.find(i);
+        lut[i] = (it != map.end() ? uint8_t(it->second): i);
+      }
+      transform_pixels<doc::IndexedTraits>(
+        img, [&lut](const uint8_t c) -> uint8_t { return lut[c]; });
+    }
+    else {
+      transform_pixels_any(
+        img, [&map](const doc::color_t c) -> doc::color_t {
+          auto it = map.find(c);
+          return (it != map.end() ? it->second: c);
+        });
+    }
+  });
+  return 0;
+}
+
+int Image_replaceColor(lua_State* L)
+{
+  auto obj = get_obj<ImageObj>(L, 1);
+  const doc::PixelFormat pixelFormat = obj->image(L)->pixelFormat();
+  if (pixelFormat == doc::IMAGE_BITMAP)
+    return luaL_error(L, "Image:replaceColor() is not supported for bitmaps");
+
+  const doc::color_t from = get_pixel_color_from_arg(L, 2, pixelFormat);
+  const doc::color_t to = get_pixel_color_from_arg(L, 3, pixelFormat);
+  modify_image(L, obj, [from, to](Image* img){
+    transform_pixels_any(
+      img, [from, to](const doc::color_t c) -> doc::color_t {
+        return (c == from ? to: c);
+      });
+  });
+  return 0;
+}
+
+int Image_applyLUT(lua_State* L)
+{
+  auto obj = get_obj<ImageObj>(L, 1);
+  const doc::PixelFormat pixelFormat = obj->image(L)->pixelFormat();
+  if (pixelFormat != doc::IMAGE_RGB &&
+      pixelFormat != doc::IMAGE_GRAYSCALE)
+    return luaL_error(L, "Image:applyLUT() is only for RGB or grayscale images");
+
+  // Tables for red (or gray value), green, blue and alpha channels
+  uint8_t r[256], g[256], b[256], a[256];
+  get_lut_from_arg(L, 2, r);
+  get_lut_from_arg(L, 3, g);
+  get_lut_from_arg(L, 4, b);
+  get_lut_from_arg(L, 5, a);
+
+  modify_image(L, obj, [&](Image* img){
+    if (img->pixelFormat() == doc::IMAGE_RGB) {
+      transform_pixels<doc::RgbTraits>(
+        img, [&](const doc::color_t c) -> doc::color_t {
+          return doc::rgba(r[doc::rgba_getr(c)],
+                           g[doc::rgba_getg(c)],
+                           b[doc::rgba_getb(c)],
+                           a[doc::rgba_geta(c)]);
+        });
+    }
+    else {
+      transform_pixels<doc::GrayscaleTraits>(
+        img, [&](const uint16_t c) -> uint16_t {
+          return doc::graya(r[doc::graya_getv(c)],
+                            a[doc::graya_geta(c)]);
+        });
+    }
+  });
   return 0;
 }
 
@@ -686,10 +925,19 @@ int Image_set_bytes(lua_State* L)
 {
   const auto img = get_obj<ImageObj>(L, 1)->image(L);
   size_t bytes_size, bytes_needed = img->rowBytes() * img->height();
-  const char* bytes = lua_tolstring(L, 2, &bytes_size);
+  const char* bytes;
+
+  // Copy directly from the pixels of other image (Image:bytesView())
+  if (const doc::Image* src = may_get_image_bytes_from_arg(L, 2)) {
+    bytes = (const char*)src->getPixelAddress(0, 0);
+    bytes_size = src->rowBytes() * src->height();
+  }
+  else
+    bytes = lua_tolstring(L, 2, &bytes_size);
 
   if (bytes_size == bytes_needed) {
-    std::memcpy(img->getPixelAddress(0, 0), bytes, bytes_size);
+    std::memmove(img->getPixelAddress(0, 0), bytes, bytes_size);
+    img->incrementVersion();
   }
   else {
     lua_pushfstring(L, "Data size does not match: given %d, needed %d.", bytes_size, bytes_needed);
@@ -699,6 +947,13 @@ int Image_set_bytes(lua_State* L)
   return 0;
 }
 
+int Image_bytesView(lua_State* L)
+{
+  const auto img = get_obj<ImageObj>(L, 1)->image(L);
+  push_image_bytes(L, img, 1);
+  return 1;
+}
+
 int Image_get_width(lua_State* L)
 {
   const auto obj = get_obj<ImageObj>(L, 1);
@@ -756,6 +1011,10 @@ const luaL_Reg Image_methods[] = {
   { "resize", Image_resize },
   { "shrinkBounds", Image_shrinkBounds },
   { "flip", Image_flip },
+  { "mapColors", Image_mapColors },
+  { "replaceColor", Image_replaceColor },
+  { "applyLUT", Image_applyLUT },
+  { "bytesView", Image_bytesView },
   { "__gc", Image_gc },
   { "__eq", Image_eq },
   { nullptr, nullptr }
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2017-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -14,6 +14,7 @@
 #include "gfx/point.h"
 
 #include <cmath>
+#include <type_traits>
 
 namespace app {
 namespace script {
@@ -65,12 +66,6 @@ int Point_new(lua_State* L)
   return 1;
 }
 
-int Point_gc(lua_State* L)
-{
-  get_obj<gfx::Point>(L, 1)->~PointT();
-  return 0;
-}
-
 int Point_eq(lua_State* L)
 {
   const auto a = get_obj<gfx::Point>(L, 1);
@@ -189,8 +184,13 @@ int Point_set_y(lua_State* L)
   return 0;
 }
 
+// Points don't need a __gc metamethod: userdata without finalizer
+// are collected in just one GC cycle, and Lua doesn't need to keep
+// them in the list of objects to be finalized.
+static_assert(std::is_trivially_destructible<gfx::Point>::value,
+              "gfx::Point must be trivially destructible");
+
 const luaL_Reg Point_methods[] = {
-  { "__gc", Point_gc },
   { "__eq", Point_eq },
   { "__tostring", Point_tostring },
   { "__unm", Point_unm },
@@ -227,5 +227,11 @@ gfx::Point convert_args_into_point(lua_State* L, int index)
   return Point_new(L, index);
 }
 
+gfx::Point convert_args_into_point(lua_State* L, int index, int& nextIndex)
+{
+  nextIndex = index + (lua_type(L, index) == LUA_TNUMBER ? 2: 1);
+  return Point_new(L, index);
+}
+
 } // namespace script
 } // namespace app
@@ -0,0 +1,308 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/script/profiler.h"
+
+#include "app/script/luacpp.h"
+#include "base/fstream_path.h"
+#include "fmt/format.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace app {
+namespace script {
+
+namespace {
+
+// Just one profiler can be running (as there is just one Lua hook).
+Profiler* g_profiler = nullptr;
+
+int64_t to_us(const Profiler::Clock::duration d)
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+}
+
+} // anonymous namespace
+
+Profiler::Profiler()
+{
+}
+
+Profiler::~Profiler()
+{
+  if (g_profiler == this)
+    g_profiler = nullptr;
+}
+
+void Profiler::start(lua_State* L)
+{
+  if (m_running)
+    return;
+
+  g_profiler = this;
+  m_running = true;
+  m_lastState = L;
+  m_lastTime = Clock::now();
+  lua_sethook(L, &Profiler::hook, LUA_MASKCALL | LUA_MASKRET, 0);
+}
+
+void Profiler::stop(lua_State* L)
+{
+  if (!m_running)
+    return;
+
+  lua_sethook(L, nullptr, 0, 0);
+
+  // Close the functions that are still running (e.g. the function
+  // that called app.profiler.stop())
+  const Clock::time_point now = Clock::now();
+  addElapsedTime(L, now);
+  for (auto& it : m_stacks) {
+    while (!it.second.empty())
+      popFrame(it.second, now);
+  }
+  m_stacks.clear();
+
+  m_running = false;
+  if (g_profiler == this)
+    g_profiler = nullptr;
+}
+
+void Profiler::reset()
+{
+  m_funcs.clear();
+  m_activeCalls.clear();
+  m_nodes.clear();
+  m_children.clear();
+  m_funcIds.clear();
+  m_stacks.clear();
+  m_lastTime = Clock::now();
+}
+
+std::vector<Profiler::FunctionStats> Profiler::functions() const
+{
+  std::vector<FunctionStats> funcs = m_funcs;
+  std::sort(funcs.begin(), funcs.end(),
+            [](const FunctionStats& a, const FunctionStats& b){
+              return a.self > b.self;
+            });
+  return funcs;
+}
+
+std::string Profiler::report(int maxFunctions) const
+{
+  std::string text =
+    fmt::format("{:>12} {:>12} {:>10}  {}\n",
+                "Self (ms)", "Total (ms)", "Calls", "Function");
+  for (const FunctionStats& f : functions()) {
+    if (maxFunctions-- <= 0)
+      break;
+    text += fmt::format("{:>12.3f} {:>12.3f} {:>10}  {}\n",
+                        double(to_us(f.self)) / 1000.0,
+                        double(to_us(f.total)) / 1000.0,
+                        f.calls, f.name);
+  }
+  return text;
+}
+
+std::string Profiler::foldedStacks() const
+{
+  std::string text;
+  for (int i=0; i<int(m_nodes.size()); ++i) {
+    const int64_t us = to_us(m_nodes[i].self);
+    if (us > 0)
+      text += fmt::format("{} {}\n", nodePath(i), us);
+  }
+  return text;
+}
+
+bool Profiler::saveFoldedStacks(const std::string& filename) const
+{
+  std::ofstream f(FSTREAM_PATH(filename), std::ios::out);
+  if (!f)
+    return false;
+  f << foldedStacks();
+  return bool(f);
+}
+
+// static
+void Profiler::hook(lua_State* L, lua_Debug* ar)
+{
+  if (!g_profiler)
+    return;
+
+  switch (ar->event) {
+    case LUA_HOOKCALL:
+    case LUA_HOOKTAILCALL:
+      g_profiler->onCall(L, ar);
+      break;
+    case LUA_HOOKRET:
+      g_profiler->onReturn(L, ar);
+      break;
+  }
+}
+
+void Profiler::onCall(lua_State* L, lua_Debug* ar)
+{
+  const Clock::time_point now = Clock::now();
+  addElapsedTime(L, now);
+
+  // A tail call reuses the CallInfo of the replaced function (which
+  // doesn't generate a return event), and the CallInfo of functions
+  // that were interrupted by an error are reused too.
+  std::vector<Frame>& stack = m_stacks[L];
+  popFrames(stack, ar->i_ci, now);
+
+  const int func = getFunction(L, ar);
+  const int node = getNode(stack.empty() ? -1: stack.back().node, func);
+  ++m_funcs[func].calls;
+  ++m_activeCalls[func];
+  stack.push_back(Frame{ node, now, ar->i_ci });
+}
+
+void Profiler::onReturn(lua_State* L, lua_Debug* ar)
+{
+  const Clock::time_point now = Clock::now();
+  addElapsedTime(L, now);
+
+  // Returns from functions called before the profiler was started
+  // are ignored (there is no frame with the CallInfo).
+  auto it = m_stacks.find(L);
+  if (it != m_stacks.end())
+    popFrames(it->second, ar->i_ci, now);
+}
+
+void Profiler::popFrames(std::vector<Frame>& stack, const void* ci,
+                         const Clock::time_point now)
+{
+  auto it = std::find_if(stack.rbegin(), stack.rend(),
+                         [ci](const Frame& frame){
+                           return frame.ci == ci;
+                         });
+  if (it == stack.rend())
+    return;
+
+  const std::size_t n = std::size_t(stack.rend() - it) - 1;
+  while (stack.size() > n)
+    popFrame(stack, now);
+}
+
+// Adds the time since the last event to the function that was
+// running (the top of the stack of the last coroutine).
+void Profiler::addElapsedTime(lua_State* L, const Clock::time_point now)
+{
+  auto it = m_stacks.find(m_lastState);
+  if (it != m_stacks.end() && !it->second.empty())
+    m_nodes[it->second.back().node].self += now - m_lastTime;
+
+  m_lastState = L;
+  m_lastTime = now;
+}
+
+void Profiler::popFrame(std::vector<Frame>& stack, const Clock::time_point now)
+{
+  const Frame& frame = stack.back();
+  const int func = m_nodes[frame.node].func;
+
+  // Only the outermost call of recursive functions counts for the
+  // total time
+  if (--m_activeCalls[func] == 0)
+    m_funcs[func].total += now - frame.start;
+
+  stack.pop_back();
+}
+
+int Profiler::getFunction(lua_State* L, lua_Debug* ar)
+{
+  lua_getinfo(L, "Sn", ar);
+
+  // Lua functions are identified by its source and first line (so
+  // different closures of the same function are the same
+  // function). Native functions are identified by the C function
+  // and the metatable name of its first argument (e.g. "ImageObj").
+  std::pair<const void*, intptr_t> key;
+  const char* className = nullptr;
+  const bool isC = (ar->what && ar->what[0] == 'C');
+  if (isC) {
+    lua_getinfo(L, "f", ar);
+    key.first = lua_topointer(L, -1);
+    lua_pop(L, 1);
+
+    if (lua_getlocal(L, ar, 1)) {
+      if (lua_getmetatable(L, -1)) {
+        if (lua_getfield(L, -1, "__name") == LUA_TSTRING)
+          className = lua_tostring(L, -1);
+        lua_pop(L, 2);
+      }
+      lua_pop(L, 1);
+    }
+    key.second = intptr_t(className);
+  }
+  else {
+    key.first = ar->source;
+    key.second = ar->linedefined;
+  }
+
+  auto it = m_funcIds.find(key);
+  if (it != m_funcIds.end())
+    return it->second;
+
+  FunctionStats f;
+  const char* name = (ar->name ? ar->name: "?");
+  if (isC) {
+    if (className)
+      f.name = fmt::format("{}:{}", className, name);
+    else
+      f.name = fmt::format("{} [C]", name);
+  }
+  else if (ar->what && std::strcmp(ar->what, "main") == 0)
+    f.name = fmt::format("main chunk ({})", ar->short_src);
+  else
+    f.name = fmt::format("{} ({}:{})", name, ar->short_src, ar->linedefined);
+
+  const int id = int(m_funcs.size());
+  m_funcs.push_back(std::move(f));
+  m_activeCalls.push_back(0);
+  m_funcIds[key] = id;
+  return id;
+}
+
+int Profiler::getNode(int parent, int func)
+{
+  const uint64_t key = (uint64_t(uint32_t(parent)) << 32) | uint32_t(func);
+  auto it = m_children.find(key);
+  if (it != m_children.end())
+    return it->second;
+
+  const int id = int(m_nodes.size());
+  m_nodes.push_back(Node{ parent, func });
+  m_children[key] = id;
+  return id;
+}
+
+std::string Profiler::nodePath(int node) const
+{
+  std::vector<int> funcs;
+  for (; node >= 0; node = m_nodes[node].parent)
+    funcs.push_back(m_nodes[node].func);
+
+  std::string path;
+  for (auto it=funcs.rbegin(); it!=funcs.rend(); ++it) {
+    if (!path.empty())
+      path.push_back(';');
+    path += m_funcs[*it].name;
+  }
+  return path;
+}
+
+} // namespace script
+} // namespace app
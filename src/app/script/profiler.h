@@ -0,0 +1,113 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_SCRIPT_PROFILER_H_INCLUDED
+#define APP_SCRIPT_PROFILER_H_INCLUDED
+#pragma once
+
+#ifndef ENABLE_SCRIPTING
+  #error ENABLE_SCRIPTING must be defined
+#endif
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct lua_State;
+struct lua_Debug;
+
+namespace app {
+namespace script {
+
+  // Hook-based profiler of Lua scripts (enabled with --profile-scripts
+  // <file.txt>, or app.profiler from the developer console). It
+  // measures the wall-time spent in each Lua function and in each
+  // native API function (named with the metatable of its first
+  // argument, e.g. "ImageObj:drawImage") for each different call
+  // stack, so it can generate a text report and the call stacks in
+  // the "folded" format used by flame graph tools (flamegraph.pl,
+  // https://www.speedscope.app/, etc.).
+  class Profiler {
+  public:
+    typedef std::chrono::steady_clock Clock;
+
+    struct FunctionStats {
+      std::string name;
+      int64_t calls = 0;
+      Clock::duration total = Clock::duration(0); // Including called functions
+      Clock::duration self = Clock::duration(0);
+    };
+
+    Profiler();
+    ~Profiler();
+
+    // Installs/removes the Lua hook in the given state (only one
+    // profiler can be running at the same time).
+    void start(lua_State* L);
+    void stop(lua_State* L);
+    bool isRunning() const { return m_running; }
+
+    // Discards all the collected data.
+    void reset();
+
+    // Returns the stats of each function sorted by self time.
+    std::vector<FunctionStats> functions() const;
+
+    // Returns a text table with the first "maxFunctions" functions
+    // sorted by self time.
+    std::string report(int maxFunctions = 30) const;
+
+    // Returns each call stack with its self time in microseconds
+    // ("main chunk;f;g 123" lines).
+    std::string foldedStacks() const;
+    bool saveFoldedStacks(const std::string& filename) const;
+
+  private:
+    // One node for each different call stack.
+    struct Node {
+      int parent;
+      int func;
+      Clock::duration self = Clock::duration(0);
+    };
+
+    struct Frame {
+      int node;
+      Clock::time_point start;
+      const void* ci;           // Lua CallInfo of the function
+    };
+
+    static void hook(lua_State* L, lua_Debug* ar);
+    void onCall(lua_State* L, lua_Debug* ar);
+    void onReturn(lua_State* L, lua_Debug* ar);
+    void popFrames(std::vector<Frame>& stack, const void* ci,
+                   const Clock::time_point now);
+    void addElapsedTime(lua_State* L, const Clock::time_point now);
+    void popFrame(std::vector<Frame>& stack, const Clock::time_point now);
+    int getFunction(lua_State* L, lua_Debug* ar);
+    int getNode(int parent, int func);
+    std::string nodePath(int node) const;
+
+    bool m_running = false;
+    std::vector<FunctionStats> m_funcs;
+    std::vector<int> m_activeCalls;     // Recursive calls of each function
+    std::vector<Node> m_nodes;
+    std::unordered_map<uint64_t, int> m_children; // (parent, func) -> node
+    std::map<std::pair<const void*, intptr_t>, int> m_funcIds;
+
+    // Call stack of each coroutine.
+    std::unordered_map<lua_State*, std::vector<Frame>> m_stacks;
+    lua_State* m_lastState = nullptr;
+    Clock::time_point m_lastTime;
+  };
+
+} // namespace script
+} // namespace app
+
+#endif
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2017-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -16,6 +16,8 @@
 #include "gfx/rect.h"
 #include "gfx/size.h"
 
+#include <type_traits>
+
 namespace app {
 namespace script {
 
@@ -84,12 +86,6 @@ int Rectangle_new(lua_State* L)
   return 1;
 }
 
-int Rectangle_gc(lua_State* L)
-{
-  get_obj<gfx::Rect>(L, 1)->~RectT();
-  return 0;
-}
-
 int Rectangle_eq(lua_State* L)
 {
   const auto a = get_obj<gfx::Rect>(L, 1);
@@ -235,8 +231,11 @@ int Rectangle_get_isEmpty(lua_State* L)
   return 1;
 }
 
+// Without __gc metamethod (see Point_methods)
+static_assert(std::is_trivially_destructible<gfx::Rect>::value,
+              "gfx::Rect must be trivially destructible");
+
 const luaL_Reg Rectangle_methods[] = {
-  { "__gc", Rectangle_gc },
   { "__eq", Rectangle_eq },
   { "__tostring", Rectangle_tostring },
   { "__band", Rectangle_intersect },
@@ -278,5 +277,17 @@ gfx::Rect convert_args_into_rect(lua_State* L, int index)
   return Rectangle_new(L, index);
 }
 
+gfx::Rect convert_args_into_rect(lua_State* L, int index, int& nextIndex)
+{
+  if (lua_type(L, index) == LUA_TNUMBER)
+    nextIndex = index + 4;
+  else if (may_get_obj<gfx::Point>(L, index) &&
+           may_get_obj<gfx::Size>(L, index+1))
+    nextIndex = index + 2;
+  else
+    nextIndex = index + 1;
+  return Rectangle_new(L, index);
+}
+
 } // namespace script
 } // namespace app
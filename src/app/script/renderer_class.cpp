@@ -0,0 +1,211 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/script/docobj.h"
+#include "app/script/engine.h"
+#include "app/script/luacpp.h"
+#include "doc/image.h"
+#include "doc/sprite.h"
+#include "render/group_cache.h"
+#include "render/projection.h"
+#include "render/render.h"
+#include "render/tile_atlas.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace app {
+namespace script {
+
+namespace {
+
+// A persistent render configuration to render several frames or
+// regions of sprites (thumbnails, atlases, previews, etc.) reusing
+// the render plans of the render::Render instance and, optionally,
+// the cache of layer groups and tilemap atlases.
+struct RendererObj {
+  render::Render render;
+  render::GroupCache groupCache;
+  render::TileAtlas tileAtlas;
+  render::Zoom zoom = render::Zoom(1, 1);
+
+  RendererObj() {
+    render.setNewBlend(true);
+  }
+  RendererObj(const RendererObj&) = delete;
+  RendererObj& operator=(const RendererObj&) = delete;
+
+  double scale() const {
+    return zoom.scale();
+  }
+
+  // Only "simple" zoom levels (N:1 or 1:N) are supported.
+  void setScale(const double scale) {
+    if (scale >= 1.0)
+      zoom = render::Zoom(std::max(1, int(std::round(scale))), 1);
+    else
+      zoom = render::Zoom(1, std::max(1, int(std::round(1.0 / scale))));
+  }
+
+  // Renders the "bounds" area of the sprite (in sprite coordinates)
+  // at the given position of "dst" (in zoomed coordinates).
+  void renderSprite(doc::Image* dst,
+                    const doc::Sprite* sprite,
+                    const doc::frame_t frame,
+                    const gfx::Rect& bounds,
+                    const gfx::Point& pos) {
+    const render::Projection proj(sprite->pixelRatio(), zoom);
+    const gfx::Rect area = proj.apply(bounds);
+    render.setProjection(proj);
+    render.renderSprite(
+      dst, sprite, frame,
+      gfx::ClipF(pos.x, pos.y, area.x, area.y, area.w, area.h));
+  }
+};
+
+int Renderer_new(lua_State* L)
+{
+  auto obj = push_new<RendererObj>(L);
+
+  if (lua_istable(L, 1)) {
+    int type = lua_getfield(L, 1, "zoom");
+    if (type == LUA_TNUMBER) {
+      const double scale = lua_tonumber(L, -1);
+      if (scale <= 0.0)
+        return luaL_error(L, "invalid zoom %f", scale);
+      obj->setScale(scale);
+    }
+    lua_pop(L, 1);
+
+    type = lua_getfield(L, 1, "newBlend");
+    if (type != LUA_TNIL)
+      obj->render.setNewBlend(lua_toboolean(L, -1));
+    lua_pop(L, 1);
+
+    // The following caches are opt-in (as in the editor) because
+    // they can produce small differences in the rounding of
+    // semi-transparent pixels.
+    lua_getfield(L, 1, "cacheGroups");
+    if (lua_toboolean(L, -1))
+      obj->render.setGroupCache(&obj->groupCache);
+    lua_pop(L, 1);
+
+    lua_getfield(L, 1, "tileAtlas");
+    if (lua_toboolean(L, -1))
+      obj->render.setTileAtlas(&obj->tileAtlas);
+    lua_pop(L, 1);
+
+    lua_getfield(L, 1, "parallel");
+    if (lua_toboolean(L, -1))
+      obj->render.setParallelTileSize(128);
+    lua_pop(L, 1);
+  }
+  return 1;
+}
+
+int Renderer_gc(lua_State* L)
+{
+  get_obj<RendererObj>(L, 1)->~RendererObj();
+  return 0;
+}
+
+// renderer:renderSprite(sprite, frame [, rectangle]) returns a new
+// image with the given area of the sprite (the whole sprite by
+// default) rendered with the renderer zoom.
+int Renderer_renderSprite(lua_State* L)
+{
+  auto obj = get_obj<RendererObj>(L, 1);
+  const auto sprite = get_docobj<doc::Sprite>(L, 2);
+  const doc::frame_t frame = get_frame_number_from_arg(L, 3);
+  gfx::Rect bounds = sprite->bounds();
+  if (!lua_isnone(L, 4))
+    bounds = convert_args_into_rect(L, 4);
+
+  const gfx::Rect area =
+    render::Projection(sprite->pixelRatio(), obj->zoom).apply(bounds);
+  if (area.isEmpty())
+    return 0;
+
+  doc::ImageSpec spec = sprite->spec();
+  spec.setSize(area.size());
+  doc::Image* image = doc::Image::create(spec);
+  if (!image)
+    return 0;
+
+  obj->renderSprite(image, sprite, frame, bounds, gfx::Point(0, 0));
+  push_image(L, image);
+  return 1;
+}
+
+// Discards the cached images of layer groups and tilemaps.
+int Renderer_clearCache(lua_State* L)
+{
+  auto obj = get_obj<RendererObj>(L, 1);
+  obj->groupCache.clear();
+  obj->tileAtlas.clear();
+  return 0;
+}
+
+int Renderer_get_zoom(lua_State* L)
+{
+  auto obj = get_obj<RendererObj>(L, 1);
+  lua_pushnumber(L, obj->scale());
+  return 1;
+}
+
+int Renderer_set_zoom(lua_State* L)
+{
+  auto obj = get_obj<RendererObj>(L, 1);
+  const double scale = luaL_checknumber(L, 2);
+  if (scale <= 0.0)
+    return luaL_error(L, "invalid zoom %f", scale);
+  obj->setScale(scale);
+  return 0;
+}
+
+const luaL_Reg Renderer_methods[] = {
+  { "renderSprite", Renderer_renderSprite },
+  { "clearCache", Renderer_clearCache },
+  { "__gc", Renderer_gc },
+  { nullptr, nullptr }
+};
+
+const Property Renderer_properties[] = {
+  { "zoom", Renderer_get_zoom, Renderer_set_zoom },
+  { nullptr, nullptr, nullptr }
+};
+
+} // anonymous namespace
+
+DEF_MTNAME(RendererObj);
+
+void register_renderer_class(lua_State* L)
+{
+  using Renderer = RendererObj;
+  REG_CLASS(L, Renderer);
+  REG_CLASS_NEW(L, Renderer);
+  REG_CLASS_PROPERTIES(L, Renderer);
+}
+
+bool render_sprite_with_renderer_from_arg(lua_State* L, int index,
+                                          doc::Image* dst,
+                                          const doc::Sprite* sprite,
+                                          const doc::frame_t frame,
+                                          const gfx::Point& pos)
+{
+  if (auto obj = may_get_obj<RendererObj>(L, index)) {
+    obj->renderSprite(dst, sprite, frame, sprite->bounds(), pos);
+    return true;
+  }
+  return false;
+}
+
+} // namespace script
+} // namespace app
@@ -0,0 +1,203 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/script/script_cache.h"
+
+#include "app/resource_finder.h"
+#include "base/convert_to.h"
+#include "base/fs.h"
+#include "base/fstream_path.h"
+#include "base/sha1.h"
+#include "base/time.h"
+#include "fmt/format.h"
+
+#include <fstream>
+
+namespace app {
+namespace script {
+
+namespace {
+
+// "ALBC" (Aseprite Lua ByteCode) + format version
+constexpr uint32_t kMagicNumber = 0x43424c41;
+constexpr uint32_t kVersion = 1;
+
+// Identifies the version of the script file and the Lua version
+// (the cache file is overwritten when the script is modified).
+std::string file_version_key(const std::string& filename)
+{
+  const base::Time t = base::get_modification_time(filename);
+  return fmt::format("{}\n{}\n{:04}{:02}{:02}{:02}{:02}{:02}\n{}",
+                     filename, base::file_size(filename),
+                     t.year, t.month, t.day,
+                     t.hour, t.minute, t.second,
+                     LUA_RELEASE);
+}
+
+std::string sha1_string(const std::string& data)
+{
+  return base::convert_to<std::string>(
+    base::Sha1::calculateFromString(data));
+}
+
+// FNV-1a hash (the std::hash<> result can change between compilers)
+uint64_t hash_string(const std::string& str)
+{
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (const char chr : str) {
+    hash ^= uint8_t(chr);
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+void write32(std::ostream& os, const uint32_t value)
+{
+  const uint8_t bytes[4] = { uint8_t(value), uint8_t(value >> 8),
+                             uint8_t(value >> 16), uint8_t(value >> 24) };
+  os.write((const char*)bytes, 4);
+}
+
+uint32_t read32(std::istream& is)
+{
+  uint8_t bytes[4] = { 0, 0, 0, 0 };
+  is.read((char*)bytes, 4);
+  return (uint32_t(bytes[0]) |
+          (uint32_t(bytes[1]) << 8) |
+          (uint32_t(bytes[2]) << 16) |
+          (uint32_t(bytes[3]) << 24));
+}
+
+void write_string(std::ostream& os, const std::string& str)
+{
+  write32(os, uint32_t(str.size()));
+  os.write(str.c_str(), str.size());
+}
+
+bool read_string(std::istream& is, std::string& str,
+                 const uint32_t maxSize)
+{
+  const uint32_t size = read32(is);
+  if (!is || size > maxSize)
+    return false;
+  str.resize(size);
+  if (size > 0)
+    is.read(&str[0], size);
+  return bool(is);
+}
+
+int string_writer(lua_State* L, const void* p, size_t size, void* ud)
+{
+  ((std::string*)ud)->append((const char*)p, size);
+  return 0;
+}
+
+} // anonymous namespace
+
+ScriptCache::ScriptCache()
+{
+  ResourceFinder rf(false);
+  rf.includeUserDir(base::join_path(base::join_path("cache", "scripts"), ".").c_str());
+  m_dir = rf.getFirstOrCreateDefault();
+}
+
+int ScriptCache::load(lua_State* L,
+                      const std::string& filename,
+                      const std::string& source) const
+{
+  const std::string chunkname = "@" + filename;
+
+  // Precompiled scripts are loaded as they are
+  if (m_dir.empty() ||
+      (!source.empty() && source[0] == LUA_SIGNATURE[0])) {
+    return luaL_loadbuffer(L, source.c_str(), source.size(),
+                           chunkname.c_str());
+  }
+
+  const std::string sourceKey = sha1_string(source);
+  std::string bytecode;
+  if (loadBytecode(filename, sourceKey, bytecode)) {
+    if (luaL_loadbufferx(L, bytecode.c_str(), bytecode.size(),
+                         chunkname.c_str(), "b") == LUA_OK)
+      return LUA_OK;
+    lua_pop(L, 1);
+  }
+
+  const int status = luaL_loadbufferx(L, source.c_str(), source.size(),
+                                      chunkname.c_str(), "t");
+  if (status != LUA_OK)
+    return status;
+
+  // Keep the debug information (the source name is used to identify
+  // the script in error messages and in security.cpp)
+  bytecode.clear();
+  if (lua_dump(L, string_writer, &bytecode, 0) == 0)
+    saveBytecode(filename, sourceKey, bytecode);
+  return LUA_OK;
+}
+
+bool ScriptCache::loadBytecode(const std::string& filename,
+                               const std::string& sourceKey,
+                               std::string& bytecode) const
+{
+  std::ifstream f(FSTREAM_PATH(cacheFilename(filename)), std::ios::binary);
+  if (!f)
+    return false;
+
+  if (read32(f) != kMagicNumber ||
+      read32(f) != kVersion)
+    return false;
+
+  // Check that the cached bytecode is for this version of the file
+  // and this same source code
+  std::string key, cachedSourceKey, bytecodeKey;
+  if (!read_string(f, key, 4096) ||
+      key != file_version_key(filename) ||
+      !read_string(f, cachedSourceKey, 64) ||
+      cachedSourceKey != sourceKey ||
+      !read_string(f, bytecodeKey, 64))
+    return false;
+
+  // The size is limited to avoid big allocations with corrupted
+  // files (256MB)
+  if (!read_string(f, bytecode, 0x10000000) ||
+      bytecode.empty() ||
+      bytecode[0] != LUA_SIGNATURE[0] ||
+      sha1_string(bytecode) != bytecodeKey)
+    return false;
+
+  return true;
+}
+
+void ScriptCache::saveBytecode(const std::string& filename,
+                               const std::string& sourceKey,
+                               const std::string& bytecode) const
+{
+  std::ofstream f(FSTREAM_PATH(cacheFilename(filename)),
+                  std::ios::binary | std::ios::trunc);
+  if (!f)
+    return;
+
+  write32(f, kMagicNumber);
+  write32(f, kVersion);
+  write_string(f, file_version_key(filename));
+  write_string(f, sourceKey);
+  write_string(f, sha1_string(bytecode));
+  write_string(f, bytecode);
+}
+
+std::string ScriptCache::cacheFilename(const std::string& filename) const
+{
+  return base::join_path(
+    m_dir, fmt::format("{:016x}.luac", hash_string(filename)));
+}
+
+} // namespace script
+} // namespace app
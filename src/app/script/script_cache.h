@@ -0,0 +1,60 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_SCRIPT_SCRIPT_CACHE_H_INCLUDED
+#define APP_SCRIPT_SCRIPT_CACHE_H_INCLUDED
+#pragma once
+
+#ifndef ENABLE_SCRIPTING
+  #error ENABLE_SCRIPTING must be defined
+#endif
+
+#include "app/script/luacpp.h"
+
+#include <string>
+
+namespace app {
+namespace script {
+
+  // Persistent cache of compiled scripts (Lua bytecode, in the
+  // "cache/scripts" folder of the user directory), so extensions and
+  // scripts are not parsed again each time they are executed.
+  //
+  // There is one cache file for each script path, which includes the
+  // size and modification time of the script and the Lua version.
+  // As Lua doesn't verify bytecode (a malformed chunk can crash the
+  // program), the bytecode is used only if the SHA1 of the current
+  // source is the one that was compiled, and the SHA1 of the
+  // bytecode matches too (the same kind of SHA1 keys that are used
+  // to remember the permissions of each script, see security.cpp).
+  class ScriptCache {
+  public:
+    ScriptCache();
+
+    // Loads the given script (the "source" is the content of the
+    // file) like luaL_loadbuffer(): pushes the compiled chunk (or an
+    // error message) and returns the status. Uses the cached bytecode
+    // if it's valid, or compiles the source and caches its bytecode.
+    int load(lua_State* L,
+             const std::string& filename,
+             const std::string& source) const;
+
+  private:
+    bool loadBytecode(const std::string& filename,
+                      const std::string& sourceKey,
+                      std::string& bytecode) const;
+    void saveBytecode(const std::string& filename,
+                      const std::string& sourceKey,
+                      const std::string& bytecode) const;
+    std::string cacheFilename(const std::string& filename) const;
+
+    std::string m_dir;
+  };
+
+} // namespace script
+} // namespace app
+
+#endif
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2017-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -14,6 +14,7 @@
 #include "gfx/size.h"
 
 #include <cmath>
+#include <type_traits>
 
 namespace app {
 namespace script {
@@ -68,12 +69,6 @@ int Size_new(lua_State* L)
   return 1;
 }
 
-int Size_gc(lua_State* L)
-{
-  get_obj<gfx::Size>(L, 1)->~SizeT();
-  return 0;
-}
-
 int Size_eq(lua_State* L)
 {
   const auto a = get_obj<gfx::Size>(L, 1);
@@ -204,8 +199,11 @@ int Size_set_height(lua_State* L)
   return 0;
 }
 
+// Without __gc metamethod (see Point_methods)
+static_assert(std::is_trivially_destructible<gfx::Size>::value,
+              "gfx::Size must be trivially destructible");
+
 const luaL_Reg Size_methods[] = {
-  { "__gc", Size_gc },
   { "__eq", Size_eq },
   { "__tostring", Size_tostring },
   { "__unm", Size_unm },
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2015-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -39,6 +39,8 @@
 #include "app/doc.h"
 #include "app/doc_access.h"
 #include "app/doc_api.h"
+#include "app/doc_diff.h"
+#include "app/doc_memory.h"
 #include "app/doc_range.h"
 #include "app/doc_undo.h"
 #include "app/doc_undo_observer.h"
@@ -156,6 +158,20 @@ int Sprite_eq(lua_State* L)
   return 1;
 }
 
+int Sprite_compare(lua_State* L)
+{
+  const auto a = get_docobj<Sprite>(L, 1);
+  const auto b = get_docobj<Sprite>(L, 2);
+  const DocDiff diff = compare_docs(static_cast<const Doc*>(a->document()),
+                                    static_cast<const Doc*>(b->document()));
+  lua_newtable(L);
+  for_each_doc_diff_field(diff, [L](const char* name, const bool value){
+    lua_pushboolean(L, value);
+    lua_setfield(L, -2, name);
+  });
+  return 1;
+}
+
 int Sprite_resize(lua_State* L)
 {
   auto sprite = get_docobj<Sprite>(L, 1);
@@ -785,6 +801,22 @@ int Sprite_get_isModified(lua_State* L)
   return 1;
 }
 
+int Sprite_get_memory(lua_State* L)
+{
+  auto sprite = get_docobj<Sprite>(L, 1);
+  const Doc* doc = static_cast<Doc*>(sprite->document());
+  const DocMemoryUsage usage = calc_doc_memory_usage(doc);
+  lua_newtable(L);
+  setfield_uinteger(L, "images", usage.images);
+  setfield_uinteger(L, "compressedImages", usage.compressedImages);
+  setfield_uinteger(L, "mappedImages", usage.mappedImages);
+  setfield_uinteger(L, "tilesets", usage.tilesets);
+  setfield_uinteger(L, "undo", usage.undo);
+  setfield_uinteger(L, "undoOnDisk", usage.undoOnDisk);
+  setfield_uinteger(L, "total", usage.total());
+  return 1;
+}
+
 int Sprite_get_width(lua_State* L)
 {
   auto sprite = get_docobj<Sprite>(L, 1);
@@ -1015,6 +1047,7 @@ int Sprite_set_tileManagementPlugin(lua_State* L)
 
 const luaL_Reg Sprite_methods[] = {
   { "__eq", Sprite_eq },
+  { "compare", Sprite_compare },
   { "resize", Sprite_resize },
   { "crop", Sprite_crop },
   { "saveAs", Sprite_saveAs },
@@ -1054,6 +1087,7 @@ const Property Sprite_properties[] = {
   { "id", Sprite_get_id, nullptr },
   { "filename", Sprite_get_filename, Sprite_set_filename },
   { "isModified", Sprite_get_isModified, nullptr },
+  { "memory", Sprite_get_memory, nullptr },
   { "width", Sprite_get_width, Sprite_set_width },
   { "height", Sprite_get_height, Sprite_set_height },
   { "colorMode", Sprite_get_colorMode, nullptr },
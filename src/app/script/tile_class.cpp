@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2023  Igara Studio S.A.
+// Copyright (C) 2023-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -41,6 +41,17 @@ int Tile_get_index(lua_State* L)
   return 1;
 }
 
+int Tile_get_useCount(lua_State* L)
+{
+  auto tile = get_obj<Tile>(L, 1);
+  auto ts = doc::get<Tileset>(tile->id);
+  if (!ts)
+    return 0;
+
+  lua_pushinteger(L, ts->usage().useCount(tile->ti));
+  return 1;
+}
+
 int Tile_get_image(lua_State* L)
 {
   auto tile = get_obj<Tile>(L, 1);
@@ -191,6 +202,7 @@ const Property Tile_properties[] = {
   { "data", Tile_get_data, Tile_set_data },
   { "color", Tile_get_color, Tile_set_color },
   { "properties", Tile_get_properties, Tile_set_properties },
+  { "useCount", Tile_get_useCount, nullptr },
   { nullptr, nullptr, nullptr }
 };
 
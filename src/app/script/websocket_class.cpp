@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2021  Igara Studio S.A.
+// Copyright (C) 2021-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -13,14 +13,18 @@
 #include "app/script/engine.h"
 #include "app/script/luacpp.h"
 #include "app/script/security.h"
+#include "doc/image.h"
 #include "ui/timer.h"
 #include "ui/manager.h"
 #include "ui/system.h"
 
 #include <ixwebsocket/IXNetSystem.h>
 #include <ixwebsocket/IXWebSocket.h>
-#include <sstream>
+
+#include <algorithm>
+#include <map>
 #include <set>
+#include <string>
 
 namespace app {
 namespace script {
@@ -30,8 +34,66 @@ namespace {
 // Additional "enum" value to make message callback simpler
 #define MESSAGE_TYPE_BINARY ((int)ix::WebSocketMessageType::Fragment + 10)
 
+// Backpressure control of each WebSocket: if there are more than
+// "maxBufferedAmount" bytes queued to be sent, new messages are
+// dropped (sendText/sendBinary return false) until the queue is
+// drained to the half of that amount.
+struct Backpressure {
+  lua_State* L = nullptr;
+  size_t maxBufferedAmount = 0; // 0 means no limit
+  int callbackRef = LUA_REFNIL; // onbackpressure(blocked) callback
+  bool blocked = false;
+};
+
 static std::unique_ptr<ui::Timer> g_timer;
 static std::set<ix::WebSocket*> g_connections;
+static std::map<ix::WebSocket*, Backpressure> g_backpressure;
+
+static void call_backpressure_callback(lua_State* L, const Backpressure& bp)
+{
+  if (bp.callbackRef == LUA_REFNIL)
+    return;
+
+  lua_rawgeti(L, LUA_REGISTRYINDEX, bp.callbackRef);
+  lua_pushboolean(L, bp.blocked);
+  if (lua_pcall(L, 1, 0, 0)) {
+    if (const char* s = lua_tostring(L, -1))
+      App::instance()->scriptEngine()->consolePrint(s);
+    lua_pop(L, 1);
+  }
+}
+
+// Returns false if the message must be dropped because the send
+// queue is full.
+static bool can_send(lua_State* L, ix::WebSocket* ws, const size_t size)
+{
+  auto it = g_backpressure.find(ws);
+  if (it == g_backpressure.end() ||
+      it->second.maxBufferedAmount == 0)
+    return true;
+
+  Backpressure& bp = it->second;
+  if (!bp.blocked &&
+      ws->bufferedAmount() + size > bp.maxBufferedAmount) {
+    bp.blocked = true;
+    call_backpressure_callback(L, bp);
+  }
+  return !bp.blocked;
+}
+
+// Called periodically (g_timer) to unblock connections with a
+// drained send queue.
+static void check_drained_queues()
+{
+  for (auto& it : g_backpressure) {
+    Backpressure& bp = it.second;
+    if (bp.blocked &&
+        it.first->bufferedAmount() <= bp.maxBufferedAmount / 2) {
+      bp.blocked = false;
+      call_backpressure_callback(bp.L, bp);
+    }
+  }
+}
 
 static void close_ws(ix::WebSocket* ws)
 {
@@ -42,6 +104,30 @@ static void close_ws(ix::WebSocket* ws)
     g_timer.reset();
 }
 
+// Appends the arguments from "index" to the end of the stack to
+// "data": strings, or the pixels of images (Image or ImageBytes
+// values) which are copied directly from the image buffer (without
+// creating Lua strings).
+static void append_message_data(lua_State* L, int index, std::string& data)
+{
+  const int argc = lua_gettop(L);
+  for (int i=index; i<=argc; ++i) {
+    const doc::Image* image = may_get_image_from_arg(L, i);
+    if (!image)
+      image = may_get_image_bytes_from_arg(L, i);
+    if (image) {
+      data.append((const char*)image->getPixelAddress(0, 0),
+                  size_t(image->rowBytes()) * image->height());
+    }
+    else {
+      size_t bufLen;
+      const char* buf = lua_tolstring(L, i, &bufLen);
+      if (buf)
+        data.append(buf, bufLen);
+    }
+  }
+}
+
 int WebSocket_new(lua_State* L)
 {
   static std::once_flag f;
@@ -82,6 +168,22 @@ int WebSocket_new(lua_State* L)
     }
     lua_pop(L, 1);
 
+    type = lua_getfield(L, 1, "maxbufferedamount");
+    if (type == LUA_TNUMBER) {
+      g_backpressure[ws].maxBufferedAmount =
+        size_t(std::max<lua_Integer>(0, lua_tointeger(L, -1)));
+    }
+    lua_pop(L, 1);
+
+    type = lua_getfield(L, 1, "onbackpressure");
+    if (type == LUA_TFUNCTION) {
+      g_backpressure[ws].L = L;
+      g_backpressure[ws].callbackRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+    else {
+      lua_pop(L, 1);
+    }
+
     type = lua_getfield(L, 1, "onreceive");
     if (type == LUA_TFUNCTION) {
       int onreceiveRef = luaL_ref(L, LUA_REGISTRYINDEX);
@@ -120,6 +222,14 @@ int WebSocket_gc(lua_State* L)
 {
   auto ws = get_ptr<ix::WebSocket>(L, 1);
   close_ws(ws);
+
+  auto it = g_backpressure.find(ws);
+  if (it != g_backpressure.end()) {
+    if (it->second.callbackRef != LUA_REFNIL)
+      luaL_unref(L, LUA_REGISTRYINDEX, it->second.callbackRef);
+    g_backpressure.erase(it);
+  }
+
   delete ws;
   return 0;
 }
@@ -132,19 +242,18 @@ int WebSocket_sendText(lua_State* L)
     return luaL_error(L, "WebSocket is not connected, can't send text");
   }
 
-  std::stringstream data;
-  int argc = lua_gettop(L);
-
-  for (int i = 2; i <= argc; i++) {
-    size_t bufLen;
-    const char* buf = lua_tolstring(L, i, &bufLen);
-    data.write(buf, bufLen);
+  std::string data;
+  append_message_data(L, 2, data);
+  if (!can_send(L, ws, data.size())) {
+    lua_pushboolean(L, false);
+    return 1;
   }
 
-  if (!ws->sendText(data.str()).success) {
+  if (!ws->sendText(data).success) {
     return luaL_error(L, "WebSocket failed to send text");
   }
-  return 0;
+  lua_pushboolean(L, true);
+  return 1;
 }
 
 int WebSocket_sendBinary(lua_State* L)
@@ -155,19 +264,18 @@ int WebSocket_sendBinary(lua_State* L)
     return luaL_error(L, "WebSocket is not connected, can't send data");
   }
 
-  std::stringstream data;
-  int argc = lua_gettop(L);
-
-  for (int i = 2; i <= argc; i++) {
-    size_t bufLen;
-    const char* buf = lua_tolstring(L, i, &bufLen);
-    data.write(buf, bufLen);
+  std::string data;
+  append_message_data(L, 2, data);
+  if (!can_send(L, ws, data.size())) {
+    lua_pushboolean(L, false);
+    return 1;
   }
 
-  if (!ws->sendBinary(data.str()).success) {
+  if (!ws->sendBinary(data).success) {
     return luaL_error(L, "WebSocket failed to send data");
   }
-  return 0;
+  lua_pushboolean(L, true);
+  return 1;
 }
 
 int WebSocket_sendPing(lua_State* L)
@@ -197,6 +305,7 @@ int WebSocket_connect(lua_State* L)
 #ifdef ENABLE_UI
     if (App::instance()->isGui()) {
       g_timer = std::make_unique<ui::Timer>(33, ui::Manager::getDefault());
+      g_timer->Tick.connect(&check_drained_queues);
       g_timer->start();
     }
 #endif
@@ -220,6 +329,29 @@ int WebSocket_get_url(lua_State* L)
   return 1;
 }
 
+int WebSocket_get_bufferedAmount(lua_State* L)
+{
+  auto ws = get_ptr<ix::WebSocket>(L, 1);
+  lua_pushinteger(L, ws->bufferedAmount());
+  return 1;
+}
+
+int WebSocket_get_maxBufferedAmount(lua_State* L)
+{
+  auto ws = get_ptr<ix::WebSocket>(L, 1);
+  auto it = g_backpressure.find(ws);
+  lua_pushinteger(L, it != g_backpressure.end() ? it->second.maxBufferedAmount: 0);
+  return 1;
+}
+
+int WebSocket_set_maxBufferedAmount(lua_State* L)
+{
+  auto ws = get_ptr<ix::WebSocket>(L, 1);
+  g_backpressure[ws].maxBufferedAmount =
+    size_t(std::max<lua_Integer>(0, luaL_checkinteger(L, 2)));
+  return 0;
+}
+
 const luaL_Reg WebSocket_methods[] = {
   { "__gc", WebSocket_gc },
   { "close", WebSocket_close },
@@ -232,6 +364,8 @@ const luaL_Reg WebSocket_methods[] = {
 
 const Property WebSocket_properties[] = {
   { "url", WebSocket_get_url, nullptr },
+  { "bufferedAmount", WebSocket_get_bufferedAmount, nullptr },
+  { "maxBufferedAmount", WebSocket_get_maxBufferedAmount, WebSocket_set_maxBufferedAmount },
   { nullptr, nullptr, nullptr }
 };
 
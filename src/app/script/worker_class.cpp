@@ -0,0 +1,442 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/app.h"
+#include "app/script/engine.h"
+#include "app/script/luacpp.h"
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "ui/system.h"
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace app {
+namespace script {
+
+namespace {
+
+// Maximum number of nested tables that can be passed to/from a
+// worker.
+constexpr int kMaxDepth = 64;
+
+// A Lua value copied from one Lua state to another one (the Lua
+// state of the script and the Lua state of the worker can only share
+// plain values).
+struct Value {
+  enum Type { Nil, Boolean, Integer, Number, String, Table, Image };
+  Type type = Nil;
+  bool b = false;
+  lua_Integer i = 0;
+  lua_Number n = 0.0;
+  std::string s;
+  std::vector<Value> keys, values; // Table
+  doc::ImageRef image;             // Detached copy of an image
+};
+
+// Copies the value at "index" in "v". Returns false if the value
+// cannot be copied (e.g. functions or userdata).
+bool get_value(lua_State* L, int index, Value& v, int depth = 0)
+{
+  index = lua_absindex(L, index);
+  switch (lua_type(L, index)) {
+    case LUA_TNONE:
+    case LUA_TNIL:
+      v.type = Value::Nil;
+      return true;
+    case LUA_TBOOLEAN:
+      v.type = Value::Boolean;
+      v.b = lua_toboolean(L, index);
+      return true;
+    case LUA_TNUMBER:
+      if (lua_isinteger(L, index)) {
+        v.type = Value::Integer;
+        v.i = lua_tointeger(L, index);
+      }
+      else {
+        v.type = Value::Number;
+        v.n = lua_tonumber(L, index);
+      }
+      return true;
+    case LUA_TSTRING: {
+      size_t len;
+      const char* s = lua_tolstring(L, index, &len);
+      v.type = Value::String;
+      v.s.assign(s, len);
+      return true;
+    }
+    case LUA_TTABLE:
+      if (depth >= kMaxDepth)
+        return false;
+      v.type = Value::Table;
+      lua_pushnil(L);
+      while (lua_next(L, index) != 0) {
+        Value key, value;
+        if (!get_value(L, -2, key, depth+1) ||
+            !get_value(L, -1, value, depth+1)) {
+          lua_pop(L, 2);
+          return false;
+        }
+        v.keys.push_back(std::move(key));
+        v.values.push_back(std::move(value));
+        lua_pop(L, 1);
+      }
+      return true;
+    case LUA_TUSERDATA:
+      // Images of the script are copied (only when the values are
+      // copied from the main Lua state)
+      if (App::instance() &&
+          App::instance()->scriptEngine() &&
+          App::instance()->scriptEngine()->luaState() == L) {
+        if (const doc::Image* image = may_get_image_from_arg(L, index)) {
+          v.type = Value::Image;
+          v.image.reset(doc::Image::createCopy(image));
+          return true;
+        }
+      }
+      return false;
+  }
+  return false;
+}
+
+void push_value(lua_State* L, const Value& v)
+{
+  switch (v.type) {
+    case Value::Nil:
+      lua_pushnil(L);
+      break;
+    case Value::Boolean:
+      lua_pushboolean(L, v.b);
+      break;
+    case Value::Integer:
+      lua_pushinteger(L, v.i);
+      break;
+    case Value::Number:
+      lua_pushnumber(L, v.n);
+      break;
+    case Value::String:
+      lua_pushlstring(L, v.s.c_str(), v.s.size());
+      break;
+    case Value::Table:
+      lua_createtable(L, 0, int(v.keys.size()));
+      for (size_t i=0; i<v.keys.size(); ++i) {
+        push_value(L, v.keys[i]);
+        push_value(L, v.values[i]);
+        lua_rawset(L, -3);
+      }
+      break;
+    case Value::Image: {
+      // Images are passed to the worker as read-only tables with the
+      // image spec and its pixels (as Image.bytes)
+      const doc::Image* image = v.image.get();
+      lua_createtable(L, 0, 4);
+      setfield_integer(L, "width", image->width());
+      setfield_integer(L, "height", image->height());
+      setfield_integer(L, "colorMode", image->pixelFormat());
+      lua_pushlstring(L, (const char*)image->getPixelAddress(0, 0),
+                      size_t(image->rowBytes()) * image->height());
+      lua_setfield(L, -2, "bytes");
+      break;
+    }
+  }
+}
+
+struct WorkerData {
+  // Lua state of the script (nullptr when the Worker object is
+  // garbage collected, e.g. when the script engine is destroyed).
+  lua_State* L = nullptr;
+  int workerRef = LUA_REFNIL;   // Keeps the Worker alive while it's running
+  int onfinishRef = LUA_REFNIL;
+
+  // Worker input
+  std::string code;
+  bool binary = false;
+  std::vector<Value> args;
+
+  // Worker output
+  bool ok = false;
+  std::vector<Value> results;
+
+  std::atomic<bool> canceled { false };
+  std::atomic<bool> finished { false };
+  bool delivered = false;
+  std::thread thread;
+};
+
+using WorkerDataPtr = std::shared_ptr<WorkerData>;
+
+struct Worker {
+  WorkerDataPtr data;
+  Worker(const WorkerDataPtr& data) : data(data) { }
+};
+
+int dump_writer(lua_State* L, const void* p, size_t sz, void* ud)
+{
+  ((std::string*)ud)->append((const char*)p, sz);
+  return 0;
+}
+
+// Runs the worker function in a new Lua state (only with the
+// standard libraries that don't access the file system or the OS).
+void run_worker(WorkerData* data)
+{
+  lua_State* WL = luaL_newstate();
+  *(WorkerData**)lua_getextraspace(WL) = data;
+
+  // Check if the worker was canceled each 1000 instructions
+  lua_sethook(
+    WL, [](lua_State* WL, lua_Debug*) {
+      auto data = *(WorkerData**)lua_getextraspace(WL);
+      if (data->canceled)
+        luaL_error(WL, "worker canceled");
+    }, LUA_MASKCOUNT, 1000);
+
+  try {
+    luaL_requiref(WL, LUA_GNAME, luaopen_base, 1);
+    luaL_requiref(WL, LUA_COLIBNAME, luaopen_coroutine, 1);
+    luaL_requiref(WL, LUA_TABLIBNAME, luaopen_table, 1);
+    luaL_requiref(WL, LUA_STRLIBNAME, luaopen_string, 1);
+    luaL_requiref(WL, LUA_MATHLIBNAME, luaopen_math, 1);
+    luaL_requiref(WL, LUA_UTF8LIBNAME, luaopen_utf8, 1);
+    lua_pop(WL, 6);
+
+    // Remove functions that can access files
+    for (const char* name : { "dofile", "loadfile", "print" }) {
+      lua_pushnil(WL);
+      lua_setglobal(WL, name);
+    }
+
+    int status = luaL_loadbufferx(WL, data->code.c_str(), data->code.size(),
+                                  "=worker", data->binary ? "b": "t");
+    if (status == LUA_OK && data->binary) {
+      // The first upvalue is set to the globals table by
+      // luaL_loadbufferx(), but only the _ENV upvalue must be the
+      // globals table, other upvalues are not available in the worker.
+      for (int i=1; const char* name = lua_getupvalue(WL, -1, i); ++i) {
+        lua_pop(WL, 1);
+        if (std::strcmp(name, "_ENV") == 0)
+          lua_pushglobaltable(WL);
+        else
+          lua_pushnil(WL);
+        lua_setupvalue(WL, -2, i);
+      }
+    }
+    if (status == LUA_OK) {
+      for (const Value& arg : data->args)
+        push_value(WL, arg);
+      status = lua_pcall(WL, int(data->args.size()), LUA_MULTRET, 0);
+    }
+
+    if (status == LUA_OK) {
+      data->ok = true;
+      const int n = lua_gettop(WL);
+      data->results.resize(n);
+      for (int i=0; i<n; ++i) {
+        if (!get_value(WL, i+1, data->results[i])) {
+          data->ok = false;
+          data->results.resize(1);
+          data->results[0].type = Value::String;
+          data->results[0].s = "worker results must be booleans, numbers, strings, or tables";
+          break;
+        }
+      }
+    }
+    else {
+      data->results.resize(1);
+      get_value(WL, -1, data->results[0]);
+    }
+  }
+  catch (const std::exception& ex) {
+    data->ok = false;
+    data->results.resize(1);
+    data->results[0].type = Value::String;
+    data->results[0].s = ex.what();
+  }
+
+  lua_close(WL);
+}
+
+// Calls the onfinish callback with the results of the worker (from
+// the UI thread). Returns the number of values pushed in the stack
+// (the results of the worker).
+int deliver_results(WorkerData* data)
+{
+  lua_State* L = data->L;
+  if (!L || !data->finished || data->delivered)
+    return 0;
+
+  data->delivered = true;
+
+  if (data->onfinishRef != LUA_REFNIL) {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, data->onfinishRef);
+    lua_pushboolean(L, data->ok);
+    for (const Value& v : data->results)
+      push_value(L, v);
+    if (lua_pcall(L, int(data->results.size()) + 1, 0, 0)) {
+      if (const char* s = lua_tostring(L, -1))
+        App::instance()->scriptEngine()->consolePrint(s);
+      lua_pop(L, 1);
+    }
+    luaL_unref(L, LUA_REGISTRYINDEX, data->onfinishRef);
+    data->onfinishRef = LUA_REFNIL;
+  }
+
+  luaL_unref(L, LUA_REGISTRYINDEX, data->workerRef);
+  data->workerRef = LUA_REFNIL;
+  return 0;
+}
+
+// app.worker(function, { args... } [, onfinish])
+//
+// The function is executed in a background thread with its own Lua
+// state, so it cannot access upvalues (local variables from outer
+// scopes) or the app API; it can only use the given arguments
+// (copied) and the standard string/table/math/utf8/coroutine
+// libraries. Images in "args" are copied and passed as tables with
+// width, height, colorMode, and bytes fields.
+//
+// The "onfinish(ok, ...)" callback receives the results of the
+// function (or false and the error message) in the UI thread.
+int App_worker(lua_State* L)
+{
+  auto data = std::make_shared<WorkerData>();
+  data->L = L;
+
+  if (lua_isfunction(L, 1)) {
+    if (lua_iscfunction(L, 1))
+      return luaL_error(L, "app.worker() cannot execute native functions");
+    lua_pushvalue(L, 1);
+    lua_dump(L, dump_writer, &data->code, 0);
+    lua_pop(L, 1);
+    data->binary = true;
+  }
+  else if (const char* code = lua_tostring(L, 1)) {
+    data->code = code;
+  }
+  else
+    return luaL_error(L, "app.worker() expects a function or Lua code as first argument");
+
+  if (lua_istable(L, 2)) {
+    const int n = int(luaL_len(L, 2));
+    data->args.resize(n);
+    for (int i=0; i<n; ++i) {
+      lua_geti(L, 2, i+1);
+      if (!get_value(L, -1, data->args[i]))
+        return luaL_error(L, "app.worker() argument %d cannot be passed to a worker", i+1);
+      lua_pop(L, 1);
+    }
+  }
+
+  if (lua_isfunction(L, 3)) {
+    lua_pushvalue(L, 3);
+    data->onfinishRef = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+
+  push_new<Worker>(L, data);
+  lua_pushvalue(L, -1);
+  data->workerRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
+  const bool isGui = App::instance()->isGui();
+  data->thread = std::thread(
+    [data, isGui]{
+      run_worker(data.get());
+      data->finished = true;
+
+#ifdef ENABLE_UI
+      // Deliver the results in the UI thread (in batch mode the
+      // script must call Worker:wait())
+      if (isGui) {
+        ui::execute_from_ui_thread([data]{
+          deliver_results(data.get());
+        });
+      }
+#endif
+    });
+  return 1;
+}
+
+int Worker_gc(lua_State* L)
+{
+  auto worker = get_obj<Worker>(L, 1);
+  WorkerDataPtr data = worker->data;
+  data->canceled = true;
+  if (data->thread.joinable())
+    data->thread.join();
+  data->L = nullptr;
+  worker->~Worker();
+  return 0;
+}
+
+// Waits the worker to finish, calls the onfinish callback (if it
+// wasn't called yet), and returns the results of the worker
+// function (like pcall()).
+int Worker_wait(lua_State* L)
+{
+  auto worker = get_obj<Worker>(L, 1);
+  WorkerDataPtr data = worker->data;
+  if (data->thread.joinable())
+    data->thread.join();
+
+  deliver_results(data.get());
+
+  lua_pushboolean(L, data->ok);
+  for (const Value& v : data->results)
+    push_value(L, v);
+  return int(data->results.size()) + 1;
+}
+
+int Worker_cancel(lua_State* L)
+{
+  auto worker = get_obj<Worker>(L, 1);
+  worker->data->canceled = true;
+  return 0;
+}
+
+int Worker_get_isRunning(lua_State* L)
+{
+  auto worker = get_obj<Worker>(L, 1);
+  lua_pushboolean(L, !worker->data->finished);
+  return 1;
+}
+
+const luaL_Reg Worker_methods[] = {
+  { "__gc", Worker_gc },
+  { "wait", Worker_wait },
+  { "cancel", Worker_cancel },
+  { nullptr, nullptr }
+};
+
+const Property Worker_properties[] = {
+  { "isRunning", Worker_get_isRunning, nullptr },
+  { nullptr, nullptr, nullptr }
+};
+
+} // anonymous namespace
+
+DEF_MTNAME(Worker);
+
+void register_worker_class(lua_State* L)
+{
+  REG_CLASS(L, Worker);
+  REG_CLASS_PROPERTIES(L, Worker);
+
+  lua_getglobal(L, "app");
+  lua_pushstring(L, "worker");
+  lua_pushcfunction(L, App_worker);
+  lua_rawset(L, -3);
+  lua_pop(L, 1);
+}
+
+} // namespace script
+} // namespace app
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2023  Igara Studio S.A.
+// Copyright (C) 2023-2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -12,6 +12,7 @@
 #include "app/shade.h"
 
 #include "base/split_string.h"
+#include "doc/palette.h"
 
 namespace app {
 
@@ -39,4 +40,27 @@ std::string shade_to_string(const Shade& shade)
   return res;
 }
 
+void ShadeIndexTable::reset(const doc::Palette* palette)
+{
+  // Keep the load factor <= 1/2
+  std::size_t capacity = 8;
+  while (capacity < 2*std::size_t(palette->size()))
+    capacity *= 2;
+  m_slots.assign(capacity, Slot());
+
+  const std::size_t mask = capacity-1;
+  for (int index=0; index<palette->size(); ++index) {
+    const doc::color_t color = palette->getEntry(index);
+    std::size_t i = slot(color);
+    while (m_slots[i].index >= 0 && m_slots[i].color != color)
+      i = (i+1) & mask;
+
+    // Keep the first index of repeated colors
+    if (m_slots[i].index < 0) {
+      m_slots[i].color = color;
+      m_slots[i].index = index;
+    }
+  }
+}
+
 } // namespace app
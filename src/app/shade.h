@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -9,9 +10,15 @@
 #pragma once
 
 #include "app/color.h"
+#include "doc/color.h"
 
+#include <cstdint>
 #include <vector>
 
+namespace doc {
+  class Palette;
+}
+
 namespace app {
 
   typedef std::vector<app::Color> Shade;
@@ -19,6 +26,42 @@ namespace app {
   Shade shade_from_string(const std::string& str);
   std::string shade_to_string(const Shade& shade);
 
+  // Hash table (open addressing) to find the index of a color in the
+  // colors of a shade (or a palette) with just one lookup, instead
+  // of comparing each painted pixel with all the colors. If a color
+  // is repeated, the first index is returned (like
+  // doc::Palette::findExactMatch()).
+  class ShadeIndexTable {
+  public:
+    void reset(const doc::Palette* palette);
+
+    // Returns -1 if the color is not in the table.
+    int findIndex(const doc::color_t color) const {
+      if (m_slots.empty())
+        return -1;
+      const std::size_t mask = m_slots.size()-1;
+      for (std::size_t i=slot(color); ; i=(i+1) & mask) {
+        const Slot& s = m_slots[i];
+        if (s.index < 0)
+          return -1;
+        if (s.color == color)
+          return s.index;
+      }
+    }
+
+  private:
+    struct Slot {
+      doc::color_t color = 0;
+      int index = -1;
+    };
+
+    std::size_t slot(const doc::color_t color) const {
+      return std::size_t((color * 0x9e3779b1u) >> 16) & (m_slots.size()-1);
+    }
+
+    std::vector<Slot> m_slots;
+  };
+
 } // namespace app
 
 #endif
@@ -0,0 +1,45 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+#include "app/shade.h"
+#include "doc/palette.h"
+
+#include <cstdlib>
+
+using namespace app;
+using namespace doc;
+
+TEST(ShadeIndexTable, LikePaletteFindExactMatch)
+{
+  std::srand(1);
+  for (int n : { 0, 1, 5, 32, 256 }) {
+    Palette palette(frame_t(0), n);
+    for (int i=0; i<n; ++i) {
+      // Few different colors to test repeated entries
+      palette.setEntry(i, rgba(std::rand()%4 * 64, std::rand()%4 * 64,
+                               std::rand()%2 * 128, 255));
+    }
+
+    ShadeIndexTable table;
+    table.reset(&palette);
+    for (int r=0; r<256; r+=64)
+      for (int g=0; g<256; g+=64)
+        for (int b=0; b<256; b+=128)
+          for (int a : { 0, 255 }) {
+            EXPECT_EQ(palette.findExactMatch(r, g, b, a, -1),
+                      table.findIndex(rgba(r, g, b, a)))
+              << " n=" << n << " color=" << r << "," << g << "," << b << "," << a;
+          }
+  }
+}
+
+TEST(ShadeIndexTable, Empty)
+{
+  ShadeIndexTable table;
+  EXPECT_EQ(-1, table.findIndex(rgba(0, 0, 0, 255)));
+}
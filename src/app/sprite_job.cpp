@@ -11,6 +11,7 @@
 
 #include "app/sprite_job.h"
 
+#include "app/doc_lock_stats.h"
 #include "base/log.h"
 
 namespace app {
@@ -53,6 +54,7 @@ void SpriteJob::onSpriteJob(Tx& tx)
 
 void SpriteJob::onJob()
 {
+  DocLockStats::Operation operation("sprite-job");
   Tx subtx(m_lockAction, m_ctx, m_doc);
   onSpriteJob(subtx);
 }
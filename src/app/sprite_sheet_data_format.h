@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -13,6 +13,7 @@ namespace app {
   enum class SpriteSheetDataFormat {
     JsonHash,
     JsonArray,
+    Binary,
     Default = JsonHash
   };
 
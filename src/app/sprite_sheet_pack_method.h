@@ -0,0 +1,22 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_SPRITE_SHEET_PACK_METHOD_H_INCLUDED
+#define APP_SPRITE_SHEET_PACK_METHOD_H_INCLUDED
+#pragma once
+
+namespace app {
+
+  // Algorithm used to pack the sprites with SpriteSheetType::Packed
+  enum class SpriteSheetPackMethod {
+    BestFit,
+    MaxRects,
+    Skyline
+  };
+
+} // namespace app
+
+#endif
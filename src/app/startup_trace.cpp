@@ -0,0 +1,144 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/startup_trace.h"
+
+#include "base/fstream_path.h"
+#include "base/log.h"
+
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace app {
+
+namespace {
+
+struct Event {
+  std::string name;
+  char phase;                   // 'X' = complete event, 'i' = instant event
+  StartupTrace::Clock::time_point start;
+  StartupTrace::Clock::duration duration;
+  std::thread::id thread;
+};
+
+std::mutex g_mutex;
+bool g_enabled = false;
+std::string g_filename;
+StartupTrace::Clock::time_point g_start;
+std::thread::id g_mainThread;
+std::vector<Event> g_events;
+
+void add_event(Event&& ev)
+{
+  const std::lock_guard lock(g_mutex);
+  if (g_enabled)
+    g_events.push_back(std::move(ev));
+}
+
+} // anonymous namespace
+
+StartupTrace::StartupTrace(const char* name)
+  : m_name(name)
+  , m_start(Clock::now())
+  , m_enabled(isEnabled())
+{
+}
+
+StartupTrace::~StartupTrace()
+{
+  if (m_enabled)
+    add_event({ m_name, 'X', m_start, Clock::now() - m_start,
+                std::this_thread::get_id() });
+}
+
+// static
+void StartupTrace::start(const std::string& filename)
+{
+  const std::lock_guard lock(g_mutex);
+  if (g_enabled || filename.empty())
+    return;
+
+  g_enabled = true;
+  g_filename = filename;
+  g_start = Clock::now();
+  g_mainThread = std::this_thread::get_id();
+}
+
+// static
+void StartupTrace::finish()
+{
+  const std::lock_guard lock(g_mutex);
+  if (!g_enabled)
+    return;
+
+  g_enabled = false;
+
+  // Each thread is identified with a number (1 for the main thread)
+  std::vector<std::thread::id> threads = { g_mainThread };
+  auto tid = [&threads](const std::thread::id id) {
+    auto it = std::find(threads.begin(), threads.end(), id);
+    if (it != threads.end())
+      return int(it - threads.begin()) + 1;
+    threads.push_back(id);
+    return int(threads.size());
+  };
+
+  std::ofstream f(FSTREAM_PATH(g_filename), std::ios::out);
+  if (!f) {
+    LOG(ERROR, "APP: Cannot write startup trace to '%s'\n", g_filename.c_str());
+    return;
+  }
+
+  using std::chrono::duration_cast;
+  using std::chrono::microseconds;
+
+  f << "{ \"traceEvents\": [";
+  bool first = true;
+  for (const Event& ev : g_events) {
+    if (first)
+      first = false;
+    else
+      f << ",";
+
+    f << "\n  { \"name\": \"" << ev.name << "\""
+      << ", \"cat\": \"startup\""
+      << ", \"ph\": \"" << ev.phase << "\""
+      << ", \"ts\": " << duration_cast<microseconds>(ev.start - g_start).count();
+    if (ev.phase == 'X')
+      f << ", \"dur\": " << duration_cast<microseconds>(ev.duration).count();
+    else
+      f << ", \"s\": \"g\"";
+    f << ", \"pid\": 1"
+      << ", \"tid\": " << tid(ev.thread) << " }";
+  }
+  f << "\n],\n"
+    << "\"displayTimeUnit\": \"ms\" }\n";
+
+  g_events.clear();
+}
+
+// static
+bool StartupTrace::isEnabled()
+{
+  const std::lock_guard lock(g_mutex);
+  return g_enabled;
+}
+
+// static
+void StartupTrace::mark(const char* name)
+{
+  add_event({ name, 'i', Clock::now(), StartupTrace::Clock::duration(0),
+              std::this_thread::get_id() });
+}
+
+} // namespace app
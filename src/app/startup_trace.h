@@ -0,0 +1,56 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_STARTUP_TRACE_H_INCLUDED
+#define APP_STARTUP_TRACE_H_INCLUDED
+#pragma once
+
+#include <chrono>
+#include <string>
+
+namespace app {
+
+  // Records the wall-time of each phase of the program startup
+  // (enabled with --trace-startup <file.json> or the
+  // ASEPRITE_TRACE_STARTUP=<file.json> environment variable) and
+  // saves them in the Chrome trace-event format (which can be opened
+  // with chrome://tracing or https://ui.perfetto.dev/).
+  //
+  // Usage:
+  //
+  //   {
+  //     StartupTrace span("extensions");
+  //     ... code to measure ...
+  //   }
+  //
+  class StartupTrace {
+  public:
+    typedef std::chrono::steady_clock Clock;
+
+    StartupTrace(const char* name);
+    ~StartupTrace();
+
+    // Starts recording the spans (does nothing if it's already
+    // started or the filename is empty).
+    static void start(const std::string& filename);
+
+    // Saves the recorded spans in the file and stops recording.
+    static void finish();
+
+    static bool isEnabled();
+
+    // Adds an instant event (e.g. "first paint")
+    static void mark(const char* name);
+
+  private:
+    const char* m_name;
+    Clock::time_point m_start;
+    bool m_enabled;
+  };
+
+} // namespace app
+
+#endif
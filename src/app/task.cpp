@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -10,36 +10,77 @@
 
 #include "app/task.h"
 
-#include "base/task.h"
-#include "base/thread.h"
-#include "base/thread_pool.h"
+#include "base/debug.h"
+#include "base/log.h"
 
-namespace app {
+#include <exception>
 
-static base::thread_pool tasks_pool(4);
+namespace app {
 
 Task::Task()
-  : m_token(nullptr)
+  : m_ownThread(true)
+{
+}
+
+Task::Task(const doc::TaskPriority priority)
+  : m_priority(priority)
+  , m_ownThread(false)
 {
 }
 
 Task::~Task()
 {
+  // The function uses this Task (and its token) until it finishes
+  wait();
+  if (m_thread.joinable())
+    m_thread.join();
 }
 
 void Task::run(base::task::func_t&& func)
 {
-  const std::lock_guard lock(m_token_mutex);
-  m_task.on_execute(std::move(func));
-  m_token = &m_task.start(tasks_pool);
+  ASSERT(!m_running);
+
+  base::task_token* token;
+  {
+    const std::lock_guard lock(m_token_mutex);
+    m_token = std::make_unique<base::task_token>();
+    token = m_token.get();
+  }
+
+  m_running = true;
+  m_completed = false;
+
+  auto taskFunc =
+    [this, token, func = std::move(func)]{
+      try {
+        func(*token);
+      }
+      catch (const std::exception& ex) {
+        LOG(ERROR, "TASK: Exception: %s\n", ex.what());
+      }
+
+      const std::lock_guard lock(m_done_mutex);
+      m_running = false;
+      m_completed = true;
+      m_done_cv.notify_all();
+    };
+
+  if (m_ownThread) {
+    // The previous function was already completed
+    if (m_thread.joinable())
+      m_thread.join();
+    m_thread = std::thread(std::move(taskFunc));
+  }
+  else {
+    doc::TaskScheduler::instance().execute(m_priority,
+                                           std::move(taskFunc));
+  }
 }
 
 void Task::wait()
 {
-  // TODO wait a condition variable
-  while (!m_task.completed()) {
-    base::this_thread::sleep_for(0.1);
-  }
+  std::unique_lock lock(m_done_mutex);
+  m_done_cv.wait(lock, [this]{ return !m_running; });
 }
 
 } // namespace app
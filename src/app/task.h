@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -9,15 +9,26 @@
 #pragma once
 
 #include "base/task.h"
+#include "doc/task_scheduler.h"
 
+#include <atomic>
+#include <condition_variable>
 #include <functional>
+#include <memory>
 #include <mutex>
+#include <thread>
 
 namespace app {
 
+  // Function that can be canceled and reports its progress through a
+  // base::task_token. By default it's executed in its own thread (for
+  // long running tasks or blocking I/O, which must not occupy the
+  // workers of the doc::TaskScheduler), or in the shared
+  // doc::TaskScheduler with the given priority (for CPU-bound tasks).
   class Task {
   public:
     Task();
+    explicit Task(doc::TaskPriority priority);
     ~Task();
 
     void run(base::task::func_t&& func);
@@ -26,11 +37,11 @@ namespace app {
     // Returns true when the task is completed (whether it was
     // canceled or not)
     bool completed() const {
-      return m_task.completed();
+      return m_completed;
     }
 
     bool running() const {
-      return m_task.running();
+      return m_running;
     }
 
     bool canceled() const {
@@ -60,9 +71,15 @@ namespace app {
     }
 
   private:
-    base::task m_task;
+    doc::TaskPriority m_priority = doc::TaskPriority::Background;
+    bool m_ownThread;
+    std::thread m_thread;
+    std::atomic<bool> m_running { false };
+    std::atomic<bool> m_completed { false };
+    std::mutex m_done_mutex;
+    std::condition_variable m_done_cv;
     mutable std::mutex m_token_mutex;
-    base::task_token* m_token;
+    std::unique_ptr<base::task_token> m_token;
   };
 
 } // namespace app
@@ -0,0 +1,196 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/thumbnail_disk_cache.h"
+
+#include "app/resource_finder.h"
+#include "base/fs.h"
+#include "base/fstream_path.h"
+#include "base/time.h"
+#include "doc/image.h"
+#include "doc/palette.h"
+#include "doc/primitives.h"
+#include "fmt/format.h"
+#include "zlib.h"
+
+#include <fstream>
+#include <vector>
+
+namespace app {
+
+using namespace doc;
+
+namespace {
+
+// "ATHC" (Aseprite THumbnail Cache) + format version
+constexpr uint32_t kMagicNumber = 0x43485441;
+constexpr uint32_t kVersion = 1;
+
+// Thumbnails of the file selector are 128x128 at most
+constexpr int kMaxSize = 1024;
+
+// Identifies the version of the original file (the cache file is
+// overwritten when the file is modified).
+std::string file_version_key(const std::string& filename)
+{
+  const base::Time t = base::get_modification_time(filename);
+  return fmt::format("{}\n{}\n{:04}{:02}{:02}{:02}{:02}{:02}",
+                     filename, base::file_size(filename),
+                     t.year, t.month, t.day,
+                     t.hour, t.minute, t.second);
+}
+
+// FNV-1a hash (the std::hash<> result can change between compilers)
+uint64_t hash_string(const std::string& str)
+{
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (const char chr : str) {
+    hash ^= uint8_t(chr);
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+void write32(std::ostream& os, const uint32_t value)
+{
+  const uint8_t bytes[4] = { uint8_t(value), uint8_t(value >> 8),
+                             uint8_t(value >> 16), uint8_t(value >> 24) };
+  os.write((const char*)bytes, 4);
+}
+
+uint32_t read32(std::istream& is)
+{
+  uint8_t bytes[4] = { 0, 0, 0, 0 };
+  is.read((char*)bytes, 4);
+  return (uint32_t(bytes[0]) |
+          (uint32_t(bytes[1]) << 8) |
+          (uint32_t(bytes[2]) << 16) |
+          (uint32_t(bytes[3]) << 24));
+}
+
+color_t to_rgba(const Image* image, const Palette* palette, const color_t c)
+{
+  switch (image->pixelFormat()) {
+    case IMAGE_RGB:
+      return c;
+    case IMAGE_GRAYSCALE: {
+      const int v = graya_getv(c);
+      return rgba(v, v, v, graya_geta(c));
+    }
+    case IMAGE_INDEXED:
+      if (c == image->maskColor() || !palette)
+        return 0;
+      return palette->getEntry(c);
+  }
+  return 0;
+}
+
+} // anonymous namespace
+
+ThumbnailDiskCache::ThumbnailDiskCache()
+{
+  ResourceFinder rf(false);
+  rf.includeUserDir(base::join_path(base::join_path("cache", "thumbnails"), ".").c_str());
+  m_dir = rf.getFirstOrCreateDefault();
+}
+
+ImageRef ThumbnailDiskCache::load(const std::string& filename) const
+{
+  if (m_dir.empty())
+    return nullptr;
+
+  std::ifstream f(FSTREAM_PATH(cacheFilename(filename)), std::ios::binary);
+  if (!f)
+    return nullptr;
+
+  if (read32(f) != kMagicNumber ||
+      read32(f) != kVersion)
+    return nullptr;
+
+  // Check that the cached thumbnail is for this version of the file
+  const std::string key = file_version_key(filename);
+  const uint32_t keySize = read32(f);
+  if (!f || keySize != key.size())
+    return nullptr;
+
+  std::string cachedKey(keySize, '\0');
+  f.read(&cachedKey[0], keySize);
+  if (!f || cachedKey != key)
+    return nullptr;
+
+  const int w = int(read32(f));
+  const int h = int(read32(f));
+  const uint32_t compressedSize = read32(f);
+  if (!f ||
+      w < 1 || w > kMaxSize ||
+      h < 1 || h > kMaxSize ||
+      compressedSize == 0 ||
+      compressedSize > compressBound(uLong(4*w*h)))
+    return nullptr;
+
+  std::vector<uint8_t> buf(compressedSize);
+  f.read((char*)&buf[0], compressedSize);
+  if (!f)
+    return nullptr;
+
+  ImageRef image(Image::create(IMAGE_RGB, w, h));
+  uLongf rawSize = uLongf(4*w*h);
+  if (uncompress(image->getPixelAddress(0, 0), &rawSize,
+                 &buf[0], uLong(compressedSize)) != Z_OK ||
+      rawSize != uLongf(4*w*h))
+    return nullptr;
+
+  return image;
+}
+
+void ThumbnailDiskCache::save(const std::string& filename,
+                              const Image* thumbnail,
+                              const Palette* palette) const
+{
+  const int w = thumbnail->width();
+  const int h = thumbnail->height();
+  if (m_dir.empty() || w > kMaxSize || h > kMaxSize)
+    return;
+
+  std::vector<uint8_t> raw(4*w*h);
+  uint32_t* dst = (uint32_t*)&raw[0];
+  for (int y=0; y<h; ++y)
+    for (int x=0; x<w; ++x)
+      *(dst++) = to_rgba(thumbnail, palette, get_pixel(thumbnail, x, y));
+
+  uLongf compressedSize = compressBound(uLong(raw.size()));
+  std::vector<uint8_t> buf(compressedSize);
+  if (compress2(&buf[0], &compressedSize,
+                &raw[0], uLong(raw.size()), Z_BEST_SPEED) != Z_OK)
+    return;
+
+  std::ofstream f(FSTREAM_PATH(cacheFilename(filename)),
+                  std::ios::binary | std::ios::trunc);
+  if (!f)
+    return;
+
+  const std::string key = file_version_key(filename);
+  write32(f, kMagicNumber);
+  write32(f, kVersion);
+  write32(f, uint32_t(key.size()));
+  f.write(key.c_str(), key.size());
+  write32(f, uint32_t(w));
+  write32(f, uint32_t(h));
+  write32(f, uint32_t(compressedSize));
+  f.write((const char*)&buf[0], compressedSize);
+}
+
+std::string ThumbnailDiskCache::cacheFilename(const std::string& filename) const
+{
+  return base::join_path(
+    m_dir, fmt::format("{:016x}.thumb", hash_string(filename)));
+}
+
+} // namespace app
@@ -0,0 +1,55 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_THUMBNAIL_DISK_CACHE_H_INCLUDED
+#define APP_THUMBNAIL_DISK_CACHE_H_INCLUDED
+#pragma once
+
+#include "doc/image_ref.h"
+
+#include <string>
+
+namespace doc {
+  class Image;
+  class Palette;
+}
+
+namespace app {
+
+  // Persistent cache of the thumbnails of the file selector (in the
+  // "cache/thumbnails" folder of the user directory), so opening a
+  // folder again doesn't need to decode each file.
+  //
+  // There is one cache file for each file path, which includes the
+  // size and modification time of the original file to know if the
+  // thumbnail is still valid. The pixels are compressed with zlib.
+  //
+  // load() and save() can be called from several threads at the
+  // same time (for different files).
+  class ThumbnailDiskCache {
+  public:
+    ThumbnailDiskCache();
+
+    // Returns the cached thumbnail (a RGB image) of the given file, or
+    // nullptr if there is no thumbnail for the current version of
+    // the file.
+    doc::ImageRef load(const std::string& filename) const;
+
+    // Saves the thumbnail of the given file (the palette is used to
+    // convert indexed images to RGB).
+    void save(const std::string& filename,
+              const doc::Image* thumbnail,
+              const doc::Palette* palette) const;
+
+  private:
+    std::string cacheFilename(const std::string& filename) const;
+
+    std::string m_dir;
+  };
+
+} // namespace app
+
+#endif
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -14,15 +14,17 @@
 #include "app/app.h"
 #include "app/cmd/convert_color_profile.h"
 #include "app/doc.h"
+#include "app/doc_lock_stats.h"
 #include "app/file/file.h"
 #include "app/file_system.h"
+#include "app/thumbnail_disk_cache.h"
 #include "app/util/conversion_to_surface.h"
-#include "base/thread.h"
 #include "doc/algorithm/rotate.h"
 #include "doc/image.h"
 #include "doc/palette.h"
 #include "doc/primitives.h"
 #include "doc/sprite.h"
+#include "doc/task_scheduler.h"
 #include "os/system.h"
 #include "render/projection.h"
 #include "render/render.h"
@@ -31,20 +33,23 @@
 #include <algorithm>
 #include <atomic>
 #include <memory>
-#include <thread>
 
 #define MAX_THUMBNAIL_SIZE   128
 #define THUMB_TRACE(...)
 
 namespace app {
 
+// Generates the thumbnail of one item in a task of the shared task
+// scheduler (with the lowest priority).
 class ThumbnailGenerator::Worker {
 public:
-  Worker(base::concurrent_queue<ThumbnailGenerator::Item>& queue)
-    : m_queue(queue)
+  Worker(const ThumbnailGenerator::Item& item,
+         const ThumbnailDiskCache& diskCache)
+    : m_diskCache(diskCache)
+    , m_item(item)
     , m_fop(nullptr)
-    , m_isDone(false)
-    , m_thread([this]{ loadBgThread(); }) {
+    , m_isDone(false) {
+    m_task.run([this]{ loadTask(); });
   }
 
   ~Worker() {
@@ -53,7 +58,7 @@ public:
       if (m_fop)
         m_fop->stop();
     }
-    m_thread.join();
+    m_task.wait();
   }
 
   void stop() const {
@@ -85,23 +90,29 @@ private:
         ASSERT(m_fop);
       }
 
-      THUMB_TRACE("FOP loading thumbnail: %s\n",
-                  m_item.fileitem->fileName().c_str());
+      const std::string& filename = m_item.fileitem->fileName();
 
-      // Load the file
-      m_fop->operate(nullptr);
+      // Use the thumbnail from the disk cache if the file wasn't
+      // modified since the last time
+      ImageRef thumbnailImage = m_diskCache.load(filename);
+      std::unique_ptr<Palette> palette;
+      if (!thumbnailImage) {
+        THUMB_TRACE("FOP loading thumbnail: %s\n", filename.c_str());
+
+        // Load the file
+        m_fop->operate(nullptr);
 
-      // Don't call post-load because postLoad() needs user interaction.
-      //m_fop->postLoad();
+        // Don't call post-load because postLoad() needs user interaction.
+        //m_fop->postLoad();
+      }
 
       // Convert the loaded document into the os::Surface.
       const Sprite* sprite =
-        (m_fop->document() &&
+        (!thumbnailImage &&
+         m_fop->document() &&
          m_fop->document()->sprite() ?
          m_fop->document()->sprite(): nullptr);
 
-      std::unique_ptr<Image> thumbnailImage;
-      std::unique_ptr<Palette> palette;
       if (!m_fop->isStop() && sprite) {
         // The palette to convert the Image
         palette.reset(new Palette(*sprite->palette(frame_t(0))));
@@ -150,6 +161,8 @@ private:
             thumbnailImage.get(), palette.get(),
             cs, gfx::ColorSpace::MakeSRGB());
         }
+
+        m_diskCache.save(filename, thumbnailImage.get(), palette.get());
       }
 
       // Close file
@@ -205,30 +218,18 @@ private:
     ASSERT(!m_fop);
   }
 
-  void loadBgThread() {
-    base::this_thread::set_name("thumbnails");
-
-    while (!m_queue.empty()) {
-      bool success = true;
-      while (success) {
-        {
-          const std::lock_guard lock(m_mutex); // To access m_item
-          success = m_queue.try_pop(m_item);
-        }
-        if (success)
-          loadItem();
-      }
-      base::this_thread::yield();
-    }
+  void loadTask() {
+    DocLockStats::Operation operation("thumbnails");
+    loadItem();
     m_isDone = true;
   }
 
-  base::concurrent_queue<Item>& m_queue;
+  const ThumbnailDiskCache& m_diskCache;
   app::ThumbnailGenerator::Item m_item;
   FileOp* m_fop;
   mutable std::mutex m_mutex;
   std::atomic<bool> m_isDone;
-  std::thread m_thread;
+  doc::TaskGroup m_task { doc::TaskPriority::Background };
 };
 
 ThumbnailGenerator* ThumbnailGenerator::instance()
@@ -246,9 +247,11 @@ ThumbnailGenerator* ThumbnailGenerator::instance()
 
 ThumbnailGenerator::ThumbnailGenerator()
 {
-  int n = std::thread::hardware_concurrency()-1;
-  if (n < 1) n = 1;
-  m_maxWorkers = n;
+  // Keep at least one thread of the scheduler for other tasks (e.g.
+  // rendering), and use no more than 8 workers (more threads just
+  // compete for the disk).
+  const int n = doc::TaskScheduler::instance().threads()-1;
+  m_maxWorkers = std::clamp(n, 1, 8);
 }
 
 bool ThumbnailGenerator::checkWorkers()
@@ -267,7 +270,10 @@ bool ThumbnailGenerator::checkWorkers()
     }
   }
 
-  return doingWork;
+  // Start the tasks of the remaining items
+  startWorkersUnlocked();
+
+  return (doingWork || !m_workers.empty());
 }
 
 void ThumbnailGenerator::generateThumbnail(IFileItem* fileitem)
@@ -282,19 +288,8 @@ void ThumbnailGenerator::generateThumbnail(IFileItem* fileitem)
           return (item.fileitem == fileitem);
         });
 
-      // If there is no more workers running, we have to start a new
-      // one to process the m_remainingItems queue. How is it possible
-      // that a IFileItem has a thumbnail progress == 0.00001 but
-      // there is no workers?  This is an edge case where:
-      // 1. The Worker::loadBgThread() asks for the queue of remaining items
-      //    and it's empty, so the thread is going to be closed
-      // 2. We've just created a FOP for this IFileItem and ask for
-      //    available workers and we've already launch the max quantity
-      //    of possible workers (m_maxWorkers)
-      // 3. All worker threads are just closed so there is no more
-      //    worker for the remaining item in the queue.
-      if (m_workers.empty())
-        startWorker();
+      // Start a task for the prioritized item if we can
+      startWorker();
     }
     return;
   }
@@ -311,6 +306,8 @@ void ThumbnailGenerator::generateThumbnail(IFileItem* fileitem)
       fileitem->fileName().c_str(),
       FILE_LOAD_SEQUENCE_NONE |
       FILE_LOAD_ONE_FRAME));
+  if (fop)
+    fop->setLoadMinSize(gfx::Size(MAX_THUMBNAIL_SIZE, MAX_THUMBNAIL_SIZE));
   if (!fop || fop->hasError()) {
     // Set a nullptr thumbnail so we don't try to generate a thumbnail
     // for this fileitem again.
@@ -347,8 +344,18 @@ void ThumbnailGenerator::stopAllWorkers()
 void ThumbnailGenerator::startWorker()
 {
   const std::lock_guard lock(m_workersAccess);
-  if (m_workers.size() < m_maxWorkers) {
-    m_workers.push_back(std::make_unique<Worker>(m_remainingItems));
+  startWorkersUnlocked();
+}
+
+// Creates one task for each remaining item (up to m_maxWorkers
+// running tasks), the rest of items are started from checkWorkers()
+// when the running tasks are done.
+void ThumbnailGenerator::startWorkersUnlocked()
+{
+  Item item;
+  while (int(m_workers.size()) < m_maxWorkers &&
+         m_remainingItems.try_pop(item)) {
+    m_workers.push_back(std::make_unique<Worker>(item, m_diskCache));
   }
 }
 
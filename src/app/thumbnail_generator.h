@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -9,6 +9,7 @@
 #define APP_THUMBNAIL_GENERATOR_H_INCLUDED
 #pragma once
 
+#include "app/thumbnail_disk_cache.h"
 #include "base/concurrent_queue.h"
 
 #include <memory>
@@ -34,7 +35,7 @@ namespace app {
 
     // Checks the status of workers. If there are workers that already
     // done its job, we've to destroy them. This function must be called
-    // from the GUI thread (because a thread is joint to it).
+    // from the GUI thread (because it waits the task of the worker).
     // Returns true if there are workers generating thumbnails.
     bool checkWorkers();
 
@@ -45,6 +46,7 @@ namespace app {
 
   private:
     void startWorker();
+    void startWorkersUnlocked();
 
     class Worker;
     using WorkerPtr = std::unique_ptr<Worker>;
@@ -61,6 +63,8 @@ namespace app {
     };
 
     int m_maxWorkers;
+    // Declared before m_workers as workers use it
+    ThumbnailDiskCache m_diskCache;
     WorkerList m_workers;
     std::mutex m_workersAccess;
     base::concurrent_queue<Item> m_remainingItems;
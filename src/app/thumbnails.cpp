@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 // Copyright (C) 2016  Carlo Caputo
 //
@@ -10,29 +10,53 @@
 #include "config.h"
 #endif
 
+#include "app/thumbnails.h"
+
 #include "app/util/conversion_to_surface.h"
 #include "doc/blend_mode.h"
 #include "doc/cel.h"
+#include "doc/image.h"
 #include "doc/layer.h"
 #include "doc/sprite.h"
 #include "os/surface.h"
 #include "os/system.h"
 #include "render/render.h"
+#include "ui/system.h"
+
+#include <algorithm>
 
 namespace app {
 namespace thumb {
 
-os::SurfaceRef get_cel_thumbnail(const doc::Cel* cel,
-                                 const gfx::Size& fitInSize)
+static gfx::Size calc_thumbnail_size(const doc::Cel* cel,
+                                     const gfx::Size& fitInSize)
 {
-  gfx::Size newSize;
-
   if (cel->bounds().w > fitInSize.w ||
       cel->bounds().h > fitInSize.h)
-    newSize = gfx::Rect(cel->bounds()).fitIn(gfx::Rect(fitInSize)).size();
+    return gfx::Rect(cel->bounds()).fitIn(gfx::Rect(fitInSize)).size();
+  else
+    return cel->bounds().size();
+}
+
+static os::SurfaceRef convert_thumbnail_to_surface(const doc::Image* image,
+                                                   const doc::Palette* palette)
+{
+  if (os::SurfaceRef thumbnail = os::instance()->makeRgbaSurface(
+        image->width(),
+        image->height())) {
+    convert_image_to_surface(
+      image, palette, thumbnail.get(),
+      0, 0, 0, 0, image->width(), image->height());
+    return thumbnail;
+  }
   else
-    newSize = cel->bounds().size();
+    return nullptr;
+}
 
+os::SurfaceRef get_cel_thumbnail(const doc::Cel* cel,
+                                 const gfx::Size& fitInSize)
+{
+  const gfx::Size newSize = calc_thumbnail_size(cel, fitInSize);
   if (newSize.w < 1 ||
       newSize.h < 1)
     return nullptr;
@@ -58,16 +82,178 @@ os::SurfaceRef get_cel_thumbnail(const doc::Cel* cel,
     gfx::Clip(gfx::Rect(gfx::Point(0, 0), newSize)),
     255, doc::BlendMode::NORMAL);
 
-  if (os::SurfaceRef thumbnail = os::instance()->makeRgbaSurface(
-        thumbnailImage->width(),
-        thumbnailImage->height())) {
-    convert_image_to_surface(
-      thumbnailImage.get(), palette, thumbnail.get(),
-      0, 0, 0, 0, thumbnailImage->width(), thumbnailImage->height());
-    return thumbnail;
+  return convert_thumbnail_to_surface(thumbnailImage.get(), palette);
+}
+
+doc::ImageRef render_cel_image_thumbnail(const doc::Image* celImage,
+                                         const doc::Palette* palette,
+                                         const gfx::Size& celSize,
+                                         const gfx::Size& size,
+                                         const doc::PixelRatio& pixelRatio)
+{
+  doc::ImageRef thumbnailImage(
+    doc::Image::create(
+      doc::IMAGE_RGB, size.w, size.h));
+  thumbnailImage->clear(0);
+
+  render::Render render;
+  render.setProjection(
+    render::Projection(pixelRatio,
+                       render::Zoom(size.w, celSize.w)));
+  render.renderImage(
+    thumbnailImage.get(), celImage, palette,
+    0, 0, 255, doc::BlendMode::NORMAL);
+  return thumbnailImage;
+}
+
+CelThumbnailCache::CelThumbnailCache()
+  : m_thread([this]{ backgroundThread(); })
+{
+}
+
+CelThumbnailCache::~CelThumbnailCache()
+{
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done = true;
+    m_cv.notify_one();
   }
-  else
+  m_thread.join();
+}
+
+os::SurfaceRef CelThumbnailCache::getCelThumbnail(const doc::Cel* cel,
+                                                  const gfx::Size& fitInSize)
+{
+  const doc::Image* image = cel->image();
+  if (!image)
+    return nullptr;
+
+  const gfx::Size size = calc_thumbnail_size(cel, fitInSize);
+  if (size.w < 1 ||
+      size.h < 1)
     return nullptr;
+
+  const doc::Sprite* sprite = cel->sprite();
+  const doc::Palette* palette = sprite->palette(cel->frame());
+  const doc::PixelRatio& pixelRatio = sprite->pixelRatio();
+  const Key key(image->id(), image->version(),
+                uintptr_t(palette), palette->getModifications(),
+                size.w, size.h,
+                pixelRatio.w, pixelRatio.h);
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  auto it = m_entries.find(key);
+  if (it != m_entries.end()) {
+    Entry& entry = it->second;
+    entry.lastUse = ++m_useCounter;
+    if (!entry.ready)
+      return nullptr;
+
+    // Surfaces are created in the UI thread
+    if (!entry.surface && entry.image) {
+      entry.surface = convert_thumbnail_to_surface(entry.image.get(), palette);
+      entry.image.reset();
+    }
+    return entry.surface;
+  }
+
+  if (int(m_entries.size()) >= kMaxThumbnails)
+    removeLeastRecentlyUsedEntry();
+
+  Entry& entry = m_entries[key];
+  entry.lastUse = ++m_useCounter;
+
+  // TODO render tilemaps in the background thread too (we should
+  //      keep a reference to the tileset images)
+  if (image->pixelFormat() == doc::IMAGE_TILEMAP) {
+    entry.ready = true;
+    entry.surface = get_cel_thumbnail(cel, fitInSize);
+    return entry.surface;
+  }
+
+  // The background thread renders a copy of the cel image which
+  // shares its pixels (without a document lock the cel image can be
+  // modified in place, or its pixels can be unshared/released by the
+  // CelsCompressor, while the thumbnail is rendered)
+  m_requests.push_back(
+    Request{ key, doc::ImageRef(doc::Image::createCopy(image)), *palette,
+             cel->bounds().size(), size, pixelRatio });
+  m_cv.notify_one();
+  return nullptr;
+}
+
+void CelThumbnailCache::clear()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_entries.clear();
+  m_requests.clear();
+}
+
+void CelThumbnailCache::backgroundThread()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_done) {
+    if (m_requests.empty()) {
+      m_cv.wait(lock);
+      continue;
+    }
+
+    // The last requested thumbnails are rendered first (e.g. the
+    // visible cels after scrolling the timeline).
+    Request req = std::move(m_requests.back());
+    m_requests.pop_back();
+
+    // The entry was discarded
+    if (m_entries.find(req.key) == m_entries.end())
+      continue;
+
+    lock.unlock();
+
+    doc::ImageRef thumbnailImage =
+      render_cel_image_thumbnail(req.celImage.get(), &req.palette,
+                                 req.celSize, req.size, req.pixelRatio);
+    // Release the copy (so the cel image doesn't need to copy its
+    // pixels to modify them)
+    req.celImage.reset();
+
+    lock.lock();
+
+    auto it = m_entries.find(req.key);
+    if (it != m_entries.end()) {
+      it->second.ready = true;
+      it->second.image = thumbnailImage;
+    }
+
+    // Just one notification for several thumbnails
+    if (!m_notifyPending) {
+      m_notifyPending = true;
+      ui::execute_from_ui_thread(
+        [self = weak_from_this()]{
+          if (auto cache = self.lock())
+            cache->notifyReadyThumbnails();
+        });
+    }
+  }
+}
+
+void CelThumbnailCache::removeLeastRecentlyUsedEntry()
+{
+  auto it = std::min_element(
+    m_entries.begin(), m_entries.end(),
+    [](const auto& a, const auto& b){
+      return a.second.lastUse < b.second.lastUse;
+    });
+  if (it != m_entries.end())
+    m_entries.erase(it);
+}
+
+void CelThumbnailCache::notifyReadyThumbnails()
+{
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_notifyPending = false;
+  }
+  ThumbnailsReady();
 }
 
 } // thumb
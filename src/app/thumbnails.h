@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2016  Carlo Caputo
 //
 // This program is distributed under the terms of
@@ -9,11 +9,27 @@
 #define APP_THUMBNAILS_H_INCLUDED
 #pragma once
 
+#include "doc/image_ref.h"
+#include "doc/object_id.h"
+#include "doc/object_version.h"
+#include "doc/palette.h"
+#include "doc/pixel_ratio.h"
 #include "gfx/size.h"
+#include "obs/signal.h"
 #include "os/surface.h"
 
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+
 namespace doc {
   class Cel;
+  class Image;
 }
 
 namespace os {
@@ -26,6 +42,84 @@ namespace thumb {
   os::SurfaceRef get_cel_thumbnail(const doc::Cel* cel,
                                    const gfx::Size& fitInSize);
 
+  // Renders the thumbnail of a cel image in an RGB image of the given
+  // size. It can be called from any thread, but the image cannot be
+  // modified in the meantime (e.g. it can be a copy created with
+  // Image::createCopy(), which shares the pixels with the cel image
+  // until one of them is modified).
+  doc::ImageRef render_cel_image_thumbnail(const doc::Image* celImage,
+                                           const doc::Palette* palette,
+                                           const gfx::Size& celSize,
+                                           const gfx::Size& size,
+                                           const doc::PixelRatio& pixelRatio);
+
+  // Cache of cel thumbnails (e.g. for the Timeline) which are
+  // rendered in a background thread. Thumbnails are identified by
+  // the cel image (id and version), the palette, and the thumbnail
+  // size, and the least recently used ones are discarded when there
+  // are more than kMaxThumbnails.
+  //
+  // It must be created with std::make_shared() (the background thread
+  // uses weak_from_this() to notify the UI thread).
+  class CelThumbnailCache
+    : public std::enable_shared_from_this<CelThumbnailCache> {
+  public:
+    static constexpr int kMaxThumbnails = 1024;
+
+    CelThumbnailCache();
+    ~CelThumbnailCache();
+
+    // Returns the thumbnail of the cel if it's ready. In other case
+    // returns nullptr and the thumbnail is rendered in the
+    // background (ThumbnailsReady is emitted in the UI thread when
+    // new thumbnails are available).
+    os::SurfaceRef getCelThumbnail(const doc::Cel* cel,
+                                   const gfx::Size& fitInSize);
+
+    void clear();
+
+    obs::signal<void()> ThumbnailsReady;
+
+  private:
+    // Image ID/version, palette pointer/modifications, thumbnail
+    // size, and sprite pixel ratio
+    using Key = std::tuple<doc::ObjectId, doc::ObjectVersion,
+                           uintptr_t, int,
+                           int, int,
+                           int, int>;
+
+    struct Entry {
+      bool ready = false;
+      doc::ImageRef image;      // Rendered in the background thread
+      os::SurfaceRef surface;   // Created from "image" in the UI thread
+      uint32_t lastUse = 0;
+    };
+
+    struct Request {
+      Key key;
+      doc::ImageRef celImage;   // Copy of the cel image (copy-on-write)
+      doc::Palette palette;
+      gfx::Size celSize;
+      gfx::Size size;
+      doc::PixelRatio pixelRatio;
+    };
+
+    void backgroundThread();
+    void removeLeastRecentlyUsedEntry();
+    void notifyReadyThumbnails();
+
+    // Accessed only from the UI thread
+    uint32_t m_useCounter = 0;
+
+    std::map<Key, Entry> m_entries;
+    std::deque<Request> m_requests;
+    bool m_done = false;
+    bool m_notifyPending = false;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::thread m_thread;
+  };
+
 } // thumb
 } // app
 
@@ -0,0 +1,67 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+#include "app/thumbnails.h"
+#include "doc/image.h"
+#include "doc/palette.h"
+#include "doc/primitives.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+using namespace app;
+using namespace doc;
+
+TEST(CelThumbnails, RenderCopyWhileCelImageIsModified)
+{
+  const gfx::Size celSize(64, 64);
+  const gfx::Size thumbSize(32, 32);
+  const color_t red = rgba(255, 0, 0, 255);
+  const Palette palette(frame_t(0), 256);
+
+  ImageRef celImage(Image::create(IMAGE_RGB, celSize.w, celSize.h));
+  celImage->clear(red);
+
+  for (int i=0; i<20; ++i) {
+    // Copy taken in the UI thread (see CelThumbnailCache::getCelThumbnail())
+    ImageRef copy(Image::createCopy(celImage.get()));
+
+    std::atomic<bool> started(false);
+    ImageRef thumbnail;
+    std::thread worker([&]{
+      started = true;
+      thumbnail = thumb::render_cel_image_thumbnail(
+        copy.get(), &palette, celSize, thumbSize, PixelRatio(1, 1));
+    });
+    while (!started)
+      std::this_thread::yield();
+
+    // Modify the cel image in place and try to release its pixels
+    // while the thumbnail is being rendered
+    for (int y=0; y<celSize.h; ++y)
+      for (int x=0; x<celSize.w; ++x)
+        put_pixel(celImage.get(), x, y, rgba(0, 0, 255, 255));
+
+    base::buffer compressed;
+    celImage->compressPixels(compressed);
+    celImage->releasePixels(std::move(compressed));
+
+    worker.join();
+
+    ASSERT_TRUE(thumbnail != nullptr);
+    EXPECT_EQ(thumbSize, thumbnail->size());
+    for (int y=0; y<thumbSize.h; ++y)
+      for (int x=0; x<thumbSize.w; ++x)
+        ASSERT_EQ(red, get_pixel(thumbnail.get(), x, y))
+          << " i=" << i << " x=" << x << " y=" << y;
+
+    // The next copy is red again
+    celImage->clear(red);
+  }
+}
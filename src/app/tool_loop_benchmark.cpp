@@ -0,0 +1,269 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/app.h"
+#include "app/cli/app_options.h"
+#include "app/context.h"
+#include "app/doc.h"
+#include "app/inline_command_execution.h"
+#include "app/pref/preferences.h"
+#include "app/site.h"
+#include "app/tools/active_tool.h"
+#include "app/tools/stroke_recording.h"
+#include "app/tools/tool.h"
+#include "app/tools/tool_box.h"
+#include "app/tools/tool_loop_manager.h"
+#include "app/ui/editor/tool_loop_impl.h"
+#include "base/chrono.h"
+#include "base/fs.h"
+#include "base/pi.h"
+#include "doc/brush.h"
+#include "doc/layer.h"
+#include "doc/sprite.h"
+#include "os/system.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Replays strokes recorded with the [perf] record_strokes option
+// (files from the "strokes" folder of the user directory) through a
+// ToolLoopManager, reporting the average/max time of each pointer
+// event. Usage:
+//
+//   tool_loop_benchmark [benchmark options] [stroke files...]
+//
+// Without files, it replays some synthetic strokes.
+
+using namespace app;
+using namespace app::tools;
+using namespace doc;
+
+#ifdef ENABLE_SCRIPTING
+
+namespace {
+
+using EventType = StrokeRecording::EventType;
+
+// A stroke following a spiral from the center of the sprite, with
+// one movement per pixel (approx.) and pressure going from 0 to 1.
+StrokeRecording synthetic_stroke(const char* toolId,
+                                 const int size,
+                                 const int brushSize)
+{
+  StrokeRecording rec;
+  rec.width = size;
+  rec.height = size;
+  rec.tool = toolId;
+  rec.fg = app::Color::fromRgb(255, 0, 0);
+  rec.bg = app::Color::fromRgb(0, 0, 255);
+  rec.brushSize = brushSize;
+
+  const int n = 4 * size;
+  const double cx = size / 2.0;
+  const double cy = size / 2.0;
+  for (int i=0; i<n; ++i) {
+    const double t = double(i) / n;
+    const double a = 6.0 * 2.0 * PI * t;
+    const gfx::Point pt(int(cx + std::cos(a) * t * size/2),
+                        int(cy + std::sin(a) * t * size/2));
+    const Pointer pointer(pt, Vec2(0.0f, 0.0f),
+                          Pointer::Button::Left,
+                          Pointer::Type::Pen,
+                          float(t));
+    if (i == 0) {
+      rec.events.push_back({ EventType::PrepareLoop, 0, pointer });
+      rec.events.push_back({ EventType::PressButton, 0, pointer });
+    }
+    else {
+      rec.events.push_back({ EventType::AddMovement, i, pointer });
+      rec.events.push_back({ EventType::DrawPendingMovements, i, pointer });
+    }
+    if (i == n-1)
+      rec.events.push_back({ EventType::ReleaseButton, i, pointer });
+  }
+  return rec;
+}
+
+std::vector<std::pair<std::string, StrokeRecording>> synthetic_strokes()
+{
+  std::vector<std::pair<std::string, StrokeRecording>> strokes;
+
+  strokes.emplace_back("Pencil1px",
+                       synthetic_stroke(WellKnownTools::Pencil, 512, 1));
+  strokes.emplace_back("Pencil64px",
+                       synthetic_stroke(WellKnownTools::Pencil, 512, 64));
+
+  StrokeRecording rec = synthetic_stroke(WellKnownTools::Pencil, 512, 64);
+  rec.dynamics.size = DynamicSensor::Pressure;
+  rec.dynamics.minSize = 1;
+  strokes.emplace_back("Pencil64pxPressure", rec);
+
+  rec = synthetic_stroke(WellKnownTools::Pencil, 512, 16);
+  rec.symmetryMode = gen::SymmetryMode::BOTH;
+  rec.symmetryX = rec.width / 2.0;
+  rec.symmetryY = rec.height / 2.0;
+  strokes.emplace_back("Pencil16pxSymmetry", rec);
+
+  strokes.emplace_back("Eraser32px",
+                       synthetic_stroke(WellKnownTools::Eraser, 512, 32));
+  return strokes;
+}
+
+void BM_ReplayStroke(benchmark::State& state,
+                     const StrokeRecording rec)
+{
+  App* app = App::instance();
+  Context* ctx = app->context();
+
+  Tool* tool = app->toolBox()->getToolById(rec.tool);
+  if (!tool) {
+    state.SkipWithError("Invalid tool");
+    return;
+  }
+
+  int64_t events = 0;
+  double total = 0.0;
+  double max = 0.0;
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::unique_ptr<Doc> doc(
+      ctx->documents().add(rec.width, rec.height, rec.colorMode, 256));
+    ctx->setActiveDocument(doc.get());
+
+    auto& pref = Preferences::instance();
+    auto& docPref = pref.document(doc.get());
+    pref.symmetryMode.enabled(rec.symmetryMode != gen::SymmetryMode::NONE);
+    docPref.symmetry.mode(rec.symmetryMode);
+    docPref.symmetry.xAxis(rec.symmetryX);
+    docPref.symmetry.yAxis(rec.symmetryY);
+
+    Site site;
+    site.document(doc.get());
+    site.sprite(doc->sprite());
+    site.layer(doc->sprite()->root()->firstLayer());
+    site.frame(0);
+
+    const int buttonIdx = (rec.rightButton ? 1: 0);
+    ToolLoopParams params;
+    params.tool = tool;
+    params.button = (rec.rightButton ? ToolLoop::Right: ToolLoop::Left);
+    params.ink = app->activeToolManager()->adjustToolInkDependingOnSelectedInkType(
+      tool->getInk(buttonIdx), rec.inkType, rec.fg);
+    params.controller = tool->getController(buttonIdx);
+    params.inkType = rec.inkType;
+    params.fg = rec.fg;
+    params.bg = rec.bg;
+    // Image brushes aren't recorded, so we use a circle instead
+    params.brush = std::make_shared<Brush>(
+      (rec.brushType == kImageBrushType ? kCircleBrushType: rec.brushType),
+      rec.brushSize, rec.brushAngle);
+    params.opacity = rec.opacity;
+    params.tolerance = rec.tolerance;
+    params.contiguous = rec.contiguous;
+    params.freehandAlgorithm = rec.freehandAlgorithm;
+    params.dynamics = rec.dynamics;
+    state.ResumeTiming();
+
+    {
+      InlineCommandExecution inlineCmd(ctx);
+      std::unique_ptr<ToolLoop> loop(
+        create_tool_loop_for_script(ctx, site, params));
+      if (!loop) {
+        state.SkipWithError("Cannot create the tool loop");
+        break;
+      }
+
+      ToolLoopManager manager(loop.get());
+      for (const auto& ev : rec.events) {
+        base::Chrono chrono;
+        switch (ev.type) {
+          case EventType::PrepareLoop:
+            manager.prepareLoop(ev.pointer);
+            break;
+          case EventType::PressButton:
+            manager.pressButton(ev.pointer);
+            break;
+          case EventType::AddMovement:
+            manager.addMovement(ev.pointer);
+            break;
+          case EventType::DrawPendingMovements:
+            manager.drawPendingMovements();
+            break;
+          case EventType::ReleaseButton:
+            manager.releaseButton(ev.pointer);
+            break;
+        }
+        const double t = chrono.elapsed();
+        total += t;
+        max = std::max(max, t);
+        ++events;
+      }
+      manager.end();
+    }
+
+    state.PauseTiming();
+    doc->close();
+    doc.reset();
+    state.ResumeTiming();
+  }
+
+  state.counters["events"] = double(rec.events.size());
+  if (events > 0) {
+    state.counters["event_avg_us"] = 1000000.0 * total / events;
+    state.counters["event_max_us"] = 1000000.0 * max;
+  }
+}
+
+} // anonymous namespace
+
+#endif // ENABLE_SCRIPTING
+
+int app_main(int argc, char* argv[])
+{
+  os::SystemRef system(os::make_system());
+  App app;
+  const char* argv2[] = { argv[0], "-b" };
+  app.initialize(AppOptions(2, { argv2 }));
+
+  ::benchmark::Initialize(&argc, argv);
+
+#ifdef ENABLE_SCRIPTING
+  // Remaining arguments are stroke files
+  std::vector<std::pair<std::string, StrokeRecording>> strokes;
+  for (int i=1; i<argc; ++i) {
+    StrokeRecording rec;
+    if (rec.load(argv[i]))
+      strokes.emplace_back(base::get_file_title(argv[i]), rec);
+    else
+      std::printf("Error loading stroke file %s\n", argv[i]);
+  }
+  if (strokes.empty())
+    strokes = synthetic_strokes();
+
+  for (const auto& stroke : strokes) {
+    benchmark::RegisterBenchmark(
+      ("BM_ReplayStroke/" + stroke.first).c_str(),
+      BM_ReplayStroke, stroke.second)
+      ->Unit(benchmark::kMillisecond);
+  }
+#endif
+
+  int status = ::benchmark::RunSpecifiedBenchmarks();
+
+  app.close();
+  return status;
+}
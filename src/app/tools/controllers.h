@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -60,8 +60,13 @@ public:
 
   Stroke::Pt getLastPoint() const override { return m_last; }
 
+  void prepareController(ToolLoop* loop) override {
+    m_nextPoint = 0;
+  }
+
   void pressButton(ToolLoop* loop, Stroke& stroke, const Stroke::Pt& pt) override {
     m_last = pt;
+    m_nextPoint = stroke.size();
     stroke.addPoint(pt);
   }
 
@@ -79,13 +84,24 @@ public:
       output.addPoint(input[0]);
     }
     else if (input.size() >= 2) {
-      // The freehand controller returns only the last two points to
-      // interwine because we accumulate (TracePolicy::Accumulate) the
+      // The freehand controller returns only the points added since
+      // the last call (plus the last intertwined point to join them)
+      // because we accumulate (TracePolicy::Accumulate) the
       // previously painted points (i.e. don't want to redraw all the
-      // stroke from the very beginning)
-      output.addPoint(input[input.size()-2]);
-      output.addPoint(input[input.size()-1]);
+      // stroke from the very beginning). Several mouse movements can
+      // be received between two calls (see
+      // ToolLoopManager::addMovement()).
+      const int first = std::clamp(m_nextPoint-1, 0, input.size()-2);
+      for (int i=first; i<input.size(); ++i)
+        output.addPoint(input[i]);
     }
+    m_nextPoint = input.size();
+  }
+
+  // Used when we continue the stroke of other controller (the first
+  // "startPoint" points were already painted).
+  void setNextPoint(int startPoint) {
+    m_nextPoint = startPoint;
   }
 
   void getStatusBarText(ToolLoop* loop, const Stroke& stroke, std::string& text) override {
@@ -104,6 +120,9 @@ public:
 
 private:
   Stroke::Pt m_last;
+  // Index of the first point in the stroke that wasn't returned by
+  // getStrokeToInterwine() yet.
+  int m_nextPoint = 0;
 };
 
 // Controls clicks for tools like line
@@ -475,6 +494,7 @@ public:
 
   void prepareController(ToolLoop* loop) override {
     m_controller = nullptr;
+    m_freehand.prepareController(loop);
   }
 
   void pressButton(ToolLoop* loop, Stroke& stroke, const Stroke::Pt& pt) override {
@@ -492,6 +512,8 @@ public:
       }
       else {
         m_controller = &m_freehand;
+        // Continue from the end of the straight line
+        m_freehand.setNextPoint(stroke.size());
       }
       return;                   // Don't send first pressButton() click to the freehand controller
     }
@@ -1,11 +1,12 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
 
 #include "app/color_utils.h"
+#include "app/shade.h"
 #include "app/util/wrap_point.h"
 #include "app/util/wrap_value.h"
 #include "doc/blend_funcs.h"
@@ -22,6 +23,10 @@
 #include "render/dithering.h"
 #include "render/gradient.h"
 
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+
 namespace app {
 namespace tools {
 
@@ -56,7 +61,7 @@ template<typename Derived>
 class InkProcessing : public BaseInkProcessing {
 public:
   void processScanline(int x1, int y, int x2, ToolLoop* loop) override {
-    int x;
+    Derived* derived = static_cast<Derived*>(this);
 
     // Use mask
     if (loop->useMask()) {
@@ -73,22 +78,42 @@ public:
         x2 = maskOrigin.x+maskBounds.w-1;
 
       if (Image* bitmap = loop->getMask()->bitmap()) {
-        static_cast<Derived*>(this)->initIterators(loop, x1, y);
-
-        for (x=x1; x<=x2; ++x) {
-          if (bitmap->getPixel(x-maskOrigin.x, y-maskOrigin.y))
-            static_cast<Derived*>(this)->processPixel(x, y);
-
-          static_cast<Derived*>(this)->moveIterators();
+        // Process each run of pixels inside the mask as a span
+        const int v = y-maskOrigin.y;
+        for (int x=x1; x<=x2; ) {
+          if (!bitmap->getPixel(x-maskOrigin.x, v)) {
+            ++x;
+            continue;
+          }
+
+          const int spanX = x;
+          do {
+            ++x;
+          } while (x <= x2 && bitmap->getPixel(x-maskOrigin.x, v));
+
+          derived->initIterators(loop, spanX, y);
+          derived->processSpan(spanX, y, x-spanX);
         }
         return;
       }
     }
 
-    static_cast<Derived*>(this)->initIterators(loop, x1, y);
-    for (x=x1; x<=x2; ++x) {
-      static_cast<Derived*>(this)->processPixel(x, y);
-      static_cast<Derived*>(this)->moveIterators();
+    if (x1 > x2)
+      return;
+
+    derived->initIterators(loop, x1, y);
+    derived->processSpan(x1, y, x2-x1+1);
+  }
+
+  // Processes "n" contiguous pixels of the scanline from "x" (the
+  // iterators are already in "x"). Inks can hide this member
+  // function to process the whole span at once (e.g. with the span
+  // blenders).
+  void processSpan(int x, const int y, int n) {
+    Derived* derived = static_cast<Derived*>(this);
+    for (; n > 0; --n, ++x) {
+      derived->processPixel(x, y);
+      derived->moveIterators();
     }
   }
 };
@@ -126,6 +151,56 @@ protected:
   typename ImageTraits::address_t m_dstAddress;
 };
 
+// Converts each source pixel of an indexed scanline to a RGBA color
+// with blendFunc() and maps all the colors to the palette with just
+// one RgbMap::mapColors() call (instead of a virtual call per pixel).
+template<typename BlendFunc>
+void blend_indexed_scanline(const IndexedTraits::address_t src,
+                            const IndexedTraits::address_t dst,
+                            const int n,
+                            const RgbMap* rgbmap,
+                            std::vector<color_t>& colors,
+                            BlendFunc blendFunc)
+{
+  colors.resize(n);
+  for (int i=0; i<n; ++i)
+    colors[i] = blendFunc(src[i]);
+  rgbmap->mapColors(colors.data(), dst, n);
+}
+
+// Blends "color" over "n" RGBA or grayscale pixels from "src" with
+// the span blenders (vectorized for the normal and merge modes), and
+// calls store(i, srcPixel, resultPixel) for each pixel. The "src"
+// pixels are read before calling store(), so it can modify them
+// (the source and destination images can be the same).
+template<typename ImageTraits, typename Store>
+void blend_color_span(const typename ImageTraits::pixel_t* src,
+                      const int n,
+                      const color_t color,
+                      const int opacity,
+                      const BlendMode blendMode,
+                      Store store)
+{
+  using pixel_t = typename ImageTraits::pixel_t;
+  const int kChunk = 64;
+  pixel_t colors[kChunk];
+  pixel_t result[kChunk];
+
+  std::fill_n(colors, kChunk, pixel_t(color));
+
+  // ~color is used as mask color, so no pixel of "colors" is skipped
+  for (int i=0; i<n; i+=kChunk) {
+    const int m = std::min(n-i, kChunk);
+    std::copy(src+i, src+i+m, result);
+    if constexpr (std::is_same_v<ImageTraits, RgbTraits>)
+      rgba_blend_span(result, colors, m, opacity, blendMode, true, ~color);
+    else
+      graya_blend_span(result, colors, m, opacity, blendMode, true, ~color);
+    for (int j=0; j<m; ++j)
+      store(i+j, src[i+j], result[j]);
+  }
+}
+
 //////////////////////////////////////////////////////////////////////
 // Copy Ink
 //////////////////////////////////////////////////////////////////////
@@ -151,6 +226,10 @@ public:
     *this->m_dstAddress = m_color;
   }
 
+  void processSpan(int x, int y, int n) {
+    std::fill_n(this->m_dstAddress, n, typename ImageTraits::pixel_t(m_color));
+  }
+
 private:
   color_t m_color;
 };
@@ -162,6 +241,8 @@ private:
 template<typename ImageTraits>
 class LockAlphaInkProcessing : public DoubleInkProcessing<LockAlphaInkProcessing<ImageTraits>, ImageTraits> {
 public:
+  typedef DoubleInkProcessing<LockAlphaInkProcessing<ImageTraits>, ImageTraits> base;
+
   LockAlphaInkProcessing(ToolLoop* loop)
     : m_opacity(loop->getOpacity()) {
   }
@@ -174,6 +255,10 @@ public:
     // Do nothing
   }
 
+  void processSpan(int x, int y, int n) {
+    base::processSpan(x, y, n);
+  }
+
 private:
   color_t m_color;
   const int m_opacity;
@@ -197,6 +282,26 @@ void LockAlphaInkProcessing<GrayscaleTraits>::processPixel(int x, int y) {
     graya_geta(*m_srcAddress));
 }
 
+template<>
+void LockAlphaInkProcessing<RgbTraits>::processSpan(int x, int y, int n) {
+  RgbTraits::address_t dst = m_dstAddress;
+  blend_color_span<RgbTraits>(
+    m_srcAddress, n, m_color, m_opacity, BlendMode::NORMAL,
+    [dst](int i, color_t src, color_t result){
+      dst[i] = (result & rgba_rgb_mask) | (src & rgba_a_mask);
+    });
+}
+
+template<>
+void LockAlphaInkProcessing<GrayscaleTraits>::processSpan(int x, int y, int n) {
+  GrayscaleTraits::address_t dst = m_dstAddress;
+  blend_color_span<GrayscaleTraits>(
+    m_srcAddress, n, m_color, m_opacity, BlendMode::NORMAL,
+    [dst](int i, color_t src, color_t result){
+      dst[i] = (result & graya_v_mask) | (src & graya_a_mask);
+    });
+}
+
 template<>
 class LockAlphaInkProcessing<IndexedTraits> : public DoubleInkProcessing<LockAlphaInkProcessing<IndexedTraits>, IndexedTraits> {
 public:
@@ -242,6 +347,8 @@ private:
 template<typename ImageTraits>
 class TransparentInkProcessing : public DoubleInkProcessing<TransparentInkProcessing<ImageTraits>, ImageTraits> {
 public:
+  typedef DoubleInkProcessing<TransparentInkProcessing<ImageTraits>, ImageTraits> base;
+
   TransparentInkProcessing(ToolLoop* loop) {
     m_opacity = loop->getOpacity();
   }
@@ -254,6 +361,10 @@ public:
     // Do nothing
   }
 
+  void processSpan(int x, int y, int n) {
+    base::processSpan(x, y, n);
+  }
+
 private:
   color_t m_color;
   int m_opacity;
@@ -269,6 +380,22 @@ void TransparentInkProcessing<GrayscaleTraits>::processPixel(int x, int y) {
   *m_dstAddress = graya_blender_normal(*m_srcAddress, m_color, m_opacity);
 }
 
+template<>
+void TransparentInkProcessing<RgbTraits>::processSpan(int x, int y, int n) {
+  RgbTraits::address_t dst = m_dstAddress;
+  blend_color_span<RgbTraits>(
+    m_srcAddress, n, m_color, m_opacity, BlendMode::NORMAL,
+    [dst](int i, color_t src, color_t result){ dst[i] = result; });
+}
+
+template<>
+void TransparentInkProcessing<GrayscaleTraits>::processSpan(int x, int y, int n) {
+  GrayscaleTraits::address_t dst = m_dstAddress;
+  blend_color_span<GrayscaleTraits>(
+    m_srcAddress, n, m_color, m_opacity, BlendMode::NORMAL,
+    [dst](int i, color_t src, color_t result){ dst[i] = result; });
+}
+
 template<>
 class TransparentInkProcessing<IndexedTraits> : public DoubleInkProcessing<TransparentInkProcessing<IndexedTraits>, IndexedTraits> {
 public:
@@ -284,27 +411,32 @@ public:
     m_color = m_palette->getEntry(loop->getPrimaryColor());
   }
 
-  void processPixel(int x, int y) {
+  void processSpan(int x, int y, int n) {
     if (m_colorIndex == m_maskIndex)
       return;
 
-    color_t c = *m_srcAddress;
+    blend_indexed_scanline(m_srcAddress, m_dstAddress, n, m_rgbmap, m_colors,
+                           [this](color_t c){ return blendColor(c); });
+  }
+
+private:
+  color_t blendColor(color_t c) const {
     if (int(c) == m_maskIndex)
       c = m_palette->getEntry(c) & rgba_rgb_mask;  // Alpha = 0
     else
       c = m_palette->getEntry(c);
 
-    c = rgba_blender_normal(c, m_color, m_opacity);
-    *m_dstAddress = m_rgbmap->mapColor(c);
+    return rgba_blender_normal(c, m_color, m_opacity);
   }
 
-private:
+
   const Palette* m_palette;
   const RgbMap* m_rgbmap;
   const int m_opacity;
   color_t m_color;
   const int m_maskIndex;
   int m_colorIndex;
+  std::vector<color_t> m_colors;
 };
 
 //////////////////////////////////////////////////////////////////////
@@ -314,6 +446,8 @@ private:
 template<typename ImageTraits>
 class MergeInkProcessing : public DoubleInkProcessing<MergeInkProcessing<ImageTraits>, ImageTraits> {
 public:
+  typedef DoubleInkProcessing<MergeInkProcessing<ImageTraits>, ImageTraits> base;
+
   MergeInkProcessing(ToolLoop* loop) {
     m_opacity = loop->getOpacity();
   }
@@ -326,6 +460,10 @@ public:
     // Do nothing
   }
 
+  void processSpan(int x, int y, int n) {
+    base::processSpan(x, y, n);
+  }
+
 private:
   color_t m_color;
   int m_opacity;
@@ -341,6 +479,22 @@ void MergeInkProcessing<GrayscaleTraits>::processPixel(int x, int y) {
   *m_dstAddress = graya_blender_merge(*m_srcAddress, m_color, m_opacity);
 }
 
+template<>
+void MergeInkProcessing<RgbTraits>::processSpan(int x, int y, int n) {
+  RgbTraits::address_t dst = m_dstAddress;
+  blend_color_span<RgbTraits>(
+    m_srcAddress, n, m_color, m_opacity, BlendMode::MERGE,
+    [dst](int i, color_t src, color_t result){ dst[i] = result; });
+}
+
+template<>
+void MergeInkProcessing<GrayscaleTraits>::processSpan(int x, int y, int n) {
+  GrayscaleTraits::address_t dst = m_dstAddress;
+  blend_color_span<GrayscaleTraits>(
+    m_srcAddress, n, m_color, m_opacity, BlendMode::MERGE,
+    [dst](int i, color_t src, color_t result){ dst[i] = result; });
+}
+
 template<>
 class MergeInkProcessing<IndexedTraits> : public DoubleInkProcessing<MergeInkProcessing<IndexedTraits>, IndexedTraits> {
 public:
@@ -357,23 +511,27 @@ public:
                (m_palette->getEntry(loop->getPrimaryColor())));
   }
 
-  void processPixel(int x, int y) {
-    color_t c = *m_srcAddress;
+  void processSpan(int x, int y, int n) {
+    blend_indexed_scanline(m_srcAddress, m_dstAddress, n, m_rgbmap, m_colors,
+                           [this](color_t c){ return blendColor(c); });
+  }
+
+private:
+  color_t blendColor(color_t c) const {
     if (int(c) == m_maskIndex)
       c = m_palette->getEntry(c) & rgba_rgb_mask;  // Alpha = 0
     else
       c = m_palette->getEntry(c);
 
-    c = rgba_blender_merge(c, m_color, m_opacity);
-    *m_dstAddress = m_rgbmap->mapColor(c);
+    return rgba_blender_merge(c, m_color, m_opacity);
   }
 
-private:
   const Palette* m_palette;
   const RgbMap* m_rgbmap;
   const int m_opacity;
   const int m_maskIndex;
   color_t m_color;
+  std::vector<color_t> m_colors;
 };
 
 //////////////////////////////////////////////////////////////////////
@@ -757,17 +915,15 @@ public:
       m_shadePalette.setEntry(
         i++, color_utils::color_for_layer(color, loop->getLayer()));
     }
+    m_shadeTable.reset(&m_shadePalette);
   }
 
   int findIndex(uint8_t r, uint8_t g, uint8_t b, uint8_t a) const {
-    return m_shadePalette.findExactMatch(r, g, b, a, -1);
+    return m_shadeTable.findIndex(rgba(r, g, b, a));
   }
 
   pixel_t operator()(const pixel_t src) const {
-    int i = findIndex(rgba_getr(src),
-                      rgba_getg(src),
-                      rgba_getb(src),
-                      rgba_geta(src));
+    int i = m_shadeTable.findIndex(src);
     if (i < 0)
       return src;
 
@@ -784,6 +940,7 @@ public:
 
 private:
   Palette m_shadePalette;
+  ShadeIndexTable m_shadeTable;
   bool m_left;
 };
 
@@ -811,10 +968,11 @@ public:
       m_shadePalette.setEntry(
         i++, color_utils::color_for_target(color, target));
     }
+    m_shadeTable.reset(&m_shadePalette);
   }
 
   int findIndex(uint8_t r, uint8_t g, uint8_t b, uint8_t a) const {
-    return m_shadePalette.findExactMatch(r, g, b, a, -1);
+    return m_shadeTable.findIndex(rgba(r, g, b, a));
   }
 
   pixel_t operator()(const pixel_t src) const {
@@ -840,6 +998,7 @@ public:
 
 private:
   Palette m_shadePalette;
+  ShadeIndexTable m_shadeTable;
   bool m_left;
 };
 
@@ -852,10 +1011,13 @@ public:
     m_palette(loop->getPalette()),
     m_remap(loop->getShadingRemap()),
     m_left(loop->getMouseButton() == ToolLoop::Left) {
+    // Used only for RGB image brushes (to know if each brush pixel
+    // is in the palette), the shading itself uses the m_remap table
+    m_paletteTable.reset(m_palette);
   }
 
   int findIndex(uint8_t r, uint8_t g, uint8_t b, uint8_t a) const {
-    return m_palette->findExactMatch(r, g, b, a, -1);
+    return m_paletteTable.findIndex(rgba(r, g, b, a));
   }
 
   pixel_t operator()(pixel_t i) const {
@@ -878,6 +1040,7 @@ public:
 private:
   const Palette* m_palette;
   const Remap* m_remap;
+  ShadeIndexTable m_paletteTable;
   bool m_left;
 };
 
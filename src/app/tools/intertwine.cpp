@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2020  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -20,7 +20,9 @@
 #include "doc/algo.h"
 #include "doc/layer.h"
 
+#include <algorithm>
 #include <cmath>
+#include <cstdlib>
 
 namespace app {
 namespace tools {
@@ -59,6 +61,48 @@ gfx::Rect Intertwine::getStrokeBounds(ToolLoop* loop, const Stroke& stroke)
   return stroke.bounds();
 }
 
+void Intertwine::getStrokeRects(ToolLoop* loop, const Stroke& stroke,
+                                std::vector<gfx::Rect>& rects)
+{
+  gfx::Rect bounds = getStrokeBounds(loop, stroke);
+  if (!bounds.isEmpty())
+    rects.push_back(bounds);
+}
+
+// static
+void Intertwine::getLineStrokeRects(const Stroke& stroke, int maxLength,
+                                    std::vector<gfx::Rect>& rects)
+{
+  ASSERT(maxLength > 0);
+
+  if (stroke.size() == 1) {
+    rects.push_back(gfx::Rect(stroke[0].x, stroke[0].y, 1, 1));
+    return;
+  }
+
+  for (int c=0; c+1<stroke.size(); ++c) {
+    const gfx::Point a(stroke[c].x, stroke[c].y);
+    const gfx::Point b(stroke[c+1].x, stroke[c+1].y);
+    const int dx = b.x - a.x;
+    const int dy = b.y - a.y;
+    const int pieces = std::max(std::abs(dx), std::abs(dy)) / maxLength + 1;
+
+    gfx::Point p = a;
+    for (int i=1; i<=pieces; ++i) {
+      const gfx::Point q(a.x + dx*i/pieces,
+                         a.y + dy*i/pieces);
+      gfx::Rect rc(std::min(p.x, q.x), std::min(p.y, q.y),
+                   std::abs(q.x - p.x) + 1, std::abs(q.y - p.y) + 1);
+      // The line algorithm can round the points of the piece ends
+      // in a different way, so we add one extra pixel.
+      if (pieces > 1)
+        rc.enlarge(1);
+      rects.push_back(rc);
+      p = q;
+    }
+  }
+}
+
 void Intertwine::doTransformPoint(const Stroke::Pt& pt, ToolLoop* loop)
 {
   loop->getPointShape()->transformPoint(loop, pt);
@@ -68,17 +112,13 @@ void Intertwine::doPointshapeStrokePt(const Stroke::Pt& pt, ToolLoop* loop)
 {
   Symmetry* symmetry = loop->getSymmetry();
   if (symmetry) {
-    // Convert the point to the sprite position so we can apply the
-    // symmetry transformation.
-    Stroke main_stroke;
-    main_stroke.addPoint(pt);
-
-    Strokes strokes;
-    symmetry->generateStrokes(main_stroke, strokes, loop);
-    for (const auto& stroke : strokes) {
+    // Generate all the mirrored points at once (overlapping copies
+    // are discarded) reusing the same m_symmetryPts for each point.
+    symmetry->generatePoints(pt, m_symmetryPts, loop);
+    for (const auto& symPt : m_symmetryPts) {
       // We call transformPoint() moving back each point to the cel
       // origin.
-      doTransformPoint(stroke[0], loop);
+      doTransformPoint(symPt, loop);
     }
   }
   else {
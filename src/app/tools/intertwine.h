@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2021  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -14,6 +14,8 @@
 #include "gfx/point.h"
 #include "gfx/rect.h"
 
+#include <vector>
+
 namespace app {
   namespace tools {
     class ToolLoop;
@@ -34,6 +36,14 @@ namespace app {
 
       virtual gfx::Rect getStrokeBounds(ToolLoop* loop, const Stroke& stroke);
 
+      // Adds to "rects" the areas (relative to the stroke, without
+      // the brush size) that will be painted by joinStroke(). By
+      // default it's only the getStrokeBounds(), but intertwiners
+      // that draw lines can return several small rectangles so we
+      // don't update the whole bounding box of a diagonal line.
+      virtual void getStrokeRects(ToolLoop* loop, const Stroke& stroke,
+                                  std::vector<gfx::Rect>& rects);
+
       // Special region to force when the modify_tilemap_cel_region()
       // is called to restore the m_dstTileset from the m_dstImage
       // in ExpandCelCanvas::validateDestTileset.
@@ -58,10 +68,18 @@ namespace app {
       static void doPointshapeLineWithoutDynamics(int x1, int y1, int x2, int y2, ToolLoop* loop);
       static void doPointshapeLine(const Stroke::Pt& a,
                                    const Stroke::Pt& b, ToolLoop* loop);
+      // Splits each line of the stroke in pieces of "maxLength"
+      // pixels and adds the bounds of each piece to "rects".
+      static void getLineStrokeRects(const Stroke& stroke, int maxLength,
+                                     std::vector<gfx::Rect>& rects);
 
       static doc::AlgoLineWithAlgoPixel getLineAlgo(ToolLoop* loop,
                                                     const Stroke::Pt& a,
                                                     const Stroke::Pt& b);
+
+    private:
+      // Mirrored copies of the current point when symmetry is active.
+      Stroke m_symmetryPts;
     };
 
   } // namespace tools
@@ -176,6 +176,28 @@ public:
       loop, (AlgoHLine)doPointshapeHline);
   }
 
+  void getStrokeRects(ToolLoop* loop, const Stroke& stroke,
+                      std::vector<gfx::Rect>& rects) override {
+    // Filled shapes (or the closing line of the polygon outline)
+    // modify the whole bounding box of the stroke.
+    if (loop->getFilled()) {
+      Intertwine::getStrokeRects(loop, stroke, rects);
+      return;
+    }
+
+    // Pieces of at least the brush size, so the dirty area of each
+    // one (expanded with the brush) doesn't overlap too much with
+    // the others.
+    const gfx::Rect brushBounds = loop->getBrush()->bounds();
+    getLineStrokeRects(stroke,
+                       std::max({ kMinStrokeRectLength,
+                                  brushBounds.w,
+                                  brushBounds.h }),
+                       rects);
+  }
+
+private:
+  static constexpr int kMinStrokeRectLength = 16;
 };
 
 class IntertwineAsRectangles : public Intertwine {
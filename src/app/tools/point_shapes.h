@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -12,7 +12,9 @@
 #include "render/gradient.h"
 
 #include <array>
+#include <map>
 #include <memory>
+#include <tuple>
 
 namespace app {
 namespace tools {
@@ -62,10 +64,30 @@ public:
 };
 
 class BrushPointShape : public PointShape {
+  using CompressedImages = std::array<std::shared_ptr<CompressedImage>, 4>;
+  using BrushKey = std::tuple<BrushType, int, int>; // Type, size, angle
+
+  // Brush created for dynamics with its scanlines for each symmetry
+  // mode (calculated the first time they are used).
+  struct CachedBrush {
+    BrushRef brush;
+    CompressedImages compressedImages;
+  };
+
+  // Maximum number of brushes in m_brushCache
+  static constexpr int kMaxCachedBrushes = 128;
+
   bool m_firstPoint;
   Brush* m_lastBrush;
   BrushType m_origBrushType;
-  std::array<std::shared_ptr<CompressedImage>, 4> m_compressedImages;
+  // Scanlines of m_lastBrush (points to m_ownCompressedImages or to
+  // the images of a brush in m_brushCache)
+  CompressedImages* m_compressedImages = nullptr;
+  CompressedImages m_ownCompressedImages;
+  // Brushes used with dynamics (each point can have a different
+  // size/angle, so we don't regenerate the brush image and its
+  // scanlines each time). This cache is kept between strokes.
+  std::map<BrushKey, CachedBrush> m_brushCache;
   // For dynamics
   DynamicsOptions m_dynamics;
   bool m_useDynamics;
@@ -177,15 +199,20 @@ public:
       if ((brush->size() != size) ||
           (brush->angle() != angle && m_origBrushType != kCircleBrushType) ||
           (m_hasDynamicGradient && pt.gradient != m_lastGradientValue)) {
-        // TODO cache brushes
-        BrushRef newBrush = std::make_shared<Brush>(
-          m_origBrushType, size, angle);
-
         // Dynamic gradient with dithering
+        const bool dithering =
+          (m_hasDynamicGradient && !ink->isEraser() &&
+           (m_dynamics.ditheringMatrix.rows() > 1 ||
+            m_dynamics.ditheringMatrix.cols() > 1));
+
+        // Brushes with dithering depend on the gradient value, so we
+        // cannot cache them.
+        BrushRef newBrush =
+          (dithering ? std::make_shared<Brush>(m_origBrushType, size, angle):
+                       getCachedBrush(size, angle));
+
         bool prepareInk = false;
-        if (m_hasDynamicGradient && !ink->isEraser() &&
-            (m_dynamics.ditheringMatrix.rows() > 1 ||
-             m_dynamics.ditheringMatrix.cols() > 1)) {
+        if (dithering) {
           convert_bitmap_brush_to_dithering_brush(
             newBrush.get(),
             loop->sprite()->pixelFormat(),
@@ -207,10 +234,20 @@ public:
       }
     }
 
-    // TODO cache compressed images (or remove them completelly)
     if (m_lastBrush != brush) {
       m_lastBrush = brush;
-      m_compressedImages.fill(nullptr);
+
+      auto it = m_brushCache.end();
+      if (m_useDynamics)
+        it = m_brushCache.find(brushKey(brush->type(), brush->size(), brush->angle()));
+
+      if (it != m_brushCache.end() && it->second.brush.get() == brush) {
+        m_compressedImages = &it->second.compressedImages;
+      }
+      else {
+        m_ownCompressedImages.fill(nullptr);
+        m_compressedImages = &m_ownCompressedImages;
+      }
     }
 
     x += brush->bounds().x;
@@ -258,8 +295,29 @@ public:
   }
 
 private:
+  static BrushKey brushKey(BrushType type, int size, int angle) {
+    // The angle of circles is not used
+    return BrushKey(type, size, (type == kCircleBrushType ? 0: angle));
+  }
+
+  BrushRef getCachedBrush(int size, int angle) {
+    const BrushKey key = brushKey(m_origBrushType, size, angle);
+    auto it = m_brushCache.find(key);
+    if (it != m_brushCache.end())
+      return it->second.brush;
+
+    // The current brush of the ToolLoop is kept alive by the
+    // ToolLoop itself, so we can remove all the cached brushes.
+    if (int(m_brushCache.size()) >= kMaxCachedBrushes)
+      m_brushCache.clear();
+
+    CachedBrush& cached = m_brushCache[key];
+    cached.brush = std::make_shared<Brush>(m_origBrushType, size, std::get<2>(key));
+    return cached.brush;
+  }
+
   CompressedImage& getCompressedImage(gen::SymmetryMode symmetryMode) {
-    auto& compressPtr = m_compressedImages[int(symmetryMode)];
+    auto& compressPtr = (*m_compressedImages)[int(symmetryMode)];
     if (!compressPtr) {
       switch (symmetryMode) {
         case gen::SymmetryMode::NONE: {
@@ -0,0 +1,250 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/tools/stroke_recording.h"
+
+#include "app/doc.h"
+#include "app/resource_finder.h"
+#include "app/tools/symmetry.h"
+#include "app/tools/tool.h"
+#include "app/tools/tool_loop.h"
+#include "base/fs.h"
+#include "base/fstream_path.h"
+#include "doc/brush.h"
+#include "doc/sprite.h"
+#include "fmt/format.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+namespace app {
+namespace tools {
+
+namespace {
+
+constexpr int kVersion = 1;
+
+const char* kEventTypeNames[] = {
+  "prepare", "press", "add", "draw", "release"
+};
+
+} // anonymous namespace
+
+StrokeRecording::StrokeRecording(ToolLoop* toolLoop)
+{
+  const doc::Sprite* sprite = toolLoop->getDocument()->sprite();
+  width = sprite->width();
+  height = sprite->height();
+  colorMode = sprite->colorMode();
+
+  auto& pref = Preferences::instance();
+  auto& toolPref = pref.tool(toolLoop->getTool());
+  tool = toolLoop->getTool()->getId();
+  rightButton = (toolLoop->getMouseButton() == ToolLoop::Right);
+  inkType = toolPref.ink();
+  fg = pref.colorBar.fgColor();
+  bg = pref.colorBar.bgColor();
+
+  const doc::Brush* brush = toolLoop->getBrush();
+  brushType = brush->type();
+  brushSize = brush->size();
+  brushAngle = brush->angle();
+
+  opacity = toolLoop->getOpacity();
+  tolerance = toolLoop->getTolerance();
+  contiguous = toolLoop->getContiguous();
+  freehandAlgorithm = toolPref.freehandAlgorithm();
+  dynamics = toolLoop->getDynamics();
+
+  if (toolLoop->getSymmetry()) {
+    auto& docPref = pref.document(toolLoop->getDocument());
+    symmetryMode = toolLoop->getSymmetry()->mode();
+    symmetryX = docPref.symmetry.xAxis();
+    symmetryY = docPref.symmetry.yAxis();
+  }
+}
+
+void StrokeRecording::addEvent(const EventType type, const Pointer& pointer)
+{
+  const base::tick_t now = base::current_tick();
+  if (events.empty())
+    m_startTime = now;
+  events.push_back(Event{ type, int(now - m_startTime), pointer });
+}
+
+bool StrokeRecording::save(const std::string& filename) const
+{
+  std::ofstream f(FSTREAM_PATH(filename), std::ios::trunc);
+  if (!f)
+    return false;
+
+  f << "aseprite-stroke " << kVersion << "\n"
+    << "sprite " << width << " " << height << " " << int(colorMode) << "\n"
+    << "tool " << tool << "\n"
+    << "button " << (rightButton ? "right": "left") << "\n"
+    << "ink " << int(inkType) << "\n"
+    << "fg " << fg.toString() << "\n"
+    << "bg " << bg.toString() << "\n"
+    << "brush " << int(brushType) << " " << brushSize << " " << brushAngle << "\n"
+    << "opacity " << opacity << "\n"
+    << "tolerance " << tolerance << "\n"
+    << "contiguous " << (contiguous ? 1: 0) << "\n"
+    << "freehand " << int(freehandAlgorithm) << "\n"
+    << "dynamics "
+    << (dynamics.stabilizer ? 1: 0) << " "
+    << dynamics.stabilizerFactor << " "
+    << int(dynamics.size) << " "
+    << int(dynamics.angle) << " "
+    << int(dynamics.gradient) << " "
+    << dynamics.minSize << " "
+    << dynamics.minAngle << " "
+    << int(dynamics.colorFromTo) << " "
+    << dynamics.minPressureThreshold << " "
+    << dynamics.maxPressureThreshold << " "
+    << dynamics.minVelocityThreshold << " "
+    << dynamics.maxVelocityThreshold << "\n"
+    << "symmetry " << int(symmetryMode) << " "
+    << symmetryX << " " << symmetryY << "\n";
+
+  for (const Event& ev : events) {
+    const Pointer& p = ev.pointer;
+    f << "event "
+      << kEventTypeNames[int(ev.type)] << " "
+      << ev.time << " "
+      << p.point().x << " " << p.point().y << " "
+      << p.velocity().x << " " << p.velocity().y << " "
+      << int(p.button()) << " "
+      << int(p.type()) << " "
+      << p.pressure() << "\n";
+  }
+  return bool(f);
+}
+
+bool StrokeRecording::load(const std::string& filename)
+{
+  std::ifstream f(FSTREAM_PATH(filename));
+  if (!f)
+    return false;
+
+  std::string line;
+  std::string key;
+  int version = 0;
+  if (!std::getline(f, line) ||
+      !(std::istringstream(line) >> key >> version) ||
+      key != "aseprite-stroke" ||
+      version != kVersion)
+    return false;
+
+  events.clear();
+  while (std::getline(f, line)) {
+    std::istringstream s(line);
+    if (!(s >> key))
+      continue;
+
+    int i, j, k;
+    if (key == "sprite") {
+      s >> width >> height >> i;
+      colorMode = doc::ColorMode(i);
+    }
+    else if (key == "tool") {
+      s >> tool;
+    }
+    else if (key == "button") {
+      std::string button;
+      s >> button;
+      rightButton = (button == "right");
+    }
+    else if (key == "ink") {
+      s >> i;
+      inkType = InkType(i);
+    }
+    else if (key == "fg" || key == "bg") {
+      std::string color;
+      s >> color;
+      (key == "fg" ? fg: bg) = app::Color::fromString(color);
+    }
+    else if (key == "brush") {
+      s >> i >> brushSize >> brushAngle;
+      brushType = doc::BrushType(i);
+    }
+    else if (key == "opacity") {
+      s >> opacity;
+    }
+    else if (key == "tolerance") {
+      s >> tolerance;
+    }
+    else if (key == "contiguous") {
+      s >> i;
+      contiguous = (i != 0);
+    }
+    else if (key == "freehand") {
+      s >> i;
+      freehandAlgorithm = FreehandAlgorithm(i);
+    }
+    else if (key == "dynamics") {
+      int stabilizer, colorFromTo;
+      s >> stabilizer >> dynamics.stabilizerFactor
+        >> i >> j >> k
+        >> dynamics.minSize >> dynamics.minAngle
+        >> colorFromTo
+        >> dynamics.minPressureThreshold >> dynamics.maxPressureThreshold
+        >> dynamics.minVelocityThreshold >> dynamics.maxVelocityThreshold;
+      dynamics.stabilizer = (stabilizer != 0);
+      dynamics.size = DynamicSensor(i);
+      dynamics.angle = DynamicSensor(j);
+      dynamics.gradient = DynamicSensor(k);
+      dynamics.colorFromTo = ColorFromTo(colorFromTo);
+    }
+    else if (key == "symmetry") {
+      s >> i >> symmetryX >> symmetryY;
+      symmetryMode = gen::SymmetryMode(i);
+    }
+    else if (key == "event") {
+      std::string type;
+      int time, x, y, button, pointerType;
+      float vx, vy, pressure;
+      s >> type >> time >> x >> y >> vx >> vy >> button >> pointerType >> pressure;
+
+      auto it = std::find(std::begin(kEventTypeNames),
+                          std::end(kEventTypeNames), type);
+      if (it == std::end(kEventTypeNames))
+        return false;
+
+      events.push_back(
+        Event{ EventType(it - std::begin(kEventTypeNames)), time,
+               Pointer(gfx::Point(x, y), Vec2(vx, vy),
+                       Pointer::Button(button),
+                       Pointer::Type(pointerType),
+                       pressure) });
+    }
+
+    if (s.fail())
+      return false;
+  }
+
+  return (width > 0 && height > 0 && !tool.empty());
+}
+
+void StrokeRecording::saveInUserDir() const
+{
+  ResourceFinder rf(false);
+  rf.includeUserDir(base::join_path("strokes", ".").c_str());
+  const std::string dir = rf.getFirstOrCreateDefault();
+  if (dir.empty())
+    return;
+
+  save(base::join_path(dir, fmt::format("stroke-{}-{}.txt",
+                                        tool, base::current_tick())));
+}
+
+} // namespace tools
+} // namespace app
@@ -0,0 +1,101 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_TOOLS_STROKE_RECORDING_H_INCLUDED
+#define APP_TOOLS_STROKE_RECORDING_H_INCLUDED
+#pragma once
+
+#include "app/color.h"
+#include "app/pref/preferences.h"
+#include "app/tools/dynamics.h"
+#include "app/tools/freehand_algorithm.h"
+#include "app/tools/ink_type.h"
+#include "app/tools/pointer.h"
+#include "base/time.h"
+#include "doc/brush_type.h"
+#include "doc/color_mode.h"
+
+#include <string>
+#include <vector>
+
+namespace app {
+namespace tools {
+
+  class ToolLoop;
+
+  // Pointer events received by a ToolLoopManager and the options of
+  // its ToolLoop, saved to replay the same stroke later (e.g. in the
+  // tool_loop_benchmark). The ToolLoopManager records each stroke in
+  // the "strokes" folder of the user directory when the [perf]
+  // record_strokes option is enabled.
+  //
+  // It's saved as a text file, with one "key value..." line for
+  // each option and one "event ..." line for each pointer event.
+  struct StrokeRecording {
+    // ToolLoopManager member function called in each event.
+    enum class EventType {
+      PrepareLoop,
+      PressButton,
+      AddMovement,
+      DrawPendingMovements,
+      ReleaseButton,
+    };
+
+    struct Event {
+      EventType type;
+      int time;                 // Milliseconds from the first event
+      Pointer pointer;
+    };
+
+    // Sprite
+    int width = 0;
+    int height = 0;
+    doc::ColorMode colorMode = doc::ColorMode::RGB;
+
+    // ToolLoopParams
+    std::string tool;
+    bool rightButton = false;
+    InkType inkType = InkType::DEFAULT;
+    app::Color fg;
+    app::Color bg;
+    doc::BrushType brushType = doc::kCircleBrushType;
+    int brushSize = 1;
+    int brushAngle = 0;
+    int opacity = 255;
+    int tolerance = 0;
+    bool contiguous = true;
+    FreehandAlgorithm freehandAlgorithm = FreehandAlgorithm::DEFAULT;
+    DynamicsOptions dynamics;
+
+    // Document preferences
+    gen::SymmetryMode symmetryMode = gen::SymmetryMode::NONE;
+    double symmetryX = 0.0;
+    double symmetryY = 0.0;
+
+    std::vector<Event> events;
+
+    StrokeRecording() { }
+
+    // Records the options of the given tool loop.
+    explicit StrokeRecording(ToolLoop* toolLoop);
+
+    void addEvent(const EventType type, const Pointer& pointer);
+
+    bool save(const std::string& filename) const;
+    bool load(const std::string& filename);
+
+    // Saves the recording with a new file name in the "strokes"
+    // folder of the user directory.
+    void saveInUserDir() const;
+
+  private:
+    base::tick_t m_startTime = 0;
+  };
+
+} // namespace tools
+} // namespace app
+
+#endif
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2021  Igara Studio S.A.
+// Copyright (C) 2021-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -10,8 +10,9 @@
 
 #include "app/tools/symmetry.h"
 
- #include "app/tools/point_shape.h"
- #include "app/tools/tool_loop.h"
+#include "app/tools/point_shape.h"
+#include "app/tools/tool_loop.h"
+#include "doc/brush.h"
 
 namespace app {
 namespace tools {
@@ -49,18 +50,65 @@ void Symmetry::generateStrokes(const Stroke& stroke, Strokes& strokes,
   }
 }
 
+void Symmetry::generatePoints(const Stroke::Pt& pt, Stroke& pts,
+                              ToolLoop* loop)
+{
+  pts.reset();
+  pts.addPoint(pt);
+
+  const bool isDynamic = loop->getDynamics().isDynamic();
+  const bool symmetricBrush = isSymmetricBrush(loop);
+  switch (m_symmetryMode) {
+    case gen::SymmetryMode::NONE:
+      ASSERT(false);
+      break;
+
+    case gen::SymmetryMode::HORIZONTAL:
+    case gen::SymmetryMode::VERTICAL:
+      addSymmetricalPt(calculateSymmetricalPt(pt, loop, isDynamic, m_symmetryMode),
+                       pts, symmetricBrush);
+      break;
+
+    case gen::SymmetryMode::BOTH: {
+      addSymmetricalPt(calculateSymmetricalPt(pt, loop, isDynamic, gen::SymmetryMode::HORIZONTAL),
+                       pts, symmetricBrush);
+
+      const Stroke::Pt pt3 =
+        calculateSymmetricalPt(pt, loop, isDynamic, gen::SymmetryMode::VERTICAL);
+      addSymmetricalPt(pt3, pts, symmetricBrush);
+      addSymmetricalPt(calculateSymmetricalPt(pt3, loop, isDynamic, gen::SymmetryMode::BOTH),
+                       pts, symmetricBrush);
+      break;
+    }
+  }
+}
+
 void Symmetry::calculateSymmetricalStroke(const Stroke& refStroke, Stroke& stroke,
                                           ToolLoop* loop, gen::SymmetryMode symmetryMode)
+{
+  const bool isDynamic = loop->getDynamics().isDynamic();
+  for (const auto& pt : refStroke)
+    stroke.addPoint(calculateSymmetricalPt(pt, loop, isDynamic, symmetryMode));
+}
+
+Stroke::Pt Symmetry::calculateSymmetricalPt(const Stroke::Pt& pt,
+                                            ToolLoop* loop,
+                                            const bool isDynamic,
+                                            gen::SymmetryMode symmetryMode)
 {
   int brushSize, brushCenter;
-  if (loop->getPointShape()->isFloodFill()) {
+  if (isDynamic) {
+    brushSize = pt.size;
+    brushCenter = (brushSize - brushSize % 2) / 2;
+  }
+  else if (loop->getPointShape()->isFloodFill()) {
     brushSize = 1;
     brushCenter = 0;
   }
   else {
     // TODO we should flip the brush center+image+bitmap or just do
     //      the symmetry of all pixels
-    auto brush = loop->getBrush();
+    const doc::Brush* brush = loop->getBrush();
     if (symmetryMode == gen::SymmetryMode::HORIZONTAL || symmetryMode == gen::SymmetryMode::BOTH) {
       brushSize = brush->bounds().w;
       brushCenter = brush->center().x;
@@ -71,20 +119,44 @@ void Symmetry::calculateSymmetricalStroke(const Stroke& refStroke, Stroke& strok
     }
   }
 
-  const bool isDynamic = loop->getDynamics().isDynamic();
-  for (const auto& pt : refStroke) {
-    if (isDynamic) {
-      brushSize = pt.size;
-      brushCenter = (brushSize - brushSize % 2) / 2;
-    }
-    Stroke::Pt pt2 = pt;
-    pt2.symmetry = symmetryMode;
-    if (symmetryMode == gen::SymmetryMode::HORIZONTAL || symmetryMode == gen::SymmetryMode::BOTH)
-      pt2.x = 2 * (m_x + brushCenter) - pt2.x - brushSize;
-    else
-      pt2.y = 2 * (m_y + brushCenter) - pt2.y - brushSize;
-    stroke.addPoint(pt2);
+  Stroke::Pt pt2 = pt;
+  pt2.symmetry = symmetryMode;
+  if (symmetryMode == gen::SymmetryMode::HORIZONTAL || symmetryMode == gen::SymmetryMode::BOTH)
+    pt2.x = 2 * (m_x + brushCenter) - pt2.x - brushSize;
+  else
+    pt2.y = 2 * (m_y + brushCenter) - pt2.y - brushSize;
+  return pt2;
+}
+
+// Returns true if the flipped brush paints the same pixels as the
+// original one, so two mirrored points in the same position are
+// equal.
+bool Symmetry::isSymmetricBrush(ToolLoop* loop)
+{
+  PointShape* pointShape = loop->getPointShape();
+  if (pointShape->isPixel() ||
+      pointShape->isFloodFill())
+    return true;
+  if (pointShape->isSpray())
+    return false;
+
+  const doc::Brush* brush = loop->getBrush();
+  return (brush->type() == doc::kCircleBrushType ||
+          (brush->type() == doc::kSquareBrushType && brush->angle() == 0));
+}
+
+// Adds the given mirrored point only if it doesn't paint the same
+// pixels than a previous point (e.g. the point is over the symmetry
+// axis), so overlapping copies are processed by the ink only once.
+void Symmetry::addSymmetricalPt(const Stroke::Pt& pt2, Stroke& pts,
+                                const bool symmetricBrush)
+{
+  for (const auto& pt : pts) {
+    if (pt.x == pt2.x && pt.y == pt2.y &&
+        (pt.symmetry == pt2.symmetry || symmetricBrush))
+      return;
   }
+  pts.addPoint(pt2);
 }
 
 } // namespace tools
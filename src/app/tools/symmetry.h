@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2021  Igara Studio S.A.
+// Copyright (C) 2021-2024  Igara Studio S.A.
 // Copyright (C) 2015  David Capello
 //
 // This program is distributed under the terms of
@@ -27,11 +27,23 @@ public:
 
   void generateStrokes(const Stroke& stroke, Strokes& strokes, ToolLoop* loop);
 
+  // Generates in "pts" the given point and all its mirrored copies
+  // in one batch (without allocating a Stroke for each copy).
+  // Copies that would paint the same pixels as a previous one are
+  // discarded.
+  void generatePoints(const Stroke::Pt& pt, Stroke& pts, ToolLoop* loop);
+
   gen::SymmetryMode mode() const { return m_symmetryMode; }
 
 private:
   void calculateSymmetricalStroke(const Stroke& refStroke, Stroke& stroke,
                                   ToolLoop* loop, gen::SymmetryMode symmetryMode);
+  Stroke::Pt calculateSymmetricalPt(const Stroke::Pt& pt, ToolLoop* loop,
+                                    const bool isDynamic,
+                                    gen::SymmetryMode symmetryMode);
+  static bool isSymmetricBrush(ToolLoop* loop);
+  static void addSymmetricalPt(const Stroke::Pt& pt2, Stroke& pts,
+                               const bool symmetricBrush);
 
   gen::SymmetryMode m_symmetryMode;
   double m_x, m_y;
@@ -12,11 +12,14 @@
 #include "app/tools/tool_loop_manager.h"
 
 #include "app/context.h"
+#include "app/perf_trace.h"
+#include "app/pref/preferences.h"
 #include "app/snap_to_grid.h"
 #include "app/tools/controller.h"
 #include "app/tools/ink.h"
 #include "app/tools/intertwine.h"
 #include "app/tools/point_shape.h"
+#include "app/tools/stroke_recording.h"
 #include "app/tools/symmetry.h"
 #include "app/tools/tool_loop.h"
 #include "app/tools/velocity.h"
@@ -29,8 +32,10 @@
 #include "gfx/region.h"
 
 #include <algorithm>
+#include <atomic>
 #include <climits>
 #include <cmath>
+#include <vector>
 
 #define TOOL_TRACE(...) // TRACEARGS(__VA_ARGS__)
 
@@ -41,17 +46,32 @@ using namespace gfx;
 using namespace doc;
 using namespace filters;
 
+// Number of ToolLoopManager instances alive
+static std::atomic<int> g_activeToolLoops(0);
+
 ToolLoopManager::ToolLoopManager(ToolLoop* toolLoop)
   : m_toolLoop(toolLoop)
   , m_canceled(false)
+  , m_pendingMovements(false)
   , m_brushSize0(toolLoop->getBrush()->size())
   , m_brushAngle0(toolLoop->getBrush()->angle())
   , m_dynamics(toolLoop->getDynamics())
 {
+  ++g_activeToolLoops;
+
+  if (Preferences::instance().perf.recordStrokes())
+    m_recording = std::make_unique<StrokeRecording>(toolLoop);
 }
 
 ToolLoopManager::~ToolLoopManager()
 {
+  --g_activeToolLoops;
+}
+
+// static
+bool ToolLoopManager::isAnyToolLoopActive()
+{
+  return (g_activeToolLoops > 0);
 }
 
 bool ToolLoopManager::isCanceled() const
@@ -68,14 +88,23 @@ void ToolLoopManager::end()
 {
   if (m_canceled)
     m_toolLoop->rollback();
-  else
+  else {
+    drawPendingMovements();
     m_toolLoop->commit();
+
+    if (m_recording && !m_recording->events.empty())
+      m_recording->saveInUserDir();
+  }
 }
 
 void ToolLoopManager::prepareLoop(const Pointer& pointer)
 {
+  if (m_recording)
+    m_recording->addEvent(StrokeRecording::EventType::PrepareLoop, pointer);
+
   // Start with no points at all
   m_stroke.reset();
+  m_pendingMovements = false;
 
   // Prepare the ink
   m_toolLoop->getInk()->prepareInk(m_toolLoop);
@@ -97,6 +126,12 @@ void ToolLoopManager::pressButton(const Pointer& pointer)
 {
   TOOL_TRACE("ToolLoopManager::pressButton", pointer.point());
 
+  if (m_recording)
+    m_recording->addEvent(StrokeRecording::EventType::PressButton, pointer);
+
+  // Draw the previous mouse movements before handling the click
+  drawPendingMovements();
+
   // A little patch to memorize initial Trace Policy in the
   // current function execution.
   // When the initial trace policy is "Last" and then
@@ -147,6 +182,11 @@ bool ToolLoopManager::releaseButton(const Pointer& pointer)
 {
   TOOL_TRACE("ToolLoopManager::releaseButton", pointer.point());
 
+  if (m_recording)
+    m_recording->addEvent(StrokeRecording::EventType::ReleaseButton, pointer);
+
+  drawPendingMovements();
+
   m_lastPointer = pointer;
 
   if (isCanceled())
@@ -175,6 +215,17 @@ bool ToolLoopManager::releaseButton(const Pointer& pointer)
 
 void ToolLoopManager::movement(Pointer pointer)
 {
+  PerfTrace span("tools", "ToolLoopManager::movement");
+
+  addMovement(pointer);
+  drawPendingMovements();
+}
+
+void ToolLoopManager::addMovement(Pointer pointer)
+{
+  if (m_recording)
+    m_recording->addEvent(StrokeRecording::EventType::AddMovement, pointer);
+
   // Filter points with the stabilizer
   if (m_dynamics.stabilizer && m_dynamics.stabilizerFactor > 0) {
     const double f = m_dynamics.stabilizerFactor;
@@ -201,11 +252,29 @@ void ToolLoopManager::movement(Pointer pointer)
 
   Stroke::Pt spritePoint = getSpriteStrokePt(pointer);
   m_toolLoop->getController()->movement(m_toolLoop, m_stroke, spritePoint);
+  m_pendingMovements = true;
+}
+
+void ToolLoopManager::drawPendingMovements()
+{
+  if (!m_pendingMovements || isCanceled())
+    return;
+
+  // Only calls that draw something are recorded (calling it again
+  // without pending movements does nothing)
+  if (m_recording)
+    m_recording->addEvent(StrokeRecording::EventType::DrawPendingMovements,
+                          m_lastPointer);
+
+  m_pendingMovements = false;
 
   std::string statusText;
   m_toolLoop->getController()->getStatusBarText(m_toolLoop, m_stroke, statusText);
   m_toolLoop->updateStatusBar(statusText.c_str());
 
+  // All the points added since the last step are intertwined
+  // together (the controller returns all of them in
+  // getStrokeToInterwine()).
   doLoopStep(false);
 }
 
@@ -328,27 +397,34 @@ void ToolLoopManager::calculateDirtyArea(const Strokes& strokes)
   // Start with a fresh dirty area
   m_dirtyArea.clear();
 
+  // Each stroke can be converted to several rectangles (e.g. one
+  // rectangle for each piece of a diagonal line) so we update only
+  // the pixels that can be modified in this step instead of the
+  // whole bounding box.
+  std::vector<gfx::Rect> strokeRects;
   for (auto& stroke : strokes) {
-    gfx::Rect strokeBounds =
-      m_toolLoop->getIntertwine()->getStrokeBounds(m_toolLoop, stroke);
+    strokeRects.clear();
+    m_toolLoop->getIntertwine()->getStrokeRects(m_toolLoop, stroke, strokeRects);
 
-    if (strokeBounds.isEmpty())
-      continue;
+    for (const gfx::Rect& strokeBounds : strokeRects) {
+      if (strokeBounds.isEmpty())
+        continue;
 
-    // Expand the dirty-area with the pen width
-    Rect r1, r2;
+      // Expand the dirty-area with the pen width
+      Rect r1, r2;
 
-    m_toolLoop->getPointShape()->getModifiedArea(
-      m_toolLoop,
-      strokeBounds.x,
-      strokeBounds.y, r1);
+      m_toolLoop->getPointShape()->getModifiedArea(
+        m_toolLoop,
+        strokeBounds.x,
+        strokeBounds.y, r1);
 
-    m_toolLoop->getPointShape()->getModifiedArea(
-      m_toolLoop,
-      strokeBounds.x+strokeBounds.w-1,
-      strokeBounds.y+strokeBounds.h-1, r2);
+      m_toolLoop->getPointShape()->getModifiedArea(
+        m_toolLoop,
+        strokeBounds.x+strokeBounds.w-1,
+        strokeBounds.y+strokeBounds.h-1, r2);
 
-    m_dirtyArea.createUnion(m_dirtyArea, Region(r1.createUnion(r2)));
+      m_dirtyArea.createUnion(m_dirtyArea, Region(r1.createUnion(r2)));
+    }
   }
 
   // Merge new dirty area with the previous one (for tools like line
@@ -16,6 +16,7 @@
 #include "gfx/point.h"
 #include "gfx/region.h"
 
+#include <memory>
 #include <vector>
 
 namespace gfx { class Region; }
@@ -24,6 +25,7 @@ namespace app {
 namespace tools {
 
 class ToolLoop;
+struct StrokeRecording;
 
 // Class to manage the drawing tool (editor <-> tool interface).
 //
@@ -47,6 +49,11 @@ public:
   ToolLoopManager(ToolLoop* toolLoop);
   virtual ~ToolLoopManager();
 
+  // Returns true if there is a tool loop in progress (a
+  // ToolLoopManager alive). It can be called from any thread (e.g. to
+  // avoid heavy background work in the middle of a stroke).
+  static bool isAnyToolLoopActive();
+
   // Returns true if the loop was canceled by the user
   bool isCanceled() const;
 
@@ -78,6 +85,14 @@ public:
   // Should be called each time the user moves the mouse inside the editor.
   void movement(Pointer pointer);
 
+  // Adds the mouse position to the stroke without drawing it. The
+  // points are drawn in one step with the next movement() or
+  // drawPendingMovements() call. Useful to process several pointer
+  // events (e.g. from a high-rate tablet) once per display frame.
+  void addMovement(Pointer pointer);
+  void drawPendingMovements();
+  bool hasPendingMovements() const { return m_pendingMovements; }
+
   // Should be called when Shift+brush tool is used to disable stabilizer
   // on the line preview
   void disableMouseStabilizer();
@@ -95,6 +110,9 @@ private:
 
   ToolLoop* m_toolLoop;
   bool m_canceled;
+  // True if there are points added with addMovement() that weren't
+  // drawn yet.
+  bool m_pendingMovements;
   Stroke m_stroke;
   Pointer m_lastPointer;
   gfx::Region m_dirtyArea;
@@ -103,6 +121,10 @@ private:
   const int m_brushAngle0;
   DynamicsOptions m_dynamics;
   gfx::PointF m_stabilizerCenter;
+
+  // Recording of the pointer events when the [perf] record_strokes
+  // option is enabled (saved when the stroke is committed).
+  std::unique_ptr<StrokeRecording> m_recording;
 };
 
 } // namespace tools
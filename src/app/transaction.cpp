@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -99,7 +99,20 @@ void Transaction::commit()
   const SpritePosition sprPos = m_cmds->spritePositionAfterExecute();
 #endif
 
-  m_undo->add(m_cmds);
+  if (m_ctx->isUndoEnabled()) {
+    m_undo->add(m_cmds);
+  }
+  else {
+    // The changes are already applied to the document, we can
+    // discard the undo information right now.
+    delete m_cmds;
+
+    // Older undo states cannot be applied to the modified document,
+    // and it cannot go back to its saved state (so it's marked as
+    // modified, and clearUndo() notifies the backup of the change).
+    m_undo->clearUndo();
+    m_doc->impossibleToBackToSavedState();
+  }
   m_cmds = nullptr;
 
   // Process changes
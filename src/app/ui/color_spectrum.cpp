@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2022  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -15,6 +15,8 @@
 #include "app/ui/skin/skin_theme.h"
 #include "app/ui/status_bar.h"
 #include "app/util/shader_helpers.h"
+#include "gfx/hsl.h"
+#include "gfx/rgb.h"
 #include "os/surface.h"
 #include "ui/graphics.h"
 #include "ui/message.h"
@@ -24,6 +26,7 @@
 #include "ui/system.h"
 
 #include <algorithm>
+#include <vector>
 
 namespace app {
 
@@ -137,18 +140,30 @@ void ColorSpectrum::onPaintSurfaceInBgThread(
     int umax = std::max(1, main.w-1);
     int vmax = std::max(1, main.h-1);
 
-    for (int y=0; y<main.h && !stop; ++y) {
-      for (int x=0; x<main.w && !stop; ++x) {
-        double hue = 360.0 * double(x) / double(umax);
-        double lit = 1.0 - double(y) / double(vmax);
-
-        gfx::Color color = color_utils::color_for_ui(
-          app::Color::fromHsl(
-            std::clamp(hue, 0.0, 360.0),
-            sat,
-            std::clamp(lit, 0.0, 1.0)));
+    // Colors with lightness=0.5 for each hue. With a fixed hue and
+    // saturation, the RGB components go linearly from black to this
+    // color (lightness in [0, 0.5]), and from this color to white
+    // (lightness in [0.5, 1]).
+    std::vector<gfx::Rgb> midColors(main.w);
+    for (int x=0; x<main.w; ++x) {
+      double hue = 360.0 * double(x) / double(umax);
+      midColors[x] = gfx::Rgb(gfx::Hsl(std::clamp(hue, 0.0, 360.0), sat, 0.5));
+    }
 
-        s->putPixel(color, main.x+x, main.y+y);
+    for (int y=0; y<main.h && !stop; ++y) {
+      double lit = 1.0 - double(y) / double(vmax);
+      lit = std::clamp(lit, 0.0, 1.0);
+
+      // Each component is calculated as a*component + b
+      const double a = (lit <= 0.5 ? 2.0*lit: 2.0 - 2.0*lit);
+      const double b = (lit <= 0.5 ? 0.0: 255.0 * (2.0*lit - 1.0));
+
+      for (int x=0; x<main.w; ++x) {
+        const gfx::Rgb& rgb = midColors[x];
+        s->putPixel(gfx::rgba(int(rgb.red()   * a + b + 0.5),
+                              int(rgb.green() * a + b + 0.5),
+                              int(rgb.blue()  * a + b + 0.5)),
+                    main.x+x, main.y+y);
       }
     }
     if (stop)
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2022  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2016-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -15,9 +15,12 @@
 #include "app/pref/preferences.h"
 #include "app/ui/skin/skin_theme.h"
 #include "app/util/shader_helpers.h"
+#include "gfx/hsv.h"
+#include "gfx/rgb.h"
 #include "ui/graphics.h"
 
 #include <algorithm>
+#include <vector>
 
 namespace app {
 
@@ -162,18 +165,24 @@ void ColorTintShadeTone::onPaintSurfaceInBgThread(
   int vmax = std::max(1, main.h-1);
 
   if (m_paintFlags & MainAreaFlag) {
-    for (int y=0; y<main.h && !stop; ++y) {
-      for (int x=0; x<main.w && !stop; ++x) {
-        double sat = double(x) / double(umax);
-        double val = 1.0 - double(y) / double(vmax);
-
-        gfx::Color color = color_utils::color_for_ui(
-          app::Color::fromHsv(
-            hue,
-            std::clamp(sat, 0.0, 1.0),
-            std::clamp(val, 0.0, 1.0)));
+    // Colors of the first row (max HSV value) for each saturation, the
+    // other rows are the same colors scaled by the value.
+    std::vector<gfx::Rgb> rowColors(main.w);
+    for (int x=0; x<main.w; ++x) {
+      double sat = double(x) / double(umax);
+      rowColors[x] = gfx::Rgb(gfx::Hsv(hue, std::clamp(sat, 0.0, 1.0), 1.0));
+    }
 
-        s->putPixel(color, main.x+x, main.y+y);
+    for (int y=0; y<main.h && !stop; ++y) {
+      double val = 1.0 - double(y) / double(vmax);
+      val = std::clamp(val, 0.0, 1.0);
+
+      for (int x=0; x<main.w; ++x) {
+        const gfx::Rgb& rgb = rowColors[x];
+        s->putPixel(gfx::rgba(int(rgb.red()   * val + 0.5),
+                              int(rgb.green() * val + 0.5),
+                              int(rgb.blue()  * val + 0.5)),
+                    main.x+x, main.y+y);
       }
     }
     if (stop)
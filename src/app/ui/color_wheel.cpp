@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2022  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -27,6 +27,8 @@
 #include "ui/size_hint_event.h"
 #include "ui/system.h"
 
+#include <vector>
+
 namespace app {
 
 using namespace app::skin;
@@ -225,19 +227,31 @@ app::Color ColorWheel::getMainAreaColor(const int _u, const int umax,
     }
   }
 
+  return getWheelColor(u, v, m_wheelRadius,
+                       hasCaptureInMainArea(),
+                       (m_color.getType() != Color::MaskType ? m_color.getHsvValue(): 1.0),
+                       getCurrentAlphaForNewColor());
+}
+
+app::Color ColorWheel::getWheelColor(const int u, const int v,
+                                     const double radius,
+                                     const bool limitToRadius,
+                                     const double value,
+                                     const int alpha) const
+{
   double d = std::sqrt(u*u + v*v);
 
   // When we click the main area we can limit the distance to the
   // wheel radius to pick colors even outside the wheel radius.
-  if (hasCaptureInMainArea() && d > m_wheelRadius) {
-    d = m_wheelRadius;
+  if (limitToRadius && d > radius) {
+    d = radius;
   }
 
   if (m_colorModel == ColorModel::NORMAL_MAP) {
-    if (d <= m_wheelRadius) {
-      double normalizedDistance = d / m_wheelRadius;
-      double normalizedU = u / m_wheelRadius;
-      double normalizedV = v / m_wheelRadius;
+    if (d <= radius) {
+      double normalizedDistance = d / radius;
+      double normalizedU = u / radius;
+      double normalizedV = v / radius;
       double blueAngle;
       int r, g, b;
 
@@ -279,7 +293,7 @@ app::Color ColorWheel::getMainAreaColor(const int _u, const int umax,
   }
 
   // Pick from the wheel
-  if (d <= m_wheelRadius) {
+  if (d <= radius) {
     double a = std::atan2(-v, u);
 
     int hue = (int(180.0 * a / PI)
@@ -296,19 +310,19 @@ app::Color ColorWheel::getMainAreaColor(const int _u, const int umax,
 
     int sat;
     if (m_discrete) {
-      sat = int(120.0 * d / m_wheelRadius);
+      sat = int(120.0 * d / radius);
       sat /= 20;
       sat *= 20;
     }
     else {
-      sat = int(100.0 * d / m_wheelRadius);
+      sat = int(100.0 * d / radius);
     }
 
     return app::Color::fromHsv(
       std::clamp(hue, 0, 360),
       std::clamp(sat / 100.0, 0.0, 1.0),
-      (m_color.getType() != Color::MaskType ? m_color.getHsvValue(): 1.0),
-      getCurrentAlphaForNewColor());
+      value,
+      alpha);
   }
 
   return app::Color::fromMask();
@@ -414,19 +428,22 @@ void ColorWheel::onPaintSurfaceInBgThread(os::Surface* s,
                                           bool& stop)
 {
   if (m_paintFlags & MainAreaFlag) {
-    int umax = std::max(1, main.w-1);
-    int vmax = std::max(1, main.h-1);
+    if (!updateWheelColors(main.size(), stop))
+      return;
 
-    for (int y=0; y<main.h && !stop; ++y) {
-      for (int x=0; x<main.w && !stop; ++x) {
-        app::Color appColor =
-          getMainAreaColor(x, umax,
-                           y, vmax);
+    // Normal maps don't depend on the HSV value
+    const double val =
+      (m_colorModel != ColorModel::NORMAL_MAP &&
+       m_color.getType() != app::Color::MaskType ? m_color.getHsvValue(): 1.0);
 
+    const gfx::Color* src = m_wheelColors.data();
+    for (int y=0; y<main.h && !stop; ++y) {
+      for (int x=0; x<main.w; ++x, ++src) {
         gfx::Color color;
-        if (appColor.getType() != app::Color::MaskType) {
-          appColor.setAlpha(255);
-          color = color_utils::color_for_ui(appColor);
+        if (*src != gfx::ColorNone) {
+          color = gfx::rgba(int(gfx::getr(*src) * val + 0.5),
+                            int(gfx::getg(*src) * val + 0.5),
+                            int(gfx::getb(*src) * val + 0.5), 255);
         }
         else {
           color = m_bgColor;
@@ -460,6 +477,43 @@ void ColorWheel::onPaintSurfaceInBgThread(os::Surface* s,
   ColorSelector::onPaintSurfaceInBgThread(s, main, bottom, alpha, stop);
 }
 
+// Executed in the background thread, returns false if the painting
+// was stopped.
+bool ColorWheel::updateWheelColors(const gfx::Size& size, bool& stop)
+{
+  if (!m_wheelColors.empty() &&
+      m_wheelColorsSize == size &&
+      m_wheelColorsDiscrete == m_discrete &&
+      m_wheelColorsModel == m_colorModel)
+    return true;
+
+  const int umax = std::max(1, size.w-1);
+  const int vmax = std::max(1, size.h-1);
+  const double radius = std::max(1.0, std::min(size.w, size.h) / 2.0) - 0.1;
+
+  std::vector<gfx::Color> colors(size.w*size.h);
+  gfx::Color* dst = colors.data();
+  for (int y=0; y<size.h && !stop; ++y) {
+    for (int x=0; x<size.w; ++x, ++dst) {
+      const app::Color appColor =
+        getWheelColor(x - umax/2, y - vmax/2, radius, false, 1.0, 255);
+
+      if (appColor.getType() != app::Color::MaskType)
+        *dst = color_utils::color_for_ui(appColor);
+      else
+        *dst = gfx::ColorNone;
+    }
+  }
+  if (stop)
+    return false;
+
+  m_wheelColors = std::move(colors);
+  m_wheelColorsSize = size;
+  m_wheelColorsDiscrete = m_discrete;
+  m_wheelColorsModel = m_colorModel;
+  return true;
+}
+
 int ColorWheel::onNeedsSurfaceRepaint(const app::Color& newColor)
 {
   return
@@ -484,6 +538,9 @@ void ColorWheel::setDiscrete(bool state)
 
 void ColorWheel::setColorModel(ColorModel colorModel)
 {
+  if (m_colorModel != colorModel)
+    m_paintFlags = AllAreasFlag;
+
   m_colorModel = colorModel;
   Preferences::instance().colorBar.wheelModel((int)m_colorModel);
 
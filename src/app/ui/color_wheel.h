@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2021-2022  Igara Studio S.A.
+// Copyright (C) 2021-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -10,8 +10,11 @@
 #pragma once
 
 #include "app/ui/color_selector.h"
+#include "gfx/size.h"
 #include "ui/button.h"
 
+#include <vector>
+
 namespace app {
 
   class ColorWheel : public ColorSelector {
@@ -66,6 +69,12 @@ namespace app {
     void onOptions();
     int getHarmonies() const;
     app::Color getColorInHarmony(int i) const;
+    app::Color getWheelColor(const int u, const int v,
+                             const double radius,
+                             const bool limitToRadius,
+                             const double value,
+                             const int alpha) const;
+    bool updateWheelColors(const gfx::Size& size, bool& stop);
 
     // Converts an hue angle from HSV <-> current color model hue.
     // With dir == +1, the angle is from the color model and it's converted to HSV hue.
@@ -85,6 +94,16 @@ namespace app {
     // Internal flag used to know if after pickColor() we selected an
     // harmony.
     mutable bool m_harmonyPicked;
+
+    // Colors of the wheel (main area) with the maximum HSV value, or
+    // gfx::ColorNone outside the wheel. They are calculated only when
+    // the size or the wheel options change, and then the main area is
+    // painted scaling them by the current HSV value. Only used from
+    // the background painting thread.
+    std::vector<gfx::Color> m_wheelColors;
+    gfx::Size m_wheelColorsSize;
+    bool m_wheelColorsDiscrete = false;
+    ColorModel m_wheelColorsModel = ColorModel::RGB;
   };
 
 } // namespace app
@@ -216,6 +216,10 @@ public:
 
 } // anonymous namespace
 
+// Milliseconds between redraws of the preview editor while the
+// sprite is being modified (~60 fps)
+static constexpr int kPreviewRefreshInterval = 16;
+
 DocView::DocView(Doc* document, Type type,
                  DocViewPreviewDelegate* previewDelegate)
   : Box(VERTICAL)
@@ -227,6 +231,7 @@ DocView::DocView(Doc* document, Type type,
   , m_editor((type == Normal ?
               (Editor*)new AppEditor(document, previewDelegate):
               (Editor*)new PreviewEditor(document)))
+  , m_previewTimer(kPreviewRefreshInterval)
 {
   addChild(m_view);
 
@@ -235,10 +240,13 @@ DocView::DocView(Doc* document, Type type,
 
   m_editor->setDocView(this);
   m_document->add_observer(this);
+
+  m_previewTimer.Tick.connect([this]{ flushPreviewRegion(); });
 }
 
 DocView::~DocView()
 {
+  m_previewTimer.stop();
   m_document->remove_observer(this);
   delete m_editor;
 }
@@ -399,15 +407,42 @@ bool DocView::onProcessMessage(Message* msg)
 
 void DocView::onGeneralUpdate(DocEvent& ev)
 {
+  // The whole editor is redrawn anyway
+  m_previewTimer.stop();
+  m_previewRegion.clear();
+
   if (m_editor->isVisible())
     m_editor->updateEditor(true);
 }
 
 void DocView::onSpritePixelsModified(DocEvent& ev)
 {
-  if (m_editor->isVisible() &&
-      m_editor->frame() == ev.frame())
-    m_editor->drawSpriteClipped(ev.region());
+  if (!m_editor->isVisible() ||
+      m_editor->frame() != ev.frame())
+    return;
+
+  // The preview editor accumulates the modified regions to redraw
+  // them in the next timer tick, so it doesn't double the cost of
+  // each change in the main editor.
+  if (m_type == Preview) {
+    m_previewRegion.createUnion(m_previewRegion, ev.region());
+    if (!m_previewTimer.isRunning())
+      m_previewTimer.start();
+    return;
+  }
+
+  m_editor->drawSpriteClipped(ev.region());
+}
+
+void DocView::flushPreviewRegion()
+{
+  m_previewTimer.stop();
+  if (m_previewRegion.isEmpty())
+    return;
+
+  if (m_editor->isVisible())
+    m_editor->drawSpriteClipped(m_previewRegion);
+  m_previewRegion.clear();
 }
 
 void DocView::onLayerMergedDown(DocEvent& ev)
@@ -13,7 +13,9 @@
 #include "app/ui/input_chain_element.h"
 #include "app/ui/tabs.h"
 #include "app/ui/workspace_view.h"
+#include "gfx/region.h"
 #include "ui/box.h"
+#include "ui/timer.h"
 
 namespace doc {
   class Layer;
@@ -111,6 +113,7 @@ namespace app {
 
   private:
     bool hasContentInActiveFrame(const doc::Layer* layer) const;
+    void flushPreviewRegion();
 
     Type m_type;
     Doc* m_document;
@@ -118,6 +121,13 @@ namespace app {
     DocViewPreviewDelegate* m_previewDelegate;
     Editor* m_editor;
     gfx::Point m_timelineScroll;
+
+    // Modified regions of the sprite that weren't redrawn yet in the
+    // preview editor. The preview is redrawn at most once per display
+    // refresh (m_previewTimer) instead of each time the main editor
+    // modifies some pixels (e.g. for each point of a stroke).
+    gfx::Region m_previewRegion;
+    ui::Timer m_previewTimer;
   };
 
 } // namespace app
@@ -136,8 +136,15 @@ color_t BrushPreview::getBrushColor(Sprite* sprite, Layer* layer)
 //      a way to simplify all possibilities
 void BrushPreview::show(const gfx::Point& screenPos)
 {
+  // The sprite area of the previous real preview is invalidated
+  // together with the area of the new one (or it's not invalidated
+  // at all if the preview didn't change).
+  const bool hadRealPreview = (m_onScreen && m_withRealPreview);
+  const gfx::Rect oldPreviewBounds = m_lastBounds;
+  const doc::frame_t oldPreviewFrame = m_lastFrame;
+
   if (m_onScreen)
-    hide();
+    hideInternal(false);
 
   Doc* document = m_editor->document();
   Sprite* sprite = m_editor->sprite();
@@ -404,12 +411,55 @@ void BrushPreview::show(const gfx::Point& screenPos)
       }
     }
 
-    document->notifySpritePixelsModified(
-      sprite, gfx::Region(m_lastBounds = extraCelBoundsInCanvas),
-      m_lastFrame = site.frame());
+    const gfx::Rect previewBounds = extraCelBoundsInCanvas;
+    const doc::frame_t previewFrame = site.frame();
+    const bool samePreview =
+      (hadRealPreview &&
+       m_lastPreviewImage &&
+       oldPreviewBounds == previewBounds &&
+       oldPreviewFrame == previewFrame &&
+       m_lastPreviewLayer == layer &&
+       m_lastPreviewOpacity == opacity &&
+       m_lastPreviewBlendMode == m_extraCel->blendMode() &&
+       is_same_image(m_lastPreviewImage.get(), extraImage));
+
+    // Re-render the sprite area only if the preview has changed
+    if (!samePreview) {
+      gfx::Region rgn(previewBounds);
+      if (hadRealPreview) {
+        if (oldPreviewFrame == previewFrame) {
+          rgn.createUnion(rgn, gfx::Region(oldPreviewBounds));
+        }
+        else {
+          document->notifySpritePixelsModified(
+            sprite, gfx::Region(oldPreviewBounds), oldPreviewFrame);
+        }
+      }
+      document->notifySpritePixelsModified(sprite, rgn, previewFrame);
+
+      if (m_lastPreviewImage &&
+          m_lastPreviewImage->pixelFormat() == extraImage->pixelFormat() &&
+          m_lastPreviewImage->width() == extraImage->width() &&
+          m_lastPreviewImage->height() == extraImage->height()) {
+        copy_image(m_lastPreviewImage.get(), extraImage);
+      }
+      else {
+        m_lastPreviewImage.reset(Image::createCopy(extraImage));
+      }
+      m_lastPreviewLayer = layer;
+      m_lastPreviewOpacity = opacity;
+      m_lastPreviewBlendMode = m_extraCel->blendMode();
+    }
 
+    m_lastBounds = previewBounds;
+    m_lastFrame = previewFrame;
     m_withRealPreview = true;
   }
+  // Clean the previous real preview
+  else if (hadRealPreview) {
+    document->notifySpritePixelsModified(
+      sprite, gfx::Region(oldPreviewBounds), oldPreviewFrame);
+  }
 
   // Save area and draw the cursor
   if (!(m_type & NATIVE_CROSSHAIR) ||
@@ -447,6 +497,11 @@ void BrushPreview::show(const gfx::Point& screenPos)
 // (m_cursorEditor). So you must to use this routine only if you
 // called showBrushPreview() before.
 void BrushPreview::hide()
+{
+  hideInternal(true);
+}
+
+void BrushPreview::hideInternal(const bool invalidateRealPreview)
 {
   if (!m_onScreen)
     return;
@@ -482,8 +537,10 @@ void BrushPreview::hide()
 
     if (document && sprite) {
       document->setExtraCel(ExtraCelRef(nullptr));
-      document->notifySpritePixelsModified(
-        sprite, gfx::Region(m_lastBounds), m_lastFrame);
+      if (invalidateRealPreview) {
+        document->notifySpritePixelsModified(
+          sprite, gfx::Region(m_lastBounds), m_lastFrame);
+      }
     }
 
     m_withRealPreview = false;
@@ -502,14 +559,18 @@ void BrushPreview::discardBrushPreview()
 
   if (document && m_onScreen && m_withRealPreview) {
     document->setExtraCel(ExtraCelRef(nullptr));
+
+    // The sprite can be rendered without the preview from now on, so
+    // the next show() must invalidate the area of the preview anyway.
+    m_lastPreviewImage.reset();
   }
 }
 
 void BrushPreview::redraw()
 {
   if (m_onScreen) {
+    // show() hides the current preview
     gfx::Point screenPos = m_screenPosition;
-    hide();
     show(screenPos);
   }
 }
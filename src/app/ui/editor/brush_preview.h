@@ -12,7 +12,9 @@
 #include "app/extra_cel.h"
 #include "doc/brush.h"
 #include "doc/color.h"
+#include "doc/blend_mode.h"
 #include "doc/frame.h"
+#include "doc/image_ref.h"
 #include "doc/mask_boundaries.h"
 #include "gfx/color.h"
 #include "gfx/point.h"
@@ -88,6 +90,11 @@ namespace app {
   private:
     typedef void (BrushPreview::*PixelDelegate)(ui::Graphics*, const gfx::Point&, gfx::Color);
 
+    // Hides the brush preview, the sprite area of the real preview
+    // is invalidated only if "invalidateRealPreview" is true (show()
+    // invalidates the old and new areas in just one notification).
+    void hideInternal(const bool invalidateRealPreview);
+
     doc::BrushRef getCurrentBrush();
     static doc::color_t getBrushColor(doc::Sprite* sprite, doc::Layer* layer);
 
@@ -152,6 +159,17 @@ namespace app {
     TilemapMode m_lastTilemapMode;
 
     ExtraCelRef m_extraCel;
+
+    // Copy of the last real preview (the extra cel image) and its
+    // properties, to avoid re-rendering the sprite area below the
+    // brush when the preview is shown again with the same pixels
+    // (e.g. moving the mouse inside the same sprite pixel with a big
+    // zoom level, or redrawing the preview when the brush didn't
+    // change).
+    doc::ImageRef m_lastPreviewImage;
+    doc::Layer* m_lastPreviewLayer = nullptr;
+    doc::BlendMode m_lastPreviewBlendMode = doc::BlendMode::NORMAL;
+    int m_lastPreviewOpacity = 0;
   };
 
   class HideBrushPreview {
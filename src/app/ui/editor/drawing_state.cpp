@@ -45,6 +45,10 @@ namespace app {
 
 using namespace ui;
 
+// Minimum time between two drawing steps of a freehand-like tool
+// (one display frame).
+static constexpr int kDrawInterval = 16;
+
 static int get_delay_interval_for_tool_loop(tools::ToolLoop* toolLoop)
 {
   if (toolLoop->getTracePolicy() == tools::TracePolicy::Last) {
@@ -71,7 +75,18 @@ DrawingState::DrawingState(Editor* editor,
   , m_mouseMoveReceived(false)
   , m_mousePressedReceived(false)
   , m_processScrollChange(true)
+  , m_drawTimer(kDrawInterval)
+  , m_lastDrawTime(0)
 {
+  m_drawTimer.Tick.connect([this]{
+    try {
+      drawPendingMovements();
+    }
+    catch (const std::exception& ex) {
+      m_editor->showUnhandledException(ex, nullptr);
+    }
+  });
+
   m_beforeCmdConn =
     UIContext::instance()->BeforeCommandExecution.connect(
       &DrawingState::onBeforeCommandExecution, this);
@@ -292,7 +307,35 @@ void DrawingState::onCommitMouseMove(Editor* editor,
   if (m_toolLoop &&
       m_toolLoopManager &&
       !m_toolLoopManager->isCanceled()) {
-    handleMouseMovement();
+    // Tools like line, rectangle, etc. use only the last mouse
+    // position (and they are already delayed with m_delayedMouseMove).
+    if (m_toolLoop->getTracePolicy() == tools::TracePolicy::Last) {
+      handleMouseMovement();
+      return;
+    }
+
+    // Freehand-like tools need all the mouse positions, but we can
+    // add them to the stroke and draw them together once per display
+    // frame (high-rate tablets generate more events than the ones
+    // that can be rendered).
+    m_toolLoopManager->addMovement(m_lastPointer);
+
+    if (base::current_tick() - m_lastDrawTime >= kDrawInterval)
+      drawPendingMovements();
+    else if (!m_drawTimer.isRunning())
+      m_drawTimer.start();
+  }
+}
+
+void DrawingState::drawPendingMovements()
+{
+  if (m_drawTimer.isRunning())
+    m_drawTimer.stop();
+
+  if (m_toolLoopManager &&
+      !m_toolLoopManager->isCanceled()) {
+    m_toolLoopManager->drawPendingMovements();
+    m_lastDrawTime = base::current_tick();
   }
 }
 
@@ -453,6 +496,9 @@ void DrawingState::destroyLoopIfCanceled(Editor* editor)
 
 void DrawingState::destroyLoop(Editor* editor)
 {
+  if (m_drawTimer.isRunning())
+    m_drawTimer.stop();
+
   if (editor)
     editor->renderEngine().removePreviewImage();
 
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -15,6 +15,8 @@
 #include "app/ui/editor/standby_state.h"
 #include "base/time.h"
 #include "obs/connection.h"
+#include "ui/timer.h"
+
 #include <memory>
 
 namespace app {
@@ -72,6 +74,7 @@ namespace app {
 
   private:
     void handleMouseMovement();
+    void drawPendingMovements();
     bool canInterpretMouseMovementAsJustOneClick();
     bool canExecuteCommands();
     void onBeforeCommandExecution(CommandExecutionEvent& ev);
@@ -117,6 +120,13 @@ namespace app {
     // Locks the scroll
     bool m_processScrollChange;
 
+    // Freehand-like tools accumulate the mouse movements in the
+    // ToolLoopManager and draw them once per display frame, this
+    // timer draws the pending movements when no more events are
+    // received.
+    ui::Timer m_drawTimer;
+    base::tick_t m_lastDrawTime;
+
     obs::scoped_connection m_beforeCmdConn;
   };
 
@@ -40,6 +40,7 @@
 #include "app/ui/editor/editor_customization_delegate.h"
 #include "app/ui/editor/editor_decorator.h"
 #include "app/ui/editor/editor_render.h"
+#include "app/ui/editor/editor_tile_cache.h"
 #include "app/ui/editor/glue.h"
 #include "app/ui/editor/moving_pixels_state.h"
 #include "app/ui/editor/pixels_movement.h"
@@ -48,11 +49,13 @@
 #include "app/ui/editor/standby_state.h"
 #include "app/ui/editor/zooming_state.h"
 #include "app/ui/main_window.h"
+#include "app/ui/paint_profiler.h"
 #include "app/ui/skin/skin_theme.h"
 #include "app/ui/status_bar.h"
 #include "app/ui/timeline/timeline.h"
 #include "app/ui/toolbar.h"
 #include "app/ui_context.h"
+#include "app/util/conversion_to_surface.h"
 #include "app/util/layer_utils.h"
 #include "app/util/tile_flags_utils.h"
 #include "base/chrono.h"
@@ -65,12 +68,14 @@
 #include "os/sampling.h"
 #include "os/surface.h"
 #include "os/system.h"
+#include "render/frame_signature.h"
 #include "render/rasterize.h"
 #include "ui/ui.h"
 
 #include <algorithm>
 #include <cmath>
 #include <cstdio>
+#include <cstring>
 #include <limits>
 #include <memory>
 
@@ -151,6 +156,7 @@ Editor::Editor(Doc* document, EditorFlags flags, EditorStatePtr state)
   , m_docPref(Preferences::instance().document(document))
   , m_tiledModeHelper(app::TiledModeHelper(m_docPref.tiled.mode(), m_sprite))
   , m_brushPreview(this)
+  , m_tileCache(EditorTileCache::getForDocument(document))
   , m_toolLoopModifiers(tools::ToolLoopModifiers::kNone)
   , m_padding(0, 0)
   , m_antsTimer(100, this)
@@ -206,7 +212,10 @@ Editor::Editor(Doc* document, EditorFlags flags, EditorStatePtr state)
   m_tiledConn = m_docPref.tiled.AfterChange.connect([this]{ onTiledModeChange(); });
   m_gridConn = m_docPref.grid.AfterChange.connect([this]{ invalidate(); });
   m_pixelGridConn = m_docPref.pixelGrid.AfterChange.connect([this]{ invalidate(); });
-  m_bgConn = m_docPref.bg.AfterChange.connect([this]{ invalidate(); });
+  m_bgConn = m_docPref.bg.AfterChange.connect([this]{
+    m_tileCache->clear();
+    invalidate();
+  });
   m_onionskinConn = m_docPref.onionskin.AfterChange.connect([this]{ invalidate(); });
   m_symmetryModeConn = Preferences::instance().symmetryMode.enabled.AfterChange.connect([this]{ invalidateIfActive(); });
   m_showExtrasConn =
@@ -403,6 +412,13 @@ void Editor::setLayer(const Layer* layer)
   updateStatusBar();
 }
 
+void Editor::setPrerenderedFrame(const frame_t frame,
+                                 const doc::ImageRef& image)
+{
+  m_prerenderedFrame = frame;
+  m_prerenderedImage = image;
+}
+
 void Editor::setFrame(frame_t frame)
 {
   if (m_frame == frame)
@@ -582,17 +598,33 @@ void Editor::updateEditor(const bool restoreScrollPos)
   View::getView(this)->updateView(restoreScrollPos);
 }
 
-void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& spriteRectToDraw, int dx, int dy)
+void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g,
+                                        const gfx::Rect& spriteRectToDraw,
+                                        const std::vector<gfx::Point>& copies)
 {
   // Clip from sprite and apply zoom
   gfx::Rect rc = m_sprite->bounds().createIntersection(spriteRectToDraw);
   rc = m_proj.apply(rc);
 
-  gfx::Rect dest(dx + m_padding.x + rc.x,
-                 dy + m_padding.y + rc.y, 0, 0);
+  gfx::Rect dest(m_padding.x + rc.x,
+                 m_padding.y + rc.y, 0, 0);
+
+  // Clip from graphics/screen. All copies show the same sprite
+  // pixels, so we map the visible area of each copy to the main copy
+  // and render the union of them only once.
+  const gfx::Rect& screenClip = g->getClipBounds();
+  const gfx::Rect mainCopy(m_padding.x, m_padding.y,
+                           m_proj.applyX(m_sprite->width()),
+                           m_proj.applyY(m_sprite->height()));
+  gfx::Rect clip;
+  for (const gfx::Point& copy : copies) {
+    gfx::Rect copyClip = screenClip;
+    copyClip.offset(-copy);
+    clip |= (copyClip & mainCopy);
+  }
+  if (clip.isEmpty())
+    return;
 
-  // Clip from graphics/screen
-  const gfx::Rect& clip = g->getClipBounds();
   if (dest.x < clip.x) {
     rc.x += clip.x - dest.x;
     rc.w -= clip.x - dest.x;
@@ -650,8 +682,8 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
   gfx::Rect rc2;
   if (newEngine) {
     rc2 = expose;               // New engine, exposed rectangle (without zoom)
-    dest.x = dx + m_padding.x + m_proj.applyX(rc2.x);
-    dest.y = dy + m_padding.y + m_proj.applyY(rc2.y);
+    dest.x = m_padding.x + m_proj.applyX(rc2.x);
+    dest.y = m_padding.y + m_proj.applyY(rc2.y);
     dest.w = m_proj.applyX(rc2.w);
     dest.h = m_proj.applyY(rc2.h);
   }
@@ -718,12 +750,14 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
     // sprite on it.)
     if (renderProperties.renderBgOnScreen) {
       m_renderEngine->setProjection(m_proj);
-      m_renderEngine->renderCheckeredBackground(
-        g->getInternalSurface(),
-        m_sprite,
-        gfx::Clip(dest.x + g->getInternalDeltaX(),
-                  dest.y + g->getInternalDeltaY(),
-                  m_proj.apply(rc2)));
+      for (const gfx::Point& copy : copies) {
+        m_renderEngine->renderCheckeredBackground(
+          g->getInternalSurface(),
+          m_sprite,
+          gfx::Clip(dest.x + copy.x + g->getInternalDeltaX(),
+                    dest.y + copy.y + g->getInternalDeltaY(),
+                    m_proj.apply(rc2)));
+      }
     }
 
     // Create a temporary surface to draw the sprite on it
@@ -739,8 +773,34 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
 
     m_renderEngine->setProjection(
       newEngine ? render::Projection(): m_proj);
-    m_renderEngine->renderSprite(
-      rendered.get(), m_sprite, m_frame, gfx::Clip(0, 0, rc2));
+
+    if (canUsePrerenderedFrame(newEngine)) {
+      // Copy the frame rendered in the background (while the
+      // animation is being played)
+      PaintProfiler::ScopedStage stage(PaintProfiler::Stage::SurfaceConversion);
+      convert_image_to_surface(m_prerenderedImage.get(),
+                               m_sprite->palette(m_frame),
+                               rendered.get(),
+                               rc2.x, rc2.y, 0, 0, rc2.w, rc2.h);
+    }
+    else if (canUseTileCache()) {
+      // Copy the cached tiles (rendering only the missing tiles)
+      const gfx::Rect canvasBounds =
+        (newEngine ? m_sprite->bounds(): m_proj.apply(m_sprite->bounds()));
+      m_tileCache->render(
+        rendered.get(), rc2, canvasBounds,
+        newEngine ? render::Projection(): m_proj,
+        tileCacheKey(newEngine),
+        m_document->osColorSpace(),
+        [this](os::Surface* dst, const gfx::Rect& bounds){
+          m_renderEngine->renderSprite(
+            dst, m_sprite, m_frame, gfx::Clip(0, 0, bounds));
+        });
+    }
+    else {
+      m_renderEngine->renderSprite(
+        rendered.get(), m_sprite, m_frame, gfx::Clip(0, 0, rc2));
+    }
 
     m_renderEngine->removeExtraImage();
 
@@ -754,6 +814,7 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
   }
 
   if (rendered && rendered->nativeHandle()) {
+    PaintProfiler::ScopedStage stage(PaintProfiler::Stage::SurfaceConversion);
     os::Paint p;
     if (newEngine) {
       os::Sampling sampling;
@@ -783,30 +844,30 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
       else
         p.blendMode(os::BlendMode::Src);
 
-      g->drawSurface(rendered.get(),
-                     gfx::Rect(0, 0, rc2.w, rc2.h),
-                     dest,
-                     sampling,
-                     &p);
+      for (const gfx::Point& copy : copies) {
+        g->drawSurface(rendered.get(),
+                       gfx::Rect(0, 0, rc2.w, rc2.h),
+                       gfx::Rect(dest).offset(copy),
+                       sampling,
+                       &p);
+      }
     }
     else {
-      g->drawSurface(rendered.get(),
-                     gfx::Rect(0, 0, dest.w, dest.h),
-                     gfx::Rect(dest.x, dest.y, dest.w, dest.h),
-                     os::Sampling(os::Sampling::Filter::Nearest),
-                     &p);
+      for (const gfx::Point& copy : copies) {
+        g->drawSurface(rendered.get(),
+                       gfx::Rect(0, 0, dest.w, dest.h),
+                       gfx::Rect(dest).offset(copy),
+                       os::Sampling(os::Sampling::Filter::Nearest),
+                       &p);
+      }
     }
   }
 
   // Draw grids
-  {
-    gfx::Rect enclosingRect(
-      m_padding.x + dx,
-      m_padding.y + dy,
-      m_proj.applyX(m_sprite->width()),
-      m_proj.applyY(m_sprite->height()));
+  for (const gfx::Point& copy : copies) {
+    const gfx::Rect enclosingRect = gfx::Rect(mainCopy).offset(copy);
 
-    IntersectClip clip(g, dest);
+    IntersectClip clip(g, gfx::Rect(dest).offset(copy));
     if (clip) {
       // Draw the pixel grid
       if ((m_proj.zoom().scale() > 2.0) && m_docPref.show.pixelGrid()) {
@@ -856,6 +917,84 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
   }
 }
 
+bool Editor::canUseTileCache() const
+{
+  return (Preferences::instance().experimental.cacheEditorTiles() &&
+          canUseCachedRender());
+}
+
+bool Editor::canUsePrerenderedFrame(const bool newEngine) const
+{
+  // Prerendered frames are rendered in sprite coordinates, with the
+  // checkered background, the new blend method, and all layers with
+  // its own opacity (see PlaybackPrerender).
+  return (m_prerenderedImage &&
+          m_prerenderedFrame == m_frame &&
+          newEngine &&
+          Preferences::instance().experimental.newBlend() &&
+          otherLayersOpacity() == 255 &&
+          canUseCachedRender());
+}
+
+bool Editor::canUseCachedRender() const
+{
+  // The following elements change in each render (or are rendered
+  // only temporarily), so we render the sprite directly.
+  if (m_renderEngine->properties().renderBgOnScreen ||
+      m_renderEngine->hasPreviewImage())
+    return false;
+
+  if ((m_flags & kShowOnionskin) == kShowOnionskin &&
+      m_docPref.onionskin.active())
+    return false;
+
+  ExtraCelRef extraCel = m_document->extraCel();
+  if (extraCel && extraCel->type() != render::ExtraType::NONE)
+    return false;
+
+  return true;
+}
+
+uint64_t Editor::tileCacheKey(const bool newEngine) const
+{
+  uint64_t key = 0;
+  auto combine = [&key](const uint64_t value){
+    key ^= value + 0x9e3779b97f4a7c15ull + (key << 6) + (key >> 2);
+  };
+  auto combine_double = [&combine](const double value){
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    combine(bits);
+  };
+
+  // Contents of the sprite (versions of layers, images, positions,
+  // etc.). The frame number is not included, so identical frames
+  // (e.g. with linked cels) share the same tiles when the animation
+  // is played.
+  combine(render::calc_frame_signature(m_sprite, m_frame));
+
+  const doc::Palette* palette = m_sprite->palette(m_frame);
+  combine(uint64_t(uintptr_t(palette)));
+  combine(uint64_t(palette->getModifications()));
+
+  // Render settings (the new engine renders in sprite coordinates,
+  // so editors with different zoom levels can share the tiles)
+  if (!newEngine) {
+    combine_double(m_proj.scaleX());
+    combine_double(m_proj.scaleY());
+  }
+  combine(newEngine);
+  combine(uint64_t(m_renderEngine->type()));
+  // The active layer is used only to make other layers transparent
+  if (otherLayersOpacity() < 255) {
+    combine(m_layer ? m_layer->id(): 0);
+    combine(uint64_t(otherLayersOpacity()));
+  }
+  combine(Preferences::instance().experimental.newBlend());
+  combine(uint64_t(uintptr_t(m_document->osColorSpace().get())));
+  return key;
+}
+
 void Editor::drawBackground(ui::Graphics* g)
 {
   if (!(m_flags & kShowOutside))
@@ -896,35 +1035,38 @@ void Editor::drawSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& _rc)
     m_proj.applyY(m_sprite->height()));
   gfx::Rect enclosingRect = spriteRect;
 
-  // Draw the main sprite at the center.
-  drawOneSpriteUnclippedRect(g, rc, 0, 0);
+  // The main sprite at the center and its copies in tiled mode (the
+  // sprite is rendered only once for all of them).
+  std::vector<gfx::Point> copies = { gfx::Point(0, 0) };
 
   // Document preferences
   if (int(m_docPref.tiled.mode()) & int(filters::TiledMode::X_AXIS)) {
-    drawOneSpriteUnclippedRect(g, rc, spriteRect.w, 0);
-    drawOneSpriteUnclippedRect(g, rc, spriteRect.w*2, 0);
+    copies.push_back(gfx::Point(spriteRect.w, 0));
+    copies.push_back(gfx::Point(spriteRect.w*2, 0));
 
     enclosingRect = gfx::Rect(spriteRect.x, spriteRect.y, spriteRect.w*3, spriteRect.h);
   }
 
   if (int(m_docPref.tiled.mode()) & int(filters::TiledMode::Y_AXIS)) {
-    drawOneSpriteUnclippedRect(g, rc, 0, spriteRect.h);
-    drawOneSpriteUnclippedRect(g, rc, 0, spriteRect.h*2);
+    copies.push_back(gfx::Point(0, spriteRect.h));
+    copies.push_back(gfx::Point(0, spriteRect.h*2));
 
     enclosingRect = gfx::Rect(spriteRect.x, spriteRect.y, spriteRect.w, spriteRect.h*3);
   }
 
   if (m_docPref.tiled.mode() == filters::TiledMode::BOTH) {
-    drawOneSpriteUnclippedRect(g, rc, spriteRect.w,   spriteRect.h);
-    drawOneSpriteUnclippedRect(g, rc, spriteRect.w*2, spriteRect.h);
-    drawOneSpriteUnclippedRect(g, rc, spriteRect.w,   spriteRect.h*2);
-    drawOneSpriteUnclippedRect(g, rc, spriteRect.w*2, spriteRect.h*2);
+    copies.push_back(gfx::Point(spriteRect.w,   spriteRect.h));
+    copies.push_back(gfx::Point(spriteRect.w*2, spriteRect.h));
+    copies.push_back(gfx::Point(spriteRect.w,   spriteRect.h*2));
+    copies.push_back(gfx::Point(spriteRect.w*2, spriteRect.h*2));
 
     enclosingRect = gfx::Rect(
       spriteRect.x, spriteRect.y,
       spriteRect.w*3, spriteRect.h*3);
   }
 
+  drawOneSpriteUnclippedRect(g, rc, copies);
+
   // Draw slices
   if (m_docPref.show.slices())
     drawSlices(g);
@@ -1029,7 +1171,22 @@ void Editor::drawMask(Graphics* g)
 
   // Create the mask boundaries path
   auto& segs = m_document->maskBoundaries();
-  segs.createPathIfNeeeded();
+  if (m_maskPathVersion != segs.version() ||
+      m_maskPathScaleX != m_proj.scaleX() ||
+      m_maskPathScaleY != m_proj.scaleY() ||
+      m_maskPathOffset != pt) {
+    segs.createPathIfNeeeded();
+
+    // We translate the path instead of applying a matrix to the
+    // ui::Graphics so the "checkered" pattern is not scaled too.
+    segs.path().transform(m_proj.scaleMatrix(), &m_maskPath);
+    m_maskPath.offset(pt.x, pt.y);
+
+    m_maskPathVersion = segs.version();
+    m_maskPathScaleX = m_proj.scaleX();
+    m_maskPathScaleY = m_proj.scaleY();
+    m_maskPathOffset = pt;
+  }
 
   ui::Paint paint;
   paint.style(ui::Paint::Stroke);
@@ -1037,12 +1194,7 @@ void Editor::drawMask(Graphics* g)
                            gfx::rgba(0, 0, 0, 255),
                            gfx::rgba(255, 255, 255, 255));
 
-  // We translate the path instead of applying a matrix to the
-  // ui::Graphics so the "checkered" pattern is not scaled too.
-  gfx::Path path;
-  segs.path().transform(m_proj.scaleMatrix(), &path);
-  path.offset(pt.x, pt.y);
-  g->drawPath(path, paint);
+  g->drawPath(m_maskPath, paint);
 }
 
 void Editor::drawMaskSafe()
@@ -2240,6 +2392,8 @@ void Editor::onResize(ui::ResizeEvent& ev)
 
 void Editor::onPaint(ui::PaintEvent& ev)
 {
+  PaintProfiler::ScopedPaint profile(PaintProfiler::Source::Editor);
+
   std::unique_ptr<HideBrushPreview> hide;
   if (m_flashing == Flashing::None) {
     // If we are drawing the editor for a tooltip background or any
@@ -2272,7 +2426,10 @@ void Editor::onPaint(ui::PaintEvent& ev)
 
       // Draw the sprite in the editor
       renderChrono.reset();
-      drawBackground(g);
+      {
+        PaintProfiler::ScopedStage stage(PaintProfiler::Stage::Background);
+        drawBackground(g);
+      }
       drawSpriteUnclippedRect(g, gfx::Rect(0, 0, m_sprite->width(), m_sprite->height()));
       renderElapsed = renderChrono.elapsed();
 
@@ -2388,6 +2545,7 @@ void Editor::onColorSpaceChanged(DocEvent& ev)
 {
   // As the document has a new color space, we've to redraw the
   // complete canvas again with the new color profile.
+  m_tileCache->clear();
   invalidate();
 }
 
@@ -26,9 +26,12 @@
 #include "doc/algorithm/flip_type.h"
 #include "doc/frame.h"
 #include "doc/image_buffer.h"
+#include "doc/image_ref.h"
 #include "doc/selected_objects.h"
 #include "filters/tiled_mode.h"
 #include "gfx/fwd.h"
+#include "gfx/path.h"
+#include "gfx/point.h"
 #include "obs/connection.h"
 #include "os/color_space.h"
 #include "render/projection.h"
@@ -39,8 +42,10 @@
 #include "ui/timer.h"
 #include "ui/widget.h"
 
+#include <cstdint>
 #include <memory>
 #include <set>
+#include <vector>
 
 namespace doc {
   class Layer;
@@ -60,6 +65,7 @@ namespace app {
   class DocView;
   class EditorCustomizationDelegate;
   class EditorRender;
+  class EditorTileCache;
   class PixelsMovement;
   class Site;
   class Transformation;
@@ -158,6 +164,13 @@ namespace app {
     void setLayer(const Layer* layer);
     void setFrame(frame_t frame);
 
+    // Sets an image with the given frame already rendered (with the
+    // checkered background) to be used instead of rendering the
+    // sprite (e.g. PlayState sets the frames rendered by
+    // PlaybackPrerender). Use a nullptr image to remove it.
+    void setPrerenderedFrame(const frame_t frame,
+                             const doc::ImageRef& image);
+
     const render::Projection& projection() const { return m_proj; }
     const render::Zoom& zoom() const { return m_proj.zoom(); }
     const gfx::Point& padding() const { return m_padding; }
@@ -391,10 +404,27 @@ namespace app {
 
     void setCursor(const gfx::Point& mouseDisplayPos);
 
-    // Draws the specified portion of sprite in the editor.  Warning:
-    // You should setup the clip of the screen before calling this
-    // routine.
-    void drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& rc, int dx, int dy);
+    // Draws the specified portion of sprite in the editor, in each
+    // given offset (copies of the sprite in tiled mode). The sprite
+    // is rendered only once for all copies. Warning: You should setup
+    // the clip of the screen before calling this routine.
+    void drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& rc,
+                                    const std::vector<gfx::Point>& copies);
+
+    // Returns true if the sprite can be rendered from/to the
+    // m_tileCache, and the key of the cache for the current render
+    // settings.
+    bool canUseTileCache() const;
+    uint64_t tileCacheKey(const bool newEngine) const;
+
+    // Returns true if the current frame can be copied from
+    // m_prerenderedImage.
+    bool canUsePrerenderedFrame(const bool newEngine) const;
+
+    // Returns true if there is nothing temporary in the render (onion
+    // skin, preview image, extra cel, etc.), i.e. if the sprite
+    // pixels can be copied from a cached/prerendered image.
+    bool canUseCachedRender() const;
 
     gfx::Point calcExtraPadding(const render::Projection& proj);
 
@@ -427,6 +457,15 @@ namespace app {
     // Brush preview
     BrushPreview m_brushPreview;
 
+    // Cache of rendered tiles of the sprite (to scroll the editor
+    // without rendering the sprite again), shared by all editors of
+    // the document.
+    std::shared_ptr<EditorTileCache> m_tileCache;
+
+    // Frame rendered in the background (see setPrerenderedFrame())
+    frame_t m_prerenderedFrame = -1;
+    doc::ImageRef m_prerenderedImage;
+
     tools::ToolLoopModifiers m_toolLoopModifiers;
 
     // Extra space around the sprite.
@@ -436,6 +475,15 @@ namespace app {
     ui::Timer m_antsTimer;
     int m_antsOffset;
 
+    // Mask boundaries path in screen coordinates, cached for the
+    // given boundaries version, scale, and offset, so we don't need
+    // to transform the path in each tick of the marching ants.
+    gfx::Path m_maskPath;
+    uint32_t m_maskPathVersion = 0;
+    double m_maskPathScaleX = 0.0;
+    double m_maskPathScaleY = 0.0;
+    gfx::Point m_maskPathOffset;
+
     obs::scoped_connection m_samplingChangeConn;
     obs::scoped_connection m_fgColorChangeConn;
     obs::scoped_connection m_contextBarBrushChangeConn;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -52,6 +52,7 @@ void EditorRender::setType(const Type type)
   {
     m_renderer = std::make_unique<SimpleRenderer>();
   }
+  m_hasPreviewImage = false;
 
   m_renderer->setNewBlendMethod(
     Preferences::instance().experimental.newBlend());
@@ -78,6 +79,13 @@ void EditorRender::setProjection(const render::Projection& projection)
 }
 
 void EditorRender::setupBackground(Doc* doc, doc::PixelFormat pixelFormat)
+{
+  m_renderer->setBgOptions(getBackgroundOptions(doc, pixelFormat));
+}
+
+// static
+render::BgOptions EditorRender::getBackgroundOptions(Doc* doc,
+                                                     doc::PixelFormat pixelFormat)
 {
   DocumentPreferences& docPref = Preferences::instance().document(doc);
   render::BgType bgType;
@@ -120,7 +128,7 @@ void EditorRender::setupBackground(Doc* doc, doc::PixelFormat pixelFormat)
   bg.color1 = color_utils::color_for_image_without_alpha(docPref.bg.color1(), pixelFormat);
   bg.color2 = color_utils::color_for_image_without_alpha(docPref.bg.color2(), pixelFormat);
   bg.stripeSize = tile;
-  m_renderer->setBgOptions(bg);
+  return bg;
 }
 
 void EditorRender::setTransparentBackground()
@@ -142,11 +150,13 @@ void EditorRender::setPreviewImage(const doc::Layer* layer,
 {
   m_renderer->setPreviewImage(layer, frame, image, tileset,
                               pos, blendMode);
+  m_hasPreviewImage = true;
 }
 
 void EditorRender::removePreviewImage()
 {
   m_renderer->removePreviewImage();
+  m_hasPreviewImage = false;
 }
 
 void EditorRender::setExtraImage(
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -17,6 +17,7 @@
 #include "doc/pixel_format.h"
 #include "gfx/clip.h"
 #include "gfx/point.h"
+#include "render/bg_options.h"
 #include "render/extra_type.h"
 #include "render/onionskin_options.h"
 #include "render/projection.h"
@@ -61,6 +62,8 @@ namespace app {
     void setProjection(const render::Projection& projection);
 
     void setupBackground(Doc* doc, doc::PixelFormat pixelFormat);
+    static render::BgOptions getBackgroundOptions(Doc* doc,
+                                                  doc::PixelFormat pixelFormat);
     void setTransparentBackground();
 
     void setSelectedLayer(const doc::Layer* layer);
@@ -72,6 +75,7 @@ namespace app {
                          const gfx::Point& pos,
                          const doc::BlendMode blendMode);
     void removePreviewImage();
+    bool hasPreviewImage() const { return m_hasPreviewImage; }
 
     void setExtraImage(
       render::ExtraType type,
@@ -107,6 +111,7 @@ namespace app {
 
   private:
     std::unique_ptr<Renderer> m_renderer;
+    bool m_hasPreviewImage = false;
   };
 
 } // namespace app
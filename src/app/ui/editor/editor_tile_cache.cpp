@@ -0,0 +1,167 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/ui/editor/editor_tile_cache.h"
+
+#include "app/doc.h"
+#include "app/doc_event.h"
+#include "os/system.h"
+
+#include <algorithm>
+
+namespace app {
+
+namespace {
+
+// Caches of the documents that have editors (the editors keep the
+// cache alive)
+std::map<Doc*, std::weak_ptr<EditorTileCache>> g_caches;
+
+// Division rounding to negative infinity
+int floor_div(const int a, const int b)
+{
+  return (a >= 0 ? a / b: -((-a + b - 1) / b));
+}
+
+} // anonymous namespace
+
+EditorTileCache::EditorTileCache(Doc* doc)
+  : m_doc(doc)
+{
+  m_doc->add_observer(this);
+}
+
+EditorTileCache::~EditorTileCache()
+{
+  m_doc->remove_observer(this);
+}
+
+// static
+std::shared_ptr<EditorTileCache> EditorTileCache::getForDocument(Doc* doc)
+{
+  // Remove caches of closed documents
+  for (auto it=g_caches.begin(); it!=g_caches.end(); ) {
+    if (it->second.expired())
+      it = g_caches.erase(it);
+    else
+      ++it;
+  }
+
+  std::shared_ptr<EditorTileCache> cache = g_caches[doc].lock();
+  if (!cache) {
+    cache = std::make_shared<EditorTileCache>(doc);
+    g_caches[doc] = cache;
+  }
+  return cache;
+}
+
+void EditorTileCache::render(os::Surface* dst,
+                             const gfx::Rect& area,
+                             const gfx::Rect& canvasBounds,
+                             const render::Projection& proj,
+                             const uint64_t key,
+                             const os::ColorSpaceRef& colorSpace,
+                             const RenderFunc& renderFunc)
+{
+  const int col1 = floor_div(area.x, kTileSize);
+  const int row1 = floor_div(area.y, kTileSize);
+  const int col2 = floor_div(area.x2()-1, kTileSize);
+  const int row2 = floor_div(area.y2()-1, kTileSize);
+
+  for (int row=row1; row<=row2; ++row) {
+    for (int col=col1; col<=col2; ++col) {
+      const Tile& tile = getTile(TileIndex(key, col, row), canvasBounds,
+                                 proj, colorSpace, renderFunc);
+      const gfx::Rect rc = (area & tile.bounds);
+      if (rc.isEmpty() || !tile.surface)
+        continue;
+
+      tile.surface->blitTo(dst,
+                           rc.x - tile.bounds.x,
+                           rc.y - tile.bounds.y,
+                           rc.x - area.x,
+                           rc.y - area.y,
+                           rc.w, rc.h);
+    }
+  }
+}
+
+void EditorTileCache::invalidate(const gfx::Rect& spriteBounds)
+{
+  for (auto it=m_tiles.begin(); it!=m_tiles.end(); ) {
+    // Add one extra pixel to include partially covered pixels of
+    // zoomed out tiles
+    gfx::Rect bounds = it->second.proj.apply(spriteBounds);
+    bounds.enlarge(1);
+
+    if (it->second.bounds.intersects(bounds))
+      it = m_tiles.erase(it);
+    else
+      ++it;
+  }
+}
+
+void EditorTileCache::clear()
+{
+  m_tiles.clear();
+}
+
+void EditorTileCache::onSpritePixelsModified(DocEvent& ev)
+{
+  // This observer is registered before the DocViews of the
+  // document, so tiles are discarded just once before the editors
+  // are redrawn.
+  for (const gfx::Rect& rc : ev.region())
+    invalidate(rc);
+}
+
+EditorTileCache::Tile& EditorTileCache::getTile(const TileIndex& index,
+                                                const gfx::Rect& canvasBounds,
+                                                const render::Projection& proj,
+                                                const os::ColorSpaceRef& colorSpace,
+                                                const RenderFunc& renderFunc)
+{
+  ++m_useCounter;
+
+  auto it = m_tiles.find(index);
+  if (it != m_tiles.end()) {
+    it->second.lastUse = m_useCounter;
+    return it->second;
+  }
+
+  if (int(m_tiles.size()) >= kMaxTiles)
+    removeLeastRecentlyUsedTile();
+
+  Tile& tile = m_tiles[index];
+  tile.lastUse = m_useCounter;
+  tile.proj = proj;
+  tile.bounds = gfx::Rect(std::get<1>(index) * kTileSize,
+                          std::get<2>(index) * kTileSize,
+                          kTileSize, kTileSize) & canvasBounds;
+  if (!tile.bounds.isEmpty()) {
+    tile.surface = os::instance()->makeRgbaSurface(
+      tile.bounds.w, tile.bounds.h, colorSpace);
+    renderFunc(tile.surface.get(), tile.bounds);
+  }
+  return tile;
+}
+
+void EditorTileCache::removeLeastRecentlyUsedTile()
+{
+  auto it = std::min_element(
+    m_tiles.begin(), m_tiles.end(),
+    [](const auto& a, const auto& b){
+      return a.second.lastUse < b.second.lastUse;
+    });
+  if (it != m_tiles.end())
+    m_tiles.erase(it);
+}
+
+} // namespace app
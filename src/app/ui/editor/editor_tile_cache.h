@@ -0,0 +1,106 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_UI_EDITOR_EDITOR_TILE_CACHE_H_INCLUDED
+#define APP_UI_EDITOR_EDITOR_TILE_CACHE_H_INCLUDED
+#pragma once
+
+#include "app/doc_observer.h"
+#include "gfx/rect.h"
+#include "os/color_space.h"
+#include "os/surface.h"
+#include "render/projection.h"
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <tuple>
+
+namespace app {
+  class Doc;
+
+  // Keeps the rendered sprite pixels of the editors of a document in
+  // tiles of kTileSize x kTileSize pixels (in the coordinates of the
+  // rendered surface, i.e. with the zoom applied in the old render
+  // engine, or in sprite coordinates in the new engine), so
+  // scrolling or exposing parts of the editor that were already
+  // rendered only copies cached tiles.
+  //
+  // The cache is shared by all editors of the same document (see
+  // getForDocument()): with the new render engine the tiles are in
+  // sprite space, so editors with different zoom levels (e.g. a
+  // duplicated view and the preview window) use the same tiles.
+  //
+  // Each tile is identified by a key (a hash of everything that
+  // affects the render: contents signature of the frame, render
+  // settings, etc.) and its position, and the tiles are discarded
+  // for the dirty regions of the document (onSpritePixelsModified()).
+  class EditorTileCache : public DocObserver {
+  public:
+    static constexpr int kTileSize = 256;
+    static constexpr int kMaxTiles = 192;
+
+    // Must render the given bounds (in render coordinates) in the
+    // given surface (at 0,0).
+    using RenderFunc = std::function<void(os::Surface* dst,
+                                          const gfx::Rect& bounds)>;
+
+    EditorTileCache(Doc* doc);
+    ~EditorTileCache();
+
+    // Returns the cache shared by all editors of the given document.
+    static std::shared_ptr<EditorTileCache> getForDocument(Doc* doc);
+
+    // Copies the "area" (in render coordinates, i.e. the sprite
+    // coordinates with "proj" applied) to "dst" (at 0,0) from the
+    // cached tiles with the given key, rendering the tiles that are
+    // not in the cache (clipped to "canvasBounds") with renderFunc().
+    void render(os::Surface* dst,
+                const gfx::Rect& area,
+                const gfx::Rect& canvasBounds,
+                const render::Projection& proj,
+                const uint64_t key,
+                const os::ColorSpaceRef& colorSpace,
+                const RenderFunc& renderFunc);
+
+    // Discards the tiles that intersect the given bounds (in sprite
+    // coordinates).
+    void invalidate(const gfx::Rect& spriteBounds);
+
+    void clear();
+
+    bool isEmpty() const { return m_tiles.empty(); }
+
+  private:
+    // DocObserver impl
+    void onSpritePixelsModified(DocEvent& ev) override;
+
+    struct Tile {
+      os::SurfaceRef surface;
+      gfx::Rect bounds;         // Rendered bounds (in render coordinates)
+      render::Projection proj;  // Projection of the render coordinates
+      uint32_t lastUse = 0;
+    };
+
+    // Tiles by (key, column, row) in the grid of kTileSize tiles
+    using TileIndex = std::tuple<uint64_t, int, int>;
+
+    Tile& getTile(const TileIndex& index,
+                  const gfx::Rect& canvasBounds,
+                  const render::Projection& proj,
+                  const os::ColorSpaceRef& colorSpace,
+                  const RenderFunc& renderFunc);
+    void removeLeastRecentlyUsedTile();
+
+    Doc* m_doc;
+    std::map<TileIndex, Tile> m_tiles;
+    uint32_t m_useCounter = 0;
+  };
+
+} // namespace app
+
+#endif
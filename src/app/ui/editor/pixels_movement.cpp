@@ -143,6 +143,7 @@ PixelsMovement::PixelsMovement(
   m_initialMask.reset(new Mask(*mask));
   m_initialMask0.reset(new Mask(*mask));
   m_currentMask.reset(new Mask(*mask));
+  m_currentMask->setBuffer(m_currentMaskBuffer);
 
   m_pivotVisConn =
     Preferences::instance().selection.pivotVisibility.AfterChange.connect(
@@ -17,6 +17,7 @@
 #include "app/ui/editor/handle_type.h"
 #include "doc/algorithm/flip_type.h"
 #include "doc/frame.h"
+#include "doc/image_buffer.h"
 #include "doc/image_ref.h"
 #include "gfx/size.h"
 #include "obs/connection.h"
@@ -179,6 +180,10 @@ namespace app {
     Transformation m_currentData;
     std::unique_ptr<Mask> m_initialMask, m_initialMask0;
     std::unique_ptr<Mask> m_currentMask;
+    // Scratch buffer reused to re-create the m_currentMask bitmap on
+    // each redrawCurrentMask().
+    doc::ImageBufferPtr m_currentMaskBuffer =
+      std::make_shared<doc::ImageBuffer>();
     bool m_opaque;
     color_t m_maskColor;
     obs::scoped_connection m_pivotVisConn;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2023  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -18,6 +18,8 @@
 #include "app/tools/ink.h"
 #include "app/ui/editor/editor.h"
 #include "app/ui/editor/editor_customization_delegate.h"
+#include "app/ui/editor/editor_render.h"
+#include "app/ui/editor/playback_prerender.h"
 #include "app/ui/editor/scrolling_state.h"
 #include "app/ui/skin/skin_theme.h"
 #include "app/ui_context.h"
@@ -51,6 +53,13 @@ PlayState::PlayState(const bool playOnce,
     &PlayState::onBeforeCommandExecution, this);
 }
 
+PlayState::~PlayState()
+{
+  // Just in case, the background thread is stopped here (the
+  // PlaybackPrerender dtor waits the thread).
+  m_prerender.reset();
+}
+
 Tag* PlayState::playingTag() const
 {
   return m_tag;
@@ -106,14 +115,19 @@ void PlayState::onEnterState(Editor* editor)
   // with ping-pong direction: the direction was reset every time
   // the user released the mouse button after scrolling the editor).
   if (!m_playTimer.isRunning()) {
-    m_playback = doc::Playback(
-      m_editor->sprite(),
-      m_playSubtags ? m_editor->sprite()->tags().getInternalList() : TagsList(),
-      m_editor->frame(),
-      m_playOnce ? doc::Playback::PlayOnce :
-      m_playAll  ? doc::Playback::PlayWithoutTagsInLoop :
-                  doc::Playback::PlayInLoop,
-      m_tag);
+    auto createPlayback = [this]{
+      return doc::Playback(
+        m_editor->sprite(),
+        m_playSubtags ? m_editor->sprite()->tags().getInternalList() : TagsList(),
+        m_editor->frame(),
+        m_playOnce ? doc::Playback::PlayOnce :
+        m_playAll  ? doc::Playback::PlayWithoutTagsInLoop :
+                    doc::Playback::PlayInLoop,
+        m_tag);
+    };
+    m_playback = createPlayback();
+    m_lookahead = createPlayback();
+    startPrerender();
     m_nextFrameTime = getNextFrameTime();
     m_curFrameTick = base::current_tick();
     m_playTimer.start();
@@ -126,6 +140,7 @@ EditorState::LeaveAction PlayState::onLeaveState(Editor* editor, EditorState* ne
   // (we keep playing the animation).
   if (!m_toScroll) {
     m_playTimer.stop();
+    stopPrerender();
 
     if (m_playOnce || Preferences::instance().general.rewindOnStop())
       m_editor->setFrame(m_refFrame);
@@ -210,6 +225,7 @@ void PlayState::onRemoveTag(Editor* editor, doc::Tag* tag)
     m_tag = nullptr;
 
   m_playback.removeReferencesToTag(tag);
+  m_lookahead.removeReferencesToTag(tag);
 }
 
 void PlayState::onPlaybackTick()
@@ -231,6 +247,21 @@ void PlayState::onPlaybackTick()
       m_editor->stop();
       break;
     }
+
+    if (m_prerender) {
+      bool missed;
+      doc::ImageRef image = m_prerender->take(frame, missed);
+      if (missed) {
+        // The look-ahead playback doesn't follow the animation
+        // anymore, we just render each frame as usual.
+        stopPrerender();
+      }
+      else {
+        m_editor->setPrerenderedFrame(frame, image);
+        fillPrerenderQueue();
+      }
+    }
+
     m_editor->setFrame(frame);
     m_nextFrameTime += getNextFrameTime();
   }
@@ -268,6 +299,35 @@ void PlayState::onBeforeCommandExecution(CommandExecutionEvent& ev)
   m_editor->stop();
 }
 
+void PlayState::startPrerender()
+{
+  m_prerender.reset();
+  if (!Preferences::instance().experimental.prerenderPlayback())
+    return;
+
+  Doc* document = m_editor->document();
+  m_prerender = std::make_unique<PlaybackPrerender>(
+    document, EditorRender::getBackgroundOptions(document, doc::IMAGE_RGB));
+  fillPrerenderQueue();
+}
+
+void PlayState::stopPrerender()
+{
+  m_prerender.reset();
+  m_editor->setPrerenderedFrame(-1, nullptr);
+}
+
+void PlayState::fillPrerenderQueue()
+{
+  while (!m_prerender->isFull()) {
+    const doc::frame_t frame = m_lookahead.nextFrame();
+    if (m_lookahead.isStopped() ||
+        frame < 0 || frame > m_editor->sprite()->lastFrame())
+      break;
+    m_prerender->enqueue(frame);
+  }
+}
+
 double PlayState::getNextFrameTime()
 {
   return
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2022  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -16,6 +16,8 @@
 #include "obs/connection.h"
 #include "ui/timer.h"
 
+#include <memory>
+
 namespace doc {
   class Tag;
 }
@@ -23,12 +25,14 @@ namespace doc {
 namespace app {
 
   class CommandExecutionEvent;
+  class PlaybackPrerender;
 
   class PlayState : public StateWithWheelBehavior {
   public:
     PlayState(const bool playOnce,
               const bool playAll,
               const bool playSubtags);
+    ~PlayState();
 
     doc::Tag* playingTag() const;
 
@@ -51,8 +55,18 @@ namespace app {
 
     double getNextFrameTime();
 
+    void startPrerender();
+    void stopPrerender();
+    void fillPrerenderQueue();
+
     Editor* m_editor;
     doc::Playback m_playback;
+
+    // Optional pre-render of the next frames in a background thread
+    // (experimental.prerender_playback option). m_lookahead is a
+    // copy of m_playback that goes ahead to know the next frames.
+    doc::Playback m_lookahead;
+    std::unique_ptr<PlaybackPrerender> m_prerender;
     bool m_playOnce;
     bool m_playAll;
     bool m_playSubtags;
@@ -0,0 +1,148 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/ui/editor/playback_prerender.h"
+
+#include "app/doc_frame_snapshot.h"
+#include "doc/image.h"
+#include "render/render.h"
+
+#include <algorithm>
+
+namespace app {
+
+// Milliseconds to wait for a read lock of the document to capture a
+// frame from the background thread.
+static constexpr int kCaptureTimeout = 250;
+
+PlaybackPrerender::PlaybackPrerender(Doc* doc, const render::BgOptions& bg)
+  : m_doc(doc)
+  , m_bg(bg)
+  , m_thread([this]{ backgroundThread(); })
+{
+}
+
+PlaybackPrerender::~PlaybackPrerender()
+{
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done = true;
+    m_cv.notify_one();
+  }
+  m_thread.join();
+}
+
+bool PlaybackPrerender::isFull() const
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  return (int(m_items.size()) >= kMaxFrames);
+}
+
+void PlaybackPrerender::enqueue(const doc::frame_t frame)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_items.push_back(Item{ m_nextId++, frame });
+  m_cv.notify_one();
+}
+
+doc::ImageRef PlaybackPrerender::take(const doc::frame_t frame, bool& missed)
+{
+  std::unique_ptr<DocFrameSnapshot> snapshot;
+  doc::ImageRef image;
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    missed = (m_items.empty() || m_items.front().frame != frame);
+    if (missed)
+      return nullptr;
+
+    Item& item = m_items.front();
+    if (item.ready) {
+      image = std::move(item.image);
+      snapshot = std::move(item.snapshot);
+    }
+    // If the frame is being rendered right now, its result will be
+    // discarded by the background thread (the item id is not found).
+    m_items.pop_front();
+    m_cv.notify_one();
+  }
+
+  if (!image || !snapshot || snapshot->isStale())
+    return nullptr;
+
+  return image;
+}
+
+void PlaybackPrerender::backgroundThread()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_done) {
+    auto it = std::find_if(m_items.begin(), m_items.end(),
+                           [](const Item& item){ return !item.ready; });
+    if (it == m_items.end()) {
+      m_cv.wait(lock);
+      continue;
+    }
+
+    const uint32_t id = it->id;
+    const doc::frame_t frame = it->frame;
+    doc::ImageRef image;
+    std::unique_ptr<DocFrameSnapshot> snapshot;
+
+    lock.unlock();
+    renderItem(frame, image, snapshot);
+    lock.lock();
+
+    // The item could be removed by take() in the meantime
+    it = std::find_if(m_items.begin(), m_items.end(),
+                      [id](const Item& item){ return item.id == id; });
+    if (it != m_items.end()) {
+      it->ready = true;
+      it->image = std::move(image);
+      it->snapshot = std::move(snapshot);
+    }
+  }
+}
+
+// Executed in the background thread without locking m_mutex
+void PlaybackPrerender::renderItem(const doc::frame_t frame,
+                                   doc::ImageRef& image,
+                                   std::unique_ptr<DocFrameSnapshot>& snapshot)
+{
+  snapshot = DocFrameSnapshot::capture(m_doc, frame, kCaptureTimeout);
+
+  // Frames that cannot be rendered exactly from a snapshot (e.g. with
+  // tilemaps) are left empty so they are rendered by the editor.
+  if (!snapshot || !snapshot->isComplete())
+    return;
+
+  // Consecutive frames with the same contents (e.g. frames that
+  // hold linked cels) share the same rendered image (if the document
+  // wasn't modified since the last render).
+  if (m_lastImage &&
+      m_lastEpoch == snapshot->epoch() &&
+      m_lastSignature == snapshot->signature()) {
+    image = m_lastImage;
+    return;
+  }
+
+  const doc::ImageSpec& spec = snapshot->spec();
+  image.reset(doc::Image::create(doc::IMAGE_RGB, spec.width(), spec.height()));
+
+  render::Render render;
+  render.setBgOptions(m_bg);
+  render.renderCheckeredBackground(image.get(), gfx::Clip(image->bounds()));
+  snapshot->renderOver(image.get());
+
+  m_lastImage = image;
+  m_lastEpoch = snapshot->epoch();
+  m_lastSignature = snapshot->signature();
+}
+
+} // namespace app
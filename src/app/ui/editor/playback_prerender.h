@@ -0,0 +1,85 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_UI_EDITOR_PLAYBACK_PRERENDER_H_INCLUDED
+#define APP_UI_EDITOR_PLAYBACK_PRERENDER_H_INCLUDED
+#pragma once
+
+#include "doc/frame.h"
+#include "doc/image_ref.h"
+#include "render/bg_options.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace app {
+  class Doc;
+  class DocFrameSnapshot;
+
+  // Renders the next frames of an animation in a background thread
+  // while it's being played in the editor (see PlayState). Frames
+  // are queued in the same order they will be played (e.g. using a
+  // second doc::Playback that goes ahead of the played one), and
+  // each frame is rendered (from a DocFrameSnapshot) in a RGB image
+  // of the sprite size with the checkered background, so the editor
+  // just has to copy it to the screen.
+  class PlaybackPrerender {
+  public:
+    // Maximum number of queued frames
+    static constexpr int kMaxFrames = 8;
+
+    PlaybackPrerender(Doc* doc, const render::BgOptions& bg);
+    ~PlaybackPrerender();
+
+    bool isFull() const;
+    void enqueue(const doc::frame_t frame);
+
+    // Returns the rendered image of the given frame if it's the
+    // first queued frame and it's ready and up to date (the document
+    // wasn't modified after the frame was captured). The frame is
+    // removed from the queue anyway. Returns nullptr if the frame
+    // must be rendered as usual.
+    //
+    // "missed" is set to true if the given frame wasn't the first
+    // one in the queue (i.e. the queued frames don't follow the
+    // played frames anymore).
+    doc::ImageRef take(const doc::frame_t frame, bool& missed);
+
+  private:
+    struct Item {
+      uint32_t id;
+      doc::frame_t frame;
+      bool ready = false;
+      doc::ImageRef image;
+      std::unique_ptr<DocFrameSnapshot> snapshot;
+    };
+
+    void backgroundThread();
+    void renderItem(const doc::frame_t frame,
+                    doc::ImageRef& image,
+                    std::unique_ptr<DocFrameSnapshot>& snapshot);
+
+    Doc* m_doc;
+    render::BgOptions m_bg;
+    uint32_t m_nextId = 0;
+    bool m_done = false;
+    std::deque<Item> m_items;
+    // Last rendered image (only used from the background thread)
+    doc::ImageRef m_lastImage;
+    uint32_t m_lastEpoch = 0;
+    uint64_t m_lastSignature = 0;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::thread m_thread;
+  };
+
+} // namespace app
+
+#endif
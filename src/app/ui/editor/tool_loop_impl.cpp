@@ -236,13 +236,18 @@ public:
         site.tilemapMode(TilemapMode::Pixels);
     }
 
-#ifdef ENABLE_UI // TODO add dynamics support when UI is not enabled
     if (m_controller->isFreehand() &&
-        !m_pointShape->isFloodFill() &&
-        App::instance()->contextBar()) {
-      m_dynamics = App::instance()->contextBar()->getDynamics();
-    }
+        !m_pointShape->isFloodFill()) {
+      // Dynamics specified in the params (e.g. to replay a stroke)
+      if (params.dynamics.isDynamic()) {
+        m_dynamics = params.dynamics;
+      }
+#ifdef ENABLE_UI
+      else if (App::instance()->contextBar()) {
+        m_dynamics = App::instance()->contextBar()->getDynamics();
+      }
 #endif
+    }
 
     if (m_tracePolicy == tools::TracePolicy::Accumulate) {
       tools::ToolBox* toolbox = App::instance()->toolBox();
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -41,6 +41,7 @@ FileList::FileList()
   , m_generateThumbnailTimer(200, this)
   , m_monitoringTimer(50, this)
   , m_itemToGenerateThumbnail(nullptr)
+  , m_waitingChildren(false)
   , m_multiselect(false)
   , m_zoom(1.0)
   , m_itemsPerRow(0)
@@ -83,15 +84,18 @@ void FileList::setCurrentFolder(IFileItem* folder)
   m_req_valid = false;
   m_selected = nullptr;
 
+  // If the folder must be read, it's read in background and the list
+  // is filled in onMonitoringTick() (so slow folders don't block the
+  // UI)
+  m_waitingChildren = !folder->prefetchChildren();
   regenerateList();
 
   // As now we are in other folder, we can stop the generation of all
   // thumbnails.
   ThumbnailGenerator::instance()->stopAllWorkers();
 
-  // select first folder
-  if (!m_list.empty() && m_list.front()->isBrowsable())
-    selectIndex(0);
+  if (!m_waitingChildren)
+    selectInitialItem();
 
   // Emit "CurrentFolderChanged" event.
   onCurrentFolderChanged();
@@ -661,6 +665,17 @@ void FileList::onCurrentFolderChanged()
 
 void FileList::onMonitoringTick()
 {
+  // Fill the list when the children of the current folder are ready
+  if (m_waitingChildren && m_currentFolder->prefetchChildren()) {
+    m_waitingChildren = false;
+    m_req_valid = false;
+    regenerateList();
+    selectInitialItem();
+
+    invalidate();
+    View::getView(this)->updateView();
+  }
+
   auto start = base::current_tick();
   while (!m_generateThumbnailsForTheseItems.empty() &&
          // No more than 200ms launching thumbnail generators
@@ -848,8 +863,12 @@ void FileList::makeSelectedFileitemVisible()
 
 void FileList::regenerateList()
 {
-  // get the children of the current folder
-  m_list = m_currentFolder->children();
+  // get the children of the current folder (the list is empty while
+  // they are being read)
+  if (m_waitingChildren)
+    m_list.clear();
+  else
+    m_list = m_currentFolder->children();
 
   // filter the list by the available extensions
   if (!m_exts.empty()) {
@@ -879,6 +898,17 @@ void FileList::regenerateList()
     m_selectedItems.clear();
 }
 
+void FileList::selectInitialItem()
+{
+  // Keep the selected item if it's in the list (e.g. the folder
+  // selected by goUp() while the list was being read), or select
+  // the first folder
+  if (selectedIndex() >= 0)
+    makeSelectedFileitemVisible();
+  else if (!m_list.empty() && m_list.front()->isBrowsable())
+    selectIndex(0);
+}
+
 int FileList::selectedIndex() const
 {
   for (auto it = m_list.begin(), end = m_list.end();
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -87,6 +87,7 @@ namespace app {
     ItemInfo getFileItemInfo(int i) const;
     void makeSelectedFileitemVisible();
     void regenerateList();
+    void selectInitialItem();
     int selectedIndex() const;
     void selectIndex(int index);
     void generateThumbnailForFileItem(IFileItem* fi);
@@ -128,6 +129,10 @@ namespace app {
     // a isIconView()
     std::deque<IFileItem*> m_generateThumbnailsForTheseItems;
 
+    // True if the children of m_currentFolder are being read in
+    // background (and m_list is empty until they are ready).
+    bool m_waitingChildren;
+
     // True if this listbox accepts selecting multiple items at the
     // same time.
     bool m_multiselect;
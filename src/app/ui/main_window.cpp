@@ -20,6 +20,7 @@
 #include "app/ini_file.h"
 #include "app/notification_delegate.h"
 #include "app/pref/preferences.h"
+#include "app/startup_trace.h"
 #include "app/ui/browser_view.h"
 #include "app/ui/color_bar.h"
 #include "app/ui/context_bar.h"
@@ -29,6 +30,7 @@
 #include "app/ui/home_view.h"
 #include "app/ui/main_menu_bar.h"
 #include "app/ui/notifications.h"
+#include "app/ui/paint_profiler.h"
 #include "app/ui/preview_editor.h"
 #include "app/ui/skin/skin_property.h"
 #include "app/ui/skin/skin_theme.h"
@@ -173,10 +175,18 @@ void MainWindow::initialize()
   // When the language is change, we reload the menu bar strings and
   // relayout the whole main window.
   Strings::instance()->LanguageChange.connect([this] { onLanguageChange(); });
+
+#if ENABLE_DEVMODE
+  m_paintProfiler = new PaintProfiler;
+#endif
 }
 
 MainWindow::~MainWindow()
 {
+#if ENABLE_DEVMODE
+  delete m_paintProfiler;
+#endif
+
   delete m_scalePanic;
 
 #ifdef ENABLE_SCRIPTING
@@ -368,6 +378,13 @@ bool MainWindow::onProcessMessage(ui::Message* msg)
 {
   if (msg->type() == kOpenMessage)
     showHomeOnOpen();
+  else if (msg->type() == kPaintMessage &&
+           StartupTrace::isEnabled()) {
+    // The startup finishes when the main window is painted for
+    // first time.
+    StartupTrace::mark("first paint");
+    StartupTrace::finish();
+  }
 
   return Window::onProcessMessage(msg);
 }
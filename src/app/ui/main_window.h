@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -34,6 +34,7 @@ namespace app {
   class INotificationDelegate;
   class MainMenuBar;
   class Notifications;
+  class PaintProfiler;
   class PreviewEditorWindow;
   class StatusBar;
   class Timeline;
@@ -141,6 +142,9 @@ namespace app {
     BrowserView* m_browserView;
 #ifdef ENABLE_SCRIPTING
     DevConsoleView* m_devConsoleView;
+#endif
+#if ENABLE_DEVMODE
+    PaintProfiler* m_paintProfiler = nullptr;
 #endif
   };
 
@@ -0,0 +1,295 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/ui/paint_profiler.h"
+
+#include "app/pref/preferences.h"
+#include "fmt/format.h"
+#include "os/font.h"
+#include "os/system.h"
+#include "ui/display.h"
+#include "ui/graphics.h"
+#include "ui/manager.h"
+#include "ui/overlay_manager.h"
+#include "ui/scale.h"
+#include "ui/system.h"
+#include "ui/theme.h"
+
+#include <algorithm>
+
+namespace app {
+
+namespace {
+
+// Milliseconds between updates of the HUD
+constexpr int kUpdateInterval = 250;
+
+// The height of the histogram is two frames at 60 fps (a line is
+// drawn in the middle to see which paints took more than one frame)
+constexpr double kFrameTime = 1.0 / 60.0;
+
+const char* kSourceNames[] = { "Editor", "Timeline", "StatusBar" };
+const char* kStageNames[] = { "plan", "composite", "bg", "onion", "convert", "ui" };
+const gfx::Color kStageColors[] = {
+  gfx::rgba(255, 96, 96),       // RenderPlan
+  gfx::rgba(96, 160, 255),      // Composite
+  gfx::rgba(160, 160, 160),     // Background
+  gfx::rgba(255, 160, 64),      // Onionskin
+  gfx::rgba(192, 96, 255),      // SurfaceConversion
+  gfx::rgba(96, 224, 96),       // UI
+};
+
+static_assert(sizeof(kSourceNames) / sizeof(kSourceNames[0]) == PaintProfiler::kSources);
+static_assert(sizeof(kStageNames) / sizeof(kStageNames[0]) == PaintProfiler::kStages);
+static_assert(sizeof(kStageColors) / sizeof(kStageColors[0]) == PaintProfiler::kStages);
+
+} // anonymous namespace
+
+// static
+PaintProfiler* PaintProfiler::m_instance = nullptr;
+
+PaintProfiler::ScopedPaint::ScopedPaint(const Source source)
+  : m_profiler(nullptr)
+  , m_source(source)
+{
+  // Nested paint events are not measured (they are part of the
+  // current paint)
+  if (m_instance &&
+      m_instance->m_visible &&
+      !m_instance->m_painting &&
+      ui::is_ui_thread()) {
+    m_profiler = m_instance;
+    m_profiler->beginPaint();
+  }
+}
+
+PaintProfiler::ScopedPaint::~ScopedPaint()
+{
+  if (m_profiler)
+    m_profiler->endPaint(m_source, m_chrono.elapsed());
+}
+
+PaintProfiler::ScopedStage::ScopedStage(const Stage stage)
+  : m_profiler(activeInstance())
+  , m_stage(stage)
+{
+}
+
+PaintProfiler::ScopedStage::~ScopedStage()
+{
+  if (m_profiler)
+    m_profiler->addStageTime(m_stage, m_chrono.elapsed());
+}
+
+PaintProfiler::PaintProfiler()
+  : m_timer(kUpdateInterval)
+{
+  ASSERT(!m_instance);
+  m_instance = this;
+
+  m_timer.Tick.connect([this]{ updateHud(); });
+  m_showConn = Preferences::instance().perf.showPaintProfiler.AfterChange.connect(
+    [this]{ onShowChange(); });
+
+  onShowChange();
+}
+
+PaintProfiler::~PaintProfiler()
+{
+  hideHud();
+  m_instance = nullptr;
+}
+
+// static
+PaintProfiler* PaintProfiler::activeInstance()
+{
+  if (m_instance &&
+      m_instance->m_painting &&
+      ui::is_ui_thread()) {
+    return m_instance;
+  }
+  return nullptr;
+}
+
+void PaintProfiler::addStageTime(const Stage stage, const double seconds)
+{
+  if (m_painting)
+    m_current.stages[int(stage)] += seconds;
+}
+
+void PaintProfiler::beginPaint()
+{
+  m_painting = true;
+  m_current = Sample();
+}
+
+void PaintProfiler::endPaint(const Source source, const double total)
+{
+  m_painting = false;
+
+  double measured = 0.0;
+  for (int i=0; i<kStages; ++i)
+    if (i != int(Stage::UI))
+      measured += m_current.stages[i];
+
+  // The rendering in parallel can add more time than the elapsed
+  // time (the time of all threads is added)
+  m_current.stages[int(Stage::UI)] = std::max(0.0, total - measured);
+  m_current.total = std::max(total, measured);
+
+  auto& history = m_history[int(source)];
+  history.push_back(m_current);
+  if (int(history.size()) > kHistorySize)
+    history.pop_front();
+
+  m_modified = true;
+}
+
+void PaintProfiler::onShowChange()
+{
+  m_visible = Preferences::instance().perf.showPaintProfiler();
+  if (m_visible) {
+    m_modified = true;
+    m_timer.start();
+  }
+  else {
+    m_timer.stop();
+    hideHud();
+    for (auto& history : m_history)
+      history.clear();
+  }
+}
+
+void PaintProfiler::updateHud()
+{
+  if (!m_modified)
+    return;
+  m_modified = false;
+
+  ui::Manager* manager = ui::Manager::getDefault();
+  if (!manager)
+    return;
+
+  ui::Display* display = manager->display();
+  os::SurfaceRef surface = renderHud(display);
+  const int margin = 4*ui::guiscale();
+  const gfx::Point pos(display->size().w - surface->width() - margin,
+                       display->size().h - surface->height() - margin);
+
+  // Create a new overlay if the size of the HUD has changed (the
+  // overlay keeps a copy of the overlapped area with its size)
+  if (m_overlay &&
+      m_overlay->bounds().size() != gfx::Size(surface->width(),
+                                              surface->height())) {
+    hideHud();
+  }
+
+  if (m_overlay) {
+    m_overlay->restoreOverlappedArea(gfx::Rect());
+    m_overlay->setSurface(surface);
+    m_overlay->moveOverlay(pos);
+  }
+  else {
+    m_overlay = base::make_ref<ui::Overlay>(display, surface, pos);
+    ui::OverlayManager::instance()->addOverlay(m_overlay);
+  }
+}
+
+void PaintProfiler::hideHud()
+{
+  if (m_overlay) {
+    ui::OverlayManager::instance()->removeOverlay(m_overlay);
+    m_overlay.reset();
+  }
+}
+
+os::SurfaceRef PaintProfiler::renderHud(ui::Display* display) const
+{
+  const int scale = ui::guiscale();
+  os::Font* font = ui::get_theme()->getDefaultFont();
+  const int textHeight = font->height();
+  const int graphHeight = 32*scale;
+  const int barWidth = scale;
+  const int margin = 2*scale;
+  const int w = 2*margin + kHistorySize*barWidth;
+  const int h = margin + kSources*(2*textHeight + graphHeight + 2*margin);
+
+  os::SurfaceRef surface = os::instance()->makeRgbaSurface(w, h);
+  {
+    ui::Graphics g(display, surface, 0, 0);
+    g.setFont(AddRef(font));
+    g.fillRect(gfx::rgba(0, 0, 0, 208), gfx::Rect(0, 0, w, h));
+
+    int y = margin;
+    for (int s=0; s<kSources; ++s) {
+      const auto& history = m_history[s];
+
+      // Average time of each stage and total
+      Sample avg;
+      double maxTotal = 0.0;
+      for (const Sample& sample : history) {
+        for (int i=0; i<kStages; ++i)
+          avg.stages[i] += sample.stages[i];
+        avg.total += sample.total;
+        maxTotal = std::max(maxTotal, sample.total);
+      }
+      if (!history.empty()) {
+        for (int i=0; i<kStages; ++i)
+          avg.stages[i] /= history.size();
+        avg.total /= history.size();
+      }
+
+      g.drawText(fmt::format("{} {:.2f}ms (max {:.2f}ms)",
+                             kSourceNames[s],
+                             1000.0 * avg.total,
+                             1000.0 * maxTotal),
+                 gfx::rgba(255, 255, 255), gfx::ColorNone,
+                 gfx::Point(margin, y));
+      y += textHeight;
+
+      int x = margin;
+      for (int i=0; i<kStages; ++i) {
+        const std::string text =
+          fmt::format("{} {:.2f} ", kStageNames[i], 1000.0 * avg.stages[i]);
+        g.drawText(text, kStageColors[i], gfx::ColorNone, gfx::Point(x, y));
+        x += g.measureUIText(text).w;
+      }
+      y += textHeight + margin;
+
+      // Histogram (the oldest paint on the left, each bar is split in
+      // the stages of the paint)
+      const gfx::Rect graph(margin, y, kHistorySize*barWidth, graphHeight);
+      g.fillRect(gfx::rgba(32, 32, 32), graph);
+
+      x = graph.x2() - int(history.size())*barWidth;
+      for (const Sample& sample : history) {
+        int y2 = graph.y2();
+        for (int i=0; i<kStages && y2 > graph.y; ++i) {
+          const int barHeight = std::min(
+            y2 - graph.y,
+            int(sample.stages[i] * graphHeight / (2.0*kFrameTime) + 0.5));
+          if (barHeight > 0) {
+            g.fillRect(kStageColors[i],
+                       gfx::Rect(x, y2-barHeight, barWidth, barHeight));
+            y2 -= barHeight;
+          }
+        }
+        x += barWidth;
+      }
+      g.drawHLine(gfx::rgba(255, 255, 255, 128),
+                  graph.x, graph.y + graph.h/2, graph.w);
+
+      y += graphHeight + margin;
+    }
+  }
+  return surface;
+}
+
+} // namespace app
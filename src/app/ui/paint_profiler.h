@@ -0,0 +1,119 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_UI_PAINT_PROFILER_H_INCLUDED
+#define APP_UI_PAINT_PROFILER_H_INCLUDED
+#pragma once
+
+#include "base/chrono.h"
+#include "obs/connection.h"
+#include "os/surface.h"
+#include "ui/overlay.h"
+#include "ui/timer.h"
+
+#include <deque>
+
+namespace ui {
+  class Display;
+}
+
+namespace app {
+
+  // Developer overlay (HUD) with the time spent in the last paint
+  // events of the Editor, Timeline, and StatusBar widgets, split in
+  // stages, and a histogram of the last kHistorySize paints of each
+  // widget. It's shown with the [perf] show_paint_profiler option,
+  // e.g. from the developer console:
+  //
+  //   app.preferences.perf.show_paint_profiler = true
+  //
+  // There is only one instance (created by the MainWindow in
+  // ENABLE_DEVMODE builds), and paint times are measured only while
+  // the HUD is visible.
+  class PaintProfiler {
+  public:
+    enum class Source {
+      Editor,
+      Timeline,
+      StatusBar,
+      Count
+    };
+
+    enum class Stage {
+      RenderPlan,               // Creation of render plans
+      Composite,                // Composition of the sprite layers
+      Background,               // Checkered background and editor background
+      Onionskin,                // Onion skin frames
+      SurfaceConversion,        // Conversion of the rendered image to a surface
+      UI,                       // Everything else (grid, selection, widget, etc.)
+      Count
+    };
+
+    static constexpr int kSources = int(Source::Count);
+    static constexpr int kStages = int(Stage::Count);
+    static constexpr int kHistorySize = 120;
+
+    // Measures the whole paint event of a widget, the time that is
+    // not measured by a specific stage is added to Stage::UI.
+    class ScopedPaint {
+    public:
+      ScopedPaint(const Source source);
+      ~ScopedPaint();
+    private:
+      PaintProfiler* m_profiler;
+      Source m_source;
+      base::Chrono m_chrono;
+    };
+
+    // Measures one stage of the current paint event.
+    class ScopedStage {
+    public:
+      ScopedStage(const Stage stage);
+      ~ScopedStage();
+    private:
+      PaintProfiler* m_profiler;
+      Stage m_stage;
+      base::Chrono m_chrono;
+    };
+
+    PaintProfiler();
+    ~PaintProfiler();
+
+    // Returns the profiler if the paint times must be measured
+    // (i.e. the HUD is visible and we are in the UI thread inside a
+    // paint event), or nullptr in other case.
+    static PaintProfiler* activeInstance();
+
+    void addStageTime(const Stage stage, const double seconds);
+
+  private:
+    struct Sample {
+      double stages[kStages] = { };
+      double total = 0.0;
+    };
+
+    void beginPaint();
+    void endPaint(const Source source, const double total);
+    void onShowChange();
+    void updateHud();
+    void hideHud();
+    os::SurfaceRef renderHud(ui::Display* display) const;
+
+    static PaintProfiler* m_instance;
+
+    bool m_visible = false;
+    bool m_painting = false;
+    bool m_modified = false;
+    Sample m_current;
+    std::deque<Sample> m_history[kSources];
+    ui::Timer m_timer;
+    ui::OverlayRef m_overlay;
+    obs::scoped_connection m_showConn;
+  };
+
+} // namespace app
+
+#endif
@@ -18,6 +18,7 @@
 #include "app/modules/gui.h"
 #include "app/pref/preferences.h"
 #include "app/resource_finder.h"
+#include "app/startup_trace.h"
 #include "app/ui/app_menuitem.h"
 #include "app/ui/keyboard_shortcuts.h"
 #include "app/ui/skin/font_data.h"
@@ -342,6 +343,7 @@ void SkinTheme::onRegenerateTheme()
 
 void SkinTheme::loadFontData()
 {
+  StartupTrace span("fonts");
   LOG("THEME: Loading fonts\n");
 
   std::string fontsFilename("fonts/fonts.xml");
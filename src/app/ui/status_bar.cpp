@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -29,6 +29,7 @@
 #include "app/ui/editor/editor.h"
 #include "app/ui/keyboard_shortcuts.h"
 #include "app/ui/main_window.h"
+#include "app/ui/paint_profiler.h"
 #include "app/ui/skin/skin_theme.h"
 #include "app/ui/status_bar.h"
 #include "app/ui/timeline/timeline.h"
@@ -134,6 +135,7 @@ class StatusBar::Indicators : public HBox {
 
   private:
     void onPaint(ui::PaintEvent& ev) override {
+      PaintProfiler::ScopedPaint profile(PaintProfiler::Source::StatusBar);
       auto theme = SkinTheme::get(this);
       gfx::Color textColor = theme->colors.statusBarText();
       Rect rc = clientBounds();
@@ -180,6 +182,7 @@ class StatusBar::Indicators : public HBox {
     }
 
     void onPaint(ui::PaintEvent& ev) override {
+      PaintProfiler::ScopedPaint profile(PaintProfiler::Source::StatusBar);
       auto theme = SkinTheme::get(this);
       gfx::Color textColor = theme->colors.statusBarText();
       Rect rc = clientBounds();
@@ -219,6 +222,7 @@ class StatusBar::Indicators : public HBox {
 
   private:
     void onPaint(ui::PaintEvent& ev) override {
+      PaintProfiler::ScopedPaint profile(PaintProfiler::Source::StatusBar);
       Rect rc = clientBounds();
       Graphics* g = ev.graphics();
 
@@ -251,6 +255,7 @@ class StatusBar::Indicators : public HBox {
 
   private:
     void onPaint(ui::PaintEvent& ev) override {
+      PaintProfiler::ScopedPaint profile(PaintProfiler::Source::StatusBar);
       Rect rc = clientBounds();
       Graphics* g = ev.graphics();
 
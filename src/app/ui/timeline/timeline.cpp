@@ -39,6 +39,7 @@
 #include "app/ui/doc_view.h"
 #include "app/ui/editor/editor.h"
 #include "app/ui/input_chain.h"
+#include "app/ui/paint_profiler.h"
 #include "app/ui/skin/skin_theme.h"
 #include "app/ui/status_bar.h"
 #include "app/ui/workspace.h"
@@ -256,9 +257,15 @@ Timeline::Timeline(TooltipManager* tooltipManager)
   , m_scroll(false)
   , m_fromTimeline(false)
   , m_aniControls(tooltipManager)
+  , m_thumbnails(std::make_shared<thumb::CelThumbnailCache>())
 {
   enableFlags(CTRL_RIGHT_CLICK);
 
+  // Redraw the timeline when thumbnails rendered in the background
+  // are ready.
+  m_thumbnailsReadyConn = m_thumbnails->ThumbnailsReady.connect(
+    [this]{ invalidate(); });
+
   m_ctxConn1 = m_context->BeforeCommandExecution.connect(
     &Timeline::onBeforeCommandExecution, this);
   m_ctxConn2 = m_context->AfterCommandExecution.connect(
@@ -1709,6 +1716,8 @@ void Timeline::onResize(ui::ResizeEvent& ev)
 
 void Timeline::onPaint(ui::PaintEvent& ev)
 {
+  PaintProfiler::ScopedPaint profile(PaintProfiler::Source::Timeline);
+
   Graphics* g = ev.graphics();
   bool noDoc = (m_document == NULL);
   if (noDoc)
@@ -2485,10 +2494,12 @@ void Timeline::drawCel(ui::Graphics* g,
         skinTheme()->calcBorder(this, style));
 
     if (!thumb_bounds.isEmpty()) {
-      if (os::SurfaceRef surface = thumb::get_cel_thumbnail(cel, thumb_bounds.size())) {
-        const int t = std::clamp(thumb_bounds.w/8, 4, 16);
-        draw_checkered_grid(g, thumb_bounds, gfx::Size(t, t), docPref());
+      // The checkered grid is a placeholder until the thumbnail is
+      // rendered in the background.
+      const int t = std::clamp(thumb_bounds.w/8, 4, 16);
+      draw_checkered_grid(g, thumb_bounds, gfx::Size(t, t), docPref());
 
+      if (os::SurfaceRef surface = m_thumbnails->getCelThumbnail(cel, thumb_bounds.size())) {
         g->drawRgbaSurface(surface.get(),
                            thumb_bounds.center().x-surface->width()/2,
                            thumb_bounds.center().y-surface->height()/2);
@@ -2579,13 +2590,13 @@ void Timeline::drawCelOverlay(ui::Graphics* g)
 
   gfx::Rect rc = m_sprite->bounds().fitIn(
     gfx::Rect(m_thumbnailsOverlayBounds).shrink(1));
-  if (os::SurfaceRef surface = thumb::get_cel_thumbnail(cel, rc.size())) {
-    draw_checkered_grid(g, rc, gfx::Size(8, 8)*ui::guiscale(), docPref());
+  draw_checkered_grid(g, rc, gfx::Size(8, 8)*ui::guiscale(), docPref());
+  g->drawRect(gfx::rgba(0, 0, 0, 128), m_thumbnailsOverlayBounds);
 
+  if (os::SurfaceRef surface = m_thumbnails->getCelThumbnail(cel, rc.size())) {
     g->drawRgbaSurface(surface.get(),
                        rc.center().x-surface->width()/2,
                        rc.center().y-surface->height()/2);
-    g->drawRect(gfx::rgba(0, 0, 0, 128), m_thumbnailsOverlayBounds);
   }
 }
 
@@ -2707,6 +2718,10 @@ void Timeline::drawTags(ui::Graphics* g)
       bounds.w += dw;
       tagBounds.x += dx;
 
+      // Skip tags outside the visible area
+      if (!g->getClipBounds().intersects(bounds.createUnion(tagBounds)))
+        continue;
+
       const gfx::Color tagColor =
         (m_tagFocusBand < 0 || pass == 1) ?
         tag->color(): theme->colors.timelineBandBg();
@@ -3130,28 +3145,56 @@ gfx::Rect Timeline::getPartBounds(const Hit& hit) const
 
 gfx::Rect Timeline::getRangeBounds(const Range& range) const
 {
+  // As the bounds of rows/cels are in a grid, the bounds of the range
+  // are the union of the bounds of its first/last layers and frames
+  // (so we don't need to iterate each selected cel).
+  layer_t firstLayerIdx = -1, lastLayerIdx = -1;
+  if (range.type() == Range::kCels ||
+      range.type() == Range::kLayers) {
+    for (auto layer : range.selectedLayers()) {
+      const layer_t layerIdx = getLayerIndex(layer);
+      if (layerIdx < 0)        // Hidden in a collapsed group
+        continue;
+      if (firstLayerIdx < 0 || layerIdx < firstLayerIdx)
+        firstLayerIdx = layerIdx;
+      if (lastLayerIdx < 0 || layerIdx > lastLayerIdx)
+        lastLayerIdx = layerIdx;
+    }
+    if (firstLayerIdx < 0)
+      return gfx::Rect();
+  }
+
+  frame_t firstFrame = -1, lastFrame = -1;
+  if (range.type() == Range::kCels ||
+      range.type() == Range::kFrames) {
+    for (auto frame : range.selectedFrames()) {
+      if (firstFrame < 0 || frame < firstFrame)
+        firstFrame = frame;
+      if (lastFrame < 0 || frame > lastFrame)
+        lastFrame = frame;
+    }
+    if (firstFrame < 0)
+      return gfx::Rect();
+  }
+
   gfx::Rect rc;
   switch (range.type()) {
     case Range::kNone:
       // Return empty rectangle
       break;
     case Range::kCels:
-      for (auto layer : range.selectedLayers()) {
-        layer_t layerIdx = getLayerIndex(layer);
-        for (auto frame : range.selectedFrames())
-          rc |= getPartBounds(Hit(PART_CEL, layerIdx, frame));
-      }
+      rc |= getPartBounds(Hit(PART_CEL, firstLayerIdx, firstFrame));
+      rc |= getPartBounds(Hit(PART_CEL, lastLayerIdx, lastFrame));
       break;
     case Range::kFrames: {
-      for (auto frame : range.selectedFrames()) {
+      for (const frame_t frame : { firstFrame, lastFrame }) {
         rc |= getPartBounds(Hit(PART_HEADER_FRAME, 0, frame));
         rc |= getPartBounds(Hit(PART_CEL, 0, frame));
       }
       break;
     }
     case Range::kLayers:
-      for (auto layer : range.selectedLayers()) {
-        layer_t layerIdx = getLayerIndex(layer);
+      for (const layer_t layerIdx : { firstLayerIdx, lastLayerIdx }) {
         rc |= getPartBounds(Hit(PART_ROW_TEXT, layerIdx));
         rc |= getPartBounds(Hit(PART_CEL, layerIdx, m_sprite->lastFrame()));
       }
@@ -3253,9 +3296,11 @@ void Timeline::regenerateRows()
   }
 
   size_t i = 0;
+  m_layerIndexes.clear();
   for_each_expanded_layer(
     m_sprite->root(),
     [&i, this](Layer* layer, int level, LayerFlags flags) {
+      m_layerIndexes[layer] = layer_t(i);
       m_rows[i++] = Row(layer, level, flags);
     });
 
@@ -3973,10 +4018,12 @@ doc::Layer* Timeline::getLayer(int layerIndex) const
 
 layer_t Timeline::getLayerIndex(const Layer* layer) const
 {
-  for (int i=0; i<(int)m_rows.size(); i++)
-    if (m_rows[i].layer() == layer)
-      return i;
-
+  auto it = m_layerIndexes.find(layer);
+  if (it != m_layerIndexes.end()) {
+    ASSERT(it->second < layer_t(m_rows.size()));
+    ASSERT(m_rows[it->second].layer() == layer);
+    return it->second;
+  }
   return -1;
 }
 
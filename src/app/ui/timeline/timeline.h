@@ -34,6 +34,7 @@
 #include "ui/widget.h"
 
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
 namespace doc {
@@ -54,6 +55,10 @@ namespace app {
     class SkinTheme;
   }
 
+  namespace thumb {
+    class CelThumbnailCache;
+  }
+
   using namespace doc;
 
   class CommandExecutionEvent;
@@ -417,6 +422,10 @@ namespace app {
     // Data used to display each row in the timeline
     std::vector<Row> m_rows;
 
+    // Index of each layer in m_rows (regenerated with m_rows) so
+    // getLayerIndex() doesn't need to iterate all rows
+    std::unordered_map<const Layer*, layer_t> m_layerIndexes;
+
     // Data used to display frame tags
     int m_tagBands;
     int m_tagFocusBand;
@@ -454,6 +463,8 @@ namespace app {
     Hit m_thumbnailsOverlayHit;
     gfx::Point m_thumbnailsOverlayDirection;
     obs::connection m_thumbnailsPrefConn;
+    std::shared_ptr<thumb::CelThumbnailCache> m_thumbnails;
+    obs::scoped_connection m_thumbnailsReadyConn;
 
     // Temporal data used to move the range.
     struct MoveRange {
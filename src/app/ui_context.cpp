@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -35,6 +35,7 @@ UIContext* UIContext::m_instance = nullptr;
 
 UIContext::UIContext()
   : m_closedDocs(preferences())
+  , m_celsCompressor(this)
 {
   ASSERT(m_instance == nullptr);
   m_instance = this;
@@ -299,6 +300,7 @@ std::vector<Doc*> UIContext::getAndRemoveAllClosedDocs()
 void UIContext::onAddDocument(Doc* doc)
 {
   app::Context::onAddDocument(doc);
+  m_celsCompressor.addDoc(doc);
 
   // We don't create views in batch mode.
   if (!App::instance()->isGui())
@@ -320,6 +322,7 @@ void UIContext::onAddDocument(Doc* doc)
 void UIContext::onRemoveDocument(Doc* doc)
 {
   app::Context::onRemoveDocument(doc);
+  m_celsCompressor.removeDoc(doc);
 
   // We don't destroy views in batch mode.
   if (isUIAvailable()) {
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -9,6 +9,7 @@
 #define APP_UI_CONTEXT_H_INCLUDED
 #pragma once
 
+#include "app/cels_compressor.h"
 #include "app/closed_docs.h"
 #include "app/context.h"
 #include "app/docs_observer.h"
@@ -87,6 +88,7 @@ namespace app {
     DocView* m_targetView = nullptr;
 
     ClosedDocs m_closedDocs;
+    CelsCompressor m_celsCompressor;
 
     static UIContext* m_instance;
   };
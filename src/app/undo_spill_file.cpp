@@ -0,0 +1,130 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/undo_spill_file.h"
+
+#include "base/debug.h"
+#include "base/fs.h"
+#include "base/fstream_path.h"
+#include "base/log.h"
+#include "base/process.h"
+#include "fmt/format.h"
+#include "zlib.h"
+
+#include <atomic>
+#include <vector>
+
+namespace app {
+
+static std::atomic<int> g_spillFiles(0);
+
+UndoSpillFile::UndoSpillFile()
+  : m_size(0)
+  , m_failed(false)
+{
+}
+
+UndoSpillFile::~UndoSpillFile()
+{
+  if (m_file.is_open()) {
+    m_file.close();
+    try {
+      base::delete_file(m_filename);
+    }
+    catch (const std::exception& ex) {
+      LOG(ERROR, "UNDO: Cannot delete spill file %s (%s)\n",
+          m_filename.c_str(), ex.what());
+    }
+  }
+}
+
+bool UndoSpillFile::write(const uint8_t* data, size_t n, Chunk& chunk)
+{
+  if (n == 0 || n > 0xffffffff || !open())
+    return false;
+
+  uLongf size = compressBound(uLong(n));
+  std::vector<uint8_t> buf(size);
+  const uint8_t* output = &buf[0];
+  if (compress2(&buf[0], &size, data, uLong(n), Z_BEST_SPEED) != Z_OK ||
+      size >= n) {
+    output = data;
+    size = uLongf(n);
+  }
+
+  m_file.seekp(std::streamoff(m_size));
+  m_file.write((const char*)output, size);
+  if (!m_file) {
+    m_file.clear();
+    return false;
+  }
+
+  chunk.offset = m_size;
+  chunk.size = uint32_t(size);
+  chunk.rawSize = uint32_t(n);
+  m_size += size;
+  return true;
+}
+
+bool UndoSpillFile::read(const Chunk& chunk, uint8_t* data)
+{
+  ASSERT(chunk.isValid());
+  if (!m_file.is_open())
+    return false;
+
+  // Uncompressed data
+  if (chunk.size == chunk.rawSize) {
+    m_file.seekg(std::streamoff(chunk.offset));
+    m_file.read((char*)data, chunk.size);
+    if (!m_file) {
+      m_file.clear();
+      return false;
+    }
+    return true;
+  }
+
+  std::vector<uint8_t> buf(chunk.size);
+  m_file.seekg(std::streamoff(chunk.offset));
+  m_file.read((char*)&buf[0], chunk.size);
+  if (!m_file) {
+    m_file.clear();
+    return false;
+  }
+
+  uLongf size = chunk.rawSize;
+  return (uncompress(data, &size, &buf[0], chunk.size) == Z_OK &&
+          size == chunk.rawSize);
+}
+
+bool UndoSpillFile::open()
+{
+  if (m_file.is_open())
+    return true;
+  if (m_failed)
+    return false;
+
+  m_filename = base::join_path(
+    base::get_temp_path(),
+    fmt::format("aseprite-undo-{}-{}.tmp",
+                base::get_current_process_id(),
+                ++g_spillFiles));
+
+  m_file.open(FSTREAM_PATH(m_filename),
+              std::ios::in | std::ios::out |
+              std::ios::trunc | std::ios::binary);
+  if (!m_file.is_open()) {
+    LOG(ERROR, "UNDO: Cannot create spill file %s\n", m_filename.c_str());
+    m_failed = true;
+    return false;
+  }
+  return true;
+}
+
+} // namespace app
@@ -0,0 +1,68 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_UNDO_SPILL_FILE_H_INCLUDED
+#define APP_UNDO_SPILL_FILE_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+namespace app {
+
+  // Temporary file where the payload of old undo states (e.g. image
+  // buffers) is compressed and stored to reduce the memory used by
+  // the undo history. The file is deleted when this object is
+  // destroyed (i.e. when the DocUndo is destroyed).
+  class UndoSpillFile {
+  public:
+    // Location of a block of data inside the file.
+    struct Chunk {
+      uint64_t offset = 0;
+      uint32_t size = 0;        // Compressed size
+      uint32_t rawSize = 0;     // Original size (== size if the data
+                                // was stored without compression)
+      bool isValid() const { return size > 0; }
+    };
+
+    // Buffers smaller than this are not worth to be spilled.
+    static constexpr size_t kMinChunkSize = 4096;
+
+    UndoSpillFile();
+    ~UndoSpillFile();
+
+    // Compresses and appends the given bytes at the end of the file
+    // (data that cannot be compressed, e.g. buffers that are already
+    // compressed, is stored as it is).
+    // Returns false if the data cannot be written (in this case the
+    // data should be kept in memory).
+    bool write(const uint8_t* data, size_t n, Chunk& chunk);
+
+    // Reads and decompresses the chunk in "data", which must have
+    // room for chunk.rawSize bytes.
+    bool read(const Chunk& chunk, uint8_t* data);
+
+    // Bytes written in the file.
+    uint64_t size() const { return m_size; }
+
+  private:
+    bool open();
+
+    std::string m_filename;
+    std::fstream m_file;
+    uint64_t m_size;
+    bool m_failed;
+
+    DISABLE_COPYING(UndoSpillFile);
+  };
+
+} // namespace app
+
+#endif
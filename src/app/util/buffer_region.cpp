@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -10,8 +10,10 @@
 
 #include "app/util/buffer_region.h"
 
+#include "app/perf_counters.h"
 #include "doc/image.h"
 #include "gfx/region.h"
+#include "zlib.h"
 
 #include <algorithm>
 
@@ -60,4 +62,73 @@ void swap_image_region_with_buffer(
   }
 }
 
+void xor_buffer_with_image_region(
+  const gfx::Region& region,
+  const doc::Image* image,
+  base::buffer& buffer)
+{
+  const size_t bytesPerPixel = image->bytesPerPixel();
+  auto it = buffer.begin();
+  for (const auto& rc : region) {
+    for (int y=0; y<rc.h; ++y) {
+      auto p = (const uint8_t*)image->getPixelAddress(rc.x, rc.y+y);
+      const size_t rowBytes = bytesPerPixel*rc.w;
+      for (size_t i=0; i<rowBytes; ++i, ++it)
+        *it ^= p[i];
+    }
+  }
+}
+
+void xor_image_region_with_buffer(
+  const gfx::Region& region,
+  doc::Image* image,
+  const base::buffer& buffer)
+{
+  const size_t bytesPerPixel = image->bytesPerPixel();
+  auto it = buffer.begin();
+  for (const auto& rc : region) {
+    for (int y=0; y<rc.h; ++y) {
+      auto p = (uint8_t*)image->getPixelAddress(rc.x, rc.y+y);
+      const size_t rowBytes = bytesPerPixel*rc.w;
+      for (size_t i=0; i<rowBytes; ++i, ++it)
+        p[i] ^= *it;
+    }
+  }
+}
+
+bool compress_buffer(const base::buffer& input,
+                     base::buffer& output)
+{
+  if (input.empty())
+    return false;
+
+  PerfCounters::add(PerfCounters::BytesCompressed, input.size());
+
+  uLongf size = compressBound(uLong(input.size()));
+  output.resize(size);
+  if (compress2(&output[0], &size,
+                &input[0], uLong(input.size()),
+                Z_BEST_SPEED) != Z_OK ||
+      size >= input.size()) {
+    output.clear();
+    return false;
+  }
+
+  output.resize(size);
+  output.shrink_to_fit();
+  return true;
+}
+
+bool decompress_buffer(const base::buffer& input,
+                       const size_t outputSize,
+                       base::buffer& output)
+{
+  output.resize(outputSize);
+  uLongf size = uLongf(outputSize);
+  return (!input.empty() &&
+          uncompress(&output[0], &size,
+                     &input[0], uLong(input.size())) == Z_OK &&
+          size == outputSize);
+}
+
 } // namespace app
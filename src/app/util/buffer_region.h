@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -28,6 +28,31 @@ namespace app {
     doc::Image* image,
     base::buffer& buffer);
 
+  // Replaces each byte of the buffer (saved with
+  // save_image_region_in_buffer()) with the XOR between that byte and
+  // the image pixels, so the buffer became the delta between both.
+  void xor_buffer_with_image_region(
+    const gfx::Region& region,
+    const doc::Image* image,
+    base::buffer& buffer);
+
+  // Applies the delta calculated with xor_buffer_with_image_region()
+  // to the image. Applying the same delta two times restores the
+  // original pixels.
+  void xor_image_region_with_buffer(
+    const gfx::Region& region,
+    doc::Image* image,
+    const base::buffer& buffer);
+
+  // Compresses the buffer with the fastest zlib level. Returns false
+  // if the output is not smaller than the input.
+  bool compress_buffer(const base::buffer& input,
+                       base::buffer& output);
+
+  bool decompress_buffer(const base::buffer& input,
+                         const size_t outputSize,
+                         base::buffer& output);
+
 } // namespace app
 
 #endif
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -22,6 +22,7 @@
 #include "app/cmd/set_cel_position.h"
 #include "app/cmd_sequence.h"
 #include "app/doc.h"
+#include "base/thread_pool.h"
 #include "doc/algorithm/fill_selection.h"
 #include "doc/algorithm/flip_image.h"
 #include "doc/algorithm/resize_image.h"
@@ -45,7 +46,10 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <memory>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #define OPS_TRACE(...) // TRACE(__VA_ARGS__)
@@ -83,22 +87,6 @@ void mask_image(Image* image, Image* bitmap)
   }
 }
 
-template<typename ImageTraits>
-void create_region_with_differences_templ(const Image* a,
-                                          const Image* b,
-                                          const gfx::Rect& bounds,
-                                          gfx::Region& output)
-{
-  for (int y=bounds.y; y<bounds.y2(); ++y) {
-    for (int x=bounds.x; x<bounds.x2(); ++x) {
-      if (get_pixel_fast<ImageTraits>(a, x, y) !=
-          get_pixel_fast<ImageTraits>(b, x, y)) {
-        output.createUnion(output, gfx::Region(gfx::Rect(x, y, 1, 1)));
-      }
-    }
-  }
-}
-
 // TODO merge this with Sprite::getTilemapsByTileset()
 template<typename UnaryFunction>
 void for_each_tile_using_tileset(Tileset* tileset, UnaryFunction f)
@@ -120,134 +108,169 @@ struct Mod {
   gfx::Region tileRgn;
 };
 
-class DoFlip {
-public:
-  DoFlip(const doc::ImageRef& image,
-         const doc::algorithm::FlipType flipType)
-    : m_image(image.get())
-    , m_flipType(flipType) {
-  }
-  ~DoFlip() {
-    reset();
-  }
-  void flip() {
-    m_flipped = !m_flipped;
-    doc::algorithm::flip_image(m_image,
-                               m_image->bounds(),
-                               m_flipType);
-  }
-  void reset() {
-    if (m_flipped)
-      flip();
-  }
-  bool operator!() const {
-    return !m_flipped;
-  }
-private:
-  doc::Image* m_image;
-  bool m_flipped = false;
-  doc::algorithm::FlipType m_flipType;
-};
-
-// This is a terrible way to find tiles, i.e. flipping several times
-// the image, instead of searching for flipped hashes. In the future
-// we could try to improve it.
+// Finds the tile (or a flipped version of it if the tileset allows
+// it) in the tileset.
 bool find_tile(doc::Tileset* tileset,
                doc::ImageRef& tileImage,
                doc::tile_index& tileIndex,
                doc::tile_flags& tileFlags)
 {
-  // Find without flags
-  if (tileset->findTileIndex(tileImage, tileIndex)) {
-    tileFlags = 0;
-    return true;
+  return tileset->findTileIndex(tileImage, tileset->matchFlags(),
+                                tileIndex, tileFlags);
+}
+
+// Tiles of the source image processed in each batch of
+// draw_image_into_new_tilemap_cel() (to limit the memory used by the
+// cropped tiles).
+constexpr int kTilesPerBatch = 4096;
+
+// Minimum number of tiles to crop/hash tiles in several threads.
+constexpr int kMinTilesInParallel = 256;
+
+struct NewTile {
+  gfx::Point tilePt;
+  doc::ImageRef image;
+  uint32_t hash = 0;
+  // Index of the first tile in the batch with the same pixels
+  int first = -1;
+  doc::tile_index tileIndex = doc::notile;
+  doc::tile_flags tileFlags = 0;
+};
+
+// Calls f(part) for each part in [0, nparts) using the threads of
+// the given pool (or just the calling thread if pool is nullptr).
+template<typename Func>
+void for_each_part(base::thread_pool* pool, const int nparts, Func&& f)
+{
+  if (!pool || nparts == 1) {
+    for (int part=0; part<nparts; ++part)
+      f(part);
+    return;
   }
+  for (int part=0; part<nparts; ++part)
+    pool->execute([&f, part]{ f(part); });
+  pool->wait_all();
+}
 
-  if (tileset->matchFlags() == 0) // In case we don't allow flipped tiles
-    return false;
+// Minimum number of pixels to compare in
+// create_region_with_differences() to use several threads.
+constexpr int kMinDiffPixelsInParallel = 1024*1024;
 
-  DoFlip x(tileImage, doc::algorithm::FlipHorizontal);
+// Pixels compared with each memcmp() to skip equal parts of a row.
+constexpr int kDiffChunkPixels = 16;
 
-  // Find with X flip
-  if (tileset->matchFlags() & doc::tile_f_xflip) {
-    x.flip();
-    if (tileset->findTileIndex(tileImage, tileIndex)) {
-      tileFlags = doc::tile_f_xflip;
-      return true;
-    }
-    x.reset();
-  }
+// Horizontal run [x1, x2) of different pixels in a row.
+struct DiffRun {
+  int x1, x2;
+  bool operator==(const DiffRun& o) const { return x1 == o.x1 && x2 == o.x2; }
+};
 
-  // Find with Y flip
-  DoFlip y(tileImage, doc::algorithm::FlipVertical);
-  if (tileset->matchFlags() & doc::tile_f_yflip) {
-    y.flip();
-    if (tileset->findTileIndex(tileImage, tileIndex)) {
-      tileFlags = doc::tile_f_yflip;
-      return true;
-    }
+// Consecutive rows with the same runs of different pixels.
+struct DiffBand {
+  int y, h;
+  std::vector<DiffRun> runs;
+};
 
-    if (tileset->matchFlags() & doc::tile_f_xflip) {
-      // Find with X+Y flip
-      x.flip();
-      if (tileset->findTileIndex(tileImage, tileIndex)) {
-        tileFlags = doc::tile_f_xflip | doc::tile_f_yflip;
-        return true;
-      }
-      x.reset();
-    }
-    y.reset();
-  }
+// Adds the runs of different pixels of the row "y" in [x1, x2) to
+// the "runs" vector. Equal parts of the row are skipped with memcmp()
+// (which is vectorized in all platforms) so only rows/chunks with
+// differences are compared pixel by pixel.
+template<typename ImageTraits>
+void collect_row_differences(const Image* a,
+                             const Image* b,
+                             const int x1, const int x2, const int y,
+                             std::vector<DiffRun>& runs)
+{
+  using pixel_t = typename ImageTraits::pixel_t;
+  auto pa = (const pixel_t*)a->readPixelAddress(0, y);
+  auto pb = (const pixel_t*)b->readPixelAddress(0, y);
 
-  // Check if we can match diagonal flips
-  if ((tileset->matchFlags() & doc::tile_f_dflip) == 0)
-    return false;
+  if (std::memcmp(pa+x1, pb+x1, sizeof(pixel_t)*(x2-x1)) == 0)
+    return;
 
-  // Find with D flip
-  DoFlip d(tileImage, doc::algorithm::FlipDiagonal);
-  d.flip();
-  if (tileset->findTileIndex(tileImage, tileIndex)) {
-    tileFlags = doc::tile_f_dflip;
-    return true;
+  int x = x1;
+  while (x < x2) {
+    while (x+kDiffChunkPixels <= x2 &&
+           std::memcmp(pa+x, pb+x, sizeof(pixel_t)*kDiffChunkPixels) == 0)
+      x += kDiffChunkPixels;
+    while (x < x2 && pa[x] == pb[x])
+      ++x;
+    if (x == x2)
+      break;
+
+    const int runStart = x;
+    while (x < x2 && pa[x] != pb[x])
+      ++x;
+    runs.push_back(DiffRun{ runStart, x });
   }
+}
 
-  // Find with X+D flip
-  if (tileset->matchFlags() & doc::tile_f_xflip) {
-    d.reset();
-    x.flip();
-    d.flip();
-    if (tileset->findTileIndex(tileImage, tileIndex)) {
-      tileFlags = doc::tile_f_xflip | doc::tile_f_dflip;
-      return true;
-    }
+// Creates the region of different pixels in the given bounds. Rows
+// with the same runs are joined in bands, and the regions of each
+// band are merged in pairs (so we don't need one union for each
+// pixel/run against the whole accumulated region).
+template<typename ImageTraits>
+gfx::Region create_region_with_differences_in_bounds(const Image* a,
+                                                     const Image* b,
+                                                     const gfx::Rect& bounds)
+{
+  std::vector<DiffBand> bands;
+  std::vector<DiffRun> runs;
+  for (int y=bounds.y; y<bounds.y2(); ++y) {
+    runs.clear();
+    collect_row_differences<ImageTraits>(a, b, bounds.x, bounds.x2(), y, runs);
+    if (runs.empty())
+      continue;
 
-    // Find with X+Y+D flip
-    if (tileset->matchFlags() & doc::tile_f_yflip) {
-      d.reset();
-      y.flip();
-      d.flip();
-      if (tileset->findTileIndex(tileImage, tileIndex)) {
-        tileFlags = doc::tile_f_xflip | doc::tile_f_yflip | doc::tile_f_dflip;
-        return true;
-      }
+    if (!bands.empty() &&
+        bands.back().y + bands.back().h == y &&
+        bands.back().runs == runs) {
+      ++bands.back().h;
+    }
+    else {
+      bands.push_back(DiffBand{ y, 1, runs });
     }
   }
 
-  // Find with Y+D flip only
-  if (tileset->matchFlags() & doc::tile_f_yflip) {
-    d.reset();
-    x.reset();
-    if (!y)
-      y.flip();
-    d.flip();
-    if (tileset->findTileIndex(tileImage, tileIndex)) {
-      tileFlags =  doc::tile_f_yflip | doc::tile_f_dflip;
-      return true;
-    }
+  std::vector<gfx::Region> rgns(bands.size());
+  for (std::size_t i=0; i<bands.size(); ++i) {
+    const DiffBand& band = bands[i];
+    for (const DiffRun& run : band.runs)
+      rgns[i] |= gfx::Region(gfx::Rect(run.x1, band.y, run.x2-run.x1, band.h));
+  }
+
+  for (std::size_t step=1; step<rgns.size(); step*=2) {
+    for (std::size_t i=0; i+step<rgns.size(); i+=2*step)
+      rgns[i] |= rgns[i+step];
+  }
+  return (rgns.empty() ? gfx::Region(): std::move(rgns[0]));
+}
+
+template<typename ImageTraits>
+void create_region_with_differences_templ(const Image* a,
+                                          const Image* b,
+                                          const gfx::Rect& bounds,
+                                          gfx::Region& output)
+{
+  const int nthreads = std::max(1u, std::thread::hardware_concurrency());
+  if (nthreads == 1 ||
+      bounds.w * bounds.h < kMinDiffPixelsInParallel) {
+    output |= create_region_with_differences_in_bounds<ImageTraits>(a, b, bounds);
+    return;
   }
 
-  // DoFlip destructors will reset the image.
-  return false;
+  // Compare horizontal strips of the images in parallel
+  const int nparts = std::min(nthreads, bounds.h);
+  std::vector<gfx::Region> parts(nparts);
+  base::thread_pool pool(nthreads);
+  for_each_part(&pool, nparts, [&](const int part){
+    const int y1 = bounds.y + part*bounds.h/nparts;
+    const int y2 = bounds.y + (part+1)*bounds.h/nparts;
+    parts[part] = create_region_with_differences_in_bounds<ImageTraits>(
+      a, b, gfx::Rect(bounds.x, y1, bounds.w, y2-y1));
+  });
+  for (const gfx::Region& rgn : parts)
+    output |= rgn;
 }
 
 } // anonymous namespace
@@ -334,9 +357,31 @@ Cel* create_cel_copy(CmdSequence* cmds,
     dstSize = tilemapBounds.size();
   }
 
+  // True if we have to convert the source image to the destination
+  // pixel format/palette.
+  const bool convertImage =
+    (!srcCel->layer()->isTilemap() && !dstLayer->isTilemap() &&
+     ((dstSprite->pixelFormat() != srcImage->pixelFormat()) ||
+      // If both images are indexed but with different palette, we can
+      // convert the source cel to RGB first.
+      (dstSprite->pixelFormat() == IMAGE_INDEXED &&
+       srcImage->pixelFormat() == IMAGE_INDEXED &&
+       srcCel->sprite()->palette(srcCel->frame())->countDiff(
+         dstSprite->palette(dstFrame), nullptr, nullptr))));
+
+  // Simple case, where we copy both images (the copy shares the
+  // pixels with the source image until one of them is modified, so
+  // copying big ranges of cels doesn't copy/allocate pixels).
+  const bool sharePixels =
+    (!srcCel->layer()->isTilemap() && !dstLayer->isTilemap() &&
+     !convertImage &&
+     srcImage->maskColor() == 0);
+
   // New cel
   auto dstCel = std::make_unique<Cel>(
-    dstFrame, ImageRef(Image::create(dstPixelFormat, dstSize.w, dstSize.h)));
+    dstFrame,
+    ImageRef(sharePixels ? Image::createCopy(srcImage):
+                           Image::create(dstPixelFormat, dstSize.w, dstSize.h)));
 
   dstCel->setOpacity(srcCel->opacity());
   dstCel->setZIndex(srcCel->zIndex());
@@ -417,13 +462,7 @@ Cel* create_cel_copy(CmdSequence* cmds,
       srcCel->bounds(),
       tilemap);
   }
-  else if ((dstSprite->pixelFormat() != srcImage->pixelFormat()) ||
-           // If both images are indexed but with different palette, we can
-           // convert the source cel to RGB first.
-           (dstSprite->pixelFormat() == IMAGE_INDEXED &&
-            srcImage->pixelFormat() == IMAGE_INDEXED &&
-            srcCel->sprite()->palette(srcCel->frame())->countDiff(
-              dstSprite->palette(dstFrame), nullptr, nullptr))) {
+  else if (convertImage) {
     ImageRef tmpImage(Image::create(IMAGE_RGB, srcImage->width(), srcImage->height()));
     tmpImage->clear(0);
 
@@ -447,8 +486,7 @@ Cel* create_cel_copy(CmdSequence* cmds,
       srcCel->layer()->isBackground(),
       dstSprite->transparentColor());
   }
-  // Simple case, where we copy both images
-  else {
+  else if (!sharePixels) {
     render::composite_image(
       dstCel->image(),
       srcImage,
@@ -519,49 +557,104 @@ void draw_image_into_new_tilemap_cel(
     ASSERT(tilemapBounds.h == newTilemap->height());
   }
 
-  for (const gfx::Point& tilePt : grid.tilesInCanvasRegion(gfx::Region(canvasBounds))) {
-    const gfx::Point tilePtInCanvas = grid.tileToCanvas(tilePt);
-    doc::ImageRef tileImage(
-      doc::crop_image(srcImage,
-                      tilePtInCanvas.x-srcImagePos.x,
-                      tilePtInCanvas.y-srcImagePos.y,
-                      tileSize.w, tileSize.h,
-                      srcImage->maskColor()));
-    if (grid.hasMask())
-      mask_image(tileImage.get(), grid.mask().get());
-
-    preprocess_transparent_pixels(tileImage.get());
+  const std::vector<gfx::Point> tilePts =
+    grid.tilesInCanvasRegion(gfx::Region(canvasBounds));
+  const int nthreads = std::max(1u, std::thread::hardware_concurrency());
+  std::unique_ptr<base::thread_pool> pool;
+  if (nthreads > 1 && int(tilePts.size()) >= kMinTilesInParallel)
+    pool = std::make_unique<base::thread_pool>(nthreads);
+  std::vector<NewTile> tiles;
+
+  for (int batch=0; batch<int(tilePts.size()); batch+=kTilesPerBatch) {
+    const int ntiles = std::min<int>(kTilesPerBatch, tilePts.size()-batch);
+    const int nparts = (pool && ntiles >= kMinTilesInParallel ? nthreads: 1);
+    tiles.clear();
+    tiles.resize(ntiles);
+
+    // Crop and hash the tiles in parallel
+    for_each_part(pool.get(), nparts, [&](const int part){
+      const int end = (part+1)*ntiles/nparts;
+      for (int i=part*ntiles/nparts; i<end; ++i) {
+        NewTile& tile = tiles[i];
+        tile.tilePt = tilePts[batch+i];
+
+        const gfx::Point tilePtInCanvas = grid.tileToCanvas(tile.tilePt);
+        tile.image.reset(
+          doc::crop_image(srcImage,
+                          tilePtInCanvas.x-srcImagePos.x,
+                          tilePtInCanvas.y-srcImagePos.y,
+                          tileSize.w, tileSize.h,
+                          srcImage->maskColor()));
+        if (grid.hasMask())
+          mask_image(tile.image.get(), grid.mask().get());
+
+        preprocess_transparent_pixels(tile.image.get());
+        tile.hash = calculate_image_hash(tile.image.get(),
+                                         tile.image->bounds());
+      }
+    });
 
-    doc::tile_index tileIndex;
-    doc::tile_flags tileFlag = 0;
+    // Find the first tile with the same pixels of each tile (each
+    // thread handles the tiles with a different subset of hashes)
+    for_each_part(pool.get(), nparts, [&](const int part){
+      std::unordered_multimap<uint32_t, int> firstTiles;
+      for (int i=0; i<ntiles; ++i) {
+        NewTile& tile = tiles[i];
+        if (int(tile.hash % nparts) != part)
+          continue;
+
+        auto range = firstTiles.equal_range(tile.hash);
+        for (auto it=range.first; it!=range.second; ++it) {
+          if (is_same_image(tiles[it->second].image.get(), tile.image.get())) {
+            tile.first = it->second;
+            break;
+          }
+        }
+        if (tile.first < 0) {
+          tile.first = i;
+          firstTiles.emplace(tile.hash, i);
+        }
+      }
+    });
 
-    if (!find_tile(tileset, tileImage, tileIndex, tileFlag)) {
-      auto addTile = new cmd::AddTile(tileset, tileImage);
+    // Find/add the tiles in the tileset sequentially (only the first
+    // tile of each group of tiles with the same pixels)
+    for (int i=0; i<ntiles; ++i) {
+      NewTile& tile = tiles[i];
 
-      if (cmds)
-        cmds->executeAndAdd(addTile);
-      else {
-        // TODO a little hacky
-        addTile->execute(doc->context());
+      if (tile.first != i) {
+        tile.tileIndex = tiles[tile.first].tileIndex;
+        tile.tileFlags = tiles[tile.first].tileFlags;
       }
+      else if (!find_tile(tileset, tile.image, tile.tileIndex, tile.tileFlags)) {
+        auto addTile = new cmd::AddTile(tileset, tile.image);
 
-      tileIndex = addTile->tileIndex();
+        if (cmds)
+          cmds->executeAndAdd(addTile);
+        else {
+          // TODO a little hacky
+          addTile->execute(doc->context());
+        }
 
-      if (!cmds)
-        delete addTile;
+        tile.tileIndex = addTile->tileIndex();
+        tile.tileFlags = 0;
 
-      doc->notifyAfterAddTile(dstLayer, dstCel->frame(), tileIndex);
-    }
+        if (!cmds)
+          delete addTile;
+
+        doc->notifyAfterAddTile(dstLayer, dstCel->frame(), tile.tileIndex);
+      }
 
-    // We were using newTilemap->putPixel() directly but received a
-    // crash report about an "access violation". So now we've added
-    // some checks to the operation.
-    {
-      const int u = tilePt.x-tilemapBounds.x;
-      const int v = tilePt.y-tilemapBounds.y;
-      ASSERT((u >= 0) && (v >= 0) && (u < newTilemap->width()) && (v < newTilemap->height()));
-      doc::put_pixel(newTilemap.get(), u, v,
-                     doc::tile(tileIndex, tileFlag));
+      // We were using newTilemap->putPixel() directly but received a
+      // crash report about an "access violation". So now we've added
+      // some checks to the operation.
+      {
+        const int u = tile.tilePt.x-tilemapBounds.x;
+        const int v = tile.tilePt.y-tilemapBounds.y;
+        ASSERT((u >= 0) && (v >= 0) && (u < newTilemap->width()) && (v < newTilemap->height()));
+        doc::put_pixel(newTilemap.get(), u, v,
+                       doc::tile(tile.tileIndex, tile.tileFlags));
+      }
     }
   }
 
@@ -185,6 +185,7 @@ Clipboard::Clipboard()
 Clipboard::~Clipboard()
 {
   ASSERT(g_instance == this);
+  unregisterNativeFormats();
   g_instance = nullptr;
 }
 
@@ -232,21 +233,13 @@ void Clipboard::setData(Image* image,
     // Copy tilemap to the native clipboard
     if (isTilemap) {
       ASSERT(tileset);
-      setNativeBitmap(image, mask, palette, tileset);
+      setNativeBitmap(m_data->tilemap, m_data->mask, m_data->palette,
+                      m_data->tileset, true);
     }
     // Copy non-tilemap images to the native clipboard
     else {
-      color_t oldMask = 0;
-      if (image) {
-        oldMask = image->maskColor();
-        if (!image_source_is_transparent)
-          image->setMaskColor(-1);
-      }
-
-      setNativeBitmap(image, mask, palette);
-
-      if (image && !image_source_is_transparent)
-        image->setMaskColor(oldMask);
+      setNativeBitmap(m_data->image, m_data->mask, m_data->palette,
+                      nullptr, image_source_is_transparent);
     }
   }
 }
@@ -298,8 +291,11 @@ bool Clipboard::copyFromDocument(const Site& site, bool merged)
 
 ClipboardFormat Clipboard::format() const
 {
-  // Check if the native clipboard has an image
-  if (use_native_clipboard() && hasNativeBitmap()) {
+  // Check if the native clipboard has an image (from other app, our
+  // own content is in m_data)
+  if (use_native_clipboard() &&
+      !isNativeContentOwner() &&
+      hasNativeBitmap()) {
     return ClipboardFormat::Image;
   }
   else {
@@ -782,8 +778,10 @@ void Clipboard::paste(Context* ctx,
 
 ImageRef Clipboard::getImage(Palette* palette)
 {
-  // Get the image from the native clipboard.
-  if (use_native_clipboard()) {
+  // Get the image from the native clipboard. If the native clipboard
+  // still contains what we've copied, we use m_data directly (without
+  // decoding the native formats).
+  if (use_native_clipboard() && !isNativeContentOwner()) {
     Image* native_image = nullptr;
     Mask* native_mask = nullptr;
     Palette* native_palette = nullptr;
@@ -807,7 +805,9 @@ ImageRef Clipboard::getImage(Palette* palette)
 
 bool Clipboard::getImageSize(gfx::Size& size)
 {
-  if (use_native_clipboard() && getNativeBitmapSize(&size))
+  if (use_native_clipboard() &&
+      !isNativeContentOwner() &&
+      getNativeBitmapSize(&size))
     return true;
 
   if (m_data->image) {
@@ -16,6 +16,7 @@
 #include "ui/base.h"
 #include "ui/clipboard_delegate.h"
 
+#include <cstdint>
 #include <memory>
 
 namespace doc {
@@ -103,11 +104,15 @@ namespace app {
     // Native clipboard
     void clearNativeContent();
     void registerNativeFormats();
+    void unregisterNativeFormats();
     bool hasNativeBitmap() const;
-    bool setNativeBitmap(const doc::Image* image,
-                         const doc::Mask* mask,
-                         const doc::Palette* palette,
-                         const doc::Tileset* tileset = nullptr);
+    bool isNativeContentOwner() const;
+    bool setNativeBitmap(const doc::ImageRef& image,
+                         const std::shared_ptr<doc::Mask>& mask,
+                         const std::shared_ptr<doc::Palette>& palette,
+                         const std::shared_ptr<doc::Tileset>& tileset,
+                         const bool imageSourceIsTransparent);
+    void onNativeBitmapReady(const uint64_t id);
     bool getNativeBitmap(doc::Image** image,
                          doc::Mask** mask,
                          doc::Palette** palette,
@@ -119,6 +124,10 @@ namespace app {
 
     struct Data;
     std::unique_ptr<Data> m_data;
+
+    // Native formats generated in a background thread
+    struct NativeJobs;
+    std::shared_ptr<NativeJobs> m_native;
   };
 
 } // namespace app
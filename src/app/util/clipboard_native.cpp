@@ -13,6 +13,7 @@
 
 #include "app/i18n/strings.h"
 #include "base/serialization.h"
+#include "base/thread_pool.h"
 #include "clip/clip.h"
 #include "doc/color_scales.h"
 #include "doc/file/hex_file.h"
@@ -26,7 +27,11 @@
 #include "os/system.h"
 #include "os/window.h"
 #include "ui/alert.h"
+#include "ui/system.h"
 
+#include <atomic>
+#include <mutex>
+#include <random>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -38,6 +43,7 @@ using namespace base::serialization::little_endian;
 
 namespace {
   clip::format custom_image_format = 0;
+  clip::format owner_format = 0;
   bool show_clip_errors = true;
 
   class InhibitClipErrors {
@@ -70,10 +76,165 @@ namespace {
     }
   }
 
+  // Native formats of an image converted in a background thread.
+  struct NativeBitmap {
+    std::vector<char> custom;
+    clip::image image;
+    bool hasImage = false;
+    // Keeps alive the pixels referenced by "image" (RGB images are
+    // used directly)
+    doc::ImageRef pixels;
+  };
+
+  std::unique_ptr<NativeBitmap> encode_native_bitmap(const doc::ImageRef& imageRef,
+                                                     const doc::Mask* mask,
+                                                     const doc::Palette* palette,
+                                                     const doc::Tileset* tileset)
+  {
+    const doc::Image* image = imageRef.get();
+    auto result = std::make_unique<NativeBitmap>();
+    result->pixels = imageRef;
+
+    // Set custom clipboard formats
+    if (custom_image_format) {
+      std::stringstream os;
+      write32(os,
+              (image   ? 1: 0) |
+              (mask    ? 2: 0) |
+              (palette ? 4: 0) |
+              (tileset ? 8: 0));
+      if (image) doc::write_image(os, image);
+      if (mask) doc::write_mask(os, mask);
+      if (palette) doc::write_palette(os, palette);
+      // The clipboard can be shared with other versions of the program,
+      // so we keep the tileset format that they can read.
+      if (tileset) doc::write_tileset(os, tileset, nullptr,
+                                      doc::SerialFormat::Ver2);
+
+      if (os.good()) {
+        size_t size = (size_t)os.tellp();
+        if (size > 0) {
+          result->custom.resize(size);
+          os.seekp(0);
+          os.read(&result->custom[0], size);
+        }
+      }
+    }
+
+    clip::image_spec spec;
+    spec.width = image->width();
+    spec.height = image->height();
+    spec.bits_per_pixel = 32;
+    spec.bytes_per_row = (image->pixelFormat() == doc::IMAGE_RGB ?
+                          image->rowBytes(): 4*spec.width);
+    spec.red_mask    = doc::rgba_r_mask;
+    spec.green_mask  = doc::rgba_g_mask;
+    spec.blue_mask   = doc::rgba_b_mask;
+    spec.alpha_mask  = doc::rgba_a_mask;
+    spec.red_shift   = doc::rgba_r_shift;
+    spec.green_shift = doc::rgba_g_shift;
+    spec.blue_shift  = doc::rgba_b_shift;
+    spec.alpha_shift = doc::rgba_a_shift;
+
+    switch (image->pixelFormat()) {
+      case doc::IMAGE_RGB: {
+        // We use the RGB image data directly
+        result->image = clip::image(image->getPixelAddress(0, 0), spec);
+        result->hasImage = true;
+        break;
+      }
+      case doc::IMAGE_GRAYSCALE: {
+        clip::image img(spec);
+        const doc::LockImageBits<doc::GrayscaleTraits> bits(image);
+        auto it = bits.begin();
+        uint32_t* dst = (uint32_t*)img.data();
+        for (int y=0; y<image->height(); ++y) {
+          for (int x=0; x<image->width(); ++x, ++it) {
+            doc::color_t c = *it;
+            *(dst++) = doc::rgba(doc::graya_getv(c),
+                                 doc::graya_getv(c),
+                                 doc::graya_getv(c),
+                                 doc::graya_geta(c));
+          }
+        }
+        result->image = std::move(img);
+        result->hasImage = true;
+        break;
+      }
+      case doc::IMAGE_INDEXED: {
+        clip::image img(spec);
+        const doc::LockImageBits<doc::IndexedTraits> bits(image);
+        auto it = bits.begin();
+        uint32_t* dst = (uint32_t*)img.data();
+        for (int y=0; y<image->height(); ++y) {
+          for (int x=0; x<image->width(); ++x, ++it) {
+            doc::color_t c = palette->getEntry(*it);
+
+            // Use alpha=0 for mask color
+            if (*it == image->maskColor())
+              c &= doc::rgba_rgb_mask;
+
+            *(dst++) = c;
+          }
+        }
+        result->image = std::move(img);
+        result->hasImage = true;
+        break;
+      }
+    }
+
+    return result;
+  }
+
 }
 
+// Copying a big image to the native clipboard (converting it to the
+// native formats) can take some time, so we set an "owner" format
+// in the clipboard immediately (with the ID of the copied content),
+// and the native formats are generated in a background thread and
+// set in the clipboard when they are ready (if the clipboard wasn't
+// modified by other app in the meantime).
+//
+// While the clipboard contains our owner ID, pasting in Aseprite
+// uses the internal Clipboard::Data directly (without decoding the
+// native formats).
+struct Clipboard::NativeJobs {
+  // Random number to distinguish our IDs from other processes
+  const uint64_t seed = (uint64_t(std::random_device()()) << 32) |
+                        std::random_device()();
+
+  // ID of the latest content set in the native clipboard (0 if we
+  // don't own the clipboard content)
+  std::atomic<uint64_t> id { 0 };
+
+  // Native formats ready to be set in the clipboard
+  std::mutex mutex;
+  uint64_t readyId = 0;
+  std::unique_ptr<NativeBitmap> ready;
+
+  base::thread_pool pool { 1 };
+
+  void setOwner(clip::lock& l, const uint64_t id) const {
+    const uint64_t data[2] = { seed, id };
+    l.set_data(owner_format, (const char*)data, sizeof(data));
+  }
+
+  uint64_t getOwnerId(clip::lock& l) const {
+    uint64_t data[2] = { 0, 0 };
+    if (!owner_format ||
+        !l.is_convertible(owner_format) ||
+        l.get_data_length(owner_format) != sizeof(data) ||
+        !l.get_data(owner_format, (char*)data, sizeof(data)) ||
+        data[0] != seed)
+      return 0;
+    return data[1];
+  }
+};
+
 void Clipboard::clearNativeContent()
 {
+  m_native->id = 0;
+
   clip::lock l(native_window_handle());
   l.clear();
 }
@@ -82,6 +243,22 @@ void Clipboard::registerNativeFormats()
 {
   clip::set_error_handler(custom_error_handler);
   custom_image_format = clip::register_format("org.aseprite.Image");
+  owner_format = clip::register_format("org.aseprite.ClipboardOwner");
+
+  m_native = std::make_shared<NativeJobs>();
+}
+
+void Clipboard::unregisterNativeFormats()
+{
+  // Set the latest content in the clipboard before we close (so it's
+  // available to other apps)
+  m_native->pool.wait_all();
+  if (m_native->id &&
+      os::instance() &&
+      os::instance()->defaultWindow()) {
+    onNativeBitmapReady(m_native->id);
+  }
+  m_native.reset();
 }
 
 bool Clipboard::hasNativeBitmap() const
@@ -90,108 +267,99 @@ bool Clipboard::hasNativeBitmap() const
   return clip::has(clip::image_format());
 }
 
-bool Clipboard::setNativeBitmap(const doc::Image* image,
-                                const doc::Mask* mask,
-                                const doc::Palette* palette,
-                                const doc::Tileset* tileset)
+bool Clipboard::isNativeContentOwner() const
 {
-  clip::lock l(native_window_handle());
-  if (!l.locked())
+  const uint64_t id = m_native->id;
+  if (!id)
     return false;
 
-  l.clear();
+  InhibitClipErrors ice;
+  clip::lock l(native_window_handle());
+  return (l.locked() && m_native->getOwnerId(l) == id);
+}
 
-  if (!image)
-    return false;
+bool Clipboard::setNativeBitmap(const doc::ImageRef& image,
+                                const std::shared_ptr<doc::Mask>& mask,
+                                const std::shared_ptr<doc::Palette>& palette,
+                                const std::shared_ptr<doc::Tileset>& tileset,
+                                const bool imageSourceIsTransparent)
+{
+  // New ID for this content (pending jobs of previous contents are
+  // discarded)
+  const uint64_t id = ++m_native->id;
 
-  // Set custom clipboard formats
-  if (custom_image_format) {
-    std::stringstream os;
-    write32(os,
-            (image   ? 1: 0) |
-            (mask    ? 2: 0) |
-            (palette ? 4: 0) |
-            (tileset ? 8: 0));
-    if (image) doc::write_image(os, image);
-    if (mask) doc::write_mask(os, mask);
-    if (palette) doc::write_palette(os, palette);
-    if (tileset) doc::write_tileset(os, tileset);
-
-    if (os.good()) {
-      size_t size = (size_t)os.tellp();
-      if (size > 0) {
-        std::vector<char> data(size);
-        os.seekp(0);
-        os.read(&data[0], size);
-
-        l.set_data(custom_image_format, &data[0], size);
-      }
-    }
+  {
+    clip::lock l(native_window_handle());
+    if (!l.locked())
+      return false;
+
+    l.clear();
+
+    if (!image)
+      return false;
+
+    m_native->setOwner(l, id);
   }
 
-  clip::image_spec spec;
-  spec.width = image->width();
-  spec.height = image->height();
-  spec.bits_per_pixel = 32;
-  spec.bytes_per_row = (image->pixelFormat() == doc::IMAGE_RGB ?
-                        image->rowBytes(): 4*spec.width);
-  spec.red_mask    = doc::rgba_r_mask;
-  spec.green_mask  = doc::rgba_g_mask;
-  spec.blue_mask   = doc::rgba_b_mask;
-  spec.alpha_mask  = doc::rgba_a_mask;
-  spec.red_shift   = doc::rgba_r_shift;
-  spec.green_shift = doc::rgba_g_shift;
-  spec.blue_shift  = doc::rgba_b_shift;
-  spec.alpha_shift = doc::rgba_a_shift;
-
-  switch (image->pixelFormat()) {
-    case doc::IMAGE_RGB: {
-      // We use the RGB image data directly
-      clip::image img(image->getPixelAddress(0, 0), spec);
-      l.set_image(img);
-      break;
-    }
-    case doc::IMAGE_GRAYSCALE: {
-      clip::image img(spec);
-      const doc::LockImageBits<doc::GrayscaleTraits> bits(image);
-      auto it = bits.begin();
-      uint32_t* dst = (uint32_t*)img.data();
-      for (int y=0; y<image->height(); ++y) {
-        for (int x=0; x<image->width(); ++x, ++it) {
-          doc::color_t c = *it;
-          *(dst++) = doc::rgba(doc::graya_getv(c),
-                               doc::graya_getv(c),
-                               doc::graya_getv(c),
-                               doc::graya_geta(c));
-        }
-      }
-      l.set_image(img);
-      break;
-    }
-    case doc::IMAGE_INDEXED: {
-      clip::image img(spec);
-      const doc::LockImageBits<doc::IndexedTraits> bits(image);
-      auto it = bits.begin();
-      uint32_t* dst = (uint32_t*)img.data();
-      for (int y=0; y<image->height(); ++y) {
-        for (int x=0; x<image->width(); ++x, ++it) {
-          doc::color_t c = palette->getEntry(*it);
+  // Opaque images are copied without mask color (the copy shares the
+  // pixels with the original image)
+  doc::ImageRef src = image;
+  if (!imageSourceIsTransparent) {
+    src.reset(doc::Image::createCopy(image.get()));
+    src->setMaskColor(-1);
+  }
 
-          // Use alpha=0 for mask color
-          if (*it == image->maskColor())
-            c &= doc::rgba_rgb_mask;
+  NativeJobs* jobs = m_native.get();
+  jobs->pool.execute([jobs, id, src, mask, palette, tileset]{
+    // Skip this content if something else was copied
+    if (jobs->id != id)
+      return;
 
-          *(dst++) = c;
-        }
-      }
-      l.set_image(img);
-      break;
+    auto bitmap = encode_native_bitmap(src, mask.get(), palette.get(), tileset.get());
+    {
+      const std::lock_guard lock(jobs->mutex);
+      if (jobs->id != id)
+        return;
+      jobs->readyId = id;
+      jobs->ready = std::move(bitmap);
     }
-  }
 
+    ui::execute_from_ui_thread([id]{
+      if (Clipboard* clipboard = Clipboard::instance())
+        clipboard->onNativeBitmapReady(id);
+    });
+  });
   return true;
 }
 
+void Clipboard::onNativeBitmapReady(const uint64_t id)
+{
+  std::unique_ptr<NativeBitmap> bitmap;
+  {
+    const std::lock_guard lock(m_native->mutex);
+    if (m_native->readyId != id || m_native->id != id)
+      return;
+    bitmap = std::move(m_native->ready);
+  }
+  if (!bitmap)
+    return;
+
+  clip::lock l(native_window_handle());
+  if (!l.locked())
+    return;
+
+  // Other app has modified the clipboard content
+  if (m_native->getOwnerId(l) != id)
+    return;
+
+  l.clear();
+  m_native->setOwner(l, id);
+  if (!bitmap->custom.empty())
+    l.set_data(custom_image_format, &bitmap->custom[0], bitmap->custom.size());
+  if (bitmap->hasImage)
+    l.set_image(bitmap->image);
+}
+
 bool Clipboard::getNativeBitmap(doc::Image** image,
                                 doc::Mask** mask,
                                 doc::Palette** palette,
@@ -220,7 +388,8 @@ bool Clipboard::getNativeBitmap(doc::Image** image,
         if (bits & 1) *image   = doc::read_image(is, false);
         if (bits & 2) *mask    = doc::read_mask(is);
         if (bits & 4) *palette = doc::read_palette(is);
-        if (bits & 8) *tileset = doc::read_tileset(is, nullptr);
+        if (bits & 8) *tileset = doc::read_tileset(is, nullptr, true, nullptr,
+                                                   doc::SerialFormat::Ver2);
         if (image)
           return true;
       }
@@ -337,6 +506,8 @@ bool Clipboard::getNativeBitmapSize(gfx::Size* size)
 bool Clipboard::setNativePalette(const doc::Palette* palette,
                                  const doc::PalettePicks& picks)
 {
+  m_native->id = 0;
+
   clip::lock l(native_window_handle());
   if (!l.locked())
     return false;
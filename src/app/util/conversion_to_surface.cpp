@@ -17,6 +17,7 @@
 #include "doc/image_impl.h"
 #include "doc/palette.h"
 #include "doc/rgbmap.h"
+#include "doc/simd.h"
 #include "os/surface.h"
 #include "os/surface_format.h"
 
@@ -26,6 +27,7 @@
 
 #include <algorithm>
 #include <stdexcept>
+#include <utility>
 
 namespace app {
 
@@ -136,6 +138,78 @@ void convert_image_to_surface_selector(const Image* image, os::Surface* surface,
   }
 }
 
+// Returns true if the surface uses 32bpp with 8 bits for each
+// channel in the given positions.
+bool is_32bpp_surface(const os::SurfaceFormatData* fd,
+                      const int rShift, const int gShift,
+                      const int bShift, const int aShift)
+{
+  return (fd->bitsPerPixel == 32 &&
+          fd->redShift == rShift &&
+          fd->greenShift == gShift &&
+          fd->blueShift == bShift &&
+          fd->alphaShift == aShift &&
+          fd->redMask == (0xffu << rShift) &&
+          fd->greenMask == (0xffu << gShift) &&
+          fd->blueMask == (0xffu << bShift) &&
+          fd->alphaMask == (0xffu << aShift));
+}
+
+// Copies a row of RGBA pixels swapping the red and blue channels
+// (for BGRA surfaces).
+void copy_row_swapping_rb(const uint32_t* src, uint32_t* dst, const int w)
+{
+  int u = 0;
+#if DOC_SIMD_SSE2
+  const __m128i agMask = _mm_set1_epi32(int(0xff00ff00));
+  const __m128i lowMask = _mm_set1_epi32(0x000000ff);
+  for (; u+4 <= w; u+=4, src+=4, dst+=4) {
+    const __m128i c = _mm_loadu_si128((const __m128i*)src);
+    const __m128i r = _mm_slli_epi32(_mm_and_si128(c, lowMask), 16);
+    const __m128i b = _mm_and_si128(_mm_srli_epi32(c, 16), lowMask);
+    _mm_storeu_si128((__m128i*)dst,
+                     _mm_or_si128(_mm_and_si128(c, agMask),
+                                  _mm_or_si128(r, b)));
+  }
+#elif DOC_SIMD_NEON
+  for (; u+16 <= w; u+=16, src+=16, dst+=16) {
+    uint8x16x4_t c = vld4q_u8((const uint8_t*)src);
+    std::swap(c.val[0], c.val[2]);
+    vst4q_u8((uint8_t*)dst, c);
+  }
+#endif
+  for (; u<w; ++u, ++src, ++dst) {
+    const uint32_t c = *src;
+    *dst = ((c & 0xff00ff00) |
+            ((c & 0xff) << 16) |
+            ((c >> 16) & 0xff));
+  }
+}
+
+// Converts indexed images to 32bpp surfaces using a table with the
+// surface color of each palette entry.
+void convert_indexed_image_to_32bpp_surface(
+  const Image* image, os::Surface* dst,
+  int src_x, int src_y, int dst_x, int dst_y, int w, int h,
+  const Palette* palette, const os::SurfaceFormatData* fd)
+{
+  uint32_t colors[256];
+  for (int i=0; i<256; ++i) {
+    if (i == int(image->maskColor()) || i >= palette->size())
+      colors[i] = 0;
+    else
+      colors[i] = convert_color_to_surface<RgbTraits, os::kRgbaSurfaceFormat>(
+        palette->getEntry(i), palette, image->spec(), fd);
+  }
+
+  for (int v=0; v<h; ++v, ++src_y, ++dst_y) {
+    const uint8_t* src_address = image->getPixelAddress(src_x, src_y);
+    uint32_t* dst_address = (uint32_t*)dst->getData(dst_x, dst_y);
+    for (int u=0; u<w; ++u)
+      dst_address[u] = colors[src_address[u]];
+  }
+}
+
 } // anonymous namespace
 
 
@@ -188,7 +262,18 @@ void convert_image_to_surface(
                     src_address + RgbTraits::bytes_per_pixel * w,
                     dst_address);
         }
-        return;
+        break;
+      }
+      // Same format with red and blue channels swapped (BGRA)
+      if (is_32bpp_surface(&fd,
+                           gfx::ColorBShift, gfx::ColorGShift,
+                           gfx::ColorRShift, gfx::ColorAShift)) {
+        for (int v=0; v<h; ++v, ++src_y, ++dst_y) {
+          copy_row_swapping_rb(
+            (const uint32_t*)image->getPixelAddress(src_x, src_y),
+            (uint32_t*)surface->getData(dst_x, dst_y), w);
+        }
+        break;
       }
       convert_image_to_surface_selector<RgbTraits>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, &fd);
       break;
@@ -198,6 +283,10 @@ void convert_image_to_surface(
       break;
 
     case IMAGE_INDEXED:
+      if (fd.bitsPerPixel == 32) {
+        convert_indexed_image_to_32bpp_surface(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, &fd);
+        break;
+      }
       convert_image_to_surface_selector<IndexedTraits>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, &fd);
       break;
 
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -33,6 +33,7 @@
 #include "doc/layer_tilemap.h"
 #include "doc/primitives.h"
 #include "doc/sprite.h"
+#include "doc/task_scheduler.h"
 #include "doc/tileset.h"
 #include "doc/tileset_hash_table.h"
 #include "doc/tilesets.h"
@@ -41,8 +42,14 @@
 #include "gfx/size_io.h"
 #include "render/render.h"
 
+#include <algorithm>
+
 namespace {
 
+// Size of the tiles used to keep track of the validated areas of the
+// source/destination canvas.
+constexpr int kValidTileSize = 64;
+
 // We cannot have two ExpandCelCanvas instances at the same time
 // (because we share ImageBuffers between them).
 static app::ExpandCelCanvas* singleton = nullptr;
@@ -99,6 +106,12 @@ ExpandCelCanvas::ExpandCelCanvas(
   }
   m_canCompareSrcVsDst = ((m_flags & NeedsSource) == NeedsSource);
 
+  // Only validated tiles of the source canvas are read, except in
+  // tiled mode (inks can read pixels from the other side of the
+  // canvas) and in tiles mode (the flood fill uses the whole tilemap).
+  m_clearSrcImage = (tiledMode != TiledMode::NONE ||
+                     m_tilemapMode == TilemapMode::Tiles);
+
   ASSERT(!singleton);
   singleton = this;
 
@@ -168,6 +181,11 @@ ExpandCelCanvas::ExpandCelCanvas(
             "m_bounds=", m_bounds,
             "m_grid=", m_grid.origin(), m_grid.tileSize());
 
+  m_tiles = gfx::Size((m_bounds.w + kValidTileSize - 1) / kValidTileSize,
+                      (m_bounds.h + kValidTileSize - 1) / kValidTileSize);
+  m_validSrcTiles.resize(m_tiles.w*m_tiles.h, false);
+  m_validDstTiles.resize(m_tiles.w*m_tiles.h, false);
+
   if (m_celCreated) {
     // Calling "getDestCanvas()" we create the m_dstImage
     getDestCanvas();
@@ -212,8 +230,8 @@ ExpandCelCanvas::~ExpandCelCanvas()
 void ExpandCelCanvas::commit()
 {
   EXP_TRACE("ExpandCelCanvas::commit",
-            "validSrcRegion", m_validSrcRegion.bounds(),
-            "validDstRegion", m_validDstRegion.bounds());
+            "validSrcRegion", validTilesRegion(m_validSrcTiles).bounds(),
+            "validDstRegion", validTilesRegion(m_validDstTiles).bounds());
 
   ASSERT(!m_closed);
   ASSERT(!m_committed);
@@ -295,17 +313,35 @@ void ExpandCelCanvas::commit()
     }
 #endif
 
-    gfx::Region* regionToPatch = &m_validDstRegion;
+    gfx::Region validDstRegion = validTilesRegion(m_validDstTiles);
+    gfx::Region* regionToPatch = &validDstRegion;
     gfx::Region reduced;
 
     if (m_canCompareSrcVsDst) {
-      ASSERT(gfx::Region().createSubtraction(m_validDstRegion, m_validSrcRegion).isEmpty());
+      std::vector<int> tiles;
+      for (int i=0; i<int(m_validDstTiles.size()); ++i) {
+        if (m_validDstTiles[i]) {
+          ASSERT(m_validSrcTiles[i]);
+          tiles.push_back(i);
+        }
+      }
 
-      for (gfx::Rect rc : m_validDstRegion) {
-        if (algorithm::shrink_bounds2(getSourceCanvas(),
-                                      getDestCanvas(), rc, rc)) {
+      // Compare each valid tile in parallel
+      const Image* src = getSourceCanvas();
+      const Image* dst = getDestCanvas();
+      std::vector<gfx::Rect> diffs(tiles.size());
+      doc::parallel_for(
+        0, int(tiles.size()), 4,
+        [this, src, dst, &tiles, &diffs](const int from, const int to){
+          for (int i=from; i<to; ++i) {
+            if (!algorithm::shrink_bounds2(src, dst, tileBounds(tiles[i]), diffs[i]))
+              diffs[i] = gfx::Rect();
+          }
+        });
+
+      for (const auto& rc : diffs) {
+        if (!rc.isEmpty())
           reduced |= gfx::Region(rc);
-        }
       }
 
       regionToPatch = &reduced;
@@ -471,7 +507,8 @@ Image* ExpandCelCanvas::getSourceCanvas()
                                      m_bounds.w, m_bounds.h, src_buffer));
       m_srcImage->setMaskColor(m_sprite->transparentColor());
     }
-    m_srcImage->clear(m_srcImage->maskColor());
+    if (m_clearSrcImage)
+      m_srcImage->clear(m_srcImage->maskColor());
   }
   return m_srcImage.get();
 }
@@ -536,27 +573,33 @@ void ExpandCelCanvas::validateSourceCanvas(const gfx::Region& rgn)
   EXP_TRACE(" ->", rgnToValidate.bounds());
 
   rgnToValidate.offset(zeroPos);
-  rgnToValidate.createSubtraction(rgnToValidate, m_validSrcRegion);
   rgnToValidate.createIntersection(rgnToValidate, gfx::Region(m_srcImage->bounds()));
 
+  const std::vector<gfx::Rect> rects = validateTiles(rgnToValidate, m_validSrcTiles);
+  if (rects.empty())
+    return;
+
   if (m_celImage && previewSpecificLayerChanges()) {
-    gfx::Region rgnToClear;
-    rgnToClear.createSubtraction(
-      rgnToValidate,
-      gfx::Region(m_celImage->bounds()
-                  .offset(origCelPos)
-                  .offset(zeroPos)));
-    for (const auto& rc : rgnToClear)
-      fill_rect(m_srcImage.get(), rc, m_srcImage->maskColor());
+    const gfx::Region celRgn(m_celImage->bounds()
+                             .offset(origCelPos)
+                             .offset(zeroPos));
+    for (const auto& rc : rects) {
+      gfx::Region rgnToClear;
+      rgnToClear.createSubtraction(gfx::Region(rc), celRgn);
+      for (const auto& rc2 : rgnToClear)
+        fill_rect(m_srcImage.get(), rc2, m_srcImage->maskColor());
+    }
 
     if (m_celImage->pixelFormat() == IMAGE_TILEMAP &&
         m_srcImage->pixelFormat() != IMAGE_TILEMAP) {
       ASSERT(m_tilemapMode == TilemapMode::Pixels);
 
       // For tilemaps, we can use the Render class to render visible
-      // tiles in the rgnToValidate of this cel.
+      // tiles in the validated tiles of this cel (the tiles are
+      // cleared first as the render composites the cel).
       render::Render subRender;
-      for (const auto& rc : rgnToValidate) {
+      for (const auto& rc : rects) {
+        fill_rect(m_srcImage.get(), rc, m_srcImage->maskColor());
         subRender.renderCel(
           m_srcImage.get(),
           m_cel,
@@ -576,7 +619,7 @@ void ExpandCelCanvas::validateSourceCanvas(const gfx::Region& rgn)
       ASSERT(m_tilemapMode == TilemapMode::Tiles);
 
       // We can copy the cel image directly
-      for (const auto& rc : rgnToValidate) {
+      for (const auto& rc : rects) {
         m_srcImage->copy(
           m_celImage.get(),
           gfx::Clip(rc.x, rc.y,
@@ -589,7 +632,7 @@ void ExpandCelCanvas::validateSourceCanvas(const gfx::Region& rgn)
              m_tilemapMode == TilemapMode::Tiles);
 
       // We can copy the cel image directly
-      for (const auto& rc : rgnToValidate)
+      for (const auto& rc : rects)
         m_srcImage->copy(
           m_celImage.get(),
           gfx::Clip(rc.x, rc.y,
@@ -598,30 +641,17 @@ void ExpandCelCanvas::validateSourceCanvas(const gfx::Region& rgn)
     }
   }
   else {
-    for (const auto& rc : rgnToValidate)
+    for (const auto& rc : rects)
       fill_rect(m_srcImage.get(), rc, m_srcImage->maskColor());
   }
-
-  m_validSrcRegion.createUnion(m_validSrcRegion, rgnToValidate);
 }
 
 void ExpandCelCanvas::validateDestCanvas(const gfx::Region& rgn)
 {
   EXP_TRACE("ExpandCelCanvas::validateDestCanvas", rgn.bounds());
 
-  Image* src;
-  int src_x, src_y;
-  if ((m_flags & NeedsSource) == NeedsSource) {
+  if ((m_flags & NeedsSource) == NeedsSource)
     validateSourceCanvas(rgn);
-    src = m_srcImage.get();
-    src_x = m_bounds.x;
-    src_y = m_bounds.y;
-  }
-  else {
-    src = m_cel->image();
-    src_x = m_origCelPos.x;
-    src_y = m_origCelPos.y;
-  }
 
   getDestCanvas();              // Create m_dstImage
 
@@ -637,31 +667,9 @@ void ExpandCelCanvas::validateDestCanvas(const gfx::Region& rgn)
 
   if (m_tilemapMode != TilemapMode::Tiles)
     rgnToValidate.offset(-m_bounds.origin());
-  rgnToValidate.createSubtraction(rgnToValidate, m_validDstRegion);
   rgnToValidate.createIntersection(rgnToValidate, gfx::Region(m_dstImage->bounds()));
 
-  // ASSERT(src);                  // TODO is it always true?
-  if (src) {
-    gfx::Region rgnToClear;
-    rgnToClear.createSubtraction(rgnToValidate,
-      gfx::Region(src->bounds()
-        .offset(src_x, src_y)
-        .offset(-m_bounds.origin())));
-    for (const auto& rc : rgnToClear)
-      fill_rect(m_dstImage.get(), rc, m_dstImage->maskColor());
-
-    for (const auto& rc : rgnToValidate)
-      m_dstImage->copy(src,
-        gfx::Clip(rc.x, rc.y,
-          rc.x+m_bounds.x-src_x,
-          rc.y+m_bounds.y-src_y, rc.w, rc.h));
-  }
-  else {
-    for (const auto& rc : rgnToValidate)
-      fill_rect(m_dstImage.get(), rc, m_dstImage->maskColor());
-  }
-
-  m_validDstRegion.createUnion(m_validDstRegion, rgnToValidate);
+  copySourceToDestCanvas(validateTiles(rgnToValidate, m_validDstTiles));
 }
 
 void ExpandCelCanvas::validateDestTileset(const gfx::Region& rgn, const gfx::Region& forceRgn)
@@ -687,7 +695,7 @@ void ExpandCelCanvas::validateDestTileset(const gfx::Region& rgn, const gfx::Reg
 void ExpandCelCanvas::invalidateDestCanvas()
 {
   EXP_TRACE("ExpandCelCanvas::invalidateDestCanvas");
-  m_validDstRegion.clear();
+  std::fill(m_validDstTiles.begin(), m_validDstTiles.end(), false);
 
   // Copy tileset for preview again
   // TODO Is there a way to avoid copying tiles that weren't modified? comparing versions maybe?
@@ -701,7 +709,30 @@ void ExpandCelCanvas::invalidateDestCanvas(const gfx::Region& rgn)
 
   gfx::Region rgnToInvalidate(rgn);
   rgnToInvalidate.offset(-m_bounds.origin());
-  m_validDstRegion.createSubtraction(m_validDstRegion, rgnToInvalidate);
+  rgnToInvalidate.createIntersection(rgnToInvalidate,
+                                     gfx::Region(gfx::Rect(0, 0, m_bounds.w, m_bounds.h)));
+
+  // Tiles completely inside the region are invalidated, and the
+  // invalidated part of the other valid tiles is restored from the
+  // source right now.
+  std::vector<gfx::Rect> rectsToRestore;
+  for (const int i : tilesIn(rgnToInvalidate)) {
+    if (!m_validDstTiles[i])
+      continue;
+
+    gfx::Region rest(tileBounds(i));
+    rest.createSubtraction(rest, rgnToInvalidate);
+    if (rest.isEmpty()) {
+      m_validDstTiles[i] = false;
+    }
+    else {
+      gfx::Region tileRgn(tileBounds(i));
+      tileRgn.createIntersection(tileRgn, rgnToInvalidate);
+      for (const auto& rc : tileRgn)
+        rectsToRestore.push_back(rc);
+    }
+  }
+  copySourceToDestCanvas(rectsToRestore);
 }
 
 void ExpandCelCanvas::copyValidDestToSourceCanvas(const gfx::Region& rgn)
@@ -710,11 +741,17 @@ void ExpandCelCanvas::copyValidDestToSourceCanvas(const gfx::Region& rgn)
 
   gfx::Region rgn2(rgn);
   rgn2.offset(-m_bounds.origin());
-  rgn2.createIntersection(rgn2, m_validSrcRegion);
-  rgn2.createIntersection(rgn2, m_validDstRegion);
-  for (const auto& rc : rgn2)
-    m_srcImage->copy(m_dstImage.get(),
-      gfx::Clip(rc.x, rc.y, rc.x, rc.y, rc.w, rc.h));
+  rgn2.createIntersection(rgn2, gfx::Region(m_srcImage->bounds()));
+  for (const int i : tilesIn(rgn2)) {
+    if (!m_validSrcTiles[i] || !m_validDstTiles[i])
+      continue;
+
+    gfx::Region tileRgn(tileBounds(i));
+    tileRgn.createIntersection(tileRgn, rgn2);
+    for (const auto& rc : tileRgn)
+      m_srcImage->copy(m_dstImage.get(),
+        gfx::Clip(rc.x, rc.y, rc.x, rc.y, rc.w, rc.h));
+  }
 
   // We cannot compare src vs dst in this case (e.g. on tools like
   // spray and jumble that updated the source image from the modified
@@ -758,4 +795,114 @@ void ExpandCelCanvas::copySourceTilestToDestTileset()
   }
 }
 
+std::vector<int> ExpandCelCanvas::tilesIn(const gfx::Region& rgn) const
+{
+  std::vector<int> tiles;
+  for (const auto& rc : rgn) {
+    if (rc.isEmpty())
+      continue;
+
+    ASSERT(rc.x >= 0 && rc.y >= 0);
+    const int tx1 = rc.x / kValidTileSize;
+    const int ty1 = rc.y / kValidTileSize;
+    const int tx2 = (rc.x2()-1) / kValidTileSize;
+    const int ty2 = (rc.y2()-1) / kValidTileSize;
+    for (int ty=ty1; ty<=ty2; ++ty)
+      for (int tx=tx1; tx<=tx2; ++tx)
+        tiles.push_back(ty*m_tiles.w + tx);
+  }
+  std::sort(tiles.begin(), tiles.end());
+  tiles.erase(std::unique(tiles.begin(), tiles.end()), tiles.end());
+  return tiles;
+}
+
+std::vector<gfx::Rect> ExpandCelCanvas::validateTiles(const gfx::Region& rgn,
+                                                      std::vector<bool>& validTiles)
+{
+  std::vector<gfx::Rect> rects;
+  for (const int i : tilesIn(rgn)) {
+    if (validTiles[i])
+      continue;
+
+    validTiles[i] = true;
+
+    // Join consecutive tiles of the same row
+    const gfx::Rect rc = tileBounds(i);
+    if (!rects.empty() &&
+        rects.back().y == rc.y &&
+        rects.back().x2() == rc.x) {
+      rects.back().w += rc.w;
+    }
+    else {
+      rects.push_back(rc);
+    }
+  }
+  return rects;
+}
+
+gfx::Region ExpandCelCanvas::validTilesRegion(const std::vector<bool>& validTiles) const
+{
+  gfx::Region rgn;
+  for (int ty=0; ty<m_tiles.h; ++ty) {
+    for (int tx=0; tx<m_tiles.w; ) {
+      if (!validTiles[ty*m_tiles.w + tx]) {
+        ++tx;
+        continue;
+      }
+      const int tx1 = tx;
+      while (tx < m_tiles.w && validTiles[ty*m_tiles.w + tx])
+        ++tx;
+      rgn |= gfx::Region(tileBounds(ty*m_tiles.w + tx1) |
+                         tileBounds(ty*m_tiles.w + tx-1));
+    }
+  }
+  return rgn;
+}
+
+gfx::Rect ExpandCelCanvas::tileBounds(const int tileIndex) const
+{
+  return gfx::Rect((tileIndex % m_tiles.w) * kValidTileSize,
+                   (tileIndex / m_tiles.w) * kValidTileSize,
+                   kValidTileSize, kValidTileSize)
+    .createIntersection(gfx::Rect(0, 0, m_bounds.w, m_bounds.h));
+}
+
+void ExpandCelCanvas::copySourceToDestCanvas(const std::vector<gfx::Rect>& rects)
+{
+  Image* src;
+  int src_x, src_y;
+  if ((m_flags & NeedsSource) == NeedsSource) {
+    src = m_srcImage.get();
+    src_x = m_bounds.x;
+    src_y = m_bounds.y;
+  }
+  else {
+    src = m_cel->image();
+    src_x = m_origCelPos.x;
+    src_y = m_origCelPos.y;
+  }
+
+  // ASSERT(src);                  // TODO is it always true?
+  if (src) {
+    const gfx::Region srcRgn(src->bounds()
+                             .offset(src_x, src_y)
+                             .offset(-m_bounds.origin()));
+    for (const auto& rc : rects) {
+      gfx::Region rgnToClear;
+      rgnToClear.createSubtraction(gfx::Region(rc), srcRgn);
+      for (const auto& rc2 : rgnToClear)
+        fill_rect(m_dstImage.get(), rc2, m_dstImage->maskColor());
+
+      m_dstImage->copy(src,
+        gfx::Clip(rc.x, rc.y,
+          rc.x+m_bounds.x-src_x,
+          rc.y+m_bounds.y-src_y, rc.w, rc.h));
+    }
+  }
+  else {
+    for (const auto& rc : rects)
+      fill_rect(m_dstImage.get(), rc, m_dstImage->maskColor());
+  }
+}
+
 } // namespace app
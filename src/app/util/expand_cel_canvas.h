@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2021  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -21,6 +21,8 @@
 #include "gfx/region.h"
 #include "gfx/size.h"
 
+#include <vector>
+
 namespace doc {
   class Cel;
   class Image;
@@ -98,6 +100,18 @@ namespace app {
     ImageRef trimDstImage(const gfx::Rect& bounds) const;
     void copySourceTilestToDestTileset();
 
+    // Returns the indexes of the tiles touched by the given region
+    // (sorted and without duplicates).
+    std::vector<int> tilesIn(const gfx::Region& rgn) const;
+    // Returns the tiles (as runs of tiles of the same row) touched by
+    // the given region (in m_srcImage/m_dstImage coordinates) which
+    // are not in "validTiles", and marks them as valid.
+    std::vector<gfx::Rect> validateTiles(const gfx::Region& rgn,
+                                         std::vector<bool>& validTiles);
+    gfx::Region validTilesRegion(const std::vector<bool>& validTiles) const;
+    gfx::Rect tileBounds(int tileIndex) const;
+    void copySourceToDestCanvas(const std::vector<gfx::Rect>& rects);
+
     bool isTilesetPreview() const {
       return ((m_flags & TilesetPreview) == TilesetPreview);
     }
@@ -130,8 +144,17 @@ namespace app {
     bool m_closed;
     bool m_committed;
     CmdSequence* m_cmds;
-    gfx::Region m_validSrcRegion;
-    gfx::Region m_validDstRegion;
+
+    // Tiles of m_srcImage/m_dstImage that were already validated
+    // (row by row, m_tiles.w x m_tiles.h tiles), so each tool-loop
+    // step only checks the tiles touched by the stroke.
+    gfx::Size m_tiles;
+    std::vector<bool> m_validSrcTiles;
+    std::vector<bool> m_validDstTiles;
+
+    // True if the whole m_srcImage must be cleared when it's created
+    // (instead of clearing/copying only the validated tiles).
+    bool m_clearSrcImage;
 
     // True if we can compare src image with dst image to patch the
     // cel. This is false when dst is copied to the src, so we cannot
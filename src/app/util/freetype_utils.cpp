@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -20,88 +20,194 @@
 #include "ft/face.h"
 #include "ft/hb_shaper.h"
 #include "ft/lib.h"
+#include "gfx/rect.h"
 
+#include <map>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
+#include <tuple>
+#include <vector>
 
 namespace app {
 
-doc::Image* render_text(const std::string& fontfile, int fontsize,
-                        const std::string& text,
-                        doc::color_t color,
-                        bool antialias)
-{
-  std::unique_ptr<doc::Image> image(nullptr);
-  ft::Lib ft;
+namespace {
+
+// Glyph bitmap converted to 8-bit alpha values (so monochrome
+// bitmaps don't need to be unpacked each time they are used).
+struct GlyphBitmap {
+  int w = 0;
+  int h = 0;
+  std::vector<uint8_t> alpha;
+};
+
+struct ShapedGlyph {
+  const GlyphBitmap* bitmap;
+  int x, y;
+};
+
+// Result of shaping a string with a specific font/size/antialias.
+struct ShapedText {
+  gfx::Rect bounds;
+  std::vector<ShapedGlyph> glyphs;
+};
+
+// Caches the opened fonts, the rasterized glyphs, and the shaped
+// texts, so rendering the same text again (e.g. with other color)
+// doesn't need FreeType/HarfBuzz at all, and new texts rasterize only
+// the glyphs that weren't used before.
+class TextCache {
+  static constexpr size_t kMaxFaces = 16;
+  static constexpr size_t kMaxGlyphs = 4096;
+  static constexpr size_t kMaxShapedTexts = 64;
+
+  // Font file, size, glyph index, antialias
+  using GlyphKey = std::tuple<std::string, int, unsigned, bool>;
+  // Font file, size, antialias, text
+  using TextKey = std::tuple<std::string, int, bool, std::string>;
+
+public:
+  static TextCache& instance() {
+    static TextCache cache;
+    return cache;
+  }
+
+  std::mutex& mutex() { return m_mutex; }
+
+  // Returns the shaped text, which is valid until the next call to
+  // this function (the mutex must be locked meanwhile).
+  const ShapedText& shapeText(const std::string& fontfile,
+                              const int fontsize,
+                              const std::string& text,
+                              const bool antialias) {
+    TextKey textKey(fontfile, fontsize, antialias, text);
+    auto it = m_texts.find(textKey);
+    if (it != m_texts.end())
+      return it->second;
 
-  ft::Face face(ft.open(fontfile));
-  if (face.isValid()) {
-    // Set font size
+    ft::Face& face = getFace(fontfile);
     face.setSize(fontsize);
     face.setAntialias(antialias);
 
-    // Calculate text size
-    gfx::Rect bounds = ft::calc_text_bounds(face, text);
-
-    // Render the image and copy it to the clipboard
-    if (!bounds.isEmpty()) {
-      image.reset(doc::Image::create(doc::IMAGE_RGB, bounds.w, bounds.h));
-      doc::clear_image(image.get(), 0);
-
-      ft::ForEachGlyph<ft::Face> feg(face, text);
-      while (feg.next()) {
-        auto glyph = feg.glyph();
-        if (!glyph)
-          continue;
-
-        int t, yimg = - bounds.y + int(glyph->y);
-
-        for (int v=0; v<int(glyph->bitmap->rows); ++v, ++yimg) {
-          const uint8_t* p = glyph->bitmap->buffer + v*glyph->bitmap->pitch;
-          int ximg = - bounds.x + int(glyph->x);
-          int bit = 0;
-
-          for (int u=0; u<int(glyph->bitmap->width); ++u, ++ximg) {
-            int alpha;
-
-            if (antialias) {
-              alpha = *(p++);
-            }
-            else {
-              alpha = ((*p) & (1 << (7 - (bit++))) ? 255: 0);
-              if (bit == 8) {
-                bit = 0;
-                ++p;
-              }
-            }
-
-            int output_alpha = MUL_UN8(doc::rgba_geta(color), alpha, t);
-            if (output_alpha) {
-              doc::color_t output_color =
-                doc::rgba(doc::rgba_getr(color),
-                          doc::rgba_getg(color),
-                          doc::rgba_getb(color),
-                          output_alpha);
-
-              doc::put_pixel(
-                image.get(), ximg, yimg,
-                doc::rgba_blender_normal(
-                  doc::get_pixel(image.get(), ximg, yimg),
-                  output_color));
-            }
-          }
-        }
-      }
+    // Glyphs are referenced by the shaped texts, so we discard both
+    // caches together.
+    if (m_glyphs.size() >= kMaxGlyphs ||
+        m_texts.size() >= kMaxShapedTexts) {
+      m_texts.clear();
+      m_glyphs.clear();
     }
-    else {
-      throw std::runtime_error("There is no text");
+
+    // Same bounds as ft::calc_text_bounds() but calculated in the
+    // same pass that rasterizes the glyphs.
+    ShapedText shaped;
+    shaped.bounds = gfx::Rect(0, 0, 0, 0);
+
+    ft::ForEachGlyph<ft::Face> feg(face, text);
+    while (feg.next()) {
+      auto glyph = feg.glyph();
+      if (!glyph)
+        continue;
+
+      auto& bitmap = m_glyphs[GlyphKey(fontfile, fontsize,
+                                       glyph->glyph_index, antialias)];
+      if (!bitmap)
+        bitmap = convertGlyph(*glyph->bitmap, antialias);
+
+      ShapedGlyph shapedGlyph;
+      shapedGlyph.bitmap = bitmap.get();
+      shapedGlyph.x = int(glyph->x);
+      shapedGlyph.y = int(glyph->y);
+      shaped.glyphs.push_back(shapedGlyph);
+
+      shaped.bounds |= gfx::Rect(shapedGlyph.x, shapedGlyph.y,
+                                 bitmap->w, bitmap->h);
     }
+
+    return (m_texts[textKey] = std::move(shaped));
+  }
+
+private:
+  ft::Face& getFace(const std::string& fontfile) {
+    auto it = m_faces.find(fontfile);
+    if (it != m_faces.end())
+      return *it->second;
+
+    auto face = std::make_unique<ft::Face>(m_ft.open(fontfile));
+    if (!face->isValid())
+      throw std::runtime_error("Error loading font face");
+
+    if (m_faces.size() >= kMaxFaces)
+      m_faces.clear();
+    return *(m_faces[fontfile] = std::move(face));
   }
-  else {
-    throw std::runtime_error("Error loading font face");
+
+  static std::unique_ptr<GlyphBitmap> convertGlyph(const FT_Bitmap& ftBitmap,
+                                                   const bool antialias) {
+    auto bitmap = std::make_unique<GlyphBitmap>();
+    bitmap->w = int(ftBitmap.width);
+    bitmap->h = int(ftBitmap.rows);
+    bitmap->alpha.resize(size_t(bitmap->w) * bitmap->h);
+
+    uint8_t* dst = bitmap->alpha.data();
+    for (int v=0; v<bitmap->h; ++v) {
+      const uint8_t* p = ftBitmap.buffer + v*ftBitmap.pitch;
+      for (int u=0; u<bitmap->w; ++u) {
+        if (antialias)
+          *(dst++) = p[u];
+        else
+          *(dst++) = (p[u/8] & (1 << (7 - (u & 7))) ? 255: 0);
+      }
+    }
+    return bitmap;
+  }
+
+  std::mutex m_mutex;
+  ft::Lib m_ft;
+  std::map<std::string, std::unique_ptr<ft::Face>> m_faces;
+  std::map<GlyphKey, std::unique_ptr<GlyphBitmap>> m_glyphs;
+  std::map<TextKey, ShapedText> m_texts;
+};
+
+} // anonymous namespace
+
+doc::Image* render_text(const std::string& fontfile, int fontsize,
+                        const std::string& text,
+                        doc::color_t color,
+                        bool antialias)
+{
+  TextCache& cache = TextCache::instance();
+  const std::lock_guard lock(cache.mutex());
+
+  const ShapedText& shaped =
+    cache.shapeText(fontfile, fontsize, text, antialias);
+  const gfx::Rect& bounds = shaped.bounds;
+  if (bounds.isEmpty())
+    throw std::runtime_error("There is no text");
+
+  std::unique_ptr<doc::Image> image(
+    doc::Image::create(doc::IMAGE_RGB, bounds.w, bounds.h));
+  doc::clear_image(image.get(), 0);
+
+  // Composite the cached glyph bitmaps
+  const int colorAlpha = doc::rgba_geta(color);
+  for (const ShapedGlyph& glyph : shaped.glyphs) {
+    const GlyphBitmap& bitmap = *glyph.bitmap;
+    const int x = glyph.x - bounds.x;
+    const int y = glyph.y - bounds.y;
+    const uint8_t* src = bitmap.alpha.data();
+
+    for (int v=0; v<bitmap.h; ++v) {
+      auto dst = (doc::color_t*)image->getPixelAddress(x, y+v);
+      for (int u=0; u<bitmap.w; ++u, ++src, ++dst) {
+        int t;
+        const int alpha = MUL_UN8(colorAlpha, *src, t);
+        if (alpha)
+          *dst = doc::rgba_blender_normal(*dst, doc::rgba_seta(color, alpha));
+      }
+    }
   }
 
-  return (image ? image.release(): nullptr);
+  return image.release();
 }
 
 } // namespace app
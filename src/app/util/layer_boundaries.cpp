@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -15,6 +15,7 @@
 #include "app/console.h"
 #include "app/context_access.h"
 #include "app/modules/gui.h"
+#include "app/perf_counters.h"
 #include "app/tx.h"
 #include "app/ui_context.h"
 #include "doc/cel.h"
@@ -24,10 +25,143 @@
 #include "doc/layer.h"
 #include "doc/mask.h"
 
+#include <algorithm>
+#include <memory>
+#include <vector>
+
 using namespace doc;
 
 namespace app {
 
+namespace {
+
+// Number of cel images with cached boundaries (so selecting the
+// boundaries of the same layers several times, e.g. to add/subtract
+// them from the selection, doesn't need to traverse their pixels
+// again).
+constexpr std::size_t kMaxCachedBoundaries = 8;
+
+struct CachedBoundaries {
+  ObjectId imageId;
+  ObjectVersion imageVersion;
+  PixelFormat pixelFormat;
+  color_t maskColor;
+  gfx::Rect celBounds;
+  std::unique_ptr<Mask> mask;
+
+  bool match(const Cel* cel, const Image* image) const {
+    return (imageId == image->id() &&
+            imageVersion == image->version() &&
+            pixelFormat == image->pixelFormat() &&
+            maskColor == image->maskColor() &&
+            celBounds == cel->bounds());
+  }
+};
+
+// The most recently used boundaries are at the end
+std::vector<CachedBoundaries> g_cache;
+
+void make_boundaries_mask(const Cel* cel, const Image* image, Mask& newMask)
+{
+  newMask.replace(cel->bounds());
+  newMask.freeze();
+  {
+    LockImageBits<BitmapTraits> maskBits(newMask.bitmap());
+    auto maskIt = maskBits.begin();
+    auto maskEnd = maskBits.end();
+
+    switch (image->pixelFormat()) {
+
+      case IMAGE_RGB: {
+        LockImageBits<RgbTraits> rgbBits(image);
+        auto rgbIt = rgbBits.begin();
+#if _DEBUG
+        auto rgbEnd = rgbBits.end();
+#endif
+        for (; maskIt != maskEnd; ++maskIt, ++rgbIt) {
+          ASSERT(rgbIt != rgbEnd);
+          color_t c = *rgbIt;
+          *maskIt = (rgba_geta(c) >= 128); // TODO configurable threshold
+        }
+        break;
+      }
+
+      case IMAGE_GRAYSCALE: {
+        LockImageBits<GrayscaleTraits> grayBits(image);
+        auto grayIt = grayBits.begin();
+#if _DEBUG
+        auto grayEnd = grayBits.end();
+#endif
+        for (; maskIt != maskEnd; ++maskIt, ++grayIt) {
+          ASSERT(grayIt != grayEnd);
+          color_t c = *grayIt;
+          *maskIt = (graya_geta(c) >= 128); // TODO configurable threshold
+        }
+        break;
+      }
+
+      case IMAGE_INDEXED: {
+        const doc::color_t maskColor = image->maskColor();
+        LockImageBits<IndexedTraits> idxBits(image);
+        auto idxIt = idxBits.begin();
+#if _DEBUG
+        auto idxEnd = idxBits.end();
+#endif
+        for (; maskIt != maskEnd; ++maskIt, ++idxIt) {
+          ASSERT(idxIt != idxEnd);
+          color_t c = *idxIt;
+          *maskIt = (c != maskColor);
+        }
+        break;
+      }
+
+    }
+  }
+  newMask.unfreeze();
+}
+
+// Returns the boundaries of the given cel image from the cache, or
+// calculates them if the image was modified since the last time.
+void get_boundaries_mask(const Cel* cel, const Image* image, Mask& newMask)
+{
+  auto it = std::find_if(g_cache.begin(), g_cache.end(),
+                         [cel, image](const CachedBoundaries& cached){
+                           return cached.match(cel, image);
+                         });
+  if (it != g_cache.end()) {
+    // Move to the end as the most recently used
+    std::rotate(it, it+1, g_cache.end());
+    newMask.copyFrom(g_cache.back().mask.get());
+    PerfCounters::add(PerfCounters::CacheHits, 1);
+    return;
+  }
+
+  PerfCounters::add(PerfCounters::CacheMisses, 1);
+  make_boundaries_mask(cel, image, newMask);
+
+  // Remove the old boundaries of this image and the least recently
+  // used ones
+  g_cache.erase(
+    std::remove_if(g_cache.begin(), g_cache.end(),
+                   [image](const CachedBoundaries& cached){
+                     return cached.imageId == image->id();
+                   }),
+    g_cache.end());
+  if (g_cache.size() >= kMaxCachedBoundaries)
+    g_cache.erase(g_cache.begin());
+
+  CachedBoundaries cached;
+  cached.imageId = image->id();
+  cached.imageVersion = image->version();
+  cached.pixelFormat = image->pixelFormat();
+  cached.maskColor = image->maskColor();
+  cached.celBounds = cel->bounds();
+  cached.mask = std::make_unique<Mask>(newMask);
+  g_cache.push_back(std::move(cached));
+}
+
+} // anonymous namespace
+
 void select_layer_boundaries(Layer* layer,
                              const frame_t frame,
                              const SelectLayerBoundariesOp op)
@@ -38,61 +172,7 @@ void select_layer_boundaries(Layer* layer,
   if (cel) {
     const Image* image = cel->image();
     if (image) {
-      newMask.replace(cel->bounds());
-      newMask.freeze();
-      {
-        LockImageBits<BitmapTraits> maskBits(newMask.bitmap());
-        auto maskIt = maskBits.begin();
-        auto maskEnd = maskBits.end();
-
-        switch (image->pixelFormat()) {
-
-          case IMAGE_RGB: {
-            LockImageBits<RgbTraits> rgbBits(image);
-            auto rgbIt = rgbBits.begin();
-#if _DEBUG
-            auto rgbEnd = rgbBits.end();
-#endif
-            for (; maskIt != maskEnd; ++maskIt, ++rgbIt) {
-              ASSERT(rgbIt != rgbEnd);
-              color_t c = *rgbIt;
-              *maskIt = (rgba_geta(c) >= 128); // TODO configurable threshold
-            }
-            break;
-          }
-
-          case IMAGE_GRAYSCALE: {
-            LockImageBits<GrayscaleTraits> grayBits(image);
-            auto grayIt = grayBits.begin();
-#if _DEBUG
-            auto grayEnd = grayBits.end();
-#endif
-            for (; maskIt != maskEnd; ++maskIt, ++grayIt) {
-              ASSERT(grayIt != grayEnd);
-              color_t c = *grayIt;
-              *maskIt = (graya_geta(c) >= 128); // TODO configurable threshold
-            }
-            break;
-          }
-
-          case IMAGE_INDEXED: {
-            const doc::color_t maskColor = image->maskColor();
-            LockImageBits<IndexedTraits> idxBits(image);
-            auto idxIt = idxBits.begin();
-#if _DEBUG
-            auto idxEnd = idxBits.end();
-#endif
-            for (; maskIt != maskEnd; ++maskIt, ++idxIt) {
-              ASSERT(idxIt != idxEnd);
-              color_t c = *idxIt;
-              *maskIt = (c != maskColor);
-            }
-            break;
-          }
-
-        }
-      }
-      newMask.unfreeze();
+      get_boundaries_mask(cel, image, newMask);
     }
   }
 
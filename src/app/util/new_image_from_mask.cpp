@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2021 Igara Studio S.A.
+// Copyright (C) 2019-2024 Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -12,6 +12,7 @@
 #include "app/util/new_image_from_mask.h"
 
 #include "app/doc.h"
+#include "app/pref/preferences.h"
 #include "app/site.h"
 #include "doc/image_impl.h"
 #include "doc/layer.h"
@@ -57,6 +58,12 @@ doc::Image* new_image_from_mask(const Site& site,
   if (merged || site.layer()->isTilemap()) {
     render::Render render;
     render.setNewBlend(newBlend);
+
+    // Render big selections dividing them in tiles rendered in
+    // several threads (only the selection bounds are rendered)
+    if (Preferences::instance().experimental.parallelRender())
+      render.setParallelTileSize(128);
+
     if (merged)
       render.renderSprite(dst.get(), srcSprite, site.frame(),
                           gfx::Clip(0, 0, srcBounds));
@@ -77,40 +84,25 @@ doc::Image* new_image_from_mask(const Site& site,
   }
   else {
     src = site.image(&x, &y);
+
+    // Copy the whole intersection with the active image (the
+    // unselected pixels are cleared below)
+    if (src)
+      copy_image(dst.get(), src, x-srcBounds.x, y-srcBounds.y);
   }
 
-  // Copy the masked zones
-  if (src) {
-    if (srcMaskBitmap) {
-      // Copy active layer with mask
-      const LockImageBits<BitmapTraits> maskBits(srcMaskBitmap, gfx::Rect(0, 0, srcBounds.w, srcBounds.h));
-      LockImageBits<BitmapTraits>::const_iterator mask_it = maskBits.begin();
-
-      for (int v=0; v<srcBounds.h; ++v) {
-        for (int u=0; u<srcBounds.w; ++u, ++mask_it) {
-          ASSERT(mask_it != maskBits.end());
-
-          if (src != dst.get()) {
-            if (*mask_it) {
-              int getx = u+srcBounds.x-x;
-              int gety = v+srcBounds.y-y;
-
-              if ((getx >= 0) && (getx < src->width()) &&
-                  (gety >= 0) && (gety < src->height()))
-                dst->putPixel(u, v, src->getPixel(getx, gety));
-            }
-          }
-          else {
-            if (!*mask_it) {
-              dst->putPixel(u, v, dst->maskColor());
-            }
-          }
-        }
+  // Clear the unselected pixels
+  if (src && srcMaskBitmap) {
+    const LockImageBits<BitmapTraits> maskBits(srcMaskBitmap, gfx::Rect(0, 0, srcBounds.w, srcBounds.h));
+    LockImageBits<BitmapTraits>::const_iterator mask_it = maskBits.begin();
+
+    for (int v=0; v<srcBounds.h; ++v) {
+      for (int u=0; u<srcBounds.w; ++u, ++mask_it) {
+        ASSERT(mask_it != maskBits.end());
+        if (!*mask_it)
+          dst->putPixel(u, v, dst->maskColor());
       }
     }
-    else if (src != dst.get()) {
-      copy_image(dst.get(), src, -srcBounds.x, -srcBounds.y);
-    }
   }
 
   return dst.release();
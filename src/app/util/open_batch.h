@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2021  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -19,12 +19,22 @@ namespace app {
   // elements)
   class OpenBatchOfFiles {
   public:
+    // The optional [fromFrame, toFrame] range (0-based) loads only
+    // the cels of those frames (see OpenFileCommand "fromframe"
+    // param).
     void open(Context* ctx,
               const std::string& fn,
-              const bool oneFrame) {
+              const bool oneFrame,
+              const doc::frame_t fromFrame = -1,
+              const doc::frame_t toFrame = -1) {
       Params params;
       params.set("filename", fn.c_str());
 
+      if (fromFrame >= 0 && toFrame >= 0) {
+        params.set("fromframe", std::to_string(fromFrame+1).c_str());
+        params.set("toframe", std::to_string(toFrame+1).c_str());
+      }
+
       if (oneFrame)
         params.set("oneframe", "true");
       else {
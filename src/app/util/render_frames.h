@@ -0,0 +1,68 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_UTIL_RENDER_FRAMES_H_INCLUDED
+#define APP_UTIL_RENDER_FRAMES_H_INCLUDED
+#pragma once
+
+#include "doc/frame.h"
+#include "doc/task_scheduler.h"
+
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace app {
+
+  // Calls renderFrame(frame) for each frame in [fromFrame, toFrame]
+  // in several threads, and then commitFrame(frame, result) in the
+  // calling thread in frame order (so cels and undo commands are
+  // created in the same order as a sequential loop).
+  //
+  // Frames are rendered in batches, so only a few results are kept
+  // in memory, and the commits of a batch never run at the same time
+  // that renderFrame() calls (renderFrame() can read the sprite
+  // without locks, but it must not modify it).
+  template<typename RenderFunc, typename CommitFunc>
+  void render_frames_in_parallel(const doc::frame_t fromFrame,
+                                 const doc::frame_t toFrame,
+                                 RenderFunc&& renderFrame,
+                                 CommitFunc&& commitFrame)
+  {
+    using Result = std::invoke_result_t<RenderFunc&, doc::frame_t>;
+
+    doc::TaskGroup group(doc::TaskPriority::Interactive);
+    const int nthreads = group.threads();
+    const int nframes = toFrame - fromFrame + 1;
+    if (nthreads == 1 || nframes < 2) {
+      for (doc::frame_t frame=fromFrame; frame<=toFrame; ++frame)
+        commitFrame(frame, renderFrame(frame));
+      return;
+    }
+
+    const int batchSize = 2*nthreads;
+    std::vector<Result> results(batchSize);
+
+    for (doc::frame_t batch=fromFrame; batch<=toFrame; batch+=batchSize) {
+      const int n = std::min<int>(batchSize, toFrame-batch+1);
+      for (int i=0; i<n; ++i) {
+        group.run([&renderFrame, &results, batch, i]{
+          results[i] = renderFrame(batch+i);
+        });
+      }
+      group.wait();
+
+      for (int i=0; i<n; ++i) {
+        commitFrame(batch+i, std::move(results[i]));
+        results[i] = Result();
+      }
+    }
+  }
+
+} // namespace app
+
+#endif
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (c) 2019-2022  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -51,11 +51,49 @@ doc::Image* resize_image(
   return newImage.release();
 }
 
+doc::ImageRef create_resized_cel_image(
+  doc::Cel* cel,
+  const gfx::SizeF& scale,
+  const doc::algorithm::ResizeMethod method)
+{
+  doc::Image* image = cel->image();
+  if (!image || cel->link() || cel->layer()->isReference())
+    return doc::ImageRef();
+
+  doc::Sprite* sprite = cel->sprite();
+  const int w = std::max(1, int(scale.w*image->width()));
+  const int h = std::max(1, int(scale.h*image->height()));
+  doc::ImageRef newImage(
+    doc::Image::create(
+      image->pixelFormat(), std::max(1, w), std::max(1, h)));
+  newImage->setMaskColor(image->maskColor());
+
+  // The RgbMap is needed only to resize indexed images with the
+  // bilinear method (we don't ask for it in other cases because
+  // Sprite::rgbMap() can re-create it and this function can be
+  // called from several threads).
+  const doc::RgbMap* rgbmap =
+    (method == doc::algorithm::RESIZE_METHOD_BILINEAR &&
+     image->pixelFormat() == doc::IMAGE_INDEXED ?
+     sprite->rgbMap(cel->frame()): nullptr);
+
+  doc::algorithm::fixup_image_transparent_colors(image);
+  doc::algorithm::resize_image(
+    image, newImage.get(),
+    method,
+    sprite->palette(cel->frame()),
+    rgbmap,
+    (cel->layer()->isBackground() ? -1: sprite->transparentColor()));
+
+  return newImage;
+}
+
 void resize_cel_image(
   Tx& tx, doc::Cel* cel,
   const gfx::SizeF& scale,
   const doc::algorithm::ResizeMethod method,
-  const gfx::PointF& pivot)
+  const gfx::PointF& pivot,
+  doc::ImageRef newImage)
 {
   // Get cel's image
   doc::Image* image = cel->image();
@@ -78,20 +116,8 @@ void resize_cel_image(
         tx(new cmd::SetCelPosition(cel, x, y));
 
       // Resize the image
-      const int w = std::max(1, int(scale.w*image->width()));
-      const int h = std::max(1, int(scale.h*image->height()));
-      doc::ImageRef newImage(
-        doc::Image::create(
-          image->pixelFormat(), std::max(1, w), std::max(1, h)));
-      newImage->setMaskColor(image->maskColor());
-
-      doc::algorithm::fixup_image_transparent_colors(image);
-      doc::algorithm::resize_image(
-        image, newImage.get(),
-        method,
-        sprite->palette(cel->frame()),
-        sprite->rgbMap(cel->frame()),
-        (cel->layer()->isBackground() ? -1: sprite->transparentColor()));
+      if (!newImage)
+        newImage = create_resized_cel_image(cel, scale, method);
 
       tx(new cmd::ReplaceImage(sprite, cel->imageRef(), newImage));
     }
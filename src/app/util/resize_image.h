@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (c) 2019-2021  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -10,6 +10,7 @@
 
 #include "doc/algorithm/resize_image.h"
 #include "doc/color.h"
+#include "doc/image_ref.h"
 #include "gfx/point.h"
 #include "gfx/size.h"
 
@@ -30,11 +31,24 @@ namespace app {
     const doc::Palette* pal,
     const doc::RgbMap* rgbmap);
 
+  // Returns the resized image of the given cel (or nullptr if the
+  // cel image doesn't need to be resized, e.g. linked cels or cels
+  // from reference layers). It doesn't modify the cel, so it can be
+  // used to resize several cels in parallel (except with the
+  // RotSprite method, or the bilinear method on indexed images).
+  doc::ImageRef create_resized_cel_image(
+    doc::Cel* cel,
+    const gfx::SizeF& scale,
+    const doc::algorithm::ResizeMethod method);
+
+  // Resizes the given cel. The "newImage" can be the already resized
+  // image returned by create_resized_cel_image().
   void resize_cel_image(
     Tx& tx, doc::Cel* cel,
     const gfx::SizeF& scale,
     const doc::algorithm::ResizeMethod method,
-    const gfx::PointF& pivot);
+    const gfx::PointF& pivot,
+    doc::ImageRef newImage = doc::ImageRef());
 
 } // namespace app
 
@@ -1,5 +1,5 @@
 // Aseprite Document IO Library
-// Copyright (c) 2018-2023 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -21,13 +21,17 @@
 #include "dio/file_interface.h"
 #include "dio/pixel_io.h"
 #include "doc/doc.h"
+#include "doc/images_dedup.h"
 #include "doc/util.h"
 #include "fixmath/fixmath.h"
 #include "fmt/format.h"
 #include "gfx/color_space.h"
 #include "zlib.h"
 
+#include <algorithm>
 #include <cstdio>
+#include <memory>
+#include <thread>
 #include <vector>
 
 namespace dio {
@@ -98,10 +102,40 @@ bool AsepriteDecoder::decode()
   if (nframes > 1 && delegate()->decodeOneFrame())
     nframes = 1;
 
+  // Just a range of frames? Cels outside the range are skipped (and
+  // whole frames too if the file contains a frame index chunk)
+  doc::frame_t fromFrame = 0;
+  doc::frame_t toFrame = nframes-1;
+  const bool frameRange =
+    (nframes > 1 && delegate()->decodeFrameRange(fromFrame, toFrame));
+  if (frameRange) {
+    fromFrame = std::clamp(fromFrame, doc::frame_t(0), nframes-1);
+    toFrame = std::clamp(toFrame, fromFrame, nframes-1);
+  }
+
+  m_frameIndex.clear();
+  m_framePos.assign(nframes, 0);
+  m_skippedCels.clear();
+
+  // Inflate compressed cel images in worker threads while we walk
+  // the chunks (lazy decoding doesn't inflate anything at this point)
+  if (delegate()->decodeCelsInParallel() &&
+      !delegate()->decodeCelsLazily()) {
+    m_decodePool = std::make_unique<base::thread_pool>(
+      std::max(1u, std::thread::hardware_concurrency()));
+  }
+
   // Read frame by frame to end-of-file
   for (doc::frame_t frame=0; frame<nframes; ++frame) {
+    // Jump to the frame using the index
+    const bool skipFrame = (frameRange &&
+                            (frame < fromFrame || frame > toFrame));
+    if (frameRange && frame > 0 && !m_frameIndex.empty())
+      f()->seek(m_frameIndex[frame].offset);
+
     // Start frame position
     size_t frame_pos = f()->tell();
+    m_framePos[frame] = frame_pos;
     delegate()->progress((float)frame_pos / (float)header.size);
 
     // Read frame header
@@ -114,6 +148,13 @@ bool AsepriteDecoder::decode()
       if (frame_header.duration > 0)
         sprite->setFrameDuration(frame, frame_header.duration);
 
+      // Frames outside the range without palette chunks don't need to
+      // be walked, we just need their durations.
+      if (skipFrame && frame > 0 && !m_frameIndex.empty() &&
+          (m_frameIndex[frame].flags & ASE_FRAME_INDEX_FLAG_PALETTE) == 0) {
+        continue;
+      }
+
       // Read chunks
       for (uint32_t c=0; c<frame_header.chunks; c++) {
         // Start chunk position
@@ -170,6 +211,14 @@ bool AsepriteDecoder::decode()
           }
 
           case ASE_FILE_CHUNK_CEL: {
+            if (skipFrame) {
+              // Linked cels in the range can still read this cel
+              // later (see readSkippedCel())
+              last_cel = nullptr;
+              last_object_with_user_data = nullptr;
+              break;
+            }
+
             doc::Cel* cel =
               readCelChunk(sprite.get(), frame,
                            sprite->pixelFormat(), &header,
@@ -292,6 +341,10 @@ bool AsepriteDecoder::decode()
             break;
           }
 
+          case ASE_FILE_CHUNK_FRAME_INDEX:
+            readFrameIndexChunk(&header, chunk_pos+chunk_size);
+            break;
+
           default:
             delegate()->incompatibilityError(
               fmt::format("Warning: Unsupported chunk type {0} (skipping)", chunk_type));
@@ -310,6 +363,20 @@ bool AsepriteDecoder::decode()
       break;
   }
 
+  // All cel images must be complete before we return the sprite
+  waitPendingImages();
+  m_decodePool.reset();
+
+  // Unlinked cels with the same pixels share them (cels decoded
+  // lazily aren't loaded yet)
+  if (delegate()->dedupCelImages() &&
+      !delegate()->decodeCelsLazily()) {
+    std::vector<doc::ImageRef> images;
+    for (doc::Cel* cel : sprite->uniqueCels())
+      images.push_back(cel->imageRef());
+    doc::share_duplicated_images(images);
+  }
+
   delegate()->onSprite(sprite.release());
   return true;
 }
@@ -386,6 +453,88 @@ void AsepriteDecoder::readFrameHeader(AsepriteFrameHeader* frame_header)
     frame_header->chunks = nchunks;
 }
 
+void AsepriteDecoder::readFrameIndexChunk(const AsepriteHeader* header,
+                                          const size_t chunk_end)
+{
+  const uint32_t nframes = read32();
+  readPadding(8);
+
+  if (nframes != header->frames ||
+      f()->tell() + 8*size_t(nframes) > chunk_end) {
+    delegate()->error("Warning: Invalid frame index chunk (skipping)");
+    return;
+  }
+
+  std::vector<FrameIndexEntry> index(nframes);
+  uint32_t prevOffset = 0;
+  for (auto& entry : index) {
+    entry.offset = read32();
+    entry.flags = read32();
+
+    // Each frame must be after the previous one (a zero offset is a
+    // frame that wasn't written), in that case we don't use the index
+    if (entry.offset <= prevOffset ||
+        entry.offset >= header->size)
+      return;
+    prevOffset = entry.offset;
+  }
+  m_frameIndex = std::move(index);
+}
+
+doc::Cel* AsepriteDecoder::readSkippedCel(doc::Sprite* sprite,
+                                          const doc::layer_t layer_index,
+                                          const doc::frame_t frame,
+                                          const doc::PixelFormat pixelFormat,
+                                          const AsepriteHeader* header)
+{
+  if (frame < 0 ||
+      frame >= doc::frame_t(m_framePos.size()) ||
+      m_framePos[frame] == 0) {
+    return nullptr;
+  }
+
+  // Several cels can be linked to the same skipped cel
+  const auto key = std::make_pair(layer_index, frame);
+  auto it = m_skippedCels.find(key);
+  if (it != m_skippedCels.end())
+    return it->second.get();
+
+  const size_t pos = f()->tell();
+  doc::Cel* cel = nullptr;
+
+  f()->seek(m_framePos[frame]);
+
+  AsepriteFrameHeader frame_header;
+  readFrameHeader(&frame_header);
+
+  if (frame_header.magic == ASE_FILE_FRAME_MAGIC) {
+    for (uint32_t c=0; c<frame_header.chunks; c++) {
+      size_t chunk_pos = f()->tell();
+      int chunk_size = read32();
+      int chunk_type = read16();
+
+      if (chunk_type == ASE_FILE_CHUNK_CEL &&
+          doc::layer_t(read16()) == layer_index) {
+        f()->seek(chunk_pos+6);
+        cel = readCelChunk(sprite, frame, pixelFormat, header,
+                           chunk_pos+chunk_size);
+
+        // The skipped frame must not contain cels, so we remove it
+        // from the layer and keep it just to be linked by other cels
+        if (cel) {
+          static_cast<doc::LayerImage*>(cel->layer())->removeCel(cel);
+          m_skippedCels[key].reset(cel);
+        }
+        break;
+      }
+      f()->seek(chunk_pos+chunk_size);
+    }
+  }
+
+  f()->seek(pos);
+  return cel;
+}
+
 void AsepriteDecoder::readPadding(int bytes)
 {
   for (int c=0; c<bytes; c++)
@@ -398,11 +547,9 @@ std::string AsepriteDecoder::readString()
   if (length == EOF)
     return "";
 
-  std::string string;
-  string.reserve(length+1);
-
-  for (int c=0; c<length; c++)
-    string.push_back(read8());
+  std::string string(length, '\0');
+  if (length > 0)
+    readBytes((uint8_t*)&string[0], length);
 
   return string;
 }
@@ -700,6 +847,15 @@ void read_raw_image(FileInterface* f,
 // Compressed Image
 //////////////////////////////////////////////////////////////////////
 
+// Pixels are stored in little-endian order in .aseprite files (RGBA
+// bytes, gray+alpha bytes, 32-bit tiles), the same layout doc::Image
+// uses in memory on little-endian machines.
+inline bool same_pixel_layout_as_file()
+{
+  const uint32_t value = 1;
+  return (*(const uint8_t*)&value == 1);
+}
+
 template<typename ImageTraits>
 void read_compressed_image_templ(FileInterface* f,
                                  DecodeDelegate* delegate,
@@ -719,28 +875,36 @@ void read_compressed_image_templ(FileInterface* f,
 
   const int width = image->width();
   const int widthBytes = image->widthBytes();
-  std::vector<uint8_t> scanline(widthBytes);
+  const int height = image->height();
+
+  // Inflate directly into the image rows when the pixel layout is
+  // the same, in other case we need to convert each scanline. Sparse
+  // (huge) images are always decoded scanline by scanline to skip
+  // empty rows, so their pages aren't allocated.
+  const bool sparse = image->isSparse();
+  const bool direct = (same_pixel_layout_as_file() && !sparse);
+  std::vector<uint8_t> scanline(direct ? 0: widthBytes);
   std::vector<uint8_t> compressed(4096);
-  std::vector<uint8_t> uncompressed(4096);
+  std::vector<uint8_t> uncompressed(direct ? 0: 4096);
   int scanline_offset = 0;
   int y = 0;
 
-  while (true) {
-    size_t input_bytes;
-
-    if (f->tell()+compressed.size() > chunk_end) {
-      input_bytes = chunk_end - f->tell(); // Remaining bytes
-      ASSERT(input_bytes < compressed.size());
-
-      if (input_bytes == 0)
-        break;                  // Done, we consumed all chunk
-    }
-    else {
-      input_bytes = compressed.size();
+  while (!direct || (y < height && err != Z_STREAM_END)) {
+    const size_t pos = f->tell();
+    if (pos >= chunk_end)
+      break;                    // Done, we consumed all chunk
+
+    // Inflate the whole chunk directly from memory if possible
+    // (e.g. memory-mapped files), or read it in small blocks.
+    size_t input_bytes = chunk_end - pos; // Remaining bytes
+    size_t bytes_read = input_bytes;
+    const uint8_t* input = f->readInPlace(input_bytes);
+    if (!input) {
+      input_bytes = std::min(input_bytes, compressed.size());
+      bytes_read = f->readBytes(&compressed[0], input_bytes);
+      input = &compressed[0];
     }
 
-    size_t bytes_read = f->readBytes(&compressed[0], input_bytes);
-
     // Error reading "input_bytes" bytes, broken file? chunk without
     // enough compressed data?
     if (bytes_read == 0) {
@@ -750,9 +914,29 @@ void read_compressed_image_templ(FileInterface* f,
       break;
     }
 
-    zstream.next_in = (Bytef*)&compressed[0];
+    zstream.next_in = (Bytef*)input;
     zstream.avail_in = bytes_read;
 
+    if (direct) {
+      do {
+        zstream.next_out = (Bytef*)image->getPixelAddress(0, y) + scanline_offset;
+        zstream.avail_out = widthBytes - scanline_offset;
+
+        err = inflate(&zstream, Z_NO_FLUSH);
+        if (err != Z_OK && err != Z_STREAM_END && err != Z_BUF_ERROR)
+          throw base::Exception("ZLib error %d in inflate().", err);
+
+        scanline_offset = widthBytes - zstream.avail_out;
+        if (scanline_offset == widthBytes) {
+          ++y;
+          scanline_offset = 0;
+        }
+      } while (zstream.avail_in != 0 && y < height && err == Z_OK);
+
+      delegate->progress((float)f->tell() / (float)header->size);
+      continue;
+    }
+
     do {
       zstream.next_out = (Bytef*)&uncompressed[0];
       zstream.avail_out = uncompressed.size();
@@ -780,10 +964,15 @@ void read_compressed_image_templ(FileInterface* f,
             break;
           }
           else {
-            // Copy the whole scanline to the image
-            pixel_io.read_scanline(
-              (typename ImageTraits::address_t)image->getPixelAddress(0, y),
-              width, &scanline[0]);
+            // Copy the whole scanline to the image (the image is new
+            // and already filled with zeros)
+            if (!sparse ||
+                std::any_of(scanline.begin(), scanline.end(),
+                            [](const uint8_t b){ return b != 0; })) {
+              pixel_io.read_scanline(
+                (typename ImageTraits::address_t)image->getPixelAddress(0, y),
+                width, &scanline[0]);
+            }
             ++y;
             scanline_offset = 0;
             if (uncompressed_bytes == 0)
@@ -839,8 +1028,129 @@ void read_compressed_image(FileInterface* f,
   }
 }
 
+// Returns a function to decode the given compressed cel image on
+// demand (used when DecodeDelegate::decodeCelsLazily() is true).
+doc::CelData::ImageLoader make_lazy_image_loader(
+  const doc::PixelFormat pixelFormat,
+  const int w, const int h,
+  const doc::color_t maskColor,
+  const AsepriteHeader& header,
+  const std::shared_ptr<base::buffer>& compressed,
+  const bool cacheCompressed)
+{
+  return [=]() -> doc::ImageRef {
+    doc::ImageRef image(doc::Image::create(pixelFormat, w, h));
+    image->setMaskColor(maskColor);
+
+    // The original delegate is not available anymore, so errors in
+    // the compressed data are ignored here (the image will be
+    // partially decoded)
+    DecodeDelegate delegate;
+    AsepriteHeader dataHeader = header;
+    dataHeader.size = compressed->size();
+
+    MemoryFileInterface f(compressed->data(), compressed->size());
+    read_compressed_image(&f, &delegate, image.get(),
+                          &dataHeader, compressed->size());
+
+    if (cacheCompressed)
+      image->setCompressedData(*compressed);
+    return image;
+  };
+}
+
+// Collects the errors found decoding a compressed image in a worker
+// thread (they are reported later from the decoder thread).
+class ErrorsDecodeDelegate : public DecodeDelegate {
+public:
+  void error(const std::string& msg) override {
+    m_errors.push_back(msg);
+  }
+  const std::vector<std::string>& errors() const {
+    return m_errors;
+  }
+private:
+  std::vector<std::string> m_errors;
+};
+
+// Max size of compressed data waiting to be inflated in worker
+// threads (when the file is not memory-mapped, we have to copy it)
+const size_t kMaxPendingCompressedBytes = 64*1024*1024;
+
 } // anonymous namespace
 
+bool AsepriteDecoder::queueCompressedImage(const doc::ImageRef& image,
+                                           base::buffer& compressed,
+                                           const AsepriteHeader& header,
+                                           const size_t chunk_end)
+{
+  // The compressed data was already read (to be cached in the image)
+  const bool cacheCompressed = !compressed.empty();
+  const size_t dataBeg = f()->tell();
+  if (!cacheCompressed && chunk_end <= dataBeg)
+    return false;
+
+  const size_t size = (cacheCompressed ? compressed.size():
+                                         chunk_end - dataBeg);
+  auto data = std::make_shared<base::buffer>(std::move(compressed));
+
+  // Use the memory-mapped data directly if possible (it's available
+  // until the end of decode())
+  const uint8_t* bytes = (cacheCompressed ? nullptr: f()->readInPlace(size));
+  if (!bytes) {
+    if (data->size() != size) {
+      data->resize(size);
+      if (f()->readBytes(&(*data)[0], size) != size) {
+        // Truncated file, just decode it in this thread
+        f()->seek(dataBeg);
+        return false;
+      }
+    }
+    bytes = data->data();
+  }
+
+  AsepriteHeader dataHeader = header;
+  dataHeader.size = size;
+
+  m_decodePool->execute(
+    [this, image, data, bytes, size, dataHeader, cacheCompressed]{
+      ErrorsDecodeDelegate delegate;
+      MemoryFileInterface f(bytes, size);
+      read_compressed_image(&f, &delegate, image.get(),
+                            &dataHeader, size);
+      if (cacheCompressed)
+        image->setCompressedData(*data);
+
+      if (!delegate.errors().empty()) {
+        std::lock_guard lock(m_decodeErrorsMutex);
+        for (const auto& msg : delegate.errors())
+          m_decodeErrors.push_back(msg);
+      }
+    });
+
+  m_pendingBytes += size;
+  if (m_pendingBytes > kMaxPendingCompressedBytes)
+    waitPendingImages();
+  return true;
+}
+
+void AsepriteDecoder::waitPendingImages()
+{
+  if (!m_decodePool)
+    return;
+
+  m_decodePool->wait_all();
+  m_pendingBytes = 0;
+
+  std::vector<std::string> errors;
+  {
+    std::lock_guard lock(m_decodeErrorsMutex);
+    std::swap(errors, m_decodeErrors);
+  }
+  for (const auto& msg : errors)
+    delegate()->error(msg);
+}
+
 //////////////////////////////////////////////////////////////////////
 // Cel Chunk
 //////////////////////////////////////////////////////////////////////
@@ -905,6 +1215,12 @@ doc::Cel* AsepriteDecoder::readCelChunk(doc::Sprite* sprite,
       doc::frame_t link_frame = doc::frame_t(read16());
       doc::Cel* link = layer->cel(link_frame);
 
+      // The linked cel can be in a frame that we've skipped
+      if (!link && link_frame < frame) {
+        link = readSkippedCel(sprite, layer_index, link_frame,
+                              pixelFormat, header);
+      }
+
       if (link) {
         // There were a beta version that allow to the user specify
         // different X, Y, or opacity per link, in that case we must
@@ -913,6 +1229,9 @@ doc::Cel* AsepriteDecoder::readCelChunk(doc::Sprite* sprite,
           cel.reset(doc::Cel::MakeLink(frame, link));
         }
         else {
+          // The image to copy could still be inflating
+          waitPendingImages();
+
           cel.reset(doc::Cel::MakeCopy(frame, link));
           cel->setPosition(x, y);
           cel->setOpacity(opacity);
@@ -932,10 +1251,54 @@ doc::Cel* AsepriteDecoder::readCelChunk(doc::Sprite* sprite,
       int h = read16();
 
       if (w > 0 && h > 0) {
-        doc::ImageRef image(doc::Image::create(pixelFormat, w, h));
-        read_compressed_image(f(), delegate(), image.get(), header, chunk_end);
+        const size_t dataBeg = f()->tell();
+        const bool lazy = delegate()->decodeCelsLazily();
+
+        // Read the compressed bytes just once, they are decoded from
+        // memory (and kept to be decoded lazily or cached in the image)
+        base::buffer compressed;
+        if ((lazy || delegate()->cacheCompressedCels()) &&
+            chunk_end > dataBeg) {
+          compressed.resize(chunk_end - dataBeg);
+          if (f()->readBytes(&compressed[0], compressed.size()) != compressed.size()) {
+            // Truncated file, read it as usual
+            compressed.clear();
+            f()->seek(dataBeg);
+          }
+        }
 
-        cel = std::make_unique<doc::Cel>(frame, image);
+        // Keep the compressed pixels in memory and decode them the
+        // first time the cel image is accessed
+        if (lazy && !compressed.empty()) {
+          auto celData = std::make_shared<doc::CelData>(
+            gfx::Size(w, h),
+            make_lazy_image_loader(
+              pixelFormat, w, h,
+              sprite->transparentColor(), *header,
+              std::make_shared<base::buffer>(std::move(compressed)),
+              delegate()->cacheCompressedCels()));
+          cel = std::make_unique<doc::Cel>(frame, celData);
+        }
+        else {
+          doc::ImageRef image(doc::Image::create(pixelFormat, w, h));
+          if (!m_decodePool ||
+              !queueCompressedImage(image, compressed, *header, chunk_end)) {
+            if (compressed.empty()) {
+              read_compressed_image(f(), delegate(), image.get(), header, chunk_end);
+            }
+            else {
+              AsepriteHeader dataHeader = *header;
+              dataHeader.size = compressed.size();
+
+              MemoryFileInterface mf(compressed.data(), compressed.size());
+              read_compressed_image(&mf, delegate(), image.get(),
+                                    &dataHeader, compressed.size());
+              image->setCompressedData(compressed);
+            }
+          }
+
+          cel = std::make_unique<doc::Cel>(frame, image);
+        }
         cel->setPosition(x, y);
         cel->setOpacity(opacity);
         cel->setZIndex(zIndex);
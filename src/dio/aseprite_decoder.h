@@ -1,5 +1,5 @@
 // Aseprite Document IO Library
-// Copyright (c) 2018-2023 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -9,8 +9,11 @@
 #define DIO_ASEPRITE_DECODER_H_INCLUDED
 #pragma once
 
+#include "base/buffer.h"
+#include "base/thread_pool.h"
 #include "dio/decoder.h"
 #include "doc/frame.h"
+#include "doc/image_ref.h"
 #include "doc/layer_list.h"
 #include "doc/pixel_format.h"
 #include "doc/slices.h"
@@ -18,7 +21,11 @@
 #include "doc/tileset.h"
 #include "doc/user_data.h"
 
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace doc {
@@ -44,6 +51,8 @@ public:
 private:
   bool readHeader(AsepriteHeader* header);
   void readFrameHeader(AsepriteFrameHeader* frame_header);
+  void readFrameIndexChunk(const AsepriteHeader* header,
+                           const size_t chunk_end);
   void readPadding(const int bytes);
   std::string readString();
   float readFloat();
@@ -57,6 +66,16 @@ private:
                          doc::PixelFormat pixelFormat,
                          const AsepriteHeader* header,
                          const size_t chunk_end);
+  doc::Cel* readSkippedCel(doc::Sprite* sprite,
+                           const doc::layer_t layer_index,
+                           const doc::frame_t frame,
+                           const doc::PixelFormat pixelFormat,
+                           const AsepriteHeader* header);
+  bool queueCompressedImage(const doc::ImageRef& image,
+                            base::buffer& compressed,
+                            const AsepriteHeader& header,
+                            const size_t chunk_end);
+  void waitPendingImages();
   void readCelExtraChunk(doc::Cel* cel);
   void readColorProfile(doc::Sprite* sprite);
   void readExternalFiles(AsepriteExternalFiles& extFiles);
@@ -74,8 +93,26 @@ private:
   const doc::UserData::Variant readPropertyValue(uint16_t type);
   void readTilesData(doc::Tileset* tileset, const AsepriteExternalFiles& extFiles);
 
+  struct FrameIndexEntry {
+    uint32_t offset;
+    uint32_t flags;
+  };
+
   doc::LayerList m_allLayers;
   std::vector<uint32_t> m_tilesetFlags;
+  std::vector<FrameIndexEntry> m_frameIndex;
+  std::vector<size_t> m_framePos;
+
+  // Cels read from skipped frames (see readSkippedCel()), they are
+  // not added to the sprite, just linked from cels in the range
+  std::map<std::pair<doc::layer_t, doc::frame_t>,
+           std::shared_ptr<doc::Cel>> m_skippedCels;
+
+  // Worker threads to inflate cel images (see queueCompressedImage())
+  std::mutex m_decodeErrorsMutex;
+  std::vector<std::string> m_decodeErrors;
+  size_t m_pendingBytes = 0;
+  std::unique_ptr<base::thread_pool> m_decodePool;
 };
 
 } // namespace dio
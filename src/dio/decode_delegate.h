@@ -1,5 +1,5 @@
 // Aseprite Document IO Library
-// Copyright (c) 2023 Igara Studio S.A.
+// Copyright (c) 2023-2024 Igara Studio S.A.
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -38,6 +38,11 @@ public:
   // to generate a thumbnail)
   virtual bool decodeOneFrame() { return false; }
 
+  // Return true if you want to read only the cels of the given
+  // [fromFrame, toFrame] range (the sprite keeps all its frames)
+  virtual bool decodeFrameRange(doc::frame_t& fromFrame,
+                                doc::frame_t& toFrame) { return false; }
+
   // Default color for slices without user data
   virtual doc::color_t defaultSliceColor() {
     return doc::rgba(0, 0, 255, 255);
@@ -56,6 +61,33 @@ public:
   virtual bool cacheCompressedTilesets() const {
     return false;
   }
+
+  // Returns true if we want to cache the read compressed data of
+  // regular cel images (so unmodified cels can be saved without
+  // re-compressing them).
+  virtual bool cacheCompressedCels() const {
+    return false;
+  }
+
+  // Returns true if we want to keep the compressed data of regular
+  // cel images in memory and decode each image the first time it's
+  // accessed (see doc::CelData::ImageLoader).
+  virtual bool decodeCelsLazily() const {
+    return false;
+  }
+
+  // Returns true if compressed cel images can be inflated in worker
+  // threads (errors are still reported from the decoding thread).
+  virtual bool decodeCelsInParallel() const {
+    return false;
+  }
+
+  // Returns true if cel images with the same pixels (but unlinked
+  // cels) should share their pixels in memory (see
+  // doc::share_duplicated_images()).
+  virtual bool dedupCelImages() const {
+    return false;
+  }
 };
 
 } // namespace dio
@@ -1,5 +1,5 @@
 // Aseprite Document IO Library
-// Copyright (c) 2018 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -35,55 +35,44 @@ uint8_t Decoder::read8()
 
 uint16_t Decoder::read16()
 {
-  int b1 = m_f->read8();
-  int b2 = m_f->read8();
-
-  if (m_f->ok()) {
-    return ((b2 << 8) | b1); // Little endian
-  }
-  else
+  uint8_t buf[2];
+  const uint8_t* b = readValueBytes(buf, 2);
+  if (!b)
     return 0;
+
+  return ((b[1] << 8) | b[0]); // Little endian
 }
 
 uint32_t Decoder::read32()
 {
-  int b1 = m_f->read8();
-  int b2 = m_f->read8();
-  int b3 = m_f->read8();
-  int b4 = m_f->read8();
-
-  if (m_f->ok()) {
-    // Little endian
-    return ((b4 << 24) | (b3 << 16) | (b2 << 8) | b1);
-  }
-  else
+  uint8_t buf[4];
+  const uint8_t* b = readValueBytes(buf, 4);
+  if (!b)
     return 0;
+
+  // Little endian
+  return ((uint32_t(b[3]) << 24) |
+          (uint32_t(b[2]) << 16) |
+          (uint32_t(b[1]) << 8) |
+          uint32_t(b[0]));
 }
 
 uint64_t Decoder::read64()
 {
-  int b1 = m_f->read8();
-  int b2 = m_f->read8();
-  int b3 = m_f->read8();
-  int b4 = m_f->read8();
-  int b5 = m_f->read8();
-  int b6 = m_f->read8();
-  int b7 = m_f->read8();
-  int b8 = m_f->read8();
-
-  if (m_f->ok()) {
-    // Little endian
-    return (((long long)b8 << 56) |
-            ((long long)b7 << 48) |
-            ((long long)b6 << 40) |
-            ((long long)b5 << 32) |
-            ((long long)b4 << 24) |
-            ((long long)b3 << 16) |
-            ((long long)b2 << 8) |
-            (long long)b1);
-  }
-  else
+  uint8_t buf[8];
+  const uint8_t* b = readValueBytes(buf, 8);
+  if (!b)
     return 0;
+
+  // Little endian
+  return ((uint64_t(b[7]) << 56) |
+          (uint64_t(b[6]) << 48) |
+          (uint64_t(b[5]) << 40) |
+          (uint64_t(b[4]) << 32) |
+          (uint64_t(b[3]) << 24) |
+          (uint64_t(b[2]) << 16) |
+          (uint64_t(b[1]) << 8) |
+          uint64_t(b[0]));
 }
 
 size_t Decoder::readBytes(uint8_t* buf, size_t n)
@@ -91,4 +80,16 @@ size_t Decoder::readBytes(uint8_t* buf, size_t n)
   return m_f->readBytes(buf, n);
 }
 
+const uint8_t* Decoder::readValueBytes(uint8_t* buf, size_t n)
+{
+  // Read the value directly from memory (e.g. memory-mapped files)
+  // or with just one call to readBytes() (instead of one read8() for
+  // each byte).
+  const uint8_t* p = m_f->readInPlace(n);
+  if (!p && m_f->readBytes(buf, n) == n)
+    p = buf;
+
+  return (p && m_f->ok() ? p: nullptr);
+}
+
 } // namespace dio
@@ -1,5 +1,5 @@
 // Aseprite Document IO Library
-// Copyright (c) 2018 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -39,6 +39,10 @@ protected:
   size_t readBytes(uint8_t* buf, size_t n);
 
 private:
+  // Returns a pointer to "n" bytes of the file (in memory or copied
+  // in "buf"), or nullptr in case of error.
+  const uint8_t* readValueBytes(uint8_t* buf, size_t n);
+
   DecodeDelegate* m_delegate;
   FileInterface* m_f;
 };
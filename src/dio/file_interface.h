@@ -1,4 +1,5 @@
 // Aseprite Document IO Library
+// Copyright (c) 2024 Igara Studio S.A.
 // Copyright (c) 2017-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -31,6 +32,12 @@ public:
   virtual uint8_t read8() = 0;
   virtual size_t readBytes(uint8_t* buf, size_t n) = 0;
 
+  // Returns a pointer to the next "n" bytes and skips them, only if
+  // the file is already in memory (e.g. memory-mapped) and the "n"
+  // bytes are available. In other case it returns nullptr and the
+  // bytes must be read with readBytes().
+  virtual const uint8_t* readInPlace(size_t n) { return nullptr; }
+
   // Writes one byte in the file (or do nothing if ok() = false)
   virtual void write8(uint8_t value) = 0;
 
@@ -50,6 +57,46 @@ private:
   bool m_ok;
 };
 
+// Read-only interface to bytes in memory (the memory must be alive
+// while the interface is used).
+class MemoryFileInterface : public FileInterface {
+public:
+  MemoryFileInterface(const uint8_t* data = nullptr, size_t size = 0);
+  bool ok() const override;
+  size_t tell() override;
+  void seek(size_t absPos) override;
+  uint8_t read8() override;
+  size_t readBytes(uint8_t* buf, size_t n) override;
+  const uint8_t* readInPlace(size_t n) override;
+  void write8(uint8_t value) override;
+protected:
+  void setData(const uint8_t* data, size_t size);
+private:
+  const uint8_t* m_data;
+  size_t m_size;
+  size_t m_pos;
+  bool m_ok;
+};
+
+// Read-only interface to a memory-mapped file. If the file cannot be
+// mapped (e.g. it's empty or it's not a regular file), isMapped()
+// returns false and StdioFileInterface should be used instead.
+class MappedFileInterface : public MemoryFileInterface {
+public:
+  MappedFileInterface(FILE* file);
+  ~MappedFileInterface();
+  bool isMapped() const { return m_mapped != nullptr; }
+private:
+  MappedFileInterface(const MappedFileInterface&) = delete;
+  MappedFileInterface& operator=(const MappedFileInterface&) = delete;
+
+  void* m_mapped;
+  size_t m_mappedSize;
+#ifdef _WIN32
+  void* m_mapping;
+#endif
+};
+
 } // namespace dio
 
 #endif
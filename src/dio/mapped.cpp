@@ -0,0 +1,88 @@
+// Aseprite Document IO Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "dio/file_interface.h"
+
+#ifdef _WIN32
+  #include <windows.h>
+  #include <io.h>
+#else
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+namespace dio {
+
+MappedFileInterface::MappedFileInterface(FILE* file)
+  : m_mapped(nullptr)
+  , m_mappedSize(0)
+#ifdef _WIN32
+  , m_mapping(nullptr)
+#endif
+{
+  if (!file)
+    return;
+
+#ifdef _WIN32
+  HANDLE handle = (HANDLE)_get_osfhandle(_fileno(file));
+  if (handle == INVALID_HANDLE_VALUE)
+    return;
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(handle, &size) ||
+      size.QuadPart <= 0 ||
+      uint64_t(size.QuadPart) > uint64_t(SIZE_MAX))
+    return;
+
+  m_mapping = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!m_mapping)
+    return;
+
+  m_mapped = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!m_mapped) {
+    CloseHandle(m_mapping);
+    m_mapping = nullptr;
+    return;
+  }
+  m_mappedSize = size_t(size.QuadPart);
+#else
+  const int fd = fileno(file);
+  struct stat st;
+  if (fd < 0 ||
+      fstat(fd, &st) != 0 ||
+      !S_ISREG(st.st_mode) ||
+      st.st_size <= 0)
+    return;
+
+  void* mapped = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mapped == MAP_FAILED)
+    return;
+
+  // The file is read sequentially by the decoders
+  madvise(mapped, size_t(st.st_size), MADV_SEQUENTIAL);
+
+  m_mapped = mapped;
+  m_mappedSize = size_t(st.st_size);
+#endif
+
+  setData((const uint8_t*)m_mapped, m_mappedSize);
+}
+
+MappedFileInterface::~MappedFileInterface()
+{
+  if (!m_mapped)
+    return;
+
+#ifdef _WIN32
+  UnmapViewOfFile(m_mapped);
+  CloseHandle(m_mapping);
+#else
+  munmap(m_mapped, m_mappedSize);
+#endif
+}
+
+} // namespace dio
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2023 Igara Studio S.A.
+// Copyright (c) 2023-2024 Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -11,6 +11,7 @@
 #include "doc/algorithm/flip_image.h"
 
 #include "doc/image.h"
+#include "doc/mask.h"
 
 #include <benchmark/benchmark.h>
 
@@ -38,6 +39,34 @@ void BM_FlipRawPtr(benchmark::State& state) {
   }
 }
 
+void BM_FlipWithMaskSlow(benchmark::State& state) {
+  const auto pf = (PixelFormat)state.range(0);
+  const int w = state.range(1);
+  const int h = state.range(2);
+  const auto ft = (doc::algorithm::FlipType)state.range(3);
+  std::unique_ptr<Image> img(Image::create(pf, w, h));
+  Mask mask;
+  mask.replace(gfx::Rect(0, 0, w, h));
+  mask.subtract(gfx::Rect(w/4, h/4, w/2, h/2));
+  while (state.KeepRunning()) {
+    algorithm::flip_image_with_mask_slow(img.get(), &mask, ft, 0);
+  }
+}
+
+void BM_FlipWithMask(benchmark::State& state) {
+  const auto pf = (PixelFormat)state.range(0);
+  const int w = state.range(1);
+  const int h = state.range(2);
+  const auto ft = (doc::algorithm::FlipType)state.range(3);
+  std::unique_ptr<Image> img(Image::create(pf, w, h));
+  Mask mask;
+  mask.replace(gfx::Rect(0, 0, w, h));
+  mask.subtract(gfx::Rect(w/4, h/4, w/2, h/2));
+  while (state.KeepRunning()) {
+    algorithm::flip_image_with_mask(img.get(), &mask, ft, 0);
+  }
+}
+
 #define DEFARGS()                                                       \
   ->Args({ IMAGE_RGB, 8192, 8192, doc::algorithm::FlipHorizontal })     \
   ->Args({ IMAGE_RGB, 8192, 8192, doc::algorithm::FlipVertical })       \
@@ -60,4 +89,20 @@ BENCHMARK(BM_FlipRawPtr)
   ->Unit(benchmark::kMicrosecond)
   ->UseRealTime();
 
+#define MASKARGS()                                                      \
+  ->Args({ IMAGE_RGB, 2048, 2048, doc::algorithm::FlipHorizontal })     \
+  ->Args({ IMAGE_RGB, 2048, 2048, doc::algorithm::FlipVertical })       \
+  ->Args({ IMAGE_INDEXED, 2048, 2048, doc::algorithm::FlipHorizontal }) \
+  ->Args({ IMAGE_INDEXED, 2048, 2048, doc::algorithm::FlipVertical })
+
+BENCHMARK(BM_FlipWithMaskSlow)
+  MASKARGS()
+  ->Unit(benchmark::kMicrosecond)
+  ->UseRealTime();
+
+BENCHMARK(BM_FlipWithMask)
+  MASKARGS()
+  ->Unit(benchmark::kMicrosecond)
+  ->UseRealTime();
+
 BENCHMARK_MAIN();
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2023 Igara Studio S.A.
+// Copyright (c) 2023-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -17,9 +17,11 @@
 #include "doc/mask.h"
 #include "doc/primitives.h"
 #include "doc/primitives_fast.h"
+#include "doc/simd.h"
 #include "gfx/rect.h"
 
 #include <algorithm>
+#include <cstring>
 #include <memory>
 #include <utility>
 #include <vector>
@@ -27,6 +29,163 @@
 namespace doc {
 namespace algorithm {
 
+namespace {
+
+//////////////////////////////////////////////////////////////////////
+// Reverse the order of 16 bytes/8 words/4 dwords (SSE2 or NEON)
+
+#if DOC_SIMD_SSE2
+
+using vec = __m128i;
+
+inline vec load(const void* p) { return _mm_loadu_si128((const __m128i*)p); }
+inline void store(void* p, const vec v) { _mm_storeu_si128((__m128i*)p, v); }
+
+inline vec reverse32(const vec v) {
+  return _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3));
+}
+
+inline vec reverse16(vec v) {
+  v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+  v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+  return _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+}
+
+inline vec reverse8(const vec v) {
+  // SSE2 doesn't have a byte shuffle, so we swap the bytes of each
+  // word and then reverse the words.
+  return reverse16(_mm_or_si128(_mm_slli_epi16(v, 8),
+                                _mm_srli_epi16(v, 8)));
+}
+
+#elif DOC_SIMD_NEON
+
+using vec = uint8x16_t;
+
+inline vec load(const void* p) { return vld1q_u8((const uint8_t*)p); }
+inline void store(void* p, const vec v) { vst1q_u8((uint8_t*)p, v); }
+
+// vrev64 reverses each 64-bit half, vext swaps both halves
+inline vec reverse32(const vec v) {
+  const vec r = vreinterpretq_u8_u32(vrev64q_u32(vreinterpretq_u32_u8(v)));
+  return vextq_u8(r, r, 8);
+}
+
+inline vec reverse16(const vec v) {
+  const vec r = vreinterpretq_u8_u16(vrev64q_u16(vreinterpretq_u16_u8(v)));
+  return vextq_u8(r, r, 8);
+}
+
+inline vec reverse8(const vec v) {
+  const vec r = vrev64q_u8(v);
+  return vextq_u8(r, r, 8);
+}
+
+#endif
+
+#if DOC_SIMD_SSE2 || DOC_SIMD_NEON
+
+template<typename T>
+inline vec reverse(const vec v) {
+  static_assert(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4);
+  if constexpr (sizeof(T) == 4)
+    return reverse32(v);
+  else if constexpr (sizeof(T) == 2)
+    return reverse16(v);
+  else
+    return reverse8(v);
+}
+
+#endif
+
+// Reverses the pixels in the [l, r] range (both inclusive).
+template<typename T>
+void reverse_pixels(T* l, T* r)
+{
+#if DOC_SIMD_SSE2 || DOC_SIMD_NEON
+  constexpr int N = 16 / sizeof(T);
+  // Swap N pixels from each side
+  while (r-l+1 >= 2*N) {
+    const vec a = load(l);
+    const vec b = load(r-N+1);
+    store(l, reverse<T>(b));
+    store(r-N+1, reverse<T>(a));
+    l += N;
+    r -= N;
+  }
+#endif
+  for (; l<r; ++l, --r)
+    std::swap(*l, *r);
+}
+
+// Copies n pixels from src to dst in reverse order (dst[i] = src[n-1-i]).
+template<typename T>
+void copy_reversed_pixels(const T* src, T* dst, const int n)
+{
+  int i = 0;
+#if DOC_SIMD_SSE2 || DOC_SIMD_NEON
+  constexpr int N = 16 / sizeof(T);
+  for (; i+N<=n; i+=N)
+    store(dst+i, reverse<T>(load(src+n-i-N)));
+#endif
+  for (; i<n; ++i)
+    dst[i] = src[n-1-i];
+}
+
+// Copies n pixels from src(srcX, srcY) to dst(dstX, dstY), in
+// reverse order if "reversed" is true.
+template<typename ImageTraits>
+void copy_pixels(const Image* src, const int srcX, const int srcY,
+                 Image* dst, const int dstX, const int dstY,
+                 const int n, const bool reversed)
+{
+  if constexpr (ImageTraits::pixel_format == IMAGE_BITMAP) {
+    // We cannot use raw pointers to iterate through bits
+    for (int i=0; i<n; ++i) {
+      put_pixel_fast<ImageTraits>(
+        dst, dstX+i, dstY,
+        get_pixel_fast<ImageTraits>(src, srcX+(reversed ? n-1-i: i), srcY));
+    }
+  }
+  else {
+    using pixel_t = typename ImageTraits::pixel_t;
+    auto s = (const pixel_t*)src->getPixelAddress(srcX, srcY);
+    auto d = (pixel_t*)dst->getPixelAddress(dstX, dstY);
+    if (reversed)
+      copy_reversed_pixels(s, d, n);
+    else
+      std::memcpy(d, s, n*sizeof(pixel_t));
+  }
+}
+
+// Gets the selected pixels of the row "y" of the mask (relative to
+// the mask bounds) as an array of booleans.
+void get_mask_row(const Mask* mask, const int y, std::vector<uint8_t>& row)
+{
+  const Image* bitmap = mask->bitmap();
+  for (int x=0; x<int(row.size()); ++x)
+    row[x] = get_pixel_fast<BitmapTraits>(bitmap, x, y);
+}
+
+// Calls f(begin, end) for each run of selected pixels in the row.
+template<typename Func>
+void for_each_run(const std::vector<uint8_t>& row, Func&& f)
+{
+  const int n = int(row.size());
+  for (int x=0; x<n; ) {
+    if (!row[x]) {
+      ++x;
+      continue;
+    }
+    const int begin = x;
+    while (x < n && row[x])
+      ++x;
+    f(begin, x);
+  }
+}
+
+} // anonymous namespace
+
 template<typename ImageTraits>
 void flip_image_with_put_pixel_fast_templ(Image* image, const gfx::Rect& bounds, FlipType flipType)
 {
@@ -81,26 +240,23 @@ void flip_image_with_rawptr_templ(Image* image, const gfx::Rect& bounds, FlipTyp
 
     case FlipHorizontal:
       for (int y=bounds.y; y<bounds.y2(); ++y) {
-        const int n = bounds.w/2;
         auto l = (address_t)image->getPixelAddress(bounds.x, y);
         auto r = (address_t)image->getPixelAddress(bounds.x2()-1, y);
-
-        for (int x=0; x<n; ++x, ++l, --r) {
-          std::swap(*l, *r);
-        }
+        reverse_pixels(l, r);
       }
       break;
 
     case FlipVertical: {
-      const int n = bounds.w;
+      // Swap whole rows using a temporary row
+      const std::size_t rowBytes = ImageTraits::width_bytes(bounds.w);
+      std::vector<uint8_t> tmp(rowBytes);
       int v = bounds.y2()-1;
       for (int y=bounds.y; y<bounds.y+bounds.h/2; ++y, --v) {
-        auto t = (address_t)image->getPixelAddress(bounds.x, y);
-        auto b = (address_t)image->getPixelAddress(bounds.x, v);
-
-        for (int x=0; x<n; ++x, ++t, ++b) {
-          std::swap(*t, *b);
-        }
+        auto t = (uint8_t*)image->getPixelAddress(bounds.x, y);
+        auto b = (uint8_t*)image->getPixelAddress(bounds.x, v);
+        std::memcpy(tmp.data(), t, rowBytes);
+        std::memcpy(t, b, rowBytes);
+        std::memcpy(b, tmp.data(), rowBytes);
       }
       break;
     }
@@ -134,7 +290,7 @@ void flip_image(Image* image, const gfx::Rect& bounds, FlipType flipType)
 }
 
 template<typename ImageTraits>
-void flip_image_with_mask_templ(Image* image, const Mask* mask, FlipType flipType, int bgcolor)
+void flip_image_with_mask_slow_templ(Image* image, const Mask* mask, FlipType flipType, int bgcolor)
 {
   gfx::Rect bounds = mask->bounds();
 
@@ -191,13 +347,91 @@ void flip_image_with_mask_templ(Image* image, const Mask* mask, FlipType flipTyp
   }
 }
 
+// Iterates the mask by runs of selected pixels, copying each run
+// with raw pointers (reversed for horizontal flips).
+template<typename ImageTraits>
+void flip_image_with_mask_templ(Image* image, const Mask* mask, FlipType flipType, int bgcolor)
+{
+  const gfx::Rect bounds = mask->bounds();
+  std::vector<uint8_t> row(bounds.w);
+
+  switch (flipType) {
+
+    case FlipHorizontal: {
+      std::unique_ptr<Image> originalRow(Image::create(image->pixelFormat(), bounds.w, 1));
+
+      for (int y=bounds.y; y<bounds.y2(); ++y) {
+        // Copy the current row.
+        originalRow->copy(image, gfx::Clip(0, 0, bounds.x, y, bounds.w, 1));
+        get_mask_row(mask, y-bounds.y, row);
+
+        for_each_run(row, [&](const int begin, const int end){
+          copy_pixels<ImageTraits>(
+            originalRow.get(), begin, 0,
+            image, bounds.x+bounds.w-end, y,
+            end-begin, true);
+
+          // Clear pixels that aren't covered by a mirrored pixel
+          for (int i=begin; i<end; ++i) {
+            if (!row[bounds.w-1-i])
+              put_pixel_fast<ImageTraits>(image, bounds.x+i, y, bgcolor);
+          }
+        });
+      }
+      break;
+    }
+
+    case FlipVertical: {
+      std::unique_ptr<Image> original(Image::create(image->pixelFormat(), bounds.w, bounds.h));
+      original->copy(image, gfx::Clip(0, 0, bounds.x, bounds.y, bounds.w, bounds.h));
+      std::vector<uint8_t> mirrorRow(bounds.w);
+
+      int v = bounds.y2()-1;
+      for (int y=bounds.y; y<bounds.y2(); ++y, --v) {
+        get_mask_row(mask, y-bounds.y, row);
+        get_mask_row(mask, v-bounds.y, mirrorRow);
+
+        for_each_run(row, [&](const int begin, const int end){
+          copy_pixels<ImageTraits>(
+            original.get(), begin, y-bounds.y,
+            image, bounds.x+begin, v,
+            end-begin, false);
+
+          // Clear pixels that aren't covered by a mirrored pixel
+          for (int i=begin; i<end; ++i) {
+            if (!mirrorRow[i])
+              put_pixel_fast<ImageTraits>(image, bounds.x+i, y, bgcolor);
+          }
+        });
+      }
+      break;
+    }
+
+    // TODO
+    case FlipDiagonal:
+      ASSERT(false);
+      break;
+  }
+}
+
 void flip_image_with_mask(Image* image, const Mask* mask, FlipType flipType, int bgcolor)
 {
+  if (!mask->bitmap())
+    return;
+
   DOC_DISPATCH_BY_COLOR_MODE(
     image->colorMode(),
     flip_image_with_mask_templ,
     image, mask, flipType, bgcolor);
 }
 
+void flip_image_with_mask_slow(Image* image, const Mask* mask, FlipType flipType, int bgcolor)
+{
+  DOC_DISPATCH_BY_COLOR_MODE(
+    image->colorMode(),
+    flip_image_with_mask_slow_templ,
+    image, mask, flipType, bgcolor);
+}
+
 } // namespace algorithm
 } // namespace doc
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2023 Igara Studio S.A.
+// Copyright (c) 2023-2024 Igara Studio S.A.
 // Copyright (c) 2001-2014 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -20,7 +20,8 @@ namespace doc {
 
     // Different implementation to flip a rectangular region specified
     // in the "bounds" parameter.
-    // flip_image: uses raw pointers
+    // flip_image: uses raw pointers (SIMD to reverse rows, and memcpy
+    //             to swap rows)
     // flip_image_slow: uses get/put_pixel_fast
     void flip_image(Image* image, const gfx::Rect& bounds, FlipType flipType);
     void flip_image_slow(Image* image, const gfx::Rect& bounds, FlipType flipType);
@@ -28,7 +29,10 @@ namespace doc {
     // Flips an irregular region specified by the "mask". The
     // "bgcolor" is used to clear areas that aren't covered by a
     // mirrored pixel.
+    // flip_image_with_mask: iterates runs of selected pixels
+    // flip_image_with_mask_slow: iterates pixel by pixel
     void flip_image_with_mask(Image* image, const Mask* mask, FlipType flipType, int bgcolor);
+    void flip_image_with_mask_slow(Image* image, const Mask* mask, FlipType flipType, int bgcolor);
 
   }
 }
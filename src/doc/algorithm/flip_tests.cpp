@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2023  Igara Studio S.A.
+// Copyright (c) 2023-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -11,6 +11,7 @@
 #include "doc/algorithm/random_image.h"
 #include "doc/image.h"
 #include "doc/image_ref.h"
+#include "doc/mask.h"
 #include "doc/primitives.h"
 
 using namespace doc;
@@ -51,6 +52,39 @@ TEST(Flip, Image)
   }
 }
 
+TEST(Flip, ImageWithMask)
+{
+  for (auto pf : { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED, IMAGE_BITMAP, IMAGE_TILEMAP }) {
+    for (int h=2; h<100; h+=7) {
+      for (int w=2; w<100; w+=7) {
+        ImageRef a(Image::create(pf, w, h));
+        doc::algorithm::random_image(a.get());
+
+        // Irregular selection inside the image
+        Mask mask;
+        mask.replace(gfx::Rect(1, 1, w-1, h-1));
+        mask.subtract(gfx::Rect(w/3, 0, w/4+1, h/2+1));
+        mask.add(gfx::Rect(0, h/2, w/5+1, h/3+1));
+        if (mask.isEmpty())
+          continue;
+
+        for (auto ft : { doc::algorithm::FlipHorizontal,
+                         doc::algorithm::FlipVertical }) {
+          ImageRef b(Image::createCopy(a.get()));
+          ImageRef c(Image::createCopy(a.get()));
+
+          doc::algorithm::flip_image_with_mask(b.get(), &mask, ft, 0);
+          doc::algorithm::flip_image_with_mask_slow(c.get(), &mask, ft, 0);
+
+          ASSERT_TRUE(is_same_image(b.get(), c.get()))
+            << "Pixel format=" << pf << " Size=" << w << "x" << h
+            << "\nFlip type=" << ft;
+        }
+      }
+    }
+  }
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
@@ -1,57 +1,52 @@
-// The floodfill routine.
-// By Shawn Hargreaves.
-//
-// Changes by David Capello:
-// - Adapted to Aseprite
-// - Added non-contiguous mode
-// - Added mask parameter
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+// Copyright (c) 2001-2017 David Capello
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
 //
-// TODO rewrite this algorithm from scratch
+// The first version of this routine was based on the floodfill
+// routine by Shawn Hargreaves (Allegro library).
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 
+#include "doc/algorithm/floodfill.h"
+
 #include "base/base.h"
-#include "doc/algo.h"
+#include "base/thread_pool.h"
 #include "doc/image.h"
 #include "doc/mask.h"
 #include "doc/primitives.h"
 #include "doc/primitives_fast.h"
+#include "doc/simd.h"
+#include "gfx/rect.h"
 
-#include <climits>
-#include <cmath>
-#include <limits>
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <thread>
 #include <vector>
 
 namespace doc {
 namespace algorithm {
 
-struct FLOODED_LINE {   // store segments which have been flooded
-  char flags;           // status of the segment
-  int lpos, rpos;       // left and right ends of segment
-  int y;                // y coordinate of the segment
-  int next;             // linked list if several per line
-};
-
-static std::vector<FLOODED_LINE> flood_buf;
-static int flood_count;          /* number of flooded segments */
+namespace {
 
-#define FLOOD_IN_USE             1
-#define FLOOD_TODO_ABOVE         2
-#define FLOOD_TODO_BELOW         4
+// Minimum number of pixels to classify the rows of the non-contiguous
+// mode in several threads.
+const int kMinPixelsToParallelize = 128*128;
 
-#define FLOOD_LINE(c)            (&flood_buf[c])
+//////////////////////////////////////////////////////////////////////
+// Color comparison (one pixel)
 
-static inline bool color_equal_32_raw(color_t c1, color_t c2)
+inline bool color_equal_32_raw(color_t c1, color_t c2)
 {
   return (c1 == c2);
 }
 
-static inline bool color_equal_32(color_t c1, color_t c2, int tolerance)
+inline bool color_equal_32(color_t c1, color_t c2, int tolerance)
 {
   if (tolerance == 0)
     return (c1 == c2) || (rgba_geta(c1) == 0 && rgba_geta(c2) == 0);
@@ -75,7 +70,7 @@ static inline bool color_equal_32(color_t c1, color_t c2, int tolerance)
   }
 }
 
-static inline bool color_equal_16(color_t c1, color_t c2, int tolerance)
+inline bool color_equal_16(color_t c1, color_t c2, int tolerance)
 {
   if (tolerance == 0)
     return (c1 == c2) || (graya_geta(c1) == 0 && graya_geta(c2) == 0);
@@ -93,7 +88,7 @@ static inline bool color_equal_16(color_t c1, color_t c2, int tolerance)
   }
 }
 
-static inline bool color_equal_8(color_t c1, color_t c2, int tolerance)
+inline bool color_equal_8(color_t c1, color_t c2, int tolerance)
 {
   if (tolerance == 0)
     return (c1 == c2);
@@ -101,282 +96,341 @@ static inline bool color_equal_8(color_t c1, color_t c2, int tolerance)
     return ABS((int)c1 - (int)c2) <= tolerance;
 }
 
-template<typename ImageTraits>
-static inline bool color_equal(color_t c1, color_t c2, int tolerance)
+//////////////////////////////////////////////////////////////////////
+// Color comparison (a whole row)
+//
+// Each match_*() function sets match[i] = 1 if the pixel i is
+// similar to the source color, or 0 in other case. The first pixels
+// are compared with SSE2/NEON instructions, and the rest (or all
+// pixels if SIMD isn't available) with the color_equal_*() functions.
+
+void match_rgba(const uint32_t* p, const int n,
+                const color_t srcColor, const int tolerance,
+                uint8_t* match)
 {
-  static_assert(false && sizeof(ImageTraits), "Invalid color comparison");
-  return false;
-}
+  int i = 0;
+
+#if DOC_SIMD_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i src = _mm_set1_epi32(int(srcColor));
+  const __m128i tol = _mm_set1_epi8(char(tolerance));
+  const __m128i alphaMask = _mm_set1_epi32(int(rgba_a_mask));
+  const bool srcTransparent = (rgba_geta(srcColor) == 0);
+
+  for (; i+4<=n; i+=4) {
+    const __m128i c = _mm_loadu_si128((const __m128i*)(p+i));
+    // |c - src| <= tolerance for each component
+    const __m128i diff = _mm_or_si128(_mm_subs_epu8(c, src),
+                                      _mm_subs_epu8(src, c));
+    __m128i eq = _mm_cmpeq_epi32(_mm_subs_epu8(diff, tol), zero);
+    if (srcTransparent)
+      eq = _mm_or_si128(eq, _mm_cmpeq_epi32(_mm_and_si128(c, alphaMask), zero));
+
+    const int bits = _mm_movemask_ps(_mm_castsi128_ps(eq));
+    for (int j=0; j<4; ++j)
+      match[i+j] = ((bits >> j) & 1);
+  }
+#elif DOC_SIMD_NEON
+  const uint32x4_t zero = vdupq_n_u32(0);
+  const uint8x16_t src = vreinterpretq_u8_u32(vdupq_n_u32(srcColor));
+  const uint8x16_t tol = vdupq_n_u8(uint8_t(tolerance));
+  const uint32x4_t alphaMask = vdupq_n_u32(rgba_a_mask);
+  const bool srcTransparent = (rgba_geta(srcColor) == 0);
+
+  for (; i+4<=n; i+=4) {
+    const uint32x4_t c = vld1q_u32(p+i);
+    const uint8x16_t diff = vabdq_u8(vreinterpretq_u8_u32(c), src);
+    uint32x4_t eq = vceqq_u32(vreinterpretq_u32_u8(vqsubq_u8(diff, tol)), zero);
+    if (srcTransparent)
+      eq = vorrq_u32(eq, vceqq_u32(vandq_u32(c, alphaMask), zero));
+
+    match[i  ] = (vgetq_lane_u32(eq, 0) & 1);
+    match[i+1] = (vgetq_lane_u32(eq, 1) & 1);
+    match[i+2] = (vgetq_lane_u32(eq, 2) & 1);
+    match[i+3] = (vgetq_lane_u32(eq, 3) & 1);
+  }
+#endif
 
-template<>
-inline bool color_equal<RgbTraits>(color_t c1, color_t c2, int tolerance)
-{
-  return color_equal_32(c1, c2, tolerance);
+  for (; i<n; ++i)
+    match[i] = color_equal_32(p[i], srcColor, tolerance);
 }
 
-template<>
-inline bool color_equal<GrayscaleTraits>(color_t c1, color_t c2, int tolerance)
+void match_graya(const uint16_t* p, const int n,
+                 const color_t srcColor, const int tolerance,
+                 uint8_t* match)
 {
-  return color_equal_16(c1, c2, tolerance);
-}
+  int i = 0;
+
+#if DOC_SIMD_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i src = _mm_set1_epi16(short(srcColor));
+  const __m128i tol = _mm_set1_epi8(char(tolerance));
+  const __m128i alphaMask = _mm_set1_epi16(short(graya_a_mask));
+  const bool srcTransparent = (graya_geta(srcColor) == 0);
+
+  for (; i+8<=n; i+=8) {
+    const __m128i c = _mm_loadu_si128((const __m128i*)(p+i));
+    const __m128i diff = _mm_or_si128(_mm_subs_epu8(c, src),
+                                      _mm_subs_epu8(src, c));
+    __m128i eq = _mm_cmpeq_epi16(_mm_subs_epu8(diff, tol), zero);
+    if (srcTransparent)
+      eq = _mm_or_si128(eq, _mm_cmpeq_epi16(_mm_and_si128(c, alphaMask), zero));
+
+    // Two bits for each pixel
+    const int bits = _mm_movemask_epi8(eq);
+    for (int j=0; j<8; ++j)
+      match[i+j] = ((bits >> (2*j)) & 1);
+  }
+#elif DOC_SIMD_NEON
+  const uint16x8_t zero = vdupq_n_u16(0);
+  const uint8x16_t src = vreinterpretq_u8_u16(vdupq_n_u16(uint16_t(srcColor)));
+  const uint8x16_t tol = vdupq_n_u8(uint8_t(tolerance));
+  const uint16x8_t alphaMask = vdupq_n_u16(graya_a_mask);
+  const bool srcTransparent = (graya_geta(srcColor) == 0);
+
+  for (; i+8<=n; i+=8) {
+    const uint16x8_t c = vld1q_u16(p+i);
+    const uint8x16_t diff = vabdq_u8(vreinterpretq_u8_u16(c), src);
+    uint16x8_t eq = vceqq_u16(vreinterpretq_u16_u8(vqsubq_u8(diff, tol)), zero);
+    if (srcTransparent)
+      eq = vorrq_u16(eq, vceqq_u16(vandq_u16(c, alphaMask), zero));
+
+    vst1_u8(match+i, vand_u8(vmovn_u16(eq), vdup_n_u8(1)));
+  }
+#endif
 
-template<>
-inline bool color_equal<IndexedTraits>(color_t c1, color_t c2, int tolerance)
-{
-  return color_equal_8(c1, c2, tolerance);
+  for (; i<n; ++i)
+    match[i] = color_equal_16(p[i], srcColor, tolerance);
 }
 
-template<>
-inline bool color_equal<TilemapTraits>(color_t c1, color_t c2, int tolerance)
+void match_indexed(const uint8_t* p, const int n,
+                   const color_t srcColor, const int tolerance,
+                   uint8_t* match)
 {
-  return color_equal_32_raw(c1, c2);
-}
-
+  int i = 0;
+
+#if DOC_SIMD_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi8(1);
+  const __m128i src = _mm_set1_epi8(char(srcColor));
+  const __m128i tol = _mm_set1_epi8(char(tolerance));
+
+  for (; i+16<=n; i+=16) {
+    const __m128i c = _mm_loadu_si128((const __m128i*)(p+i));
+    const __m128i diff = _mm_or_si128(_mm_subs_epu8(c, src),
+                                      _mm_subs_epu8(src, c));
+    const __m128i eq = _mm_cmpeq_epi8(_mm_subs_epu8(diff, tol), zero);
+    _mm_storeu_si128((__m128i*)(match+i), _mm_and_si128(eq, one));
+  }
+#elif DOC_SIMD_NEON
+  const uint8x16_t one = vdupq_n_u8(1);
+  const uint8x16_t src = vdupq_n_u8(uint8_t(srcColor));
+  const uint8x16_t tol = vdupq_n_u8(uint8_t(tolerance));
+
+  for (; i+16<=n; i+=16) {
+    const uint8x16_t c = vld1q_u8(p+i);
+    const uint8x16_t eq = vcleq_u8(vabdq_u8(c, src), tol);
+    vst1q_u8(match+i, vandq_u8(eq, one));
+  }
+#endif
 
+  for (; i<n; ++i)
+    match[i] = color_equal_8(p[i], srcColor, tolerance);
+}
 
-/* flooder:
- *  Fills a horizontal line around the specified position, and adds it
- *  to the list of drawn segments. Returns the first x coordinate after
- *  the part of the line which it has dealt with.
- */
-static int flooder(const Image* image,
-                   const Mask* mask,
-                   int x, int y,
-                   const gfx::Rect& bounds,
-                   color_t src_color, int tolerance, void *data, AlgoHLine proc)
+void match_tilemap(const uint32_t* p, const int n,
+                   const color_t srcColor,
+                   uint8_t* match)
 {
-#define MASKED(u, v)                                                    \
-        (mask &&                                                        \
-         (!mask->bounds().contains(u, v) ||                             \
-          (mask->bitmap() &&                                            \
-           !get_pixel_fast<BitmapTraits>(mask->bitmap(),                \
-                                         (u)-mask->bounds().x,          \
-                                         (v)-mask->bounds().y))))
-
-  FLOODED_LINE *p;
-  int left = 0, right = 0;
-  int c;
-
-  switch (image->pixelFormat()) {
-
-    case IMAGE_RGB:
-      {
-        uint32_t* address = reinterpret_cast<uint32_t*>(image->getPixelAddress(0, y));
-
-        // Check start pixel
-        if (!color_equal_32((int)*(address+x), src_color, tolerance) || MASKED(x, y))
-          return x+1;
-
-        // Work left from starting point
-        for (left=x-1; left>=bounds.x; left--) {
-          if (!color_equal_32((int)*(address+left), src_color, tolerance) || MASKED(left, y))
-            break;
-        }
-
-        // Work right from starting point
-        for (right=x+1; right<bounds.x2(); right++) {
-          if (!color_equal_32((int)*(address+right), src_color, tolerance) || MASKED(right, y))
-            break;
-        }
-      }
-      break;
-
-    case IMAGE_GRAYSCALE:
-      {
-        uint16_t* address = reinterpret_cast<uint16_t*>(image->getPixelAddress(0, y));
-
-        // Check start pixel
-        if (!color_equal_16((int)*(address+x), src_color, tolerance) || MASKED(x, y))
-          return x+1;
-
-        // Work left from starting point
-        for (left=x-1; left>=bounds.x; left--) {
-          if (!color_equal_16((int)*(address+left), src_color, tolerance) || MASKED(left, y))
-            break;
-        }
-
-        // Work right from starting point
-        for (right=x+1; right<bounds.x2(); right++) {
-          if (!color_equal_16((int)*(address+right), src_color, tolerance) || MASKED(right, y))
-            break;
-        }
-      }
-      break;
-
-    case IMAGE_INDEXED:
-      {
-        uint8_t* address = image->getPixelAddress(0, y);
-
-        // Check start pixel
-        if (!color_equal_8((int)*(address+x), src_color, tolerance) || MASKED(x, y))
-          return x+1;
-
-        // Work left from starting point
-        for (left=x-1; left>=bounds.x; left--) {
-          if (!color_equal_8((int)*(address+left), src_color, tolerance) || MASKED(left, y))
-            break;
-        }
-
-        // Work right from starting point
-        for (right=x+1; right<bounds.x2(); right++) {
-          if (!color_equal_8((int)*(address+right), src_color, tolerance) || MASKED(right, y))
-            break;
-        }
-      }
-      break;
+  int i = 0;
 
-    case IMAGE_TILEMAP:
-      {
-        // TODO add support for mask
+#if DOC_SIMD_SSE2
+  const __m128i src = _mm_set1_epi32(int(srcColor));
 
-        uint32_t* address = reinterpret_cast<uint32_t*>(image->getPixelAddress(0, y));
-
-        // Check start pixel
-        if (!color_equal_32_raw((int)*(address+x), src_color))
-          return x+1;
-
-        // Work left from starting point
-        for (left=x-1; left>=bounds.x; left--) {
-          if (!color_equal_32_raw((int)*(address+left), src_color))
-            break;
-        }
+  for (; i+4<=n; i+=4) {
+    const __m128i c = _mm_loadu_si128((const __m128i*)(p+i));
+    const int bits = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(c, src)));
+    for (int j=0; j<4; ++j)
+      match[i+j] = ((bits >> j) & 1);
+  }
+#elif DOC_SIMD_NEON
+  const uint32x4_t src = vdupq_n_u32(srcColor);
+
+  for (; i+4<=n; i+=4) {
+    const uint32x4_t eq = vceqq_u32(vld1q_u32(p+i), src);
+    match[i  ] = (vgetq_lane_u32(eq, 0) & 1);
+    match[i+1] = (vgetq_lane_u32(eq, 1) & 1);
+    match[i+2] = (vgetq_lane_u32(eq, 2) & 1);
+    match[i+3] = (vgetq_lane_u32(eq, 3) & 1);
+  }
+#endif
 
-        // Work right from starting point
-        for (right=x+1; right<bounds.x2(); right++) {
-          if (!color_equal_32_raw((int)*(address+right), src_color))
-            break;
-        }
-      }
-      break;
+  for (; i<n; ++i)
+    match[i] = color_equal_32_raw(p[i], srcColor);
+}
 
-    default:
-      // Check start pixel
-      if (get_pixel(image, x, y) != src_color || MASKED(x, y))
-        return x+1;
+//////////////////////////////////////////////////////////////////////
+// Runs of pixels
 
-      // Work left from starting point
-      for (left=x-1; left>=bounds.x; left--) {
-        if (get_pixel(image, left, y) != src_color || MASKED(left, y))
-          break;
-      }
+// Horizontal run of pixels [x1, x2] (maximal in its row) that match
+// the source color.
+struct Run {
+  int x1, x2;
+  bool visited;
+};
 
-      // Work right from starting point
-      for (right=x+1; right<bounds.x2(); right++) {
-        if (get_pixel(image, right, y) != src_color || MASKED(right, y))
-          break;
-      }
-      break;
+using Runs = std::vector<Run>;
+
+// Calculates the runs of pixels of each row (inside the given
+// bounds) that match the source color and are inside the mask.
+class RowClassifier {
+public:
+  RowClassifier(const Image* image,
+                const Mask* mask,
+                const gfx::Rect& bounds,
+                const color_t srcColor,
+                const int tolerance)
+    : m_image(image)
+    // TODO add support for mask in tilemaps
+    , m_mask(image->pixelFormat() == IMAGE_TILEMAP ? nullptr: mask)
+    , m_bounds(bounds)
+    , m_srcColor(srcColor)
+    , m_tolerance(std::clamp(tolerance, 0, 255)) {
   }
 
-  left++;
-  right--;
+  // It's thread-safe to call this function from several threads
+  // (using a different "runs" and "match" buffer for each thread).
+  void getRuns(const int y, Runs& runs, std::vector<uint8_t>& match) const {
+    const int w = m_bounds.w;
+    match.resize(w);
+    runs.clear();
 
-  /* draw the line */
-  (*proc)(left, y, right, data);
+    const uint8_t* addr = m_image->getPixelAddress(m_bounds.x, y);
+    switch (m_image->pixelFormat()) {
+      case IMAGE_RGB:
+        match_rgba((const uint32_t*)addr, w, m_srcColor, m_tolerance, match.data());
+        break;
+      case IMAGE_GRAYSCALE:
+        match_graya((const uint16_t*)addr, w, m_srcColor, m_tolerance, match.data());
+        break;
+      case IMAGE_INDEXED:
+        match_indexed(addr, w, m_srcColor, m_tolerance, match.data());
+        break;
+      case IMAGE_TILEMAP:
+        match_tilemap((const uint32_t*)addr, w, m_srcColor, match.data());
+        break;
+      default:
+        for (int i=0; i<w; ++i)
+          match[i] = (get_pixel(m_image, m_bounds.x+i, y) == m_srcColor);
+        break;
+    }
 
-  /* store it in the list of flooded segments */
-  c = y;
-  p = FLOOD_LINE(c);
+    if (m_mask)
+      applyMask(y, match);
 
-  if (p->flags) {
-    while (p->next) {
-      c = p->next;
-      p = FLOOD_LINE(c);
+    for (int i=0; i<w; ) {
+      if (!match[i]) {
+        ++i;
+        continue;
+      }
+      const int x1 = i;
+      do {
+        ++i;
+      } while (i < w && match[i]);
+      runs.push_back(Run{ m_bounds.x+x1, m_bounds.x+i-1, false });
     }
-
-    p->next = c = flood_count++;
-    flood_buf.resize(flood_count);
-    p = FLOOD_LINE(c);
   }
 
-  p->flags = FLOOD_IN_USE;
-  p->lpos = left;
-  p->rpos = right;
-  p->y = y;
-  p->next = 0;
-
-  if (y > bounds.y)
-    p->flags |= FLOOD_TODO_ABOVE;
-
-  if (y+1 < bounds.y2())
-    p->flags |= FLOOD_TODO_BELOW;
+private:
+  // Removes pixels outside the mask from "match"
+  void applyMask(const int y, std::vector<uint8_t>& match) const {
+    const gfx::Rect& maskBounds = m_mask->bounds();
+    const int x1 = std::clamp(maskBounds.x, m_bounds.x, m_bounds.x2());
+    const int x2 = std::clamp(maskBounds.x2(), m_bounds.x, m_bounds.x2());
 
-  return right+2;
-}
-
-
-
-/* check_flood_line:
- *  Checks a line segment, using the scratch buffer is to store a list of
- *  segments which have already been drawn in order to minimise the required
- *  number of tests.
- */
-static int check_flood_line(const Image* image,
-                            const Mask* mask,
-                            int y, int left, int right,
-                            const gfx::Rect& bounds,
-                            int src_color, int tolerance, void *data, AlgoHLine proc)
-{
-  int c;
-  FLOODED_LINE *p;
-  int ret = false;
-
-  while (left <= right) {
-    c = y;
-
-    for (;;) {
-      p = FLOOD_LINE(c);
-
-      if ((left >= p->lpos) && (left <= p->rpos)) {
-        left = p->rpos+2;
-        break;
-      }
+    if (y < maskBounds.y || y >= maskBounds.y2() || x1 >= x2) {
+      std::fill(match.begin(), match.end(), 0);
+      return;
+    }
 
-      c = p->next;
+    std::fill(match.begin(), match.begin()+(x1-m_bounds.x), 0);
+    std::fill(match.begin()+(x2-m_bounds.x), match.end(), 0);
 
-      if (!c) {
-        left = flooder(image, mask, left, y, bounds, src_color, tolerance, data, proc);
-        ret = true;
-        break;
+    if (const Image* bitmap = m_mask->bitmap()) {
+      for (int x=x1; x<x2; ++x) {
+        if (!get_pixel_fast<BitmapTraits>(bitmap,
+                                          x-maskBounds.x,
+                                          y-maskBounds.y))
+          match[x-m_bounds.x] = 0;
       }
     }
   }
 
-  return ret;
-}
+  const Image* m_image;
+  const Mask* m_mask;
+  gfx::Rect m_bounds;
+  color_t m_srcColor;
+  int m_tolerance;
+};
 
-template<typename ImageTraits>
-static void replace_color(const Image* image, const gfx::Rect& bounds, int src_color, int tolerance, void* data, AlgoHLine proc)
+// Calls "proc" for all pixels in the bounds that match the source
+// color. The rows are classified in several threads (each one with a
+// band of rows), but "proc" is always called from this thread.
+void replace_color(const RowClassifier& classifier,
+                   const gfx::Rect& bounds,
+                   void* data,
+                   AlgoHLine proc)
 {
-  typename ImageTraits::address_t address;
-
-  for (int y=bounds.y; y<bounds.y2(); ++y) {
-    address = reinterpret_cast<typename ImageTraits::address_t>(image->getPixelAddress(bounds.x, y));
-
-    for (int x=bounds.x; x<bounds.x2(); ++x, ++address) {
-      int right = -1;
-
-      if (color_equal<ImageTraits>((int)(*address), src_color, tolerance)) {
-        ++address;
-        for (right=x+1; right<bounds.x2(); ++right, ++address) {
-          if (!color_equal<ImageTraits>((int)(*address), src_color, tolerance))
-            break;
-        }
-        (*proc)(x, y, right-1, data);
-        x = right;
+  const int nthreads =
+    (bounds.w*bounds.h < kMinPixelsToParallelize ? 1:
+     std::clamp<int>(std::thread::hardware_concurrency(), 1, 8));
+
+  // Bands of rows are processed in groups of "nthreads" bands, so we
+  // don't need to keep the runs of the whole image in memory.
+  const int bandHeight = std::clamp(bounds.h / nthreads, 1, 64);
+  std::vector<std::vector<Runs>> bands(nthreads);
+  std::vector<std::vector<uint8_t>> matches(nthreads);
+
+  auto classify_band =
+    [&classifier, &bands, &matches, bandHeight, &bounds](const int i, const int y1) {
+      const int y2 = std::min(y1+bandHeight, bounds.y2());
+      bands[i].resize(std::max(0, y2-y1));
+      for (int y=y1; y<y2; ++y)
+        classifier.getRuns(y, bands[i][y-y1], matches[i]);
+    };
+
+  std::unique_ptr<base::thread_pool> threads;
+  if (nthreads > 1)
+    threads = std::make_unique<base::thread_pool>(nthreads);
+
+  for (int y=bounds.y; y<bounds.y2(); y+=bandHeight*nthreads) {
+    if (threads) {
+      for (int i=0; i<nthreads; ++i)
+        threads->execute([&classify_band, i, y, bandHeight]{
+          classify_band(i, y+i*bandHeight);
+        });
+      threads->wait_all();
+    }
+    else
+      classify_band(0, y);
+
+    for (int i=0; i<nthreads; ++i) {
+      const int y1 = y+i*bandHeight;
+      for (int j=0; j<int(bands[i].size()); ++j) {
+        for (const Run& run : bands[i][j])
+          (*proc)(run.x1, y1+j, run.x2, data);
       }
     }
   }
 }
 
-/* floodfill:
- *  Fills an enclosed area (starting at point x, y) with the specified color.
- */
+} // anonymous namespace
+
 void floodfill(const Image* image,
                const Mask* mask,
                const int x, const int y,
                const gfx::Rect& bounds,
-               const doc::color_t src_color,
+               const doc::color_t srcColor,
                const int tolerance,
                const bool contiguous,
                const bool isEightConnected,
@@ -388,135 +442,78 @@ void floodfill(const Image* image,
       (y < 0) || (y >= image->height()))
     return;
 
+  const gfx::Rect rc = (bounds & image->bounds());
+  if (rc.isEmpty())
+    return;
+
+  RowClassifier classifier(image, mask, rc, srcColor, tolerance);
+
   // Non-contiguous case, we replace colors in the whole image.
   if (!contiguous) {
-    switch (image->pixelFormat()) {
-      case IMAGE_RGB:
-        replace_color<RgbTraits>(image, bounds, src_color, tolerance, data, proc);
-        break;
-      case IMAGE_GRAYSCALE:
-        replace_color<GrayscaleTraits>(image, bounds, src_color, tolerance, data, proc);
-        break;
-      case IMAGE_INDEXED:
-        replace_color<IndexedTraits>(image, bounds, src_color, tolerance, data, proc);
-        break;
-      case IMAGE_TILEMAP:
-        replace_color<TilemapTraits>(image, bounds, src_color, tolerance, data, proc);
-        break;
-    }
+    replace_color(classifier, rc, data, proc);
     return;
   }
 
-  /* set up the list of flooded segments */
-  flood_buf.resize(image->height());
-  flood_count = image->height();
-  FLOODED_LINE* p = (FLOODED_LINE*)&flood_buf[0];
-  for (int c=0; c<flood_count; c++) {
-    p[c].flags = 0;
-    p[c].lpos = std::numeric_limits<int>::max();
-    p[c].rpos = std::numeric_limits<int>::min();
-    p[c].y = y;
-    p[c].next = 0;
-  }
+  if (!rc.contains(gfx::Point(x, y)))
+    return;
 
-  // Start up the flood algorithm
-  flooder(image, mask, x, y, bounds, src_color, tolerance, data, proc);
-
-  // Continue as long as there are some segments still to test
-  bool done;
-  do {
-    done = true;
-
-    // For each line on the screen
-    for (int c=0; c<flood_count; c++) {
-      p = FLOOD_LINE(c);
-
-      // Check below the segment?
-      if (p->flags & FLOOD_TODO_BELOW) {
-        p->flags &= ~FLOOD_TODO_BELOW;
-
-        if (isEightConnected) {
-          if (p->lpos+1 < bounds.x2() &&
-              check_flood_line(image, mask, p->y+1, p->lpos+1, p->rpos, bounds,
-                               src_color, tolerance, data, proc)) {
-            done = false;
-            p = FLOOD_LINE(c);
-          }
-
-          if (p->lpos-1 >= bounds.x &&
-              check_flood_line(image, mask, p->y+1, p->lpos-1, p->rpos, bounds,
-                               src_color, tolerance, data, proc)) {
-            done = false;
-            p = FLOOD_LINE(c);
-          }
-
-          if (p->rpos+1 < bounds.x2() &&
-              check_flood_line(image, mask, p->y+1, p->lpos, p->rpos+1, bounds,
-                               src_color, tolerance, data, proc)) {
-            done = false;
-            p = FLOOD_LINE(c);
-          }
-
-          if (p->rpos-1 >= bounds.x &&
-              check_flood_line(image, mask, p->y+1, p->lpos, p->rpos-1, bounds,
-                               src_color, tolerance, data, proc)) {
-            done = false;
-            p = FLOOD_LINE(c);
-          }
-        }
-
-        if (check_flood_line(image, mask, p->y+1, p->lpos, p->rpos, bounds,
-                             src_color, tolerance, data, proc)) {
-          done = false;
-          p = FLOOD_LINE(c);
-        }
-      }
+  // Runs of each row (calculated the first time we reach each row)
+  std::vector<Runs> rows(rc.h);
+  std::vector<bool> classified(rc.h, false);
+  std::vector<uint8_t> match;
 
-      // Check above the segment?
-      if (p->flags & FLOOD_TODO_ABOVE) {
-        p->flags &= ~FLOOD_TODO_ABOVE;
-
-        if (isEightConnected) {
-          if (p->lpos+1 < bounds.x2() &&
-              check_flood_line(image, mask, p->y-1, p->lpos+1, p->rpos, bounds,
-                               src_color, tolerance, data, proc)) {
-            done = false;
-            p = FLOOD_LINE(c);
-          }
-
-          if (p->lpos-1 >= bounds.x &&
-              check_flood_line(image, mask, p->y-1, p->lpos-1, p->rpos, bounds,
-                               src_color, tolerance, data, proc)) {
-            done = false;
-            p = FLOOD_LINE(c);
-          }
-
-          if (p->rpos+1 < bounds.x2() &&
-              check_flood_line(image, mask, p->y-1, p->lpos, p->rpos+1, bounds,
-                               src_color, tolerance, data, proc)) {
-            done = false;
-            p = FLOOD_LINE(c);
-          }
-
-          if (p->rpos-1 >= bounds.x &&
-              check_flood_line(image, mask, p->y-1, p->lpos, p->rpos-1, bounds,
-                               src_color, tolerance, data, proc)) {
-            done = false;
-            p = FLOOD_LINE(c);
-          }
-        }
-
-        if (check_flood_line(image, mask, p->y-1, p->lpos, p->rpos, bounds,
-                             src_color, tolerance, data, proc)) {
-          done = false;
-
-          // Special case shortcut for going backwards
-          if ((c > bounds.y) && (c < bounds.y2()))
-            c -= 2;
-        }
+  auto get_row_runs = [&](const int v) -> Runs& {
+    const int i = v - rc.y;
+    if (!classified[i]) {
+      classifier.getRuns(v, rows[i], match);
+      classified[i] = true;
+    }
+    return rows[i];
+  };
+
+  // Start with the run that contains the starting point
+  struct Segment { int y, x1, x2; };
+  std::vector<Segment> stack;
+  {
+    Runs& runs = get_row_runs(y);
+    auto it = std::find_if(runs.begin(), runs.end(),
+                           [x](const Run& run){ return x <= run.x2; });
+    if (it == runs.end() || x < it->x1)
+      return;
+
+    it->visited = true;
+    (*proc)(it->x1, y, it->x2, data);
+    stack.push_back(Segment{ y, it->x1, it->x2 });
+  }
+
+  // Each run is visited (filled) just one time, when it's touched by
+  // a filled run in the row above or below.
+  const int d = (isEightConnected ? 1: 0);
+  while (!stack.empty()) {
+    const Segment seg = stack.back();
+    stack.pop_back();
+
+    for (const int v : { seg.y-1, seg.y+1 }) {
+      if (v < rc.y || v >= rc.y2())
+        continue;
+
+      const int x1 = seg.x1 - d;
+      const int x2 = seg.x2 + d;
+      Runs& runs = get_row_runs(v);
+      auto it = std::lower_bound(runs.begin(), runs.end(), x1,
+                                 [](const Run& run, const int x){
+                                   return run.x2 < x;
+                                 });
+      for (; it != runs.end() && it->x1 <= x2; ++it) {
+        if (it->visited)
+          continue;
+
+        it->visited = true;
+        (*proc)(it->x1, v, it->x2, data);
+        stack.push_back(Segment{ v, it->x1, it->x2 });
       }
     }
-  } while (!done);
+  }
 }
 
 } // namespace algorithm
@@ -0,0 +1,173 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/algorithm/floodfill.h"
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/mask.h"
+#include "doc/primitives.h"
+#include "gfx/rect.h"
+
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace doc;
+using namespace gfx;
+
+namespace {
+
+struct Filled {
+  int w, h;
+  std::vector<int> count;       // Number of times each pixel was filled
+
+  Filled(int w, int h) : w(w), h(h), count(w*h, 0) { }
+
+  static void hline(int x1, int y, int x2, void* data) {
+    auto filled = (Filled*)data;
+    for (int x=x1; x<=x2; ++x)
+      ++filled->count[y*filled->w + x];
+  }
+};
+
+bool similar(const Image* image, color_t a, color_t b, int tolerance)
+{
+  switch (image->pixelFormat()) {
+    case IMAGE_RGB:
+      if (rgba_geta(a) == 0 && rgba_geta(b) == 0)
+        return true;
+      return (std::abs(int(rgba_getr(a)) - int(rgba_getr(b))) <= tolerance &&
+              std::abs(int(rgba_getg(a)) - int(rgba_getg(b))) <= tolerance &&
+              std::abs(int(rgba_getb(a)) - int(rgba_getb(b))) <= tolerance &&
+              std::abs(int(rgba_geta(a)) - int(rgba_geta(b))) <= tolerance);
+    case IMAGE_GRAYSCALE:
+      if (graya_geta(a) == 0 && graya_geta(b) == 0)
+        return true;
+      return (std::abs(int(graya_getv(a)) - int(graya_getv(b))) <= tolerance &&
+              std::abs(int(graya_geta(a)) - int(graya_geta(b))) <= tolerance);
+    default:
+      return std::abs(int(a) - int(b)) <= tolerance;
+  }
+}
+
+// Naive flood fill (pixel by pixel) to compare results
+std::vector<int> expected_fill(const Image* image, const Rect& bounds,
+                               const Rect& maskBounds,
+                               int x, int y, int tolerance,
+                               bool contiguous, bool eight)
+{
+  const int w = image->width();
+  const color_t src = get_pixel(image, x, y);
+  auto inside = [&](int u, int v) {
+    return (bounds.contains(Point(u, v)) &&
+            maskBounds.contains(Point(u, v)) &&
+            similar(image, get_pixel(image, u, v), src, tolerance));
+  };
+
+  std::vector<int> result(w*image->height(), 0);
+  if (!contiguous) {
+    for (int v=0; v<image->height(); ++v)
+      for (int u=0; u<w; ++u)
+        if (inside(u, v))
+          result[v*w+u] = 1;
+    return result;
+  }
+
+  if (!inside(x, y))
+    return result;
+
+  std::vector<Point> stack = { Point(x, y) };
+  result[y*w+x] = 1;
+  while (!stack.empty()) {
+    Point pt = stack.back();
+    stack.pop_back();
+    for (int dv=-1; dv<=1; ++dv) {
+      for (int du=-1; du<=1; ++du) {
+        if ((du == 0 && dv == 0) || (!eight && du != 0 && dv != 0))
+          continue;
+        const int u = pt.x+du, v = pt.y+dv;
+        if (inside(u, v) && !result[v*w+u]) {
+          result[v*w+u] = 1;
+          stack.push_back(Point(u, v));
+        }
+      }
+    }
+  }
+  return result;
+}
+
+} // anonymous namespace
+
+TEST(FloodFill, MatchNaiveFloodFill)
+{
+  std::mt19937 rng(1);
+
+  for (PixelFormat pf : { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED }) {
+    for (int i=0; i<200; ++i) {
+      const int w = 1 + rng() % 70;
+      const int h = 1 + rng() % 40;
+      ImageRef image(Image::create(pf, w, h));
+
+      // Few different colors to get big regions
+      const color_t colors[] = {
+        (pf == IMAGE_RGB ? rgba(10, 20, 30, 255):
+         pf == IMAGE_GRAYSCALE ? graya(10, 255): 10),
+        (pf == IMAGE_RGB ? rgba(12, 18, 33, 255):
+         pf == IMAGE_GRAYSCALE ? graya(13, 250): 12),
+        (pf == IMAGE_RGB ? rgba(200, 20, 30, 0):
+         pf == IMAGE_GRAYSCALE ? graya(200, 0): 0),
+        (pf == IMAGE_RGB ? rgba(0, 0, 0, 0):
+         pf == IMAGE_GRAYSCALE ? graya(0, 0): 30) };
+      for (int v=0; v<h; ++v)
+        for (int u=0; u<w; ++u)
+          put_pixel(image.get(), u, v, colors[rng() % 4]);
+
+      const int x = rng() % w;
+      const int y = rng() % h;
+      const int tolerance = (rng() % 2 ? 0: rng() % 8);
+      const bool contiguous = (rng() % 4 != 0);
+      const bool eight = (rng() % 2 != 0);
+      const Rect bounds = (rng() % 2 ? image->bounds():
+                                       Rect(0, y/2, w, h-y/2));
+
+      Mask mask;
+      Rect maskBounds = image->bounds();
+      if (rng() % 3 == 0) {
+        maskBounds = Rect(rng() % w, rng() % h, 1 + rng() % w, 1 + rng() % h);
+        mask.replace(maskBounds);
+      }
+
+      Filled filled(w, h);
+      algorithm::floodfill(image.get(),
+                           (maskBounds == image->bounds() ? nullptr: &mask),
+                           x, y, bounds,
+                           get_pixel(image.get(), x, y),
+                           tolerance, contiguous, eight,
+                           &filled, &Filled::hline);
+
+      const std::vector<int> expected =
+        expected_fill(image.get(), bounds, maskBounds,
+                      x, y, tolerance, contiguous, eight);
+
+      ASSERT_EQ(expected, filled.count)
+        << "pf=" << int(pf) << " i=" << i
+        << " tolerance=" << tolerance
+        << " contiguous=" << contiguous << " eight=" << eight;
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
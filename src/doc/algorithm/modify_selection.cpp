@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2021 Igara Studio S.A.
+// Copyright (c) 2021-2024 Igara Studio S.A.
 // Copyright (c) 2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -13,15 +13,75 @@
 
 #include "doc/image_impl.h"
 #include "doc/mask.h"
+#include "doc/mask_runs.h"
 #include "doc/primitives.h"
 
+#include <algorithm>
 #include <memory>
+#include <vector>
 
 namespace doc {
 namespace algorithm {
 
+namespace {
+
+using Runs = std::vector<MaskRuns::Run>;
+
+// Sorts and merges the overlapping runs.
+void merge_runs(Runs& runs)
+{
+  std::sort(runs.begin(), runs.end(),
+            [](const MaskRuns::Run& a, const MaskRuns::Run& b){
+              return a.x < b.x;
+            });
+  std::size_t n = 0;
+  for (const auto& run : runs) {
+    if (n > 0 && run.x <= runs[n-1].x2)
+      runs[n-1].x2 = std::max(runs[n-1].x2, run.x2);
+    else
+      runs[n++] = run;
+  }
+  runs.resize(n);
+}
+
+// Pixels in both sorted lists of runs.
+void intersect_runs(const Runs& a, const Runs& b, Runs& out)
+{
+  out.clear();
+  auto i = a.begin(), j = b.begin();
+  while (i != a.end() && j != b.end()) {
+    const int x = std::max(i->x, j->x);
+    const int x2 = std::min(i->x2, j->x2);
+    if (x < x2)
+      out.push_back(MaskRuns::Run{ x, x2 });
+    if (i->x2 < j->x2)
+      ++i;
+    else
+      ++j;
+  }
+}
+
+// Pixels in "a" that are not in "b" (both sorted).
+void subtract_runs(const Runs& a, const Runs& b, Runs& out)
+{
+  out.clear();
+  auto j = b.begin();
+  for (MaskRuns::Run run : a) {
+    while (j != b.end() && j->x2 <= run.x)
+      ++j;
+    for (auto k=j; k != b.end() && k->x < run.x2 && run.x < run.x2; ++k) {
+      if (run.x < k->x)
+        out.push_back(MaskRuns::Run{ run.x, k->x });
+      run.x = std::max(run.x, k->x2);
+    }
+    if (run.x < run.x2)
+      out.push_back(run);
+  }
+}
+
+} // anonymous namespace
+
 // TODO create morphological operators/functions in "doc" namespace
-// TODO the impl is not optimal, but is good enough as a first version
 void modify_selection(const SelectionModifier modifier,
                       const Mask* srcMask,
                       Mask* dstMask,
@@ -30,13 +90,15 @@ void modify_selection(const SelectionModifier modifier,
 {
   const doc::Image* srcImage = srcMask->bitmap();
   doc::Image* dstImage = dstMask->bitmap();
+  ASSERT(srcImage);
+  ASSERT(dstImage);
+  if (!srcImage || !dstImage)
+    return;
+
   const gfx::Point offset =
     srcMask->bounds().origin() -
     dstMask->bounds().origin();
 
-  // Image bounds to clip get/put pixels
-  const gfx::Rect srcBounds = srcImage->bounds();
-
   // Create a kernel
   const int size = 2*radius+1;
   std::unique_ptr<doc::Image> kernel(doc::Image::create(IMAGE_BITMAP, size, size));
@@ -47,49 +109,78 @@ void modify_selection(const SelectionModifier modifier,
     doc::fill_rect(kernel.get(), 0, 0, size-1, size-1, 1);
   doc::put_pixel(kernel.get(), radius, radius, 0);
 
-  int total = 0;                // Number of 1s in the kernel image
-  for (int v=0; v<size; ++v)
-    for (int u=0; u<size; ++u)
-      total += kernel->getPixel(u, v);
-
-  for (int y=-radius; y<srcBounds.h+radius; ++y) {
-    for (int x=-radius; x<srcBounds.w+radius; ++x) {
-      doc::color_t c;
-      if (srcBounds.contains(x, y))
-        c = srcImage->getPixel(x, y);
-      else
-        c = 0;
-
-      int accum = 0;
-      for (int v=0; v<size; ++v) {
-        for (int u=0; u<size; ++u) {
-          if (kernel->getPixel(u, v)) {
-            if (srcBounds.contains(x+u-radius, y+v-radius))
-              accum += srcImage->getPixel(x-radius+u, y-radius+v);
+  // Work with the runs of the source selection and the kernel, so we
+  // don't visit each pixel of the source bitmap (and each pixel of
+  // the kernel for each one of them).
+  const MaskRuns srcRuns(srcImage);
+  const MaskRuns kernelRuns(kernel.get());
+  const int h = srcRuns.height();
+
+  Runs srcRow, kernelRow, result, tmp;
+  for (int y=-radius; y<h+radius; ++y) {
+    srcRow.clear();
+    if (y >= 0 && y < h) {
+      auto row = srcRuns.row(y);
+      srcRow.assign(row.begin(), row.end());
+    }
+
+    switch (modifier) {
+
+      // Pixels selected or with at least one selected pixel in the
+      // kernel area.
+      case SelectionModifier::Expand: {
+        result = srcRow;
+        for (int v=0; v<size; ++v) {
+          const int sy = y-radius+v;
+          if (sy < 0 || sy >= h)
+            continue;
+          for (const auto& k : kernelRuns.row(v)) {
+            for (const auto& run : srcRuns.row(sy)) {
+              result.push_back(
+                MaskRuns::Run{ run.x+radius-(k.x2-1),
+                               run.x2+radius-k.x });
+            }
           }
         }
+        merge_runs(result);
+        break;
       }
 
-      switch (modifier) {
-        case SelectionModifier::Border: {
-          c = (c && accum < total) ? 1: 0;
-          break;
-        }
-        case SelectionModifier::Expand: {
-          c = (c || accum > 0) ? 1: 0;
-          break;
+      // Selected pixels with all the kernel area selected (Contract),
+      // or the rest of the selected pixels (Border).
+      case SelectionModifier::Border:
+      case SelectionModifier::Contract: {
+        result = srcRow;
+        for (int v=0; v<size && !result.empty(); ++v) {
+          const int sy = y-radius+v;
+          for (const auto& k : kernelRuns.row(v)) {
+            // Positions where this run of the kernel is inside a
+            // run of the source selection.
+            kernelRow.clear();
+            if (sy >= 0 && sy < h) {
+              for (const auto& run : srcRuns.row(sy)) {
+                const int x = run.x+radius-k.x;
+                const int x2 = run.x2+radius-(k.x2-1);
+                if (x < x2)
+                  kernelRow.push_back(MaskRuns::Run{ x, x2 });
+              }
+            }
+            intersect_runs(result, kernelRow, tmp);
+            std::swap(result, tmp);
+          }
         }
-        case SelectionModifier::Contract: {
-          c = (c && accum == total) ? 1: 0;
-          break;
+        if (modifier == SelectionModifier::Border) {
+          subtract_runs(srcRow, result, tmp);
+          std::swap(result, tmp);
         }
+        break;
       }
-
-      if (c)
-        doc::put_pixel(dstImage,
-                       offset.x+x,
-                       offset.y+y, 1);
     }
+
+    for (const auto& run : result)
+      doc::draw_hline(dstImage,
+                      offset.x+run.x, offset.y+y,
+                      offset.x+run.x2-1, 1);
   }
 }
 
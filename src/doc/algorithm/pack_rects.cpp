@@ -0,0 +1,602 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/algorithm/pack_rects.h"
+
+#include "base/thread_pool.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <deque>
+#include <future>
+#include <memory>
+#include <numeric>
+#include <thread>
+
+namespace doc {
+namespace algorithm {
+
+namespace {
+
+enum class Heuristic {
+  // MaxRects
+  ShortSideFit,
+  LongSideFit,
+  AreaFit,
+  BottomLeft,
+  // Skyline
+  SkylineBottomLeft,
+  SkylineMinWaste,
+};
+
+enum class Order {
+  Area,
+  MaxSide,
+  Height,
+};
+
+const Order kOrders[] = { Order::Area, Order::MaxSide, Order::Height };
+
+struct Trial {
+  Heuristic heuristic;
+  Order order;
+  int width;
+  int height;
+};
+
+struct TrialResult {
+  bool ok = false;
+  // Size of the used area
+  int width = 0;
+  int height = 0;
+  // Position of each rectangle (in the same order as the sizes)
+  std::vector<gfx::Point> positions;
+};
+
+typedef RectsPacker::Sizes Sizes;
+
+// Number of rectangles inserted between each check of the task token
+const int kCancelCheckInterval = 256;
+
+// Number of texture widths tried by RectsPacker::bestFit()
+const int kBestFitWidths = 16;
+
+// Max number of rectangles inserted in all the trials of
+// RectsPacker::bestFit() (the number of trials depends on the number
+// of rectangles, not on the number of threads, so we get the same
+// result in all computers).
+const int kBestFitInsertions = 400000;
+const int kMinBestFitTrials = 8;
+
+bool rect_contains(const gfx::Rect& a, const gfx::Rect& b)
+{
+  return (b.x >= a.x && b.y >= a.y &&
+          b.x2() <= a.x2() && b.y2() <= a.y2());
+}
+
+bool rect_intersects(const gfx::Rect& a, const gfx::Rect& b)
+{
+  return (a.x < b.x2() && b.x < a.x2() &&
+          a.y < b.y2() && b.y < a.y2());
+}
+
+class MaxRectsBin {
+public:
+  MaxRectsBin(const int width, const int height) {
+    m_free.emplace_back(0, 0, width, height);
+  }
+
+  bool insert(const gfx::Size& sz, const Heuristic heuristic, gfx::Point& pos) {
+    int64_t bestScore1 = INT64_MAX;
+    int64_t bestScore2 = INT64_MAX;
+    const gfx::Rect* best = nullptr;
+
+    for (const gfx::Rect& freeRc : m_free) {
+      if (freeRc.w < sz.w || freeRc.h < sz.h)
+        continue;
+
+      const int64_t leftoverW = freeRc.w - sz.w;
+      const int64_t leftoverH = freeRc.h - sz.h;
+      int64_t score1, score2;
+      switch (heuristic) {
+        case Heuristic::ShortSideFit:
+          score1 = std::min(leftoverW, leftoverH);
+          score2 = std::max(leftoverW, leftoverH);
+          break;
+        case Heuristic::LongSideFit:
+          score1 = std::max(leftoverW, leftoverH);
+          score2 = std::min(leftoverW, leftoverH);
+          break;
+        case Heuristic::AreaFit:
+          score1 = int64_t(freeRc.w)*freeRc.h - int64_t(sz.w)*sz.h;
+          score2 = std::min(leftoverW, leftoverH);
+          break;
+        case Heuristic::BottomLeft:
+        default:
+          score1 = freeRc.y + sz.h;
+          score2 = freeRc.x;
+          break;
+      }
+      if (score1 < bestScore1 ||
+          (score1 == bestScore1 && score2 < bestScore2)) {
+        bestScore1 = score1;
+        bestScore2 = score2;
+        best = &freeRc;
+      }
+    }
+
+    if (!best)
+      return false;
+
+    pos = best->origin();
+    place(gfx::Rect(pos, sz));
+    return true;
+  }
+
+private:
+  // Splits the free rectangles that intersect the new placed
+  // rectangle in the maximal free rectangles around it.
+  void place(const gfx::Rect& rc) {
+    m_newFree.clear();
+    for (std::size_t i=0; i<m_free.size(); ) {
+      const gfx::Rect freeRc = m_free[i];
+      if (!rect_intersects(freeRc, rc)) {
+        ++i;
+        continue;
+      }
+
+      if (rc.x > freeRc.x)
+        m_newFree.emplace_back(freeRc.x, freeRc.y, rc.x - freeRc.x, freeRc.h);
+      if (rc.x2() < freeRc.x2())
+        m_newFree.emplace_back(rc.x2(), freeRc.y, freeRc.x2() - rc.x2(), freeRc.h);
+      if (rc.y > freeRc.y)
+        m_newFree.emplace_back(freeRc.x, freeRc.y, freeRc.w, rc.y - freeRc.y);
+      if (rc.y2() < freeRc.y2())
+        m_newFree.emplace_back(freeRc.x, rc.y2(), freeRc.w, freeRc.y2() - rc.y2());
+
+      m_free[i] = m_free.back();
+      m_free.pop_back();
+    }
+
+    // Only the new free rectangles can be contained in other ones
+    // (the old ones were already pruned).
+    const std::size_t oldFree = m_free.size();
+    for (std::size_t i=0; i<m_newFree.size(); ++i) {
+      const gfx::Rect& newRc = m_newFree[i];
+      bool contained = false;
+      for (std::size_t j=0; j<m_newFree.size() && !contained; ++j) {
+        if (i != j &&
+            rect_contains(m_newFree[j], newRc) &&
+            (m_newFree[j] != newRc || j < i))
+          contained = true;
+      }
+      for (std::size_t j=0; j<oldFree && !contained; ++j) {
+        if (rect_contains(m_free[j], newRc))
+          contained = true;
+      }
+      if (!contained)
+        m_free.push_back(newRc);
+    }
+  }
+
+  std::vector<gfx::Rect> m_free;
+  std::vector<gfx::Rect> m_newFree;
+};
+
+class SkylineBin {
+public:
+  SkylineBin(const int width, const int height)
+    : m_width(width)
+    , m_height(height) {
+    m_nodes.push_back(Node{ 0, 0, width });
+  }
+
+  bool insert(const gfx::Size& sz, const Heuristic heuristic, gfx::Point& pos) {
+    int64_t bestScore1 = INT64_MAX;
+    int64_t bestScore2 = INT64_MAX;
+    int bestNode = -1;
+    int bestY = 0;
+
+    for (int i=0; i<int(m_nodes.size()); ++i) {
+      int y;
+      int64_t waste;
+      if (!fit(i, sz, y, waste))
+        continue;
+
+      int64_t score1, score2;
+      if (heuristic == Heuristic::SkylineMinWaste) {
+        score1 = waste;
+        score2 = y + sz.h;
+      }
+      else {
+        score1 = y + sz.h;
+        score2 = m_nodes[i].w;
+      }
+      if (score1 < bestScore1 ||
+          (score1 == bestScore1 && score2 < bestScore2)) {
+        bestScore1 = score1;
+        bestScore2 = score2;
+        bestNode = i;
+        bestY = y;
+      }
+    }
+
+    if (bestNode < 0)
+      return false;
+
+    pos = gfx::Point(m_nodes[bestNode].x, bestY);
+    addLevel(bestNode, gfx::Rect(pos, sz));
+    return true;
+  }
+
+private:
+  struct Node {
+    int x, y, w;
+  };
+
+  // Returns the "y" position where the rectangle can be placed
+  // starting from the given node, and the wasted area below it.
+  bool fit(const int i, const gfx::Size& sz, int& y, int64_t& waste) const {
+    const int x = m_nodes[i].x;
+    if (x + sz.w > m_width)
+      return false;
+
+    y = m_nodes[i].y;
+    int j = i;
+    for (int widthLeft = sz.w; widthLeft > 0; ++j) {
+      ASSERT(j < int(m_nodes.size()));
+      y = std::max(y, m_nodes[j].y);
+      if (y + sz.h > m_height)
+        return false;
+      widthLeft -= m_nodes[j].w;
+    }
+
+    waste = 0;
+    for (int k=i; k<j; ++k) {
+      const int x1 = std::max(x, m_nodes[k].x);
+      const int x2 = std::min(x + sz.w, m_nodes[k].x + m_nodes[k].w);
+      waste += int64_t(x2 - x1) * (y - m_nodes[k].y);
+    }
+    return true;
+  }
+
+  void addLevel(const int i, const gfx::Rect& rc) {
+    m_nodes.insert(m_nodes.begin()+i, Node{ rc.x, rc.y2(), rc.w });
+
+    // Shrink/remove the nodes below the new node
+    for (int k=i+1; k<int(m_nodes.size()); ) {
+      const Node& prev = m_nodes[k-1];
+      Node& node = m_nodes[k];
+      if (node.x >= prev.x + prev.w)
+        break;
+
+      const int shrink = prev.x + prev.w - node.x;
+      node.x += shrink;
+      node.w -= shrink;
+      if (node.w > 0)
+        break;
+      m_nodes.erase(m_nodes.begin()+k);
+    }
+
+    // Merge nodes at the same level
+    for (int k=0; k+1<int(m_nodes.size()); ) {
+      if (m_nodes[k].y == m_nodes[k+1].y) {
+        m_nodes[k].w += m_nodes[k+1].w;
+        m_nodes.erase(m_nodes.begin()+k+1);
+      }
+      else
+        ++k;
+    }
+  }
+
+  int m_width;
+  int m_height;
+  std::vector<Node> m_nodes;
+};
+
+std::vector<int> sorted_indexes(const Sizes& sizes, const Order order)
+{
+  std::vector<int> indexes(sizes.size());
+  std::iota(indexes.begin(), indexes.end(), 0);
+
+  auto area = [&sizes](const int i) {
+    return int64_t(sizes[i].w) * sizes[i].h;
+  };
+  auto maxSide = [&sizes](const int i) {
+    return std::max(sizes[i].w, sizes[i].h);
+  };
+
+  std::stable_sort(
+    indexes.begin(), indexes.end(),
+    [&](const int a, const int b) {
+      switch (order) {
+        case Order::Area:
+          if (area(a) != area(b))
+            return area(a) > area(b);
+          return maxSide(a) > maxSide(b);
+        case Order::MaxSide:
+          if (maxSide(a) != maxSide(b))
+            return maxSide(a) > maxSide(b);
+          return area(a) > area(b);
+        case Order::Height:
+        default:
+          if (sizes[a].h != sizes[b].h)
+            return sizes[a].h > sizes[b].h;
+          return sizes[a].w > sizes[b].w;
+      }
+    });
+  return indexes;
+}
+
+template<typename Bin>
+TrialResult run_trial(const Sizes& sizes,
+                      const std::vector<int>& indexes,
+                      const Trial& trial,
+                      const base::task_token& token)
+{
+  TrialResult result;
+  result.positions.resize(sizes.size());
+
+  Bin bin(trial.width, trial.height);
+  int n = 0;
+  for (const int i : indexes) {
+    if ((++n % kCancelCheckInterval) == 0 && token.canceled())
+      return result;
+
+    gfx::Point& pos = result.positions[i];
+    if (!bin.insert(sizes[i], trial.heuristic, pos))
+      return result;
+
+    result.width = std::max(result.width, pos.x + sizes[i].w);
+    result.height = std::max(result.height, pos.y + sizes[i].h);
+  }
+  result.ok = true;
+  return result;
+}
+
+std::vector<Heuristic> method_heuristics(const RectsPacker::Method method)
+{
+  if (method == RectsPacker::Method::MaxRects)
+    return { Heuristic::ShortSideFit,
+             Heuristic::LongSideFit,
+             Heuristic::AreaFit,
+             Heuristic::BottomLeft };
+  else
+    return { Heuristic::SkylineBottomLeft,
+             Heuristic::SkylineMinWaste };
+}
+
+// Runs all trials in worker threads and returns the best result
+// (the first one in case of a tie, so the result doesn't depend on
+// the number of threads).
+template<typename IsBetter>
+TrialResult run_trials(const RectsPacker::Method method,
+                       const Sizes& sizes,
+                       const std::vector<Trial>& trials,
+                       base::task_token& token,
+                       IsBetter isBetter)
+{
+  std::vector<std::vector<int>> indexes;
+  for (const Order order : kOrders)
+    indexes.push_back(sorted_indexes(sizes, order));
+
+  base::thread_pool pool(std::max(1u, std::thread::hardware_concurrency()));
+  std::deque<std::future<TrialResult>> results;
+  for (const Trial& trial : trials) {
+    auto task = std::make_shared<std::packaged_task<TrialResult()>>(
+      [method, &sizes, &indexes, &token, trial]{
+        const auto& order = indexes[int(trial.order)];
+        if (method == RectsPacker::Method::MaxRects)
+          return run_trial<MaxRectsBin>(sizes, order, trial, token);
+        else
+          return run_trial<SkylineBin>(sizes, order, trial, token);
+      });
+    results.push_back(task->get_future());
+    pool.execute([task]{ (*task)(); });
+  }
+
+  TrialResult best;
+  for (std::size_t i=0; i<trials.size(); ++i) {
+    TrialResult result = results.front().get();
+    results.pop_front();
+    token.set_progress(float(i+1) / trials.size());
+    if (result.ok && (!best.ok || isBetter(result, best)))
+      best = std::move(result);
+  }
+  pool.wait_all();
+  return best;
+}
+
+} // anonymous namespace
+
+RectsPacker::RectsPacker(const Method method,
+                         const int borderPadding,
+                         const int shapePadding)
+  : m_method(method)
+  , m_borderPadding(borderPadding)
+  , m_shapePadding(shapePadding)
+{
+}
+
+void RectsPacker::add(const gfx::Size& sz)
+{
+  m_rects.emplace_back(gfx::Point(0, 0), sz);
+}
+
+gfx::Size RectsPacker::bestFit(base::task_token& token,
+                               const int fixedWidth,
+                               const int fixedHeight)
+{
+  if (m_rects.empty()) {
+    const int minSize = std::max(1, 2*m_borderPadding);
+    return gfx::Size(fixedWidth > 0 ? fixedWidth: minSize,
+                     fixedHeight > 0 ? fixedHeight: minSize);
+  }
+
+  if (fixedWidth > 0 && fixedHeight > 0) {
+    pack(gfx::Size(fixedWidth, fixedHeight), token);
+    return gfx::Size(fixedWidth, fixedHeight);
+  }
+
+  // Each rectangle is packed with the shape padding (so the texture
+  // area is bigger than the real one by the shape padding and
+  // smaller because of the border padding).
+  const int extra = m_shapePadding - 2*m_borderPadding;
+  int maxWidth = 0;
+  int64_t sumWidth = 0;
+  double area = 0.0;
+  for (const auto& rc : m_rects) {
+    const int w = rc.w + m_shapePadding;
+    const int h = rc.h + m_shapePadding;
+    maxWidth = std::max(maxWidth, w);
+    sumWidth += w;
+    area += double(w) * h;
+  }
+  const int maxInnerWidth = int(std::min<int64_t>(sumWidth, INT_MAX/2));
+
+  // Candidate widths of the texture (without the border padding),
+  // sorted from the most to the least squared texture.
+  std::vector<int> widths;
+  if (fixedWidth > 0) {
+    widths.push_back(fixedWidth + extra);
+  }
+  else {
+    double target;
+    double minFactor, maxFactor;
+    if (fixedHeight > 0) {
+      target = area / std::max(1, fixedHeight + extra);
+      minFactor = 1.0;
+      maxFactor = 2.0;
+    }
+    else {
+      target = std::sqrt(area);
+      minFactor = 0.5;
+      maxFactor = 2.0;
+    }
+    for (int k=0; k<kBestFitWidths; ++k) {
+      const double factor =
+        minFactor * std::pow(maxFactor / minFactor,
+                             double(k) / (kBestFitWidths-1));
+      widths.push_back(
+        int(std::clamp<double>(std::round(target * factor),
+                               maxWidth, std::max(maxWidth, maxInnerWidth))));
+    }
+    std::sort(widths.begin(), widths.end());
+    widths.erase(std::unique(widths.begin(), widths.end()), widths.end());
+    std::stable_sort(
+      widths.begin(), widths.end(),
+      [target](const int a, const int b) {
+        return (std::abs(std::log(a / target)) <
+                std::abs(std::log(b / target)));
+      });
+  }
+
+  const int height = (fixedHeight > 0 ? fixedHeight + extra: INT_MAX/2);
+  std::vector<Trial> trials;
+  for (const int width : widths)
+    for (const Heuristic heuristic : method_heuristics(m_method))
+      for (const Order order : kOrders)
+        trials.push_back(Trial{ heuristic, order, width, height });
+
+  const std::size_t maxTrials =
+    std::max<std::size_t>(kMinBestFitTrials,
+                          kBestFitInsertions / m_rects.size());
+  if (trials.size() > maxTrials)
+    trials.resize(maxTrials);
+
+  // One row with all rectangles always fits in a fixed height.
+  if (fixedHeight > 0) {
+    trials.push_back(Trial{ method_heuristics(m_method).front(),
+                            Order::Height, maxInnerWidth, height });
+  }
+
+  // Choose the smallest texture (or the most squared one).
+  auto textureSize = [=](const TrialResult& result) {
+    return gfx::Size(fixedWidth > 0 ? fixedWidth: result.width - extra,
+                     fixedHeight > 0 ? fixedHeight: result.height - extra);
+  };
+  const TrialResult best = run_trials(
+    m_method, paddedSizes(), trials, token,
+    [&textureSize](const TrialResult& a, const TrialResult& b) {
+      const gfx::Size sa = textureSize(a);
+      const gfx::Size sb = textureSize(b);
+      const int64_t areaA = int64_t(sa.w) * sa.h;
+      const int64_t areaB = int64_t(sb.w) * sb.h;
+      return (areaA < areaB ||
+              (areaA == areaB &&
+               std::max(sa.w, sa.h) < std::max(sb.w, sb.h)));
+    });
+
+  if (!best.ok) {
+    // The rectangles don't fit in the fixed dimension
+    if (!token.canceled() && (fixedWidth > 0 || fixedHeight > 0))
+      return bestFit(token, 0, 0);
+    return gfx::Size(0, 0);
+  }
+
+  setPositions(best.positions);
+  return textureSize(best);
+}
+
+bool RectsPacker::pack(const gfx::Size& size,
+                       base::task_token& token)
+{
+  if (m_rects.empty())
+    return true;
+
+  const int extra = m_shapePadding - 2*m_borderPadding;
+  const int width = size.w + extra;
+  const int height = size.h + extra;
+  if (width <= 0 || height <= 0)
+    return false;
+
+  // Try each heuristic/order and keep the smallest used area.
+  std::vector<Trial> trials;
+  for (const Heuristic heuristic : method_heuristics(m_method))
+    for (const Order order : kOrders)
+      trials.push_back(Trial{ heuristic, order, width, height });
+
+  const TrialResult best = run_trials(
+    m_method, paddedSizes(), trials, token,
+    [](const TrialResult& a, const TrialResult& b) {
+      return (int64_t(a.width) * a.height <
+              int64_t(b.width) * b.height);
+    });
+
+  if (!best.ok)
+    return false;
+
+  setPositions(best.positions);
+  return true;
+}
+
+RectsPacker::Sizes RectsPacker::paddedSizes() const
+{
+  // Each rectangle is packed with the shape padding at the right and
+  // bottom sides.
+  Sizes sizes;
+  sizes.reserve(m_rects.size());
+  for (const auto& rc : m_rects)
+    sizes.emplace_back(rc.w + m_shapePadding, rc.h + m_shapePadding);
+  return sizes;
+}
+
+void RectsPacker::setPositions(const std::vector<gfx::Point>& positions)
+{
+  ASSERT(positions.size() == m_rects.size());
+  for (std::size_t i=0; i<m_rects.size(); ++i) {
+    m_rects[i].setOrigin(gfx::Point(positions[i].x + m_borderPadding,
+                                    positions[i].y + m_borderPadding));
+  }
+}
+
+} // namespace algorithm
+} // namespace doc
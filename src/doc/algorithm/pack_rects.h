@@ -0,0 +1,80 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_ALGORITHM_PACK_RECTS_H_INCLUDED
+#define DOC_ALGORITHM_PACK_RECTS_H_INCLUDED
+#pragma once
+
+#include "base/task.h"
+#include "gfx/rect.h"
+#include "gfx/size.h"
+
+#include <vector>
+
+namespace doc {
+  namespace algorithm {
+
+    // Packs rectangles in a texture using the MaxRects or the
+    // Skyline algorithm. It has the same interface as
+    // gfx::PackingRects so it can be used to create sprite sheets,
+    // but it's faster for thousands of rectangles. Each algorithm
+    // is tried with several heuristics, sorting orders and texture
+    // widths in worker threads, and the smallest texture wins (the
+    // result doesn't depend on the number of threads).
+    class RectsPacker {
+    public:
+      enum class Method {
+        MaxRects,
+        Skyline,
+      };
+
+      typedef std::vector<gfx::Size> Sizes;
+      typedef std::vector<gfx::Rect> Rects;
+      typedef Rects::const_iterator const_iterator;
+
+      RectsPacker(const Method method,
+                  const int borderPadding = 0,
+                  const int shapePadding = 0);
+
+      // Iterates over all given rectangles (in the same order they
+      // were given in add() calls)
+      const_iterator begin() const { return m_rects.begin(); }
+      const_iterator end() const { return m_rects.end(); }
+
+      std::size_t size() const { return m_rects.size(); }
+      const gfx::Rect& operator[](int i) const { return m_rects[i]; }
+
+      // Adds a new rectangle.
+      void add(const gfx::Size& sz);
+
+      // Returns the best size for the texture (the smallest area
+      // that contains all rectangles) and arranges the rectangles
+      // in it. If fixedWidth or fixedHeight are > 0, that dimension
+      // of the texture is fixed.
+      gfx::Size bestFit(base::task_token& token,
+                        const int fixedWidth = 0,
+                        const int fixedHeight = 0);
+
+      // Rearranges all given rectangles to fit in the given texture
+      // size. Returns true if all rectangles were arranged, or false
+      // if there is not enough space (the rectangles are not moved).
+      bool pack(const gfx::Size& size,
+                base::task_token& token);
+
+    private:
+      Sizes paddedSizes() const;
+      void setPositions(const std::vector<gfx::Point>& positions);
+
+      Method m_method;
+      int m_borderPadding;
+      int m_shapePadding;
+      Rects m_rects;
+    };
+
+  } // namespace algorithm
+} // namespace doc
+
+#endif
@@ -0,0 +1,160 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "gtest/gtest.h"
+
+#include "doc/algorithm/pack_rects.h"
+
+#include <cstdlib>
+
+using namespace doc;
+using namespace doc::algorithm;
+using namespace gfx;
+
+static const RectsPacker::Method kMethods[] = {
+  RectsPacker::Method::MaxRects,
+  RectsPacker::Method::Skyline,
+};
+
+static void expect_valid_packing(const RectsPacker& packer,
+                                 const std::vector<Size>& sizes,
+                                 const Size& textureSize,
+                                 const int borderPadding,
+                                 const int shapePadding)
+{
+  ASSERT_EQ(sizes.size(), packer.size());
+
+  const Rect area = Rect(textureSize).shrink(borderPadding);
+  for (std::size_t i=0; i<packer.size(); ++i) {
+    const Rect& rc = packer[i];
+    EXPECT_EQ(sizes[i], rc.size());
+    EXPECT_TRUE(rc.x >= area.x && rc.y >= area.y &&
+                rc.x2() <= area.x2() && rc.y2() <= area.y2())
+      << "Rect " << i << " is outside the texture";
+
+    for (std::size_t j=i+1; j<packer.size(); ++j) {
+      const Rect big = Rect(packer[j]).enlarge(shapePadding);
+      EXPECT_FALSE(rc.intersects(big))
+        << "Rect " << i << " overlaps rect " << j;
+    }
+  }
+}
+
+TEST(PackRects, Empty)
+{
+  base::task_token token;
+  for (auto method : kMethods) {
+    RectsPacker packer(method);
+    EXPECT_EQ(Size(1, 1), packer.bestFit(token));
+    EXPECT_TRUE(packer.pack(Size(4, 4), token));
+  }
+}
+
+TEST(PackRects, SameSizes)
+{
+  base::task_token token;
+  for (auto method : kMethods) {
+    RectsPacker packer(method);
+    std::vector<Size> sizes(16, Size(8, 8));
+    for (auto sz : sizes)
+      packer.add(sz);
+
+    const Size size = packer.bestFit(token);
+    EXPECT_EQ(Size(32, 32), size);
+    expect_valid_packing(packer, sizes, size, 0, 0);
+  }
+}
+
+TEST(PackRects, RandomSizesWithPadding)
+{
+  base::task_token token;
+  std::srand(1);
+  std::vector<Size> sizes;
+  int area = 0;
+  for (int i=0; i<300; ++i) {
+    sizes.push_back(Size(1 + std::rand() % 40,
+                         1 + std::rand() % 40));
+    area += sizes.back().w * sizes.back().h;
+  }
+
+  for (auto method : kMethods) {
+    for (int padding=0; padding<3; ++padding) {
+      RectsPacker packer(method, padding, padding);
+      for (auto sz : sizes)
+        packer.add(sz);
+
+      const Size size = packer.bestFit(token);
+      EXPECT_GE(size.w * size.h, area);
+      expect_valid_packing(packer, sizes, size, padding, padding);
+    }
+  }
+}
+
+TEST(PackRects, FixedDimension)
+{
+  base::task_token token;
+  std::vector<Size> sizes;
+  for (int i=0; i<50; ++i)
+    sizes.push_back(Size(5 + i % 7, 3 + i % 5));
+
+  for (auto method : kMethods) {
+    RectsPacker packer(method, 1, 2);
+    for (auto sz : sizes)
+      packer.add(sz);
+
+    Size size = packer.bestFit(token, 64, 0);
+    EXPECT_EQ(64, size.w);
+    expect_valid_packing(packer, sizes, size, 1, 2);
+
+    size = packer.bestFit(token, 0, 48);
+    EXPECT_EQ(48, size.h);
+    expect_valid_packing(packer, sizes, size, 1, 2);
+  }
+}
+
+TEST(PackRects, Pack)
+{
+  base::task_token token;
+  for (auto method : kMethods) {
+    RectsPacker packer(method, 0, 1);
+    std::vector<Size> sizes = { Size(5, 5), Size(4, 5), Size(10, 4) };
+    for (auto sz : sizes)
+      packer.add(sz);
+
+    EXPECT_TRUE(packer.pack(Size(11, 11), token));
+    expect_valid_packing(packer, sizes, Size(11, 11), 0, 1);
+
+    // The 10x4 rectangle plus the padding doesn't fit
+    EXPECT_FALSE(packer.pack(Size(10, 9), token));
+  }
+}
+
+TEST(PackRects, SameResultEachTime)
+{
+  base::task_token token;
+  std::srand(2);
+  std::vector<Size> sizes;
+  for (int i=0; i<500; ++i)
+    sizes.push_back(Size(1 + std::rand() % 30,
+                         1 + std::rand() % 30));
+
+  for (auto method : kMethods) {
+    RectsPacker a(method, 0, 1), b(method, 0, 1);
+    for (auto sz : sizes) {
+      a.add(sz);
+      b.add(sz);
+    }
+    EXPECT_EQ(a.bestFit(token), b.bestFit(token));
+    for (std::size_t i=0; i<sizes.size(); ++i)
+      EXPECT_EQ(a[i], b[i]);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
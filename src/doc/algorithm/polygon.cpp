@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2020 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2014 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -162,52 +162,68 @@ void algorithm::polygon(int vertices, const int* points, void* data, AlgoHLine p
     }
   }
 
-  // Scan Line Loop:
-  int y;
-  int x1, y1;
-  int x2, y2;
-  int ind1, ind2;
-  int ints;
-  std::vector<int> polyInts(pts.size());
-  for (y = ymin; y <= ymax; y++) {
-    ints = 0;
-    for (int i=0; i < pts.size(); i++) {
-      if (!i) {
-        ind1 = pts.size() - 1;
-        ind2 = 0;
-      }
-      else {
-        ind1 = i - 1;
-        ind2 = i;
-      }
-      y1 = pts[ind1].y;
-      y2 = pts[ind2].y;
-      if (y1 < y2) {
-        x1 = pts[ind1].x;
-        x2 = pts[ind2].x;
-      }
-      else if (y1 > y2) {
-        y2 = pts[ind1].y;
-        y1 = pts[ind2].y;
-        x2 = pts[ind1].x;
-        x1 = pts[ind2].x;
-      }
-      else
-        continue;
+  // Edge table: each non-horizontal edge between consecutive points
+  // (with y1 < y2) sorted by its first scan line. The edge is active
+  // in [y1, y2), or in [y1, y2] if y2 is the last scan line.
+  struct Edge {
+    int x1, y1, x2, y2;
+  };
+  const int npts = int(pts.size());
+  std::vector<Edge> edges;
+  edges.reserve(npts);
+  for (int i=0; i < npts; i++) {
+    const gfx::Point& p1 = pts[i == 0 ? npts-1: i-1];
+    const gfx::Point& p2 = pts[i];
+    if (p1.y < p2.y)
+      edges.push_back(Edge{ p1.x, p1.y, p2.x, p2.y });
+    else if (p1.y > p2.y)
+      edges.push_back(Edge{ p2.x, p2.y, p1.x, p1.y });
+  }
+  std::stable_sort(edges.begin(), edges.end(),
+                   [](const Edge& a, const Edge& b){
+                     return a.y1 < b.y1;
+                   });
+
+  // Points of each scan line (in the same order of "pts") to join
+  // them with the scan segments using createUnion().
+  const int rows = ymax - ymin + 1;
+  std::vector<int> rowStart(rows+1, 0);
+  for (const gfx::Point& pt : pts)
+    ++rowStart[pt.y - ymin + 1];
+  for (int i=0; i < rows; i++)
+    rowStart[i+1] += rowStart[i];
+  std::vector<int> rowXs(npts);
+  {
+    std::vector<int> pos(rowStart.begin(), rowStart.end()-1);
+    for (const gfx::Point& pt : pts)
+      rowXs[pos[pt.y - ymin]++] = pt.x;
+  }
 
-      if ((y >= y1 && y < y2) ||
-          (y == ymax && y > y1 && y <= y2)) {
-        polyInts[ints] = (int) ((float)((y - y1)*(x2 - x1)) / (float)(y2 - y1) + 0.5f + (float)x1);
-        ints++;
-      }
+  // Scan Line Loop:
+  std::vector<Edge> active;
+  std::vector<int> polyInts;
+  auto nextEdge = edges.begin();
+  for (int y = ymin; y <= ymax; y++) {
+    // Update the active edge table
+    active.erase(
+      std::remove_if(active.begin(), active.end(),
+                     [y, ymax](const Edge& e){
+                       return (e.y2 < y || (e.y2 == y && y != ymax));
+                     }),
+      active.end());
+    for (; nextEdge != edges.end() && nextEdge->y1 == y; ++nextEdge)
+      active.push_back(*nextEdge);
+
+    polyInts.clear();
+    for (const Edge& e : active) {
+      polyInts.push_back(
+        (int) ((float)((y - e.y1)*(e.x2 - e.x1)) / (float)(e.y2 - e.y1) + 0.5f + (float)e.x1));
     }
+    std::sort(polyInts.begin(), polyInts.end());
 
-    std::sort(polyInts.begin(), polyInts.begin() + ints);
-
-    for (int i=0; i < pts.size(); i++) {
-      if (pts[i].y == y)
-        createUnion(polyInts, pts[i].x, ints);
-    }
+    int ints = int(polyInts.size());
+    for (int i=rowStart[y-ymin]; i < rowStart[y-ymin+1]; i++)
+      createUnion(polyInts, rowXs[i], ints);
 
     for (int i=0; i < ints; i+=2)
       proc(polyInts[i], y, polyInts[i+1], data);
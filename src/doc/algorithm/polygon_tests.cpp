@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -8,6 +8,9 @@
 
 #include "doc/algorithm/polygon.h"
 
+#include <cmath>
+#include <vector>
+
 struct scanSegment {
   int x1;
   int x2;
@@ -497,6 +500,53 @@ TEST(Polygon, Polygon2Test)
   }
 }
 
+TEST(Polygon, OverlappedEdges)
+{
+  // Freehand path that goes back and forth over the same pixels
+  int points[24] = { 0 , 1 , 1 , 1 , 1 , 0 , 0 , 1 ,
+                     0 , 1 , 1 , 0 , 0 , 1 , 1 , 0 ,
+                     1 , 0 , 0 , 0 , 1 , 1 , 0 , 0 };
+  int n = 12;
+  ScanLineResult results;
+  doc::algorithm::polygon(n, points, (void *) &results, captureHscanSegment);
+  EXPECT_EQ(results.scanLines.size(), 2);
+  if (results.scanLines.size() == 2) {
+    EXPECT_EQ(results.scanLines[0].x1, 0);
+    EXPECT_EQ(results.scanLines[0].x2, 1);
+    EXPECT_EQ(results.scanLines[0].y, 0);
+
+    EXPECT_EQ(results.scanLines[1].x1, 0);
+    EXPECT_EQ(results.scanLines[1].x2, 1);
+    EXPECT_EQ(results.scanLines[1].y, 1);
+  }
+}
+
+TEST(Polygon, LongFreehandPath)
+{
+  // Closed path with thousands of vertices, each scan line must be
+  // covered by disjoint segments sorted by x.
+  std::vector<int> points;
+  const int n = 4000;
+  for (int i=0; i<n; ++i) {
+    const double t = 2.0*3.14159265358979*i/n;
+    const double r = 400.0 + 100.0*std::sin(37.0*t);
+    points.push_back(int(500.0 + r*std::cos(t)));
+    points.push_back(int(500.0 + r*std::sin(t)));
+  }
+  ScanLineResult results;
+  doc::algorithm::polygon(n, points.data(), (void *) &results, captureHscanSegment);
+  ASSERT_FALSE(results.scanLines.empty());
+  for (int i=1; i<int(results.scanLines.size()); ++i) {
+    const scanSegment& a = results.scanLines[i-1];
+    const scanSegment& b = results.scanLines[i];
+    EXPECT_LE(b.x1, b.x2);
+    if (a.y == b.y)
+      EXPECT_LT(a.x2+1, b.x1);
+    else
+      EXPECT_EQ(a.y+1, b.y);
+  }
+}
+
 // createUnion() function TESTS:
 // =============================
 // Function Tests to ensure correct results when:
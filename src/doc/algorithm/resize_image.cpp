@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -11,37 +11,305 @@
 
 #include "doc/algorithm/resize_image.h"
 
+#include "base/thread_pool.h"
 #include "doc/algorithm/rotsprite.h"
 #include "doc/image_impl.h"
 #include "doc/palette.h"
 #include "doc/primitives_fast.h"
 #include "doc/rgbmap.h"
+#include "doc/simd.h"
 #include "gfx/point.h"
 
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <thread>
+#include <vector>
 
 namespace doc {
 namespace algorithm {
 
+namespace {
+
+// Minimum number of destination pixels to resize an image in
+// several threads (each one resizing a band of rows).
+static constexpr int kMinPixelsToParallelize = 128*128;
+
+// Calls "resize_rows(y1, y2)" for bands of rows of the destination
+// image, in several threads if the image is big enough.
+template<typename ResizeRows>
+void for_each_band_of_rows(const Image* dst, ResizeRows&& resize_rows)
+{
+  const int h = dst->height();
+  const int nthreads =
+    (std::int64_t(dst->width())*h < kMinPixelsToParallelize ? 1:
+     std::min<int>({ int(std::thread::hardware_concurrency()), 8, h }));
+  if (nthreads <= 1) {
+    resize_rows(0, h);
+    return;
+  }
+
+  base::thread_pool threads(nthreads);
+  for (int i=0; i<nthreads; ++i) {
+    threads.execute([&resize_rows, i, h, nthreads]{
+      resize_rows(h*i/nthreads, h*(i+1)/nthreads);
+    });
+  }
+  threads.wait_all();
+}
+
 template<typename ImageTraits>
 void resize_image_nearest(const Image* src, Image* dst)
 {
-  double x_ratio = double(src->width()) / double(dst->width());
-  double y_ratio = double(src->height()) / double(dst->height());
-  double px, py;
+  using pixel_t = typename ImageTraits::pixel_t;
+
+  const int src_w = src->width();
+  const int dst_w = dst->width();
+  const double x_ratio = double(src_w) / double(dst_w);
+  const double y_ratio = double(src->height()) / double(dst->height());
+
+  // Source column of each destination column
+  std::vector<int> cols(dst_w);
+  for (int x=0; x<dst_w; ++x)
+    cols[x] = int(std::floor(x * x_ratio));
+
+  // Integer upscale factor (each source pixel is repeated "xscale"
+  // times in the destination row).
+  const int xscale = (dst_w % src_w == 0 ? dst_w / src_w: 0);
+
+  for_each_band_of_rows(dst, [&](const int y1, const int y2){
+    int prev_py = -1;
+    for (int y=y1; y<y2; ++y) {
+      const int py = int(std::floor(y * y_ratio));
+
+      // Upscaling: this row is equal to the previous one.
+      if (py == prev_py) {
+        const uint8_t* prevRow = dst->getPixelAddress(0, y-1);
+        std::copy(prevRow, prevRow+dst->rowBytes(),
+                  dst->getPixelAddress(0, y));
+        continue;
+      }
+      prev_py = py;
 
-  LockImageBits<ImageTraits> dstBits(dst);
-  auto dstIt = dstBits.begin();
+      if constexpr (ImageTraits::color_mode == ColorMode::BITMAP) {
+        for (int x=0; x<dst_w; ++x)
+          put_pixel_fast<ImageTraits>(
+            dst, x, y, get_pixel_fast<ImageTraits>(src, cols[x], py));
+      }
+      else {
+        auto srcRow = (const pixel_t*)src->getPixelAddress(0, py);
+        auto dstRow = (pixel_t*)dst->getPixelAddress(0, y);
+        if (xscale > 0) {
+          for (int x=0; x<src_w; ++x, dstRow+=xscale)
+            std::fill_n(dstRow, xscale, srcRow[x]);
+        }
+        else {
+          for (int x=0; x<dst_w; ++x)
+            dstRow[x] = srcRow[cols[x]];
+        }
+      }
+    }
+  });
+}
+
+// Source coordinates and weights to interpolate one destination
+// column (or row) with the bilinear method.
+struct BilinearCoord {
+  int floor, floor2;            // Source columns/rows to interpolate
+  double t1, t2;                // Weights of "floor2" and "floor"
+};
+
+// Precalculates the coordinates for each destination column/row
+// accumulating the source position in the same way as the original
+// pixel-by-pixel loop did, so the result is exactly the same.
+std::vector<BilinearCoord> bilinear_coords(const int src_size,
+                                           const int dst_size)
+{
+  std::vector<BilinearCoord> coords(dst_size);
+  const double d = (src_size-1) * 1.0 / (dst_size-1);
+  double u = 0.0;
+  for (BilinearCoord& c : coords) {
+    c.floor = (int)std::floor(u);
+    if (c.floor > src_size-1) {
+      c.floor = src_size-1;
+      c.floor2 = src_size-1;
+    }
+    else if (c.floor == src_size-1)
+      c.floor2 = c.floor;
+    else
+      c.floor2 = c.floor+1;
+
+    c.t1 = u - c.floor;
+    c.t2 = 1 - c.t1;
+    u += d;
+  }
+  return coords;
+}
+
+// Interpolates the 4 given RGBA colors (c0/c1 from the upper row and
+// c2/c3 from the lower row).
+inline color_t bilinear_rgba(const color_t c0, const color_t c1,
+                             const color_t c2, const color_t c3,
+                             const BilinearCoord& u,
+                             const BilinearCoord& v)
+{
+#if DOC_SIMD_SSE2
+  // Each color is converted to two pairs of doubles (r,g) and (b,a)
+  const __m128i zero = _mm_setzero_si128();
+  auto unpack = [zero](const color_t c, __m128d& rg, __m128d& ba) {
+    __m128i p = _mm_cvtsi32_si128(int(c));
+    p = _mm_unpacklo_epi16(_mm_unpacklo_epi8(p, zero), zero);
+    rg = _mm_cvtepi32_pd(p);
+    ba = _mm_cvtepi32_pd(_mm_srli_si128(p, 8));
+  };
+  __m128d rg0, ba0, rg1, ba1, rg2, ba2, rg3, ba3;
+  unpack(c0, rg0, ba0);
+  unpack(c1, rg1, ba1);
+  unpack(c2, rg2, ba2);
+  unpack(c3, rg3, ba3);
+
+  const __m128d u1 = _mm_set1_pd(u.t1), u2 = _mm_set1_pd(u.t2);
+  const __m128d v1 = _mm_set1_pd(v.t1), v2 = _mm_set1_pd(v.t2);
+  const __m128d rg =
+    _mm_add_pd(_mm_mul_pd(_mm_add_pd(_mm_mul_pd(rg0, u2), _mm_mul_pd(rg1, u1)), v2),
+               _mm_mul_pd(_mm_add_pd(_mm_mul_pd(rg2, u2), _mm_mul_pd(rg3, u1)), v1));
+  const __m128d ba =
+    _mm_add_pd(_mm_mul_pd(_mm_add_pd(_mm_mul_pd(ba0, u2), _mm_mul_pd(ba1, u1)), v2),
+               _mm_mul_pd(_mm_add_pd(_mm_mul_pd(ba2, u2), _mm_mul_pd(ba3, u1)), v1));
+
+  __m128i p = _mm_unpacklo_epi64(_mm_cvttpd_epi32(rg), _mm_cvttpd_epi32(ba));
+  p = _mm_packs_epi32(p, p);
+  p = _mm_packus_epi16(p, p);
+  return color_t(_mm_cvtsi128_si32(p));
+#elif DOC_SIMD_NEON
+  auto unpack = [](const color_t c, float64x2_t& rg, float64x2_t& ba) {
+    const uint32x4_t p = vmovl_u16(vget_low_u16(vmovl_u8(vcreate_u8(c))));
+    rg = vcvtq_f64_u64(vmovl_u32(vget_low_u32(p)));
+    ba = vcvtq_f64_u64(vmovl_u32(vget_high_u32(p)));
+  };
+  float64x2_t rg0, ba0, rg1, ba1, rg2, ba2, rg3, ba3;
+  unpack(c0, rg0, ba0);
+  unpack(c1, rg1, ba1);
+  unpack(c2, rg2, ba2);
+  unpack(c3, rg3, ba3);
+
+  const float64x2_t u1 = vdupq_n_f64(u.t1), u2 = vdupq_n_f64(u.t2);
+  const float64x2_t v1 = vdupq_n_f64(v.t1), v2 = vdupq_n_f64(v.t2);
+  const float64x2_t rg =
+    vaddq_f64(vmulq_f64(vaddq_f64(vmulq_f64(rg0, u2), vmulq_f64(rg1, u1)), v2),
+              vmulq_f64(vaddq_f64(vmulq_f64(rg2, u2), vmulq_f64(rg3, u1)), v1));
+  const float64x2_t ba =
+    vaddq_f64(vmulq_f64(vaddq_f64(vmulq_f64(ba0, u2), vmulq_f64(ba1, u1)), v2),
+              vmulq_f64(vaddq_f64(vmulq_f64(ba2, u2), vmulq_f64(ba3, u1)), v1));
+
+  const int32x4_t p = vcombine_s32(vmovn_s64(vcvtq_s64_f64(rg)),
+                                   vmovn_s64(vcvtq_s64_f64(ba)));
+  const uint16x4_t p16 = vqmovun_s32(p);
+  const uint8x8_t p8 = vqmovn_u16(vcombine_u16(p16, p16));
+  return color_t(vget_lane_u32(vreinterpret_u32_u8(p8), 0));
+#else
+  const double u1 = u.t1, u2 = u.t2;
+  const double v1 = v.t1, v2 = v.t2;
+  int r = int((rgba_getr(c0)*u2 + rgba_getr(c1)*u1)*v2 +
+              (rgba_getr(c2)*u2 + rgba_getr(c3)*u1)*v1);
+  int g = int((rgba_getg(c0)*u2 + rgba_getg(c1)*u1)*v2 +
+              (rgba_getg(c2)*u2 + rgba_getg(c3)*u1)*v1);
+  int b = int((rgba_getb(c0)*u2 + rgba_getb(c1)*u1)*v2 +
+              (rgba_getb(c2)*u2 + rgba_getb(c3)*u1)*v1);
+  int a = int((rgba_geta(c0)*u2 + rgba_geta(c1)*u1)*v2 +
+              (rgba_geta(c2)*u2 + rgba_geta(c3)*u1)*v1);
+  return rgba(r, g, b, a);
+#endif
+}
 
+inline color_t bilinear_graya(const color_t c0, const color_t c1,
+                              const color_t c2, const color_t c3,
+                              const BilinearCoord& u,
+                              const BilinearCoord& v)
+{
+  const double u1 = u.t1, u2 = u.t2;
+  const double v1 = v.t1, v2 = v.t2;
+  int k = int((graya_getv(c0)*u2 + graya_getv(c1)*u1)*v2 +
+              (graya_getv(c2)*u2 + graya_getv(c3)*u1)*v1);
+  int a = int((graya_geta(c0)*u2 + graya_geta(c1)*u1)*v2 +
+              (graya_geta(c2)*u2 + graya_geta(c3)*u1)*v1);
+  return graya(k, a);
+}
+
+template<typename ImageTraits>
+void resize_image_bilinear(const Image* src, Image* dst)
+{
+  using pixel_t = typename ImageTraits::pixel_t;
+
+  const std::vector<BilinearCoord> cols =
+    bilinear_coords(src->width(), dst->width());
+  const std::vector<BilinearCoord> rows =
+    bilinear_coords(src->height(), dst->height());
+
+  for_each_band_of_rows(dst, [&](const int y1, const int y2){
+    for (int y=y1; y<y2; ++y) {
+      const BilinearCoord& v = rows[y];
+      auto srcRow1 = (const pixel_t*)src->getPixelAddress(0, v.floor);
+      auto srcRow2 = (const pixel_t*)src->getPixelAddress(0, v.floor2);
+      auto dstRow = (pixel_t*)dst->getPixelAddress(0, y);
+
+      for (const BilinearCoord& u : cols) {
+        const color_t c0 = srcRow1[u.floor];
+        const color_t c1 = srcRow1[u.floor2];
+        const color_t c2 = srcRow2[u.floor];
+        const color_t c3 = srcRow2[u.floor2];
+        if constexpr (ImageTraits::color_mode == ColorMode::RGB)
+          *dstRow = bilinear_rgba(c0, c1, c2, c3, u, v);
+        else
+          *dstRow = bilinear_graya(c0, c1, c2, c3, u, v);
+        ++dstRow;
+      }
+    }
+  });
+}
+
+// The indexed version is not parallelized because RgbMap
+// implementations aren't thread-safe (they are lazily filled).
+void resize_image_bilinear_indexed(const Image* src,
+                                   Image* dst,
+                                   const Palette* pal,
+                                   const RgbMap* rgbmap,
+                                   const color_t maskColor)
+{
+  const std::vector<BilinearCoord> cols =
+    bilinear_coords(src->width(), dst->width());
+  const std::vector<BilinearCoord> rows =
+    bilinear_coords(src->height(), dst->height());
+
+  // Convert index to RGBA values
+  color_t entries[256];
+  for (int i=0; i<256; ++i) {
+    if (color_t(i) == maskColor)
+      entries[i] = pal->getEntry(i) & rgba_rgb_mask; // Set alpha = 0
+    else
+      entries[i] = pal->getEntry(i);
+  }
+
+  std::vector<color_t> colors(dst->width());
   for (int y=0; y<dst->height(); ++y) {
-    py = std::floor(y * y_ratio);
-    for (int x=0; x<dst->width(); ++x, ++dstIt) {
-      px = std::floor(x * x_ratio);
-      *dstIt = get_pixel_fast<ImageTraits>(src, int(px), int(py));
+    const BilinearCoord& v = rows[y];
+    const uint8_t* srcRow1 = src->getPixelAddress(0, v.floor);
+    const uint8_t* srcRow2 = src->getPixelAddress(0, v.floor2);
+
+    for (int x=0; x<dst->width(); ++x) {
+      const BilinearCoord& u = cols[x];
+      colors[x] = bilinear_rgba(entries[srcRow1[u.floor]],
+                                entries[srcRow1[u.floor2]],
+                                entries[srcRow2[u.floor]],
+                                entries[srcRow2[u.floor2]], u, v);
     }
+    rgbmap->mapColors(colors.data(), dst->getPixelAddress(0, y),
+                      dst->width());
   }
 }
 
+} // anonymous namespace
+
 void resize_image(const Image* src,
                   Image* dst,
                   const ResizeMethod method,
@@ -51,7 +319,6 @@ void resize_image(const Image* src,
 {
   switch (method) {
 
-    // TODO optimize this
     case RESIZE_METHOD_NEAREST_NEIGHBOR: {
       ASSERT(src->pixelFormat() == dst->pixelFormat());
 
@@ -64,112 +331,31 @@ void resize_image(const Image* src,
       break;
     }
 
-    // TODO optimize this
     case RESIZE_METHOD_BILINEAR: {
-      uint32_t color[4], dst_color = 0;
-      double u, v, du, dv;
-      int u_floor, u_floor2;
-      int v_floor, v_floor2;
-      int x, y;
-
-      // We cannot do interpolations between RGB values on indexed
-      // images without a palette/rgbmap.
-      if (dst->pixelFormat() == IMAGE_INDEXED &&
-          (!pal || !rgbmap)) {
-        resize_image(
-          src, dst,
-          RESIZE_METHOD_NEAREST_NEIGHBOR,
-          pal, rgbmap, maskColor);
-        return;
-      }
-
-      u = v = 0.0;
-      du = (src->width()-1) * 1.0 / (dst->width()-1);
-      dv = (src->height()-1) * 1.0 / (dst->height()-1);
-      for (y=0; y<dst->height(); ++y) {
-        for (x=0; x<dst->width(); ++x) {
-          u_floor = (int)std::floor(u);
-          v_floor = (int)std::floor(v);
-
-          if (u_floor > src->width()-1) {
-            u_floor = src->width()-1;
-            u_floor2 = src->width()-1;
-          }
-          else if (u_floor == src->width()-1)
-            u_floor2 = u_floor;
-          else
-            u_floor2 = u_floor+1;
-
-          if (v_floor > src->height()-1) {
-            v_floor = src->height()-1;
-            v_floor2 = src->height()-1;
-          }
-          else if (v_floor == src->height()-1)
-            v_floor2 = v_floor;
-          else
-            v_floor2 = v_floor+1;
-
-          // get the four colors
-          color[0] = src->getPixel(u_floor,  v_floor);
-          color[1] = src->getPixel(u_floor2, v_floor);
-          color[2] = src->getPixel(u_floor,  v_floor2);
-          color[3] = src->getPixel(u_floor2, v_floor2);
-
-          // calculate the interpolated color
-          double u1 = u - u_floor;
-          double v1 = v - v_floor;
-          double u2 = 1 - u1;
-          double v2 = 1 - v1;
-
-          switch (dst->pixelFormat()) {
-            case IMAGE_RGB: {
-              int r = int((rgba_getr(color[0])*u2 + rgba_getr(color[1])*u1)*v2 +
-                          (rgba_getr(color[2])*u2 + rgba_getr(color[3])*u1)*v1);
-              int g = int((rgba_getg(color[0])*u2 + rgba_getg(color[1])*u1)*v2 +
-                          (rgba_getg(color[2])*u2 + rgba_getg(color[3])*u1)*v1);
-              int b = int((rgba_getb(color[0])*u2 + rgba_getb(color[1])*u1)*v2 +
-                          (rgba_getb(color[2])*u2 + rgba_getb(color[3])*u1)*v1);
-              int a = int((rgba_geta(color[0])*u2 + rgba_geta(color[1])*u1)*v2 +
-                          (rgba_geta(color[2])*u2 + rgba_geta(color[3])*u1)*v1);
-              dst_color = rgba(r, g, b, a);
-              break;
-            }
-            case IMAGE_GRAYSCALE: {
-              int v = int((graya_getv(color[0])*u2 + graya_getv(color[1])*u1)*v2 +
-                          (graya_getv(color[2])*u2 + graya_getv(color[3])*u1)*v1);
-              int a = int((graya_geta(color[0])*u2 + graya_geta(color[1])*u1)*v2 +
-                          (graya_geta(color[2])*u2 + graya_geta(color[3])*u1)*v1);
-              dst_color = graya(v, a);
-              break;
-            }
-            case IMAGE_INDEXED: {
-              // Convert index to RGBA values
-              for (int i=0; i<4; ++i) {
-                if (color[i] == maskColor)
-                  color[i] = pal->getEntry(color[i]) & rgba_rgb_mask; // Set alpha = 0
-                else
-                  color[i] = pal->getEntry(color[i]);
-              }
+      ASSERT(src->pixelFormat() == dst->pixelFormat());
 
-              int r = int((rgba_getr(color[0])*u2 + rgba_getr(color[1])*u1)*v2 +
-                          (rgba_getr(color[2])*u2 + rgba_getr(color[3])*u1)*v1);
-              int g = int((rgba_getg(color[0])*u2 + rgba_getg(color[1])*u1)*v2 +
-                          (rgba_getg(color[2])*u2 + rgba_getg(color[3])*u1)*v1);
-              int b = int((rgba_getb(color[0])*u2 + rgba_getb(color[1])*u1)*v2 +
-                          (rgba_getb(color[2])*u2 + rgba_getb(color[3])*u1)*v1);
-              int a = int((rgba_geta(color[0])*u2 + rgba_geta(color[1])*u1)*v2 +
-                          (rgba_geta(color[2])*u2 + rgba_geta(color[3])*u1)*v1);
-              dst_color = rgbmap->mapColor(r, g, b, a);
-              break;
-            }
+      switch (dst->pixelFormat()) {
+        case IMAGE_RGB:
+          resize_image_bilinear<RgbTraits>(src, dst);
+          return;
+        case IMAGE_GRAYSCALE:
+          resize_image_bilinear<GrayscaleTraits>(src, dst);
+          return;
+        case IMAGE_INDEXED:
+          // We cannot do interpolations between RGB values on indexed
+          // images without a palette/rgbmap.
+          if (pal && rgbmap) {
+            resize_image_bilinear_indexed(src, dst, pal, rgbmap, maskColor);
+            return;
           }
-
-          dst->putPixel(x, y, dst_color);
-          u += du;
-        }
-        u = 0.0;
-        v += dv;
+          break;
       }
+
+      // Other cases use the nearest neighbor method
+      resize_image(
+        src, dst,
+        RESIZE_METHOD_NEAREST_NEIGHBOR,
+        pal, rgbmap, maskColor);
       break;
     }
 
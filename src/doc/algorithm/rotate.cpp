@@ -12,6 +12,7 @@
 #endif
 
 #include "base/pi.h"
+#include "base/thread_pool.h"
 #include "doc/blend_funcs.h"
 #include "doc/image_impl.h"
 #include "doc/mask.h"
@@ -19,13 +20,20 @@
 #include "doc/primitives_fast.h"
 #include "fixmath/fixmath.h"
 
+#include <algorithm>
 #include <cmath>
+#include <thread>
+#include <vector>
 
 namespace doc {
 namespace algorithm {
 
 using namespace fixmath;
 
+// Minimum number of destination pixels to draw the scanlines of a
+// parallelogram from several threads.
+static constexpr int kMinPixelsToParallelize = 256*256;
+
 static void ase_parallelogram_map_standard(
   Image* bmp, const Image* sprite, const Image* mask,
   fixed xs[4], fixed ys[4]);
@@ -224,6 +232,57 @@ static void draw_scanline(
   delegate.unlockBits();
 }
 
+// Scanline of the parallelogram calculated by ase_parallelogram_map()
+// with the arguments for draw_scanline().
+struct ParallelogramScanline {
+  int bmp_y_i;
+  fixed l_bmp_x, r_bmp_x;
+  fixed l_spr_x, l_spr_y;
+};
+
+// Draws the given scanlines by bands of rows in several threads
+// (each scanline is a different row of "bmp", so each thread
+// modifies different pixels).
+template<class Traits, class Delegate>
+static void draw_scanlines(
+  Image* bmp,
+  const Image* spr,
+  const Image* mask,
+  const std::vector<ParallelogramScanline>& scanlines,
+  const int pixels,
+  fixed spr_dx, fixed spr_dy,
+  const Delegate& delegate)
+{
+  auto draw_rows =
+    [bmp, spr, mask, &scanlines, spr_dx, spr_dy, &delegate](const int i, const int j) {
+      Delegate rowsDelegate(delegate);
+      for (int k=i; k<j; ++k) {
+        const ParallelogramScanline& s = scanlines[k];
+        draw_scanline<Traits, Delegate>(bmp, spr, mask,
+          s.l_bmp_x, s.bmp_y_i, s.r_bmp_x,
+          s.l_spr_x, s.l_spr_y,
+          spr_dx, spr_dy, rowsDelegate);
+      }
+    };
+
+  const int n = int(scanlines.size());
+  const int nthreads =
+    std::min<int>({ int(std::thread::hardware_concurrency()), 8, n });
+
+  if (nthreads < 2 || pixels < kMinPixelsToParallelize) {
+    draw_rows(0, n);
+    return;
+  }
+
+  base::thread_pool threads(nthreads);
+  for (int i=0; i<nthreads; ++i) {
+    threads.execute([&draw_rows, i, n, nthreads]{
+      draw_rows(n*i/nthreads, n*(i+1)/nthreads);
+    });
+  }
+  threads.wait_all();
+}
+
 template<class Traits>
 class GenericDelegate {
 public:
@@ -385,6 +444,11 @@ static void ase_parallelogram_map(
   int bmp_y_i;
   /* Right edge of scanline. */
   int right_edge_test;
+  /* Scanlines to draw (and their number of pixels). The scanlines
+     are calculated incrementally, but then they can be drawn in
+     parallel. */
+  std::vector<ParallelogramScanline> scanlines;
+  int pixels = 0;
 
   /* Get index of topmost point. */
   top_index = 0;
@@ -713,11 +777,11 @@ static void ase_parallelogram_map(
           }
         }
       }
-      draw_scanline<Traits, Delegate>(bmp, spr, mask,
-        l_bmp_x_rounded, bmp_y_i, r_bmp_x_rounded,
-        l_spr_x_rounded, l_spr_y_rounded,
-        spr_dx, spr_dy, delegate);
-
+      scanlines.push_back(
+        ParallelogramScanline{ bmp_y_i,
+                               l_bmp_x_rounded, r_bmp_x_rounded,
+                               l_spr_x_rounded, l_spr_y_rounded });
+      pixels += ((r_bmp_x_rounded >> 16) - (l_bmp_x_rounded >> 16) + 1);
     }
     /* I'm not going to apoligize for this label and its gotos: to get
        rid of it would just make the code look worse. */
@@ -736,6 +800,9 @@ static void ase_parallelogram_map(
     r_spr_y += r_spr_dy;
 #endif
   }
+
+  draw_scanlines<Traits, Delegate>(bmp, spr, mask, scanlines, pixels,
+                                   spr_dx, spr_dy, delegate);
 }
 
 /* _parallelogram_map_standard:
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2020-2023  Igara Studio S.A.
+// Copyright (c) 2020-2024  Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -10,21 +10,29 @@
 #endif
 
 #include "doc/algorithm/rotate.h"
+#include "base/thread_pool.h"
 #include "doc/image_impl.h"
 #include "doc/primitives.h"
 
 #include <algorithm>
 #include <memory>
+#include <thread>
 
 namespace doc {
 namespace algorithm {
 
+// Minimum number of source pixels to scale an image from several
+// threads.
+static constexpr int kMinPixelsToParallelize = 128*128;
+
 // More information about EPX/Scale2x:
 // http://en.wikipedia.org/wiki/Pixel_art_scaling_algorithms#EPX.2FScale2.C3.97.2FAdvMAME2.C3.97
 // http://scale2x.sourceforge.net/algorithm.html
 // http://scale2x.sourceforge.net/scale2xandepx.html
+// Scales the rows [y1, y2) of "src" to the rows [y1*2, y2*2) of "dst".
 template<typename ImageTraits>
-static void image_scale2x_tpl(Image* dst, const Image* src, int src_w, int src_h)
+static void image_scale2x_tpl(Image* dst, const Image* src, int src_w, int src_h,
+                              int y1, int y2)
 {
 #if 0      // TODO complete this implementation that should be faster
            // than using a lot of get/put_pixel_fast calls.
@@ -124,12 +132,12 @@ static void image_scale2x_tpl(Image* dst, const Image* src, int src_w, int src_h
 #define D c[3]
 #define P c[4]
 
-  LockImageBits<ImageTraits> dstBits(dst, gfx::Rect(0, 0, src_w*2, src_h*2));
+  LockImageBits<ImageTraits> dstBits(dst, gfx::Rect(0, y1*2, src_w*2, (y2-y1)*2));
   auto dstIt = dstBits.begin();
   auto dstIt2 = dstIt;
 
   color_t c[5];
-  for (int y=0; y<src_h; ++y) {
+  for (int y=y1; y<y2; ++y) {
     dstIt2 += src_w*2;
     for (int x=0; x<src_w; ++x) {
       P = get_pixel_fast<ImageTraits>(src, x, y);
@@ -154,16 +162,36 @@ static void image_scale2x_tpl(Image* dst, const Image* src, int src_w, int src_h
 #endif
 }
 
-static void image_scale2x(Image* dst, const Image* src, int src_w, int src_h)
+static void image_scale2x_rows(Image* dst, const Image* src, int src_w, int src_h,
+                               int y1, int y2)
 {
   switch (src->pixelFormat()) {
-    case IMAGE_RGB:       image_scale2x_tpl<RgbTraits>(dst, src, src_w, src_h); break;
-    case IMAGE_GRAYSCALE: image_scale2x_tpl<GrayscaleTraits>(dst, src, src_w, src_h); break;
-    case IMAGE_INDEXED:   image_scale2x_tpl<IndexedTraits>(dst, src, src_w, src_h); break;
-    case IMAGE_BITMAP:    image_scale2x_tpl<BitmapTraits>(dst, src, src_w, src_h); break;
+    case IMAGE_RGB:       image_scale2x_tpl<RgbTraits>(dst, src, src_w, src_h, y1, y2); break;
+    case IMAGE_GRAYSCALE: image_scale2x_tpl<GrayscaleTraits>(dst, src, src_w, src_h, y1, y2); break;
+    case IMAGE_INDEXED:   image_scale2x_tpl<IndexedTraits>(dst, src, src_w, src_h, y1, y2); break;
+    case IMAGE_BITMAP:    image_scale2x_tpl<BitmapTraits>(dst, src, src_w, src_h, y1, y2); break;
   }
 }
 
+// Each output row depends on three source rows only, so we can scale
+// bands of rows in parallel.
+static void image_scale2x(Image* dst, const Image* src, int src_w, int src_h,
+                          base::thread_pool* threads, int nthreads)
+{
+  if (!threads || src_w*src_h < kMinPixelsToParallelize) {
+    image_scale2x_rows(dst, src, src_w, src_h, 0, src_h);
+    return;
+  }
+
+  for (int i=0; i<nthreads; ++i) {
+    threads->execute([dst, src, src_w, src_h, i, nthreads]{
+      image_scale2x_rows(dst, src, src_w, src_h,
+                         src_h*i/nthreads, src_h*(i+1)/nthreads);
+    });
+  }
+  threads->wait_all();
+}
+
 void rotsprite_image(Image* bmp, const Image* spr, const Image* mask,
   int x1, int y1, int x2, int y2,
   int x3, int y3, int x4, int y4)
@@ -186,8 +214,8 @@ void rotsprite_image(Image* bmp, const Image* spr, const Image* mask,
 
   int scale = 8;
   std::unique_ptr<Image> bmp_copy(Image::create(bmp->pixelFormat(), rot_width*scale, rot_height*scale, buf[0]));
-  std::unique_ptr<Image> tmp_copy(Image::create(spr->pixelFormat(), spr->width()*scale, spr->height()*scale, buf[1]));
-  std::unique_ptr<Image> spr_copy(Image::create(spr->pixelFormat(), spr->width()*scale, spr->height()*scale, buf[2]));
+  std::unique_ptr<Image> spr_copy(Image::create(spr->pixelFormat(), spr->width()*scale, spr->height()*scale, buf[1]));
+  std::unique_ptr<Image> tmp_copy(Image::create(spr->pixelFormat(), spr->width()*scale, spr->height()*scale, buf[2]));
   std::unique_ptr<Image> msk_copy;
 
   color_t maskColor = spr->maskColor();
@@ -196,18 +224,29 @@ void rotsprite_image(Image* bmp, const Image* spr, const Image* mask,
   tmp_copy->setMaskColor(maskColor);
   spr_copy->setMaskColor(maskColor);
 
-  spr_copy->clear(maskColor);
-  spr_copy->copy(spr, gfx::Clip(spr->bounds()));
-
-  for (int i=0; i<3; ++i) {
-    // clear_image(tmp_copy, maskColor);
-    image_scale2x(tmp_copy.get(), spr_copy.get(), spr->width()*(1<<i), spr->height()*(1<<i));
-    spr_copy->copy(tmp_copy.get(), gfx::Clip(tmp_copy->bounds()));
+  // Threads used to scale the image (the same threads for the three
+  // Scale2x passes)
+  std::unique_ptr<base::thread_pool> threads;
+  const int nthreads =
+    std::min<int>({ int(std::thread::hardware_concurrency()), 8, spr->height() });
+  if (nthreads > 1 &&
+      spr->width()*spr->height()*16 >= kMinPixelsToParallelize) {
+    threads = std::make_unique<base::thread_pool>(nthreads);
   }
 
+  // Three Scale2x passes: spr -> spr_copy -> tmp_copy -> spr_copy
+  // (each pass writes the whole area that the next pass reads, so we
+  // don't need to clear or copy the intermediate images).
+  image_scale2x(spr_copy.get(), spr, spr->width(), spr->height(),
+                threads.get(), nthreads);
+  image_scale2x(tmp_copy.get(), spr_copy.get(), spr->width()*2, spr->height()*2,
+                threads.get(), nthreads);
+  image_scale2x(spr_copy.get(), tmp_copy.get(), spr->width()*4, spr->height()*4,
+                threads.get(), nthreads);
+
   if (mask) {
     // Same ImageBuffer than tmp_copy
-    msk_copy.reset(Image::create(IMAGE_BITMAP, mask->width()*scale, mask->height()*scale, buf[1]));
+    msk_copy.reset(Image::create(IMAGE_BITMAP, mask->width()*scale, mask->height()*scale, buf[2]));
     clear_image(msk_copy.get(), 0);
     scale_image(msk_copy.get(), mask,
                 0, 0, msk_copy->width(), msk_copy->height(),
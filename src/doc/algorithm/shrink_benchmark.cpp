@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -49,6 +49,22 @@ void BM_ShrinkBounds(benchmark::State& state) {
   ->Args({ MODE, 4000, 4000 })             \
   ->Args({ MODE, 8000, 8000 })
 
+// Image with transparent pixels in the borders of a sprite
+void BM_ShrinkBoundsSprite(benchmark::State& state) {
+  const PixelFormat pixelFormat = (PixelFormat)state.range(0);
+  const int w = state.range(1);
+  const int h = state.range(2);
+
+  std::unique_ptr<Image> img(Image::create(pixelFormat, w, h));
+  img->clear(0);
+  for (int y=h/4; y<3*h/4; ++y)
+    img->putPixel(w/4 + y%(w/2), y, rgba(1, 2, 3, 4));
+  gfx::Rect rc;
+  while (state.KeepRunning()) {
+    doc::algorithm::shrink_bounds(img.get(), 0, nullptr, rc);
+  }
+}
+
 BENCHMARK(BM_ShrinkBounds)
   DEFARGS(IMAGE_RGB)
   DEFARGS(IMAGE_GRAYSCALE)
@@ -56,4 +72,11 @@ BENCHMARK(BM_ShrinkBounds)
   ->Unit(benchmark::kMicrosecond)
   ->UseRealTime();
 
+BENCHMARK(BM_ShrinkBoundsSprite)
+  DEFARGS(IMAGE_RGB)
+  DEFARGS(IMAGE_GRAYSCALE)
+  DEFARGS(IMAGE_INDEXED)
+  ->Unit(benchmark::kMicrosecond)
+  ->UseRealTime();
+
 BENCHMARK_MAIN();
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2023 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -17,10 +17,12 @@
 #include "doc/image_impl.h"
 #include "doc/layer.h"
 #include "doc/layer_tilemap.h"
+#include "doc/plain_pixels.h"
 #include "doc/primitives.h"
 #include "doc/primitives_fast.h"
 #include "doc/tileset.h"
 
+#include <algorithm>
 #include <thread>
 
 namespace doc {
@@ -28,35 +30,13 @@ namespace algorithm {
 
 namespace {
 
-template<typename ImageTraits>
-bool is_same_pixel(color_t pixel1, color_t pixel2)
-{
-  static_assert(false && sizeof(ImageTraits), "No is_same_pixel impl");
-  return false;
-}
-
-template<>
-bool is_same_pixel<RgbTraits>(color_t pixel1, color_t pixel2)
-{
-  return (rgba_geta(pixel1) == 0 && rgba_geta(pixel2) == 0) || (pixel1 == pixel2);
-}
-
-template<>
-bool is_same_pixel<GrayscaleTraits>(color_t pixel1, color_t pixel2)
-{
-  return (graya_geta(pixel1) == 0 && graya_geta(pixel2) == 0) || (pixel1 == pixel2);
-}
+// Scalar functions to shrink each side of bitmaps (where each byte
+// contains 8 pixels).
 
-template<>
-bool is_same_pixel<IndexedTraits>(color_t pixel1, color_t pixel2)
-{
-  return pixel1 == pixel2;
-}
-
-template<>
-bool is_same_pixel<BitmapTraits>(color_t pixel1, color_t pixel2)
+template<typename ImageTraits>
+typename ImageTraits::const_address_t get_pixel_read_address(const Image* image, int x, int y)
 {
-  return pixel1 == pixel2;
+  return ((const ImageImpl<ImageTraits>*)image)->readAddress(x, y);
 }
 
 template<typename ImageTraits>
@@ -65,10 +45,10 @@ bool shrink_bounds_left_templ(const Image* image, gfx::Rect& bounds, color_t ref
   int u, v;
   // Shrink left side
   for (u=bounds.x; u<bounds.x2(); ++u) {
-    auto ptr = get_pixel_address_fast<ImageTraits>(image, u, v=bounds.y);
+    auto ptr = get_pixel_read_address<ImageTraits>(image, u, v=bounds.y);
     for (; v<bounds.y2(); ++v, ptr+=rowPixels) {
-      ASSERT(ptr == get_pixel_address_fast<ImageTraits>(image, u, v));
-      if (!is_same_pixel<ImageTraits>(*ptr, refpixel))
+      ASSERT(ptr == get_pixel_read_address<ImageTraits>(image, u, v));
+      if (*ptr != refpixel)
         return (!bounds.isEmpty());
     }
     ++bounds.x;
@@ -83,10 +63,10 @@ bool shrink_bounds_right_templ(const Image* image, gfx::Rect& bounds, color_t re
   int u, v;
   // Shrink right side
   for (u=bounds.x2()-1; u>=bounds.x; --u) {
-    auto ptr = get_pixel_address_fast<ImageTraits>(image, u, v=bounds.y);
+    auto ptr = get_pixel_read_address<ImageTraits>(image, u, v=bounds.y);
     for (; v<bounds.y2(); ++v, ptr+=rowPixels) {
-      ASSERT(ptr == get_pixel_address_fast<ImageTraits>(image, u, v));
-      if (!is_same_pixel<ImageTraits>(*ptr, refpixel))
+      ASSERT(ptr == get_pixel_read_address<ImageTraits>(image, u, v));
+      if (*ptr != refpixel)
         return (!bounds.isEmpty());
     }
     --bounds.w;
@@ -100,10 +80,10 @@ bool shrink_bounds_top_templ(const Image* image, gfx::Rect& bounds, color_t refp
   int u, v;
   // Shrink top side
   for (v=bounds.y; v<bounds.y2(); ++v) {
-    auto ptr = get_pixel_address_fast<ImageTraits>(image, u=bounds.x, v);
+    auto ptr = get_pixel_read_address<ImageTraits>(image, u=bounds.x, v);
     for (; u<bounds.x2(); ++u, ++ptr) {
-      ASSERT(ptr == get_pixel_address_fast<ImageTraits>(image, u, v));
-      if (!is_same_pixel<ImageTraits>(*ptr, refpixel))
+      ASSERT(ptr == get_pixel_read_address<ImageTraits>(image, u, v));
+      if (*ptr != refpixel)
         return (!bounds.isEmpty());
     }
     ++bounds.y;
@@ -118,10 +98,10 @@ bool shrink_bounds_bottom_templ(const Image* image, gfx::Rect& bounds, color_t r
   int u, v;
   // Shrink bottom side
   for (v=bounds.y2()-1; v>=bounds.y; --v) {
-    auto ptr = get_pixel_address_fast<ImageTraits>(image, u=bounds.x, v);
+    auto ptr = get_pixel_read_address<ImageTraits>(image, u=bounds.x, v);
     for (; u<bounds.x2(); ++u, ++ptr) {
-      ASSERT(ptr == get_pixel_address_fast<ImageTraits>(image, u, v));
-      if (!is_same_pixel<ImageTraits>(*ptr, refpixel))
+      ASSERT(ptr == get_pixel_read_address<ImageTraits>(image, u, v));
+      if (*ptr != refpixel)
         return (!bounds.isEmpty());
     }
     --bounds.h;
@@ -130,41 +110,123 @@ bool shrink_bounds_bottom_templ(const Image* image, gfx::Rect& bounds, color_t r
 }
 
 template<typename ImageTraits>
-bool shrink_bounds_templ(const Image* image, gfx::Rect& bounds, color_t refpixel)
+bool shrink_bounds_bitmap_templ(const Image* image, gfx::Rect& bounds, color_t refpixel)
 {
-  // Pixels per row
   const int rowPixels = image->rowPixels();
+  return
+    shrink_bounds_left_templ<ImageTraits>(image, bounds, refpixel, rowPixels) &&
+    shrink_bounds_right_templ<ImageTraits>(image, bounds, refpixel, rowPixels) &&
+    shrink_bounds_top_templ<ImageTraits>(image, bounds, refpixel) &&
+    shrink_bounds_bottom_templ<ImageTraits>(image, bounds, refpixel);
+}
+
+// Shrinks the rows [y1, y2) of the given bounds, scanning whole rows
+// (contiguous memory) with find_first/last_non_plain_pixel(): first
+// the top and bottom rows are found, and then only the left/right
+// margins of the rows between them are checked (the margins get
+// smaller on each row with a non-plain pixel). Returns an empty
+// rectangle if all pixels are the same as the refpixel.
+template<typename ImageTraits>
+gfx::Rect shrink_rows_templ(const Image* image,
+                            const gfx::Rect& bounds,
+                            const typename ImageTraits::pixel_t refpixel,
+                            const int y1, const int y2)
+{
+  using pixel_t = typename ImageTraits::pixel_t;
+  const int w = bounds.w;
+  auto row = [image, &bounds](const int v) {
+    return (const pixel_t*)image->readPixelAddress(bounds.x, v);
+  };
+
+  // Shrink top side
+  int top = y1;
+  int left = w;
+  for (; top<y2; ++top) {
+    left = find_first_non_plain_pixel<ImageTraits>(row(top), w, refpixel);
+    if (left < w)
+      break;
+  }
+  if (top == y2)
+    return gfx::Rect();
+
+  // Shrink bottom side
+  int bottom = y2-1;
+  int right = -1;
+  for (; bottom>top; --bottom) {
+    right = find_last_non_plain_pixel<ImageTraits>(row(bottom), w, refpixel);
+    if (right >= 0)
+      break;
+  }
+  if (bottom == top)
+    right = find_last_non_plain_pixel<ImageTraits>(row(top), w, refpixel);
+  ASSERT(left >= 0 && right >= 0);
+
+  // Shrink left/right sides checking only the margins of each row
+  for (int v=top; v<=bottom && (left > 0 || right < w-1); ++v) {
+    const pixel_t* p = row(v);
+    left = find_first_non_plain_pixel<ImageTraits>(p, left, refpixel);
+    const int i = find_last_non_plain_pixel<ImageTraits>(p+right+1, w-right-1, refpixel);
+    if (i >= 0)
+      right += i+1;
+  }
+
+  return gfx::Rect(bounds.x+left, top, right-left+1, bottom-top+1);
+}
+
+template<typename ImageTraits>
+bool shrink_bounds_templ(const Image* image, gfx::Rect& bounds, color_t refpixel)
+{
+  if (bounds.isEmpty())
+    return false;
+
+  const auto pixel = typename ImageTraits::pixel_t(refpixel);
+  gfx::Rect result;
+
   const int canvasSize = image->width()*image->height();
   if ((std::thread::hardware_concurrency() >= 4) &&
       ((image->pixelFormat() == IMAGE_RGB && canvasSize >= 800*800) ||
-       (image->pixelFormat() != IMAGE_RGB && canvasSize >= 500*500))) {
-    gfx::Rect
-      leftBounds(bounds), rightBounds(bounds),
-      topBounds(bounds), bottomBounds(bounds);
-
-    // TODO use a base::thread_pool and a base::task for each border
-
-    std::thread left  ([&]{ shrink_bounds_left_templ  <ImageTraits>(image, leftBounds, refpixel, rowPixels); });
-    std::thread right ([&]{ shrink_bounds_right_templ <ImageTraits>(image, rightBounds, refpixel, rowPixels); });
-    std::thread top   ([&]{ shrink_bounds_top_templ   <ImageTraits>(image, topBounds, refpixel); });
-    std::thread bottom([&]{ shrink_bounds_bottom_templ<ImageTraits>(image, bottomBounds, refpixel); });
-    left.join();
-    right.join();
-    top.join();
-    bottom.join();
-    bounds = leftBounds;
-    bounds &= rightBounds;
-    bounds &= topBounds;
-    bounds &= bottomBounds;
-    return !bounds.isEmpty();
+       (image->pixelFormat() != IMAGE_RGB && canvasSize >= 500*500)) &&
+      bounds.h >= 4) {
+    // Shrink 4 horizontal bands of the image in parallel
+
+    // TODO use a base::thread_pool and a base::task for each band
+
+    constexpr int kBands = 4;
+    gfx::Rect bands[kBands];
+    std::thread threads[kBands];
+    for (int i=0; i<kBands; ++i) {
+      const int y1 = bounds.y + bounds.h*i/kBands;
+      const int y2 = bounds.y + bounds.h*(i+1)/kBands;
+      threads[i] = std::thread([&, i, y1, y2]{
+        bands[i] = shrink_rows_templ<ImageTraits>(image, bounds, pixel, y1, y2);
+      });
+    }
+    for (int i=0; i<kBands; ++i) {
+      threads[i].join();
+      if (bands[i].isEmpty())
+        continue;
+      if (result.isEmpty()) {
+        result = bands[i];
+      }
+      else {
+        const int x1 = std::min(result.x, bands[i].x);
+        const int x2 = std::max(result.x2(), bands[i].x2());
+        result = gfx::Rect(x1, result.y, x2-x1, bands[i].y2()-result.y);
+      }
+    }
   }
   else {
-    return
-      shrink_bounds_left_templ<ImageTraits>(image, bounds, refpixel, rowPixels) &&
-      shrink_bounds_right_templ<ImageTraits>(image, bounds, refpixel, rowPixels) &&
-      shrink_bounds_top_templ<ImageTraits>(image, bounds, refpixel) &&
-      shrink_bounds_bottom_templ<ImageTraits>(image, bounds, refpixel);
+    result = shrink_rows_templ<ImageTraits>(image, bounds, pixel,
+                                            bounds.y, bounds.y2());
   }
+
+  if (result.isEmpty()) {
+    bounds.x = bounds.x2();
+    bounds.w = 0;
+    return false;
+  }
+  bounds = result;
+  return true;
 }
 
 template<typename ImageTraits>
@@ -347,7 +409,7 @@ bool shrink_bounds(const Image* image,
     case IMAGE_RGB:       return shrink_bounds_templ<RgbTraits>(image, bounds, refpixel);
     case IMAGE_GRAYSCALE: return shrink_bounds_templ<GrayscaleTraits>(image, bounds, refpixel);
     case IMAGE_INDEXED:   return shrink_bounds_templ<IndexedTraits>(image, bounds, refpixel);
-    case IMAGE_BITMAP:    return shrink_bounds_templ<BitmapTraits>(image, bounds, refpixel);
+    case IMAGE_BITMAP:    return shrink_bounds_bitmap_templ<BitmapTraits>(image, bounds, refpixel);
     case IMAGE_TILEMAP:   return shrink_bounds_tilemap(image, refpixel, layer, bounds);
   }
   ASSERT(false);
@@ -0,0 +1,125 @@
+// Aseprite Document Library
+// Copyright (c) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "gtest/gtest.h"
+
+#include "doc/algorithm/shrink_bounds.h"
+
+#include "doc/color.h"
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/primitives.h"
+
+#include <algorithm>
+#include <random>
+
+using namespace doc;
+using namespace gfx;
+
+namespace {
+
+bool same_pixel(const PixelFormat pf, const color_t a, const color_t b)
+{
+  switch (pf) {
+    case IMAGE_RGB:
+      return (a == b) || (rgba_geta(a) == 0 && rgba_geta(b) == 0);
+    case IMAGE_GRAYSCALE:
+      return (a == b) || (graya_geta(a) == 0 && graya_geta(b) == 0);
+    default:
+      return (a == b);
+  }
+}
+
+// Slow reference implementation: the bounds of all pixels that are
+// not the same as the refpixel.
+Rect expected_bounds(const Image* image, const color_t refpixel)
+{
+  int x1 = image->width(), y1 = image->height(), x2 = -1, y2 = -1;
+  for (int y=0; y<image->height(); ++y) {
+    for (int x=0; x<image->width(); ++x) {
+      if (!same_pixel(image->pixelFormat(), get_pixel(image, x, y), refpixel)) {
+        x1 = std::min(x1, x);
+        y1 = std::min(y1, y);
+        x2 = std::max(x2, x);
+        y2 = std::max(y2, y);
+      }
+    }
+  }
+  if (x2 < 0)
+    return Rect();
+  return Rect(x1, y1, x2-x1+1, y2-y1+1);
+}
+
+} // anonymous namespace
+
+TEST(ShrinkBounds, Image)
+{
+  std::mt19937 gen(1);
+  for (auto pf : { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED }) {
+    const color_t bg = (pf == IMAGE_INDEXED ? 3: 0);
+    // Different transparent colors must be the same pixel in RGB/gray
+    const color_t fg = (pf == IMAGE_RGB ? rgba(255, 0, 0, 255):
+                        pf == IMAGE_GRAYSCALE ? graya(128, 255): 5);
+    const color_t transparent = (pf == IMAGE_RGB ? rgba(1, 2, 3, 0):
+                                 pf == IMAGE_GRAYSCALE ? graya(4, 0): bg);
+
+    for (int h=1; h<90; h+=11) {
+      for (int w=1; w<150; w+=7) {
+        ImageRef image(Image::create(pf, w, h));
+        image->clear(bg);
+        for (int i=0; i<w*h/4; ++i)
+          put_pixel(image.get(), gen() % w, gen() % h, transparent);
+
+        Rect rc;
+        EXPECT_FALSE(algorithm::shrink_bounds(image.get(), bg, nullptr, rc));
+
+        for (int i=0, n=1+gen()%3; i<n; ++i)
+          put_pixel(image.get(), gen() % w, gen() % h, fg);
+
+        EXPECT_TRUE(algorithm::shrink_bounds(image.get(), bg, nullptr, rc));
+        EXPECT_EQ(expected_bounds(image.get(), bg), rc);
+
+        // Shrink a part of the image
+        const Rect startBounds(w/3, h/3, w/2+1, h/2+1);
+        ImageRef part(Image::create(pf, w, h));
+        part->clear(bg);
+        part->copy(image.get(), Clip(startBounds.origin(), startBounds & image->bounds()));
+        const Rect expected = expected_bounds(part.get(), bg);
+        EXPECT_EQ(!expected.isEmpty(),
+                  algorithm::shrink_bounds(image.get(), bg, nullptr, startBounds, rc));
+        if (!expected.isEmpty()) {
+          EXPECT_EQ(expected, rc);
+        }
+      }
+    }
+  }
+}
+
+TEST(ShrinkBounds, BigImage)
+{
+  // Big images are shrunk in several threads
+  for (auto pf : { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED }) {
+    ImageRef image(Image::create(pf, 1001, 903));
+    image->clear(0);
+
+    Rect rc;
+    EXPECT_FALSE(algorithm::shrink_bounds(image.get(), 0, nullptr, rc));
+
+    const color_t fg = (pf == IMAGE_RGB ? rgba(0, 0, 255, 255):
+                        pf == IMAGE_GRAYSCALE ? graya(255, 255): 1);
+    for (const auto& pt : { Point(500, 450), Point(20, 700), Point(990, 10), Point(600, 902) }) {
+      put_pixel(image.get(), pt.x, pt.y, fg);
+      EXPECT_TRUE(algorithm::shrink_bounds(image.get(), 0, nullptr, rc));
+      EXPECT_EQ(expected_bounds(image.get(), 0), rc);
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,4 +1,5 @@
 // Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -12,6 +13,8 @@
 
 #include <benchmark/benchmark.h>
 
+#include <vector>
+
 using namespace doc;
 
 static void CustomArguments(benchmark::internal::Benchmark* b) {
@@ -53,4 +56,65 @@ BENCHMARK_TEMPLATE(BM_Rgba, rgba_blender_hsl_saturation)->Apply(CustomArguments)
 BENCHMARK_TEMPLATE(BM_Rgba, rgba_blender_hsl_color)->Apply(CustomArguments);
 BENCHMARK_TEMPLATE(BM_Rgba, rgba_blender_hsl_luminosity)->Apply(CustomArguments);
 
+// Span benchmarks: blend a row of pixels with one BlendFunc call per
+// pixel vs. one rgba_blend_span() call for the whole row.
+
+static void SpanArguments(benchmark::internal::Benchmark* b) {
+  b ->Args({ 1024, 255 })
+    ->Args({ 1024, 128 })
+    ->Args({ 4096, 255 })
+    ->Args({ 4096, 128 });
+}
+
+static void fill_span_pixels(std::vector<color_t>& dst,
+                             std::vector<color_t>& src)
+{
+  for (int i=0; i<int(dst.size()); ++i) {
+    dst[i] = rgba(i & 255, (i*3) & 255, (i*7) & 255, 255 - (i & 127));
+    src[i] = rgba((i*5) & 255, i & 255, (i*11) & 255, (i*13) & 255);
+  }
+}
+
+template<BlendMode M>
+void BM_RgbaPixels(benchmark::State& state) {
+  const int n = state.range(0);
+  const int opacity = state.range(1);
+  std::vector<color_t> dst(n), src(n);
+  fill_span_pixels(dst, src);
+  BlendFunc func = get_rgba_blender(M, true);
+  while (state.KeepRunning()) {
+    for (int i=0; i<n; ++i)
+      if (src[i] != 0)
+        dst[i] = func(dst[i], src[i], opacity);
+    benchmark::DoNotOptimize(dst.data());
+  }
+  state.SetItemsProcessed(int64_t(state.iterations()) * n);
+}
+
+template<BlendMode M>
+void BM_RgbaSpan(benchmark::State& state) {
+  const int n = state.range(0);
+  const int opacity = state.range(1);
+  std::vector<color_t> dst(n), src(n);
+  fill_span_pixels(dst, src);
+  while (state.KeepRunning()) {
+    rgba_blend_span(dst.data(), src.data(), n, opacity, M, true);
+    benchmark::DoNotOptimize(dst.data());
+  }
+  state.SetItemsProcessed(int64_t(state.iterations()) * n);
+}
+
+#define BENCHMARK_SPAN(mode)                                             \
+  BENCHMARK_TEMPLATE(BM_RgbaPixels, mode)->Apply(SpanArguments);        \
+  BENCHMARK_TEMPLATE(BM_RgbaSpan, mode)->Apply(SpanArguments);
+
+BENCHMARK_SPAN(BlendMode::NORMAL)
+BENCHMARK_SPAN(BlendMode::MULTIPLY)
+BENCHMARK_SPAN(BlendMode::SCREEN)
+BENCHMARK_SPAN(BlendMode::OVERLAY)
+BENCHMARK_SPAN(BlendMode::DARKEN)
+BENCHMARK_SPAN(BlendMode::LIGHTEN)
+BENCHMARK_SPAN(BlendMode::ADDITION)
+BENCHMARK_SPAN(BlendMode::SUBTRACT)
+
 BENCHMARK_MAIN();
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2022 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -251,6 +251,43 @@ color_t rgba_blender_normal_dst_over(color_t backdrop, color_t src, int opacity)
   return rgba_blender_normal(src, backdrop);
 }
 
+color_t rgba_premultiply(color_t c)
+{
+  int t;
+  const int a = rgba_geta(c);
+  return rgba(MUL_UN8(rgba_getr(c), a, t),
+              MUL_UN8(rgba_getg(c), a, t),
+              MUL_UN8(rgba_getb(c), a, t), a);
+}
+
+color_t rgba_unpremultiply(color_t c)
+{
+  const int a = rgba_geta(c);
+  if (a == 0)
+    return 0;
+  else if (a == 255)
+    return c;
+
+  const int r = std::min(255, (rgba_getr(c)*255 + a/2) / a);
+  const int g = std::min(255, (rgba_getg(c)*255 + a/2) / a);
+  const int b = std::min(255, (rgba_getb(c)*255 + a/2) / a);
+  return rgba(r, g, b, a);
+}
+
+// Same as rgba_blender_normal() but without the divisions by the
+// result alpha (the backdrop is premultiplied)
+color_t rgba_blender_normal_premul(color_t backdrop, color_t src, int opacity)
+{
+  int t, u;
+  const int Sa = MUL_UN8(rgba_geta(src), opacity, t);
+  const int Ba = 255 - Sa;
+  const int r = MUL_UN8(rgba_getr(src), Sa, t) + MUL_UN8(rgba_getr(backdrop), Ba, u);
+  const int g = MUL_UN8(rgba_getg(src), Sa, t) + MUL_UN8(rgba_getg(backdrop), Ba, u);
+  const int b = MUL_UN8(rgba_getb(src), Sa, t) + MUL_UN8(rgba_getb(backdrop), Ba, u);
+  const int a = Sa + MUL_UN8(rgba_geta(backdrop), Ba, t);
+  return rgba(r, g, b, a);
+}
+
 color_t rgba_blender_multiply(color_t backdrop, color_t src, int opacity)
 {
   int t;
@@ -766,6 +803,7 @@ BlendFunc get_rgba_blender(BlendMode blendmode, const bool newBlend)
     case BlendMode::RED_TINT:       return rgba_blender_red_tint;
     case BlendMode::BLUE_TINT:      return rgba_blender_blue_tint;
     case BlendMode::DST_OVER:       return rgba_blender_normal_dst_over;
+    case BlendMode::NORMAL_PREMUL:  return rgba_blender_normal_premul;
 
     case BlendMode::NORMAL:         return rgba_blender_normal;
     case BlendMode::MULTIPLY:       return newBlend? rgba_blender_multiply_n: rgba_blender_multiply;
@@ -800,6 +838,7 @@ BlendFunc get_graya_blender(BlendMode blendmode, const bool newBlend)
     case BlendMode::RED_TINT:       return graya_blender_normal;
     case BlendMode::BLUE_TINT:      return graya_blender_normal;
     case BlendMode::DST_OVER:       return graya_blender_normal_dst_over;
+    case BlendMode::NORMAL_PREMUL:  return graya_blender_normal;
 
     case BlendMode::NORMAL:         return graya_blender_normal;
     case BlendMode::MULTIPLY:       return newBlend? graya_blender_multiply_n: graya_blender_multiply;
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (c) 2001-2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -23,6 +23,13 @@ namespace doc {
   color_t rgba_blender_blue_tint(color_t backdrop, color_t src, int opacity);
   color_t rgba_blender_normal(color_t backdrop, color_t src, int opacity = 255);
   color_t rgba_blender_normal_dst_over(color_t backdrop, color_t src, int opacity);
+
+  // Premultiplied alpha: the backdrop and the result of
+  // rgba_blender_normal_premul() have premultiplied RGB components
+  // (the source color is straight alpha as in the other blenders).
+  color_t rgba_premultiply(color_t c);
+  color_t rgba_unpremultiply(color_t c);
+  color_t rgba_blender_normal_premul(color_t backdrop, color_t src, int opacity);
   color_t rgba_blender_multiply(color_t backdrop, color_t src, int opacity);
   color_t rgba_blender_screen(color_t backdrop, color_t src, int opacity);
   color_t rgba_blender_overlay(color_t backdrop, color_t src, int opacity);
@@ -65,7 +72,30 @@ namespace doc {
   color_t indexed_blender_src(color_t dst, color_t src, int opacity);
 
   BlendFunc get_rgba_blender(BlendMode blendmode, const bool newBlend);
+
+  // Blends "n" contiguous RGBA pixels from "src" to "dst". It's like
+  // calling get_rgba_blender(blendMode, newBlend) for each pixel
+  // (skipping "src" pixels equal to "maskColor"), but the most common
+  // blend modes are vectorized using SSE2/NEON instructions.
+  void rgba_blend_span(color_t* dst,
+                       const color_t* src,
+                       const int n,
+                       const int opacity,
+                       const BlendMode blendMode,
+                       const bool newBlend,
+                       const color_t maskColor = 0);
+
   BlendFunc get_graya_blender(BlendMode blendmode, const bool newBlend);
+
+  // Same as rgba_blend_span() for "n" grayscale pixels. Only the
+  // normal and merge modes are vectorized.
+  void graya_blend_span(uint16_t* dst,
+                        const uint16_t* src,
+                        int n,
+                        const int opacity,
+                        const BlendMode blendMode,
+                        const bool newBlend,
+                        const color_t maskColor = 0);
   BlendFunc get_indexed_blender(BlendMode blendmode, const bool newBlend);
 
 } // namespace doc
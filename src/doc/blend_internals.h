@@ -22,6 +22,8 @@
 #include "doc/image_traits.h"
 #include "doc/palette.h"
 
+#include <algorithm>
+
 namespace doc {
 
   template<class DstTraits, class SrcTraits>
@@ -79,10 +81,13 @@ namespace doc {
 
   template<>
   class BlenderHelper<RgbTraits, IndexedTraits> {
-    const Palette* m_pal;
     BlendMode m_blendMode;
     BlendFunc m_blendFunc;
     color_t m_maskColor;
+    bool m_normal;
+    // Palette entries converted to RGBA for each possible index (out
+    // of range indexes are transparent as in Palette::getEntry())
+    color_t m_lut[256];
   public:
     BlenderHelper(Image* dst, const Image* src, const Palette* pal,
                   const BlendMode blendMode, const bool newBlend)
@@ -90,7 +95,12 @@ namespace doc {
       m_blendMode = blendMode;
       m_blendFunc = RgbTraits::get_blender(blendMode, newBlend);
       m_maskColor = src->maskColor();
-      m_pal = pal;
+      m_normal = (blendMode == BlendMode::NORMAL);
+
+      const int n = std::min(pal->size(), 256);
+      for (int i=0; i<n; ++i)
+        m_lut[i] = pal->getEntry(i);
+      std::fill(m_lut+n, m_lut+256, 0);
     }
 
     inline RgbTraits::pixel_t
@@ -99,15 +109,25 @@ namespace doc {
                int opacity)
     {
       if (m_blendMode == BlendMode::SRC) {
-        return m_pal->getEntry(src);
+        return m_lut[src];
       }
-      else {
-        if (src != m_maskColor) {
-          return (*m_blendFunc)(dst, m_pal->getEntry(src), opacity);
-        }
-        else
-          return dst;
+      else if (src == m_maskColor) {
+        return dst;
+      }
+
+      const color_t c = m_lut[src];
+
+      // Fully opaque or fully transparent palette entries with the
+      // Normal mode at full opacity give the same result as
+      // rgba_blender_normal() without doing the whole blend.
+      if (m_normal && opacity == 255) {
+        const color_t a = (c & rgba_a_mask);
+        if (a == rgba_a_mask)
+          return c;
+        else if (a == 0)
+          return ((dst & rgba_a_mask) ? dst: c);
       }
+      return (*m_blendFunc)(dst, c, opacity);
     }
   };
 
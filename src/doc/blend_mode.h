@@ -1,4 +1,5 @@
 // Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
 // Copyright (c) 2001-2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -21,6 +22,7 @@ namespace doc {
     RED_TINT        = -5,
     BLUE_TINT       = -6,
     DST_OVER        = -7,
+    NORMAL_PREMUL   = -8,       // Normal over a premultiplied backdrop
 
     // Aseprite (.ase files) blend modes
     NORMAL          = 0,
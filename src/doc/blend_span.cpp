@@ -0,0 +1,466 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/blend_funcs.h"
+
+#include "base/debug.h"
+#include "doc/blend_internals.h"
+#include "doc/simd.h"
+
+#include <algorithm>
+
+namespace doc {
+
+#if defined(DOC_SIMD_SSE2) || defined(DOC_SIMD_NEON)
+
+namespace {
+
+//////////////////////////////////////////////////////////////////////
+// 4 x int32 vector operations (SSE2 or NEON)
+
+#if DOC_SIMD_SSE2
+
+using vec = __m128i;
+
+inline vec load(const color_t* p) { return _mm_loadu_si128((const __m128i*)p); }
+inline void store(color_t* p, const vec v) { _mm_storeu_si128((__m128i*)p, v); }
+inline vec set1(const int v) { return _mm_set1_epi32(v); }
+inline vec v_and(const vec a, const vec b) { return _mm_and_si128(a, b); }
+inline vec v_or(const vec a, const vec b) { return _mm_or_si128(a, b); }
+inline vec add(const vec a, const vec b) { return _mm_add_epi32(a, b); }
+inline vec sub(const vec a, const vec b) { return _mm_sub_epi32(a, b); }
+template<int N> inline vec shl(const vec a) { return _mm_slli_epi32(a, N); }
+template<int N> inline vec shr(const vec a) { return _mm_srli_epi32(a, N); }
+template<int N> inline vec sar(const vec a) { return _mm_srai_epi32(a, N); }
+inline vec eq(const vec a, const vec b) { return _mm_cmpeq_epi32(a, b); }
+inline vec lt(const vec a, const vec b) { return _mm_cmplt_epi32(a, b); }
+inline vec select(const vec mask, const vec a, const vec b) {
+  return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+inline bool all_ones(const vec mask) { return _mm_movemask_epi8(mask) == 0xffff; }
+
+// Multiplies two vectors of integers. SSE2 doesn't have a 32-bit
+// multiplication, but as |a*b| < 2^24 (8-bit components), the
+// float product is exact.
+inline vec mul(const vec a, const vec b) {
+  return _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(a), _mm_cvtepi32_ps(b)));
+}
+
+// Multiplies two vectors of non-negative 8-bit values using 16-bit
+// integer multiplications (the product fits in the low 16 bits of
+// each lane and the high 16 bits are zero).
+inline vec mul_u8(const vec a, const vec b) {
+  return _mm_mullo_epi16(a, b);
+}
+
+// Integer division truncating towards zero like C++ does. The float
+// quotient of two integers (|a| < 2^24, 0 < b < 256) is never
+// rounded to the next integer, so truncating it gives the exact
+// result.
+inline vec div(const vec a, const vec b) {
+  return _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(a), _mm_cvtepi32_ps(b)));
+}
+
+#elif DOC_SIMD_NEON
+
+using vec = int32x4_t;
+
+inline vec load(const color_t* p) { return vreinterpretq_s32_u32(vld1q_u32(p)); }
+inline void store(color_t* p, const vec v) { vst1q_u32(p, vreinterpretq_u32_s32(v)); }
+inline vec set1(const int v) { return vdupq_n_s32(v); }
+inline vec v_and(const vec a, const vec b) { return vandq_s32(a, b); }
+inline vec v_or(const vec a, const vec b) { return vorrq_s32(a, b); }
+inline vec add(const vec a, const vec b) { return vaddq_s32(a, b); }
+inline vec sub(const vec a, const vec b) { return vsubq_s32(a, b); }
+template<int N> inline vec shl(const vec a) { return vshlq_n_s32(a, N); }
+template<int N> inline vec shr(const vec a) {
+  return vreinterpretq_s32_u32(vshrq_n_u32(vreinterpretq_u32_s32(a), N));
+}
+template<int N> inline vec sar(const vec a) { return vshrq_n_s32(a, N); }
+inline vec eq(const vec a, const vec b) { return vreinterpretq_s32_u32(vceqq_s32(a, b)); }
+inline vec lt(const vec a, const vec b) { return vreinterpretq_s32_u32(vcltq_s32(a, b)); }
+inline vec select(const vec mask, const vec a, const vec b) {
+  return vbslq_s32(vreinterpretq_u32_s32(mask), a, b);
+}
+inline bool all_ones(const vec mask) {
+  return vminvq_u32(vreinterpretq_u32_s32(mask)) == 0xffffffff;
+}
+inline vec mul(const vec a, const vec b) { return vmulq_s32(a, b); }
+inline vec mul_u8(const vec a, const vec b) { return vmulq_s32(a, b); }
+inline vec div(const vec a, const vec b) {
+  return vcvtq_s32_f32(vdivq_f32(vcvtq_f32_s32(a), vcvtq_f32_s32(b)));
+}
+
+#endif
+
+inline vec min(const vec a, const vec b) { return select(lt(a, b), a, b); }
+inline vec max(const vec a, const vec b) { return select(lt(a, b), b, a); }
+
+// Same as MUL_UN8() macro (including the rounding for negative
+// values, as "t" is a signed int in the scalar version)
+inline vec mul_un8(const vec a, const vec b) {
+  const vec t = add(mul(a, b), set1(ONE_HALF));
+  return sar<8>(add(sar<8>(t), t));
+}
+
+// MUL_UN8() for non-negative values (0-255) in fixed-point
+inline vec mul_un8_u(const vec a, const vec b) {
+  const vec t = add(mul_u8(a, b), set1(ONE_HALF));
+  return shr<8>(add(shr<8>(t), t));
+}
+
+// Layer/cel opacity applied to the source alpha. The Opaque case
+// compiles out the multiplication (MUL_UN8(a, 255) == a).
+struct Opaque {
+  vec apply(const vec a) const { return a; }
+  vec value() const { return set1(255); }
+};
+
+struct Translucent {
+  vec opacity;
+  explicit Translucent(const int opacity) : opacity(set1(opacity)) { }
+  vec apply(const vec a) const { return mul_un8_u(a, opacity); }
+  vec value() const { return opacity; }
+};
+
+// Four RGBA pixels with a separated vector for each component
+struct Pixels {
+  vec r, g, b, a;
+
+  Pixels() { }
+  Pixels(const vec r, const vec g, const vec b, const vec a)
+    : r(r), g(g), b(b), a(a) { }
+  explicit Pixels(const vec c) {
+    const vec m = set1(0xff);
+    r = v_and(c, m);                       // rgba_r_shift == 0
+    g = v_and(shr<rgba_g_shift>(c), m);
+    b = v_and(shr<rgba_b_shift>(c), m);
+    a = shr<rgba_a_shift>(c);
+  }
+
+  vec pack() const {
+    return v_or(v_or(shl<rgba_r_shift>(r),
+                     shl<rgba_g_shift>(g)),
+                v_or(shl<rgba_b_shift>(b),
+                     shl<rgba_a_shift>(a)));
+  }
+};
+
+inline Pixels select(const vec mask, const Pixels& a, const Pixels& b) {
+  return Pixels(select(mask, a.r, b.r),
+                select(mask, a.g, b.g),
+                select(mask, a.b, b.b),
+                select(mask, a.a, b.a));
+}
+
+// Vectorized version of rgba_blender_normal()
+template<typename Opacity>
+inline Pixels normal(const Pixels& B, const Pixels& S, const Opacity& opacity)
+{
+  const vec zero = set1(0);
+  const vec Sa = opacity.apply(S.a);
+  const vec Ra = sub(add(Sa, B.a), mul_un8(B.a, Sa));
+
+  Pixels R(add(B.r, div(mul(sub(S.r, B.r), Sa), Ra)),
+           add(B.g, div(mul(sub(S.g, B.g), Sa), Ra)),
+           add(B.b, div(mul(sub(S.b, B.b), Sa), Ra)),
+           Ra);
+
+  R = select(eq(S.a, zero), B, R);
+  return select(eq(B.a, zero), Pixels(S.r, S.g, S.b, Sa), R);
+}
+
+// Vectorized version of rgba_blender_merge()
+inline Pixels merge(const Pixels& B, const Pixels& S, const vec opacity)
+{
+  const vec zero = set1(0);
+  const vec Ra = add(B.a, mul_un8(sub(S.a, B.a), opacity));
+
+  Pixels R(add(B.r, mul_un8(sub(S.r, B.r), opacity)),
+           add(B.g, mul_un8(sub(S.g, B.g), opacity)),
+           add(B.b, mul_un8(sub(S.b, B.b), opacity)),
+           Ra);
+
+  R = select(eq(S.a, zero), Pixels(B.r, B.g, B.b, Ra), R);
+  R = select(eq(B.a, zero), Pixels(S.r, S.g, S.b, Ra), R);
+  return select(eq(Ra, zero), Pixels(zero, zero, zero, Ra), R);
+}
+
+// Separable blend modes (the same formulas used in blend_funcs.cpp)
+struct Multiply {
+  static vec blend(const vec b, const vec s) { return mul_un8(b, s); }
+};
+
+struct Screen {
+  static vec blend(const vec b, const vec s) { return sub(add(b, s), mul_un8(b, s)); }
+};
+
+struct Overlay {
+  static vec blend(const vec b, const vec s) {
+    const vec b2 = shl<1>(b);
+    return select(lt(b, set1(128)),
+                  mul_un8(s, b2),
+                  Screen::blend(s, sub(b2, set1(255))));
+  }
+};
+
+struct Darken {
+  static vec blend(const vec b, const vec s) { return min(b, s); }
+};
+
+struct Lighten {
+  static vec blend(const vec b, const vec s) { return max(b, s); }
+};
+
+struct Addition {
+  static vec blend(const vec b, const vec s) { return min(add(b, s), set1(255)); }
+};
+
+struct Subtract {
+  static vec blend(const vec b, const vec s) { return max(sub(b, s), set1(0)); }
+};
+
+// Vectorized version of rgba_blender_*() functions (old blend method)
+template<typename Mode, typename Opacity>
+inline Pixels separable(const Pixels& B, const Pixels& S, const Opacity& opacity)
+{
+  return normal(B, Pixels(Mode::blend(B.r, S.r),
+                          Mode::blend(B.g, S.g),
+                          Mode::blend(B.b, S.b),
+                          S.a), opacity);
+}
+
+// Vectorized version of rgba_blender_*_n() functions (new blend
+// method, see RGBA_BLENDER_N macro)
+template<typename Mode, typename Opacity>
+inline Pixels separable_n(const Pixels& B, const Pixels& S, const Opacity& opacity)
+{
+  const Pixels normalPx = normal(B, S, opacity);
+  const Pixels blendPx = separable<Mode>(B, S, opacity);
+  const Pixels normalToBlendMerge = merge(normalPx, blendPx, B.a);
+  const vec compositeAlpha = mul_un8_u(B.a, opacity.apply(S.a));
+  return select(eq(B.a, set1(0)),
+                normalPx,
+                merge(normalToBlendMerge, blendPx, compositeAlpha));
+}
+
+// Vectorized version of rgba_blender_normal_premul()
+template<typename Opacity>
+inline Pixels normal_premul(const Pixels& B, const Pixels& S, const Opacity& opacity)
+{
+  const vec Sa = opacity.apply(S.a);
+  const vec Ba = sub(set1(255), Sa);
+  return Pixels(add(mul_un8(S.r, Sa), mul_un8(B.r, Ba)),
+                add(mul_un8(S.g, Sa), mul_un8(B.g, Ba)),
+                add(mul_un8(S.b, Sa), mul_un8(B.b, Ba)),
+                add(Sa, mul_un8(B.a, Ba)));
+}
+
+struct NormalKernel {
+  template<typename Opacity>
+  static Pixels blend(const Pixels& B, const Pixels& S, const Opacity& opacity) {
+    return normal(B, S, opacity);
+  }
+};
+
+struct MergeKernel {
+  template<typename Opacity>
+  static Pixels blend(const Pixels& B, const Pixels& S, const Opacity& opacity) {
+    return merge(B, S, opacity.value());
+  }
+};
+
+struct NormalPremulKernel {
+  template<typename Opacity>
+  static Pixels blend(const Pixels& B, const Pixels& S, const Opacity& opacity) {
+    return normal_premul(B, S, opacity);
+  }
+};
+
+template<typename Mode>
+struct SeparableKernel {
+  template<typename Opacity>
+  static Pixels blend(const Pixels& B, const Pixels& S, const Opacity& opacity) {
+    return separable<Mode>(B, S, opacity);
+  }
+};
+
+template<typename Mode>
+struct SeparableKernelN {
+  template<typename Opacity>
+  static Pixels blend(const Pixels& B, const Pixels& S, const Opacity& opacity) {
+    return separable_n<Mode>(B, S, opacity);
+  }
+};
+
+// Blends 4 pixels at a time, the rest of the span (n % 4) is blended
+// with the scalar version of the blender.
+template<typename Kernel, typename Opacity>
+void blend_span_loop(color_t*& dst,
+                     const color_t*& src,
+                     int& n,
+                     const Opacity& opacityOp,
+                     const color_t maskColor)
+{
+  const vec maskVec = set1(int(maskColor));
+
+  for (; n >= 4; n-=4, dst+=4, src+=4) {
+    const vec s = load(src);
+    const vec isMask = eq(s, maskVec);
+    if (all_ones(isMask))
+      continue;
+
+    const vec d = load(dst);
+    const vec r = Kernel::blend(Pixels(d), Pixels(s), opacityOp).pack();
+    store(dst, select(isMask, d, r));
+  }
+}
+
+template<typename Kernel>
+void blend_span_templ(color_t* dst,
+                      const color_t* src,
+                      int n,
+                      const int opacity,
+                      const color_t maskColor,
+                      const BlendFunc scalarFunc)
+{
+  // Layers/cels with full opacity (the most common case) don't need
+  // to multiply the source alpha by the opacity
+  if (opacity == 255)
+    blend_span_loop<Kernel>(dst, src, n, Opaque(), maskColor);
+  else
+    blend_span_loop<Kernel>(dst, src, n, Translucent(opacity), maskColor);
+
+  for (; n > 0; --n, ++dst, ++src) {
+    if (*src != maskColor)
+      *dst = (*scalarFunc)(*dst, *src, opacity);
+  }
+}
+
+} // anonymous namespace
+
+#endif // DOC_SIMD_SSE2 || DOC_SIMD_NEON
+
+void rgba_blend_span(color_t* dst,
+                     const color_t* src,
+                     const int n,
+                     const int opacity,
+                     const BlendMode blendMode,
+                     const bool newBlend,
+                     const color_t maskColor)
+{
+  ASSERT(n >= 0);
+  ASSERT(n == 0 || (dst && src));
+
+  const BlendFunc func = get_rgba_blender(blendMode, newBlend);
+
+#if defined(DOC_SIMD_SSE2) || defined(DOC_SIMD_NEON)
+  switch (blendMode) {
+    case BlendMode::NORMAL:
+      blend_span_templ<NormalKernel>(dst, src, n, opacity, maskColor, func);
+      return;
+    case BlendMode::MERGE:
+      blend_span_templ<MergeKernel>(dst, src, n, opacity, maskColor, func);
+      return;
+    case BlendMode::NORMAL_PREMUL:
+      blend_span_templ<NormalPremulKernel>(dst, src, n, opacity, maskColor, func);
+      return;
+    case BlendMode::MULTIPLY:
+      if (newBlend) blend_span_templ<SeparableKernelN<Multiply>>(dst, src, n, opacity, maskColor, func);
+      else          blend_span_templ<SeparableKernel<Multiply>>(dst, src, n, opacity, maskColor, func);
+      return;
+    case BlendMode::SCREEN:
+      if (newBlend) blend_span_templ<SeparableKernelN<Screen>>(dst, src, n, opacity, maskColor, func);
+      else          blend_span_templ<SeparableKernel<Screen>>(dst, src, n, opacity, maskColor, func);
+      return;
+    case BlendMode::OVERLAY:
+      if (newBlend) blend_span_templ<SeparableKernelN<Overlay>>(dst, src, n, opacity, maskColor, func);
+      else          blend_span_templ<SeparableKernel<Overlay>>(dst, src, n, opacity, maskColor, func);
+      return;
+    case BlendMode::DARKEN:
+      if (newBlend) blend_span_templ<SeparableKernelN<Darken>>(dst, src, n, opacity, maskColor, func);
+      else          blend_span_templ<SeparableKernel<Darken>>(dst, src, n, opacity, maskColor, func);
+      return;
+    case BlendMode::LIGHTEN:
+      if (newBlend) blend_span_templ<SeparableKernelN<Lighten>>(dst, src, n, opacity, maskColor, func);
+      else          blend_span_templ<SeparableKernel<Lighten>>(dst, src, n, opacity, maskColor, func);
+      return;
+    case BlendMode::ADDITION:
+      if (newBlend) blend_span_templ<SeparableKernelN<Addition>>(dst, src, n, opacity, maskColor, func);
+      else          blend_span_templ<SeparableKernel<Addition>>(dst, src, n, opacity, maskColor, func);
+      return;
+    case BlendMode::SUBTRACT:
+      if (newBlend) blend_span_templ<SeparableKernelN<Subtract>>(dst, src, n, opacity, maskColor, func);
+      else          blend_span_templ<SeparableKernel<Subtract>>(dst, src, n, opacity, maskColor, func);
+      return;
+    default:
+      break;
+  }
+#endif
+
+  // Generic version (one BlendFunc call for each pixel)
+  for (int i=0; i<n; ++i, ++dst, ++src) {
+    if (*src != maskColor)
+      *dst = (*func)(*dst, *src, opacity);
+  }
+}
+
+void graya_blend_span(uint16_t* dst,
+                      const uint16_t* src,
+                      int n,
+                      const int opacity,
+                      const BlendMode blendMode,
+                      const bool newBlend,
+                      const color_t maskColor)
+{
+  ASSERT(n >= 0);
+  ASSERT(n == 0 || (dst && src));
+
+#if defined(DOC_SIMD_SSE2) || defined(DOC_SIMD_NEON)
+  // The grayscale normal/merge blenders use the same formulas as
+  // the RGBA ones for each channel, so we can convert gray pixels to
+  // RGBA (r=g=b=v) and use the vectorized RGBA version.
+  if (blendMode == BlendMode::NORMAL ||
+      blendMode == BlendMode::MERGE) {
+    const int kChunk = 64;
+    color_t d[kChunk], s[kChunk];
+
+    // The mask color as RGBA (r != g when it isn't a gray color, so
+    // no pixel of "src" will match it).
+    const color_t rgbaMaskColor =
+      (maskColor <= 0xffff ? rgba(graya_getv(maskColor),
+                                  graya_getv(maskColor),
+                                  graya_getv(maskColor),
+                                  graya_geta(maskColor)):
+                             rgba(0, 1, 0, 0));
+
+    for (; n > 0; n-=kChunk, dst+=kChunk, src+=kChunk) {
+      const int m = std::min(n, kChunk);
+      for (int i=0; i<m; ++i) {
+        d[i] = rgba(graya_getv(dst[i]), graya_getv(dst[i]), graya_getv(dst[i]), graya_geta(dst[i]));
+        s[i] = rgba(graya_getv(src[i]), graya_getv(src[i]), graya_getv(src[i]), graya_geta(src[i]));
+      }
+      rgba_blend_span(d, s, m, opacity, blendMode, newBlend, rgbaMaskColor);
+      for (int i=0; i<m; ++i)
+        dst[i] = graya(rgba_getr(d[i]), rgba_geta(d[i]));
+    }
+    return;
+  }
+#endif
+
+  // Generic version (one BlendFunc call for each pixel)
+  const BlendFunc func = get_graya_blender(blendMode, newBlend);
+  for (int i=0; i<n; ++i, ++dst, ++src) {
+    if (*src != maskColor)
+      *dst = (*func)(*dst, *src, opacity);
+  }
+}
+
+} // namespace doc
@@ -0,0 +1,109 @@
+// Aseprite Document Library
+// Copyright (c) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/blend_funcs.h"
+
+#include <random>
+#include <vector>
+
+using namespace doc;
+
+// rgba_blend_span() must give exactly the same result as the
+// per-pixel blenders.
+TEST(BlendSpan, MatchPerPixelBlenders)
+{
+  const BlendMode modes[] = {
+    BlendMode::NORMAL, BlendMode::MULTIPLY, BlendMode::SCREEN,
+    BlendMode::OVERLAY, BlendMode::DARKEN, BlendMode::LIGHTEN,
+    BlendMode::ADDITION, BlendMode::SUBTRACT, BlendMode::DIFFERENCE,
+    BlendMode::NORMAL_PREMUL, BlendMode::MERGE
+  };
+
+  std::mt19937 rng(1);
+  for (const BlendMode mode : modes) {
+    for (const bool newBlend : { false, true }) {
+      const BlendFunc func = get_rgba_blender(mode, newBlend);
+
+      for (int i=0; i<500; ++i) {
+        const int n = rng() % 37;
+        const int opacity = (i % 5 == 0 ? 255: rng() % 256);
+        std::vector<color_t> dst(n), src(n);
+        for (int j=0; j<n; ++j) {
+          dst[j] = rng();
+          src[j] = rng();
+          switch (rng() % 5) {
+            case 0: src[j] = 0; break;                      // Mask color
+            case 1: src[j] &= rgba_rgb_mask; break;         // Transparent
+            case 2: dst[j] &= rgba_rgb_mask; break;
+            case 3: src[j] |= rgba_a_mask; break;           // Opaque
+          }
+        }
+
+        std::vector<color_t> expected = dst;
+        for (int j=0; j<n; ++j)
+          if (src[j] != 0)
+            expected[j] = func(expected[j], src[j], opacity);
+
+        rgba_blend_span(dst.data(), src.data(), n, opacity, mode, newBlend);
+        EXPECT_EQ(expected, dst)
+          << " mode=" << int(mode) << " newBlend=" << newBlend
+          << " opacity=" << opacity;
+      }
+    }
+  }
+}
+
+// graya_blend_span() must give exactly the same result as the
+// per-pixel grayscale blenders.
+TEST(BlendSpan, MatchPerPixelGrayBlenders)
+{
+  const BlendMode modes[] = {
+    BlendMode::NORMAL, BlendMode::MERGE, BlendMode::MULTIPLY
+  };
+
+  std::mt19937 rng(2);
+  for (const BlendMode mode : modes) {
+    const BlendFunc func = get_graya_blender(mode, true);
+
+    for (int i=0; i<500; ++i) {
+      const int n = rng() % 150;
+      const int opacity = (i % 5 == 0 ? 255: rng() % 256);
+      const color_t maskColor = (i % 3 == 0 ? 0x10000: rng() & 0xffff);
+      std::vector<uint16_t> dst(n), src(n);
+      for (int j=0; j<n; ++j) {
+        dst[j] = rng();
+        src[j] = rng();
+        switch (rng() % 5) {
+          case 0: src[j] = maskColor; break;
+          case 1: src[j] &= graya_v_mask; break;        // Transparent
+          case 2: dst[j] &= graya_v_mask; break;
+          case 3: src[j] |= graya_a_mask; break;        // Opaque
+        }
+      }
+
+      std::vector<uint16_t> expected = dst;
+      for (int j=0; j<n; ++j)
+        if (src[j] != maskColor)
+          expected[j] = func(expected[j], src[j], opacity);
+
+      graya_blend_span(dst.data(), src.data(), n, opacity, mode, true, maskColor);
+      EXPECT_EQ(expected, dst)
+        << " mode=" << int(mode) << " opacity=" << opacity;
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2023 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -172,6 +172,12 @@ Grid Cel::grid() const
 
 void Cel::fixupImage()
 {
+  // Images loaded on demand must be created with the correct mask
+  // color/bounds by their CelData::ImageLoader, we don't want to load
+  // them just to fix them up here.
+  if (!m_data->isImageLoaded())
+    return;
+
   // Change the mask color to the sprite mask color
   if (m_layer && image()) {
     image()->setMaskColor((image()->pixelFormat() == IMAGE_TILEMAP) ?
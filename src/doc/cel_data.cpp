@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2022 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -12,14 +12,76 @@
 #include "doc/cel_data.h"
 
 #include "doc/image.h"
+#include "doc/image_impl.h"
 #include "doc/layer.h"
 #include "doc/layer_tilemap.h"
+#include "doc/primitives_fast.h"
 #include "doc/sprite.h"
 #include "doc/tileset.h"
 #include "gfx/rect.h"
 
+#include <algorithm>
+#include <atomic>
+
 namespace doc {
 
+namespace {
+
+// Unlike algorithm::shrink_bounds(), this compares the exact value of
+// each pixel with the mask color (and not just the alpha), so culled
+// pixels are the ones that doc blenders leave untouched.
+template<typename ImageTraits>
+gfx::Rect calc_content_bounds_templ(const Image* image)
+{
+  const auto mask = typename ImageTraits::pixel_t(image->maskColor());
+  const int w = image->width();
+  const int h = image->height();
+  int x1 = w, y1 = h, x2 = -1, y2 = -1;
+
+  for (int y=0; y<h; ++y) {
+    auto row = get_pixel_address_fast<ImageTraits>(image, 0, y);
+    int u = 0;
+    while (u < w && row[u] == mask)
+      ++u;
+    if (u == w)
+      continue;
+
+    int v = w-1;
+    while (v > u && row[v] == mask)
+      --v;
+
+    x1 = std::min(x1, u);
+    x2 = std::max(x2, v);
+    if (y1 == h)
+      y1 = y;
+    y2 = y;
+  }
+
+  if (x2 < 0)
+    return gfx::Rect();
+  return gfx::Rect(x1, y1, x2-x1+1, y2-y1+1);
+}
+
+gfx::Rect calc_content_bounds(const Image* image)
+{
+  switch (image->pixelFormat()) {
+    case IMAGE_RGB:       return calc_content_bounds_templ<RgbTraits>(image);
+    case IMAGE_GRAYSCALE: return calc_content_bounds_templ<GrayscaleTraits>(image);
+    case IMAGE_INDEXED:   return calc_content_bounds_templ<IndexedTraits>(image);
+  }
+  return image->bounds();
+}
+
+} // anonymous namespace
+
+struct CelData::LazyImage {
+  std::once_flag once;
+  std::atomic<bool> loaded { false };
+  ImageLoader loader;
+
+  LazyImage(const ImageLoader& loader) : loader(loader) { }
+};
+
 CelData::CelData(const ImageRef& image)
   : WithUserData(ObjectType::CelData)
   , m_image(image)
@@ -31,9 +93,19 @@ CelData::CelData(const ImageRef& image)
 {
 }
 
+CelData::CelData(const gfx::Size& imageSize, const ImageLoader& loader)
+  : WithUserData(ObjectType::CelData)
+  , m_opacity(255)
+  , m_bounds(0, 0, imageSize.w, imageSize.h)
+  , m_boundsF(nullptr)
+  , m_lazyImage(std::make_unique<LazyImage>(loader))
+{
+  ASSERT(loader);
+}
+
 CelData::CelData(const CelData& celData)
   : WithUserData(ObjectType::CelData)
-  , m_image(celData.m_image)
+  , m_image(celData.imageRef())
   , m_opacity(celData.m_opacity)
   , m_bounds(celData.m_bounds)
   , m_boundsF(celData.m_boundsF ? std::make_unique<gfx::RectF>(*celData.m_boundsF):
@@ -45,11 +117,63 @@ CelData::~CelData()
 {
 }
 
+bool CelData::isImageLoaded() const
+{
+  return (!m_lazyImage || m_lazyImage->loaded);
+}
+
+int CelData::getMemSize() const
+{
+  int size = sizeof(CelData);
+  if (isImageLoaded()) {
+    ASSERT(m_image);
+    size += m_image->getMemSize();
+  }
+  return size;
+}
+
+void CelData::loadLazyImage() const
+{
+  ASSERT(m_lazyImage);
+
+  // Several threads can access the image at the same time (e.g. when
+  // the sprite is rendered in parallel), so only the first one calls
+  // the loader and the others wait for it.
+  std::call_once(
+    m_lazyImage->once,
+    [this]{
+      ImageRef image = m_lazyImage->loader();
+      ASSERT(image);
+      m_image = image;
+      m_lazyImage->loader = nullptr;  // Release the loader data
+      m_lazyImage->loaded = true;
+    });
+}
+
+gfx::Rect CelData::contentBounds() const
+{
+  loadImage();
+  ASSERT(m_image);
+  if (m_image->pixelFormat() == IMAGE_TILEMAP)
+    return m_image->bounds();
+
+  const std::lock_guard lock(m_contentMutex);
+  const ObjectId imageId = m_image->id();
+  if (m_contentImageId != imageId ||
+      m_contentImageVersion != m_image->version()) {
+    m_contentBounds = calc_content_bounds(m_image.get());
+    m_contentImageId = imageId;
+    m_contentImageVersion = m_image->version();
+  }
+  return m_contentBounds;
+}
+
 void CelData::setImage(const ImageRef& image, Layer* layer)
 {
   ASSERT(image.get());
 
   m_image = image;
+  m_lazyImage.reset();
   adjustBounds(layer);
 }
 
@@ -62,6 +186,7 @@ void CelData::setPosition(const gfx::Point& pos)
 
 void CelData::adjustBounds(Layer* layer)
 {
+  loadImage();
   ASSERT(m_image);
   if (m_image->pixelFormat() == IMAGE_TILEMAP) {
     Tileset* tileset = nullptr;
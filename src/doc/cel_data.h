@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -11,10 +11,15 @@
 
 #include "doc/image_ref.h"
 #include "doc/object.h"
+#include "doc/object_id.h"
+#include "doc/object_version.h"
 #include "doc/with_user_data.h"
 #include "gfx/rect.h"
+#include "gfx/size.h"
 
+#include <functional>
 #include <memory>
+#include <mutex>
 
 namespace doc {
 
@@ -23,27 +28,46 @@ namespace doc {
 
   class CelData : public WithUserData {
   public:
+    // Function to create the image of the cel on demand (e.g. to
+    // decode the pixels from a file the first time the image is
+    // accessed).
+    using ImageLoader = std::function<ImageRef()>;
+
     CelData(const ImageRef& image);
+    CelData(const gfx::Size& imageSize, const ImageLoader& loader);
     CelData(const CelData& celData);
     ~CelData();
 
     gfx::Point position() const { return m_bounds.origin(); }
     const gfx::Rect& bounds() const { return m_bounds; }
     int opacity() const { return m_opacity; }
-    Image* image() const { return const_cast<Image*>(m_image.get()); };
-    ImageRef imageRef() const { return m_image; }
+    Image* image() const { loadImage(); return const_cast<Image*>(m_image.get()); };
+    ImageRef imageRef() const { loadImage(); return m_image; }
+
+    // Returns false if the image was created with an ImageLoader
+    // which wasn't called yet.
+    bool isImageLoaded() const;
 
     // Returns a rectangle with the bounds of the image (width/height
     // of the image) in the position of the cel (useful to compare
     // active tilemap bounds when we have to change the tilemap cel
     // bounds).
     gfx::Rect imageBounds() const {
+      const Image* image = this->image();
       return gfx::Rect(m_bounds.x,
                        m_bounds.y,
-                       m_image->width(),
-                       m_image->height());
+                       image->width(),
+                       image->height());
     }
 
+    // Returns the bounds of the pixels that are different from the
+    // mask color (relative to the image origin, not to the cel
+    // position), or an empty rectangle if the whole image is
+    // transparent. The result is calculated lazily and cached until
+    // the image (or its version) changes. Tilemaps and bitmaps are
+    // not shrunk (their full bounds are returned).
+    gfx::Rect contentBounds() const;
+
     void setImage(const ImageRef& image, Layer* layer);
     void setPosition(const gfx::Point& pos);
 
@@ -80,21 +104,38 @@ namespace doc {
       return m_boundsF != nullptr;
     }
 
-    virtual int getMemSize() const override {
-      ASSERT(m_image);
-      return sizeof(CelData) + m_image->getMemSize();
-    }
+    // Doesn't load the image (it counts only loaded images).
+    virtual int getMemSize() const override;
 
     void adjustBounds(Layer* layer);
 
   private:
-    ImageRef m_image;
+    struct LazyImage;
+
+    void loadImage() const {
+      if (m_lazyImage)
+        loadLazyImage();
+    }
+    void loadLazyImage() const;
+
+    mutable ImageRef m_image;
+
+    // Non-nullptr if the image is created on demand by an
+    // ImageLoader (m_image is nullptr until the loader is called).
+    std::unique_ptr<LazyImage> m_lazyImage;
+
     int m_opacity;
     gfx::Rect m_bounds;
 
     // Special bounds for reference layers that can have subpixel
     // position.
     mutable std::unique_ptr<gfx::RectF> m_boundsF;
+
+    // Cached result of contentBounds() for the given image ID/version
+    mutable std::mutex m_contentMutex;
+    mutable ObjectId m_contentImageId = NullId;
+    mutable ObjectVersion m_contentImageVersion = 0;
+    mutable gfx::Rect m_contentBounds;
   };
 
   typedef std::shared_ptr<CelData> CelDataRef;
@@ -0,0 +1,59 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/cel.h"
+#include "doc/cel_data.h"
+#include "doc/image.h"
+#include "doc/primitives.h"
+
+#include <memory>
+
+using namespace doc;
+
+TEST(CelData, ImageLoader)
+{
+  int calls = 0;
+  auto data = std::make_shared<CelData>(
+    gfx::Size(4, 3),
+    [&calls]{
+      ++calls;
+      ImageRef image(Image::create(IMAGE_RGB, 4, 3));
+      clear_image(image.get(), rgba(255, 0, 0, 255));
+      return image;
+    });
+
+  EXPECT_FALSE(data->isImageLoaded());
+  EXPECT_EQ(gfx::Rect(0, 0, 4, 3), data->bounds());
+  EXPECT_EQ(int(sizeof(CelData)), data->getMemSize());
+  EXPECT_EQ(0, calls);
+
+  Cel cel(0, data);
+  cel.setPosition(2, 1);
+  EXPECT_FALSE(data->isImageLoaded());
+  EXPECT_EQ(gfx::Rect(2, 1, 4, 3), cel.bounds());
+
+  Image* image = cel.image();
+  ASSERT_NE(nullptr, image);
+  EXPECT_TRUE(data->isImageLoaded());
+  EXPECT_EQ(1, calls);
+  EXPECT_EQ(rgba(255, 0, 0, 255), get_pixel(image, 3, 2));
+
+  // The loader is called just one time
+  EXPECT_EQ(image, cel.imageRef().get());
+  EXPECT_EQ(1, calls);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2020  Igara Studio S.A.
+// Copyright (c) 2020-2024  Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -17,6 +17,7 @@
 #include "doc/palette.h"
 
 #include <cctype>
+#include <cstdlib>
 #include <fstream>
 #include <iomanip>
 #include <memory>
@@ -72,24 +73,35 @@ std::unique_ptr<Palette> load_gpl_file(const char* filename)
       continue;
     }
 
+    // Parse "R G B [A] Name" directly from the line (creating a
+    // std::istringstream for each entry is slow for big palettes)
+    const char* p = line.c_str();
+    auto readInt = [&p](int& value) -> bool {
+      char* end;
+      const long v = std::strtol(p, &end, 10);
+      if (end == p)
+        return false;
+      value = int(v);
+      p = end;
+      return true;
+    };
+
     int r, g, b, a = 255;
-    std::string entryName;
-    std::istringstream lineIn(line);
-    lineIn >> r >> g >> b;
-    if (hasAlpha) {
-      lineIn >> a;
-    }
-    lineIn >> entryName;
+    if (!readInt(r) || !readInt(g) || !readInt(b) ||
+        (hasAlpha && !readInt(a)))
+      continue;
 
-    if (lineIn.fail())
-        continue;
+    // Each entry must have a name (only its first word is used)
+    while (std::isspace((unsigned char)*p))
+      ++p;
+    const char* nameEnd = p;
+    while (*nameEnd && !std::isspace((unsigned char)*nameEnd))
+      ++nameEnd;
+    if (nameEnd == p)
+      continue;
 
     pal->addEntry(rgba(r, g, b, a));
-    if (!entryName.empty()) {
-      base::trim_string(entryName, entryName);
-      if (!entryName.empty())
-        pal->setEntryName(pal->size()-1, entryName);
-    }
+    pal->setEntryName(pal->size()-1, std::string(p, nameEnd));
   }
 
   base::trim_string(comment, comment);
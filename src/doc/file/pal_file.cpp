@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2022 Igara Studio S.A.
+// Copyright (c) 2022-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -16,6 +16,7 @@
 #include "doc/palette.h"
 
 #include <cctype>
+#include <cstdlib>
 #include <fstream>
 #include <iomanip>
 #include <memory>
@@ -60,9 +61,24 @@ std::unique_ptr<Palette> load_pal_file(const char *filename)
     if (line.empty())
       continue;
 
+    // Parse "R G B [A]" directly from the line (without a
+    // std::istringstream for each entry)
+    const char* p = line.c_str();
+    auto readInt = [&p](int& value) -> bool {
+      char* end;
+      const long v = std::strtol(p, &end, 10);
+      if (end == p)
+        return false;
+      value = int(v);
+      p = end;
+      return true;
+    };
+
     int r, g, b, a=255;
-    std::istringstream lineIn(line);
-    lineIn >> r >> g >> b >> a;
+    if (!readInt(r) || !readInt(g) || !readInt(b))
+      continue;
+    readInt(a);
+
     pal->addEntry(rgba(r, g, b, a));
   }
 
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2018-2020 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -35,6 +35,45 @@ int Image::getMemSize() const
   return sizeof(Image) + rowBytes()*height();
 }
 
+void Image::discardCompressedData()
+{
+  m_compressedData.clear();
+  m_compressedDataVersion = 0;
+  m_compressedDataHash = 0;
+}
+
+void Image::setCompressedData(const base::buffer& buffer) const
+{
+  if (!buffer.empty())
+    setCompressedData(buffer, calculate_image_content_hash(this));
+}
+
+void Image::setCompressedData(const base::buffer& buffer,
+                              const uint64_t contentHash) const
+{
+  ASSERT(contentHash == calculate_image_content_hash(this));
+  if (!buffer.empty()) {
+    m_compressedData = buffer;
+    m_compressedDataVersion = version();
+    m_compressedDataHash = contentHash;
+  }
+}
+
+bool Image::hasValidCompressedData() const
+{
+  return (!m_compressedData.empty() &&
+          m_compressedDataVersion == version() &&
+          m_compressedDataHash == calculate_image_content_hash(this));
+}
+
+bool Image::hasValidCompressedData(const uint64_t contentHash) const
+{
+  ASSERT(contentHash == calculate_image_content_hash(this));
+  return (!m_compressedData.empty() &&
+          m_compressedDataVersion == version() &&
+          m_compressedDataHash == contentHash);
+}
+
 // static
 Image* Image::create(PixelFormat format, int width, int height,
                      const ImageBufferPtr& buffer)
@@ -60,10 +99,41 @@ Image* Image::create(const ImageSpec& spec,
   return nullptr;
 }
 
+template<typename Traits>
+static Image* create_shared_copy(const Image* image)
+{
+  auto src = static_cast<const ImageImpl<Traits>*>(image);
+  if (!src->canSharePixels())
+    return nullptr;
+
+  // Same spec that crop_image() would create (without color space)
+  return new ImageImpl<Traits>(
+    ImageSpec(image->colorMode(), image->width(), image->height(),
+              image->maskColor()),
+    src);
+}
+
 // static
 Image* Image::createCopy(const Image* image, const ImageBufferPtr& buffer)
 {
   ASSERT(image);
+
+  // If we don't need to use a specific buffer, the copy shares the
+  // pixels with the original image until one of them is modified
+  // (copy-on-write).
+  if (!buffer) {
+    Image* copy = nullptr;
+    switch (image->colorMode()) {
+      case ColorMode::RGB:       copy = create_shared_copy<RgbTraits>(image); break;
+      case ColorMode::GRAYSCALE: copy = create_shared_copy<GrayscaleTraits>(image); break;
+      case ColorMode::INDEXED:   copy = create_shared_copy<IndexedTraits>(image); break;
+      case ColorMode::BITMAP:    copy = create_shared_copy<BitmapTraits>(image); break;
+      case ColorMode::TILEMAP:   copy = create_shared_copy<TilemapTraits>(image); break;
+    }
+    if (copy)
+      return copy;
+  }
+
   return crop_image(image, 0, 0, image->width(), image->height(),
                     image->maskColor(), buffer);
 }
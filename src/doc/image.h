@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2018-2023 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -9,6 +9,7 @@
 #define DOC_IMAGE_H_INCLUDED
 #pragma once
 
+#include "base/buffer.h"
 #include "doc/color.h"
 #include "doc/color_mode.h"
 #include "doc/image_buffer.h"
@@ -70,8 +71,69 @@ namespace doc {
     // when width() < rowPixels()).
     int rowPixels() const { return m_rowBytes / bytesPerPixel(); }
 
+    // True if the pixels are stored in a sparse buffer (huge images),
+    // where areas with zeros (transparent) don't use memory until
+    // they are modified.
+    virtual bool isSparse() const = 0;
+
+    // Memory-saving mode for images that are not being used: the
+    // pixels are compressed (see doc/image_rle.h) and the buffer is
+    // released, then the pixels are decompressed on the next access.
+    //
+    // compressPixels() can be called from a background thread (while
+    // the image is not modified). releasePixels() replaces the pixels
+    // with the compressed data (e.g. from compressPixels()) and must
+    // be called when no other thread is using the image (e.g. with
+    // the sprite locked for writing). It returns false if the pixels
+    // cannot be released (buffer given by the caller, or shared with
+    // other image copies).
+    virtual void compressPixels(base::buffer& output) const = 0;
+    virtual bool releasePixels(base::buffer&& compressed) = 0;
+    virtual bool hasReleasedPixels() const = 0;
+
+    // Makes this image use the pixels buffer of "src" (copy-on-write)
+    // to save memory when both images have the same pixels (e.g. to
+    // deduplicate cels, see doc/images_dedup.h). It must be called
+    // when no other thread is using this image. Returns false if the
+    // pixels cannot be shared (different spec, or buffer given by the
+    // caller) or if they were already shared.
+    virtual bool sharePixelsWith(const Image* src) = 0;
+
+    // Out-of-core mode for big documents: moves the pixels to a
+    // buffer mapped to a scratch file (see ImageBuffer::isMapped()),
+    // so the OS can page them out instead of keeping them in memory.
+    // It must be called when no other thread is using this image.
+    // Returns false if the pixels cannot be moved (buffer given by
+    // the caller, shared with other images, released, or the file
+    // cannot be created) or if they were already mapped.
+    virtual bool mapPixels() = 0;
+    virtual bool hasMappedPixels() const = 0;
+
+    // Returns the buffer of pixels of this image (decompressing
+    // released pixels). While the returned buffer is referenced, the
+    // pixels cannot be released or moved (releasePixels() and
+    // mapPixels() return false) and the buffer is not freed, so the
+    // image can be read from other threads without locking the
+    // document (e.g. see app::DocFrameSnapshot).
+    virtual ImageBufferPtr pinPixels() const = 0;
+
     virtual int getMemSize() const override;
 
+    // Cached compressed pixels read/written directly from .aseprite
+    // files. The data is valid only if compressedDataVersion() is
+    // equal to version() and the pixels still have the same content
+    // hash (pixels can be modified in-place without a version bump).
+    // The overloads with a contentHash parameter receive the result
+    // of calculate_image_content_hash() to avoid calculating it again.
+    void discardCompressedData();
+    void setCompressedData(const base::buffer& buffer) const;
+    void setCompressedData(const base::buffer& buffer,
+                           const uint64_t contentHash) const;
+    const base::buffer& compressedData() const { return m_compressedData; }
+    ObjectVersion compressedDataVersion() const { return m_compressedDataVersion; }
+    bool hasValidCompressedData() const;
+    bool hasValidCompressedData(const uint64_t contentHash) const;
+
     template<typename ImageTraits>
     ImageBits<ImageTraits> lockBits(LockType lockType, const gfx::Rect& bounds) {
       return ImageBits<ImageTraits>(this, bounds);
@@ -91,6 +153,9 @@ namespace doc {
     // bounds checks. Use the primitives defined in doc/primitives.h
     // in case that you need bounds check.
     virtual uint8_t* getPixelAddress(int x, int y) const = 0;
+    // Same as getPixelAddress() but only to read pixels (pixels
+    // shared with other images aren't copied).
+    virtual const uint8_t* readPixelAddress(int x, int y) const = 0;
     virtual color_t getPixel(int x, int y) const = 0;
     virtual void putPixel(int x, int y, color_t color) = 0;
     virtual void clear(color_t color) = 0;
@@ -107,6 +172,13 @@ namespace doc {
 
   private:
     ImageSpec m_spec;
+
+    // Same as Tileset::m_compressedData, used to save cels that
+    // weren't modified since the last load/save without
+    // re-compressing their pixels.
+    mutable base::buffer m_compressedData;
+    mutable ObjectVersion m_compressedDataVersion = 0;
+    mutable uint64_t m_compressedDataHash = 0;
   };
 
 } // namespace doc
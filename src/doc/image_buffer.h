@@ -11,7 +11,7 @@
 
 #include "base/disable_copying.h"
 #include "base/ints.h"
-#include "doc/aligned_memory.h"
+#include "doc/image_buffer_pool.h"
 
 #include <algorithm>
 #include <cstddef>
@@ -22,37 +22,62 @@ namespace doc {
 
   class ImageBuffer {
   public:
-    ImageBuffer(std::size_t size = 1)
-      : m_size(doc_align_size(size))
-      , m_buffer((uint8_t*)doc_aligned_alloc(m_size)) {
+    // If "mapped" is true, the buffer is mapped to a temporary
+    // scratch file (see ImageBufferPool::allocateMapped()).
+    ImageBuffer(std::size_t size = 1, bool mapped = false)
+      : m_size(mapped ? size: ImageBufferPool::allocSize(size))
+      , m_mapped(mapped)
+      , m_buffer(allocate(m_size, mapped)) {
       if (!m_buffer)
         throw std::bad_alloc();
     }
 
     ~ImageBuffer() noexcept {
-      if (m_buffer)
-        doc_aligned_free(m_buffer);
+      deallocate();
     }
 
     std::size_t size() const { return m_size; }
     uint8_t* buffer() { return (uint8_t*)m_buffer; }
 
+    // True if the pages of the buffer are allocated only when they
+    // are modified (see ImageBufferPool).
+    bool isSparse() const { return !m_mapped && ImageBufferPool::isSparseSize(m_size); }
+
+    // True if the buffer is mapped to a scratch file (its pages are
+    // zero-filled when it's created).
+    bool isMapped() const { return m_mapped; }
+
     void resizeIfNecessary(std::size_t size) {
       if (size > m_size) {
-        if (m_buffer) {
-          doc_aligned_free(m_buffer);
-          m_buffer = nullptr;
-        }
+        deallocate();
+        m_buffer = nullptr;
 
-        m_size = doc_align_size(size);
-        m_buffer = (uint8_t*)doc_aligned_alloc(m_size);
+        m_size = (m_mapped ? size: ImageBufferPool::allocSize(size));
+        m_buffer = allocate(m_size, m_mapped);
         if (!m_buffer)
           throw std::bad_alloc();
       }
     }
 
   private:
+    static uint8_t* allocate(std::size_t size, bool mapped) {
+      auto pool = ImageBufferPool::instance();
+      return (uint8_t*)(mapped ? pool->allocateMapped(size):
+                                 pool->allocate(size));
+    }
+
+    void deallocate() {
+      if (m_buffer) {
+        auto pool = ImageBufferPool::instance();
+        if (m_mapped)
+          pool->deallocateMapped(m_buffer, m_size);
+        else
+          pool->deallocate(m_buffer, m_size);
+      }
+    }
+
     size_t m_size;
+    bool m_mapped;
     uint8_t* m_buffer;
 
     DISABLE_COPYING(ImageBuffer);
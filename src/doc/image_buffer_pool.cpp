@@ -0,0 +1,461 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/image_buffer_pool.h"
+
+#include "base/debug.h"
+#include "doc/aligned_memory.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <string>
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <sys/mman.h>
+  #include <unistd.h>
+#endif
+
+namespace doc {
+
+namespace {
+
+// There are 4 size classes for each power of two between
+// kMinPooledSize and kMaxPooledSize.
+constexpr int kMinPooledSizeBits = 15;
+constexpr int kMaxPooledSizeBits = 26;
+constexpr int kNumClasses = 4*(kMaxPooledSizeBits - kMinPooledSizeBits) + 1;
+
+static_assert(ImageBufferPool::kMinPooledSize == (std::size_t(1) << kMinPooledSizeBits),
+              "Invalid kMinPooledSizeBits");
+static_assert(ImageBufferPool::kMaxPooledSize == (std::size_t(1) << kMaxPooledSizeBits),
+              "Invalid kMaxPooledSizeBits");
+
+std::size_t class_size(const int sizeClass)
+{
+  ASSERT(sizeClass >= 0 && sizeClass < kNumClasses);
+  return ((std::size_t(1) << (kMinPooledSizeBits + sizeClass/4)) / 4
+          * (4 + sizeClass%4));
+}
+
+// Returns the size class to allocate "size" bytes, or -1 if the size
+// is not pooled.
+int size_class(const std::size_t size)
+{
+  if (size < ImageBufferPool::kMinPooledSize ||
+      size > ImageBufferPool::kMaxPooledSize)
+    return -1;
+  if (size == ImageBufferPool::kMinPooledSize)
+    return 0;
+
+  // 2^k < size <= 2^(k+1)
+  int k = kMinPooledSizeBits;
+  while ((std::size_t(2) << k) < size)
+    ++k;
+
+  // Round up to a multiple of 2^k/4 (5 to 8 quarters of 2^k)
+  const int stepBits = (k - 2);
+  const int quarters = int((size + (std::size_t(1) << stepBits) - 1) >> stepBits);
+  ASSERT(quarters >= 5 && quarters <= 8);
+
+  const int sizeClass = 4*(k - kMinPooledSizeBits) + quarters - 4;
+  ASSERT(class_size(sizeClass) >= size);
+  return sizeClass;
+}
+
+std::size_t page_size()
+{
+  static const std::size_t size = []{
+#ifdef _WIN32
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return std::size_t(si.dwPageSize);
+#else
+    return std::size_t(sysconf(_SC_PAGESIZE));
+#endif
+  }();
+  return size;
+}
+
+// Sparse blocks are mapped from the OS, their pages are zero-filled
+// and allocated on the first write.
+void* alloc_sparse(const std::size_t size)
+{
+#ifdef _WIN32
+  return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+  void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return (ptr != MAP_FAILED ? ptr: nullptr);
+#endif
+}
+
+void free_sparse(void* ptr, const std::size_t size)
+{
+#ifdef _WIN32
+  VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+  munmap(ptr, size);
+#endif
+}
+
+// Mapped blocks use a new temporary file for each block. The file is
+// deleted when the block is unmapped (on POSIX it's unlinked right
+// after it's created, on Windows it's deleted on close).
+void* alloc_mapped(const std::size_t size)
+{
+#ifdef _WIN32
+  wchar_t dir[MAX_PATH+1];
+  wchar_t fn[MAX_PATH+1];
+  if (!GetTempPathW(MAX_PATH+1, dir) ||
+      !GetTempFileNameW(dir, L"ase", 0, fn))
+    return nullptr;
+
+  HANDLE file = CreateFileW(fn, GENERIC_READ | GENERIC_WRITE, 0, nullptr,
+                            CREATE_ALWAYS,
+                            FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE,
+                            nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    return nullptr;
+
+  const uint64_t size64 = size;
+  HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READWRITE,
+                                      DWORD(size64 >> 32), DWORD(size64),
+                                      nullptr);
+  void* ptr = nullptr;
+  if (mapping) {
+    ptr = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    CloseHandle(mapping);
+  }
+  // The view keeps the file alive until it's unmapped
+  CloseHandle(file);
+  return ptr;
+#else
+  const char* dir = std::getenv("TMPDIR");
+  std::string fn = (dir && *dir ? dir: "/tmp");
+  fn += "/aseprite-pixels-XXXXXX";
+
+  const int fd = mkstemp(fn.data());
+  if (fd < 0)
+    return nullptr;
+  unlink(fn.c_str());
+
+  void* ptr = nullptr;
+  if (ftruncate(fd, off_t(size)) == 0) {
+    ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+               MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED)
+      ptr = nullptr;
+  }
+  // The mapping keeps the file alive until it's unmapped
+  close(fd);
+  return ptr;
+#endif
+}
+
+void free_mapped(void* ptr, const std::size_t size)
+{
+#ifdef _WIN32
+  UnmapViewOfFile(ptr);
+#else
+  munmap(ptr, size);
+#endif
+}
+
+// Replaces whole pages with new zero-filled pages (releasing their
+// memory).
+bool release_pages(void* ptr, const std::size_t size)
+{
+#ifdef _WIN32
+  return (VirtualFree(ptr, size, MEM_DECOMMIT) &&
+          VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE) == ptr);
+#else
+  return (mmap(ptr, size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == ptr);
+#endif
+}
+
+bool is_zero(const uint8_t* p, std::size_t size)
+{
+  for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t), p += sizeof(uint64_t)) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    if (v)
+      return false;
+  }
+  for (; size > 0; --size, ++p) {
+    if (*p)
+      return false;
+  }
+  return true;
+}
+
+} // anonymous namespace
+
+// Small cache of free blocks for each thread, used before locking
+// the global pool. When the thread finishes, its blocks go back to
+// the global pool.
+class ImageBufferThreadCache {
+public:
+  ~ImageBufferThreadCache() {
+    flush(false);
+  }
+
+  void* pop(const int sizeClass) {
+    for (auto it=m_blocks.rbegin(), end=m_blocks.rend(); it!=end; ++it) {
+      if (it->sizeClass == sizeClass) {
+        void* ptr = it->ptr;
+        m_blocks.erase(std::next(it).base());
+        m_bytes -= class_size(sizeClass);
+        return ptr;
+      }
+    }
+    return nullptr;
+  }
+
+  bool push(const int sizeClass, void* ptr) {
+    const std::size_t size = class_size(sizeClass);
+    if (m_blocks.size() >= ImageBufferPool::kMaxThreadCacheBlocks ||
+        m_bytes + size > ImageBufferPool::kMaxThreadCacheBytes)
+      return false;
+
+    m_blocks.push_back(Block{ sizeClass, ptr });
+    m_bytes += size;
+    return true;
+  }
+
+  // Moves all blocks to the global pool, or frees them if "release"
+  // is true (or the pool is full).
+  void flush(const bool release) {
+    ImageBufferPool* pool = ImageBufferPool::instance();
+    for (const Block& block : m_blocks) {
+      if (release || !pool->push(block.sizeClass, block.ptr)) {
+        doc_aligned_free(block.ptr);
+        pool->m_cachedBytes -= class_size(block.sizeClass);
+      }
+    }
+    m_blocks.clear();
+    m_bytes = 0;
+  }
+
+private:
+  struct Block {
+    int sizeClass;
+    void* ptr;
+  };
+  std::vector<Block> m_blocks;
+  std::size_t m_bytes = 0;
+};
+
+static thread_local ImageBufferThreadCache t_cache;
+
+// static
+ImageBufferPool* ImageBufferPool::instance()
+{
+  // Never deleted, so threads finishing at exit can still return
+  // their cached blocks to the pool.
+  static ImageBufferPool* pool = new ImageBufferPool;
+  return pool;
+}
+
+ImageBufferPool::ImageBufferPool()
+  : m_blocks(kNumClasses)
+{
+}
+
+// static
+std::size_t ImageBufferPool::allocSize(std::size_t size)
+{
+  size = doc_align_size(size);
+  const int sizeClass = size_class(size);
+  return (sizeClass >= 0 ? class_size(sizeClass): size);
+}
+
+void* ImageBufferPool::allocate(std::size_t size)
+{
+  size = doc_align_size(size);
+  if (isSparseSize(size))
+    return alloc_sparse(size);
+
+  const int sizeClass = size_class(size);
+  if (sizeClass < 0)
+    return doc_aligned_alloc(size);
+
+  size = class_size(sizeClass);
+  ++m_allocs;
+
+  void* ptr = t_cache.pop(sizeClass);
+  if (!ptr)
+    ptr = pop(sizeClass);
+
+  if (ptr) {
+    ++m_reused;
+    m_cachedBytes -= size;
+  }
+  else {
+    ptr = doc_aligned_alloc(size);
+    // Try again releasing the free blocks
+    if (!ptr) {
+      trim();
+      ptr = doc_aligned_alloc(size);
+      if (!ptr)
+        return nullptr;
+    }
+  }
+
+  m_usedBytes += size;
+  return ptr;
+}
+
+void ImageBufferPool::deallocate(void* ptr, std::size_t size)
+{
+  if (!ptr)
+    return;
+
+  size = doc_align_size(size);
+  if (isSparseSize(size)) {
+    free_sparse(ptr, size);
+    return;
+  }
+
+  const int sizeClass = size_class(size);
+  if (sizeClass < 0) {
+    doc_aligned_free(ptr);
+    return;
+  }
+
+  size = class_size(sizeClass);
+  m_usedBytes -= size;
+
+  if (t_cache.push(sizeClass, ptr) ||
+      push(sizeClass, ptr)) {
+    m_cachedBytes += size;
+  }
+  else {
+    doc_aligned_free(ptr);
+  }
+}
+
+// static
+void ImageBufferPool::zeroSparse(void* ptr, std::size_t size)
+{
+  auto p = (uint8_t*)ptr;
+  const std::size_t pageSize = page_size();
+  const auto begin = uintptr_t(p);
+  const auto end = begin + size;
+  const uintptr_t pagesBegin = (begin + pageSize - 1) / pageSize * pageSize;
+  const uintptr_t pagesEnd = end / pageSize * pageSize;
+
+  if (pagesBegin < pagesEnd &&
+      release_pages((void*)pagesBegin, pagesEnd - pagesBegin)) {
+    std::memset(p, 0, pagesBegin - begin);
+    std::memset((void*)pagesEnd, 0, end - pagesEnd);
+  }
+  else {
+    std::memset(p, 0, size);
+  }
+}
+
+// static
+void ImageBufferPool::copySparse(void* dst, const void* src, std::size_t size)
+{
+  auto d = (uint8_t*)dst;
+  auto s = (const uint8_t*)src;
+  const std::size_t pageSize = page_size();
+
+  while (size > 0) {
+    // Copy up to the next page boundary of the destination
+    const std::size_t n =
+      std::min(size, pageSize - std::size_t(uintptr_t(d) % pageSize));
+
+    if (!is_zero(s, n) || !is_zero(d, n))
+      std::memcpy(d, s, n);
+
+    d += n;
+    s += n;
+    size -= n;
+  }
+}
+
+void* ImageBufferPool::allocateMapped(std::size_t size)
+{
+  size = doc_align_size(size);
+  void* ptr = alloc_mapped(size);
+  if (ptr)
+    m_mappedBytes += size;
+  return ptr;
+}
+
+void ImageBufferPool::deallocateMapped(void* ptr, std::size_t size)
+{
+  if (!ptr)
+    return;
+
+  size = doc_align_size(size);
+  free_mapped(ptr, size);
+  m_mappedBytes -= size;
+}
+
+ImageBufferPool::Stats ImageBufferPool::stats() const
+{
+  Stats stats;
+  stats.allocs = m_allocs;
+  stats.reused = m_reused;
+  stats.usedBytes = m_usedBytes;
+  stats.cachedBytes = m_cachedBytes;
+  stats.mappedBytes = m_mappedBytes;
+  return stats;
+}
+
+void ImageBufferPool::trim()
+{
+  t_cache.flush(true);
+
+  const std::lock_guard lock(m_mutex);
+  for (int sizeClass=0; sizeClass<kNumClasses; ++sizeClass) {
+    for (void* ptr : m_blocks[sizeClass]) {
+      doc_aligned_free(ptr);
+      m_cachedBytes -= class_size(sizeClass);
+    }
+    m_blocks[sizeClass].clear();
+  }
+  m_poolBytes = 0;
+}
+
+void* ImageBufferPool::pop(const int sizeClass)
+{
+  const std::lock_guard lock(m_mutex);
+  auto& blocks = m_blocks[sizeClass];
+  if (blocks.empty())
+    return nullptr;
+
+  void* ptr = blocks.back();
+  blocks.pop_back();
+  m_poolBytes -= class_size(sizeClass);
+  return ptr;
+}
+
+bool ImageBufferPool::push(const int sizeClass, void* ptr)
+{
+  const std::size_t size = class_size(sizeClass);
+  const std::lock_guard lock(m_mutex);
+  if (m_poolBytes + size > kMaxPoolBytes)
+    return false;
+
+  m_blocks[sizeClass].push_back(ptr);
+  m_poolBytes += size;
+  return true;
+}
+
+} // namespace doc
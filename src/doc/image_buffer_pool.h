@@ -0,0 +1,124 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_IMAGE_BUFFER_POOL_H_INCLUDED
+#define DOC_IMAGE_BUFFER_POOL_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace doc {
+
+  // Global pool of memory blocks for ImageBuffers. Image-sized
+  // allocations are rounded up to size classes (at most 25% bigger
+  // than the requested size) and freed blocks are kept to be reused
+  // by the next buffer of the same class, instead of going back to
+  // the general allocator (temporary images in rendering, tools,
+  // filters, export, etc. are created and destroyed all the time).
+  //
+  // Each thread keeps a small cache of free blocks that can be used
+  // without locking the global pool. Small and very big buffers
+  // aren't pooled at all.
+  //
+  // Very big buffers (huge canvases) are sparse: they are allocated
+  // directly from the OS and their pages start filled with zeros and
+  // use memory only when they are modified for the first time, so
+  // transparent areas of a huge image don't use memory.
+  //
+  // Mapped buffers (see allocateMapped()) are backed by a temporary
+  // scratch file instead of memory, for documents bigger than the
+  // RAM: the OS can write their pages to the file and read them
+  // again when they are used.
+  class ImageBufferPool {
+  public:
+    // Buffers smaller than this use the general allocator directly
+    static constexpr std::size_t kMinPooledSize = 32*1024;
+    // Buffers bigger than this aren't kept in the pool
+    static constexpr std::size_t kMaxPooledSize = 64*1024*1024;
+    // Maximum number of bytes of free blocks in the global pool
+    static constexpr std::size_t kMaxPoolBytes = 256*1024*1024;
+    // Limits of the cache of free blocks of each thread
+    static constexpr std::size_t kMaxThreadCacheBytes = 32*1024*1024;
+    static constexpr std::size_t kMaxThreadCacheBlocks = 8;
+
+    struct Stats {
+      std::size_t allocs = 0;        // Number of pooled-size allocations
+      std::size_t reused = 0;        // Allocations that reused a free block
+      std::size_t usedBytes = 0;     // Bytes in pooled-size blocks being used
+      std::size_t cachedBytes = 0;   // Bytes in free blocks (pool + thread caches)
+      std::size_t mappedBytes = 0;   // Bytes in blocks mapped to scratch files
+    };
+
+    static ImageBufferPool* instance();
+
+    // Returns the real size of the block that will be allocated for
+    // the given size (the size class).
+    static std::size_t allocSize(std::size_t size);
+
+    // Returns true if a block of the given size is sparse (bigger
+    // than kMaxPooledSize).
+    static bool isSparseSize(std::size_t size) {
+      return (size > kMaxPooledSize);
+    }
+
+    // Fills with zeros "size" bytes of a sparse block, the whole
+    // pages in the range are released.
+    static void zeroSparse(void* ptr, std::size_t size);
+
+    // Copies "size" bytes to a sparse block, skipping the pages that
+    // are zero in both "src" and "dst" (so they aren't allocated).
+    static void copySparse(void* dst, const void* src, std::size_t size);
+
+    // Allocates a block of allocSize(size) bytes. Returns nullptr if
+    // there is not enough memory.
+    void* allocate(std::size_t size);
+
+    // Frees a block returned by allocate(size) (with the same size or
+    // the allocSize() of it).
+    void deallocate(void* ptr, std::size_t size);
+
+    // Allocates a block of "size" bytes filled with zeros that is
+    // mapped to a new temporary file (deleted when the block is
+    // freed). Returns nullptr if the file cannot be created/mapped.
+    void* allocateMapped(std::size_t size);
+    void deallocateMapped(void* ptr, std::size_t size);
+
+    Stats stats() const;
+
+    // Frees all the blocks kept in the global pool and in the cache
+    // of the calling thread.
+    void trim();
+
+  private:
+    friend class ImageBufferThreadCache;
+
+    ImageBufferPool();
+
+    void* pop(int sizeClass);
+    bool push(int sizeClass, void* ptr);
+
+    mutable std::mutex m_mutex;
+    // Free blocks for each size class
+    std::vector<std::vector<void*>> m_blocks;
+    std::size_t m_poolBytes = 0;
+
+    std::atomic<std::size_t> m_allocs{0};
+    std::atomic<std::size_t> m_reused{0};
+    std::atomic<std::size_t> m_usedBytes{0};
+    std::atomic<std::size_t> m_cachedBytes{0};
+    std::atomic<std::size_t> m_mappedBytes{0};
+
+    DISABLE_COPYING(ImageBufferPool);
+  };
+
+} // namespace doc
+
+#endif
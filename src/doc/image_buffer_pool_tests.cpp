@@ -0,0 +1,237 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/image.h"
+#include "doc/image_buffer.h"
+#include "doc/image_buffer_pool.h"
+#include "doc/image_ref.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+using namespace doc;
+
+TEST(ImageBufferPool, AllocSize)
+{
+  using Pool = ImageBufferPool;
+
+  EXPECT_EQ(1u, Pool::allocSize(1));
+  EXPECT_EQ(Pool::kMinPooledSize-1, Pool::allocSize(Pool::kMinPooledSize-1));
+  EXPECT_EQ(Pool::kMinPooledSize, Pool::allocSize(Pool::kMinPooledSize));
+  EXPECT_EQ(5*Pool::kMinPooledSize/4, Pool::allocSize(Pool::kMinPooledSize+1));
+  EXPECT_EQ(2*Pool::kMinPooledSize, Pool::allocSize(7*Pool::kMinPooledSize/4+1));
+  EXPECT_EQ(Pool::kMaxPooledSize, Pool::allocSize(Pool::kMaxPooledSize));
+  EXPECT_EQ(Pool::kMaxPooledSize+1, Pool::allocSize(Pool::kMaxPooledSize+1));
+
+  for (std::size_t size=Pool::kMinPooledSize; size<=Pool::kMaxPooledSize; size=size*9/8+1) {
+    const std::size_t allocSize = Pool::allocSize(size);
+    EXPECT_GE(allocSize, size);
+    EXPECT_LE(allocSize, size + size/4);
+    EXPECT_EQ(allocSize, Pool::allocSize(allocSize));
+  }
+}
+
+TEST(ImageBufferPool, ReuseBlocks)
+{
+  ImageBufferPool* pool = ImageBufferPool::instance();
+  pool->trim();
+  EXPECT_EQ(0u, pool->stats().cachedBytes);
+
+  const ImageBufferPool::Stats stats0 = pool->stats();
+  const std::size_t size = ImageBufferPool::allocSize(256*256*4);
+  void* ptr = pool->allocate(256*256*4);
+  ASSERT_NE(nullptr, ptr);
+  EXPECT_EQ(stats0.usedBytes + size, pool->stats().usedBytes);
+
+  pool->deallocate(ptr, 256*256*4);
+  EXPECT_EQ(stats0.usedBytes, pool->stats().usedBytes);
+  EXPECT_EQ(size, pool->stats().cachedBytes);
+
+  // A buffer of the same size class reuses the block
+  void* ptr2 = pool->allocate(256*256*4 - 100);
+  EXPECT_EQ(ptr, ptr2);
+  EXPECT_EQ(stats0.allocs + 2, pool->stats().allocs);
+  EXPECT_EQ(stats0.reused + 1, pool->stats().reused);
+  EXPECT_EQ(0u, pool->stats().cachedBytes);
+  pool->deallocate(ptr2, size);
+
+  pool->trim();
+  EXPECT_EQ(0u, pool->stats().cachedBytes);
+  EXPECT_EQ(stats0.usedBytes, pool->stats().usedBytes);
+}
+
+TEST(ImageBufferPool, Images)
+{
+  ImageBufferPool* pool = ImageBufferPool::instance();
+  pool->trim();
+  const ImageBufferPool::Stats stats0 = pool->stats();
+
+  for (int i=0; i<10; ++i) {
+    ImageRef image(Image::create(IMAGE_RGB, 300, 200));
+    for (int y=0; y<image->height(); ++y)
+      for (int x=0; x<image->width(); ++x)
+        EXPECT_EQ(0, image->getPixel(x, y));
+    image->clear(rgba(255, 0, 0, 255));
+  }
+
+  EXPECT_EQ(stats0.allocs + 10, pool->stats().allocs);
+  EXPECT_EQ(stats0.reused + 9, pool->stats().reused);
+  EXPECT_EQ(stats0.usedBytes, pool->stats().usedBytes);
+
+  // Blocks freed from other threads go back to the pool
+  std::vector<std::thread> threads;
+  for (int i=0; i<4; ++i) {
+    threads.emplace_back([]{
+      for (int j=0; j<20; ++j) {
+        auto buffer = std::make_shared<ImageBuffer>(64*1024*(1+j%4));
+        std::fill(buffer->buffer(), buffer->buffer()+buffer->size(), j);
+      }
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+
+  EXPECT_EQ(stats0.usedBytes, pool->stats().usedBytes);
+  pool->trim();
+  EXPECT_EQ(0u, pool->stats().cachedBytes);
+}
+
+TEST(ImageBufferPool, SparseBuffers)
+{
+  using Pool = ImageBufferPool;
+
+  EXPECT_FALSE(Pool::isSparseSize(Pool::kMaxPooledSize));
+  EXPECT_TRUE(Pool::isSparseSize(Pool::kMaxPooledSize+1));
+
+  const std::size_t size = Pool::kMaxPooledSize + 12345;
+  ImageBuffer buffer(size);
+  EXPECT_TRUE(buffer.isSparse());
+
+  // Zero/copy ranges that aren't aligned to pages
+  uint8_t* p = buffer.buffer();
+  std::fill(p, p+100000, 7);
+  Pool::zeroSparse(p+10, 99980);
+  EXPECT_EQ(7, p[9]);
+  EXPECT_EQ(7, p[99990]);
+  EXPECT_TRUE(std::all_of(p+10, p+99990, [](uint8_t b){ return b == 0; }));
+
+  std::vector<uint8_t> src(50000, 0);
+  src[20000] = 1;
+  Pool::copySparse(p+5, src.data(), src.size());
+  EXPECT_EQ(7, p[4]);
+  EXPECT_TRUE(std::equal(src.begin(), src.end(), p+5));
+  EXPECT_EQ(0, p[size-1]);
+}
+
+TEST(ImageBufferPool, SparseImages)
+{
+  // 4096x4097 RGB image is bigger than kMaxPooledSize
+  ImageRef image(Image::create(IMAGE_RGB, 4096, 4097));
+  EXPECT_TRUE(image->isSparse());
+  EXPECT_EQ(0, image->getPixel(4095, 4096));
+
+  image->putPixel(10, 20, rgba(255, 0, 0, 255));
+  image->putPixel(4000, 4000, rgba(0, 255, 0, 255));
+
+  ImageRef copy(Image::create(IMAGE_RGB, 4096, 4097));
+  copy->copy(image.get(), gfx::Clip(0, 0, image->bounds()));
+  EXPECT_EQ(rgba(255, 0, 0, 255), copy->getPixel(10, 20));
+  EXPECT_EQ(rgba(0, 255, 0, 255), copy->getPixel(4000, 4000));
+  EXPECT_EQ(0, copy->getPixel(11, 20));
+
+  copy->clear(0);
+  EXPECT_EQ(0, copy->getPixel(10, 20));
+  EXPECT_EQ(0, copy->getPixel(4000, 4000));
+  EXPECT_EQ(rgba(255, 0, 0, 255), image->getPixel(10, 20));
+
+  copy->clear(rgba(0, 0, 255, 255));
+  EXPECT_EQ(rgba(0, 0, 255, 255), copy->getPixel(4095, 4096));
+
+  // Small images aren't sparse
+  ImageRef small(Image::create(IMAGE_RGB, 256, 256));
+  EXPECT_FALSE(small->isSparse());
+}
+
+TEST(ImageBufferPool, MappedBuffers)
+{
+  ImageBufferPool* pool = ImageBufferPool::instance();
+  const std::size_t mappedBytes0 = pool->stats().mappedBytes;
+  {
+    ImageBuffer buffer(100000, true);
+    ASSERT_TRUE(buffer.isMapped());
+    EXPECT_FALSE(buffer.isSparse());
+    EXPECT_GE(buffer.size(), 100000u);
+    EXPECT_GE(pool->stats().mappedBytes, mappedBytes0 + 100000);
+
+    uint8_t* p = buffer.buffer();
+    EXPECT_TRUE(std::all_of(p, p+100000, [](uint8_t b){ return b == 0; }));
+    std::fill(p, p+100000, 3);
+    EXPECT_EQ(3, p[99999]);
+
+    // Mapped buffers are still mapped after resizing them
+    buffer.resizeIfNecessary(200000);
+    EXPECT_TRUE(buffer.isMapped());
+    EXPECT_EQ(0, buffer.buffer()[199999]);
+  }
+  EXPECT_EQ(mappedBytes0, pool->stats().mappedBytes);
+}
+
+TEST(ImageBufferPool, MappedImages)
+{
+  ImageRef image(Image::create(IMAGE_RGB, 300, 200));
+  image->putPixel(10, 20, rgba(255, 0, 0, 255));
+  image->putPixel(299, 199, rgba(0, 255, 0, 255));
+  EXPECT_FALSE(image->hasMappedPixels());
+
+  // Images sharing their pixels cannot be mapped
+  {
+    ImageRef copy(Image::createCopy(image.get()));
+    EXPECT_FALSE(image->mapPixels());
+  }
+
+  // Pinned pixels cannot be moved
+  {
+    ImageBufferPtr pinned = image->pinPixels();
+    EXPECT_FALSE(image->mapPixels());
+    EXPECT_FALSE(pinned->isMapped());
+  }
+
+  ASSERT_TRUE(image->mapPixels());
+  EXPECT_TRUE(image->hasMappedPixels());
+  EXPECT_FALSE(image->mapPixels());
+  EXPECT_EQ(rgba(255, 0, 0, 255), image->getPixel(10, 20));
+  EXPECT_EQ(rgba(0, 255, 0, 255), image->getPixel(299, 199));
+  EXPECT_EQ(0, image->getPixel(11, 20));
+
+  // Copies of mapped images are mapped too when they are modified
+  ImageRef copy(Image::createCopy(image.get()));
+  copy->putPixel(0, 0, rgba(0, 0, 255, 255));
+  EXPECT_TRUE(copy->hasMappedPixels());
+  EXPECT_EQ(rgba(255, 0, 0, 255), copy->getPixel(10, 20));
+  EXPECT_EQ(0, image->getPixel(0, 0));
+
+  image->clear(rgba(0, 0, 255, 255));
+  EXPECT_EQ(rgba(0, 0, 255, 255), image->getPixel(299, 199));
+  EXPECT_EQ(rgba(0, 255, 0, 255), copy->getPixel(299, 199));
+
+  // Images with a buffer given by the caller cannot be mapped
+  ImageBufferPtr buffer = std::make_shared<ImageBuffer>();
+  ImageRef other(Image::create(IMAGE_RGB, 8, 8, buffer));
+  EXPECT_FALSE(other->mapPixels());
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
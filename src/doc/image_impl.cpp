@@ -1,4 +1,5 @@
 // Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
 // Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -15,6 +16,12 @@
 
 namespace doc {
 
+std::mutex& image_shared_pixels_mutex()
+{
+  static std::mutex mutex;
+  return mutex;
+}
+
 void copy_bitmaps(Image* dst, const Image* src, gfx::Clip area)
 {
   if (!area.clip(dst->width(), dst->height(), src->width(), src->height()))
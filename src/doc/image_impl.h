@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -10,19 +10,26 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <cstdlib>
 #include <cstring>
+#include <mutex>
+#include <vector>
 
 #include "doc/blend_funcs.h"
 #include "doc/image.h"
 #include "doc/image_bits.h"
 #include "doc/image_iterator.h"
+#include "doc/image_rle.h"
 #include "doc/palette.h"
 
 namespace doc {
 
   template<typename ImageTraits> class LockImageBits;
 
+  // Mutex used to share/unshare the pixels of images (copy-on-write).
+  std::mutex& image_shared_pixels_mutex();
+
   template<class Traits>
   class ImageImpl : public Image {
   public:
@@ -31,27 +38,154 @@ namespace doc {
     using const_address_t = typename traits_t::const_address_t;
 
   private:
-    ImageBufferPtr m_buffer;
-    address_t* m_rows;
-    address_t m_bits;
+    mutable ImageBufferPtr m_buffer;
+
+    // Row table and pixels of m_buffer. They are atomic because other
+    // threads can read the image while its pixels are unshared (see
+    // setupRows()).
+    mutable std::atomic<address_t*> m_rows;
+    mutable std::atomic<address_t> m_bits;
+
+    // Buffers replaced by unsharePixels() that are kept alive until
+    // no other thread can be reading them, i.e. until the image is
+    // destroyed or its pixels are released/mapped (which is done with
+    // the document locked for writing).
+    mutable std::vector<ImageBufferPtr> m_retiredBuffers;
+
+    // True if m_buffer was allocated by this image (and not given by
+    // the caller to reuse it), so we can share it with copies.
+    bool m_ownBuffer;
+
+    // True if m_buffer might be shared with other images created with
+    // Image::createCopy(). In that case the pixels are copied (and
+    // the buffer unshared) before giving an address to modify them.
+    mutable std::atomic<bool> m_sharedPixels;
+
+    // True if the pixels were released with releasePixels() and must
+    // be decompressed from m_compressedPixels before using them.
+    mutable std::atomic<bool> m_releasedPixels;
+    mutable base::buffer m_compressedPixels;
 
     inline address_t getLineAddress(int y) {
       ASSERT(y >= 0 && y < height());
-      return m_rows[y];
+      unshare();
+      return m_rows.load(std::memory_order_acquire)[y];
     }
 
     inline const_address_t getLineAddress(int y) const {
       ASSERT(y >= 0 && y < height());
-      return m_rows[y];
+      loadPixels();
+      return m_rows.load(std::memory_order_acquire)[y];
+    }
+
+    static constexpr int pixelSize() {
+      return (Traits::pixels_per_byte == 0 ? Traits::bytes_per_pixel: 1);
+    }
+
+    std::size_t rowsSize() const {
+      return doc_align_size(sizeof(address_t) * height());
+    }
+
+    // Fills the row table of the given buffer and then publishes it
+    // as the buffer of this image, so a thread reading pixels at the
+    // same time sees the old rows or the new ones, but never a
+    // partially filled table.
+    void setupRows(const ImageBufferPtr& buffer) const {
+      auto rows = (address_t*)buffer->buffer();
+      auto bits = (address_t)(buffer->buffer() + rowsSize());
+
+      auto addr = (uint8_t*)bits;
+      for (int y=0; y<height(); ++y) {
+        rows[y] = (address_t)addr;
+        addr += m_rowBytes;
+      }
+
+      m_buffer = buffer;
+      m_bits.store(bits, std::memory_order_relaxed);
+      m_rows.store(rows, std::memory_order_release);
+    }
+
+    inline void loadPixels() const {
+      if (m_releasedPixels.load(std::memory_order_acquire))
+        decompressPixels();
+    }
+
+    inline void unshare() const {
+      loadPixels();
+      if (m_sharedPixels.load(std::memory_order_acquire))
+        unsharePixels();
+    }
+
+    void decompressPixels() const {
+      const std::lock_guard lock(image_shared_pixels_mutex());
+      if (!m_releasedPixels)
+        return;
+
+      const std::size_t forPixels = m_rowBytes * height();
+      auto buffer = std::make_shared<ImageBuffer>(rowsSize() + forPixels);
+      const bool sparse = buffer->isSparse();
+      if (sparse)
+        ImageBufferPool::zeroSparse(buffer->buffer(), rowsSize() + forPixels);
+      else if (m_rowBytes != std::size_t(Traits::width_bytes(width())))
+        std::fill(buffer->buffer(), buffer->buffer() + rowsSize() + forPixels, 0);
+
+      setupRows(buffer);
+
+      std::size_t pos = 0;
+      const int n = Traits::width_bytes(width()) / pixelSize();
+      const address_t* rows = m_rows.load(std::memory_order_relaxed);
+      for (int y=0; y<height(); ++y) {
+        if (!rle_decode_row(m_compressedPixels, pos, (uint8_t*)rows[y],
+                            n, pixelSize(), sparse)) {
+          ASSERT(false);
+          break;
+        }
+      }
+
+      base::buffer().swap(m_compressedPixels);
+      m_releasedPixels.store(false, std::memory_order_release);
+    }
+
+    void unsharePixels() const {
+      const std::lock_guard lock(image_shared_pixels_mutex());
+      if (!m_sharedPixels)
+        return;
+
+      // Other images are still using these pixels
+      if (m_buffer.use_count() > 1) {
+        const std::size_t forPixels = m_rowBytes * height();
+        const auto bits = (const uint8_t*)m_bits.load(std::memory_order_relaxed);
+        auto buffer = std::make_shared<ImageBuffer>(rowsSize() + forPixels,
+                                                    m_buffer->isMapped());
+        if (buffer->isSparse() || buffer->isMapped()) {
+          ImageBufferPool::copySparse(buffer->buffer() + rowsSize(),
+                                      bits, forPixels);
+        }
+        else {
+          std::copy(bits, bits + forPixels,
+                    buffer->buffer() + rowsSize());
+        }
+        // Other threads might be reading the old rows of this image
+        m_retiredBuffers.push_back(m_buffer);
+        setupRows(buffer);
+      }
+      m_sharedPixels.store(false, std::memory_order_release);
     }
 
   public:
     inline address_t address(int x, int y) const {
+      unshare();
+      return (address_t)readAddress(x, y);
+    }
+
+    // Returns the address of a pixel only to read it (doesn't copy
+    // shared pixels).
+    inline const_address_t readAddress(int x, int y) const {
       if constexpr (Traits::pixels_per_byte == 0) {
-        return (address_t)(getLineAddress(y) + x);
+        return (getLineAddress(y) + x);
       }
       else {
-        return (address_t)(getLineAddress(y) + x / Traits::pixels_per_byte);
+        return (getLineAddress(y) + x / Traits::pixels_per_byte);
       }
     }
 
@@ -59,12 +193,15 @@ namespace doc {
               const ImageBufferPtr& buffer)
       : Image(spec)
       , m_buffer(buffer)
+      , m_ownBuffer(!buffer)
+      , m_sharedPixels(false)
+      , m_releasedPixels(false)
     {
       ASSERT(Traits::color_mode == spec.colorMode());
 
       m_rowBytes = Traits::rowstride_bytes(width());
 
-      const std::size_t for_rows = doc_align_size(sizeof(address_t) * height());
+      const std::size_t for_rows = rowsSize();
       const std::size_t for_pixels = m_rowBytes * height();
       const std::size_t required_size = for_pixels + for_rows;
 
@@ -73,17 +210,152 @@ namespace doc {
       else
         m_buffer->resizeIfNecessary(required_size);
 
-      std::fill(m_buffer->buffer(),
-                m_buffer->buffer()+required_size, 0);
+      if (m_buffer->isSparse())
+        ImageBufferPool::zeroSparse(m_buffer->buffer(), required_size);
+      else
+        std::fill(m_buffer->buffer(),
+                  m_buffer->buffer()+required_size, 0);
 
-      m_rows = (address_t*)m_buffer->buffer();
-      m_bits = (address_t)(m_buffer->buffer() + for_rows);
+      setupRows(m_buffer);
+    }
 
-      auto addr = (uint8_t*)m_bits;
-      for (int y=0; y<height(); ++y) {
-        m_rows[y] = (address_t)addr;
-        addr += m_rowBytes;
+    // Creates an image with the same pixels of "src" sharing its
+    // buffer until one of them is modified.
+    ImageImpl(const ImageSpec& spec,
+              const ImageImpl* src)
+      : Image(spec)
+      , m_ownBuffer(true)
+      , m_sharedPixels(true)
+      , m_releasedPixels(false)
+    {
+      ASSERT(Traits::color_mode == spec.colorMode());
+      ASSERT(src->m_ownBuffer);
+      ASSERT(spec.size() == src->size());
+
+      m_rowBytes = src->m_rowBytes;
+      src->loadPixels();
+
+      const std::lock_guard lock(image_shared_pixels_mutex());
+      m_buffer = src->m_buffer;
+      m_bits.store(src->m_bits.load(std::memory_order_relaxed),
+                   std::memory_order_relaxed);
+      m_rows.store(src->m_rows.load(std::memory_order_relaxed),
+                   std::memory_order_release);
+      src->m_sharedPixels.store(true, std::memory_order_release);
+    }
+
+    bool canSharePixels() const {
+      return m_ownBuffer;
+    }
+
+    bool isSparse() const override {
+      if (m_buffer)
+        return m_buffer->isSparse();
+      return ImageBufferPool::isSparseSize(rowsSize() + m_rowBytes * height());
+    }
+
+    int getMemSize() const override {
+      if (hasReleasedPixels())
+        return sizeof(*this) + int(m_compressedPixels.size());
+      return Image::getMemSize();
+    }
+
+    void compressPixels(base::buffer& output) const override {
+      const int n = Traits::width_bytes(width()) / pixelSize();
+      output.clear();
+      for (int y=0; y<height(); ++y)
+        rle_encode_row((const uint8_t*)getLineAddress(y), n, pixelSize(), output);
+    }
+
+    bool releasePixels(base::buffer&& compressed) override {
+      const std::lock_guard lock(image_shared_pixels_mutex());
+      // Pixels given by the caller, shared with other images (or
+      // pinned, see pinPixels()), or already released
+      if (!m_ownBuffer ||
+          m_buffer.use_count() > 1 ||
+          m_releasedPixels)
+        return false;
+
+      m_compressedPixels = std::move(compressed);
+      m_buffer.reset();
+      m_retiredBuffers.clear();
+      m_rows.store(nullptr, std::memory_order_relaxed);
+      m_bits.store(nullptr, std::memory_order_relaxed);
+      m_sharedPixels.store(false, std::memory_order_relaxed);
+      m_releasedPixels.store(true, std::memory_order_release);
+      return true;
+    }
+
+    bool hasReleasedPixels() const override {
+      return m_releasedPixels.load(std::memory_order_acquire);
+    }
+
+    bool sharePixelsWith(const Image* _src) override {
+      if (_src == this ||
+          _src->colorMode() != colorMode() ||
+          _src->size() != size())
+        return false;
+
+      auto src = static_cast<const ImageImpl*>(_src);
+      if (!m_ownBuffer || !src->m_ownBuffer ||
+          m_rowBytes != src->m_rowBytes)
+        return false;
+
+      src->loadPixels();
+
+      const std::lock_guard lock(image_shared_pixels_mutex());
+      if (m_buffer == src->m_buffer)
+        return false;
+
+      m_buffer = src->m_buffer;
+      m_bits.store(src->m_bits.load(std::memory_order_relaxed),
+                   std::memory_order_relaxed);
+      m_rows.store(src->m_rows.load(std::memory_order_relaxed),
+                   std::memory_order_release);
+      m_compressedPixels.clear();
+      m_releasedPixels.store(false, std::memory_order_relaxed);
+      m_sharedPixels.store(true, std::memory_order_release);
+      src->m_sharedPixels.store(true, std::memory_order_release);
+      return true;
+    }
+
+    bool mapPixels() override {
+      const std::lock_guard lock(image_shared_pixels_mutex());
+      // Same conditions as releasePixels()
+      if (!m_ownBuffer ||
+          m_buffer.use_count() > 1 ||
+          m_releasedPixels ||
+          m_buffer->isMapped())
+        return false;
+
+      const std::size_t forPixels = m_rowBytes * height();
+      ImageBufferPtr buffer;
+      try {
+        buffer = std::make_shared<ImageBuffer>(rowsSize() + forPixels, true);
       }
+      catch (const std::bad_alloc&) {
+        return false;
+      }
+      // Skip zero pages so they aren't written to the file
+      ImageBufferPool::copySparse(buffer->buffer() + rowsSize(),
+                                  m_bits.load(std::memory_order_relaxed),
+                                  forPixels);
+      m_retiredBuffers.clear();
+      setupRows(buffer);
+      m_sharedPixels.store(false, std::memory_order_release);
+      return true;
+    }
+
+    bool hasMappedPixels() const override {
+      const std::lock_guard lock(image_shared_pixels_mutex());
+      return (m_buffer && m_buffer->isMapped());
+    }
+
+    ImageBufferPtr pinPixels() const override {
+      loadPixels();
+
+      const std::lock_guard lock(image_shared_pixels_mutex());
+      return m_buffer;
     }
 
     uint8_t* getPixelAddress(int x, int y) const override {
@@ -93,11 +365,18 @@ namespace doc {
       return (uint8_t*)address(x, y);
     }
 
+    const uint8_t* readPixelAddress(int x, int y) const override {
+      ASSERT(x >= 0 && x < width());
+      ASSERT(y >= 0 && y < height());
+
+      return (const uint8_t*)readAddress(x, y);
+    }
+
     color_t getPixel(int x, int y) const override {
       ASSERT(x >= 0 && x < width());
       ASSERT(y >= 0 && y < height());
 
-      return *address(x, y);
+      return *readAddress(x, y);
     }
 
     void putPixel(int x, int y, color_t color) override {
@@ -108,6 +387,9 @@ namespace doc {
     }
 
     void clear(color_t color) override {
+      if (clearSparse(color))
+        return;
+
       const int w = width();
       const int h = height();
       for (int y=0; y<h; ++y) {
@@ -118,21 +400,30 @@ namespace doc {
 
     void copy(const Image* _src, gfx::Clip area) override {
       const ImageImpl<Traits>* src = (const ImageImpl<Traits>*)_src;
-      address_t src_address;
+      const_address_t src_address;
       address_t dst_address;
 
       if (!area.clip(width(), height(), src->width(), src->height()))
         return;
 
+      // Don't touch the zero pages of sparse images
+      const bool sparse = isSparse();
+
       for (int end_y=area.dst.y+area.size.h;
            area.dst.y<end_y;
            ++area.dst.y, ++area.src.y) {
-        src_address = src->address(area.src.x, area.src.y);
+        src_address = src->readAddress(area.src.x, area.src.y);
         dst_address = address(area.dst.x, area.dst.y);
 
-        std::copy(src_address,
-                  src_address + area.size.w,
-                  dst_address);
+        if (sparse) {
+          ImageBufferPool::copySparse(dst_address, src_address,
+                                      sizeof(*src_address) * area.size.w);
+        }
+        else {
+          std::copy(src_address,
+                    src_address + area.size.w,
+                    dst_address);
+        }
       }
     }
 
@@ -161,6 +452,17 @@ namespace doc {
     }
 
   private:
+    // Clears a sparse image with zeros releasing its pages.
+    bool clearSparse(color_t color) {
+      if (color != 0 || !isSparse())
+        return false;
+
+      unshare();
+      ImageBufferPool::zeroSparse((uint8_t*)m_bits.load(std::memory_order_relaxed),
+                                  m_rowBytes * height());
+      return true;
+    }
+
     bool clip_rects(const Image* src, int& dst_x, int& dst_y, int& src_x, int& src_y, int& w, int& h) const {
       // Clip with destionation image
       if (dst_x < 0) {
@@ -222,12 +524,18 @@ namespace doc {
 
   template<>
   inline void ImageImpl<IndexedTraits>::clear(color_t color) {
+    if (clearSparse(color))
+      return;
+
     uint8_t* p = address(0, 0);
     std::fill(p, p+rowBytes()*height(), color);
   }
 
   template<>
   inline void ImageImpl<BitmapTraits>::clear(color_t color) {
+    if (clearSparse(color))
+      return;
+
     uint8_t* p = address(0, 0);
     std::fill(p, p+rowBytes()*height(), (color ? 0xff: 0x00));
   }
@@ -253,6 +561,38 @@ namespace doc {
       (*(getLineAddress(y) + d.quot)) &= ~(1 << d.rem);
   }
 
+  template<>
+  inline void ImageImpl<BitmapTraits>::drawHLine(int x1, int y, int x2, color_t color) {
+    if (x1 > x2)
+      return;
+
+    ASSERT(x1 >= 0 && x2 < width());
+    ASSERT(y >= 0 && y < height());
+
+    // Fill whole bytes at once (only the first and last bytes are
+    // partially modified)
+    uint8_t* p = getLineAddress(y);
+    const int b1 = x1 / 8;
+    const int b2 = x2 / 8;
+    const uint8_t mask1 = uint8_t(0xff << (x1 % 8));
+    const uint8_t mask2 = uint8_t(0xff >> (7 - x2 % 8));
+    if (b1 == b2) {
+      if (color) p[b1] |= (mask1 & mask2);
+      else       p[b1] &= ~(mask1 & mask2);
+    }
+    else {
+      if (color) {
+        p[b1] |= mask1;
+        p[b2] |= mask2;
+      }
+      else {
+        p[b1] &= ~mask1;
+        p[b2] &= ~mask2;
+      }
+      std::fill(p+b1+1, p+b2, (color ? 0xff: 0x00));
+    }
+  }
+
   template<>
   inline void ImageImpl<BitmapTraits>::fillRect(int x1, int y1, int x2, int y2, color_t color) {
     for (int y=y1; y<=y2; ++y)
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2023 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -17,6 +17,7 @@
 #include <cstdlib>
 
 #include <iostream>
+#include <type_traits>
 
 namespace doc {
 
@@ -48,7 +49,7 @@ namespace doc {
 
     ImageIteratorT(const Image* image, const gfx::Rect& bounds, int x, int y) :
       m_image(const_cast<Image*>(image)),
-      m_ptr(get_pixel_address_fast<ImageTraits>(image, x, y)),
+      m_ptr(pixelAddress(image, x, y)),
       m_x(x),
       m_y(y),
       m_xbegin(bounds.x),
@@ -102,7 +103,7 @@ namespace doc {
         ++m_y;
 
         if (m_y < m_image->height())
-          m_ptr = get_pixel_address_fast<ImageTraits>(m_image, m_x, m_y);
+          m_ptr = pixelAddress(m_image, m_x, m_y);
       }
 
       return *this;
@@ -126,6 +127,15 @@ namespace doc {
     int y() const { return m_y; }
 
   private:
+    // Const iterators only read pixels, so they must not unshare
+    // pixels shared with other images (see ImageImpl::unshare()).
+    static pointer pixelAddress(const Image* image, int x, int y) {
+      if constexpr (std::is_const_v<std::remove_pointer_t<pointer>>)
+        return get_pixel_address_fast<ImageTraits>(image, x, y);
+      else
+        return get_pixel_address_fast<ImageTraits>(const_cast<Image*>(image), x, y);
+    }
+
     Image* m_image = nullptr;
     pointer m_ptr = nullptr;
     int m_x = 0, m_y = 0;
@@ -275,7 +285,7 @@ namespace doc {
 
     ImageIteratorT(const Image* image, const gfx::Rect& bounds, int x, int y) :
       m_image(const_cast<Image*>(image)),
-      m_ptr(get_pixel_address_fast<BitmapTraits>(image, x, y)),
+      m_ptr(pixelAddress(image, x, y)),
       m_x(x),
       m_y(y),
       m_subPixel(x % 8),
@@ -329,7 +339,7 @@ namespace doc {
         ++m_y;
 
         if (m_y < m_image->height())
-          m_ptr = get_pixel_address_fast<BitmapTraits>(m_image, m_x, m_y);
+          m_ptr = pixelAddress(m_image, m_x, m_y);
         else
           ++m_ptr;
       }
@@ -367,6 +377,15 @@ namespace doc {
     int y() const { return m_y; }
 
   private:
+    // Const iterators only read pixels, so they must not unshare
+    // pixels shared with other images (see ImageImpl::unshare()).
+    static pointer pixelAddress(const Image* image, int x, int y) {
+      if constexpr (std::is_const_v<std::remove_pointer_t<pointer>>)
+        return get_pixel_address_fast<BitmapTraits>(image, x, y);
+      else
+        return get_pixel_address_fast<BitmapTraits>(const_cast<Image*>(image), x, y);
+    }
+
     Image* m_image = nullptr;
     pointer m_ptr = nullptr;
     int m_x = 0, m_y = 0;
@@ -0,0 +1,126 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/image_rle.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace doc {
+
+namespace {
+
+constexpr int kRunBit = 0x8000;
+constexpr int kMaxPacket = 0x8000;
+
+inline bool same_pixel(const uint8_t* a, const uint8_t* b, const int pixelSize)
+{
+  return std::memcmp(a, b, pixelSize) == 0;
+}
+
+inline void add_header(base::buffer& output, const int header)
+{
+  output.push_back(header & 0xff);
+  output.push_back((header >> 8) & 0xff);
+}
+
+// Returns the number of pixels equal to row[i] starting from i
+int run_length(const uint8_t* row, const int i, const int n, const int pixelSize)
+{
+  const uint8_t* p = row + i*pixelSize;
+  int j = i+1;
+  for (const int end=std::min(n, i+kMaxPacket); j<end; ++j) {
+    if (!same_pixel(p, row + j*pixelSize, pixelSize))
+      break;
+  }
+  return j - i;
+}
+
+} // anonymous namespace
+
+void rle_encode_row(const uint8_t* row, const int n, const int pixelSize,
+                    base::buffer& output)
+{
+  // Runs of 2 pixels are not worth it for 1-byte pixels
+  const int minRun = (pixelSize == 1 ? 3: 2);
+
+  int i = 0;
+  while (i < n) {
+    int run = run_length(row, i, n, pixelSize);
+    if (run >= minRun) {
+      add_header(output, kRunBit | (run-1));
+      output.insert(output.end(), row + i*pixelSize, row + (i+1)*pixelSize);
+      i += run;
+      continue;
+    }
+
+    // Literal pixels until the next run
+    int j = i + run;
+    while (j < n && j-i < kMaxPacket) {
+      run = run_length(row, j, n, pixelSize);
+      if (run >= minRun)
+        break;
+      j += run;
+    }
+    j = std::min(j, i+kMaxPacket);
+
+    add_header(output, j-i-1);
+    output.insert(output.end(), row + i*pixelSize, row + j*pixelSize);
+    i = j;
+  }
+}
+
+bool rle_decode_row(const base::buffer& input, std::size_t& pos,
+                    uint8_t* row, const int n, const int pixelSize,
+                    const bool skipZeros)
+{
+  int i = 0;
+  while (i < n) {
+    if (pos+2 > input.size())
+      return false;
+
+    const int header = input[pos] | (input[pos+1] << 8);
+    const int count = (header & (kRunBit-1)) + 1;
+    pos += 2;
+    if (i+count > n)
+      return false;
+
+    uint8_t* dst = row + i*pixelSize;
+    if (header & kRunBit) {
+      if (pos+pixelSize > input.size())
+        return false;
+
+      const uint8_t* pixel = &input[pos];
+      if (!skipZeros ||
+          std::any_of(pixel, pixel+pixelSize, [](uint8_t b){ return b != 0; })) {
+        if (pixelSize == 1) {
+          std::memset(dst, *pixel, count);
+        }
+        else {
+          for (int j=0; j<count; ++j, dst+=pixelSize)
+            std::memcpy(dst, pixel, pixelSize);
+        }
+      }
+      pos += pixelSize;
+    }
+    else {
+      const std::size_t size = std::size_t(count)*pixelSize;
+      if (pos+size > input.size())
+        return false;
+
+      std::memcpy(dst, &input[pos], size);
+      pos += size;
+    }
+    i += count;
+  }
+  return true;
+}
+
+} // namespace doc
@@ -0,0 +1,42 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_IMAGE_RLE_H_INCLUDED
+#define DOC_IMAGE_RLE_H_INCLUDED
+#pragma once
+
+#include "base/buffer.h"
+#include "base/ints.h"
+
+#include <cstddef>
+
+namespace doc {
+
+  // Simple RLE of pixels used to keep the pixels of images
+  // compressed in memory (see Image::releasePixels()). It's fast to
+  // compress/decompress, and pixel art (and transparent areas) have
+  // a lot of runs of equal pixels.
+  //
+  // Each row is a sequence of packets with a 16-bit header: if the
+  // high bit is 1 it's a run of N equal pixels (followed by one
+  // pixel), in other case N different pixels follow the header.
+
+  // Appends the compressed "row" ("n" pixels of "pixelSize" bytes)
+  // to "output".
+  void rle_encode_row(const uint8_t* row, int n, int pixelSize,
+                      base::buffer& output);
+
+  // Decompresses one row from "input" starting at "pos" (which is
+  // updated to the next row). If "skipZeros" is true, runs of zeros
+  // are not written (e.g. because the row is already filled with
+  // zeros). Returns false if the input data is invalid.
+  bool rle_decode_row(const base::buffer& input, std::size_t& pos,
+                      uint8_t* row, int n, int pixelSize,
+                      bool skipZeros);
+
+} // namespace doc
+
+#endif
@@ -0,0 +1,150 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/image_rle.h"
+#include "doc/primitives.h"
+
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace doc;
+
+TEST(ImageRle, EncodeDecodeRows)
+{
+  std::mt19937 rng(1);
+  for (int pixelSize : { 1, 2, 4 }) {
+    for (int n : { 1, 2, 3, 17, 1000, 70000 }) {
+      std::vector<uint8_t> row(n*pixelSize);
+      for (int i=0; i<n; ) {
+        // Runs of random pixels (and some literals)
+        const int len = std::min<int>(n-i, (rng() % 3 == 0 ? 1: rng() % 40000));
+        const uint8_t v = (rng() % 2 ? 0: rng());
+        std::fill(row.begin()+i*pixelSize, row.begin()+(i+len)*pixelSize, v);
+        i += len;
+      }
+
+      base::buffer data;
+      rle_encode_row(row.data(), n, pixelSize, data);
+      rle_encode_row(row.data(), n, pixelSize, data);
+
+      std::size_t pos = 0;
+      for (bool skipZeros : { false, true }) {
+        std::vector<uint8_t> result(n*pixelSize, 0);
+        ASSERT_TRUE(rle_decode_row(data, pos, result.data(), n, pixelSize, skipZeros));
+        EXPECT_EQ(row, result);
+      }
+      EXPECT_EQ(data.size(), pos);
+
+      // Truncated data
+      data.resize(data.size()/2 - 1);
+      std::vector<uint8_t> result(n*pixelSize);
+      pos = 0;
+      bool ok = true;
+      for (int i=0; i<2 && ok; ++i)
+        ok = rle_decode_row(data, pos, result.data(), n, pixelSize, false);
+      EXPECT_FALSE(ok);
+    }
+  }
+}
+
+TEST(ImageRle, ReleasePixels)
+{
+  std::mt19937 rng(2);
+  for (PixelFormat format : { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED,
+                              IMAGE_BITMAP, IMAGE_TILEMAP }) {
+    ImageRef image(Image::create(format, 97, 53));
+    image->clear(0);
+    for (int i=0; i<500; ++i)
+      put_pixel(image.get(), rng() % 97, rng() % 53, rng() % 2);
+    fill_rect(image.get(), 10, 10, 60, 30, 1);
+
+    ImageRef original(Image::create(format, 97, 53));
+    copy_image(original.get(), image.get());
+    const ObjectId id = image->id();
+
+    base::buffer data;
+    image->compressPixels(data);
+    // Random bits in bitmaps are not compressed at all
+    if (format != IMAGE_BITMAP)
+      EXPECT_LT(data.size(), std::size_t(image->rowBytes() * image->height()));
+    EXPECT_TRUE(image->releasePixels(std::move(data)));
+    EXPECT_TRUE(image->hasReleasedPixels());
+    EXPECT_FALSE(image->releasePixels(base::buffer()));
+
+    // Decompressed on the first access
+    EXPECT_EQ(0, count_diff_between_images(image.get(), original.get()));
+    EXPECT_FALSE(image->hasReleasedPixels());
+    EXPECT_EQ(id, image->id());
+
+    // Pixels shared with a copy cannot be released
+    ImageRef copy(Image::createCopy(image.get()));
+    image->compressPixels(data);
+    EXPECT_FALSE(image->releasePixels(std::move(data)));
+    put_pixel(copy.get(), 0, 0, 1);
+    image->compressPixels(data);
+    EXPECT_TRUE(image->releasePixels(std::move(data)));
+
+    // Pinned pixels cannot be released, and a released image is
+    // decompressed to pin its pixels
+    {
+      ImageBufferPtr pinned = image->pinPixels();
+      EXPECT_TRUE(pinned != nullptr);
+      EXPECT_FALSE(image->hasReleasedPixels());
+      image->compressPixels(data);
+      EXPECT_FALSE(image->releasePixels(std::move(data)));
+    }
+    image->compressPixels(data);
+    EXPECT_TRUE(image->releasePixels(std::move(data)));
+
+    // A write access decompresses the pixels too
+    put_pixel(image.get(), 1, 1, 1);
+    put_pixel(original.get(), 1, 1, 1);
+    EXPECT_EQ(0, count_diff_between_images(image.get(), original.get()));
+  }
+}
+
+TEST(ImageRle, DecompressFromSeveralThreads)
+{
+  ImageRef image(Image::create(IMAGE_RGB, 256, 256));
+  for (int y=0; y<256; ++y)
+    for (int x=0; x<256; ++x)
+      put_pixel(image.get(), x, y, rgba(x, y, 0, 255));
+
+  base::buffer data;
+  image->compressPixels(data);
+  ASSERT_TRUE(image->releasePixels(std::move(data)));
+
+  std::vector<std::thread> threads;
+  std::vector<int> errors(4, 0);
+  for (int i=0; i<4; ++i) {
+    threads.emplace_back([&image, &errors, i]{
+      for (int y=0; y<256; ++y)
+        for (int x=0; x<256; ++x)
+          if (get_pixel(image.get(), x, y) != rgba(x, y, 0, 255))
+            ++errors[i];
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+
+  for (int i=0; i<4; ++i)
+    EXPECT_EQ(0, errors[i]);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
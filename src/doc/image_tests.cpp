@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2018 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -14,7 +14,9 @@
 #include "doc/image_impl.h"
 #include "doc/primitives.h"
 
+#include <atomic>
 #include <memory>
+#include <thread>
 
 using namespace base;
 using namespace doc;
@@ -225,6 +227,160 @@ TYPED_TEST(ImageAllTypes, FillRect)
   }
 }
 
+TYPED_TEST(ImageAllTypes, CopyOnWrite)
+{
+  typedef TypeParam ImageTraits;
+
+  const int w = 33, h = 17;
+  std::unique_ptr<Image> image(Image::create(ImageTraits::pixel_format, w, h));
+  for (int v=0; v<h; ++v)
+    for (int u=0; u<w; ++u)
+      put_pixel_fast<ImageTraits>(image.get(), u, v, (u+v) % 2);
+
+  // The copy shares the pixels with the original image
+  std::unique_ptr<Image> copy(Image::createCopy(image.get()));
+  EXPECT_EQ(image->pixelFormat(), copy->pixelFormat());
+  EXPECT_EQ(image->bounds(), copy->bounds());
+  EXPECT_EQ(0, count_diff_between_images(image.get(), copy.get()));
+
+  // Modifying one of them (with any of the write functions) doesn't
+  // modify the other one
+  std::unique_ptr<Image> copy2(Image::createCopy(copy.get()));
+  put_pixel_fast<ImageTraits>(image.get(), 0, 0, 1);
+  EXPECT_EQ(0, get_pixel_fast<ImageTraits>(copy.get(), 0, 0));
+  EXPECT_EQ(0, get_pixel_fast<ImageTraits>(copy2.get(), 0, 0));
+
+  copy->clear(1);
+  EXPECT_EQ(1, get_pixel(copy.get(), 1, 0));
+  EXPECT_EQ(1, get_pixel(image.get(), 1, 0));
+  EXPECT_EQ(1, get_pixel(copy2.get(), 1, 0));
+  EXPECT_EQ(0, get_pixel(image.get(), 2, 0));
+  EXPECT_EQ(0, get_pixel(copy2.get(), 2, 0));
+
+  fill_rect(copy2.get(), 0, 0, w-1, h-1, 1);
+  EXPECT_EQ(0, get_pixel(image.get(), 2, 0));
+  EXPECT_EQ(1, get_pixel(copy2.get(), 2, 0));
+
+  {
+    LockImageBits<ImageTraits> bits(image.get(), Image::WriteLock);
+    for (auto it=bits.begin(), end=bits.end(); it!=end; ++it)
+      *it = 0;
+  }
+  std::unique_ptr<Image> copy3(Image::createCopy(image.get()));
+  *image->getPixelAddress(0, 1) = 1;
+  EXPECT_EQ(1, get_pixel(image.get(), 0, 1));
+  EXPECT_EQ(0, get_pixel(copy3.get(), 0, 1));
+  EXPECT_EQ(1, get_pixel(copy.get(), 0, 1));
+  EXPECT_EQ(1, get_pixel(copy2.get(), 0, 1));
+}
+
+TYPED_TEST(ImageAllTypes, ReadingDoesntUnsharePixels)
+{
+  typedef TypeParam ImageTraits;
+
+  std::unique_ptr<Image> image(Image::create(ImageTraits::pixel_format, 33, 17));
+  std::unique_ptr<Image> copy(Image::createCopy(image.get()));
+  const Image* constCopy = copy.get();
+
+  {
+    const LockImageBits<ImageTraits> bits(constCopy);
+    int n = 0;
+    for (auto it=bits.begin(), end=bits.end(); it!=end; ++it)
+      n += (*it ? 1: 0);
+    EXPECT_EQ(0, n);
+  }
+  EXPECT_EQ(0, get_pixel_fast<ImageTraits>(constCopy, 0, 0));
+  EXPECT_EQ(image->readPixelAddress(0, 0),
+            (const uint8_t*)get_pixel_address_fast<ImageTraits>(constCopy, 0, 0));
+  EXPECT_EQ(image->readPixelAddress(0, 0), copy->readPixelAddress(0, 0));
+
+  // Only write access unshares the pixels
+  {
+    LockImageBits<ImageTraits> bits(copy.get(), Image::WriteLock);
+    *bits.begin() = 1;
+  }
+  EXPECT_NE(image->readPixelAddress(0, 0), copy->readPixelAddress(0, 0));
+  EXPECT_EQ(0, get_pixel_fast<ImageTraits>(image.get(), 0, 0));
+  EXPECT_EQ(1, get_pixel_fast<ImageTraits>(copy.get(), 0, 0));
+}
+
+TEST(Image, ReadWhileOtherThreadUnsharesPixels)
+{
+  const int w = 64, h = 64;
+  const color_t color = rgba(255, 0, 0, 255);
+  std::unique_ptr<Image> image(Image::create(IMAGE_RGB, w, h));
+  image->clear(color);
+
+  for (int i=0; i<100; ++i) {
+    std::unique_ptr<Image> copy(Image::createCopy(image.get()));
+    const Image* constCopy = copy.get();
+
+    std::atomic<bool> started(false);
+    int invalid = 0;
+    std::thread reader([&]{
+      started = true;
+      for (int j=0; j<4; ++j)
+        for (int y=0; y<h; ++y)
+          for (int x=0; x<w; ++x)
+            if (get_pixel_fast<RgbTraits>(constCopy, x, y) != color)
+              ++invalid;
+    });
+    while (!started)
+      std::this_thread::yield();
+
+    // Unshare the pixels (copying them to a new buffer) and destroy
+    // the original image while the other thread is reading the old
+    // buffer
+    copy->getPixelAddress(0, 0);
+    image.reset(Image::createCopy(copy.get()));
+
+    reader.join();
+    EXPECT_EQ(0, invalid);
+  }
+}
+
+TEST(Image, CopyWithBufferDoesntSharePixels)
+{
+  ImageBufferPtr buffer = std::make_shared<ImageBuffer>();
+  std::unique_ptr<Image> image(Image::create(IMAGE_RGB, 8, 8, buffer));
+  image->clear(rgba(255, 0, 0, 255));
+
+  // The buffer can be reused for other images, so the copy cannot
+  // share it
+  std::unique_ptr<Image> copy(Image::createCopy(image.get()));
+  std::unique_ptr<Image> other(Image::create(IMAGE_RGB, 8, 8, buffer));
+  EXPECT_EQ(rgba(255, 0, 0, 255), get_pixel(copy.get(), 3, 3));
+}
+
+TEST(Image, CompressedDataInvalidatedByInPlaceWrites)
+{
+  std::unique_ptr<Image> image(Image::create(IMAGE_RGB, 8, 8));
+  image->clear(rgba(255, 0, 0, 255));
+
+  base::buffer data(16, 1);
+  image->setCompressedData(data);
+  EXPECT_TRUE(image->hasValidCompressedData());
+
+  // Modify pixels without incrementing the image version
+  put_pixel(image.get(), 3, 3, rgba(0, 0, 255, 255));
+  EXPECT_FALSE(image->hasValidCompressedData());
+
+  put_pixel(image.get(), 3, 3, rgba(255, 0, 0, 255));
+  EXPECT_TRUE(image->hasValidCompressedData());
+
+  image->incrementVersion();
+  EXPECT_FALSE(image->hasValidCompressedData());
+
+  // Same with a content hash calculated by the caller
+  uint64_t hash = calculate_image_content_hash(image.get());
+  image->setCompressedData(data, hash);
+  EXPECT_TRUE(image->hasValidCompressedData(hash));
+
+  put_pixel(image.get(), 3, 3, rgba(0, 0, 255, 255));
+  hash = calculate_image_content_hash(image.get());
+  EXPECT_FALSE(image->hasValidCompressedData(hash));
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
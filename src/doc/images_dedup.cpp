@@ -0,0 +1,50 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/images_dedup.h"
+
+#include "doc/images_map.h"
+
+namespace doc {
+
+std::vector<DuplicatedImage> find_duplicated_images(const std::vector<ImageRef>& images)
+{
+  std::vector<DuplicatedImage> dups;
+  ImagesMap map;
+  for (const ImageRef& image : images) {
+    // Don't decompress images just to compare them
+    if (image->hasReleasedPixels())
+      continue;
+
+    auto it = map.find(image);
+    if (it == map.end())
+      map.insert(std::make_pair(image, 0));
+    else if (it->first != image)
+      dups.push_back(DuplicatedImage{ image, it->first });
+  }
+  return dups;
+}
+
+int share_duplicated_images(const std::vector<DuplicatedImage>& dups)
+{
+  int n = 0;
+  for (const DuplicatedImage& dup : dups) {
+    if (dup.image->sharePixelsWith(dup.original.get()))
+      ++n;
+  }
+  return n;
+}
+
+int share_duplicated_images(const std::vector<ImageRef>& images)
+{
+  return share_duplicated_images(find_duplicated_images(images));
+}
+
+} // namespace doc
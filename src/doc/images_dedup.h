@@ -0,0 +1,37 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_IMAGES_DEDUP_H_INCLUDED
+#define DOC_IMAGES_DEDUP_H_INCLUDED
+#pragma once
+
+#include "doc/image_ref.h"
+
+#include <vector>
+
+namespace doc {
+
+  // An image with the same pixels of other "original" image.
+  struct DuplicatedImage {
+    ImageRef image;
+    ImageRef original;
+  };
+
+  // Finds images with the same pixels (using an ImagesMap). Images
+  // with released pixels are ignored. It doesn't modify the images,
+  // so it can be used from a background thread while the images are
+  // not being modified.
+  std::vector<DuplicatedImage> find_duplicated_images(const std::vector<ImageRef>& images);
+
+  // Makes each duplicated image share the pixels of its original
+  // (see Image::sharePixelsWith()). Returns the number of images
+  // that started sharing pixels.
+  int share_duplicated_images(const std::vector<DuplicatedImage>& dups);
+  int share_duplicated_images(const std::vector<ImageRef>& images);
+
+} // namespace doc
+
+#endif
@@ -0,0 +1,56 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/image.h"
+#include "doc/images_dedup.h"
+#include "doc/primitives.h"
+
+using namespace doc;
+
+TEST(ImagesDedup, SharePixels)
+{
+  ImageRef a(Image::create(IMAGE_RGB, 16, 16));
+  ImageRef b(Image::create(IMAGE_RGB, 16, 16));
+  ImageRef c(Image::create(IMAGE_RGB, 16, 16));
+  ImageRef d(Image::create(IMAGE_INDEXED, 16, 16));
+  for (auto& image : { a, b, c })
+    image->clear(rgba(255, 0, 0, 255));
+  c->putPixel(3, 4, rgba(0, 0, 255, 255));
+
+  const std::vector<ImageRef> images = { a, b, c, d, a };
+  const auto dups = find_duplicated_images(images);
+  ASSERT_EQ(1u, dups.size());
+  EXPECT_EQ(b, dups[0].image);
+  EXPECT_EQ(a, dups[0].original);
+
+  // The pixels are shared after the first call
+  EXPECT_EQ(1, share_duplicated_images(images));
+  EXPECT_EQ(a->readPixelAddress(0, 0), b->readPixelAddress(0, 0));
+  EXPECT_EQ(0, share_duplicated_images(images));
+
+  // Modifying one image doesn't modify the other one
+  b->putPixel(0, 0, rgba(0, 255, 0, 255));
+  EXPECT_NE(a->readPixelAddress(0, 0), b->readPixelAddress(0, 0));
+  EXPECT_EQ(rgba(255, 0, 0, 255), a->getPixel(0, 0));
+  EXPECT_EQ(rgba(0, 255, 0, 255), b->getPixel(0, 0));
+
+  // Reading doesn't unshare pixels
+  ImageRef e(Image::createCopy(a.get()));
+  EXPECT_TRUE(is_same_image(a.get(), e.get()));
+  EXPECT_EQ(a->readPixelAddress(0, 0), e->readPixelAddress(0, 0));
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2019-2021  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -270,13 +270,13 @@ void LayerImage::destroyAllCels()
     delete cel;
   }
   m_cels.clear();
+  m_celsByFrame.clear();
 }
 
 Cel* LayerImage::cel(frame_t frame) const
 {
-  CelConstIterator it = findCelIterator(frame);
-  if (it != getCelEnd())
-    return *it;
+  if (frame >= 0 && frame < frame_t(m_celsByFrame.size()))
+    return m_celsByFrame[frame];
   else
     return nullptr;
 }
@@ -350,6 +350,17 @@ void LayerImage::addCel(Cel* cel)
   CelIterator it = findFirstCelIteratorAfter(cel->frame());
   m_cels.insert(it, cel);
 
+  const frame_t frame = cel->frame();
+  ASSERT(frame >= 0);
+  if (frame >= 0) {
+    if (frame >= frame_t(m_celsByFrame.size()))
+      m_celsByFrame.resize(frame+1, nullptr);
+    ASSERT(!m_celsByFrame[frame]);
+    // Keep the first cel of the list if there are two in the same frame
+    if (!m_celsByFrame[frame])
+      m_celsByFrame[frame] = cel;
+  }
+
   cel->setParentLayer(this);
 }
 
@@ -367,6 +378,16 @@ void LayerImage::removeCel(Cel* cel)
 
   m_cels.erase(it);
 
+  const frame_t frame = cel->frame();
+  if (frame >= 0 && frame < frame_t(m_celsByFrame.size())) {
+    it = findCelIterator(frame);
+    m_celsByFrame[frame] = (it != m_cels.end() ? *it: nullptr);
+
+    // Remove empty frames at the end
+    while (!m_celsByFrame.empty() && !m_celsByFrame.back())
+      m_celsByFrame.pop_back();
+  }
+
   cel->setParentLayer(NULL);
 }
 
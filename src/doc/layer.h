@@ -17,6 +17,7 @@
 #include "doc/with_user_data.h"
 
 #include <string>
+#include <vector>
 
 namespace doc {
 
@@ -184,6 +185,11 @@ namespace doc {
     BlendMode m_blendmode;
     int m_opacity;
     CelList m_cels;   // List of all cels inside this layer used by frames.
+
+    // Cels indexed by frame (nullptr if there is no cel in a frame)
+    // to get the cel of a specific frame in O(1). It's kept in sync
+    // with m_cels in addCel()/removeCel().
+    std::vector<Cel*> m_celsByFrame;
   };
 
   //////////////////////////////////////////////////////////////////////
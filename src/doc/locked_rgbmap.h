@@ -0,0 +1,97 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_LOCKED_RGBMAP_H_INCLUDED
+#define DOC_LOCKED_RGBMAP_H_INCLUDED
+#pragma once
+
+#include "base/debug.h"
+#include "doc/rgbmap.h"
+
+#include <array>
+#include <mutex>
+
+namespace doc {
+
+  // Makes possible to use one RgbMap from several threads. The RgbMap
+  // implementations calculate their entries lazily, so
+  // RgbMap::mapColor() cannot be called from two threads at the same
+  // time. Each thread must use its own LockedRgbMap: it caches the
+  // already mapped colors, and locks the given mutex only to ask the
+  // shared RgbMap for new colors.
+  class LockedRgbMap : public RgbMap {
+  public:
+    LockedRgbMap(const RgbMap* rgbmap, std::mutex& mutex)
+      : m_rgbmap(rgbmap)
+      , m_mutex(mutex) {
+      ASSERT(m_rgbmap);
+      m_cache.fill(Entry{ 0, -1 });
+    }
+
+    // RgbMap impl
+    void regenerateMap(const Palette* palette, const int maskIndex) override {
+      // The shared RgbMap must be regenerated before creating the
+      // LockedRgbMap instances.
+      ASSERT(false);
+    }
+
+    int mapColor(const color_t rgba) const override {
+      Entry& entry = m_cache[hash(rgba)];
+      if (entry.index < 0 || entry.color != rgba) {
+        const std::lock_guard lock(m_mutex);
+        entry.color = rgba;
+        entry.index = m_rgbmap->mapColor(rgba);
+      }
+      return entry.index;
+    }
+
+    // Locks the mutex only once for all the colors of the span that
+    // are not in the cache.
+    void mapColors(const color_t* colors, uint8_t* indexes, const int n) const override {
+      bool misses = false;
+      for (int i=0; i<n; ++i) {
+        const Entry& entry = m_cache[hash(colors[i])];
+        if (entry.index < 0 || entry.color != colors[i])
+          misses = true;
+        else
+          indexes[i] = entry.index;
+      }
+      if (!misses)
+        return;
+
+      const std::lock_guard lock(m_mutex);
+      for (int i=0; i<n; ++i) {
+        Entry& entry = m_cache[hash(colors[i])];
+        if (entry.index < 0 || entry.color != colors[i]) {
+          entry.color = colors[i];
+          entry.index = m_rgbmap->mapColor(colors[i]);
+        }
+        indexes[i] = entry.index;
+      }
+    }
+
+    int maskIndex() const override { return m_rgbmap->maskIndex(); }
+
+  private:
+    static constexpr std::size_t kCacheSize = 4096;
+
+    static std::size_t hash(const color_t rgba) {
+      return (rgba ^ (rgba >> 12) ^ (rgba >> 20)) & (kCacheSize-1);
+    }
+
+    struct Entry {
+      color_t color;
+      int index;
+    };
+
+    const RgbMap* m_rgbmap;
+    std::mutex& m_mutex;
+    mutable std::array<Entry, kCacheSize> m_cache;
+  };
+
+} // namespace doc
+
+#endif
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -13,38 +13,14 @@
 
 #include "base/memory.h"
 #include "doc/image_impl.h"
+#include "doc/mask_runs.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 
 namespace doc {
 
-namespace {
-
-  template<typename Func>
-  void for_each_mask_pixel(Mask& a, const Mask& b, Func f) {
-    a.reserve(b.bounds());
-
-    {
-      LockImageBits<BitmapTraits> aBits(a.bitmap());
-      auto aIt = aBits.begin();
-
-      auto bounds = a.bounds();
-      for (int y=0; y<bounds.h; ++y) {
-        for (int x=0; x<bounds.w; ++x, ++aIt) {
-          color_t aColor = *aIt;
-          color_t bColor = (b.containsPoint(bounds.x+x,
-                                            bounds.y+y) ? 1: 0);
-          *aIt = f(aColor, bColor);
-        }
-      }
-    }
-
-    a.shrink();
-  }
-
-} // namespace namespace
-
 Mask::Mask()
   : Object(ObjectType::Mask)
 {
@@ -167,34 +143,85 @@ void Mask::replace(const gfx::Rect& bounds)
   clear_image(m_bitmap.get(), 1);
 }
 
+// The operations with other masks use the runs of the other mask, so
+// we only visit the rows/pixels of the other mask that are selected.
+
 void Mask::add(const doc::Mask& mask)
 {
-  for_each_mask_pixel(
-    *this, mask,
-    [](color_t a, color_t b) -> color_t {
-      return a | b;
-    });
+  if (!mask.bitmap())
+    return;
+
+  reserve(mask.bounds());
+
+  const MaskRuns runs(mask.bitmap());
+  const gfx::Point delta = mask.bounds().origin() - m_bounds.origin();
+  for (int y=0; y<runs.height(); ++y) {
+    for (const auto& run : runs.row(y))
+      m_bitmap->drawHLine(delta.x+run.x, delta.y+y, delta.x+run.x2-1, 1);
+  }
+
+  shrink();
 }
 
 void Mask::subtract(const doc::Mask& mask)
 {
-  for_each_mask_pixel(
-    *this, mask,
-    [](color_t a, color_t b) -> color_t {
-      if (a)
-        return a - b;
-      else
-        return 0;
-    });
+  if (!m_bitmap || !mask.bitmap())
+    return;
+
+  const gfx::Rect area = m_bounds.createIntersection(mask.bounds());
+  if (!area.isEmpty()) {
+    const MaskRuns runs(mask.bitmap());
+    const gfx::Point delta = mask.bounds().origin() - m_bounds.origin();
+    for (int y=area.y-m_bounds.y; y<area.y2()-m_bounds.y; ++y) {
+      for (const auto& run : runs.row(y-delta.y)) {
+        const int x1 = std::max(delta.x+run.x, 0);
+        const int x2 = std::min(delta.x+run.x2, m_bounds.w);
+        if (x1 < x2)
+          m_bitmap->drawHLine(x1, y, x2-1, 0);
+      }
+    }
+  }
+
+  shrink();
 }
 
 void Mask::intersect(const doc::Mask& mask)
 {
-  for_each_mask_pixel(
-    *this, mask,
-    [](color_t a, color_t b) -> color_t {
-      return a & b;
-    });
+  if (!m_bitmap)
+    return;
+
+  const gfx::Rect newBounds = m_bounds.createIntersection(mask.bounds());
+  if (!mask.bitmap() || newBounds.isEmpty()) {
+    clear();
+    return;
+  }
+
+  if (newBounds != m_bounds) {
+    m_bitmap.reset(
+      crop_image(m_bitmap.get(),
+                 newBounds.x-m_bounds.x,
+                 newBounds.y-m_bounds.y,
+                 newBounds.w,
+                 newBounds.h, 0));
+    m_bounds = newBounds;
+  }
+
+  // Clear the gaps between the runs of the other mask
+  const MaskRuns runs(mask.bitmap());
+  const gfx::Point delta = mask.bounds().origin() - m_bounds.origin();
+  for (int y=0; y<m_bounds.h; ++y) {
+    int x = 0;
+    for (const auto& run : runs.row(y-delta.y)) {
+      const int x1 = std::clamp(delta.x+run.x, 0, m_bounds.w);
+      if (x < x1)
+        m_bitmap->drawHLine(x, y, x1-1, 0);
+      x = std::max(x, std::clamp(delta.x+run.x2, 0, m_bounds.w));
+    }
+    if (x < m_bounds.w)
+      m_bitmap->drawHLine(x, y, m_bounds.w-1, 0);
+  }
+
+  shrink();
 }
 
 void Mask::add(const gfx::Rect& bounds)
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2020 Igara Studio S.A.
+// Copyright (c) 2020-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -95,6 +95,11 @@ namespace doc {
     void byColor(const Image* image, int color, int fuzziness);
     void crop(const Image* image);
 
+    // Sets the buffer used to create the bitmap in replace() and
+    // reserve(), so it can be reused when the mask is re-created
+    // frequently (e.g. on each mouse movement).
+    void setBuffer(const ImageBufferPtr& buffer) { m_buffer = buffer; }
+
     // Reserves a rectangle to draw onto the bitmap (you should call
     // shrink after you draw in the bitmap)
     void reserve(const gfx::Rect& bounds);
@@ -1,4 +1,5 @@
 // Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
 // Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -12,13 +13,54 @@
 
 #include "doc/image_impl.h"
 
+#include <atomic>
+#include <cstring>
+
 namespace doc {
 
+namespace {
+
+// Each change of any MaskBoundaries instance gets a new version
+// number, so versions of different instances never match.
+std::atomic<uint32_t> g_version(0);
+
+// Returns true if both bitmaps have the same size and pixels.
+bool same_bitmap(const Image* a, const Image* b)
+{
+  if (a->width() != b->width() ||
+      a->height() != b->height())
+    return false;
+
+  const int widthBytes = (a->width()+7) / 8;
+  const int lastBits = a->width() % 8;
+  const uint8_t lastByteMask = (lastBits ? (1 << lastBits) - 1: 0xff);
+
+  for (int y=0; y<a->height(); ++y) {
+    const uint8_t* p = a->getPixelAddress(0, y);
+    const uint8_t* q = b->getPixelAddress(0, y);
+    if (std::memcmp(p, q, widthBytes-1) != 0 ||
+        ((p[widthBytes-1] ^ q[widthBytes-1]) & lastByteMask) != 0)
+      return false;
+  }
+  return true;
+}
+
+} // anonymous namespace
+
+MaskBoundaries::MaskBoundaries()
+  : m_version(++g_version)
+{
+}
+
 void MaskBoundaries::reset()
 {
   m_segs.clear();
   if (!m_path.isEmpty())
     m_path.rewind();
+
+  m_bitmap.reset();
+  m_origin = gfx::Point(0, 0);
+  updateVersion();
 }
 
 void MaskBoundaries::regen(const Image* bitmap)
@@ -27,11 +69,16 @@ void MaskBoundaries::regen(const Image* bitmap)
 
   int x, y, w = bitmap->width(), h = bitmap->height();
 
-  const LockImageBits<BitmapTraits> bits(bitmap);
-  auto it = bits.begin();       // Current pixel iterator
-#if _DEBUG
-  auto prevIt = bits.begin();   // Previous row iterator (same X pos)
-#endif
+  // Current and previous rows (nullptr for the rows outside the
+  // bitmap, which are empty).
+  const uint8_t* row = nullptr;
+  const uint8_t* prevRow = nullptr;
+  auto pixel = [](const uint8_t* row, const int x) -> bool {
+    return (row && (row[x/8] & (1 << (x%8))));
+  };
+  auto byte = [](const uint8_t* row, const int i) -> uint8_t {
+    return (row ? row[i]: 0);
+  };
 
   // Vertical segments being expanded from the previous row.
   std::vector<int> vertSegs(w+1, -1);
@@ -66,10 +113,27 @@ void MaskBoundaries::regen(const Image* bitmap)
     bool prevColor = false;         // Previous color (X-1) same Y row
     horzSeg = -1;
 
+    prevRow = row;
+    row = (y < h ? bitmap->getPixelAddress(0, y): nullptr);
+
     for (x=0; x<=w; ++x) {
-      bool color = (x < w && y < h && *it ? true: false);
+      // Skip whole bytes of pixels equal to the previous pixel and
+      // the previous row (we are inside or outside the boundaries,
+      // there is no segment to create or expand). This is what makes
+      // sparse selections (big empty areas) fast.
+      if (x % 8 == 0 && horzSeg < 0) {
+        const uint8_t same = (prevColor ? 0xff: 0);
+        while (x+8 <= w &&
+               byte(row, x/8) == same &&
+               byte(prevRow, x/8) == same) {
+          ASSERT(vertSegs[x] < 0);
+          x += 8;
+        }
+      }
+
+      bool color = (x < w && pixel(row, x));
 #if _DEBUG
-      bool prevRowColor = (x < w && y > 0 && *prevIt ? true: false);
+      bool prevRowColor = (x < w && pixel(prevRow, x));
 #endif
       Segment* hseg = (horzSeg >= 0 ? &m_segs[horzSeg]: nullptr);
       Segment* vseg = (vertSegs[x] >= 0 ? &m_segs[vertSegs[x]]: nullptr);
@@ -326,17 +390,24 @@ void MaskBoundaries::regen(const Image* bitmap)
       }
 
       prevColor = color;
-      if (x < w) {
-#if _DEBUG
-        if (y > 0) ++prevIt;
-#endif
-        if (y < h) ++it;
-      }
     }
   }
+}
 
-  ASSERT(it == bits.end());
-  ASSERT(prevIt == bits.end());
+void MaskBoundaries::regen(const Image* bitmap, const gfx::Point& origin)
+{
+  // Same bitmap (e.g. the selection was moved, or the same selection
+  // is generated again), we can reuse the segments
+  if (m_bitmap && same_bitmap(m_bitmap.get(), bitmap)) {
+    if (origin != m_origin)
+      offset(origin.x - m_origin.x,
+             origin.y - m_origin.y);
+    return;
+  }
+
+  regen(bitmap);
+  offset(origin.x, origin.y);
+  m_bitmap.reset(Image::createCopy(bitmap));
 }
 
 void MaskBoundaries::offset(int x, int y)
@@ -345,6 +416,8 @@ void MaskBoundaries::offset(int x, int y)
     seg.offset(x, y);
 
   m_path.offset(x, y);
+  m_origin += gfx::Point(x, y);
+  updateVersion();
 }
 
 void MaskBoundaries::createPathIfNeeeded()
@@ -363,4 +436,9 @@ void MaskBoundaries::createPathIfNeeeded()
   }
 }
 
+void MaskBoundaries::updateVersion()
+{
+  m_version = ++g_version;
+}
+
 } // namespace doc
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2020 Igara Studio S.A.
+// Copyright (c) 2020-2024 Igara Studio S.A.
 // Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -9,9 +9,12 @@
 #define DOC_MASK_BOUNDARIES_H_INCLUDED
 #pragma once
 
+#include "doc/image_ref.h"
 #include "gfx/path.h"
+#include "gfx/point.h"
 #include "gfx/rect.h"
 
+#include <cstdint>
 #include <vector>
 
 namespace doc {
@@ -43,10 +46,22 @@ namespace doc {
     typedef list_type::iterator iterator;
     typedef list_type::const_iterator const_iterator;
 
+    MaskBoundaries();
+
     bool isEmpty() const { return m_segs.empty(); }
     void reset();
     void regen(const Image* bitmap);
 
+    // Regenerates the boundaries of the given bitmap located at
+    // "origin". If the bitmap has the same pixels that the one used
+    // in the previous call, the segments are reused (and offset if
+    // the origin is different).
+    void regen(const Image* bitmap, const gfx::Point& origin);
+
+    // Returns a different number each time the segments change, so
+    // paths created from the segments can be cached.
+    uint32_t version() const { return m_version; }
+
     const_iterator begin() const { return m_segs.begin(); }
     const_iterator end() const { return m_segs.end(); }
     iterator begin() { return m_segs.begin(); }
@@ -58,8 +73,16 @@ namespace doc {
     void createPathIfNeeeded();
 
   private:
+    void updateVersion();
+
     list_type m_segs;
     gfx::Path m_path;
+    uint32_t m_version;
+
+    // Copy of the bitmap used in the last regen(bitmap, origin) call,
+    // and the current offset of the segments.
+    ImageRef m_bitmap;
+    gfx::Point m_origin;
   };
 
 } // namespace doc
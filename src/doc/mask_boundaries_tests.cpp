@@ -0,0 +1,91 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/mask_boundaries.h"
+#include "doc/primitives.h"
+
+#include <random>
+#include <vector>
+
+using namespace doc;
+using namespace gfx;
+
+namespace {
+
+std::vector<Rect> segments(const MaskBoundaries& boundaries)
+{
+  std::vector<Rect> result;
+  for (const auto& seg : boundaries)
+    result.push_back(seg.bounds());
+  return result;
+}
+
+std::vector<Rect> expected_segments(const Image* bitmap, const Point& origin)
+{
+  MaskBoundaries boundaries;
+  boundaries.regen(bitmap);
+  boundaries.offset(origin.x, origin.y);
+  return segments(boundaries);
+}
+
+} // anonymous namespace
+
+TEST(MaskBoundaries, ReuseSegmentsOfSameBitmap)
+{
+  std::mt19937 rng(1);
+  ImageRef bitmap(Image::create(IMAGE_BITMAP, 37, 21));
+  for (int y=0; y<bitmap->height(); ++y)
+    for (int x=0; x<bitmap->width(); ++x)
+      put_pixel(bitmap.get(), x, y, rng() % 2);
+
+  MaskBoundaries boundaries;
+  boundaries.regen(bitmap.get(), Point(3, 4));
+  EXPECT_EQ(expected_segments(bitmap.get(), Point(3, 4)), segments(boundaries));
+
+  // Same bitmap in the same position, nothing changes
+  uint32_t version = boundaries.version();
+  ImageRef copy(Image::createCopy(bitmap.get()));
+  boundaries.regen(copy.get(), Point(3, 4));
+  EXPECT_EQ(version, boundaries.version());
+  EXPECT_EQ(expected_segments(bitmap.get(), Point(3, 4)), segments(boundaries));
+
+  // Same bitmap moved
+  boundaries.regen(copy.get(), Point(-5, 2));
+  EXPECT_NE(version, boundaries.version());
+  EXPECT_EQ(expected_segments(bitmap.get(), Point(-5, 2)), segments(boundaries));
+
+  // Different bitmap
+  version = boundaries.version();
+  put_pixel(copy.get(), 36, 20, !get_pixel(copy.get(), 36, 20));
+  boundaries.regen(copy.get(), Point(-5, 2));
+  EXPECT_NE(version, boundaries.version());
+  EXPECT_EQ(expected_segments(copy.get(), Point(-5, 2)), segments(boundaries));
+
+  // Boundaries moved with offset() keep their origin
+  boundaries.offset(10, 20);
+  boundaries.regen(copy.get(), Point(0, 0));
+  EXPECT_EQ(expected_segments(copy.get(), Point(0, 0)), segments(boundaries));
+
+  // After a reset() the segments are generated again
+  boundaries.reset();
+  EXPECT_TRUE(boundaries.isEmpty());
+  boundaries.regen(copy.get(), Point(0, 0));
+  EXPECT_EQ(expected_segments(copy.get(), Point(0, 0)), segments(boundaries));
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
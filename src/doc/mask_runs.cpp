@@ -0,0 +1,59 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/mask_runs.h"
+
+#include "doc/image.h"
+
+namespace doc {
+
+MaskRuns::MaskRuns(const Image* bitmap)
+{
+  ASSERT(bitmap->pixelFormat() == IMAGE_BITMAP);
+
+  const int w = bitmap->width();
+  const int h = bitmap->height();
+  const int widthBytes = (w+7) / 8;
+  // Valid bits of the last byte of each row
+  const uint8_t lastByteMask = (w % 8 ? (1 << (w % 8)) - 1: 0xff);
+
+  m_rows.reserve(h+1);
+  for (int y=0; y<h; ++y) {
+    addRow();
+
+    const uint8_t* p = bitmap->getPixelAddress(0, y);
+    int start = -1;             // Start of the current run
+    for (int i=0; i<widthBytes; ++i) {
+      uint8_t byte = p[i];
+      if (i == widthBytes-1)
+        byte &= lastByteMask;
+
+      // Nothing changes in this byte
+      if ((byte == 0 && start < 0) ||
+          (byte == 0xff && start >= 0))
+        continue;
+
+      for (int j=0; j<8; ++j) {
+        if (byte & (1 << j)) {
+          if (start < 0)
+            start = i*8 + j;
+        }
+        else if (start >= 0) {
+          addRun(start, i*8 + j);
+          start = -1;
+        }
+      }
+    }
+    if (start >= 0)
+      addRun(start, w);
+  }
+}
+
+} // namespace doc
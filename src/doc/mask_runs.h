@@ -0,0 +1,85 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_MASK_RUNS_H_INCLUDED
+#define DOC_MASK_RUNS_H_INCLUDED
+#pragma once
+
+#include "base/debug.h"
+
+#include <vector>
+
+namespace doc {
+  class Image;
+
+  // Row-run representation (RLE) of a mask bitmap: for each row we
+  // store the horizontal runs of pixels with 1. Empty areas of the
+  // bitmap cost nothing, so operations over sparse selections can
+  // work with the runs instead of visiting each pixel.
+  class MaskRuns {
+  public:
+    struct Run {
+      int x, x2;                // Pixels in the [x, x2) range
+    };
+
+    class Row {
+    public:
+      Row(const Run* begin, const Run* end) : m_begin(begin), m_end(end) { }
+      const Run* begin() const { return m_begin; }
+      const Run* end() const { return m_end; }
+      bool empty() const { return m_begin == m_end; }
+    private:
+      const Run* m_begin;
+      const Run* m_end;
+    };
+
+    MaskRuns() { }
+
+    // Creates the runs of the given IMAGE_BITMAP (skipping whole
+    // bytes of 0s/1s).
+    explicit MaskRuns(const Image* bitmap);
+
+    int height() const { return int(m_rows.size())-1; }
+    bool empty() const { return m_runs.empty(); }
+
+    Row row(const int y) const {
+      ASSERT(y >= 0 && y < height());
+      return Row(m_runs.data()+m_rows[y],
+                 m_runs.data()+m_rows[y+1]);
+    }
+
+    // Adds a new empty row at the bottom.
+    void addRow() {
+      m_rows.push_back(m_rows.back());
+    }
+
+    // Adds a run at the end of the last row. Runs must be added from
+    // left to right, and overlapping/touching runs are merged.
+    void addRun(const int x, const int x2) {
+      ASSERT(height() > 0);
+      ASSERT(x < x2);
+      if (m_rows.back() > m_rows[m_rows.size()-2] &&
+          x <= m_runs.back().x2) {
+        ASSERT(x >= m_runs.back().x);
+        if (x2 > m_runs.back().x2)
+          m_runs.back().x2 = x2;
+      }
+      else {
+        m_runs.push_back(Run{ x, x2 });
+        ++m_rows.back();
+      }
+    }
+
+  private:
+    std::vector<Run> m_runs;
+    // Index of the first run of each row in m_runs (plus the end of
+    // the last row).
+    std::vector<int> m_rows = { 0 };
+  };
+
+} // namespace doc
+
+#endif
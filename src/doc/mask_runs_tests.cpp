@@ -0,0 +1,106 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/mask.h"
+#include "doc/mask_runs.h"
+#include "doc/primitives.h"
+
+#include <random>
+
+using namespace doc;
+using namespace gfx;
+
+namespace {
+
+// Fills the bitmap with random pixels, sometimes sparse, sometimes
+// with long runs of 0s and 1s.
+void random_bitmap(Image* bitmap, std::mt19937& rng)
+{
+  const int kind = rng() % 3;
+  for (int y=0; y<bitmap->height(); ++y)
+    for (int x=0; x<bitmap->width(); ++x)
+      put_pixel(bitmap, x, y,
+                kind == 0 ? rng() % 2:
+                kind == 1 ? (rng() % 10 == 0):
+                            ((x/9 + y/5) % 2));
+}
+
+void random_mask(Mask& mask, std::mt19937& rng)
+{
+  mask.replace(Rect(int(rng() % 40) - 10, int(rng() % 40) - 10,
+                    1 + rng() % 50, 1 + rng() % 30));
+  random_bitmap(mask.bitmap(), rng);
+}
+
+} // anonymous namespace
+
+TEST(MaskRuns, MatchBitmapPixels)
+{
+  std::mt19937 rng(1);
+  for (int i=0; i<200; ++i) {
+    ImageRef bitmap(Image::create(IMAGE_BITMAP, 1 + rng() % 70, 1 + rng() % 20));
+    random_bitmap(bitmap.get(), rng);
+
+    MaskRuns runs(bitmap.get());
+    ASSERT_EQ(bitmap->height(), runs.height());
+
+    for (int y=0; y<bitmap->height(); ++y) {
+      int x = 0;
+      for (const auto& run : runs.row(y)) {
+        ASSERT_LT(run.x, run.x2);
+        // Runs are sorted and never touch each other
+        ASSERT_TRUE(x == 0 || x < run.x);
+        for (; x<run.x; ++x)
+          ASSERT_EQ(0, get_pixel(bitmap.get(), x, y)) << "x=" << x << " y=" << y;
+        for (; x<run.x2; ++x)
+          ASSERT_EQ(1, get_pixel(bitmap.get(), x, y)) << "x=" << x << " y=" << y;
+      }
+      ASSERT_LE(x, bitmap->width());
+      for (; x<bitmap->width(); ++x)
+        ASSERT_EQ(0, get_pixel(bitmap.get(), x, y)) << "x=" << x << " y=" << y;
+    }
+  }
+}
+
+TEST(MaskRuns, MaskOperations)
+{
+  std::mt19937 rng(2);
+  for (int i=0; i<300; ++i) {
+    Mask a, b;
+    random_mask(a, rng);
+    random_mask(b, rng);
+
+    Mask added(a), subtracted(a), intersected(a);
+    added.add(b);
+    subtracted.subtract(b);
+    intersected.intersect(b);
+
+    const Rect bounds = a.bounds().createUnion(b.bounds());
+    for (int y=bounds.y; y<bounds.y2(); ++y) {
+      for (int x=bounds.x; x<bounds.x2(); ++x) {
+        const bool u = a.containsPoint(x, y);
+        const bool v = b.containsPoint(x, y);
+        ASSERT_EQ(u || v, added.containsPoint(x, y)) << "i=" << i;
+        ASSERT_EQ(u && !v, subtracted.containsPoint(x, y)) << "i=" << i;
+        ASSERT_EQ(u && v, intersected.containsPoint(x, y)) << "i=" << i;
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -13,15 +13,127 @@
 
 #include "base/debug.h"
 
-#include <map>
+#include <algorithm>
+#include <atomic>
 #include <mutex>
+#include <vector>
 
 namespace doc {
 
-static std::mutex g_mutex;
-static ObjectId newId = 0;
-// TODO Profile this and see if an unordered_map is better
-static std::map<ObjectId, Object*> objects;
+namespace {
+
+// Registry of objects split in shards (by the lowest bits of the
+// ID), each one with its own lock, so threads looking for different
+// objects don't block each other. Each shard is an open-addressing
+// hash table (linear probing) that keeps IDs and pointers together
+// in one array.
+constexpr int kShardBits = 6;
+constexpr int kNumShards = (1 << kShardBits);
+
+class ObjectsShard {
+public:
+  static constexpr std::size_t kMinCapacity = 64;
+
+  Object* find(const ObjectId id) const {
+    if (m_entries.empty())
+      return nullptr;
+    for (std::size_t i=home(id); ; i=(i+1) & mask()) {
+      const Entry& entry = m_entries[i];
+      if (entry.id == id)
+        return entry.object;
+      if (entry.id == NullId)
+        return nullptr;
+    }
+  }
+
+  void insert(const ObjectId id, Object* object) {
+    ASSERT(id != NullId);
+    // Keep the load factor <= 1/2
+    if ((m_count+1)*2 > m_entries.size())
+      rehash(std::max(kMinCapacity, m_entries.size()*2));
+
+    std::size_t i = home(id);
+    while (m_entries[i].id != NullId && m_entries[i].id != id)
+      i = (i+1) & mask();
+    if (m_entries[i].id == NullId)
+      ++m_count;
+    m_entries[i] = Entry{ id, object };
+  }
+
+  bool erase(const ObjectId id) {
+    if (m_entries.empty())
+      return false;
+
+    std::size_t i = home(id);
+    while (m_entries[i].id != id) {
+      if (m_entries[i].id == NullId)
+        return false;
+      i = (i+1) & mask();
+    }
+
+    // Move back the next entries of the cluster that can be placed
+    // in the hole (so we don't need tombstones).
+    for (std::size_t j=(i+1) & mask(); m_entries[j].id != NullId; j=(j+1) & mask()) {
+      const std::size_t k = home(m_entries[j].id);
+      const bool inRange = (i <= j ? (i < k && k <= j):
+                                     (i < k || k <= j));
+      if (!inRange) {
+        m_entries[i] = m_entries[j];
+        i = j;
+      }
+    }
+    m_entries[i] = Entry();
+    --m_count;
+
+    // Release memory when most objects were deleted
+    if (m_entries.size() > kMinCapacity && m_count*8 < m_entries.size())
+      rehash(m_entries.size()/2);
+    return true;
+  }
+
+  std::mutex& mutex() const { return m_mutex; }
+
+private:
+  struct Entry {
+    ObjectId id = NullId;
+    Object* object = nullptr;
+  };
+
+  std::size_t mask() const { return m_entries.size()-1; }
+
+  // Fibonacci hashing of the ID bits that aren't used to select
+  // the shard.
+  std::size_t home(const ObjectId id) const {
+    return std::size_t((id >> kShardBits) * 2654435769u) & mask();
+  }
+
+  void rehash(const std::size_t capacity) {
+    ASSERT((capacity & (capacity-1)) == 0);
+    std::vector<Entry> old(capacity);
+    std::swap(old, m_entries);
+    m_count = 0;
+    for (const Entry& entry : old) {
+      if (entry.id != NullId)
+        insert(entry.id, entry.object);
+    }
+  }
+
+  mutable std::mutex m_mutex;
+  std::vector<Entry> m_entries;
+  std::size_t m_count = 0;
+};
+
+struct alignas(64) AlignedShard : ObjectsShard { };
+
+AlignedShard shards[kNumShards];
+std::atomic<ObjectId> newId{0};
+
+ObjectsShard& shard_for(const ObjectId id)
+{
+  return shards[id & (kNumShards-1)];
+}
+
+} // anonymous namespace
 
 Object::Object(ObjectType type)
   : m_type(type)
@@ -53,44 +165,38 @@ const ObjectId Object::id() const
   // The first time the ID is request, we store the object in the
   // "objects" hash table.
   if (!m_id) {
-    const std::lock_guard lock(g_mutex);
-    m_id = ++newId;
-    objects.insert(std::make_pair(m_id, const_cast<Object*>(this)));
+    const ObjectId id = ++newId;
+    ObjectsShard& shard = shard_for(id);
+    const std::lock_guard lock(shard.mutex());
+    shard.insert(id, const_cast<Object*>(this));
+    m_id = id;
   }
   return m_id;
 }
 
 void Object::setId(ObjectId id)
 {
-  const std::lock_guard lock(g_mutex);
-
   if (m_id) {
-    auto it = objects.find(m_id);
-    ASSERT(it != objects.end());
-    ASSERT(it->second == this);
-    if (it != objects.end())
-      objects.erase(it);
+    ObjectsShard& shard = shard_for(m_id);
+    const std::lock_guard lock(shard.mutex());
+    ASSERT(shard.find(m_id) == this);
+    shard.erase(m_id);
   }
 
   m_id = id;
 
   if (m_id) {
+    ObjectsShard& shard = shard_for(m_id);
+    const std::lock_guard lock(shard.mutex());
 #ifdef _DEBUG
-    if (objects.find(m_id) != objects.end()) {
-      Object* obj = objects.find(m_id)->second;
-      if (obj) {
-        TRACEARGS("ASSERT FAILED: Object with id", m_id,
-                  "of kind", int(obj->type()),
-                  "version", obj->version(), "should not exist");
-      }
-      else {
-        TRACEARGS("ASSERT FAILED: Object with id", m_id,
-                  "registered as nullptr should not exist");
-      }
+    if (Object* obj = shard.find(m_id)) {
+      TRACEARGS("ASSERT FAILED: Object with id", m_id,
+                "of kind", int(obj->type()),
+                "version", obj->version(), "should not exist");
     }
-    ASSERT(objects.find(m_id) == objects.end());
+    ASSERT(shard.find(m_id) == nullptr);
 #endif
-    objects.insert(std::make_pair(m_id, this));
+    shard.insert(m_id, this);
   }
 }
 
@@ -101,12 +207,12 @@ void Object::setVersion(ObjectVersion version)
 
 Object* get_object(ObjectId id)
 {
-  const std::lock_guard lock(g_mutex);
-  auto it = objects.find(id);
-  if (it != objects.end())
-    return it->second;
-  else
+  if (id == NullId)
     return nullptr;
+
+  const ObjectsShard& shard = shard_for(id);
+  const std::lock_guard lock(shard.mutex());
+  return shard.find(id);
 }
 
 } // namespace doc
@@ -0,0 +1,78 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/object.h"
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace doc;
+
+namespace {
+
+class TestObject : public Object {
+public:
+  TestObject() : Object(ObjectType::Image) { }
+};
+
+// Objects shared by all threads of the benchmark
+std::mutex objsMutex;
+std::vector<std::unique_ptr<TestObject>> objs;
+
+void create_objects(const std::size_t n)
+{
+  const std::lock_guard lock(objsMutex);
+  if (objs.size() != n) {
+    objs.clear();
+    objs.resize(n);
+    for (auto& obj : objs) {
+      obj = std::make_unique<TestObject>();
+      obj->id();
+    }
+  }
+}
+
+} // anonymous namespace
+
+void BM_GetObject(benchmark::State& state) {
+  create_objects(state.range(0));
+
+  const ObjectId firstId = objs.front()->id();
+  const ObjectId n = ObjectId(objs.size());
+  ObjectId i = ObjectId(state.thread_index()) * 7919;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(get_object(firstId + (i % n)));
+    i += 104729;
+  }
+}
+
+void BM_CreateObjectIds(benchmark::State& state) {
+  for (auto _ : state) {
+    TestObject obj;
+    benchmark::DoNotOptimize(obj.id());
+  }
+}
+
+BENCHMARK(BM_GetObject)
+  ->Arg(1000)
+  ->Arg(1000000)
+  ->Threads(1)
+  ->Threads(4)
+  ->UseRealTime();
+
+BENCHMARK(BM_CreateObjectIds)
+  ->Threads(1)
+  ->Threads(4)
+  ->UseRealTime();
+
+BENCHMARK_MAIN();
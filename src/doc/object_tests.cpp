@@ -0,0 +1,87 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/object.h"
+
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace doc;
+
+namespace {
+
+class TestObject : public Object {
+public:
+  TestObject() : Object(ObjectType::Image) { }
+};
+
+} // anonymous namespace
+
+TEST(Object, Registry)
+{
+  std::vector<std::unique_ptr<TestObject>> objs;
+  for (int i=0; i<10000; ++i) {
+    objs.push_back(std::make_unique<TestObject>());
+    objs.back()->id();
+  }
+  for (auto& obj : objs)
+    EXPECT_EQ(obj.get(), get_object(obj->id()));
+  EXPECT_EQ(nullptr, get_object(NullId));
+
+  // Delete objects in random order, the rest must be still found
+  std::mt19937 rng(1);
+  std::shuffle(objs.begin(), objs.end(), rng);
+  std::vector<ObjectId> deleted;
+  while (objs.size() > 100) {
+    deleted.push_back(objs.back()->id());
+    objs.pop_back();
+  }
+  for (auto& obj : objs)
+    EXPECT_EQ(obj.get(), get_object(obj->id()));
+  for (ObjectId id : deleted)
+    EXPECT_EQ(nullptr, get_object(id));
+
+  // Change the ID of an object
+  TestObject* obj = objs[0].get();
+  const ObjectId oldId = obj->id();
+  obj->setId(deleted[0]);
+  EXPECT_EQ(nullptr, get_object(oldId));
+  EXPECT_EQ(obj, get_object(deleted[0]));
+}
+
+TEST(Object, RegistryThreads)
+{
+  std::vector<std::thread> threads;
+  for (int i=0; i<4; ++i) {
+    threads.emplace_back([]{
+      std::vector<std::unique_ptr<TestObject>> objs;
+      for (int j=0; j<5000; ++j) {
+        objs.push_back(std::make_unique<TestObject>());
+        EXPECT_EQ(objs.back().get(), get_object(objs.back()->id()));
+        if (j % 3 == 0)
+          objs.erase(objs.begin() + j/2);
+      }
+      for (auto& obj : objs)
+        EXPECT_EQ(obj.get(), get_object(obj->id()));
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (c) 2020-2023 Igara Studio S.A.
+// Copyright (c) 2020-2024 Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -10,16 +10,55 @@
 
 #include "doc/octree_map.h"
 
+#include "base/thread_pool.h"
 #include "doc/palette.h"
 
+#include <algorithm>
+#include <thread>
+
 #define MIN_LEVEL_OCTREE_DEEP 3
 
 namespace doc {
 
+// Minimum number of pixels to feed the octree from several threads
+static constexpr int kMinPixelsToParallelize = 512*512;
+
+//////////////////////////////////////////////////////////////////////
+// OctreeNodePool
+
+OctreeNodeChildren* OctreeNodePool::allocChildren()
+{
+  if (m_used == kChunkSize) {
+    m_chunks.emplace_back(new OctreeNodeChildren[kChunkSize]);
+    m_used = 0;
+  }
+  return &m_chunks.back()[m_used++];
+}
+
+void OctreeNodePool::adopt(OctreeNodePool&& other)
+{
+  // Insert the chunks of "other" before our last chunk, so we can
+  // continue using the free children of our last chunk.
+  const auto pos = (m_chunks.empty() ? m_chunks.end(): m_chunks.end()-1);
+  m_chunks.insert(pos,
+                  std::make_move_iterator(other.m_chunks.begin()),
+                  std::make_move_iterator(other.m_chunks.end()));
+  if (m_chunks.size() == other.m_chunks.size())
+    m_used = other.m_used;
+  other.clear();
+}
+
+void OctreeNodePool::clear()
+{
+  m_chunks.clear();
+  m_used = kChunkSize;
+}
+
 //////////////////////////////////////////////////////////////////////
 // OctreeNode
 
-void OctreeNode::addColor(color_t c, int level, OctreeNode* parent,
+void OctreeNode::addColor(OctreeNodePool& pool,
+                          color_t c, int level, OctreeNode* parent,
                           int paletteIndex, int levelDeep)
 {
   m_parent = parent;
@@ -29,13 +68,13 @@ void OctreeNode::addColor(color_t c, int level, OctreeNode* parent,
     return;
   }
   int index = getHextet(c, level);
-  if (!m_children) {
-    m_children.reset(new std::array<OctreeNode, 16>());
-  }
-  (*m_children)[index].addColor(c, level + 1, this, paletteIndex, levelDeep);
+  if (!m_children)
+    m_children = pool.allocChildren();
+  (*m_children)[index].addColor(pool, c, level + 1, this, paletteIndex, levelDeep);
 }
 
-int OctreeNode::mapColor(int  r, int g, int b, int a, int mask_index, const Palette* palette, int level) const
+int OctreeNode::mapColor(OctreeNodePool& pool,
+                         int  r, int g, int b, int a, int mask_index, const Palette* palette, int level) const
 {
   // New behavior: if mapColor do not have an exact rgba match, it must calculate which
   // color of the current palette is the bestfit and memorize the index in a octree leaf.
@@ -46,8 +85,45 @@ int OctreeNode::mapColor(int  r, int g, int b, int a, int mask_index, const Pale
   }
   int index = getHextet(r, g, b, a, level);
   if (!m_children)
-    m_children.reset(new std::array<OctreeNode, 16>());
-  return (*m_children)[index].mapColor(r, g, b, a, mask_index, palette, level + 1);
+    m_children = pool.allocChildren();
+  return (*m_children)[index].mapColor(pool, r, g, b, a, mask_index, palette, level + 1);
+}
+
+void OctreeNode::merge(OctreeNode& other)
+{
+  // Roots are their own parents
+  if (other.m_parent == &other)
+    m_parent = this;
+
+  if (other.m_leafColor.pixelCount() > 0) {
+    m_leafColor.add(other.m_leafColor);
+    m_paletteIndex = other.m_paletteIndex;
+  }
+
+  if (!other.m_children)
+    return;
+
+  // Re-use the whole branch of "other"
+  if (!m_children) {
+    m_children = other.m_children;
+    other.m_children = nullptr;
+    for (OctreeNode& child : *m_children) {
+      if (child.m_parent)
+        child.m_parent = this;
+    }
+    return;
+  }
+
+  for (int i=0; i<16; ++i) {
+    OctreeNode& otherChild = (*other.m_children)[i];
+    // Only nodes that were visited by addColor() have a parent
+    if (!otherChild.m_parent)
+      continue;
+
+    OctreeNode& child = (*m_children)[i];
+    child.m_parent = this;
+    child.merge(otherChild);
+  }
 }
 
 void OctreeNode::collectLeafNodes(OctreeNodes& leavesVector, int& paletteIndex)
@@ -230,32 +306,66 @@ void OctreeMap::feedWithImage(const Image* image,
 {
   ASSERT(image);
   ASSERT(image->pixelFormat() == IMAGE_RGB || image->pixelFormat() == IMAGE_GRAYSCALE);
-  color_t forceFullOpacity;
   const bool imageIsRGBA = (image->pixelFormat() == IMAGE_RGB);
-
-  auto add_color_to_octree =
-    [this, &forceFullOpacity, levelDeep, imageIsRGBA](color_t color) {
-      const int alpha = (imageIsRGBA ? rgba_geta(color) : graya_geta(color));
-      if (alpha) {
-        color |= forceFullOpacity;
-        color = (imageIsRGBA ? color : rgba(graya_getv(color),
-                                            graya_getv(color),
-                                            graya_getv(color),
-                                            alpha));
-        addColor(color, levelDeep);
+  const color_t forceFullOpacity = (withAlpha ? 0: rgba_a_mask);
+
+  // Adds the pixels of the rows [y0, y1) to the given octree root
+  auto feed_rows =
+    [image, forceFullOpacity, levelDeep, imageIsRGBA]
+    (OctreeNode& root, OctreeNodePool& pool, const int y0, const int y1) {
+      const int w = image->width();
+      for (int y=y0; y<y1; ++y) {
+        if (imageIsRGBA) {
+          auto p = (const RgbTraits::address_t)image->getPixelAddress(0, y);
+          for (int x=0; x<w; ++x, ++p) {
+            const color_t color = *p;
+            if (rgba_geta(color))
+              root.addColor(pool, color | forceFullOpacity, 0, &root, 0, levelDeep);
+          }
+        }
+        else {
+          auto p = (const GrayscaleTraits::address_t)image->getPixelAddress(0, y);
+          for (int x=0; x<w; ++x, ++p) {
+            const color_t color = *p;
+            const int alpha = graya_geta(color);
+            if (alpha) {
+              const int v = graya_getv(color);
+              root.addColor(pool, rgba(v, v, v, alpha), 0, &root, 0, levelDeep);
+            }
+          }
+        }
       }
     };
 
-  switch (image->pixelFormat()) {
-    case IMAGE_RGB: {
-      forceFullOpacity = (withAlpha ? 0 : rgba_a_mask);
-      doc::for_each_pixel<RgbTraits>(image, add_color_to_octree);
-      break;
+  const int h = image->height();
+  const int nthreads =
+    std::min<int>({ int(std::thread::hardware_concurrency()), 8, h });
+
+  if (nthreads < 2 || image->width()*h < kMinPixelsToParallelize) {
+    feed_rows(m_root, m_pool, 0, h);
+  }
+  else {
+    // Each thread fills its own octree (with its own pool of nodes)
+    // with a band of rows, then we merge all partial octrees in
+    // order. The sums of each leaf are integers so the result is
+    // exactly the same as feeding the octree from only one thread.
+    std::vector<OctreeNode> roots(nthreads);
+    std::vector<OctreeNodePool> pools(nthreads);
+    {
+      base::thread_pool threads(nthreads);
+      for (int i=0; i<nthreads; ++i) {
+        threads.execute([&feed_rows, &roots, &pools, i, h, nthreads]{
+          feed_rows(roots[i], pools[i], h*i/nthreads, h*(i+1)/nthreads);
+        });
+      }
+      threads.wait_all();
     }
-    case IMAGE_GRAYSCALE: {
-      forceFullOpacity = (withAlpha ? 0 : graya_a_mask);
-      doc::for_each_pixel<GrayscaleTraits>(image, add_color_to_octree);
-      break;
+
+    for (int i=0; i<nthreads; ++i) {
+      if (!roots[i].parent())   // Empty band (all transparent pixels)
+        continue;
+      m_root.merge(roots[i]);
+      m_pool.adopt(std::move(pools[i]));
     }
   }
   m_maskColor = maskColor;
@@ -263,7 +373,8 @@ void OctreeMap::feedWithImage(const Image* image,
 
 int OctreeMap::mapColor(color_t rgba) const
 {
-  return m_root.mapColor(rgba_getr(rgba),
+  return m_root.mapColor(m_pool,
+                         rgba_getr(rgba),
                          rgba_getg(rgba),
                          rgba_getb(rgba),
                          rgba_geta(rgba),
@@ -271,6 +382,12 @@ int OctreeMap::mapColor(color_t rgba) const
                          m_palette, 0);
 }
 
+void OctreeMap::mapColors(const color_t* colors, uint8_t* indexes, const int n) const
+{
+  for (int i=0; i<n; ++i)
+    indexes[i] = OctreeMap::mapColor(colors[i]);
+}
+
 void OctreeMap::regenerateMap(const Palette* palette, const int maskIndex)
 {
   ASSERT(palette);
@@ -284,6 +401,7 @@ void OctreeMap::regenerateMap(const Palette* palette, const int maskIndex)
     return;
 
   m_root = OctreeNode();
+  m_pool.clear();
   m_leavesVector.clear();
   m_maskIndex = maskIndex;
   int maskColorBestFitIndex;
@@ -301,10 +419,10 @@ void OctreeMap::regenerateMap(const Palette* palette, const int maskIndex)
 
   for (int i=0; i<palette->size(); i++) {
     if (i == maskIndex) {
-      m_root.addColor(palette->entry(i), 0, &m_root, maskColorBestFitIndex, 8);
+      m_root.addColor(m_pool, palette->entry(i), 0, &m_root, maskColorBestFitIndex, 8);
       continue;
     }
-    m_root.addColor(palette->entry(i), 0, &m_root, i, 8);
+    m_root.addColor(m_pool, palette->entry(i), 0, &m_root, i, 8);
   }
 
   m_palette = palette;
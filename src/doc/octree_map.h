@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (c) 2020-2022 Igara Studio S.A.
+// Copyright (c) 2020-2024 Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -14,6 +14,7 @@
 #include "doc/rgbmap.h"
 
 #include <array>
+#include <cstdint>
 #include <memory>
 #include <vector>
 
@@ -27,6 +28,26 @@ namespace doc {
 
 class OctreeNode;
 using OctreeNodes = std::vector<OctreeNode*>;
+using OctreeNodeChildren = std::array<OctreeNode, 16>;
+
+// Allocates the children of octree nodes in big chunks (instead of
+// one heap allocation per node). All nodes are deleted when the pool
+// is cleared/destroyed.
+class OctreeNodePool {
+public:
+  OctreeNodeChildren* allocChildren();
+
+  // Moves all chunks of "other" to this pool (used to merge octrees
+  // created in different threads).
+  void adopt(OctreeNodePool&& other);
+
+  void clear();
+
+private:
+  static constexpr int kChunkSize = 64;
+  std::vector<std::unique_ptr<OctreeNodeChildren[]>> m_chunks;
+  int m_used = kChunkSize;      // Used children in the last chunk
+};
 
 class OctreeNode {
 private:
@@ -41,10 +62,10 @@ private:
     }
 
     LeafColor(int r, int g, int b, int a, size_t pixelCount) :
-      m_r((double)r),
-      m_g((double)g),
-      m_b((double)b),
-      m_a((double)a),
+      m_r(r),
+      m_g(g),
+      m_b(b),
+      m_a(a),
       m_pixelCount(pixelCount) {
     }
 
@@ -65,23 +86,25 @@ private:
     }
 
     color_t rgbaColor() const {
-      int auxR = (((int)m_r) % m_pixelCount > m_pixelCount / 2) ? 1: 0;
-      int auxG = (((int)m_g) % m_pixelCount > m_pixelCount / 2) ? 1: 0;
-      int auxB = (((int)m_b) % m_pixelCount > m_pixelCount / 2) ? 1: 0;
-      int auxA = (((int)m_a) % m_pixelCount > m_pixelCount / 2) ? 1: 0;
-      return rgba(int(m_r / m_pixelCount + auxR),
-                  int(m_g / m_pixelCount + auxG),
-                  int(m_b / m_pixelCount + auxB),
-                  int(m_a / m_pixelCount + auxA));
+      const uint64_t n = m_pixelCount;
+      int auxR = ((m_r % n) > n / 2) ? 1: 0;
+      int auxG = ((m_g % n) > n / 2) ? 1: 0;
+      int auxB = ((m_b % n) > n / 2) ? 1: 0;
+      int auxA = ((m_a % n) > n / 2) ? 1: 0;
+      return rgba(int(m_r / n + auxR),
+                  int(m_g / n + auxG),
+                  int(m_b / n + auxB),
+                  int(m_a / n + auxA));
     }
 
     size_t pixelCount() const { return m_pixelCount; }
 
 private:
-    double m_r;
-    double m_g;
-    double m_b;
-    double m_a;
+    // Integer accumulators (sums of 8-bit components)
+    uint64_t m_r;
+    uint64_t m_g;
+    uint64_t m_b;
+    uint64_t m_a;
     size_t m_pixelCount;
   };
 
@@ -90,10 +113,17 @@ public:
   bool hasChildren() const { return m_children != nullptr; }
   LeafColor leafColor() const { return m_leafColor; }
 
-  void addColor(color_t c, int level, OctreeNode* parent,
+  void addColor(OctreeNodePool& pool,
+                color_t c, int level, OctreeNode* parent,
                 int paletteIndex = 0, int levelDeep = 7);
 
-  int mapColor(int  r, int g, int b, int a, int mask_index, const Palette* palette, int level) const;
+  int mapColor(OctreeNodePool& pool,
+               int  r, int g, int b, int a, int mask_index, const Palette* palette, int level) const;
+
+  // Adds all the colors of "other" (a node in the same position of
+  // other octree) to this node. The children nodes of "other" are
+  // re-used (so its pool must be adopted by the pool of this node).
+  void merge(OctreeNode& other);
 
   void collectLeafNodes(OctreeNodes& leavesVector, int& paletteIndex);
 
@@ -113,14 +143,14 @@ private:
 
   LeafColor m_leafColor;
   mutable int m_paletteIndex = -1;
-  mutable std::unique_ptr<std::array<OctreeNode, 16>> m_children;
+  mutable OctreeNodeChildren* m_children = nullptr; // Owned by an OctreeNodePool
   OctreeNode* m_parent = nullptr;
 };
 
 class OctreeMap : public RgbMap {
 public:
   void addColor(color_t color, int levelDeep = 7) {
-    m_root.addColor(color, 0, &m_root, 0, levelDeep);
+    m_root.addColor(m_pool, color, 0, &m_root, 0, levelDeep);
   }
 
   // makePalette returns true if a 7 level octreeDeep is OK, and false
@@ -137,6 +167,7 @@ public:
   // RgbMap impl
   void regenerateMap(const Palette* palette, const int maskIndex) override;
   int mapColor(color_t rgba) const override;
+  void mapColors(const color_t* colors, uint8_t* indexes, const int n) const override;
   int maskIndex() const override { return m_maskIndex; }
   int mapColor(const int r, const int g,
                const int b, const int a) const
@@ -151,6 +182,9 @@ public:
   int moodifications() const { return m_modifications; };
 
 private:
+  // Nodes of m_root (must be destroyed after m_root, and m_root
+  // must be reset when the pool is cleared)
+  mutable OctreeNodePool m_pool;
   OctreeNode m_root;
   OctreeNodes m_leavesVector;
   const Palette* m_palette = nullptr;
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2020-2023 Igara Studio S.A.
+// Copyright (c) 2020-2024 Igara Studio S.A.
 // Copyright (c) 2001-2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -15,12 +15,14 @@
 #include "doc/image.h"
 #include "doc/palette_gradient_type.h"
 #include "doc/remap.h"
+#include "doc/simd.h"
 #include "gfx/hsv.h"
 #include "gfx/rgb.h"
 
 #include <algorithm>
 #include <limits>
 #include <cmath>
+#include <cstdlib>
 
 namespace doc {
 
@@ -415,6 +417,316 @@ static void rgbToOtherSpace(double& r, double& g, double& b, FitCriteria fc)
   }
 }
 
+// Weights of each component in the distance between two colors, the
+// same values used to create the col_diff tables (the distance is
+// the sum of w*d^2 for each component, where d is the difference of
+// the 5-bit components)
+enum { kWeightR = 30*30, kWeightG = 59*59, kWeightB = 11*11, kWeightA = 8*8 };
+
+// To find the best fit in big palettes, the 5-bit RGBA space is
+// divided in cells (smaller in the components with bigger weights),
+// and for each cell we calculate (the first time a color inside the
+// cell is searched) the list of entries that can be the nearest one
+// to a color inside the cell.
+enum {
+  kCellShiftR = 2,
+  kCellShiftG = 1,
+  kCellShiftB = 3,
+  kCellShiftA = 4,
+  kCellsR = 32 >> kCellShiftR,
+  kCellsG = 32 >> kCellShiftG,
+  kCellsB = 32 >> kCellShiftB,
+  kCellsA = 32 >> kCellShiftA,
+  kCells = kCellsR * kCellsG * kCellsB * kCellsA,
+  // Below this number of entries it's faster to compare all entries
+  kCellsMinEntries = 64,
+};
+
+static inline int findCell(const int r, const int g, const int b, const int a)
+{
+  return ((((r >> kCellShiftR) * kCellsG
+            + (g >> kCellShiftG)) * kCellsB
+           + (b >> kCellShiftB)) * kCellsA
+          + (a >> kCellShiftA));
+}
+
+// Adds to minDist/maxDist the minimum/maximum weighted distance
+// between the value v and the values in the [lo, lo+2^shift) range.
+static inline void addCellDist(const int v, const int lo, const int shift,
+                               const int weight, int& minDist, int& maxDist)
+{
+  const int hi = lo + (1 << shift) - 1;
+  const int d0 = (v < lo ? lo - v: (v > hi ? v - hi: 0));
+  const int d1 = std::max(std::abs(v - lo), std::abs(v - hi));
+  minDist += weight * d0 * d0;
+  maxDist += weight * d1 * d1;
+}
+
+// Calculates the candidates of the given cell: any color inside the
+// cell is at most at "bound" distance of its nearest entry, so
+// entries with a minimum distance to the cell greater than "bound"
+// cannot be the nearest one. We use the second lowest maximum
+// distance as the bound, so the list is still valid when one of the
+// entries is ignored (the mask_index). The entries keep the palette
+// order (so we can return the first entry with the lowest distance).
+static void findCellCandidates(const int16_t* table, const int n,
+                               const int cell,
+                               std::vector<uint8_t>& candidates)
+{
+  const int n8 = (n+7) & ~7;
+  const int16_t* tr = table;
+  const int16_t* tg = tr + n8;
+  const int16_t* tb = tg + n8;
+  const int16_t* ta = tb + n8;
+
+  const int a0 = (cell % kCellsA) << kCellShiftA;
+  const int b0 = ((cell / kCellsA) % kCellsB) << kCellShiftB;
+  const int g0 = ((cell / kCellsA / kCellsB) % kCellsG) << kCellShiftG;
+  const int r0 = (cell / kCellsA / kCellsB / kCellsG) << kCellShiftR;
+
+  std::vector<int> minDist(n);
+  int bound1 = std::numeric_limits<int>::max();
+  int bound2 = std::numeric_limits<int>::max();
+  for (int i=0; i<n; ++i) {
+    int maxDist = 0;
+    minDist[i] = 0;
+    addCellDist(tr[i], r0, kCellShiftR, kWeightR, minDist[i], maxDist);
+    addCellDist(tg[i], g0, kCellShiftG, kWeightG, minDist[i], maxDist);
+    addCellDist(tb[i], b0, kCellShiftB, kWeightB, minDist[i], maxDist);
+    addCellDist(ta[i], a0, kCellShiftA, kWeightA, minDist[i], maxDist);
+    if (maxDist < bound1) {
+      bound2 = bound1;
+      bound1 = maxDist;
+    }
+    else if (maxDist < bound2)
+      bound2 = maxDist;
+  }
+
+  candidates.clear();
+  for (int i=0; i<n; ++i) {
+    if (minDist[i] <= bound2)
+      candidates.push_back(uint8_t(i));
+  }
+}
+
+// Returns the same index as findBestfitTable() but comparing only the
+// candidates of the cell of the given color.
+static int findBestfitCandidates(const int16_t* table, const int n,
+                                 const std::vector<uint8_t>& candidates,
+                                 const int r, const int g, const int b, const int a,
+                                 const int mask_index)
+{
+  const int n8 = (n+7) & ~7;
+  const int16_t* tr = table;
+  const int16_t* tg = tr + n8;
+  const int16_t* tb = tg + n8;
+  const int16_t* ta = tb + n8;
+
+  int bestfit = 0;
+  int lowest = std::numeric_limits<int>::max();
+  for (const int i : candidates) {
+    const int dr = tr[i] - r;
+    const int dg = tg[i] - g;
+    const int db = tb[i] - b;
+    const int da = ta[i] - a;
+    const int dist = kWeightR*dr*dr + kWeightG*dg*dg + kWeightB*db*db + kWeightA*da*da;
+    if (dist < lowest && i != mask_index) {
+      bestfit = i;
+      lowest = dist;
+    }
+  }
+  return bestfit;
+}
+
+#if defined(DOC_SIMD_SSE2) || defined(DOC_SIMD_NEON)
+
+// Compares 8 palette entries at the same time (int16 lanes, the
+// weighted distances are accumulated in two int32 vectors). Returns
+// the same index as the scalar version: the first entry with the
+// lowest distance (ignoring the mask_index).
+static int findBestfitTable(const int16_t* table, const int n,
+                            const int r, const int g, const int b, const int a,
+                            const int mask_index)
+{
+  const int n8 = (n+7) & ~7;
+  const int16_t* tr = table;
+  const int16_t* tg = tr + n8;
+  const int16_t* tb = tg + n8;
+  const int16_t* ta = tb + n8;
+  int bestDist[8];
+  int bestIndex[8];
+
+#if DOC_SIMD_SSE2
+  const __m128i vr = _mm_set1_epi16(r);
+  const __m128i vg = _mm_set1_epi16(g);
+  const __m128i vb = _mm_set1_epi16(b);
+  const __m128i va = _mm_set1_epi16(a);
+  // Pairs of weights for _mm_madd_epi16() (low element first)
+  const __m128i wGR = _mm_set_epi16(kWeightR, kWeightG, kWeightR, kWeightG,
+                                    kWeightR, kWeightG, kWeightR, kWeightG);
+  const __m128i wBA = _mm_set_epi16(kWeightA, kWeightB, kWeightA, kWeightB,
+                                    kWeightA, kWeightB, kWeightA, kWeightB);
+  const __m128i vmax = _mm_set1_epi32(std::numeric_limits<int>::max());
+  const __m128i vmask = _mm_set1_epi32(mask_index);
+  const __m128i vn = _mm_set1_epi32(n);
+  const __m128i v8 = _mm_set1_epi32(8);
+  __m128i idxLo = _mm_setr_epi32(0, 1, 2, 3);
+  __m128i idxHi = _mm_setr_epi32(4, 5, 6, 7);
+  __m128i bestLo = vmax, bestHi = vmax;
+  __m128i bestIdxLo = _mm_setzero_si128(), bestIdxHi = _mm_setzero_si128();
+
+  auto update = [&](__m128i dist, const __m128i idx, __m128i& best, __m128i& bestIdx) {
+    // Ignore the mask index and entries after the end of the palette
+    const __m128i skip = _mm_or_si128(_mm_cmpeq_epi32(idx, vmask),
+                                      _mm_cmpeq_epi32(_mm_cmplt_epi32(idx, vn),
+                                                      _mm_setzero_si128()));
+    dist = _mm_or_si128(_mm_and_si128(skip, vmax), _mm_andnot_si128(skip, dist));
+    const __m128i lt = _mm_cmplt_epi32(dist, best);
+    best = _mm_or_si128(_mm_and_si128(lt, dist), _mm_andnot_si128(lt, best));
+    bestIdx = _mm_or_si128(_mm_and_si128(lt, idx), _mm_andnot_si128(lt, bestIdx));
+  };
+
+  for (int i=0; i<n8; i+=8) {
+    __m128i dr = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(tr+i)), vr);
+    __m128i dg = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(tg+i)), vg);
+    __m128i db = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(tb+i)), vb);
+    __m128i da = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(ta+i)), va);
+    dr = _mm_mullo_epi16(dr, dr);
+    dg = _mm_mullo_epi16(dg, dg);
+    db = _mm_mullo_epi16(db, db);
+    da = _mm_mullo_epi16(da, da);
+
+    const __m128i distLo =
+      _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(dg, dr), wGR),
+                    _mm_madd_epi16(_mm_unpacklo_epi16(db, da), wBA));
+    const __m128i distHi =
+      _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(dg, dr), wGR),
+                    _mm_madd_epi16(_mm_unpackhi_epi16(db, da), wBA));
+
+    update(distLo, idxLo, bestLo, bestIdxLo);
+    update(distHi, idxHi, bestHi, bestIdxHi);
+    idxLo = _mm_add_epi32(idxLo, v8);
+    idxHi = _mm_add_epi32(idxHi, v8);
+  }
+
+  _mm_storeu_si128((__m128i*)&bestDist[0], bestLo);
+  _mm_storeu_si128((__m128i*)&bestDist[4], bestHi);
+  _mm_storeu_si128((__m128i*)&bestIndex[0], bestIdxLo);
+  _mm_storeu_si128((__m128i*)&bestIndex[4], bestIdxHi);
+#elif DOC_SIMD_NEON
+  const int16x8_t vr = vdupq_n_s16(r);
+  const int16x8_t vg = vdupq_n_s16(g);
+  const int16x8_t vb = vdupq_n_s16(b);
+  const int16x8_t va = vdupq_n_s16(a);
+  const int32x4_t vmax = vdupq_n_s32(std::numeric_limits<int>::max());
+  const int32x4_t vmask = vdupq_n_s32(mask_index);
+  const int32x4_t vn = vdupq_n_s32(n);
+  const int32x4_t v8 = vdupq_n_s32(8);
+  const int32_t idx0[4] = { 0, 1, 2, 3 };
+  int32x4_t idxLo = vld1q_s32(idx0);
+  int32x4_t idxHi = vaddq_s32(idxLo, vdupq_n_s32(4));
+  int32x4_t bestLo = vmax, bestHi = vmax;
+  int32x4_t bestIdxLo = vdupq_n_s32(0), bestIdxHi = vdupq_n_s32(0);
+
+  auto update = [&](int32x4_t dist, const int32x4_t idx, int32x4_t& best, int32x4_t& bestIdx) {
+    // Ignore the mask index and entries after the end of the palette
+    const uint32x4_t skip = vorrq_u32(vceqq_s32(idx, vmask),
+                                      vcgeq_s32(idx, vn));
+    dist = vbslq_s32(skip, vmax, dist);
+    const uint32x4_t lt = vcltq_s32(dist, best);
+    best = vbslq_s32(lt, dist, best);
+    bestIdx = vbslq_s32(lt, idx, bestIdx);
+  };
+
+  for (int i=0; i<n8; i+=8) {
+    int16x8_t dr = vsubq_s16(vld1q_s16(tr+i), vr);
+    int16x8_t dg = vsubq_s16(vld1q_s16(tg+i), vg);
+    int16x8_t db = vsubq_s16(vld1q_s16(tb+i), vb);
+    int16x8_t da = vsubq_s16(vld1q_s16(ta+i), va);
+    dr = vmulq_s16(dr, dr);
+    dg = vmulq_s16(dg, dg);
+    db = vmulq_s16(db, db);
+    da = vmulq_s16(da, da);
+
+    int32x4_t distLo = vmull_n_s16(vget_low_s16(dg), kWeightG);
+    distLo = vmlal_n_s16(distLo, vget_low_s16(dr), kWeightR);
+    distLo = vmlal_n_s16(distLo, vget_low_s16(db), kWeightB);
+    distLo = vmlal_n_s16(distLo, vget_low_s16(da), kWeightA);
+    int32x4_t distHi = vmull_n_s16(vget_high_s16(dg), kWeightG);
+    distHi = vmlal_n_s16(distHi, vget_high_s16(dr), kWeightR);
+    distHi = vmlal_n_s16(distHi, vget_high_s16(db), kWeightB);
+    distHi = vmlal_n_s16(distHi, vget_high_s16(da), kWeightA);
+
+    update(distLo, idxLo, bestLo, bestIdxLo);
+    update(distHi, idxHi, bestHi, bestIdxHi);
+    idxLo = vaddq_s32(idxLo, v8);
+    idxHi = vaddq_s32(idxHi, v8);
+  }
+
+  vst1q_s32(&bestDist[0], bestLo);
+  vst1q_s32(&bestDist[4], bestHi);
+  vst1q_s32(&bestIndex[0], bestIdxLo);
+  vst1q_s32(&bestIndex[4], bestIdxHi);
+#endif
+
+  // Each lane has the first entry with the lowest distance of its
+  // own entries, now we get the first entry with the lowest distance
+  // of all lanes.
+  int bestfit = 0;
+  int lowest = std::numeric_limits<int>::max();
+  for (int i=0; i<8; ++i) {
+    if (bestDist[i] < lowest ||
+        (bestDist[i] == lowest && bestDist[i] != std::numeric_limits<int>::max() &&
+         bestIndex[i] < bestfit)) {
+      bestfit = bestIndex[i];
+      lowest = bestDist[i];
+    }
+  }
+  return bestfit;
+}
+
+#endif // DOC_SIMD_SSE2 || DOC_SIMD_NEON
+
+void Palette::updateBestfitTable() const
+{
+  const std::lock_guard lock(m_bestfitTableMutex);
+
+  // Other thread could have updated the table
+  if (m_bestfitTableModifications.load(std::memory_order_relaxed) == m_modifications)
+    return;
+
+  const int n = std::min(256, int(m_colors.size()));
+  const int n8 = (n+7) & ~7;
+  m_bestfitTable.assign(4*n8, 0);
+  int16_t* tr = m_bestfitTable.data();
+  int16_t* tg = tr + n8;
+  int16_t* tb = tg + n8;
+  int16_t* ta = tb + n8;
+  for (int i=0; i<n; ++i) {
+    const color_t c = m_colors[i];
+    tr[i] = rgba_getr(c) >> 3;
+    tg[i] = rgba_getg(c) >> 3;
+    tb[i] = rgba_getb(c) >> 3;
+    ta[i] = rgba_geta(c) >> 3;
+  }
+
+  // The candidates of each cell are calculated on demand
+  if (n >= kCellsMinEntries) {
+    m_bestfitCells.resize(kCells);
+    if (!m_bestfitCellsReady)
+      m_bestfitCellsReady.reset(new std::atomic<bool>[kCells]);
+    for (int i=0; i<kCells; ++i)
+      m_bestfitCellsReady[i].store(false, std::memory_order_relaxed);
+  }
+  else {
+    m_bestfitCells.clear();
+    m_bestfitCellsReady.reset();
+  }
+
+  m_bestfitTableSize = n;
+  m_bestfitTableModifications.store(m_modifications, std::memory_order_release);
+}
+
 int Palette::findBestfit(int r, int g, int b, int a, int mask_index) const
 {
   ASSERT(r >= 0 && r <= 255);
@@ -436,6 +748,31 @@ int Palette::findBestfit(int r, int g, int b, int a, int mask_index) const
     if (a == 0 && mask_index >= 0)
       return mask_index;
 
+    if (m_bestfitTableModifications.load(std::memory_order_acquire) != m_modifications)
+      updateBestfitTable();
+
+    if (m_bestfitTableSize >= kCellsMinEntries) {
+      const int cell = findCell(r, g, b, a);
+      if (!m_bestfitCellsReady[cell].load(std::memory_order_acquire)) {
+        const std::lock_guard lock(m_bestfitTableMutex);
+        if (!m_bestfitCellsReady[cell].load(std::memory_order_relaxed)) {
+          findCellCandidates(m_bestfitTable.data(),
+                             m_bestfitTableSize,
+                             cell, m_bestfitCells[cell]);
+          m_bestfitCellsReady[cell].store(true, std::memory_order_release);
+        }
+      }
+      return findBestfitCandidates(m_bestfitTable.data(),
+                                   m_bestfitTableSize,
+                                   m_bestfitCells[cell],
+                                   r, g, b, a, mask_index);
+    }
+
+#if defined(DOC_SIMD_SSE2) || defined(DOC_SIMD_NEON)
+    return findBestfitTable(m_bestfitTable.data(),
+                            m_bestfitTableSize,
+                            r, g, b, a, mask_index);
+#else
     int bestfit = 0;
     int lowest = std::numeric_limits<int>::max();
     int size = std::min(256, int(m_colors.size()));
@@ -463,6 +800,7 @@ int Palette::findBestfit(int r, int g, int b, int a, int mask_index) const
     }
 
     return bestfit;
+#endif
   }
 
   if (a == 0 && mask_index >= 0)
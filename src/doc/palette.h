@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2020-2023  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -15,6 +15,10 @@
 #include "doc/object.h"
 #include "doc/palette_gradient_type.h"
 
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <string>
 
@@ -121,6 +125,22 @@ namespace doc {
     int m_modifications;
     std::string m_filename; // If the palette is associated with a file.
     std::string m_comment; // Some extra comment from the .gpl file (author, website, etc.).
+
+    // Palette entries with 5 bits per component as separated int16
+    // arrays (r, g, b, a) to compare several entries at the same time
+    // in findBestfit(). It's re-created from findBestfit() (which can
+    // be called from several threads) when m_modifications changes.
+    // In big palettes, m_bestfitCells has the entries that can be the
+    // best fit of the colors inside each cell of the RGBA space
+    // (calculated the first time a color of the cell is searched,
+    // when m_bestfitCellsReady[cell] is false).
+    void updateBestfitTable() const;
+    mutable std::vector<int16_t> m_bestfitTable;
+    mutable std::vector<std::vector<uint8_t>> m_bestfitCells;
+    mutable std::unique_ptr<std::atomic<bool>[]> m_bestfitCellsReady;
+    mutable int m_bestfitTableSize = 0;
+    mutable std::atomic<int> m_bestfitTableModifications { -1 };
+    mutable std::mutex m_bestfitTableMutex;
   };
 
 } // namespace doc
@@ -0,0 +1,44 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/palette.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+
+using namespace doc;
+
+void BM_FindBestfit(benchmark::State& state) {
+  const int ncolors = state.range(0);
+
+  Palette::initBestfit();
+  Palette pal(0, ncolors);
+  std::srand(1);
+  for (int i=0; i<ncolors; ++i)
+    pal.setEntry(i, rgba(std::rand() % 256,
+                         std::rand() % 256,
+                         std::rand() % 256, 255));
+
+  int r = 0, g = 64, b = 128;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(pal.findBestfit(r, g, b, 255, 0));
+    r = (r + 7) & 255;
+    g = (g + 13) & 255;
+    b = (b + 29) & 255;
+  }
+}
+
+BENCHMARK(BM_FindBestfit)
+  ->Arg(16)
+  ->Arg(64)
+  ->Arg(256);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,95 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/palette.h"
+
+#include <cstdlib>
+#include <limits>
+
+using namespace doc;
+
+// Linear search with the same distance used in Palette::findBestfit()
+static int bruteforce_bestfit(const Palette& pal,
+                              int r, int g, int b, int a,
+                              const int mask_index)
+{
+  r >>= 3;
+  g >>= 3;
+  b >>= 3;
+  a >>= 3;
+  if (a == 0 && mask_index >= 0)
+    return mask_index;
+
+  int bestfit = 0;
+  int lowest = std::numeric_limits<int>::max();
+  for (int i=0; i<pal.size(); ++i) {
+    const color_t c = pal.getEntry(i);
+    const int dr = (rgba_getr(c)>>3) - r;
+    const int dg = (rgba_getg(c)>>3) - g;
+    const int db = (rgba_getb(c)>>3) - b;
+    const int da = (rgba_geta(c)>>3) - a;
+    const int dist = 30*30*dr*dr + 59*59*dg*dg + 11*11*db*db + 8*8*da*da;
+    if (dist < lowest && i != mask_index) {
+      bestfit = i;
+      lowest = dist;
+    }
+  }
+  return bestfit;
+}
+
+TEST(Palette, FindBestfitLikeLinearSearch)
+{
+  std::srand(1);
+  for (const int ncolors : { 16, 64, 200, 256 }) {
+    for (const int spread : { 32, 256 }) {
+      Palette pal(0, ncolors);
+      for (int i=0; i<ncolors; ++i) {
+        // Some repeated entries to test that we return the first one
+        if (i > 0 && (std::rand() % 8) == 0)
+          pal.setEntry(i, pal.getEntry(i-1));
+        else
+          pal.setEntry(i, rgba(std::rand() % spread,
+                               std::rand() % spread,
+                               std::rand() % spread,
+                               (i & 1 ? 255: std::rand() % 256)));
+      }
+
+      for (int j=0; j<20000; ++j) {
+        const int r = std::rand() % 256;
+        const int g = std::rand() % 256;
+        const int b = std::rand() % 256;
+        const int a = std::rand() % 256;
+        const int mask_index = (j % 3) - 1;
+        ASSERT_EQ(bruteforce_bestfit(pal, r, g, b, a, mask_index),
+                  pal.findBestfit(r, g, b, a, mask_index));
+      }
+    }
+  }
+}
+
+TEST(Palette, FindBestfitAfterModification)
+{
+  Palette pal(0, 128);
+  for (int i=0; i<128; ++i)
+    pal.setEntry(i, rgba(i*2, i*2, i*2, 255));
+  EXPECT_NE(100, pal.findBestfit(255, 0, 0, 255, -1));
+
+  pal.setEntry(100, rgba(255, 0, 0, 255));
+  EXPECT_EQ(100, pal.findBestfit(255, 0, 0, 255, -1));
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  Palette::initBestfit();
+  return RUN_ALL_TESTS();
+}
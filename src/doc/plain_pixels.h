@@ -0,0 +1,224 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_PLAIN_PIXELS_H_INCLUDED
+#define DOC_PLAIN_PIXELS_H_INCLUDED
+#pragma once
+
+#include "doc/color.h"
+#include "doc/image_traits.h"
+#include "doc/simd.h"
+
+namespace doc {
+
+  // Functions to find the first/last pixel of a row that is not the
+  // same color as a reference pixel (using ImageTraits::same_color(),
+  // i.e. all transparent RGB/grayscale pixels are the same color).
+  // Used to check plain images and to shrink bounds, they compare
+  // 16 bytes at a time with SSE2/NEON (64 bytes per iteration until
+  // a different pixel is found).
+  //
+  // Only for RgbTraits, GrayscaleTraits, IndexedTraits and
+  // TilemapTraits (not bitmaps, where each byte has 8 pixels).
+
+  namespace details {
+
+    template<typename ImageTraits>
+    class PlainBlock {
+    public:
+      using pixel_t = typename ImageTraits::pixel_t;
+      static constexpr int kPixels = 16 / sizeof(pixel_t);
+
+      explicit PlainBlock(const pixel_t ref) {
+        pixel_t alphaMask = 0;
+        if constexpr (ImageTraits::color_mode == ColorMode::RGB)
+          alphaMask = rgba_a_mask;
+        else if constexpr (ImageTraits::color_mode == ColorMode::GRAYSCALE)
+          alphaMask = graya_a_mask;
+        // Transparent pixels match a transparent reference pixel
+        m_transparentRef = (alphaMask && (ref & alphaMask) == 0);
+
+#if DOC_SIMD_SSE2
+        if constexpr (sizeof(pixel_t) == 4) {
+          m_ref = _mm_set1_epi32(int(ref));
+          m_alpha = _mm_set1_epi32(int(alphaMask));
+        }
+        else if constexpr (sizeof(pixel_t) == 2) {
+          m_ref = _mm_set1_epi16(short(ref));
+          m_alpha = _mm_set1_epi16(short(alphaMask));
+        }
+        else {
+          m_ref = _mm_set1_epi8(char(ref));
+          m_alpha = _mm_setzero_si128();
+        }
+#elif DOC_SIMD_NEON
+        if constexpr (sizeof(pixel_t) == 4) {
+          m_ref = vreinterpretq_u8_u32(vdupq_n_u32(ref));
+          m_alpha = vreinterpretq_u8_u32(vdupq_n_u32(alphaMask));
+        }
+        else if constexpr (sizeof(pixel_t) == 2) {
+          m_ref = vreinterpretq_u8_u16(vdupq_n_u16(ref));
+          m_alpha = vreinterpretq_u8_u16(vdupq_n_u16(alphaMask));
+        }
+        else {
+          m_ref = vdupq_n_u8(ref);
+          m_alpha = vdupq_n_u8(0);
+        }
+#else
+        m_ref = ref;
+#endif
+      }
+
+#if DOC_SIMD_SSE2
+      using vector_t = __m128i;
+
+      // Returns a vector with all bits set in the pixels that match
+      // the reference pixel.
+      vector_t match(const pixel_t* p) const {
+        const __m128i v = _mm_loadu_si128((const __m128i*)p);
+        __m128i r = cmpeq(v, m_ref);
+        if (m_transparentRef)
+          r = _mm_or_si128(r, cmpeq(_mm_and_si128(v, m_alpha), _mm_setzero_si128()));
+        return r;
+      }
+
+      static vector_t both(const vector_t a, const vector_t b) {
+        return _mm_and_si128(a, b);
+      }
+
+      static bool all(const vector_t r) {
+        return (_mm_movemask_epi8(r) == 0xffff);
+      }
+
+    private:
+      static __m128i cmpeq(const __m128i a, const __m128i b) {
+        if constexpr (sizeof(pixel_t) == 4)
+          return _mm_cmpeq_epi32(a, b);
+        else if constexpr (sizeof(pixel_t) == 2)
+          return _mm_cmpeq_epi16(a, b);
+        else
+          return _mm_cmpeq_epi8(a, b);
+      }
+
+    public:
+#elif DOC_SIMD_NEON
+      using vector_t = uint8x16_t;
+
+      vector_t match(const pixel_t* p) const {
+        const uint8x16_t v = vld1q_u8((const uint8_t*)p);
+        uint8x16_t r = cmpeq(v, m_ref);
+        if (m_transparentRef)
+          r = vorrq_u8(r, cmpeq(vandq_u8(v, m_alpha), vdupq_n_u8(0)));
+        return r;
+      }
+
+      static vector_t both(const vector_t a, const vector_t b) {
+        return vandq_u8(a, b);
+      }
+
+      static bool all(const vector_t r) {
+        return (vminvq_u8(r) == 0xff);
+      }
+
+    private:
+      static uint8x16_t cmpeq(const uint8x16_t a, const uint8x16_t b) {
+        if constexpr (sizeof(pixel_t) == 4)
+          return vreinterpretq_u8_u32(vceqq_u32(vreinterpretq_u32_u8(a),
+                                                vreinterpretq_u32_u8(b)));
+        else if constexpr (sizeof(pixel_t) == 2)
+          return vreinterpretq_u8_u16(vceqq_u16(vreinterpretq_u16_u8(a),
+                                                vreinterpretq_u16_u8(b)));
+        else
+          return vceqq_u8(a, b);
+      }
+
+    public:
+#else
+      using vector_t = bool;
+
+      vector_t match(const pixel_t* p) const {
+        for (int i=0; i<kPixels; ++i)
+          if (!ImageTraits::same_color(p[i], m_ref))
+            return false;
+        return true;
+      }
+
+      static vector_t both(const vector_t a, const vector_t b) { return a && b; }
+      static bool all(const vector_t r) { return r; }
+#endif
+
+    private:
+#if DOC_SIMD_SSE2
+      __m128i m_ref, m_alpha;
+#elif DOC_SIMD_NEON
+      uint8x16_t m_ref, m_alpha;
+#else
+      pixel_t m_ref;
+#endif
+      bool m_transparentRef;
+    };
+
+  } // namespace details
+
+  // Returns the index of the first pixel in [p, p+n) that is not the
+  // same color as "ref", or n if all pixels are the same color.
+  template<typename ImageTraits>
+  int find_first_non_plain_pixel(const typename ImageTraits::pixel_t* p,
+                                 const int n,
+                                 const typename ImageTraits::pixel_t ref) {
+    using Block = details::PlainBlock<ImageTraits>;
+    constexpr int N = Block::kPixels;
+    const Block block(ref);
+    int x = 0;
+
+    for (; x+4*N<=n; x+=4*N) {
+      const auto r = Block::both(Block::both(block.match(p+x), block.match(p+x+N)),
+                                 Block::both(block.match(p+x+2*N), block.match(p+x+3*N)));
+      if (!Block::all(r))
+        break;
+    }
+    for (; x+N<=n; x+=N) {
+      if (!Block::all(block.match(p+x)))
+        break;
+    }
+    for (; x<n; ++x) {
+      if (!ImageTraits::same_color(p[x], ref))
+        return x;
+    }
+    return n;
+  }
+
+  // Returns the index of the last pixel in [p, p+n) that is not the
+  // same color as "ref", or -1 if all pixels are the same color.
+  template<typename ImageTraits>
+  int find_last_non_plain_pixel(const typename ImageTraits::pixel_t* p,
+                                const int n,
+                                const typename ImageTraits::pixel_t ref) {
+    using Block = details::PlainBlock<ImageTraits>;
+    constexpr int N = Block::kPixels;
+    const Block block(ref);
+    int x = n;
+
+    for (; x-4*N>=0; x-=4*N) {
+      const auto r = Block::both(Block::both(block.match(p+x-N), block.match(p+x-2*N)),
+                                 Block::both(block.match(p+x-3*N), block.match(p+x-4*N)));
+      if (!Block::all(r))
+        break;
+    }
+    for (; x-N>=0; x-=N) {
+      if (!Block::all(block.match(p+x-N)))
+        break;
+    }
+    for (--x; x>=0; --x) {
+      if (!ImageTraits::same_color(p[x], ref))
+        return x;
+    }
+    return -1;
+  }
+
+} // namespace doc
+
+#endif
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2018-2023 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -16,8 +16,10 @@
 #include "doc/dispatch.h"
 #include "doc/image_impl.h"
 #include "doc/palette.h"
+#include "doc/plain_pixels.h"
 #include "doc/remap.h"
 #include "doc/rgbmap.h"
+#include "doc/simd.h"
 #include "doc/tile.h"
 #include "gfx/region.h"
 
@@ -25,9 +27,7 @@
 
 #include <stdexcept>
 
-#if defined(__x86_64__) || defined(_WIN64)
-  #include <emmintrin.h>
-#endif
+#include <cstring>
 
 namespace doc {
 
@@ -311,6 +311,20 @@ void fill_ellipse(Image* image, int x1, int y1, int x2, int y2, int extraXPxs, i
 
 namespace {
 
+template<typename ImageTraits>
+bool is_plain_image_simd_templ(const Image* img, const color_t color)
+{
+  using pixel_t = typename ImageTraits::pixel_t;
+  const int w = img->width();
+  const int h = img->height();
+  for (int y=0; y<h; ++y) {
+    auto p = (const pixel_t*)img->readPixelAddress(0, y);
+    if (find_first_non_plain_pixel<ImageTraits>(p, w, pixel_t(color)) < w)
+      return false;
+  }
+  return true;
+}
+
 template<typename ImageTraits>
 bool is_plain_image_templ(const Image* img, const color_t color)
 {
@@ -359,74 +373,91 @@ bool is_same_image_templ(const Image* i1, const Image* i2)
   return true;
 }
 
-template<typename ImageTraits>
-bool is_same_image_simd_templ(const Image* i1, const Image* i2)
+// Returns true if the 16 bytes in "p" and "q" are equal (the
+// addresses don't need to be aligned).
+inline bool equal_16_bytes(const uint8_t* p, const uint8_t* q)
 {
-  using address_t = typename ImageTraits::address_t;
-  const int w = i1->width();
-  const int h = i1->height();
-  for (int y=0; y<h; ++y) {
-    auto p = (const address_t)i1->getPixelAddress(0, y);
-    auto q = (const address_t)i2->getPixelAddress(0, y);
-    int x = 0;
-
-#if DOC_USE_ALIGNED_PIXELS
-#if defined(__x86_64__) || defined(_WIN64)
-    // Use SSE2
-
-    if constexpr (ImageTraits::bytes_per_pixel == 4) {
-      for (; x+4<=w; x+=4, p+=4, q+=4) {
-        __m128i r = _mm_cmpeq_epi32(*(const __m128i*)p, *(const __m128i*)q);
-        if (_mm_movemask_epi8(r) != 0xffff) { // !_mm_test_all_ones(r)
-          if (!ImageTraits::same_color(p[0], q[0]) ||
-              !ImageTraits::same_color(p[1], q[1]) ||
-              !ImageTraits::same_color(p[2], q[2]) ||
-              !ImageTraits::same_color(p[3], q[3]))
-            return false;
-        }
-      }
-    }
-    else if constexpr (ImageTraits::bytes_per_pixel == 2) {
-      for (; x+8<=w; x+=8, p+=8, q+=8) {
-        __m128i r = _mm_cmpeq_epi16(*(const __m128i*)p, *(const __m128i*)q);
-        if (_mm_movemask_epi8(r) != 0xffff) { // !_mm_test_all_ones(r)
-          if (!ImageTraits::same_color(p[0], q[0]) ||
-              !ImageTraits::same_color(p[1], q[1]) ||
-              !ImageTraits::same_color(p[2], q[2]) ||
-              !ImageTraits::same_color(p[3], q[3]) ||
-              !ImageTraits::same_color(p[4], q[4]) ||
-              !ImageTraits::same_color(p[5], q[5]) ||
-              !ImageTraits::same_color(p[6], q[6]) ||
-              !ImageTraits::same_color(p[7], q[7]))
-            return false;
-        }
-      }
-    }
-    else if constexpr (ImageTraits::bytes_per_pixel == 1) {
-      for (; x+16<=w; x+=16, p+=16, q+=16) {
-        __m128i r = _mm_cmpeq_epi8(*(const __m128i*)p, *(const __m128i*)q);
-        if (_mm_movemask_epi8(r) != 0xffff) { // !_mm_test_all_ones(r)
-          return false;
-        }
-      }
-    }
+#if DOC_SIMD_SSE2
+  const __m128i r = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p),
+                                   _mm_loadu_si128((const __m128i*)q));
+  return (_mm_movemask_epi8(r) == 0xffff);
+#elif DOC_SIMD_NEON
+  const uint8x16_t r = vceqq_u8(vld1q_u8(p), vld1q_u8(q));
+  return (vminvq_u8(r) == 0xff);
+#else
+  return (std::memcmp(p, q, 16) == 0);
 #endif
-#endif  // DOC_USE_ALIGNED_PIXELS
-    {
-      for (; x+4<=w; x+=4, p+=4, q+=4) {
-        if (!ImageTraits::same_color(p[0], q[0]) ||
-            !ImageTraits::same_color(p[1], q[1]) ||
-            !ImageTraits::same_color(p[2], q[2]) ||
-            !ImageTraits::same_color(p[3], q[3]))
-          return false;
+}
+
+// Counts the different pixels of two rows (or returns 1 on the first
+// different pixel if "stopOnFirst" is true). Blocks of 16 bytes are
+// compared at once, and only blocks with different bytes are checked
+// pixel by pixel with same_color() (e.g. transparent RGB pixels with
+// different RGB values are the same color).
+template<typename ImageTraits, bool stopOnFirst>
+int count_row_diff(const typename ImageTraits::pixel_t* p,
+                   const typename ImageTraits::pixel_t* q,
+                   const int w)
+{
+  constexpr int N = 16 / sizeof(typename ImageTraits::pixel_t);
+  int diff = 0;
+  int x = 0;
+
+  for (; x+N<=w; x+=N, p+=N, q+=N) {
+    if (equal_16_bytes((const uint8_t*)p, (const uint8_t*)q))
+      continue;
+
+    for (int i=0; i<N; ++i) {
+      if (!ImageTraits::same_color(p[i], q[i])) {
+        if constexpr (stopOnFirst)
+          return 1;
+        ++diff;
       }
     }
+  }
 
-    for (; x<w; ++x, ++p, ++q) {
-      if (!ImageTraits::same_color(*p, *q))
-        return false;
+  for (; x<w; ++x, ++p, ++q) {
+    if (!ImageTraits::same_color(*p, *q)) {
+      if constexpr (stopOnFirst)
+        return 1;
+      ++diff;
     }
   }
+  return diff;
+}
+
+template<typename ImageTraits>
+int count_diff_between_images_simd_templ(const Image* i1, const Image* i2)
+{
+  using pixel_t = typename ImageTraits::pixel_t;
+  const int w = i1->width();
+  const int h = i1->height();
+  int diff = 0;
+  for (int y=0; y<h; ++y) {
+    diff += count_row_diff<ImageTraits, false>(
+      (const pixel_t*)i1->readPixelAddress(0, y),
+      (const pixel_t*)i2->readPixelAddress(0, y), w);
+  }
+  return diff;
+}
+
+template<typename ImageTraits>
+bool is_same_image_simd_templ(const Image* i1, const Image* i2)
+{
+  using pixel_t = typename ImageTraits::pixel_t;
+  const int w = i1->width();
+  const int h = i1->height();
+
+  // Images sharing the same pixels
+  if (h > 0 && i1->readPixelAddress(0, 0) == i2->readPixelAddress(0, 0))
+    return true;
+
+  for (int y=0; y<h; ++y) {
+    if (count_row_diff<ImageTraits, true>(
+          (const pixel_t*)i1->readPixelAddress(0, y),
+          (const pixel_t*)i2->readPixelAddress(0, y), w))
+      return false;
+  }
   return true;
 }
 
@@ -435,11 +466,11 @@ bool is_same_image_simd_templ(const Image* i1, const Image* i2)
 bool is_plain_image(const Image* img, color_t c)
 {
   switch (img->pixelFormat()) {
-    case IMAGE_RGB:       return is_plain_image_templ<RgbTraits>(img, c);
-    case IMAGE_GRAYSCALE: return is_plain_image_templ<GrayscaleTraits>(img, c);
-    case IMAGE_INDEXED:   return is_plain_image_templ<IndexedTraits>(img, c);
+    case IMAGE_RGB:       return is_plain_image_simd_templ<RgbTraits>(img, c);
+    case IMAGE_GRAYSCALE: return is_plain_image_simd_templ<GrayscaleTraits>(img, c);
+    case IMAGE_INDEXED:   return is_plain_image_simd_templ<IndexedTraits>(img, c);
     case IMAGE_BITMAP:    return is_plain_image_templ<BitmapTraits>(img, c);
-    case IMAGE_TILEMAP:   return is_plain_image_templ<TilemapTraits>(img, c);
+    case IMAGE_TILEMAP:   return is_plain_image_simd_templ<TilemapTraits>(img, c);
   }
   return false;
 }
@@ -460,11 +491,11 @@ int count_diff_between_images(const Image* i1, const Image* i2)
     return -1;
 
   switch (i1->pixelFormat()) {
-    case IMAGE_RGB:       return count_diff_between_images_templ<RgbTraits>(i1, i2);
-    case IMAGE_GRAYSCALE: return count_diff_between_images_templ<GrayscaleTraits>(i1, i2);
-    case IMAGE_INDEXED:   return count_diff_between_images_templ<IndexedTraits>(i1, i2);
+    case IMAGE_RGB:       return count_diff_between_images_simd_templ<RgbTraits>(i1, i2);
+    case IMAGE_GRAYSCALE: return count_diff_between_images_simd_templ<GrayscaleTraits>(i1, i2);
+    case IMAGE_INDEXED:   return count_diff_between_images_simd_templ<IndexedTraits>(i1, i2);
     case IMAGE_BITMAP:    return count_diff_between_images_templ<BitmapTraits>(i1, i2);
-    case IMAGE_TILEMAP:   return count_diff_between_images_templ<TilemapTraits>(i1, i2);
+    case IMAGE_TILEMAP:   return count_diff_between_images_simd_templ<TilemapTraits>(i1, i2);
   }
 
   ASSERT(false);
@@ -557,16 +588,19 @@ static uint32_t calculate_image_hash_templ(const Image* image,
   const uint32_t len = widthBytes * bounds.h;
   if (bounds == image->bounds() &&
       widthBytes == image->rowBytes()) {
-    return CITYHASH((const char*)image->getPixelAddress(0, 0), len);
+    return CITYHASH((const char*)image->readPixelAddress(0, 0), len);
   }
   else {
-    std::vector<uint8_t> buf(len);
-    uint8_t* dst = &buf[0];
+    // Reuse the buffer to copy the rows (this is called for each tile
+    // when tilesets are matched)
+    static thread_local std::vector<uint8_t> buf;
+    buf.resize(len);
+    uint8_t* dst = buf.data();
     for (int y=0; y<bounds.h; ++y, dst+=widthBytes) {
-      auto src = (const uint8_t*)image->getPixelAddress(bounds.x, bounds.y+y);
+      auto src = image->readPixelAddress(bounds.x, bounds.y+y);
       std::copy(src, src+widthBytes, dst);
     }
-    return CITYHASH((const char*)&buf[0], buf.size());
+    return CITYHASH((const char*)buf.data(), len);
   }
 }
 
@@ -582,6 +616,46 @@ uint32_t calculate_image_hash(const Image* img, const gfx::Rect& bounds)
   return 0;
 }
 
+uint64_t calculate_image_content_hash(const Image* image)
+{
+  const uint32_t header[4] = {
+    uint32_t(image->pixelFormat()),
+    uint32_t(image->width()),
+    uint32_t(image->height()),
+    uint32_t(image->maskColor())
+  };
+  uint64_t hash = CityHash64((const char*)header, sizeof(header));
+
+  // ImageSpec::widthBytes() counts one byte per pixel for bitmaps,
+  // so we calculate the real number of used bytes per row here.
+  const bool isBitmap = (image->pixelFormat() == IMAGE_BITMAP);
+  const int widthBytes = (isBitmap ? (image->width()+7) / 8:
+                                     image->widthBytes());
+
+  // Ignore unused bits at the end of each row of bitmaps
+  const int extraBits = (isBitmap ? (image->width() & 7): 0);
+  if (extraBits) {
+    const uint8_t mask = uint8_t((1 << extraBits) - 1);
+    std::vector<uint8_t> row(widthBytes);
+    for (int y=0; y<image->height(); ++y) {
+      const uint8_t* src = image->readPixelAddress(0, y);
+      std::copy(src, src+widthBytes, row.begin());
+      row.back() &= mask;
+      hash = CityHash64WithSeed((const char*)row.data(), widthBytes, hash);
+    }
+  }
+  else if (widthBytes == image->rowBytes()) {
+    hash = CityHash64WithSeed((const char*)image->readPixelAddress(0, 0),
+                              size_t(widthBytes) * image->height(), hash);
+  }
+  else {
+    for (int y=0; y<image->height(); ++y)
+      hash = CityHash64WithSeed((const char*)image->readPixelAddress(0, y),
+                                widthBytes, hash);
+  }
+  return hash;
+}
+
 void preprocess_transparent_pixels(Image* image)
 {
   switch (image->pixelFormat()) {
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2023 Igara Studio S.A.
+// Copyright (c) 2023-2024 Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -41,6 +41,44 @@ void BM_IsSameImageNew(benchmark::State& state) {
   }
 }
 
+void BM_CountDiffBetweenImages(benchmark::State& state) {
+  const auto pf = (PixelFormat)state.range(0);
+  const int w = state.range(1);
+  const int h = state.range(2);
+  ImageRef a(Image::create(pf, w, h));
+  doc::algorithm::random_image(a.get());
+  ImageRef b(Image::create(pf, w, h));
+  b->copy(a.get(), gfx::Clip(a->bounds()));
+  b->putPixel(w/2, h/2, a->getPixel(w/2, h/2) ^ 1);
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(count_diff_between_images(a.get(), b.get()));
+  }
+}
+
+void BM_CalculateImageHash(benchmark::State& state) {
+  const auto pf = (PixelFormat)state.range(0);
+  const int w = state.range(1);
+  const int h = state.range(2);
+  ImageRef a(Image::create(pf, w+3, h));
+  doc::algorithm::random_image(a.get());
+  // Region of the image (rows are not contiguous)
+  const gfx::Rect bounds(1, 0, w, h);
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(calculate_image_hash(a.get(), bounds));
+  }
+}
+
+void BM_IsEmptyImage(benchmark::State& state) {
+  const auto pf = (PixelFormat)state.range(0);
+  const int w = state.range(1);
+  const int h = state.range(2);
+  ImageRef a(Image::create(pf, w, h));
+  a->clear(a->maskColor());
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(is_empty_image(a.get()));
+  }
+}
+
 #define DEFARGS()                                                \
    ->Args({ IMAGE_RGB, 16, 16 })                                 \
    ->Args({ IMAGE_RGB, 1024, 1024 })                             \
@@ -60,4 +98,16 @@ BENCHMARK(BM_IsSameImageNew)
   DEFARGS()
   ->UseRealTime();
 
+BENCHMARK(BM_CountDiffBetweenImages)
+  DEFARGS()
+  ->UseRealTime();
+
+BENCHMARK(BM_CalculateImageHash)
+  DEFARGS()
+  ->UseRealTime();
+
+BENCHMARK(BM_IsEmptyImage)
+  DEFARGS()
+  ->UseRealTime();
+
 BENCHMARK_MAIN();
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2023 Igara Studio S.A.
+// Copyright (c) 2023-2024 Igara Studio S.A.
 // Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -16,20 +16,32 @@ namespace doc {
   class Image;
   template<typename ImageTraits> class ImageImpl;
 
+  // Returns the address of a pixel to modify it, pixels shared with
+  // other images are unshared (copied) first.
   template<class Traits>
-  inline typename Traits::address_t get_pixel_address_fast(const Image* image, int x, int y) {
+  inline typename Traits::address_t get_pixel_address_fast(Image* image, int x, int y) {
     ASSERT(x >= 0 && x < image->width());
     ASSERT(y >= 0 && y < image->height());
 
     return (((ImageImpl<Traits>*)image)->address(x, y));
   }
 
+  // Returns the address of a pixel only to read it, shared pixels
+  // are not copied.
+  template<class Traits>
+  inline typename Traits::const_address_t get_pixel_address_fast(const Image* image, int x, int y) {
+    ASSERT(x >= 0 && x < image->width());
+    ASSERT(y >= 0 && y < image->height());
+
+    return (((const ImageImpl<Traits>*)image)->readAddress(x, y));
+  }
+
   template<class Traits>
   inline typename Traits::pixel_t get_pixel_fast(const Image* image, int x, int y) {
     ASSERT(x >= 0 && x < image->width());
     ASSERT(y >= 0 && y < image->height());
 
-    return *(((ImageImpl<Traits>*)image)->address(x, y));
+    return *(((const ImageImpl<Traits>*)image)->readAddress(x, y));
   }
 
   template<class Traits>
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2023  Igara Studio S.A.
+// Copyright (c) 2023-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -80,6 +80,113 @@ TYPED_TEST(Primitives, IsSameImage)
   }
 }
 
+TYPED_TEST(Primitives, CountDiffBetweenImages)
+{
+  using ImageTraits = TypeParam;
+
+  std::mt19937 gen(1);
+  for (int w=1; w<70; w+=3) {
+    ImageRef a(Image::create(ImageTraits::pixel_format, w, 5));
+    doc::algorithm::random_image(a.get());
+    ImageRef b(Image::createCopy(a.get()));
+    EXPECT_EQ(0, count_diff_between_images(a.get(), b.get()));
+
+    for (int i=0; i<w; ++i) {
+      const int u = gen() % w;
+      const int v = gen() % 5;
+      put_pixel_fast<ImageTraits>(b.get(), u, v,
+                                  get_pixel_fast<ImageTraits>(b.get(), u, v) ^ (gen() & 0xff));
+    }
+
+    int expected = 0;
+    for (int v=0; v<5; ++v)
+      for (int u=0; u<w; ++u)
+        if (!ImageTraits::same_color(get_pixel_fast<ImageTraits>(a.get(), u, v),
+                                     get_pixel_fast<ImageTraits>(b.get(), u, v)))
+          ++expected;
+
+    EXPECT_EQ(expected, count_diff_between_images(a.get(), b.get()));
+    EXPECT_EQ(expected == 0, is_same_image(a.get(), b.get()));
+  }
+}
+
+TYPED_TEST(Primitives, IsPlainImage)
+{
+  using ImageTraits = TypeParam;
+
+  // Opaque color
+  color_t c = 1;
+  if (ImageTraits::pixel_format == IMAGE_RGB) c |= rgba_a_mask;
+  else if (ImageTraits::pixel_format == IMAGE_GRAYSCALE) c |= graya_a_mask;
+
+  std::mt19937 gen(1);
+  for (int w=1; w<90; w+=5) {
+    ImageRef a(Image::create(ImageTraits::pixel_format, w, 3));
+    a->clear(c);
+    EXPECT_TRUE(is_plain_image(a.get(), c));
+    EXPECT_FALSE(is_plain_image(a.get(), 0));
+
+    const int u = gen() % w;
+    const int v = gen() % 3;
+    put_pixel_fast<ImageTraits>(a.get(), u, v, 0);
+    EXPECT_FALSE(is_plain_image(a.get(), c));
+    put_pixel_fast<ImageTraits>(a.get(), u, v, c);
+    EXPECT_TRUE(is_plain_image(a.get(), c));
+  }
+
+  // All transparent RGB/grayscale pixels are the same color
+  if (ImageTraits::pixel_format == IMAGE_RGB ||
+      ImageTraits::pixel_format == IMAGE_GRAYSCALE) {
+    ImageRef a(Image::create(ImageTraits::pixel_format, 67, 2));
+    a->clear(0);
+    put_pixel_fast<ImageTraits>(a.get(), 40, 1, 0x12);
+    EXPECT_TRUE(is_empty_image(a.get()));
+    EXPECT_TRUE(is_plain_image(a.get(), 0x34));
+    EXPECT_FALSE(is_plain_image(a.get(), c));
+  }
+}
+
+TYPED_TEST(Primitives, ImageHash)
+{
+  using ImageTraits = TypeParam;
+  if (ImageTraits::pixel_format == IMAGE_BITMAP ||
+      ImageTraits::pixel_format == IMAGE_TILEMAP)
+    return;
+
+  // The hash of a region of an image is the same as the hash of an
+  // image with the same pixels
+  ImageRef a(Image::create(ImageTraits::pixel_format, 37, 19));
+  doc::algorithm::random_image(a.get());
+  ImageRef b(Image::create(ImageTraits::pixel_format, 16, 16));
+  b->copy(a.get(), gfx::Clip(0, 0, 5, 3, 16, 16));
+  EXPECT_EQ(calculate_image_hash(b.get(), b->bounds()),
+            calculate_image_hash(a.get(), gfx::Rect(5, 3, 16, 16)));
+}
+
+TYPED_TEST(Primitives, ImageContentHash)
+{
+  using ImageTraits = TypeParam;
+
+  ImageRef a(Image::create(ImageTraits::pixel_format, 31, 17));
+  doc::algorithm::random_image(a.get());
+  ImageRef b(Image::createCopy(a.get()));
+  EXPECT_EQ(calculate_image_content_hash(a.get()),
+            calculate_image_content_hash(b.get()));
+
+  auto old = get_pixel_fast<ImageTraits>(b.get(), 30, 16);
+  put_pixel_fast<ImageTraits>(b.get(), 30, 16, (old != 0 ? 0: 1));
+  EXPECT_NE(calculate_image_content_hash(a.get()),
+            calculate_image_content_hash(b.get()));
+
+  // Same pixels with a different size
+  ImageRef c(Image::create(ImageTraits::pixel_format, 17, 31));
+  ImageRef d(Image::create(ImageTraits::pixel_format, 31, 17));
+  c->clear(0);
+  d->clear(0);
+  EXPECT_NE(calculate_image_content_hash(c.get()),
+            calculate_image_content_hash(d.get()));
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2023  Igara Studio S.A.
+// Copyright (c) 2023-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -39,7 +39,9 @@ void RenderPlan::addLayer(const Layer* layer,
 
     case ObjectType::LayerImage:
     case ObjectType::LayerTilemap: {
-      m_items.emplace_back(m_order, layer, layer->cel(frame));
+      const Cel* cel = layer->cel(frame);
+      m_items.emplace_back(m_order, layer, cel);
+      m_keys.push_back(Key{ layer, cel, (cel ? cel->zIndex(): 0) });
       break;
     }
 
@@ -53,6 +55,47 @@ void RenderPlan::addLayer(const Layer* layer,
   }
 }
 
+bool RenderPlan::isValidFor(const Layer* layer,
+                            const frame_t frame) const
+{
+  size_t i = 0;
+  return (checkLayer(layer, frame, i) &&
+          i == m_keys.size());
+}
+
+bool RenderPlan::checkLayer(const Layer* layer,
+                            const frame_t frame,
+                            size_t& i) const
+{
+  if (!layer->isVisible())
+    return true;
+
+  switch (layer->type()) {
+
+    case ObjectType::LayerImage:
+    case ObjectType::LayerTilemap: {
+      if (i >= m_keys.size())
+        return false;
+
+      const Key& key = m_keys[i++];
+      const Cel* cel = layer->cel(frame);
+      return (key.layer == layer &&
+              key.cel == cel &&
+              key.zIndex == (cel ? cel->zIndex(): 0));
+    }
+
+    case ObjectType::LayerGroup: {
+      for (const auto child : static_cast<const LayerGroup*>(layer)->layers()) {
+        if (!checkLayer(child, frame, i))
+          return false;
+      }
+      break;
+    }
+
+  }
+  return true;
+}
+
 void RenderPlan::processZIndexes() const
 {
   m_processZIndex = false;
@@ -80,4 +123,60 @@ void RenderPlan::processZIndexes() const
             });
 }
 
+//////////////////////////////////////////////////////////////////////
+// RenderPlanCache
+
+RenderPlanCache::RenderPlanCache(const int maxPlans)
+  : m_maxPlans(std::max(1, maxPlans))
+{
+}
+
+RenderPlanPtr RenderPlanCache::getPlan(const Layer* layer,
+                                       const frame_t frame)
+{
+  ++m_useCounter;
+
+  auto it = std::find_if(m_entries.begin(), m_entries.end(),
+                         [layer, frame](const Entry& entry){
+                           return (entry.layer == layer &&
+                                   entry.frame == frame);
+                         });
+  if (it != m_entries.end()) {
+    it->lastUse = m_useCounter;
+    if (it->plan->isValidFor(layer, frame))
+      return it->plan;
+  }
+  else {
+    // Replace the least recently used plan
+    if (int(m_entries.size()) >= m_maxPlans) {
+      it = std::min_element(m_entries.begin(), m_entries.end(),
+                            [](const Entry& a, const Entry& b){
+                              return a.lastUse < b.lastUse;
+                            });
+    }
+    else {
+      m_entries.emplace_back();
+      it = m_entries.end()-1;
+    }
+    it->layer = layer;
+    it->frame = frame;
+    it->lastUse = m_useCounter;
+  }
+
+  auto plan = std::make_shared<RenderPlan>();
+  plan->addLayer(layer, frame);
+
+  // Process z-indexes right now so the plan is not modified anymore
+  // (and can be used from several threads)
+  plan->items();
+
+  it->plan = plan;
+  return plan;
+}
+
+void RenderPlanCache::clear()
+{
+  m_entries.clear();
+}
+
 } // namespace doc
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2023  Igara Studio S.A.
+// Copyright (c) 2023-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -12,6 +12,10 @@
 #include "doc/cel_list.h"
 #include "doc/frame.h"
 
+#include <cstdint>
+#include <memory>
+#include <vector>
+
 namespace doc {
   class Layer;
 
@@ -43,12 +47,60 @@ namespace doc {
     void addLayer(const Layer* layer,
                   const frame_t frame);
 
+    // Returns true if creating a new plan with addLayer(layer, frame)
+    // would give us the same items (same layers, cels and
+    // z-indexes). This plan must be created with just one addLayer()
+    // call.
+    bool isValidFor(const Layer* layer,
+                    const frame_t frame) const;
+
   private:
+    // Layer/cel/z-index added with addLayer() in the original order
+    // (m_items is re-ordered by processZIndexes())
+    struct Key {
+      const Layer* layer;
+      const Cel* cel;
+      int zIndex;
+    };
+
     void processZIndexes() const;
+    bool checkLayer(const Layer* layer,
+                    const frame_t frame,
+                    size_t& i) const;
 
     int m_order = 0;
     mutable Items m_items;
     mutable bool m_processZIndex = true;
+    std::vector<Key> m_keys;
+  };
+
+  using RenderPlanPtr = std::shared_ptr<const RenderPlan>;
+
+  // Keeps the RenderPlans used in previous renders to avoid creating
+  // and sorting them again and again (e.g. on each playback tick or
+  // editor redraw) when layers, cels and z-indexes didn't change.
+  //
+  // This class is not thread-safe, but the returned plans are
+  // read-only and can be shared between threads.
+  class RenderPlanCache {
+  public:
+    explicit RenderPlanCache(const int maxPlans = 16);
+
+    RenderPlanPtr getPlan(const Layer* layer,
+                          const frame_t frame);
+    void clear();
+
+  private:
+    struct Entry {
+      const Layer* layer;
+      frame_t frame;
+      uint32_t lastUse;
+      RenderPlanPtr plan;
+    };
+
+    std::vector<Entry> m_entries;
+    int m_maxPlans;
+    uint32_t m_useCounter = 0;
   };
 
 } // namespace doc
@@ -134,6 +134,49 @@ TEST(RenderPlan, ZIndexBugWithEmptyCels)
   d->setZIndex(-3); EXPECT_PLAN(d, a, b);
 }
 
+TEST(RenderPlan, Cache)
+{
+  auto doc = std::make_shared<Document>();
+  ImageSpec spec(ColorMode::INDEXED, 2, 2);
+  Sprite* spr;
+  doc->sprites().add(spr = Sprite::MakeStdSprite(spec));
+
+  LayerImage
+    *lay0 = static_cast<LayerImage*>(spr->root()->firstLayer()),
+    *lay1 = new LayerImage(spr);
+  Cel* a = lay0->cel(0), *b;
+  lay1->addCel(b = new Cel(0, ImageRef(Image::create(spec))));
+  spr->root()->insertLayer(lay1, lay0);
+
+  RenderPlanCache cache;
+  RenderPlanPtr plan = cache.getPlan(spr->root(), 0);
+  ASSERT_EQ(2, int(plan->items().size()));
+  EXPECT_EQ(a, plan->items()[0].cel);
+  EXPECT_EQ(b, plan->items()[1].cel);
+
+  // Nothing changed, reuse the same plan
+  EXPECT_EQ(plan, cache.getPlan(spr->root(), 0));
+
+  // Z-index changed
+  a->setZIndex(1);
+  EXPECT_FALSE(plan->isValidFor(spr->root(), 0));
+  plan = cache.getPlan(spr->root(), 0);
+  EXPECT_EQ(b, plan->items()[0].cel);
+  EXPECT_EQ(a, plan->items()[1].cel);
+  EXPECT_EQ(plan, cache.getPlan(spr->root(), 0));
+
+  // Hidden layer
+  lay1->setVisible(false);
+  plan = cache.getPlan(spr->root(), 0);
+  ASSERT_EQ(1, int(plan->items().size()));
+  EXPECT_EQ(a, plan->items()[0].cel);
+
+  // Other frame
+  plan = cache.getPlan(spr->root(), 1);
+  ASSERT_EQ(1, int(plan->items().size()));
+  EXPECT_EQ(nullptr, plan->items()[0].cel);
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2022 Igara Studio S.A.
+// Copyright (c) 2022-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -86,6 +86,36 @@ TEST(ResizeImage, NearestNeighborInterp)
   ASSERT_EQ(0, count_diff_between_images(src.get(), dst2.get()));
 }
 
+TEST(ResizeImage, NearestNeighborRandomSizes)
+{
+  for (PixelFormat pf : { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED, IMAGE_BITMAP }) {
+    for (int i=0; i<100; ++i) {
+      const int w = 1 + (i*7) % 23;
+      const int h = 1 + (i*5) % 19;
+      const int dw = (i % 3 == 0 ? w*(1 + i%4): 1 + (i*11) % 61);
+      const int dh = (i % 3 == 0 ? h*(1 + i%5): 1 + (i*13) % 53);
+
+      ImageRef src(Image::create(pf, w, h));
+      for (int y=0; y<h; ++y)
+        for (int x=0; x<w; ++x)
+          put_pixel(src.get(), x, y, (pf == IMAGE_BITMAP ? (x+y*i) & 1: x*31 + y*17 + i));
+
+      ImageRef dst(Image::create(pf, dw, dh));
+      algorithm::resize_image(src.get(), dst.get(),
+                              algorithm::RESIZE_METHOD_NEAREST_NEIGHBOR,
+                              nullptr, nullptr, -1);
+
+      for (int y=0; y<dh; ++y)
+        for (int x=0; x<dw; ++x)
+          ASSERT_EQ(get_pixel(src.get(),
+                              int(x * (double(w) / double(dw))),
+                              int(y * (double(h) / double(dh)))),
+                    get_pixel(dst.get(), x, y))
+            << "pf=" << pf << " i=" << i << " x=" << x << " y=" << y;
+    }
+  }
+}
+
 #if 0                           // TODO complete this test
 TEST(ResizeImage, BilinearInterpRGBType)
 {
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2020-2022 Igara Studio S.A.
+// Copyright (c) 2020-2024 Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -27,6 +27,14 @@ namespace doc {
 
     virtual int maskIndex() const = 0;
 
+    // Maps "n" colors at once, so a whole scanline can be converted
+    // with just one virtual call. Implementations override it to
+    // avoid the virtual mapColor() call per pixel.
+    virtual void mapColors(const color_t* colors, uint8_t* indexes, const int n) const {
+      for (int i=0; i<n; ++i)
+        indexes[i] = mapColor(colors[i]);
+    }
+
     int mapColor(const int r,
                  const int g,
                  const int b,
@@ -0,0 +1,120 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/rgbmap_cache.h"
+
+#include "base/debug.h"
+#include "doc/octree_map.h"
+#include "doc/palette.h"
+#include "doc/rgbmap_rgb5a3.h"
+
+namespace doc {
+
+struct RgbMapCache::Entry {
+  uint32_t hash;
+  int maskIndex;
+  RgbMapAlgorithm mapAlgo;
+  // Copy of the palette used to create the map (RgbMap keeps a
+  // pointer to it)
+  std::unique_ptr<Palette> palette;
+  std::unique_ptr<RgbMap> rgbmap;
+};
+
+// static
+RgbMapCache* RgbMapCache::instance()
+{
+  static RgbMapCache cache;
+  return &cache;
+}
+
+RgbMapCache::RgbMapCache(std::size_t maxEntries)
+  : m_maxEntries(maxEntries)
+{
+  ASSERT(m_maxEntries > 0);
+}
+
+std::shared_ptr<RgbMap> RgbMapCache::get(const Palette* palette,
+                                         const int maskIndex,
+                                         RgbMapAlgorithm mapAlgo)
+{
+  ASSERT(palette);
+  if (mapAlgo == RgbMapAlgorithm::DEFAULT)
+    mapAlgo = RgbMapAlgorithm::OCTREE;
+
+  const uint32_t hash = PaletteHash(palette);
+
+  std::lock_guard lock(m_mutex);
+  for (auto it=m_entries.begin(); it!=m_entries.end(); ++it) {
+    std::shared_ptr<Entry> entry = *it;
+    if (entry->hash == hash &&
+        entry->maskIndex == maskIndex &&
+        entry->mapAlgo == mapAlgo &&
+        entry->palette->size() == palette->size() &&
+        *entry->palette == *palette) {
+      // Move to the front (most recently used)
+      if (it != m_entries.begin())
+        m_entries.splice(m_entries.begin(), m_entries, it);
+      return std::shared_ptr<RgbMap>(entry, entry->rgbmap.get());
+    }
+  }
+
+  auto entry = std::make_shared<Entry>();
+  entry->hash = hash;
+  entry->maskIndex = maskIndex;
+  entry->mapAlgo = mapAlgo;
+  entry->palette = std::make_unique<Palette>(*palette);
+  switch (mapAlgo) {
+    case RgbMapAlgorithm::RGB5A3: entry->rgbmap = std::make_unique<RgbMapRGB5A3>(); break;
+    case RgbMapAlgorithm::OCTREE: entry->rgbmap = std::make_unique<OctreeMap>(); break;
+    default:
+      ASSERT(false);
+      return nullptr;
+  }
+  entry->rgbmap->regenerateMap(entry->palette.get(), maskIndex);
+
+  // Entries that are still used (e.g. by a sprite) are kept alive by
+  // their shared_ptr
+  m_entries.push_front(entry);
+  if (m_entries.size() > m_maxEntries)
+    m_entries.pop_back();
+
+  return std::shared_ptr<RgbMap>(entry, entry->rgbmap.get());
+}
+
+void RgbMapCache::clear()
+{
+  std::lock_guard lock(m_mutex);
+  m_entries.clear();
+}
+
+std::size_t RgbMapCache::size() const
+{
+  std::lock_guard lock(m_mutex);
+  return m_entries.size();
+}
+
+// static
+uint32_t RgbMapCache::PaletteHash(const Palette* palette)
+{
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  auto add = [&hash](uint32_t value) {
+    for (int i=0; i<4; ++i, value >>= 8) {
+      hash ^= (value & 0xff);
+      hash *= 16777619u;
+    }
+  };
+  add(palette->size());
+  for (int i=0; i<palette->size(); ++i)
+    add(palette->getEntry(i));
+  return hash;
+}
+
+} // namespace doc
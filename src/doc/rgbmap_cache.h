@@ -0,0 +1,62 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_RGBMAP_CACHE_H_INCLUDED
+#define DOC_RGBMAP_CACHE_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "base/ints.h"
+#include "doc/rgbmap_algorithm.h"
+
+#include <list>
+#include <memory>
+#include <mutex>
+
+namespace doc {
+
+  class Palette;
+  class RgbMap;
+
+  // Global cache of RgbMaps shared between all sprites. The RgbMaps
+  // are created for a copy of the given palette, so they are found
+  // by palette content (e.g. when a sprite with a palette per frame
+  // is played, or several sprites use the same palette), and they
+  // aren't affected by future changes of the original palette.
+  //
+  // RgbMapRGB5A3 can be used from several threads at the same time,
+  // OctreeMap cannot (use LockedRgbMap in that case).
+  class RgbMapCache {
+  public:
+    static constexpr std::size_t kDefaultMaxEntries = 16;
+
+    static RgbMapCache* instance();
+
+    RgbMapCache(std::size_t maxEntries = kDefaultMaxEntries);
+
+    std::shared_ptr<RgbMap> get(const Palette* palette,
+                                const int maskIndex,
+                                RgbMapAlgorithm mapAlgo);
+    void clear();
+
+    std::size_t size() const;
+
+    static uint32_t PaletteHash(const Palette* palette);
+
+  private:
+    struct Entry;
+
+    mutable std::mutex m_mutex;
+    // Most recently used entries first
+    std::list<std::shared_ptr<Entry>> m_entries;
+    std::size_t m_maxEntries;
+
+    DISABLE_COPYING(RgbMapCache);
+  };
+
+} // namespace doc
+
+#endif
@@ -0,0 +1,69 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/palette.h"
+#include "doc/rgbmap.h"
+#include "doc/rgbmap_cache.h"
+
+using namespace doc;
+
+TEST(RgbMapCache, SameMapForSamePaletteContent)
+{
+  RgbMapCache cache;
+  Palette a(0, 4), b(0, 4);
+  for (int i=0; i<4; ++i) {
+    a.setEntry(i, rgba(i*64, 0, 0, 255));
+    b.setEntry(i, rgba(i*64, 0, 0, 255));
+  }
+
+  auto mapA = cache.get(&a, 0, RgbMapAlgorithm::RGB5A3);
+  auto mapB = cache.get(&b, 0, RgbMapAlgorithm::RGB5A3);
+  EXPECT_EQ(mapA.get(), mapB.get());
+  EXPECT_EQ(1, cache.size());
+
+  // Different mask index or algorithm
+  EXPECT_NE(mapA.get(), cache.get(&a, -1, RgbMapAlgorithm::RGB5A3).get());
+  EXPECT_NE(mapA.get(), cache.get(&a, 0, RgbMapAlgorithm::OCTREE).get());
+  EXPECT_EQ(3, cache.size());
+
+  // The cached map is not affected by changes in the original palette
+  b.setEntry(3, rgba(0, 0, 255, 255));
+  auto mapC = cache.get(&b, 0, RgbMapAlgorithm::RGB5A3);
+  EXPECT_NE(mapA.get(), mapC.get());
+  EXPECT_EQ(3, mapA->mapColor(rgba(192, 0, 0, 255)));
+  EXPECT_EQ(3, mapC->mapColor(rgba(0, 0, 255, 255)));
+}
+
+TEST(RgbMapCache, LeastRecentlyUsed)
+{
+  RgbMapCache cache(2);
+  Palette a(0, 2), b(0, 2), c(0, 2);
+  a.setEntry(1, rgba(255, 0, 0, 255));
+  b.setEntry(1, rgba(0, 255, 0, 255));
+  c.setEntry(1, rgba(0, 0, 255, 255));
+
+  RgbMap* mapA = cache.get(&a, 0, RgbMapAlgorithm::RGB5A3).get();
+  cache.get(&b, 0, RgbMapAlgorithm::RGB5A3);
+  EXPECT_EQ(mapA, cache.get(&a, 0, RgbMapAlgorithm::RGB5A3).get());
+
+  // "b" is the least recently used entry
+  cache.get(&c, 0, RgbMapAlgorithm::RGB5A3);
+  EXPECT_EQ(2, cache.size());
+  EXPECT_EQ(mapA, cache.get(&a, 0, RgbMapAlgorithm::RGB5A3).get());
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  Palette::initBestfit();
+  return RUN_ALL_TESTS();
+}
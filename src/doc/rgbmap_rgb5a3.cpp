@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2020 Igara Studio S.A.
+// Copyright (c) 2020-2024 Igara Studio S.A.
 // Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -43,18 +43,21 @@ void RgbMapRGB5A3::regenerateMap(const Palette* palette, int maskIndex)
   m_maskIndex = maskIndex;
 
   // Mark all entries as invalid (need to be regenerated)
-  for (uint16_t& entry : m_map)
-    entry |= INVALID;
+  for (auto& entry : m_map)
+    entry.store(entry.load(std::memory_order_relaxed) | INVALID,
+                std::memory_order_relaxed);
 }
 
 int RgbMapRGB5A3::generateEntry(int i, int r, int g, int b, int a) const
 {
-  return m_map[i] =
+  const int index =
     m_palette->findBestfit(
       scale_5bits_to_8bits(r>>3),
       scale_5bits_to_8bits(g>>3),
       scale_5bits_to_8bits(b>>3),
       scale_3bits_to_8bits(a>>5), m_maskIndex);
+  m_map[i].store(index, std::memory_order_relaxed);
+  return index;
 }
 
 } // namespace doc
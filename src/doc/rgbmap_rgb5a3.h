@@ -15,6 +15,7 @@
 #include "doc/object.h"
 #include "doc/rgbmap.h"
 
+#include <atomic>
 #include <vector>
 
 namespace doc {
@@ -38,16 +39,25 @@ namespace doc {
       const uint8_t a = rgba_geta(rgba);
       // bits -> bbbbbgggggrrrrraaa
       const uint32_t i = (a>>5) | ((b>>3) << 3) | ((g>>3) << 8) | ((r>>3) << 13);
-      const uint16_t v = m_map[i];
+      const uint16_t v = m_map[i].load(std::memory_order_relaxed);
       return (v & INVALID) ? generateEntry(i, r, g, b, a): v;
     }
 
+    void mapColors(const color_t* colors, uint8_t* indexes, const int n) const override {
+      for (int i=0; i<n; ++i)
+        indexes[i] = RgbMapRGB5A3::mapColor(colors[i]);
+    }
+
     int maskIndex() const override { return m_maskIndex; }
 
   private:
     int generateEntry(int i, int r, int g, int b, int a) const;
 
-    mutable std::vector<uint16_t> m_map;
+    // Entries are generated lazily, they are atomic so the map can
+    // be used from several threads at the same time (two threads
+    // might generate the same entry, but both will store the same
+    // value).
+    mutable std::vector<std::atomic<uint16_t>> m_map;
     const Palette* m_palette;
     int m_modifications;
     int m_maskIndex;
@@ -0,0 +1,23 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_SIMD_H_INCLUDED
+#define DOC_SIMD_H_INCLUDED
+#pragma once
+
+// SIMD instruction set that can be used without runtime checks:
+// SSE2 on x86-64 (DOC_SIMD_SSE2) or NEON on ARM64 (DOC_SIMD_NEON).
+// _WIN64 cannot be used to detect x86-64 because it's defined on
+// Windows ARM64 too.
+#if defined(__x86_64__) || defined(_M_X64) || defined(_M_AMD64)
+  #include <emmintrin.h>
+  #define DOC_SIMD_SSE2 1
+#elif defined(__aarch64__) || defined(_M_ARM64)
+  #include <arm_neon.h>
+  #define DOC_SIMD_NEON 1
+#endif
+
+#endif
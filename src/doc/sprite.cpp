@@ -13,17 +13,17 @@
 
 #include "base/memory.h"
 #include "base/remove_from_container.h"
+#include "base/thread_pool.h"
 #include "doc/cel.h"
 #include "doc/cels_range.h"
 #include "doc/image_impl.h"
 #include "doc/layer.h"
 #include "doc/layer_tilemap.h"
-#include "doc/octree_map.h"
 #include "doc/palette.h"
 #include "doc/primitives.h"
 #include "doc/remap.h"
 #include "doc/render_plan.h"
-#include "doc/rgbmap_rgb5a3.h"
+#include "doc/rgbmap_cache.h"
 #include "doc/tag.h"
 #include "doc/tile_primitives.h"
 #include "doc/tilesets.h"
@@ -32,6 +32,7 @@
 #include <cstring>
 #include <functional>
 #include <memory>
+#include <thread>
 #include <vector>
 
 namespace doc {
@@ -39,6 +40,28 @@ namespace doc {
 static RgbMapAlgorithm g_rgbMapAlgorithm = RgbMapAlgorithm::DEFAULT;
 static gfx::Rect g_defaultGridBounds(0, 0, 16, 16);
 
+// Minimum number of tiles in all tilemaps to remap them in parallel
+static constexpr int kMinTilesToRemapInParallel = 64*64;
+
+// Returns true if the tilemap references a tile index marked in
+// "tiles" (the empty tile "notile" without flags is never remapped).
+static bool uses_any_tile(const Image* tilemap,
+                          const std::vector<bool>& tiles)
+{
+  const int w = tilemap->width();
+  const int h = tilemap->height();
+  const std::size_t n = tiles.size();
+  for (int y=0; y<h; ++y) {
+    auto p = (const tile_t*)tilemap->readPixelAddress(0, y);
+    for (int x=0; x<w; ++x, ++p) {
+      const tile_index ti = tile_geti(*p);
+      if (*p != notile && ti < n && tiles[ti])
+        return true;
+    }
+  }
+  return false;
+}
+
 // static
 gfx::Rect Sprite::DefaultGridBounds()
 {
@@ -449,27 +472,28 @@ RgbMap* Sprite::rgbMap(const frame_t frame,
                        const RgbMapFor forLayer,
                        RgbMapAlgorithm mapAlgo) const
 {
-  if (!m_rgbMap || m_rgbMapAlgorithm != mapAlgo) {
-    m_rgbMapAlgorithm = mapAlgo;
-    switch (m_rgbMapAlgorithm) {
-      case RgbMapAlgorithm::RGB5A3: m_rgbMap.reset(new RgbMapRGB5A3); break;
-      case RgbMapAlgorithm::DEFAULT:
-      case RgbMapAlgorithm::OCTREE: m_rgbMap.reset(new OctreeMap); break;
-      default:
-        m_rgbMap.reset(nullptr);
-        ASSERT(false);
-        return nullptr;
-    }
-  }
+  const Palette* pal = palette(frame);
   int maskIndex;
   if (forLayer == RgbMapFor::OpaqueLayer)
     maskIndex = -1;
   else {
-    maskIndex = palette(frame)->findMaskColor();
+    maskIndex = pal->findMaskColor();
     if (maskIndex == -1)
       maskIndex = 0;
   }
-  m_rgbMap->regenerateMap(palette(frame), maskIndex);
+
+  // Get a new map from the global cache only if something has changed
+  // (the cache has to calculate the palette hash to find the map).
+  if (!m_rgbMap ||
+      m_rgbMapAlgorithm != mapAlgo ||
+      m_rgbMapPalette != pal ||
+      m_rgbMapModifications != pal->getModifications() ||
+      m_rgbMap->maskIndex() != maskIndex) {
+    m_rgbMap = RgbMapCache::instance()->get(pal, maskIndex, mapAlgo);
+    m_rgbMapAlgorithm = mapAlgo;
+    m_rgbMapPalette = pal;
+    m_rgbMapModifications = pal->getModifications();
+  }
   return m_rgbMap.get();
 }
 
@@ -663,12 +687,60 @@ void Sprite::remapImages(const Remap& remap)
 }
 
 void Sprite::remapTilemaps(const Tileset* tileset,
-                           const Remap& remap)
+                           const Remap& remap,
+                           std::vector<ImageRef>* remappedImages)
 {
-  for (Cel* cel : uniqueCels()) {
-    if (cel->layer()->isTilemap() &&
-        static_cast<LayerTilemap*>(cel->layer())->tileset() == tileset) {
-      remap_image(cel->image(), remap);
+  std::vector<ImageRef> images;
+  getTilemapsByTileset(tileset, images);
+
+  // Each image must be remapped just once (and by only one thread)
+  std::sort(images.begin(), images.end());
+  images.erase(std::unique(images.begin(), images.end()), images.end());
+  if (images.empty())
+    return;
+
+  // Tile indexes that are modified by the remap, so we can skip
+  // tilemaps that don't use any of them.
+  std::vector<bool> remapped(remap.size(), false);
+  for (int i=0; i<remap.size(); ++i) {
+    const int to = remap[i];
+    remapped[i] = (to == Remap::kNoTile || (to != Remap::kUnused && to != i));
+  }
+
+  std::vector<char> modified(images.size(), false);
+  auto remapImage = [&remap, &remapped, &images, &modified](const std::size_t i){
+    Image* image = images[i].get();
+    if (uses_any_tile(image, remapped)) {
+      remap_image(image, remap);
+      modified[i] = true;
+    }
+  };
+
+  int nthreads = 1;
+  if (images.size() > 1) {
+    int ntiles = 0;
+    for (const ImageRef& image : images)
+      ntiles += image->width() * image->height();
+    if (ntiles >= kMinTilesToRemapInParallel)
+      nthreads = std::min<int>(std::max(1u, std::thread::hardware_concurrency()),
+                               images.size());
+  }
+
+  if (nthreads < 2) {
+    for (std::size_t i=0; i<images.size(); ++i)
+      remapImage(i);
+  }
+  else {
+    base::thread_pool threads(nthreads);
+    for (std::size_t i=0; i<images.size(); ++i)
+      threads.execute([&remapImage, i]{ remapImage(i); });
+    threads.wait_all();
+  }
+
+  if (remappedImages) {
+    for (std::size_t i=0; i<images.size(); ++i) {
+      if (modified[i])
+        remappedImages->push_back(images[i]);
     }
   }
 }
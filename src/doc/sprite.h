@@ -211,8 +211,13 @@ namespace doc {
                               std::vector<ImageRef>& images) const;
 
     void remapImages(const Remap& remap);
+    // Remaps the tiles of all tilemaps that use the given tileset
+    // (in parallel when there are several tilemaps). Only tilemaps
+    // referencing tiles modified by the remap are changed, and they
+    // are added to "remappedImages" (if it's not nullptr).
     void remapTilemaps(const Tileset* tileset,
-                       const Remap& remap);
+                       const Remap& remap,
+                       std::vector<ImageRef>* remappedImages = nullptr);
     void pickCels(const gfx::PointF& pos,
                   const int opacityThreshold,
                   const RenderPlan& plan,
@@ -264,7 +269,9 @@ namespace doc {
 
     // Current rgb map
     mutable RgbMapAlgorithm m_rgbMapAlgorithm;
-    mutable std::unique_ptr<RgbMap> m_rgbMap;
+    mutable std::shared_ptr<RgbMap> m_rgbMap; // From RgbMapCache
+    mutable const Palette* m_rgbMapPalette = nullptr;
+    mutable int m_rgbMapModifications = 0;
 
     Tags m_tags;
     Slices m_slices;
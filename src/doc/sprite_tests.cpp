@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2018-2022 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -14,8 +14,13 @@
 #include "doc/cel.h"
 #include "doc/cels_range.h"
 #include "doc/layer.h"
+#include "doc/layer_tilemap.h"
 #include "doc/pixel_format.h"
+#include "doc/primitives.h"
+#include "doc/remap.h"
 #include "doc/sprite.h"
+#include "doc/tileset.h"
+#include "doc/tilesets.h"
 
 #include <memory>
 
@@ -193,6 +198,89 @@ TEST(Sprite, CelsRange)
   EXPECT_EQ(3, i);
 }
 
+TEST(Sprite, CelsByFrame)
+{
+  std::shared_ptr<Sprite> sprPtr(std::make_shared<Sprite>(
+                                   ImageSpec(ColorMode::RGB, 32, 32), 256));
+  Sprite* spr = sprPtr.get();
+  spr->setTotalFrames(10);
+
+  LayerImage* lay = new LayerImage(spr);
+  spr->root()->addLayer(lay);
+
+  Cel* cel1 = new Cel(frame_t(1), ImageRef(Image::create(IMAGE_RGB, 4, 4)));
+  Cel* cel5 = new Cel(frame_t(5), ImageRef(Image::create(IMAGE_RGB, 4, 4)));
+  lay->addCel(cel5);
+  lay->addCel(cel1);
+
+  EXPECT_EQ(nullptr, lay->cel(-1));
+  EXPECT_EQ(nullptr, lay->cel(0));
+  EXPECT_EQ(cel1, lay->cel(1));
+  EXPECT_EQ(cel5, lay->cel(5));
+  EXPECT_EQ(nullptr, lay->cel(6));
+  EXPECT_EQ(nullptr, lay->cel(100));
+
+  lay->moveCel(cel5, 8);
+  EXPECT_EQ(nullptr, lay->cel(5));
+  EXPECT_EQ(cel5, lay->cel(8));
+
+  lay->displaceFrames(0, 1);
+  EXPECT_EQ(nullptr, lay->cel(1));
+  EXPECT_EQ(cel1, lay->cel(2));
+  EXPECT_EQ(cel5, lay->cel(9));
+
+  lay->removeCel(cel5);
+  delete cel5;
+  EXPECT_EQ(nullptr, lay->cel(9));
+  EXPECT_EQ(cel1, lay->cel(2));
+  EXPECT_EQ(1, lay->getCelsCount());
+}
+
+TEST(Sprite, RemapTilemaps)
+{
+  std::shared_ptr<Sprite> sprPtr(std::make_shared<Sprite>(
+                                   ImageSpec(ColorMode::RGB, 128, 128), 256));
+  Sprite* spr = sprPtr.get();
+  spr->setTotalFrames(4);
+
+  Tileset* tileset = new Tileset(spr, Grid(gfx::Size(2, 2)), 4);
+  const tileset_index tsi = spr->tilesets()->add(tileset);
+  LayerTilemap* lay = new LayerTilemap(spr, tsi);
+  spr->root()->addLayer(lay);
+
+  // Big enough tilemaps to be remapped in parallel
+  const tile_t tiles[4] = { tile(1, 0),
+                            tile(3, 0),
+                            tile(2, tile_f_xflip),
+                            notile };
+  ImageRef images[4];
+  for (int i=0; i<4; ++i) {
+    images[i].reset(Image::create(IMAGE_TILEMAP, 64, 64));
+    clear_image(images[i].get(), tiles[i]);
+    lay->addCel(new Cel(frame_t(i), images[i]));
+  }
+
+  // Swap tiles 1 and 2
+  Remap remap(4);
+  remap.map(0, 0);
+  remap.map(1, 2);
+  remap.map(2, 1);
+  remap.map(3, 3);
+
+  std::vector<ImageRef> remapped;
+  spr->remapTilemaps(tileset, remap, &remapped);
+
+  // Only tilemaps using tiles 1 or 2 are modified
+  ASSERT_EQ(2, remapped.size());
+  EXPECT_TRUE((remapped[0] == images[0] && remapped[1] == images[2]) ||
+              (remapped[0] == images[2] && remapped[1] == images[0]));
+
+  EXPECT_TRUE(is_plain_image(images[0].get(), tile(2, 0)));
+  EXPECT_TRUE(is_plain_image(images[1].get(), tile(3, 0)));
+  EXPECT_TRUE(is_plain_image(images[2].get(), tile(1, tile_f_xflip)));
+  EXPECT_TRUE(is_plain_image(images[3].get(), notile));
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
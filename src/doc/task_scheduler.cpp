@@ -0,0 +1,208 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/task_scheduler.h"
+
+#include <chrono>
+
+namespace doc {
+
+// Scheduler and index of the worker that is running in the current
+// thread (to push new tasks in its own queues).
+static thread_local TaskScheduler* t_scheduler = nullptr;
+static thread_local int t_worker = -1;
+
+TaskScheduler::TaskScheduler(int nthreads)
+{
+  nthreads = std::max(1, nthreads);
+  m_workers.reserve(nthreads);
+  for (int i=0; i<nthreads; ++i)
+    m_workers.push_back(std::make_unique<Worker>());
+  for (int i=0; i<nthreads; ++i)
+    m_workers[i]->thread = std::thread([this, i]{ workerProc(i); });
+}
+
+TaskScheduler::~TaskScheduler()
+{
+  {
+    const std::lock_guard lock(m_mutex);
+    m_running = false;
+    m_cv.notify_all();
+  }
+  for (auto& worker : m_workers)
+    worker->thread.join();
+}
+
+// static
+TaskScheduler& TaskScheduler::instance()
+{
+  static TaskScheduler scheduler(
+    std::max(1u, std::thread::hardware_concurrency()));
+  return scheduler;
+}
+
+void TaskScheduler::execute(const TaskPriority priority, Func&& func)
+{
+  const int index =
+    (isWorkerThread() ? t_worker:
+                        int(m_next++ % unsigned(m_workers.size())));
+  {
+    Worker& worker = *m_workers[index];
+    const std::lock_guard lock(worker.mutex);
+    worker.queues[int(priority)].push_back(std::move(func));
+  }
+  {
+    const std::lock_guard lock(m_mutex);
+    ++m_pending;
+  }
+  m_cv.notify_one();
+}
+
+bool TaskScheduler::isWorkerThread() const
+{
+  return (t_scheduler == this);
+}
+
+bool TaskScheduler::runPendingTask(const TaskPriority lowestPriority)
+{
+  if (m_pending == 0)
+    return false;
+
+  Func func;
+  const int index =
+    (isWorkerThread() ? t_worker:
+                        int(m_next % unsigned(m_workers.size())));
+  if (!popTask(index, lowestPriority, func))
+    return false;
+
+  func();
+  return true;
+}
+
+void TaskScheduler::workerProc(const int index)
+{
+  t_scheduler = this;
+  t_worker = index;
+
+  while (true) {
+    Func func;
+    if (popTask(index, TaskPriority::Background, func)) {
+      func();
+      continue;
+    }
+
+    std::unique_lock lock(m_mutex);
+    m_cv.wait(lock, [this]{ return m_pending > 0 || !m_running; });
+    if (!m_running && m_pending == 0)
+      break;
+  }
+
+  t_scheduler = nullptr;
+  t_worker = -1;
+}
+
+bool TaskScheduler::popTask(const int index,
+                            const TaskPriority lowestPriority,
+                            Func& func)
+{
+  const int n = int(m_workers.size());
+  for (int p=0; p<=int(lowestPriority); ++p) {
+    // Newest task of our own queue
+    {
+      Worker& worker = *m_workers[index];
+      const std::lock_guard lock(worker.mutex);
+      auto& queue = worker.queues[p];
+      if (!queue.empty()) {
+        func = std::move(queue.back());
+        queue.pop_back();
+        --m_pending;
+        return true;
+      }
+    }
+
+    // Steal the oldest task of other worker
+    for (int i=1; i<n; ++i) {
+      Worker& worker = *m_workers[(index+i) % n];
+      const std::lock_guard lock(worker.mutex);
+      auto& queue = worker.queues[p];
+      if (!queue.empty()) {
+        func = std::move(queue.front());
+        queue.pop_front();
+        --m_pending;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+TaskGroup::TaskGroup(const TaskPriority priority,
+                     TaskScheduler& scheduler)
+  : m_scheduler(scheduler)
+  , m_priority(priority)
+{
+}
+
+TaskGroup::~TaskGroup()
+{
+  try {
+    wait();
+  }
+  catch (...) {
+    // Exceptions are re-thrown only from an explicit wait()
+  }
+}
+
+void TaskGroup::run(TaskScheduler::Func&& func)
+{
+  ++m_pending;
+  m_scheduler.execute(
+    m_priority,
+    [this, func = std::move(func)]{
+      try {
+        func();
+      }
+      catch (...) {
+        const std::lock_guard lock(m_mutex);
+        if (!m_exception)
+          m_exception = std::current_exception();
+      }
+
+      const std::lock_guard lock(m_mutex);
+      if (--m_pending == 0)
+        m_cv.notify_all();
+    });
+}
+
+void TaskGroup::wait()
+{
+  while (m_pending > 0) {
+    // Workers execute other tasks while our tasks are running (so
+    // tasks can wait other tasks without deadlocks). Other threads
+    // (e.g. the UI thread) just wait.
+    if (m_scheduler.isWorkerThread() &&
+        m_scheduler.runPendingTask(m_priority))
+      continue;
+
+    std::unique_lock lock(m_mutex);
+    m_cv.wait_for(lock, std::chrono::milliseconds(1),
+                  [this]{ return m_pending == 0; });
+  }
+
+  std::exception_ptr exception;
+  {
+    const std::lock_guard lock(m_mutex);
+    std::swap(exception, m_exception);
+  }
+  if (exception)
+    std::rethrow_exception(exception);
+}
+
+} // namespace doc
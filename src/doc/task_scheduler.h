@@ -0,0 +1,153 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_TASK_SCHEDULER_H_INCLUDED
+#define DOC_TASK_SCHEDULER_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "base/task.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace doc {
+
+  enum class TaskPriority {
+    UICritical,    // Results needed to paint the screen (e.g. render tiles)
+    Interactive,   // The user is waiting the result (e.g. a filter)
+    Background,    // Work that can be delayed (e.g. thumbnails)
+  };
+
+  // Work-stealing scheduler shared by all subsystems that need to
+  // run work in parallel, so they share the cores instead of creating
+  // their own threads (one per core each one).
+  //
+  // Each worker has its own queues (one per priority), new tasks
+  // created from a worker go to its own queues (and are executed in
+  // LIFO order), and idle workers steal the oldest tasks of other
+  // workers. Tasks with higher priority are always executed first.
+  //
+  // Tasks must not block waiting other tasks except through
+  // TaskGroup::wait() (which executes pending tasks meanwhile, so
+  // nested groups don't deadlock). Long running loops (e.g. a thread
+  // that waits for events) must use their own thread.
+  class TaskScheduler {
+  public:
+    using Func = std::function<void()>;
+
+    explicit TaskScheduler(int nthreads);
+    ~TaskScheduler();
+
+    // Scheduler with one worker per core used by default.
+    static TaskScheduler& instance();
+
+    int threads() const { return int(m_workers.size()); }
+
+    void execute(TaskPriority priority, Func&& func);
+
+    // Returns true if it's called from a worker of this scheduler.
+    bool isWorkerThread() const;
+
+    // Executes one pending task (with the given priority or a higher
+    // one) in the calling thread. Returns false if there is no
+    // pending task.
+    bool runPendingTask(TaskPriority lowestPriority);
+
+  private:
+    static constexpr int kPriorities = 3;
+
+    struct Worker {
+      std::mutex mutex;
+      std::deque<Func> queues[kPriorities];
+      std::thread thread;
+    };
+
+    void workerProc(int index);
+    bool popTask(int index, TaskPriority lowestPriority, Func& func);
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::atomic<int> m_pending { 0 };
+    std::atomic<unsigned> m_next { 0 };
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_running = true;
+
+    DISABLE_COPYING(TaskScheduler);
+  };
+
+  // Set of tasks that can be waited. The destructor waits all the
+  // tasks too.
+  class TaskGroup {
+  public:
+    explicit TaskGroup(TaskPriority priority = TaskPriority::Interactive,
+                       TaskScheduler& scheduler = TaskScheduler::instance());
+    ~TaskGroup();
+
+    TaskPriority priority() const { return m_priority; }
+    int threads() const { return m_scheduler.threads(); }
+
+    void run(TaskScheduler::Func&& func);
+
+    // Waits all the tasks. When it's called from a worker, it
+    // executes other pending tasks (with the same priority or a
+    // higher one) in the meantime. Re-throws the first exception
+    // thrown by a task of the group.
+    void wait();
+
+  private:
+    TaskScheduler& m_scheduler;
+    TaskPriority m_priority;
+    std::atomic<int> m_pending { 0 };
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::exception_ptr m_exception;
+
+    DISABLE_COPYING(TaskGroup);
+  };
+
+  // Calls func(from, to) for ranges of [begin, end) of at least
+  // "grain" items in parallel, and waits all of them. Ranges that
+  // weren't started when the token is canceled are skipped.
+  template<typename Func>
+  void parallel_for(const int begin, const int end, const int grain,
+                    Func&& func,
+                    const TaskPriority priority = TaskPriority::Interactive,
+                    const base::task_token* token = nullptr)
+  {
+    const int n = end - begin;
+    if (n <= 0)
+      return;
+
+    TaskGroup group(priority);
+    const int step = std::max(std::max(1, grain),
+                              (n + 4*group.threads() - 1) / (4*group.threads()));
+    if (step >= n) {
+      func(begin, end);
+      return;
+    }
+
+    for (int i=begin; i<end; i+=step) {
+      const int j = std::min(i+step, end);
+      group.run([&func, token, i, j]{
+        if (!token || !token->canceled())
+          func(i, j);
+      });
+    }
+    group.wait();
+  }
+
+} // namespace doc
+
+#endif
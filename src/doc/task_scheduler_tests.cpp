@@ -0,0 +1,76 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/task_scheduler.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+using namespace doc;
+
+TEST(TaskScheduler, ParallelFor)
+{
+  std::vector<int> values(10000, 0);
+  parallel_for(0, int(values.size()), 16, [&values](const int from, const int to){
+    for (int i=from; i<to; ++i)
+      values[i] += i;
+  });
+  for (int i=0; i<int(values.size()); ++i)
+    EXPECT_EQ(i, values[i]);
+}
+
+TEST(TaskScheduler, NestedGroups)
+{
+  TaskScheduler scheduler(2);
+  std::atomic<int> count(0);
+  {
+    TaskGroup outer(TaskPriority::Interactive, scheduler);
+    for (int i=0; i<8; ++i) {
+      outer.run([&scheduler, &count]{
+        // Each task waits its own subtasks (without deadlocks even
+        // when all workers are waiting)
+        TaskGroup inner(TaskPriority::UICritical, scheduler);
+        for (int j=0; j<8; ++j)
+          inner.run([&count]{ ++count; });
+        inner.wait();
+      });
+    }
+    outer.wait();
+  }
+  EXPECT_EQ(64, count);
+}
+
+TEST(TaskScheduler, RethrowException)
+{
+  TaskGroup group;
+  group.run([]{ throw std::runtime_error("error"); });
+  EXPECT_THROW(group.wait(), std::runtime_error);
+}
+
+TEST(TaskScheduler, CanceledParallelFor)
+{
+  base::task_token token;
+  token.cancel();
+
+  std::atomic<int> count(0);
+  parallel_for(0, 1000, 1, [&count](const int from, const int to){
+    count += to - from;
+  }, TaskPriority::Background, &token);
+  EXPECT_EQ(0, count);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,216 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/tile_hash.h"
+
+#include "doc/dispatch.h"
+#include "doc/image_impl.h"
+#include "doc/primitives.h"
+#include "doc/primitives_fast.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace doc {
+
+namespace {
+
+// The hash of a tile is the sum of each pixel value (scrambled)
+// multiplied by a pseudo-random weight of its position:
+//
+//   H = sum( g(pixel(x, y)) * w(x, y) )
+//
+// A flipped tile has the same pixels in other positions, so we can
+// calculate the hash of each orientation in the same pass using a
+// different weight for each one (the weight of the position where
+// the pixel is drawn with that orientation).
+
+inline uint32_t mix32(uint32_t h)
+{
+  // Finalizer of MurmurHash3
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+  return h;
+}
+
+inline uint32_t position_weight(const int x, const int y)
+{
+  // Odd weights so they are invertible (mod 2^32)
+  return mix32((uint32_t(y) << 16) ^ uint32_t(x) ^ 0x5bd1e995) | 1;
+}
+
+// Same mapping of pixels as composite_image_general_with_tile_flags()
+// and get_tile_pixel(): the pixel (x, y) of the drawn tile is the
+// pixel (srcX, srcY) of the tile image.
+inline void tile_src_pixel(const int w, const int h,
+                           const tile_flags flags,
+                           const int x, const int y,
+                           int& srcX, int& srcY)
+{
+  const int fx = ((flags & tile_f_xflip) ? w-1-x: x);
+  const int fy = ((flags & tile_f_yflip) ? h-1-y: y);
+  srcX = ((flags & tile_f_dflip) ? fy: fx);
+  srcY = ((flags & tile_f_dflip) ? fx: fy);
+}
+
+// Weights of each pixel of the tile image for each orientation,
+// interleaved (weights[i*kTileOrientations + orientation]) so the
+// inner loop over orientations can be vectorized.
+struct TileWeights {
+  int w = 0;
+  int h = 0;
+  std::vector<uint32_t> weights;
+};
+
+const std::vector<uint32_t>& get_tile_weights(const int w, const int h)
+{
+  // Usually all tiles have the same size, so we keep the weights of
+  // the last used size in each thread.
+  thread_local TileWeights tw;
+  if (tw.w == w && tw.h == h)
+    return tw.weights;
+
+  tw.w = w;
+  tw.h = h;
+  tw.weights.assign(std::size_t(w)*h*kTileOrientations, 0);
+  for (int o=0; o<kTileOrientations; ++o) {
+    const tile_flags flags = tile_orientation_flags(o);
+    if ((flags & tile_f_dflip) && w != h)
+      continue;
+
+    for (int y=0; y<h; ++y) {
+      for (int x=0; x<w; ++x) {
+        int srcX, srcY;
+        tile_src_pixel(w, h, flags, x, y, srcX, srcY);
+        tw.weights[(std::size_t(srcY)*w + srcX)*kTileOrientations + o] =
+          position_weight(x, y);
+      }
+    }
+  }
+  return tw.weights;
+}
+
+template<typename ImageTraits>
+inline uint32_t normalize_pixel(const typename ImageTraits::pixel_t c)
+{
+  if constexpr (ImageTraits::color_mode == ColorMode::RGB)
+    return (rgba_geta(c) == 0 ? 0: c);
+  else if constexpr (ImageTraits::color_mode == ColorMode::GRAYSCALE)
+    return (graya_geta(c) == 0 ? 0: c);
+  else
+    return uint32_t(c);
+}
+
+template<typename ImageTraits>
+void calculate_tile_hashes_templ(const Image* image,
+                                 uint32_t hashes[kTileOrientations])
+{
+  const int w = image->width();
+  const int h = image->height();
+  const std::vector<uint32_t>& weights = get_tile_weights(w, h);
+
+  uint32_t acc[kTileOrientations] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+  std::vector<uint32_t> row(w);
+  const uint32_t* wt = weights.data();
+
+  for (int y=0; y<h; ++y) {
+    for (int x=0; x<w; ++x)
+      row[x] = mix32(normalize_pixel<ImageTraits>(
+                       get_pixel_fast<ImageTraits>(image, x, y)) + 0x9e3779b9);
+
+    for (int x=0; x<w; ++x, wt+=kTileOrientations) {
+      const uint32_t g = row[x];
+      for (int o=0; o<kTileOrientations; ++o)
+        acc[o] += g * wt[o];
+    }
+  }
+
+  for (int o=0; o<kTileOrientations; ++o)
+    hashes[o] = mix32(acc[o]);
+}
+
+template<typename ImageTraits>
+bool is_same_tile_templ(const Image* tile,
+                        const tile_flags flags,
+                        const Image* image)
+{
+  const int w = image->width();
+  const int h = image->height();
+  for (int y=0; y<h; ++y) {
+    for (int x=0; x<w; ++x) {
+      int srcX, srcY;
+      tile_src_pixel(w, h, flags, x, y, srcX, srcY);
+      if (!ImageTraits::same_color(get_pixel_fast<ImageTraits>(tile, srcX, srcY),
+                                   get_pixel_fast<ImageTraits>(image, x, y)))
+        return false;
+    }
+  }
+  return true;
+}
+
+} // anonymous namespace
+
+bool is_valid_tile_orientation(const Image* image, const tile_flags flags)
+{
+  return ((flags & tile_f_dflip) == 0 ||
+          image->width() == image->height());
+}
+
+void calculate_tile_hashes(const Image* image,
+                           uint32_t hashes[kTileOrientations])
+{
+  ASSERT(image);
+
+  // Invalid orientations have all weights = 0, so their hash is 0
+  // (mix32(0) == 0)
+  DOC_DISPATCH_BY_COLOR_MODE(
+    image->colorMode(),
+    calculate_tile_hashes_templ,
+    image, hashes);
+}
+
+uint32_t calculate_canonical_tile_hash(const Image* image)
+{
+  uint32_t hashes[kTileOrientations];
+  calculate_tile_hashes(image, hashes);
+
+  // Non-square tiles have only 4 valid orientations (without
+  // diagonal flip, i.e. even orientation indexes)
+  const int step = (image->width() == image->height() ? 1: 2);
+  uint32_t result = hashes[0];
+  for (int o=step; o<kTileOrientations; o+=step)
+    result = std::min(result, hashes[o]);
+  return result;
+}
+
+bool is_same_tile(const Image* tile,
+                  const tile_flags flags,
+                  const Image* image)
+{
+  if ((flags & tile_f_mask) == 0)
+    return is_same_image(tile, image);
+
+  if (tile->colorMode() != image->colorMode() ||
+      tile->width() != image->width() ||
+      tile->height() != image->height() ||
+      !is_valid_tile_orientation(image, flags))
+    return false;
+
+  DOC_DISPATCH_BY_COLOR_MODE(
+    image->colorMode(),
+    is_same_tile_templ,
+    tile, flags, image);
+  return false;
+}
+
+} // namespace doc
@@ -0,0 +1,51 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_TILE_HASH_H_INCLUDED
+#define DOC_TILE_HASH_H_INCLUDED
+#pragma once
+
+#include "doc/tile.h"
+
+namespace doc {
+
+  class Image;
+
+  // Number of combinations of flip flags (orientations) of a tile.
+  constexpr int kTileOrientations = 8;
+
+  inline int tile_orientation(const tile_flags flags) {
+    return int((flags & tile_f_mask) >> 29);
+  }
+
+  inline tile_flags tile_orientation_flags(const int orientation) {
+    return tile_flags(orientation) << 29;
+  }
+
+  // Diagonal flips are valid only for square tiles.
+  bool is_valid_tile_orientation(const Image* image, const tile_flags flags);
+
+  // Calculates the hash of the image as it would be rendered with
+  // each combination of flip flags in just one pass over the pixels,
+  // i.e. hashes[tile_orientation(flags)] is the hash of the image
+  // drawn with "flags". Transparent pixels are considered equal (as
+  // in is_same_image()). Hashes of invalid orientations are 0.
+  void calculate_tile_hashes(const Image* image,
+                             uint32_t hashes[kTileOrientations]);
+
+  // Returns the minimum hash of all valid orientations of the image,
+  // so a tile and all its flipped versions have the same hash.
+  uint32_t calculate_canonical_tile_hash(const Image* image);
+
+  // Returns true if "tile" drawn with the given flip flags has the
+  // same pixels as "image".
+  bool is_same_tile(const Image* tile,
+                    const tile_flags flags,
+                    const Image* image);
+
+} // namespace doc
+
+#endif
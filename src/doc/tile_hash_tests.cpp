@@ -0,0 +1,155 @@
+// Aseprite Document Library
+// Copyright (c) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/tile_hash.h"
+
+#include "doc/image_impl.h"
+#include "doc/image_ref.h"
+#include "doc/primitives.h"
+#include "doc/primitives_fast.h"
+
+#include <random>
+
+using namespace doc;
+
+namespace {
+
+template<typename ImageTraits>
+ImageRef random_tile(std::mt19937& gen, const int w, const int h)
+{
+  ImageRef image(Image::create(ImageTraits::pixel_format, w, h));
+  for (int y=0; y<h; ++y)
+    for (int x=0; x<w; ++x)
+      put_pixel_fast<ImageTraits>(image.get(), x, y,
+                                  typename ImageTraits::pixel_t(gen()));
+  return image;
+}
+
+// Creates the tile as it's drawn by the renderer with the given
+// flags.
+template<typename ImageTraits>
+ImageRef draw_tile(const Image* tile, const tile_flags flags)
+{
+  const int w = tile->width();
+  const int h = tile->height();
+  ImageRef image(Image::create(tile->pixelFormat(), w, h));
+  for (int y=0; y<h; ++y) {
+    for (int x=0; x<w; ++x) {
+      const int fx = ((flags & tile_f_xflip) ? w-1-x: x);
+      const int fy = ((flags & tile_f_yflip) ? h-1-y: y);
+      put_pixel_fast<ImageTraits>(
+        image.get(), x, y,
+        get_pixel_fast<ImageTraits>(tile,
+                                    (flags & tile_f_dflip) ? fy: fx,
+                                    (flags & tile_f_dflip) ? fx: fy));
+    }
+  }
+  return image;
+}
+
+template<typename ImageTraits>
+void test_orientations(const int w, const int h)
+{
+  std::mt19937 gen(w*100 + h);
+
+  for (int i=0; i<8; ++i) {
+    const ImageRef tile = random_tile<ImageTraits>(gen, w, h);
+    const uint32_t canonical = calculate_canonical_tile_hash(tile.get());
+
+    uint32_t hashes[kTileOrientations];
+    calculate_tile_hashes(tile.get(), hashes);
+
+    for (int o=0; o<kTileOrientations; ++o) {
+      const tile_flags flags = tile_orientation_flags(o);
+      if (!is_valid_tile_orientation(tile.get(), flags)) {
+        EXPECT_EQ(0, hashes[o]);
+        EXPECT_FALSE(is_same_tile(tile.get(), flags, tile.get()));
+        continue;
+      }
+
+      const ImageRef drawn = draw_tile<ImageTraits>(tile.get(), flags);
+
+      // The hash of each orientation is the hash of the drawn tile
+      uint32_t drawnHashes[kTileOrientations];
+      calculate_tile_hashes(drawn.get(), drawnHashes);
+      EXPECT_EQ(hashes[o], drawnHashes[0]) << "o=" << o;
+      EXPECT_EQ(canonical, calculate_canonical_tile_hash(drawn.get()));
+
+      EXPECT_TRUE(is_same_tile(tile.get(), flags, drawn.get()));
+      for (int o2=0; o2<kTileOrientations; ++o2) {
+        if (o2 != o && is_valid_tile_orientation(tile.get(),
+                                                 tile_orientation_flags(o2))) {
+          EXPECT_FALSE(is_same_tile(tile.get(), tile_orientation_flags(o2),
+                                    drawn.get()));
+          EXPECT_NE(hashes[o], hashes[o2]);
+        }
+      }
+    }
+  }
+}
+
+} // anonymous namespace
+
+TEST(TileHash, OrientationsRgb)
+{
+  test_orientations<RgbTraits>(8, 8);
+  test_orientations<RgbTraits>(16, 8);
+  test_orientations<RgbTraits>(3, 5);
+}
+
+TEST(TileHash, OrientationsGrayscale)
+{
+  test_orientations<GrayscaleTraits>(8, 8);
+  test_orientations<GrayscaleTraits>(5, 3);
+}
+
+TEST(TileHash, OrientationsIndexed)
+{
+  test_orientations<IndexedTraits>(16, 16);
+  test_orientations<IndexedTraits>(7, 4);
+}
+
+TEST(TileHash, TransparentPixels)
+{
+  ImageRef a(Image::create(IMAGE_RGB, 4, 4));
+  ImageRef b(Image::create(IMAGE_RGB, 4, 4));
+  clear_image(a.get(), rgba(0, 0, 0, 0));
+  clear_image(b.get(), rgba(255, 0, 0, 0));
+  put_pixel(a.get(), 1, 2, rgba(255, 0, 0, 255));
+  put_pixel(b.get(), 1, 2, rgba(255, 0, 0, 255));
+
+  // Transparent pixels with different RGB values are the same
+  EXPECT_EQ(calculate_canonical_tile_hash(a.get()),
+            calculate_canonical_tile_hash(b.get()));
+  EXPECT_TRUE(is_same_tile(a.get(), 0, b.get()));
+}
+
+TEST(TileHash, SymmetricTile)
+{
+  // A tile that is the same with any flip
+  ImageRef tile(Image::create(IMAGE_INDEXED, 4, 4));
+  clear_image(tile.get(), 1);
+  fill_rect(tile.get(), 1, 1, 2, 2, 2);
+
+  uint32_t hashes[kTileOrientations];
+  calculate_tile_hashes(tile.get(), hashes);
+  for (int o=0; o<kTileOrientations; ++o) {
+    EXPECT_EQ(hashes[0], hashes[o]);
+    EXPECT_TRUE(is_same_tile(tile.get(), tile_orientation_flags(o), tile.get()));
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
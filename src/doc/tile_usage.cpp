@@ -0,0 +1,140 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/tile_usage.h"
+
+#include "doc/image.h"
+
+#include <algorithm>
+
+namespace doc {
+
+namespace {
+
+// Returns the tiles used by the tilemap sorted by tile index.
+std::vector<TileUsage::TileCount> calc_tiles(const Image* tilemap)
+{
+  ASSERT(tilemap->pixelFormat() == IMAGE_TILEMAP);
+
+  std::vector<tile_index> indexes;
+  indexes.reserve(std::size_t(tilemap->width())*tilemap->height());
+
+  const int w = tilemap->width();
+  const int h = tilemap->height();
+  for (int y=0; y<h; ++y) {
+    auto p = (const tile_t*)tilemap->readPixelAddress(0, y);
+    for (int x=0; x<w; ++x, ++p) {
+      if (*p != notile)
+        indexes.push_back(tile_geti(*p));
+    }
+  }
+  std::sort(indexes.begin(), indexes.end());
+
+  std::vector<TileUsage::TileCount> tiles;
+  for (auto it=indexes.begin(), end=indexes.end(); it!=end; ) {
+    auto next = std::upper_bound(it, end, *it);
+    tiles.emplace_back(*it, uint32_t(next - it));
+    it = next;
+  }
+  return tiles;
+}
+
+} // anonymous namespace
+
+void TileUsage::update(const std::vector<ImageRef>& tilemaps)
+{
+  ++m_generation;
+
+  for (const ImageRef& tilemap : tilemaps) {
+    if (!tilemap || tilemap->pixelFormat() != IMAGE_TILEMAP)
+      continue;
+
+    auto [it, isNew] = m_entries.try_emplace(tilemap->id());
+    Entry& entry = it->second;
+    if (isNew || entry.version != tilemap->version()) {
+      if (!isNew)
+        removeEntry(entry);
+      entry.version = tilemap->version();
+      entry.tiles = calc_tiles(tilemap.get());
+      addEntry(entry);
+    }
+    entry.generation = m_generation;
+  }
+
+  // Remove tilemaps that are not used anymore
+  for (auto it=m_entries.begin(); it!=m_entries.end(); ) {
+    if (it->second.generation != m_generation) {
+      removeEntry(it->second);
+      it = m_entries.erase(it);
+    }
+    else
+      ++it;
+  }
+}
+
+void TileUsage::clear()
+{
+  m_entries.clear();
+  m_counts.clear();
+  m_tilemaps.clear();
+}
+
+bool TileUsage::isUsedBy(const Image* tilemap, const tile_index ti) const
+{
+  const std::vector<TileCount>* tiles = tilesUsedBy(tilemap);
+  if (!tiles)
+    return false;
+
+  auto it = std::lower_bound(tiles->begin(), tiles->end(), ti,
+                             [](const TileCount& a, const tile_index b){
+                               return a.first < b;
+                             });
+  return (it != tiles->end() && it->first == ti);
+}
+
+const std::vector<TileUsage::TileCount>* TileUsage::tilesUsedBy(const Image* tilemap) const
+{
+  auto it = m_entries.find(tilemap->id());
+  if (it == m_entries.end())
+    return nullptr;
+
+  ASSERT(it->second.version == tilemap->version());
+  return &it->second.tiles;
+}
+
+void TileUsage::addEntry(const Entry& entry)
+{
+  if (entry.tiles.empty())
+    return;
+
+  const std::size_t n = std::size_t(entry.tiles.back().first) + 1;
+  if (m_counts.size() < n) {
+    m_counts.resize(n, 0);
+    m_tilemaps.resize(n, 0);
+  }
+
+  for (const TileCount& tile : entry.tiles) {
+    m_counts[tile.first] += tile.second;
+    ++m_tilemaps[tile.first];
+  }
+}
+
+void TileUsage::removeEntry(const Entry& entry)
+{
+  for (const TileCount& tile : entry.tiles) {
+    ASSERT(tile.first < m_counts.size());
+    ASSERT(m_counts[tile.first] >= tile.second);
+    ASSERT(m_tilemaps[tile.first] > 0);
+    m_counts[tile.first] -= tile.second;
+    --m_tilemaps[tile.first];
+  }
+}
+
+} // namespace doc
@@ -0,0 +1,83 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_TILE_USAGE_H_INCLUDED
+#define DOC_TILE_USAGE_H_INCLUDED
+#pragma once
+
+#include "doc/image_ref.h"
+#include "doc/object_id.h"
+#include "doc/object_version.h"
+#include "doc/tile.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace doc {
+
+  // Reverse index of tiles -> tilemaps: how many times each tile is
+  // used in all tilemaps of a tileset, and which tiles are used by
+  // each tilemap (a sorted list of tile index + count per tilemap
+  // image).
+  //
+  // It's updated incrementally with update(): only tilemap images
+  // that are new or were modified (a different version) since the
+  // last update are scanned again, so queries after small changes
+  // are cheap (see Tileset::usage()).
+  class TileUsage {
+  public:
+    using TileCount = std::pair<tile_index, uint32_t>;
+
+    // Updates the index with the given tilemap images (all tilemaps
+    // that use the tileset). Tilemaps that are not in the list
+    // anymore are removed from the index.
+    void update(const std::vector<ImageRef>& tilemaps);
+    void clear();
+
+    // Number of cells in all tilemaps referencing the given tile
+    // (the empty tile without flags is not counted).
+    std::size_t useCount(const tile_index ti) const {
+      return (ti < m_counts.size() ? m_counts[ti]: 0);
+    }
+
+    bool isUsed(const tile_index ti) const {
+      return (useCount(ti) > 0);
+    }
+
+    // Number of tilemap images using the given tile.
+    int tilemapsUsing(const tile_index ti) const {
+      return (ti < m_tilemaps.size() ? int(m_tilemaps[ti]): 0);
+    }
+
+    // Returns true if the given tilemap (which must be in the index)
+    // references the tile "ti".
+    bool isUsedBy(const Image* tilemap, const tile_index ti) const;
+
+    // Returns the tiles used by the given tilemap (sorted by tile
+    // index), or nullptr if the tilemap isn't in the index.
+    const std::vector<TileCount>* tilesUsedBy(const Image* tilemap) const;
+
+  private:
+    struct Entry {
+      ObjectVersion version = 0;
+      uint32_t generation = 0;
+      std::vector<TileCount> tiles;
+    };
+
+    void addEntry(const Entry& entry);
+    void removeEntry(const Entry& entry);
+
+    std::unordered_map<ObjectId, Entry> m_entries;
+    std::vector<std::size_t> m_counts;
+    std::vector<uint32_t> m_tilemaps;
+    uint32_t m_generation = 0;
+  };
+
+} // namespace doc
+
+#endif
@@ -0,0 +1,138 @@
+// Aseprite Document Library
+// Copyright (c) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/tile_usage.h"
+
+#include "doc/image.h"
+#include "doc/primitives.h"
+
+#include <random>
+
+using namespace doc;
+
+namespace {
+
+ImageRef make_tilemap(const int w, const int h, const tile_t t)
+{
+  ImageRef tilemap(Image::create(IMAGE_TILEMAP, w, h));
+  clear_image(tilemap.get(), t);
+  return tilemap;
+}
+
+// Checks the usage against a histogram of the given tilemaps
+void expect_valid_usage(const TileUsage& usage,
+                        const std::vector<ImageRef>& tilemaps,
+                        const tile_index ntiles)
+{
+  for (tile_index ti=0; ti<ntiles; ++ti) {
+    std::size_t count = 0;
+    int ntilemaps = 0;
+    for (const ImageRef& tilemap : tilemaps) {
+      int n = 0;
+      for (int y=0; y<tilemap->height(); ++y)
+        for (int x=0; x<tilemap->width(); ++x) {
+          const tile_t t = get_pixel(tilemap.get(), x, y);
+          if (t != notile && tile_geti(t) == ti)
+            ++n;
+        }
+      count += n;
+      if (n > 0)
+        ++ntilemaps;
+      EXPECT_EQ(n > 0, usage.isUsedBy(tilemap.get(), ti));
+    }
+    EXPECT_EQ(count, usage.useCount(ti)) << " ti=" << ti;
+    EXPECT_EQ(count > 0, usage.isUsed(ti));
+    EXPECT_EQ(ntilemaps, usage.tilemapsUsing(ti)) << " ti=" << ti;
+  }
+}
+
+} // anonymous namespace
+
+TEST(TileUsage, Basic)
+{
+  TileUsage usage;
+  std::vector<ImageRef> tilemaps = {
+    make_tilemap(4, 4, tile(1, 0)),
+    make_tilemap(2, 3, notile),
+  };
+  put_pixel(tilemaps[0].get(), 1, 1, tile(3, tile_f_xflip));
+  put_pixel(tilemaps[1].get(), 0, 0, tile(3, 0));
+  put_pixel(tilemaps[1].get(), 1, 2, tile(0, tile_f_yflip));
+
+  usage.update(tilemaps);
+  EXPECT_EQ(1, usage.useCount(0)); // Only the empty tile with flags
+  EXPECT_EQ(15, usage.useCount(1));
+  EXPECT_EQ(0, usage.useCount(2));
+  EXPECT_EQ(2, usage.useCount(3));
+  EXPECT_EQ(0, usage.useCount(100));
+  EXPECT_EQ(2, usage.tilemapsUsing(3));
+  expect_valid_usage(usage, tilemaps, 5);
+
+  // Modify a tilemap
+  clear_image(tilemaps[0].get(), tile(2, 0));
+  tilemaps[0]->incrementVersion();
+  usage.update(tilemaps);
+  EXPECT_EQ(0, usage.useCount(1));
+  EXPECT_EQ(16, usage.useCount(2));
+  EXPECT_EQ(1, usage.useCount(3));
+  expect_valid_usage(usage, tilemaps, 5);
+
+  // Remove a tilemap
+  tilemaps.erase(tilemaps.begin());
+  usage.update(tilemaps);
+  EXPECT_EQ(0, usage.useCount(2));
+  EXPECT_EQ(1, usage.useCount(3));
+  expect_valid_usage(usage, tilemaps, 5);
+}
+
+TEST(TileUsage, RandomChanges)
+{
+  std::mt19937 gen(1);
+  TileUsage usage;
+  std::vector<ImageRef> tilemaps;
+
+  for (int i=0; i<200; ++i) {
+    switch (gen() % 3) {
+      case 0:
+        tilemaps.push_back(make_tilemap(1+gen()%8, 1+gen()%8, notile));
+        break;
+      case 1:
+        if (!tilemaps.empty())
+          tilemaps.erase(tilemaps.begin() + gen() % tilemaps.size());
+        break;
+      case 2:
+        if (!tilemaps.empty()) {
+          Image* tilemap = tilemaps[gen() % tilemaps.size()].get();
+          put_pixel(tilemap,
+                    gen() % tilemap->width(),
+                    gen() % tilemap->height(),
+                    tile(gen() % 20, (gen() & 1 ? tile_f_dflip: 0)));
+          tilemap->incrementVersion();
+        }
+        break;
+    }
+
+    // Some tilemaps can be repeated (linked cels)
+    std::vector<ImageRef> list = tilemaps;
+    if (!tilemaps.empty() && (gen() & 1))
+      list.push_back(tilemaps[gen() % tilemaps.size()]);
+
+    usage.update(list);
+    expect_valid_usage(usage, tilemaps, 20);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2023  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -17,6 +17,7 @@
 #include "doc/primitives.h"
 #include "doc/remap.h"
 #include "doc/sprite.h"
+#include "doc/tile_hash.h"
 
 #include <memory>
 
@@ -24,6 +25,17 @@
 
 namespace doc {
 
+namespace {
+
+// The same hash for all flipped versions of a tile, so we can find
+// flipped tiles in the same probe sequence of the hash table.
+uint32_t tile_hash(const Image* image)
+{
+  return (image ? calculate_canonical_tile_hash(image): 0);
+}
+
+} // anonymous namespace
+
 // static
 UserData Tileset::kNoUserData;
 
@@ -44,11 +56,8 @@ Tileset::Tileset(Sprite* sprite,
   //      clipboard
   //ASSERT(sprite);
 
-  for (tile_index ti=0; ti<ntiles; ++ti) {
-    ImageRef tile = makeEmptyTile();
-    m_tiles[ti].image = tile;
-    hashImage(ti, tile);
-  }
+  for (tile_index ti=0; ti<ntiles; ++ti)
+    m_tiles[ti].image = makeEmptyTile();
 }
 
 // static
@@ -127,12 +136,29 @@ void Tileset::resize(const tile_index ntiles)
   m_tiles.resize(ntiles);
   for (tile_index ti=oldSize; ti<ntiles; ++ti)
     m_tiles[ti].image = makeEmptyTile();
+
+  if (!m_hash.empty()) {
+    for (tile_index ti=m_hash.size(); ti>ntiles; --ti)
+      m_hash.erase(ti-1);
+    for (tile_index ti=m_hash.size(); ti<ntiles; ++ti)
+      m_hash.insert(ti, tile_hash(m_tiles[ti].image.get()));
+  }
 }
 
 void Tileset::remap(const Remap& remap)
 {
   Tiles tmp = m_tiles;
 
+  // Move the hash of each tile with the tile (without hashing the
+  // tile images again)
+  std::vector<uint32_t> hashes;
+  if (!m_hash.empty()) {
+    hashes.resize(m_hash.size());
+    for (tile_index ti=0; ti<m_hash.size(); ++ti)
+      hashes[ti] = m_hash.hash(ti);
+  }
+  const std::vector<uint32_t> oldHashes = hashes;
+
   // The notile cannot be remapped
   ASSERT(remap[0] == 0);
 
@@ -146,10 +172,14 @@ void Tileset::remap(const Remap& remap)
       ASSERT(remap[ti] != notile);
 
       m_tiles[remap[ti]] = tmp[ti];
+      if (!hashes.empty())
+        hashes[remap[ti]] = oldHashes[ti];
     }
   }
 
-  rehash();
+  if (!hashes.empty())
+    m_hash.reset(std::move(hashes));
+  discardCompressedData();
 }
 
 void Tileset::setTileData(const tile_index ti,
@@ -172,13 +202,11 @@ void Tileset::set(const tile_index ti,
   }
 #endif
 
-  removeFromHash(ti, false);
-
   preprocess_transparent_pixels(image.get());
   m_tiles[ti].image = image;
 
   if (!m_hash.empty())
-    hashImage(ti, image);
+    m_hash.update(ti, tile_hash(image.get()));
 }
 
 tile_index Tileset::add(const ImageRef& image,
@@ -193,7 +221,7 @@ tile_index Tileset::add(const ImageRef& image,
 
   const tile_index newIndex = tile_index(m_tiles.size()-1);
   if (!m_hash.empty())
-    hashImage(newIndex, image);
+    m_hash.insert(newIndex, tile_hash(image.get()));
   return newIndex;
 }
 
@@ -215,25 +243,19 @@ void Tileset::insert(const tile_index ti,
   preprocess_transparent_pixels(image.get());
   m_tiles.insert(m_tiles.begin()+ti, Tile(image, userData));
 
-  if (!m_hash.empty()) {
-    // Fix all indexes in the hash that are greater than "ti"
-    for (auto& it : m_hash)
-      if (it.second >= ti)
-        ++it.second;
-
-    // And now we can add the new image with the "ti" index
-    hashImage(ti, image);
-  }
+  // Indexes of the next tiles are incremented in the hash table
+  if (!m_hash.empty())
+    m_hash.insert(ti, tile_hash(image.get()));
 }
 
 void Tileset::erase(const tile_index ti)
 {
   ASSERT(ti >= 0 && ti < size());
-  // TODO check why this doesn't work
-  //removeFromHash(ti, true);
 
   m_tiles.erase(m_tiles.begin()+ti);
-  rehash();
+  if (!m_hash.empty())
+    m_hash.erase(ti);
+  discardCompressedData();
 }
 
 ImageRef Tileset::makeEmptyTile()
@@ -259,12 +281,14 @@ bool Tileset::findTileIndex(const ImageRef& tileImage,
     return false;
   }
 
-  auto& h = hashTable(); // Don't use m_hash directly in case that
-                         // we've to regenerate the hash table.
+  const auto& h = hashTable(); // Don't use m_hash directly in case that
+                               // we've to regenerate the hash table.
 
-  auto it = h.find(tileImage);
-  if (it != h.end()) {
-    ti = it->second;
+  const Image* image = tileImage.get();
+  if (h.find(tile_hash(image),
+             [this, image](const tile_index i){
+               return is_same_image(m_tiles[i].image.get(), image);
+             }, ti)) {
     return true;
   }
   else {
@@ -273,47 +297,65 @@ bool Tileset::findTileIndex(const ImageRef& tileImage,
   }
 }
 
-void Tileset::notifyTileContentChange(const tile_index ti)
+bool Tileset::findTileIndex(const ImageRef& tileImage,
+                            const tile_flags matchFlags,
+                            tile_index& ti,
+                            tile_flags& tf)
 {
-#if 0 // TODO Try to do less work
-
-  ASSERT(ti >= 0 && ti < size());
+  ASSERT(tileImage);
+  if (!tileImage) {
+    ti = notile;
+    tf = 0;
+    return false;
+  }
 
-  // If two or more tiles are exactly the same, they will have the
-  // same hash, so the m_hash table can be smaller than the m_tiles
-  // array.
-  if (m_hash.size() < m_tiles.size()) {
-    // Count how many hash elements are poiting to this tile index
-    int tilesWithSameHash = 0;
-    for (auto item : m_hash)
-      if (item.second == ti)
-        ++tilesWithSameHash;
-
-    // In this case we re-generate the whole hash table because one or
-    // more tiles tile are using the hash of the modified tile.
-    if (tilesWithSameHash >= 2) {
-      rehash();
-      return;
+  // Order used to find flipped tiles (the first orientations have
+  // priority over the next ones).
+  static constexpr tile_flags kFlags[] = {
+    0,
+    tile_f_xflip,
+    tile_f_yflip,
+    tile_f_xflip | tile_f_yflip,
+    tile_f_dflip,
+    tile_f_xflip | tile_f_dflip,
+    tile_f_xflip | tile_f_yflip | tile_f_dflip,
+    tile_f_yflip | tile_f_dflip,
+  };
+
+  const auto& h = hashTable();
+  const Image* image = tileImage.get();
+
+  // All flipped versions of the image have the same hash, so we
+  // calculate the hash only once.
+  const uint32_t hash = tile_hash(image);
+  for (const tile_flags flags : kFlags) {
+    if ((flags & ~matchFlags) != 0 ||
+        !is_valid_tile_orientation(image, flags))
+      continue;
+
+    if (h.find(hash,
+               [this, image, flags](const tile_index i){
+                 return is_same_tile(m_tiles[i].image.get(), flags, image);
+               }, ti)) {
+      tf = flags;
+      return true;
     }
   }
+  ti = notile;
+  tf = 0;
+  return false;
+}
 
-  // In other case we can do a fast-path, just removing and
-  // re-adding the tile to the hash table.
-  removeFromHash(ti, false);
-  if (!m_hash.empty())
-    hashImage(ti, m_tiles[ti]);
-
-#else // Regenerate the whole hash map (at the moment this is the
-      // only way to make it work correctly)
-
-  (void)ti;                     // unused
-
-  if (ti >= 0 && ti < m_tiles.size() && m_tiles[ti].image)
+void Tileset::notifyTileContentChange(const tile_index ti)
+{
+  if (ti >= 0 && ti < m_tiles.size() && m_tiles[ti].image) {
     preprocess_transparent_pixels(m_tiles[ti].image.get());
+    updateHash(ti);
+  }
 
-  rehash();
-
-#endif
+  // Reset the compressed data (just in case we have cached the data
+  // from a loaded .aseprite file or when saving the file).
+  discardCompressedData();
 }
 
 void Tileset::notifyRegenerateEmptyTile()
@@ -322,26 +364,11 @@ void Tileset::notifyRegenerateEmptyTile()
     return;
 
   ImageRef image = get(doc::notile);
-  if (image)
+  if (image) {
     doc::clear_image(image.get(), image->maskColor());
-  rehash();
-}
-
-void Tileset::removeFromHash(const tile_index ti,
-                             const bool adjustIndexes)
-{
-  auto end = m_hash.end();
-  for (auto it=m_hash.begin(); it!=end; ) {
-    if (it->second == ti) {
-      it = m_hash.erase(it);
-      end = m_hash.end();
-    }
-    else {
-      if (adjustIndexes && it->second > ti)
-        --it->second;
-      ++it;
-    }
+    updateHash(doc::notile);
   }
+  discardCompressedData();
 }
 
 #ifdef _DEBUG
@@ -352,63 +379,54 @@ void Tileset::assertValidHashTable()
   if (m_hash.empty())
     return;
 
-  // If two or more tiles are exactly the same, they will have the
-  // same hash, so the m_hash table can be smaller than the m_tiles
-  // array.
-  if (m_hash.size() < m_tiles.size()) {
-    for (tile_index ti=0; ti<tile_index(m_tiles.size()); ++ti) {
-      auto it = m_hash.find(m_tiles[ti].image);
-      ASSERT(it != m_hash.end());
-
-      // If the hash doesn't match, it is because other tile is equal
-      // to this one.
-      if (it->second != ti) {
-        ASSERT(is_same_image(it->first.get(), m_tiles[it->second].image.get()));
-      }
-    }
-  }
-  else if (m_hash.size() == m_tiles.size()) {
-    for (tile_index ti=0; ti<tile_index(m_tiles.size()); ++ti) {
-      auto it = m_hash.find(m_tiles[ti].image);
-      ASSERT(it != m_hash.end());
-      ASSERT(it->second == ti);
-    }
-  }
-  else {
-    ASSERT(false && "The hash table cannot contain more tiles than the tileset");
+  ASSERT(m_hash.size() == m_tiles.size());
+  for (tile_index ti=0; ti<tile_index(m_tiles.size()); ++ti) {
+    const Image* image = m_tiles[ti].image.get();
+    ASSERT(m_hash.hash(ti) == tile_hash(image));
+
+    // The found tile is this one, or a previous tile with the same
+    // pixels
+    tile_index found = notile;
+    ASSERT(m_hash.find(tile_hash(image),
+                       [this, image](const tile_index i){
+                         return is_same_image(m_tiles[i].image.get(), image);
+                       }, found));
+    ASSERT(found <= ti);
   }
 }
 #endif
 
-void Tileset::hashImage(const tile_index ti,
-                        const ImageRef& tileImage)
-{
-  if (m_hash.find(tileImage) == m_hash.end())
-    m_hash[tileImage] = ti;
-}
-
-void Tileset::rehash()
+void Tileset::updateHash(const tile_index ti)
 {
-  // Clear the hash table, we'll lazy-rehash it when
-  // hashTable()/findTileIndex() is used.
-  m_hash.clear();
-
-  // Reset the compressed data (just in case we have cached the data
-  // from a loaded .aseprite file or when saving the file).
-  discardCompressedData();
+  if (!m_hash.empty() && ti < m_hash.size())
+    m_hash.update(ti, tile_hash(m_tiles[ti].image.get()));
 }
 
-TilesetHashTable& Tileset::hashTable()
+const TilesetHashTable& Tileset::hashTable()
 {
   if (m_hash.empty()) {
     // Re-hash/create the whole hash table from scratch
-    tile_index ti = 0;
-    for (auto& tile : m_tiles)
-      hashImage(ti++, tile.image);
+    std::vector<uint32_t> hashes(m_tiles.size());
+    for (tile_index ti=0; ti<tile_index(m_tiles.size()); ++ti)
+      hashes[ti] = tile_hash(m_tiles[ti].image.get());
+    m_hash.reset(std::move(hashes));
   }
   return m_hash;
 }
 
+const TileUsage& Tileset::usage()
+{
+  if (m_sprite) {
+    std::vector<ImageRef> tilemaps;
+    m_sprite->getTilemapsByTileset(this, tilemaps);
+    m_usage.update(tilemaps);
+  }
+  else {
+    m_usage.clear();
+  }
+  return m_usage;
+}
+
 int Tileset::tilemapsCount() const {
   auto tsi = sprite()->tilesets()->getIndex(this);
   int count = 0;
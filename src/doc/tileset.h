@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2023  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -13,6 +13,7 @@
 #include "doc/image_ref.h"
 #include "doc/object.h"
 #include "doc/tile.h"
+#include "doc/tile_usage.h"
 #include "doc/tileset_hash_table.h"
 #include "doc/with_user_data.h"
 
@@ -127,6 +128,17 @@ namespace doc {
     bool findTileIndex(const ImageRef& tileImage,
                        tile_index& ti);
 
+    // Same as findTileIndex() but it can match flipped versions of
+    // the tiles with the combinations of "matchFlags" (e.g. the
+    // tileset matchFlags()). Returns the flip flags that must be used
+    // to draw the "ti" tile as "tileImage" in "tf". All flipped
+    // versions of a tile have the same hash (see
+    // calculate_canonical_tile_hash()) so the image is hashed once.
+    bool findTileIndex(const ImageRef& tileImage,
+                       const tile_flags matchFlags,
+                       tile_index& ti,
+                       tile_flags& tf);
+
     // Must be called when a tile image was modified externally, so
     // the hash elements are re-calculated for that specific tile.
     void notifyTileContentChange(const tile_index ti);
@@ -138,22 +150,25 @@ namespace doc {
     // Returns the number of tilemap layers that are referencing this tileset.
     int tilemapsCount() const;
 
+    // Returns the usage of each tile in all tilemaps that use this
+    // tileset. Only tilemaps modified since the last call are scanned
+    // again (tilemap images must increment their version when they
+    // are modified).
+    const TileUsage& usage();
+
 #ifdef _DEBUG
     void assertValidHashTable();
 #endif
 
   private:
-    void removeFromHash(const tile_index ti,
-                        const bool adjustIndexes);
-    void hashImage(const tile_index ti,
-                   const ImageRef& tileImage);
-    void rehash();
-    TilesetHashTable& hashTable();
+    void updateHash(const tile_index ti);
+    const TilesetHashTable& hashTable();
 
     Sprite* m_sprite;
     Grid m_grid;
     Tiles m_tiles;
     TilesetHashTable m_hash;
+    TileUsage m_usage;
     std::string m_name;
     int m_baseIndex = 1;
     tile_flags m_matchFlags = 0;
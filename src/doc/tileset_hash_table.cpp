@@ -0,0 +1,134 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/tileset_hash_table.h"
+
+#include "base/debug.h"
+
+#include <algorithm>
+
+namespace doc {
+
+static constexpr std::size_t kMinSlots = 16;
+
+void TilesetHashTable::clear()
+{
+  m_hashes.clear();
+  m_slots.clear();
+  m_mask = 0;
+  m_shift = 32;
+}
+
+void TilesetHashTable::reset(std::vector<uint32_t>&& hashes)
+{
+  m_hashes = std::move(hashes);
+
+  // Keep the load factor below 50%
+  std::size_t nslots = kMinSlots;
+  int bits = 4;
+  while (nslots < 2*m_hashes.size()) {
+    nslots *= 2;
+    ++bits;
+  }
+  m_slots.assign(nslots, Slot());
+  m_mask = nslots-1;
+  m_shift = 32-bits;
+
+  for (tile_index ti=0; ti<size(); ++ti)
+    addSlot(m_hashes[ti], ti);
+}
+
+void TilesetHashTable::insert(const tile_index ti, const uint32_t hash)
+{
+  ASSERT(ti <= size());
+
+  if (ti < size())
+    shiftIndexes(ti, 1);
+  m_hashes.insert(m_hashes.begin()+ti, hash);
+
+  // growIfNeeded() re-creates the whole table including the new
+  // tile.
+  if (!growIfNeeded())
+    addSlot(hash, ti);
+}
+
+void TilesetHashTable::erase(const tile_index ti)
+{
+  ASSERT(ti < size());
+
+  removeSlot(m_hashes[ti], ti);
+  m_hashes.erase(m_hashes.begin()+ti);
+  if (ti < size())
+    shiftIndexes(ti+1, -1);
+}
+
+void TilesetHashTable::update(const tile_index ti, const uint32_t hash)
+{
+  ASSERT(ti < size());
+  if (m_hashes[ti] == hash)
+    return;
+
+  removeSlot(m_hashes[ti], ti);
+  m_hashes[ti] = hash;
+  addSlot(hash, ti);
+}
+
+void TilesetHashTable::addSlot(const uint32_t hash, const tile_index ti)
+{
+  std::size_t i = homeSlot(hash);
+  while (m_slots[i].ti != kEmptySlot)
+    i = (i+1) & m_mask;
+  m_slots[i].hash = hash;
+  m_slots[i].ti = ti;
+}
+
+void TilesetHashTable::removeSlot(const uint32_t hash, const tile_index ti)
+{
+  std::size_t i = homeSlot(hash);
+  while (m_slots[i].ti != ti) {
+    ASSERT(m_slots[i].ti != kEmptySlot);
+    if (m_slots[i].ti == kEmptySlot)
+      return;
+    i = (i+1) & m_mask;
+  }
+
+  // Move back the next slots of the probe sequence to fill the hole
+  // (backward shift deletion, so we don't need tombstones)
+  for (std::size_t j=(i+1) & m_mask; m_slots[j].ti != kEmptySlot; j=(j+1) & m_mask) {
+    const std::size_t home = homeSlot(m_slots[j].hash);
+    // Distance from the home slot must be greater than or equal to
+    // the distance to the hole to move the slot there
+    if (((j - home) & m_mask) >= ((j - i) & m_mask)) {
+      m_slots[i] = m_slots[j];
+      i = j;
+    }
+  }
+  m_slots[i] = Slot();
+}
+
+void TilesetHashTable::shiftIndexes(const tile_index firstTi, const int delta)
+{
+  for (Slot& slot : m_slots) {
+    if (slot.ti != kEmptySlot && slot.ti >= firstTi)
+      slot.ti += delta;
+  }
+}
+
+bool TilesetHashTable::growIfNeeded()
+{
+  if (2*m_hashes.size() <= m_slots.size())
+    return false;
+
+  std::vector<uint32_t> hashes = std::move(m_hashes);
+  reset(std::move(hashes));
+  return true;
+}
+
+} // namespace doc
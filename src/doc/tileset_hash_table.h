@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -10,19 +10,96 @@
 
 #include "doc/image.h"
 #include "doc/image_ref.h"
-#include "doc/images_map.h"
 #include "doc/primitives.h"
 #include "doc/tile.h"
 
-#include <unordered_map>
+#include <cstdint>
+#include <vector>
 
 namespace doc {
 
-  // A hash table used to match Image pixels data <-> tileset index
-  typedef std::unordered_map<ImageRef,
-                             tile_index,
-                             details::image_hash,
-                             details::image_eq> TilesetHashTable;
+  // A hash table used to match Image pixels data <-> tileset index.
+  //
+  // It keeps the hash of the pixels of each tile (given by the
+  // Tileset, see calculate_canonical_tile_hash()), so it can be
+  // updated incrementally when a tile is added, modified, or removed
+  // without hashing all tiles again. Each tile has its own slot in an
+  // open-addressing table (with linear probing) keyed by that hash,
+  // so tiles with the same pixels (or flipped versions of the same
+  // pixels) are in the same probe sequence.
+  class TilesetHashTable {
+  public:
+    // An empty table means that it must be re-created (see
+    // Tileset::hashTable()).
+    bool empty() const { return m_hashes.empty(); }
+    tile_index size() const { return tile_index(m_hashes.size()); }
+    uint32_t hash(const tile_index ti) const { return m_hashes[ti]; }
+
+    void clear();
+
+    // Re-creates the whole table with the given hashes of each tile.
+    void reset(std::vector<uint32_t>&& hashes);
+
+    // Inserts the hash of a new tile in the "ti" index, the indexes
+    // of the next tiles are incremented by one.
+    void insert(const tile_index ti, const uint32_t hash);
+
+    // Removes the tile "ti", the indexes of the next tiles are
+    // decremented by one.
+    void erase(const tile_index ti);
+
+    // Changes the hash of the tile "ti" (e.g. when its pixels were
+    // modified).
+    void update(const tile_index ti, const uint32_t hash);
+
+    // Returns the lowest tile index with the given hash where
+    // isSameTile(ti) returns true (i.e. the tile image has the same
+    // pixels as the image that we are looking for).
+    template<typename IsSameTile>
+    bool find(const uint32_t hash,
+              IsSameTile&& isSameTile,
+              tile_index& ti) const {
+      if (m_slots.empty())
+        return false;
+
+      bool found = false;
+      for (std::size_t i=homeSlot(hash); m_slots[i].ti != kEmptySlot;
+           i=(i+1) & m_mask) {
+        const Slot& slot = m_slots[i];
+        if (slot.hash == hash &&
+            (!found || slot.ti < ti) &&
+            isSameTile(slot.ti)) {
+          ti = slot.ti;
+          found = true;
+        }
+      }
+      return found;
+    }
+
+  private:
+    static constexpr tile_index kEmptySlot = tile_index(-1);
+
+    struct Slot {
+      uint32_t hash = 0;
+      tile_index ti = kEmptySlot;
+    };
+
+    std::size_t homeSlot(const uint32_t hash) const {
+      // Fibonacci hashing to spread the bits of the pixels hash
+      return std::size_t(uint32_t(hash * 0x9e3779b1u) >> m_shift) & m_mask;
+    }
+
+    void addSlot(const uint32_t hash, const tile_index ti);
+    void removeSlot(const uint32_t hash, const tile_index ti);
+    void shiftIndexes(const tile_index firstTi, const int delta);
+    bool growIfNeeded();
+
+    // Hash of each tile
+    std::vector<uint32_t> m_hashes;
+    std::vector<Slot> m_slots;
+    std::size_t m_mask = 0;
+    int m_shift = 32;
+  };
 
 } // namespace doc
 
@@ -0,0 +1,153 @@
+// Aseprite Document Library
+// Copyright (c) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/tileset_hash_table.h"
+
+#include <random>
+#include <vector>
+
+using namespace doc;
+
+namespace {
+
+// Tiles are just numbers, two tiles are the same tile if they have
+// the same number. The hash of a tile has a lot of collisions to
+// test tiles with the same hash but different "pixels".
+uint32_t hash_of(const int tile) { return uint32_t(tile % 7); }
+
+bool find_tile(const TilesetHashTable& table,
+               const std::vector<int>& tiles,
+               const int tile,
+               tile_index& ti)
+{
+  return table.find(hash_of(tile),
+                    [&tiles, tile](const tile_index i){
+                      return tiles[i] == tile;
+                    }, ti);
+}
+
+// The expected result is the first tile with the same "pixels"
+bool expected_find(const std::vector<int>& tiles,
+                   const int tile,
+                   tile_index& ti)
+{
+  for (ti=0; ti<tiles.size(); ++ti)
+    if (tiles[ti] == tile)
+      return true;
+  return false;
+}
+
+void expect_valid_table(const TilesetHashTable& table,
+                        const std::vector<int>& tiles)
+{
+  ASSERT_EQ(tiles.size(), table.size());
+  for (tile_index ti=0; ti<tiles.size(); ++ti)
+    EXPECT_EQ(hash_of(tiles[ti]), table.hash(ti));
+
+  for (int tile=0; tile<40; ++tile) {
+    tile_index ti = 0, expectedTi = 0;
+    const bool expected = expected_find(tiles, tile, expectedTi);
+    EXPECT_EQ(expected, find_tile(table, tiles, tile, ti)) << " tile=" << tile;
+    if (expected) {
+      EXPECT_EQ(expectedTi, ti) << " tile=" << tile;
+    }
+  }
+}
+
+} // anonymous namespace
+
+TEST(TilesetHashTable, Basic)
+{
+  TilesetHashTable table;
+  EXPECT_TRUE(table.empty());
+
+  std::vector<int> tiles = { 0, 3, 10, 3, 17 };
+  std::vector<uint32_t> hashes;
+  for (int tile : tiles)
+    hashes.push_back(hash_of(tile));
+  table.reset(std::move(hashes));
+  EXPECT_FALSE(table.empty());
+  expect_valid_table(table, tiles);
+
+  tile_index ti;
+  EXPECT_TRUE(find_tile(table, tiles, 3, ti));
+  EXPECT_EQ(1, ti);
+  EXPECT_TRUE(find_tile(table, tiles, 17, ti));
+  EXPECT_EQ(4, ti);
+  EXPECT_FALSE(find_tile(table, tiles, 24, ti));
+
+  // Remove the first tile 3, the next one is found
+  tiles.erase(tiles.begin()+1);
+  table.erase(1);
+  expect_valid_table(table, tiles);
+  EXPECT_TRUE(find_tile(table, tiles, 3, ti));
+  EXPECT_EQ(2, ti);
+
+  tiles.insert(tiles.begin(), 24);
+  table.insert(0, hash_of(24));
+  expect_valid_table(table, tiles);
+
+  tiles[2] = 31;
+  table.update(2, hash_of(31));
+  expect_valid_table(table, tiles);
+
+  table.clear();
+  EXPECT_TRUE(table.empty());
+  EXPECT_FALSE(find_tile(table, tiles, 3, ti));
+}
+
+TEST(TilesetHashTable, RandomOperations)
+{
+  std::mt19937 gen(1);
+  TilesetHashTable table;
+  std::vector<int> tiles;
+
+  for (int i=0; i<3000; ++i) {
+    const int tile = gen() % 40;
+    const tile_index n = tile_index(tiles.size());
+
+    switch (gen() % 4) {
+      case 0: {
+        // Add/insert a tile
+        const tile_index ti = (n > 0 && (gen() & 1) ? gen() % (n+1): n);
+        tiles.insert(tiles.begin()+ti, tile);
+        table.insert(ti, hash_of(tile));
+        break;
+      }
+      case 1:
+        if (n > 50) {
+          const tile_index ti = gen() % n;
+          tiles.erase(tiles.begin()+ti);
+          table.erase(ti);
+        }
+        break;
+      case 2:
+      case 3:
+        if (n > 0) {
+          const tile_index ti = gen() % n;
+          tiles[ti] = tile;
+          table.update(ti, hash_of(tile));
+        }
+        break;
+    }
+
+    if ((i % 100) == 0)
+      expect_valid_table(table, tiles);
+  }
+  expect_valid_table(table, tiles);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -10,6 +10,8 @@
 
 #include "doc/tileset_io.h"
 
+#include "base/buffer.h"
+#include "base/exception.h"
 #include "base/serialization.h"
 #include "doc/cancel_io.h"
 #include "doc/grid_io.h"
@@ -19,27 +21,175 @@
 #include "doc/tileset.h"
 #include "doc/user_data_io.h"
 #include "doc/util.h"
+#include "zlib.h"
 
 #include <iostream>
+#include <vector>
 
 namespace doc {
 
 using namespace base::serialization;
 using namespace base::serialization::little_endian;
 
+namespace {
+
+// Returns true if all tiles can be saved in one block of pixels (the
+// same layout of tilesets in .aseprite files, one tile below the
+// other).
+bool can_write_tiles_block(const Tileset* tileset)
+{
+  if (tileset->size() == 0)
+    return false;
+
+  const gfx::Size tileSize = tileset->grid().tileSize();
+  const ImageRef first = tileset->get(0);
+  if (!first ||
+      first->pixelFormat() == IMAGE_BITMAP ||
+      first->pixelFormat() == IMAGE_TILEMAP)
+    return false;
+
+  for (const auto& tile : *tileset) {
+    if (!tile.image ||
+        tile.image->size() != tileSize ||
+        tile.image->pixelFormat() != first->pixelFormat())
+      return false;
+  }
+  return true;
+}
+
+void compress_tiles_block(const Tileset* tileset, base::buffer& output)
+{
+  z_stream zstream;
+  zstream.zalloc = (alloc_func)0;
+  zstream.zfree  = (free_func)0;
+  zstream.opaque = (voidpf)0;
+  int err = deflateInit(&zstream, Z_DEFAULT_COMPRESSION);
+  if (err != Z_OK)
+    throw base::Exception("ZLib error %d in deflateInit().", err);
+
+  std::vector<uint8_t> compressed(4096);
+  const tile_index ntiles = tileset->size();
+  for (tile_index ti=0; ti<ntiles; ++ti) {
+    const ImageRef image = tileset->get(ti);
+    const int h = image->height();
+    for (int y=0; y<h; ++y) {
+      zstream.next_in = (Bytef*)image->readPixelAddress(0, y);
+      zstream.avail_in = image->widthBytes();
+      const int flush = (ti == ntiles-1 && y == h-1 ? Z_FINISH: Z_NO_FLUSH);
+
+      do {
+        zstream.next_out = (Bytef*)&compressed[0];
+        zstream.avail_out = compressed.size();
+
+        err = deflate(&zstream, flush);
+        if (err != Z_OK && err != Z_STREAM_END && err != Z_BUF_ERROR)
+          throw base::Exception("ZLib error %d in deflate().", err);
+
+        const int output_bytes = compressed.size() - zstream.avail_out;
+        if (output_bytes > 0)
+          output.insert(output.end(), &compressed[0], &compressed[0]+output_bytes);
+      } while (zstream.avail_out == 0);
+    }
+  }
+
+  err = deflateEnd(&zstream);
+  if (err != Z_OK)
+    throw base::Exception("ZLib error %d in deflateEnd().", err);
+}
+
+void write_tiles_block(std::ostream& os, const Tileset* tileset)
+{
+  write8(os, tileset->get(0)->pixelFormat());
+  for (const auto& tile : *tileset) {
+    write32(os, tile.image->id());
+    write32(os, tile.image->maskColor());
+  }
+
+  // Reuse the compressed data cached from the .aseprite file (it's
+  // the same block of pixels) when the tileset wasn't modified.
+  if (!tileset->compressedData().empty() &&
+      tileset->compressedDataVersion() == tileset->version()) {
+    const base::buffer& data = tileset->compressedData();
+    write32(os, data.size());
+    os.write((const char*)data.data(), data.size());
+  }
+  else {
+    base::buffer data;
+    compress_tiles_block(tileset, data);
+    write32(os, data.size());
+    os.write((const char*)data.data(), data.size());
+  }
+}
+
+void read_tiles_block(std::istream& is, Tileset* tileset, const bool setId)
+{
+  const auto pixelFormat = PixelFormat(read8(is));
+  const gfx::Size tileSize = tileset->grid().tileSize();
+  const tile_index ntiles = tileset->size();
+  if ((pixelFormat != IMAGE_RGB &&
+       pixelFormat != IMAGE_GRAYSCALE &&
+       pixelFormat != IMAGE_INDEXED) ||
+      tileSize.w < 1 || tileSize.h < 1)
+    throw base::Exception("Invalid tileset pixels block");
+
+  std::vector<ImageRef> images(ntiles);
+  for (tile_index ti=0; ti<ntiles; ++ti) {
+    const ObjectId id = read32(is);
+    const uint32_t maskColor = read32(is);
+    images[ti].reset(Image::create(pixelFormat, tileSize.w, tileSize.h));
+    images[ti]->setMaskColor(maskColor);
+    if (setId)
+      images[ti]->setId(id);
+  }
+
+  const uint32_t size = read32(is);
+  base::buffer data(size);
+  if (size > 0 && is.read((char*)data.data(), size).fail())
+    throw base::Exception("Error reading tileset pixels block");
+
+  const int widthBytes = (ntiles > 0 ? images[0]->widthBytes(): 0);
+  std::vector<uint8_t> pixels(std::size_t(widthBytes)*tileSize.h*ntiles);
+  uLongf pixelsSize = pixels.size();
+  if (!pixels.empty() &&
+      (uncompress(pixels.data(), &pixelsSize, data.data(), data.size()) != Z_OK ||
+       pixelsSize != pixels.size()))
+    throw base::Exception("Error decompressing tileset pixels block");
+
+  const uint8_t* src = pixels.data();
+  for (tile_index ti=0; ti<ntiles; ++ti) {
+    for (int y=0; y<tileSize.h; ++y, src+=widthBytes)
+      std::copy(src, src+widthBytes, images[ti]->getPixelAddress(0, y));
+    tileset->set(ti, images[ti]);
+  }
+}
+
+} // anonymous namespace
+
 bool write_tileset(std::ostream& os,
                    const Tileset* tileset,
-                   CancelIO* cancel)
+                   CancelIO* cancel,
+                   const SerialFormat serial)
 {
   write32(os, tileset->id());
   write32(os, tileset->size());
   write_grid(os, tileset->grid());
 
-  for (tile_index ti=0; ti<tileset->size(); ++ti) {
-    if (cancel && cancel->isCanceled())
-      return false;
+  // Since SerialFormat::Ver3 all tiles can be saved in one block
+  bool block = false;
+  if (serial >= SerialFormat::Ver3) {
+    block = can_write_tiles_block(tileset);
+    write8(os, block ? 1: 0);
+  }
+  if (block) {
+    write_tiles_block(os, tileset);
+  }
+  else {
+    for (tile_index ti=0; ti<tileset->size(); ++ti) {
+      if (cancel && cancel->isCanceled())
+        return false;
 
-    write_image(os, tileset->get(ti).get(), cancel);
+      write_image(os, tileset->get(ti).get(), cancel);
+    }
   }
 
   write8(os, uint8_t(TilesetSerialFormat::LastVer));
@@ -68,9 +218,14 @@ Tileset* read_tileset(std::istream& is,
   if (setId)
     tileset->setId(id);
 
-  for (tileset_index ti=0; ti<ntiles; ++ti) {
-    ImageRef image(read_image(is, setId));
-    tileset->set(ti, image);
+  if (serial >= SerialFormat::Ver3 && read8(is)) {
+    read_tiles_block(is, tileset, setId);
+  }
+  else {
+    for (tileset_index ti=0; ti<ntiles; ++ti) {
+      ImageRef image(read_image(is, setId));
+      tileset->set(ti, image);
+    }
   }
 
   // Read extra version byte after tiles
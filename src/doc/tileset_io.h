@@ -38,9 +38,12 @@ namespace doc {
   class Sprite;
   class Tileset;
 
+  // Since SerialFormat::Ver3 the pixels of all tiles are saved in one
+  // compressed block (reusing Tileset::compressedData() if possible).
   bool write_tileset(std::ostream& os,
                      const Tileset* tileset,
-                     CancelIO* cancel = nullptr);
+                     CancelIO* cancel = nullptr,
+                     SerialFormat serial = SerialFormat::LastVer);
 
   Tileset* read_tileset(std::istream& is,
                         Sprite* sprite,
@@ -27,11 +27,16 @@ namespace filters {
     void setBrightness(double brightness);
     void setContrast(double contrast);
 
+    // Map from the original value of each RGB channel to the new one.
+    const std::vector<int>& colorMap() const { return m_cmap; }
+
     // Filter implementation
     const char* getName() override;
     void applyToRgba(FilterManager* filterMgr) override;
     void applyToGrayscale(FilterManager* filterMgr) override;
     void applyToIndexed(FilterManager* filterMgr) override;
+    bool isParallelizable() const override { return true; }
+    bool isPointFilter() const override { return true; }
 
   private:
     void onApplyToPalette(FilterManager* filterMgr,
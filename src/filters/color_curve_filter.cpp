@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -19,14 +19,31 @@
 #include "doc/rgbmap.h"
 #include "doc/sprite.h"
 
+#include <algorithm>
 #include <vector>
 
 namespace filters {
 
 using namespace doc;
 
+namespace {
+
+// Map used for channels that aren't modified by the filter
+struct IdentityMap {
+  uint8_t map[256];
+  IdentityMap() {
+    for (int i=0; i<256; ++i)
+      map[i] = uint8_t(i);
+  }
+};
+
+const IdentityMap g_identity;
+
+} // anonymous namespace
+
 ColorCurveFilter::ColorCurveFilter()
   : m_cmap(256)
+  , m_lut()
 {
 }
 
@@ -40,8 +57,16 @@ void ColorCurveFilter::generateMap()
 {
   // Generate the color convertion map
   m_curve.getValues(0, 255, m_cmap);
-  for (int c=0; c<256; c++)
+  for (int c=0; c<256; c++) {
     m_cmap[c] = std::clamp(m_cmap[c], 0, 255);
+    m_lut[c] = uint8_t(m_cmap[c]);
+  }
+}
+
+const uint8_t* ColorCurveFilter::channelMap(const Target target,
+                                            const Target channel) const
+{
+  return ((target & channel) ? m_lut: g_identity.map);
 }
 
 const char* ColorCurveFilter::getName()
@@ -51,74 +76,126 @@ const char* ColorCurveFilter::getName()
 
 void ColorCurveFilter::applyToRgba(FilterManager* filterMgr)
 {
-  int c, r, g, b, a;
-
-  FILTER_LOOP_THROUGH_ROW_BEGIN(uint32_t) {
-    c = *src_address;
-
-    r = rgba_getr(c);
-    g = rgba_getg(c);
-    b = rgba_getb(c);
-    a = rgba_geta(c);
+  if (m_usePaletteOnRGB) {
+    FilterIndexedData* fid = filterMgr->getIndexedData();
+    const Palette* pal = fid->getPalette();
+    const Palette* newPal = fid->getNewPalette();
+
+    FILTER_LOOP_THROUGH_ROW_BEGIN(uint32_t) {
+      color_t c = *src_address;
+      int i = pal->findExactMatch(rgba_getr(c),
+                                  rgba_getg(c),
+                                  rgba_getb(c),
+                                  rgba_geta(c), -1);
+      if (i >= 0)
+        c = newPal->getEntry(i);
+      *dst_address = c;
+    }
+    FILTER_LOOP_THROUGH_ROW_END()
+    return;
+  }
 
-    if (target & TARGET_RED_CHANNEL) r = m_cmap[r];
-    if (target & TARGET_GREEN_CHANNEL) g = m_cmap[g];
-    if (target & TARGET_BLUE_CHANNEL) b = m_cmap[b];
-    if (target & TARGET_ALPHA_CHANNEL) a = m_cmap[a];
+  // Channels that aren't in the target use the identity map, so we
+  // don't have to check the target for each pixel.
+  const Target channels = filterMgr->getTarget();
+  const uint8_t* rmap = channelMap(channels, TARGET_RED_CHANNEL);
+  const uint8_t* gmap = channelMap(channels, TARGET_GREEN_CHANNEL);
+  const uint8_t* bmap = channelMap(channels, TARGET_BLUE_CHANNEL);
+  const uint8_t* amap = channelMap(channels, TARGET_ALPHA_CHANNEL);
 
-    *dst_address = rgba(r, g, b, a);
+  FILTER_LOOP_THROUGH_ROW_BEGIN(uint32_t) {
+    const color_t c = *src_address;
+    *dst_address = rgba(rmap[rgba_getr(c)],
+                        gmap[rgba_getg(c)],
+                        bmap[rgba_getb(c)],
+                        amap[rgba_geta(c)]);
   }
   FILTER_LOOP_THROUGH_ROW_END()
 }
 
 void ColorCurveFilter::applyToGrayscale(FilterManager* filterMgr)
 {
-  int c, k, a;
+  const Target channels = filterMgr->getTarget();
+  const uint8_t* kmap = channelMap(channels, TARGET_GRAY_CHANNEL);
+  const uint8_t* amap = channelMap(channels, TARGET_ALPHA_CHANNEL);
 
   FILTER_LOOP_THROUGH_ROW_BEGIN(uint16_t) {
-    c = *src_address;
-
-    k = graya_getv(c);
-    a = graya_geta(c);
-
-    if (target & TARGET_GRAY_CHANNEL) k = m_cmap[k];
-    if (target & TARGET_ALPHA_CHANNEL) a = m_cmap[a];
-
-    *dst_address = graya(k, a);
+    const color_t c = *src_address;
+    *dst_address = graya(kmap[graya_getv(c)],
+                         amap[graya_geta(c)]);
   }
   FILTER_LOOP_THROUGH_ROW_END()
 }
 
 void ColorCurveFilter::applyToIndexed(FilterManager* filterMgr)
 {
-  const Palette* pal = filterMgr->getIndexedData()->getPalette();
-  const RgbMap* rgbmap = filterMgr->getIndexedData()->getRgbMap();
-  int c, r, g, b, a;
-
-  FILTER_LOOP_THROUGH_ROW_BEGIN(uint8_t) {
-    c = *src_address;
+  FilterIndexedData* fid = filterMgr->getIndexedData();
+  const Palette* pal = fid->getPalette();
+  const int maxIndex = pal->size()-1;
 
-    if (target & TARGET_INDEX_CHANNEL) {
-      c = m_cmap[c];
-    }
-    else {
-      c = pal->getEntry(c);
-      r = rgba_getr(c);
-      g = rgba_getg(c);
-      b = rgba_getb(c);
-      a = rgba_geta(c);
-
-      if (target & TARGET_RED_CHANNEL  ) r = m_cmap[r];
-      if (target & TARGET_GREEN_CHANNEL) g = m_cmap[g];
-      if (target & TARGET_BLUE_CHANNEL ) b = m_cmap[b];
-      if (target & TARGET_ALPHA_CHANNEL) a = m_cmap[a];
-
-      c = rgbmap->mapColor(r, g, b, a);
+  if (filterMgr->getTarget() & TARGET_INDEX_CHANNEL) {
+    FILTER_LOOP_THROUGH_ROW_BEGIN(uint8_t) {
+      *dst_address = std::clamp<int>(m_lut[*src_address], 0, maxIndex);
     }
+    FILTER_LOOP_THROUGH_ROW_END()
+    return;
+  }
 
-    *dst_address = std::clamp(c, 0, pal->size()-1);
+  // Apply filter to pixels if there is selection (in other case, the
+  // change is global, so we have already applied the filter to the
+  // palette).
+  if (!filterMgr->isMaskActive())
+    return;
+
+  // Each palette entry is converted only once per row (the first
+  // time we find a pixel with that index).
+  const RgbMap* rgbmap = fid->getRgbMap();
+  int remap[256];
+  std::fill(remap, remap+256, -1);
+
+  FILTER_LOOP_THROUGH_ROW_BEGIN(uint8_t) {
+    const int i = *src_address;
+    if (remap[i] < 0) {
+      color_t c = pal->getEntry(i);
+      applyFilterToRgb(target, c);
+      remap[i] = std::clamp(rgbmap->mapColor(c), 0, maxIndex);
+    }
+    *dst_address = remap[i];
   }
   FILTER_LOOP_THROUGH_ROW_END()
 }
 
+void ColorCurveFilter::onApplyToPalette(FilterManager* filterMgr,
+                                        const PalettePicks& picks)
+{
+  const Target target = filterMgr->getTarget();
+
+  // The curve is applied to the indexes, not to the palette
+  if (target & TARGET_INDEX_CHANNEL)
+    return;
+
+  FilterIndexedData* fid = filterMgr->getIndexedData();
+  const Palette* pal = fid->getPalette();
+  Palette* newPal = fid->getNewPalette();
+
+  int i = 0;
+  for (bool state : picks) {
+    if (state) {
+      color_t c = pal->getEntry(i);
+      applyFilterToRgb(target, c);
+      newPal->setEntry(i, c);
+    }
+    ++i;
+  }
+}
+
+void ColorCurveFilter::applyFilterToRgb(const Target target,
+                                        doc::color_t& c) const
+{
+  c = rgba(channelMap(target, TARGET_RED_CHANNEL)[rgba_getr(c)],
+           channelMap(target, TARGET_GREEN_CHANNEL)[rgba_getg(c)],
+           channelMap(target, TARGET_BLUE_CHANNEL)[rgba_getb(c)],
+           channelMap(target, TARGET_ALPHA_CHANNEL)[rgba_geta(c)]);
+}
+
 } // namespace filters
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -9,31 +9,47 @@
 #define FILTERS_COLOR_CURVE_FILTER_H_INCLUDED
 #pragma once
 
-#include <vector>
-
-#include "filters/filter.h"
+#include "doc/color.h"
+#include "doc/palette_picks.h"
 #include "filters/color_curve.h"
+#include "filters/filter.h"
+#include "filters/target.h"
+
+#include <cstdint>
+#include <vector>
 
 namespace filters {
 
-  class ColorCurveFilter : public Filter {
+  class ColorCurveFilter : public FilterWithPalette {
   public:
     ColorCurveFilter();
 
     void setCurve(const ColorCurve& curve);
     const ColorCurve& getCurve() const { return m_curve; }
 
+    // Map from the original value of each channel to the new one.
+    const std::vector<int>& colorMap() const { return m_cmap; }
+
     // Filter implementation
-    const char* getName();
-    void applyToRgba(FilterManager* filterMgr);
-    void applyToGrayscale(FilterManager* filterMgr);
-    void applyToIndexed(FilterManager* filterMgr);
+    const char* getName() override;
+    void applyToRgba(FilterManager* filterMgr) override;
+    void applyToGrayscale(FilterManager* filterMgr) override;
+    void applyToIndexed(FilterManager* filterMgr) override;
+    bool isParallelizable() const override { return true; }
+    bool isPointFilter() const override { return true; }
 
   private:
+    void onApplyToPalette(FilterManager* filterMgr,
+                          const doc::PalettePicks& picks) override;
+    void applyFilterToRgb(const Target target, doc::color_t& color) const;
+    const uint8_t* channelMap(const Target target,
+                              const Target channel) const;
     void generateMap();
 
     ColorCurve m_curve;
     std::vector<int> m_cmap;
+    // The same m_cmap as bytes (to be used in the rows loops)
+    uint8_t m_lut[256];
   };
 
 } // namespace filters
@@ -0,0 +1,170 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/image_impl.h"
+#include "doc/image_ref.h"
+#include "filters/color_curve.h"
+#include "filters/color_curve_filter.h"
+#include "filters/filter_manager.h"
+
+#include <random>
+#include <vector>
+
+using namespace doc;
+using namespace filters;
+
+namespace {
+
+// Applies a filter to a whole image row by row, skipping one of each
+// three pixels (like a selection).
+class TestFilterManager : public FilterManager {
+public:
+  TestFilterManager(const Image* src, Image* dst, Target target)
+    : m_src(src), m_dst(dst), m_target(target), m_row(0) { }
+
+  void apply(Filter* filter) {
+    for (m_row=0; m_row<m_src->height(); ++m_row) {
+      m_x = 0;
+      if (m_src->pixelFormat() == IMAGE_RGB)
+        filter->applyToRgba(this);
+      else
+        filter->applyToGrayscale(this);
+    }
+  }
+
+  bool skip(int x, int y) const { return ((x + y) % 3) == 0; }
+
+  doc::PixelFormat pixelFormat() const override { return m_src->pixelFormat(); }
+  const void* getSourceAddress() override { return m_src->getPixelAddress(0, m_row); }
+  void* getDestinationAddress() override { return m_dst->getPixelAddress(0, m_row); }
+  int getWidth() override { return m_src->width(); }
+  Target getTarget() override { return m_target; }
+  FilterIndexedData* getIndexedData() override { return nullptr; }
+  bool skipPixel() override { return skip(m_x++, m_row); }
+  const doc::Image* getSourceImage() override { return m_src; }
+  int x() const override { return 0; }
+  int y() const override { return m_row; }
+  bool isFirstRow() const override { return m_row == 0; }
+  bool isMaskActive() const override { return true; }
+  base::task_token& taskToken() const override { return m_token; }
+
+private:
+  const Image* m_src;
+  Image* m_dst;
+  Target m_target;
+  int m_row;
+  int m_x = 0;
+  mutable base::task_token m_token;
+};
+
+ColorCurve test_curve()
+{
+  ColorCurve curve(ColorCurve::Linear);
+  curve.addPoint(gfx::Point(0, 20));
+  curve.addPoint(gfx::Point(64, 200));
+  curve.addPoint(gfx::Point(255, 100));
+  return curve;
+}
+
+} // anonymous namespace
+
+TEST(ColorCurveFilter, RgbaChannels)
+{
+  ColorCurve curve = test_curve();
+  std::vector<int> cmap(256);
+  curve.getValues(0, 255, cmap);
+
+  ColorCurveFilter filter;
+  filter.setCurve(curve);
+  EXPECT_EQ(cmap, filter.colorMap());
+
+  std::mt19937 rng(1);
+  ImageRef src(Image::create(IMAGE_RGB, 31, 5));
+  for (int y=0; y<src->height(); ++y)
+    for (int x=0; x<src->width(); ++x)
+      put_pixel_fast<RgbTraits>(src.get(), x, y, rng());
+
+  for (Target target : { TARGET_RED_CHANNEL,
+                         TARGET_GREEN_CHANNEL | TARGET_ALPHA_CHANNEL,
+                         TARGET_RED_CHANNEL | TARGET_GREEN_CHANNEL | TARGET_BLUE_CHANNEL,
+                         TARGET_ALL_CHANNELS }) {
+    ImageRef dst(Image::create(IMAGE_RGB, src->width(), src->height()));
+    dst->clear(0);
+
+    TestFilterManager mgr(src.get(), dst.get(), target);
+    mgr.apply(&filter);
+
+    for (int y=0; y<src->height(); ++y) {
+      for (int x=0; x<src->width(); ++x) {
+        color_t c = get_pixel_fast<RgbTraits>(src.get(), x, y);
+        color_t expected = 0;
+        if (!mgr.skip(x, y)) {
+          int r = rgba_getr(c), g = rgba_getg(c), b = rgba_getb(c), a = rgba_geta(c);
+          if (target & TARGET_RED_CHANNEL) r = cmap[r];
+          if (target & TARGET_GREEN_CHANNEL) g = cmap[g];
+          if (target & TARGET_BLUE_CHANNEL) b = cmap[b];
+          if (target & TARGET_ALPHA_CHANNEL) a = cmap[a];
+          expected = rgba(r, g, b, a);
+        }
+        ASSERT_EQ(expected, get_pixel_fast<RgbTraits>(dst.get(), x, y))
+          << "x=" << x << " y=" << y << " target=" << target;
+      }
+    }
+  }
+}
+
+TEST(ColorCurveFilter, GrayscaleChannels)
+{
+  ColorCurve curve = test_curve();
+  std::vector<int> cmap(256);
+  curve.getValues(0, 255, cmap);
+
+  ColorCurveFilter filter;
+  filter.setCurve(curve);
+
+  std::mt19937 rng(2);
+  ImageRef src(Image::create(IMAGE_GRAYSCALE, 23, 4));
+  for (int y=0; y<src->height(); ++y)
+    for (int x=0; x<src->width(); ++x)
+      put_pixel_fast<GrayscaleTraits>(src.get(), x, y, rng() & 0xffff);
+
+  for (Target target : { TARGET_GRAY_CHANNEL,
+                         TARGET_ALPHA_CHANNEL,
+                         TARGET_GRAY_CHANNEL | TARGET_ALPHA_CHANNEL }) {
+    ImageRef dst(Image::create(IMAGE_GRAYSCALE, src->width(), src->height()));
+    dst->clear(0);
+
+    TestFilterManager mgr(src.get(), dst.get(), target);
+    mgr.apply(&filter);
+
+    for (int y=0; y<src->height(); ++y) {
+      for (int x=0; x<src->width(); ++x) {
+        color_t c = get_pixel_fast<GrayscaleTraits>(src.get(), x, y);
+        color_t expected = 0;
+        if (!mgr.skip(x, y)) {
+          int k = graya_getv(c), a = graya_geta(c);
+          if (target & TARGET_GRAY_CHANNEL) k = cmap[k];
+          if (target & TARGET_ALPHA_CHANNEL) a = cmap[a];
+          expected = graya(k, a);
+        }
+        ASSERT_EQ(expected, get_pixel_fast<GrayscaleTraits>(dst.get(), x, y))
+          << "x=" << x << " y=" << y << " target=" << target;
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -10,6 +10,8 @@
 
 #include "filters/convolution_matrix.h"
 
+#include <numeric>
+
 namespace filters {
 
 ConvolutionMatrix::ConvolutionMatrix(int width, int height)
@@ -24,4 +26,46 @@ ConvolutionMatrix::ConvolutionMatrix(int width, int height)
 {
 }
 
+bool ConvolutionMatrix::getSeparableVectors(std::vector<int>& horz,
+                                            std::vector<int>& vert) const
+{
+  // Find a non-zero value to use its row/column as the base vectors
+  int px = -1, py = -1;
+  for (int y=0; y<m_height && py < 0; ++y) {
+    for (int x=0; x<m_width; ++x) {
+      if (value(x, y)) {
+        px = x;
+        py = y;
+        break;
+      }
+    }
+  }
+  if (py < 0)
+    return false;
+
+  // The horizontal vector is the row "py" divided by the GCD of its
+  // values, so the vertical vector can be made of integers too.
+  int gcd = 0;
+  for (int x=0; x<m_width; ++x)
+    gcd = std::gcd(gcd, value(x, py));
+
+  horz.resize(m_width);
+  for (int x=0; x<m_width; ++x)
+    horz[x] = value(x, py) / gcd;
+
+  vert.resize(m_height);
+  for (int y=0; y<m_height; ++y) {
+    if (value(px, y) % horz[px] != 0)
+      return false;
+    vert[y] = value(px, y) / horz[px];
+  }
+
+  for (int y=0; y<m_height; ++y)
+    for (int x=0; x<m_width; ++x)
+      if (vert[y]*horz[x] != value(x, y))
+        return false;
+
+  return true;
+}
+
 } // namespace filters
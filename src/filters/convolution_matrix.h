@@ -54,6 +54,12 @@ namespace filters {
     int& value(int x, int y) { return m_data[y*m_width+x]; }
     const int& value(int x, int y) const { return m_data[y*m_width+x]; }
 
+    // Returns true if the matrix is separable, i.e. value(x, y) ==
+    // vert[y]*horz[x] for all its values. In this case the matrix can
+    // be applied as two 1D convolutions (vertical and horizontal).
+    bool getSeparableVectors(std::vector<int>& horz,
+                             std::vector<int>& vert) const;
+
   private:
     std::string m_name;          // Name
     int m_width, m_height;       // Size of the matrix
@@ -11,100 +11,220 @@
 
 #include "filters/convolution_matrix_filter.h"
 
+#include "base/debug.h"
 #include "filters/convolution_matrix.h"
 #include "filters/filter_indexed_data.h"
 #include "filters/filter_manager.h"
 #include "filters/neighboring_pixels.h"
+#include "filters/tiled_mode.h"
 #include "doc/image_impl.h"
 #include "doc/palette.h"
 #include "doc/rgbmap.h"
 
+#include <algorithm>
+#include <vector>
+
 namespace filters {
 
 using namespace doc;
 
 namespace {
 
-  struct GetPixelsDelegate {
-    int div;
-    const int* matrixData;
+  // Decoders of each pixel format to "planes" of integers that can be
+  // multiplied by the matrix values. Transparent pixels don't
+  // contribute to color channels, they add the matrix value to the
+  // "Transparent" plane (which is subtracted from the divisor).
+
+  struct DecodeRgba {
+    enum { R, G, B, A, Transparent, Planes };
 
-    void reset(const ConvolutionMatrix* matrix) {
-      div = matrix->getDiv();
-      matrixData = &matrix->value(0, 0);
+    void operator()(const RgbTraits::pixel_t color, int* const* planes, const int i) const {
+      if (rgba_geta(color) == 0) {
+        planes[R][i] = planes[G][i] = planes[B][i] = planes[A][i] = 0;
+        planes[Transparent][i] = 1;
+      }
+      else {
+        planes[R][i] = rgba_getr(color);
+        planes[G][i] = rgba_getg(color);
+        planes[B][i] = rgba_getb(color);
+        planes[A][i] = rgba_geta(color);
+        planes[Transparent][i] = 0;
+      }
     }
   };
 
-  struct GetPixelsDelegateRgba : public GetPixelsDelegate {
-    int r, g, b, a;
-
-    void reset(const ConvolutionMatrix* matrix) {
-      GetPixelsDelegate::reset(matrix);
-      r = g = b = a = 0;
-    }
+  struct DecodeGrayscale {
+    enum { V, A, Transparent, Planes };
 
-    void operator()(RgbTraits::pixel_t color) {
-      if (*matrixData) {
-        if (rgba_geta(color) == 0)
-          div -= *matrixData;
-        else {
-          r += rgba_getr(color) * (*matrixData);
-          g += rgba_getg(color) * (*matrixData);
-          b += rgba_getb(color) * (*matrixData);
-          a += rgba_geta(color) * (*matrixData);
-        }
+    void operator()(const GrayscaleTraits::pixel_t color, int* const* planes, const int i) const {
+      if (graya_geta(color) == 0) {
+        planes[V][i] = planes[A][i] = 0;
+        planes[Transparent][i] = 1;
+      }
+      else {
+        planes[V][i] = graya_getv(color);
+        planes[A][i] = graya_geta(color);
+        planes[Transparent][i] = 0;
       }
-      matrixData++;
     }
   };
 
-  struct GetPixelsDelegateGrayscale : public GetPixelsDelegate {
-    int v, a;
+  struct DecodeIndexed {
+    enum { R, G, B, A, Transparent, Index, Planes };
+    const Palette* pal;
 
-    void reset(const ConvolutionMatrix* matrix) {
-      GetPixelsDelegate::reset(matrix);
-      v = a = 0;
-    }
+    DecodeIndexed(const Palette* pal) : pal(pal) { }
 
-    void operator()(GrayscaleTraits::pixel_t color) {
-      if (*matrixData) {
-        if (graya_geta(color) == 0)
-          div -= *matrixData;
-        else {
-          v += graya_getv(color) * (*matrixData);
-          a += graya_geta(color) * (*matrixData);
-        }
+    void operator()(const IndexedTraits::pixel_t color, int* const* planes, const int i) const {
+      const color_t rgba = pal->getEntry(color);
+      planes[Index][i] = color;
+      if (rgba_geta(rgba) == 0) {
+        planes[R][i] = planes[G][i] = planes[B][i] = planes[A][i] = 0;
+        planes[Transparent][i] = 1;
+      }
+      else {
+        planes[R][i] = rgba_getr(rgba);
+        planes[G][i] = rgba_getg(rgba);
+        planes[B][i] = rgba_getb(rgba);
+        planes[A][i] = rgba_geta(rgba);
+        planes[Transparent][i] = 0;
       }
-      matrixData++;
     }
   };
 
-  struct GetPixelsDelegateIndexed : public GetPixelsDelegate {
-    const Palette* pal;
-    int r, g, b, a, index;
+  // Convolves a whole row of pixels plane by plane. Each row of the
+  // source image is decoded only once for each matrix row, and the
+  // inner loops go through contiguous integers (so the compiler can
+  // vectorize them). Separable matrices are applied as a vertical 1D
+  // convolution and then a horizontal one (using a running sum for
+  // box kernels), so their cost is O(w+h) instead of O(w*h) per
+  // pixel.
+  template<typename Traits, typename Decoder>
+  class RowConvolution {
+  public:
+    static constexpr int N = Decoder::Planes;
+
+    RowConvolution(const ConvolutionMatrix* matrix,
+                   const std::vector<int>* horz,
+                   const std::vector<int>* vert,
+                   const TiledMode tiledMode,
+                   const Decoder& decoder)
+      : m_matrix(matrix)
+      , m_horz(horz)
+      , m_vert(vert)
+      , m_tiledMode(tiledMode)
+      , m_decoder(decoder) {
+      ASSERT((horz && vert) || (!horz && !vert));
+    }
 
-    GetPixelsDelegateIndexed(const Palette* pal) : pal(pal) { }
+    // Accumulates the matrix values for the "w" pixels from (x, y).
+    void convolve(const Image* src, const int x, const int y, const int w) {
+      const int mw = m_matrix->getWidth();
+      const int mh = m_matrix->getHeight();
+      const int cx = m_matrix->getCenterX();
+      const int cy = m_matrix->getCenterY();
+      const bool tiledX = (int(m_tiledMode) & int(TiledMode::X_AXIS));
+      const bool tiledY = (int(m_tiledMode) & int(TiledMode::Y_AXIS));
+      const int extW = w + mw - 1;
+
+      m_xs.resize(extW);
+      for (int i=0; i<extW; ++i)
+        m_xs[i] = get_neighboring_coord(x - cx + i, src->width(), tiledX);
+
+      for (int p=0; p<N; ++p) {
+        m_ext[p].resize(extW);
+        m_sums[p].assign(w, 0);
+        m_extPtrs[p] = m_ext[p].data();
+      }
 
-    void reset(const ConvolutionMatrix* matrix) {
-      GetPixelsDelegate::reset(matrix);
-      r = g = b = a = index = 0;
-    }
+      if (m_horz) {
+        // Vertical pass for all the source columns that we need
+        for (int p=0; p<N; ++p)
+          m_cols[p].assign(extW, 0);
+
+        for (int dy=0; dy<mh; ++dy) {
+          const int k = (*m_vert)[dy];
+          if (!k)
+            continue;
+          decodeRow(src, get_neighboring_coord(y - cy + dy, src->height(), tiledY), extW);
+          for (int p=0; p<N; ++p) {
+            int* col = m_cols[p].data();
+            const int* ext = m_ext[p].data();
+            for (int i=0; i<extW; ++i)
+              col[i] += k * ext[i];
+          }
+        }
 
-    void operator()(IndexedTraits::pixel_t color) {
-      if (*matrixData) {
-        index += color * (*matrixData);
-        color_t rgba = pal->getEntry(color);
-        if (rgba_geta(rgba) == 0)
-          div -= *matrixData;
-        else {
-          r += rgba_getr(rgba) * (*matrixData);
-          g += rgba_getg(rgba) * (*matrixData);
-          b += rgba_getb(rgba) * (*matrixData);
-          a += rgba_geta(rgba) * (*matrixData);
+        // Horizontal pass
+        const std::vector<int>& horz = *m_horz;
+        const bool box = std::all_of(horz.begin(), horz.end(),
+                                     [&horz](int k){ return k == horz[0]; });
+        for (int p=0; p<N; ++p) {
+          int* sums = m_sums[p].data();
+          const int* col = m_cols[p].data();
+          if (box) {
+            const int k = horz[0];
+            int sum = 0;
+            for (int dx=0; dx<mw; ++dx)
+              sum += col[dx];
+            sums[0] = k * sum;
+            for (int i=1; i<w; ++i) {
+              sum += col[i+mw-1] - col[i-1];
+              sums[i] = k * sum;
+            }
+          }
+          else {
+            for (int dx=0; dx<mw; ++dx) {
+              const int k = horz[dx];
+              if (!k)
+                continue;
+              for (int i=0; i<w; ++i)
+                sums[i] += k * col[i+dx];
+            }
+          }
+        }
+      }
+      else {
+        for (int dy=0; dy<mh; ++dy) {
+          decodeRow(src, get_neighboring_coord(y - cy + dy, src->height(), tiledY), extW);
+          for (int dx=0; dx<mw; ++dx) {
+            const int k = m_matrix->value(dx, dy);
+            if (!k)
+              continue;
+            for (int p=0; p<N; ++p) {
+              int* sums = m_sums[p].data();
+              const int* ext = m_ext[p].data() + dx;
+              for (int i=0; i<w; ++i)
+                sums[i] += k * ext[i];
+            }
+          }
         }
       }
-      matrixData++;
     }
+
+    // Returns the accumulated value of the given plane for the i-th
+    // pixel of the row.
+    int sum(const int plane, const int i) const {
+      return m_sums[plane][i];
+    }
+
+  private:
+    void decodeRow(const Image* src, const int y, const int extW) {
+      auto srcAddress = (typename Traits::const_address_t)src->getPixelAddress(0, y);
+      for (int i=0; i<extW; ++i)
+        m_decoder(srcAddress[m_xs[i]], m_extPtrs, i);
+    }
+
+    const ConvolutionMatrix* m_matrix;
+    const std::vector<int>* m_horz;
+    const std::vector<int>* m_vert;
+    TiledMode m_tiledMode;
+    Decoder m_decoder;
+    std::vector<int> m_xs;          // Source X coordinate of each decoded pixel
+    std::vector<int> m_ext[N];      // Decoded source row
+    std::vector<int> m_cols[N];     // Result of the vertical pass
+    std::vector<int> m_sums[N];     // Result for each pixel of the row
+    int* m_extPtrs[N];
   };
 
 }
@@ -112,12 +232,15 @@ namespace {
 ConvolutionMatrixFilter::ConvolutionMatrixFilter()
   : m_matrix(NULL)
   , m_tiledMode(TiledMode::NONE)
+  , m_separable(false)
 {
 }
 
 void ConvolutionMatrixFilter::setMatrix(const std::shared_ptr<ConvolutionMatrix>& matrix)
 {
   m_matrix = matrix;
+  m_separable = (m_matrix &&
+                 m_matrix->getSeparableVectors(m_horz, m_vert));
 }
 
 void ConvolutionMatrixFilter::setTiledMode(TiledMode tiledMode)
@@ -136,53 +259,57 @@ void ConvolutionMatrixFilter::applyToRgba(FilterManager* filterMgr)
     return;
 
   const Image* src = filterMgr->getSourceImage();
+  const int x0 = filterMgr->x();
   uint32_t color;
-  GetPixelsDelegateRgba delegate;
+  RowConvolution<RgbTraits, DecodeRgba> conv(
+    m_matrix.get(),
+    m_separable ? &m_horz: nullptr,
+    m_separable ? &m_vert: nullptr,
+    m_tiledMode, DecodeRgba());
+  conv.convolve(src, x0, filterMgr->y(), filterMgr->getWidth());
 
   FILTER_LOOP_THROUGH_ROW_BEGIN(uint32_t) {
-    delegate.reset(m_matrix.get());
-    get_neighboring_pixels<RgbTraits>(src, x, y,
-                                      m_matrix->getWidth(),
-                                      m_matrix->getHeight(),
-                                      m_matrix->getCenterX(),
-                                      m_matrix->getCenterY(),
-                                      m_tiledMode, delegate);
+    int div = m_matrix->getDiv() - conv.sum(DecodeRgba::Transparent, x-x0);
+    int r = conv.sum(DecodeRgba::R, x-x0);
+    int g = conv.sum(DecodeRgba::G, x-x0);
+    int b = conv.sum(DecodeRgba::B, x-x0);
+    int a = conv.sum(DecodeRgba::A, x-x0);
 
     color = get_pixel_fast<RgbTraits>(src, x, y);
-    if (delegate.div == 0) {
+    if (div == 0) {
       *dst_address = color;
       continue;
     }
 
     if (target & TARGET_RED_CHANNEL) {
-      delegate.r = delegate.r / delegate.div + m_matrix->getBias();
-      delegate.r = std::clamp(delegate.r, 0, 255);
+      r = r / div + m_matrix->getBias();
+      r = std::clamp(r, 0, 255);
     }
     else
-      delegate.r = rgba_getr(color);
+      r = rgba_getr(color);
 
     if (target & TARGET_GREEN_CHANNEL) {
-      delegate.g = delegate.g / delegate.div + m_matrix->getBias();
-      delegate.g = std::clamp(delegate.g, 0, 255);
+      g = g / div + m_matrix->getBias();
+      g = std::clamp(g, 0, 255);
     }
     else
-      delegate.g = rgba_getg(color);
+      g = rgba_getg(color);
 
     if (target & TARGET_BLUE_CHANNEL) {
-      delegate.b = delegate.b / delegate.div + m_matrix->getBias();
-      delegate.b = std::clamp(delegate.b, 0, 255);
+      b = b / div + m_matrix->getBias();
+      b = std::clamp(b, 0, 255);
     }
     else
-      delegate.b = rgba_getb(color);
+      b = rgba_getb(color);
 
     if (target & TARGET_ALPHA_CHANNEL) {
-      delegate.a = delegate.a / m_matrix->getDiv() + m_matrix->getBias();
-      delegate.a = std::clamp(delegate.a, 0, 255);
+      a = a / m_matrix->getDiv() + m_matrix->getBias();
+      a = std::clamp(a, 0, 255);
     }
     else
-      delegate.a = rgba_geta(color);
+      a = rgba_geta(color);
 
-    *dst_address = rgba(delegate.r, delegate.g, delegate.b, delegate.a);
+    *dst_address = rgba(r, g, b, a);
   }
   FILTER_LOOP_THROUGH_ROW_END()
 }
@@ -193,39 +320,41 @@ void ConvolutionMatrixFilter::applyToGrayscale(FilterManager* filterMgr)
     return;
 
   const Image* src = filterMgr->getSourceImage();
+  const int x0 = filterMgr->x();
   uint16_t color;
-  GetPixelsDelegateGrayscale delegate;
+  RowConvolution<GrayscaleTraits, DecodeGrayscale> conv(
+    m_matrix.get(),
+    m_separable ? &m_horz: nullptr,
+    m_separable ? &m_vert: nullptr,
+    m_tiledMode, DecodeGrayscale());
+  conv.convolve(src, x0, filterMgr->y(), filterMgr->getWidth());
 
   FILTER_LOOP_THROUGH_ROW_BEGIN(uint16_t) {
-    delegate.reset(m_matrix.get());
-    get_neighboring_pixels<GrayscaleTraits>(src, x, y,
-                                            m_matrix->getWidth(),
-                                            m_matrix->getHeight(),
-                                            m_matrix->getCenterX(),
-                                            m_matrix->getCenterY(),
-                                            m_tiledMode, delegate);
+    int div = m_matrix->getDiv() - conv.sum(DecodeGrayscale::Transparent, x-x0);
+    int v = conv.sum(DecodeGrayscale::V, x-x0);
+    int a = conv.sum(DecodeGrayscale::A, x-x0);
 
     color = get_pixel_fast<GrayscaleTraits>(src, x, y);
-    if (delegate.div == 0) {
+    if (div == 0) {
       *dst_address = color;
       continue;
     }
 
     if (target & TARGET_GRAY_CHANNEL) {
-      delegate.v = delegate.v / delegate.div + m_matrix->getBias();
-      delegate.v = std::clamp(delegate.v, 0, 255);
+      v = v / div + m_matrix->getBias();
+      v = std::clamp(v, 0, 255);
     }
     else
-      delegate.v = graya_getv(color);
+      v = graya_getv(color);
 
     if (target & TARGET_ALPHA_CHANNEL) {
-      delegate.a = delegate.a / m_matrix->getDiv() + m_matrix->getBias();
-      delegate.a = std::clamp(delegate.a, 0, 255);
+      a = a / m_matrix->getDiv() + m_matrix->getBias();
+      a = std::clamp(a, 0, 255);
     }
     else
-      delegate.a = graya_geta(color);
+      a = graya_geta(color);
 
-    *dst_address = graya(delegate.v, delegate.a);
+    *dst_address = graya(v, a);
   }
   FILTER_LOOP_THROUGH_ROW_END()
 }
@@ -238,62 +367,67 @@ void ConvolutionMatrixFilter::applyToIndexed(FilterManager* filterMgr)
   const Image* src = filterMgr->getSourceImage();
   const Palette* pal = filterMgr->getIndexedData()->getPalette();
   const RgbMap* rgbmap = filterMgr->getIndexedData()->getRgbMap();
+  const int x0 = filterMgr->x();
   uint8_t color;
-  GetPixelsDelegateIndexed delegate(pal);
+  RowConvolution<IndexedTraits, DecodeIndexed> conv(
+    m_matrix.get(),
+    m_separable ? &m_horz: nullptr,
+    m_separable ? &m_vert: nullptr,
+    m_tiledMode, DecodeIndexed(pal));
+  conv.convolve(src, x0, filterMgr->y(), filterMgr->getWidth());
 
   FILTER_LOOP_THROUGH_ROW_BEGIN(uint8_t) {
-    delegate.reset(m_matrix.get());
-    get_neighboring_pixels<IndexedTraits>(src, x, y,
-                                          m_matrix->getWidth(),
-                                          m_matrix->getHeight(),
-                                          m_matrix->getCenterX(),
-                                          m_matrix->getCenterY(),
-                                          m_tiledMode, delegate);
+    int div = m_matrix->getDiv() - conv.sum(DecodeIndexed::Transparent, x-x0);
+    int r = conv.sum(DecodeIndexed::R, x-x0);
+    int g = conv.sum(DecodeIndexed::G, x-x0);
+    int b = conv.sum(DecodeIndexed::B, x-x0);
+    int a = conv.sum(DecodeIndexed::A, x-x0);
+    int index = conv.sum(DecodeIndexed::Index, x-x0);
 
     color = get_pixel_fast<IndexedTraits>(src, x, y);
-    if (delegate.div == 0) {
+    if (div == 0) {
       *dst_address = color;
       continue;
     }
 
     if (target & TARGET_INDEX_CHANNEL) {
-      delegate.index = delegate.index / m_matrix->getDiv() + m_matrix->getBias();
-      delegate.index = std::clamp(delegate.index, 0, 255);
+      index = index / m_matrix->getDiv() + m_matrix->getBias();
+      index = std::clamp(index, 0, 255);
 
-      *dst_address = delegate.index;
+      *dst_address = index;
     }
     else {
       color = pal->getEntry(color);
 
       if (target & TARGET_RED_CHANNEL) {
-        delegate.r = delegate.r / delegate.div + m_matrix->getBias();
-        delegate.r = std::clamp(delegate.r, 0, 255);
+        r = r / div + m_matrix->getBias();
+        r = std::clamp(r, 0, 255);
       }
       else
-        delegate.r = rgba_getr(color);
+        r = rgba_getr(color);
 
       if (target & TARGET_GREEN_CHANNEL) {
-        delegate.g =  delegate.g / delegate.div + m_matrix->getBias();
-        delegate.g = std::clamp(delegate.g, 0, 255);
+        g =  g / div + m_matrix->getBias();
+        g = std::clamp(g, 0, 255);
       }
       else
-        delegate.g = rgba_getg(color);
+        g = rgba_getg(color);
 
       if (target & TARGET_BLUE_CHANNEL) {
-        delegate.b = delegate.b / delegate.div + m_matrix->getBias();
-        delegate.b = std::clamp(delegate.b, 0, 255);
+        b = b / div + m_matrix->getBias();
+        b = std::clamp(b, 0, 255);
       }
       else
-        delegate.b = rgba_getb(color);
+        b = rgba_getb(color);
 
       if (target & TARGET_ALPHA_CHANNEL) {
-        delegate.a = delegate.a / delegate.div + m_matrix->getBias();
-        delegate.a = std::clamp(delegate.a, 0, 255);
+        a = a / div + m_matrix->getBias();
+        a = std::clamp(a, 0, 255);
       }
       else
-        delegate.a = rgba_geta(color);
+        a = rgba_geta(color);
 
-      *dst_address = rgbmap->mapColor(delegate.r, delegate.g, delegate.b, delegate.a);
+      *dst_address = rgbmap->mapColor(r, g, b, a);
     }
   }
   FILTER_LOOP_THROUGH_ROW_END()
@@ -13,6 +13,7 @@
 #include "filters/tiled_mode.h"
 
 #include <memory>
+#include <vector>
 
 namespace filters {
 
@@ -33,10 +34,17 @@ namespace filters {
     void applyToRgba(FilterManager* filterMgr);
     void applyToGrayscale(FilterManager* filterMgr);
     void applyToIndexed(FilterManager* filterMgr);
+    bool isParallelizable() const { return true; }
 
   private:
     std::shared_ptr<ConvolutionMatrix> m_matrix;
     TiledMode m_tiledMode;
+
+    // Vectors to apply m_matrix as two 1D convolutions (only when
+    // m_separable is true).
+    bool m_separable;
+    std::vector<int> m_horz;
+    std::vector<int> m_vert;
   };
 
 } // namespace filters
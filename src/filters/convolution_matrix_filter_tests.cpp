@@ -0,0 +1,204 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/image_impl.h"
+#include "doc/image_ref.h"
+#include "filters/convolution_matrix.h"
+#include "filters/convolution_matrix_filter.h"
+#include "filters/filter_manager.h"
+#include "filters/neighboring_pixels.h"
+
+#include <algorithm>
+#include <memory>
+#include <random>
+
+using namespace doc;
+using namespace filters;
+
+namespace {
+
+// Applies a filter to a whole RGBA image row by row.
+class TestFilterManager : public FilterManager {
+public:
+  TestFilterManager(const Image* src, Image* dst)
+    : m_src(src), m_dst(dst), m_row(0) { }
+
+  void apply(Filter* filter) {
+    for (m_row=0; m_row<m_src->height(); ++m_row)
+      filter->applyToRgba(this);
+  }
+
+  doc::PixelFormat pixelFormat() const override { return IMAGE_RGB; }
+  const void* getSourceAddress() override { return m_src->getPixelAddress(0, m_row); }
+  void* getDestinationAddress() override { return m_dst->getPixelAddress(0, m_row); }
+  int getWidth() override { return m_src->width(); }
+  Target getTarget() override { return TARGET_ALL_CHANNELS; }
+  FilterIndexedData* getIndexedData() override { return nullptr; }
+  bool skipPixel() override { return false; }
+  const doc::Image* getSourceImage() override { return m_src; }
+  int x() const override { return 0; }
+  int y() const override { return m_row; }
+  bool isFirstRow() const override { return m_row == 0; }
+  bool isMaskActive() const override { return false; }
+  base::task_token& taskToken() const override { return m_token; }
+
+private:
+  const Image* m_src;
+  Image* m_dst;
+  int m_row;
+  mutable base::task_token m_token;
+};
+
+// Per-pixel convolution (how ConvolutionMatrixFilter worked before
+// the row-based implementation) to compare the results.
+struct Reference {
+  const ConvolutionMatrix* matrix;
+  const int* data;
+  int div, r, g, b, a;
+
+  void operator()(RgbTraits::pixel_t color) {
+    if (*data) {
+      if (rgba_geta(color) == 0)
+        div -= *data;
+      else {
+        r += rgba_getr(color) * (*data);
+        g += rgba_getg(color) * (*data);
+        b += rgba_getb(color) * (*data);
+        a += rgba_geta(color) * (*data);
+      }
+    }
+    ++data;
+  }
+
+  color_t apply(const Image* src, int x, int y, TiledMode tiledMode) {
+    data = &matrix->value(0, 0);
+    div = matrix->getDiv();
+    r = g = b = a = 0;
+    get_neighboring_pixels<RgbTraits>(src, x, y,
+                                      matrix->getWidth(), matrix->getHeight(),
+                                      matrix->getCenterX(), matrix->getCenterY(),
+                                      tiledMode, *this);
+    const color_t color = get_pixel_fast<RgbTraits>(src, x, y);
+    if (div == 0)
+      return color;
+
+    const int bias = matrix->getBias();
+    return rgba(std::clamp(r / div + bias, 0, 255),
+                std::clamp(g / div + bias, 0, 255),
+                std::clamp(b / div + bias, 0, 255),
+                std::clamp(a / matrix->getDiv() + bias, 0, 255));
+  }
+};
+
+std::shared_ptr<ConvolutionMatrix> make_matrix(int w, int h,
+                                               std::initializer_list<int> values,
+                                               int cx = -1, int cy = -1)
+{
+  auto matrix = std::make_shared<ConvolutionMatrix>(w, h);
+  auto it = values.begin();
+  int div = 0;
+  for (int y=0; y<h; ++y)
+    for (int x=0; x<w; ++x, ++it) {
+      matrix->value(x, y) = *it * ConvolutionMatrix::Precision;
+      div += matrix->value(x, y);
+    }
+  if (cx >= 0) matrix->setCenterX(cx);
+  if (cy >= 0) matrix->setCenterY(cy);
+  matrix->setDiv(div > 0 ? div: ConvolutionMatrix::Precision);
+  matrix->setBias(div > 0 ? 0: 128);
+  return matrix;
+}
+
+} // anonymous namespace
+
+TEST(ConvolutionMatrix, SeparableVectors)
+{
+  std::vector<int> horz, vert;
+
+  EXPECT_TRUE(make_matrix(3, 3, { 1, 2, 1,
+                                  2, 4, 2,
+                                  1, 2, 1 })->getSeparableVectors(horz, vert));
+  EXPECT_EQ(std::vector<int>({ 1, 2, 1 }), horz);
+  EXPECT_EQ(std::vector<int>({ 256, 512, 256 }), vert);
+
+  EXPECT_TRUE(make_matrix(3, 2, { 0, 0, 0,
+                                  1, 1, 1 })->getSeparableVectors(horz, vert));
+  EXPECT_EQ(std::vector<int>({ 1, 1, 1 }), horz);
+  EXPECT_EQ(std::vector<int>({ 0, 256 }), vert);
+
+  EXPECT_FALSE(make_matrix(3, 3, {  0, -1,  0,
+                                   -1,  5, -1,
+                                    0, -1,  0 })->getSeparableVectors(horz, vert));
+  EXPECT_FALSE(make_matrix(2, 2, { 0, 0,
+                                   0, 0 })->getSeparableVectors(horz, vert));
+}
+
+TEST(ConvolutionMatrixFilter, MatchesPerPixelConvolution)
+{
+  std::mt19937 rng(1);
+  ImageRef src(Image::create(IMAGE_RGB, 37, 23));
+  for (int y=0; y<src->height(); ++y)
+    for (int x=0; x<src->width(); ++x) {
+      const color_t c = rng();
+      put_pixel_fast<RgbTraits>(src.get(), x, y, (rng() % 5) == 0 ? c & rgba_rgb_mask: c);
+    }
+
+  const std::shared_ptr<ConvolutionMatrix> matrices[] = {
+    // Box blur
+    make_matrix(5, 5, { 1, 1, 1, 1, 1,
+                        1, 1, 1, 1, 1,
+                        1, 1, 1, 1, 1,
+                        1, 1, 1, 1, 1,
+                        1, 1, 1, 1, 1 }),
+    // Gaussian blur
+    make_matrix(3, 3, { 1, 2, 1,
+                        2, 4, 2,
+                        1, 2, 1 }),
+    // Horizontal and vertical blur with a center in the border
+    make_matrix(4, 1, { 1, 2, 3, 1 }, 0, 0),
+    make_matrix(1, 4, { 1, 1, 1, 1 }, 0, 3),
+    // Sharpen (non-separable)
+    make_matrix(3, 3, {  0, -1,  0,
+                        -1,  5, -1,
+                         0, -1,  0 }),
+    // Emboss (non-separable, div=0)
+    make_matrix(3, 3, { -1, -1,  0,
+                        -1,  0,  1,
+                         0,  1,  1 }),
+  };
+
+  for (const auto& matrix : matrices) {
+    for (TiledMode tiledMode : { TiledMode::NONE, TiledMode::X_AXIS,
+                                 TiledMode::Y_AXIS, TiledMode::BOTH }) {
+      ConvolutionMatrixFilter filter;
+      filter.setMatrix(matrix);
+      filter.setTiledMode(tiledMode);
+
+      ImageRef dst(Image::createCopy(src.get()));
+      TestFilterManager mgr(src.get(), dst.get());
+      mgr.apply(&filter);
+
+      Reference ref{ matrix.get() };
+      for (int y=0; y<src->height(); ++y)
+        for (int x=0; x<src->width(); ++x)
+          ASSERT_EQ(ref.apply(src.get(), x, y, tiledMode),
+                    get_pixel_fast<RgbTraits>(dst.get(), x, y))
+            << "x=" << x << " y=" << y << " tiledMode=" << int(tiledMode);
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -44,6 +44,18 @@ namespace filters {
 
     // Applies the filter to the color palette.
     virtual void applyToPalette(FilterManager* filterMgr) { }
+
+    // Returns true if applyToRgba/Grayscale/Indexed() can be called
+    // at the same time from several threads (each one for a different
+    // row). Filters which keep state between pixels/rows (e.g. some
+    // buffer as a member) must return false.
+    virtual bool isParallelizable() const { return false; }
+
+    // Returns true if each pixel is calculated only from the same
+    // pixel of the source (it doesn't use neighbors or the source
+    // image), so the filter can be applied in place and be part of
+    // a FilterChain.
+    virtual bool isPointFilter() const { return false; }
   };
 
   // Filter that support applying it only to palette colors.
@@ -52,6 +64,11 @@ namespace filters {
     FilterWithPalette();
     void applyToPalette(FilterManager* filterMgr) override;
 
+    // Returns true if the last applyToPalette() call decided to
+    // modify RGB pixels using the palette (instead of applying the
+    // filter to each pixel).
+    bool usePaletteOnRGB() const { return m_usePaletteOnRGB; }
+
   protected:
     virtual void onApplyToPalette(FilterManager* filterMgr,
                                   const doc::PalettePicks& picks) = 0;
@@ -0,0 +1,199 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "filters/filter_chain.h"
+
+#include "base/debug.h"
+#include "doc/palette.h"
+#include "doc/palette_picks.h"
+#include "filters/filter_indexed_data.h"
+#include "filters/filter_manager.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace filters {
+
+using namespace doc;
+
+// FilterManager given to each filter of the chain. All filters
+// modify the destination row in place (the first one reads the source
+// row), and use the mask of the row calculated by the chain (the
+// original FilterManager::skipPixel() can be called only once per
+// pixel).
+class FilterChain::ItemManager : public FilterManager
+                               , public FilterIndexedData {
+public:
+  ItemManager(FilterManager* mgr,
+              const std::vector<std::unique_ptr<Palette>>* palettes,
+              const std::vector<uint8_t>* skip)
+    : m_mgr(mgr)
+    , m_palettes(palettes)
+    , m_skip(skip) { }
+
+  void setItem(const int index, const Target target) {
+    m_index = index;
+    m_target = (m_mgr->getTarget() & target);
+    m_x = 0;
+  }
+
+  // FilterManager impl
+  doc::PixelFormat pixelFormat() const override { return m_mgr->pixelFormat(); }
+  const void* getSourceAddress() override {
+    return (m_index == 0 ? m_mgr->getSourceAddress():
+                           m_mgr->getDestinationAddress());
+  }
+  void* getDestinationAddress() override { return m_mgr->getDestinationAddress(); }
+  int getWidth() override { return m_mgr->getWidth(); }
+  Target getTarget() override { return m_target; }
+  FilterIndexedData* getIndexedData() override {
+    m_fid = m_mgr->getIndexedData();
+    return (m_fid ? this: nullptr);
+  }
+  bool skipPixel() override {
+    if (m_skip) {
+      ASSERT(m_x < int(m_skip->size()));
+      return (*m_skip)[m_x++] != 0;
+    }
+    return m_mgr->skipPixel();
+  }
+  const doc::Image* getSourceImage() override { return m_mgr->getSourceImage(); }
+  int x() const override { return m_mgr->x(); }
+  int y() const override { return m_mgr->y(); }
+  bool isFirstRow() const override { return m_mgr->isFirstRow(); }
+  bool isMaskActive() const override { return m_mgr->isMaskActive(); }
+  base::task_token& taskToken() const override { return m_mgr->taskToken(); }
+
+  // FilterIndexedData impl
+  const doc::Palette* getPalette() const override {
+    if (m_index < int(m_palettes->size()))
+      return (*m_palettes)[m_index].get();
+    return m_fid->getPalette();
+  }
+  const doc::RgbMap* getRgbMap() const override { return m_fid->getRgbMap(); }
+  doc::Palette* getNewPalette() override {
+    // Rows (m_skip != nullptr) use the palette after this filter
+    if (m_skip && m_index+1 < int(m_palettes->size()))
+      return (*m_palettes)[m_index+1].get();
+    return m_fid->getNewPalette();
+  }
+  doc::PalettePicks getPalettePicks() override { return m_fid->getPalettePicks(); }
+
+private:
+  FilterManager* m_mgr;
+  FilterIndexedData* m_fid = nullptr;
+  const std::vector<std::unique_ptr<Palette>>* m_palettes;
+  const std::vector<uint8_t>* m_skip;
+  int m_index = 0;
+  Target m_target = 0;
+  int m_x = 0;
+};
+
+FilterChain::FilterChain()
+{
+}
+
+FilterChain::~FilterChain()
+{
+}
+
+void FilterChain::addFilter(std::unique_ptr<Filter>&& filter,
+                            const Target target)
+{
+  ASSERT(filter);
+  ASSERT(filter->isPointFilter());
+
+  if (!m_name.empty())
+    m_name += " + ";
+  m_name += filter->getName();
+
+  m_items.push_back(Item{ std::move(filter), target });
+}
+
+const char* FilterChain::getName()
+{
+  return m_name.c_str();
+}
+
+void FilterChain::applyToRgba(FilterManager* filterMgr)
+{
+  applyToRow(filterMgr, &Filter::applyToRgba);
+}
+
+void FilterChain::applyToGrayscale(FilterManager* filterMgr)
+{
+  applyToRow(filterMgr, &Filter::applyToGrayscale);
+}
+
+void FilterChain::applyToIndexed(FilterManager* filterMgr)
+{
+  applyToRow(filterMgr, &Filter::applyToIndexed);
+}
+
+void FilterChain::applyToPalette(FilterManager* filterMgr)
+{
+  m_palettes.clear();
+
+  FilterIndexedData* fid = filterMgr->getIndexedData();
+  if (!fid)
+    return;
+
+  // The same cases where FilterWithPalette modifies the palette, in
+  // other case we don't need to chain palettes.
+  switch (filterMgr->pixelFormat()) {
+    case IMAGE_RGB:
+      if (fid->getPalettePicks().picks() == 0)
+        return;
+      break;
+    case IMAGE_INDEXED:
+      if (filterMgr->isMaskActive())
+        return;
+      break;
+    default:
+      return;
+  }
+
+  // Each filter modifies the new palette (the sprite palette) using
+  // the colors of the palette modified by the previous filters.
+  ItemManager mgr(filterMgr, &m_palettes, nullptr);
+  m_palettes.push_back(std::make_unique<Palette>(*fid->getPalette()));
+  for (int i=0; i<int(m_items.size()); ++i) {
+    mgr.setItem(i, m_items[i].target);
+    m_items[i].filter->applyToPalette(&mgr);
+    m_palettes.push_back(std::make_unique<Palette>(*fid->getNewPalette()));
+  }
+}
+
+bool FilterChain::isParallelizable() const
+{
+  return std::all_of(m_items.begin(), m_items.end(),
+                     [](const Item& item){
+                       return item.filter->isParallelizable();
+                     });
+}
+
+void FilterChain::applyToRow(FilterManager* filterMgr,
+                             void (Filter::*applyToRow)(FilterManager*))
+{
+  std::vector<uint8_t> skip(filterMgr->getWidth());
+  for (auto& s : skip)
+    s = filterMgr->skipPixel();
+
+  ItemManager mgr(filterMgr, &m_palettes, &skip);
+  for (int i=0; i<int(m_items.size()); ++i) {
+    if (filterMgr->taskToken().canceled())
+      break;
+
+    mgr.setItem(i, m_items[i].target);
+    (m_items[i].filter.get()->*applyToRow)(&mgr);
+  }
+}
+
+} // namespace filters
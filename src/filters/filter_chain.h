@@ -0,0 +1,75 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef FILTERS_FILTER_CHAIN_H_INCLUDED
+#define FILTERS_FILTER_CHAIN_H_INCLUDED
+#pragma once
+
+#include "filters/filter.h"
+#include "filters/target.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace doc {
+  class Palette;
+}
+
+namespace filters {
+
+  // Applies several point filters (see Filter::isPointFilter()) as
+  // one filter: each row is modified by all the filters in order
+  // (each one reads the pixels modified by the previous one), so
+  // there is only one pass over each cel and no intermediate images.
+  class FilterChain : public Filter {
+  public:
+    FilterChain();
+    ~FilterChain();
+
+    // Adds a filter at the end of the chain. The "target" is
+    // intersected with the FilterManager target to know the channels
+    // that this filter can modify.
+    void addFilter(std::unique_ptr<Filter>&& filter,
+                   const Target target = TARGET_ALL_CHANNELS |
+                                         TARGET_INDEX_CHANNEL);
+
+    bool empty() const { return m_items.empty(); }
+    int size() const { return int(m_items.size()); }
+    Filter* filter(const int i) const { return m_items[i].filter.get(); }
+
+    // Filter implementation
+    const char* getName() override;
+    void applyToRgba(FilterManager* filterMgr) override;
+    void applyToGrayscale(FilterManager* filterMgr) override;
+    void applyToIndexed(FilterManager* filterMgr) override;
+    void applyToPalette(FilterManager* filterMgr) override;
+    bool isParallelizable() const override;
+    bool isPointFilter() const override { return true; }
+
+  private:
+    class ItemManager;
+
+    struct Item {
+      std::unique_ptr<Filter> filter;
+      Target target;
+    };
+
+    void applyToRow(FilterManager* filterMgr,
+                    void (Filter::*applyToRow)(FilterManager*));
+
+    std::vector<Item> m_items;
+    std::string m_name;
+
+    // Palette before each filter of the chain and after the last one
+    // (only if applyToPalette() modified the palette), so each filter
+    // uses the palette modified by the previous one.
+    std::vector<std::unique_ptr<doc::Palette>> m_palettes;
+  };
+
+} // namespace filters
+
+#endif
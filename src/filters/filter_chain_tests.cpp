@@ -0,0 +1,123 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/image_impl.h"
+#include "doc/image_ref.h"
+#include "filters/filter_chain.h"
+#include "filters/filter_manager.h"
+#include "filters/invert_color_filter.h"
+#include "filters/replace_color_filter.h"
+
+#include <memory>
+#include <random>
+
+using namespace doc;
+using namespace filters;
+
+namespace {
+
+// Applies a filter to a whole RGBA image row by row, skipping one of
+// each three pixels (like a selection).
+class TestFilterManager : public FilterManager {
+public:
+  TestFilterManager(const Image* src, Image* dst, Target target)
+    : m_src(src), m_dst(dst), m_target(target), m_row(0) { }
+
+  void apply(Filter* filter) {
+    for (m_row=0; m_row<m_src->height(); ++m_row) {
+      m_x = 0;
+      filter->applyToRgba(this);
+    }
+  }
+
+  int skipPixelCalls() const { return m_skipPixelCalls; }
+
+  doc::PixelFormat pixelFormat() const override { return IMAGE_RGB; }
+  const void* getSourceAddress() override { return m_src->getPixelAddress(0, m_row); }
+  void* getDestinationAddress() override { return m_dst->getPixelAddress(0, m_row); }
+  int getWidth() override { return m_src->width(); }
+  Target getTarget() override { return m_target; }
+  FilterIndexedData* getIndexedData() override { return nullptr; }
+  bool skipPixel() override {
+    ++m_skipPixelCalls;
+    return ((m_x++ + m_row) % 3) == 0;
+  }
+  const doc::Image* getSourceImage() override { return m_src; }
+  int x() const override { return 0; }
+  int y() const override { return m_row; }
+  bool isFirstRow() const override { return m_row == 0; }
+  bool isMaskActive() const override { return true; }
+  base::task_token& taskToken() const override { return m_token; }
+
+private:
+  const Image* m_src;
+  Image* m_dst;
+  Target m_target;
+  int m_row;
+  int m_x = 0;
+  int m_skipPixelCalls = 0;
+  mutable base::task_token m_token;
+};
+
+} // anonymous namespace
+
+TEST(FilterChain, SameResultAsEachFilter)
+{
+  std::mt19937 rng(1);
+  ImageRef src(Image::create(IMAGE_RGB, 19, 7));
+  for (int y=0; y<src->height(); ++y)
+    for (int x=0; x<src->width(); ++x)
+      put_pixel_fast<RgbTraits>(src.get(), x, y,
+                                (rng() % 4) == 0 ? rgba(10, 20, 30, 255): rng());
+
+  auto invert = std::make_unique<InvertColorFilter>();
+  auto replace = std::make_unique<ReplaceColorFilter>();
+  replace->setFrom(rgba(245, 20, 30, 255));  // Inverted red of (10, 20, 30)
+  replace->setTo(rgba(0, 255, 0, 255));
+  replace->setTolerance(0);
+
+  // Expected result applying each filter
+  ImageRef tmp(Image::createCopy(src.get()));
+  ImageRef expected(Image::createCopy(src.get()));
+  {
+    TestFilterManager mgr1(src.get(), tmp.get(), TARGET_RED_CHANNEL);
+    mgr1.apply(invert.get());
+    expected.reset(Image::createCopy(tmp.get()));
+    TestFilterManager mgr2(tmp.get(), expected.get(), TARGET_ALL_CHANNELS);
+    mgr2.apply(replace.get());
+  }
+
+  FilterChain chain;
+  chain.addFilter(std::move(invert), TARGET_RED_CHANNEL);
+  chain.addFilter(std::move(replace));
+  EXPECT_EQ(2, chain.size());
+  EXPECT_TRUE(chain.isPointFilter());
+
+  ImageRef dst(Image::createCopy(src.get()));
+  TestFilterManager mgr(src.get(), dst.get(), TARGET_ALL_CHANNELS);
+  mgr.apply(&chain);
+
+  // The mask is read only once
+  EXPECT_EQ(src->width() * src->height(), mgr.skipPixelCalls());
+
+  for (int y=0; y<src->height(); ++y)
+    for (int x=0; x<src->width(); ++x)
+      ASSERT_EQ(get_pixel_fast<RgbTraits>(expected.get(), x, y),
+                get_pixel_fast<RgbTraits>(dst.get(), x, y))
+        << "x=" << x << " y=" << y;
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,275 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/image_impl.h"
+#include "doc/image_ref.h"
+#include "doc/palette.h"
+#include "doc/palette_picks.h"
+#include "doc/rgbmap_rgb5a3.h"
+#include "filters/brightness_contrast_filter.h"
+#include "filters/color_curve.h"
+#include "filters/color_curve_filter.h"
+#include "filters/convolution_matrix.h"
+#include "filters/convolution_matrix_filter.h"
+#include "filters/filter_indexed_data.h"
+#include "filters/filter_manager.h"
+#include "filters/hue_saturation_filter.h"
+#include "filters/invert_color_filter.h"
+#include "filters/median_filter.h"
+#include "filters/outline_filter.h"
+#include "filters/replace_color_filter.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <memory>
+#include <random>
+
+using namespace doc;
+using namespace filters;
+
+namespace {
+
+// Applies a filter to a whole image row by row (like the
+// FilterManagerImpl of the app, but without a sprite, undo, or
+// threads). The "mask" is active so filters with palette (e.g. hue
+// saturation) modify the pixels of indexed images.
+class BenchmarkFilterManager : public FilterManager
+                             , public FilterIndexedData {
+public:
+  BenchmarkFilterManager(const Image* src, Image* dst,
+                         const Palette* palette,
+                         const RgbMap* rgbmap)
+    : m_src(src), m_dst(dst), m_row(0)
+    , m_palette(palette)
+    , m_newPalette(*palette)
+    , m_rgbmap(rgbmap) { }
+
+  void apply(Filter* filter) {
+    for (m_row=0; m_row<m_src->height(); ++m_row) {
+      switch (m_src->pixelFormat()) {
+        case IMAGE_RGB:       filter->applyToRgba(this); break;
+        case IMAGE_GRAYSCALE: filter->applyToGrayscale(this); break;
+        case IMAGE_INDEXED:   filter->applyToIndexed(this); break;
+      }
+    }
+  }
+
+  // FilterManager impl
+  doc::PixelFormat pixelFormat() const override { return m_src->pixelFormat(); }
+  const void* getSourceAddress() override { return m_src->getPixelAddress(0, m_row); }
+  void* getDestinationAddress() override { return m_dst->getPixelAddress(0, m_row); }
+  int getWidth() override { return m_src->width(); }
+  Target getTarget() override { return TARGET_ALL_CHANNELS; }
+  FilterIndexedData* getIndexedData() override { return this; }
+  bool skipPixel() override { return false; }
+  const doc::Image* getSourceImage() override { return m_src; }
+  int x() const override { return 0; }
+  int y() const override { return m_row; }
+  bool isFirstRow() const override { return m_row == 0; }
+  bool isMaskActive() const override { return true; }
+  base::task_token& taskToken() const override { return m_token; }
+
+  // FilterIndexedData impl
+  const Palette* getPalette() const override { return m_palette; }
+  const RgbMap* getRgbMap() const override { return m_rgbmap; }
+  Palette* getNewPalette() override { return &m_newPalette; }
+  PalettePicks getPalettePicks() override {
+    PalettePicks picks(m_palette->size());
+    picks.all();
+    return picks;
+  }
+
+private:
+  const Image* m_src;
+  Image* m_dst;
+  int m_row;
+  const Palette* m_palette;
+  Palette m_newPalette;
+  const RgbMap* m_rgbmap;
+  mutable base::task_token m_token;
+};
+
+enum class FilterType {
+  Blur3x3,
+  Blur5x5,
+  Blur9x9,
+  Blur17x17,
+  Median3x3,
+  Median5x5,
+  Median9x9,
+  HueSaturation,
+  BrightnessContrast,
+  ColorCurve,
+  InvertColor,
+  ReplaceColor,
+  Outline,
+};
+
+// Same "blur-NxN" matrices of the stock (data/convmatr.def)
+std::shared_ptr<ConvolutionMatrix> make_blur_matrix(const int n)
+{
+  auto matrix = std::make_shared<ConvolutionMatrix>(n, n);
+  const int c = n/2;
+  int div = 0;
+  for (int y=0; y<n; ++y)
+    for (int x=0; x<n; ++x)
+      div += (matrix->value(x, y) = 1 + (c - std::abs(x-c)) + (c - std::abs(y-c)));
+  matrix->setCenterX(c);
+  matrix->setCenterY(c);
+  matrix->setDiv(div);
+  matrix->setBias(0);
+  matrix->setDefaultTarget(TARGET_ALL_CHANNELS);
+  return matrix;
+}
+
+std::unique_ptr<Filter> make_filter(const FilterType type)
+{
+  switch (type) {
+    case FilterType::Blur3x3:
+    case FilterType::Blur5x5:
+    case FilterType::Blur9x9:
+    case FilterType::Blur17x17: {
+      const int n = (type == FilterType::Blur3x3 ? 3:
+                     type == FilterType::Blur5x5 ? 5:
+                     type == FilterType::Blur9x9 ? 9: 17);
+      auto filter = std::make_unique<ConvolutionMatrixFilter>();
+      filter->setMatrix(make_blur_matrix(n));
+      return filter;
+    }
+    case FilterType::Median3x3:
+    case FilterType::Median5x5:
+    case FilterType::Median9x9: {
+      const int n = (type == FilterType::Median3x3 ? 3:
+                     type == FilterType::Median5x5 ? 5: 9);
+      auto filter = std::make_unique<MedianFilter>();
+      filter->setSize(n, n);
+      return filter;
+    }
+    case FilterType::HueSaturation: {
+      auto filter = std::make_unique<HueSaturationFilter>();
+      filter->setMode(HueSaturationFilter::Mode::HSL_MUL);
+      filter->setHue(90.0);
+      filter->setSaturation(0.5);
+      filter->setLightness(-0.2);
+      return filter;
+    }
+    case FilterType::BrightnessContrast: {
+      auto filter = std::make_unique<BrightnessContrastFilter>();
+      filter->setBrightness(0.2);
+      filter->setContrast(0.3);
+      return filter;
+    }
+    case FilterType::ColorCurve: {
+      ColorCurve curve;
+      curve.addDefaultPoints();
+      curve.addPoint(gfx::Point(64, 96));
+      curve.addPoint(gfx::Point(192, 160));
+      auto filter = std::make_unique<ColorCurveFilter>();
+      filter->setCurve(curve);
+      return filter;
+    }
+    case FilterType::InvertColor:
+      return std::make_unique<InvertColorFilter>();
+    case FilterType::ReplaceColor: {
+      auto filter = std::make_unique<ReplaceColorFilter>();
+      filter->setFrom(rgba(255, 0, 0, 255));
+      filter->setTo(rgba(0, 0, 255, 255));
+      filter->setTolerance(64);
+      return filter;
+    }
+    case FilterType::Outline: {
+      auto filter = std::make_unique<OutlineFilter>();
+      filter->place(OutlineFilter::Place::Outside);
+      filter->matrix(OutlineFilter::Matrix::Circle);
+      filter->color(rgba(0, 0, 0, 255));
+      filter->bgColor(0);
+      return filter;
+    }
+  }
+  return nullptr;
+}
+
+// Image with blobs of random colors and transparent areas (so the
+// outline filter has edges to find).
+ImageRef random_image(const PixelFormat pixelFormat, const int w, const int h)
+{
+  std::mt19937 rng(w*h);
+  ImageRef image(Image::create(pixelFormat, w, h));
+  for (int y=0; y<h; ++y) {
+    for (int x=0; x<w; ++x) {
+      const bool opaque = (((x/16) + (y/16)) % 3) != 0;
+      color_t c;
+      switch (pixelFormat) {
+        case IMAGE_RGB:
+          c = (opaque ? rgba(rng() & 255, rng() & 255, rng() & 255, 255): 0);
+          put_pixel_fast<RgbTraits>(image.get(), x, y, c);
+          break;
+        case IMAGE_GRAYSCALE:
+          c = (opaque ? graya(rng() & 255, 255): 0);
+          put_pixel_fast<GrayscaleTraits>(image.get(), x, y, c);
+          break;
+        case IMAGE_INDEXED:
+          c = (opaque ? 1 + (rng() % 255): 0);
+          put_pixel_fast<IndexedTraits>(image.get(), x, y, c);
+          break;
+      }
+    }
+  }
+  return image;
+}
+
+void BM_Filter(benchmark::State& state, const FilterType type)
+{
+  const auto pixelFormat = PixelFormat(state.range(0));
+  const int size = state.range(1);
+
+  ImageRef src = random_image(pixelFormat, size, size);
+  ImageRef dst(Image::createCopy(src.get()));
+
+  std::unique_ptr<Palette> palette(Palette::createGrayscale());
+  RgbMapRGB5A3 rgbmap;
+  rgbmap.regenerateMap(palette.get(), 0);
+
+  std::unique_ptr<Filter> filter = make_filter(type);
+  BenchmarkFilterManager mgr(src.get(), dst.get(), palette.get(), &rgbmap);
+
+  for (auto _ : state) {
+    mgr.apply(filter.get());
+    benchmark::DoNotOptimize(dst->getPixelAddress(0, 0));
+  }
+
+  // Reported as items (pixels) per second
+  state.SetItemsProcessed(state.iterations() * size * size);
+}
+
+} // anonymous namespace
+
+#define FILTER_BENCHMARK(name)                                  \
+  BENCHMARK_CAPTURE(BM_Filter, name, FilterType::name)          \
+    ->ArgsProduct({ { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED }, \
+                    { 256, 1024 } })                            \
+    ->Unit(benchmark::kMicrosecond)
+
+FILTER_BENCHMARK(Blur3x3);
+FILTER_BENCHMARK(Blur5x5);
+FILTER_BENCHMARK(Blur9x9);
+FILTER_BENCHMARK(Blur17x17);
+FILTER_BENCHMARK(Median3x3);
+FILTER_BENCHMARK(Median5x5);
+FILTER_BENCHMARK(Median9x9);
+FILTER_BENCHMARK(HueSaturation);
+FILTER_BENCHMARK(BrightnessContrast);
+FILTER_BENCHMARK(ColorCurve);
+FILTER_BENCHMARK(InvertColor);
+FILTER_BENCHMARK(ReplaceColor);
+FILTER_BENCHMARK(Outline);
+
+BENCHMARK_MAIN();
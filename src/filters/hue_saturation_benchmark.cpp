@@ -0,0 +1,87 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/color.h"
+#include "filters/hue_saturation_filter.h"
+#include "gfx/hsl.h"
+#include "gfx/rgb.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace doc;
+using namespace filters;
+
+static std::vector<color_t> random_row(const int n)
+{
+  std::mt19937 rng(1);
+  std::vector<color_t> row(n);
+  for (color_t& c : row)
+    c = rng();
+  return row;
+}
+
+// Per-pixel gfx::Hsl conversion (the old implementation) to compare
+// with the vectorized kernel.
+void BM_HueSaturationGfxHsl(benchmark::State& state) {
+  const int n = state.range(0);
+  const std::vector<color_t> src = random_row(n);
+  std::vector<color_t> dst(n);
+
+  for (auto _ : state) {
+    for (int i=0; i<n; ++i) {
+      const color_t c = src[i];
+      gfx::Hsl hsl(gfx::Rgb(rgba_getr(c), rgba_getg(c), rgba_getb(c)));
+      hsl.hue(std::fmod(hsl.hue() + 90.0, 360.0));
+      hsl.saturation(std::clamp(hsl.saturation()*1.5, 0.0, 1.0));
+      hsl.lightness(std::clamp(hsl.lightness()*0.8, 0.0, 1.0));
+      gfx::Rgb rgb(hsl);
+      dst[i] = rgba(rgb.red(), rgb.green(), rgb.blue(), rgba_geta(c));
+    }
+    benchmark::DoNotOptimize(dst.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+void BM_HueSaturationSpan(benchmark::State& state) {
+  const auto mode = HueSaturationFilter::Mode(state.range(0));
+  const int n = state.range(1);
+  const std::vector<color_t> src = random_row(n);
+  std::vector<color_t> dst(n);
+
+  HueSaturationFilter filter;
+  filter.setMode(mode);
+  filter.setHue(90.0);
+  filter.setSaturation(0.5);
+  filter.setLightness(-0.2);
+
+  for (auto _ : state) {
+    filter.applyToRgbaSpan(TARGET_ALL_CHANNELS, src.data(), dst.data(), n);
+    benchmark::DoNotOptimize(dst.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+BENCHMARK(BM_HueSaturationGfxHsl)
+  ->Arg(1024)
+  ->Arg(64*1024);
+
+BENCHMARK(BM_HueSaturationSpan)
+  ->Args({ int(HueSaturationFilter::Mode::HSL_MUL), 1024 })
+  ->Args({ int(HueSaturationFilter::Mode::HSL_MUL), 64*1024 })
+  ->Args({ int(HueSaturationFilter::Mode::HSV_MUL), 64*1024 })
+  ->Args({ int(HueSaturationFilter::Mode::HSL_ADD), 64*1024 })
+  ->Args({ int(HueSaturationFilter::Mode::HSV_ADD), 64*1024 });
+
+BENCHMARK_MAIN();
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2017-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -15,18 +15,171 @@
 #include "doc/palette.h"
 #include "doc/palette_picks.h"
 #include "doc/rgbmap.h"
+#include "doc/simd.h"
 #include "filters/filter_indexed_data.h"
 #include "filters/filter_manager.h"
 #include "gfx/hsl.h"
-#include "gfx/hsv.h"
 #include "gfx/rgb.h"
 
+#include <algorithm>
 #include <cmath>
+#include <vector>
 
 namespace filters {
 
 using namespace doc;
 
+namespace {
+
+// Four floats (one channel of four pixels) with the few operations
+// that the HSL/HSV conversion needs.
+#if DOC_SIMD_SSE2
+
+struct F4 {
+  __m128 v;
+  F4(__m128 v) : v(v) { }
+  F4(float f) : v(_mm_set1_ps(f)) { }
+};
+using M4 = __m128;
+
+inline F4 operator+(F4 a, F4 b) { return _mm_add_ps(a.v, b.v); }
+inline F4 operator-(F4 a, F4 b) { return _mm_sub_ps(a.v, b.v); }
+inline F4 operator*(F4 a, F4 b) { return _mm_mul_ps(a.v, b.v); }
+inline F4 operator/(F4 a, F4 b) { return _mm_div_ps(a.v, b.v); }
+inline M4 operator==(F4 a, F4 b) { return _mm_cmpeq_ps(a.v, b.v); }
+inline M4 operator<(F4 a, F4 b) { return _mm_cmplt_ps(a.v, b.v); }
+inline F4 min(F4 a, F4 b) { return _mm_min_ps(a.v, b.v); }
+inline F4 max(F4 a, F4 b) { return _mm_max_ps(a.v, b.v); }
+inline F4 select(M4 m, F4 a, F4 b) {
+  return _mm_or_ps(_mm_and_ps(m, a.v), _mm_andnot_ps(m, b.v));
+}
+inline F4 floor(F4 a) {
+  const __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+  return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a.v), _mm_set1_ps(1.0f)));
+}
+
+inline void load_rgba(const color_t* p, F4& r, F4& g, F4& b, F4& a) {
+  const __m128i c = _mm_loadu_si128((const __m128i*)p);
+  const __m128i ff = _mm_set1_epi32(0xff);
+  r = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(c, rgba_r_shift), ff));
+  g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(c, rgba_g_shift), ff));
+  b = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(c, rgba_b_shift), ff));
+  a = _mm_cvtepi32_ps(_mm_srli_epi32(c, rgba_a_shift));
+}
+
+// The given values must be in [0,256), they are truncated.
+inline void store_rgba(color_t* p, F4 r, F4 g, F4 b, F4 a) {
+  const __m128i c =
+    _mm_or_si128(
+      _mm_or_si128(_mm_slli_epi32(_mm_cvttps_epi32(r.v), rgba_r_shift),
+                   _mm_slli_epi32(_mm_cvttps_epi32(g.v), rgba_g_shift)),
+      _mm_or_si128(_mm_slli_epi32(_mm_cvttps_epi32(b.v), rgba_b_shift),
+                   _mm_slli_epi32(_mm_cvttps_epi32(a.v), rgba_a_shift)));
+  _mm_storeu_si128((__m128i*)p, c);
+}
+
+#elif DOC_SIMD_NEON
+
+struct F4 {
+  float32x4_t v;
+  F4(float32x4_t v) : v(v) { }
+  F4(float f) : v(vdupq_n_f32(f)) { }
+};
+using M4 = uint32x4_t;
+
+inline F4 operator+(F4 a, F4 b) { return vaddq_f32(a.v, b.v); }
+inline F4 operator-(F4 a, F4 b) { return vsubq_f32(a.v, b.v); }
+inline F4 operator*(F4 a, F4 b) { return vmulq_f32(a.v, b.v); }
+inline F4 operator/(F4 a, F4 b) { return vdivq_f32(a.v, b.v); }
+inline M4 operator==(F4 a, F4 b) { return vceqq_f32(a.v, b.v); }
+inline M4 operator<(F4 a, F4 b) { return vcltq_f32(a.v, b.v); }
+inline F4 min(F4 a, F4 b) { return vminq_f32(a.v, b.v); }
+inline F4 max(F4 a, F4 b) { return vmaxq_f32(a.v, b.v); }
+inline F4 select(M4 m, F4 a, F4 b) { return vbslq_f32(m, a.v, b.v); }
+inline F4 floor(F4 a) { return vrndmq_f32(a.v); }
+
+inline void load_rgba(const color_t* p, F4& r, F4& g, F4& b, F4& a) {
+  const uint32x4_t c = vld1q_u32(p);
+  const uint32x4_t ff = vdupq_n_u32(0xff);
+  r = vcvtq_f32_u32(vandq_u32(c, ff));
+  g = vcvtq_f32_u32(vandq_u32(vshrq_n_u32(c, 8*1), ff));
+  b = vcvtq_f32_u32(vandq_u32(vshrq_n_u32(c, 8*2), ff));
+  a = vcvtq_f32_u32(vshrq_n_u32(c, 8*3));
+}
+
+// The given values must be in [0,256), they are truncated.
+inline void store_rgba(color_t* p, F4 r, F4 g, F4 b, F4 a) {
+  const uint32x4_t c =
+    vorrq_u32(vorrq_u32(vcvtq_u32_f32(r.v),
+                        vshlq_n_u32(vcvtq_u32_f32(g.v), 8*1)),
+              vorrq_u32(vshlq_n_u32(vcvtq_u32_f32(b.v), 8*2),
+                        vshlq_n_u32(vcvtq_u32_f32(a.v), 8*3)));
+  vst1q_u32(p, c);
+}
+
+#else
+
+struct F4 {
+  float v[4];
+  F4() { }
+  F4(float f) { std::fill(v, v+4, f); }
+};
+struct M4 {
+  bool v[4];
+};
+
+#define FILTERS_HUE_SATURATION_OP(Result, name, expr)     \
+  inline Result name(F4 a, F4 b) {                        \
+    Result r;                                             \
+    for (int i=0; i<4; ++i)                               \
+      r.v[i] = (expr);                                    \
+    return r;                                             \
+  }
+
+FILTERS_HUE_SATURATION_OP(F4, operator+, a.v[i] + b.v[i])
+FILTERS_HUE_SATURATION_OP(F4, operator-, a.v[i] - b.v[i])
+FILTERS_HUE_SATURATION_OP(F4, operator*, a.v[i] * b.v[i])
+FILTERS_HUE_SATURATION_OP(F4, operator/, a.v[i] / b.v[i])
+FILTERS_HUE_SATURATION_OP(M4, operator==, a.v[i] == b.v[i])
+FILTERS_HUE_SATURATION_OP(M4, operator<, a.v[i] < b.v[i])
+FILTERS_HUE_SATURATION_OP(F4, min, std::min(a.v[i], b.v[i]))
+FILTERS_HUE_SATURATION_OP(F4, max, std::max(a.v[i], b.v[i]))
+
+#undef FILTERS_HUE_SATURATION_OP
+
+inline F4 select(M4 m, F4 a, F4 b) {
+  F4 r;
+  for (int i=0; i<4; ++i)
+    r.v[i] = (m.v[i] ? a.v[i]: b.v[i]);
+  return r;
+}
+
+inline F4 floor(F4 a) {
+  F4 r;
+  for (int i=0; i<4; ++i)
+    r.v[i] = std::floor(a.v[i]);
+  return r;
+}
+
+inline void load_rgba(const color_t* p, F4& r, F4& g, F4& b, F4& a) {
+  for (int i=0; i<4; ++i) {
+    r.v[i] = rgba_getr(p[i]);
+    g.v[i] = rgba_getg(p[i]);
+    b.v[i] = rgba_getb(p[i]);
+    a.v[i] = rgba_geta(p[i]);
+  }
+}
+
+// The given values must be in [0,256), they are truncated.
+inline void store_rgba(color_t* p, F4 r, F4 g, F4 b, F4 a) {
+  for (int i=0; i<4; ++i)
+    p[i] = rgba(int(r.v[i]), int(g.v[i]), int(b.v[i]), int(a.v[i]));
+}
+
+#endif
+
+} // anonymous namespace
+
 const char* HueSaturationFilter::getName()
 {
   return "Hue Saturation Color";
@@ -72,10 +225,9 @@ void HueSaturationFilter::applyToRgba(FilterManager* filterMgr)
   const Palette* pal = fid->getPalette();
   Palette* newPal = (m_usePaletteOnRGB ? fid->getNewPalette(): nullptr);
 
-  FILTER_LOOP_THROUGH_ROW_BEGIN(uint32_t) {
-    color_t c = *src_address;
-
-    if (newPal) {
+  if (newPal) {
+    FILTER_LOOP_THROUGH_ROW_BEGIN(uint32_t) {
+      color_t c = *src_address;
       int i =
         pal->findExactMatch(rgba_getr(c),
                             rgba_getg(c),
@@ -83,12 +235,22 @@ void HueSaturationFilter::applyToRgba(FilterManager* filterMgr)
                             rgba_geta(c), -1);
       if (i >= 0)
         c = newPal->getEntry(i);
+      *dst_address = c;
     }
-    else {
-      applyFilterToRgb(target, c);
-    }
+    FILTER_LOOP_THROUGH_ROW_END()
+    return;
+  }
+
+  // Convert the whole row with the vectorized kernel, then copy only
+  // the pixels that are not skipped.
+  std::vector<color_t> row(filterMgr->getWidth());
+  applyToRgbaSpan(filterMgr->getTarget(),
+                  (const color_t*)filterMgr->getSourceAddress(),
+                  row.data(), int(row.size()));
 
-    *dst_address = c;
+  const int x0 = filterMgr->x();
+  FILTER_LOOP_THROUGH_ROW_BEGIN(uint32_t) {
+    *dst_address = row[x-x0];
   }
   FILTER_LOOP_THROUGH_ROW_END()
 }
@@ -165,72 +327,108 @@ void HueSaturationFilter::onApplyToPalette(FilterManager* filterMgr,
   }
 }
 
-template<class T,
-         double (T::*get_lightness)() const,
-         void (T::*set_lightness)(double)>
-void HueSaturationFilter::applyFilterToRgbT(const Target target,
-                                            doc::color_t& c,
-                                            bool multiply)
+void HueSaturationFilter::applyToRgbaSpan(const Target target,
+                                          const color_t* src,
+                                          color_t* dst,
+                                          const int n) const
 {
-  int r = rgba_getr(c);
-  int g = rgba_getg(c);
-  int b = rgba_getb(c);
-  int a = rgba_geta(c);
-
-  T hsl(gfx::Rgb(r, g, b));
-
-  double h = hsl.hue() + m_h;
-  while (h < 0.0) h += 360.0;
-  h = std::fmod(h, 360.0);
-
-  double s = (multiply ? hsl.saturation()*(1.0+m_s):
-                         hsl.saturation() + m_s);
-  s = std::clamp(s, 0.0, 1.0);
-
-  double l = (multiply ? (hsl.*get_lightness)()*(1.0+m_l):
-                         (hsl.*get_lightness)() + m_l);
-  l = std::clamp(l, 0.0, 1.0);
-
-  hsl.hue(h);
-  hsl.saturation(s);
-  (hsl.*set_lightness)(l);
-  gfx::Rgb rgb(hsl);
-
-  if (target & TARGET_RED_CHANNEL  ) r = rgb.red();
-  if (target & TARGET_GREEN_CHANNEL) g = rgb.green();
-  if (target & TARGET_BLUE_CHANNEL ) b = rgb.blue();
-  if (a && (target & TARGET_ALPHA_CHANNEL)) {
-    a = a*(1.0+m_a);
-    a = std::clamp(a, 0, 255);
+  switch (m_mode) {
+    case Mode::HSV_MUL: applyToRgbaSpanT<false, true>(target, src, dst, n); break;
+    case Mode::HSL_MUL: applyToRgbaSpanT<true, true>(target, src, dst, n); break;
+    case Mode::HSV_ADD: applyToRgbaSpanT<false, false>(target, src, dst, n); break;
+    case Mode::HSL_ADD: applyToRgbaSpanT<true, false>(target, src, dst, n); break;
   }
+}
+
+// Converts 4 pixels per iteration RGB -> HSL/HSV -> RGB. The hue is
+// kept in sectors of 60 degrees ([0,6) range), and the conversion to
+// RGB uses the branchless formulas f(n) = V - V*S*max(0, min(k, 4-k, 1))
+// for HSV (k = (n + H/60) mod 6) and f(n) = L - A*max(-1, min(k-3, 9-k, 1))
+// for HSL (k = (n + H/30) mod 12, A = S*min(L, 1-L)).
+template<bool hsl, bool multiply>
+void HueSaturationFilter::applyToRgbaSpanT(const Target target,
+                                           const color_t* src,
+                                           color_t* dst,
+                                           const int n) const
+{
+  const F4 zero(0.0f), one(1.0f), six(6.0f), twelve(12.0f);
+  const F4 k255(255.0f), kInv255(1.0f / 255.0f), half(0.5f);
+  const F4 dh(float(m_h / 60.0));
+  const F4 ds(float(multiply ? 1.0+m_s: m_s));
+  const F4 dl(float(multiply ? 1.0+m_l: m_l));
+  const F4 da(float(1.0+m_a));
+
+  color_t tail[4];
+  for (int i=0; i<n; i+=4) {
+    const color_t* s = src+i;
+    color_t* d = dst+i;
+    const int m = std::min(n-i, 4);
+    if (m < 4) {
+      std::fill(std::copy(s, s+m, tail), tail+4, 0);
+      s = d = tail;
+    }
 
-  c = rgba(r, g, b, a);
+    F4 r(0.0f), g(0.0f), b(0.0f), a(0.0f);
+    load_rgba(s, r, g, b, a);
+
+    const F4 rf = r*kInv255, gf = g*kInv255, bf = b*kInv255;
+    const F4 hi = max(rf, max(gf, bf));
+    const F4 lo = min(rf, min(gf, bf));
+    const F4 chroma = hi - lo;
+    const M4 gray = (chroma == zero);
+    const F4 safeChroma = select(gray, one, chroma);
+
+    F4 h = select(hi == rf, (gf - bf) / safeChroma,
+                  select(hi == gf, (bf - rf) / safeChroma + F4(2.0f),
+                                   (rf - gf) / safeChroma + F4(4.0f)));
+    h = select(h < zero, h + six, h);
+    h = select(gray, zero, h) + dh;
+    h = h - six*floor(h / six);
+
+    F4 sat(0.0f), x(0.0f);
+    if (hsl) {
+      x = (hi + lo) * half;
+      const F4 t = hi + lo - one;
+      sat = chroma / select(gray, one, one - max(t, zero - t));
+    }
+    else {
+      x = hi;
+      sat = chroma / select(gray, one, hi);
+    }
+
+    sat = min(max(multiply ? sat*ds: sat+ds, zero), one);
+    x = min(max(multiply ? x*dl: x+dl, zero), one);
+
+    auto channel = [&](const float k0) -> F4 {
+      if (hsl) {
+        const F4 c = sat * min(x, one - x);
+        F4 k = h + h + F4(k0);
+        k = select(k < twelve, k, k - twelve);
+        const F4 f = max(F4(-1.0f), min(k - F4(3.0f), min(F4(9.0f) - k, one)));
+        return (x - c*f) * k255 + half;
+      }
+      else {
+        F4 k = h + F4(k0);
+        k = select(k < six, k, k - six);
+        const F4 f = max(zero, min(k, min(F4(4.0f) - k, one)));
+        return (x - x*sat*f) * k255 + half;
+      }
+    };
+
+    if (target & TARGET_RED_CHANNEL  ) r = channel(hsl ? 0.0f: 5.0f);
+    if (target & TARGET_GREEN_CHANNEL) g = channel(hsl ? 8.0f: 3.0f);
+    if (target & TARGET_BLUE_CHANNEL ) b = channel(hsl ? 4.0f: 1.0f);
+    if (target & TARGET_ALPHA_CHANNEL) a = min(max(a*da, zero), k255);
+
+    store_rgba(d, r, g, b, a);
+    if (m < 4)
+      std::copy(tail, tail+m, dst+i);
+  }
 }
 
 void HueSaturationFilter::applyFilterToRgb(const Target target, doc::color_t& color)
 {
-  switch (m_mode) {
-    case Mode::HSV_MUL:
-      applyFilterToRgbT<gfx::Hsv,
-                        &gfx::Hsv::value,
-                        &gfx::Hsv::value>(target, color, true);
-      break;
-    case Mode::HSL_MUL:
-      applyFilterToRgbT<gfx::Hsl,
-                        &gfx::Hsl::lightness,
-                        &gfx::Hsl::lightness>(target, color, true);
-      break;
-    case Mode::HSV_ADD:
-      applyFilterToRgbT<gfx::Hsv,
-                        &gfx::Hsv::value,
-                        &gfx::Hsv::value>(target, color, false);
-      break;
-    case Mode::HSL_ADD:
-      applyFilterToRgbT<gfx::Hsl,
-                        &gfx::Hsl::lightness,
-                        &gfx::Hsl::lightness>(target, color, false);
-      break;
-  }
+  applyToRgbaSpan(target, &color, &color, 1);
 }
 
 } // namespace filters
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2017-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -30,20 +30,36 @@ namespace filters {
     void setLightness(double v);
     void setAlpha(double a);
 
+    Mode mode() const { return m_mode; }
+    double hue() const { return m_h; }
+    double saturation() const { return m_s; }
+    double lightness() const { return m_l; }
+    double alpha() const { return m_a; }
+
     // Filter implementation
     const char* getName() override;
     void applyToRgba(FilterManager* filterMgr) override;
     void applyToGrayscale(FilterManager* filterMgr) override;
     void applyToIndexed(FilterManager* filterMgr) override;
+    bool isParallelizable() const override { return true; }
+    bool isPointFilter() const override { return true; }
+
+    // Applies the filter to "n" RGBA pixels (4 pixels per iteration
+    // with SSE2/NEON). "src" and "dst" can be the same buffer.
+    void applyToRgbaSpan(const Target target,
+                         const doc::color_t* src,
+                         doc::color_t* dst,
+                         const int n) const;
 
   private:
     void onApplyToPalette(FilterManager* filterMgr,
                           const doc::PalettePicks& picks) override;
 
-    template<class T,
-             double (T::*get_lightness)() const,
-             void (T::*set_lightness)(double)>
-    void applyFilterToRgbT(const Target target, doc::color_t& color, bool multiply);
+    template<bool hsl, bool multiply>
+    void applyToRgbaSpanT(const Target target,
+                          const doc::color_t* src,
+                          doc::color_t* dst,
+                          const int n) const;
     void applyFilterToRgb(const Target target, doc::color_t& color);
 
     Mode m_mode;
@@ -0,0 +1,176 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/color.h"
+#include "filters/hue_saturation_filter.h"
+#include "gfx/hsl.h"
+#include "gfx/hsv.h"
+#include "gfx/rgb.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace doc;
+using namespace filters;
+
+namespace {
+
+using Mode = HueSaturationFilter::Mode;
+
+// Per-pixel conversion with gfx::Hsl/Hsv (how HueSaturationFilter
+// worked before the vectorized kernel) to compare the results.
+template<class T,
+         double (T::*get_lightness)() const,
+         void (T::*set_lightness)(double)>
+color_t reference_t(color_t c, Target target, bool multiply,
+                    double dh, double ds, double dl, double da)
+{
+  int r = rgba_getr(c);
+  int g = rgba_getg(c);
+  int b = rgba_getb(c);
+  int a = rgba_geta(c);
+
+  T hsl(gfx::Rgb(r, g, b));
+
+  double h = hsl.hue() + dh;
+  while (h < 0.0) h += 360.0;
+  h = std::fmod(h, 360.0);
+
+  double s = (multiply ? hsl.saturation()*(1.0+ds): hsl.saturation() + ds);
+  s = std::clamp(s, 0.0, 1.0);
+
+  double l = (multiply ? (hsl.*get_lightness)()*(1.0+dl):
+                         (hsl.*get_lightness)() + dl);
+  l = std::clamp(l, 0.0, 1.0);
+
+  hsl.hue(h);
+  hsl.saturation(s);
+  (hsl.*set_lightness)(l);
+  gfx::Rgb rgb(hsl);
+
+  if (target & TARGET_RED_CHANNEL  ) r = rgb.red();
+  if (target & TARGET_GREEN_CHANNEL) g = rgb.green();
+  if (target & TARGET_BLUE_CHANNEL ) b = rgb.blue();
+  if (a && (target & TARGET_ALPHA_CHANNEL)) {
+    a = a*(1.0+da);
+    a = std::clamp(a, 0, 255);
+  }
+  return rgba(r, g, b, a);
+}
+
+color_t reference(color_t c, Target target, Mode mode,
+                  double dh, double ds, double dl, double da)
+{
+  switch (mode) {
+    case Mode::HSV_MUL:
+      return reference_t<gfx::Hsv, &gfx::Hsv::value, &gfx::Hsv::value>(
+        c, target, true, dh, ds, dl, da);
+    case Mode::HSL_MUL:
+      return reference_t<gfx::Hsl, &gfx::Hsl::lightness, &gfx::Hsl::lightness>(
+        c, target, true, dh, ds, dl, da);
+    case Mode::HSV_ADD:
+      return reference_t<gfx::Hsv, &gfx::Hsv::value, &gfx::Hsv::value>(
+        c, target, false, dh, ds, dl, da);
+    case Mode::HSL_ADD:
+      return reference_t<gfx::Hsl, &gfx::Hsl::lightness, &gfx::Hsl::lightness>(
+        c, target, false, dh, ds, dl, da);
+  }
+  return c;
+}
+
+bool similar(color_t a, color_t b)
+{
+  return (std::abs(int(rgba_getr(a)) - int(rgba_getr(b))) <= 1 &&
+          std::abs(int(rgba_getg(a)) - int(rgba_getg(b))) <= 1 &&
+          std::abs(int(rgba_getb(a)) - int(rgba_getb(b))) <= 1 &&
+          rgba_geta(a) == rgba_geta(b));
+}
+
+} // anonymous namespace
+
+TEST(HueSaturationFilter, SpanMatchesPerPixelConversion)
+{
+  std::mt19937 rng(1);
+  std::vector<color_t> src;
+  for (int v=0; v<256; ++v)     // Grays
+    src.push_back(rgba(v, v, v, 255));
+  for (int i=0; i<4000; ++i)
+    src.push_back(rng());
+  src.push_back(rgba(255, 0, 0, 0));
+  src.push_back(rgba(0, 0, 255, 128));
+
+  struct Params { Mode mode; double h, s, l, a; };
+  const Params params[] = {
+    { Mode::HSL_MUL,    0.0,  0.0,  0.0,  0.0 },
+    { Mode::HSL_MUL,   90.0,  0.5, -0.3,  0.2 },
+    { Mode::HSL_MUL, -180.0, -1.0,  1.0, -1.0 },
+    { Mode::HSV_MUL,   45.0, -0.4,  0.25, 0.0 },
+    { Mode::HSV_MUL, -120.0,  1.0, -1.0,  0.5 },
+    { Mode::HSL_ADD,  170.0,  0.3,  0.1, -0.5 },
+    { Mode::HSL_ADD,  -30.0, -0.2, -0.6,  0.0 },
+    { Mode::HSV_ADD,   10.0,  0.7, -0.1,  0.1 },
+    { Mode::HSV_ADD, -179.0, -0.5,  0.5,  1.0 },
+  };
+  const Target targets[] = {
+    TARGET_ALL_CHANNELS,
+    TARGET_RED_CHANNEL | TARGET_BLUE_CHANNEL,
+    TARGET_GREEN_CHANNEL | TARGET_ALPHA_CHANNEL,
+  };
+
+  for (const Params& p : params) {
+    HueSaturationFilter filter;
+    filter.setMode(p.mode);
+    filter.setHue(p.h);
+    filter.setSaturation(p.s);
+    filter.setLightness(p.l);
+    filter.setAlpha(p.a);
+
+    for (Target target : targets) {
+      // Odd size to test the last incomplete group of pixels
+      std::vector<color_t> dst(src.size());
+      filter.applyToRgbaSpan(target, src.data(), dst.data(), int(src.size()));
+
+      for (std::size_t i=0; i<src.size(); ++i) {
+        const color_t expected = reference(src[i], target, p.mode,
+                                           p.h, p.s, p.l, p.a);
+        ASSERT_TRUE(similar(expected, dst[i]))
+          << "i=" << i << " src=" << std::hex << src[i]
+          << " expected=" << expected << " result=" << dst[i]
+          << std::dec << " mode=" << int(p.mode) << " target=" << target;
+      }
+    }
+  }
+}
+
+TEST(HueSaturationFilter, SpanInPlace)
+{
+  HueSaturationFilter filter;
+  filter.setHue(120.0);
+
+  std::vector<color_t> colors = { rgba(255, 0, 0, 255),
+                                  rgba(0, 255, 0, 128),
+                                  rgba(0, 0, 255, 0) };
+  filter.applyToRgbaSpan(TARGET_ALL_CHANNELS, colors.data(), colors.data(),
+                         int(colors.size()));
+  EXPECT_EQ(rgba(0, 255, 0, 255), colors[0]);
+  EXPECT_EQ(rgba(0, 0, 255, 128), colors[1]);
+  EXPECT_EQ(rgba(255, 0, 0, 0), colors[2]);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -19,6 +19,8 @@ namespace filters {
     void applyToRgba(FilterManager* filterMgr);
     void applyToGrayscale(FilterManager* filterMgr);
     void applyToIndexed(FilterManager* filterMgr);
+    bool isParallelizable() const { return true; }
+    bool isPointFilter() const { return true; }
   };
 
 } // namespace filters
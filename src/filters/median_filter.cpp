@@ -21,80 +21,192 @@
 #include "filters/tiled_mode.h"
 
 #include <algorithm>
+#include <vector>
 
 namespace filters {
 
 using namespace doc;
 
 namespace {
-  struct GetPixelsDelegateRgba {
-    std::vector<std::vector<uint8_t> >& channel;
-    int c;
 
-    GetPixelsDelegateRgba(std::vector<std::vector<uint8_t> >& channel) : channel(channel) { }
+  // Decoders of each pixel format to 8-bit channels.
 
-    void reset() { c = 0; }
+  struct DecodeRgba {
+    enum { R, G, B, A, Channels };
 
-    void operator()(RgbTraits::pixel_t color)
-    {
-      channel[0][c] = rgba_getr(color);
-      channel[1][c] = rgba_getg(color);
-      channel[2][c] = rgba_getb(color);
-      channel[3][c] = rgba_geta(color);
-      c++;
+    void operator()(const RgbTraits::pixel_t color, uint8_t* const* channels, const int i) const {
+      channels[R][i] = rgba_getr(color);
+      channels[G][i] = rgba_getg(color);
+      channels[B][i] = rgba_getb(color);
+      channels[A][i] = rgba_geta(color);
     }
   };
 
-  struct GetPixelsDelegateGrayscale {
-    std::vector<std::vector<uint8_t> >& channel;
-    int c;
+  struct DecodeGrayscale {
+    enum { V, A, Channels };
 
-    GetPixelsDelegateGrayscale(std::vector<std::vector<uint8_t> >& channel) : channel(channel) { }
+    void operator()(const GrayscaleTraits::pixel_t color, uint8_t* const* channels, const int i) const {
+      channels[V][i] = graya_getv(color);
+      channels[A][i] = graya_geta(color);
+    }
+  };
 
-    void reset() { c = 0; }
+  struct DecodeIndex {
+    enum { Index, Channels };
 
-    void operator()(GrayscaleTraits::pixel_t color)
-    {
-      channel[0][c] = graya_getv(color);
-      channel[1][c] = graya_geta(color);
-      c++;
+    void operator()(const IndexedTraits::pixel_t color, uint8_t* const* channels, const int i) const {
+      channels[Index][i] = color;
     }
   };
 
-  struct GetPixelsDelegateIndexed {
+  struct DecodeIndexedRgba {
+    enum { R, G, B, A, Channels };
     const Palette* pal;
-    std::vector<std::vector<uint8_t> >& channel;
-    Target target;
-    int c;
 
-    GetPixelsDelegateIndexed(const Palette* pal, std::vector<std::vector<uint8_t> >& channel, Target target)
-      : pal(pal), channel(channel), target(target) { }
+    DecodeIndexedRgba(const Palette* pal) : pal(pal) { }
+
+    void operator()(const IndexedTraits::pixel_t color, uint8_t* const* channels, const int i) const {
+      const color_t rgba = pal->getEntry(color);
+      channels[R][i] = rgba_getr(rgba);
+      channels[G][i] = rgba_getg(rgba);
+      channels[B][i] = rgba_getb(rgba);
+      channels[A][i] = rgba_geta(rgba);
+    }
+  };
+
+  // Histogram of the values of one channel inside the filter window
+  // (Huang's algorithm). When the window moves one pixel to the right
+  // we remove the values of its left column and add the values of
+  // the new right column, then the median is moved from its previous
+  // position. So each pixel costs O(height) instead of sorting
+  // width*height values.
+  class MedianHistogram {
+  public:
+    void reset(const int n) {
+      std::fill(std::begin(m_hist), std::end(m_hist), 0);
+      m_half = n/2;
+      m_median = 0;
+      m_lessThanMedian = 0;
+    }
+
+    void add(const int v) {
+      ++m_hist[v];
+      if (v < m_median)
+        ++m_lessThanMedian;
+    }
+
+    void remove(const int v) {
+      --m_hist[v];
+      if (v < m_median)
+        --m_lessThanMedian;
+    }
+
+    // Returns the same value as the n/2-th element of the sorted
+    // values of the window.
+    int median() {
+      while (m_lessThanMedian > m_half)
+        m_lessThanMedian -= m_hist[--m_median];
+      while (m_lessThanMedian + m_hist[m_median] <= m_half)
+        m_lessThanMedian += m_hist[m_median++];
+      return m_median;
+    }
+
+  private:
+    int m_hist[256];
+    int m_half;
+    int m_median;
+    int m_lessThanMedian;
+  };
 
-    void reset() { c = 0; }
+  // Calculates the median of each channel for all the pixels of a row.
+  template<typename Traits, typename Decoder>
+  class RowMedian {
+  public:
+    static constexpr int N = Decoder::Channels;
+
+    RowMedian(const int width, const int height,
+              const TiledMode tiledMode,
+              const Decoder& decoder)
+      : m_width(width)
+      , m_height(height)
+      , m_tiledMode(tiledMode)
+      , m_decoder(decoder) {
+    }
 
-    void operator()(IndexedTraits::pixel_t color)
-    {
-      if (target & TARGET_INDEX_CHANNEL) {
-        channel[0][c] = color;
+    // Calculates the medians of the "w" pixels from (x, y) for the
+    // channels specified in the "channels" bits.
+    void calculate(const Image* src, const int x, const int y, const int w,
+                   const int channels) {
+      const bool tiledX = (int(m_tiledMode) & int(TiledMode::X_AXIS));
+      const bool tiledY = (int(m_tiledMode) & int(TiledMode::Y_AXIS));
+      const int extW = w + m_width - 1;
+      const int cx = m_width/2;
+      const int cy = m_height/2;
+
+      m_xs.resize(extW);
+      for (int i=0; i<extW; ++i)
+        m_xs[i] = get_neighboring_coord(x - cx + i, src->width(), tiledX);
+
+      // Decode the rows of the window (row "dy" starts at dy*extW)
+      uint8_t* ptrs[N];
+      for (int c=0; c<N; ++c) {
+        m_window[c].resize(m_height*extW);
+        m_medians[c].resize(w);
       }
-      else {
-        color_t rgb = pal->getEntry(color);
-        channel[0][c] = rgba_getr(rgb);
-        channel[1][c] = rgba_getg(rgb);
-        channel[2][c] = rgba_getb(rgb);
-        channel[3][c] = rgba_geta(rgb);
+      for (int dy=0; dy<m_height; ++dy) {
+        auto srcAddress = (typename Traits::const_address_t)
+          src->getPixelAddress(
+            0, get_neighboring_coord(y - cy + dy, src->height(), tiledY));
+        for (int c=0; c<N; ++c)
+          ptrs[c] = m_window[c].data() + dy*extW;
+        for (int i=0; i<extW; ++i)
+          m_decoder(srcAddress[m_xs[i]], ptrs, i);
       }
-      c++;
+
+      for (int c=0; c<N; ++c) {
+        if ((channels & (1 << c)) == 0)
+          continue;
+
+        const uint8_t* window = m_window[c].data();
+        uint8_t* medians = m_medians[c].data();
+
+        m_hist.reset(m_width*m_height);
+        for (int dy=0; dy<m_height; ++dy)
+          for (int dx=0; dx<m_width; ++dx)
+            m_hist.add(window[dy*extW + dx]);
+        medians[0] = m_hist.median();
+
+        for (int i=1; i<w; ++i) {
+          for (int dy=0; dy<m_height; ++dy) {
+            m_hist.remove(window[dy*extW + i-1]);
+            m_hist.add(window[dy*extW + i+m_width-1]);
+          }
+          medians[i] = m_hist.median();
+        }
+      }
+    }
+
+    int median(const int c, const int i) const {
+      return m_medians[c][i];
     }
+
+  private:
+    int m_width;
+    int m_height;
+    TiledMode m_tiledMode;
+    Decoder m_decoder;
+    MedianHistogram m_hist;
+    std::vector<int> m_xs;              // Source X coordinate of each decoded column
+    std::vector<uint8_t> m_window[N];   // Decoded rows of the window
+    std::vector<uint8_t> m_medians[N];  // Result for each pixel of the row
   };
-};
+
+}
 
 MedianFilter::MedianFilter()
   : m_tiledMode(TiledMode::NONE)
   , m_width(1)
   , m_height(1)
-  , m_ncolors(0)
-  , m_channel(4)
 {
 }
 
@@ -110,10 +222,6 @@ void MedianFilter::setSize(int width, int height)
 
   m_width = std::max(1, width);
   m_height = std::max(1, height);
-  m_ncolors = width*height;
-
-  for (int c = 0; c < 4; ++c)
-    m_channel[c].resize(m_ncolors);
 }
 
 const char* MedianFilter::getName()
@@ -124,41 +232,36 @@ const char* MedianFilter::getName()
 void MedianFilter::applyToRgba(FilterManager* filterMgr)
 {
   const Image* src = filterMgr->getSourceImage();
+  const Target filterTarget = filterMgr->getTarget();
+  const int x0 = filterMgr->x();
   int color, r, g, b, a;
-  GetPixelsDelegateRgba delegate(m_channel);
+  RowMedian<RgbTraits, DecodeRgba> median(m_width, m_height, m_tiledMode, DecodeRgba());
+  median.calculate(src, x0, filterMgr->y(), filterMgr->getWidth(),
+                   (filterTarget & TARGET_RED_CHANNEL   ? 1 << DecodeRgba::R: 0) |
+                   (filterTarget & TARGET_GREEN_CHANNEL ? 1 << DecodeRgba::G: 0) |
+                   (filterTarget & TARGET_BLUE_CHANNEL  ? 1 << DecodeRgba::B: 0) |
+                   (filterTarget & TARGET_ALPHA_CHANNEL ? 1 << DecodeRgba::A: 0));
 
   FILTER_LOOP_THROUGH_ROW_BEGIN(uint32_t) {
-    delegate.reset();
-    get_neighboring_pixels<RgbTraits>(src, x, y, m_width, m_height, m_width/2, m_height/2,
-                                      m_tiledMode, delegate);
-
     color = get_pixel_fast<RgbTraits>(src, x, y);
 
-    if (target & TARGET_RED_CHANNEL) {
-      std::sort(m_channel[0].begin(), m_channel[0].end());
-      r = m_channel[0][m_ncolors/2];
-    }
+    if (target & TARGET_RED_CHANNEL)
+      r = median.median(DecodeRgba::R, x-x0);
     else
       r = rgba_getr(color);
 
-    if (target & TARGET_GREEN_CHANNEL) {
-      std::sort(m_channel[1].begin(), m_channel[1].end());
-      g = m_channel[1][m_ncolors/2];
-    }
+    if (target & TARGET_GREEN_CHANNEL)
+      g = median.median(DecodeRgba::G, x-x0);
     else
       g = rgba_getg(color);
 
-    if (target & TARGET_BLUE_CHANNEL) {
-      std::sort(m_channel[2].begin(), m_channel[2].end());
-      b = m_channel[2][m_ncolors/2];
-    }
+    if (target & TARGET_BLUE_CHANNEL)
+      b = median.median(DecodeRgba::B, x-x0);
     else
       b = rgba_getb(color);
 
-    if (target & TARGET_ALPHA_CHANNEL) {
-      std::sort(m_channel[3].begin(), m_channel[3].end());
-      a = m_channel[3][m_ncolors/2];
-    }
+    if (target & TARGET_ALPHA_CHANNEL)
+      a = median.median(DecodeRgba::A, x-x0);
     else
       a = rgba_geta(color);
 
@@ -170,27 +273,24 @@ void MedianFilter::applyToRgba(FilterManager* filterMgr)
 void MedianFilter::applyToGrayscale(FilterManager* filterMgr)
 {
   const Image* src = filterMgr->getSourceImage();
+  const Target filterTarget = filterMgr->getTarget();
+  const int x0 = filterMgr->x();
   int color, k, a;
-  GetPixelsDelegateGrayscale delegate(m_channel);
+  RowMedian<GrayscaleTraits, DecodeGrayscale> median(m_width, m_height, m_tiledMode, DecodeGrayscale());
+  median.calculate(src, x0, filterMgr->y(), filterMgr->getWidth(),
+                   (filterTarget & TARGET_GRAY_CHANNEL  ? 1 << DecodeGrayscale::V: 0) |
+                   (filterTarget & TARGET_ALPHA_CHANNEL ? 1 << DecodeGrayscale::A: 0));
 
   FILTER_LOOP_THROUGH_ROW_BEGIN(uint16_t) {
-    delegate.reset();
-    get_neighboring_pixels<GrayscaleTraits>(src, x, y, m_width, m_height, m_width/2, m_height/2,
-                                            m_tiledMode, delegate);
-
     color = get_pixel_fast<GrayscaleTraits>(src, x, y);
 
-    if (target & TARGET_GRAY_CHANNEL) {
-      std::sort(m_channel[0].begin(), m_channel[0].end());
-      k = m_channel[0][m_ncolors/2];
-    }
+    if (target & TARGET_GRAY_CHANNEL)
+      k = median.median(DecodeGrayscale::V, x-x0);
     else
       k = graya_getv(color);
 
-    if (target & TARGET_ALPHA_CHANNEL) {
-      std::sort(m_channel[1].begin(), m_channel[1].end());
-      a = m_channel[1][m_ncolors/2];
-    }
+    if (target & TARGET_ALPHA_CHANNEL)
+      a = median.median(DecodeGrayscale::A, x-x0);
     else
       a = graya_geta(color);
 
@@ -204,52 +304,54 @@ void MedianFilter::applyToIndexed(FilterManager* filterMgr)
   const Image* src = filterMgr->getSourceImage();
   const Palette* pal = filterMgr->getIndexedData()->getPalette();
   const RgbMap* rgbmap = filterMgr->getIndexedData()->getRgbMap();
-  int color, r, g, b, a;
-  GetPixelsDelegateIndexed delegate(pal, m_channel, filterMgr->getTarget());
+  const Target filterTarget = filterMgr->getTarget();
+  const int x0 = filterMgr->x();
 
-  FILTER_LOOP_THROUGH_ROW_BEGIN(uint8_t) {
-    delegate.reset();
-    get_neighboring_pixels<IndexedTraits>(src, x, y, m_width, m_height, m_width/2, m_height/2,
-                                          m_tiledMode, delegate);
+  if (filterTarget & TARGET_INDEX_CHANNEL) {
+    RowMedian<IndexedTraits, DecodeIndex> median(m_width, m_height, m_tiledMode, DecodeIndex());
+    median.calculate(src, x0, filterMgr->y(), filterMgr->getWidth(),
+                     1 << DecodeIndex::Index);
 
-    if (target & TARGET_INDEX_CHANNEL) {
-      std::sort(m_channel[0].begin(), m_channel[0].end());
-      *dst_address = m_channel[0][m_ncolors/2];
+    FILTER_LOOP_THROUGH_ROW_BEGIN(uint8_t) {
+      *dst_address = median.median(DecodeIndex::Index, x-x0);
     }
-    else {
-      color = get_pixel_fast<IndexedTraits>(src, x, y);
-      color = pal->getEntry(color);
+    FILTER_LOOP_THROUGH_ROW_END()
+    return;
+  }
 
-      if (target & TARGET_RED_CHANNEL) {
-        std::sort(m_channel[0].begin(), m_channel[0].end());
-        r = m_channel[0][m_ncolors/2];
-      }
-      else
-        r = rgba_getr(color);
+  int color, r, g, b, a;
+  RowMedian<IndexedTraits, DecodeIndexedRgba> median(m_width, m_height, m_tiledMode, DecodeIndexedRgba(pal));
+  median.calculate(src, x0, filterMgr->y(), filterMgr->getWidth(),
+                   (filterTarget & TARGET_RED_CHANNEL   ? 1 << DecodeIndexedRgba::R: 0) |
+                   (filterTarget & TARGET_GREEN_CHANNEL ? 1 << DecodeIndexedRgba::G: 0) |
+                   (filterTarget & TARGET_BLUE_CHANNEL  ? 1 << DecodeIndexedRgba::B: 0) |
+                   (filterTarget & TARGET_ALPHA_CHANNEL ? 1 << DecodeIndexedRgba::A: 0));
 
-      if (target & TARGET_GREEN_CHANNEL) {
-        std::sort(m_channel[1].begin(), m_channel[1].end());
-        g = m_channel[1][m_ncolors/2];
-      }
-      else
-        g = rgba_getg(pal->getEntry(color));
+  FILTER_LOOP_THROUGH_ROW_BEGIN(uint8_t) {
+    color = get_pixel_fast<IndexedTraits>(src, x, y);
+    color = pal->getEntry(color);
 
-      if (target & TARGET_BLUE_CHANNEL) {
-        std::sort(m_channel[2].begin(), m_channel[2].end());
-        b = m_channel[2][m_ncolors/2];
-      }
-      else
-        b = rgba_getb(color);
+    if (target & TARGET_RED_CHANNEL)
+      r = median.median(DecodeIndexedRgba::R, x-x0);
+    else
+      r = rgba_getr(color);
 
-      if (target & TARGET_ALPHA_CHANNEL) {
-        std::sort(m_channel[3].begin(), m_channel[3].end());
-        a = m_channel[3][m_ncolors/2];
-      }
-      else
-        a = rgba_geta(color);
+    if (target & TARGET_GREEN_CHANNEL)
+      g = median.median(DecodeIndexedRgba::G, x-x0);
+    else
+      g = rgba_getg(color);
 
-      *dst_address = rgbmap->mapColor(r, g, b, a);
-    }
+    if (target & TARGET_BLUE_CHANNEL)
+      b = median.median(DecodeIndexedRgba::B, x-x0);
+    else
+      b = rgba_getb(color);
+
+    if (target & TARGET_ALPHA_CHANNEL)
+      a = median.median(DecodeIndexedRgba::A, x-x0);
+    else
+      a = rgba_geta(color);
+
+    *dst_address = rgbmap->mapColor(r, g, b, a);
   }
   FILTER_LOOP_THROUGH_ROW_END()
 }
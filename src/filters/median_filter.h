@@ -32,13 +32,12 @@ namespace filters {
     void applyToRgba(FilterManager* filterMgr);
     void applyToGrayscale(FilterManager* filterMgr);
     void applyToIndexed(FilterManager* filterMgr);
+    bool isParallelizable() const { return true; }
 
   private:
     TiledMode m_tiledMode;
     int m_width;
     int m_height;
-    int m_ncolors;
-    std::vector<std::vector<uint8_t> > m_channel;
   };
 
 } // namespace filters
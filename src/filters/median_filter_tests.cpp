@@ -0,0 +1,125 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/image_impl.h"
+#include "doc/image_ref.h"
+#include "filters/filter_manager.h"
+#include "filters/median_filter.h"
+#include "filters/neighboring_pixels.h"
+#include "gfx/size.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace doc;
+using namespace filters;
+
+namespace {
+
+// Applies a filter to a whole RGBA image row by row.
+class TestFilterManager : public FilterManager {
+public:
+  TestFilterManager(const Image* src, Image* dst)
+    : m_src(src), m_dst(dst), m_row(0) { }
+
+  void apply(Filter* filter) {
+    for (m_row=0; m_row<m_src->height(); ++m_row)
+      filter->applyToRgba(this);
+  }
+
+  doc::PixelFormat pixelFormat() const override { return IMAGE_RGB; }
+  const void* getSourceAddress() override { return m_src->getPixelAddress(0, m_row); }
+  void* getDestinationAddress() override { return m_dst->getPixelAddress(0, m_row); }
+  int getWidth() override { return m_src->width(); }
+  Target getTarget() override { return TARGET_ALL_CHANNELS; }
+  FilterIndexedData* getIndexedData() override { return nullptr; }
+  bool skipPixel() override { return false; }
+  const doc::Image* getSourceImage() override { return m_src; }
+  int x() const override { return 0; }
+  int y() const override { return m_row; }
+  bool isFirstRow() const override { return m_row == 0; }
+  bool isMaskActive() const override { return false; }
+  base::task_token& taskToken() const override { return m_token; }
+
+private:
+  const Image* m_src;
+  Image* m_dst;
+  int m_row;
+  mutable base::task_token m_token;
+};
+
+// Sorts the values of the window to get the median of each channel.
+struct Reference {
+  std::vector<int> channels[4];
+
+  void operator()(RgbTraits::pixel_t color) {
+    channels[0].push_back(rgba_getr(color));
+    channels[1].push_back(rgba_getg(color));
+    channels[2].push_back(rgba_getb(color));
+    channels[3].push_back(rgba_geta(color));
+  }
+
+  color_t apply(const Image* src, int x, int y, int w, int h, TiledMode tiledMode) {
+    for (auto& c : channels)
+      c.clear();
+    get_neighboring_pixels<RgbTraits>(src, x, y, w, h, w/2, h/2,
+                                      tiledMode, *this);
+    int v[4];
+    for (int i=0; i<4; ++i) {
+      std::sort(channels[i].begin(), channels[i].end());
+      v[i] = channels[i][channels[i].size()/2];
+    }
+    return rgba(v[0], v[1], v[2], v[3]);
+  }
+};
+
+} // anonymous namespace
+
+TEST(MedianFilter, MatchesSortedWindow)
+{
+  std::mt19937 rng(1);
+  ImageRef src(Image::create(IMAGE_RGB, 29, 17));
+  for (int y=0; y<src->height(); ++y)
+    for (int x=0; x<src->width(); ++x) {
+      // Few different values to have repeated values in the windows
+      const int v = rng() % 4;
+      put_pixel_fast<RgbTraits>(src.get(), x, y,
+                                rgba(v*85, rng() % 256, (x*y) % 256, v == 0 ? 0: 255));
+    }
+
+  const gfx::Size sizes[] = { { 1, 1 }, { 3, 3 }, { 2, 4 }, { 7, 1 }, { 9, 11 } };
+  for (const auto& size : sizes) {
+    for (TiledMode tiledMode : { TiledMode::NONE, TiledMode::BOTH }) {
+      MedianFilter filter;
+      filter.setSize(size.w, size.h);
+      filter.setTiledMode(tiledMode);
+
+      ImageRef dst(Image::createCopy(src.get()));
+      TestFilterManager mgr(src.get(), dst.get());
+      mgr.apply(&filter);
+
+      Reference ref;
+      for (int y=0; y<src->height(); ++y)
+        for (int x=0; x<src->width(); ++x)
+          ASSERT_EQ(ref.apply(src.get(), x, y, size.w, size.h, tiledMode),
+                    get_pixel_fast<RgbTraits>(dst.get(), x, y))
+            << "x=" << x << " y=" << y << " size=" << size.w << "x" << size.h;
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
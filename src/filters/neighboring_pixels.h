@@ -12,11 +12,25 @@
 #include "doc/image.h"
 #include "doc/image_traits.h"
 
+#include <algorithm>
 #include <vector>
 
 namespace filters {
   using namespace doc;
 
+  // Returns the coordinate of the pixel to use when a matrix reaches
+  // the given coordinate "v" (which can be outside the [0, size)
+  // range). It's wrapped in tiled mode, or clamped in other case
+  // (the same as get_neighboring_pixels() does).
+  inline int get_neighboring_coord(const int v, const int size, const bool tiled)
+  {
+    if (tiled) {
+      const int r = v % size;
+      return (r < 0 ? r + size: r);
+    }
+    return std::clamp(v, 0, size-1);
+  }
+
   // Calls the specified "delegate" for all neighboring pixels in a 2D
   // (width*height) matrix located in (x,y) where its center is the
   // (centerX,centerY) element of the matrix.
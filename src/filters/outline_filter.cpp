@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -18,6 +18,9 @@
 #include "filters/neighboring_pixels.h"
 
 #include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
 
 namespace filters {
 
@@ -25,6 +28,9 @@ using namespace doc;
 
 namespace {
 
+  // Maximum number of source images with cached neighbors
+  const std::size_t kMaxCachedNeighbors = 16;
+
   struct GetPixelsDelegate {
     color_t bgColor;
     int transparent;    // Transparent pixels
@@ -79,11 +85,211 @@ namespace {
     }
   };
 
+  inline int wrap_index(const int i, const int n) {
+    return (i < 0 ? i + n: (i >= n ? i - n: i));
+  }
+
+  // 1D distance transform of a line: dist[i] = min(dist[j] + |i-j|)
+  // limited to "limit" (two sweeps, one in each direction). In tiled
+  // mode the line wraps around.
+  void distance_1d(int* dist, const int n, const int stride,
+                   const bool tiled, const int limit,
+                   std::vector<int>& ext)
+  {
+    const int pad = (tiled ? std::min(limit, n): 0);
+    const int m = n + 2*pad;
+    ext.resize(m);
+    for (int e=0, d=limit; e<m; ++e) {
+      d = std::min(d+1, dist[wrap_index(e-pad, n)*stride]);
+      ext[e] = d;
+    }
+    for (int e=m-1, d=limit; e>=0; --e) {
+      d = std::min(d+1, ext[e]);
+      ext[e] = d;
+    }
+    for (int i=0; i<n; ++i)
+      dist[i*stride] = ext[i+pad];
+  }
+
+  // Squared euclidean distance transform of a line: f[i] = min(f[j] +
+  // (i-j)^2), using the lower envelope of parabolas from Felzenszwalb
+  // and Huttenlocher. Only distances below "limit" are exact.
+  void squared_distance_1d(int* f, const int n, const int stride,
+                           const bool tiled, const int limit,
+                           std::vector<int>& ext,
+                           std::vector<int>& v,
+                           std::vector<double>& z)
+  {
+    const int pad = (tiled ? std::min(limit, n): 0);
+    const int m = n + 2*pad;
+    ext.resize(m);
+    v.resize(m);
+    z.resize(m+1);
+    for (int e=0; e<m; ++e)
+      ext[e] = f[wrap_index(e-pad, n)*stride];
+
+    auto intersection = [&ext](const int q, const int p) {
+      return ((ext[q] + double(q)*q) - (ext[p] + double(p)*p)) / (2.0*(q - p));
+    };
+
+    int k = 0;
+    v[0] = 0;
+    z[0] = -std::numeric_limits<double>::infinity();
+    z[1] = std::numeric_limits<double>::infinity();
+    for (int q=1; q<m; ++q) {
+      double s = intersection(q, v[k]);
+      while (s <= z[k]) {
+        --k;
+        s = intersection(q, v[k]);
+      }
+      ++k;
+      v[k] = q;
+      z[k] = s;
+      z[k+1] = std::numeric_limits<double>::infinity();
+    }
+
+    k = 0;
+    for (int q=pad; q<pad+n; ++q) {
+      while (z[k+1] < q)
+        ++k;
+      f[(q-pad)*stride] = (q-v[k])*(q-v[k]) + ext[v[k]];
+    }
+  }
+
+  // Converts "bits" (1 for the source pixels) to 1 for the pixels
+  // that have a source pixel in the given matrix scaled by "r". The
+  // Circle matrix uses the euclidean distance, Square the chessboard
+  // distance, and Horizontal/Vertical the distance in one axis. Other
+  // matrices are applied "r" times (dilation with a 3x3 matrix).
+  void calculate_neighbors(std::vector<uint8_t>& bits,
+                           const int w, const int h,
+                           const OutlineFilter::Matrix matrix,
+                           const int r,
+                           const TiledMode tiledMode)
+  {
+    const bool tiledX = (int(tiledMode) & int(TiledMode::X_AXIS));
+    const bool tiledY = (int(tiledMode) & int(TiledMode::Y_AXIS));
+    const int limit = r+1;
+    std::vector<int> dist(w*h), ext, v;
+    std::vector<double> z;
+
+    auto from_bits = [&]{
+      for (int i=0; i<w*h; ++i)
+        dist[i] = (bits[i] ? 0: limit);
+    };
+    auto to_bits = [&](const int maxDist){
+      for (int i=0; i<w*h; ++i)
+        bits[i] = (dist[i] <= maxDist);
+    };
+    auto rows = [&]{
+      for (int y=0; y<h; ++y)
+        distance_1d(&dist[y*w], w, 1, tiledX, limit, ext);
+    };
+    auto cols = [&]{
+      for (int x=0; x<w; ++x)
+        distance_1d(&dist[x], h, w, tiledY, limit, ext);
+    };
+
+    switch (matrix) {
+
+      case OutlineFilter::Matrix::Circle:
+        from_bits();
+        rows();
+        for (int& d : dist)
+          d *= d;
+        for (int x=0; x<w; ++x)
+          squared_distance_1d(&dist[x], h, w, tiledY, limit, ext, v, z);
+        to_bits(r*r);
+        break;
+
+      case OutlineFilter::Matrix::Square:
+        from_bits();
+        rows();
+        for (int& d : dist)
+          d = (d <= r ? 0: limit);
+        cols();
+        to_bits(r);
+        break;
+
+      case OutlineFilter::Matrix::Horizontal:
+        from_bits();
+        rows();
+        to_bits(r);
+        break;
+
+      case OutlineFilter::Matrix::Vertical:
+        from_bits();
+        cols();
+        to_bits(r);
+        break;
+
+      default: {
+        std::vector<uint8_t> prev;
+        for (int i=0; i<r; ++i) {
+          prev = bits;
+          for (int y=0; y<h; ++y)
+            for (int x=0; x<w; ++x) {
+              uint8_t b = 0;
+              for (int bit=0; bit<9 && !b; ++bit) {
+                if (int(matrix) & (1 << bit)) {
+                  const int u = get_neighboring_coord(x + bit%3 - 1, w, tiledX);
+                  const int t = get_neighboring_coord(y + bit/3 - 1, h, tiledY);
+                  b = prev[t*w+u];
+                }
+              }
+              bits[y*w+x] = b;
+            }
+        }
+        break;
+      }
+    }
+  }
+
+  // Returns true if the pixel is a "source" pixel to calculate
+  // outline neighbors, i.e. opaque pixels for Place::Outside, or
+  // transparent pixels for Place::Inside (the same criteria of the
+  // GetPixelsDelegate).
+  template<typename Traits>
+  void get_source_bits(const Image* image,
+                       const OutlineFilter::Place place,
+                       const color_t bgColor,
+                       const Palette* pal,
+                       std::vector<uint8_t>& bits)
+  {
+    const bool outside = (place == OutlineFilter::Place::Outside);
+    const int w = image->width();
+    for (int y=0; y<image->height(); ++y) {
+      auto p = (const typename Traits::pixel_t*)image->getPixelAddress(0, y);
+      for (int x=0; x<w; ++x, ++p) {
+        const color_t c = *p;
+        bool transparent;
+        if constexpr (std::is_same_v<Traits, RgbTraits>)
+          transparent = (rgba_geta(c) == 0 || c == bgColor);
+        else if constexpr (std::is_same_v<Traits, GrayscaleTraits>)
+          transparent = (graya_geta(c) == 0 || c == bgColor);
+        else
+          transparent = (rgba_geta(pal->getEntry(c)) == 0 || c == bgColor);
+        bits[y*w+x] = (transparent != outside);
+      }
+    }
+  }
+
 }
 
+struct OutlineFilter::Neighbors {
+  ObjectId imageId = 0;
+  ObjectVersion imageVersion = 0;
+  std::once_flag calculated;
+  int width = 0;
+  std::vector<uint8_t> bits;
+
+  bool get(const int x, const int y) const { return bits[y*width+x] != 0; }
+};
+
 OutlineFilter::OutlineFilter()
   : m_place(Place::Outside)
   , m_matrix(Matrix::Circle)
+  , m_width(1)
   , m_tiledMode(TiledMode::NONE)
   , m_color(0)
   , m_bgColor(0)
@@ -105,12 +311,19 @@ void OutlineFilter::applyToRgba(FilterManager* filterMgr)
   GetPixelsDelegateRgba delegate;
   delegate.init(m_bgColor, m_matrix);
 
+  const std::shared_ptr<const Neighbors> neighbors = getNeighbors(filterMgr);
+
   FILTER_LOOP_THROUGH_ROW_BEGIN(uint32_t) {
-    delegate.reset();
-    get_neighboring_pixels<RgbTraits>(src, x, y, 3, 3, 1, 1, m_tiledMode, delegate);
+    if (neighbors) {
+      n = (neighbors->get(x, y) ? 1: 0);
+    }
+    else {
+      delegate.reset();
+      get_neighboring_pixels<RgbTraits>(src, x, y, 3, 3, 1, 1, m_tiledMode, delegate);
+      n = (m_place == Place::Outside ? delegate.opaque: delegate.transparent);
+    }
 
     c = *src_address;
-    n = (m_place == Place::Outside ? delegate.opaque: delegate.transparent);
     isTransparent = (rgba_geta(c) == 0 || c == m_bgColor);
 
     if ((n >= 1) &&
@@ -138,12 +351,19 @@ void OutlineFilter::applyToGrayscale(FilterManager* filterMgr)
   GetPixelsDelegateGrayscale delegate;
   delegate.init(m_bgColor, m_matrix);
 
+  const std::shared_ptr<const Neighbors> neighbors = getNeighbors(filterMgr);
+
   FILTER_LOOP_THROUGH_ROW_BEGIN(uint16_t) {
-    delegate.reset();
-    get_neighboring_pixels<GrayscaleTraits>(src, x, y, 3, 3, 1, 1, m_tiledMode, delegate);
+    if (neighbors) {
+      n = (neighbors->get(x, y) ? 1: 0);
+    }
+    else {
+      delegate.reset();
+      get_neighboring_pixels<GrayscaleTraits>(src, x, y, 3, 3, 1, 1, m_tiledMode, delegate);
+      n = (m_place == Place::Outside ? delegate.opaque: delegate.transparent);
+    }
 
     c = *src_address;
-    n = (m_place == Place::Outside ? delegate.opaque: delegate.transparent);
     isTransparent = (graya_geta(c) == 0 || c == m_bgColor);
 
     if ((n >= 1) &&
@@ -171,12 +391,19 @@ void OutlineFilter::applyToIndexed(FilterManager* filterMgr)
   GetPixelsDelegateIndexed delegate(pal);
   delegate.init(m_bgColor, m_matrix);
 
+  const std::shared_ptr<const Neighbors> neighbors = getNeighbors(filterMgr);
+
   FILTER_LOOP_THROUGH_ROW_BEGIN(uint8_t) {
-    delegate.reset();
-    get_neighboring_pixels<IndexedTraits>(src, x, y, 3, 3, 1, 1, m_tiledMode, delegate);
+    if (neighbors) {
+      n = (neighbors->get(x, y) ? 1: 0);
+    }
+    else {
+      delegate.reset();
+      get_neighboring_pixels<IndexedTraits>(src, x, y, 3, 3, 1, 1, m_tiledMode, delegate);
+      n = (m_place == Place::Outside ? delegate.opaque: delegate.transparent);
+    }
 
     c = *src_address;
-    n = (m_place == Place::Outside ? delegate.opaque: delegate.transparent);
 
     if (target & TARGET_INDEX_CHANNEL) {
       isTransparent = (c == m_bgColor);
@@ -206,4 +433,67 @@ void OutlineFilter::applyToIndexed(FilterManager* filterMgr)
   FILTER_LOOP_THROUGH_ROW_END()
 }
 
+std::shared_ptr<const OutlineFilter::Neighbors> OutlineFilter::getNeighbors(FilterManager* filterMgr)
+{
+  if (m_width <= 1)
+    return nullptr;
+
+  const Image* src = filterMgr->getSourceImage();
+  std::shared_ptr<Neighbors> neighbors;
+  {
+    const std::lock_guard lock(m_neighborsMutex);
+    // Object::id() is assigned lazily, so we ask for it with the
+    // mutex locked (other rows of the same image could be in other
+    // threads).
+    const ObjectId imageId = src->id();
+    for (const auto& item : m_neighbors) {
+      if (item->imageId == imageId &&
+          item->imageVersion == src->version()) {
+        neighbors = item;
+        break;
+      }
+    }
+    if (!neighbors) {
+      // Keep only the neighbors of the last images
+      if (m_neighbors.size() >= kMaxCachedNeighbors)
+        m_neighbors.erase(m_neighbors.begin());
+
+      neighbors = std::make_shared<Neighbors>();
+      neighbors->imageId = imageId;
+      neighbors->imageVersion = src->version();
+      m_neighbors.push_back(neighbors);
+    }
+  }
+
+  // Calculated only by the first thread that needs it
+  std::call_once(
+    neighbors->calculated,
+    [this, filterMgr, src, &neighbors]{
+      const int w = src->width();
+      const int h = src->height();
+      neighbors->width = w;
+      neighbors->bits.resize(w*h);
+
+      const color_t bgColor = m_bgColor;
+      switch (src->pixelFormat()) {
+        case IMAGE_RGB:
+          get_source_bits<RgbTraits>(src, m_place, bgColor, nullptr, neighbors->bits);
+          break;
+        case IMAGE_GRAYSCALE:
+          get_source_bits<GrayscaleTraits>(src, m_place, bgColor, nullptr, neighbors->bits);
+          break;
+        case IMAGE_INDEXED:
+          get_source_bits<IndexedTraits>(src, m_place, bgColor,
+                                         filterMgr->getIndexedData()->getPalette(),
+                                         neighbors->bits);
+          break;
+        default:
+          break;
+      }
+      calculate_neighbors(neighbors->bits, w, h, m_matrix, m_width, m_tiledMode);
+    });
+
+  return neighbors;
+}
+
 } // namespace filters
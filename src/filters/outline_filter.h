@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -12,6 +12,10 @@
 #include "filters/filter.h"
 #include "filters/tiled_mode.h"
 
+#include <memory>
+#include <mutex>
+#include <vector>
+
 namespace filters {
 
   class OutlineFilter : public Filter {
@@ -27,14 +31,16 @@ namespace filters {
 
     OutlineFilter();
 
-    void place(const Place place) { m_place = place; }
-    void matrix(const Matrix matrix) { m_matrix = matrix; }
-    void tiledMode(const TiledMode tiledMode) { m_tiledMode = tiledMode; }
+    void place(const Place place) { m_place = place; m_neighbors.clear(); }
+    void matrix(const Matrix matrix) { m_matrix = matrix; m_neighbors.clear(); }
+    void width(const int width) { m_width = width; m_neighbors.clear(); }
+    void tiledMode(const TiledMode tiledMode) { m_tiledMode = tiledMode; m_neighbors.clear(); }
     void color(const doc::color_t color) { m_color = color; }
-    void bgColor(const doc::color_t color) { m_bgColor = color; }
+    void bgColor(const doc::color_t color) { m_bgColor = color; m_neighbors.clear(); }
 
     Place place() const { return m_place; }
     Matrix matrix() const { return m_matrix; }
+    int width() const { return m_width; }
     TiledMode tiledMode() const { return m_tiledMode; }
     doc::color_t color() const { return m_color; }
     doc::color_t bgColor() const { return m_bgColor; }
@@ -44,13 +50,28 @@ namespace filters {
     void applyToRgba(FilterManager* filterMgr);
     void applyToGrayscale(FilterManager* filterMgr);
     void applyToIndexed(FilterManager* filterMgr);
+    bool isParallelizable() const { return true; }
 
   private:
+    struct Neighbors;
+
+    // Returns the pixels of the given image that have opaque pixels
+    // (or transparent pixels for Place::Inside) in the matrix scaled
+    // by the outline width. Used for outlines wider than one pixel
+    // and calculated only once for each source image.
+    std::shared_ptr<const Neighbors> getNeighbors(FilterManager* filterMgr);
+
     Place m_place;
     Matrix m_matrix;
+    int m_width;
     TiledMode m_tiledMode;
     doc::color_t m_color;
     doc::color_t m_bgColor;
+
+    // Neighbors of the last source images (several images are used
+    // at the same time when the filter is applied to several cels).
+    std::vector<std::shared_ptr<Neighbors>> m_neighbors;
+    std::mutex m_neighborsMutex;
   };
 
 } // namespace filters
@@ -0,0 +1,173 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/image_impl.h"
+#include "doc/image_ref.h"
+#include "filters/filter_manager.h"
+#include "filters/neighboring_pixels.h"
+#include "filters/outline_filter.h"
+
+#include <random>
+
+using namespace doc;
+using namespace filters;
+
+namespace {
+
+using Matrix = OutlineFilter::Matrix;
+using Place = OutlineFilter::Place;
+
+const color_t kOutlineColor = rgba(255, 0, 0, 255);
+
+// Applies a filter to a whole RGBA image row by row.
+class TestFilterManager : public FilterManager {
+public:
+  TestFilterManager(const Image* src, Image* dst)
+    : m_src(src), m_dst(dst), m_row(0) { }
+
+  void apply(Filter* filter) {
+    for (m_row=0; m_row<m_src->height(); ++m_row)
+      filter->applyToRgba(this);
+  }
+
+  doc::PixelFormat pixelFormat() const override { return IMAGE_RGB; }
+  const void* getSourceAddress() override { return m_src->getPixelAddress(0, m_row); }
+  void* getDestinationAddress() override { return m_dst->getPixelAddress(0, m_row); }
+  int getWidth() override { return m_src->width(); }
+  Target getTarget() override { return TARGET_ALL_CHANNELS; }
+  FilterIndexedData* getIndexedData() override { return nullptr; }
+  bool skipPixel() override { return false; }
+  const doc::Image* getSourceImage() override { return m_src; }
+  int x() const override { return 0; }
+  int y() const override { return m_row; }
+  bool isFirstRow() const override { return m_row == 0; }
+  bool isMaskActive() const override { return false; }
+  base::task_token& taskToken() const override { return m_token; }
+
+private:
+  const Image* m_src;
+  Image* m_dst;
+  int m_row;
+  mutable base::task_token m_token;
+};
+
+ImageRef apply_outline(const Image* src, Matrix matrix, Place place,
+                       int width, TiledMode tiledMode)
+{
+  OutlineFilter filter;
+  filter.matrix(matrix);
+  filter.place(place);
+  filter.width(width);
+  filter.tiledMode(tiledMode);
+  filter.color(kOutlineColor);
+
+  ImageRef dst(Image::createCopy(src));
+  TestFilterManager mgr(src, dst.get());
+  mgr.apply(&filter);
+  return dst;
+}
+
+ImageRef random_sprite(int w, int h)
+{
+  std::mt19937 rng(1);
+  ImageRef image(Image::create(IMAGE_RGB, w, h));
+  for (int y=0; y<h; ++y)
+    for (int x=0; x<w; ++x)
+      put_pixel_fast<RgbTraits>(image.get(), x, y,
+                                (rng() % 13) == 0 ? rgba(0, 0, 255, 255): 0);
+  return image;
+}
+
+void expect_equal_images(const Image* expected, const Image* result)
+{
+  for (int y=0; y<expected->height(); ++y)
+    for (int x=0; x<expected->width(); ++x)
+      ASSERT_EQ(get_pixel_fast<RgbTraits>(expected, x, y),
+                get_pixel_fast<RgbTraits>(result, x, y))
+        << "x=" << x << " y=" << y;
+}
+
+} // anonymous namespace
+
+// Outside outlines with a 3x3 matrix (except the circle) of width N
+// must be the same as applying N times the outline of width 1.
+TEST(OutlineFilter, WidthIsLikeRepeatedOutlines)
+{
+  ImageRef src = random_sprite(41, 29);
+
+  for (Matrix matrix : { Matrix::Square, Matrix::Horizontal,
+                         Matrix::Vertical, Matrix(0421) }) {
+    for (TiledMode tiledMode : { TiledMode::NONE, TiledMode::X_AXIS,
+                                 TiledMode::Y_AXIS, TiledMode::BOTH }) {
+      ImageRef expected(Image::createCopy(src.get()));
+      for (int width=1; width<=4; ++width) {
+        expected = apply_outline(expected.get(), matrix, Place::Outside,
+                                 1, tiledMode);
+        ImageRef result = apply_outline(src.get(), matrix, Place::Outside,
+                                        width, tiledMode);
+        SCOPED_TRACE("matrix=" + std::to_string(int(matrix)) +
+                     " width=" + std::to_string(width) +
+                     " tiledMode=" + std::to_string(int(tiledMode)));
+        expect_equal_images(expected.get(), result.get());
+      }
+    }
+  }
+}
+
+TEST(OutlineFilter, CircleUsesEuclideanDistance)
+{
+  ImageRef src = random_sprite(37, 31);
+
+  for (Place place : { Place::Outside, Place::Inside }) {
+    for (TiledMode tiledMode : { TiledMode::NONE, TiledMode::BOTH }) {
+      for (int width : { 1, 2, 3, 5, 40 }) {
+        const bool tiledX = (int(tiledMode) & int(TiledMode::X_AXIS));
+        const bool tiledY = (int(tiledMode) & int(TiledMode::Y_AXIS));
+        const int w = src->width();
+        const int h = src->height();
+
+        ImageRef expected(Image::createCopy(src.get()));
+        for (int y=0; y<h; ++y)
+          for (int x=0; x<w; ++x) {
+            const bool transparent = (get_pixel_fast<RgbTraits>(src.get(), x, y) == 0);
+            if (transparent != (place == Place::Outside))
+              continue;
+
+            bool found = false;
+            for (int dy=-width; dy<=width && !found; ++dy)
+              for (int dx=-width; dx<=width && !found; ++dx) {
+                if (dx*dx + dy*dy > width*width)
+                  continue;
+                const int u = get_neighboring_coord(x+dx, w, tiledX);
+                const int v = get_neighboring_coord(y+dy, h, tiledY);
+                found = ((get_pixel_fast<RgbTraits>(src.get(), u, v) == 0) != transparent);
+              }
+            if (found)
+              put_pixel_fast<RgbTraits>(expected.get(), x, y, kOutlineColor);
+          }
+
+        ImageRef result = apply_outline(src.get(), Matrix::Circle, place,
+                                        width, tiledMode);
+        SCOPED_TRACE("place=" + std::to_string(int(place)) +
+                     " width=" + std::to_string(width) +
+                     " tiledMode=" + std::to_string(int(tiledMode)));
+        expect_equal_images(expected.get(), result.get());
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
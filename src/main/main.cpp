@@ -14,6 +14,7 @@
 #include "app/console.h"
 #include "app/resource_finder.h"
 #include "app/send_crash.h"
+#include "app/startup_trace.h"
 #include "base/exception.h"
 #include "base/memory.h"
 #include "base/system_console.h"
@@ -125,6 +126,7 @@ int app_main(int argc, char* argv[])
     MemLeak memleak;
     base::SystemConsole systemConsole;
     app::AppOptions options(argc, const_cast<const char**>(argv));
+    app::StartupTrace::start(options.traceStartup());
     os::SystemRef system(os::make_system());
     doc::Palette::initBestfit();
     app::App app;
@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c)      2020 Igara Studio S.A.
+// Copyright (c) 2020-2024 Igara Studio S.A.
 // Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -9,6 +9,9 @@
 #define RENDER_COLOR_HISTOGRAM_H_INCLUDED
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
 #include <limits>
 #include <vector>
 
@@ -17,11 +20,96 @@
 #include "doc/image_traits.h"
 #include "doc/palette.h"
 
+#include "render/kmeans.h"
 #include "render/median_cut.h"
+#include "render/palette_algorithm.h"
+#include "render/wu_quantizer.h"
 
 namespace render {
   using namespace doc;
 
+  // Compact open-addressing hash table (linear probing) with the
+  // number of samples of each non-empty entry of a histogram, so
+  // images with few colors don't need a big array with all the
+  // possible entries.
+  class SparseHistogramCounts {
+  public:
+    // Keys must be less than this value (which is used to mark empty
+    // slots).
+    static constexpr uint32_t kEmptyKey = std::numeric_limits<uint32_t>::max();
+
+    std::size_t size() const { return m_count; }
+
+    std::size_t get(const uint32_t key) const {
+      if (m_entries.empty())
+        return 0;
+      for (std::size_t i=home(key); ; i=(i+1) & mask()) {
+        const Entry& entry = m_entries[i];
+        if (entry.key == key)
+          return entry.count;
+        if (entry.key == kEmptyKey)
+          return 0;
+      }
+    }
+
+    void add(const uint32_t key, const std::size_t count) {
+      // Keep the load factor <= 1/2
+      if ((m_count+1)*2 > m_entries.size())
+        rehash(std::max(kMinCapacity, m_entries.size()*2));
+
+      std::size_t i = home(key);
+      while (m_entries[i].key != kEmptyKey && m_entries[i].key != key)
+        i = (i+1) & mask();
+
+      Entry& entry = m_entries[i];
+      if (entry.key == kEmptyKey) {
+        entry.key = key;
+        ++m_count;
+      }
+      if (entry.count < std::numeric_limits<std::size_t>::max()-count) // Avoid overflow
+        entry.count += count;
+      else
+        entry.count = std::numeric_limits<std::size_t>::max();
+    }
+
+    // Calls func(key, count) for each non-empty entry.
+    template<typename Func>
+    void forEach(Func&& func) const {
+      for (const Entry& entry : m_entries)
+        if (entry.key != kEmptyKey)
+          func(entry.key, entry.count);
+    }
+
+  private:
+    static constexpr std::size_t kMinCapacity = 256;
+
+    struct Entry {
+      uint32_t key = kEmptyKey;
+      std::size_t count = 0;
+    };
+
+    std::size_t mask() const { return m_entries.size()-1; }
+    std::size_t home(const uint32_t key) const {
+      return std::size_t((key * 0x9e3779b1u) >> 8) & mask();
+    }
+
+    void rehash(const std::size_t capacity) {
+      std::vector<Entry> old(capacity);
+      std::swap(old, m_entries);
+      for (const Entry& entry : old) {
+        if (entry.key == kEmptyKey)
+          continue;
+        std::size_t i = home(entry.key);
+        while (m_entries[i].key != kEmptyKey)
+          i = (i+1) & mask();
+        m_entries[i] = entry;
+      }
+    }
+
+    std::vector<Entry> m_entries;
+    std::size_t m_count = 0;
+  };
+
   template<int RBits, // Number of bits for each component in the histogram
            int GBits,
            int BBits,
@@ -36,44 +124,55 @@ namespace render {
       AElements = 1 << ABits
     };
 
+    static_assert(RBits+GBits+BBits+ABits < 32,
+                  "Histogram indexes must be less than SparseHistogramCounts::kEmptyKey");
+
     ColorHistogram()
-      : m_histogram(RElements*GElements*BElements*AElements, 0)
-      , m_useHighPrecision(true) {
+      : m_useHighPrecision(true) {
+      m_highPrecisionSlots.fill(0);
     }
 
     // Returns the number of points in the specified histogram
     // entry. Each rgba-index is in the range of the histogram, e.g.
     // r=[0,RElements), g=[0,GElements), etc.
     std::size_t at(int r, int g, int b, int a) const {
-      return m_histogram[histogramIndex(r, g, b, a)];
+      const std::size_t i = histogramIndex(r, g, b, a);
+      if (!m_dense.empty())
+        return m_dense[i];
+      return m_samples.get(uint32_t(i));
     }
 
     // Add the specified "color" in the histogram as many times as the
     // specified value in "count".
     void addSamples(doc::color_t color, std::size_t count = 1) {
-      int i = histogramIndex(color);
-
-      if (m_histogram[i] < std::numeric_limits<std::size_t>::max()-count) // Avoid overflow
-        m_histogram[i] += count;
-      else
-        m_histogram[i] = std::numeric_limits<std::size_t>::max();
+      m_samples.add(uint32_t(histogramIndex(color)), count);
 
       // Accurate colors are used only for less than 256 colors.  If the
-      // image has more than 256 colors the m_histogram is used
+      // image has more than 256 colors the m_samples are used
       // instead.
-      if (m_useHighPrecision) {
-        std::vector<doc::color_t>::iterator it =
-          std::find(m_highPrecision.begin(), m_highPrecision.end(), color);
-
-        // The color is not in the high-precision table
-        if (it == m_highPrecision.end()) {
-          if (m_highPrecision.size() < 256) {
-            m_highPrecision.push_back(color);
-          }
-          else {
-            // In this case we reach the limit for the high-precision histogram.
-            m_useHighPrecision = false;
-          }
+      if (m_useHighPrecision)
+        addHighPrecisionColor(color);
+    }
+
+    // Adds all the samples of the "other" histogram to this one
+    // (e.g. a histogram fed in other thread). The high-precision
+    // colors of "other" are appended after the colors of this
+    // histogram, so merging histograms of consecutive images in order
+    // gives the same result as feeding one histogram with all the
+    // images.
+    void merge(const ColorHistogram& other) {
+      other.m_samples.forEach([this](const uint32_t key, const std::size_t count){
+        m_samples.add(key, count);
+      });
+
+      if (!other.m_useHighPrecision) {
+        m_useHighPrecision = false;
+      }
+      else {
+        for (doc::color_t color : other.m_highPrecision) {
+          if (!m_useHighPrecision)
+            break;
+          addHighPrecisionColor(color);
         }
       }
     }
@@ -82,7 +181,8 @@ namespace render {
     // with the more important colors in the histogram. Returns the
     // number of used entries in the palette (maybe the range [from,to]
     // is more than necessary).
-    int createOptimizedPalette(Palette* palette) {
+    int createOptimizedPalette(Palette* palette,
+                               const PaletteAlgorithm algorithm = PaletteAlgorithm::MedianCut) {
       // Can we use the high-precision table?
       if (m_useHighPrecision && int(m_highPrecision.size()) <= palette->size()) {
         for (int i=0; i<(int)m_highPrecision.size(); ++i)
@@ -93,8 +193,29 @@ namespace render {
       // OK, we have to use the histogram and some algorithm (like
       // median-cut) to quantize "optimal" colors.
       else {
+        // The algorithms visit all the entries of the histogram, so
+        // we use a dense array just while they are running.
+        m_dense.assign(RElements*GElements*BElements*AElements, 0);
+        m_samples.forEach([this](const uint32_t key, const std::size_t count){
+          m_dense[key] = count;
+        });
+
         std::vector<doc::color_t> result;
-        median_cut(*this, palette->size(), result);
+        switch (algorithm) {
+          case PaletteAlgorithm::Wu:
+            wu_quantizer(*this, palette->size(), result);
+            break;
+          case PaletteAlgorithm::KMeans:
+            wu_quantizer(*this, palette->size(), result);
+            kmeans_refine(*this, result);
+            break;
+          default:
+            median_cut(*this, palette->size(), result);
+            break;
+        }
+
+        m_dense.clear();
+        m_dense.shrink_to_fit();
 
         for (int i=0; i<(int)result.size(); ++i)
           palette->setEntry(i, result[i]);
@@ -106,7 +227,31 @@ namespace render {
     bool isHighPrecision() { return m_useHighPrecision; }
     int highPrecisionSize() { return m_highPrecision.size(); }
 
+    // Number of non-empty entries in the histogram.
+    std::size_t usedEntries() const { return m_samples.size(); }
+
   private:
+    static constexpr int kMaxHighPrecisionColors = 256;
+    static constexpr int kHighPrecisionSlots = 2*kMaxHighPrecisionColors;
+
+    void addHighPrecisionColor(const doc::color_t color) {
+      std::size_t i = ((color * 0x9e3779b1u) >> 8) & (kHighPrecisionSlots-1);
+      for (; m_highPrecisionSlots[i] != 0; i=(i+1) & (kHighPrecisionSlots-1)) {
+        if (m_highPrecision[m_highPrecisionSlots[i]-1] == color)
+          return;
+      }
+
+      // The color is not in the high-precision table
+      if (m_highPrecision.size() < kMaxHighPrecisionColors) {
+        m_highPrecision.push_back(color);
+        m_highPrecisionSlots[i] = uint16_t(m_highPrecision.size());
+      }
+      else {
+        // In this case we reach the limit for the high-precision histogram.
+        m_useHighPrecision = false;
+      }
+    }
+
     // Converts input color in a index for the histogram. It reduces
     // each 8-bit component to the resolution given in the template
     // parameters.
@@ -125,13 +270,22 @@ namespace render {
         | (a << (RBits+GBits+BBits));
     }
 
-    // 3D histogram (the index in the histogram is calculated through histogramIndex() function).
-    std::vector<std::size_t> m_histogram;
+    // 4D histogram with the non-empty entries only (the index in the
+    // histogram is calculated through histogramIndex() function).
+    SparseHistogramCounts m_samples;
+
+    // All the entries of the histogram, used only while
+    // createOptimizedPalette() runs the quantization algorithm.
+    std::vector<std::size_t> m_dense;
 
     // High precision histogram to create an accurate palette if RGB
     // source images contains less than 256 colors.
     std::vector<doc::color_t> m_highPrecision;
 
+    // Hash table (linear probing) with indexes+1 of m_highPrecision
+    // colors (0 means an empty slot).
+    std::array<uint16_t, kHighPrecisionSlots> m_highPrecisionSlots;
+
     // True if we can use m_highPrecision still (it means that the
     // number of different samples is less than 256 colors still).
     bool m_useHighPrecision;
@@ -0,0 +1,163 @@
+// Aseprite Render Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/image_ref.h"
+#include "doc/primitives.h"
+#include "render/color_histogram.h"
+#include "render/quantization.h"
+
+#include <cstdlib>
+#include <map>
+
+using namespace doc;
+using namespace render;
+
+using Histogram = ColorHistogram<5, 6, 5, 5>;
+
+TEST(ColorHistogram, MergeKeepsSamplesAndOrder)
+{
+  const color_t a = rgba(255, 0, 0, 255);
+  const color_t b = rgba(0, 255, 0, 255);
+  const color_t c = rgba(0, 0, 255, 255);
+
+  Histogram serial, first, second;
+  for (color_t color : { a, b, a })
+    serial.addSamples(color);
+  for (color_t color : { c, a })
+    serial.addSamples(color);
+
+  for (color_t color : { a, b, a })
+    first.addSamples(color);
+  for (color_t color : { c, a })
+    second.addSamples(color);
+  first.merge(second);
+
+  EXPECT_EQ(3, first.at(31, 0, 0, 31));
+  EXPECT_EQ(1, first.at(0, 63, 0, 31));
+  EXPECT_EQ(1, first.at(0, 0, 31, 31));
+  EXPECT_TRUE(first.isHighPrecision());
+  EXPECT_EQ(3, first.highPrecisionSize());
+
+  Palette serialPal(0, 256), mergedPal(0, 256);
+  EXPECT_EQ(serial.createOptimizedPalette(&serialPal),
+            first.createOptimizedPalette(&mergedPal));
+  for (int i=0; i<3; ++i)
+    EXPECT_EQ(serialPal.getEntry(i), mergedPal.getEntry(i));
+}
+
+TEST(ColorHistogram, MergeDisablesHighPrecision)
+{
+  Histogram first, second;
+  for (int i=0; i<200; ++i)
+    first.addSamples(rgba(i, 0, 0, 255));
+  for (int i=0; i<200; ++i)
+    second.addSamples(rgba(0, i, 0, 255));
+
+  EXPECT_TRUE(first.isHighPrecision());
+  EXPECT_TRUE(second.isHighPrecision());
+  first.merge(second);
+  EXPECT_FALSE(first.isHighPrecision());
+}
+
+TEST(ColorHistogram, SparseCounts)
+{
+  std::srand(1);
+  std::map<std::size_t, std::size_t> expected;
+  Histogram histogram;
+  for (int i=0; i<20000; ++i) {
+    const int r = std::rand()%32, g = std::rand()%64, b = std::rand()%32;
+    const std::size_t count = 1+std::rand()%4;
+    histogram.addSamples(rgba(r << 3, g << 2, b << 3, 255), count);
+    expected[r | (g << 5) | (b << 11)] += count;
+  }
+  EXPECT_FALSE(histogram.isHighPrecision());
+  EXPECT_EQ(expected.size(), histogram.usedEntries());
+
+  for (int b=0; b<32; ++b)
+    for (int g=0; g<64; ++g)
+      for (int r=0; r<32; ++r) {
+        auto it = expected.find(r | (g << 5) | (b << 11));
+        EXPECT_EQ((it != expected.end() ? it->second: 0),
+                  histogram.at(r, g, b, 31));
+        EXPECT_EQ(0, histogram.at(r, g, b, 0));
+      }
+}
+
+TEST(ColorHistogram, ShardedImageLikeSerial)
+{
+  // Big image (fed in several threads) with more than 256 colors
+  ImageRef image(Image::create(IMAGE_RGB, 512, 512));
+  for (int y=0; y<image->height(); ++y)
+    for (int x=0; x<image->width(); ++x)
+      put_pixel(image.get(), x, y, rgba(x/2, y/2, (x/64)*32, 255));
+
+  PaletteOptimizer sharded, serial;
+  sharded.feedWithImage(image.get(), false);
+  // Small bands are added in this same thread
+  for (int y=0; y<image->height(); y+=8)
+    serial.feedWithImage(image.get(), gfx::Rect(0, y, image->width(), 8), false);
+  EXPECT_FALSE(sharded.isHighPrecision());
+  EXPECT_FALSE(serial.isHighPrecision());
+
+  Palette shardedPal(0, 256), serialPal(0, 256);
+  sharded.calculate(&shardedPal, -1);
+  serial.calculate(&serialPal, -1);
+  ASSERT_EQ(serialPal.size(), shardedPal.size());
+  for (int i=0; i<serialPal.size(); ++i)
+    EXPECT_EQ(serialPal.getEntry(i), shardedPal.getEntry(i));
+}
+
+TEST(ColorHistogram, WuAndKMeansFindClusters)
+{
+  // Four clusters of colors (more than 256 different colors)
+  const color_t centers[] = { rgba(32, 32, 32, 255),
+                              rgba(224, 32, 32, 255),
+                              rgba(32, 224, 32, 255),
+                              rgba(32, 32, 224, 255) };
+  Histogram histogram;
+  for (color_t center : centers) {
+    for (int i=-8; i<8; ++i)
+      for (int j=-8; j<8; ++j)
+        histogram.addSamples(rgba(rgba_getr(center) + i,
+                                  rgba_getg(center) + j,
+                                  rgba_getb(center) + (i ^ j),
+                                  255));
+  }
+  EXPECT_FALSE(histogram.isHighPrecision());
+
+  for (PaletteAlgorithm algo : { PaletteAlgorithm::Wu,
+                                 PaletteAlgorithm::KMeans }) {
+    Palette palette(0, 4);
+    EXPECT_EQ(4, histogram.createOptimizedPalette(&palette, algo));
+
+    // Each cluster must have one palette entry near its center
+    for (color_t center : centers) {
+      bool found = false;
+      for (int i=0; i<4; ++i) {
+        const color_t c = palette.getEntry(i);
+        if (std::abs(rgba_getr(c) - rgba_getr(center)) < 16 &&
+            std::abs(rgba_getg(c) - rgba_getg(center)) < 16 &&
+            std::abs(rgba_getb(c) - rgba_getb(center)) < 16 &&
+            rgba_geta(c) == 255) {
+          found = true;
+        }
+      }
+      EXPECT_TRUE(found);
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
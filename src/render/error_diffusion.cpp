@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019-2022  Igara Studio S.A
+// Copyright (c) 2019-2024  Igara Studio S.A
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -30,8 +30,9 @@ void ErrorDiffusionDither::start(
 {
   m_srcImage = srcImage;
   m_width = 2+srcImage->width();
-  for (int i=0; i<kChannels; ++i)
-    m_err[i].resize(m_width*2, 0);
+  m_err.resize(2*m_width*kChannels, 0);
+  m_curRow = 0;
+  m_nextRow = m_width*kChannels;
   m_lastY = -1;
   m_factor = int(factor * 100.0);
 }
@@ -46,16 +47,16 @@ doc::color_t ErrorDiffusionDither::ditherRgbToIndex2D(
   const doc::Palette* palette)
 {
   if (y != m_lastY) {
-    for (int i=0; i<kChannels; ++i) {
-      int* row0 = &m_err[i][0];
-      int* row1 = row0 + m_width;
-      int* end1 = row1 + m_width;
-      std::copy(row1, end1, row0);
-      std::fill(row1, end1, 0);
-    }
+    std::swap(m_curRow, m_nextRow);
+    std::fill(m_err.begin()+m_nextRow,
+              m_err.begin()+m_nextRow+m_width*kChannels, 0);
     m_lastY = y;
   }
 
+  // Errors of the pixel at x-1 in the current and next rows
+  int* const row0 = &m_err[m_curRow + x*kChannels];
+  int* const row1 = &m_err[m_nextRow + x*kChannels];
+
   doc::color_t color =
     doc::get_pixel_fast<doc::RgbTraits>(m_srcImage, x, y);
 
@@ -67,7 +68,7 @@ doc::color_t ErrorDiffusionDither::ditherRgbToIndex2D(
     doc::rgba_geta(color)
   };
   for (int i=0; i<kChannels; ++i) {
-    v[i] += m_err[i][x+1];
+    v[i] += row0[kChannels+i];
     v[i] = std::clamp(v[i], 0, 255);
   }
 
@@ -90,7 +91,6 @@ doc::color_t ErrorDiffusionDither::ditherRgbToIndex2D(
 
   // TODO using Floyd-Steinberg matrix here but it should be configurable
   for (int i=0; i<kChannels; ++i) {
-    int* err = &m_err[i][x];
     const int q = quantError[i] * m_factor / 100;
     const int a = q * 7 / 16;
     const int b = q * 3 / 16;
@@ -98,16 +98,16 @@ doc::color_t ErrorDiffusionDither::ditherRgbToIndex2D(
     const int d = q * 1 / 16;
 
     if (y & 1) {
-      err[0        ] += a;
-      err[m_width+2] += b;
-      err[m_width+1] += c;
-      err[m_width  ] += d;
+      row0[              i] += a;
+      row1[2*kChannels + i] += b;
+      row1[  kChannels + i] += c;
+      row1[              i] += d;
     }
     else {
-      err[       +2] += a;
-      err[m_width  ] += b;
-      err[m_width+1] += c;
-      err[m_width+2] += d;
+      row0[2*kChannels + i] += a;
+      row1[              i] += b;
+      row1[  kChannels + i] += c;
+      row1[2*kChannels + i] += d;
     }
   }
 
@@ -35,7 +35,12 @@ namespace render {
     const doc::Image* m_srcImage;
     int m_width, m_lastY;
     static const int kChannels = 4;
-    std::vector<int> m_err[kChannels];
+    // Quantization error of the current and next rows, the
+    // kChannels errors of each pixel are stored together. Rows are
+    // swapped (instead of copied) when we move to the next row.
+    std::vector<int> m_err;
+    int m_curRow = 0;
+    int m_nextRow = 0;
     int m_factor;
   };
 
@@ -0,0 +1,115 @@
+// Aseprite Render Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "render/frame_signature.h"
+
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/layer_tilemap.h"
+#include "doc/palette.h"
+#include "doc/sprite.h"
+#include "doc/tileset.h"
+
+#include <cstring>
+
+namespace render {
+
+using namespace doc;
+
+namespace {
+
+inline void hash_combine(uint64_t& seed, const uint64_t value)
+{
+  seed ^= value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+}
+
+inline void hash_combine_double(uint64_t& seed, const double value)
+{
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  hash_combine(seed, bits);
+}
+
+void hash_layer(uint64_t& seed, const Layer* layer, const frame_t frame)
+{
+  hash_combine(seed, layer->id());
+  hash_combine(seed, layer->version());
+  hash_combine(seed, uint64_t(layer->flags()));
+  if (!layer->isVisible())
+    return;
+
+  if (layer->isGroup()) {
+    for (const Layer* child : static_cast<const LayerGroup*>(layer)->layers())
+      hash_layer(seed, child, frame);
+    return;
+  }
+
+  const auto imgLayer = static_cast<const LayerImage*>(layer);
+  hash_combine(seed, uint64_t(imgLayer->blendMode()));
+  hash_combine(seed, uint64_t(imgLayer->opacity()));
+
+  if (layer->isTilemap()) {
+    if (const Tileset* tileset = static_cast<const LayerTilemap*>(layer)->tileset()) {
+      hash_combine(seed, tileset->id());
+      hash_combine(seed, tileset->version());
+    }
+  }
+
+  // Linked cels are different cels (with their own id/version) that
+  // share the same data, so we use the cel data (image, position,
+  // opacity) instead of the cel itself.
+  const Cel* cel = layer->cel(frame);
+  if (!cel) {
+    hash_combine(seed, 0);
+    return;
+  }
+
+  hash_combine(seed, uint64_t(cel->opacity()));
+  hash_combine(seed, uint64_t(uint32_t(cel->zIndex())));
+  if (layer->isReference()) {
+    const gfx::RectF& bounds = cel->boundsF();
+    hash_combine_double(seed, bounds.x);
+    hash_combine_double(seed, bounds.y);
+    hash_combine_double(seed, bounds.w);
+    hash_combine_double(seed, bounds.h);
+  }
+  else {
+    hash_combine(seed, uint64_t(uint32_t(cel->x())) |
+                       (uint64_t(uint32_t(cel->y())) << 32));
+  }
+  if (const Image* image = cel->image()) {
+    hash_combine(seed, image->id());
+    hash_combine(seed, image->version());
+  }
+}
+
+} // anonymous namespace
+
+uint64_t calc_frame_signature(const Sprite* sprite,
+                              const frame_t frame)
+{
+  uint64_t seed = 0;
+  hash_combine(seed, sprite->id());
+  hash_combine(seed, uint64_t(sprite->pixelFormat()));
+  hash_combine(seed, uint64_t(uint32_t(sprite->width())) |
+                     (uint64_t(uint32_t(sprite->height())) << 32));
+  hash_combine(seed, uint64_t(sprite->transparentColor()));
+  hash_layer(seed, sprite->root(), frame);
+
+  // The palette is needed to render indexed images
+  if (const Palette* pal = sprite->palette(frame)) {
+    hash_combine(seed, pal->id());
+    hash_combine(seed, pal->version());
+  }
+  return seed;
+}
+
+} // namespace render
@@ -0,0 +1,35 @@
+// Aseprite Render Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef RENDER_FRAME_SIGNATURE_H_INCLUDED
+#define RENDER_FRAME_SIGNATURE_H_INCLUDED
+#pragma once
+
+#include "doc/frame.h"
+
+#include <cstdint>
+
+namespace doc {
+  class Sprite;
+}
+
+namespace render {
+
+  // Returns a signature of the visible contents of the given sprite
+  // frame (images, positions, opacities, blend modes of visible
+  // layers, and palette). Two frames with the same signature render
+  // the same pixels (e.g. frames with linked cels), so the render of
+  // one of them can be re-used for the other one.
+  //
+  // The frame number itself is not part of the signature, and the
+  // onion skin is not included either (callers must not re-use
+  // renders when the onion skin is visible).
+  uint64_t calc_frame_signature(const doc::Sprite* sprite,
+                                const doc::frame_t frame);
+
+} // namespace render
+
+#endif
@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -9,14 +9,108 @@
 #include "config.h"
 #endif
 
+#include "render/get_sprite_pixel.h"
+
 #include "doc/doc.h"
 #include "gfx/clip.h"
+#include "render/frame_signature.h"
 #include "render/render.h"
 
+#include <cmath>
+#include <mutex>
+
 namespace render {
 
 using namespace doc;
 
+namespace {
+
+// Bigger frames are not cached (to avoid keeping a lot of memory
+// for just one frame).
+constexpr int kMaxCachedPixels = 2048*2048;
+
+// Last composited frame (in sprite coordinates, without zoom) used
+// to get sprite pixels. It's shared by all callers, so dragging the
+// eyedropper or moving the mouse over an editor (which picks the
+// color below the cursor each time) reads pixels from the same image
+// until the frame is modified.
+//
+// The frame is rendered only when the same frame (with the same
+// signature) is picked twice, so one isolated pick is still just a
+// 1x1 render.
+class FrameCache {
+public:
+  static FrameCache& instance() {
+    static FrameCache cache;
+    return cache;
+  }
+
+  // Returns true if "color" was read from the cached frame.
+  bool getPixel(const Sprite* sprite,
+                const frame_t frame,
+                const bool newBlend,
+                const int x, const int y,
+                color_t& color) {
+    const uint64_t key = (calc_frame_signature(sprite, frame) ^
+                          (newBlend ? 0x9e3779b97f4a7c15ull: 0));
+    ImageRef image;
+    {
+      const std::lock_guard lock(m_mutex);
+      if (m_image && m_key == key) {
+        image = m_image;
+      }
+      else if (m_lastMissKey != key) {
+        m_lastMissKey = key;
+        return false;
+      }
+    }
+
+    if (!image) {
+      image.reset(Image::create(sprite->pixelFormat(),
+                                sprite->width(), sprite->height()));
+
+      render::Render render;
+      render.setNewBlend(newBlend);
+      render.setRefLayersVisiblity(true);
+      render.setParallelTileSize(128);
+      render.renderSprite(image.get(), sprite, frame);
+
+      const std::lock_guard lock(m_mutex);
+      m_key = key;
+      m_image = image;
+    }
+
+    color = get_pixel(image.get(), x, y);
+    return true;
+  }
+
+private:
+  std::mutex m_mutex;
+  uint64_t m_key = 0;
+  uint64_t m_lastMissKey = 0;
+  ImageRef m_image;
+};
+
+// Returns true if the 1x1 render with the given projection gives
+// the same pixel as the frame rendered in sprite coordinates.
+bool can_use_frame_cache(const Sprite* sprite,
+                         const Projection& proj)
+{
+  // Reference layers are rendered with sub-pixel precision when
+  // they are zoomed in
+  if (sprite->hasVisibleReferenceLayers())
+    return false;
+
+  // Integer scales only (so the projected pixel is the sprite pixel)
+  const double sx = proj.scaleX();
+  const double sy = proj.scaleY();
+  return (sx >= 1.0 && sy >= 1.0 &&
+          sx == std::floor(sx) && sy == std::floor(sy) &&
+          sprite->width()*sprite->height() <= kMaxCachedPixels);
+}
+
+} // anonymous namespace
+
 color_t get_sprite_pixel(const Sprite* sprite,
                          const double x,
                          const double y,
@@ -28,6 +122,12 @@ color_t get_sprite_pixel(const Sprite* sprite,
 
   if ((x >= 0.0) && (x < sprite->width()) &&
       (y >= 0.0) && (y < sprite->height())) {
+    if (can_use_frame_cache(sprite, proj) &&
+        FrameCache::instance().getPixel(sprite, frame, newBlend,
+                                        int(x), int(y), color)) {
+      return color;
+    }
+
     std::unique_ptr<Image> image(Image::create(sprite->pixelFormat(), 1, 1));
 
     render::Render render;
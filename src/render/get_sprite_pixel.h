@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -23,6 +23,11 @@ namespace render {
   // Gets a pixel from the sprite in the specified position. If in the
   // specified coordinates there're background this routine will
   // return the 0 color (the mask-color).
+  //
+  // When the same frame is picked several times without changes
+  // (e.g. dragging the eyedropper), pixels are read from a cached
+  // render of the whole frame instead of rendering a 1x1 area each
+  // time.
   color_t get_sprite_pixel(const Sprite* sprite,
                            const double x,
                            const double y,
@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019-2020 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -14,8 +14,14 @@
 #include "base/vector2d.h"
 #include "doc/image.h"
 #include "doc/image_impl.h"
+#include "doc/simd.h"
+#include "doc/task_scheduler.h"
 #include "render/dithering_matrix.h"
 
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
 namespace render {
 
 void render_rgba_gradient(
@@ -38,6 +44,184 @@ void render_rgba_gradient(
   }
 }
 
+// Calculates the gradient position "f" of each pixel of a row of a
+// linear gradient: f = ((x, qy) . w) / wmag
+static void linear_gradient_row(double* f, const int width,
+                                const double qx0, const double qyw,
+                                const double wx, const double wmag)
+{
+  int x = 0;
+#if DOC_SIMD_SSE2
+  const __m128d vwx = _mm_set1_pd(wx);
+  const __m128d vqyw = _mm_set1_pd(qyw);
+  const __m128d vwmag = _mm_set1_pd(wmag);
+  for (; x+2<=width; x+=2) {
+    const __m128d qx = _mm_set_pd(qx0+x+1, qx0+x);
+    _mm_storeu_pd(f+x, _mm_div_pd(_mm_add_pd(_mm_mul_pd(qx, vwx), vqyw), vwmag));
+  }
+#elif DOC_SIMD_NEON
+  const float64x2_t vwx = vdupq_n_f64(wx);
+  const float64x2_t vqyw = vdupq_n_f64(qyw);
+  const float64x2_t vwmag = vdupq_n_f64(wmag);
+  for (; x+2<=width; x+=2) {
+    const double qxs[2] = { qx0+x, qx0+x+1 };
+    const float64x2_t qx = vld1q_f64(qxs);
+    vst1q_f64(f+x, vdivq_f64(vaddq_f64(vmulq_f64(qx, vwx), vqyw), vwmag));
+  }
+#endif
+  for (; x<width; ++x)
+    f[x] = ((qx0+x)*wx + qyw) / wmag;
+}
+
+// Calculates the gradient position "f" of each pixel of a row of a
+// radial gradient: f = |((x - cx) / wx, qy)|
+static void radial_gradient_row(double* f, const int width,
+                                const double x0, const double cx,
+                                const double wx, const double qy2)
+{
+  int x = 0;
+#if DOC_SIMD_SSE2
+  const __m128d vcx = _mm_set1_pd(cx);
+  const __m128d vwx = _mm_set1_pd(wx);
+  const __m128d vqy2 = _mm_set1_pd(qy2);
+  for (; x+2<=width; x+=2) {
+    const __m128d qx = _mm_div_pd(_mm_sub_pd(_mm_set_pd(x0+x+1, x0+x), vcx), vwx);
+    _mm_storeu_pd(f+x, _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(qx, qx), vqy2)));
+  }
+#elif DOC_SIMD_NEON
+  const float64x2_t vcx = vdupq_n_f64(cx);
+  const float64x2_t vwx = vdupq_n_f64(wx);
+  const float64x2_t vqy2 = vdupq_n_f64(qy2);
+  for (; x+2<=width; x+=2) {
+    const double xs[2] = { x0+x, x0+x+1 };
+    const float64x2_t qx = vdivq_f64(vsubq_f64(vld1q_f64(xs), vcx), vwx);
+    vst1q_f64(f+x, vsqrtq_f64(vaddq_f64(vmulq_f64(qx, qx), vqy2)));
+  }
+#endif
+  for (; x<width; ++x) {
+    const double qx = (x0+x - cx) / wx;
+    f[x] = std::sqrt(qx*qx + qy2);
+  }
+}
+
+// Interpolates c0 and c1 for each pixel of the row. Values of "f"
+// outside [0, 1] are clamped (which gives exactly c0 or c1).
+static void interpolate_gradient_row(doc::RgbTraits::address_t dst,
+                                     const double* f, const int width,
+                                     const doc::color_t c0,
+                                     const doc::color_t c1)
+{
+  const int r0 = doc::rgba_getr(c0);
+  const int g0 = doc::rgba_getg(c0);
+  const int b0 = doc::rgba_getb(c0);
+  const int a0 = doc::rgba_geta(c0);
+
+  const int r1 = doc::rgba_getr(c1);
+  const int g1 = doc::rgba_getg(c1);
+  const int b1 = doc::rgba_getb(c1);
+  const int a1 = doc::rgba_geta(c1);
+
+  int x = 0;
+#if DOC_SIMD_SSE2
+  const __m128d zero = _mm_setzero_pd();
+  const __m128d one = _mm_set1_pd(1.0);
+  const __m128d eps = _mm_set1_pd(1e-7);
+  const __m128d rg0 = _mm_set_pd(g0, r0);
+  const __m128d ba0 = _mm_set_pd(a0, b0);
+  const __m128d rgd = _mm_set_pd(g1-g0, r1-r0);
+  const __m128d bad = _mm_set_pd(a1-a0, b1-b0);
+  for (; x<width; ++x) {
+    const __m128d t = _mm_min_pd(_mm_max_pd(_mm_set1_pd(f[x]), zero), one);
+    const __m128i rg = _mm_cvttpd_epi32(_mm_add_pd(_mm_add_pd(rg0, _mm_mul_pd(t, rgd)), eps));
+    const __m128i ba = _mm_cvttpd_epi32(_mm_add_pd(_mm_add_pd(ba0, _mm_mul_pd(t, bad)), eps));
+    __m128i c = _mm_unpacklo_epi64(rg, ba);
+    c = _mm_packs_epi32(c, c);
+    c = _mm_packus_epi16(c, c);
+    dst[x] = uint32_t(_mm_cvtsi128_si32(c));
+  }
+#elif DOC_SIMD_NEON
+  const float64x2_t eps = vdupq_n_f64(1e-7);
+  const double rg0s[2] = { double(r0), double(g0) };
+  const double ba0s[2] = { double(b0), double(a0) };
+  const double rgds[2] = { double(r1-r0), double(g1-g0) };
+  const double bads[2] = { double(b1-b0), double(a1-a0) };
+  const float64x2_t rg0 = vld1q_f64(rg0s);
+  const float64x2_t ba0 = vld1q_f64(ba0s);
+  const float64x2_t rgd = vld1q_f64(rgds);
+  const float64x2_t bad = vld1q_f64(bads);
+  for (; x<width; ++x) {
+    const float64x2_t t = vdupq_n_f64(std::clamp(f[x], 0.0, 1.0));
+    const int32x2_t rg = vmovn_s64(vcvtq_s64_f64(vaddq_f64(vaddq_f64(rg0, vmulq_f64(t, rgd)), eps)));
+    const int32x2_t ba = vmovn_s64(vcvtq_s64_f64(vaddq_f64(vaddq_f64(ba0, vmulq_f64(t, bad)), eps)));
+    const uint16x4_t c16 = vqmovun_s32(vcombine_s32(rg, ba));
+    const uint8x8_t c8 = vqmovn_u16(vcombine_u16(c16, c16));
+    dst[x] = vget_lane_u32(vreinterpret_u32_u8(c8), 0);
+  }
+#endif
+  for (; x<width; ++x) {
+    const double t = std::clamp(f[x], 0.0, 1.0);
+    dst[x] = doc::rgba(int(r0 + t*(r1-r0) + 1e-7),
+                       int(g0 + t*(g1-g0) + 1e-7),
+                       int(b0 + t*(b1-b0) + 1e-7),
+                       int(a0 + t*(a1-a0) + 1e-7));
+  }
+}
+
+// Chooses c0 or c1 for each pixel of the row "y" comparing "f" with
+// the dithering matrix.
+static void dither_gradient_row(doc::RgbTraits::address_t dst,
+                                const double* f, const int width,
+                                const int y,
+                                const render::DitheringMatrix& matrix,
+                                const doc::color_t c0,
+                                const doc::color_t c1)
+{
+  const double m = matrix.maxValue()+2;
+  for (int x=0; x<width; ++x)
+    dst[x] = (f[x]*m < matrix(y, x)+1 ? c0: c1);
+}
+
+// Fills each row of the image calling rowFunc(f, y) to get the
+// gradient positions of the row. Rows are rendered in parallel.
+template<typename RowFunc>
+static void render_rgba_gradient_rows(doc::Image* img,
+                                      doc::color_t c0,
+                                      doc::color_t c1,
+                                      const render::DitheringMatrix& matrix,
+                                      RowFunc&& rowFunc)
+{
+  // As we use non-premultiplied RGB values, we need correct RGB
+  // values on each stop. So in case that one color has alpha=0
+  // (complete transparent), use the RGB values of the
+  // non-transparent color in the other stop point.
+  if (doc::rgba_geta(c0) == 0 &&
+      doc::rgba_geta(c1) != 0) {
+    c0 = (c1 & doc::rgba_rgb_mask);
+  }
+  else if (doc::rgba_geta(c0) != 0 &&
+           doc::rgba_geta(c1) == 0) {
+    c1 = (c0 & doc::rgba_rgb_mask);
+  }
+
+  const int width = img->width();
+  const bool dither = (matrix.rows() != 1 || matrix.cols() != 1);
+
+  doc::parallel_for(
+    0, img->height(), 16,
+    [img, width, c0, c1, dither, &matrix, &rowFunc](const int from, const int to){
+      std::vector<double> f(width);
+      for (int y=from; y<to; ++y) {
+        auto dst = (doc::RgbTraits::address_t)img->getPixelAddress(0, y);
+        rowFunc(f.data(), y);
+        if (dither)
+          dither_gradient_row(dst, f.data(), width, y, matrix, c0, c1);
+        else
+          interpolate_gradient_row(dst, f.data(), width, c0, c1);
+      }
+    },
+    doc::TaskPriority::UICritical);
+}
+
 void render_rgba_linear_gradient(
   doc::Image* img,
   const gfx::Point imgPos,
@@ -66,68 +250,14 @@ void render_rgba_linear_gradient(
   const double wmag = w.magnitude();
   w = w.normalize();
 
-  // As we use non-premultiplied RGB values, we need correct RGB
-  // values on each stop. So in case that one color has alpha=0
-  // (complete transparent), use the RGB values of the
-  // non-transparent color in the other stop point.
-  if (doc::rgba_geta(c0) == 0 &&
-      doc::rgba_geta(c1) != 0) {
-    c0 = (c1 & doc::rgba_rgb_mask);
-  }
-  else if (doc::rgba_geta(c0) != 0 &&
-           doc::rgba_geta(c1) == 0) {
-    c1 = (c0 & doc::rgba_rgb_mask);
-  }
-
-  const uint8_t r0 = doc::rgba_getr(c0);
-  const uint8_t g0 = doc::rgba_getg(c0);
-  const uint8_t b0 = doc::rgba_getb(c0);
-  const uint8_t a0 = doc::rgba_geta(c0);
-
-  const uint8_t r1 = doc::rgba_getr(c1);
-  const uint8_t g1 = doc::rgba_getg(c1);
-  const uint8_t b1 = doc::rgba_getb(c1);
-  const uint8_t a1 = doc::rgba_geta(c1);
-
-  doc::LockImageBits<doc::RgbTraits> bits(img);
-  auto it = bits.begin();
+  // f is (q-u)*w/wmag, where q is the pixel position
   const int width = img->width();
-  const int height = img->height();
-
-  if (matrix.rows() == 1 && matrix.cols() == 1) {
-    for (int y=0; y<height; ++y) {
-      for (int x=0; x<width; ++x, ++it) {
-        base::Vector2d<double> q(imgPos.x+x,
-                                 imgPos.y+y);
-        q -= u;
-        double f = (q * w) / wmag;
-
-        doc::color_t c;
-        if (f < 0.0) c = c0;
-        else if (f > 1.0) c = c1;
-        else {
-          c = doc::rgba(int(r0 + f*(r1-r0) + 1e-7),
-                        int(g0 + f*(g1-g0) + 1e-7),
-                        int(b0 + f*(b1-b0) + 1e-7),
-                        int(a0 + f*(a1-a0) + 1e-7));
-        }
-
-        *it = c;
-      }
-    }
-  }
-  else {
-    for (int y=0; y<height; ++y) {
-      for (int x=0; x<width; ++x, ++it) {
-        base::Vector2d<double> q(imgPos.x+x,
-                                 imgPos.y+y);
-        q -= u;
-        double f = (q * w) / wmag;
-
-        *it = (f*(matrix.maxValue()+2) < matrix(y, x)+1 ? c0: c1);
-      }
-    }
-  }
+  render_rgba_gradient_rows(
+    img, c0, c1, matrix,
+    [imgPos, u, w, wmag, width](double* f, const int y){
+      const double qyw = (imgPos.y+y - u.y) * w.y;
+      linear_gradient_row(f, width, imgPos.x - u.x, qyw, w.x, wmag);
+    });
 }
 
 void render_rgba_radial_gradient(
@@ -157,72 +287,17 @@ void render_rgba_radial_gradient(
     return;
   }
 
-  // As we use non-premultiplied RGB values, we need correct RGB
-  // values on each stop. So in case that one color has alpha=0
-  // (complete transparent), use the RGB values of the
-  // non-transparent color in the other stop point.
-  if (doc::rgba_geta(c0) == 0 &&
-      doc::rgba_geta(c1) != 0) {
-    c0 = (c1 & doc::rgba_rgb_mask);
-  }
-  else if (doc::rgba_geta(c0) != 0 &&
-           doc::rgba_geta(c1) == 0) {
-    c1 = (c0 & doc::rgba_rgb_mask);
-  }
+  const base::Vector2d<double> c = (u+v)/2;
+  const double wx = std::fabs(w.x);
+  const double wy = std::fabs(w.y);
 
-  const uint8_t r0 = doc::rgba_getr(c0);
-  const uint8_t g0 = doc::rgba_getg(c0);
-  const uint8_t b0 = doc::rgba_getb(c0);
-  const uint8_t a0 = doc::rgba_geta(c0);
-
-  const uint8_t r1 = doc::rgba_getr(c1);
-  const uint8_t g1 = doc::rgba_getg(c1);
-  const uint8_t b1 = doc::rgba_getb(c1);
-  const uint8_t a1 = doc::rgba_geta(c1);
-
-  doc::LockImageBits<doc::RgbTraits> bits(img);
-  auto it = bits.begin();
   const int width = img->width();
-  const int height = img->height();
-
-  if (matrix.rows() == 1 && matrix.cols() == 1) {
-    for (int y=0; y<height; ++y) {
-      for (int x=0; x<width; ++x, ++it) {
-        base::Vector2d<double> q(imgPos.x+x,
-                                 imgPos.y+y);
-        q -= (u+v)/2;
-        q.x /= std::fabs(w.x);
-        q.y /= std::fabs(w.y);
-        double f = std::sqrt(q.x*q.x + q.y*q.y);
-
-        doc::color_t c;
-        if (f < 0.0) c = c0;
-        else if (f > 1.0) c = c1;
-        else {
-          c = doc::rgba(int(r0 + f*(r1-r0) + 1e-7),
-                        int(g0 + f*(g1-g0) + 1e-7),
-                        int(b0 + f*(b1-b0) + 1e-7),
-                        int(a0 + f*(a1-a0) + 1e-7));
-        }
-
-        *it = c;
-      }
-    }
-  }
-  else {
-    for (int y=0; y<height; ++y) {
-      for (int x=0; x<width; ++x, ++it) {
-        base::Vector2d<double> q(imgPos.x+x,
-                                 imgPos.y+y);
-        q -= (u+v)/2;
-        q.x /= std::fabs(w.x);
-        q.y /= std::fabs(w.y);
-        double f = std::sqrt(q.x*q.x + q.y*q.y);
-
-        *it = (f*(matrix.maxValue()+2) < matrix(y, x)+1 ? c0: c1);
-      }
-    }
-  }
+  render_rgba_gradient_rows(
+    img, c0, c1, matrix,
+    [imgPos, c, wx, wy, width](double* f, const int y){
+      const double qy = (imgPos.y+y - c.y) / wy;
+      radial_gradient_row(f, width, imgPos.x, c.x, wx, qy*qy);
+    });
 }
 
 template<typename ImageTraits>
@@ -0,0 +1,120 @@
+// Aseprite Render Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "base/vector2d.h"
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "render/dithering_matrix.h"
+#include "render/gradient.h"
+#include "render/ordered_dither.h"
+
+#include <cmath>
+#include <cstdlib>
+
+using namespace doc;
+using namespace render;
+
+// Per-pixel gradient position like the original scalar implementation
+static double expected_f(const GradientType type,
+                         const gfx::Point& imgPos,
+                         const gfx::Point& p0,
+                         const gfx::Point& p1,
+                         const int x, const int y)
+{
+  base::Vector2d<double>
+    u(p0.x, p0.y),
+    v(p1.x, p1.y),
+    q(imgPos.x+x, imgPos.y+y);
+
+  if (type == GradientType::Linear) {
+    base::Vector2d<double> w = v - u;
+    const double wmag = w.magnitude();
+    w = w.normalize();
+    q -= u;
+    return (q * w) / wmag;
+  }
+  else {
+    const base::Vector2d<double> w = (v - u) / 2;
+    q -= (u+v)/2;
+    q.x /= std::fabs(w.x);
+    q.y /= std::fabs(w.y);
+    return std::sqrt(q.x*q.x + q.y*q.y);
+  }
+}
+
+static color_t expected_color(const double f,
+                              const color_t c0,
+                              const color_t c1)
+{
+  if (f < 0.0) return c0;
+  if (f > 1.0) return c1;
+  return rgba(int(rgba_getr(c0) + f*(rgba_getr(c1)-rgba_getr(c0)) + 1e-7),
+              int(rgba_getg(c0) + f*(rgba_getg(c1)-rgba_getg(c0)) + 1e-7),
+              int(rgba_getb(c0) + f*(rgba_getb(c1)-rgba_getb(c0)) + 1e-7),
+              int(rgba_geta(c0) + f*(rgba_geta(c1)-rgba_geta(c0)) + 1e-7));
+}
+
+TEST(Gradient, LikePerPixelFormula)
+{
+  std::srand(1);
+  const DitheringMatrix noDither;
+  const BayerMatrix bayer(4);
+
+  for (int i=0; i<50; ++i) {
+    // Odd sizes to test the remaining pixels of each SIMD loop
+    ImageRef img(Image::create(IMAGE_RGB, 1+std::rand()%67, 1+std::rand()%33));
+    const gfx::Point imgPos(std::rand()%16, std::rand()%16);
+    const gfx::Point p0(std::rand()%100 - 20, std::rand()%60 - 20);
+    const gfx::Point p1(std::rand()%100 - 20, std::rand()%60 - 20);
+    const color_t c0 = rgba(std::rand()%256, std::rand()%256, std::rand()%256, 1+std::rand()%255);
+    const color_t c1 = rgba(std::rand()%256, std::rand()%256, std::rand()%256, 1+std::rand()%255);
+    if (p0.x == p1.x || p0.y == p1.y)
+      continue;
+
+    for (const GradientType type : { GradientType::Linear,
+                                     GradientType::Radial }) {
+      render_rgba_gradient(img.get(), imgPos, p0, p1, c0, c1, noDither, type);
+      for (int y=0; y<img->height(); ++y) {
+        for (int x=0; x<img->width(); ++x) {
+          const double f = expected_f(type, imgPos, p0, p1, x, y);
+          ASSERT_EQ(expected_color(f, c0, c1), img->getPixel(x, y));
+        }
+      }
+
+      render_rgba_gradient(img.get(), imgPos, p0, p1, c0, c1, bayer, type);
+      for (int y=0; y<img->height(); ++y) {
+        for (int x=0; x<img->width(); ++x) {
+          const double f = expected_f(type, imgPos, p0, p1, x, y);
+          ASSERT_EQ((f*(bayer.maxValue()+2) < bayer(y, x)+1 ? c0: c1),
+                    img->getPixel(x, y));
+        }
+      }
+    }
+  }
+}
+
+TEST(Gradient, TransparentStopUsesOtherColor)
+{
+  ImageRef img(Image::create(IMAGE_RGB, 11, 1));
+  render_rgba_linear_gradient(img.get(), gfx::Point(0, 0),
+                              gfx::Point(0, 0), gfx::Point(10, 0),
+                              rgba(0, 0, 0, 0), rgba(255, 128, 64, 255),
+                              DitheringMatrix());
+  EXPECT_EQ(rgba(255, 128, 64, 0), img->getPixel(0, 0));
+  EXPECT_EQ(rgba(255, 128, 64, 255), img->getPixel(10, 0));
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,226 @@
+// Aseprite Render Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "render/group_cache.h"
+
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/layer_tilemap.h"
+#include "doc/palette.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+#include "doc/tileset.h"
+#include "render/render_counters.h"
+
+#include <algorithm>
+#include <exception>
+
+namespace render {
+
+using namespace doc;
+
+namespace {
+
+inline void hash_combine(uint64_t& seed, const uint64_t value)
+{
+  seed ^= value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+}
+
+void hash_layer(uint64_t& seed, const Layer* layer, const frame_t frame)
+{
+  hash_combine(seed, layer->id());
+  hash_combine(seed, layer->version());
+  hash_combine(seed, uint64_t(layer->flags()));
+  if (!layer->isVisible())
+    return;
+
+  if (layer->isGroup()) {
+    for (const Layer* child : static_cast<const LayerGroup*>(layer)->layers())
+      hash_layer(seed, child, frame);
+    return;
+  }
+
+  const auto imgLayer = static_cast<const LayerImage*>(layer);
+  hash_combine(seed, uint64_t(imgLayer->blendMode()));
+  hash_combine(seed, uint64_t(imgLayer->opacity()));
+
+  if (layer->isTilemap()) {
+    if (const Tileset* tileset = static_cast<const LayerTilemap*>(layer)->tileset()) {
+      hash_combine(seed, tileset->id());
+      hash_combine(seed, tileset->version());
+    }
+  }
+
+  if (const Cel* cel = layer->cel(frame)) {
+    hash_combine(seed, cel->id());
+    hash_combine(seed, cel->version());
+    hash_combine(seed, uint64_t(cel->opacity()));
+    hash_combine(seed, uint64_t(uint32_t(cel->zIndex())));
+    hash_combine(seed, uint64_t(uint32_t(cel->x())) |
+                       (uint64_t(uint32_t(cel->y())) << 32));
+    if (const Image* image = cel->image()) {
+      hash_combine(seed, image->id());
+      hash_combine(seed, image->version());
+    }
+  }
+}
+
+} // anonymous namespace
+
+GroupCache::GroupCache(const int maxEntries)
+  : m_maxEntries(std::max(1, maxEntries))
+{
+}
+
+uint32_t GroupCache::newPass()
+{
+  const std::lock_guard lock(m_mutex);
+  return ++m_passCounter;
+}
+
+ImageRef GroupCache::getImage(const Layer* group,
+                              const frame_t frame,
+                              const RenderFunc& renderFunc)
+{
+  return getImage(group, frame, group->sprite()->spec(), 0, renderFunc);
+}
+
+ImageRef GroupCache::getImage(const Layer* group,
+                              const frame_t frame,
+                              const ImageSpec& spec,
+                              const uint64_t variant,
+                              const RenderFunc& renderFunc)
+{
+  return getImage(group, frame, spec, variant, 0, false, renderFunc);
+}
+
+ImageRef GroupCache::getUnchangedImage(const Layer* group,
+                                       const frame_t frame,
+                                       const ImageSpec& spec,
+                                       const uint64_t variant,
+                                       const uint32_t pass,
+                                       const RenderFunc& renderFunc)
+{
+  return getImage(group, frame, spec, variant, pass, true, renderFunc);
+}
+
+ImageRef GroupCache::getImage(const Layer* group,
+                              const frame_t frame,
+                              const ImageSpec& spec,
+                              const uint64_t variant,
+                              const uint32_t pass,
+                              const bool onlyUnchanged,
+                              const RenderFunc& renderFunc)
+{
+  const uint64_t signature = calcSignature(group, frame);
+  const auto sameKey =
+    [group, frame, variant](const Entry& entry){
+      return (entry.groupId == group->id() &&
+              entry.frame == frame &&
+              entry.variant == variant);
+    };
+
+  std::promise<ImageRef> promise;
+  {
+    std::unique_lock lock(m_mutex);
+    ++m_useCounter;
+
+    auto it = std::find_if(m_entries.begin(), m_entries.end(), sameKey);
+    if (it == m_entries.end()) {
+      // Remove the least recently used entry
+      if (int(m_entries.size()) >= m_maxEntries) {
+        m_entries.erase(
+          std::min_element(m_entries.begin(), m_entries.end(),
+                           [](const Entry& a, const Entry& b){
+                             return a.lastUse < b.lastUse;
+                           }));
+      }
+      m_entries.emplace_back();
+      it = m_entries.end()-1;
+      it->groupId = group->id();
+      it->frame = frame;
+      it->variant = variant;
+      it->signature = signature;
+      it->pass = pass;
+      it->spec = spec;
+    }
+    else if (it->signature != signature ||
+             it->spec != spec) {
+      it->signature = signature;
+      it->pass = pass;
+      it->spec = spec;
+      it->image = std::shared_future<ImageRef>();
+    }
+    it->lastUse = m_useCounter;
+
+    // The image is ready or other thread is rendering it
+    if (it->image.valid()) {
+      std::shared_future<ImageRef> future = it->image;
+      lock.unlock();
+
+      RenderCounters::add(RenderCounters::CacheHits, 1);
+      return future.get();
+    }
+
+    // The group changed in this same pass
+    if (onlyUnchanged && it->pass == pass)
+      return nullptr;
+
+    it->image = promise.get_future().share();
+  }
+
+  // Render the group outside the lock (so other threads can use the
+  // cache in the meantime) and in a new image (the old one can be
+  // in use by other threads)
+  RenderCounters::add(RenderCounters::CacheMisses, 1);
+  try {
+    ImageRef image(Image::create(spec));
+    clear_image(image.get(), spec.maskColor());
+    renderFunc(image.get());
+    promise.set_value(image);
+    return image;
+  }
+  catch (...) {
+    promise.set_exception(std::current_exception());
+
+    // Try to render the image again in the next call
+    const std::lock_guard lock(m_mutex);
+    auto it = std::find_if(m_entries.begin(), m_entries.end(), sameKey);
+    if (it != m_entries.end() && it->signature == signature)
+      it->image = std::shared_future<ImageRef>();
+    throw;
+  }
+}
+
+void GroupCache::clear()
+{
+  const std::lock_guard lock(m_mutex);
+  m_entries.clear();
+}
+
+// static
+uint64_t GroupCache::calcSignature(const Layer* group,
+                                   const frame_t frame)
+{
+  uint64_t seed = 0;
+  hash_layer(seed, group, frame);
+
+  // The palette is needed to flatten indexed images in RGB
+  const Sprite* sprite = group->sprite();
+  if (const Palette* pal = sprite->palette(frame)) {
+    hash_combine(seed, pal->id());
+    hash_combine(seed, pal->version());
+  }
+  hash_combine(seed, uint64_t(sprite->transparentColor()));
+  return seed;
+}
+
+} // namespace render
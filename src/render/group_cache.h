@@ -0,0 +1,119 @@
+// Aseprite Render Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef RENDER_GROUP_CACHE_H_INCLUDED
+#define RENDER_GROUP_CACHE_H_INCLUDED
+#pragma once
+
+#include "doc/frame.h"
+#include "doc/image_ref.h"
+#include "doc/image_spec.h"
+#include "doc/object_id.h"
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <vector>
+
+namespace doc {
+  class Layer;
+}
+
+namespace render {
+
+  // Keeps the flattened image (in sprite coordinates, without
+  // zoom) of layer groups so a group which didn't change can be
+  // composited as just one image (see Render::setGroupCache() and
+  // Render::setOnionskinCache()).
+  //
+  // Each cached image is validated against a signature of the whole
+  // subtree (versions of layers, cels and images, positions,
+  // opacities, flags, etc.).
+  //
+  // If several threads need the same image at the same time (e.g.
+  // tiles of a parallel render), it's rendered just once and the
+  // other threads wait for it.
+  class GroupCache {
+  public:
+    using RenderFunc = std::function<void(doc::Image* dst)>;
+
+    GroupCache(const int maxEntries = 32);
+
+    // Returns the ID of a new render pass for getUnchangedImage().
+    // All the calls of the same render (e.g. all tiles of a parallel
+    // render) must use the same pass.
+    uint32_t newPass();
+
+    // Returns the flattened image of the given group/frame. If the
+    // cached image is not valid anymore, it's re-created calling
+    // renderFunc() (which must render the group in the given image).
+    // renderFunc() is called without locking the cache, so other
+    // groups can be rendered from other threads at the same time.
+    doc::ImageRef getImage(const doc::Layer* group,
+                           const doc::frame_t frame,
+                           const RenderFunc& renderFunc);
+
+    // Same as above, but the image is created with the given spec,
+    // and "variant" identifies different images of the same
+    // group/frame (e.g. rendered with different options).
+    doc::ImageRef getImage(const doc::Layer* group,
+                           const doc::frame_t frame,
+                           const doc::ImageSpec& spec,
+                           const uint64_t variant,
+                           const RenderFunc& renderFunc);
+
+    // Same as above, but returns nullptr if the group changed in the
+    // given render pass (i.e. its signature is different than in
+    // previous passes), so the caller can render it directly (just
+    // the needed area) instead of flattening the whole group again
+    // and again while it's being edited. The image is created only
+    // when the same signature is found in a later pass.
+    doc::ImageRef getUnchangedImage(const doc::Layer* group,
+                                    const doc::frame_t frame,
+                                    const doc::ImageSpec& spec,
+                                    const uint64_t variant,
+                                    const uint32_t pass,
+                                    const RenderFunc& renderFunc);
+
+    void clear();
+
+    static uint64_t calcSignature(const doc::Layer* group,
+                                  const doc::frame_t frame);
+
+  private:
+    struct Entry {
+      doc::ObjectId groupId = doc::NullId;
+      doc::frame_t frame = 0;
+      uint64_t variant = 0;
+      uint64_t signature = 0;
+      // Render pass where this signature was found the first time
+      uint32_t pass = 0;
+      uint32_t lastUse = 0;
+      doc::ImageSpec spec = doc::ImageSpec(doc::ColorMode::RGB, 0, 0);
+      // Not valid if the image wasn't requested yet, or not ready
+      // if it's being rendered by other thread
+      std::shared_future<doc::ImageRef> image;
+    };
+
+    doc::ImageRef getImage(const doc::Layer* group,
+                           const doc::frame_t frame,
+                           const doc::ImageSpec& spec,
+                           const uint64_t variant,
+                           const uint32_t pass,
+                           const bool onlyUnchanged,
+                           const RenderFunc& renderFunc);
+
+    std::mutex m_mutex;
+    std::vector<Entry> m_entries;
+    int m_maxEntries;
+    uint32_t m_useCounter = 0;
+    uint32_t m_passCounter = 0;
+  };
+
+} // namespace render
+
+#endif
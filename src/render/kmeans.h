@@ -0,0 +1,142 @@
+// Aseprite Render Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef RENDER_KMEANS_H_INCLUDED
+#define RENDER_KMEANS_H_INCLUDED
+#pragma once
+
+#include "base/thread_pool.h"
+#include "doc/color.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <thread>
+#include <vector>
+
+namespace render {
+
+  // Refines the given "colors" with the k-means algorithm (Lloyd's
+  // iterations) using the samples of the histogram as weighted
+  // points. The colors can be generated previously by any other
+  // quantization algorithm (e.g. wu_quantizer()).
+  //
+  // Points are assigned to their nearest color from several threads,
+  // and each thread accumulates the sums of its own points in
+  // integers, so the result doesn't depend on the number of threads.
+  template<class Histogram>
+  void kmeans_refine(const Histogram& histogram,
+                     std::vector<doc::color_t>& colors,
+                     const int maxIterations = 16) {
+    const int k = int(colors.size());
+    if (k == 0)
+      return;
+
+    struct Point {
+      int r, g, b, a;
+      std::size_t n;
+    };
+    std::vector<Point> points;
+    for (int l=0; l<Histogram::AElements; ++l)
+      for (int z=0; z<Histogram::BElements; ++z)
+        for (int j=0; j<Histogram::GElements; ++j)
+          for (int i=0; i<Histogram::RElements; ++i) {
+            const std::size_t n = histogram.at(i, j, z, l);
+            if (n > 0)
+              points.push_back(Point{ 255 * i / (Histogram::RElements-1),
+                                      255 * j / (Histogram::GElements-1),
+                                      255 * z / (Histogram::BElements-1),
+                                      255 * l / (Histogram::AElements-1),
+                                      n });
+          }
+    if (points.empty())
+      return;
+
+    struct Sum {
+      uint64_t r = 0, g = 0, b = 0, a = 0, n = 0;
+    };
+
+    const int nthreads = std::clamp<int>(
+      std::min<int>(std::thread::hardware_concurrency(),
+                    int(points.size() / 4096)), 1, 8);
+    base::thread_pool pool(nthreads);
+    std::vector<int> assignments(points.size(), -1);
+    std::vector<std::vector<Sum>> sums(nthreads);
+
+    for (int iter=0; iter<maxIterations; ++iter) {
+      std::atomic<bool> changed(false);
+
+      for (int t=0; t<nthreads; ++t) {
+        pool.execute([&, t]{
+          std::vector<Sum>& threadSums = sums[t];
+          threadSums.assign(k, Sum());
+          bool threadChanged = false;
+
+          const std::size_t i0 = points.size() * t / nthreads;
+          const std::size_t i1 = points.size() * (t+1) / nthreads;
+          for (std::size_t i=i0; i<i1; ++i) {
+            const Point& p = points[i];
+            int best = 0;
+            int bestDist = std::numeric_limits<int>::max();
+            for (int c=0; c<k; ++c) {
+              const int dr = p.r - int(doc::rgba_getr(colors[c]));
+              const int dg = p.g - int(doc::rgba_getg(colors[c]));
+              const int db = p.b - int(doc::rgba_getb(colors[c]));
+              const int da = p.a - int(doc::rgba_geta(colors[c]));
+              const int dist = dr*dr + dg*dg + db*db + da*da;
+              if (dist < bestDist) {
+                bestDist = dist;
+                best = c;
+              }
+            }
+
+            if (assignments[i] != best) {
+              assignments[i] = best;
+              threadChanged = true;
+            }
+
+            Sum& s = threadSums[best];
+            s.r += uint64_t(p.r) * p.n;
+            s.g += uint64_t(p.g) * p.n;
+            s.b += uint64_t(p.b) * p.n;
+            s.a += uint64_t(p.a) * p.n;
+            s.n += p.n;
+          }
+
+          if (threadChanged)
+            changed = true;
+        });
+      }
+      pool.wait_all();
+
+      if (!changed)
+        break;
+
+      // Move each color to the mean of its points (colors without
+      // points are kept in their current position)
+      for (int c=0; c<k; ++c) {
+        Sum s;
+        for (const auto& threadSums : sums) {
+          s.r += threadSums[c].r;
+          s.g += threadSums[c].g;
+          s.b += threadSums[c].b;
+          s.a += threadSums[c].a;
+          s.n += threadSums[c].n;
+        }
+        if (s.n > 0) {
+          colors[c] = doc::rgba(int((s.r + s.n/2) / s.n),
+                                int((s.g + s.n/2) / s.n),
+                                int((s.b + s.n/2) / s.n),
+                                int((s.a + s.n/2) / s.n));
+        }
+      }
+    }
+  }
+
+} // namespace render
+
+#endif
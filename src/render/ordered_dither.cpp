@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019-2022  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -11,6 +11,7 @@
 
 #include "render/ordered_dither.h"
 
+#include "doc/simd.h"
 #include "render/dithering.h"
 #include "render/dithering_matrix.h"
 
@@ -20,6 +21,9 @@
 
 namespace render {
 
+// Number of pixels converted in each batch of ditherRgbSpanToIndex()
+static constexpr int kSpanSize = 64;
+
 // Base 2x2 dither matrix, called D(2):
 int BayerMatrix::D2[4] = { 0, 2,
                            3, 1 };
@@ -40,6 +44,103 @@ static int colorDistance(int r1, int g1, int b1, int a1,
   return result;
 }
 
+// Calculates the color in the other side of each original color
+// with respect to its nearest palette entry, i.e. clamp(2*c - p) for
+// each component.
+static void mirror_colors(const doc::color_t* colors,
+                          const doc::color_t* nearest,
+                          doc::color_t* result,
+                          const int n)
+{
+  int i = 0;
+
+#if DOC_SIMD_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  for (; i+4<=n; i+=4) {
+    const __m128i c = _mm_loadu_si128((const __m128i*)(colors+i));
+    const __m128i p = _mm_loadu_si128((const __m128i*)(nearest+i));
+    const __m128i lo = _mm_sub_epi16(_mm_slli_epi16(_mm_unpacklo_epi8(c, zero), 1),
+                                     _mm_unpacklo_epi8(p, zero));
+    const __m128i hi = _mm_sub_epi16(_mm_slli_epi16(_mm_unpackhi_epi8(c, zero), 1),
+                                     _mm_unpackhi_epi8(p, zero));
+    // Saturated pack = clamp each component to [0, 255]
+    _mm_storeu_si128((__m128i*)(result+i), _mm_packus_epi16(lo, hi));
+  }
+#elif DOC_SIMD_NEON
+  for (; i+4<=n; i+=4) {
+    const uint8x16_t c = vld1q_u8((const uint8_t*)(colors+i));
+    const uint8x16_t p = vld1q_u8((const uint8_t*)(nearest+i));
+    const int16x8_t lo = vsubq_s16(vreinterpretq_s16_u16(vshll_n_u8(vget_low_u8(c), 1)),
+                                   vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(p))));
+    const int16x8_t hi = vsubq_s16(vreinterpretq_s16_u16(vshll_n_u8(vget_high_u8(c), 1)),
+                                   vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(p))));
+    // Saturated narrow = clamp each component to [0, 255]
+    vst1q_u8((uint8_t*)(result+i), vcombine_u8(vqmovun_s16(lo), vqmovun_s16(hi)));
+  }
+#endif
+
+  for (; i<n; ++i) {
+    const doc::color_t c = colors[i];
+    const doc::color_t p = nearest[i];
+    result[i] = doc::rgba(
+      std::clamp(2*int(doc::rgba_getr(c)) - int(doc::rgba_getr(p)), 0, 255),
+      std::clamp(2*int(doc::rgba_getg(c)) - int(doc::rgba_getg(p)), 0, 255),
+      std::clamp(2*int(doc::rgba_getb(c)) - int(doc::rgba_getb(p)), 0, 255),
+      std::clamp(2*int(doc::rgba_geta(c)) - int(doc::rgba_geta(p)), 0, 255));
+  }
+}
+
+// Chooses between the two nearest palette entries of the given
+// 'color' using the threshold of the dither matrix.
+static doc::color_t choose_nearest(
+  const DitheringMatrix& matrix,
+  const doc::color_t color,
+  const int x,
+  const int y,
+  const doc::color_t nearest1idx,
+  const doc::color_t nearest2idx,
+  const doc::Palette* palette)
+{
+  // If both possible RGB colors use the same index, we cannot
+  // make any dither with these two colors.
+  if (nearest1idx == nearest2idx)
+    return nearest1idx;
+
+  const int r = doc::rgba_getr(color);
+  const int g = doc::rgba_getg(color);
+  const int b = doc::rgba_getb(color);
+  const int a = doc::rgba_geta(color);
+
+  const doc::color_t nearest1rgb = palette->getEntry(nearest1idx);
+  const int r1 = doc::rgba_getr(nearest1rgb);
+  const int g1 = doc::rgba_getg(nearest1rgb);
+  const int b1 = doc::rgba_getb(nearest1rgb);
+  const int a1 = doc::rgba_geta(nearest1rgb);
+
+  const doc::color_t nearest2rgb = palette->getEntry(nearest2idx);
+  const int r2 = doc::rgba_getr(nearest2rgb);
+  const int g2 = doc::rgba_getg(nearest2rgb);
+  const int b2 = doc::rgba_getb(nearest2rgb);
+  const int a2 = doc::rgba_geta(nearest2rgb);
+
+  // Here we calculate the distance between the original 'color'
+  // and 'nearest1rgb'. The maximum possible distance is given by
+  // the distance between 'nearest1rgb' and 'nearest2rgb'.
+  int d = colorDistance(r1, g1, b1, a1, r, g, b, a);
+  int D = colorDistance(r1, g1, b1, a1, r2, g2, b2, a2);
+  if (D == 0)
+    return nearest1idx;
+
+  // We convert the d/D factor to the matrix range to compare it
+  // with the threshold. If d > threshold, it means that we're
+  // closer to 'nearest2rgb' than to 'nearest1rgb'.
+  d = matrix.maxValue() * d / D;
+  int threshold = matrix(y, x);
+
+  return (d > threshold ? nearest2idx:
+                          nearest1idx);
+}
+
 OrderedDither::OrderedDither(int transparentIndex)
   : m_transparentIndex(transparentIndex)
 {
@@ -68,55 +169,72 @@ doc::color_t OrderedDither::ditherRgbPixelToIndex(
     (rgbmap ? rgbmap->mapColor(r, g, b, a):
               palette->findBestfit(r, g, b, a, m_transparentIndex));
 
-  doc::color_t nearest1rgb = palette->getEntry(nearest1idx);
-  int r1 = doc::rgba_getr(nearest1rgb);
-  int g1 = doc::rgba_getg(nearest1rgb);
-  int b1 = doc::rgba_getb(nearest1rgb);
-  int a1 = doc::rgba_geta(nearest1rgb);
-
   // Between the original color ('color' parameter) and 'nearest'
   // index, we have an error (r1-r, g1-g, b1-b). Here we try to
   // find the other nearest color with the same error but with
   // different sign.
-  int r2 = r - (r1-r);
-  int g2 = g - (g1-g);
-  int b2 = b - (b1-b);
-  int a2 = a - (a1-a);
-  r2 = std::clamp(r2, 0, 255);
-  g2 = std::clamp(g2, 0, 255);
-  b2 = std::clamp(b2, 0, 255);
-  a2 = std::clamp(a2, 0, 255);
+  doc::color_t mirrored;
+  const doc::color_t nearest1rgb = palette->getEntry(nearest1idx);
+  mirror_colors(&color, &nearest1rgb, &mirrored, 1);
+
+  const int r2 = doc::rgba_getr(mirrored);
+  const int g2 = doc::rgba_getg(mirrored);
+  const int b2 = doc::rgba_getb(mirrored);
+  const int a2 = doc::rgba_geta(mirrored);
   doc::color_t nearest2idx =
     (rgbmap ? rgbmap->mapColor(r2, g2, b2, a2):
               palette->findBestfit(r2, g2, b2, a2, m_transparentIndex));
 
-  // If both possible RGB colors use the same index, we cannot
-  // make any dither with these two colors.
-  if (nearest1idx == nearest2idx)
-    return nearest1idx;
+  return choose_nearest(matrix, color, x, y,
+                        nearest1idx, nearest2idx, palette);
+}
+
+// Same as ditherRgbPixelToIndex() but mapping all the colors of the
+// span with only two RgbMap::mapColors() calls (one for the nearest
+// colors and other for the mirrored ones).
+void OrderedDither::ditherRgbSpanToIndex(
+  const DitheringMatrix& matrix,
+  const doc::color_t* src,
+  uint8_t* dst,
+  const int n,
+  const int x, const int y,
+  const doc::RgbMap* rgbmap,
+  const doc::Palette* palette)
+{
+  if (!rgbmap) {
+    DitheringAlgorithmBase::ditherRgbSpanToIndex(
+      matrix, src, dst, n, x, y, rgbmap, palette);
+    return;
+  }
 
-  doc::color_t nearest2rgb = palette->getEntry(nearest2idx);
-  r2 = doc::rgba_getr(nearest2rgb);
-  g2 = doc::rgba_getg(nearest2rgb);
-  b2 = doc::rgba_getb(nearest2rgb);
-  a2 = doc::rgba_geta(nearest2rgb);
+  uint8_t nearest1idx[kSpanSize];
+  uint8_t nearest2idx[kSpanSize];
+  doc::color_t nearest1rgb[kSpanSize];
+  doc::color_t mirrored[kSpanSize];
 
-  // Here we calculate the distance between the original 'color'
-  // and 'nearest1rgb'. The maximum possible distance is given by
-  // the distance between 'nearest1rgb' and 'nearest2rgb'.
-  int d = colorDistance(r1, g1, b1, a1, r, g, b, a);
-  int D = colorDistance(r1, g1, b1, a1, r2, g2, b2, a2);
-  if (D == 0)
-    return nearest1idx;
+  for (int i0=0; i0<n; i0+=kSpanSize) {
+    const int m = std::min(kSpanSize, n-i0);
+    const doc::color_t* colors = src+i0;
 
-  // We convert the d/D factor to the matrix range to compare it
-  // with the threshold. If d > threshold, it means that we're
-  // closer to 'nearest2rgb' than to 'nearest1rgb'.
-  d = matrix.maxValue() * d / D;
-  int threshold = matrix(y, x);
+    rgbmap->mapColors(colors, nearest1idx, m);
+    for (int i=0; i<m; ++i)
+      nearest1rgb[i] = palette->getEntry(nearest1idx[i]);
 
-  return (d > threshold ? nearest2idx:
-                          nearest1idx);
+    mirror_colors(colors, nearest1rgb, mirrored, m);
+    rgbmap->mapColors(mirrored, nearest2idx, m);
+
+    for (int i=0; i<m; ++i) {
+      // Alpha=0, output transparent color
+      if (m_transparentIndex >= 0 &&
+          doc::rgba_geta(colors[i]) == 0) {
+        dst[i0+i] = m_transparentIndex;
+      }
+      else {
+        dst[i0+i] = choose_nearest(matrix, colors[i], x+i0+i, y,
+                                   nearest1idx[i], nearest2idx[i], palette);
+      }
+    }
+  }
 }
 
 OrderedDither2::OrderedDither2(int transparentIndex)
@@ -159,6 +277,58 @@ doc::color_t OrderedDither2::ditherRgbPixelToIndex(
     (rgbmap ? rgbmap->mapColor(r, g, b, a):
               palette->findBestfit(r, g, b, a, m_transparentIndex));
 
+  return mixWithIndex(matrix, color, x, y, index, palette);
+}
+
+void OrderedDither2::ditherRgbSpanToIndex(
+  const DitheringMatrix& matrix,
+  const doc::color_t* src,
+  uint8_t* dst,
+  const int n,
+  const int x, const int y,
+  const doc::RgbMap* rgbmap,
+  const doc::Palette* palette)
+{
+  if (!rgbmap) {
+    DitheringAlgorithmBase::ditherRgbSpanToIndex(
+      matrix, src, dst, n, x, y, rgbmap, palette);
+    return;
+  }
+
+  uint8_t indexes[kSpanSize];
+  for (int i0=0; i0<n; i0+=kSpanSize) {
+    const int m = std::min(kSpanSize, n-i0);
+    const doc::color_t* colors = src+i0;
+
+    rgbmap->mapColors(colors, indexes, m);
+
+    for (int i=0; i<m; ++i) {
+      // Alpha=0, output transparent color
+      if (m_transparentIndex >= 0 &&
+          doc::rgba_geta(colors[i]) == 0) {
+        dst[i0+i] = m_transparentIndex;
+      }
+      else {
+        dst[i0+i] = mixWithIndex(matrix, colors[i], x+i0+i, y,
+                                 indexes[i], palette);
+      }
+    }
+  }
+}
+
+doc::color_t OrderedDither2::mixWithIndex(
+  const DitheringMatrix& matrix,
+  const doc::color_t color,
+  const int x,
+  const int y,
+  const int index,
+  const doc::Palette* palette) const
+{
+  const int r = doc::rgba_getr(color);
+  const int g = doc::rgba_getg(color);
+  const int b = doc::rgba_getb(color);
+  const int a = doc::rgba_geta(color);
+
   const doc::color_t color0 = palette->getEntry(index);
   const int r0 = doc::rgba_getr(color0);
   const int g0 = doc::rgba_getg(color0);
@@ -242,25 +412,17 @@ void dither_rgb_image_to_indexed(
   algorithm.start(srcImage, dstImage, dithering.factor());
 
   if (algorithm.dimensions() == 1) {
-    const doc::LockImageBits<doc::RgbTraits> srcBits(srcImage);
-    doc::LockImageBits<doc::IndexedTraits> dstBits(dstImage);
-    auto srcIt = srcBits.begin();
-    auto dstIt = dstBits.begin();
-
     for (int y=0; y<h; ++y) {
-      for (int x=0; x<w; ++x, ++srcIt, ++dstIt) {
-        ASSERT(srcIt != srcBits.end());
-        ASSERT(dstIt != dstBits.end());
-        *dstIt = algorithm.ditherRgbPixelToIndex(
-          dithering.matrix(), *srcIt, x, y, rgbmap, palette);
-
-        if (delegate) {
-          if (!delegate->continueTask())
-            return;
-        }
-      }
+      algorithm.ditherRgbSpanToIndex(
+        dithering.matrix(),
+        doc::get_pixel_address_fast<doc::RgbTraits>(srcImage, 0, y),
+        doc::get_pixel_address_fast<doc::IndexedTraits>(dstImage, 0, y),
+        w, 0, y, rgbmap, palette);
 
       if (delegate) {
+        if (!delegate->continueTask())
+          return;
+
         delegate->notifyTaskProgress(
           double(y+1) / double(h));
       }
@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -43,6 +43,21 @@ namespace render {
       const doc::RgbMap* rgbmap,
       const doc::Palette* palette) { return 0; }
 
+    // Converts the "n" pixels of a span of the row "y" starting at
+    // column "x". The default implementation calls
+    // ditherRgbPixelToIndex() for each pixel.
+    virtual void ditherRgbSpanToIndex(
+      const DitheringMatrix& matrix,
+      const doc::color_t* src,
+      uint8_t* dst,
+      const int n,
+      const int x, const int y,
+      const doc::RgbMap* rgbmap,
+      const doc::Palette* palette) {
+      for (int i=0; i<n; ++i)
+        dst[i] = ditherRgbPixelToIndex(matrix, src[i], x+i, y, rgbmap, palette);
+    }
+
     virtual doc::color_t ditherRgbToIndex2D(
       const int x, const int y,
       const doc::RgbMap* rgbmap,
@@ -59,6 +74,14 @@ namespace render {
       const int y,
       const doc::RgbMap* rgbmap,
       const doc::Palette* palette) override;
+    void ditherRgbSpanToIndex(
+      const DitheringMatrix& matrix,
+      const doc::color_t* src,
+      uint8_t* dst,
+      const int n,
+      const int x, const int y,
+      const doc::RgbMap* rgbmap,
+      const doc::Palette* palette) override;
   private:
     int m_transparentIndex;
   };
@@ -73,7 +96,23 @@ namespace render {
       const int y,
       const doc::RgbMap* rgbmap,
       const doc::Palette* palette) override;
+    void ditherRgbSpanToIndex(
+      const DitheringMatrix& matrix,
+      const doc::color_t* src,
+      uint8_t* dst,
+      const int n,
+      const int x, const int y,
+      const doc::RgbMap* rgbmap,
+      const doc::Palette* palette) override;
   private:
+    doc::color_t mixWithIndex(
+      const DitheringMatrix& matrix,
+      const doc::color_t color,
+      const int x,
+      const int y,
+      const int index,
+      const doc::Palette* palette) const;
+
     int m_transparentIndex;
   };
 
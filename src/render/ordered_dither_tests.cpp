@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -11,9 +11,14 @@
 
 #include <gtest/gtest.h>
 
+#include "doc/palette.h"
+#include "doc/rgbmap_rgb5a3.h"
 #include "render/dithering_matrix.h"
 #include "render/ordered_dither.h"
 
+#include <cstdlib>
+#include <vector>
+
 using namespace doc;
 using namespace render;
 
@@ -65,8 +70,40 @@ TEST(BayerMatrix, CheckD8)
       EXPECT_EQ(expected[c++], matrix(i, j));
 }
 
+TEST(OrderedDither, SpanMatchesPixels)
+{
+  Palette palette(0, 16);
+  palette.setEntry(0, rgba(0, 0, 0, 0));
+  for (int i=1; i<16; ++i)
+    palette.setEntry(i, rgba(17*i, 255-17*i, (i*64) & 255, 255));
+
+  RgbMapRGB5A3 rgbmap;
+  rgbmap.regenerateMap(&palette, 0);
+
+  std::srand(1);
+  std::vector<color_t> src(203);
+  for (color_t& c : src)
+    c = rgba(std::rand() & 255, std::rand() & 255, std::rand() & 255,
+             (std::rand() & 3) ? 255: 0);
+
+  BayerMatrix matrix(8);
+  OrderedDither dither1(0);
+  OrderedDither2 dither2(0);
+  for (DitheringAlgorithmBase* dither : { (DitheringAlgorithmBase*)&dither1,
+                                          (DitheringAlgorithmBase*)&dither2 }) {
+    std::vector<uint8_t> dst(src.size());
+    dither->ditherRgbSpanToIndex(matrix, src.data(), dst.data(),
+                                 int(src.size()), 3, 5, &rgbmap, &palette);
+    for (int i=0; i<int(src.size()); ++i) {
+      EXPECT_EQ(dither->ditherRgbPixelToIndex(matrix, src[i], 3+i, 5, &rgbmap, &palette),
+                dst[i]);
+    }
+  }
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
+  Palette::initBestfit();
   return RUN_ALL_TESTS();
 }
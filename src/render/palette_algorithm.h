@@ -0,0 +1,23 @@
+// Aseprite Render Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef RENDER_PALETTE_ALGORITHM_H_INCLUDED
+#define RENDER_PALETTE_ALGORITHM_H_INCLUDED
+#pragma once
+
+namespace render {
+
+  // Algorithms to generate a palette from the colors of a sprite
+  enum class PaletteAlgorithm {
+    Default,    // Depends on the RgbMapAlgorithm (octree or median cut)
+    MedianCut,
+    Wu,
+    KMeans,     // Wu's palette refined with k-means iterations
+  };
+
+} // namespace render
+
+#endif
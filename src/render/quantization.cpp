@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019-2022  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 // Copyright (c) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -11,8 +11,10 @@
 
 #include "render/quantization.h"
 
+#include "base/thread_pool.h"
 #include "doc/image_impl.h"
 #include "doc/layer.h"
+#include "doc/locked_rgbmap.h"
 #include "doc/octree_map.h"
 #include "doc/palette.h"
 #include "doc/primitives.h"
@@ -25,9 +27,16 @@
 #include "render/task_delegate.h"
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <future>
 #include <limits>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
 #include <vector>
 
 namespace render {
@@ -35,6 +44,345 @@ namespace render {
 using namespace doc;
 using namespace gfx;
 
+namespace {
+
+// Renders the frames of the sprite in worker threads (a few frames
+// ahead) and calls feedFunc() for each rendered frame in the same
+// order of the sprite, so the octree/optimizer is fed with the
+// same sequence of images as a serial render.
+template<typename FeedFunc>
+bool render_sprite_frames(const Sprite* sprite,
+                          const frame_t fromFrame,
+                          const frame_t toFrame,
+                          const bool newBlend,
+                          TaskDelegate* delegate,
+                          FeedFunc feedFunc)
+{
+  using Task = std::packaged_task<ImageRef()>;
+
+  const int nthreads = std::max(1u, std::thread::hardware_concurrency());
+  const int maxPending = 2 * nthreads;
+  base::thread_pool pool(nthreads);
+  std::deque<std::future<ImageRef>> pending;
+  frame_t nextFrame = fromFrame;
+  bool result = true;
+
+  for (frame_t frame=fromFrame; frame<=toFrame; ++frame) {
+    for (; nextFrame<=toFrame && int(pending.size()) < maxPending; ++nextFrame) {
+      auto task = std::make_shared<Task>(
+        [sprite, newBlend, renderFrame=nextFrame]{
+          ImageRef image(Image::create(IMAGE_RGB,
+                                       sprite->width(), sprite->height()));
+          render::Render render;
+          render.setNewBlend(newBlend);
+          render.renderSprite(image.get(), sprite, renderFrame);
+          return image;
+        });
+      pending.push_back(task->get_future());
+      pool.execute([task]{ (*task)(); });
+    }
+
+    ImageRef image = pending.front().get();
+    pending.pop_front();
+    feedFunc(image.get());
+
+    if (delegate) {
+      if (!delegate->continueTask()) {
+        result = false;
+        break;
+      }
+
+      delegate->notifyTaskProgress(
+        double(frame-fromFrame+1) / double(toFrame-fromFrame+1));
+    }
+  }
+
+  // Wait the frames that are still being rendered (in case that the
+  // task was canceled)
+  pool.wait_all();
+  return result;
+}
+
+// Feeds the optimizer with the rendered frames splitting the frames
+// range in several chunks of consecutive frames, each one rendered
+// and added to a partial histogram in a worker thread. The partial
+// histograms are merged in order at the end, so the result is the
+// same as feeding the optimizer serially.
+bool feed_optimizer_with_sprite_frames(const Sprite* sprite,
+                                       const frame_t fromFrame,
+                                       const frame_t toFrame,
+                                       const bool withAlpha,
+                                       const bool newBlend,
+                                       TaskDelegate* delegate,
+                                       PaletteOptimizer& optimizer)
+{
+  // Each chunk renders the frames in its own image, so we limit the
+  // number of chunks to avoid using too much memory in machines with
+  // a lot of cores (partial histograms are sparse, so they are small
+  // for images with few colors).
+  const int kMaxChunks = 8;
+  const int nframes = toFrame - fromFrame + 1;
+  const int nchunks = std::clamp<int>(
+    std::min<int>(std::thread::hardware_concurrency(), nframes), 1, kMaxChunks);
+
+  if (nchunks == 1) {
+    return render_sprite_frames(
+      sprite, fromFrame, toFrame, newBlend, delegate,
+      [&](const Image* flat_image){
+        optimizer.feedWithImage(flat_image, withAlpha);
+      });
+  }
+
+  std::vector<PaletteOptimizer> partials(nchunks);
+  std::mutex mutex;
+  std::condition_variable cv;
+  int doneFrames = 0;
+  std::atomic<bool> canceled(false);
+
+  base::thread_pool pool(nchunks);
+  for (int i=0; i<nchunks; ++i) {
+    const frame_t chunkFrom = fromFrame + frame_t(nframes * i / nchunks);
+    const frame_t chunkTo = fromFrame + frame_t(nframes * (i+1) / nchunks) - 1;
+
+    pool.execute(
+      [&, chunkFrom, chunkTo, i]{
+        ImageRef image(Image::create(IMAGE_RGB,
+                                     sprite->width(), sprite->height()));
+        render::Render render;
+        render.setNewBlend(newBlend);
+
+        for (frame_t frame=chunkFrom; frame<=chunkTo && !canceled; ++frame) {
+          render.renderSprite(image.get(), sprite, frame);
+          partials[i].feedWithImage(image.get(), withAlpha);
+
+          std::lock_guard lock(mutex);
+          ++doneFrames;
+          cv.notify_one();
+        }
+      });
+  }
+
+  // Report the progress from this thread (the delegate is not used
+  // from the worker threads)
+  if (delegate) {
+    std::unique_lock lock(mutex);
+    while (doneFrames < nframes) {
+      const int lastDone = doneFrames;
+      cv.wait(lock, [&]{ return doneFrames != lastDone; });
+
+      const int done = doneFrames;
+      lock.unlock();
+      if (!delegate->continueTask()) {
+        canceled = true;
+        break;
+      }
+      delegate->notifyTaskProgress(double(done) / double(nframes));
+      lock.lock();
+    }
+  }
+
+  pool.wait_all();
+  if (canceled)
+    return false;
+
+  for (const auto& partial : partials)
+    optimizer.merge(partial);
+  return true;
+}
+
+// Minimum number of pixels in an image to convert it in several
+// threads (for small images it's faster to convert them directly).
+const int kMinPixelsToParallelize = 256*256;
+const int kMinBandHeight = 16;
+
+// Calls func(y0, y1) for bands of rows of an image with the given
+// height from worker threads (func() must access only the rows of
+// its band). The progress/cancellation is reported through the
+// delegate from the calling thread. Returns false if the task was
+// canceled.
+template<typename Func>
+bool for_each_rows_band(const int h,
+                        TaskDelegate* delegate,
+                        Func func)
+{
+  const int nthreads = std::max(1u, std::thread::hardware_concurrency());
+  const int bandHeight = std::max(kMinBandHeight, (h + 4*nthreads - 1) / (4*nthreads));
+  const int nbands = (h + bandHeight - 1) / bandHeight;
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  int doneBands = 0;
+  std::atomic<bool> canceled(false);
+
+  base::thread_pool pool(std::min(nthreads, nbands));
+  for (int i=0; i<nbands; ++i) {
+    const int y0 = i*bandHeight;
+    const int y1 = std::min(h, y0+bandHeight);
+    pool.execute(
+      [&, y0, y1]{
+        if (!canceled)
+          func(y0, y1);
+
+        std::lock_guard lock(mutex);
+        ++doneBands;
+        cv.notify_one();
+      });
+  }
+
+  {
+    std::unique_lock lock(mutex);
+    while (doneBands < nbands) {
+      const int lastDone = doneBands;
+      cv.wait(lock, [&]{ return doneBands != lastDone; });
+
+      if (delegate && !canceled) {
+        const int done = doneBands;
+        lock.unlock();
+        if (delegate->continueTask())
+          delegate->notifyTaskProgress(double(done) / double(nbands));
+        else
+          canceled = true;
+        lock.lock();
+      }
+    }
+  }
+
+  pool.wait_all();
+  return !canceled;
+}
+
+// Adds the visible pixels of the given image area to the
+// histogram. Runs of pixels with the same color are added with one
+// addSamples() call.
+template<typename Histogram>
+void add_image_samples(Histogram& histogram,
+                       const Image* image,
+                       const gfx::Rect& bounds,
+                       const bool withAlpha)
+{
+  color_t runColor = 0;
+  std::size_t runLength = 0;
+  auto addSample = [&](const color_t color){
+    if (runLength > 0 && color == runColor) {
+      ++runLength;
+    }
+    else {
+      if (runLength > 0)
+        histogram.addSamples(runColor, runLength);
+      runColor = color;
+      runLength = 1;
+    }
+  };
+
+  switch (image->pixelFormat()) {
+
+    case IMAGE_RGB:
+      {
+        const LockImageBits<RgbTraits> bits(image, bounds);
+        auto it = bits.begin(), end = bits.end();
+
+        for (; it != end; ++it) {
+          color_t color = *it;
+          if (rgba_geta(color) > 0) {
+            if (!withAlpha)
+              color |= rgba(0, 0, 0, 255);
+
+            addSample(color);
+          }
+        }
+      }
+      break;
+
+    case IMAGE_GRAYSCALE:
+      {
+        const LockImageBits<GrayscaleTraits> bits(image, bounds);
+        auto it = bits.begin(), end = bits.end();
+
+        for (; it != end; ++it) {
+          color_t color = *it;
+
+          if (graya_geta(color) > 0) {
+            if (!withAlpha)
+              color = graya(graya_getv(color), 255);
+
+            addSample(rgba(graya_getv(color),
+                           graya_getv(color),
+                           graya_getv(color),
+                           graya_geta(color)));
+          }
+        }
+      }
+      break;
+
+    case IMAGE_INDEXED:
+      ASSERT(false);
+      break;
+
+  }
+
+  if (runLength > 0)
+    histogram.addSamples(runColor, runLength);
+}
+
+void convert_rgb_rows_to_indexed(const Image* image,
+                                 Image* new_image,
+                                 const int y0, const int y1,
+                                 const RgbMap* rgbmap,
+                                 const Palette* palette,
+                                 const color_t new_mask_color)
+{
+  const int w = image->width();
+  const color_t maskIndex = (new_mask_color == -1 ? 0: new_mask_color);
+
+  for (int y=y0; y<y1; ++y) {
+    const auto src = get_pixel_address_fast<RgbTraits>(image, 0, y);
+    const auto dst = get_pixel_address_fast<IndexedTraits>(new_image, 0, y);
+
+    if (rgbmap) {
+      // Map the whole row with one call, then fix transparent pixels
+      rgbmap->mapColors(src, dst, w);
+      for (int x=0; x<w; ++x) {
+        if (rgba_geta(src[x]) == 0)
+          dst[x] = maskIndex;
+      }
+    }
+    else {
+      for (int x=0; x<w; ++x) {
+        const color_t c = src[x];
+        const int a = rgba_geta(c);
+        if (a == 0)
+          dst[x] = maskIndex;
+        else
+          dst[x] = palette->findBestfit(rgba_getr(c),
+                                        rgba_getg(c),
+                                        rgba_getb(c), a, new_mask_color);
+      }
+    }
+  }
+}
+
+void dither_rgb_rows_to_indexed(DitheringAlgorithmBase& algorithm,
+                                const Dithering& dithering,
+                                const Image* image,
+                                Image* new_image,
+                                const int y0, const int y1,
+                                const RgbMap* rgbmap,
+                                const Palette* palette)
+{
+  ASSERT(algorithm.dimensions() == 1);
+
+  const int w = image->width();
+  for (int y=y0; y<y1; ++y) {
+    algorithm.ditherRgbSpanToIndex(
+      dithering.matrix(),
+      get_pixel_address_fast<RgbTraits>(image, 0, y),
+      get_pixel_address_fast<IndexedTraits>(new_image, 0, y),
+      w, 0, y, rgbmap, palette);
+  }
+}
+
+} // anonymous namespace
+
 Palette* create_palette_from_sprite(
   const Sprite* sprite,
   const frame_t fromFrame,
@@ -44,11 +392,20 @@ Palette* create_palette_from_sprite(
   TaskDelegate* delegate,
   const bool newBlend,
   RgbMapAlgorithm mapAlgo,
-  const bool calculateWithTransparent)
+  const bool calculateWithTransparent,
+  PaletteAlgorithm paletteAlgo)
 {
    if (mapAlgo == doc::RgbMapAlgorithm::DEFAULT)
      mapAlgo = doc::RgbMapAlgorithm::OCTREE;
 
+  // The octree generates its own palette, the other algorithms use
+  // the histogram of the PaletteOptimizer (as RGB5A3 does).
+  if (paletteAlgo == PaletteAlgorithm::Default) {
+    paletteAlgo = (mapAlgo == RgbMapAlgorithm::RGB5A3 ? PaletteAlgorithm::MedianCut:
+                                                        PaletteAlgorithm::Default);
+  }
+  const bool useOptimizer = (paletteAlgo != PaletteAlgorithm::Default);
+
   PaletteOptimizer optimizer;
   OctreeMap octreemap;
 
@@ -73,67 +430,41 @@ Palette* create_palette_from_sprite(
   if (!palette)
     palette = new Palette(fromFrame, 256);
 
-  // Add a flat image with the current sprite's frame rendered
-  ImageRef flat_image(Image::create(IMAGE_RGB,
-      sprite->width(), sprite->height()));
-
-  render::Render render;
-  render.setNewBlend(newBlend);
-
   // Feed the optimizer with all rendered frames
-  for (frame_t frame=fromFrame; frame<=toFrame; ++frame) {
-    render.renderSprite(flat_image.get(), sprite, frame);
-
-    switch (mapAlgo) {
-      case RgbMapAlgorithm::RGB5A3:
-        optimizer.feedWithImage(flat_image.get(), withAlpha);
-        break;
-      case RgbMapAlgorithm::OCTREE:
-        octreemap.feedWithImage(flat_image.get(), withAlpha, maskColor);
-        break;
-      default:
-        ASSERT(false);
-        break;
-    }
-
-    if (delegate) {
-      if (!delegate->continueTask())
-        return nullptr;
-
-      delegate->notifyTaskProgress(
-        double(frame-fromFrame+1) / double(toFrame-fromFrame+1));
-    }
+  if (useOptimizer) {
+    if (!feed_optimizer_with_sprite_frames(
+          sprite, fromFrame, toFrame, withAlpha, newBlend, delegate,
+          optimizer))
+      return nullptr;
   }
-
-  switch (mapAlgo) {
-
-    case RgbMapAlgorithm::RGB5A3: {
-      // Generate an optimized palette
-      optimizer.calculate(palette, maskIndex);
-      break;
+  else if (!render_sprite_frames(
+        sprite, fromFrame, toFrame, newBlend, delegate,
+        [&](const Image* flat_image){
+          ASSERT(mapAlgo == RgbMapAlgorithm::OCTREE);
+          octreemap.feedWithImage(flat_image, withAlpha, maskColor);
+        }))
+    return nullptr;
+
+  if (useOptimizer) {
+    // Generate an optimized palette
+    optimizer.calculate(palette, maskIndex, paletteAlgo);
+  }
+  else {
+    ASSERT(mapAlgo == RgbMapAlgorithm::OCTREE);
+    // TODO check calculateWithTransparent flag
+
+    if (!octreemap.makePalette(palette, palette->size())) {
+      // We can use an 8-bit deep octree map, instead of 7-bit of the
+      // first attempt.
+      octreemap = OctreeMap();
+      if (!render_sprite_frames(
+            sprite, fromFrame, toFrame, newBlend, delegate,
+            [&](const Image* flat_image){
+              octreemap.feedWithImage(flat_image, withAlpha, maskColor, 8);
+            }))
+        return nullptr;
+      octreemap.makePalette(palette, palette->size(), 8);
     }
-
-    case RgbMapAlgorithm::OCTREE:
-      // TODO check calculateWithTransparent flag
-
-      if (!octreemap.makePalette(palette, palette->size())) {
-        // We can use an 8-bit deep octree map, instead of 7-bit of the
-        // first attempt.
-        octreemap = OctreeMap();
-        for (frame_t frame=fromFrame; frame<=toFrame; ++frame) {
-          render.renderSprite(flat_image.get(), sprite, frame);
-          octreemap.feedWithImage(flat_image.get(), withAlpha, maskColor , 8);
-          if (delegate) {
-            if (!delegate->continueTask())
-              return nullptr;
-
-            delegate->notifyTaskProgress(
-              double(frame-fromFrame+1) / double(toFrame-fromFrame+1));
-          }
-        }
-        octreemap.makePalette(palette, palette->size(), 8);
-      }
-      break;
   }
 
   return palette;
@@ -155,6 +486,47 @@ Image* convert_pixel_format(
     new_image = Image::create(pixelFormat, image->width(), image->height());
   new_image->setMaskColor(new_mask_color);
 
+  // RGB -> Indexed without dithering or with ordered dithering: each
+  // pixel is converted independently, so big images are converted in
+  // bands of rows from several threads.
+  if (image->pixelFormat() == IMAGE_RGB &&
+      pixelFormat == IMAGE_INDEXED &&
+      dithering.algorithm() != DitheringAlgorithm::ErrorDiffusion &&
+      image->width()*image->height() >= kMinPixelsToParallelize &&
+      std::thread::hardware_concurrency() > 1) {
+    std::unique_ptr<DitheringAlgorithmBase> dither;
+    switch (dithering.algorithm()) {
+      case DitheringAlgorithm::Ordered:
+        dither.reset(new OrderedDither2(is_background ? -1: new_mask_color));
+        break;
+      case DitheringAlgorithm::Old:
+        dither.reset(new OrderedDither(is_background ? -1: new_mask_color));
+        break;
+      default:
+        break;
+    }
+
+    // The RgbMap is shared between all threads through LockedRgbMap
+    // instances (one per band)
+    std::mutex rgbmapMutex;
+    for_each_rows_band(
+      image->height(), delegate,
+      [&](const int y0, const int y1){
+        std::optional<LockedRgbMap> lockedRgbmap;
+        if (rgbmap)
+          lockedRgbmap.emplace(rgbmap, rgbmapMutex);
+        const RgbMap* bandRgbmap = (rgbmap ? &*lockedRgbmap: nullptr);
+
+        if (dither)
+          dither_rgb_rows_to_indexed(*dither, dithering, image, new_image,
+                                     y0, y1, bandRgbmap, palette);
+        else
+          convert_rgb_rows_to_indexed(image, new_image, y0, y1,
+                                      bandRgbmap, palette, new_mask_color);
+      });
+    return new_image;
+  }
+
   // RGB -> Indexed with ordered dithering
   if (image->pixelFormat() == IMAGE_RGB &&
       pixelFormat == IMAGE_INDEXED &&
@@ -219,32 +591,10 @@ Image* convert_pixel_format(
         }
 
         // RGB -> Indexed
-        case IMAGE_INDEXED: {
-          LockImageBits<IndexedTraits> dstBits(new_image, Image::WriteLock);
-          auto dst_it = dstBits.begin();
-#ifdef _DEBUG
-          auto dst_end = dstBits.end();
-#endif
-
-          for (; src_it != src_end; ++src_it, ++dst_it) {
-            ASSERT(dst_it != dst_end);
-            c = *src_it;
-
-            r = rgba_getr(c);
-            g = rgba_getg(c);
-            b = rgba_getb(c);
-            a = rgba_geta(c);
-
-            if (a == 0)
-              *dst_it = (new_mask_color == -1? 0 : new_mask_color);
-            else if (rgbmap)
-              *dst_it = rgbmap->mapColor(c);
-            else
-              *dst_it = palette->findBestfit(r, g, b, a, new_mask_color);
-          }
-          ASSERT(dst_it == dst_end);
+        case IMAGE_INDEXED:
+          convert_rgb_rows_to_indexed(image, new_image, 0, image->height(),
+                                      rgbmap, palette, new_mask_color);
           break;
-        }
       }
       break;
     }
@@ -412,57 +762,40 @@ void PaletteOptimizer::feedWithImage(const Image* image,
                                      const gfx::Rect& bounds,
                                      const bool withAlpha)
 {
-  uint32_t color;
-
   if (withAlpha)
     m_withAlpha = true;
 
   ASSERT(image);
-  switch (image->pixelFormat()) {
-
-    case IMAGE_RGB:
-      {
-        const LockImageBits<RgbTraits> bits(image, bounds);
-        auto it = bits.begin(), end = bits.end();
-
-        for (; it != end; ++it) {
-          color = *it;
-          if (rgba_geta(color) > 0) {
-            if (!withAlpha)
-              color |= rgba(0, 0, 0, 255);
-
-            m_histogram.addSamples(color, 1);
-          }
-        }
-      }
-      break;
 
-    case IMAGE_GRAYSCALE:
-      {
-        const LockImageBits<GrayscaleTraits> bits(image, bounds);
-        auto it = bits.begin(), end = bits.end();
-
-        for (; it != end; ++it) {
-          color = *it;
-
-          if (graya_geta(color) > 0) {
-            if (!withAlpha)
-              color = graya(graya_getv(color), 255);
-
-            m_histogram.addSamples(rgba(graya_getv(color),
-                                        graya_getv(color),
-                                        graya_getv(color),
-                                        graya_geta(color)), 1);
-          }
-        }
-      }
-      break;
-
-    case IMAGE_INDEXED:
-      ASSERT(false);
-      break;
+  const int nthreads = std::max(1u, std::thread::hardware_concurrency());
+  const int nshards =
+    (bounds.w*bounds.h >= kMinPixelsToParallelize ?
+     std::min(nthreads, bounds.h / kMinBandHeight): 1);
+  if (nshards <= 1) {
+    add_image_samples(m_histogram, image, bounds, withAlpha);
+    return;
+  }
 
+  // Big images are split in bands of rows, each band is added to its
+  // own sparse histogram (shard) in a worker thread, and then the
+  // shards are merged in order (so the result is the same as adding
+  // all the rows here).
+  std::vector<Histogram> shards(nshards);
+  base::thread_pool pool(nshards);
+  for (int i=0; i<nshards; ++i) {
+    const int y0 = bounds.y + bounds.h * i / nshards;
+    const int y1 = bounds.y + bounds.h * (i+1) / nshards;
+    pool.execute(
+      [&shards, image, &bounds, withAlpha, i, y0, y1]{
+        add_image_samples(shards[i], image,
+                          gfx::Rect(bounds.x, y0, bounds.w, y1-y0),
+                          withAlpha);
+      });
   }
+  pool.wait_all();
+
+  for (const auto& shard : shards)
+    m_histogram.merge(shard);
 }
 
 void PaletteOptimizer::feedWithRgbaColor(color_t color)
@@ -470,7 +803,15 @@ void PaletteOptimizer::feedWithRgbaColor(color_t color)
   m_histogram.addSamples(color, 1);
 }
 
-void PaletteOptimizer::calculate(Palette* palette, int maskIndex)
+void PaletteOptimizer::merge(const PaletteOptimizer& other)
+{
+  m_histogram.merge(other.m_histogram);
+  if (other.m_withAlpha)
+    m_withAlpha = true;
+}
+
+void PaletteOptimizer::calculate(Palette* palette, int maskIndex,
+                                 PaletteAlgorithm algorithm)
 {
   bool addMask;
 
@@ -486,7 +827,7 @@ void PaletteOptimizer::calculate(Palette* palette, int maskIndex)
   // used, in other case the 0 indexed will be the mask color, so it
   // will not be used later in the color conversion (from RGB to
   // Indexed).
-  int usedColors = m_histogram.createOptimizedPalette(palette);
+  int usedColors = m_histogram.createOptimizedPalette(palette, algorithm);
 
   if (addMask) {
     palette->resize(usedColors+1);
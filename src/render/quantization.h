@@ -1,5 +1,5 @@
 // Aseprite Rener Library
-// Copyright (c) 2019-2021  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 // Copyright (c) 2001-2017  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -13,6 +13,7 @@
 #include "doc/pixel_format.h"
 #include "doc/rgbmap_algorithm.h"
 #include "render/color_histogram.h"
+#include "render/palette_algorithm.h"
 
 #include <vector>
 
@@ -35,12 +36,17 @@ namespace render {
                        const gfx::Rect& bounds,
                        const bool withAlpha);
     void feedWithRgbaColor(doc::color_t color);
-    void calculate(doc::Palette* palette, int maskIndex);
+    // Adds the samples of other optimizer (e.g. fed in other thread).
+    void merge(const PaletteOptimizer& other);
+    void calculate(doc::Palette* palette, int maskIndex,
+                   PaletteAlgorithm algorithm = PaletteAlgorithm::MedianCut);
     bool isHighPrecision() { return m_histogram.isHighPrecision(); }
     int highPrecisionSize() { return m_histogram.highPrecisionSize(); }
 
   private:
-    render::ColorHistogram<5, 6, 5, 5> m_histogram;
+    using Histogram = render::ColorHistogram<5, 6, 5, 5>;
+
+    Histogram m_histogram;
     bool m_withAlpha = false;
   };
 
@@ -54,7 +60,8 @@ namespace render {
     TaskDelegate* delegate,
     const bool newBlend,
     RgbMapAlgorithm mapAlgo,
-    const bool calculateWithTransparent = true);
+    const bool calculateWithTransparent = true,
+    const PaletteAlgorithm paletteAlgo = PaletteAlgorithm::Default);
 
   // Changes the image pixel format. The dithering method is used only
   // when you want to convert from RGB to Indexed.
@@ -0,0 +1,204 @@
+// Aseprite Render Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "render/quantization.h"
+
+#include "doc/image.h"
+#include "doc/image_impl.h"
+#include "doc/octree_map.h"
+#include "doc/palette.h"
+#include "doc/rgbmap_rgb5a3.h"
+#include "render/dithering.h"
+#include "render/dithering_matrix.h"
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace doc;
+using namespace render;
+
+// Image with runs of random colors (the same image for the same size)
+static ImageRef random_image(const int w, const int h)
+{
+  std::mt19937 rng(w*h);
+  std::uniform_int_distribution<color_t> colors(0, 0xffffffff);
+  std::uniform_int_distribution<int> runs(1, 8);
+
+  ImageRef image(Image::create(IMAGE_RGB, w, h));
+  color_t c = colors(rng);
+  int run = runs(rng);
+  for (auto& pixel : LockImageBits<RgbTraits>(image.get(), Image::WriteLock)) {
+    pixel = c;
+    if (--run == 0) {
+      c = colors(rng);
+      run = runs(rng);
+    }
+  }
+  return image;
+}
+
+static std::unique_ptr<Palette> optimized_palette(const Image* image,
+                                                  const int ncolors)
+{
+  PaletteOptimizer optimizer;
+  optimizer.feedWithImage(image, true);
+
+  auto palette = std::make_unique<Palette>(frame_t(0), ncolors);
+  optimizer.calculate(palette.get(), 0, PaletteAlgorithm::MedianCut);
+  return palette;
+}
+
+static std::unique_ptr<RgbMap> make_rgbmap(const RgbMapAlgorithm mapAlgo,
+                                           const Palette* palette)
+{
+  std::unique_ptr<RgbMap> rgbmap;
+  if (mapAlgo == RgbMapAlgorithm::OCTREE)
+    rgbmap = std::make_unique<OctreeMap>();
+  else
+    rgbmap = std::make_unique<RgbMapRGB5A3>();
+  rgbmap->regenerateMap(palette, 0);
+  return rgbmap;
+}
+
+static void BM_PaletteOptimizerFeed(benchmark::State& state)
+{
+  const int w = state.range(0);
+  const int h = state.range(1);
+  ImageRef image = random_image(w, h);
+
+  for (auto _ : state) {
+    PaletteOptimizer optimizer;
+    optimizer.feedWithImage(image.get(), true);
+    benchmark::DoNotOptimize(optimizer.isHighPrecision());
+  }
+  state.SetItemsProcessed(state.iterations() * w * h);
+}
+
+static void BM_PaletteOptimizerCalculate(benchmark::State& state)
+{
+  const auto algorithm = PaletteAlgorithm(state.range(0));
+  const int ncolors = state.range(1);
+  const int size = state.range(2);
+  ImageRef image = random_image(size, size);
+
+  PaletteOptimizer optimizer;
+  optimizer.feedWithImage(image.get(), true);
+
+  for (auto _ : state) {
+    Palette palette(frame_t(0), ncolors);
+    optimizer.calculate(&palette, 0, algorithm);
+    benchmark::DoNotOptimize(palette.size());
+  }
+}
+
+static void BM_ConvertPixelFormat(benchmark::State& state)
+{
+  const auto ditheringAlgo = DitheringAlgorithm(state.range(0));
+  const auto mapAlgo = RgbMapAlgorithm(state.range(1));
+  const int ncolors = state.range(2);
+  const int size = state.range(3);
+
+  ImageRef src = random_image(size, size);
+  ImageRef dst(Image::create(IMAGE_INDEXED, size, size));
+  std::unique_ptr<Palette> palette = optimized_palette(src.get(), ncolors);
+  std::unique_ptr<RgbMap> rgbmap = make_rgbmap(mapAlgo, palette.get());
+  const Dithering dithering(ditheringAlgo, BayerMatrix(8));
+
+  for (auto _ : state) {
+    convert_pixel_format(src.get(), dst.get(), IMAGE_INDEXED,
+                         dithering, rgbmap.get(), palette.get(),
+                         false, 0);
+  }
+  state.SetItemsProcessed(state.iterations() * size * size);
+}
+
+static void BM_RgbMapLookup(benchmark::State& state)
+{
+  const auto mapAlgo = RgbMapAlgorithm(state.range(0));
+  const int ncolors = state.range(1);
+  const int n = 64*1024;
+
+  ImageRef image = random_image(256, 256);
+  std::unique_ptr<Palette> palette = optimized_palette(image.get(), ncolors);
+  std::unique_ptr<RgbMap> rgbmap = make_rgbmap(mapAlgo, palette.get());
+
+  std::vector<uint8_t> indexes(n);
+
+  for (auto _ : state) {
+    for (int y=0; y<image->height(); ++y) {
+      rgbmap->mapColors((const color_t*)image->getPixelAddress(0, y),
+                        &indexes[y*image->width()], image->width());
+    }
+    benchmark::DoNotOptimize(indexes.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+static void BM_RgbMapRegenerate(benchmark::State& state)
+{
+  const auto mapAlgo = RgbMapAlgorithm(state.range(0));
+  const int ncolors = state.range(1);
+
+  ImageRef image = random_image(256, 256);
+  std::unique_ptr<Palette> palette = optimized_palette(image.get(), ncolors);
+  std::unique_ptr<RgbMap> rgbmap = make_rgbmap(mapAlgo, palette.get());
+
+  for (auto _ : state) {
+    // Modify the palette so the map must be regenerated
+    palette->setEntry(1, palette->getEntry(1) ^ 1);
+    rgbmap->regenerateMap(palette.get(), 0);
+  }
+}
+
+#define RGB5A3 int(RgbMapAlgorithm::RGB5A3)
+#define OCTREE int(RgbMapAlgorithm::OCTREE)
+
+BENCHMARK(BM_PaletteOptimizerFeed)
+  ->Args({ 256, 256 })
+  ->Args({ 1024, 1024 })
+  ->Args({ 4096, 4096 })
+  ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_PaletteOptimizerCalculate)
+  ->Args({ int(PaletteAlgorithm::MedianCut), 16, 256 })
+  ->Args({ int(PaletteAlgorithm::MedianCut), 256, 256 })
+  ->Args({ int(PaletteAlgorithm::MedianCut), 256, 1024 })
+  ->Args({ int(PaletteAlgorithm::Wu), 16, 256 })
+  ->Args({ int(PaletteAlgorithm::Wu), 256, 256 })
+  ->Args({ int(PaletteAlgorithm::Wu), 256, 1024 })
+  ->Args({ int(PaletteAlgorithm::KMeans), 16, 256 })
+  ->Args({ int(PaletteAlgorithm::KMeans), 256, 256 })
+  ->Args({ int(PaletteAlgorithm::KMeans), 256, 1024 })
+  ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_ConvertPixelFormat)
+  ->ArgsProduct({ { int(DitheringAlgorithm::None),
+                    int(DitheringAlgorithm::Ordered),
+                    int(DitheringAlgorithm::Old),
+                    int(DitheringAlgorithm::ErrorDiffusion) },
+                  { RGB5A3, OCTREE },
+                  { 16, 256 },
+                  { 256, 1024 } })
+  ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_RgbMapLookup)
+  ->ArgsProduct({ { RGB5A3, OCTREE },
+                  { 2, 16, 64, 256 } })
+  ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_RgbMapRegenerate)
+  ->ArgsProduct({ { RGB5A3, OCTREE },
+                  { 16, 256 } })
+  ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -18,12 +18,21 @@
 #include "doc/layer_tilemap.h"
 #include "doc/playback.h"
 #include "doc/render_plan.h"
+#include "doc/task_scheduler.h"
 #include "doc/tileset.h"
 #include "doc/tilesets.h"
 #include "gfx/clip.h"
 #include "gfx/region.h"
+#include "render/group_cache.h"
+#include "render/render_counters.h"
+#include "render/render_stats.h"
+#include "render/tile_atlas.h"
 
+#include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <type_traits>
+#include <vector>
 
 #define TRACE_RENDER_CEL(...) // TRACE
 
@@ -63,6 +72,35 @@ void composite_image_without_scale(
 
   ASSERT(!srcBounds.isEmpty());
 
+  // RGBA to RGBA: blend each row in just one call
+  if constexpr (std::is_same_v<DstTraits, RgbTraits> &&
+                std::is_same_v<SrcTraits, RgbTraits>) {
+    const int h = std::min(srcBounds.h, dstBounds.h);
+    for (int y=0; y<h; ++y) {
+      rgba_blend_span(
+        get_pixel_address_fast<RgbTraits>(dst, dstBounds.x, dstBounds.y+y),
+        get_pixel_address_fast<RgbTraits>(src, srcBounds.x, srcBounds.y+y),
+        srcBounds.w, opacity, blendMode, newBlend, src->maskColor());
+    }
+    return;
+  }
+
+  // Indexed to RGBA: walk each row directly, the blender converts
+  // indexes using its palette lookup table
+  if constexpr (std::is_same_v<DstTraits, RgbTraits> &&
+                std::is_same_v<SrcTraits, IndexedTraits>) {
+    const int h = std::min(srcBounds.h, dstBounds.h);
+    for (int y=0; y<h; ++y) {
+      RgbTraits::address_t d =
+        get_pixel_address_fast<RgbTraits>(dst, dstBounds.x, dstBounds.y+y);
+      IndexedTraits::const_address_t s =
+        get_pixel_address_fast<IndexedTraits>(src, srcBounds.x, srcBounds.y+y);
+      for (int x=0; x<srcBounds.w; ++x, ++d, ++s)
+        *d = blender(*d, *s, opacity);
+    }
+    return;
+  }
+
   // Lock all necessary bits
   const LockImageBits<SrcTraits> srcBits(src, srcBounds);
   LockImageBits<DstTraits> dstBits(dst, dstBounds);
@@ -244,6 +282,120 @@ done_with_line:;
 done_with_blit:;
 }
 
+// Copies the "n" pixels of "src" into "dst" repeating each one
+// "PxW" times (the compiler can use wide stores for each block when
+// PxW is known at compile-time).
+template<int PxW, typename pixel_t>
+inline pixel_t* replicate_pixels(pixel_t* dst, const pixel_t* src, const int n)
+{
+  for (int i=0; i<n; ++i, dst+=PxW)
+    std::fill_n(dst, PxW, src[i]);
+  return dst;
+}
+
+template<typename pixel_t>
+inline pixel_t* replicate_pixels(pixel_t* dst, const pixel_t* src, const int n,
+                                 const int px_w)
+{
+  switch (px_w) {
+    case 2:  return replicate_pixels<2>(dst, src, n);
+    case 3:  return replicate_pixels<3>(dst, src, n);
+    case 4:  return replicate_pixels<4>(dst, src, n);
+    case 8:  return replicate_pixels<8>(dst, src, n);
+    case 16: return replicate_pixels<16>(dst, src, n);
+  }
+  for (int i=0; i<n; ++i, dst+=px_w)
+    std::fill_n(dst, px_w, src[i]);
+  return dst;
+}
+
+// Same result as composite_image_scale_up() but for integer scale
+// factors only: each source pixel is blended one time (with the
+// destination pixel at the top-left corner of its block), and the
+// first destination row of each block is copied to the other rows.
+template<class DstTraits, class SrcTraits>
+void composite_image_int_scale_up(
+  Image* dst, const Image* src, const Palette* pal,
+  const gfx::ClipF& areaF,
+  const int opacity,
+  const BlendMode blendMode,
+  const double sx,
+  const double sy,
+  const bool newBlend,
+  const tile_flags tileFlags)
+{
+  ASSERT(dst);
+  ASSERT(src);
+  ASSERT(DstTraits::pixel_format == dst->pixelFormat());
+  ASSERT(SrcTraits::pixel_format == src->pixelFormat());
+
+  const int px_w = int(sx);
+  const int px_h = int(sy);
+  if (px_w < 1 || px_h < 1 || sx != double(px_w) || sy != double(px_h)) {
+    composite_image_scale_up<DstTraits, SrcTraits>(
+      dst, src, pal, areaF, opacity, blendMode, sx, sy, newBlend, tileFlags);
+    return;
+  }
+
+  gfx::Clip area(areaF);
+  if (!area.clip(dst->width(), dst->height(),
+                 px_w*src->width(),
+                 px_h*src->height()))
+    return;
+
+  BlenderHelper<DstTraits, SrcTraits> blender(dst, src, pal, blendMode, newBlend);
+
+  using dst_pixel_t = typename DstTraits::pixel_t;
+
+  // Source pixels that are visible in the area
+  const int u1 = area.src.x / px_w;
+  const int v1 = area.src.y / px_h;
+  const int u2 = (area.src.x + area.size.w - 1) / px_w;
+  const int v2 = (area.src.y + area.size.h - 1) / px_h;
+  const int srcW = u2 - u1 + 1;
+
+  // Width of the first (maybe partial) block of each row, and the
+  // number of complete blocks after it.
+  const int first_px_w = std::min(px_w - (area.src.x % px_w), area.size.w);
+  const int full_blocks = (area.size.w - first_px_w) / px_w;
+  const int last_px_w = (area.size.w - first_px_w) % px_w;
+
+  std::vector<dst_pixel_t> scanline(srcW);
+  int y = area.dst.y;
+
+  for (int v=v1; v<=v2; ++v) {
+    const int rows =
+      std::min((v+1)*px_h, area.src.y + area.size.h) -
+      std::max(v*px_h, area.src.y);
+    ASSERT(rows > 0);
+
+    // Blend each source pixel with the first destination pixel of
+    // its block.
+    dst_pixel_t* dstRow =
+      get_pixel_address_fast<DstTraits>(dst, area.dst.x, y);
+    auto srcPtr = get_pixel_address_fast<SrcTraits>(src, u1, v);
+
+    scanline[0] = blender(dstRow[0], srcPtr[0], opacity);
+    for (int i=1; i<srcW; ++i)
+      scanline[i] = blender(dstRow[first_px_w + (i-1)*px_w], srcPtr[i], opacity);
+
+    // Write the first row of the block
+    dst_pixel_t* d = dstRow;
+    std::fill_n(d, first_px_w, scanline[0]);
+    d += first_px_w;
+    d = replicate_pixels(d, &scanline[1], full_blocks, px_w);
+    if (last_px_w > 0)
+      std::fill_n(d, last_px_w, scanline[1+full_blocks]);
+
+    // Copy it to the other rows
+    for (int j=1; j<rows; ++j)
+      std::copy(dstRow, dstRow+area.size.w,
+                get_pixel_address_fast<DstTraits>(dst, area.dst.x, y+j));
+
+    y += rows;
+  }
+}
+
 template<class DstTraits, class SrcTraits>
 void composite_image_scale_down(
   Image* dst, const Image* src, const Palette* pal,
@@ -496,6 +648,9 @@ CompositeImageFunc get_fastest_composition_path(const Projection& proj,
     return composite_image_without_scale<DstTraits, SrcTraits>;
   }
   else if (proj.scaleX() >= 1.0 && proj.scaleY() >= 1.0) {
+    if (proj.scaleX() == std::floor(proj.scaleX()) &&
+        proj.scaleY() == std::floor(proj.scaleY()))
+      return composite_image_int_scale_up<DstTraits, SrcTraits>;
     return composite_image_scale_up<DstTraits, SrcTraits>;
   }
   // Slower composite function for special cases with odd zoom and non-square pixel ratio
@@ -524,6 +679,64 @@ bool has_visible_reference_layers(const LayerGroup* group)
   return false;
 }
 
+void premultiply_rect(Image* image, const gfx::Rect& bounds)
+{
+  for (int y=bounds.y; y<bounds.y2(); ++y) {
+    auto it = get_pixel_address_fast<RgbTraits>(image, bounds.x, y);
+    for (int x=0; x<bounds.w; ++x, ++it)
+      *it = rgba_premultiply(*it);
+  }
+}
+
+void unpremultiply_rect(Image* image, const gfx::Rect& bounds)
+{
+  for (int y=bounds.y; y<bounds.y2(); ++y) {
+    auto it = get_pixel_address_fast<RgbTraits>(image, bounds.x, y);
+    for (int x=0; x<bounds.w; ++x, ++it)
+      *it = rgba_unpremultiply(*it);
+  }
+}
+
+// Integer division rounding to negative infinity
+int floor_div(const int a, const int b)
+{
+  const int q = a / b;
+  return ((a % b) != 0 && (a < 0) != (b < 0) ? q-1: q);
+}
+
+template<typename ImageTraits>
+void fill_checkered_row(uint8_t* row,
+                        const int width,
+                        const int tile_w,
+                        const color_t color1,
+                        const color_t color2)
+{
+  auto* it = (typename ImageTraits::address_t)row;
+  for (int x=0; x<width; ++x, ++it)
+    *it = (((x / tile_w) & 1) ? color2: color1);
+}
+
+// Adds the elapsed time of its scope to a RenderStats counter
+class ScopedRenderStat {
+public:
+  ScopedRenderStat(RenderStats* stats, const RenderStats::Counter counter)
+    : m_stats(stats)
+    , m_counter(counter) {
+    if (m_stats)
+      m_start = RenderStats::Clock::now();
+  }
+
+  ~ScopedRenderStat() {
+    if (m_stats)
+      m_stats->add(m_counter, RenderStats::Clock::now() - m_start);
+  }
+
+private:
+  RenderStats* m_stats;
+  RenderStats::Counter m_counter;
+  RenderStats::Clock::time_point m_start;
+};
+
 } // anonymous namespace
 
 Render::Render()
@@ -544,6 +757,14 @@ Render::Render()
   , m_previewTileset(nullptr)
   , m_previewBlendMode(BlendMode::NORMAL)
   , m_onionskin(OnionskinType::NONE)
+  , m_parallelTileSize(0)
+  , m_groupCache(nullptr)
+  , m_groupCachePass(0)
+  , m_onionskinCache(nullptr)
+  , m_tileAtlas(nullptr)
+  , m_stats(nullptr)
+  , m_premultiplied(false)
+  , m_premultipliedPass(false)
 {
 }
 
@@ -580,6 +801,36 @@ void Render::setSelectedLayer(const Layer* layer)
   m_selectedLayerForOpacity = layer;
 }
 
+void Render::setParallelTileSize(const int tileSize)
+{
+  m_parallelTileSize = std::max(0, tileSize);
+}
+
+void Render::setGroupCache(GroupCache* groupCache)
+{
+  m_groupCache = groupCache;
+}
+
+void Render::setOnionskinCache(GroupCache* onionskinCache)
+{
+  m_onionskinCache = onionskinCache;
+}
+
+void Render::setTileAtlas(TileAtlas* tileAtlas)
+{
+  m_tileAtlas = tileAtlas;
+}
+
+void Render::setPremultipliedComposition(const bool premultiplied)
+{
+  m_premultiplied = premultiplied;
+}
+
+void Render::setStats(RenderStats* stats)
+{
+  m_stats = stats;
+}
+
 void Render::setPreviewImage(const Layer* layer,
                              const frame_t frame,
                              const Image* image,
@@ -668,11 +919,12 @@ void Render::renderLayer(
     return;
 
   m_globalOpacity = 255;
+  if (m_groupCache)
+    m_groupCachePass = m_groupCache->newPass();
 
-  doc::RenderPlan plan;
-  plan.addLayer(layer, frame);
+  const RenderPlanPtr plan = getPlan(layer, frame);
   renderPlan(
-    plan, dstImage, area,
+    *plan, layer, dstImage, area,
     frame, compositeImage,
     true, true, blendMode);
 }
@@ -682,6 +934,78 @@ void Render::renderSprite(
   const Sprite* sprite,
   frame_t frame,
   const gfx::ClipF& area)
+{
+  // All tiles of a parallel render use the same pass
+  if (m_groupCache)
+    m_groupCachePass = m_groupCache->newPass();
+
+  if (m_parallelTileSize > 0 &&
+      (area.size.w > m_parallelTileSize ||
+       area.size.h > m_parallelTileSize)) {
+    renderSpriteInParallel(dstImage, sprite, frame, area);
+  }
+  else {
+    renderSpriteArea(dstImage, sprite, frame, area);
+  }
+}
+
+void Render::renderSpriteInParallel(
+  Image* dstImage,
+  const Sprite* sprite,
+  frame_t frame,
+  const gfx::ClipF& area)
+{
+  const gfx::Rect bounds =
+    gfx::Rect(int(area.dst.x), int(area.dst.y),
+              int(std::ceil(area.size.w)),
+              int(std::ceil(area.size.h))) & dstImage->bounds();
+  if (bounds.isEmpty())
+    return;
+
+  m_sprite = sprite;
+
+  // Create/validate the plan in this thread so it can be shared by
+  // all tiles (the plan cache is copied with this Render instance)
+  getPlan(sprite->root(), frame);
+
+  const int tileSize = m_parallelTileSize;
+  // Tiles are needed to paint the screen, so they are executed
+  // before other tasks of the shared scheduler.
+  doc::TaskGroup tiles(doc::TaskPriority::UICritical);
+
+  for (int y=bounds.y; y<bounds.y2(); y+=tileSize) {
+    for (int x=bounds.x; x<bounds.x2(); x+=tileSize) {
+      const gfx::ClipF tileArea(
+        x, y,
+        area.src.x + double(x) - area.dst.x,
+        area.src.y + double(y) - area.dst.y,
+        std::min(tileSize, bounds.x2()-x),
+        std::min(tileSize, bounds.y2()-y));
+
+      // Each tile uses its own copy of this Render because some
+      // fields are modified in the middle of the rendering process
+      // (e.g. m_globalOpacity or m_tmpBuf). Tiles don't overlap so
+      // each thread writes a different region of dstImage.
+      Render tileRender(*this);
+      tileRender.m_parallelTileSize = 0;
+      tileRender.m_tmpBuf.reset();
+      tileRender.m_tileRowBuf.reset();
+
+      tiles.run(
+        [tileRender, dstImage, sprite, frame, tileArea]() mutable {
+          tileRender.renderSpriteArea(dstImage, sprite, frame, tileArea);
+        });
+    }
+  }
+
+  tiles.wait();
+}
+
+void Render::renderSpriteArea(
+  Image* dstImage,
+  const Sprite* sprite,
+  frame_t frame,
+  const gfx::ClipF& area)
 {
   m_sprite = sprite;
 
@@ -720,16 +1044,28 @@ void Render::renderSprite(
     // In case that we need a special background (e.g. like the
     // checkered pattern), we can draw the background in a temporal
     // image and then merge this temporal image with the dstImage.
-    if (!isSolidBackground(bgLayer, bg_color)) {
+    const gfx::Rect bgBounds =
+      gfx::Rect(area.dstBounds()) & dstImage->bounds();
+    if (!isSolidBackground(bgLayer, bg_color) && !bgBounds.isEmpty()) {
       if (!m_tmpBuf)
         m_tmpBuf.reset(new doc::ImageBuffer);
-      ImageRef tmpBackground(Image::create(dstImage->spec(), m_tmpBuf));
-      renderBackground(tmpBackground.get(), bgLayer, bg_color, area);
+
+      // The temporary background covers just the rendered area, so
+      // we don't touch pixels outside "area" (which could be
+      // rendered by other thread, see renderSpriteInParallel()).
+      ImageSpec bgSpec = dstImage->spec();
+      bgSpec.setSize(bgBounds.size());
+      ImageRef tmpBackground(Image::create(bgSpec, m_tmpBuf));
+      renderBackground(tmpBackground.get(), bgLayer, bg_color,
+                       gfx::ClipF(0, 0,
+                                  area.src.x + bgBounds.x - area.dst.x,
+                                  area.src.y + bgBounds.y - area.dst.y,
+                                  bgBounds.w, bgBounds.h));
 
       // Draws dstImage over the background on each pixel of dstImage
       // with opacity is < 255 (the result is left on dstImage itself)
       composite_image(dstImage, tmpBackground.get(), sprite->palette(frame),
-                      0, 0, 255, BlendMode::DST_OVER);
+                      bgBounds.x, bgBounds.y, 255, BlendMode::DST_OVER);
     }
   }
   // Old Blending Method:
@@ -768,12 +1104,20 @@ void Render::renderSpriteLayers(Image* dstImage,
                                 frame_t frame,
                                 CompositeImageFunc compositeImage)
 {
-  doc::RenderPlan plan;
-  plan.addLayer(m_sprite->root(), frame);
+  const RenderPlanPtr plan = getPlan(m_sprite->root(), frame);
+
+  const gfx::Rect bounds = gfx::Rect(area.dstBounds()) & dstImage->bounds();
+  const bool premultiplied =
+    (!bounds.isEmpty() &&
+     canUsePremultipliedComposition(dstImage, *plan));
+  if (premultiplied) {
+    premultiply_rect(dstImage, bounds);
+    m_premultipliedPass = true;
+  }
 
   // Draw the background layer.
   m_globalOpacity = 255;
-  renderPlan(plan, dstImage,
+  renderPlan(*plan, m_sprite->root(), dstImage,
              area, frame, compositeImage,
              true,
              false,
@@ -785,11 +1129,16 @@ void Render::renderSpriteLayers(Image* dstImage,
 
   // Draw the transparent layers.
   m_globalOpacity = 255;
-  renderPlan(plan, dstImage,
+  renderPlan(*plan, m_sprite->root(), dstImage,
              area, frame, compositeImage,
              false,
              true,
              BlendMode::UNSPECIFIED);
+
+  if (premultiplied) {
+    m_premultipliedPass = false;
+    unpremultiply_rect(dstImage, bounds);
+  }
 }
 
 void Render::renderBackground(Image* image,
@@ -845,6 +1194,8 @@ void Render::renderOnionskin(
   // Onion-skin feature: Draw previous/next frames with different
   // opacity (<255)
   if (m_onionskin.type() != OnionskinType::NONE) {
+    ScopedRenderStat stat(m_stats, RenderStats::Onionskin);
+
     Tag* loop = m_onionskin.loopTag();
     Layer* onionLayer = (m_onionskin.layer() ? m_onionskin.layer():
                                                m_sprite->root());
@@ -884,16 +1235,24 @@ void Render::renderOnionskin(
         else if (m_onionskin.type() == OnionskinType::RED_BLUE_TINT)
           blendMode = (frameOut < frame ? BlendMode::RED_TINT: BlendMode::BLUE_TINT);
 
-        doc::RenderPlan plan;
-        plan.addLayer(onionLayer, frameIn);
+        // Render background only for "in-front" onion skinning and
+        // when opacity is < 255
+        const bool render_background =
+          (m_globalOpacity < 255 &&
+           m_onionskin.position() == OnionskinPosition::INFRONT);
+
+        if (canUseOnionskinCache(dstImage, onionLayer, frameIn)) {
+          renderCachedOnionskin(
+            dstImage, onionLayer, area, frameIn,
+            render_background, blendMode);
+          continue;
+        }
+
+        const RenderPlanPtr plan = m_plans.getPlan(onionLayer, frameIn);
         renderPlan(
-          plan, dstImage,
+          *plan, onionLayer, dstImage,
           area, frameIn, compositeImage,
-          // Render background only for "in-front" onion skinning and
-          // when opacity is < 255
-          (m_globalOpacity < 255 &&
-           m_onionskin.position() == OnionskinPosition::INFRONT),
-          true, blendMode);
+          render_background, true, blendMode);
       }
     }
   }
@@ -903,7 +1262,6 @@ void Render::renderCheckeredBackground(
   Image* image,
   const gfx::Clip& area)
 {
-  int x, y, u, v;
   int tile_w = m_bg.stripeSize.w;
   int tile_h = m_bg.stripeSize.h;
 
@@ -916,16 +1274,6 @@ void Render::renderCheckeredBackground(
   if (tile_w < 1) tile_w = 1;
   if (tile_h < 1) tile_h = 1;
 
-  // Tile position (u,v) is the number of tile we start in "area.src" coordinate
-  u = (area.src.x / tile_w);
-  v = (area.src.y / tile_h);
-
-  // Position where we start drawing the first tile in "image"
-  int x_start = -(area.src.x % tile_w);
-  int y_start = -(area.src.y % tile_h);
-
-  gfx::Rect dstBounds = area.dstBounds();
-
   // Fix background colors (make them opaque)
   ASSERT(m_bg.colorPixelFormat == image->pixelFormat());
   switch (m_bg.colorPixelFormat) {
@@ -939,19 +1287,60 @@ void Render::renderCheckeredBackground(
       break;
   }
 
-  // Draw checkered background (tile by tile)
-  int u_start = u;
-  for (y=y_start-tile_h; y<image->height()+tile_h; y+=tile_h) {
-    for (x=x_start-tile_w; x<image->width()+tile_w; x+=tile_w) {
-      gfx::Rect fillRc = dstBounds.createIntersection(gfx::Rect(x, y, tile_w, tile_h));
-      if (!fillRc.isEmpty())
-        fill_rect(
-          image, fillRc.x, fillRc.y, fillRc.x+fillRc.w-1, fillRc.y+fillRc.h-1,
-          (((u+v))&1)? m_bg.color2: m_bg.color1);
-      ++u;
+  const gfx::Rect bounds = area.dstBounds() & image->bounds();
+  if (bounds.isEmpty())
+    return;
+
+  // Pattern row with two tiles (color1 + color2) plus the width of
+  // the area, so each row of the area is just a copy of this row
+  // starting in the offset of its first pixel.
+  const int bpp = image->bytesPerPixel();
+  const int patternWidth = 2*tile_w + bounds.w;
+  if (m_bgPattern.format != image->pixelFormat() ||
+      m_bgPattern.color1 != m_bg.color1 ||
+      m_bgPattern.color2 != m_bg.color2 ||
+      m_bgPattern.tileWidth != tile_w ||
+      m_bgPattern.width < patternWidth) {
+    m_bgPattern.format = image->pixelFormat();
+    m_bgPattern.color1 = m_bg.color1;
+    m_bgPattern.color2 = m_bg.color2;
+    m_bgPattern.tileWidth = tile_w;
+    m_bgPattern.width = patternWidth;
+    m_bgPattern.row.resize(patternWidth * bpp);
+
+    uint8_t* row = m_bgPattern.row.data();
+    switch (image->pixelFormat()) {
+      case IMAGE_RGB:
+        fill_checkered_row<RgbTraits>(row, patternWidth, tile_w, m_bg.color1, m_bg.color2);
+        break;
+      case IMAGE_GRAYSCALE:
+        fill_checkered_row<GrayscaleTraits>(row, patternWidth, tile_w, m_bg.color1, m_bg.color2);
+        break;
+      case IMAGE_INDEXED:
+        fill_checkered_row<IndexedTraits>(row, patternWidth, tile_w, m_bg.color1, m_bg.color2);
+        break;
+      case IMAGE_TILEMAP:
+        fill_checkered_row<TilemapTraits>(row, patternWidth, tile_w, m_bg.color1, m_bg.color2);
+        break;
+      default:
+        ASSERT(false);
+        m_bgPattern.width = 0;
+        return;
     }
-    u = u_start;
-    ++v;
+  }
+
+  // Tile column/row of the first pixel in the area (x/y in "image"
+  // are (area.src.x+x, area.src.y+y) in "area.src" coordinates)
+  const int u = floor_div(area.src.x + bounds.x, tile_w);
+  const int offset = area.src.x + bounds.x - u*tile_w;
+  const uint8_t* pattern = m_bgPattern.row.data();
+
+  for (int y=bounds.y; y<bounds.y2(); ++y) {
+    const int v = floor_div(area.src.y + y, tile_h);
+    const int start = ((u+v) & 1)*tile_w + offset;
+    std::copy(pattern + start*bpp,
+              pattern + (start+bounds.w)*bpp,
+              image->getPixelAddress(bounds.x, y));
   }
 }
 
@@ -973,6 +1362,10 @@ void Render::renderImage(
   if (!compositeImage)
     return;
 
+  RenderCounters::add(RenderCounters::PixelsComposited,
+                      int64_t(m_proj.applyX(src_image->width())) *
+                      int64_t(m_proj.applyY(src_image->height())));
+
   compositeImage(
     dst_image, src_image, pal,
     gfx::ClipF(x, y, 0, 0,
@@ -986,7 +1379,8 @@ void Render::renderImage(
 }
 
 void Render::renderPlan(
-  RenderPlan& plan,
+  const RenderPlan& plan,
+  const Layer* rootLayer,
   Image* image,
   const gfx::Clip& area,
   const frame_t frame,
@@ -995,12 +1389,52 @@ void Render::renderPlan(
   const bool render_transparent,
   const BlendMode blendMode)
 {
+  // Check if we can use cached images of layer groups
+  bool useGroupCache =
+    (m_groupCache &&
+     render_transparent &&
+     blendMode == BlendMode::UNSPECIFIED &&
+     m_globalOpacity == 255 &&
+     m_nonactiveLayersOpacity == 255 &&
+     // Groups are flattened in RGB images (an indexed image cannot
+     // keep the opacity of the group cels)
+     image->pixelFormat() == IMAGE_RGB);
+  if (useGroupCache) {
+    // Cels with z-index can be moved in/out of their group
+    for (const auto& item : plan.items()) {
+      if (item.zIndex() != 0) {
+        useGroupCache = false;
+        break;
+      }
+    }
+  }
+  CacheableGroups cacheableGroups;
+  CachedGroupImages cachedGroupImages;
+  const LayerGroup* lastCachedGroup = nullptr;
+
   for (const auto& item : plan.items()) {
     const Cel* cel = item.cel;
     const Layer* layer = item.layer;
 
     ASSERT(layer->isVisible()); // Hidden layers shouldn't be in the plan
 
+    if (useGroupCache) {
+      if (const LayerGroup* group =
+            getCachedGroupForLayer(layer, rootLayer, frame,
+                                   cacheableGroups, cachedGroupImages)) {
+        // All the items of the group are consecutive in the plan
+        // (there is no z-index), so we composite the whole group
+        // with the first item.
+        if (group != lastCachedGroup) {
+          renderCachedGroup(image, group,
+                            cachedGroupImages[group].get(),
+                            area, frame);
+          lastCachedGroup = group;
+        }
+        continue;
+      }
+    }
+
     const bool isSelected = (m_selectedLayerForOpacity == layer);
     gfx::Rect extraArea;
     bool drawExtra = false;
@@ -1220,6 +1654,8 @@ void Render::renderCel(
                    int(celBounds.w), int(celBounds.h),
                    area.src.x, area.src.y, area.dst.x, area.dst.y, area.size.w, area.size.h);
 
+  RenderCounters::add(RenderCounters::CelsRendered, 1);
+
   if (cel_layer &&
       cel_image->pixelFormat() == IMAGE_TILEMAP) {
     ASSERT(cel_layer->isTilemap());
@@ -1266,6 +1702,21 @@ void Render::renderCel(
     TRACE_RENDER_CEL("Drawing tilemap (%d %d %d %d)\n",
                      tilesToDraw.x, tilesToDraw.y, tilesToDraw.w, tilesToDraw.h);
 
+    // Render rows of tiles from the atlas (the preview tileset is
+    // modified in place while the user draws, so it's not cached)
+    if (m_tileAtlas &&
+        dst_image->pixelFormat() != IMAGE_TILEMAP &&
+        tileset != m_previewTileset &&
+        blendMode == BlendMode::NORMAL &&
+        grid.tileOffset() == gfx::Point(grid.tileSize().w, grid.tileSize().h) &&
+        grid.oddRowOffset() == gfx::Point(0, 0) &&
+        grid.oddColOffset() == gfx::Point(0, 0) &&
+        !tilesToDraw.isEmpty() &&
+        renderTilemapRows(dst_image, cel_image, tileset, grid, tilesToDraw,
+                          pal, area, compositeImage, opacity, blendMode)) {
+      return;
+    }
+
     for (int v=tilesToDraw.y; v<tilesToDraw.y2(); ++v) {
       for (int u=tilesToDraw.x; u<tilesToDraw.x2(); ++u) {
         auto tileBoundsOnCanvas = grid.tileToCanvas(gfx::Rect(u, v, 1, 1));
@@ -1295,11 +1746,154 @@ void Render::renderCel(
     }
   }
   else {
+    // Clip the composition to the non-transparent pixels of the cel
+    // image, or skip the cel completely if it's fully transparent
+    // (SRC/MERGE modes modify the destination even with transparent
+    // pixels, so they are not culled). The preview image is never
+    // culled: it can be the cel image itself (e.g. a new cel) which
+    // is modified by the tool loop without a version increment, so
+    // the cached content bounds would be outdated.
+    if (cel &&
+        cel_image == cel->image() &&
+        cel_image != m_previewImage &&
+        !(m_previewImage && checkIfWeShouldUsePreview(cel)) &&
+        blendMode != BlendMode::SRC &&
+        blendMode != BlendMode::MERGE) {
+      const gfx::Rect content = cel->data()->contentBounds();
+      if (content.isEmpty())
+        return;
+
+      // Only for cels that are not scaled (e.g. reference layers)
+      if (celBounds.w == cel_image->width() &&
+          celBounds.h == cel_image->height()) {
+        gfx::RectF contentBounds(content);
+        contentBounds.offset(celBounds.origin());
+        contentBounds = m_proj.apply(contentBounds);
+
+        // Include partially covered pixels of the destination
+        const gfx::Rect rc =
+          area.srcBounds() &
+          gfx::Rect(gfx::Point(int(std::floor(contentBounds.x)),
+                               int(std::floor(contentBounds.y))),
+                    gfx::Point(int(std::ceil(contentBounds.x2())),
+                               int(std::ceil(contentBounds.y2()))));
+        if (rc.isEmpty())
+          return;
+
+        renderImage(dst_image, cel_image, pal, celBounds,
+                    gfx::Clip(area.dst.x+rc.x-area.src.x,
+                              area.dst.y+rc.y-area.src.y, rc),
+                    compositeImage, opacity, blendMode);
+        return;
+      }
+    }
+
     renderImage(dst_image, cel_image, pal, celBounds,
                 area, compositeImage, opacity, blendMode);
   }
 }
 
+bool Render::renderTilemapRows(
+  Image* dst_image,
+  const Image* cel_image,
+  const Tileset* tileset,
+  const Grid& grid,
+  const gfx::Rect& tilesToDraw,
+  const Palette* pal,
+  const gfx::Clip& area,
+  const CompositeImageFunc compositeImage,
+  const int opacity,
+  const BlendMode blendMode)
+{
+  ASSERT(m_tileAtlas);
+  ASSERT(cel_image->bounds().contains(tilesToDraw));
+
+  // Variants of the atlas (flip flags) used by the visible tiles
+  int variants = 0;
+  for (int v=tilesToDraw.y; v<tilesToDraw.y2(); ++v) {
+    auto row = (const tile_t*)cel_image->readPixelAddress(tilesToDraw.x, v);
+    for (int u=0; u<tilesToDraw.w; ++u) {
+      if (row[u] != notile)
+        variants |= (1 << TileAtlas::variant(tile_getf(row[u])));
+    }
+  }
+  if (!variants)
+    return true;
+
+  TileAtlas::Atlases atlases;
+  if (!m_tileAtlas->getAtlases(tileset, variants, atlases))
+    return false;
+
+  const Image* base = atlases[0].get();
+  const gfx::Size tileSize = grid.tileSize();
+  const int tileRowBytes = tileSize.w * base->bytesPerPixel();
+  const tile_index ntiles = tileset->size();
+
+  if (!m_tileRowBuf)
+    m_tileRowBuf.reset(new ImageBuffer);
+
+  for (int v=tilesToDraw.y; v<tilesToDraw.y2(); ++v) {
+    auto row = (const tile_t*)cel_image->readPixelAddress(tilesToDraw.x, v);
+
+    // Cull empty tiles at both sides of the row
+    int u1 = 0, u2 = tilesToDraw.w;
+    while (u1 < u2 && row[u1] == notile)
+      ++u1;
+    while (u2 > u1 && row[u2-1] == notile)
+      --u2;
+    if (u1 == u2)
+      continue;
+
+    ImageSpec spec = base->spec();
+    spec.setSize((u2-u1)*tileSize.w, tileSize.h);
+    ImageRef strip(Image::create(spec, m_tileRowBuf));
+
+    // Tiles without a pre-flipped variant are rendered one by one
+    // (e.g. diagonal flip of non-square tiles)
+    int nonAtlasTiles = 0;
+
+    for (int u=u1; u<u2; ++u) {
+      const tile_t t = row[u];
+      const tile_index i = tile_geti(t);
+      const Image* atlas = atlases[TileAtlas::variant(tile_getf(t))].get();
+      const int x = (u-u1)*tileSize.w;
+
+      if (t == notile || i >= ntiles || !atlas) {
+        fill_rect(strip.get(), x, 0, x+tileSize.w-1, tileSize.h-1,
+                  spec.maskColor());
+        if (t != notile && i < ntiles)
+          ++nonAtlasTiles;
+        continue;
+      }
+
+      for (int y=0; y<tileSize.h; ++y)
+        std::memcpy(strip->getPixelAddress(x, y),
+                    atlas->readPixelAddress(0, i*tileSize.h + y),
+                    tileRowBytes);
+    }
+
+    renderImage(dst_image, strip.get(), pal,
+                grid.tileToCanvas(gfx::Rect(tilesToDraw.x+u1, v, u2-u1, 1)),
+                area, compositeImage, opacity, blendMode);
+
+    for (int u=u1; nonAtlasTiles > 0 && u<u2; ++u) {
+      const tile_t t = row[u];
+      if (t == notile ||
+          tile_geti(t) >= ntiles ||
+          atlases[TileAtlas::variant(tile_getf(t))])
+        continue;
+
+      if (const ImageRef tile_image = tileset->get(tile_geti(t))) {
+        renderImage(dst_image, tile_image.get(), pal,
+                    grid.tileToCanvas(gfx::Rect(tilesToDraw.x+u, v, 1, 1)),
+                    area, compositeImage, opacity, blendMode, tile_getf(t));
+      }
+      --nonAtlasTiles;
+    }
+  }
+  return true;
+}
+
 void Render::renderImage(
   Image* dst_image,
   const Image* cel_image,
@@ -1324,6 +1918,9 @@ void Render::renderImage(
       nullptr, tileFlags);
   }
 
+  RenderCounters::add(RenderCounters::PixelsComposited,
+                      int64_t(srcBounds.w) * int64_t(srcBounds.h));
+
   compositeImage(
     dst_image, cel_image, pal,
     gfx::ClipF(
@@ -1334,7 +1931,8 @@ void Render::renderImage(
       srcBounds.w,
       srcBounds.h),
     opacity,
-    blendMode,
+    (m_premultipliedPass && blendMode == BlendMode::NORMAL ?
+     BlendMode::NORMAL_PREMUL: blendMode),
     m_proj.scaleX() * celBounds.w / double(cel_image->width()),
     m_proj.scaleY() * celBounds.h / double(cel_image->height()),
     m_newBlendMethod,
@@ -1399,6 +1997,12 @@ CompositeImageFunc Render::getImageComposition(
   return nullptr;
 }
 
+RenderPlanPtr Render::getPlan(const Layer* layer, const frame_t frame)
+{
+  ScopedRenderStat stat(m_stats, RenderStats::Plan);
+  return m_plans.getPlan(layer, frame);
+}
+
 bool Render::checkIfWeShouldUsePreview(const Cel* cel) const
 {
   if ((m_selectedLayer == cel->layer())) {
@@ -1416,6 +2020,248 @@ bool Render::checkIfWeShouldUsePreview(const Cel* cel) const
   return false;
 }
 
+bool Render::isCacheableGroup(const LayerGroup* group,
+                              CacheableGroups& cacheable) const
+{
+  auto it = cacheable.find(group);
+  if (it != cacheable.end())
+    return it->second;
+
+  bool result = true;
+  for (const Layer* child : group->layers()) {
+    if (!child->isVisible())
+      continue;
+
+    if (child->isReference() ||
+        (m_previewImage && child == m_selectedLayer) ||
+        (m_extraCel && m_extraImage && child == m_currentLayer)) {
+      result = false;
+    }
+    else if (child->isGroup()) {
+      result = isCacheableGroup(static_cast<const LayerGroup*>(child),
+                                cacheable);
+    }
+    else if (static_cast<const LayerImage*>(child)->blendMode() != BlendMode::NORMAL) {
+      result = false;
+    }
+    if (!result)
+      break;
+  }
+
+  cacheable[group] = result;
+  return result;
+}
+
+const LayerGroup* Render::getCachedGroupForLayer(const Layer* layer,
+                                                 const Layer* rootLayer,
+                                                 const frame_t frame,
+                                                 CacheableGroups& cacheable,
+                                                 CachedGroupImages& images) const
+{
+  // Groups that contain the layer below the rendered root layer
+  // (and without including the sprite root, which doesn't have a
+  // parent), from the outermost to the innermost one
+  std::vector<const LayerGroup*> groups;
+  for (const LayerGroup* group = layer->parent();
+       group && group != rootLayer && group->parent();
+       group = group->parent()) {
+    groups.push_back(group);
+  }
+
+  // Get the outermost cacheable group that didn't change, changed
+  // groups are rendered directly so only their unchanged subgroups
+  // are cached
+  for (auto it=groups.rbegin(); it!=groups.rend(); ++it) {
+    const LayerGroup* group = *it;
+    if (!isCacheableGroup(group, cacheable))
+      continue;
+
+    auto imgIt = images.find(group);
+    if (imgIt == images.end())
+      imgIt = images.emplace(group, getCachedGroupImage(group, frame)).first;
+    if (imgIt->second)
+      return group;
+  }
+  return nullptr;
+}
+
+bool Render::canUsePremultipliedComposition(const Image* dstImage,
+                                            const RenderPlan& plan) const
+{
+  if (!m_premultiplied ||
+      dstImage->pixelFormat() != IMAGE_RGB)
+    return false;
+
+  for (const auto& item : plan.items()) {
+    if (item.layer->isImage() &&
+        static_cast<const LayerImage*>(item.layer)->blendMode() != BlendMode::NORMAL)
+      return false;
+  }
+
+  if (m_extraCel && m_extraImage &&
+      m_extraType != ExtraType::NONE &&
+      m_extraBlendMode != BlendMode::NORMAL)
+    return false;
+
+  if (m_previewImage &&
+      m_selectedLayer &&
+      m_previewBlendMode != BlendMode::NORMAL)
+    return false;
+
+  return (m_onionskin.type() != OnionskinType::RED_BLUE_TINT);
+}
+
+bool Render::canUseOnionskinCache(const Image* dstImage,
+                                  const Layer* layer,
+                                  const frame_t frame) const
+{
+  if (!m_onionskinCache ||
+      m_nonactiveLayersOpacity != 255 ||
+      dstImage->pixelFormat() == IMAGE_TILEMAP)
+    return false;
+
+  // Reference layers need to be composited with the final
+  // projection (they can have sub-pixel bounds)
+  if ((m_flags & Flags::ShowRefLayers) &&
+      layer->isGroup() &&
+      has_visible_reference_layers(static_cast<const LayerGroup*>(layer)))
+    return false;
+
+  // The preview image replaces the cel of the selected layer in
+  // this frame (or in a linked frame)
+  if (m_previewImage && m_selectedLayer) {
+    const Cel* cel = m_selectedLayer->cel(frame);
+    if (frame == m_selectedFrame ||
+        (cel && checkIfWeShouldUsePreview(cel)))
+      return false;
+  }
+
+  // Same for the extra cel in the current layer
+  if (m_extraCel && m_extraImage) {
+    if (frame == m_extraCel->frame())
+      return false;
+    if (m_currentLayer) {
+      const Cel* cel = m_currentLayer->cel(frame);
+      const Cel* cel2 = m_currentLayer->cel(m_extraCel->frame());
+      if (cel && cel2 && cel->data() == cel2->data())
+        return false;
+    }
+  }
+  return true;
+}
+
+void Render::renderCachedOnionskin(
+  Image* dstImage,
+  const Layer* layer,
+  const gfx::Clip& area,
+  const frame_t frame,
+  const bool render_background,
+  const BlendMode blendMode)
+{
+  // The frame is flattened in the destination pixel format (so the
+  // onion skin tint/opacity is applied only once to each pixel)
+  const PixelFormat dstFormat = dstImage->pixelFormat();
+  ImageSpec spec = m_sprite->spec();
+  if (spec.colorMode() != (ColorMode)dstFormat) {
+    spec.setColorMode((ColorMode)dstFormat);
+    spec.setMaskColor(0);
+  }
+
+  // Merge onion skin uses the Normal blend mode for each cel, the
+  // tint is applied to the flattened frame
+  const BlendMode celBlendMode = (blendMode == BlendMode::NORMAL ?
+                                  BlendMode::NORMAL:
+                                  BlendMode::UNSPECIFIED);
+  const uint64_t variant =
+    (uint64_t(render_background ? 1: 0) |
+     (uint64_t(m_newBlendMethod ? 1: 0) << 1) |
+     (uint64_t(celBlendMode == BlendMode::NORMAL ? 1: 0) << 2) |
+     (uint64_t(m_flags) << 8));
+
+  const int flags = m_flags;
+  const bool newBlend = m_newBlendMethod;
+  ImageRef frameImage = m_onionskinCache->getImage(
+    layer, frame, spec, variant,
+    [layer, frame, flags, newBlend, render_background, celBlendMode](Image* dst){
+      Render render;
+      render.m_flags = flags;
+      render.setNewBlend(newBlend);
+      render.m_sprite = layer->sprite();
+      render.m_globalOpacity = 255;
+
+      CompositeImageFunc compositeImage =
+        render.getImageComposition(dst->pixelFormat(),
+                                   render.m_sprite->pixelFormat(),
+                                   layer);
+      if (!compositeImage)
+        return;
+
+      const RenderPlanPtr plan = render.m_plans.getPlan(layer, frame);
+      render.renderPlan(
+        *plan, layer, dst, gfx::Clip(dst->bounds()),
+        frame, compositeImage,
+        render_background, true, celBlendMode);
+    });
+  if (!frameImage)
+    return;
+
+  CompositeImageFunc compositeImage =
+    getImageComposition(dstFormat, frameImage->pixelFormat(), layer);
+  if (!compositeImage)
+    return;
+
+  renderImage(dstImage, frameImage.get(),
+              m_sprite->palette(frame),
+              gfx::RectF(frameImage->bounds()),
+              area, compositeImage,
+              m_globalOpacity,
+              (blendMode == BlendMode::UNSPECIFIED ? BlendMode::NORMAL:
+                                                     blendMode));
+}
+
+ImageRef Render::getCachedGroupImage(const LayerGroup* group,
+                                     const frame_t frame) const
+{
+  // The group is flattened in RGB (even for indexed sprites) so
+  // semi-transparent cels/layers inside the group are not lost
+  ImageSpec spec = m_sprite->spec();
+  spec.setColorMode(ColorMode::RGB);
+  spec.setMaskColor(0);
+
+  // The whole group is flattened only if it didn't change since the
+  // previous render (so it's worth to cache it)
+  const bool newBlend = m_newBlendMethod;
+  GroupCache* groupCache = m_groupCache;
+  return m_groupCache->getUnchangedImage(
+    group, frame, spec, (newBlend ? 1: 0), m_groupCachePass,
+    [group, frame, newBlend, groupCache](Image* dst){
+      // Unchanged subgroups are composited from the cache too
+      Render render;
+      render.setNewBlend(newBlend);
+      render.setGroupCache(groupCache);
+      render.renderLayer(dst, group, frame);
+    });
+}
+
+void Render::renderCachedGroup(
+  Image* image,
+  const LayerGroup* group,
+  const Image* groupImage,
+  const gfx::Clip& area,
+  const frame_t frame)
+{
+  CompositeImageFunc compositeImage =
+    getImageComposition(image->pixelFormat(), IMAGE_RGB, group);
+  if (!compositeImage)
+    return;
+
+  renderImage(image, groupImage,
+              m_sprite->palette(frame),
+              gfx::RectF(groupImage->bounds()),
+              area, compositeImage,
+              255, BlendMode::NORMAL);
+}
+
 void composite_image(Image* dst,
                      const Image* src,
                      const Palette* pal,
@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019-2023 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -14,7 +14,9 @@
 #include "doc/color.h"
 #include "doc/doc.h"
 #include "doc/frame.h"
+#include "doc/image_ref.h"
 #include "doc/pixel_format.h"
+#include "doc/render_plan.h"
 #include "doc/tile.h"
 #include "gfx/clip.h"
 #include "gfx/point.h"
@@ -24,18 +26,24 @@
 #include "render/onionskin_options.h"
 #include "render/projection.h"
 
+#include <map>
+#include <vector>
+
 namespace doc {
   class Cel;
+  class Grid;
   class Image;
   class Layer;
   class Palette;
-  class RenderPlan;
   class Sprite;
   class Tileset;
 }
 
 namespace render {
   using namespace doc;
+  class GroupCache;
+  class RenderStats;
+  class TileAtlas;
 
   typedef void (*CompositeImageFunc)(
     Image* dst,
@@ -64,6 +72,50 @@ namespace render {
     void setBgOptions(const BgOptions& bg);
     void setSelectedLayer(const Layer* layer);
 
+    // Splits the area given to renderSprite() in tiles of
+    // tileSize x tileSize pixels which are rendered in parallel
+    // using a pool of worker threads. Use 0 to render everything in
+    // the calling thread (the default).
+    void setParallelTileSize(const int tileSize);
+
+    // Uses the given cache to composite layer groups that didn't
+    // change as just one image. Only groups with visible layers
+    // using the Normal blend mode (and without reference layers,
+    // z-index, preview or extra images) rendered in RGB images are
+    // cached. Groups are flattened in RGB (even in indexed sprites),
+    // so the result can differ only in the rounding of the alpha
+    // compositing.
+    // Use nullptr to disable it (the default).
+    void setGroupCache(GroupCache* groupCache);
+
+    // Uses the given cache to keep the flattened image of each
+    // onion skin frame, so neighbor frames that didn't change are
+    // composited as just one image (with the onion skin opacity or
+    // tint applied to the whole frame instead of to each cel).
+    // Use nullptr to disable it (the default).
+    void setOnionskinCache(GroupCache* onionskinCache);
+
+    // Uses the given atlas to render tilemaps composited with the
+    // Normal blend mode, each row of visible tiles is copied from
+    // the atlas to one image which is composited at once (instead of
+    // compositing each tile). With zoom out the sampling is done in
+    // the whole row, so it can differ in the pixels at the edges of
+    // each tile. Use nullptr to disable it (the default).
+    void setTileAtlas(TileAtlas* tileAtlas);
+
+    // Composites the sprite layers over a premultiplied copy of the
+    // destination RGB image, converting it back to straight alpha
+    // after the last layer. It's used only when all layers use the
+    // Normal blend mode (the premultiplied blender doesn't need
+    // divisions), the result can differ in the rounding of
+    // semi-transparent pixels.
+    void setPremultipliedComposition(const bool premultiplied);
+
+    // Adds the time spent creating render plans and rendering onion
+    // skin frames to the given stats. Use nullptr to disable it (the
+    // default).
+    void setStats(RenderStats* stats);
+
     // Sets the preview image. This preview image is an alternative
     // image to be used for the given layer/frame.
     void setPreviewImage(const Layer* layer,
@@ -139,6 +191,18 @@ namespace render {
       const BlendMode blendMode);
 
   private:
+    void renderSpriteArea(
+      Image* dstImage,
+      const Sprite* sprite,
+      frame_t frame,
+      const gfx::ClipF& area);
+
+    void renderSpriteInParallel(
+      Image* dstImage,
+      const Sprite* sprite,
+      frame_t frame,
+      const gfx::ClipF& area);
+
     void renderSpriteLayers(
       Image* dstImage,
       const gfx::ClipF& area,
@@ -162,7 +226,8 @@ namespace render {
       const CompositeImageFunc compositeImage);
 
     void renderPlan(
-      doc::RenderPlan& plan,
+      const doc::RenderPlan& plan,
+      const Layer* rootLayer,
       Image* image,
       const gfx::Clip& area,
       const frame_t frame,
@@ -194,6 +259,18 @@ namespace render {
       const BlendMode blendMode,
       const tile_flags tileFlags = notile);
 
+    bool renderTilemapRows(
+      Image* dst_image,
+      const Image* cel_image,
+      const Tileset* tileset,
+      const Grid& grid,
+      const gfx::Rect& tilesToDraw,
+      const Palette* pal,
+      const gfx::Clip& area,
+      const CompositeImageFunc compositeImage,
+      const int opacity,
+      const BlendMode blendMode);
+
     CompositeImageFunc getImageComposition(
       const PixelFormat dstFormat,
       const PixelFormat srcFormat,
@@ -201,6 +278,37 @@ namespace render {
       const tile_flags tileFlags = notile);
 
     bool checkIfWeShouldUsePreview(const Cel* cel) const;
+    RenderPlanPtr getPlan(const Layer* layer, const frame_t frame);
+
+    using CacheableGroups = std::map<const LayerGroup*, bool>;
+    using CachedGroupImages = std::map<const LayerGroup*, ImageRef>;
+    bool isCacheableGroup(const LayerGroup* group,
+                          CacheableGroups& cacheable) const;
+    const LayerGroup* getCachedGroupForLayer(const Layer* layer,
+                                             const Layer* rootLayer,
+                                             const frame_t frame,
+                                             CacheableGroups& cacheable,
+                                             CachedGroupImages& images) const;
+    bool canUsePremultipliedComposition(const Image* dstImage,
+                                        const RenderPlan& plan) const;
+    bool canUseOnionskinCache(const Image* dstImage,
+                              const Layer* layer,
+                              const frame_t frame) const;
+    void renderCachedOnionskin(
+      Image* dstImage,
+      const Layer* layer,
+      const gfx::Clip& area,
+      const frame_t frame,
+      const bool render_background,
+      const BlendMode blendMode);
+    ImageRef getCachedGroupImage(const LayerGroup* group,
+                                 const frame_t frame) const;
+    void renderCachedGroup(
+      Image* image,
+      const LayerGroup* group,
+      const Image* groupImage,
+      const gfx::Clip& area,
+      const frame_t frame);
 
     int m_flags;
     int m_nonactiveLayersOpacity;
@@ -224,6 +332,30 @@ namespace render {
     BlendMode m_previewBlendMode;
     OnionskinOptions m_onionskin;
     ImageBufferPtr m_tmpBuf;
+    int m_parallelTileSize;
+    GroupCache* m_groupCache;
+    uint32_t m_groupCachePass;
+    GroupCache* m_onionskinCache;
+    TileAtlas* m_tileAtlas;
+    RenderStats* m_stats;
+    // Buffer for the strip of tiles rendered by renderTilemapRows()
+    ImageBufferPtr m_tileRowBuf;
+    bool m_premultiplied;
+    // True while the sprite layers are composited in a premultiplied
+    // destination (to use BlendMode::NORMAL_PREMUL)
+    bool m_premultipliedPass;
+
+    // Cached row of the checkered background (see
+    // renderCheckeredBackground())
+    struct BgPattern {
+      PixelFormat format = IMAGE_RGB;
+      color_t color1 = 0;
+      color_t color2 = 0;
+      int tileWidth = 0;
+      int width = 0;
+      std::vector<uint8_t> row;
+    } m_bgPattern;
+    RenderPlanCache m_plans;
   };
 
   void composite_image(Image* dst,
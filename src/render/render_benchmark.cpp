@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2022 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -13,12 +13,19 @@
 #include "doc/cel.h"
 #include "doc/image.h"
 #include "doc/layer.h"
+#include "doc/layer_tilemap.h"
 #include "doc/palette.h"
 #include "doc/primitives.h"
 #include "doc/sprite.h"
+#include "doc/tileset.h"
+#include "doc/tilesets.h"
+#include "render/onionskin_options.h"
+#include "render/tile_atlas.h"
 
 #include <benchmark/benchmark.h>
 
+#include <memory>
+
 using namespace doc;
 using namespace render;
 
@@ -79,4 +86,278 @@ BENCHMARK(Bm_Render)
   ->Args({ 4096, 4096 })
   ->Unit(benchmark::kMicrosecond);
 
+static void Bm_RenderZoom(benchmark::State& state)
+{
+  const int w = state.range(0);
+  const int h = state.range(1);
+  const int zoom = state.range(2);
+
+  Sprite* spr = Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, w, h));
+  LayerImage* lay = static_cast<LayerImage*>(spr->root()->firstLayer());
+  Image* img = lay->cel(0)->image();
+  clear_image(img, 0);
+  fill_rect(img, 16, 16, w-32, h-32, rgba(32, 128, 255, 128));
+
+  std::unique_ptr<Image> dst(Image::create(spr->pixelFormat(), w*zoom, h*zoom));
+
+  Render render;
+  BgOptions bg;
+  bg.type = BgType::CHECKERED;
+  bg.zoom = true;
+  bg.color1 = rgba(100, 100, 100, 255);
+  bg.color2 = rgba(200, 200, 200, 255);
+  bg.stripeSize = gfx::Size(16, 16);
+  render.setBgOptions(bg);
+  render.setProjection(Projection(PixelRatio(1, 1), Zoom(zoom, 1)));
+
+  while (state.KeepRunning()) {
+    render.renderSprite(
+      dst.get(), spr, frame_t(0),
+      gfx::Clip(0, 0, 0, 0, w*zoom, h*zoom));
+  }
+}
+
+BENCHMARK(Bm_RenderZoom)
+  ->Args({ 256, 256, 2 })
+  ->Args({ 256, 256, 4 })
+  ->Args({ 256, 256, 8 })
+  ->Args({ 512, 512, 3 })
+  ->Unit(benchmark::kMicrosecond);
+
+static void Bm_RenderTilemapZoomOut(benchmark::State& state)
+{
+  const int ntiles = state.range(0); // Tilemap of ntiles x ntiles
+  const bool useAtlas = (state.range(1) != 0);
+  const gfx::Size tileSize(16, 16);
+
+  Sprite* spr = Sprite::MakeStdSprite(
+    ImageSpec(ColorMode::RGB, ntiles*tileSize.w, ntiles*tileSize.h));
+  clear_image(spr->root()->firstLayer()->cel(0)->image(), 0);
+
+  Tileset* tileset = new Tileset(spr, Grid(tileSize), 64);
+  for (tile_index ti=1; ti<tileset->size(); ++ti) {
+    ImageRef tile = tileset->get(ti);
+    clear_image(tile.get(), rgba(4*ti, 255-4*ti, 128, 255));
+    fill_rect(tile.get(), 2, 2, 9, 9, rgba(255, 0, 0, 128));
+  }
+  LayerTilemap* lay = new LayerTilemap(spr, spr->tilesets()->add(tileset));
+  spr->root()->addLayer(lay);
+
+  ImageRef tilemap(Image::create(IMAGE_TILEMAP, ntiles, ntiles));
+  for (int v=0; v<ntiles; ++v)
+    for (int u=0; u<ntiles; ++u)
+      put_pixel(tilemap.get(), u, v,
+                tile((u*7 + v*3) % 64, ((u+v) & 1) ? tile_f_xflip: 0));
+  lay->addCel(new Cel(frame_t(0), tilemap));
+
+  // Zoom out to see the whole tilemap in a 1024x1024 image
+  const int w = 1024;
+  const int h = 1024;
+  std::unique_ptr<Image> dst(Image::create(spr->pixelFormat(), w, h));
+
+  TileAtlas atlas;
+  Render render;
+  render.setProjection(Projection(PixelRatio(1, 1),
+                                  Zoom(w, ntiles*tileSize.w)));
+  if (useAtlas)
+    render.setTileAtlas(&atlas);
+
+  while (state.KeepRunning()) {
+    clear_image(dst.get(), 0);
+    render.renderSprite(
+      dst.get(), spr, frame_t(0),
+      gfx::Clip(0, 0, 0, 0, w, h));
+  }
+}
+
+BENCHMARK(Bm_RenderTilemapZoomOut)
+  ->Args({ 128, 0 })
+  ->Args({ 128, 1 })
+  ->Args({ 512, 0 })
+  ->Args({ 512, 1 })
+  ->Unit(benchmark::kMicrosecond);
+
+// Parameters of a synthetic document with a realistic structure to
+// measure Bm_RenderScene.
+struct SceneParams {
+  int layers;                   // Image layers
+  int groupDepth;               // Image layers are inside N nested groups
+  BlendMode blendMode;          // Blend mode of all layers (except the background)
+  bool zIndex;                  // Use cels with different z-index
+  int onionskin;                // Onion skin previous/next frames
+  int tilemaps;                 // Tilemap layers
+  bool indexed;                 // Indexed (or RGBA) sprite
+  int zoom;                     // Zoom in percentage (e.g. 25, 100, 400)
+};
+
+static std::unique_ptr<Sprite> make_scene(const SceneParams& params,
+                                          const int w, const int h)
+{
+  auto spr = std::unique_ptr<Sprite>(
+    Sprite::MakeStdSprite(ImageSpec(params.indexed ? ColorMode::INDEXED:
+                                                     ColorMode::RGB, w, h)));
+  const frame_t frames = 1 + 2*params.onionskin;
+  spr->setTotalFrames(frames);
+
+  auto color = [&params](int i) -> color_t {
+    if (params.indexed)
+      return 1 + (i % 254);
+    return rgba((i*37) & 255, (i*91) & 255, (i*53) & 255, 160);
+  };
+
+  // Background layer
+  LayerImage* bg = static_cast<LayerImage*>(spr->root()->firstLayer());
+  clear_image(bg->cel(0)->image(), color(0));
+  for (frame_t f=1; f<frames; ++f)
+    bg->addCel(Cel::MakeLink(f, bg->cel(0)));
+
+  LayerGroup* parent = spr->root();
+  for (int d=0; d<params.groupDepth; ++d) {
+    auto group = new LayerGroup(spr.get());
+    parent->addLayer(group);
+    parent = group;
+  }
+
+  // Each layer has a cel covering half of the sprite, moving in each
+  // frame (as an animation of the layer).
+  for (int i=0; i<params.layers; ++i) {
+    auto lay = new LayerImage(spr.get());
+    lay->setBlendMode(params.blendMode);
+    parent->addLayer(lay);
+
+    for (frame_t f=0; f<frames; ++f) {
+      ImageRef img(Image::create(spr->pixelFormat(), w/2, h/2));
+      clear_image(img.get(), 0);
+      fill_rect(img.get(), 4, 4, w/2-8, h/2-8, color(1+i));
+      fill_rect(img.get(), w/8, h/8, w/4, h/4, color(2+i+f));
+
+      Cel* cel = new Cel(f, img);
+      cel->setPosition(((i*w/7) + f*8) % (w/2),
+                       ((i*h/5) + f*4) % (h/2));
+      if (params.zIndex)
+        cel->setZIndex((i % 3) - 1);
+      lay->addCel(cel);
+    }
+  }
+
+  // Tilemap layers covering the whole sprite
+  if (params.tilemaps > 0) {
+    const gfx::Size tileSize(16, 16);
+    Tileset* tileset = new Tileset(spr.get(), Grid(tileSize), 64);
+    for (tile_index ti=1; ti<tileset->size(); ++ti) {
+      ImageRef tile = tileset->get(ti);
+      clear_image(tile.get(), color(ti));
+      fill_rect(tile.get(), 2, 2, 9, 9, color(ti+1));
+    }
+    const tileset_index tsi = spr->tilesets()->add(tileset);
+
+    const int u = w / tileSize.w;
+    const int v = h / tileSize.h;
+    for (int i=0; i<params.tilemaps; ++i) {
+      auto lay = new LayerTilemap(spr.get(), tsi);
+      lay->setBlendMode(params.blendMode);
+      spr->root()->addLayer(lay);
+
+      for (frame_t f=0; f<frames; ++f) {
+        ImageRef tilemap(Image::create(IMAGE_TILEMAP, u, v));
+        for (int y=0; y<v; ++y)
+          for (int x=0; x<u; ++x)
+            put_pixel(tilemap.get(), x, y,
+                      tile((x*7 + y*3 + i + f) % 64,
+                           ((x+y) & 1) ? tile_f_xflip: 0));
+        lay->addCel(new Cel(f, tilemap));
+      }
+    }
+  }
+
+  return spr;
+}
+
+static void Bm_RenderScene(benchmark::State& state)
+{
+  const SceneParams params = {
+    int(state.range(0)),
+    int(state.range(1)),
+    BlendMode(state.range(2)),
+    state.range(3) != 0,
+    int(state.range(4)),
+    int(state.range(5)),
+    state.range(6) != 0,
+    int(state.range(7)),
+  };
+  const int w = 512;
+  const int h = 512;
+  std::unique_ptr<Sprite> spr = make_scene(params, w, h);
+
+  const Zoom zoom = (params.zoom >= 100 ? Zoom(params.zoom / 100, 1):
+                                          Zoom(1, 100 / params.zoom));
+  const int dstW = zoom.apply(w);
+  const int dstH = zoom.apply(h);
+  std::unique_ptr<Image> dst(Image::create(IMAGE_RGB, dstW, dstH));
+
+  Render render;
+  BgOptions bg;
+  bg.type = BgType::CHECKERED;
+  bg.zoom = true;
+  bg.color1 = rgba(100, 100, 100, 255);
+  bg.color2 = rgba(200, 200, 200, 255);
+  bg.stripeSize = gfx::Size(16, 16);
+  render.setBgOptions(bg);
+  render.setProjection(Projection(PixelRatio(1, 1), zoom));
+
+  if (params.onionskin > 0) {
+    OnionskinOptions onionskin(OnionskinType::MERGE);
+    onionskin.prevFrames(params.onionskin);
+    onionskin.nextFrames(params.onionskin);
+    onionskin.opacityBase(68);
+    onionskin.opacityStep(28);
+    render.setOnionskin(onionskin);
+  }
+
+  // Render the frame in the middle to show the onion skin of
+  // previous and next frames
+  const frame_t frame = params.onionskin;
+
+  for (auto _ : state) {
+    render.renderSprite(
+      dst.get(), spr.get(), frame,
+      gfx::Clip(0, 0, 0, 0, dstW, dstH));
+  }
+  state.SetItemsProcessed(state.iterations() * dstW * dstH);
+}
+
+// Args: layers, group depth, blend mode, z-index, onion skin frames,
+//       tilemap layers, indexed, zoom %
+BENCHMARK(Bm_RenderScene)
+  ->ArgNames({ "layers", "depth", "blend", "zindex", "onion", "tilemaps", "indexed", "zoom" })
+  // Number of layers
+  ->Args({ 8,   0, 0, 0, 0, 0, 0, 100 })
+  ->Args({ 64,  0, 0, 0, 0, 0, 0, 100 })
+  ->Args({ 256, 0, 0, 0, 0, 0, 0, 100 })
+  // Nested groups
+  ->Args({ 64,  4, 0, 0, 0, 0, 0, 100 })
+  ->Args({ 64,  16, 0, 0, 0, 0, 0, 100 })
+  // Blend modes (multiply, overlay, hsl hue)
+  ->Args({ 64,  0, int(BlendMode::MULTIPLY), 0, 0, 0, 0, 100 })
+  ->Args({ 64,  0, int(BlendMode::OVERLAY), 0, 0, 0, 0, 100 })
+  ->Args({ 64,  0, int(BlendMode::HSL_HUE), 0, 0, 0, 0, 100 })
+  // Z-index
+  ->Args({ 64,  0, 0, 1, 0, 0, 0, 100 })
+  // Onion skin
+  ->Args({ 64,  0, 0, 0, 1, 0, 0, 100 })
+  ->Args({ 64,  0, 0, 0, 4, 0, 0, 100 })
+  // Tilemaps
+  ->Args({ 8,   0, 0, 0, 0, 4, 0, 100 })
+  // Indexed
+  ->Args({ 64,  0, 0, 0, 0, 0, 1, 100 })
+  ->Args({ 64,  4, 0, 1, 2, 2, 1, 100 })
+  // Zoom levels
+  ->Args({ 64,  0, 0, 0, 0, 0, 0, 25 })
+  ->Args({ 64,  0, 0, 0, 0, 0, 0, 50 })
+  ->Args({ 64,  0, 0, 0, 0, 0, 0, 200 })
+  ->Args({ 64,  0, 0, 0, 0, 0, 0, 400 })
+  // Everything
+  ->Args({ 64,  4, int(BlendMode::MULTIPLY), 1, 2, 2, 0, 200 })
+  ->Unit(benchmark::kMicrosecond);
+
 BENCHMARK_MAIN();
@@ -0,0 +1,50 @@
+// Aseprite Render Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef RENDER_RENDER_COUNTERS_H_INCLUDED
+#define RENDER_RENDER_COUNTERS_H_INCLUDED
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace render {
+
+  // Cumulative counters of the work done by all Render instances
+  // since the program started (or the last reset()). Unlike
+  // RenderStats (wall-time of one Render), these counters are
+  // deterministic, so they can be used to detect regressions (e.g.
+  // more pixels composited to render the same sprite).
+  class RenderCounters {
+  public:
+    enum Counter {
+      PixelsComposited,         // Destination pixels of each composited image
+      CelsRendered,             // Calls to Render::renderCel()
+      CacheHits,                // Layer groups found in a GroupCache
+      CacheMisses,              // Layer groups re-rendered in a GroupCache
+      kCounters
+    };
+
+    static void add(const Counter counter, const int64_t value) {
+      m_values[counter].fetch_add(value, std::memory_order_relaxed);
+    }
+
+    static int64_t get(const Counter counter) {
+      return m_values[counter].load(std::memory_order_relaxed);
+    }
+
+    static void reset() {
+      for (auto& value : m_values)
+        value = 0;
+    }
+
+  private:
+    static inline std::atomic<int64_t> m_values[kCounters] = { };
+  };
+
+} // namespace render
+
+#endif
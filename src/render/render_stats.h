@@ -0,0 +1,56 @@
+// Aseprite Render Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef RENDER_RENDER_STATS_H_INCLUDED
+#define RENDER_RENDER_STATS_H_INCLUDED
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace render {
+
+  // Time spent in some parts of the rendering process (see
+  // Render::setStats()), used to profile the editor painting.
+  //
+  // When the sprite is rendered in parallel (see
+  // Render::setParallelTileSize()) the time of all threads is added,
+  // so it can be greater than the elapsed time.
+  class RenderStats {
+  public:
+    enum Counter {
+      Plan,                     // Creation/validation of render plans
+      Onionskin,                // Onion skin frames (including their plans)
+      kCounters
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    RenderStats() { reset(); }
+
+    void reset() {
+      for (auto& ns : m_ns)
+        ns = 0;
+    }
+
+    void add(const Counter counter, const Clock::duration duration) {
+      m_ns[counter] +=
+        std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    }
+
+    // Returns the elapsed time in seconds
+    double elapsed(const Counter counter) const {
+      return double(m_ns[counter]) / 1000000000.0;
+    }
+
+  private:
+    std::atomic<int64_t> m_ns[kCounters];
+  };
+
+} // namespace render
+
+#endif
@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019-2023 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -13,14 +13,28 @@
 
 #include "render/render.h"
 
+#include "doc/blend_funcs.h"
 #include "doc/cel.h"
 #include "doc/document.h"
 #include "doc/image.h"
 #include "doc/layer.h"
+#include "doc/layer_tilemap.h"
 #include "doc/palette.h"
 #include "doc/primitives.h"
+#include "doc/tileset.h"
+#include "doc/tilesets.h"
+#include "render/frame_signature.h"
+#include "render/get_sprite_pixel.h"
+#include "render/group_cache.h"
+#include "render/render_counters.h"
+#include "render/tile_atlas.h"
 
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <memory>
+#include <thread>
+#include <vector>
 
 using namespace doc;
 using namespace render;
@@ -81,6 +95,31 @@ TEST(Render, Basic)
   EXPECT_2X2_PIXELS(dst.get(), 2, 2, 2, 2);
 }
 
+TEST(Render, Counters)
+{
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  doc->sprites().add(Sprite::MakeStdSprite(ImageSpec(ColorMode::INDEXED, 2, 2)));
+
+  Image* src = doc->sprite()->root()->firstLayer()->cel(0)->image();
+  clear_image(src, 2);
+
+  std::unique_ptr<Image> dst(Image::create(IMAGE_INDEXED, 2, 2));
+
+  RenderCounters::reset();
+  Render render;
+  render.renderSprite(dst.get(), doc->sprite(), frame_t(0));
+
+  EXPECT_EQ(1, RenderCounters::get(RenderCounters::CelsRendered));
+  EXPECT_LE(4, RenderCounters::get(RenderCounters::PixelsComposited));
+
+  // The same render must produce the same counters
+  const int64_t pixels = RenderCounters::get(RenderCounters::PixelsComposited);
+  RenderCounters::reset();
+  render.renderSprite(dst.get(), doc->sprite(), frame_t(0));
+  EXPECT_EQ(1, RenderCounters::get(RenderCounters::CelsRendered));
+  EXPECT_EQ(pixels, RenderCounters::get(RenderCounters::PixelsComposited));
+}
+
 TYPED_TEST(RenderAllModes, CheckDefaultBackgroundMode)
 {
   typedef TypeParam ImageTraits;
@@ -131,6 +170,171 @@ TEST(Render, DefaultBackgroundModeWithNonzeroTransparentIndex)
   EXPECT_2X2_PIXELS(dst.get(), 0, 0, 0, c1); // RGB transparent
 }
 
+TEST(Render, IndexedToRgbPaletteEntries)
+{
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  doc->sprites().add(Sprite::MakeStdSprite(ImageSpec(ColorMode::INDEXED, 2, 2)));
+  Sprite* spr = doc->sprite();
+  Palette* pal = spr->palette(0);
+  pal->setEntry(1, rgba(255, 0, 0, 255));
+  pal->setEntry(2, rgba(0, 255, 0, 128));
+  pal->setEntry(3, rgba(0, 0, 255, 0));
+
+  LayerImage* lay = static_cast<LayerImage*>(spr->root()->firstLayer());
+  Image* src = lay->cel(0)->image();
+  put_pixel(src, 0, 0, 0);      // Transparent index
+  put_pixel(src, 1, 0, 1);
+  put_pixel(src, 0, 1, 2);
+  put_pixel(src, 1, 1, 3);
+
+  const color_t bg = rgba(10, 20, 30, 200);
+  for (int opacity : { 255, 100 }) {
+    lay->setOpacity(opacity);
+
+    for (color_t initial : { bg, color_t(0) }) {
+      std::unique_ptr<Image> dst(Image::create(IMAGE_RGB, 2, 2));
+      clear_image(dst.get(), initial);
+
+      Render render;
+      render.renderLayer(dst.get(), lay, frame_t(0));
+      EXPECT_2X2_PIXELS(
+        dst.get(),
+        initial,
+        rgba_blender_normal(initial, pal->entry(1), opacity),
+        rgba_blender_normal(initial, pal->entry(2), opacity),
+        rgba_blender_normal(initial, pal->entry(3), opacity));
+    }
+  }
+}
+
+TEST(Render, CullTransparentCelPixels)
+{
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  doc->sprites().add(Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 40, 30)));
+  LayerImage* lay = static_cast<LayerImage*>(doc->sprite()->root()->firstLayer());
+  Cel* cel = lay->cel(0);
+  Image* src = cel->image();
+  cel->setPosition(3, 2);
+  clear_image(src, 0);
+
+  const color_t bg = rgba(10, 20, 30, 255);
+  auto render_and_compare = [&](const Zoom& zoom) {
+    const gfx::Rect bounds =
+      Projection(PixelRatio(1, 1), zoom).apply(doc->sprite()->bounds());
+    std::unique_ptr<Image> dst(Image::create(IMAGE_RGB, bounds.w, bounds.h));
+    std::unique_ptr<Image> ref(Image::create(IMAGE_RGB, bounds.w, bounds.h));
+    clear_image(dst.get(), bg);
+    clear_image(ref.get(), bg);
+
+    Render render;
+    render.setProjection(Projection(PixelRatio(1, 1), zoom));
+    render.renderLayer(dst.get(), lay, frame_t(0));
+
+    // A preview image is never culled
+    render.setPreviewImage(lay, frame_t(0), src, nullptr,
+                           cel->position(), BlendMode::NORMAL);
+    render.renderLayer(ref.get(), lay, frame_t(0));
+    EXPECT_EQ(0, count_diff_between_images(dst.get(), ref.get()))
+      << "zoom=" << zoom.scale();
+  };
+
+  // Fully transparent cel
+  render_and_compare(Zoom(1, 1));
+
+  put_pixel(src, 0, 0, rgba(255, 0, 0, 255));
+  fill_rect(src, 17, 9, 21, 12, rgba(0, 255, 0, 128));
+  put_pixel(src, 30, 20, rgba(0, 0, 255, 255));
+  src->incrementVersion();
+
+  for (const Zoom& zoom : { Zoom(1, 1), Zoom(2, 1), Zoom(3, 1),
+                            Zoom(1, 2), Zoom(1, 3), Zoom(2, 3) })
+    render_and_compare(zoom);
+
+  // Change the content again
+  clear_image(src, 0);
+  put_pixel(src, 5, 25, rgba(255, 255, 0, 255));
+  src->incrementVersion();
+  EXPECT_EQ(gfx::Rect(5, 25, 1, 1), cel->data()->contentBounds());
+  render_and_compare(Zoom(1, 1));
+  render_and_compare(Zoom(2, 1));
+}
+
+TEST(Render, DontCullPreviewImageModifiedInPlace)
+{
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  doc->sprites().add(Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 8, 8)));
+  LayerImage* lay = static_cast<LayerImage*>(doc->sprite()->root()->firstLayer());
+  Cel* cel = lay->cel(0);
+  Image* src = cel->image();
+  clear_image(src, 0);
+
+  // Cache the (empty) content bounds of the cel
+  EXPECT_TRUE(cel->data()->contentBounds().isEmpty());
+
+  // Draw in the cel image without incrementing its version (as the
+  // tool loop does with a new cel used as the preview image too)
+  fill_rect(src, 2, 2, 5, 5, rgba(255, 0, 0, 255));
+
+  std::unique_ptr<Image> dst(Image::create(IMAGE_RGB, 8, 8));
+  clear_image(dst.get(), 0);
+
+  Render render;
+  render.setPreviewImage(lay, frame_t(0), src, nullptr,
+                         cel->position(), BlendMode::NORMAL);
+  render.renderLayer(dst.get(), lay, frame_t(0));
+  EXPECT_EQ(rgba(255, 0, 0, 255), get_pixel(dst.get(), 3, 3));
+  EXPECT_EQ(0, count_diff_between_images(src, dst.get()));
+}
+
+TEST(Render, IntegerZoomReplicatesPixels)
+{
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  doc->sprites().add(Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 23, 17)));
+  Image* src = doc->sprite()->root()->firstLayer()->cel(0)->image();
+  clear_image(src, 0);
+  fill_rect(src, 3, 2, 15, 11, rgba(255, 0, 0, 128));
+  draw_line(src, 0, 0, 22, 16, rgba(0, 0, 255, 255));
+  put_pixel(src, 22, 0, rgba(0, 255, 0, 200));
+
+  BgOptions bg;
+  bg.type = BgType::CHECKERED;
+  bg.zoom = true;
+  bg.color1 = rgba(128, 128, 128, 255);
+  bg.color2 = rgba(64, 64, 64, 255);
+  bg.stripeSize = gfx::Size(2, 2);
+
+  std::unique_ptr<Image> ref(Image::create(IMAGE_RGB, 23, 17));
+  {
+    Render render;
+    render.setBgOptions(bg);
+    render.renderSprite(ref.get(), doc->sprite(), frame_t(0));
+  }
+
+  for (int zoom : { 2, 3, 4, 5, 8 }) {
+    // Render areas that don't start/end at the edges of each pixel
+    for (const gfx::Rect& rc : { gfx::Rect(0, 0, 23*zoom, 17*zoom),
+                                 gfx::Rect(1, 1, 21*zoom, 15*zoom),
+                                 gfx::Rect(zoom+1, zoom-1, zoom+1, 3) }) {
+      std::unique_ptr<Image> dst(Image::create(IMAGE_RGB, rc.w, rc.h));
+      clear_image(dst.get(), 0);
+
+      Render render;
+      render.setBgOptions(bg);
+      render.setProjection(Projection(PixelRatio(1, 1), Zoom(zoom, 1)));
+      render.renderSprite(dst.get(), doc->sprite(), frame_t(0),
+                          gfx::Clip(0, 0, rc));
+
+      for (int y=0; y<rc.h; ++y) {
+        for (int x=0; x<rc.w; ++x) {
+          ASSERT_EQ(get_pixel(ref.get(), (rc.x+x)/zoom, (rc.y+y)/zoom),
+                    get_pixel(dst.get(), x, y))
+            << " zoom=" << zoom << " x=" << x << " y=" << y;
+        }
+      }
+    }
+  }
+}
+
 TEST(Render, CheckeredBackground)
 {
   std::shared_ptr<Document> doc = std::make_shared<Document>();
@@ -185,6 +389,44 @@ TEST(Render, CheckeredBackground)
     2, 2, 1, 1);
 }
 
+TEST(Render, CheckeredBackgroundWithOffset)
+{
+  std::unique_ptr<Image> dst(Image::create(IMAGE_RGB, 16, 8));
+
+  Render render;
+  BgOptions bg;
+  bg.type = BgType::CHECKERED;
+  bg.zoom = false;
+  bg.colorPixelFormat = IMAGE_RGB;
+  bg.color1 = rgba(255, 0, 0, 255);
+  bg.color2 = rgba(0, 0, 255, 255);
+  bg.stripeSize = gfx::Size(3, 2);
+  render.setBgOptions(bg);
+
+  for (const gfx::Point src : { gfx::Point(0, 0),
+                                gfx::Point(5, 7),
+                                gfx::Point(-4, -3),
+                                gfx::Point(-7, 2) }) {
+    clear_image(dst.get(), 0);
+    render.renderCheckeredBackground(
+      dst.get(), gfx::Clip(2, 1, src.x, src.y, 11, 6));
+
+    for (int y=0; y<dst->height(); ++y) {
+      for (int x=0; x<dst->width(); ++x) {
+        color_t expected = 0;
+        if (x >= 2 && x < 13 && y >= 1 && y < 7) {
+          const int u = int(std::floor((src.x + x) / 3.0));
+          const int v = int(std::floor((src.y + y) / 2.0));
+          expected = (((u+v) & 1) ? bg.color2: bg.color1);
+        }
+        EXPECT_EQ(expected, get_pixel(dst.get(), x, y))
+          << " x=" << x << " y=" << y
+          << " src=" << src.x << "," << src.y;
+      }
+    }
+  }
+}
+
 TEST(Render, ZoomAndDstBounds)
 {
   // Create this image:
@@ -277,6 +519,523 @@ TEST(Render, BugWithMultiplesOf3ZoomFactors)
   }
 }
 
+TEST(Render, ParallelTilesMatchSingleThread)
+{
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  doc->sprites().add(Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 100, 70)));
+  Image* src = doc->sprite()->root()->firstLayer()->cel(0)->image();
+  clear_image(src, 0);
+  fill_rect(src, 10, 5, 80, 60, rgba(255, 0, 0, 128));
+  draw_line(src, 0, 0, 99, 69, rgba(0, 0, 255, 255));
+
+  BgOptions bg;
+  bg.type = BgType::CHECKERED;
+  bg.zoom = true;
+  bg.colorPixelFormat = IMAGE_RGB;
+  bg.color1 = rgba(128, 128, 128, 255);
+  bg.color2 = rgba(64, 64, 64, 255);
+  bg.stripeSize = gfx::Size(3, 3);
+
+  for (int zoom : { 1, 2, 3 }) {
+    const int w = 100*zoom;
+    const int h = 70*zoom;
+    std::unique_ptr<Image> expected(Image::create(IMAGE_RGB, w, h));
+    std::unique_ptr<Image> result(Image::create(IMAGE_RGB, w, h));
+    clear_image(expected.get(), 0);
+    clear_image(result.get(), 0);
+
+    Render render;
+    render.setBgOptions(bg);
+    render.setProjection(Projection(PixelRatio(1, 1), Zoom(zoom, 1)));
+    render.renderSprite(
+      expected.get(), doc->sprite(), frame_t(0),
+      gfx::Clip(0, 0, 0, 0, w, h));
+
+    render.setParallelTileSize(32);
+    render.renderSprite(
+      result.get(), doc->sprite(), frame_t(0),
+      gfx::Clip(0, 0, 0, 0, w, h));
+
+    EXPECT_EQ(0, count_diff_between_images(expected.get(), result.get()))
+      << " zoom=" << zoom;
+  }
+}
+
+TEST(Render, GroupCache)
+{
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  Sprite* spr = Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 8, 8));
+  doc->sprites().add(spr);
+
+  LayerGroup* group = new LayerGroup(spr);
+  LayerImage* lay1 = new LayerImage(spr);
+  LayerImage* lay2 = new LayerImage(spr);
+  spr->root()->addLayer(group);
+  group->addLayer(lay1);
+  group->addLayer(lay2);
+
+  ImageRef img1(Image::create(IMAGE_RGB, 8, 8));
+  ImageRef img2(Image::create(IMAGE_RGB, 4, 4));
+  clear_image(img1.get(), 0);
+  clear_image(img2.get(), rgba(0, 255, 0, 255));
+  fill_rect(img1.get(), 0, 0, 3, 3, rgba(255, 0, 0, 255));
+  lay1->addCel(new Cel(frame_t(0), img1));
+  Cel* cel2 = new Cel(frame_t(0), img2);
+  cel2->setPosition(2, 2);
+  lay2->addCel(cel2);
+
+  std::unique_ptr<Image> expected(Image::create(IMAGE_RGB, 8, 8));
+  std::unique_ptr<Image> result(Image::create(IMAGE_RGB, 8, 8));
+
+  GroupCache cache;
+  for (int i=0; i<3; ++i) {
+    Render().renderSprite(expected.get(), spr, frame_t(0));
+
+    Render render;
+    render.setGroupCache(&cache);
+    render.renderSprite(result.get(), spr, frame_t(0));
+    EXPECT_EQ(0, count_diff_between_images(expected.get(), result.get()))
+      << " i=" << i;
+
+    // Modify the group to check that the cache is invalidated
+    switch (i) {
+      case 0:
+        clear_image(img2.get(), rgba(0, 0, 255, 255));
+        img2->incrementVersion();
+        break;
+      case 1:
+        cel2->setPosition(4, 4);
+        break;
+    }
+  }
+}
+
+TEST(Render, GroupCacheIndexedOpacity)
+{
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  Sprite* spr = Sprite::MakeStdSprite(ImageSpec(ColorMode::INDEXED, 8, 8));
+  doc->sprites().add(spr);
+
+  LayerGroup* group = new LayerGroup(spr);
+  LayerImage* lay1 = new LayerImage(spr);
+  LayerImage* lay2 = new LayerImage(spr);
+  spr->root()->addLayer(group);
+  group->addLayer(lay1);
+  group->addLayer(lay2);
+
+  ImageRef img1(Image::create(IMAGE_INDEXED, 8, 8));
+  ImageRef img2(Image::create(IMAGE_INDEXED, 4, 4));
+  clear_image(img1.get(), 0);
+  clear_image(img2.get(), 2);
+  fill_rect(img1.get(), 0, 0, 5, 5, 1);
+  lay1->addCel(new Cel(frame_t(0), img1));
+  Cel* cel2 = new Cel(frame_t(0), img2);
+  cel2->setPosition(2, 2);
+  cel2->setOpacity(128);
+  lay2->addCel(cel2);
+  lay1->setOpacity(200);
+
+  std::unique_ptr<Image> expected(Image::create(IMAGE_RGB, 8, 8));
+  std::unique_ptr<Image> result(Image::create(IMAGE_RGB, 8, 8));
+
+  GroupCache cache;
+  for (int i=0; i<2; ++i) {
+    Render().renderSprite(expected.get(), spr, frame_t(0));
+
+    Render render;
+    render.setGroupCache(&cache);
+    render.renderSprite(result.get(), spr, frame_t(0));
+    EXPECT_EQ(0, count_diff_between_images(expected.get(), result.get()))
+      << " i=" << i;
+  }
+}
+
+TEST(Render, GroupCacheUnchangedGroups)
+{
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  Sprite* spr = Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 8, 8));
+  doc->sprites().add(spr);
+
+  LayerGroup* group = new LayerGroup(spr);
+  LayerImage* lay = new LayerImage(spr);
+  spr->root()->addLayer(group);
+  group->addLayer(lay);
+
+  ImageRef img(Image::create(IMAGE_RGB, 8, 8));
+  clear_image(img.get(), rgba(255, 0, 0, 255));
+  lay->addCel(new Cel(frame_t(0), img));
+
+  GroupCache cache;
+  int renders = 0;
+  const auto renderFunc = [&renders](Image*){ ++renders; };
+  const ImageSpec spec = spr->spec();
+
+  // The group is new (changed) in the first pass
+  uint32_t pass = cache.newPass();
+  EXPECT_EQ(nullptr, cache.getUnchangedImage(group, 0, spec, 0, pass, renderFunc));
+  EXPECT_EQ(nullptr, cache.getUnchangedImage(group, 0, spec, 0, pass, renderFunc));
+  EXPECT_EQ(0, renders);
+
+  // It's flattened in the next pass, and then re-used
+  pass = cache.newPass();
+  ImageRef a = cache.getUnchangedImage(group, 0, spec, 0, pass, renderFunc);
+  EXPECT_NE(nullptr, a);
+  EXPECT_EQ(1, renders);
+  pass = cache.newPass();
+  EXPECT_EQ(a, cache.getUnchangedImage(group, 0, spec, 0, pass, renderFunc));
+  EXPECT_EQ(1, renders);
+
+  // A changed group is not flattened until it stops changing
+  img->incrementVersion();
+  pass = cache.newPass();
+  EXPECT_EQ(nullptr, cache.getUnchangedImage(group, 0, spec, 0, pass, renderFunc));
+  pass = cache.newPass();
+  ImageRef b = cache.getUnchangedImage(group, 0, spec, 0, pass, renderFunc);
+  EXPECT_NE(nullptr, b);
+  EXPECT_NE(a, b);
+  EXPECT_EQ(2, renders);
+}
+
+TEST(Render, GroupCacheConcurrentMisses)
+{
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  Sprite* spr = Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 8, 8));
+  doc->sprites().add(spr);
+
+  LayerGroup* group = new LayerGroup(spr);
+  spr->root()->addLayer(group);
+  group->addLayer(new LayerImage(spr));
+
+  // All threads get the same image, which is rendered just once
+  GroupCache cache;
+  std::atomic<int> renders(0);
+  std::vector<ImageRef> images(8);
+  std::vector<std::thread> threads;
+  for (ImageRef& image : images) {
+    threads.emplace_back(
+      [&cache, &renders, &image, group]{
+        image = cache.getImage(
+          group, 0,
+          [&renders](Image*){
+            ++renders;
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+          });
+      });
+  }
+  for (auto& thread : threads)
+    thread.join();
+
+  EXPECT_EQ(1, renders);
+  for (const ImageRef& image : images)
+    EXPECT_EQ(images[0], image);
+}
+
+TEST(Render, GroupCacheNestedGroups)
+{
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  Sprite* spr = Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 8, 8));
+  doc->sprites().add(spr);
+
+  LayerGroup* outer = new LayerGroup(spr);
+  LayerGroup* inner = new LayerGroup(spr);
+  LayerImage* lay1 = new LayerImage(spr);
+  LayerImage* lay2 = new LayerImage(spr);
+  spr->root()->addLayer(outer);
+  outer->addLayer(inner);
+  outer->addLayer(lay2);
+  inner->addLayer(lay1);
+
+  ImageRef img1(Image::create(IMAGE_RGB, 6, 6));
+  ImageRef img2(Image::create(IMAGE_RGB, 4, 4));
+  clear_image(img1.get(), rgba(255, 0, 0, 255));
+  clear_image(img2.get(), rgba(0, 255, 0, 128));
+  lay1->addCel(new Cel(frame_t(0), img1));
+  Cel* cel2 = new Cel(frame_t(0), img2);
+  cel2->setPosition(3, 3);
+  lay2->addCel(cel2);
+
+  std::unique_ptr<Image> expected(Image::create(IMAGE_RGB, 8, 8));
+  std::unique_ptr<Image> result(Image::create(IMAGE_RGB, 8, 8));
+
+  // Edit the outer group (and then the inner one) in some renders,
+  // only unchanged groups are flattened
+  GroupCache cache;
+  for (int i=0; i<8; ++i) {
+    Render().renderSprite(expected.get(), spr, frame_t(0));
+
+    Render render;
+    render.setGroupCache(&cache);
+    render.setParallelTileSize(4);
+    render.renderSprite(result.get(), spr, frame_t(0));
+    EXPECT_EQ(0, count_diff_between_images(expected.get(), result.get()))
+      << " i=" << i;
+
+    if (i < 4) {
+      cel2->setPosition(3-i, 3);
+    }
+    else if (i < 6) {
+      clear_image(img1.get(), rgba(0, 0, 255-i, 255));
+      img1->incrementVersion();
+    }
+  }
+}
+
+TEST(Render, GetSpritePixel)
+{
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  Sprite* spr = Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 8, 8));
+  doc->sprites().add(spr);
+
+  LayerImage* lay = static_cast<LayerImage*>(spr->root()->firstLayer());
+  Image* img = lay->cel(0)->image();
+  clear_image(img, 0);
+  fill_rect(img, 0, 0, 3, 3, rgba(255, 0, 0, 255));
+
+  std::unique_ptr<Image> expected(Image::create(IMAGE_RGB, 8, 8));
+  Projection proj;
+  Projection zoomProj(PixelRatio(1, 1), Zoom(2, 1));
+
+  for (int i=0; i<3; ++i) {
+    Render().renderSprite(expected.get(), spr, frame_t(0));
+
+    // Pick each pixel several times (the first picks are 1x1
+    // renders, and then the pixels come from the cached frame)
+    for (int j=0; j<3; ++j) {
+      for (int y=0; y<8; ++y)
+        for (int x=0; x<8; ++x) {
+          EXPECT_EQ(get_pixel(expected.get(), x, y),
+                    get_sprite_pixel(spr, x+0.5, y+0.5, frame_t(0), proj, false))
+            << " i=" << i << " j=" << j << " x=" << x << " y=" << y;
+          EXPECT_EQ(get_pixel(expected.get(), x, y),
+                    get_sprite_pixel(spr, x+0.25, y+0.75, frame_t(0), zoomProj, false))
+            << " i=" << i << " j=" << j << " x=" << x << " y=" << y;
+        }
+    }
+
+    // Modify the sprite to check that the cached frame is not used
+    switch (i) {
+      case 0:
+        fill_rect(img, 2, 2, 6, 6, rgba(0, 0, 255, 255));
+        img->incrementVersion();
+        break;
+      case 1:
+        lay->cel(0)->setPosition(1, 2);
+        break;
+    }
+  }
+}
+
+TEST(Render, OnionskinCache)
+{
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  Sprite* spr = Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 8, 8));
+  doc->sprites().add(spr);
+  spr->setTotalFrames(frame_t(3));
+
+  LayerImage* lay = static_cast<LayerImage*>(spr->root()->firstLayer());
+  Image* img0 = lay->cel(0)->image();
+  clear_image(img0, 0);
+  fill_rect(img0, 0, 0, 3, 3, rgba(255, 0, 0, 255));
+
+  ImageRef img1(Image::create(IMAGE_RGB, 4, 4));
+  clear_image(img1.get(), rgba(0, 255, 0, 255));
+  Cel* cel1 = new Cel(frame_t(1), img1);
+  cel1->setPosition(2, 2);
+  lay->addCel(cel1);
+
+  ImageRef img2(Image::create(IMAGE_RGB, 2, 2));
+  clear_image(img2.get(), rgba(0, 0, 255, 255));
+  Cel* cel2 = new Cel(frame_t(2), img2);
+  cel2->setPosition(5, 5);
+  lay->addCel(cel2);
+
+  OnionskinOptions onionskin(OnionskinType::MERGE);
+  onionskin.prevFrames(1);
+  onionskin.nextFrames(1);
+  onionskin.opacityBase(128);
+
+  std::unique_ptr<Image> expected(Image::create(IMAGE_RGB, 8, 8));
+  std::unique_ptr<Image> result(Image::create(IMAGE_RGB, 8, 8));
+
+  GroupCache cache;
+  for (int i=0; i<3; ++i) {
+    Render render1;
+    render1.setOnionskin(onionskin);
+    render1.renderSprite(expected.get(), spr, frame_t(1));
+
+    Render render2;
+    render2.setOnionskin(onionskin);
+    render2.setOnionskinCache(&cache);
+    render2.renderSprite(result.get(), spr, frame_t(1));
+    EXPECT_EQ(0, count_diff_between_images(expected.get(), result.get()))
+      << " i=" << i;
+
+    // Modify the neighbor frames to check that the cache is
+    // invalidated
+    switch (i) {
+      case 0:
+        clear_image(img0, rgba(255, 255, 0, 255));
+        img0->incrementVersion();
+        break;
+      case 1:
+        cel2->setPosition(0, 6);
+        break;
+    }
+  }
+}
+
+TEST(Render, FrameSignature)
+{
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  Sprite* spr = Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 8, 8));
+  doc->sprites().add(spr);
+  spr->setTotalFrames(frame_t(3));
+
+  LayerImage* lay = static_cast<LayerImage*>(spr->root()->firstLayer());
+  Cel* cel0 = lay->cel(0);
+  lay->addCel(Cel::MakeLink(frame_t(1), cel0));
+  Cel* cel2 = Cel::MakeCopy(frame_t(2), cel0);
+  lay->addCel(cel2);
+
+  // Linked cels render the same pixels
+  EXPECT_EQ(calc_frame_signature(spr, 0), calc_frame_signature(spr, 1));
+  EXPECT_NE(calc_frame_signature(spr, 0), calc_frame_signature(spr, 2));
+
+  // The same image in the same position
+  cel2->data()->setImage(cel0->imageRef(), lay);
+  EXPECT_EQ(calc_frame_signature(spr, 0), calc_frame_signature(spr, 2));
+
+  cel2->setPosition(1, 0);
+  EXPECT_NE(calc_frame_signature(spr, 0), calc_frame_signature(spr, 2));
+
+  // Changes in the image/layer change the signature
+  const uint64_t signature = calc_frame_signature(spr, 0);
+  cel0->image()->incrementVersion();
+  EXPECT_NE(signature, calc_frame_signature(spr, 0));
+  EXPECT_EQ(calc_frame_signature(spr, 0), calc_frame_signature(spr, 1));
+
+  const uint64_t signature2 = calc_frame_signature(spr, 0);
+  lay->setVisible(false);
+  EXPECT_NE(signature2, calc_frame_signature(spr, 0));
+}
+
+TEST(Render, PremultipliedComposition)
+{
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  Sprite* spr = Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 8, 8));
+  doc->sprites().add(spr);
+
+  LayerImage* lay1 = static_cast<LayerImage*>(spr->root()->firstLayer());
+  LayerImage* lay2 = new LayerImage(spr);
+  spr->root()->addLayer(lay2);
+  lay2->setOpacity(200);
+
+  Image* img1 = lay1->cel(0)->image();
+  clear_image(img1, 0);
+  fill_rect(img1, 0, 0, 5, 5, rgba(255, 0, 0, 128));
+  fill_rect(img1, 6, 6, 7, 7, rgba(0, 0, 255, 255));
+
+  ImageRef img2(Image::create(IMAGE_RGB, 6, 6));
+  clear_image(img2.get(), rgba(0, 255, 64, 100));
+  Cel* cel2 = new Cel(frame_t(0), img2);
+  cel2->setPosition(2, 2);
+  lay2->addCel(cel2);
+
+  std::unique_ptr<Image> expected(Image::create(IMAGE_RGB, 8, 8));
+  std::unique_ptr<Image> result(Image::create(IMAGE_RGB, 8, 8));
+
+  for (const int zoom : { 1, 3 }) {
+    expected.reset(Image::create(IMAGE_RGB, 8*zoom, 8*zoom));
+    result.reset(Image::create(IMAGE_RGB, 8*zoom, 8*zoom));
+
+    Render render1;
+    render1.setNewBlend(true);
+    render1.setProjection(Projection(PixelRatio(1, 1), Zoom(zoom, 1)));
+    render1.renderSprite(expected.get(), spr, frame_t(0));
+
+    Render render2;
+    render2.setNewBlend(true);
+    render2.setProjection(Projection(PixelRatio(1, 1), Zoom(zoom, 1)));
+    render2.setPremultipliedComposition(true);
+    render2.renderSprite(result.get(), spr, frame_t(0));
+
+    // Only the rounding of semi-transparent pixels can be different
+    for (int y=0; y<expected->height(); ++y) {
+      for (int x=0; x<expected->width(); ++x) {
+        const color_t a = get_pixel(expected.get(), x, y);
+        const color_t b = get_pixel(result.get(), x, y);
+        EXPECT_NEAR(rgba_getr(a), rgba_getr(b), 2) << " x=" << x << " y=" << y;
+        EXPECT_NEAR(rgba_getg(a), rgba_getg(b), 2) << " x=" << x << " y=" << y;
+        EXPECT_NEAR(rgba_getb(a), rgba_getb(b), 2) << " x=" << x << " y=" << y;
+        EXPECT_NEAR(rgba_geta(a), rgba_geta(b), 1) << " x=" << x << " y=" << y;
+        if (rgba_geta(a) == 255)
+          EXPECT_EQ(a, b) << " x=" << x << " y=" << y;
+      }
+    }
+  }
+}
+
+TEST(Render, TileAtlas)
+{
+  // Square and non-square tiles (diagonal flips of non-square tiles
+  // are not in the atlas)
+  for (const gfx::Size tileSize : { gfx::Size(4, 4), gfx::Size(4, 3) }) {
+    std::shared_ptr<Document> doc = std::make_shared<Document>();
+    Sprite* spr = Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 20, 14));
+    doc->sprites().add(spr);
+    clear_image(spr->root()->firstLayer()->cel(0)->image(), 0);
+
+    Tileset* tileset = new Tileset(spr, Grid(tileSize), 4);
+    for (tile_index ti=1; ti<4; ++ti) {
+      ImageRef tile = tileset->get(ti);
+      for (int y=0; y<tileSize.h; ++y)
+        for (int x=0; x<tileSize.w; ++x)
+          put_pixel(tile.get(), x, y, rgba(60*ti, 40*x, 50*y, (x+y) & 1 ? 255: 128));
+    }
+    LayerTilemap* lay = new LayerTilemap(spr, spr->tilesets()->add(tileset));
+    spr->root()->addLayer(lay);
+
+    ImageRef tilemap(Image::create(IMAGE_TILEMAP, 5, 4));
+    clear_image(tilemap.get(), notile);
+    const tile_flags flags[] = { 0, tile_f_xflip, tile_f_yflip, tile_f_dflip,
+                                 tile_f_xflip | tile_f_yflip | tile_f_dflip };
+    for (int v=0; v<tilemap->height(); ++v) {
+      if (v == 2)
+        continue;               // Empty row
+      for (int u=1; u<tilemap->width(); ++u)
+        put_pixel(tilemap.get(), u, v, tile(1+(u+v)%3, flags[(u*3+v) % 5]));
+    }
+    Cel* cel = new Cel(frame_t(0), tilemap);
+    cel->setPosition(1, -2);
+    lay->addCel(cel);
+
+    TileAtlas atlas;
+    for (int i=0; i<2; ++i) {
+      for (const int zoom : { 1, 2, 3 }) {
+        std::unique_ptr<Image> expected(Image::create(IMAGE_RGB, 20*zoom, 14*zoom));
+        std::unique_ptr<Image> result(Image::create(IMAGE_RGB, 20*zoom, 14*zoom));
+        clear_image(expected.get(), rgba(0, 0, 255, 255));
+        clear_image(result.get(), rgba(0, 0, 255, 255));
+
+        Render render;
+        render.setProjection(Projection(PixelRatio(1, 1), Zoom(zoom, 1)));
+        render.renderSprite(expected.get(), spr, frame_t(0));
+
+        render.setTileAtlas(&atlas);
+        render.renderSprite(result.get(), spr, frame_t(0));
+
+        EXPECT_EQ(0, count_diff_between_images(expected.get(), result.get()))
+          << " tileSize=" << tileSize.w << "x" << tileSize.h
+          << " i=" << i << " zoom=" << zoom;
+      }
+
+      // Modify a tile to check that the atlas is invalidated
+      fill_rect(tileset->get(2).get(), 0, 0, 1, 1, rgba(255, 255, 0, 255));
+      tileset->get(2)->incrementVersion();
+    }
+  }
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,205 @@
+// Aseprite Render Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "render/tile_atlas.h"
+
+#include "doc/image.h"
+#include "doc/primitives.h"
+#include "doc/tileset.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace render {
+
+using namespace doc;
+
+namespace {
+
+inline void hash_combine(uint64_t& seed, const uint64_t value)
+{
+  seed ^= value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+}
+
+// Creates the atlas without flips, or nullptr if some tile image
+// doesn't match the grid (or the tileset is empty).
+ImageRef create_base_atlas(const Tileset* tileset)
+{
+  const gfx::Size tileSize = tileset->grid().tileSize();
+  const tile_index ntiles = tileset->size();
+  if (ntiles < 1 || tileSize.w < 1 || tileSize.h < 1)
+    return nullptr;
+
+  const ImageRef first = tileset->get(0);
+  if (!first)
+    return nullptr;
+
+  ImageSpec spec = first->spec();
+  spec.setSize(tileSize.w, tileSize.h*int(ntiles));
+  ImageRef atlas(Image::create(spec));
+
+  const int rowBytes = first->widthBytes();
+  for (tile_index ti=0; ti<ntiles; ++ti) {
+    const ImageRef tile = tileset->get(ti);
+    if (!tile) {
+      fill_rect(atlas.get(), 0, ti*tileSize.h,
+                tileSize.w-1, (ti+1)*tileSize.h-1, spec.maskColor());
+      continue;
+    }
+    if (tile->size() != tileSize ||
+        tile->pixelFormat() != first->pixelFormat() ||
+        tile->maskColor() != first->maskColor())
+      return nullptr;
+
+    for (int y=0; y<tileSize.h; ++y)
+      std::memcpy(atlas->getPixelAddress(0, ti*tileSize.h + y),
+                  tile->readPixelAddress(0, y), rowBytes);
+  }
+  return atlas;
+}
+
+// Same mapping of source/destination pixels as
+// composite_image_general_with_tile_flags() (without scale).
+template<typename pixel_t>
+void flip_tiles(const Image* base, Image* atlas,
+                const gfx::Size& tileSize,
+                const tile_flags flags)
+{
+  const int w = tileSize.w;
+  const int h = tileSize.h;
+  const int ntiles = base->height() / h;
+
+  for (int ti=0; ti<ntiles; ++ti) {
+    for (int y=0; y<h; ++y) {
+      auto dst = (pixel_t*)atlas->getPixelAddress(0, ti*h + y);
+      const int fy = ((flags & tile_f_yflip) ? h-1-y: y);
+
+      for (int x=0; x<w; ++x, ++dst) {
+        const int fx = ((flags & tile_f_xflip) ? w-1-x: x);
+        const int srcX = ((flags & tile_f_dflip) ? fy: fx);
+        const int srcY = ((flags & tile_f_dflip) ? fx: fy);
+        *dst = *(const pixel_t*)base->readPixelAddress(srcX, ti*h + srcY);
+      }
+    }
+  }
+}
+
+ImageRef create_flipped_atlas(const Image* base,
+                              const gfx::Size& tileSize,
+                              const tile_flags flags)
+{
+  // Diagonal flips of non-square tiles are rendered with the
+  // general path (which leaves pixels out of the square empty)
+  if ((flags & tile_f_dflip) && tileSize.w != tileSize.h)
+    return nullptr;
+
+  ImageRef atlas(Image::create(base->spec()));
+  switch (base->bytesPerPixel()) {
+    case 1: flip_tiles<uint8_t>(base, atlas.get(), tileSize, flags); break;
+    case 2: flip_tiles<uint16_t>(base, atlas.get(), tileSize, flags); break;
+    case 4: flip_tiles<uint32_t>(base, atlas.get(), tileSize, flags); break;
+    default:
+      ASSERT(false);
+      return nullptr;
+  }
+  return atlas;
+}
+
+} // anonymous namespace
+
+TileAtlas::TileAtlas(const int maxEntries)
+  : m_maxEntries(std::max(1, maxEntries))
+{
+}
+
+bool TileAtlas::getAtlases(const Tileset* tileset,
+                           const int variants,
+                           Atlases& atlases)
+{
+  const uint64_t signature = calcSignature(tileset);
+
+  const std::lock_guard lock(m_mutex);
+  ++m_useCounter;
+
+  auto it = std::find_if(m_entries.begin(), m_entries.end(),
+                         [tileset](const Entry& entry){
+                           return (entry.tilesetId == tileset->id());
+                         });
+  if (it == m_entries.end()) {
+    // Remove the least recently used entry
+    if (int(m_entries.size()) >= m_maxEntries) {
+      m_entries.erase(
+        std::min_element(m_entries.begin(), m_entries.end(),
+                         [](const Entry& a, const Entry& b){
+                           return a.lastUse < b.lastUse;
+                         }));
+    }
+    m_entries.emplace_back();
+    it = m_entries.end()-1;
+    it->tilesetId = tileset->id();
+  }
+  else if (it->signature != signature) {
+    it->atlases = Atlases();
+  }
+
+  if (!it->atlases[0]) {
+    it->atlases[0] = create_base_atlas(tileset);
+    it->signature = signature;
+    if (!it->atlases[0]) {
+      // Remove the entry so the atlas is tried again when the
+      // tileset is modified
+      m_entries.erase(it);
+      return false;
+    }
+  }
+  it->lastUse = m_useCounter;
+
+  const gfx::Size tileSize = tileset->grid().tileSize();
+  for (int i=0; i<kVariants; ++i) {
+    if ((variants & (1 << i)) == 0)
+      continue;
+
+    if (!it->atlases[i]) {
+      it->atlases[i] = create_flipped_atlas(it->atlases[0].get(), tileSize,
+                                            tile_flags(i) << 29);
+    }
+    atlases[i] = it->atlases[i];
+  }
+  return true;
+}
+
+void TileAtlas::clear()
+{
+  const std::lock_guard lock(m_mutex);
+  m_entries.clear();
+}
+
+// static
+uint64_t TileAtlas::calcSignature(const Tileset* tileset)
+{
+  uint64_t seed = 0;
+  hash_combine(seed, tileset->id());
+  hash_combine(seed, tileset->version());
+  hash_combine(seed, tileset->size());
+  hash_combine(seed, uint64_t(uint32_t(tileset->grid().tileSize().w)) |
+                     (uint64_t(uint32_t(tileset->grid().tileSize().h)) << 32));
+  for (const auto& tile : *tileset) {
+    if (const Image* image = tile.image.get()) {
+      hash_combine(seed, image->id());
+      hash_combine(seed, image->version());
+      hash_combine(seed, uint64_t(image->maskColor()));
+    }
+    else
+      hash_combine(seed, 0);
+  }
+  return seed;
+}
+
+} // namespace render
@@ -0,0 +1,77 @@
+// Aseprite Render Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef RENDER_TILE_ATLAS_H_INCLUDED
+#define RENDER_TILE_ATLAS_H_INCLUDED
+#pragma once
+
+#include "doc/image_ref.h"
+#include "doc/object_id.h"
+#include "doc/tile.h"
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace doc {
+  class Tileset;
+}
+
+namespace render {
+
+  // Keeps all tiles of a tileset in one image (one tile below the
+  // other, tile "i" is in the rows [i*h, (i+1)*h)) so tilemaps can be
+  // rendered copying rows of pixels from the atlas to a strip of
+  // tiles, which is composited as just one image (see
+  // Render::setTileAtlas()).
+  //
+  // Each combination of flip flags (a "variant") has its own atlas
+  // with the pre-flipped tiles, created only when it's needed. The
+  // atlas is validated against a signature of the tileset (versions
+  // of the tileset and its tile images).
+  class TileAtlas {
+  public:
+    static constexpr int kVariants = 8;
+    using Atlases = std::array<doc::ImageRef, kVariants>;
+
+    TileAtlas(const int maxEntries = 4);
+
+    // Returns the index of the variant for the given tile flags.
+    static int variant(const doc::tile_flags flags) {
+      return int(flags >> 29);
+    }
+
+    // Fills "atlases" with the atlas of each variant whose bit
+    // (1 << variant) is in "variants". Returns false if the tileset
+    // cannot be used with an atlas (e.g. a tile image doesn't have
+    // the size of the grid). Variants with diagonal flip are nullptr
+    // for non-square tiles.
+    bool getAtlases(const doc::Tileset* tileset,
+                    const int variants,
+                    Atlases& atlases);
+
+    void clear();
+
+    static uint64_t calcSignature(const doc::Tileset* tileset);
+
+  private:
+    struct Entry {
+      doc::ObjectId tilesetId = doc::NullId;
+      uint64_t signature = 0;
+      uint32_t lastUse = 0;
+      Atlases atlases;
+    };
+
+    std::mutex m_mutex;
+    std::vector<Entry> m_entries;
+    int m_maxEntries;
+    uint32_t m_useCounter = 0;
+  };
+
+} // namespace render
+
+#endif
@@ -0,0 +1,237 @@
+// Aseprite Render Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef RENDER_WU_QUANTIZER_H_INCLUDED
+#define RENDER_WU_QUANTIZER_H_INCLUDED
+#pragma once
+
+#include "doc/color.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace render {
+
+  // Wu's color quantizer as described in X. Wu, "Efficient
+  // Statistical Computations for Optimal Color Quantization",
+  // Graphics Gems II, pp. 126-133 (1991), extended to four
+  // dimensions (RGBA).
+  //
+  // The cumulative moments are calculated over a reduced version of
+  // the given histogram (5 bits for RGB and 3 bits for alpha), so we
+  // can evaluate the sum of any box with 16 lookups.
+  template<class Histogram>
+  class WuQuantizer {
+    static constexpr int RSize = std::min<int>(Histogram::RElements, 32);
+    static constexpr int GSize = std::min<int>(Histogram::GElements, 32);
+    static constexpr int BSize = std::min<int>(Histogram::BElements, 32);
+    static constexpr int ASize = std::min<int>(Histogram::AElements, 8);
+
+    // Strides of each axis in the moments table (each axis has one
+    // extra element at the beginning filled with zeros)
+    static constexpr int RStride = 1;
+    static constexpr int GStride = RStride * (RSize+1);
+    static constexpr int BStride = GStride * (GSize+1);
+    static constexpr int AStride = BStride * (BSize+1);
+
+    struct Moment {
+      double w = 0.0;           // Number of samples
+      double r = 0.0, g = 0.0, b = 0.0, a = 0.0;
+      double m2 = 0.0;          // Sum of squared components
+
+      void add(const Moment& m, const double sign) {
+        w += sign * m.w;
+        r += sign * m.r;
+        g += sign * m.g;
+        b += sign * m.b;
+        a += sign * m.a;
+        m2 += sign * m.m2;
+      }
+
+      // Sum of squared components divided by the number of samples
+      double dist() const {
+        return (r*r + g*g + b*b + a*a) / w;
+      }
+    };
+
+    // Box of cells in the range (lo, hi] of each axis (R, G, B, A)
+    struct Box {
+      int lo[4];
+      int hi[4];
+    };
+
+  public:
+    WuQuantizer(const Histogram& histogram)
+      : m_moments(AStride * (ASize+1)) {
+      // Accumulate the histogram samples in the reduced table
+      for (int l=0; l<Histogram::AElements; ++l)
+        for (int k=0; k<Histogram::BElements; ++k)
+          for (int j=0; j<Histogram::GElements; ++j)
+            for (int i=0; i<Histogram::RElements; ++i) {
+              const std::size_t c = histogram.at(i, j, k, l);
+              if (c == 0)
+                continue;
+
+              const double n = double(c);
+              const int r = 255 * i / (Histogram::RElements-1);
+              const int g = 255 * j / (Histogram::GElements-1);
+              const int b = 255 * k / (Histogram::BElements-1);
+              const int a = 255 * l / (Histogram::AElements-1);
+
+              Moment& m = m_moments[
+                (1 + i * RSize / Histogram::RElements) * RStride +
+                (1 + j * GSize / Histogram::GElements) * GStride +
+                (1 + k * BSize / Histogram::BElements) * BStride +
+                (1 + l * ASize / Histogram::AElements) * AStride];
+              m.w += n;
+              m.r += n * r;
+              m.g += n * g;
+              m.b += n * b;
+              m.a += n * a;
+              m.m2 += n * (r*r + g*g + b*b + a*a);
+            }
+
+      // Convert the table to cumulative moments (each cell contains
+      // the sum of all cells between the origin and itself)
+      for (int stride : { RStride, GStride, BStride, AStride }) {
+        for (int l=1; l<=ASize; ++l)
+          for (int k=1; k<=BSize; ++k)
+            for (int j=1; j<=GSize; ++j)
+              for (int i=1; i<=RSize; ++i) {
+                const int index = i*RStride + j*GStride + k*BStride + l*AStride;
+                m_moments[index].add(m_moments[index-stride], 1.0);
+              }
+      }
+    }
+
+    // Creates up to "maxColors" colors that minimize the variance of
+    // the histogram samples.
+    void calculate(const std::size_t maxColors,
+                   std::vector<doc::color_t>& result) {
+      if (maxColors == 0)
+        return;
+
+      std::vector<Box> boxes;
+      std::vector<double> variances;
+      boxes.push_back(Box{ { 0, 0, 0, 0 }, { RSize, GSize, BSize, ASize } });
+      variances.push_back(variance(boxes[0]));
+
+      std::size_t next = 0;
+      while (boxes.size() < maxColors) {
+        Box newBox;
+        if (cut(boxes[next], newBox)) {
+          variances[next] = variance(boxes[next]);
+          boxes.push_back(newBox);
+          variances.push_back(variance(newBox));
+        }
+        else {
+          // This box cannot be split anymore
+          variances[next] = 0.0;
+        }
+
+        // Split the box with the biggest variance in the next iteration
+        next = std::max_element(variances.begin(), variances.end()) - variances.begin();
+        if (variances[next] <= 0.0)
+          break;
+      }
+
+      for (const Box& box : boxes) {
+        const Moment m = volume(box);
+        if (m.w <= 0.0)
+          continue;
+
+        result.push_back(
+          doc::rgba(std::clamp(int(m.r / m.w + 0.5), 0, 255),
+                    std::clamp(int(m.g / m.w + 0.5), 0, 255),
+                    std::clamp(int(m.b / m.w + 0.5), 0, 255),
+                    std::clamp(int(m.a / m.w + 0.5), 0, 255)));
+      }
+    }
+
+  private:
+    // Returns the sum of all the samples inside the box using the
+    // inclusion-exclusion principle over the 16 corners of the box.
+    Moment volume(const Box& box) const {
+      const int strides[4] = { RStride, GStride, BStride, AStride };
+      Moment result;
+      for (int corner=0; corner<16; ++corner) {
+        int index = 0;
+        int lows = 0;
+        for (int axis=0; axis<4; ++axis) {
+          if (corner & (1 << axis)) {
+            index += box.lo[axis] * strides[axis];
+            ++lows;
+          }
+          else
+            index += box.hi[axis] * strides[axis];
+        }
+        result.add(m_moments[index], (lows & 1) ? -1.0: 1.0);
+      }
+      return result;
+    }
+
+    double variance(const Box& box) const {
+      const Moment m = volume(box);
+      if (m.w <= 0.0)
+        return 0.0;
+      return m.m2 - m.dist();
+    }
+
+    // Splits "box" in two boxes ("box" and "newBox") in the plane
+    // that minimizes the sum of the variances of both boxes (i.e. it
+    // maximizes the sum of the Moment::dist() of both sides).
+    bool cut(Box& box, Box& newBox) const {
+      const Moment whole = volume(box);
+      double maxDist = 0.0;
+      int cutAxis = -1;
+      int cutPos = 0;
+
+      for (int axis=0; axis<4; ++axis) {
+        Box half = box;
+        for (int pos=box.lo[axis]+1; pos<box.hi[axis]; ++pos) {
+          half.hi[axis] = pos;
+          const Moment m1 = volume(half);
+          if (m1.w <= 0.0)
+            continue;
+
+          Moment m2 = whole;
+          m2.add(m1, -1.0);
+          if (m2.w <= 0.0)
+            continue;
+
+          const double dist = m1.dist() + m2.dist();
+          if (dist > maxDist) {
+            maxDist = dist;
+            cutAxis = axis;
+            cutPos = pos;
+          }
+        }
+      }
+
+      if (cutAxis < 0)
+        return false;
+
+      newBox = box;
+      newBox.lo[cutAxis] = cutPos;
+      box.hi[cutAxis] = cutPos;
+      return true;
+    }
+
+    // Cumulative moments
+    std::vector<Moment> m_moments;
+  };
+
+  template<class Histogram>
+  void wu_quantizer(const Histogram& histogram,
+                    const std::size_t maxColors,
+                    std::vector<doc::color_t>& result) {
+    WuQuantizer<Histogram> wu(histogram);
+    wu.calculate(maxColors, result);
+  }
+
+} // namespace render
+
+#endif
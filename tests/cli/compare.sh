@@ -0,0 +1,16 @@
+#! /bin/bash
+# Copyright (C) 2024 Igara Studio S.A.
+
+# --compare
+
+$ASEPRITE -b sprites/1empty3.aseprite --compare sprites/1empty3.aseprite || exit 1
+
+d=$t/compare
+mkdir -p $d
+$ASEPRITE -b sprites/1empty3.aseprite --save-as $d/copy.aseprite || exit 1
+$ASEPRITE -b sprites/1empty3.aseprite --compare $d/copy.aseprite || exit 1
+
+if $ASEPRITE -b sprites/1empty3.aseprite --compare sprites/abcd.aseprite ; then
+    echo "FAILED: sprites/1empty3.aseprite and sprites/abcd.aseprite are different"
+    exit 1
+fi
@@ -365,6 +365,43 @@ do -- BrightnessContrast
                d[3], d[4] })
 end
 
+do -- FilterChain
+  local s = Sprite(2, 2)
+  local cel = app.activeCel
+  local c = { rgba(255, 128, 64), rgba(250, 225, 110),
+              rgba( 30,  60,  0), rgba(200, 100,  50), }
+  local i = cel.image
+
+  i:drawPixel(0, 0, c[1])
+  i:drawPixel(1, 0, c[2])
+  i:drawPixel(0, 1, c[3])
+  i:drawPixel(1, 1, c[4])
+
+  -- Expected result applying each filter
+  app.command.BrightnessContrast{ brightness=50 }
+  app.command.HueSaturation{ hue=90 }
+  app.command.InvertColor()
+  local expected = i:clone()
+  app.undo()
+  app.undo()
+  app.undo()
+  expect_img(i, c)
+
+  app.command.FilterChain{
+    filters={ { "BrightnessContrast", brightness=50 },
+              { "HueSaturation", hue=90 },
+              { "InvertColor" } } }
+  assert(i:isEqual(expected))
+
+  -- Only one undoable change
+  app.undo()
+  expect_img(i, c)
+
+  app.command.FilterChain{
+    filters="BrightnessContrast brightness=50; HueSaturation hue=90; InvertColor" }
+  assert(i:isEqual(expected))
+end
+
 do -- Despeckle
   local s = Sprite(5, 5)
   local white = Color(255, 255, 255)
@@ -0,0 +1,41 @@
+-- Copyright (C) 2024  Igara Studio S.A.
+--
+-- This file is released under the terms of the MIT license.
+-- Read LICENSE.txt for more information.
+
+local function fib(n)
+  if n < 2 then return n end
+  return fib(n-1) + fib(n-2)
+end
+
+local function drawImages(n)
+  local a = Image(32, 32)
+  local b = Image(8, 8)
+  for i=1,n do
+    a:drawImage(b, Point(i % 32, 0))
+  end
+end
+
+app.profiler.reset()
+app.profiler.start()
+assert(app.profiler.isRunning)
+fib(15)
+drawImages(100)
+app.profiler.stop()
+assert(not app.profiler.isRunning)
+
+-- Per Lua function and native API function stats
+local report = app.profiler.report()
+assert(report:find("fib %(") ~= nil)
+assert(report:find("drawImages %(") ~= nil)
+assert(report:find("ImageObj:drawImage") ~= nil)
+
+-- Folded call stacks ("f;g;h <microseconds>" lines)
+local stacks = app.profiler.foldedStacks()
+for line in stacks:gmatch("[^\n]+") do
+  assert(line:match("^.+ %d+$"))
+end
+assert(stacks:find("drawImages %(.-%);ImageObj:drawImage") ~= nil)
+
+app.profiler.reset()
+assert(app.profiler.foldedStacks() == "")
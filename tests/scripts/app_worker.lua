@@ -0,0 +1,74 @@
+-- Copyright (C) 2024  Igara Studio S.A.
+--
+-- This file is released under the terms of the MIT license.
+-- Read LICENSE.txt for more information.
+
+-- Plain values and tables are copied to/from the worker
+do
+  local called = false
+  local worker = app.worker(
+    function(a, t)
+      local sum = 0
+      for _,v in ipairs(t) do sum = sum + v end
+      return a * 2, { sum=sum, name="worker" }
+    end,
+    { 21, { 1, 2, 3 } },
+    function(ok, a, t)
+      called = true
+      assert(ok)
+      assert(a == 42)
+      assert(t.sum == 6)
+    end)
+
+  local ok, a, t = worker:wait()
+  assert(called)
+  assert(ok and a == 42 and t.sum == 6 and t.name == "worker")
+  assert(not worker.isRunning)
+end
+
+-- Images are passed as copies of their pixels
+do
+  local img = Image(2, 2, ColorMode.INDEXED)
+  img:clear(3)
+  local worker = app.worker(
+    function(image)
+      local count = 0
+      for i=1,#image.bytes do
+        if image.bytes:byte(i) == 3 then count = count + 1 end
+      end
+      return image.width, image.height, count
+    end, { img })
+  local ok, w, h, count = worker:wait()
+  assert(ok and w == 2 and h == 2 and count == 4)
+end
+
+-- Errors, upvalues, and code strings
+do
+  local ok, msg = app.worker(function() error("fail") end):wait()
+  assert(not ok)
+  assert(msg:find("fail") ~= nil)
+
+  -- Upvalues are not available in the worker
+  local x = 5
+  local ok2, y = app.worker(function() return x end):wait()
+  assert(ok2 and y == nil)
+
+  -- The worker doesn't have access to the app API or the file system
+  local ok3, hasApp, hasIO = app.worker("return app ~= nil, io ~= nil"):wait()
+  assert(ok3 and hasApp == false and hasIO == false)
+
+  local ok4, n = app.worker("local a, b = ... return a + b", { 1, 2 }):wait()
+  assert(ok4 and n == 3)
+end
+
+-- Functions cannot be passed to workers
+assert(not pcall(function() app.worker(function() end, { print }) end))
+
+-- Cancel a long-running worker
+do
+  local worker = app.worker(function() while true do end end)
+  worker:cancel()
+  local ok, msg = worker:wait()
+  assert(not ok)
+  assert(msg:find("canceled") ~= nil)
+end
@@ -1,4 +1,4 @@
--- Copyright (C) 2018-2022  Igara Studio S.A.
+-- Copyright (C) 2018-2024  Igara Studio S.A.
 --
 -- This file is released under the terms of the MIT license.
 -- Read LICENSE.txt for more information.
@@ -66,6 +66,48 @@ do
    assert(r:getPixel(2, 2) == pc.rgba(255, 255, 0, 255))
 end
 
+-- Renderer
+do
+   local spr = Sprite(2, 2)
+   local cel = spr.cels[1]
+   cel.image:putPixel(0, 0, pc.rgba(255, 0, 0, 255))
+   cel.image:putPixel(1, 1, pc.rgba(0, 0, 255, 255))
+   spr:newFrame()
+   spr.cels[2].image:clear(pc.rgba(0, 255, 0, 255))
+
+   local renderer = Renderer{ zoom=2, cacheGroups=true }
+   assert(renderer.zoom == 2)
+
+   -- Render several frames with the same renderer
+   local r = renderer:renderSprite(spr, 1)
+   assert(r.width == 4 and r.height == 4)
+   assert(r:getPixel(0, 0) == pc.rgba(255, 0, 0, 255))
+   assert(r:getPixel(1, 1) == pc.rgba(255, 0, 0, 255))
+   assert(r:getPixel(2, 0) == pc.rgba(0, 0, 0, 0))
+   assert(r:getPixel(3, 3) == pc.rgba(0, 0, 255, 255))
+
+   r = renderer:renderSprite(spr, 2)
+   assert(r:getPixel(0, 0) == pc.rgba(0, 255, 0, 255))
+   assert(r:getPixel(3, 3) == pc.rgba(0, 255, 0, 255))
+
+   -- Render a region
+   r = renderer:renderSprite(spr, 1, Rectangle(1, 1, 1, 1))
+   assert(r.width == 2 and r.height == 2)
+   assert(r:getPixel(0, 0) == pc.rgba(0, 0, 255, 255))
+
+   -- Draw frames in an atlas with Image:drawSprite()
+   renderer.zoom = 1
+   local atlas = Image(4, 2, spr.colorMode)
+   atlas:drawSprite(spr, 1, 0, 0, renderer)
+   atlas:drawSprite(spr, 2, Point(2, 0), renderer)
+   assert(atlas:getPixel(0, 0) == pc.rgba(255, 0, 0, 255))
+   assert(atlas:getPixel(1, 1) == pc.rgba(0, 0, 255, 255))
+   assert(atlas:getPixel(2, 0) == pc.rgba(0, 255, 0, 255))
+   assert(atlas:getPixel(3, 1) == pc.rgba(0, 255, 0, 255))
+
+   renderer:clearCache()
+end
+
 
 -- Image:drawPixel with indexed color
 do
@@ -62,6 +62,19 @@ do
   img:clear(Rectangle(1, 0, 1, 2), 2)
   expect_img(img, { 1, 2,
                     1, 2 })
+
+  -- Rectangle as plain numbers
+  img:clear(0, 1, 2, 1, 3)
+  expect_img(img, { 1, 2,
+                    3, 3 })
+  img:clear(0, 0, 1, 1)
+  expect_img(img, { 1, 2,
+                    3, 3 })
+
+  local crop = Image(img, 1, 0, 1, 2)
+  assert(crop.width == 1 and crop.height == 2)
+  expect_img(crop, { 2,
+                     3 })
 end
 
 -- Clone
@@ -534,3 +547,107 @@ do
                     2, 3 })
 
 end
+
+-- Image:mapColors(), Image:replaceColor(), and Image:applyLUT()
+do
+  local idx = Image(2, 2, ColorMode.INDEXED)
+  array_to_pixels({ 0, 1,
+                    2, 1 }, idx)
+  idx:mapColors({ [1]=3, [2]=0 })
+  expect_img(idx, { 0, 3,
+                    0, 3 })
+
+  idx:replaceColor(3, 5)
+  expect_img(idx, { 0, 5,
+                    0, 5 })
+
+  local pc = app.pixelColor
+  local a = pc.rgba(10, 20, 30, 255)
+  local b = pc.rgba(40, 50, 60, 128)
+  local rgb = Image(2, 1, ColorMode.RGB)
+  array_to_pixels({ a, b }, rgb)
+
+  rgb:replaceColor(b, a)
+  expect_img(rgb, { a, a })
+
+  rgb:mapColors({ [a]=b })
+  expect_img(rgb, { b, b })
+
+  -- Invert red channel and make all pixels opaque
+  local r, alpha = {}, {}
+  for i=0,255 do
+    r[i] = 255-i
+    alpha[i] = 255
+  end
+  rgb:applyLUT(r, nil, nil, alpha)
+  expect_img(rgb, { pc.rgba(215, 50, 60, 255),
+                    pc.rgba(215, 50, 60, 255) })
+
+  -- Undoable changes in cel images
+  local spr = Sprite(2, 2, ColorMode.INDEXED)
+  local cel = spr.cels[1]
+  cel.image:replaceColor(0, 7)
+  expect_img(cel.image, { 7, 7,
+                          7, 7 })
+  app.undo()
+  expect_img(cel.image, { 0, 0,
+                          0, 0 })
+end
+
+-- Image:bytesView()
+do
+  local img = Image(2, 2, ColorMode.INDEXED)
+  array_to_pixels({ 1, 2,
+                    3, 4 }, img)
+
+  local view = img:bytesView()
+  assert(#view == 4)
+  assert(view:u8(1) == 1)
+  assert(view:u8(4) == 4)
+  assert(view:read(2, 3) == string.char(2, 3))
+
+  view:u8(1, 5)
+  view:write(3, string.char(6, 7))
+  expect_img(img, { 5, 2,
+                    6, 7 })
+
+  -- pack/unpack directly from/to the view
+  assert(view:pack(1, "BB", 8, 9) == 3)
+  local b1, b2, nextPos = view:unpack("BB", 2)
+  assert(b1 == 9 and b2 == 6 and nextPos == 4)
+  assert(view:u32(1) == string.unpack("=I4", img.bytes))
+
+  -- Out of bounds accesses
+  assert(not pcall(function() return view:u8(0) end))
+  assert(not pcall(function() return view:u8(5) end))
+  assert(not pcall(function() return view:u32(2) end))
+
+  -- Copy the pixels of an image to other image without strings
+  local copy = Image(2, 2, ColorMode.INDEXED)
+  copy.bytes = view
+  expect_img(copy, { 8, 9,
+                     6, 7 })
+
+  -- The view is not valid after modifying the image by other means
+  img:putPixel(0, 0, 1)
+  assert(not pcall(function() return view:u8(1) end))
+  assert(img:bytesView():u8(1) == 1)
+end
+
+-- Point/Rectangle arguments as plain numbers
+do
+  local a = Image(2, 1, ColorMode.INDEXED)
+  a:putPixel(0, 0, 1)
+  a:putPixel(1, 0, 2)
+
+  local b = Image(3, 2, ColorMode.INDEXED)
+  b:drawImage(a, 1, 1)
+  expect_img(b, { 0, 0, 0,
+                  0, 1, 2 })
+
+  -- Opacity/blend mode after x, y numbers
+  b:clear()
+  b:drawImage(a, 0, 0, 255, BlendMode.SRC)
+  expect_img(b, { 1, 2, 0,
+                  0, 0, 0 })
+end
@@ -1,4 +1,4 @@
--- Copyright (C) 2019-2023  Igara Studio S.A.
+-- Copyright (C) 2019-2024  Igara Studio S.A.
 -- Copyright (C) 2018  David Capello
 --
 -- This file is released under the terms of the MIT license.
@@ -228,3 +228,37 @@ do
   c = app.open(fn)
   assert(c.tileManagementPlugin == nil)
 end
+
+-- Memory usage
+do
+  local a = Sprite(32, 64)
+  local m = a.memory
+  assert(m.images >= 32*64*4)
+  assert(m.compressedImages == 0)
+  assert(m.mappedImages == 0)
+  assert(m.tilesets == 0)
+  assert(m.total == m.images + m.compressedImages + m.tilesets + m.undo)
+end
+
+-- Compare sprites
+do
+  local a = Sprite(32, 16)
+  local b = Sprite(32, 16)
+  local d = a:compare(b)
+  assert(not d.anything)
+
+  b.cels[1].image:drawPixel(1, 2, Color(255, 0, 0))
+  d = a:compare(b)
+  assert(d.anything)
+  assert(d.images)
+  assert(not d.canvas)
+  assert(not d.layers)
+
+  a.cels[1].image:drawPixel(1, 2, Color(255, 0, 0))
+  assert(not a:compare(b).anything)
+
+  b.width = 64
+  d = a:compare(b)
+  assert(d.anything)
+  assert(d.canvas)
+end
@@ -1,4 +1,4 @@
--- Copyright (C) 2019-2023  Igara Studio S.A.
+-- Copyright (C) 2019-2024  Igara Studio S.A.
 --
 -- This file is released under the terms of the MIT license.
 -- Read LICENSE.txt for more information.
@@ -579,6 +579,39 @@ do
   assert(i:getPixel(8, 7) ~= 0)
 end
 
+----------------------------------------------------------------------
+-- Convert a big layer with repeated tiles to a tilemap (tiles are
+-- found/deduplicated in batches using several threads)
+----------------------------------------------------------------------
+
+do
+  local spr = Sprite(320, 320, ColorMode.INDEXED)
+  spr.gridBounds = Rectangle(0, 0, 4, 4)
+  local img = spr.cels[1].image
+  for y=0,319 do
+    for x=0,319 do
+      local u, v = x//4, y//4
+      img:drawPixel(x, y, (u+2*v) % 5)
+    end
+  end
+
+  app.command.ConvertLayer{ to="tilemap" }
+  local lay = spr.layers[1]
+  assert(lay.isTilemap)
+  expect_eq(5, #lay.tileset)
+
+  local map = lay.cels[1].image
+  expect_eq(80, map.width)
+  expect_eq(80, map.height)
+  for v=0,79 do
+    for u=0,79 do
+      if map:getPixel(u, v) ~= (u+2*v) % 5 then
+        expect_eq((u+2*v) % 5, map:getPixel(u, v))
+      end
+    end
+  end
+end
+
 -----------------------------------------------------------------------
 -- Test CanvasSize with tilemaps when we trim out content
 -----------------------------------------------------------------------
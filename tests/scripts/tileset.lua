@@ -1,4 +1,4 @@
--- Copyright (C) 2022-2023  Igara Studio S.A.
+-- Copyright (C) 2022-2024  Igara Studio S.A.
 --
 -- This file is released under the terms of the MIT license.
 -- Read LICENSE.txt for more information.
@@ -49,6 +49,11 @@ do
   for ti=0,2 do
     assert(tileset:tile(ti).image.id == tileset:getTile(ti).id)
   end
+
+  -- The only tilemap cell uses the last tile
+  assert(tileset:tile(0).useCount == 0)
+  assert(tileset:tile(1).useCount == 0)
+  assert(tileset:tile(2).useCount == 1)
 end
 
 -- Check undo/redo of name and baseIndex changes